@@ -0,0 +1,6 @@
+// Calls to variadic built-in functions - Array.push receives its arguments directly, without an arguments array
+var a = [];
+for (var i=0;i<1000;i++) {
+  a.push(i, i+1);
+  if (a.length>50) a = [];
+}
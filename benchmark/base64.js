@@ -0,0 +1,9 @@
+// Base64 encode and decode a 3kB binary buffer
+var data = new Uint8Array(3000);
+data.fill(0x5A);
+var n = 0;
+for (var i=0;i<200;i++) {
+  var s = btoa(data);
+  n += atob(s).length;
+}
+print(n);
@@ -0,0 +1,14 @@
+// Create lots of closures inside nested function calls
+function outer() {
+  var total = 0;
+  function inner(n) {
+    var fns = [];
+    for (var i=0;i<n;i++) fns.push(function(x) { total += x; });
+    fns.forEach(function(f,i) { f(i); });
+    return process.memory().usage;
+  }
+  var m = 0;
+  for (var j=0;j<20;j++) m = Math.max(m, inner(100));
+  return total + " " + m;
+}
+print(outer());
@@ -0,0 +1,9 @@
+// Parsing multi-byte fields from a binary frame - each DataView get is a single native call
+var frame = new Uint8Array(64);
+for (var i=0;i<64;i++) frame[i] = i*7;
+var d = new DataView(frame.buffer);
+var s = 0;
+for (var i=0;i<1000;i++) {
+  var o = i&31;
+  s += d.getUint16(o) + d.getInt32(o, true);
+}
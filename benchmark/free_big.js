@@ -0,0 +1,9 @@
+// Build and then drop a big nested structure, over and over
+var n = 0;
+for (var j=0;j<20;j++) {
+  var list = undefined;
+  for (var i=0;i<500;i++) list = {v:i, next:list, arr:[i,i]};
+  n += list.v;
+  list = undefined;
+}
+print(n);
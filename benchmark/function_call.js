@@ -0,0 +1,6 @@
+// Calls to small helper functions - dominated by setting up and tearing
+// down each call's scope, parameters and return value
+function add(a, b) { return a + b; }
+function clamp(x) { if (x>100) return 100; return x; }
+var s = 0;
+for (var i=0;i<2000;i++) s = clamp(add(s, i&7));
@@ -0,0 +1,10 @@
+// Property reads/writes and object walks - dominated by jsvLock/jsvUnLock
+// and following refs, so this shows the cost of the packed JsVar layout
+var o = {a:1, b:2, c:3, d:4};
+var list = [];
+for (var i=0;i<20;i++) list.push({n:i});
+for (var j=0;j<300;j++) {
+  o.a = o.b + o.c;
+  o.d = o.a - o.b;
+  for (var k in list) list[k].n++;
+}
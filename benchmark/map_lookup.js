@@ -0,0 +1,8 @@
+// Lookups in a Map with a few hundred entries - the hash table means this doesn't walk the entries
+var m = new Map();
+for (var i=0;i<300;i++) m.set("dev"+i, i);
+var s = 0;
+for (var i=0;i<1000;i++) {
+  s += m.get("dev"+(i%300));
+  if (m.has(i)) s++;
+}
@@ -0,0 +1,6 @@
+// Calls to built-in functions - dominated by jsnCallFunction's argument marshalling
+var s = 0;
+for (var i=0;i<1000;i++) {
+  s += Math.sin(i) + Math.abs(-i) + Math.pow(i, 2);
+  s += getTime()&1;
+}
@@ -0,0 +1,10 @@
+// Mapping arrays with built-in functions - these are now called directly rather than through jspeFunctionCall
+var a = new Float32Array(200);
+for (var i=0;i<200;i++) a[i] = i-100;
+var b = [];
+for (var i=0;i<200;i++) b.push(i-100);
+for (var i=0;i<20;i++) {
+  a.map(Math.abs);
+  b.map(Math.abs);
+  b.forEach(E.clip);
+}
@@ -0,0 +1,10 @@
+// Object.keys/values and for..in over a 100 key object
+var o = {};
+for (var i=0;i<100;i++) o["key"+i] = i;
+var n = 0;
+for (var j=0;j<20;j++) {
+  n += Object.keys(o).length;
+  n += Object.values(o).length;
+  for (var k in o) n++;
+}
+print(n);
@@ -0,0 +1,7 @@
+// Keeping a running mean of the last 100 samples - a RingBuffer avoids Array.shift and the JS sum loop
+var h = E.RingBuffer(Float32Array, 100);
+var m = 0;
+for (var i=0;i<1000;i++) {
+  h.push(Math.sin(i));
+  m = E.sum(h) / h.length;
+}
@@ -0,0 +1,7 @@
+// Get the length of some long strings over and over
+var a = "", b = "";
+for (var i=0;i<300;i++) { a += "abcdefghij"; b += "0123456789"; }
+a = a.substr(1); b = b.substr(1);
+var n = 0;
+for (var i=0;i<2000;i++) n += a.length + b.length;
+print(n);
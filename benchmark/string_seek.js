@@ -0,0 +1,7 @@
+// Read every character of a long string built up a piece at a time
+var s = "";
+for (var i=0;i<200;i++) s += "The quick brown fox ";
+var n = 0;
+for (var i=0;i<s.length;i++) n += s.charCodeAt(i);
+for (var i=0;i<s.length;i+=7) n += s[i].length + s.indexOf("fox", i);
+print(n);
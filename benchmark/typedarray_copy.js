@@ -0,0 +1,10 @@
+// Assembling packets from a header string and a payload - set/slice/fill copy whole blocks
+var payload = new Uint8Array(200);
+for (var i=0;i<200;i++) payload[i] = i;
+var pkt = new Uint8Array(256);
+for (var i=0;i<200;i++) {
+  pkt.fill(0);
+  pkt.set("HDR:", 0);
+  pkt.set(payload, 4);
+  var out = pkt.slice(0, 204);
+}
@@ -19,7 +19,8 @@ info = {
  'espruino_page_link' : 'EspruinoESP8266',
  'default_console' : "EV_SERIAL1",
  'default_console_baudrate' : "115200",
- 'variables'       : 1700,
+ 'variables'       : 3000, # the most we can have - the actual number is decided at boot
+ 'variables_heap_reserve' : 12000, # bytes of heap to leave free for networking when allocating variables
  'binary_name'     : 'espruino_%v_esp8266',
  'build' : {
    'defines' : [
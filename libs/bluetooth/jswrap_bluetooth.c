@@ -97,6 +97,9 @@
 
 static ble_nus_t                        m_nus;                                      /**< Structure to identify the Nordic UART Service. */
 static uint16_t                         m_conn_handle = BLE_CONN_HANDLE_INVALID;    /**< Handle of the current connection. */
+static uint8_t                          m_tx_packets_max;                           /**< Application TX packets the SoftDevice guarantees us on m_conn_handle */
+static volatile uint8_t                 m_tx_packets_sent;                          /**< Packets we've given the SoftDevice on m_conn_handle (wraps around) */
+static volatile uint8_t                 m_tx_packets_done;                          /**< Packets BLE_EVT_TX_COMPLETE says were sent on m_conn_handle (wraps around) */
 #if CENTRAL_LINK_COUNT>0
 static uint16_t                         m_central_conn_handle = BLE_CONN_HANDLE_INVALID; /**< Handle for central mode connection */
 #endif
@@ -111,7 +114,7 @@ static dm_application_instance_t        m_app_handle;
 
 typedef enum  {
   BLE_NONE = 0,
-  BLE_IS_SENDING = 1,
+  BLE_IS_SENDING = 1, ///< We're handing packets to the SoftDevice (so an IRQ shouldn't too)
   BLE_IS_SCANNING = 2,
 } BLEStatus;
 
@@ -119,15 +122,20 @@ static volatile BLEStatus bleStatus;
 
 #define BLE_SCAN_EVENT                  JS_EVENT_PREFIX"blescan"
 #define BLE_WRITE_EVENT                 JS_EVENT_PREFIX"blew"
+#define BLE_HANDLES_NAME                "bleHndl" ///< Object mapping service+characteristic UUIDs to value handles (in hiddenRoot)
+#define BLE_NOTIFY_QUEUE_NAME           "bleNtfy" ///< Array of notifications waiting for a free TX packet (in hiddenRoot)
+#define BLE_NOTIFY_MAX_LEN              (GATT_MTU_SIZE_DEFAULT-3) ///< Most data a notification can carry
 
 bool jswrap_nrf_transmit_string();
+static bool ble_send_notifications();
 
 /*JSON{
   "type" : "idle",
   "generate" : "jswrap_nrf_idle"
 }*/
 bool jswrap_nrf_idle() {
-  return jswrap_nrf_transmit_string()>0; // return true if we sent anything
+  bool sent = ble_send_notifications();
+  return jswrap_nrf_transmit_string() || sent; // return true if we sent anything
 }
 
 /*JSON{
@@ -319,25 +327,85 @@ static void nus_data_handler(ble_nus_t * p_nus, uint8_t * p_data, uint16_t lengt
     }
 }
 
+/// How many more packets we can give the SoftDevice before we have to wait for BLE_EVT_TX_COMPLETE
+static uint8_t ble_tx_packets_free() {
+  uint8_t inFlight = (uint8_t)(m_tx_packets_sent - m_tx_packets_done);
+  return (inFlight < m_tx_packets_max) ? (uint8_t)(m_tx_packets_max - inFlight) : 0;
+}
+
+/* Fill as many of the SoftDevice's TX packets as we can, so several go out
+ * in each connection event rather than one per BLE_EVT_TX_COMPLETE. This is
+ * also called from the BLE_EVT_TX_COMPLETE IRQ, so uses BLE_IS_SENDING to
+ * make sure it's never run while ble_send_notifications is. */
 bool jswrap_nrf_transmit_string() {
   if (m_conn_handle == BLE_CONN_HANDLE_INVALID) {
     // If no connection, drain the output buffer
     while (jshGetCharToTransmit(EV_BLUETOOTH)>=0);
   }
   if (bleStatus & BLE_IS_SENDING) return false;
+  bleStatus |= BLE_IS_SENDING;
   static uint8_t buf[BLE_NUS_MAX_DATA_LEN];
-  int idx = 0;
-  int ch = jshGetCharToTransmit(EV_BLUETOOTH);
-  while (ch>=0) {
-    buf[idx++] = ch;
-    if (idx>=BLE_NUS_MAX_DATA_LEN) break;
-    ch = jshGetCharToTransmit(EV_BLUETOOTH);
+  bool sent = false;
+  while (ble_tx_packets_free()) {
+    int idx = 0;
+    int ch = jshGetCharToTransmit(EV_BLUETOOTH);
+    while (ch>=0) {
+      buf[idx++] = ch;
+      if (idx>=BLE_NUS_MAX_DATA_LEN) break;
+      ch = jshGetCharToTransmit(EV_BLUETOOTH);
+    }
+    if (!idx) break;
+    sent = true;
+    if (ble_nus_string_send(&m_nus, buf, idx) != NRF_SUCCESS)
+      break; // not connected/notifications not enabled - the data is lost, as before
+    m_tx_packets_sent++;
+  }
+  bleStatus &= ~BLE_IS_SENDING;
+  return sent;
+}
+
+/* Send notifications queued by NRF.updateServices, while the SoftDevice has
+ * TX packets free. Each item in the queue is a string - the 16 bit value
+ * handle (little endian) followed by the data. Only called from idle/JS. */
+static bool ble_send_notifications() {
+  JsVar *queue = jsvObjectGetChild(execInfo.hiddenRoot, BLE_NOTIFY_QUEUE_NAME, 0);
+  if (!queue) return false;
+  if (m_conn_handle == BLE_CONN_HANDLE_INVALID) {
+    // nobody to send them to
+    jsvUnLock(queue);
+    jsvObjectSetChild(execInfo.hiddenRoot, BLE_NOTIFY_QUEUE_NAME, 0);
+    return false;
+  }
+  if (bleStatus & BLE_IS_SENDING) {
+    jsvUnLock(queue);
+    return false;
   }
-  if (idx>0) {
-    if (ble_nus_string_send(&m_nus, buf, idx) == NRF_SUCCESS)
-      bleStatus |= BLE_IS_SENDING;
+  bleStatus |= BLE_IS_SENDING;
+  bool sent = false;
+  uint8_t buf[2+BLE_NOTIFY_MAX_LEN+1]; // +1 as jsvGetStringChars adds a trailing 0
+  while (ble_tx_packets_free()) {
+    JsVar *item = jsvSkipNameAndUnLock(jsvArrayPopFirst(queue));
+    if (!item) break;
+    size_t len = jsvGetStringChars(item, 0, (char*)buf, 2+BLE_NOTIFY_MAX_LEN);
+    jsvUnLock(item);
+    if (len<2) continue;
+    uint16_t dataLen = (uint16_t)(len-2);
+    ble_gatts_hvx_params_t hvx_params;
+    memset(&hvx_params, 0, sizeof(hvx_params));
+    hvx_params.handle = (uint16_t)(buf[0] | (buf[1]<<8));
+    hvx_params.p_data = &buf[2];
+    hvx_params.p_len  = &dataLen;
+    hvx_params.type   = BLE_GATT_HVX_NOTIFICATION;
+    // if notifications aren't enabled for this characteristic, just drop it
+    if (sd_ble_gatts_hvx(m_conn_handle, &hvx_params) == NRF_SUCCESS)
+      m_tx_packets_sent++;
+    sent = true;
   }
-  return idx>0;
+  bleStatus &= ~BLE_IS_SENDING;
+  bool empty = !jsvGetFirstChild(queue);
+  jsvUnLock(queue);
+  if (empty) jsvObjectSetChild(execInfo.hiddenRoot, BLE_NOTIFY_QUEUE_NAME, 0);
+  return sent;
 }
 /**@snippet [Handling the data received over BLE] */
 
@@ -551,6 +619,11 @@ void jswrap_nrf_bluetooth_startAdvertise(void) {
   APP_ERROR_CHECK(err_code);
 }
 
+/// Get the name we store a characteristic's value handle under in BLE_HANDLES_NAME (handleName should be 20 chars long)
+static void ble_uuids_to_handle_name(char *handleName, ble_uuid_t *service, ble_uuid_t *characteristic) {
+  espruino_snprintf(handleName, 20, "%x:%x/%x:%x", service->type, service->uuid, characteristic->type, characteristic->uuid);
+}
+
 /// Get the correct event name for a BLE write event to a characteristic (eventName should be 12 chars long)
 void ble_handle_to_write_event_name(char *eventName, uint16_t handle) {
   strcpy(eventName, BLE_WRITE_EVENT);
@@ -575,7 +648,11 @@ static void on_ble_evt(ble_evt_t * p_ble_evt)
       case BLE_GAP_EVT_CONNECTED:
         if (p_ble_evt->evt.gap_evt.params.connected.role == BLE_GAP_ROLE_PERIPH) {
           m_conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
-          bleStatus &= ~BLE_IS_SENDING; // reset state - just in case
+          // find out how many packets we can queue up in each connection event
+          if (sd_ble_tx_packet_count_get(m_conn_handle, &m_tx_packets_max) != NRF_SUCCESS)
+            m_tx_packets_max = 1;
+          m_tx_packets_sent = 0;
+          m_tx_packets_done = 0;
           if (!jsiIsConsoleDeviceForced()) jsiSetConsoleDevice(EV_BLUETOOTH, false);
         }
 #if CENTRAL_LINK_COUNT>0
@@ -595,6 +672,7 @@ static void on_ble_evt(ble_evt_t * p_ble_evt)
         }
 #endif
         m_conn_handle = BLE_CONN_HANDLE_INVALID;
+        m_tx_packets_max = 0;
         if (!jsiIsConsoleDeviceForced()) jsiSetConsoleDevice(DEFAULT_CONSOLE_DEVICE, 0);
         // restart advertising after disconnection
         jswrap_nrf_bluetooth_startAdvertise();
@@ -607,8 +685,9 @@ static void on_ble_evt(ble_evt_t * p_ble_evt)
         break;
 
       case BLE_EVT_TX_COMPLETE:
-        // UART Transmit finished - we can try and send more data
-        bleStatus &= ~BLE_IS_SENDING;
+        // Packets sent - we can try and send more UART data (notifications go from idle)
+        if (p_ble_evt->evt.common_evt.conn_handle == m_conn_handle)
+          m_tx_packets_done += p_ble_evt->evt.common_evt.params.tx_complete.count;
         jswrap_nrf_transmit_string();
         break;
 
@@ -1119,6 +1198,7 @@ NRF.setServices({
       broadcast : false, // optional, default is false
       readable : true,   // optional, default is false
       writable : true,   // optional, default is false
+      notify : true,     // optional, default is false
       onWrite : function(evt) { // optional
         console.log("Got ", evt.data);
       }
@@ -1131,6 +1211,9 @@ NRF.setServices({
 
 **Note:** UUIDs can be integers between `0` and `0xFFFF`, strings of
 the form `"0xABCD"`, or strings of the form `""ABCDABCD-ABCD-ABCD-ABCD-ABCDABCDABCD""`
+
+To change a characteristic's value (and notify a connected device of it)
+afterwards, use `NRF.updateServices`.
 */
 void jswrap_nrf_bluetooth_setServices(JsVar *data) {
   uint32_t err_code;
@@ -1190,6 +1273,16 @@ void jswrap_nrf_bluetooth_setServices(JsVar *data) {
         char_md.p_user_desc_md           = NULL;
         char_md.p_cccd_md                = NULL;
         char_md.p_sccd_md                = NULL;
+        // The CCCD is how the other device turns notifications on
+        ble_gatts_attr_md_t cccd_md;
+        if (jsvGetBoolAndUnLock(jsvObjectGetChild(charVar, "notify", 0))) {
+          char_md.char_props.notify = 1;
+          memset(&cccd_md, 0, sizeof(cccd_md));
+          BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.read_perm);
+          BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.write_perm);
+          cccd_md.vloc = BLE_GATTS_VLOC_STACK;
+          char_md.p_cccd_md = &cccd_md;
+        }
 
         memset(&attr_md, 0, sizeof(attr_md));
         BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
@@ -1231,6 +1324,15 @@ void jswrap_nrf_bluetooth_setServices(JsVar *data) {
           break;
         }
 
+        // Remember the handle so NRF.updateServices can find it
+        JsVar *handles = jsvObjectGetChild(execInfo.hiddenRoot, BLE_HANDLES_NAME, JSV_OBJECT);
+        if (handles) {
+          char handleName[20];
+          ble_uuids_to_handle_name(handleName, &ble_uuid, &char_uuid);
+          jsvObjectSetChildAndUnLock(handles, handleName, jsvNewFromInteger(characteristic_handles.value_handle));
+          jsvUnLock(handles);
+        }
+
         // Add Write callback
         JsVar *writeCb = jsvObjectGetChild(charVar, "onWrite", 0);
         if (writeCb) {
@@ -1240,20 +1342,6 @@ void jswrap_nrf_bluetooth_setServices(JsVar *data) {
         }
 
         jsvUnLock(charVar);
-        /* We'd update the characteristic with:
-
-    memset(&hvx_params, 0, sizeof(hvx_params));
-    hvx_params.handle = characteristic_handle.value_handle;
-    hvx_params.p_data = p_string;
-    hvx_params.p_len  = &length;
-    hvx_params.type   = BLE_GATT_HVX_NOTIFICATION;
-    return sd_ble_gatts_hvx(p_nus->conn_handle, &hvx_params);
-
-    Maybe we could find the handle out based on characteristic UUID, rather than having
-    to store it?
-
-    */
-
         jsvObjectIteratorNext(&serviceit);
       }
       jsvObjectIteratorFree(&serviceit);
@@ -1271,6 +1359,170 @@ void jswrap_nrf_bluetooth_setServices(JsVar *data) {
 }
 
 
+/*JSON{
+    "type" : "staticmethod",
+    "class" : "NRF",
+    "name" : "updateServices",
+    "generate" : "jswrap_nrf_bluetooth_updateServices",
+    "params" : [
+      ["data","JsVar","The service (and characteristics) to update"]
+    ]
+}
+Update values for the services and characteristics that were created with
+`NRF.setServices`, and optionally notify the connected device.
+
+```
+NRF.updateServices({
+  0xBCDE : {
+    0xABCD : {
+      value : "World",
+      notify : true // optional, default is false
+    }
+  }
+});
+```
+
+Notifications are sent as soon as the Bluetooth stack has a free transmit
+buffer, so several can be sent in each connection event - calling this many
+times in a row (for instance to stream sensor readings) queues notifications
+rather than waiting for each one to be sent. Only the first 20 bytes of a value
+are sent in a notification.
+
+**Note:** the characteristic must have been created with `notify:true`, and the
+connected device must have enabled notifications on it. If not, notifications
+are silently dropped.
+*/
+void jswrap_nrf_bluetooth_updateServices(JsVar *data) {
+  uint32_t err_code;
+  if (!jsvIsObject(data)) {
+    if (!jsvIsUndefined(data))
+      jsExceptionHere(JSET_TYPEERROR, "Expecting object or undefined, got %t", data);
+    return;
+  }
+  JsVar *handles = jsvObjectGetChild(execInfo.hiddenRoot, BLE_HANDLES_NAME, 0);
+  bool shouldNotify = false;
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, data);
+  while (jsvObjectIteratorHasValue(&it)) {
+    ble_uuid_t ble_uuid;
+    if (!bleVarToUUIDAndUnLock(&ble_uuid, jsvObjectIteratorGetKey(&it))) {
+      jsExceptionHere(JSET_ERROR, "Invalid Service UUID");
+      break;
+    }
+    JsVar *serviceVar = jsvObjectIteratorGetValue(&it);
+    JsvObjectIterator serviceit;
+    jsvObjectIteratorNew(&serviceit, serviceVar);
+    while (jsvObjectIteratorHasValue(&serviceit)) {
+      ble_uuid_t char_uuid;
+      if (!bleVarToUUIDAndUnLock(&char_uuid, jsvObjectIteratorGetKey(&serviceit))) {
+        jsExceptionHere(JSET_ERROR, "Invalid Characteristic UUID");
+        break;
+      }
+      char handleName[20];
+      ble_uuids_to_handle_name(handleName, &ble_uuid, &char_uuid);
+      JsVar *handleVar = handles ? jsvObjectGetChild(handles, handleName, 0) : 0;
+      if (!handleVar) {
+        jsExceptionHere(JSET_ERROR, "Characteristic not found - was it added with NRF.setServices?");
+        break;
+      }
+      uint16_t handle = (uint16_t)jsvGetIntegerAndUnLock(handleVar);
+      JsVar *charVar = jsvObjectIteratorGetValue(&serviceit);
+      JsVar *charValue = jsvObjectGetChild(charVar, "value", 0);
+      bool notify = jsvGetBoolAndUnLock(jsvObjectGetChild(charVar, "notify", 0));
+      jsvUnLock(charVar);
+      if (charValue) {
+        JSV_GET_AS_CHAR_ARRAY(vPtr, vLen, charValue);
+        if (vPtr) {
+          ble_gatts_value_t gatts_value;
+          memset(&gatts_value, 0, sizeof(gatts_value));
+          gatts_value.len = (uint16_t)vLen;
+          gatts_value.offset = 0;
+          gatts_value.p_value = (uint8_t*)vPtr;
+          err_code = sd_ble_gatts_value_set(BLE_CONN_HANDLE_INVALID, handle, &gatts_value);
+          if (err_code) {
+            jsvUnLock(charValue);
+            jsExceptionHere(JSET_ERROR, "Got BLE error code %d in gatts_value_set", err_code);
+            break;
+          }
+          if (notify && m_conn_handle != BLE_CONN_HANDLE_INVALID) {
+            // queue [handle_lo, handle_hi, data...] for ble_send_notifications
+            if (vLen > BLE_NOTIFY_MAX_LEN) vLen = BLE_NOTIFY_MAX_LEN;
+            char buf[2+BLE_NOTIFY_MAX_LEN];
+            buf[0] = (char)(handle&0xFF);
+            buf[1] = (char)(handle>>8);
+            memcpy(&buf[2], vPtr, vLen);
+            JsVar *queue = jsvObjectGetChild(execInfo.hiddenRoot, BLE_NOTIFY_QUEUE_NAME, JSV_ARRAY);
+            JsVar *item = jsvNewStringOfLength((unsigned int)vLen+2);
+            if (queue && item) {
+              jsvSetString(item, buf, vLen+2);
+              jsvArrayPush(queue, item);
+            }
+            jsvUnLock2(queue, item);
+            shouldNotify = true;
+          }
+        }
+        jsvUnLock(charValue); // unlock here in case we were storing data in a flat string
+      }
+      jsvObjectIteratorNext(&serviceit);
+    }
+    jsvObjectIteratorFree(&serviceit);
+    jsvUnLock(serviceVar);
+    jsvObjectIteratorNext(&it);
+  }
+  jsvObjectIteratorFree(&it);
+  jsvUnLock(handles);
+  // send what we can right away
+  if (shouldNotify) ble_send_notifications();
+}
+
+/*JSON{
+    "type" : "staticmethod",
+    "class" : "NRF",
+    "name" : "setConnectionInterval",
+    "generate" : "jswrap_nrf_bluetooth_setConnectionInterval",
+    "params" : [
+      ["interval","JsVar","The connection interval in milliseconds, `{minInterval:ms, maxInterval:ms}`, or `undefined` for the default"]
+    ]
+}
+Set the connection interval that Espruino asks for when a device is
+connected to it (7.5ms to 4000ms). If a device is connected now, the
+new interval is requested immediately.
+
+A short interval gives more connection events per second, so more data can be
+streamed (several notifications are sent in each event), at the cost of
+power consumption. The default is between 7.5ms and 20ms.
+
+**Note:** the connected device decides what interval is actually used. If it
+won't accept the requested interval after a few attempts, it is disconnected.
+*/
+void jswrap_nrf_bluetooth_setConnectionInterval(JsVar *interval) {
+  JsVarFloat minInterval = 7.5, maxInterval = 20;
+  if (jsvIsNumeric(interval)) {
+    minInterval = maxInterval = jsvGetFloat(interval);
+  } else if (jsvIsObject(interval)) {
+    minInterval = jsvGetFloatAndUnLock(jsvObjectGetChild(interval, "minInterval", 0));
+    maxInterval = jsvGetFloatAndUnLock(jsvObjectGetChild(interval, "maxInterval", 0));
+  } else if (!jsvIsUndefined(interval)) {
+    jsExceptionHere(JSET_TYPEERROR, "Expecting number, object or undefined, got %t", interval);
+    return;
+  }
+  if (!(minInterval>=7.5 && maxInterval<=4000 && minInterval<=maxInterval)) {
+    jsExceptionHere(JSET_ERROR, "Interval must be between 7.5 and 4000ms");
+    return;
+  }
+  ble_gap_conn_params_t gap_conn_params;
+  memset(&gap_conn_params, 0, sizeof(gap_conn_params));
+  gap_conn_params.min_conn_interval = (uint16_t)MSEC_TO_UNITS(minInterval, UNIT_1_25_MS);
+  gap_conn_params.max_conn_interval = (uint16_t)MSEC_TO_UNITS(maxInterval, UNIT_1_25_MS);
+  gap_conn_params.slave_latency     = SLAVE_LATENCY;
+  gap_conn_params.conn_sup_timeout  = CONN_SUP_TIMEOUT;
+  // sets the preferred parameters, and starts a negotiation if we're connected
+  uint32_t err_code = ble_conn_params_change_conn_params(&gap_conn_params);
+  if (err_code == BLE_ERROR_INVALID_CONN_HANDLE) err_code = NRF_SUCCESS; // not connected
+  if (err_code)
+    jsExceptionHere(JSET_ERROR, "Got BLE error code %d", err_code);
+}
+
 /*JSON{
     "type" : "staticmethod",
     "class" : "NRF",
@@ -23,6 +23,8 @@ void jswrap_nrf_bluetooth_wake(void);
 JsVarFloat jswrap_nrf_bluetooth_getBattery(void);
 void jswrap_nrf_bluetooth_setAdvertising(JsVar *data);
 void jswrap_nrf_bluetooth_setServices(JsVar *data);
+void jswrap_nrf_bluetooth_updateServices(JsVar *data);
+void jswrap_nrf_bluetooth_setConnectionInterval(JsVar *interval);
 void jswrap_nrf_bluetooth_setScan(JsVar *callback);
 void jswrap_nrf_bluetooth_setTxPower(JsVarInt pwr);
 
@@ -21,11 +21,34 @@
 
 #define BUFFERSIZE 128
 
+#define WINDOWSIZE (1<<HEATSHRINK_STATIC_WINDOW_BITS)
+
+/* A dictionary is put at the end of the window, as if it had just been
+ * compressed/decompressed. Both start with an all-zero window, and a back
+ * reference of N bytes means the same thing to each, so all that matters is
+ * that the dictionary ends up the same distance back in both. */
+static void heatshrink_dict_copy(uint8_t *window, const unsigned char *dict, size_t dictLen) {
+  if (dictLen > WINDOWSIZE) {
+    dict += dictLen-WINDOWSIZE;
+    dictLen = WINDOWSIZE;
+  }
+  size_t i;
+  for (i=0;i<dictLen;i++)
+    window[WINDOWSIZE-dictLen+i] = READ_FLASH_UINT8(&dict[i]);
+}
+
 /** gets data from array, writes to callback */
 void heatshrink_encode(unsigned char *data, size_t dataLen, void (*callback)(unsigned char ch, uint32_t *cbdata), uint32_t *cbdata) {
+  heatshrink_encode_dict(data, dataLen, 0, 0, callback, cbdata);
+}
+
+/** gets data from array, writes to callback. The window starts off containing dict */
+void heatshrink_encode_dict(unsigned char *data, size_t dataLen, const unsigned char *dict, size_t dictLen, void (*callback)(unsigned char ch, uint32_t *cbdata), uint32_t *cbdata) {
   heatshrink_encoder hse;
   uint8_t outBuf[BUFFERSIZE];
   heatshrink_encoder_reset(&hse);
+  // the encoder's buffer is the window followed by the input
+  if (dict) heatshrink_dict_copy(hse.buffer, dict, dictLen);
 
   size_t i;
   size_t count = 0;
@@ -56,9 +79,16 @@ void heatshrink_encode(unsigned char *data, size_t dataLen, void (*callback)(uns
 
 /** gets data from callback, writes it into array */
 void heatshrink_decode(int (*callback)(uint32_t *cbdata), uint32_t *cbdata, unsigned char *data) {
+  heatshrink_decode_dict(callback, cbdata, 0, 0, data);
+}
+
+/** gets data from callback, writes it into array. dict must be the same as was given to heatshrink_encode_dict */
+void heatshrink_decode_dict(int (*callback)(uint32_t *cbdata), uint32_t *cbdata, const unsigned char *dict, size_t dictLen, unsigned char *data) {
   heatshrink_decoder hsd;
   uint8_t inBuf[BUFFERSIZE];
   heatshrink_decoder_reset(&hsd);
+  // the decoder's buffer is the input followed by the window (a circular buffer that starts at 0)
+  if (dict) heatshrink_dict_copy(&hsd.buffers[HEATSHRINK_DECODER_INPUT_BUFFER_SIZE(&hsd)], dict, dictLen);
 
   size_t count = 0;
   size_t sunk = 0;
@@ -99,3 +129,37 @@ void heatshrink_decode(int (*callback)(uint32_t *cbdata), uint32_t *cbdata, unsi
     }
   }
 }
+
+/** start decoding data from callback */
+void heatshrink_stream_init(heatshrink_stream *hs, int (*callback)(uint32_t *cbdata), uint32_t *cbdata) {
+  heatshrink_decoder_reset(&hs->hsd);
+  hs->callback = callback;
+  hs->cbdata = cbdata;
+  hs->inputDone = false;
+  hs->outPos = 0;
+  hs->outCount = 0;
+}
+
+/** return the next decoded byte, or -1 when there is no more data */
+int heatshrink_stream_read(heatshrink_stream *hs) {
+  while (hs->outPos >= hs->outCount) {
+    size_t count = 0;
+    HSD_poll_res pres = heatshrink_decoder_poll(&hs->hsd, hs->outBuf, sizeof(hs->outBuf), &count);
+    if (pres < 0) return -1;
+    hs->outPos = 0;
+    hs->outCount = (uint8_t)count;
+    if (count) break;
+    // decoder is empty - feed it another byte, or tell it we're done
+    if (hs->inputDone) return -1;
+    int ch = hs->callback(hs->cbdata);
+    if (ch < 0) {
+      hs->inputDone = true;
+      if (heatshrink_decoder_finish(&hs->hsd) == HSDR_FINISH_DONE)
+        return -1;
+    } else {
+      uint8_t b = (uint8_t)ch;
+      heatshrink_decoder_sink(&hs->hsd, &b, 1, &count);
+    }
+  }
+  return hs->outBuf[hs->outPos++];
+}
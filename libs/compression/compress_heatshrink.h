@@ -17,3 +17,29 @@ void heatshrink_encode(unsigned char *data, size_t dataLen, void (*callback)(uns
 
 /** gets data from callback, writes it into array */
 void heatshrink_decode(int (*callback)(uint32_t *cbdata), uint32_t *cbdata, unsigned char *data);
+
+/** As heatshrink_encode, but with the window primed with a dictionary of data that's likely to
+ * appear (only the last 2^HEATSHRINK_STATIC_WINDOW_BITS bytes are used). It must be decoded
+ * with heatshrink_decode_dict and the same dictionary */
+void heatshrink_encode_dict(unsigned char *data, size_t dataLen, const unsigned char *dict, size_t dictLen, void (*callback)(unsigned char ch, uint32_t *cbdata), uint32_t *cbdata);
+
+/** As heatshrink_decode, for data from heatshrink_encode_dict */
+void heatshrink_decode_dict(int (*callback)(uint32_t *cbdata), uint32_t *cbdata, const unsigned char *dict, size_t dictLen, unsigned char *data);
+
+#include "heatshrink_decoder.h"
+
+/// State for decoding a heatshrink stream a byte at a time, without a buffer for the whole output
+typedef struct {
+  heatshrink_decoder hsd;
+  int (*callback)(uint32_t *cbdata); ///< returns the next compressed byte, or -1 at the end
+  uint32_t *cbdata;
+  bool inputDone;    ///< callback has returned -1 and the decoder has been told to finish
+  uint8_t outBuf[16];
+  uint8_t outPos, outCount;
+} heatshrink_stream;
+
+/** start decoding data from callback */
+void heatshrink_stream_init(heatshrink_stream *hs, int (*callback)(uint32_t *cbdata), uint32_t *cbdata);
+
+/** return the next decoded byte, or -1 when there is no more data */
+int heatshrink_stream_read(heatshrink_stream *hs);
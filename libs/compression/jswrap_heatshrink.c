@@ -0,0 +1,243 @@
+/*
+ * This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+ *
+ * Copyright (C) 2013 Gordon Williams <gw@pur3.co.uk>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * ----------------------------------------------------------------------------
+ * This file is designed to be parsed during the build process
+ *
+ * JavaScript streaming heatshrink compression
+ * ----------------------------------------------------------------------------
+ */
+#include "jswrap_heatshrink.h"
+#include "jsvariterator.h"
+#include "jsparse.h"
+#include "jsinteractive.h"
+#include "heatshrink_encoder.h"
+#include "heatshrink_decoder.h"
+
+/// Flat string containing the heatshrink_encoder/heatshrink_decoder (flat strings never move)
+#define JSI_HEATSHRINK_STATE JS_HIDDEN_CHAR_STR"hs"
+
+/*JSON{
+  "type" : "class",
+  "ifdef" : "USE_HEATSHRINK",
+  "class" : "Compressor"
+}
+Compresses data a chunk at a time, using the same heatshrink compression as `E.compress`.
+Only a fixed amount of memory is used however much data is written, so this is
+useful for compressing logged data before it is stored or sent.
+
+```
+var c = new Compressor();
+var out = c.write(data1) + c.write(data2) + c.end();
+// E.decompress(out) == data1+data2
+```
+*/
+/*JSON{
+  "type" : "class",
+  "ifdef" : "USE_HEATSHRINK",
+  "class" : "Decompressor"
+}
+Decompresses data created with `Compressor` or `E.compress` a chunk at a time
+*/
+
+/*JSON{
+  "type" : "constructor",
+  "ifdef" : "USE_HEATSHRINK",
+  "class" : "Compressor",
+  "name" : "Compressor",
+  "generate" : "jswrap_compressor_constructor",
+  "return" : ["JsVar","A Compressor object"]
+}
+Create a new Compressor. Around 600 bytes of state are allocated
+*/
+/*JSON{
+  "type" : "constructor",
+  "ifdef" : "USE_HEATSHRINK",
+  "class" : "Decompressor",
+  "name" : "Decompressor",
+  "generate" : "jswrap_decompressor_constructor",
+  "return" : ["JsVar","A Decompressor object"]
+}
+Create a new Decompressor. Around 300 bytes of state are allocated
+*/
+static JsVar *jswrap_heatshrink_constructor(const char *className, size_t stateSize) {
+  JsVar *state = jsvNewFlatStringOfLength((unsigned int)stateSize);
+  if (!state) {
+    jsExceptionHere(JSET_ERROR, "Not enough memory for %s", className);
+    return 0;
+  }
+  JsVar *obj = jspNewObject(0, className);
+  if (obj) {
+    if (stateSize == sizeof(heatshrink_encoder))
+      heatshrink_encoder_reset((heatshrink_encoder*)jsvGetFlatStringPointer(state));
+    else
+      heatshrink_decoder_reset((heatshrink_decoder*)jsvGetFlatStringPointer(state));
+    jsvObjectSetChild(obj, JSI_HEATSHRINK_STATE, state);
+  }
+  jsvUnLock(state);
+  return obj;
+}
+
+JsVar *jswrap_compressor_constructor() {
+  return jswrap_heatshrink_constructor("Compressor", sizeof(heatshrink_encoder));
+}
+
+JsVar *jswrap_decompressor_constructor() {
+  return jswrap_heatshrink_constructor("Decompressor", sizeof(heatshrink_decoder));
+}
+
+/// State while writing data through a Compressor/Decompressor
+typedef struct {
+  bool compress;
+  void *hs;              ///< heatshrink_encoder or heatshrink_decoder
+  JsvStringIterator out; ///< where output is appended
+  uint8_t buf[32];       ///< input waiting to be sunk
+  size_t bufLen;
+} JswHeatshrinkWriter;
+
+static void jswrap_heatshrink_poll(JswHeatshrinkWriter *w) {
+  uint8_t outBuf[32];
+  size_t i, count;
+  int pres;
+  do {
+    count = 0;
+    if (w->compress)
+      pres = heatshrink_encoder_poll((heatshrink_encoder*)w->hs, outBuf, sizeof(outBuf), &count);
+    else
+      pres = heatshrink_decoder_poll((heatshrink_decoder*)w->hs, outBuf, sizeof(outBuf), &count);
+    for (i=0;i<count;i++)
+      jsvStringIteratorAppend(&w->out, (char)outBuf[i]);
+  } while (pres == HSER_POLL_MORE);
+}
+
+static void jswrap_heatshrink_sink(JswHeatshrinkWriter *w) {
+  size_t sunk = 0;
+  while (sunk < w->bufLen) {
+    size_t count = 0;
+    if (w->compress)
+      heatshrink_encoder_sink((heatshrink_encoder*)w->hs, &w->buf[sunk], w->bufLen-sunk, &count);
+    else
+      heatshrink_decoder_sink((heatshrink_decoder*)w->hs, &w->buf[sunk], w->bufLen-sunk, &count);
+    sunk += count;
+    jswrap_heatshrink_poll(w);
+  }
+  w->bufLen = 0;
+}
+
+static void jswrap_heatshrink_writeCb(int ch, JswHeatshrinkWriter *w) {
+  w->buf[w->bufLen++] = (uint8_t)ch;
+  if (w->bufLen == sizeof(w->buf))
+    jswrap_heatshrink_sink(w);
+}
+
+/// Set up a writer for a Compressor/Decompressor - returns the output string (or 0)
+static JsVar *jswrap_heatshrink_start(JsVar *parent, JswHeatshrinkWriter *w, JsVar **state) {
+  *state = jsvObjectGetChild(parent, JSI_HEATSHRINK_STATE, 0);
+  if (!jsvIsFlatString(*state)) {
+    jsExceptionHere(JSET_ERROR, "Not a Compressor or Decompressor");
+    jsvUnLock(*state);
+    return 0;
+  }
+  JsVar *str = jsvNewFromEmptyString();
+  if (!str) {
+    jsvUnLock(*state);
+    return 0;
+  }
+  w->compress = jsvGetStringLength(*state) == sizeof(heatshrink_encoder);
+  w->hs = jsvGetFlatStringPointer(*state);
+  w->bufLen = 0;
+  jsvStringIteratorNew(&w->out, str, 0);
+  return str;
+}
+
+/*JSON{
+  "type" : "method",
+  "ifdef" : "USE_HEATSHRINK",
+  "class" : "Compressor",
+  "name" : "write",
+  "generate" : "jswrap_heatshrink_write",
+  "params" : [
+    ["data","JsVar","A String, Array or ArrayBuffer of data to compress"]
+  ],
+  "return" : ["JsVar","A String of compressed data (which may be empty)"],
+  "return_object" : "String"
+}
+Compress some data. Output is only produced once enough input has been written,
+so call `end()` to get the last of it.
+*/
+/*JSON{
+  "type" : "method",
+  "ifdef" : "USE_HEATSHRINK",
+  "class" : "Decompressor",
+  "name" : "write",
+  "generate" : "jswrap_heatshrink_write",
+  "params" : [
+    ["data","JsVar","A String, Array or ArrayBuffer of compressed data"]
+  ],
+  "return" : ["JsVar","A String of decompressed data (which may be empty)"],
+  "return_object" : "String"
+}
+Decompress some data
+*/
+JsVar *jswrap_heatshrink_write(JsVar *parent, JsVar *data) {
+  JswHeatshrinkWriter w;
+  JsVar *state;
+  JsVar *str = jswrap_heatshrink_start(parent, &w, &state);
+  if (!str) return 0;
+  jsvIterateCallback(data, (void (*)(int,  void *))jswrap_heatshrink_writeCb, &w);
+  jswrap_heatshrink_sink(&w);
+  jsvStringIteratorFree(&w.out);
+  jsvUnLock(state);
+  return str;
+}
+
+/*JSON{
+  "type" : "method",
+  "ifdef" : "USE_HEATSHRINK",
+  "class" : "Compressor",
+  "name" : "end",
+  "generate" : "jswrap_heatshrink_end",
+  "return" : ["JsVar","A String containing the remaining compressed data"],
+  "return_object" : "String"
+}
+Finish compressing, and return any data that hasn't been output yet. The
+Compressor can then be used again for a new stream of data.
+*/
+/*JSON{
+  "type" : "method",
+  "ifdef" : "USE_HEATSHRINK",
+  "class" : "Decompressor",
+  "name" : "end",
+  "generate" : "jswrap_heatshrink_end",
+  "return" : ["JsVar","A String containing the remaining decompressed data"],
+  "return_object" : "String"
+}
+Finish decompressing, and return any data that hasn't been output yet. The
+Decompressor can then be used again for a new stream of data.
+*/
+JsVar *jswrap_heatshrink_end(JsVar *parent) {
+  JswHeatshrinkWriter w;
+  JsVar *state;
+  JsVar *str = jswrap_heatshrink_start(parent, &w, &state);
+  if (!str) return 0;
+  if (w.compress) {
+    heatshrink_encoder *hse = (heatshrink_encoder*)w.hs;
+    while (heatshrink_encoder_finish(hse) == HSER_FINISH_MORE)
+      jswrap_heatshrink_poll(&w);
+    heatshrink_encoder_reset(hse);
+  } else {
+    heatshrink_decoder *hsd = (heatshrink_decoder*)w.hs;
+    while (heatshrink_decoder_finish(hsd) == HSDR_FINISH_MORE)
+      jswrap_heatshrink_poll(&w);
+    heatshrink_decoder_reset(hsd);
+  }
+  jsvStringIteratorFree(&w.out);
+  jsvUnLock(state);
+  return str;
+}
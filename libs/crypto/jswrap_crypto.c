@@ -15,6 +15,7 @@
  */
 #include "jsvar.h"
 #include "jsvariterator.h"
+#include "jsparse.h"
 #include "jswrap_crypto.h"
 
 #ifdef USE_AES
@@ -103,6 +104,7 @@ typedef enum {
   CM_CTR,
   CM_OFB,
   CM_ECB,
+  CM_GCM, ///< only for AES.createCipher
 } CryptoMode;
 
 CryptoMode jswrap_crypto_getMode(JsVar *mode) {
@@ -111,6 +113,7 @@ CryptoMode jswrap_crypto_getMode(JsVar *mode) {
   if (jsvIsStringEqual(mode, "CTR")) return CM_CTR;
   if (jsvIsStringEqual(mode, "OFB")) return CM_OFB;
   if (jsvIsStringEqual(mode, "ECB")) return CM_ECB;
+  if (jsvIsStringEqual(mode, "GCM")) return CM_GCM;
   jsExceptionHere(JSET_ERROR, "Unknown Crypto mode %q", mode);
   return CM_NONE;
 }
@@ -125,10 +128,33 @@ mbedtls_md_type_t jswrap_crypto_getHasher(JsVar *hasher) {
   return MBEDTLS_MD_NONE;
 }
 
-JsVar *jswrap_crypto_SHAx(JsVar *message, int shaNum) {
-  JSV_GET_AS_CHAR_ARRAY(msgPtr, msgLen, message);
-  if (!msgPtr) return 0;
+#ifdef MBEDTLS_SHA1_PROCESS_ALT
+/* SHA1 block function in the ESP8266's ROM (the SDK uses it for WPA). It keeps
+ * the same 5 word state as mbedtls, so it can be dropped straight in. */
+extern void SHA1Transform(uint32_t state[5], const unsigned char buffer[64]);
+void mbedtls_sha1_process(mbedtls_sha1_context *ctx, const unsigned char data[64]) {
+  SHA1Transform(ctx->state, data);
+}
+#endif
+
+/// Contexts for each of the SHA functions - only one is used at a time
+typedef union {
+  mbedtls_sha1_context sha1;
+  mbedtls_sha256_context sha256;
+  mbedtls_sha512_context sha512;
+} JswCryptoSHAContext;
+
+static void jswrap_crypto_SHA1_update(const unsigned char *data, size_t len, void *ctx) {
+  mbedtls_sha1_update((mbedtls_sha1_context*)ctx, data, len);
+}
+static void jswrap_crypto_SHA256_update(const unsigned char *data, size_t len, void *ctx) {
+  mbedtls_sha256_update((mbedtls_sha256_context*)ctx, data, len);
+}
+static void jswrap_crypto_SHA512_update(const unsigned char *data, size_t len, void *ctx) {
+  mbedtls_sha512_update((mbedtls_sha512_context*)ctx, data, len);
+}
 
+JsVar *jswrap_crypto_SHAx(JsVar *message, int shaNum) {
   int bufferSize = 20;
   if (shaNum>1) bufferSize = shaNum/8;
 
@@ -139,11 +165,27 @@ JsVar *jswrap_crypto_SHAx(JsVar *message, int shaNum) {
     return 0;
   }
 
-  if (shaNum==1) mbedtls_sha1((unsigned char *)msgPtr, msgLen, (unsigned char *)outPtr);
-  else if (shaNum==224) mbedtls_sha256((unsigned char *)msgPtr, msgLen, (unsigned char *)outPtr, true/*224*/);
-  else if (shaNum==256) mbedtls_sha256((unsigned char *)msgPtr, msgLen, (unsigned char *)outPtr, false/*256*/);
-  else if (shaNum==384) mbedtls_sha512((unsigned char *)msgPtr, msgLen, (unsigned char *)outPtr, true/*384*/);
-  else if (shaNum==512) mbedtls_sha512((unsigned char *)msgPtr, msgLen, (unsigned char *)outPtr, false/*512*/);
+  // The message is hashed a block at a time, so it never has to be copied onto the stack
+  JswCryptoSHAContext ctx;
+  if (shaNum==1) {
+    mbedtls_sha1_init(&ctx.sha1);
+    mbedtls_sha1_starts(&ctx.sha1);
+    jsvIterateBufferCallback(message, jswrap_crypto_SHA1_update, &ctx.sha1);
+    mbedtls_sha1_finish(&ctx.sha1, (unsigned char *)outPtr);
+    mbedtls_sha1_free(&ctx.sha1);
+  } else if (shaNum==224 || shaNum==256) {
+    mbedtls_sha256_init(&ctx.sha256);
+    mbedtls_sha256_starts(&ctx.sha256, shaNum==224);
+    jsvIterateBufferCallback(message, jswrap_crypto_SHA256_update, &ctx.sha256);
+    mbedtls_sha256_finish(&ctx.sha256, (unsigned char *)outPtr);
+    mbedtls_sha256_free(&ctx.sha256);
+  } else if (shaNum==384 || shaNum==512) {
+    mbedtls_sha512_init(&ctx.sha512);
+    mbedtls_sha512_starts(&ctx.sha512, shaNum==384);
+    jsvIterateBufferCallback(message, jswrap_crypto_SHA512_update, &ctx.sha512);
+    mbedtls_sha512_finish(&ctx.sha512, (unsigned char *)outPtr);
+    mbedtls_sha512_free(&ctx.sha512);
+  }
   return outArr;
 }
 
@@ -449,4 +491,322 @@ JsVar *jswrap_crypto_AES_encrypt(JsVar *message, JsVar *key, JsVar *options) {
 JsVar *jswrap_crypto_AES_decrypt(JsVar *message, JsVar *key, JsVar *options) {
   return jswrap_crypto_AEScrypt(message, key, options, false);
 }
+
+/*JSON{
+  "type" : "class",
+  "library" : "crypto",
+  "class" : "AESCipher",
+  "ifdef" : "USE_AES"
+}
+A stateful AES cipher created with `require("crypto").AES.createCipher` - see that for more information
+*/
+
+#define JSW_CRYPTO_CIPHER_STATE JS_HIDDEN_CHAR_STR"cs"
+
+/// State of an AESCipher - stored in a flat string (which never moves, as mbedtls_aes_context points to itself)
+typedef struct {
+  CryptoMode mode;        ///< CM_CTR or CM_GCM
+  bool encrypt;
+  bool finished;          ///< final() has been called
+  unsigned char counter[16];   ///< CTR: next counter block, GCM: last counter block used
+  unsigned char keystream[16]; ///< encrypted counter block
+  unsigned char ksOff;    ///< how much of keystream has been used
+  // GCM only
+  unsigned char ghashOff; ///< bytes of ciphertext in ghashBuf
+  unsigned char ghashBuf[16];
+  unsigned char ghash[16];     ///< running GHASH value
+  unsigned char H[16];         ///< hash subkey = E(K, 0)
+  unsigned char tagMask[16];   ///< E(K, J0) - xored with GHASH to make the tag
+  uint32_t aadLen, dataLen;    ///< in bytes
+  mbedtls_aes_context aes;
+} JswCryptoCipher;
+
+/// GCM: x = x*H in GF(2^128) - bit at a time to keep code size down
+static void jswrap_crypto_gcmMult(unsigned char *x, const unsigned char *H) {
+  unsigned char z[16], v[16];
+  int i, j;
+  memset(z, 0, 16);
+  memcpy(v, H, 16);
+  for (i=0;i<128;i++) {
+    if (x[i>>3] & (0x80>>(i&7)))
+      for (j=0;j<16;j++) z[j] ^= v[j];
+    bool lsb = v[15]&1;
+    for (j=15;j>0;j--) v[j] = (unsigned char)((v[j]>>1) | (v[j-1]<<7));
+    v[0] >>= 1;
+    if (lsb) v[0] ^= 0xE1;
+  }
+  memcpy(x, z, 16);
+}
+
+/// GCM: add one byte to the GHASH
+static void jswrap_crypto_gcmHashByte(JswCryptoCipher *c, unsigned char ch) {
+  c->ghashBuf[c->ghashOff++] = ch;
+  if (c->ghashOff == 16) {
+    int i;
+    for (i=0;i<16;i++) c->ghash[i] ^= c->ghashBuf[i];
+    jswrap_crypto_gcmMult(c->ghash, c->H);
+    c->ghashOff = 0;
+  }
+}
+
+static void jswrap_crypto_gcmHashAADCb(int ch, void *c) {
+  jswrap_crypto_gcmHashByte((JswCryptoCipher*)c, (unsigned char)ch);
+  ((JswCryptoCipher*)c)->aadLen++;
+}
+
+/// GCM: zero-pad whatever is in the GHASH buffer
+static void jswrap_crypto_gcmHashPad(JswCryptoCipher *c) {
+  while (c->ghashOff) jswrap_crypto_gcmHashByte(c, 0);
+}
+
+/// Encrypt or decrypt one byte
+static unsigned char jswrap_crypto_cipherByte(JswCryptoCipher *c, unsigned char in) {
+  if (c->ksOff == 16) {
+    int i;
+    if (c->mode == CM_GCM) { // GCM increments the last 32 bits before encrypting
+      for (i=15;i>11;i--) if (++c->counter[i]) break;
+    }
+    mbedtls_aes_crypt_ecb(&c->aes, MBEDTLS_AES_ENCRYPT, c->counter, c->keystream);
+    if (c->mode == CM_CTR) { // CTR (like mbedtls) increments all 128 bits afterwards
+      for (i=15;i>=0;i--) if (++c->counter[i]) break;
+    }
+    c->ksOff = 0;
+  }
+  unsigned char out = in ^ c->keystream[c->ksOff++];
+  if (c->mode == CM_GCM) {
+    jswrap_crypto_gcmHashByte(c, c->encrypt ? out : in);
+    c->dataLen++;
+  }
+  return out;
+}
+
+/*JSON{
+  "type" : "staticmethod",
+  "class" : "AES",
+  "name" : "createCipher",
+  "generate" : "jswrap_crypto_AES_createCipher",
+  "params" : [
+    ["key","JsVar","Key - must be an ArrayBuffer of 128, 192, or 256 BITS"],
+    ["options","JsVar","`{ mode : 'CTR'|'GCM', iv : ArrayBuffer, decrypt : bool, aad : ArrayBuffer }` - see below"]
+  ],
+  "return" : ["JsVar","An AESCipher"],
+  "return_object" : "AESCipher",
+  "ifdef" : "USE_AES"
+}
+Create a stateful AES cipher that can encrypt or decrypt a stream of data a chunk at a time,
+for instance to send encrypted data over a socket without the memory needed for TLS.
+
+* `mode` - `'CTR'` (default) or `'GCM'`
+* `iv` - For CTR, the 16 byte initial counter block. For GCM, a 12 byte IV. **Never use the same key and iv twice.**
+* `decrypt` - `true` to decrypt (only matters for GCM, as CTR encryption and decryption are the same)
+* `aad` - GCM only: additional data that is authenticated but not encrypted
+
+```
+var c = require("crypto").AES.createCipher(key, {mode:"GCM", iv:iv});
+sock.write(c.update(chunk1)); // chunk1 is encrypted in place
+sock.write(c.update(chunk2));
+sock.write(c.final()); // 16 byte authentication tag
+```
+*/
+JsVar *jswrap_crypto_AES_createCipher(JsVar *key, JsVar *options) {
+  CryptoMode mode = CM_CTR;
+  bool decrypt = false;
+  unsigned char iv[16];
+  memset(iv, 0, sizeof(iv));
+  unsigned int ivLen = 0;
+  JsVar *aad = 0;
+  if (jsvIsObject(options)) {
+    JsVar *modeVar = jsvObjectGetChild(options, "mode", 0);
+    if (!jsvIsUndefined(modeVar))
+      mode = jswrap_crypto_getMode(modeVar);
+    jsvUnLock(modeVar);
+    if (mode == CM_NONE) return 0;
+    JsVar *ivVar = jsvObjectGetChild(options, "iv", 0);
+    if (ivVar) ivLen = jsvIterateCallbackToBytes(ivVar, iv, sizeof(iv));
+    jsvUnLock(ivVar);
+    decrypt = jsvGetBoolAndUnLock(jsvObjectGetChild(options, "decrypt", 0));
+    aad = jsvObjectGetChild(options, "aad", 0);
+  } else if (!jsvIsUndefined(options)) {
+    jsError("'options' must be undefined, or an Object");
+    return 0;
+  }
+  if (mode != CM_CTR && mode != CM_GCM) {
+    jsError("Only CTR and GCM modes are supported");
+    jsvUnLock(aad);
+    return 0;
+  }
+  if (mode == CM_GCM && ivLen != 12) {
+    jsError("GCM needs a 12 byte iv");
+    jsvUnLock(aad);
+    return 0;
+  }
+
+  JsVar *state = jsvNewFlatStringOfLength(sizeof(JswCryptoCipher));
+  JsVar *cipher = state ? jspNewObject(0, "AESCipher") : 0;
+  if (!cipher) {
+    jsError("Not enough memory for cipher");
+    jsvUnLock2(state, aad);
+    return 0;
+  }
+  JswCryptoCipher *c = (JswCryptoCipher*)jsvGetFlatStringPointer(state);
+  memset(c, 0, sizeof(JswCryptoCipher));
+  c->mode = mode;
+  c->encrypt = !decrypt;
+  c->ksOff = 16;
+  memcpy(c->counter, iv, 16);
+  mbedtls_aes_init(&c->aes);
+  int err;
+  { // counter modes only ever use AES encryption
+    JSV_GET_AS_CHAR_ARRAY(keyPtr, keyLen, key);
+    err = keyPtr ? mbedtls_aes_setkey_enc(&c->aes, (unsigned char*)keyPtr, (unsigned int)keyLen*8) : MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+  }
+  if (!err && mode == CM_GCM) {
+    mbedtls_aes_crypt_ecb(&c->aes, MBEDTLS_AES_ENCRYPT, c->H, c->H); // H = E(K, 0)
+    c->counter[15] = 1; // J0 = IV || 0^31 || 1
+    mbedtls_aes_crypt_ecb(&c->aes, MBEDTLS_AES_ENCRYPT, c->counter, c->tagMask);
+    if (aad) {
+      jsvIterateCallback(aad, jswrap_crypto_gcmHashAADCb, c);
+      jswrap_crypto_gcmHashPad(c);
+    }
+  }
+  jsvUnLock(aad);
+  if (err) {
+    jswrap_crypto_error(err);
+    jsvUnLock2(state, cipher);
+    return 0;
+  }
+  jsvObjectSetChildAndUnLock(cipher, JSW_CRYPTO_CIPHER_STATE, state);
+  return cipher;
+}
+
+static JswCryptoCipher *jswrap_crypto_getCipher(JsVar *parent, JsVar **state) {
+  *state = jsvObjectGetChild(parent, JSW_CRYPTO_CIPHER_STATE, 0);
+  if (!jsvIsFlatString(*state) || jsvGetStringLength(*state)!=sizeof(JswCryptoCipher)) {
+    jsError("Not an AESCipher");
+    jsvUnLock(*state);
+    return 0;
+  }
+  JswCryptoCipher *c = (JswCryptoCipher*)jsvGetFlatStringPointer(*state);
+  if (c->finished) {
+    jsError("final() has already been called");
+    jsvUnLock(*state);
+    return 0;
+  }
+  return c;
+}
+
+static void _jswrap_crypto_setByte(int ch, JsvStringIterator *it) {
+  jsvStringIteratorSetChar(it, (char)ch);
+  jsvStringIteratorNext(it);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "AESCipher",
+  "name" : "update",
+  "generate" : "jswrap_crypto_cipher_update",
+  "params" : [
+    ["data","JsVar","The data to encrypt or decrypt"]
+  ],
+  "return" : ["JsVar","The result"],
+  "return_object" : "ArrayBuffer",
+  "ifdef" : "USE_AES"
+}
+Encrypt or decrypt some data, which may be any length. If `data` is an
+ArrayBuffer (or typed array) it is modified in place and returned, so no
+extra memory is needed. Otherwise a new `Uint8Array` is returned.
+*/
+JsVar *jswrap_crypto_cipher_update(JsVar *parent, JsVar *data) {
+  JsVar *state;
+  JswCryptoCipher *c = jswrap_crypto_getCipher(parent, &state);
+  if (!c) return 0;
+  JsVar *result;
+  if (jsvIsArrayBuffer(data)) {
+    result = jsvLockAgain(data);
+  } else {
+    int len = jsvIterateCallbackCount(data);
+    result = jsvNewTypedArray(ARRAYBUFFERVIEW_UINT8, len);
+    if (!result) {
+      jsvUnLock(state);
+      return 0;
+    }
+    JsVar *str = jsvGetArrayBufferBackingString(result);
+    JsvStringIterator it;
+    jsvStringIteratorNew(&it, str, 0);
+    jsvIterateCallback(data, (void (*)(int,  void *))_jswrap_crypto_setByte, &it);
+    jsvStringIteratorFree(&it);
+    jsvUnLock(str);
+  }
+  size_t len;
+  unsigned char *ptr = (unsigned char*)jsvGetDataPointer(result, &len);
+  if (ptr) {
+    len *= (size_t)JSV_ARRAYBUFFER_GET_SIZE(result->varData.arraybuffer.type);
+    size_t i;
+    for (i=0;i<len;i++)
+      ptr[i] = jswrap_crypto_cipherByte(c, ptr[i]);
+  } else {
+    len = jsvGetArrayBufferLength(result) * (size_t)JSV_ARRAYBUFFER_GET_SIZE(result->varData.arraybuffer.type);
+    JsVar *str = jsvGetArrayBufferBackingString(result);
+    JsvStringIterator it;
+    jsvStringIteratorNew(&it, str, result->varData.arraybuffer.byteOffset);
+    while (len-- && jsvStringIteratorHasChar(&it)) {
+      jsvStringIteratorSetChar(&it, (char)jswrap_crypto_cipherByte(c, (unsigned char)jsvStringIteratorGetChar(&it)));
+      jsvStringIteratorNext(&it);
+    }
+    jsvStringIteratorFree(&it);
+    jsvUnLock(str);
+  }
+  jsvUnLock(state);
+  return result;
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "AESCipher",
+  "name" : "final",
+  "generate" : "jswrap_crypto_cipher_final",
+  "params" : [
+    ["tag","JsVar","GCM decryption: (optional) the tag that was received - an exception is thrown if it doesn't match"]
+  ],
+  "return" : ["JsVar","For GCM, the 16 byte authentication tag. For CTR, undefined"],
+  "return_object" : "ArrayBuffer",
+  "ifdef" : "USE_AES"
+}
+Finish encrypting or decrypting. For GCM this returns the authentication tag
+that should be sent along with the data. When decrypting, either pass the
+tag that was received, or compare it with the returned tag yourself.
+The AESCipher can't be used after this.
+*/
+JsVar *jswrap_crypto_cipher_final(JsVar *parent, JsVar *tag) {
+  JsVar *state;
+  JswCryptoCipher *c = jswrap_crypto_getCipher(parent, &state);
+  if (!c) return 0;
+  c->finished = true;
+  JsVar *result = 0;
+  if (c->mode == CM_GCM) {
+    jswrap_crypto_gcmHashPad(c);
+    // length block - 64 bit bit counts of AAD and data
+    uint32_t lens[2] = { c->aadLen, c->dataLen };
+    int i, j;
+    for (i=0;i<2;i++) {
+      for (j=0;j<3;j++) jswrap_crypto_gcmHashByte(c, 0);
+      jswrap_crypto_gcmHashByte(c, (unsigned char)(lens[i]>>29));
+      for (j=3;j>=0;j--) jswrap_crypto_gcmHashByte(c, (unsigned char)((lens[i]<<3)>>(j*8)));
+    }
+    char *tagPtr = 0;
+    result = jsvNewArrayBufferWithPtr(16, &tagPtr);
+    if (tagPtr) {
+      for (i=0;i<16;i++) tagPtr[i] = (char)(c->ghash[i] ^ c->tagMask[i]);
+      if (!c->encrypt && tag) {
+        unsigned char expected[16];
+        unsigned char diff = (unsigned char)(jsvIterateCallbackToBytes(tag, expected, sizeof(expected)) != 16);
+        for (i=0;i<16;i++) diff |= (unsigned char)(expected[i] ^ (unsigned char)tagPtr[i]);
+        if (diff) jsExceptionHere(JSET_ERROR, "Authentication tag doesn't match");
+      }
+    }
+  }
+  mbedtls_aes_free(&c->aes);
+  jsvUnLock(state);
+  return result;
+}
 #endif
\ No newline at end of file
@@ -22,4 +22,7 @@ JsVar *jswrap_crypto_PBKDF2(JsVar *passphrase, JsVar *salt, JsVar *options);
 #ifdef USE_AES
 JsVar *jswrap_crypto_AES_encrypt(JsVar *message, JsVar *key, JsVar *options);
 JsVar *jswrap_crypto_AES_decrypt(JsVar *message, JsVar *key, JsVar *options);
+JsVar *jswrap_crypto_AES_createCipher(JsVar *key, JsVar *options);
+JsVar *jswrap_crypto_cipher_update(JsVar *parent, JsVar *data);
+JsVar *jswrap_crypto_cipher_final(JsVar *parent, JsVar *tag);
 #endif
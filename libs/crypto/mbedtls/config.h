@@ -45,7 +45,20 @@
 
 #define MBEDTLS_PKCS1_V15
 #define MBEDTLS_KEY_EXCHANGE_RSA_ENABLED
+#define MBEDTLS_KEY_EXCHANGE_PSK_ENABLED /* options.psk - no certificates or RSA needed */
 #define MBEDTLS_SSL_PROTO_TLS1_2
+#define MBEDTLS_SSL_SESSION_TICKETS /* so we can resume sessions with servers that don't keep a session cache */
+#define MBEDTLS_SSL_SERVER_NAME_INDICATION /* options.host is sent so virtual hosts pick the right certificate */
+
+/* mbedtls allocates an input and an output buffer of MBEDTLS_SSL_MAX_CONTENT_LEN
+ * (plus ~500 bytes) for every connection - 16kB each by default. On devices we
+ * use 4kB, and ask the server not to send bigger records with the max fragment
+ * length extension. Servers that don't support the extension may still send
+ * 16kB records, which will then fail. */
+#define MBEDTLS_SSL_MAX_FRAGMENT_LENGTH
+#ifndef LINUX
+#define MBEDTLS_SSL_MAX_CONTENT_LEN 4096
+#endif
 
 /* mbed TLS modules */
 #define MBEDTLS_AES_C
@@ -123,6 +136,11 @@
 #define memcpy(d,s,n) flash_memcpy(d,s,n)
 #endif
 
+/* use the SHA1 block function in the ESP8266's ROM (see jswrap_crypto.c) */
+#ifdef ESP8266
+#define MBEDTLS_SHA1_PROCESS_ALT
+#endif
+
 
 #include "mbedtls/check_config.h"
 
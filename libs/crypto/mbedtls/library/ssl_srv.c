@@ -3558,10 +3558,10 @@ static int ssl_write_new_session_ticket( mbedtls_ssl_context *ssl )
         tlen = 0;
     }
 
-    ssl->out_msg[4] = ( lifetime >> 24 ) & 0xFF;
-    ssl->out_msg[5] = ( lifetime >> 16 ) & 0xFF;
-    ssl->out_msg[6] = ( lifetime >>  8 ) & 0xFF;
-    ssl->out_msg[7] = ( lifetime       ) & 0xFF;
+    ssl->out_msg[4] = (unsigned char)( ( lifetime >> 24 ) & 0xFF );
+    ssl->out_msg[5] = (unsigned char)( ( lifetime >> 16 ) & 0xFF );
+    ssl->out_msg[6] = (unsigned char)( ( lifetime >>  8 ) & 0xFF );
+    ssl->out_msg[7] = (unsigned char)( ( lifetime       ) & 0xFF );
 
     ssl->out_msg[8] = (unsigned char)( ( tlen >> 8 ) & 0xFF );
     ssl->out_msg[9] = (unsigned char)( ( tlen      ) & 0xFF );
@@ -1175,7 +1175,7 @@ int mbedtls_ssl_psk_derive_premaster( mbedtls_ssl_context *ssl, mbedtls_key_exch
     memcpy( p, psk, psk_len );
     p += psk_len;
 
-    ssl->handshake->pmslen = p - ssl->handshake->premaster;
+    ssl->handshake->pmslen = (size_t)( p - ssl->handshake->premaster );
 
     return( 0 );
 }
@@ -5937,7 +5937,7 @@ int mbedtls_ssl_conf_max_frag_len( mbedtls_ssl_config *conf, unsigned char mfl_c
         return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
     }
 
-    conf->mfl_code = mfl_code;
+    conf->mfl_code = (unsigned int)mfl_code & 0x07u;
 
     return( 0 );
 }
@@ -5984,7 +5984,7 @@ void mbedtls_ssl_conf_renegotiation_period( mbedtls_ssl_config *conf,
 #if defined(MBEDTLS_SSL_CLI_C)
 void mbedtls_ssl_conf_session_tickets( mbedtls_ssl_config *conf, int use_tickets )
 {
-    conf->session_tickets = use_tickets;
+    conf->session_tickets = (unsigned int)use_tickets & 0x01u;
 }
 #endif
 
@@ -0,0 +1,226 @@
+// USED FOR FILESYSTEMS IN THE MICROCONTROLLER'S OWN FLASH MEMORY
+/*
+ * This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * ----------------------------------------------------------------------------
+ * FatFS disk driver that stores 512 byte sectors in an area of flash using
+ * jshFlashRead/jshFlashWrite.
+ *
+ * One flash page is cached in RAM. Writes go into the cache, and the page is
+ * only written back when another page is needed or FatFS syncs, so several
+ * sector writes to the same page cost one erase. If a page only has bits
+ * cleared (eg. appending to a file in erased flash) it is written without
+ * erasing it first at all.
+ * ----------------------------------------------------------------------------
+ */
+
+#include "platform_config.h"
+#include "jsutils.h"
+#include "jsvar.h"
+#include "jsvariterator.h"
+#include "jshardware.h"
+#include "diskio.h"
+
+#define FLASHFS_SECTOR_SIZE 512
+#ifndef FLASHFS_CACHE_SIZE
+#define FLASHFS_CACHE_SIZE 4096 // biggest flash page we can handle
+#endif
+#define FLASHFS_NO_PAGE 0xFFFFFFFF
+
+static volatile DSTATUS Stat = STA_NOINIT;	/* Disk status */
+static uint32_t flashfsStart;   ///< address of the start of the filesystem
+static uint32_t flashfsLength;  ///< length of the filesystem in bytes
+static uint32_t flashfsPageSize;
+static uint32_t cachePage = FLASHFS_NO_PAGE; ///< address of the page in the cache
+static bool cacheDirty;        ///< the cache has data that isn't in flash yet
+static bool cacheNeedsErase;   ///< a dirty cache sets bits that are clear in flash
+static uint32_t cache[FLASHFS_CACHE_SIZE/4]; // words, as some platforms need aligned flash access
+
+/// Work out which area of flash we're using
+static bool flashfsGetArea() {
+#if defined(FLASHFS_START) && defined(FLASHFS_LENGTH)
+  flashfsStart = FLASHFS_START;
+  flashfsLength = FLASHFS_LENGTH;
+#else
+  // Use the biggest area of flash that the hardware says is free
+  flashfsLength = 0;
+  JsVar *areas = jshFlashGetFree();
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, areas);
+  while (jsvObjectIteratorHasValue(&it)) {
+    JsVar *area = jsvObjectIteratorGetValue(&it);
+    uint32_t length = (uint32_t)jsvGetIntegerAndUnLock(jsvObjectGetChild(area, "length", 0));
+    if (length > flashfsLength) {
+      flashfsStart = (uint32_t)jsvGetIntegerAndUnLock(jsvObjectGetChild(area, "addr", 0));
+      flashfsLength = length;
+    }
+    jsvUnLock(area);
+    jsvObjectIteratorNext(&it);
+  }
+  jsvObjectIteratorFree(&it);
+  jsvUnLock(areas);
+#endif
+  uint32_t pageStart;
+  if (!flashfsLength ||
+      !jshFlashGetPage(flashfsStart, &pageStart, &flashfsPageSize) ||
+      pageStart != flashfsStart ||
+      flashfsPageSize > FLASHFS_CACHE_SIZE ||
+      flashfsPageSize % FLASHFS_SECTOR_SIZE)
+    return false;
+  // only whole pages
+  flashfsLength -= flashfsLength % flashfsPageSize;
+  return true;
+}
+
+/// Write the cached page back to flash if it has been changed
+static void flashfsFlush() {
+  if (!cacheDirty) return;
+  if (cacheNeedsErase)
+    jshFlashErasePage(cachePage);
+  jshFlashWrite(cache, cachePage, flashfsPageSize);
+  cacheDirty = false;
+  cacheNeedsErase = false;
+}
+
+/// Make sure the page containing the given address is in the cache, and return a pointer to the address in it
+static BYTE *flashfsGetCached(uint32_t addr) {
+  uint32_t page = addr - ((addr - flashfsStart) % flashfsPageSize);
+  if (page != cachePage) {
+    flashfsFlush();
+    jshFlashRead(cache, page, flashfsPageSize);
+    cachePage = page;
+  }
+  return &((BYTE*)cache)[addr - page];
+}
+
+
+/*--------------------------------------------------------------------------
+
+   Public Functions
+
+---------------------------------------------------------------------------*/
+
+
+/*-----------------------------------------------------------------------*/
+/* Initialize Disk Drive                                                 */
+/*-----------------------------------------------------------------------*/
+
+DSTATUS disk_initialize (
+  BYTE drv /* Physical drive number (0) */
+  )
+{
+  if (drv) return STA_NOINIT;
+  if (!(Stat & STA_NOINIT)) flashfsFlush();
+  cachePage = FLASHFS_NO_PAGE;
+  cacheDirty = false;
+  cacheNeedsErase = false;
+  Stat = flashfsGetArea() ? 0 : STA_NOINIT;
+  return Stat;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/* Get Disk Status                                                       */
+/*-----------------------------------------------------------------------*/
+
+DSTATUS disk_status (
+  BYTE drv /* Physical drive number (0) */
+  )
+{
+  if (drv) return STA_NOINIT;
+  return Stat;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/* Read Sector(s)                                                        */
+/*-----------------------------------------------------------------------*/
+
+DRESULT disk_read (
+  BYTE drv, /* Physical drive number (0) */
+  BYTE *buff, /* Pointer to the data buffer to store read data */
+  DWORD sector, /* Start sector number (LBA) */
+  UINT count /* Sector count (1..255) */
+  )
+{
+  if (drv || !count) return RES_PARERR;
+  if (Stat & STA_NOINIT) return RES_NOTRDY;
+  if ((sector+count)*FLASHFS_SECTOR_SIZE > flashfsLength) return RES_PARERR;
+
+  uint32_t addr = flashfsStart + (uint32_t)sector*FLASHFS_SECTOR_SIZE;
+  while (count--) {
+    memcpy(buff, flashfsGetCached(addr), FLASHFS_SECTOR_SIZE);
+    buff += FLASHFS_SECTOR_SIZE;
+    addr += FLASHFS_SECTOR_SIZE;
+  }
+  return RES_OK;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/* Write Sector(s)                                                       */
+/*-----------------------------------------------------------------------*/
+
+DRESULT disk_write (
+  BYTE drv, /* Physical drive number (0) */
+  const BYTE *buff, /* Pointer to the data to be written */
+  DWORD sector, /* Start sector number (LBA) */
+  UINT count /* Sector count (1..255) */
+  )
+{
+  if (drv || !count) return RES_PARERR;
+  if (Stat & STA_NOINIT) return RES_NOTRDY;
+  if ((sector+count)*FLASHFS_SECTOR_SIZE > flashfsLength) return RES_PARERR;
+
+  uint32_t addr = flashfsStart + (uint32_t)sector*FLASHFS_SECTOR_SIZE;
+  while (count--) {
+    BYTE *data = flashfsGetCached(addr);
+    int i;
+    for (i=0;i<FLASHFS_SECTOR_SIZE;i++) {
+      if (data[i] == buff[i]) continue;
+      // flash can only clear bits without an erase
+      if ((data[i] & buff[i]) != buff[i]) cacheNeedsErase = true;
+      data[i] = buff[i];
+      cacheDirty = true;
+    }
+    buff += FLASHFS_SECTOR_SIZE;
+    addr += FLASHFS_SECTOR_SIZE;
+  }
+  return RES_OK;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/* Miscellaneous Functions                                               */
+/*-----------------------------------------------------------------------*/
+
+DRESULT disk_ioctl (
+  BYTE drv, /* Physical drive number (0) */
+  BYTE ctrl, /* Control code */
+  void *buff /* Buffer to send/receive control data */
+  )
+{
+  if (drv) return RES_PARERR;
+  if (Stat & STA_NOINIT) return RES_NOTRDY;
+
+  switch (ctrl) {
+  case CTRL_SYNC :    /* Make sure that no pending write process */
+    flashfsFlush();
+    return RES_OK;
+  case GET_SECTOR_COUNT :  /* Get number of sectors on the disk (DWORD) */
+    *(DWORD*)buff = flashfsLength / FLASHFS_SECTOR_SIZE;
+    return RES_OK;
+  case GET_SECTOR_SIZE :  /* Get R/W sector size (WORD) */
+    *(WORD*)buff = FLASHFS_SECTOR_SIZE;
+    return RES_OK;
+  case GET_BLOCK_SIZE :  /* Get erase block size in unit of sector (DWORD) */
+    *(DWORD*)buff = flashfsPageSize / FLASHFS_SECTOR_SIZE;
+    return RES_OK;
+  default:
+    return RES_PARERR;
+  }
+}
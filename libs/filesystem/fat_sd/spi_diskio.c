@@ -82,6 +82,13 @@ static BYTE CardType;			/* Card type flags */
 static Pin sdCSPin = PIN_UNDEFINED; // SD_CS_PIN
 static JsVar *sdSPI = 0;
 
+/* A multiple block write (CMD25) is left open after disk_write, so that
+ * if the next write carries on from the next sector (as it does when
+ * FatFS writes a file a sector at a time) we can just send more blocks.
+ * The card is deselected in between, so other devices can use the bus. */
+static bool multiWriteOpen = false;
+static DWORD multiWriteNextSector;	/* LBA of the next block in the open write */
+
 static inline bool chk_power() { return 1; }
 
 
@@ -251,6 +258,27 @@ bool xmit_datablock (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Finish any multiple block write left open by disk_write               */
+/*-----------------------------------------------------------------------*/
+
+#if _READONLY == 0
+static
+bool finish_multi_write (void)
+{
+	if (!multiWriteOpen) return TRUE;
+	multiWriteOpen = false;
+	SELECT();
+	bool ok = xmit_datablock(0, 0xFD);	/* STOP_TRAN token */
+	release_spi();
+	return ok;
+}
+#else
+#define finish_multi_write() TRUE
+#endif
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Send a command packet to MMC                                          */
 /*-----------------------------------------------------------------------*/
@@ -325,6 +353,7 @@ DSTATUS disk_initialize (
 	if (drv) return STA_NOINIT;			/* Supports only single drive */
 	if (Stat & STA_NODISK) return Stat;	/* No card in the socket */
 
+	finish_multi_write();
 	power_on();							/* Force socket power on */
 	for (n = 10; n; n--) read_spi_byte();	/* 80 dummy clocks */
 
@@ -393,6 +422,7 @@ DRESULT disk_read (
 {
 	if (drv || !count) return RES_PARERR;
 	if (Stat & STA_NOINIT) return RES_NOTRDY;
+	if (!finish_multi_write()) return RES_ERROR;
 
 	if (!(CardType & CT_BLOCK)) sector *= 512;	/* Convert to byte address if needed */
 
@@ -437,27 +467,31 @@ DRESULT disk_write (
 	if (Stat & STA_NOINIT) return RES_NOTRDY;
 	if (Stat & STA_PROTECT) return RES_WRPRT;
 
-	if (!(CardType & CT_BLOCK)) sector *= 512;	/* Convert to byte address if needed */
-
-	if (count == 1) {	/* Single block write */
-		if ((send_cmd(CMD24, sector) == 0)	/* WRITE_BLOCK */
-			&& xmit_datablock(buff, 0xFE))
-			count = 0;
-	}
-	else {				/* Multiple block write */
-		if (CardType & CT_SDC) send_cmd(ACMD23, count);
-		if (send_cmd(CMD25, sector) == 0) {	/* WRITE_MULTIPLE_BLOCK */
-			do {
-				if (!xmit_datablock(buff, 0xFC)) break;
-				buff += 512;
-			} while (--count);
-			if (!xmit_datablock(0, 0xFD))	/* STOP_TRAN token */
-				count = 1;
+	DWORD nextSector = sector + count;
+	if (multiWriteOpen && sector == multiWriteNextSector) {
+		/* Carry on with the multiple block write we already started */
+		SELECT();
+	} else {
+		if (!finish_multi_write()) return RES_ERROR;
+		if (!(CardType & CT_BLOCK)) sector *= 512;	/* Convert to byte address if needed */
+		if (send_cmd(CMD25, sector) != 0) {	/* WRITE_MULTIPLE_BLOCK */
+			release_spi();
+			return RES_ERROR;
 		}
+		multiWriteOpen = true;
 	}
+	do {
+		if (!xmit_datablock(buff, 0xFC)) break;
+		buff += 512;
+	} while (--count);
 	release_spi();
+	multiWriteNextSector = nextSector;
+	if (count) {		/* Failed - stop the write so the card is usable again */
+		finish_multi_write();
+		return RES_ERROR;
+	}
 
-	return count ? RES_ERROR : RES_OK;
+	return RES_OK;
 }
 #endif /* _READONLY == 0 */
 
@@ -480,6 +514,7 @@ DRESULT disk_ioctl (
 
 
 	if (drv) return RES_PARERR;
+	if (!finish_multi_write()) return RES_ERROR;
 
 	res = RES_ERROR;
 
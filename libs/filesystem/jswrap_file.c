@@ -19,7 +19,7 @@
 #define JS_FS_DATA_NAME JS_HIDDEN_CHAR_STR"FSd" // the data in each file
 #define JS_FS_OPEN_FILES_NAME JS_HIDDEN_CHAR_STR"FSo" // the list of open files
 
-#if !defined(LINUX) && !defined(USE_FILESYSTEM_SDIO)
+#if !defined(LINUX) && !defined(USE_FILESYSTEM_SDIO) && !defined(USE_FLASHFS)
 #define SD_CARD_ANYWHERE
 #endif
 
@@ -89,11 +89,24 @@ bool jsfsInit() {
     }
 #endif
 
-    FRESULT res;
-    if ((res = f_mount(&jsfsFAT, "", 1/*immediate*/)) != FR_OK) {
+    FRESULT res = f_mount(&jsfsFAT, "", 1/*immediate*/);
+#ifdef USE_FLASHFS
+    // First time we've used this area of flash - so format it
+    if (res == FR_NO_FILESYSTEM) {
+      jsiConsolePrint("Formatting flash filesystem...\n");
+      res = f_mkfs("", 1/*no partition table*/, 0/*auto cluster size*/);
+      if (res == FR_OK) res = f_mount(&jsfsFAT, "", 1/*immediate*/);
+    }
+    if (res != FR_OK) {
+      jsfsReportError("Unable to mount flash filesystem", res);
+      return false;
+    }
+#else
+    if (res != FR_OK) {
       jsfsReportError("Unable to mount SD card", res);
       return false;
     }
+#endif
     fat_initialised = true;
   }
 #endif
@@ -427,6 +440,19 @@ size_t jswrap_file_write(JsVar* parent, JsVar* buffer) {
   return bytesWritten;
 }
 
+/// Read up to len bytes from the file into buf
+static FRESULT fileReadBytes(JsFile *file, char *buf, size_t len, size_t *actual) {
+#ifndef LINUX
+  UINT n = 0;
+  FRESULT res = f_read(&file->data.handle, buf, (UINT)len, &n);
+  *actual = n;
+  return res;
+#else
+  *actual = fread(buf, 1, len, file->data.handle);
+  return FR_OK;
+#endif
+}
+
 /*JSON{
   "type" : "method",
   "class" : "File",
@@ -455,13 +481,8 @@ JsVar *jswrap_file_read(JsVar* parent, int length) {
           size_t requested = (size_t)length - bytesRead;
           if (requested > sizeof( buf ))
             requested = sizeof( buf );
-          actual = 0;
-    #ifndef LINUX
-          res = f_read(&file.data.handle, buf, requested, &actual);
+          res = fileReadBytes(&file, buf, requested, &actual);
           if(res) break;
-    #else
-          actual = fread(buf, 1, requested, file.data.handle);
-    #endif
           if (actual>0) {
             if (!buffer) {
               buffer = jsvNewFromEmptyString();
@@ -487,6 +508,87 @@ JsVar *jswrap_file_read(JsVar* parent, int length) {
   return buffer;
 }
 
+/*JSON{
+  "type" : "method",
+  "class" : "File",
+  "name" : "readInto",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_file_readInto",
+  "params" : [
+    ["buffer","JsVar","An ArrayBuffer or typed array to read the data into"],
+    ["offset","int32","The offset in bytes in `buffer` to start writing data at"],
+    ["length","JsVar","(optional) The maximum number of bytes to read. If not specified, `buffer` is filled"]
+  ],
+  "return" : ["int32","The number of bytes read - 0 if the end of the file has been reached"]
+}
+Read data from a file into an existing ArrayBuffer or typed array. Unlike
+`File.read`, this doesn't allocate a new String each time, so it is faster
+and doesn't fragment memory when reading a file in chunks.
+
+```
+var buf = new Uint8Array(64), n;
+while ((n = f.readInto(buf, 0)) > 0) { ... }
+```
+*/
+int jswrap_file_readInto(JsVar* parent, JsVar* buffer, int offset, JsVar* length) {
+  if (!jsvIsArrayBuffer(buffer)) {
+    jsExceptionHere(JSET_TYPEERROR, "Expecting an ArrayBuffer or typed array, got %t", buffer);
+    return 0;
+  }
+  size_t bufferLen = jsvGetArrayBufferLength(buffer) * JSV_ARRAYBUFFER_GET_SIZE(buffer->varData.arraybuffer.type);
+  if (offset<0 || (size_t)offset>bufferLen) {
+    jsExceptionHere(JSET_ERROR, "Offset %d out of range", offset);
+    return 0;
+  }
+  size_t requested = bufferLen - (size_t)offset;
+  if (jsvIsNumeric(length)) {
+    JsVarInt l = jsvGetInteger(length);
+    if (l < 0) l = 0;
+    if ((size_t)l < requested) requested = (size_t)l;
+  }
+
+  FRESULT res = 0;
+  size_t bytesRead = 0;
+  if (jsfsInit()) {
+    JsFile file;
+    if (fileGetFromVar(&file, parent)) {
+      if(file.data.mode == FM_READ || file.data.mode == FM_READ_WRITE) {
+        size_t dataLen;
+        char *dataPtr = jsvGetWritableDataPointer(buffer, &dataLen);
+        if (dataPtr) {
+          // buffer is flat, so we can read straight into it
+          res = fileReadBytes(&file, dataPtr+offset, requested, &bytesRead);
+        } else {
+          // otherwise go a few bytes at a time into the backing string
+          JsVar *str = jsvGetArrayBufferBackingString(buffer);
+          JsvStringIterator it;
+          jsvStringIteratorNew(&it, str, (size_t)buffer->varData.arraybuffer.byteOffset + (size_t)offset);
+          char buf[32];
+          while (bytesRead < requested) {
+            size_t chunk = requested - bytesRead;
+            if (chunk > sizeof(buf)) chunk = sizeof(buf);
+            size_t actual;
+            res = fileReadBytes(&file, buf, chunk, &actual);
+            if (res) break;
+            size_t i;
+            for (i=0;i<actual;i++) {
+              jsvStringIteratorSetChar(&it, buf[i]);
+              jsvStringIteratorNext(&it);
+            }
+            bytesRead += actual;
+            if (actual != chunk) break;
+          }
+          jsvStringIteratorFree(&it);
+          jsvUnLock(str);
+        }
+        fileSetVar(&file);
+      }
+    }
+  }
+  if (res) jsfsReportError("Unable to read file", res);
+  return (int)bytesRead;
+}
+
 /*JSON{
   "type" : "method",
   "class" : "File",
@@ -539,7 +641,7 @@ void jswrap_file_skip_or_seek(JsVar* parent, int nBytes, bool is_skip) {
   "generate" : "jswrap_pipe",
   "params" : [
     ["destination","JsVar","The destination file/stream that will receive content from the source."],
-    ["options","JsVar",["An optional object `{ chunkSize : int=32, end : bool=true, complete : function }`","chunkSize : The amount of data to pipe from source to destination at a time","complete : a function to call when the pipe activity is complete","end : call the 'end' function on the destination when the source is finished"]]
+    ["options","JsVar",["An optional object `{ chunkSize : int=32, end : bool=true, complete : function, reuseBuffer : bool=false }`","chunkSize : The amount of data to pipe from source to destination at a time","complete : a function to call when the pipe activity is complete","end : call the 'end' function on the destination when the source is finished","reuseBuffer : read each chunk into the same buffer with `File.readInto` rather than allocating a new String. Only use this if the destination has finished with the data by the time `write` returns (eg. another File)"]]
   ]
 }
 Pipe this file to a stream (an object with a 'write' method)
@@ -72,5 +72,6 @@ void jswrap_E_unmountSD();
 
 size_t jswrap_file_write(JsVar* parent, JsVar* buffer);
 JsVar *jswrap_file_read(JsVar* parent, int length);
+int jswrap_file_readInto(JsVar* parent, JsVar* buffer, int offset, JsVar* length);
 void jswrap_file_skip_or_seek(JsVar* parent, int length, bool is_skip);
 void jswrap_file_close(JsVar* parent);
@@ -0,0 +1,336 @@
+/*
+ * This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * ----------------------------------------------------------------------------
+ * This file is designed to be parsed during the build process
+ *
+ * Append-only binary data logs, stored in a file
+ *
+ * The file starts with a header:
+ *   "ELOG" + uint16 version + uint16 recordSize + 8 bytes reserved
+ * followed by records, each of which is a little-endian double timestamp
+ * and then recordSize bytes of data. Timestamps never go backwards, and
+ * as every record is the same size the file can be binary searched on
+ * time directly, without reading (or keeping) a separate index.
+ * ----------------------------------------------------------------------------
+ */
+#include "jswrap_log.h"
+#include "jswrap_file.h"
+#include "jswrap_fs.h"
+#include "jswrap_arraybuffer.h"
+#include "jsparse.h"
+#include "jsinteractive.h"
+
+#define LOG_MAGIC "ELOG"
+#define LOG_VERSION 1
+#define LOG_HEADER_SIZE 16
+#define LOG_TIME_SIZE 8
+#define LOG_MAX_RECORD_SIZE 1024
+
+#define LOG_PATH_NAME JS_HIDDEN_CHAR_STR"path"
+#define LOG_RECORDSIZE_NAME JS_HIDDEN_CHAR_STR"rs"
+#define LOG_COUNT_NAME JS_HIDDEN_CHAR_STR"cnt"
+#define LOG_LASTTIME_NAME JS_HIDDEN_CHAR_STR"lt"
+
+/*JSON{
+  "type" : "class",
+  "class" : "DataLog",
+  "ifndef" : "SAVE_ON_FLASH"
+}
+An append-only log of fixed-size binary records, each with a timestamp.
+Create one with `E.createLog`.
+
+Records are written straight to the file as binary, so appending is much
+faster than formatting JSON for `fs.appendFileSync`, and `DataLog.query`
+finds the records it needs by binary search without reading the whole file.
+*/
+
+static JsVar *logOpenFile(JsVar *log, const char *mode) {
+  JsVar *path = jsvObjectGetChild(log, LOG_PATH_NAME, 0);
+  JsVar *modeVar = jsvNewFromString(mode);
+  JsVar *f = jswrap_E_openFile(path, modeVar);
+  jsvUnLock2(path, modeVar);
+  return f;
+}
+
+static size_t logGetRecordSize(JsVar *log) {
+  return (size_t)jsvGetIntegerAndUnLock(jsvObjectGetChild(log, LOG_RECORDSIZE_NAME, 0));
+}
+
+/// Read len bytes from the file's current position. Returns false if there weren't enough
+static bool logRead(JsVar *f, char *buf, size_t len) {
+  JsVar *s = jswrap_file_read(f, (int)len);
+  // not jsvGetStringChars, as that adds a trailing 0
+  size_t l = 0;
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, s, 0);
+  while (l<len && jsvStringIteratorHasChar(&it)) {
+    buf[l++] = jsvStringIteratorGetChar(&it);
+    jsvStringIteratorNext(&it);
+  }
+  jsvStringIteratorFree(&it);
+  jsvUnLock(s);
+  return l == len;
+}
+
+/// Read the timestamp of the given record
+static JsVarFloat logReadTime(JsVar *f, size_t recordSize, size_t record) {
+  double t = 0; // always stored as a double, even with USE_FLOATS
+  jswrap_file_skip_or_seek(f, (int)(LOG_HEADER_SIZE + record*(LOG_TIME_SIZE+recordSize)), false);
+  logRead(f, (char*)&t, sizeof(t));
+  return (JsVarFloat)t;
+}
+
+/// Find the first record with a time that is >= (or > if 'after') the given time
+static size_t logFindTime(JsVar *f, size_t recordSize, size_t count, JsVarFloat time, bool after) {
+  size_t lo = 0, hi = count;
+  while (lo < hi) {
+    size_t mid = (lo+hi)/2;
+    JsVarFloat t = logReadTime(f, recordSize, mid);
+    if (after ? (t <= time) : (t < time)) lo = mid+1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+/*JSON{
+  "type" : "staticmethod",
+  "class" : "E",
+  "name" : "createLog",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_E_createLog",
+  "params" : [
+    ["path","JsVar","The path of the file to log to"],
+    ["options","JsVar","An object `{ recordSize : int }` - the size in bytes of the data in each record. This can be left out if the log already exists"]
+  ],
+  "return" : ["JsVar","A DataLog object"],
+  "return_object" : "DataLog"
+}
+Open an append-only binary log in a file, creating it if it doesn't exist.
+For example to log 3 16 bit values each time:
+
+```
+var log = E.createLog("accel.log", {recordSize:6});
+log.append(new Int16Array([x,y,z]).buffer);
+// ...
+var r = log.query(getTime()-60, getTime());
+// r.time is a Float64Array of timestamps, r.data is a Uint8Array
+var xyz = new Int16Array(r.data.buffer);
+```
+*/
+JsVar *jswrap_E_createLog(JsVar *path, JsVar *options) {
+  if (!jsvIsString(path)) {
+    jsExceptionHere(JSET_TYPEERROR, "Expecting a path as a String, got %t", path);
+    return 0;
+  }
+  JsVarInt recordSize = 0;
+  if (jsvIsObject(options))
+    recordSize = jsvGetIntegerAndUnLock(jsvObjectGetChild(options, "recordSize", 0));
+  else if (!jsvIsUndefined(options)) {
+    jsExceptionHere(JSET_TYPEERROR, "'options' must be an object, or undefined");
+    return 0;
+  }
+
+  char header[LOG_HEADER_SIZE];
+  size_t count = 0;
+  JsVarFloat lastTime = -INFINITY;
+  JsVar *stat = jswrap_fs_stat(path);
+  JsVarInt fileSize = stat ? jsvGetIntegerAndUnLock(jsvObjectGetChild(stat, "size", 0)) : 0;
+  jsvUnLock(stat);
+  JsVar *log = jspNewObject(0, "DataLog");
+  if (!log) return 0;
+  jsvObjectSetChild(log, LOG_PATH_NAME, path);
+
+  if (fileSize > 0) {
+    // existing log - check the header, and find how many records we have
+    JsVar *f = logOpenFile(log, "r");
+    bool ok = f && logRead(f, header, LOG_HEADER_SIZE) &&
+              memcmp(header, LOG_MAGIC, 4)==0 && header[4]==LOG_VERSION;
+    JsVarInt fileRecordSize = (unsigned char)header[6] | ((unsigned char)header[7]<<8);
+    if (!ok) {
+      jsExceptionHere(JSET_ERROR, "File is not a DataLog");
+    } else if (recordSize && recordSize!=fileRecordSize) {
+      jsExceptionHere(JSET_ERROR, "DataLog has a recordSize of %d, not %d", (int)fileRecordSize, (int)recordSize);
+      ok = false;
+    } else {
+      recordSize = fileRecordSize;
+      count = (size_t)(fileSize-LOG_HEADER_SIZE) / (size_t)(LOG_TIME_SIZE+recordSize);
+      if (count) lastTime = logReadTime(f, (size_t)recordSize, count-1);
+    }
+    if (f) jswrap_file_close(f);
+    jsvUnLock(f);
+    if (!ok) {
+      jsvUnLock(log);
+      return 0;
+    }
+  } else {
+    // new log - write the header
+    if (recordSize<1 || recordSize>LOG_MAX_RECORD_SIZE) {
+      jsExceptionHere(JSET_ERROR, "recordSize must be between 1 and %d", LOG_MAX_RECORD_SIZE);
+      jsvUnLock(log);
+      return 0;
+    }
+    memset(header, 0, sizeof(header));
+    memcpy(header, LOG_MAGIC, 4);
+    header[4] = LOG_VERSION;
+    header[6] = (char)(recordSize&255);
+    header[7] = (char)(recordSize>>8);
+    JsVar *f = logOpenFile(log, "w");
+    JsVar *data = jsvNewStringOfLength(LOG_HEADER_SIZE);
+    if (data) jsvSetString(data, header, LOG_HEADER_SIZE);
+    size_t written = (f && data) ? jswrap_file_write(f, data) : 0;
+    if (f) jswrap_file_close(f);
+    jsvUnLock2(f, data);
+    if (written != LOG_HEADER_SIZE) {
+      jsvUnLock(log);
+      return 0;
+    }
+  }
+  jsvObjectSetChildAndUnLock(log, LOG_RECORDSIZE_NAME, jsvNewFromInteger(recordSize));
+  jsvObjectSetChildAndUnLock(log, LOG_COUNT_NAME, jsvNewFromInteger((JsVarInt)count));
+  jsvObjectSetChildAndUnLock(log, LOG_LASTTIME_NAME, jsvNewFromFloat(lastTime));
+  return log;
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "DataLog",
+  "name" : "append",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_datalog_append",
+  "params" : [
+    ["data","JsVar","The data for the record - an ArrayBuffer, typed array, String or array of bytes. If it is shorter than `recordSize` it is padded with 0"],
+    ["time","JsVar","(optional) The time of the record. Defaults to `getTime()`. This can't be earlier than the time of the last record"]
+  ],
+  "return" : ["bool","True on success"]
+}
+Add a record to the end of the log
+*/
+bool jswrap_datalog_append(JsVar *parent, JsVar *data, JsVar *time) {
+  size_t recordSize = logGetRecordSize(parent);
+  if (!recordSize) return false;
+  JsVarFloat t = jsvIsUndefined(time) ?
+      (JsVarFloat)jshGetSystemTime() / (JsVarFloat)jshGetTimeFromMilliseconds(1000) :
+      jsvGetFloat(time);
+  JsVarFloat lastTime = jsvGetFloatAndUnLock(jsvObjectGetChild(parent, LOG_LASTTIME_NAME, 0));
+  if (!(t >= lastTime)) {
+    jsExceptionHere(JSET_ERROR, "Record time can't be before the last record's");
+    return false;
+  }
+  if (jsvIterateCallbackCount(data) > (int)recordSize) {
+    jsExceptionHere(JSET_ERROR, "Data is longer than recordSize (%d)", (int)recordSize);
+    return false;
+  }
+  JsVar *record = jsvNewStringOfLength((unsigned int)(LOG_TIME_SIZE+recordSize));
+  if (!record) return false;
+  // the time, then the data - anything after it is already 0
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, record, 0);
+  double td = (double)t; // always stored as a double, even with USE_FLOATS
+  size_t i;
+  for (i=0;i<sizeof(td);i++) {
+    jsvStringIteratorSetChar(&it, ((char*)&td)[i]);
+    jsvStringIteratorNext(&it);
+  }
+  JsvIterator dit;
+  jsvIteratorNew(&dit, data);
+  while (jsvIteratorHasElement(&dit) && jsvStringIteratorHasChar(&it)) {
+    jsvStringIteratorSetChar(&it, (char)jsvIteratorGetIntegerValue(&dit));
+    jsvStringIteratorNext(&it);
+    jsvIteratorNext(&dit);
+  }
+  jsvIteratorFree(&dit);
+  jsvStringIteratorFree(&it);
+
+  bool ok = false;
+  JsVar *f = logOpenFile(parent, "a");
+  if (f) {
+    ok = jswrap_file_write(f, record) == LOG_TIME_SIZE+recordSize;
+    jswrap_file_close(f);
+    jsvUnLock(f);
+  }
+  jsvUnLock(record);
+  if (ok) {
+    JsVarInt count = jsvGetIntegerAndUnLock(jsvObjectGetChild(parent, LOG_COUNT_NAME, 0));
+    jsvObjectSetChildAndUnLock(parent, LOG_COUNT_NAME, jsvNewFromInteger(count+1));
+    jsvObjectSetChildAndUnLock(parent, LOG_LASTTIME_NAME, jsvNewFromFloat(t));
+  }
+  return ok;
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "DataLog",
+  "name" : "getLength",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_datalog_getLength",
+  "return" : ["int32","The number of records in the log"]
+}
+*/
+int jswrap_datalog_getLength(JsVar *parent) {
+  return (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(parent, LOG_COUNT_NAME, 0));
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "DataLog",
+  "name" : "query",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_datalog_query",
+  "params" : [
+    ["from","JsVar","(optional) The earliest time to return records for"],
+    ["to","JsVar","(optional) The latest time to return records for"]
+  ],
+  "return" : ["JsVar","An object `{ time : Float64Array, data : Uint8Array }`"]
+}
+Return all records with a time between `from` and `to` (inclusive). The
+records are found by binary search, so only the ones that are returned
+are read from the file in full.
+
+`data` contains `recordSize` bytes for each record, one after the other.
+*/
+JsVar *jswrap_datalog_query(JsVar *parent, JsVar *from, JsVar *to) {
+  size_t recordSize = logGetRecordSize(parent);
+  size_t count = (size_t)jswrap_datalog_getLength(parent);
+  if (!recordSize) return 0;
+  JsVar *f = count ? logOpenFile(parent, "r") : 0;
+  size_t start = 0, end = count;
+  if (f) {
+    if (!jsvIsUndefined(from))
+      start = logFindTime(f, recordSize, count, jsvGetFloat(from), false);
+    if (!jsvIsUndefined(to))
+      end = logFindTime(f, recordSize, count, jsvGetFloat(to), true);
+  }
+  if (end < start) end = start;
+  size_t n = end - start;
+
+  JsVar *result = jsvNewObject();
+  JsVar *times = jsvNewTypedArray(ARRAYBUFFERVIEW_FLOAT64, (JsVarInt)n);
+  JsVar *data = jsvNewTypedArray(ARRAYBUFFERVIEW_UINT8, (JsVarInt)(n*recordSize));
+  if (result && times && data && n) {
+    JsVar *timeLen = jsvNewFromInteger(LOG_TIME_SIZE);
+    JsVar *dataLen = jsvNewFromInteger((JsVarInt)recordSize);
+    jswrap_file_skip_or_seek(f, (int)(LOG_HEADER_SIZE + start*(LOG_TIME_SIZE+recordSize)), false);
+    size_t i;
+    for (i=0;i<n && !jspIsInterrupted();i++) {
+      if (jswrap_file_readInto(f, times, (int)(i*LOG_TIME_SIZE), timeLen) != LOG_TIME_SIZE ||
+          jswrap_file_readInto(f, data, (int)(i*recordSize), dataLen) != (int)recordSize)
+        break;
+    }
+    jsvUnLock2(timeLen, dataLen);
+  }
+  if (f) {
+    jswrap_file_close(f);
+    jsvUnLock(f);
+  }
+  if (result) {
+    jsvObjectSetChild(result, "time", times);
+    jsvObjectSetChild(result, "data", data);
+  }
+  jsvUnLock2(times, data);
+  return result;
+}
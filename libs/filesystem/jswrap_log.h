@@ -0,0 +1,17 @@
+/*
+ * This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * ----------------------------------------------------------------------------
+ * Append-only binary data logs, stored in a file
+ * ----------------------------------------------------------------------------
+ */
+#include "jsvar.h"
+
+JsVar *jswrap_E_createLog(JsVar *path, JsVar *options);
+bool jswrap_datalog_append(JsVar *parent, JsVar *data, JsVar *time);
+int jswrap_datalog_getLength(JsVar *parent);
+JsVar *jswrap_datalog_query(JsVar *parent, JsVar *from, JsVar *to);
@@ -166,13 +166,11 @@ void graphicsDrawChar4x6(JsGraphics *gfx, short x1, short y1, char ch) {
   if (idx<0 || idx>=LCD_FONT_4X6_CHARS) return; // no char for this - just return
   int cidx = idx % 5;
   idx = (idx/5)*6;
+  uint32_t rows[6];
   int y;
-  for (y=0;y<6;y++) {
-    unsigned int line = READ_FLASH_UINT16(&LCD_FONT_4X6[idx + y]) >> (cidx*3);
-    if (line&4) graphicsSetPixel(gfx, (short)(x1+0), (short)(y+y1), gfx->data.fgColor);
-    if (line&2) graphicsSetPixel(gfx, (short)(x1+1), (short)(y+y1), gfx->data.fgColor);
-    if (line&1) graphicsSetPixel(gfx, (short)(x1+2), (short)(y+y1), gfx->data.fgColor);
-  }
+  for (y=0;y<6;y++)
+    rows[y] = (READ_FLASH_UINT16(&LCD_FONT_4X6[idx + y]) >> (cidx*3)) & 7;
+  graphicsDrawGlyph(gfx, x1, y1, 3, 6, rows);
 }
 
 
@@ -67,6 +67,9 @@ bool graphicsGetFromVar(JsGraphics *gfx, JsVar *parent) {
     gfx->setPixel = graphicsFallbackSetPixel;
     gfx->getPixel = graphicsFallbackGetPixel;
     gfx->fillRect = graphicsFallbackFillRect;
+    gfx->drawGlyph = 0;
+    gfx->blit = 0;
+    gfx->backendData = 0;
 #ifdef USE_LCD_SDL
     if (gfx->data.type == JSGRAPHICSTYPE_SDL) {
       lcdSetCallbacks_SDL(gfx);
@@ -119,12 +122,83 @@ void graphicsToDeviceCoordinates(const JsGraphics *gfx, short *x, short *y) {
 
 // ----------------------------------------------------------------------------------------------
 
+void graphicsResetModified(JsGraphics *gfx) {
+  gfx->data.modMaxX = -32768;
+  gfx->data.modMaxY = -32768;
+  gfx->data.modMinX = 32767;
+  gfx->data.modMinY = 32767;
+  gfx->data.dirtyCount = 0;
+}
+
+static int graphicsRectArea(short x1, short y1, short x2, short y2) {
+  return (x2+1-x1) * (y2+1-y1);
+}
+
+/// How much extra area we'd send if we merged r into d
+static int graphicsRectMergeCost(const JsGraphicsRect *d, const JsGraphicsRect *r) {
+  int merged = graphicsRectArea(
+      (r->x1 < d->x1) ? r->x1 : d->x1, (r->y1 < d->y1) ? r->y1 : d->y1,
+      (r->x2 > d->x2) ? r->x2 : d->x2, (r->y2 > d->y2) ? r->y2 : d->y2);
+  return merged - graphicsRectArea(d->x1,d->y1,d->x2,d->y2) - graphicsRectArea(r->x1,r->y1,r->x2,r->y2);
+}
+
+/// Do the rectangles overlap or touch?
+static bool graphicsRectTouches(const JsGraphicsRect *d, const JsGraphicsRect *r) {
+  return r->x1 <= d->x2+1 && r->x2+1 >= d->x1 &&
+         r->y1 <= d->y2+1 && r->y2+1 >= d->y1;
+}
+
+static void graphicsRectMerge(JsGraphicsRect *d, const JsGraphicsRect *r) {
+  if (r->x1 < d->x1) d->x1 = r->x1;
+  if (r->y1 < d->y1) d->y1 = r->y1;
+  if (r->x2 > d->x2) d->x2 = r->x2;
+  if (r->y2 > d->y2) d->y2 = r->y2;
+}
+
+void graphicsSetModified(JsGraphics *gfx, short x1, short y1, short x2, short y2) {
+  if (x1 < gfx->data.modMinX) gfx->data.modMinX=x1;
+  if (x2 > gfx->data.modMaxX) gfx->data.modMaxX=x2;
+  if (y1 < gfx->data.modMinY) gfx->data.modMinY=y1;
+  if (y2 > gfx->data.modMaxY) gfx->data.modMaxY=y2;
+
+  JsGraphicsRect r = { x1, y1, x2, y2 };
+  JsGraphicsRect *dirty = gfx->data.dirty;
+  int i, best = -1, bestCost = 0;
+  for (i=0;i<gfx->data.dirtyCount;i++) {
+    if (graphicsRectTouches(&dirty[i], &r)) {
+      best = i;
+      break;
+    }
+  }
+  if (best<0) {
+    if (gfx->data.dirtyCount<JSGRAPHICS_DIRTY_RECTS) {
+      dirty[gfx->data.dirtyCount++] = r;
+      return;
+    }
+    // out of rectangles - merge with whichever adds the least area
+    for (i=0;i<gfx->data.dirtyCount;i++) {
+      int cost = graphicsRectMergeCost(&dirty[i], &r);
+      if (best<0 || cost<bestCost) {
+        best = i;
+        bestCost = cost;
+      }
+    }
+  }
+  graphicsRectMerge(&dirty[best], &r);
+  // the bigger rectangle may now overlap others - fold those in too
+  for (i=gfx->data.dirtyCount-1;i>=0;i--) {
+    if (i!=best && graphicsRectTouches(&dirty[best], &dirty[i])) {
+      graphicsRectMerge(&dirty[best], &dirty[i]);
+      gfx->data.dirtyCount--;
+      dirty[i] = dirty[gfx->data.dirtyCount];
+      if (best==gfx->data.dirtyCount) best = i;
+    }
+  }
+}
+
 static void graphicsSetPixelDevice(JsGraphics *gfx, short x, short y, unsigned int col) {
   if (x<0 || y<0 || x>=gfx->data.width || y>=gfx->data.height) return;
-  if (x < gfx->data.modMinX) gfx->data.modMinX=x;
-  if (x > gfx->data.modMaxX) gfx->data.modMaxX=x;
-  if (y < gfx->data.modMinY) gfx->data.modMinY=y;
-  if (y > gfx->data.modMaxY) gfx->data.modMaxY=y;
+  graphicsSetModified(gfx, x, y, x, y);
   gfx->setPixel(gfx,x,y,col & (unsigned int)((1L<<gfx->data.bpp)-1));
 }
 
@@ -150,15 +224,11 @@ static void graphicsFillRectDevice(JsGraphics *gfx, short x1, short y1, short x2
   if (y2>=gfx->data.height) y2 = (short)(gfx->data.height - 1);
   if (x2<x1 || y2<y1) return; // nope
 
-  if (x1 < gfx->data.modMinX) gfx->data.modMinX=x1;
-  if (x2 > gfx->data.modMaxX) gfx->data.modMaxX=x2;
-  if (y1 < gfx->data.modMinY) gfx->data.modMinY=y1;
-  if (y2 > gfx->data.modMaxY) gfx->data.modMaxY=y2;
-
   if (x1==x2 && y1==y2) {
     graphicsSetPixelDevice(gfx,x1,y1,gfx->data.fgColor);
     return;
   }
+  graphicsSetModified(gfx, x1, y1, x2, y2);
 
   return gfx->fillRect(gfx, x1, y1, x2, y2);
 }
@@ -209,6 +279,37 @@ void graphicsDrawString(JsGraphics *gfx, short x1, short y1, const char *str) {
   }
 }
 
+void graphicsDrawGlyph(JsGraphics *gfx, short x1, short y1, short width, short height, const uint32_t *rows) {
+  // Work out which pixels are actually set, so the modified area is the same as if we'd set them one at a time
+  uint32_t allRows = 0;
+  short y, firstRow = -1, lastRow = -1;
+  for (y=0;y<height;y++) {
+    if (rows[y]) {
+      if (firstRow<0) firstRow = y;
+      lastRow = y;
+      allRows |= rows[y];
+    }
+  }
+  if (firstRow<0) return; // nothing to draw
+  short firstCol = 0, lastCol = (short)(width-1);
+  while (!(allRows & (1U<<(width-1-firstCol)))) firstCol++;
+  while (!(allRows & (1U<<(width-1-lastCol)))) lastCol--;
+  // The backend can write whole bytes at once if we're not rotated and the glyph is on screen
+  if (gfx->drawGlyph &&
+      !(gfx->data.flags & (JSGRAPHICSFLAGS_SWAP_XY|JSGRAPHICSFLAGS_INVERT_X|JSGRAPHICSFLAGS_INVERT_Y)) &&
+      x1>=0 && y1>=0 && x1+width<=gfx->data.width && y1+height<=gfx->data.height) {
+    graphicsSetModified(gfx, (short)(x1+firstCol), (short)(y1+firstRow), (short)(x1+lastCol), (short)(y1+lastRow));
+    gfx->drawGlyph(gfx, x1, y1, width, height, rows);
+    return;
+  }
+  for (y=firstRow;y<=lastRow;y++) {
+    short x;
+    for (x=firstCol;x<=lastCol;x++)
+      if (rows[y] & (1U<<(width-1-x)))
+        graphicsSetPixel(gfx, (short)(x1+x), (short)(y1+y), gfx->data.fgColor);
+  }
+}
+
 void graphicsDrawLine(JsGraphics *gfx, short x1, short y1, short x2, short y2) {
   graphicsToDeviceCoordinates(gfx, &x1, &y1);
   graphicsToDeviceCoordinates(gfx, &x2, &y2);
@@ -246,33 +347,13 @@ void graphicsDrawLine(JsGraphics *gfx, short x1, short y1, short x2, short y2) {
   }
 }
 
-static inline void graphicsFillPolyCreateScanLines(JsGraphics *gfx, short *minx, short *maxx, short x1, short y1,short x2, short y2) {
-    if (y2 < y1) {
-        short t;
-        t=x1;x1=x2;x2=t;
-        t=y1;y1=y2;y2=t;
-    }
-    int xh = x1*256;
-    int yl = y2-y1;
-    if (yl==0) yl=1;
-    int stepx = (x2-x1)*256 / yl;
-    short y;
-    for (y=y1;y<=y2;y++) {
-        int x = xh>>8;
-        if (x<-32768) x=-32768;
-        if (x>32767) x=32767;
-        if (y>=0 && y<gfx->data.height) {
-            if (x<minx[y]) {
-                minx[y] = (short)x;
-            }
-            if (x>maxx[y]) {
-                maxx[y] = (short)x;
-            }
-        }
-        xh += stepx;
-    }
-}
+typedef struct {
+  short y1, y2; ///< y1<=y2
+  int xh; ///< x at y1, in 1/256ths of a pixel
+  int stepx; ///< change in xh per scanline
+} GfxPolyEdge;
 
+/// Fills the span between the leftmost and rightmost edge on each scanline, using fillRect
 void graphicsFillPoly(JsGraphics *gfx, int points, short *vertices) {
   int i;
   short miny = (short)(gfx->data.height-1);
@@ -286,40 +367,81 @@ void graphicsFillPoly(JsGraphics *gfx, int points, short *vertices) {
   }
   if (miny<0) miny=0;
   if (maxy>=gfx->data.height) maxy=(short)(gfx->data.height-1);
-  short minx[gfx->data.height];
-  short maxx[gfx->data.height];
-  short y;
-  for (y=miny;y<=maxy;y++) {
-    minx[y] = (short)(gfx->data.width);
-    maxx[y] = -1;
-  }
+  if (points<=0 || miny>maxy) return;
+  // build the edge table, sorted by the top of the edge
+  GfxPolyEdge edges[points];
   int j = (points-1)*2;
-  for (i=0;i<points*2;i+=2) {
-    graphicsFillPolyCreateScanLines(gfx, minx, maxx, vertices[j+0], vertices[j+1], vertices[i+0], vertices[i+1]);
-    j = i;
+  for (i=0;i<points;i++) {
+    short x1 = vertices[j+0], y1 = vertices[j+1];
+    short x2 = vertices[i*2+0], y2 = vertices[i*2+1];
+    j = i*2;
+    if (y2 < y1) {
+      short t;
+      t=x1;x1=x2;x2=t;
+      t=y1;y1=y2;y2=t;
+    }
+    int yl = y2-y1;
+    if (yl==0) yl=1;
+    GfxPolyEdge e = { y1, y2, x1*256, (x2-x1)*256 / yl };
+    int k = i;
+    while (k>0 && edges[k-1].y1 > e.y1) {
+      edges[k] = edges[k-1];
+      k--;
+    }
+    edges[k] = e;
   }
-  for (y=miny;y<=maxy;y++) {
-    if (maxx[y]>=minx[y] && maxx[y]>=0 && minx[y]<gfx->data.width) {
-      // clip
-      if (minx[y]<0) minx[y]=0;
-      if (maxx[y]>=gfx->data.width) maxx[y]=(short)(gfx->data.width-1);
-      // try and expand the rect that we fill
-      short oldy = y;
-      while (y<maxy && minx[y+1]==minx[oldy] && maxx[y+1]==maxx[oldy])
-        y++;
-      // actually fill
-      graphicsFillRectDevice(gfx,minx[y],oldy,maxx[y],y);
+  // now go down scanlines, merging identical spans into one fillRect
+  short spanMinX = 0, spanMaxX = -1, spanY = 0;
+  short y;
+  for (y=miny;y<=maxy+1;y++) {
+    int minx = gfx->data.width, maxx = -1;
+    if (y<=maxy) {
+      for (i=0;i<points && edges[i].y1<=y;i++) {
+        if (edges[i].y2 < y) continue;
+        int x = (edges[i].xh + (y-edges[i].y1)*edges[i].stepx) >> 8;
+        if (x<minx) minx = x;
+        if (x>maxx) maxx = x;
+      }
+      if (maxx>=minx && maxx>=0 && minx<gfx->data.width) {
+        // clip
+        if (minx<0) minx=0;
+        if (maxx>=gfx->data.width) maxx=gfx->data.width-1;
+      } else {
+        minx = 0;
+        maxx = -1; // empty
+      }
+    }
+    if (minx!=spanMinX || maxx!=spanMaxX || y>maxy) {
+      if (spanMaxX>=spanMinX)
+        graphicsFillRectDevice(gfx,spanMinX,spanY,spanMaxX,(short)(y-1));
       if (jspIsInterrupted()) break;
+      spanMinX = (short)minx;
+      spanMaxX = (short)maxx;
+      spanY = y;
     }
   }
 }
 
 #ifndef SAVE_ON_FLASH
-// prints character, returns width
-unsigned int graphicsFillVectorChar(JsGraphics *gfx, short x1, short y1, short size, char ch) {
-  // no need to modify coordinates as graphicsFillPoly does that
-  if (size<0) return 0;
-  if (ch<vectorFontOffset || ch-vectorFontOffset>=vectorFontCount) return 0;
+#define GLYPH_CACHE_SIZE 16 ///< How many rasterised vector font characters each Graphics keeps
+#define GLYPH_CACHE_MAX_BYTES 256 ///< Characters bigger than this (as a 1bpp bitmap) aren't cached
+
+static void graphicsGlyphFillRect(JsGraphics *gfx, short x1, short y1, short x2, short y2) {
+  unsigned char *bmp = (unsigned char*)gfx->backendData;
+  int stride = (gfx->data.width+7)>>3;
+  short x, y;
+  for (y=y1;y<=y2;y++)
+    for (x=x1;x<=x2;x++)
+      bmp[2 + y*stride + (x>>3)] |= (unsigned char)(0x80>>(x&7));
+}
+
+static void graphicsGlyphSetPixel(JsGraphics *gfx, short x, short y, unsigned int col) {
+  if (col) graphicsGlyphFillRect(gfx, x, y, x, y);
+}
+
+/** Calls graphicsFillPoly for each polygon in the character at x1,y1 and returns the
+ * character width. If extent is set, don't draw - just put the maximum x and y in it */
+static unsigned int graphicsVectorCharPolys(JsGraphics *gfx, short x1, short y1, short size, char ch, short *extent) {
   int vertOffset = 0;
   int i;
   /* compute offset (I figure a ~50 iteration FOR loop is preferable to
@@ -335,9 +457,13 @@ unsigned int graphicsFillVectorChar(JsGraphics *gfx, short x1, short y1, short s
   for (i=0;i<vector.vertCount;i+=2) {
     verts[idx+0] = (short)(x1 + (((READ_FLASH_UINT8(&vectorFontPolys[vertOffset+i+0])&0x7F)*size + (VECTOR_FONT_POLY_SIZE/2)) / VECTOR_FONT_POLY_SIZE));
     verts[idx+1] = (short)(y1 + (((READ_FLASH_UINT8(&vectorFontPolys[vertOffset+i+1])&0x7F)*size + (VECTOR_FONT_POLY_SIZE/2)) / VECTOR_FONT_POLY_SIZE));
+    if (extent) {
+      if (verts[idx+0]>extent[0]) extent[0] = verts[idx+0];
+      if (verts[idx+1]>extent[1]) extent[1] = verts[idx+1];
+    }
     idx+=2;
     if (READ_FLASH_UINT8(&vectorFontPolys[vertOffset+i+1]) & VECTOR_FONT_POLY_SEPARATOR) {
-      graphicsFillPoly(gfx,idx/2, verts);
+      if (!extent) graphicsFillPoly(gfx,idx/2, verts);
 
       if (jspIsInterrupted()) break;
       idx=0;
@@ -346,6 +472,112 @@ unsigned int graphicsFillVectorChar(JsGraphics *gfx, short x1, short y1, short s
   return (vector.width * (unsigned int)size)/(VECTOR_FONT_POLY_SIZE*2);
 }
 
+/** Get a flat string containing the character as a 1bpp bitmap in DEVICE orientation (width,
+ * height, then rows of pixels MSB first), rasterising it if it's not in the Graphics instance's
+ * least-recently-used cache. Returns 0 if it's too big to cache or we're out of memory */
+static JsVar *graphicsGetGlyph(JsGraphics *gfx, short size, char ch) {
+  JsGraphicsFlags orientation = gfx->data.flags & (JSGRAPHICSFLAGS_SWAP_XY|JSGRAPHICSFLAGS_INVERT_X|JSGRAPHICSFLAGS_INVERT_Y);
+  JsVar *cache = jsvObjectGetChild(gfx->graphicsVar, JSGRAPHICS_GLYPH_CACHE, JSV_OBJECT);
+  if (!cache) return 0;
+  char key[10];
+  key[0] = ch;
+  key[1] = (char)('0' + (orientation/JSGRAPHICSFLAGS_SWAP_XY));
+  itostr(size, &key[2], 10);
+  JsVar *glyph = 0;
+  JsVar *glyphName = jsvFindChildFromString(cache, key, false);
+  if (glyphName) {
+    // most recently used go at the end
+    glyph = jsvSkipName(glyphName);
+    jsvRemoveChild(cache, glyphName);
+    jsvAddName(cache, glyphName);
+    jsvUnLock2(glyphName, cache);
+    return glyph;
+  }
+  // Not found - work out how big it is
+  short extent[2] = { 0, 0 };
+  graphicsVectorCharPolys(gfx, 0, 0, size, ch, extent);
+  int w = extent[0]+1, h = extent[1]+1;
+  if (orientation & JSGRAPHICSFLAGS_SWAP_XY) {
+    int t = w;
+    w = h;
+    h = t;
+  }
+  int bytes = ((w+7)>>3)*h;
+  if (w<=255 && h<=255 && bytes<=GLYPH_CACHE_MAX_BYTES) {
+    if (jsvGetChildren(cache) >= GLYPH_CACHE_SIZE) {
+      JsVar *oldest = jsvGetFirstName(cache);
+      jsvRemoveChild(cache, oldest);
+      jsvUnLock(oldest);
+    }
+    glyph = jsvNewFlatStringOfLength((unsigned int)(2+bytes));
+  }
+  if (glyph) {
+    unsigned char *bmp = (unsigned char*)jsvGetFlatStringPointer(glyph);
+    memset(bmp, 0, (size_t)(2+bytes));
+    bmp[0] = (unsigned char)w;
+    bmp[1] = (unsigned char)h;
+    /* rasterise with a Graphics that writes into the bitmap. Do it in device orientation, so
+     * we get exactly the same pixels that graphicsFillPoly would have drawn */
+    JsGraphics glyphGfx;
+    graphicsStructInit(&glyphGfx);
+    glyphGfx.data.flags = orientation;
+    glyphGfx.graphicsVar = 0;
+    glyphGfx.data.width = (unsigned short)w;
+    glyphGfx.data.height = (unsigned short)h;
+    glyphGfx.data.bpp = 1;
+    glyphGfx.setPixel = graphicsGlyphSetPixel;
+    glyphGfx.fillRect = graphicsGlyphFillRect;
+    glyphGfx.getPixel = graphicsFallbackGetPixel;
+    glyphGfx.backendData = bmp;
+    graphicsVectorCharPolys(&glyphGfx, 0, 0, size, ch, 0);
+    if (jspIsInterrupted()) { // don't cache a half-drawn character
+      jsvUnLock2(glyph, cache);
+      return 0;
+    }
+    jsvObjectSetChild(cache, key, glyph);
+  }
+  jsvUnLock(cache);
+  return glyph;
+}
+
+// prints character, returns width
+unsigned int graphicsFillVectorChar(JsGraphics *gfx, short x1, short y1, short size, char ch) {
+  if (size<0) return 0;
+  if (ch<vectorFontOffset || ch-vectorFontOffset>=vectorFontCount) return 0;
+  JsVar *glyph = graphicsGetGlyph(gfx, size, ch);
+  if (!glyph) // no need to modify coordinates as graphicsFillPoly does that
+    return graphicsVectorCharPolys(gfx, x1, y1, size, ch, 0);
+  const unsigned char *bmp = (const unsigned char*)jsvGetFlatStringPointer(glyph);
+  int w = bmp[0], h = bmp[1], stride = (w+7)>>3;
+  // work out where the top-left of the bitmap is on the device
+  short x2 = (short)(x1+w-1), y2 = (short)(y1+h-1);
+  if (gfx->data.flags & JSGRAPHICSFLAGS_SWAP_XY) {
+    x2 = (short)(x1+h-1);
+    y2 = (short)(y1+w-1);
+  }
+  graphicsToDeviceCoordinates(gfx, &x1, &y1);
+  graphicsToDeviceCoordinates(gfx, &x2, &y2);
+  if (x2<x1) x1 = x2;
+  if (y2<y1) y1 = y2;
+  // fill each run of set pixels in the bitmap
+  int x, y;
+  for (y=0;y<h;y++) {
+    const unsigned char *row = &bmp[2 + y*stride];
+    x = 0;
+    while (x<w) {
+      if (!(row[x>>3] & (0x80>>(x&7)))) {
+        x++;
+        continue;
+      }
+      int start = x;
+      while (x<w && (row[x>>3] & (0x80>>(x&7)))) x++;
+      graphicsFillRectDevice(gfx, (short)(x1+start), (short)(y1+y), (short)(x1+x-1), (short)(y1+y));
+    }
+  }
+  jsvUnLock(glyph);
+  return graphicsVectorCharWidth(gfx, size, ch);
+}
+
 // returns the width of a character
 unsigned int graphicsVectorCharWidth(JsGraphics *gfx, short size, char ch) {
   NOT_USED(gfx);
@@ -51,6 +51,20 @@ typedef enum {
 #define JSGRAPHICS_CUSTOMFONT_WIDTH JS_HIDDEN_CHAR_STR"fnW"
 #define JSGRAPHICS_CUSTOMFONT_HEIGHT JS_HIDDEN_CHAR_STR"fnH"
 #define JSGRAPHICS_CUSTOMFONT_FIRSTCHAR JS_HIDDEN_CHAR_STR"fn1"
+#define JSGRAPHICS_CUSTOMFONT_COMPRESSED JS_HIDDEN_CHAR_STR"fnZ" ///< set if the custom font bitmap is heatshrink compressed
+#define JSGRAPHICS_FLIP_CALLBACK JS_HIDDEN_CHAR_STR"flp"
+#define JSGRAPHICS_GLYPH_CACHE JS_HIDDEN_CHAR_STR"fnC" ///< cache of rasterised vector font characters
+#define JSGRAPHICS_FRONT_BUFFER JS_HIDDEN_CHAR_STR"fBf" ///< doubleBuffer: the buffer that was last flipped (and may be being sent)
+#define JSGRAPHICS_FLUSH_TARGET JS_HIDDEN_CHAR_STR"fBt" ///< flush: the SPI device to send the buffer to on flip()
+#define JSGRAPHICS_FLUSH_BUSY JS_HIDDEN_CHAR_STR"fBb" ///< set while the front buffer is being sent
+#define JSGRAPHICS_FLUSH_PENDING JS_HIDDEN_CHAR_STR"fBp" ///< set if flip() was called while busy (the callback, or true)
+
+#define JSGRAPHICS_DIRTY_RECTS 4 ///< How many separate modified rectangles we keep track of for flip()
+#define JSGRAPHICS_GLYPH_MAX_HEIGHT 32 ///< Tallest glyph graphicsDrawGlyph can draw (glyphs are at most 32 wide, one uint32_t per row)
+
+typedef struct {
+  short x1, y1, x2, y2;
+} PACKED_FLAGS JsGraphicsRect;
 
 typedef struct {
   JsGraphicsType type;
@@ -61,6 +75,8 @@ typedef struct {
   short fontSize; ///< See JSGRAPHICS_FONTSIZE_ constants
   short cursorX, cursorY; ///< current cursor positions
   short modMinX, modMinY, modMaxX, modMaxY; ///< area that has been modified
+  unsigned char dirtyCount; ///< how many of 'dirty' are used
+  JsGraphicsRect dirty[JSGRAPHICS_DIRTY_RECTS]; ///< modified areas (merged when they overlap or we run out), for flip()
 } PACKED_FLAGS JsGraphicsData;
 
 typedef struct JsGraphics {
@@ -71,6 +87,12 @@ typedef struct JsGraphics {
   void (*setPixel)(struct JsGraphics *gfx, short x, short y, unsigned int col);
   void (*fillRect)(struct JsGraphics *gfx, short x1, short y1, short x2, short y2);
   unsigned int (*getPixel)(struct JsGraphics *gfx, short x, short y);
+  /// Optional: draw a 1 bit glyph in fgColor (see graphicsDrawGlyph). DEVICE coordinates, and the glyph is entirely on screen
+  void (*drawGlyph)(struct JsGraphics *gfx, short x, short y, short width, short height, const uint32_t *rows);
+  /** Optional: draw a block of pixels in the format of drawImage's buffer at this bpp (MSB first), with rows
+   * 'stride' bytes apart. DEVICE coordinates, and the block is entirely on screen */
+  void (*blit)(struct JsGraphics *gfx, short x, short y, short width, short height, const unsigned char *data, size_t stride);
+  void *backendData; ///< Set by the backend's SetCallbacks, valid for this draw call only (eg. ArrayBuffer's raw pointer)
 } PACKED_FLAGS JsGraphics;
 
 static inline void graphicsStructInit(JsGraphics *gfx) {
@@ -85,12 +107,16 @@ static inline void graphicsStructInit(JsGraphics *gfx) {
   gfx->data.modMaxY = -32768;
   gfx->data.modMinX = 32767;
   gfx->data.modMinY = 32767;
+  gfx->data.dirtyCount = 0;
 }
 
 // ---------------------------------- these are in graphics.c
 // Access a JsVar and get/set the relevant info in JsGraphics
 bool graphicsGetFromVar(JsGraphics *gfx, JsVar *parent);
 void graphicsSetVar(JsGraphics *gfx);
+void graphicsResetModified(JsGraphics *gfx); ///< Clear the modified area and the dirty rectangles
+void graphicsSetModified(JsGraphics *gfx, short x1, short y1, short x2, short y2); ///< Add a (device coordinate, already clipped) rectangle to the modified area and dirty rectangles
+void graphicsToDeviceCoordinates(const JsGraphics *gfx, short *x, short *y); ///< Convert USER coordinates to DEVICE coordinates
 // ----------------------------------------------------------------------------------------------
 // drawing functions - all coordinates are in USER coordinates, not DEVICE coordinates
 void         graphicsSetPixel(JsGraphics *gfx, short x, short y, unsigned int col);
@@ -100,6 +126,8 @@ void         graphicsFillRect(JsGraphics *gfx, short x1, short y1, short x2, sho
 void graphicsFallbackFillRect(JsGraphics *gfx, short x1, short y1, short x2, short y2); // Simple fillrect - doesn't call device-specific FR
 void graphicsDrawRect(JsGraphics *gfx, short x1, short y1, short x2, short y2);
 void graphicsDrawString(JsGraphics *gfx, short x1, short y1, const char *str);
+/// Draw a 1 bit glyph in fgColor, leaving 0 bits alone. rows[y] holds row y, with bit (width-1) the leftmost pixel. width<=32, height<=JSGRAPHICS_GLYPH_MAX_HEIGHT
+void graphicsDrawGlyph(JsGraphics *gfx, short x1, short y1, short width, short height, const uint32_t *rows);
 void graphicsDrawLine(JsGraphics *gfx, short x1, short y1, short x2, short y2);
 void graphicsFillPoly(JsGraphics *gfx, int points, short *vertices); // may overwrite vertices...
 #ifndef SAVE_ON_FLASH
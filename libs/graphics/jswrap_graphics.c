@@ -16,6 +16,12 @@
 #include "jswrap_graphics.h"
 #include "jsutils.h"
 #include "jsinteractive.h"
+#include "jswrap_arraybuffer.h"
+#include "jswrap_spi_i2c.h"
+#include "jswrapper.h"
+#ifdef USE_HEATSHRINK
+#include "compress_heatshrink.h"
+#endif
 
 #include "lcd_arraybuffer.h"
 #include "lcd_js.h"
@@ -87,11 +93,14 @@ static bool isValidBPP(int bpp) {
     ["height","int32","Pixels high"],
     ["bpp","int32","Number of bits per pixel"],
     ["options","JsVar",[
-      "An object of other options. ```{ zigzag : true/false(default), vertical_byte : true/false(default), msb : true/false(default), color_order: 'rgb'(default),'bgr',etc }```",
+      "An object of other options. ```{ zigzag : true/false(default), vertical_byte : true/false(default), msb : true/false(default), color_order: 'rgb'(default),'bgr',etc, flip : function(x1,y1,x2,y2), doubleBuffer : true/false(default), flush : SPI }```",
       "zigzag = whether to alternate the direction of scanlines for rows",
       "vertical_byte = whether to align bits in a byte vertically or not",
       "msb = when bits<8, store pixels msb first",
-      "color_order = re-orders the colour values that are supplied via setColor"
+      "color_order = re-orders the colour values that are supplied via setColor",
+      "flip = called by `g.flip()` for each modified area of the buffer (in device coordinates), so a display driver can send just that area",
+      "doubleBuffer = use two buffers, swapping them on `g.flip()` - see `Graphics.flip`",
+      "flush = an SPI device that the whole buffer is sent to on `g.flip()` (in the background if `doubleBuffer` is set)"
     ]]
   ],
   "return" : ["JsVar","The new Graphics object"],
@@ -149,6 +158,26 @@ JsVar *jswrap_graphics_createArrayBuffer(int width, int height, int bpp, JsVar *
         jsWarn("color_order must be 3 characters");
       jsvUnLock(colorv);
     }
+    JsVar *flip = jsvObjectGetChild(options, "flip", 0);
+    if (jsvIsFunction(flip))
+      jsvObjectSetChild(parent, JSGRAPHICS_FLIP_CALLBACK, flip);
+    else if (flip)
+      jsWarn("flip must be a function");
+    jsvUnLock(flip);
+    JsVar *flush = jsvObjectGetChild(options, "flush", 0);
+    if (jsvIsObject(flush))
+      jsvObjectSetChild(parent, JSGRAPHICS_FLUSH_TARGET, flush);
+    else if (flush)
+      jsWarn("flush must be an SPI device");
+    jsvUnLock(flush);
+    if (jsvGetBoolAndUnLock(jsvObjectGetChild(options, "doubleBuffer", 0))) {
+      JsVar *front = jswrap_arraybuffer_constructor((gfx.data.width * gfx.data.height * gfx.data.bpp + 7) >> 3);
+      if (!front) { // out of memory
+        jsvUnLock(parent);
+        return 0;
+      }
+      jsvObjectSetChildAndUnLock(parent, JSGRAPHICS_FRONT_BUFFER, front);
+    }
   }
 
   lcdInit_ArrayBuffer(&gfx);
@@ -524,17 +553,119 @@ void jswrap_graphics_setFontSizeX(JsVar *parent, int size, bool checkValid) {
     jsvObjectSetChild(parent, JSGRAPHICS_CUSTOMFONT_WIDTH, 0);
     jsvObjectSetChild(parent, JSGRAPHICS_CUSTOMFONT_HEIGHT, 0);
     jsvObjectSetChild(parent, JSGRAPHICS_CUSTOMFONT_FIRSTCHAR, 0);
+    jsvObjectSetChild(parent, JSGRAPHICS_CUSTOMFONT_COMPRESSED, 0);
   }
   gfx.data.fontSize = (short)size;
   graphicsSetVar(&gfx);
 }
+/// Where drawImage and custom fonts get their pixels from - a flat buffer if possible, otherwise we walk forwards through the string
+typedef struct {
+  const unsigned char *ptr; ///< pointer to flat data, or 0
+  size_t len;
+  JsVar *str; ///< string we're iterating over (if not flat)
+  JsvStringIterator it;
+  size_t itIdx; ///< index of the iterator (only ever moves forwards)
+#ifdef USE_HEATSHRINK
+  bool compressed; ///< data is heatshrink compressed - 'it' is the compressed input
+  heatshrink_stream hs;
+  size_t hsIdx; ///< number of bytes decoded so far
+  unsigned char hsByte; ///< last byte decoded (index hsIdx-1)
+#endif
+} GfxImageSource;
+
+#ifdef USE_HEATSHRINK
+static int graphicsImageSourceReadCompressed(uint32_t *cbdata) {
+  JsvStringIterator *it = (JsvStringIterator *)cbdata;
+  if (!jsvStringIteratorHasChar(it)) return -1;
+  int ch = (unsigned char)jsvStringIteratorGetChar(it);
+  jsvStringIteratorNext(it);
+  return ch;
+}
+#endif
+
+/** Set up a source for data (a String or ArrayBuffer). startIdx is the first byte that
+ * will be asked for. If compressed, data is decoded as it is read, so it can come straight
+ * from flash without ever being decompressed into RAM */
+static bool graphicsImageSourceNew(GfxImageSource *src, JsVar *data, size_t startIdx, bool compressed) {
+  src->ptr = 0;
+  src->str = 0;
+  src->itIdx = startIdx;
+#ifdef USE_HEATSHRINK
+  src->compressed = compressed;
+  if (compressed) {
+    src->str = jsvIsArrayBuffer(data) ? jsvGetArrayBufferBackingString(data) : jsvLockAgain(data);
+    jsvStringIteratorNew(&src->it, src->str, jsvIsArrayBuffer(data) ? (size_t)data->varData.arraybuffer.byteOffset : 0);
+    heatshrink_stream_init(&src->hs, graphicsImageSourceReadCompressed, (uint32_t*)&src->it);
+    src->hsIdx = 0;
+    src->hsByte = 0;
+    return true;
+  }
+#else
+  if (compressed) {
+    jsExceptionHere(JSET_ERROR, "Compressed images not supported in this build");
+    return false;
+  }
+#endif
+  src->ptr = (const unsigned char*)jsvGetDataPointer(data, &src->len);
+  if (!src->ptr) {
+    size_t offset = startIdx;
+    if (jsvIsArrayBuffer(data)) {
+      src->str = jsvGetArrayBufferBackingString(data);
+      offset += (size_t)data->varData.arraybuffer.byteOffset;
+    } else
+      src->str = jsvLockAgain(data);
+    jsvStringIteratorNew(&src->it, src->str, offset);
+  }
+  return true;
+}
+
+static void graphicsImageSourceFree(GfxImageSource *src) {
+  if (src->str) {
+    jsvStringIteratorFree(&src->it);
+    jsvUnLock(src->str);
+  }
+}
+
+static unsigned char graphicsImageGetByte(GfxImageSource *src, size_t idx) {
+  if (src->ptr) return (idx < src->len) ? src->ptr[idx] : 0;
+#ifdef USE_HEATSHRINK
+  if (src->compressed) {
+    while (src->hsIdx <= idx) {
+      int ch = heatshrink_stream_read(&src->hs);
+      src->hsByte = (unsigned char)((ch<0) ? 0 : ch);
+      src->hsIdx++;
+    }
+    return src->hsByte;
+  }
+#endif
+  while (src->itIdx < idx) {
+    jsvStringIteratorNext(&src->it);
+    src->itIdx++;
+  }
+  return (unsigned char)jsvStringIteratorGetChar(&src->it);
+}
+
+/// Get 'bpp' bits starting at bit 'bitIdx', MSB first
+static unsigned int graphicsImageGetBits(GfxImageSource *src, size_t bitIdx, int bpp) {
+  unsigned int col = 0;
+  while (bpp>0) {
+    unsigned char b = graphicsImageGetByte(src, bitIdx>>3);
+    int avail = 8 - (int)(bitIdx&7);
+    int take = (bpp<avail) ? bpp : avail;
+    col = (col<<take) | ((unsigned int)(b >> (avail-take)) & ((1U<<take)-1));
+    bpp -= take;
+    bitIdx += (size_t)take;
+  }
+  return col;
+}
+
 /*JSON{
   "type" : "method",
   "class" : "Graphics",
   "name" : "setFontCustom",
   "generate" : "jswrap_graphics_setFontCustom",
   "params" : [
-    ["bitmap","JsVar","A column-first, MSB-first, 1bpp bitmap containing the font bitmap"],
+    ["bitmap","JsVar","A column-first, MSB-first, 1bpp bitmap containing the font bitmap. Either a String, or `{ buffer : String, compressed : true }` for a bitmap compressed with `E.compress`"],
     ["firstChar","int32","The first character in the font - usually 32 (space)"],
     ["width","JsVar","The width of each character in the font. Either an integer, or a string where each character represents the width"],
     ["height","int32","The height as an integer"]
@@ -542,30 +673,45 @@ void jswrap_graphics_setFontSizeX(JsVar *parent, int size, bool checkValid) {
 }
 Make subsequent calls to `drawString` use a Custom Font of the given height. See the [Fonts page](http://www.espruino.com/Fonts) for more
 information about custom fonts and how to create them.
+
+If the bitmap is compressed, it is decompressed as each character is drawn, so it can
+stay compressed in Flash (eg. `E.memoryArea` or a file in Storage). Characters nearer the
+start of the font are quicker to draw.
 */
 void jswrap_graphics_setFontCustom(JsVar *parent, JsVar *bitmap, int firstChar, JsVar *width, int height) {
   JsGraphics gfx; if (!graphicsGetFromVar(&gfx, parent)) return;
 
+  bool compressed = false;
+  if (jsvIsObject(bitmap)) {
+    compressed = jsvGetBoolAndUnLock(jsvObjectGetChild(bitmap, "compressed", 0));
+    bitmap = jsvObjectGetChild(bitmap, "buffer", 0);
+  } else
+    bitmap = jsvLockAgainSafe(bitmap);
   if (!jsvIsString(bitmap)) {
     jsExceptionHere(JSET_ERROR, "Font bitmap must be a String");
+    jsvUnLock(bitmap);
     return;
   }
   if (firstChar<0 || firstChar>255) {
     jsExceptionHere(JSET_ERROR, "First character out of range");
+    jsvUnLock(bitmap);
     return;
   }
   if (!jsvIsString(width) && !jsvIsInt(width)) {
     jsExceptionHere(JSET_ERROR, "Font width must be a String or an integer");
+    jsvUnLock(bitmap);
     return;
   }
   if (height<=0 || height>255) {
    jsExceptionHere(JSET_ERROR, "Invalid height");
+   jsvUnLock(bitmap);
    return;
  }
-  jsvObjectSetChild(parent, JSGRAPHICS_CUSTOMFONT_BMP, bitmap);
+  jsvObjectSetChildAndUnLock(parent, JSGRAPHICS_CUSTOMFONT_BMP, bitmap);
   jsvObjectSetChild(parent, JSGRAPHICS_CUSTOMFONT_WIDTH, width);
   jsvObjectSetChildAndUnLock(parent, JSGRAPHICS_CUSTOMFONT_HEIGHT, jsvNewFromInteger(height));
   jsvObjectSetChildAndUnLock(parent, JSGRAPHICS_CUSTOMFONT_FIRSTCHAR, jsvNewFromInteger(firstChar));
+  jsvObjectSetChildAndUnLock(parent, JSGRAPHICS_CUSTOMFONT_COMPRESSED, compressed ? jsvNewFromBool(true) : 0);
   gfx.data.fontSize = JSGRAPHICS_FONTSIZE_CUSTOM;
   graphicsSetVar(&gfx);
 }
@@ -589,11 +735,13 @@ void jswrap_graphics_drawString(JsVar *parent, JsVar *var, int x, int y) {
 
   JsVar *customBitmap = 0, *customWidth = 0;
   int customHeight = 0, customFirstChar = 0;
+  bool customCompressed = false;
   if (gfx.data.fontSize == JSGRAPHICS_FONTSIZE_CUSTOM) {
     customBitmap = jsvObjectGetChild(parent, JSGRAPHICS_CUSTOMFONT_BMP, 0);
     customWidth = jsvObjectGetChild(parent, JSGRAPHICS_CUSTOMFONT_WIDTH, 0);
     customHeight = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(parent, JSGRAPHICS_CUSTOMFONT_HEIGHT, 0));
     customFirstChar = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(parent, JSGRAPHICS_CUSTOMFONT_FIRSTCHAR, 0));
+    customCompressed = jsvGetBoolAndUnLock(jsvObjectGetChild(parent, JSGRAPHICS_CUSTOMFONT_COMPRESSED, 0));
   }
 
   JsVar *str = jsvAsString(var, false);
@@ -630,22 +778,33 @@ void jswrap_graphics_drawString(JsVar *parent, JsVar *var, int x, int y) {
       if (ch>=customFirstChar) {
         bmpOffset *= customHeight;
         // now render character
-        JsvStringIterator cit;
-        jsvStringIteratorNew(&cit, customBitmap, (size_t)bmpOffset>>3);
-        bmpOffset &= 7;
+        GfxImageSource src;
+        if (!graphicsImageSourceNew(&src, customBitmap, (size_t)bmpOffset>>3, customCompressed))
+          break;
+        size_t bitIdx = (size_t)bmpOffset;
         int cx,cy;
-        for (cx=0;cx<width;cx++) {
-          for (cy=0;cy<customHeight;cy++) {
-            if ((jsvStringIteratorGetChar(&cit)<<bmpOffset)&128)
-              graphicsSetPixel(&gfx, (short)(cx+x), (short)(cy+y), gfx.data.fgColor);
-            bmpOffset++;
-            if (bmpOffset==8) {
-              bmpOffset=0;
-              jsvStringIteratorNext(&cit);
+        if (width<=32 && customHeight<=JSGRAPHICS_GLYPH_MAX_HEIGHT) {
+          // the bitmap is stored column by column - turn it into rows so it can be drawn in one go
+          uint32_t rows[JSGRAPHICS_GLYPH_MAX_HEIGHT];
+          memset(rows, 0, sizeof(rows));
+          for (cx=0;cx<width;cx++) {
+            for (cy=0;cy<customHeight;cy++) {
+              if (graphicsImageGetBits(&src, bitIdx, 1))
+                rows[cy] |= 1U<<(width-1-cx);
+              bitIdx++;
+            }
+          }
+          graphicsDrawGlyph(&gfx, (short)x, (short)y, (short)width, (short)customHeight, rows);
+        } else {
+          for (cx=0;cx<width;cx++) {
+            for (cy=0;cy<customHeight;cy++) {
+              if (graphicsImageGetBits(&src, bitIdx, 1))
+                graphicsSetPixel(&gfx, (short)(cx+x), (short)(cy+y), gfx.data.fgColor);
+              bitIdx++;
             }
           }
         }
-        jsvStringIteratorFree(&cit);
+        graphicsImageSourceFree(&src);
       }
       x += width;
     }
@@ -843,12 +1002,17 @@ void jswrap_graphics_setRotation(JsVar *parent, int rotation, bool reflect) {
   "name" : "drawImage",
   "generate" : "jswrap_graphics_drawImage",
   "params" : [
-    ["image","JsVar","An object with the following fields `{ width : int, height : int, bpp : int, buffer : ArrayBuffer, transparent: optional int }`. bpp = bits per pixel, transparent (if defined) is the colour that will be treated as transparent"],
+    ["image","JsVar","An object with the following fields `{ width : int, height : int, bpp : int, buffer : ArrayBuffer/String, transparent: optional int, palette : optional array, compressed : optional bool }`. bpp = bits per pixel, transparent (if defined) is the colour that will be treated as transparent, palette (if defined, for bpp<=8) maps each of the image's colours to a colour for this Graphics, compressed (if true) means buffer was created with `E.compress`"],
     ["x","int32","The X offset to draw the image"],
     ["y","int32","The Y offset to draw the image"]
   ]
 }
-Draw an image at the specified position. If the image is 1 bit, the graphics foreground/background colours will be used. Otherwise color data will be copied as-is. Bitmaps are rendered MSB-first
+Draw an image at the specified position. If the image is 1 bit and has no palette, the graphics foreground/background colours will be used. Otherwise
+color data will be copied as-is, or looked up in `palette` - eg. `palette:new Uint16Array([0,0xF800,0x07E0,0xFFFF])` to draw a 2 bit image onto a 16 bit display.
+Bitmaps are rendered MSB-first
+
+Compressed images are decompressed a few bytes at a time as they are drawn, so they can be
+drawn straight from Flash (eg. `E.memoryArea`) without needing RAM for the whole image.
 */
 void jswrap_graphics_drawImage(JsVar *parent, JsVar *image, int xPos, int yPos) {
   JsGraphics gfx; if (!graphicsGetFromVar(&gfx, parent)) return;
@@ -859,53 +1023,118 @@ void jswrap_graphics_drawImage(JsVar *parent, JsVar *image, int xPos, int yPos)
   int imageWidth = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(image, "width", 0));
   int imageHeight = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(image, "height", 0));
   int imageBpp = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(image, "bpp", 0));
-  unsigned int imageBitMask = (unsigned int)((1L<<imageBpp)-1L);
   JsVar *transpVar = jsvObjectGetChild(image, "transparent", 0);
   bool imageIsTransparent = transpVar!=0;
   unsigned int imageTransparentCol = (unsigned int)jsvGetInteger(transpVar);
   jsvUnLock(transpVar);
+  bool imageCompressed = jsvGetBoolAndUnLock(jsvObjectGetChild(image, "compressed", 0));
   JsVar *imageBuffer = jsvObjectGetChild(image, "buffer", 0);
-  if (!(jsvIsArrayBuffer(imageBuffer) && imageWidth>0 && imageHeight>0 && imageBpp>0 && imageBpp<=32)) {
+  if (!((jsvIsArrayBuffer(imageBuffer) || jsvIsString(imageBuffer)) && imageWidth>0 && imageHeight>0 && imageBpp>0 && imageBpp<=32)) {
     jsExceptionHere(JSET_ERROR, "Expecting first argument to a valid Image");
     jsvUnLock(imageBuffer);
     return;
   }
-  JsVar *imageBufferString = jsvGetArrayBufferBackingString(imageBuffer);
-  jsvUnLock(imageBuffer);
-
 
-  int x=0, y=0;
-  int bits=0;
-  unsigned int colData = 0;
-  JsvStringIterator it;
-  jsvStringIteratorNew(&it, imageBufferString, 0);
-  while ((bits>=imageBpp || jsvStringIteratorHasChar(&it)) && y<imageHeight) {
-    // Get the data we need...
-    while (bits < imageBpp) {
-      colData = (colData<<8) | ((unsigned char)jsvStringIteratorGetChar(&it));
-      jsvStringIteratorNext(&it);
-      bits += 8;
+  // Work out the colour lookup table (if any)
+  unsigned int lutSmall[16];
+  unsigned int *lut = 0;
+  JsVar *lutVar = 0;
+  JsVar *palette = jsvObjectGetChild(image, "palette", 0);
+  if (palette && imageBpp<=8) {
+    int lutSize = 1<<imageBpp;
+    if (lutSize <= 16) {
+      lut = lutSmall;
+    } else {
+      lutVar = jsvNewFlatStringOfLength((unsigned int)((size_t)lutSize*sizeof(unsigned int)));
+      if (lutVar) lut = (unsigned int*)jsvGetFlatStringPointer(lutVar);
     }
-    // extract just the bits we want
-    unsigned int col = (colData>>(bits-imageBpp))&imageBitMask;
-    bits -= imageBpp;
-    // Try and write pixel!
-    if (!imageIsTransparent || imageTransparentCol!=col) {
-      if (imageBpp==1)
-        col = col ? gfx.data.fgColor : gfx.data.bgColor;
-      graphicsSetPixel(&gfx, (short)(x+xPos), (short)(y+yPos), col);
+    if (lut) {
+      int i = 0;
+      JsvIterator it;
+      jsvIteratorNew(&it, palette);
+      while (i<lutSize && jsvIteratorHasElement(&it)) {
+        lut[i++] = (unsigned int)jsvIteratorGetIntegerValue(&it);
+        jsvIteratorNext(&it);
+      }
+      jsvIteratorFree(&it);
+      while (i<lutSize) lut[i++] = 0;
     }
-    // Go to next pixel
-    x++;
-    if (x>=imageWidth) {
-      x=0;
-      y++;
-      // we don't care about image height - we'll stop next time...
+  } else if (imageBpp==1) {
+    lut = lutSmall;
+    lut[0] = gfx.data.bgColor;
+    lut[1] = gfx.data.fgColor;
+  }
+  jsvUnLock(palette);
+  if (palette && !lut) {
+    jsExceptionHere(JSET_ERROR, "Not enough memory for palette");
+    jsvUnLock(imageBuffer);
+    return;
+  }
+
+  GfxImageSource src;
+  bool srcOk = graphicsImageSourceNew(&src, imageBuffer, 0, imageCompressed);
+  jsvUnLock(imageBuffer);
+  if (!srcOk) {
+    jsvUnLock(lutVar);
+    return;
+  }
+
+  // Clip once, in user coordinates
+  int userWidth = (gfx.data.flags & JSGRAPHICSFLAGS_SWAP_XY) ? gfx.data.height : gfx.data.width;
+  int userHeight = (gfx.data.flags & JSGRAPHICSFLAGS_SWAP_XY) ? gfx.data.width : gfx.data.height;
+  int x1 = (xPos<0) ? -xPos : 0;
+  int y1 = (yPos<0) ? -yPos : 0;
+  int x2 = (xPos+imageWidth > userWidth) ? userWidth-xPos : imageWidth; // exclusive
+  int y2 = (yPos+imageHeight > userHeight) ? userHeight-yPos : imageHeight;
+
+  if (x1<x2 && y1<y2) {
+    unsigned int colMask = (unsigned int)((1L<<gfx.data.bpp)-1);
+    // Work out how device coordinates move as we go along a row of the image
+    short sx = (short)(xPos+x1), sy = (short)(yPos+y1);
+    short nx = (short)(sx+1), ny = sy;
+    graphicsToDeviceCoordinates(&gfx, &sx, &sy);
+    graphicsToDeviceCoordinates(&gfx, &nx, &ny);
+    int stepX = nx-sx, stepY = ny-sy;
+    // and as we go down a column
+    short dx = (short)(xPos+x1), dy = (short)(yPos+y1+1);
+    graphicsToDeviceCoordinates(&gfx, &dx, &dy);
+    int rowStepX = dx-sx, rowStepY = dy-sy;
+
+    int x, y;
+    if (gfx.blit && src.ptr && !lut && !imageIsTransparent && imageBpp==gfx.data.bpp &&
+        !(gfx.data.flags & (JSGRAPHICSFLAGS_SWAP_XY|JSGRAPHICSFLAGS_INVERT_X|JSGRAPHICSFLAGS_INVERT_Y)) &&
+        ((size_t)imageWidth*(size_t)imageBpp)%8==0 && (x1*imageBpp)%8==0 &&
+        (size_t)imageHeight*(size_t)imageWidth*(size_t)imageBpp <= src.len*8) {
+      // the backend can copy the image data as-is
+      size_t stride = (size_t)imageWidth*(size_t)imageBpp/8;
+      gfx.blit(&gfx, sx, sy, (short)(x2-x1), (short)(y2-y1),
+               src.ptr + (size_t)y1*stride + (size_t)x1*(size_t)imageBpp/8, stride);
+    } else for (y=y1;y<y2;y++) {
+      int devX = sx + rowStepX*(y-y1);
+      int devY = sy + rowStepY*(y-y1);
+      size_t bitIdx = ((size_t)y*(size_t)imageWidth + (size_t)x1)*(size_t)imageBpp;
+      for (x=x1;x<x2;x++) {
+        unsigned int col = graphicsImageGetBits(&src, bitIdx, imageBpp);
+        if (!imageIsTransparent || imageTransparentCol!=col) {
+          if (lut) col = lut[col];
+          gfx.setPixel(&gfx, (short)devX, (short)devY, col & colMask);
+        }
+        bitIdx += (size_t)imageBpp;
+        devX += stepX;
+        devY += stepY;
+      }
     }
 
+    // mark the whole (clipped) area as modified
+    short mx1 = (short)(xPos+x1), my1 = (short)(yPos+y1);
+    short mx2 = (short)(xPos+x2-1), my2 = (short)(yPos+y2-1);
+    graphicsToDeviceCoordinates(&gfx, &mx1, &my1);
+    graphicsToDeviceCoordinates(&gfx, &mx2, &my2);
+    graphicsSetModified(&gfx, (mx1<mx2)?mx1:mx2, (my1<my2)?my1:my2, (mx1>mx2)?mx1:mx2, (my1>my2)?my1:my2);
   }
-  jsvStringIteratorFree(&it);
-  jsvUnLock(imageBufferString);
+
+  graphicsImageSourceFree(&src);
+  jsvUnLock(lutVar);
   graphicsSetVar(&gfx); // gfx data changed because modified area
 }
 
@@ -937,11 +1166,172 @@ JsVar *jswrap_graphics_getModified(JsVar *parent, bool reset) {
     }
   }
   if (reset) {
-    gfx.data.modMaxX = -32768;
-    gfx.data.modMaxY = -32768;
-    gfx.data.modMinX = 32767;
-    gfx.data.modMinY = 32767;
+    graphicsResetModified(&gfx);
     graphicsSetVar(&gfx);
   }
   return obj;
 }
+
+/// Copy the contents of one ArrayBuffer into another of the same size
+static void graphicsCopyBuffer(JsVar *dst, JsVar *src) {
+  size_t dstLen, srcLen;
+  char *dstPtr = jsvGetWritableDataPointer(dst, &dstLen);
+  char *srcPtr = jsvGetDataPointer(src, &srcLen);
+  if (dstPtr && srcPtr) {
+    memcpy(dstPtr, srcPtr, (dstLen<srcLen) ? dstLen : srcLen);
+    return;
+  }
+  JsvArrayBufferIterator itDst, itSrc;
+  jsvArrayBufferIteratorNew(&itDst, dst, 0);
+  jsvArrayBufferIteratorNew(&itSrc, src, 0);
+  while (jsvArrayBufferIteratorHasElement(&itDst) && jsvArrayBufferIteratorHasElement(&itSrc)) {
+    jsvArrayBufferIteratorSetByteValue(&itDst, (char)jsvArrayBufferIteratorGetIntegerValue(&itSrc));
+    jsvArrayBufferIteratorNext(&itDst);
+    jsvArrayBufferIteratorNext(&itSrc);
+  }
+  jsvArrayBufferIteratorFree(&itDst);
+  jsvArrayBufferIteratorFree(&itSrc);
+}
+
+static void graphicsSwapAndFlush(JsVar *parent, JsVar *callback);
+
+/// Called (via the SPI device) when the front buffer has been sent
+void _jswrap_graphics_flushComplete(JsVar *parent) {
+  jsvRemoveNamedChild(parent, JSGRAPHICS_FLUSH_BUSY);
+  JsVar *pending = jsvObjectGetChild(parent, JSGRAPHICS_FLUSH_PENDING, 0);
+  if (pending) {
+    jsvRemoveNamedChild(parent, JSGRAPHICS_FLUSH_PENDING);
+    graphicsSwapAndFlush(parent, jsvIsFunction(pending) ? pending : 0);
+    jsvUnLock(pending);
+  }
+}
+
+/** Swap buffers (if doubleBuffer), send the buffer that was drawn to the flush target (if any)
+ * and queue 'callback', as it's now ok to draw the next frame */
+static void graphicsSwapAndFlush(JsVar *parent, JsVar *callback) {
+  JsGraphics gfx; if (!graphicsGetFromVar(&gfx, parent)) return;
+  graphicsResetModified(&gfx);
+  graphicsSetVar(&gfx);
+
+  JsVar *drawn = jsvObjectGetChild(parent, "buffer", 0);
+  JsVar *front = jsvObjectGetChild(parent, JSGRAPHICS_FRONT_BUFFER, 0);
+  if (front) {
+    jsvObjectSetChild(parent, "buffer", front);
+    jsvObjectSetChild(parent, JSGRAPHICS_FRONT_BUFFER, drawn);
+    // so we can carry on drawing on top of what was there before
+    graphicsCopyBuffer(front, drawn);
+  }
+  // let a display driver set its window up
+  JsVar *flipCallback = jsvObjectGetChild(parent, JSGRAPHICS_FLIP_CALLBACK, 0);
+  if (flipCallback) {
+    JsVar *args[4];
+    args[0] = jsvNewFromInteger(0);
+    args[1] = jsvNewFromInteger(0);
+    args[2] = jsvNewFromInteger(gfx.data.width-1);
+    args[3] = jsvNewFromInteger(gfx.data.height-1);
+    jsvUnLock(jspExecuteFunction(flipCallback, parent, 4, args));
+    jsvUnLockMany(4, args);
+    jsvUnLock(flipCallback);
+  }
+  JsVar *spi = jsvObjectGetChild(parent, JSGRAPHICS_FLUSH_TARGET, 0);
+  if (spi && front) {
+    // send in the background, and don't swap again until it's done
+    JsVar *fn = jsvNewNativeFunction((void (*)(void))_jswrap_graphics_flushComplete, JSWAT_VOID|JSWAT_THIS_ARG);
+    if (fn) {
+      jsvObjectSetChild(fn, JSPARSE_FUNCTION_THIS_NAME, parent);
+      jsvObjectSetChildAndUnLock(parent, JSGRAPHICS_FLUSH_BUSY, jsvNewFromBool(true));
+      jswrap_spi_sendAsync(spi, drawn, fn);
+      if (jspHasError())
+        jsvRemoveNamedChild(parent, JSGRAPHICS_FLUSH_BUSY);
+      jsvUnLock(fn);
+    }
+  } else if (spi) {
+    jsvUnLock(jswrap_spi_send(spi, drawn, PIN_UNDEFINED));
+  }
+  jsvUnLock3(spi, front, drawn);
+  if (callback)
+    jsiQueueEvents(parent, callback, 0, 0);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "Graphics",
+  "name" : "flip",
+  "generate" : "jswrap_graphics_flip",
+  "params" : [
+    ["callback","JsVar","(optional) A function to call when the next frame can be drawn"]
+  ],
+  "return" : ["int","The number of modified areas that were sent"]
+}
+Send the parts of the Graphics that have changed since the last `flip()` (or
+`getModified(true)`) to the display. This calls the `flip` function given in the
+options of `Graphics.createArrayBuffer` with `x1,y1,x2,y2` for each area - up to
+4, as nearby areas are merged.
+
+For instance an SPI display driver might use `flip:function(x1,y1,x2,y2) { ... }`
+to set the display's window and then `spi.write` the rows of `g.buffer` inside it,
+so small changes to a UI don't mean re-sending the whole screen.
+
+If the Graphics was created with `doubleBuffer` or `flush` options, the whole screen
+is sent instead: `flip` is called once with the full area, and then the buffer that
+was drawn is written to the `flush` SPI device. With `doubleBuffer`, `g.buffer` is
+swapped for a second buffer (which is given a copy of the frame) and the data is sent
+in the background with `SPI.sendAsync`, so the next frame can be drawn while the last
+one is being sent:
+
+```
+var g = Graphics.createArrayBuffer(128,64,8,{doubleBuffer:true, flush:SPI1});
+function frame() {
+  g.clear();
+  // ... draw
+  g.flip(frame); // frame is called again when it's ok to draw
+}
+```
+
+If `flip` is called again before the last frame has been sent, the swap is
+done (and `callback` is called) when the send completes.
+*/
+JsVarInt jswrap_graphics_flip(JsVar *parent, JsVar *callback) {
+  if (!jsvIsUndefined(callback) && !jsvIsFunction(callback)) {
+    jsExceptionHere(JSET_ERROR, "Expecting a callback function, got %t", callback);
+    return 0;
+  }
+  JsVar *front = jsvObjectGetChild(parent, JSGRAPHICS_FRONT_BUFFER, 0);
+  JsVar *flush = jsvObjectGetChild(parent, JSGRAPHICS_FLUSH_TARGET, 0);
+  bool wholeScreen = front || flush;
+  jsvUnLock2(front, flush);
+  if (wholeScreen) {
+    if (jsvGetBoolAndUnLock(jsvObjectGetChild(parent, JSGRAPHICS_FLUSH_BUSY, 0))) {
+      // still sending the last frame - swap when that's done
+      JsVar *pending = jsvIsFunction(callback) ? jsvLockAgain(callback) : jsvNewFromBool(true);
+      jsvObjectSetChildAndUnLock(parent, JSGRAPHICS_FLUSH_PENDING, pending);
+    } else
+      graphicsSwapAndFlush(parent, jsvIsFunction(callback) ? callback : 0);
+    return 1;
+  }
+
+  JsGraphics gfx; if (!graphicsGetFromVar(&gfx, parent)) return 0;
+  JsGraphicsRect dirty[JSGRAPHICS_DIRTY_RECTS];
+  int i, count = gfx.data.dirtyCount;
+  memcpy(dirty, gfx.data.dirty, sizeof(dirty));
+  // reset first, as the callback may well draw
+  graphicsResetModified(&gfx);
+  graphicsSetVar(&gfx);
+
+  JsVar *flipCallback = jsvObjectGetChild(parent, JSGRAPHICS_FLIP_CALLBACK, 0);
+  if (flipCallback) {
+    for (i=0;i<count && !jspIsInterrupted();i++) {
+      JsVar *args[4];
+      args[0] = jsvNewFromInteger(dirty[i].x1);
+      args[1] = jsvNewFromInteger(dirty[i].y1);
+      args[2] = jsvNewFromInteger(dirty[i].x2);
+      args[3] = jsvNewFromInteger(dirty[i].y2);
+      jsvUnLock(jspExecuteFunction(flipCallback, parent, 4, args));
+      jsvUnLockMany(4, args);
+    }
+    jsvUnLock(flipCallback);
+  }
+  if (jsvIsFunction(callback))
+    jsiQueueEvents(parent, callback, 0, 0);
+  return count;
+}
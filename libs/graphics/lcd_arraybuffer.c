@@ -115,6 +115,146 @@ void  lcdFillRect_ArrayBuffer(struct JsGraphics *gfx, short x1, short y1, short
     lcdSetPixels_ArrayBuffer(gfx, x1, y, (short)(1+x2-x1), gfx->data.fgColor);
 }
 
+// ----------------------------------------------------------------------------------------------
+// If the buffer is a flat string we can write straight into memory. The buffer is referenced
+// by the Graphics instance, so the pointer stays valid until the end of the draw call
+
+unsigned int lcdGetPixel_ArrayBufferFlat(JsGraphics *gfx, short x, short y) {
+  unsigned int idx = lcdGetPixelIndex_ArrayBuffer(gfx,x,y,1);
+  unsigned char *ptr = &((unsigned char*)gfx->backendData)[idx>>3];
+  unsigned int col = 0;
+  if (gfx->data.bpp&7/*not a multiple of one byte*/) {
+    idx = idx & 7;
+    unsigned int mask = (unsigned int)(1<<gfx->data.bpp)-1;
+    unsigned int bitIdx = (gfx->data.flags & JSGRAPHICSFLAGS_ARRAYBUFFER_MSB) ? 8-(idx+gfx->data.bpp) : idx;
+    col = ((*ptr>>bitIdx)&mask);
+  } else {
+    int i;
+    for (i=0;i<gfx->data.bpp;i+=8)
+      col |= ((unsigned int)*(ptr++)) << i;
+  }
+  return col;
+}
+
+void lcdSetPixels_ArrayBufferFlat(JsGraphics *gfx, short x, short y, short pixelCount, unsigned int col) {
+  if (pixelCount<=0) return;
+  unsigned int idx = lcdGetPixelIndex_ArrayBuffer(gfx,x,y,pixelCount);
+  unsigned char *ptr = &((unsigned char*)gfx->backendData)[idx>>3];
+
+  if (gfx->data.bpp&7/*not a multiple of one byte*/) {
+    unsigned int mask = (unsigned int)(1<<gfx->data.bpp)-1;
+    bool vertical = gfx->data.flags & JSGRAPHICSFLAGS_ARRAYBUFFER_VERTICAL_BYTE;
+    bool shortCut = (col==0 || (col&mask)==mask) && !vertical; // simple black or white fill
+    idx = idx & 7;
+    while (pixelCount--) {
+      if (shortCut && idx==0) {
+        // aligned and filling with all 0 or all 1 - just memset whole bytes
+        int wholeBytes = (gfx->data.bpp*(pixelCount+1)) >> 3;
+        if (wholeBytes) {
+          memset(ptr, col?0xFF:0, (size_t)wholeBytes);
+          ptr += wholeBytes;
+          pixelCount = (short)(pixelCount+1 - (wholeBytes*8/gfx->data.bpp));
+          continue;
+        }
+      }
+      unsigned int bitIdx = (gfx->data.flags & JSGRAPHICSFLAGS_ARRAYBUFFER_MSB) ? 8-(idx+gfx->data.bpp) : idx;
+      *ptr = (unsigned char)((*ptr&~(mask<<bitIdx)) | ((col&mask)<<bitIdx));
+      if (vertical) {
+        ptr++;
+      } else {
+        idx += gfx->data.bpp;
+        if (idx>=8) {
+          idx -= 8;
+          ptr++;
+        }
+      }
+    }
+  } else { // we're writing whole bytes
+    int bytes = gfx->data.bpp>>3;
+    unsigned char c[4];
+    bool sameBytes = true;
+    int i;
+    for (i=0;i<bytes;i++) {
+      c[i] = (unsigned char)(col >> (i*8));
+      if (c[i]!=c[0]) sameBytes = false;
+    }
+    if (sameBytes) { // 8 bit, or every byte of the color the same
+      memset(ptr, c[0], (size_t)(pixelCount*bytes));
+    } else if (bytes==2) {
+      while (pixelCount--) {
+        *(ptr++) = c[0];
+        *(ptr++) = c[1];
+      }
+    } else {
+      while (pixelCount--)
+        for (i=0;i<bytes;i++)
+          *(ptr++) = c[i];
+    }
+  }
+}
+
+void lcdSetPixel_ArrayBufferFlat(JsGraphics *gfx, short x, short y, unsigned int col) {
+  lcdSetPixels_ArrayBufferFlat(gfx,x,y,1,col);
+}
+
+static unsigned char lcdReverseByte(unsigned char b) {
+  b = (unsigned char)(((b&0xF0)>>4) | ((b&0x0F)<<4));
+  b = (unsigned char)(((b&0xCC)>>2) | ((b&0x33)<<2));
+  return (unsigned char)(((b&0xAA)>>1) | ((b&0x55)<<1));
+}
+
+static void lcdMaskByte(unsigned char *ptr, unsigned char bits, bool set) {
+  if (set) *ptr |= bits;
+  else *ptr &= (unsigned char)~bits;
+}
+
+// 1bpp only (not zigzag) - write a glyph a byte at a time rather than a pixel at a time
+void lcdDrawGlyph_ArrayBufferFlat(JsGraphics *gfx, short x, short y, short width, short height, const uint32_t *rows) {
+  unsigned char *buf = (unsigned char*)gfx->backendData;
+  bool msb = gfx->data.flags & JSGRAPHICSFLAGS_ARRAYBUFFER_MSB;
+  bool set = gfx->data.fgColor & 1;
+  short cx, cy;
+  if (gfx->data.flags & JSGRAPHICSFLAGS_ARRAYBUFFER_VERTICAL_BYTE) {
+    // each byte is 8 pixels of a column, top pixel in bit 0 - so turn the glyph into columns
+    for (cx=0;cx<width;cx++) {
+      uint32_t bit = 1U<<(width-1-cx);
+      uint64_t column = 0;
+      for (cy=0;cy<height;cy++)
+        if (rows[cy]&bit) column |= 1ULL<<cy;
+      column <<= y&7;
+      unsigned char *ptr = &buf[x + cx + (y>>3)*gfx->data.width];
+      while (column) {
+        unsigned char b = (unsigned char)column;
+        lcdMaskByte(ptr, msb ? lcdReverseByte(b) : b, set);
+        column >>= 8;
+        ptr += gfx->data.width;
+      }
+    }
+  } else {
+    // pixels are in rows - line each row up with the bytes it covers, leftmost pixel in the top bit
+    for (cy=0;cy<height;cy++) {
+      if (!rows[cy]) continue;
+      unsigned int idx = (unsigned int)(x + (y+cy)*gfx->data.width);
+      uint64_t line = ((uint64_t)rows[cy]) << (64 - (unsigned int)width - (idx&7));
+      unsigned char *ptr = &buf[idx>>3];
+      while (line) {
+        unsigned char b = (unsigned char)(line>>56);
+        lcdMaskByte(ptr, msb ? b : lcdReverseByte(b), set);
+        line <<= 8;
+        ptr++;
+      }
+    }
+  }
+}
+
+void  lcdFillRect_ArrayBufferFlat(struct JsGraphics *gfx, short x1, short y1, short x2, short y2) {
+  short y;
+  for (y=y1;y<=y2;y++)
+    lcdSetPixels_ArrayBufferFlat(gfx, x1, y, (short)(1+x2-x1), gfx->data.fgColor);
+}
+
+// ----------------------------------------------------------------------------------------------
+
 void lcdInit_ArrayBuffer(JsGraphics *gfx) {
   // create buffer
   JsVar *buf = jswrap_arraybuffer_constructor((gfx->data.width * gfx->data.height * gfx->data.bpp + 7) >> 3);
@@ -122,7 +262,20 @@ void lcdInit_ArrayBuffer(JsGraphics *gfx) {
 }
 
 void lcdSetCallbacks_ArrayBuffer(JsGraphics *gfx) {
-  gfx->setPixel = lcdSetPixel_ArrayBuffer;
-  gfx->getPixel = lcdGetPixel_ArrayBuffer;
-  gfx->fillRect = lcdFillRect_ArrayBuffer;
+  JsVar *buf = jsvObjectGetChild(gfx->graphicsVar, "buffer", 0);
+  size_t len = 0;
+  char *dataPtr = jsvIsArrayBuffer(buf) ? jsvGetWritableDataPointer(buf, &len) : 0;
+  jsvUnLock(buf);
+  if (dataPtr && len >= (size_t)((gfx->data.width * gfx->data.height * gfx->data.bpp + 7) >> 3)) {
+    gfx->backendData = dataPtr;
+    gfx->setPixel = lcdSetPixel_ArrayBufferFlat;
+    gfx->getPixel = lcdGetPixel_ArrayBufferFlat;
+    gfx->fillRect = lcdFillRect_ArrayBufferFlat;
+    if (gfx->data.bpp==1 && !(gfx->data.flags & JSGRAPHICSFLAGS_ARRAYBUFFER_ZIGZAG))
+      gfx->drawGlyph = lcdDrawGlyph_ArrayBufferFlat;
+  } else {
+    gfx->setPixel = lcdSetPixel_ArrayBuffer;
+    gfx->getPixel = lcdGetPixel_ArrayBuffer;
+    gfx->fillRect = lcdFillRect_ArrayBuffer;
+  }
 }
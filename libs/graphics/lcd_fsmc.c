@@ -305,22 +305,102 @@ void LCD_init_hardware() {
 #define LCD_RAM              (*((volatile unsigned short *) 0x60020000)) /* RS = 1 */
 
 
+/* Big writes to LCD_RAM are done with a memory to memory DMA transfer, which
+ * carries on after we return. Everything else that touches the LCD waits for
+ * it to finish first. */
+#define LCD_DMA DMA1_Channel6
+#define LCD_DMA_FLAG_TC DMA1_FLAG_TC6
+#define LCD_DMA_MAX 0xFFFF // the DMA count register is 16 bits
+#define LCD_DMA_MIN 32 // below this it's faster to just write the data
+#define LCD_DMA_PIXEL_CHUNK 128 // pixels byte-swapped at a time by LCD_WR_Data_pixels
+
+static uint16_t lcdDMAColor; ///< Source of DMA fills - must stay the same until the transfer finishes
+static bool lcdDMABusy = false;
+
+/// Wait for any DMA transfer to the LCD to finish
+static inline void lcdDMAWait() {
+  if (!lcdDMABusy) return;
+  while (DMA_GetFlagStatus(LCD_DMA_FLAG_TC) == RESET);
+  DMA_Cmd(LCD_DMA, DISABLE);
+  DMA_ClearFlag(LCD_DMA_FLAG_TC);
+  lcdDMABusy = false;
+}
+
+/// Start writing count (<=LCD_DMA_MAX) values from src to LCD_RAM. If !inc, the same value is written each time
+static void lcdDMAStart(const uint16_t *src, unsigned int count, bool inc) {
+  lcdDMAWait();
+  DMA_InitTypeDef DMA_InitStructure;
+  DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)&LCD_RAM;
+  DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t)src;
+  DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralDST;
+  DMA_InitStructure.DMA_BufferSize = count;
+  DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+  DMA_InitStructure.DMA_MemoryInc = inc ? DMA_MemoryInc_Enable : DMA_MemoryInc_Disable;
+  DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+  DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
+  DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+  DMA_InitStructure.DMA_Priority = DMA_Priority_Medium;
+  DMA_InitStructure.DMA_M2M = DMA_M2M_Enable;
+  DMA_Init(LCD_DMA, &DMA_InitStructure);
+  lcdDMABusy = true;
+  DMA_Cmd(LCD_DMA, ENABLE);
+}
+
 static inline void LCD_WR_REG(unsigned int index) {
+  lcdDMAWait();
   LCD_REG = (uint16_t)index;
 }
 
 static inline unsigned int LCD_RD_Data(void) {
-    return LCD_RAM;
+  lcdDMAWait();
+  return LCD_RAM;
 }
 
 static inline void LCD_WR_Data(unsigned int val) {
+  lcdDMAWait();
   LCD_RAM = (uint16_t)val;
 }
 
 static inline void LCD_WR_Data_multi(unsigned int val, unsigned int count) {
-  int i;
-  for (i=0;i<count;i++)
-    LCD_RAM = (uint16_t)val;
+  if (count < LCD_DMA_MIN) {
+    int i;
+    for (i=0;i<count;i++)
+      LCD_WR_Data(val);
+    return;
+  }
+  lcdDMAWait();
+  lcdDMAColor = (uint16_t)val;
+  while (count) {
+    unsigned int n = (count>LCD_DMA_MAX) ? LCD_DMA_MAX : count;
+    lcdDMAStart(&lcdDMAColor, n, false);
+    count -= n;
+  }
+  // the last transfer finishes in the background
+}
+
+/// Write count pixels, stored MSB first (as in drawImage's buffer)
+static void LCD_WR_Data_pixels(const unsigned char *data, unsigned int count) {
+  if (count < LCD_DMA_MIN) {
+    unsigned int i;
+    for (i=0;i<count;i++,data+=2)
+      LCD_WR_Data(((unsigned int)data[0]<<8) | data[1]);
+    return;
+  }
+  /* LCD_RAM wants them the other way around, so swap the bytes into a buffer
+   * while DMA sends the last one. We can't leave the transfer running
+   * after we return, as the buffer is on the stack. */
+  uint16_t buf[2][LCD_DMA_PIXEL_CHUNK];
+  int bufIdx = 0;
+  while (count) {
+    unsigned int i, n = (count>LCD_DMA_PIXEL_CHUNK) ? LCD_DMA_PIXEL_CHUNK : count;
+    uint16_t *b = buf[bufIdx];
+    for (i=0;i<n;i++,data+=2)
+      b[i] = (uint16_t)(((unsigned int)data[0]<<8) | data[1]);
+    lcdDMAStart(b, n, true);
+    bufIdx = !bufIdx;
+    count -= n;
+  }
+  lcdDMAWait();
 }
 
 
@@ -332,6 +412,7 @@ void LCD_init_hardware() {
   GPIO_InitTypeDef GPIO_InitStructure;
 
   RCC_AHBPeriphClockCmd(RCC_AHBPeriph_FSMC, ENABLE); /* Enable the FSMC Clock */
+  RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE); /* for lcdDMAStart */
   RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOA | RCC_APB2Periph_GPIOB | RCC_APB2Periph_GPIOC |
                    RCC_APB2Periph_GPIOD | RCC_APB2Periph_GPIOE , ENABLE);
 
@@ -390,6 +471,15 @@ void LCD_init_hardware() {
 
 #endif // NOT ILI9325_BITBANG
 
+#if defined(ILI9325_BITBANG) || defined(FSMC_BITBANG)
+/// Write count pixels, stored MSB first (as in drawImage's buffer)
+static void LCD_WR_Data_pixels(const unsigned char *data, unsigned int count) {
+  unsigned int i;
+  for (i=0;i<count;i++,data+=2)
+    LCD_WR_Data(((unsigned int)data[0]<<8) | data[1]);
+}
+#endif
+
 static inline void LCD_WR_CMD(unsigned int index,unsigned int val) {
   LCD_WR_REG(index);
   LCD_WR_Data(val);
@@ -1341,30 +1431,59 @@ static inline void lcdSetWindow(JsGraphics *gfx, unsigned short x1, unsigned sho
   }
 }
 
+static bool lcdHasWindow = false; ///< lcdSetWindow has been used since lcdSetFullWindow
+
 static inline void lcdSetFullWindow(JsGraphics *gfx) {
   lcdSetWindow(gfx,0,0,gfx->data.width-1,gfx->data.height-1);
+  lcdHasWindow = false;
 }
 
-
+/* Resetting the window is left until something needs it, so that a fill can
+ * carry on in the background (and fills one after another don't need it) */
+static inline void lcdEnsureFullWindow(JsGraphics *gfx) {
+  if (lcdHasWindow) lcdSetFullWindow(gfx);
+}
 
 void lcdFillRect_FSMC(JsGraphics *gfx, short x1, short y1, short x2, short y2) {
   // finally!
   if (x1==x2) { // special case for single vertical line - no window needed
+    lcdEnsureFullWindow(gfx);
     lcdSetCursor(gfx,x2,y1);
     LCD_WR_REG(0x22); // start data tx
-    unsigned int i=0, l=(1+y2-y1);
+    unsigned int l=(1+y2-y1);
     LCD_WR_Data_multi(gfx->data.fgColor, l);
   } else {
     lcdSetWindow(gfx,x1,y1,x2,y2);
+    lcdHasWindow = true;
     lcdSetCursor(gfx,x2,y1);
     LCD_WR_REG(0x22); // start data tx
-    unsigned int i=0, l=(1+x2-x1)*(1+y2-y1);
+    unsigned int l=(1+x2-x1)*(1+y2-y1);
     LCD_WR_Data_multi(gfx->data.fgColor, l);
-    lcdSetFullWindow(gfx);
   }
 }
 
+/* Write the image a row at a time, left to right. The panel normally fills a
+ * window a column at a time (see lcdFillRect_FSMC) so we temporarily change the
+ * entry mode - we only know how to do that for the ILI9325/ILI9331 */
+void lcdBlit_FSMC(JsGraphics *gfx, short x, short y, short width, short height, const unsigned char *data, size_t stride) {
+  short x2 = (short)(x+width-1), y2 = (short)(y+height-1);
+  lcdSetWindow(gfx,x,y,x2,y2);
+  lcdHasWindow = true;
+  LCD_WR_CMD(0x0003, 0x1018); // vertical address (our X) updated first, and decremented
+  lcdSetCursor(gfx,x,y);
+  LCD_WR_REG(0x22); // start data tx
+  if (stride == (size_t)width*2) {
+    LCD_WR_Data_pixels(data, (unsigned int)width*(unsigned int)height);
+  } else {
+    short i;
+    for (i=0;i<height;i++,data+=stride)
+      LCD_WR_Data_pixels(data, (unsigned int)width);
+  }
+  LCD_WR_CMD(0x0003, 0x1030);
+}
+
 unsigned int lcdGetPixel_FSMC(JsGraphics *gfx, short x, short y) {
+  lcdEnsureFullWindow(gfx);
   lcdSetCursor(gfx,x,y);
   LCD_WR_REG(0x22); // start data tx
   return LCD_RD_Data();
@@ -1372,6 +1491,7 @@ unsigned int lcdGetPixel_FSMC(JsGraphics *gfx, short x, short y) {
 
 
 void lcdSetPixel_FSMC(JsGraphics *gfx, short x, short y, unsigned int col) {
+  lcdEnsureFullWindow(gfx);
   lcdSetCursor(gfx,x,y);
   LCD_WR_REG(34);
   LCD_WR_Data(col);
@@ -1389,5 +1509,7 @@ void lcdSetCallbacks_FSMC(JsGraphics *gfx) {
   gfx->setPixel = lcdSetPixel_FSMC;
   gfx->getPixel = lcdGetPixel_FSMC;
   gfx->fillRect = lcdFillRect_FSMC;
+  if (LCD_Code == ILI9325 || LCD_Code == ILI9331)
+    gfx->blit = lcdBlit_FSMC;
 }
 
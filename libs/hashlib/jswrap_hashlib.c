@@ -16,8 +16,8 @@
 #include <string.h>
 #include "jswrap_hashlib.h"
 
-const JsHash256 ctx256;
-// const JsHash512 ctx512;
+static JsHash256 ctx256;
+// static JsHash512 ctx512;
 
 JsHashLib hashFunctions[4] = {
   { .name="sha224", .data=(char*)&ctx256.context, .init=sha224_init, .update=sha224_update,
@@ -95,6 +95,11 @@ JsVar *jswrap_hashlib_sha256(JsVar *message) {
 }
 
 
+static void jswrap_hashlib_hash_update_cb(const unsigned char *data, size_t len, void *userData) {
+  JsHashLib *hash = (JsHashLib*)userData;
+  hash->update(hash->data, data, (unsigned int)len);
+}
+
 JsVar *jswrap_hashlib_sha2(JsHashType hash_type) {
   JsVar *hashobj = jspNewObject(0, "HASH");
 
@@ -121,6 +126,120 @@ JsVar *jswrap_hashlib_sha2(JsHashType hash_type) {
   return hashobj;
 }
 
+/// Load the named context of a HASH object into hash->data
+static void jswrap_hashlib_load_context(JsVar *parent, const char *name, JsHashLib *hash) {
+  JsVar *jsCtx = jsvObjectGetChild(parent, name, 0);
+  jsvGetString(jsCtx, hash->data, hash->ctx_size + 1); // trailing zero
+  jsvUnLock(jsCtx);
+}
+
+/// Create a new string containing hash->data
+static JsVar *jswrap_hashlib_new_context(JsHashLib *hash) {
+  JsVar *jsCtx = jsvNewStringOfLength(hash->ctx_size);
+  if (jsCtx) jsvSetString(jsCtx, hash->data, hash->ctx_size);
+  return jsCtx;
+}
+
+/// Get the hash functions used by a HASH object
+static JsHashLib *jswrap_hashlib_get(JsVar *parent) {
+  JsVar *child = jsvObjectGetChild(parent, "hash_type", 0);
+  JsVarInt type = jsvGetInteger(child);
+  jsvUnLock(child);
+  if (type<HASH_SHA224 || type>HASH_SHA256) return 0;
+  return &hashFunctions[type];
+}
+
+/// Finish the hash (without changing the HASH object), and return the size of the digest written to buff
+static unsigned int jswrap_hashlib_final(JsVar *parent, char *buff) {
+  JsHashLib *hash = jswrap_hashlib_get(parent);
+  if (!hash) return 0;
+  jswrap_hashlib_load_context(parent, "context", hash);
+  hash->final(hash->data, buff);
+  JsVar *outer = jsvObjectGetChild(parent, "outer", 0);
+  if (outer) {
+    // HMAC - hash the inner digest with the (precomputed) outer key pad
+    jswrap_hashlib_load_context(parent, "outer", hash);
+    hash->update(hash->data, buff, hash->digest_size);
+    hash->final(hash->data, buff);
+    jsvUnLock(outer);
+  }
+  return hash->digest_size;
+}
+
+/// Start a new hash with the key XORed with 'pad', and store its context in parent
+static void jswrap_hashlib_hmac_pad(JsVar *parent, const char *name, JsHashLib *hash, const unsigned char *key, unsigned char pad) {
+  unsigned char block[SHA256_BLOCK_SIZE];
+  unsigned int i;
+  for (i=0;i<hash->block_size;i++)
+    block[i] = key[i] ^ pad;
+  hash->init(hash->data);
+  hash->update(hash->data, block, hash->block_size);
+  memset(block, 0, sizeof(block));
+  jsvObjectSetChildAndUnLock(parent, name, jswrap_hashlib_new_context(hash));
+}
+
+/*JSON{
+  "type" : "staticmethod",
+  "class" : "hashlib",
+  "name" : "hmac",
+  "generate" : "jswrap_hashlib_hmac",
+  "params" : [
+    ["key","JsVar","The secret key (a String or ArrayBuffer)"],
+    ["hash","JsVar","The name of the hash to use - `'sha256'` (default) or `'sha224'`"]
+  ],
+  "return" : ["JsVar","Returns a new HASH Object that computes an HMAC"],
+  "return_object" : "HASH"
+}
+Create an HMAC (RFC 2104) of messages passed to `update` using `key`, for
+instance for signing requests:
+
+```
+var mac = require("hashlib").hmac("secret", "sha256");
+mac.update("message");
+print(mac.hexdigest());
+mac.reset(); // ready to sign another message with the same key
+```
+
+The key is only processed once, when the HMAC is created. After `reset()` the
+same object can be used for the next message without hashing the key again.
+*/
+JsVar *jswrap_hashlib_hmac(JsVar *key, JsVar *hashName) {
+  JsHashType type = HASH_SHA256;
+  if (!jsvIsUndefined(hashName)) {
+    if (jsvIsStringEqual(hashName, hashFunctions[HASH_SHA224].name)) type = HASH_SHA224;
+    else if (!jsvIsStringEqual(hashName, hashFunctions[HASH_SHA256].name)) {
+      jsExceptionHere(JSET_ERROR, "Unsupported hash %q", hashName);
+      return 0;
+    }
+  }
+  if (!jsvIsIterable(key)) {
+    jsExceptionHere(JSET_TYPEERROR, "Expecting key to be a String or ArrayBuffer, got %t", key);
+    return 0;
+  }
+  JsHashLib *hash = &hashFunctions[type];
+  unsigned char k[SHA256_BLOCK_SIZE];
+  memset(k, 0, sizeof(k));
+  if ((unsigned int)jsvIterateCallbackCount(key) > hash->block_size) {
+    // keys longer than a block are hashed first
+    hash->init(hash->data);
+    jsvIterateBufferCallback(key, jswrap_hashlib_hash_update_cb, hash);
+    hash->final(hash->data, k);
+  } else {
+    jsvIterateCallbackToBytes(key, k, hash->block_size);
+  }
+
+  JsVar *hashobj = jswrap_hashlib_sha2(type);
+  if (hashobj) {
+    jswrap_hashlib_hmac_pad(hashobj, "outer", hash, k, 0x5C);
+    jswrap_hashlib_hmac_pad(hashobj, "inner", hash, k, 0x36);
+    // hash->data now holds the inner context, which is where we start
+    jsvObjectSetChildAndUnLock(hashobj, "context", jswrap_hashlib_new_context(hash));
+    JsVar *name = jsvVarPrintf("hmac-%s", hash->name);
+    jsvObjectSetChildAndUnLock(hashobj, "name", name);
+  }
+  memset(k, 0, sizeof(k));
+  return hashobj;
+}
 
 /*JSON{
   "type" : "method",
@@ -133,27 +252,14 @@ JsVar *jswrap_hashlib_sha2(JsHashType hash_type) {
 }
 */
 void jswrap_hashlib_hash_update(JsVar *parent, JsVar *message) {
-  int type;
-  char buff[SHA256_DIGEST_SIZE];
+  JsHashLib *hash = jswrap_hashlib_get(parent);
+  if (!hash || !jsvIsIterable(message)) return;
 
   JsVar *jsCtx = jsvObjectGetChild(parent, "context", 0);
-  JsVar *child = jsvObjectGetChild(parent, "hash_type", 0);
-
-  type = jsvGetInteger(child);
-  jsvUnLock(child);
-
-  jsvGetString(jsCtx, hashFunctions[type].data, hashFunctions[type].ctx_size + 1);  // trailing zero
-
-  if (jsvIsString(message)) {
-    size_t i;
-    size_t len = jsvGetStringLength(message);
-    for(i = 0; i < len; i += sizeof(buff)) {
-      int read = (int)jsvGetStringChars(message, i, buff, sizeof(buff));
-      hashFunctions[type].update(hashFunctions[type].data, buff, read);
-    }
-    jsvSetString(jsCtx, hashFunctions[type].data, hashFunctions[type].ctx_size);
-  }
-
+  jsvGetString(jsCtx, hash->data, hash->ctx_size + 1);  // trailing zero
+  // hash a block of the String/ArrayBuffer at a time
+  jsvIterateBufferCallback(message, jswrap_hashlib_hash_update_cb, hash);
+  jsvSetString(jsCtx, hash->data, hash->ctx_size);
   jsvUnLock(jsCtx);
 }
 
@@ -169,26 +275,11 @@ void jswrap_hashlib_hash_update(JsVar *parent, JsVar *message) {
 }
 */
 JsVar *jswrap_hashlib_hash_digest(JsVar *parent) {
-  int type;
   char buff[SHA256_DIGEST_SIZE];
-  JsVar *jsCtx = NULL;
-  JsVar *child = NULL;
-
-  child = jsvObjectGetChild(parent, "hash_type", 0);
-  type = jsvGetInteger(child);
-  jsvUnLock(child);
-
-  JsVar *digest = jsvNewStringOfLength(hashFunctions[type].digest_size);
+  unsigned int size = jswrap_hashlib_final(parent, buff);
+  JsVar *digest = jsvNewStringOfLength(size);
   if (!digest) return 0; // out of memory
-
-  jsCtx = jsvObjectGetChild(parent, "context", 0);
-
-  jsvGetString(jsCtx, hashFunctions[type].data, hashFunctions[type].ctx_size + 1); // trailing zero
-  jsvUnLock(jsCtx);
-
-  hashFunctions[type].final(hashFunctions[type].data, buff);
-  jsvSetString(digest, buff, hashFunctions[type].digest_size);
-
+  jsvSetString(digest, buff, size);
   return digest;
 }
 
@@ -204,28 +295,15 @@ JsVar *jswrap_hashlib_hash_digest(JsVar *parent) {
 }
 */
 JsVar *jswrap_hashlib_hash_hexdigest(JsVar *parent) {
-  int type;
   char buff[SHA256_DIGEST_SIZE];
   char a[] = "0123456789abcdef";
-  JsVar *jsCtx = NULL;
-  JsVar *child = NULL;
-  JsVar *digest = NULL;
-
-  child = jsvObjectGetChild(parent, "hash_type", 0);
-  type = jsvGetInteger(child);
-  jsvUnLock(child);
+  unsigned int size = jswrap_hashlib_final(parent, buff);
 
-  digest = jsvNewStringOfLength(0); // hashFunctions[type].digest_size*2
+  JsVar *digest = jsvNewStringOfLength(0); // size*2
   if (!digest) return 0; // out of memory
 
-  jsCtx = jsvObjectGetChild(parent, "context", 0);
-  jsvGetString(jsCtx, hashFunctions[type].data, hashFunctions[type].ctx_size + 1); // trailing zero
-  jsvUnLock(jsCtx);
-
-  hashFunctions[type].final(hashFunctions[type].data, buff);
-
   unsigned int i;
-  for(i = 0; i < hashFunctions[type].digest_size; i++) {
+  for(i = 0; i < size; i++) {
     char c[2];
     c[0] = a[ (unsigned char)(buff[i]) >> 4 ];
     c[1] = a[ (unsigned char)(buff[i]) & 0x0F ];
@@ -234,3 +312,26 @@ JsVar *jswrap_hashlib_hash_hexdigest(JsVar *parent) {
 
   return digest;
 }
+
+/*JSON{
+  "type" : "method",
+  "class" : "HASH",
+  "name" : "reset",
+  "generate" : "jswrap_hashlib_hash_reset"
+}
+Forget everything passed to `update` so the object can be used to hash a new
+message. For an HMAC the key is kept, so it doesn't have to be processed again.
+*/
+void jswrap_hashlib_hash_reset(JsVar *parent) {
+  JsHashLib *hash = jswrap_hashlib_get(parent);
+  if (!hash) return;
+  JsVar *jsCtx = jsvObjectGetChild(parent, "context", 0);
+  JsVar *inner = jsvObjectGetChild(parent, "inner", 0);
+  if (inner)
+    jswrap_hashlib_load_context(parent, "inner", hash);
+  else
+    hash->init(hash->data);
+  jsvUnLock(inner);
+  jsvSetString(jsCtx, hash->data, hash->ctx_size);
+  jsvUnLock(jsCtx);
+}
@@ -50,7 +50,9 @@ JsVar *jswrap_hashlib_sha256(JsVar *message);
 // JsVar *jswrap_hashlib_sha512(JsVar *message);
 
 JsVar *jswrap_hashlib_sha2(JsHashType hash_type);
+JsVar *jswrap_hashlib_hmac(JsVar *key, JsVar *hashName);
 
 JsVar *jswrap_hashlib_hash_digest(JsVar *parent);
 JsVar *jswrap_hashlib_hash_hexdigest(JsVar *parent);
 void jswrap_hashlib_hash_update(JsVar *parent, JsVar *message);
+void jswrap_hashlib_hash_reset(JsVar *parent);
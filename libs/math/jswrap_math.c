@@ -16,12 +16,32 @@
 #include "jswrap_math.h"
 #include "jsvariterator.h"
 
-static bool isNegativeZero(double x) {
-  double NEGATIVE_ZERO = -0.0;
-  return *((long long*)&x) == *((long long*)&NEGATIVE_ZERO);
+static bool isNegativeZero(JsVarFloat x) {
+  return x==0 && signbit(x);
 }
 
-double jswrap_math_sin(double x) {
+#ifdef FAST_MATH
+// ln(2) split so k*LN2_HI is exact for the exponents we use (from fdlibm)
+#define LN2_HI (6.93147180369123816490e-01)
+#define LN2_LO (1.90821492927058770002e-10)
+#define PI_LO (1.2246467991473532e-16) // PI - (double)PI
+
+/// 1/n for odd n, for the atan and log series
+static const JsVarFloat mathOddRecip[] = {
+  1.0, 1.0/3, 1.0/5, 1.0/7, 1.0/9, 1.0/11, 1.0/13, 1.0/15, 1.0/17, 1.0/19, 1.0/21
+};
+
+/// sum of (-1)^i * x2^i / (2i+1) - atan(x)/x. Good to 1e-10 for |x|<0.42
+static JsVarFloat mathAtanSeries(JsVarFloat x2) {
+  JsVarFloat p = 0;
+  int i;
+  for (i=10;i>=0;i--)
+    p = mathOddRecip[i] - x2*p;
+  return p;
+}
+#endif
+
+JsVarFloat jswrap_math_sin(JsVarFloat x) {
 #ifdef SAVE_ON_FLASH
   /* To save on flash, do our own sin function that's slower/nastier
    * but is smaller! If we pull in gcc's it adds:
@@ -37,23 +57,39 @@ double jswrap_math_sin(double x) {
   x -= xi*PI;
   if (x>PI/2) x=PI-x;
   // Taylor series expansion of 'sin'
-  double r = x; // running total
-  double x2 = x*x; // precalculate x^2
-  double xpow = x; // running power
+  JsVarFloat r = x; // running total
+  JsVarFloat x2 = x*x; // precalculate x^2
+  JsVarFloat xpow = x; // running power
   unsigned int factorial = 1; // running factorial
   unsigned int i;
   for (i=1;i<10;i++) {
     xpow = xpow*x2;
     factorial *= (i*2)*((i*2)+1);
-    double term = xpow / factorial;
+    JsVarFloat term = xpow / factorial;
     if (i&1) r-=term; else r+=term;
   }
   // symmetry
   if (xi&1) r=-r;
   return r;
+#elif defined(FAST_MATH)
+  /* Reduce to -PI/2..PI/2 then use the Taylor series up to x^15, which
+   * is good to ~1e-12 there. Far faster than libm without an FPU */
+  if (!isfinite(x)) return NAN;
+  JsVarFloat n = jswrap_math_floor(x/PI + 0.5);
+  x = (x - n*PI) - n*PI_LO;
+  JsVarFloat x2 = x*x;
+  JsVarFloat r = x*(1 + x2*(-1.0/6 + x2*(1.0/120 + x2*(-1.0/5040 + x2*(1.0/362880 +
+                 x2*(-1.0/39916800 + x2*(1.0/6227020800 + x2*(-1.0/1307674368000))))))));
+  // odd multiples of PI flip the sign
+  if (n - 2*jswrap_math_floor(n/2) != 0) r=-r;
+  return r;
+#else
+#ifdef USE_FLOATS
+  return sinf(x);
 #else
   return sin(x);
 #endif
+#endif
 }
 
 /*JSON{
@@ -165,12 +201,12 @@ JsVarFloat jswrap_math_abs(JsVarFloat x) {
   ],
   "return" : ["float","The arc tangent of x, between -PI/2 and PI/2"]
 }*/
-double jswrap_math_atan(double x) {
+JsVarFloat jswrap_math_atan(JsVarFloat x) {
 #ifdef SAVE_ON_FLASH
   /* To save on flash, do our own atan function that's slower/nastier
    * but is smaller! */
   // exploit symmetry - we're only accurate when x is small
-  double ox = x;
+  JsVarFloat ox = x;
   bool negate = false;
   bool offset = false;
   if (x<0) {
@@ -183,22 +219,40 @@ double jswrap_math_atan(double x) {
   }
 
   // Taylor series expansion of 'atan'
-  double r = x; // running total
-  double x2 = x*x; // precalculate x^2
-  double xpow = x; // running power
+  JsVarFloat r = x; // running total
+  JsVarFloat x2 = x*x; // precalculate x^2
+  JsVarFloat xpow = x; // running power
   unsigned int i;
   for (i=1;i<20;i++) {
     xpow = xpow*x2;
-    double term = xpow / ((i*2)+1);
+    JsVarFloat term = xpow / ((i*2)+1);
     if (i&1) r-=term; else r+=term;
   }
   // symmetry
   if (offset) r=(PI/2)-r;
   if (negate) r=-r;
   return r;
+#elif defined(FAST_MATH)
+  // fold into 0..tan(PI/8) using symmetry, then a series that converges quickly there
+  bool negate = signbit(x);
+  if (negate) x = -x;
+  bool invert = x>1;
+  if (invert) x = 1/x;
+  JsVarFloat offset = 0;
+  if (x > 0.41421356237309503) { // tan(PI/8)
+    x = (x-1) / (x+1); // atan(x) = PI/4 + atan((x-1)/(x+1))
+    offset = PI/4;
+  }
+  JsVarFloat r = offset + x*mathAtanSeries(x*x);
+  if (invert) r = (PI/2) - r;
+  return negate ? -r : r;
+#else
+#ifdef USE_FLOATS
+  return atanf(x);
 #else
   return atan(x);
 #endif
+#endif
 }
 
 /*JSON{
@@ -206,29 +260,43 @@ double jswrap_math_atan(double x) {
   "ifndef" : "SAVE_ON_FLASH",
   "class" : "Math",
   "name" : "atan2",
-  "generate" : "atan2",
+  "generate" : "jswrap_math_atan2",
   "params" : [
     ["y","float","The Y-part of the angle to get the arc tangent of"],
     ["x","float","The X-part of the angle to get the arc tangent of"]
   ],
   "return" : ["float","The arctangent of Y/X, between -PI and PI"]
 }*/
+#ifdef FAST_MATH
+JsVarFloat jswrap_math_atan2(JsVarFloat y, JsVarFloat x) {
+  if (isnan(x) || isnan(y)) return NAN;
+  JsVarFloat r;
+  if (isinf(x) && isinf(y))
+    r = PI/4;
+  else if (x==0 && y==0)
+    r = 0;
+  else
+    r = jswrap_math_atan(fabs(y) / fabs(x)); // 0..PI/2, handles infinities
+  if (signbit(x)) r = PI - r;
+  return signbit(y) ? -r : r;
+}
+#endif
 
 /* we use sin here, not cos, to try and save a bit of code space */
 /*JSON{
   "type" : "staticmethod",
   "class" : "Math",
   "name" : "cos",
-  "generate_full" : "jswrap_math_sin(theta + (PI/2))",
+  "generate_full" : "jswrap_math_sin(theta + (JsVarFloat)(PI/2))",
   "params" : [
     ["theta","float","The angle to get the cosine of"]
   ],
   "return" : ["float","The cosine of theta"]
 }*/
 
-double jswrap_math_mod(double x, double y) {
-  double a, b;
-  const double c = x;
+JsVarFloat jswrap_math_mod(JsVarFloat x, JsVarFloat y) {
+  JsVarFloat a, b;
+  const JsVarFloat c = x;
 
   if (!isfinite(x) || isnan(y))
     return NAN;
@@ -254,8 +322,8 @@ double jswrap_math_mod(double x, double y) {
   return 0 > c ? -x : x;
 }
 
-double jswrap_math_pow(double x, double y) {
-  double p;
+JsVarFloat jswrap_math_pow(JsVarFloat x, JsVarFloat y) {
+  JsVarFloat p;
   /* quick hack for raising to a small integer power.
    * exp/log aren't accurate and are relatively slow, so
    * it's probably better to bash through small integer
@@ -276,13 +344,13 @@ double jswrap_math_pow(double x, double y) {
    * of flash */
   if (x < 0 && jswrap_math_mod(y, 1) == 0) {
     if (jswrap_math_mod(y, 2) == 0) {
-      p = exp(log(-x) * y);
+      p = jswrap_math_exp(jswrap_math_log(-x) * y);
     } else {
-      p = -exp(log(-x) * y);
+      p = -jswrap_math_exp(jswrap_math_log(-x) * y);
     }
   } else {
     if (x != 0 || 0 >= y) {
-      p = exp(log( x) * y);
+      p = jswrap_math_exp(jswrap_math_log( x) * y);
     } else {
       p = 0;
     }
@@ -319,11 +387,12 @@ double jswrap_math_pow(double x, double y) {
   ],
   "return" : ["JsVar","x, rounded to the nearest integer"]
 }*/
-JsVar *jswrap_math_round(double x) {
+JsVar *jswrap_math_round(JsVarFloat x) {
   if (!isfinite(x) || isNegativeZero(x)) return jsvNewFromFloat(x);
-  x += (x<0) ? -0.4999999999 : 0.4999999999;
-  JsVarInt i = (JsVarInt)x;
-  if (i==0 && (x<0))
+  // in double, as with USE_FLOATS the offset would round up to 0.5
+  double d = x + ((x<0) ? -0.4999999999 : 0.4999999999);
+  JsVarInt i = (JsVarInt)d;
+  if (i==0 && (d<0))
     return jsvNewFromFloat(-0.0); // pass -0 through
   return jsvNewFromInteger(i);
 }
@@ -342,7 +411,7 @@ JsVar *jswrap_math_round(double x) {
   "type" : "staticmethod",
   "class" : "Math",
   "name" : "tan",
-  "generate_full" : "jswrap_math_sin(theta) / jswrap_math_sin(theta+(PI/2))",
+  "generate_full" : "jswrap_math_sin(theta) / jswrap_math_sin(theta+(JsVarFloat)(PI/2))",
   "params" : [
     ["theta","float","The angle to get the tangent of"]
   ],
@@ -361,15 +430,28 @@ JsVar *jswrap_math_round(double x) {
   "return" : ["float","The square root of x"]
 }*/
 
-double jswrap_math_sqrt(double x) {
-  return (x>=0) ? exp(log(x) * 0.5) : NAN;
+JsVarFloat jswrap_math_sqrt(JsVarFloat x) {
+#ifdef FAST_MATH
+  if (!(x>0) || isinf(x)) return (x>=0) ? x : NAN; // +-0, Infinity, NaN and negatives
+  // split into mantissa 0.5..2 and an even exponent, then Newton's method
+  int e;
+  JsVarFloat m = jswrap_math_frexp(x, &e);
+  if (e&1) { m *= 2; e--; }
+  JsVarFloat r = (1 + m) / 2;
+  int i;
+  for (i=0;i<4;i++) // error goes 6% -> 0.2% -> 2e-6 -> 1e-12 -> exact
+    r = (r + m/r) / 2;
+  return jswrap_math_ldexp(r, e/2);
+#else
+  return (x>=0) ? jswrap_math_exp(jswrap_math_log(x) / 2) : NAN;
+#endif
 }
 
 /*JSON{
   "type" : "staticmethod",
   "class" : "Math",
   "name" : "ceil",
-  "generate" : "ceil",
+  "generate" : "jswrap_math_ceil",
   "params" : [
     ["x","float","The value to round up"]
   ],
@@ -379,7 +461,7 @@ double jswrap_math_sqrt(double x) {
   "type" : "staticmethod",
   "class" : "Math",
   "name" : "floor",
-  "generate" : "floor",
+  "generate" : "jswrap_math_floor",
   "params" : [
     ["x","float","The value to round down"]
   ],
@@ -390,22 +472,54 @@ double jswrap_math_sqrt(double x) {
   "type" : "staticmethod",
   "class" : "Math",
   "name" : "exp",
-  "generate" : "exp",
+  "generate" : "jswrap_math_exp",
   "params" : [
     ["x","float","The value raise E to the power of"]
   ],
   "return" : ["float","E^x"]
 }*/
+#ifdef FAST_MATH
+JsVarFloat jswrap_math_exp(JsVarFloat x) {
+  if (isnan(x)) return x;
+  if (x > 709.8) return INFINITY;
+  if (x < -745.2) return 0;
+  // e^x = 2^k * e^r, where |r| <= ln(2)/2 - then Taylor series up to r^11
+  int k = (int)jswrap_math_floor(x*1.4426950408889634 + 0.5);
+  JsVarFloat r = (x - k*LN2_HI) - k*LN2_LO;
+  JsVarFloat p = 1;
+  int i;
+  for (i=11;i>0;i--)
+    p = 1 + p*r/i;
+  return jswrap_math_ldexp(p, k);
+}
+#endif
 /*JSON{
   "type" : "staticmethod",
   "class" : "Math",
   "name" : "log",
-  "generate" : "log",
+  "generate" : "jswrap_math_log",
   "params" : [
     ["x","float","The value to take the logarithm (base E) root of"]
   ],
   "return" : ["float","The log (base E) of x"]
 }*/
+#ifdef FAST_MATH
+JsVarFloat jswrap_math_log(JsVarFloat x) {
+  if (isnan(x) || x<0) return NAN;
+  if (x==0) return -INFINITY;
+  if (isinf(x)) return x;
+  // x = m * 2^e with m in 1/sqrt(2)..sqrt(2), then ln(m) = 2*atanh((m-1)/(m+1))
+  int e;
+  JsVarFloat m = jswrap_math_frexp(x, &e);
+  if (m < 0.7071067811865476) { m *= 2; e--; }
+  JsVarFloat s = (m-1) / (m+1), s2 = s*s;
+  JsVarFloat p = 0;
+  int i;
+  for (i=7;i>=0;i--) // |s| < 0.172, so this is good to ~1e-13
+    p = mathOddRecip[i] + s2*p;
+  return e*LN2_HI + (2*s*p + e*LN2_LO);
+}
+#endif
 
 /*JSON{
   "type" : "staticmethod",
@@ -483,3 +597,87 @@ JsVarFloat jswrap_math_minmax(JsVar *args, bool isMax) {
   return v;
 }
 
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "Math",
+  "name" : "isqrt",
+  "generate" : "jswrap_math_isqrt",
+  "params" : [
+    ["x","int","The integer to take the square root of"]
+  ],
+  "return" : ["int","The square root of x rounded down, or 0 if x is negative"]
+}
+**Note:** This is not part of the JavaScript standard.
+
+Integer square root, calculated using only integer arithmetic. On devices without
+an FPU this is much faster than `Math.floor(Math.sqrt(x))`.
+*/
+#ifndef SAVE_ON_FLASH
+JsVarInt jswrap_math_isqrt(JsVarInt x) {
+  if (x<=0) return 0;
+  uint32_t n = (uint32_t)x;
+  uint32_t r = 0;
+  uint32_t bit = 1UL << 30; // highest power of 4 <= 2^31
+  while (bit > n) bit >>= 2;
+  while (bit) {
+    if (n >= r + bit) {
+      n -= r + bit;
+      r = (r >> 1) + bit;
+    } else
+      r >>= 1;
+    bit >>= 2;
+  }
+  return (JsVarInt)r;
+}
+
+/// round(32767*sin(i*PI/512)) - a quarter of a sine wave
+static const int16_t fixedSinTable[257] = {
+  0, 201, 402, 603, 804, 1005, 1206, 1407, 1608, 1809, 2009, 2210, 2410, 2611, 2811, 3012,
+  3212, 3412, 3612, 3811, 4011, 4210, 4410, 4609, 4808, 5007, 5205, 5404, 5602, 5800, 5998, 6195,
+  6393, 6590, 6786, 6983, 7179, 7375, 7571, 7767, 7962, 8157, 8351, 8545, 8739, 8933, 9126, 9319,
+  9512, 9704, 9896, 10087, 10278, 10469, 10659, 10849, 11039, 11228, 11417, 11605, 11793, 11980, 12167, 12353,
+  12539, 12725, 12910, 13094, 13279, 13462, 13645, 13828, 14010, 14191, 14372, 14553, 14732, 14912, 15090, 15269,
+  15446, 15623, 15800, 15976, 16151, 16325, 16499, 16673, 16846, 17018, 17189, 17360, 17530, 17700, 17869, 18037,
+  18204, 18371, 18537, 18703, 18868, 19032, 19195, 19357, 19519, 19680, 19841, 20000, 20159, 20317, 20475, 20631,
+  20787, 20942, 21096, 21250, 21403, 21554, 21705, 21856, 22005, 22154, 22301, 22448, 22594, 22739, 22884, 23027,
+  23170, 23311, 23452, 23592, 23731, 23870, 24007, 24143, 24279, 24413, 24547, 24680, 24811, 24942, 25072, 25201,
+  25329, 25456, 25582, 25708, 25832, 25955, 26077, 26198, 26319, 26438, 26556, 26674, 26790, 26905, 27019, 27133,
+  27245, 27356, 27466, 27575, 27683, 27790, 27896, 28001, 28105, 28208, 28310, 28411, 28510, 28609, 28706, 28803,
+  28898, 28992, 29085, 29177, 29268, 29358, 29447, 29534, 29621, 29706, 29791, 29874, 29956, 30037, 30117, 30195,
+  30273, 30349, 30424, 30498, 30571, 30643, 30714, 30783, 30852, 30919, 30985, 31050, 31113, 31176, 31237, 31297,
+  31356, 31414, 31470, 31526, 31580, 31633, 31685, 31736, 31785, 31833, 31880, 31926, 31971, 32014, 32057, 32098,
+  32137, 32176, 32213, 32250, 32285, 32318, 32351, 32382, 32412, 32441, 32469, 32495, 32521, 32545, 32567, 32589,
+  32609, 32628, 32646, 32663, 32678, 32692, 32705, 32717, 32728, 32737, 32745, 32752, 32757, 32761, 32765, 32766,
+  32767
+};
+#endif
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "fixedSin",
+  "generate" : "jswrap_espruino_fixedSin",
+  "params" : [
+    ["angle","int","The angle, where 65536 is a full circle (so 16384 is 90 degrees)"]
+  ],
+  "return" : ["int","The sine of the angle, between -32767 and 32767"]
+}
+Fixed point sine, using a lookup table and only integer arithmetic. This is far faster
+than `Math.sin` on devices without an FPU, and is accurate to within 1 (out of 32767).
+
+The angle wraps around, and `E.fixedSin(angle+16384)` gives the cosine.
+*/
+#ifndef SAVE_ON_FLASH
+JsVarInt jswrap_espruino_fixedSin(JsVarInt angle) {
+  uint32_t a = (uint32_t)angle & 0xFFFF;
+  uint32_t p = a & 0x3FFF; // position in this quarter
+  if (a & 0x4000) p = 0x4000 - p; // second and fourth quarters go backwards
+  uint32_t idx = p >> 6, frac = p & 63;
+  int v = fixedSinTable[idx];
+  if (frac) v += ((fixedSinTable[idx+1] - v) * (int)frac) >> 6;
+  return (a & 0x8000) ? -v : v;
+}
+#endif
@@ -18,14 +18,45 @@
 
 #define PI (3.141592653589793)
 
+/* libm functions that are called directly from JS. With USE_FLOATS these
+ * must be the single precision versions, as they're passed JsVarFloats */
+#ifdef USE_FLOATS
+#define jswrap_math_ceil ceilf
+#define jswrap_math_floor floorf
+#define jswrap_math_ldexp ldexpf
+#define jswrap_math_frexp frexpf
+#else
+#define jswrap_math_ceil ceil
+#define jswrap_math_floor floor
+#define jswrap_math_ldexp ldexp
+#define jswrap_math_frexp frexp
+#endif
+/* With FAST_MATH, these are our own polynomial versions (see jswrap_math.c)
+ * rather than libm's, which are very slow on chips without an FPU */
+#ifdef FAST_MATH
+JsVarFloat jswrap_math_atan2(JsVarFloat y, JsVarFloat x);
+JsVarFloat jswrap_math_exp(JsVarFloat x);
+JsVarFloat jswrap_math_log(JsVarFloat x);
+#elif defined(USE_FLOATS)
+#define jswrap_math_atan2 atan2f
+#define jswrap_math_exp expf
+#define jswrap_math_log logf
+#else
+#define jswrap_math_atan2 atan2
+#define jswrap_math_exp exp
+#define jswrap_math_log log
+#endif
+
 
 JsVarInt jswrap_integer_valueOf(JsVar *v);
 JsVarFloat jswrap_math_abs(JsVarFloat x);
-double jswrap_math_mod(double x, double y);
-double jswrap_math_pow(double x, double y);
-JsVar *jswrap_math_round(double x);
-double jswrap_math_sqrt(double x);
-double jswrap_math_sin(double x);
-double jswrap_math_atan(double x);
+JsVarFloat jswrap_math_mod(JsVarFloat x, JsVarFloat y);
+JsVarFloat jswrap_math_pow(JsVarFloat x, JsVarFloat y);
+JsVar *jswrap_math_round(JsVarFloat x);
+JsVarFloat jswrap_math_sqrt(JsVarFloat x);
+JsVarFloat jswrap_math_sin(JsVarFloat x);
+JsVarFloat jswrap_math_atan(JsVarFloat x);
 JsVarFloat jswrap_math_clip(JsVarFloat x, JsVarFloat min, JsVarFloat max);
 JsVarFloat jswrap_math_minmax(JsVar *args, bool isMax);
+JsVarInt jswrap_math_isqrt(JsVarInt x);
+JsVarInt jswrap_espruino_fixedSin(JsVarInt angle);
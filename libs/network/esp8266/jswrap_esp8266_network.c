@@ -51,6 +51,7 @@ typedef long long int64_t;
 
 #include "jswrap_esp8266_network.h"
 #include "jswrap_esp8266.h"
+#include "ESP8266_board.h"
 #include "jswrap_modules.h"
 #include "jsinteractive.h"
 #include "network.h"
@@ -111,9 +112,31 @@ typedef struct {
   char        staSsid[32], staPass[64];
   char        apSsid[32], apPass[64];
   char        dhcpHostname[64];
+  uint8_t     fastConnect, powerAuto;
+  uint32_t    staticIP, staticMask, staticGw; // all 0 to use DHCP
 } Esp8266_config;
 static Esp8266_config esp8266Config;
 
+// Static IP configuration for the station from Wifi.connect's options (ip.addr is 0 to use DHCP)
+static struct ip_info g_staticIP;
+// Whether Wifi.connect was asked to reconnect using the AP details kept in RTC memory
+static bool g_fastConnect;
+// Set while we're connecting with the details from RTC memory, so we can do it normally if that fails
+static bool g_fastConnecting;
+
+// The AP we last got an IP address from, kept in RTC memory (at RTC_WIFI_ADDR) for fast reconnect
+#define RTC_WIFI_MAGIC 0x57494649
+typedef struct {
+  uint32_t magic;
+  uint32_t apHash;   // CRC of the SSID and password, so we only use this for the same network
+  uint8_t  bssid[6];
+  uint8_t  channel, unused;
+  uint32_t ip, mask, gw; // the DHCP lease we got
+  uint32_t crc;
+} RtcWifiData;
+// The AP details from the last EVENT_STAMODE_CONNECTED, saved to RTC memory once we get an IP
+static RtcWifiData g_rtcWifi;
+
 //===== Mapping from enums to strings
 
 // Reasons for which a connection failed
@@ -432,6 +455,73 @@ void jswrap_ESP8266_wifi_stopAP(JsVar *jsCallback) {
   DBGV("< Wifi.stopAP\n");
 }
 
+//===== Wifi fast reconnect
+
+// Get a hash of the network we're configured to connect to
+static uint32_t wifiGetAPHash(struct station_config *config) {
+  uint8_t buf[32+64];
+  os_memcpy(buf, config->ssid, 32);
+  os_memcpy(buf+32, config->password, 64);
+  return crc32(buf, sizeof(buf));
+}
+
+// Read the details of the AP we last connected to from RTC memory, if they're for this network
+static bool wifiReadRtc(RtcWifiData *data, uint32_t apHash) {
+  system_rtc_mem_read(RTC_WIFI_ADDR, data, sizeof(RtcWifiData));
+  return data->magic == RTC_WIFI_MAGIC && data->apHash == apHash &&
+         data->crc == crc32((uint8_t*)data, sizeof(RtcWifiData)-4) &&
+         data->channel >= 1 && data->channel <= 14;
+}
+
+static void wifiClearRtc() {
+  uint32_t magic = 0;
+  system_rtc_mem_write(RTC_WIFI_ADDR, &magic, 4);
+}
+
+/**
+ * Set up for connecting with the given station config (before it's passed to the SDK). With
+ * fast reconnect, if RTC memory has the AP we last used on this network we go straight to its
+ * BSSID and channel rather than scanning, and re-use the DHCP lease. A static IP stops DHCP.
+ */
+static void wifiPrepareConnect(struct station_config *config) {
+  struct ip_info info = g_staticIP;
+  RtcWifiData rtc;
+  g_fastConnecting = false;
+  config->bssid_set = 0;
+  if (g_fastConnect && wifiReadRtc(&rtc, wifiGetAPHash(config))) {
+    DBG("Wifi: fast connect to " MACSTR " ch %d\n", MAC2STR(rtc.bssid), rtc.channel);
+    config->bssid_set = 1;
+    os_memcpy(config->bssid, rtc.bssid, 6);
+    wifi_set_channel(rtc.channel);
+    if (info.ip.addr == 0) {
+      info.ip.addr = rtc.ip;
+      info.netmask.addr = rtc.mask;
+      info.gw.addr = rtc.gw;
+    }
+    g_fastConnecting = true;
+  }
+  if (info.ip.addr != 0) {
+    wifi_station_dhcpc_stop();
+    wifi_set_ip_info(STATION_IF, &info);
+  } else if (wifi_station_dhcpc_status() != DHCP_STARTED) {
+    wifi_station_dhcpc_start();
+  }
+}
+
+// Get an IP address option like "192.168.1.2" from Wifi.connect's options, or 0 if it isn't there
+static uint32_t wifiGetIPOption(JsVar *jsOptions, const char *name) {
+  JsVar *jsIP = jsvObjectGetChild(jsOptions, name, 0);
+  uint32_t ip = 0;
+  if (jsvIsString(jsIP)) {
+    char buffer[20];
+    size_t size = jsvGetString(jsIP, buffer, sizeof(buffer)-1);
+    buffer[size] = '\0';
+    ip = networkParseIPAddress(buffer);
+  }
+  jsvUnLock(jsIP);
+  return ip;
+}
+
 //===== Wifi.connect
 
 /*JSON{
@@ -452,10 +542,16 @@ The options properties may contain:
 
 * `password` - Password string to be used to access the network.
 * `dnsServers` (array of String) - An array of up to two DNS servers in dotted decimal format string.
+* `ip`, `netmask`, `gw` - A static IP address, netmask and gateway in dotted decimal format. DHCP isn't used if `ip` is set.
+* `fast` - If `true`, remember the access point's BSSID and channel and the DHCP lease in RTC memory, and
+  use them on the next connection to the same network (including after `ESP8266.deepSleep`) so that it doesn't
+  need to scan or wait for DHCP. If the access point can't be found that way, a normal connection is made.
 
 Notes:
 
-* the options should include the ability to set a static IP and associated netmask and gateway, this is a future enhancement.
+* `Wifi.save()` saves the `fast`, `ip`, `netmask` and `gw` options, so they are used when connecting at boot.
+* with `fast`, the IP address is re-used without asking the DHCP server again, so make sure that its leases
+  are longer than the device sleeps for (or reserve an address for it).
 * the only error reported in the callback is "Bad password", all other errors (such as access point not found or DHCP timeout) just cause connection retries. If the reporting of such temporary errors is desired, the caller must use its own timeout and the `getDetails().status` field.
 * the `connect` call automatically enabled station mode, it can be disabled again by calling `disconnect`.
 
@@ -521,6 +617,15 @@ void jswrap_ESP8266_wifi_connect(
     jsvUnLock(jsPassword);
   }
 
+  // static IP and fast reconnect
+  os_memset(&g_staticIP, 0, sizeof(g_staticIP));
+  g_staticIP.ip.addr = wifiGetIPOption(jsOptions, "ip");
+  g_staticIP.netmask.addr = wifiGetIPOption(jsOptions, "netmask");
+  g_staticIP.gw.addr = wifiGetIPOption(jsOptions, "gw");
+  if (g_staticIP.ip.addr != 0 && g_staticIP.netmask.addr == 0)
+    g_staticIP.netmask.addr = 0x00FFFFFF; // 255.255.255.0
+  g_fastConnect = jsvGetBoolAndUnLock(jsvObjectGetChild(jsOptions, "fast", 0));
+
   // structure for SDK call, it's a shame we need to copy ssid and password but if we placed
   // them straight into the stationConfig struct we wouldn't be able to printf them for debug
   struct station_config stationConfig;
@@ -554,6 +659,7 @@ void jswrap_ESP8266_wifi_connect(
     // we skip the disconnect event unless we're connected (then it's legit) and unless
     // we're idle/off (then there is no disconnect event to start with)
     g_skipDisconnect = wifiConnectStatus != STATION_GOT_IP && wifiConnectStatus != STATION_IDLE;
+    esp8266_powerWakeRadio(); // the power manager may have turned the radio off
     wifi_set_opmode(wifi_get_opmode() | STATION_MODE);
   }
 
@@ -561,6 +667,7 @@ void jswrap_ESP8266_wifi_connect(
   if (jsvIsFunction(jsCallback)) g_jsGotIpCallback = jsvLockAgainSafe(jsCallback);
 
   // Set the station configuration
+  wifiPrepareConnect(&stationConfig);
   int8 ok = wifi_station_set_config_current(&stationConfig);
 
   // Do we have a child property called dnsServers?
@@ -664,6 +771,7 @@ void jswrap_ESP8266_wifi_scan(JsVar *jsCallback) {
   // Ask the ESP8266 to perform a network scan after first entering
   // station mode.  The network scan will eventually result in a callback
   // being executed (scanCB) which will contain the results.
+  esp8266_powerWakeRadio(); // the power manager may have turned the radio off
   wifi_set_opmode_current(wifi_get_opmode() | STATION_MODE);
 
   // Request a scan of the network calling "scanCB" on completion
@@ -794,6 +902,7 @@ void jswrap_ESP8266_wifi_startAP(
 
   // Define that we are in Soft AP mode including station mode if required.
   DBGV("Wifi: switching to soft-AP mode, authmode=%d\n", softApConfig.authmode);
+  esp8266_powerWakeRadio(); // the power manager may have turned the radio off
   wifi_set_opmode(wifi_get_opmode() | SOFTAP_MODE);
   wifi_set_event_handler_cb(wifiEventHandler); // this seems to get lost sometimes...
 
@@ -842,7 +951,7 @@ Retrieve the current overall WiFi configuration. This call provides general info
 * `ap` - Status of the wifi access point: `disabled`, `enabled`.
 * `mode` - The current operation mode: `off`, `sta`, `ap`, `sta+ap`.
 * `phy` - Modulation standard configured: `11b`, `11g`, `11n` (the esp8266 docs are not very clear, but it is assumed that 11n means b/g/n). This setting limits the modulations that the radio will use, it does not indicate the current modulation used with a specific access point.
-* `powersave` - Power saving mode: `none` (radio is on all the time), `ps-poll` (radio is off between beacons as determined by the access point's DTIM setting). Note that in 'ap' and 'sta+ap' modes the radio is always on, i.e., no power saving is possible.
+* `powersave` - Power saving mode: `none` (radio is on all the time), `ps-poll` (radio is off between beacons as determined by the access point's DTIM setting), `light` (as `ps-poll`, but the CPU is also suspended while Espruino is idle - see `E.setTimerSlack` to reduce how often it wakes up). `auto` picks between these depending on what Espruino is doing: the radio stays on while JavaScript is busy, sockets are active or a timer is due soon, `ps-poll` is used once idle, and `light` once nothing is due for a while and no pins are being watched (as light sleep would miss pin changes). In `auto`, the radio is also switched off completely while both station and access point are disconnected. Note that in 'ap' and 'sta+ap' modes the radio is always on, i.e., no power saving is possible.
 * `savedMode` - The saved operation mode which will be applied at boot time: `off`, `sta`, `ap`, `sta+ap`.
 
 */
@@ -871,7 +980,8 @@ JsVar *jswrap_ESP8266_wifi_getStatus(JsVar *jsCallback) {
   jsvObjectSetChildAndUnLock(jsWiFiStatus, "phy",
     jsvNewFromString(wifiPhy[phy]));
   jsvObjectSetChildAndUnLock(jsWiFiStatus, "powersave",
-    jsvNewFromString(sleep == NONE_SLEEP_T ? "none" : "ps-poll"));
+    jsvNewFromString(esp8266_getPowerManager() ? "auto" :
+      (sleep == NONE_SLEEP_T ? "none" : (sleep == LIGHT_SLEEP_T ? "light" : "ps-poll"))));
   jsvObjectSetChildAndUnLock(jsWiFiStatus, "savedMode",
     jsvNewFromString("off"));
 
@@ -902,7 +1012,7 @@ Sets a number of global wifi configuration settings. All parameters are optional
 The settings available are:
 
 * `phy` - Modulation standard to allow: `11b`, `11g`, `11n` (the esp8266 docs are not very clear, but it is assumed that 11n means b/g/n).
-* `powersave` - Power saving mode: `none` (radio is on all the time), `ps-poll` (radio is off between beacons as determined by the access point's DTIM setting). Note that in 'ap' and 'sta+ap' modes the radio is always on, i.e., no power saving is possible.
+* `powersave` - Power saving mode: `none` (radio is on all the time), `ps-poll` (radio is off between beacons as determined by the access point's DTIM setting), `light` (as `ps-poll`, but the CPU is also suspended while Espruino is idle - see `E.setTimerSlack` to reduce how often it wakes up). `auto` picks between these depending on what Espruino is doing: the radio stays on while JavaScript is busy, sockets are active or a timer is due soon, `ps-poll` is used once idle, and `light` once nothing is due for a while and no pins are being watched (as light sleep would miss pin changes). In `auto`, the radio is also switched off completely while both station and access point are disconnected. Note that in 'ap' and 'sta+ap' modes the radio is always on, i.e., no power saving is possible.
 
 Note: esp8266 SDK programmers may be missing an "opmode" option to set the sta/ap/sta+ap operation mode. Please use connect/scan/disconnect/startAP/stopAP, which all set the esp8266 opmode indirectly.
 */
@@ -936,9 +1046,16 @@ void jswrap_ESP8266_wifi_setConfig(JsVar *jsSettings) {
   JsVar *jsPowerSave = jsvObjectGetChild(jsSettings, "powersave", 0);
   if (jsvIsString(jsPowerSave)) {
     if (jsvIsStringEqual(jsPowerSave, "none")) {
+      esp8266_setPowerManager(false);
       wifi_set_sleep_type(NONE_SLEEP_T);
     } else if (jsvIsStringEqual(jsPowerSave, "ps-poll")) {
+      esp8266_setPowerManager(false);
       wifi_set_sleep_type(MODEM_SLEEP_T);
+    } else if (jsvIsStringEqual(jsPowerSave, "light")) {
+      esp8266_setPowerManager(false);
+      wifi_set_sleep_type(LIGHT_SLEEP_T);
+    } else if (jsvIsStringEqual(jsPowerSave, "auto")) {
+      esp8266_setPowerManager(true);
     } else {
       jsvUnLock(jsPowerSave);
       jsExceptionHere(JSET_ERROR, "Unknown powersave mode.");
@@ -1129,6 +1246,7 @@ Save the current wifi configuration (station and access point) to flash and auto
 * phy (11b/g/n)
 * powersave setting
 * DHCP hostname
+* static IP and fast reconnect settings (see `Wifi.connect`)
 
 */
 void jswrap_ESP8266_wifi_save(JsVar *what) {
@@ -1151,6 +1269,7 @@ void jswrap_ESP8266_wifi_save(JsVar *what) {
     conf->mode = wifi_get_opmode();
     conf->phyMode = wifi_get_phy_mode();
     conf->sleepType = wifi_get_sleep_type();
+    conf->powerAuto = esp8266_getPowerManager();
     DBG("Wifi.save: len=%d phy=%d sleep=%d opmode=%d\n",
         sizeof(*conf), conf->phyMode, conf->sleepType, conf->mode);
 
@@ -1170,6 +1289,11 @@ void jswrap_ESP8266_wifi_save(JsVar *what) {
 
     char *hostname = wifi_station_get_hostname();
     if (hostname) os_strncpy(conf->dhcpHostname, hostname, 64);
+
+    conf->fastConnect = g_fastConnect;
+    conf->staticIP = g_staticIP.ip.addr;
+    conf->staticMask = g_staticIP.netmask.addr;
+    conf->staticGw = g_staticIP.gw.addr;
   }
 
   conf->crc = crc32((uint8_t*)flashBlock, sizeof(flashBlock));
@@ -1217,6 +1341,7 @@ void jswrap_ESP8266_wifi_restore(void) {
 
   wifi_set_phy_mode(conf->phyMode);
   wifi_set_sleep_type(conf->sleepType);
+  esp8266_setPowerManager(conf->powerAuto != 0);
   wifi_set_opmode_current(conf->mode);
 
   if (conf->mode & SOFTAP_MODE) {
@@ -1240,10 +1365,18 @@ void jswrap_ESP8266_wifi_restore(void) {
       wifi_station_set_hostname(conf->dhcpHostname);
     }
 
+    // configs saved before these were added have zeros here
+    g_fastConnect = conf->fastConnect != 0;
+    os_memset(&g_staticIP, 0, sizeof(g_staticIP));
+    g_staticIP.ip.addr = conf->staticIP;
+    g_staticIP.netmask.addr = conf->staticMask;
+    g_staticIP.gw.addr = conf->staticGw;
+
     struct station_config sta_config;
     os_memset(&sta_config, 0, sizeof(sta_config));
     os_strncpy((char *)sta_config.ssid, conf->staSsid, 32);
     os_strncpy((char *)sta_config.password, conf->staPass, 64);
+    wifiPrepareConnect(&sta_config);
     wifi_station_set_config_current(&sta_config);
     DBG("Wifi.restore: STA=%s\n", sta_config.ssid);
     wifi_station_connect(); // we're not supposed to call this from user_init but it doesn't harm
@@ -1601,6 +1734,7 @@ void jswrap_ESP8266_wifi_reset() {
   g_jsHostByNameCallback = NULL;
   g_jsDisconnectCallback = NULL;
   g_disconnecting = false;
+  g_fastConnecting = false;
 
   DBGV("< Wifi reset\n");
 }
@@ -1881,6 +2015,9 @@ static void wifiEventHandler(System_Event_t *evt) {
     jsvObjectSetChildAndUnLock(jsDetails, "channel",
         jsvNewFromInteger(evt->event_info.connected.channel));
     sendWifiEvent(evt->event, jsDetails);
+    // remember the AP, for fast reconnect once we have an IP
+    os_memcpy(g_rtcWifi.bssid, evt->event_info.connected.bssid, 6);
+    g_rtcWifi.channel = evt->event_info.connected.channel;
     break;
 
   // We have disconnected or been disconnected from an access point.
@@ -1898,6 +2035,18 @@ static void wifiEventHandler(System_Event_t *evt) {
       break;
     }
 
+    // if a fast reconnect failed (eg. the AP changed channel), forget it and connect normally
+    if (g_fastConnecting && wifiConnectStatus != STATION_WRONG_PASSWORD) {
+      DBG("Wifi: fast connect failed, scanning\n");
+      wifiClearRtc();
+      struct station_config config;
+      wifi_station_get_config(&config);
+      wifiPrepareConnect(&config); // RTC is cleared, so this does a normal connect
+      wifi_station_set_config_current(&config);
+      wifi_station_connect();
+      break;
+    }
+
     // if'were connecting and we get a fatal error, then make a callback
     if (wifiConnectStatus == STATION_WRONG_PASSWORD && jsvIsFunction(g_jsGotIpCallback)) {
       sendWifiCompletionCB(&g_jsGotIpCallback, "bad password");
@@ -1947,6 +2096,20 @@ static void wifiEventHandler(System_Event_t *evt) {
       IP2STR(&evt->event_info.got_ip.ip), IP2STR(&evt->event_info.got_ip.mask),
       IP2STR(&evt->event_info.got_ip.gw));
 
+    // keep the AP and lease in RTC memory for fast reconnect
+    g_fastConnecting = false;
+    if (g_fastConnect) {
+      struct station_config config;
+      wifi_station_get_config(&config);
+      g_rtcWifi.magic = RTC_WIFI_MAGIC;
+      g_rtcWifi.apHash = wifiGetAPHash(&config);
+      g_rtcWifi.ip = evt->event_info.got_ip.ip.addr;
+      g_rtcWifi.mask = evt->event_info.got_ip.mask.addr;
+      g_rtcWifi.gw = evt->event_info.got_ip.gw.addr;
+      g_rtcWifi.crc = crc32((uint8_t*)&g_rtcWifi, sizeof(RtcWifiData)-4);
+      system_rtc_mem_write(RTC_WIFI_ADDR, &g_rtcWifi, sizeof(RtcWifiData));
+    }
+
     // start mDNS
     char *hostname = wifi_station_get_hostname();
     if (hostname && hostname[0] != 0) {
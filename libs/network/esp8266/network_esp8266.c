@@ -29,7 +29,9 @@ typedef long long int64_t;
 #include "network_esp8266.h"
 #include "socketerrors.h"
 #include "esp8266_board_utils.h"
+#include "ESP8266_board.h"
 #include "pktbuf.h"
+#include "jstrace.h"
 
 //#define espconn_abort espconn_disconnect
 
@@ -50,7 +52,6 @@ static struct socketData *getSocketData(int s);
  */
 static int g_nextSocketId = 0;
 
-static int  getServerSocketByLocalPort(unsigned short port);
 static void setSocketInError(struct socketData *pSocketData, int code);
 static void dumpEspConn(struct espconn *pEspConn);
 static struct socketData *allocateNewSocket();
@@ -59,6 +60,9 @@ static void doClose(struct socketData *pSocketData);
 static void releaseSocket(struct socketData *pSocketData);
 static void resetSocket(struct socketData *pSocketData);
 static void esp8266_dumpSocketData(struct socketData *pSocketData);
+static void esp8266_rxFlowControl(struct socketData *pSocketData);
+static void esp8266_rxQueuedStats(struct socketData *pSocketData);
+static void esp8266_setTxOptions(struct espconn *pEspconn);
 
 static void esp8266_callback_connectCB_inbound(void *arg);
 static void esp8266_callback_connectCB_outbound(void *arg);
@@ -66,6 +70,7 @@ static void esp8266_callback_disconnectCB(void *arg);
 static void esp8266_callback_sentCB(void *arg);
 static void esp8266_callback_writeFinishedCB(void *arg);
 static void esp8266_callback_recvCB(void *arg, char *pData, unsigned short len);
+static void esp8266_callback_recvCB_udp(void *arg, char *pData, unsigned short len);
 static void esp8266_callback_reconnectCB(void *arg, sint8 err);
 
 /** Socket data structure
@@ -112,9 +117,35 @@ enum SOCKET_CREATION_TYPE {
   SOCKET_CREATED_NONE,      //!< The socket has not yet been created.
   SOCKET_CREATED_SERVER,    //!< Listening socket ("server socket")
   SOCKET_CREATED_OUTBOUND,  //!< Outbound connection
-  SOCKET_CREATED_INBOUND    //!< Inbound connection
+  SOCKET_CREATED_INBOUND,   //!< Inbound connection
+  SOCKET_CREATED_UDP        //!< UDP socket, rxBufQ holds one datagram (with its JsNetUDPPacketHeader) per buffer
 };
 
+/**
+ * Counters for tuning throughput, kept for each socket and in total
+ * (see net_ESP8266_BOARD_getStats). These are updated in the espconn callbacks.
+ */
+struct netStats {
+  uint32_t bytesIn;      //!< Bytes received
+  uint32_t bytesOut;     //!< Bytes passed to espconn to send
+  uint32_t segmentsIn;   //!< TCP segments or UDP datagrams received
+  uint32_t segmentsOut;  //!< Calls to espconn_send/espconn_sendto
+  uint32_t recvHolds;    //!< Calls to espconn_recv_hold
+  uint32_t recvUnholds;  //!< Calls to espconn_recv_unhold
+  uint32_t allocFails;   //!< Receive (PktBuf_New) or transmit buffers we couldn't allocate
+  uint32_t rxDropped;    //!< UDP datagrams dropped because the receive window was full
+  uint32_t rxQueuedMax;  //!< The most bytes that have been queued for reading
+  unsigned long long txWaitUs; //!< Microseconds spent in SOCKET_STATE_TRANSMITTING
+};
+
+/**
+ * Add n to one of the counters of a socket, and to the total.
+ */
+#define NET_STAT_ADD(pSocketData, field, n) do { \
+    (pSocketData)->stats.field += (n); \
+    g_netStats.field += (n); \
+  } while(0)
+
 /**
  * The core socket structure.
  * The structure is initialized by resetSocket.
@@ -128,21 +159,72 @@ struct socketData {
 
   uint8    *currentTx;        //!< Data currently being transmitted.
   PktBuf   *rxBufQ;           //!< Queue of received buffers
+  uint32_t  rxQueued;         //!< Number of unread bytes in rxBufQ
+  uint16_t  rxWindow;         //!< Stop receiving when rxQueued reaches this
+  bool      rxHeld;           //!< Have we called espconn_recv_hold?
+  bool      nagle;            //!< Turn Nagle's algorithm back on, see net_ESP8266_BOARD_setNoDelay
+  uint32_t  txStart;          //!< system_get_time() when we started transmitting
 
   short    errorCode;         //!< Error code, 0=no error
+  struct netStats stats;      //!< Counters since the socket was created
 };
 
 
 /**
- * An array of socket data structures.
+ * An array of socket data structures. A socket is always in slot socketId%MAX_SOCKETS.
  */
 static struct socketData socketArray[MAX_SOCKETS];
 
+/**
+ * An espconn along with the TCP or UDP details that it points to, see allocateEspconn.
+ */
+struct espconnPoolEntry {
+  struct espconn espconn; //!< Must be first, see freeEspconn
+  union {
+    esp_tcp tcp;
+    esp_udp udp;
+  } proto;
+  bool inUse;
+};
+
+/**
+ * ESPCONN_POOL_SIZE espconn structures, allocated by netInit_esp8266_board.
+ */
+static struct espconnPoolEntry *g_espconnPool = NULL;
+
+/**
+ * The counters for all sockets since boot.
+ */
+static struct netStats g_netStats;
+
+/**
+ * The receive window for new sockets, see net_ESP8266_BOARD_setRecvWindow.
+ */
+static uint16_t g_rxWindowDefault = RX_WINDOW_DEFAULT;
+
 /**
  * Flag the sockets as initially NOT initialized.
  */
 static bool g_socketsInitialized = false;
 
+/**
+ * When there was last network activity (system_get_time), see net_ESP8266_BOARD_isBusy.
+ */
+static uint32_t g_lastActivity = 0;
+
+/**
+ * Note that something happened on a socket, and wake the main loop to handle it.
+ */
+static void esp8266_netActivity(
+    struct espconn *pEspconn //!< The connection it happened on.
+) {
+  g_lastActivity = system_get_time();
+  struct socketData *pSocketData = pEspconn != NULL ? (struct socketData *)pEspconn->reverse : NULL;
+  if (pSocketData != NULL)
+    networkSetSocketReady(pSocketData->socketId); // so socketserver knows to look at it
+  esp8266_wakeMainLoop();
+}
+
 /**
  * Dump all the socket structures.
  * This is used exclusively for debugging.  It walks through each of the
@@ -189,6 +271,9 @@ static void esp8266_dumpSocketData(
   case SOCKET_CREATED_SERVER:
     creationTypeMsg = "server";
     break;
+  case SOCKET_CREATED_UDP:
+    creationTypeMsg = "udp";
+    break;
   }
   DBG(" type=%s, txBuf=%p", creationTypeMsg, pSocketData->currentTx);
   char *stateMsg;
@@ -227,9 +312,13 @@ static void esp8266_dumpSocketData(
   DBG(", state=%s, espconn=%p, err=%d", stateMsg, pSocketData->pEspconn, pSocketData->errorCode);
   DBG(", rx:");
   for (PktBuf *b=pSocketData->rxBufQ; b; b=b->next) {
-    DBG(" %d@%p", b->filled, b);
+    DBG(" %d@%p", PktBuf_Available(b), b);
   }
-  DBG("\n");
+  DBG("\n    in=%d/%d out=%d/%d holds=%d/%d allocFails=%d\n",
+      pSocketData->stats.bytesIn, pSocketData->stats.segmentsIn,
+      pSocketData->stats.bytesOut, pSocketData->stats.segmentsOut,
+      pSocketData->stats.recvHolds, pSocketData->stats.recvUnholds,
+      pSocketData->stats.allocFails);
 }
 
 
@@ -312,11 +401,13 @@ static void dumpEspConn(
 
 
 /**
- * Get the next new global socket id.
- * \return A new socketId that is assured to be unique.
+ * Get the next new global socket id for the given slot in socketArray.
+ * \return A new socketId that is assured to be unique, and where socketId%MAX_SOCKETS==slot.
  */
-static int getNextGlobalSocketId() {
-  return ++g_nextSocketId;
+static int getNextGlobalSocketId(int slot) {
+  int next = g_nextSocketId+1;
+  g_nextSocketId = next + (slot - next%MAX_SOCKETS + MAX_SOCKETS) % MAX_SOCKETS;
+  return g_nextSocketId;
 }
 
 
@@ -324,7 +415,7 @@ static int getNextGlobalSocketId() {
  * Allocate a new socket
  * Look for the first free socket in the array of sockets and return the first one
  * that is available.  The socketId property is set to a unique and new socketId value
- * that will not previously have been seen.
+ * that will not previously have been seen, and that maps back to the socket's slot.
  * \return The socketData structure for the returned socket.
  */
 static struct socketData *allocateNewSocket() {
@@ -333,7 +424,8 @@ static struct socketData *allocateNewSocket() {
   // socketId to the next global socketId value.
   for (int i=0; i<MAX_SOCKETS; i++) {
     if (socketArray[i].state == SOCKET_STATE_UNUSED) {
-      socketArray[i].socketId = getNextGlobalSocketId();
+      socketArray[i].socketId = getNextGlobalSocketId(i);
+      socketArray[i].rxWindow = g_rxWindowDefault;
       return &socketArray[i];
     }
   }
@@ -347,42 +439,18 @@ static struct socketData *allocateNewSocket() {
  * \return The socket data for the given socket or NULL if there is no matching socket.
  */
 static struct socketData *getSocketData(int socketId) {
-  struct socketData *pSocketData = socketArray;
-  for (int socketArrayIndex=0; socketArrayIndex<MAX_SOCKETS; socketArrayIndex++) {
+  // the id tells us which slot the socket is in (see getNextGlobalSocketId)
+  if (socketId > 0) {
+    struct socketData *pSocketData = &socketArray[socketId % MAX_SOCKETS];
     if (pSocketData->socketId == socketId) {
       return pSocketData;
     }
-    pSocketData++;
   }
   DBG("%s: socket %d not found\n", DBG_LIB, socketId);
   return NULL;
 }
 
 
-/**
- * Find the server socket that is bound to the given local port.
- * \return The socket id of the socket listening on the given port or -1 if there is no
- * server socket that matches.
- */
-static int getServerSocketByLocalPort(
-    unsigned short port //!< The port number on which a server socket is listening.
-  ) {
-  // Loop through each of the sockets in the socket array looking for a socket
-  // that is inuse, a server and has a local_port of the passed in port number.
-  int socketArrayIndex;
-  struct socketData *pSocketData = socketArray;
-  for (socketArrayIndex=0; socketArrayIndex<MAX_SOCKETS; socketArrayIndex++) {
-    if (pSocketData->state  != SOCKET_STATE_UNUSED &&
-      pSocketData->creationType == SOCKET_CREATED_SERVER &&
-      pSocketData->pEspconn->proto.tcp->local_port == port)
-    {
-      return pSocketData->socketId;
-    }
-    pSocketData++;
-  } // End of for each socket
-  return -1;
-}
-
 /**
  * Release the socket and return it to the free pool.
  * The connection (espconn) must be closed and deallocated before calling releaseSocket.
@@ -401,13 +469,66 @@ static void releaseSocket(
 
   if (pSocketData->currentTx != NULL) {
     //DBG("%s: freeing tx buf %p\n", DBG_LIB, pSocketData->currentTx);
-    os_free(pSocketData->currentTx);
+    esp8266_heapFree(pSocketData->currentTx);
     pSocketData->currentTx = NULL;
   }
 
   os_memset(pSocketData, 0, sizeof(struct socketData));
 }
 
+/**
+ * Allocate a zeroed espconn, with proto.tcp or proto.udp pointing at zeroed
+ * TCP or UDP details. This comes from the pool if it can, else from the heap.
+ * \return The espconn, or NULL if we're out of memory.
+ */
+static struct espconn *allocateEspconn(
+    bool isUDP //!< Is proto.udp needed rather than proto.tcp?
+) {
+  struct espconn *pEspconn = NULL;
+  void *proto = NULL;
+  for (int i=0; g_espconnPool != NULL && i<ESPCONN_POOL_SIZE; i++) {
+    struct espconnPoolEntry *pEntry = &g_espconnPool[i];
+    if (!pEntry->inUse) {
+      os_memset(pEntry, 0, sizeof(struct espconnPoolEntry));
+      pEntry->inUse = true;
+      pEspconn = &pEntry->espconn;
+      proto = &pEntry->proto;
+      break;
+    }
+  }
+  if (pEspconn == NULL) {
+    pEspconn = esp8266_heapAlloc(ESP_HEAP_ESPCONN, sizeof(struct espconn));
+    proto = esp8266_heapAlloc(ESP_HEAP_ESPCONN, isUDP ? sizeof(esp_udp) : sizeof(esp_tcp));
+    if (pEspconn == NULL || proto == NULL) {
+      esp8266_heapFree(pEspconn);
+      esp8266_heapFree(proto);
+      return NULL;
+    }
+  }
+  if (isUDP) pEspconn->proto.udp = proto;
+  else pEspconn->proto.tcp = proto;
+  return pEspconn;
+}
+
+/**
+ * Free an espconn from allocateEspconn.
+ */
+static void freeEspconn(
+    struct espconn *pEspconn
+) {
+  if (g_espconnPool != NULL &&
+      (char *)pEspconn >= (char *)g_espconnPool &&
+      (char *)pEspconn < (char *)(g_espconnPool+ESPCONN_POOL_SIZE)) {
+    struct espconnPoolEntry *pEntry = (struct espconnPoolEntry *)pEspconn;
+    pEntry->espconn.reverse = NULL; // so any stray callbacks are ignored
+    pEntry->inUse = false;
+    return;
+  }
+  esp8266_heapFree(pEspconn->proto.tcp); // same pointer as proto.udp
+  pEspconn->proto.tcp = NULL;
+  esp8266_heapFree(pEspconn);
+}
+
 /**
  * Release the espconn structure
  */
@@ -419,9 +540,7 @@ static void releaseEspconn(
   if (pSocketData->creationType != SOCKET_CREATED_INBOUND) {
     //DBG("%s: freeing espconn %p/%p for socket %d\n", DBG_LIB,
     //    pSocketData->pEspconn, pSocketData->pEspconn->proto.tcp, pSocketData->socketId);
-    os_free(pSocketData->pEspconn->proto.tcp);
-    pSocketData->pEspconn->proto.tcp = NULL;
-    os_free(pSocketData->pEspconn);
+    freeEspconn(pSocketData->pEspconn);
   }
   pSocketData->pEspconn = NULL;
 }
@@ -434,6 +553,9 @@ void netInit_esp8266_board() {
   if (g_socketsInitialized) return;
   g_socketsInitialized = true;
   os_memset(socketArray, 0, sizeof(socketArray));
+  // if this fails, allocateEspconn just uses the heap
+  g_espconnPool = esp8266_heapAlloc(ESP_HEAP_ESPCONN,
+      ESPCONN_POOL_SIZE * sizeof(struct espconnPoolEntry));
 }
 
 
@@ -479,6 +601,12 @@ static void doClose(
     pSocketData->state = SOCKET_STATE_UNUSED;
     pSocketData->creationType = SOCKET_CREATED_NONE;
 
+  } else if (pSocketData->creationType == SOCKET_CREATED_UDP) {
+    // there's no connection to disconnect, so free everything now
+    espconn_delete(pSocketData->pEspconn);
+    releaseEspconn(pSocketData);
+    releaseSocket(pSocketData);
+
   } else {
     int rc = espconn_disconnect(pSocketData->pEspconn);
     if (rc == 0) {
@@ -526,6 +654,7 @@ static void setSocketInError(
 static void esp8266_callback_connectCB_inbound(
     void *arg //!<
 ) {
+  esp8266_netActivity((struct espconn *)arg); // the main loop will have work to do
   struct espconn *pEspconn = (struct espconn *)arg;
   assert(pEspconn != NULL);
 
@@ -545,11 +674,13 @@ static void esp8266_callback_connectCB_inbound(
   espconn_regist_reconcb(pEspconn, esp8266_callback_reconnectCB);
   espconn_regist_sentcb(pEspconn, esp8266_callback_sentCB);
   espconn_regist_recvcb(pEspconn, esp8266_callback_recvCB);
+  esp8266_setTxOptions(pEspconn);
 
   pClientSocketData->pEspconn          = pEspconn;
   pClientSocketData->pEspconn->reverse = pClientSocketData;
   pClientSocketData->creationType      = SOCKET_CREATED_INBOUND;
   pClientSocketData->state             = SOCKET_STATE_UNACCEPTED;
+  networkSetSocketReady(pClientSocketData->socketId);
 }
 
 /**
@@ -559,6 +690,7 @@ static void esp8266_callback_connectCB_inbound(
 static void esp8266_callback_connectCB_outbound(
     void *arg //!< A pointer to a `struct espconn`.
 ) {
+  esp8266_netActivity((struct espconn *)arg); // the main loop will have work to do
   struct espconn *pEspconn = (struct espconn *)arg;
   assert(pEspconn != NULL);
   struct socketData *pSocketData = (struct socketData *)pEspconn->reverse;
@@ -568,6 +700,7 @@ static void esp8266_callback_connectCB_outbound(
   // if we're connecting, then move on, else ignore (could be that we're disconnecting)
   if (pSocketData->state == SOCKET_STATE_CONNECTING) {
     pSocketData->state = SOCKET_STATE_IDLE;
+    if (pSocketData->nagle) espconn_clear_opt(pEspconn, ESPCONN_NODELAY);
   }
 }
 
@@ -580,6 +713,7 @@ static void esp8266_callback_connectCB_outbound(
 static void esp8266_callback_disconnectCB(
     void *arg //!< A pointer to a `struct espconn`.
 ) {
+  esp8266_netActivity((struct espconn *)arg); // the main loop will have work to do
   struct espconn *pEspconn = (struct espconn *)arg;
   struct socketData *pSocketData = (struct socketData *)pEspconn->reverse;
   if (pSocketData == NULL) return;
@@ -599,7 +733,7 @@ static void esp8266_callback_disconnectCB(
     // we can deallocate the tx buffer
     if (pSocketData->currentTx != NULL) {
       //DBG("%s: freeing tx buf %p\n", DBG_LIB, pSocketData->currentTx);
-      os_free(pSocketData->currentTx);
+      esp8266_heapFree(pSocketData->currentTx);
       pSocketData->currentTx = NULL;
     }
 
@@ -616,6 +750,7 @@ static void esp8266_callback_reconnectCB(
     void *arg, //!< A pointer to a `struct espconn`.
     sint8 err  //!< The error code.
 ) {
+  esp8266_netActivity((struct espconn *)arg); // the main loop will have work to do
   struct espconn *pEspconn = (struct espconn *)arg;
   struct socketData *pSocketData = (struct socketData *)pEspconn->reverse;
   if (pSocketData == NULL) return; // we already closed this.
@@ -631,6 +766,40 @@ static void esp8266_callback_reconnectCB(
 }
 
 
+/**
+ * Release the transmit buffer once espconn has finished with it, so that the
+ * socket lib can send more.
+ */
+static void esp8266_txDone(
+    struct socketData *pSocketData //!< The socket that has finished transmitting.
+) {
+  if (pSocketData->currentTx != NULL) {
+    esp8266_heapFree(pSocketData->currentTx);
+    pSocketData->currentTx = NULL;
+  }
+
+  if (pSocketData->state == SOCKET_STATE_TRANSMITTING) {
+    pSocketData->state = SOCKET_STATE_IDLE;
+    NET_STAT_ADD(pSocketData, txWaitUs, system_get_time() - pSocketData->txStart);
+  }
+}
+
+
+/**
+ * Set up a TCP connection so that several segments can be in flight. With
+ * ESPCONN_COPY set, espconn copies the data we send into its own buffer (of
+ * TX_BUF_COUNT segments) and calls the write finish callback as soon as it has,
+ * rather than us having to wait for the data to be acknowledged.
+ */
+static void esp8266_setTxOptions(
+    struct espconn *pEspconn //!< The connection to set up.
+) {
+  espconn_set_opt(pEspconn, ESPCONN_NODELAY|ESPCONN_COPY); // disable nagle, don't need the extra delay
+  espconn_regist_write_finish(pEspconn, esp8266_callback_writeFinishedCB);
+  espconn_tcp_set_buf_count(pEspconn, TX_BUF_COUNT);
+}
+
+
 /**
  * Callback function registered to the ESP8266 environment that is
  * invoked when a send operation has been completed. This signals that we can reuse the tx buffer
@@ -639,6 +808,8 @@ static void esp8266_callback_reconnectCB(
 static void esp8266_callback_sentCB(
     void *arg //!< A pointer to a `struct espconn`.
 ) {
+  JSTRACE(JST_NET_SENT, 0);
+  esp8266_netActivity((struct espconn *)arg); // the main loop will have work to do
   struct espconn *pEspconn = (struct espconn *)arg;
   struct socketData *pSocketData = (struct socketData *)pEspconn->reverse;
   if (pSocketData == NULL) return; // we already closed this.
@@ -647,16 +818,26 @@ static void esp8266_callback_sentCB(
 
   //DBG("%s: socket %d send completed\n", DBG_LIB, pSocketData->socketId);
 
-  // We have transmitted the data ... which means that the data that was in the transmission
-  // buffer can be released.
-  if (pSocketData->currentTx != NULL) {
-    os_free(pSocketData->currentTx);
-    pSocketData->currentTx = NULL;
-  }
+  // Normally the write finish callback has already done this, but just in case
+  esp8266_txDone(pSocketData);
+}
 
-  if (pSocketData->state == SOCKET_STATE_TRANSMITTING) {
-    pSocketData->state = SOCKET_STATE_IDLE;
-  }
+
+/**
+ * Callback function registered to the ESP8266 environment that is
+ * invoked when data passed to espconn_send has been copied into espconn's
+ * send buffer (see esp8266_setTxOptions). It may not have been sent yet, but we
+ * can pass espconn the next segment without waiting for this one to be acknowledged.
+ */
+static void esp8266_callback_writeFinishedCB(
+    void *arg //!< A pointer to a `struct espconn`.
+) {
+  struct espconn *pEspconn = (struct espconn *)arg;
+  struct socketData *pSocketData = (struct socketData *)pEspconn->reverse;
+  if (pSocketData == NULL) return; // we already closed this.
+  assert(pSocketData->state != SOCKET_STATE_UNUSED);
+
+  esp8266_txDone(pSocketData);
 }
 
 
@@ -669,6 +850,8 @@ static void esp8266_callback_recvCB(
     char *pData,       //!< A pointer to data received over the socket.
     unsigned short len //!< The length of the data.
 ) {
+  JSTRACE(JST_NET_RECV, len);
+  esp8266_netActivity((struct espconn *)arg); // the main loop will have work to do
   struct espconn *pEspconn = (struct espconn *)arg;
   struct socketData *pSocketData = (struct socketData *)pEspconn->reverse;
   if (pSocketData == NULL) return; // we closed this socket
@@ -686,14 +869,27 @@ static void esp8266_callback_recvCB(
     return;
   }
 
+  NET_STAT_ADD(pSocketData, bytesIn, len);
+  NET_STAT_ADD(pSocketData, segmentsIn, 1);
+
+  // If the last buffer still has room, just add the data to it
+  if (PktBuf_Coalesce(pSocketData->rxBufQ, pData, len)) {
+    pSocketData->rxQueued += len;
+    esp8266_rxQueuedStats(pSocketData);
+    esp8266_rxFlowControl(pSocketData);
+    return;
+  }
+
   // Allocate a buffer and add to the receive queue
   PktBuf *buf = PktBuf_New(len);
   if (!buf) {
     // handle out of memory condition
     DBG("%s: Out of memory allocating %d for recv\n", DBG_LIB, len);
+    NET_STAT_ADD(pSocketData, allocFails, 1);
     // at this point we're gonna deallocate all receive buffers as a panic measure
     while (pSocketData->rxBufQ != NULL)
       pSocketData->rxBufQ = PktBuf_ShiftFree(pSocketData->rxBufQ);
+    pSocketData->rxQueued = 0;
     // save the error
     setSocketInError(pSocketData, ESPCONN_MEM);
     // now reset the connection
@@ -702,12 +898,68 @@ static void esp8266_callback_recvCB(
     //DBG("%s: ret from recvCB\n", DBG_LIB);
     return;
   }
-  // if this is the second buffer then stop the flood!
-  if (pSocketData->rxBufQ != NULL) espconn_recv_hold(pEspconn);
   // got buffer, fill it
   os_memcpy(buf->data, pData, len);
   buf->filled = len;
   pSocketData->rxBufQ = PktBuf_Push(pSocketData->rxBufQ, buf);
+  pSocketData->rxQueued += len;
+  esp8266_rxQueuedStats(pSocketData);
+  // if we have more than the receive window queued up then stop the flood!
+  esp8266_rxFlowControl(pSocketData);
+}
+
+
+/**
+ * ESP8266 callback function that is invoked when a datagram has arrived on a
+ * UDP socket. Each datagram is queued in its own buffer, preceded by a header
+ * saying where it came from, so that net_ESP8266_BOARD_recv can hand the socket
+ * lib all the datagrams that are waiting in one go.
+ */
+static void esp8266_callback_recvCB_udp(
+    void *arg,         //!< A pointer to a `struct espconn`.
+    char *pData,       //!< A pointer to the datagram.
+    unsigned short len //!< The length of the datagram.
+) {
+  esp8266_netActivity((struct espconn *)arg); // the main loop will have work to do
+  struct espconn *pEspconn = (struct espconn *)arg;
+  struct socketData *pSocketData = (struct socketData *)pEspconn->reverse;
+  if (pSocketData == NULL) return; // we closed this socket
+  assert(pSocketData->state != SOCKET_STATE_UNUSED);
+
+  // We can't hold a UDP socket, so if the receive window is full (or we're short of
+  // heap) just drop the datagram - the sender has to cope with that anyway
+  NET_STAT_ADD(pSocketData, bytesIn, len);
+  NET_STAT_ADD(pSocketData, segmentsIn, 1);
+  uint16_t bufLen = (uint16_t)(sizeof(JsNetUDPPacketHeader) + len);
+  if (pSocketData->rxQueued > 0 &&
+      (pSocketData->rxQueued + bufLen > pSocketData->rxWindow ||
+       system_get_free_heap_size() < RX_MIN_FREE_HEAP)) {
+    DBG("%s: socket %d rx full, dropping %d byte datagram\n", DBG_LIB, pSocketData->socketId, len);
+    NET_STAT_ADD(pSocketData, rxDropped, 1);
+    return;
+  }
+  PktBuf *buf = PktBuf_New(bufLen);
+  if (!buf) {
+    DBG("%s: Out of memory allocating %d for recv\n", DBG_LIB, bufLen);
+    NET_STAT_ADD(pSocketData, allocFails, 1);
+    return;
+  }
+
+  // the sender's address is only valid during this callback
+  JsNetUDPPacketHeader header;
+  remot_info *pRemote = NULL;
+  os_memset(&header, 0, sizeof(header));
+  if (espconn_get_connection_info(pEspconn, &pRemote, 0) == 0 && pRemote != NULL) {
+    os_memcpy(header.host, pRemote->remote_ip, sizeof(header.host));
+    header.port = (unsigned short)pRemote->remote_port;
+  }
+  header.length = len;
+  os_memcpy(buf->data, &header, sizeof(header));
+  os_memcpy(buf->data + sizeof(header), pData, len);
+  buf->filled = bufLen;
+  pSocketData->rxBufQ = PktBuf_Push(pSocketData->rxBufQ, buf);
+  pSocketData->rxQueued += bufLen;
+  esp8266_rxQueuedStats(pSocketData);
 }
 
 
@@ -726,9 +978,37 @@ void netSetCallbacks_esp8266_board(
     net->accept        = net_ESP8266_BOARD_accept;
     net->gethostbyname = net_ESP8266_BOARD_gethostbyname;
     net->recv          = net_ESP8266_BOARD_recv;
+    net->recvVar       = net_ESP8266_BOARD_recvVar;
+    net->setRecvWindow = net_ESP8266_BOARD_setRecvWindow;
+    net->setNoDelay    = net_ESP8266_BOARD_setNoDelay;
     net->send          = net_ESP8266_BOARD_send;
-    // The TCP MSS is 536, we use half that 'cause otherwise we easily run out of JSvars memory
-    net->chunkSize     = 536/2;
+    net->createsocketUDP = net_ESP8266_BOARD_createSocketUDP;
+    net->getStats      = net_ESP8266_BOARD_getStats;
+    net->chunkSize     = net_ESP8266_BOARD_getChunkSize();
+    net->reportsReady  = true; // see esp8266_netActivity
+}
+
+/**
+ * Work out how much data the socket lib should move to or from espconn at a time.
+ * This is called each time the network is used, so it adapts to the memory we have:
+ * a full TCP segment if there's plenty, down to CHUNK_SIZE_MIN (which is what we
+ * always used to use) if JsVars, heap or stack are short. Each chunk sent is copied
+ * onto the stack and then into the heap, and each chunk received becomes JsVars.
+ */
+int net_ESP8266_BOARD_getChunkSize() {
+  uint32_t freeHeap = system_get_free_heap_size();
+  size_t freeStack = jsuGetFreeStack();
+  int size = CHUNK_SIZE_MAX;
+  while (size > CHUNK_SIZE_MIN) {
+    unsigned int vars = (unsigned int)(size / JSVAR_DATA_STRING_MAX_LEN) + 1;
+    if (freeHeap > (uint32_t)size*CHUNK_HEADROOM + RX_MIN_FREE_HEAP &&
+        freeStack > (size_t)size*CHUNK_HEADROOM &&
+        jsvMoreFreeVariablesThan(vars*CHUNK_HEADROOM))
+      break;
+    size /= 2;
+  }
+  if (size < CHUNK_SIZE_MIN) size = CHUNK_SIZE_MIN;
+  return size;
 }
 
 /**
@@ -763,6 +1043,89 @@ int net_ESP8266_BOARD_accept(
 }
 
 
+/**
+ * Hold or unhold receiving on a socket, depending on how much data it has queued
+ * compared to its receive window, and how much heap we have left.
+ */
+static void esp8266_rxFlowControl(
+    struct socketData *pSocketData //!< The socket to check.
+) {
+  // UDP sockets can't be held, esp8266_callback_recvCB_udp drops datagrams instead
+  if (pSocketData->pEspconn == NULL || pSocketData->creationType == SOCKET_CREATED_UDP) return;
+  // Never hold with nothing queued, as we only unhold when data is read
+  bool full = pSocketData->rxQueued > 0 &&
+      (pSocketData->rxQueued >= pSocketData->rxWindow ||
+       system_get_free_heap_size() < RX_MIN_FREE_HEAP);
+  if (full && !pSocketData->rxHeld) {
+    espconn_recv_hold(pSocketData->pEspconn);
+    pSocketData->rxHeld = true;
+    NET_STAT_ADD(pSocketData, recvHolds, 1);
+  } else if (!full && pSocketData->rxHeld) {
+    espconn_recv_unhold(pSocketData->pEspconn);
+    pSocketData->rxHeld = false;
+    NET_STAT_ADD(pSocketData, recvUnholds, 1);
+  }
+}
+
+/**
+ * Note the most data that has been queued on a socket, after more has been received.
+ */
+static void esp8266_rxQueuedStats(
+    struct socketData *pSocketData //!< The socket that has received data.
+) {
+  if (pSocketData->rxQueued > pSocketData->stats.rxQueuedMax)
+    pSocketData->stats.rxQueuedMax = pSocketData->rxQueued;
+  if (pSocketData->rxQueued > g_netStats.rxQueuedMax)
+    g_netStats.rxQueuedMax = pSocketData->rxQueued;
+}
+
+/**
+ * Remove len bytes from the front of a socket's receive queue.
+ */
+static void esp8266_rxBufConsume(
+    struct socketData *pSocketData, //!< The socket whose data has been received.
+    size_t len                      //!< The number of bytes to remove.
+) {
+  pSocketData->rxBufQ = PktBuf_Consume(pSocketData->rxBufQ, (uint16_t)len);
+  pSocketData->rxQueued -= len;
+  // re-enable the flood if we now have room
+  esp8266_rxFlowControl(pSocketData);
+}
+
+/**
+ * Receive the datagrams queued on a UDP socket, as many whole ones (each preceded by its
+ * JsNetUDPPacketHeader) as fit in the buffer, so the socket lib gets a burst of them at once.
+ * If the first one doesn't fit on its own, it is truncated.
+ * Returns the number of bytes put in the buffer.
+ */
+static int esp8266_recvDatagrams(
+    struct socketData *pSocketData, //!< The UDP socket.
+    uint8_t *buf,                   //!< The storage buffer into which we will receive data.
+    size_t len                      //!< The length of the buffer.
+) {
+  size_t pos = 0;
+  while (pSocketData->rxBufQ != NULL) {
+    PktBuf *rxBuf = pSocketData->rxBufQ;
+    size_t bufLen = rxBuf->filled;
+    if (pos + bufLen > len) {
+      if (pos > 0 || len <= sizeof(JsNetUDPPacketHeader)) break; // leave it for next time
+      // too big to ever fit - pass on what we can
+      JsNetUDPPacketHeader header;
+      os_memcpy(&header, rxBuf->data, sizeof(header));
+      header.length = (unsigned short)(len - sizeof(header));
+      os_memcpy(buf, &header, sizeof(header));
+      os_memcpy(buf + sizeof(header), rxBuf->data + sizeof(header), header.length);
+      pos = len;
+    } else {
+      os_memcpy(buf + pos, rxBuf->data, bufLen);
+      pos += bufLen;
+    }
+    pSocketData->rxBufQ = PktBuf_ShiftFree(pSocketData->rxBufQ);
+    pSocketData->rxQueued -= bufLen;
+  }
+  return (int)pos;
+}
+
 /**
  * Receive data from the network device.
  * Returns the number of bytes received which may be 0 and <0 if there was an error.
@@ -800,37 +1163,198 @@ int net_ESP8266_BOARD_recv(
       return 0; // we just have no data
     }
   }
+  if (pSocketData->creationType == SOCKET_CREATED_UDP)
+    return esp8266_recvDatagrams(pSocketData, buf, len);
+  PktBuf *rxBuf = pSocketData->rxBufQ;
+  if (len > PktBuf_Available(rxBuf)) len = PktBuf_Available(rxBuf);
+  os_memcpy(buf, PktBuf_ReadPtr(rxBuf), len);
+  esp8266_rxBufConsume(pSocketData, len);
+  //DBG("%s: socket %d JS recv %d\n", DBG_LIB, sckt, len);
+  return len;
+}
+
+/**
+ * Receive data from the network device straight into a new String, which saves
+ * copying it via the socket server's buffer.
+ * Returns the number of bytes received which may be 0 and <0 if there was an error.
+ */
+int net_ESP8266_BOARD_recvVar(
+    JsNetwork *net, //!< The Network we are going to use to create the socket.
+    int sckt,       //!< The socket from which we are to receive data.
+    JsVar **data,   //!< Set to the String of data received
+    size_t len      //!< The maximum amount of data to receive.
+) {
+  struct socketData *pSocketData = getSocketData(sckt);
+  assert(pSocketData);
+  // let recv handle errors and the case where there's no data
+  if (pSocketData->state == SOCKET_STATE_TO_ABORT || pSocketData->rxBufQ == NULL)
+    return net_ESP8266_BOARD_recv(net, sckt, NULL, 0);
+  // datagrams need their headers, so go via a buffer
+  if (pSocketData->creationType == SOCKET_CREATED_UDP) {
+    char *buf = alloca(len);
+    int num = net_ESP8266_BOARD_recv(net, sckt, buf, len);
+    if (num > 0) {
+      *data = jsvNewStringOfLength((unsigned int)num);
+      if (*data) jsvSetString(*data, buf, (size_t)num);
+    }
+    return num;
+  }
+
   PktBuf *rxBuf = pSocketData->rxBufQ;
+  if (len > PktBuf_Available(rxBuf)) len = PktBuf_Available(rxBuf);
+  *data = jsvNewStringOfLength((unsigned int)len);
+  if (!*data) return 0; // out of memory - leave the data where it is for now
+  len = jsvGetStringLength(*data); // could have been truncated
+  jsvSetString(*data, (char*)PktBuf_ReadPtr(rxBuf), len);
+  esp8266_rxBufConsume(pSocketData, len);
+  return (int)len;
+}
+
 
-  // If the receive buffer is able to completely fit in the buffer
-  // passed into us then we can copy all the data and the receive buffer will be clear.
-  if (rxBuf->filled <= len) {
-    os_memcpy(buf, rxBuf->data, rxBuf->filled);
-    int retLen = rxBuf->filled;
-    pSocketData->rxBufQ = PktBuf_ShiftFree(rxBuf);
-    // if we now have exactly one buffer enqueued we need to re-enable the flood
-    if (pSocketData->rxBufQ != NULL && pSocketData->rxBufQ->next == NULL)
-      espconn_recv_unhold(pSocketData->pEspconn);
-    //DBG("%s: socket %d JS recv %d\n", DBG_LIB, sckt, retLen);
-    return retLen;
+/**
+ * Return an object containing the counters for a socket, or for all sockets
+ * since boot if sckt<0. Returns 0 if the socket isn't in use.
+ */
+JsVar *net_ESP8266_BOARD_getStats(
+    JsNetwork *net, //!< The Network we are going to use.
+    int sckt        //!< The socket, or <0 for the totals.
+) {
+  struct netStats *stats;
+  uint32_t rxQueued = 0;
+  int sockets = 0;
+  if (sckt < 0) {
+    stats = &g_netStats;
+    for (int i=0; i<MAX_SOCKETS; i++) {
+      if (socketArray[i].state == SOCKET_STATE_UNUSED) continue;
+      rxQueued += socketArray[i].rxQueued;
+      sockets++;
+    }
+  } else {
+    struct socketData *pSocketData = getSocketData(sckt);
+    if (pSocketData == NULL) return 0;
+    stats = &pSocketData->stats;
+    rxQueued = pSocketData->rxQueued;
   }
 
-  // If we are here, then we have more data in the receive buffer than is available
-  // to be returned in this request for data.  So we have to copy the amount of data
-  // that is allowed to be returned and then strip that from the beginning of the
-  // receive buffer.
-
-  // First we copy the data we are going to return.
-  os_memcpy(buf, rxBuf->data, len);
-  // Next we shift up the remaining data
-  uint16_t newLen = rxBuf->filled - len;
-  os_memmove(rxBuf->data, rxBuf->data + len, newLen);
-  rxBuf->filled = newLen;
-  //DBG("%s: socket %d JS recv %d\n", DBG_LIB, sckt, len);
-  return len;
+  JsVar *obj = jsvNewObject();
+  if (!obj) return 0;
+  jsvObjectSetChildAndUnLock(obj, "bytesIn", jsvNewFromLongInteger(stats->bytesIn));
+  jsvObjectSetChildAndUnLock(obj, "bytesOut", jsvNewFromLongInteger(stats->bytesOut));
+  jsvObjectSetChildAndUnLock(obj, "segmentsIn", jsvNewFromLongInteger(stats->segmentsIn));
+  jsvObjectSetChildAndUnLock(obj, "segmentsOut", jsvNewFromLongInteger(stats->segmentsOut));
+  jsvObjectSetChildAndUnLock(obj, "recvHolds", jsvNewFromLongInteger(stats->recvHolds));
+  jsvObjectSetChildAndUnLock(obj, "recvUnholds", jsvNewFromLongInteger(stats->recvUnholds));
+  jsvObjectSetChildAndUnLock(obj, "txWait", jsvNewFromLongInteger((long long)(stats->txWaitUs / 1000)));
+  jsvObjectSetChildAndUnLock(obj, "allocFails", jsvNewFromLongInteger(stats->allocFails));
+  jsvObjectSetChildAndUnLock(obj, "rxDropped", jsvNewFromLongInteger(stats->rxDropped));
+  jsvObjectSetChildAndUnLock(obj, "rxQueued", jsvNewFromLongInteger(rxQueued));
+  jsvObjectSetChildAndUnLock(obj, "rxQueuedMax", jsvNewFromLongInteger(stats->rxQueuedMax));
+  if (sckt < 0) {
+    jsvObjectSetChildAndUnLock(obj, "sockets", jsvNewFromInteger(sockets));
+    jsvObjectSetChildAndUnLock(obj, "freeHeap", jsvNewFromInteger((JsVarInt)system_get_free_heap_size()));
+  }
+  return obj;
 }
 
 
+/**
+ * Set the number of received bytes that can be queued for a socket before we
+ * stop receiving. If sckt<0, set the default for new sockets.
+ */
+void net_ESP8266_BOARD_setRecvWindow(
+    JsNetwork *net, //!< The Network we are going to use.
+    int sckt,       //!< The socket, or <0 for the default.
+    int bytes       //!< The number of bytes.
+) {
+  if (bytes < RX_WINDOW_MIN) bytes = RX_WINDOW_MIN;
+  if (bytes > RX_WINDOW_MAX) bytes = RX_WINDOW_MAX;
+  if (sckt < 0) {
+    g_rxWindowDefault = (uint16_t)bytes;
+    return;
+  }
+  struct socketData *pSocketData = getSocketData(sckt);
+  if (pSocketData == NULL) return;
+  pSocketData->rxWindow = (uint16_t)bytes;
+  esp8266_rxFlowControl(pSocketData);
+}
+
+
+/**
+ * Turn Nagle's algorithm off (noDelay=true) or back on for a TCP socket. It's off
+ * for all sockets to start with, see esp8266_setTxOptions. Sockets that are still
+ * connecting get it set when they connect.
+ */
+void net_ESP8266_BOARD_setNoDelay(
+    JsNetwork *net, //!< The Network we are going to use.
+    int sckt,       //!< The socket.
+    bool noDelay    //!< Whether to send small segments straight away.
+) {
+  struct socketData *pSocketData = getSocketData(sckt);
+  if (pSocketData == NULL) return;
+  if (pSocketData->creationType != SOCKET_CREATED_OUTBOUND &&
+      pSocketData->creationType != SOCKET_CREATED_INBOUND) return; // TCP connections only
+  pSocketData->nagle = !noDelay;
+  if (pSocketData->pEspconn == NULL ||
+      pSocketData->state == SOCKET_STATE_HOST_RESOLVING ||
+      pSocketData->state == SOCKET_STATE_CONNECTING) return;
+  if (noDelay)
+    espconn_set_opt(pSocketData->pEspconn, ESPCONN_NODELAY);
+  else
+    espconn_clear_opt(pSocketData->pEspconn, ESPCONN_NODELAY);
+}
+
+
+/**
+ * Is the network busy? That is, whether any socket is connecting, sending, closing or
+ * has data queued, or there was activity on a socket in the last recentMs milliseconds.
+ * The power manager keeps the radio awake while this is true.
+ */
+bool net_ESP8266_BOARD_isBusy(
+    uint32_t recentMs //!< How recent activity must be to count as busy.
+) {
+  if (system_get_time() - g_lastActivity < recentMs*1000) return true;
+  for (int i=0; i<MAX_SOCKETS; i++) {
+    struct socketData *pSocketData = &socketArray[i];
+    if (pSocketData->rxQueued > 0) return true;
+    switch (pSocketData->state) {
+    case SOCKET_STATE_UNUSED:
+    case SOCKET_STATE_IDLE: // includes listening sockets
+    case SOCKET_STATE_CLOSED:
+      break;
+    default:
+      return true;
+    }
+  }
+  return false;
+}
+
+
+/**
+ * Send one datagram (preceded by a JsNetUDPPacketHeader saying where to) on a UDP socket.
+ * espconn copies the data straight into a pbuf, so there's no tx buffer to wait for.
+ */
+static int esp8266_sendDatagram(
+    struct socketData *pSocketData, //!< The UDP socket.
+    const void *buf,                //!< The header and datagram.
+    size_t len                      //!< The length of the header and datagram.
+) {
+  JsNetUDPPacketHeader header;
+  if (len < sizeof(header)) return SOCKET_ERR_BAD_ARG;
+  os_memcpy(&header, buf, sizeof(header));
+  esp_udp *udp = pSocketData->pEspconn->proto.udp;
+  os_memcpy(udp->remote_ip, header.host, sizeof(header.host));
+  udp->remote_port = header.port;
+  int rc = espconn_sendto(pSocketData->pEspconn, (uint8 *)buf + sizeof(header), header.length);
+  if (rc == ESPCONN_MEM || rc == ESPCONN_MAXNUM) return 0; // out of pbufs - try again later
+  if (rc < 0) {
+    setSocketInError(pSocketData, rc);
+    return pSocketData->errorCode;
+  }
+  NET_STAT_ADD(pSocketData, bytesOut, header.length);
+  NET_STAT_ADD(pSocketData, segmentsOut, 1);
+  return (int)len;
+}
+
 /**
  * Send data to the partner.
  * The return is the number of bytes actually transmitted which may also be
@@ -847,6 +1371,7 @@ int net_ESP8266_BOARD_send(
   //DBG("%s:send\n", DBG_LIB);
   struct socketData *pSocketData = getSocketData(sckt);
   assert(pSocketData->state != SOCKET_STATE_UNUSED);
+  g_lastActivity = system_get_time(); // a reply is likely, so keep the radio awake
 
   // If the socket is in error or it is closing return -1
   switch (pSocketData->state) {
@@ -867,15 +1392,19 @@ int net_ESP8266_BOARD_send(
     return 0;
   }
 
+  if (pSocketData->creationType == SOCKET_CREATED_UDP)
+    return esp8266_sendDatagram(pSocketData, buf, len);
+
   // Log the content of the data we are sending.
   //esp8266_board_writeString(buf, len);
   //os_printf("\n");
 
   // Copy the data to be sent into a transmit buffer we hand off to espconn
   assert(pSocketData->currentTx == NULL);
-  pSocketData->currentTx = (uint8_t *)os_malloc(len);
+  pSocketData->currentTx = (uint8_t *)esp8266_heapAlloc(ESP_HEAP_TX, len);
   if (pSocketData->currentTx == NULL) {
     DBG("%s: Out of memory sending %d on socket %d\n", DBG_LIB, len, sckt);
+    NET_STAT_ADD(pSocketData, allocFails, 1);
     setSocketInError(pSocketData, ESPCONN_MEM);
     espconn_abort(pSocketData->pEspconn);
     pSocketData->state = SOCKET_STATE_ABORTING;
@@ -885,9 +1414,15 @@ int net_ESP8266_BOARD_send(
 
   // Send the data over the ESP8266 SDK.
   int rc = espconn_send(pSocketData->pEspconn, pSocketData->currentTx, len);
+  if (rc == ESPCONN_MAXNUM) {
+    // espconn's send buffer is full - try again later
+    esp8266_heapFree(pSocketData->currentTx);
+    pSocketData->currentTx = NULL;
+    return 0;
+  }
   if (rc < 0) {
     setSocketInError(pSocketData, rc);
-    os_free(pSocketData->currentTx);
+    esp8266_heapFree(pSocketData->currentTx);
     pSocketData->currentTx = NULL;
     espconn_abort(pSocketData->pEspconn);
     pSocketData->state = SOCKET_STATE_ABORTING;
@@ -895,6 +1430,9 @@ int net_ESP8266_BOARD_send(
   }
 
   pSocketData->state = SOCKET_STATE_TRANSMITTING;
+  pSocketData->txStart = system_get_time();
+  NET_STAT_ADD(pSocketData, bytesOut, len);
+  NET_STAT_ADD(pSocketData, segmentsOut, 1);
   //DBG("%s: socket %d JS send %d\n", DBG_LIB, sckt, len);
   return len;
 }
@@ -951,6 +1489,7 @@ static void dnsFoundCallback(const char *hostName, ip_addr_t *ipAddr, void *arg)
   assert(arg != NULL); // arg points to the espconn struct where the resolved IP address needs to go
   struct espconn *pEspconn = arg;
   struct socketData *pSocketData = pEspconn->reverse;
+  esp8266_netActivity(pEspconn);
 
   if (pSocketData->state == SOCKET_STATE_DISCONNECTING) {
     // the sockte library closed the socket while we were resolving, we now need to deallocate
@@ -962,6 +1501,7 @@ static void dnsFoundCallback(const char *hostName, ip_addr_t *ipAddr, void *arg)
 
   // ipAddr will be NULL if the IP address can not be resolved.
   if (ipAddr != NULL) {
+    networkDNSCacheAdd(hostName, ipAddr->addr);
     *(uint32_t *)&pEspconn->proto.tcp->remote_ip = ipAddr->addr;
     if (pSocketData != NULL) connectSocket(pSocketData);
   } else {
@@ -992,24 +1532,21 @@ int net_ESP8266_BOARD_createSocket(
   }
 
   // allocate espconn data structure and initialize it
-  struct espconn *pEspconn = os_zalloc(sizeof(struct espconn));
-  esp_tcp *tcp = os_zalloc(sizeof(esp_tcp));
-  if (pEspconn == NULL || tcp == NULL) {
+  struct espconn *pEspconn = allocateEspconn(false);
+  if (pEspconn == NULL) {
     DBG("%s: Out of memory for outbound connection\n", DBG_LIB);
-    if (pEspconn != NULL) os_free(pEspconn);
-    if (tcp != NULL) os_free(tcp);
     releaseSocket(pSocketData);
     return SOCKET_ERR_MEM;
   }
+  esp_tcp *tcp = pEspconn->proto.tcp;
 
   pSocketData->pEspconn = pEspconn;
   pEspconn->type      = ESPCONN_TCP;
   pEspconn->state     = ESPCONN_NONE;
-  pEspconn->proto.tcp = tcp;
   tcp->remote_port    = port;
   tcp->local_port     = espconn_port(); // using 0 doesn't work
   pEspconn->reverse   = pSocketData;
-  espconn_set_opt(pEspconn, ESPCONN_NODELAY); // disable nagle, don't need the extra delay
+  esp8266_setTxOptions(pEspconn);
 
   if (ipAddress == (uint32_t)-1) {
     // We need DNS resolution, kick it off
@@ -1027,6 +1564,49 @@ int net_ESP8266_BOARD_createSocket(
   }
 }
 
+/**
+ * Create a new UDP socket, bound to the given local port (or any port if 0).
+ * Returns >=0 on success.
+ */
+int net_ESP8266_BOARD_createSocketUDP(
+    JsNetwork *net,     //!< The Network we are going to use to create the socket.
+    unsigned short port //!< The local port to receive datagrams on, or 0 for any.
+) {
+  struct socketData *pSocketData = allocateNewSocket();
+  if (pSocketData == NULL) { // No free socket
+    DBG("%s: No free sockets for UDP\n", DBG_LIB);
+    return SOCKET_ERR_MAX_SOCK;
+  }
+
+  struct espconn *pEspconn = allocateEspconn(true);
+  if (pEspconn == NULL) {
+    DBG("%s: Out of memory for UDP socket\n", DBG_LIB);
+    releaseSocket(pSocketData);
+    return SOCKET_ERR_MEM;
+  }
+  esp_udp *udp = pEspconn->proto.udp;
+
+  pSocketData->pEspconn     = pEspconn;
+  pSocketData->creationType = SOCKET_CREATED_UDP;
+  pSocketData->state        = SOCKET_STATE_IDLE;
+  pEspconn->type      = ESPCONN_UDP;
+  pEspconn->state     = ESPCONN_NONE;
+  udp->local_port     = port ? port : espconn_port();
+  pEspconn->reverse   = pSocketData;
+  espconn_regist_recvcb(pEspconn, esp8266_callback_recvCB_udp);
+
+  int rc = espconn_create(pEspconn);
+  if (rc != 0) {
+    DBG("%s: error %d creating UDP socket %d: %s\n", DBG_LIB,
+        rc, pSocketData->socketId, esp8266_errorToString(rc));
+    releaseEspconn(pSocketData);
+    releaseSocket(pSocketData);
+    return rc;
+  }
+  DBG("%s: UDP socket %d on port %d\n", DBG_LIB, pSocketData->socketId, udp->local_port);
+  return pSocketData->socketId;
+}
+
 /**
  * Continue creating a socket, the name resolution having completed
  */
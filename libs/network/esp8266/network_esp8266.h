@@ -26,16 +26,62 @@
  */
 #define MAX_SOCKETS (10)
 
+/**
+ * The number of espconn structures (with the esp_tcp or esp_udp they point to) that
+ * netInit_esp8266_board allocates for outbound, listening and UDP sockets, so that
+ * setting up a connection doesn't need the heap. If they're all in use, more
+ * come from the heap.
+ */
+#ifndef ESPCONN_POOL_SIZE
+#define ESPCONN_POOL_SIZE (4)
+#endif
+
+/**
+ * The default number of received bytes that can be queued for each socket before
+ * we stop receiving (about the same as the old behaviour of holding when a second
+ * segment arrived), and the limits for what can be set.
+ */
+#define RX_WINDOW_DEFAULT (1460)
+#define RX_WINDOW_MIN     (536)
+#define RX_WINDOW_MAX     (16384)
+
+/**
+ * Limits for the amount of data the socket lib moves at a time, see
+ * net_ESP8266_BOARD_getChunkSize. We only use the maximum if there's CHUNK_HEADROOM
+ * times as much heap, stack and JsVars free.
+ */
+#define CHUNK_SIZE_MAX    (1460)
+#define CHUNK_SIZE_MIN    (536/2)
+#define CHUNK_HEADROOM    (4)
+
+/**
+ * The number of segments espconn can buffer for sending on each connection. With
+ * this many, one can be sent while we are still waiting for others to be acknowledged.
+ */
+#define TX_BUF_COUNT      (4)
+
+/**
+ * Stop receiving on any socket that has data queued if the free heap drops below this.
+ */
+#define RX_MIN_FREE_HEAP  (8192)
+
 void netInit_esp8266_board();
 void netSetCallbacks_esp8266_board(JsNetwork *net);
 void esp8266_dumpSocket(int socketId);
 void esp8266_dumpAllSocketData();
 int  net_ESP8266_BOARD_accept(JsNetwork *net, int serverSckt);
 int  net_ESP8266_BOARD_recv(JsNetwork *net, int sckt, void *buf, size_t len);
+int  net_ESP8266_BOARD_recvVar(JsNetwork *net, int sckt, JsVar **data, size_t len);
+void net_ESP8266_BOARD_setRecvWindow(JsNetwork *net, int sckt, int bytes);
+void net_ESP8266_BOARD_setNoDelay(JsNetwork *net, int sckt, bool noDelay);
+bool net_ESP8266_BOARD_isBusy(uint32_t recentMs);
+JsVar *net_ESP8266_BOARD_getStats(JsNetwork *net, int sckt);
+int  net_ESP8266_BOARD_getChunkSize();
 int  net_ESP8266_BOARD_send(JsNetwork *net, int sckt, const void *buf, size_t len);
 void net_ESP8266_BOARD_idle(JsNetwork *net);
 bool net_ESP8266_BOARD_checkError(JsNetwork *net);
 int  net_ESP8266_BOARD_createSocket(JsNetwork *net, uint32_t ipAddress, unsigned short port);
+int  net_ESP8266_BOARD_createSocketUDP(JsNetwork *net, unsigned short port);
 void net_ESP8266_BOARD_closeSocket(JsNetwork *net, int sckt);
 void net_ESP8266_BOARD_gethostbyname(JsNetwork *net, char *hostName, uint32_t *outIp);
 #endif /* LIBS_NETWORK_ESP8266_NETWORK_ESP8266_H_ */
@@ -8,10 +8,59 @@
 #include <upgrade.h>
 #include <espconn.h>
 #include <espmissingincludes.h>
+#include "esp8266_board_utils.h"
 #include "ota.h"
+#ifdef USE_HEATSHRINK
+#include "heatshrink_decoder.h"
+#endif
 
 #define OTA_BUFF_SZ 512
 #define OTA_CHUNK_SZ 512
+#define OTA_ERASE_MS 5 // how often we erase the next flash sector while waiting for data
+
+/* Uploads are either a raw userN.bin, or start with an 8 byte header:
+ *   'E','S','O',flags, then the length of the resulting image (uint32, little endian)
+ * flags is a combination of:
+ *   OTA_HDR_HEATSHRINK - the rest is heatshrink compressed (window 8, lookahead 6)
+ *   OTA_HDR_DELTA - the (decompressed) rest is a patch against the running firmware.
+ *     It is a series of records, each a 12 byte header of diffLen, extraLen and seek
+ *     (all 32 bit little endian, seek is signed) followed by diffLen bytes that are
+ *     added to the bytes of the old image starting from oldPos, then extraLen bytes
+ *     that are copied as-is. oldPos then advances by diffLen+seek. This is bsdiff's
+ *     format with the blocks interleaved so it can be applied while streaming.
+ * scripts/ota_pack.py creates these. */
+#define OTA_HDR_SZ 8
+#define OTA_HDR_HEATSHRINK 1
+#define OTA_HDR_DELTA 2
+#define OTA_DELTA_HDR_SZ 12
+
+// State of an upload that is being written to flash
+typedef struct OtaWriter {
+  uint32_t       outStart;      // flash address the image is written to
+  uint32_t       outLen;        // length of the image
+  uint32_t       outPos;        // bytes of the image produced so far
+  uint32_t       erasedTo;      // flash address up to which we have erased
+  uint32_t       outBuf[OTA_CHUNK_SZ/4]; // data waiting to be written (words, for spi_flash_write)
+  uint16_t       outFill;       // number of bytes in outBuf
+  uint32_t       bodyLen;       // length of the data we're being sent (including any header)
+  uint8_t        hdr[OTA_HDR_SZ]; // the start of the data, to work out what it is
+  uint8_t        hdrFill;       // number of bytes in hdr
+  uint8_t        flags;         // OTA_HDR_*
+  char           *err;          // error message if the image was bad
+  // OTA_HDR_DELTA
+  uint32_t       oldStart;      // flash address of the running firmware
+  uint32_t       oldPos;        // position in the running firmware
+  uint32_t       oldBuf[8];     // cache of the running firmware
+  uint32_t       oldBufPos;     // position of oldBuf in the running firmware
+  uint32_t       diffLeft;      // bytes left in this record's diff block
+  uint32_t       extraLeft;     // bytes left in this record's extra block
+  int32_t        seek;          // added to oldPos at the end of this record
+  uint8_t        deltaHdr[OTA_DELTA_HDR_SZ];
+  uint8_t        deltaHdrFill;
+#ifdef USE_HEATSHRINK
+  heatshrink_decoder hsd;
+#endif
+} OtaWriter;
 
 // Request handler
 struct OtaConn;
@@ -26,8 +75,13 @@ typedef struct OtaConn {
   int32_t        rxBufOff;      // offset into req body of first char in buffer, -1:in header
   uint32_t       reqLen;        // length of request body
   OtaHandler     *handler;      // handler to process this request
+  bool           writing;       // we're writing a firmware image from this request (see otaWriteBegin)
 } OtaConn;
 
+static ETSTimer ota_erase_timer;
+static OtaWriter *otaWriter;    // the firmware image being written, if any
+static OtaConn otaConn[1]; // allocate a single connection for now
+
 // Format for the response we send
 static char *responseFmt =
       "HTTP/1.1 %d %s\r\n"
@@ -45,7 +99,8 @@ static char *responseFmt =
  */
 static void releaseConn(OtaConn *oc) {
   if (!oc) return;
-  if (oc->rxBuffer) os_free(oc->rxBuffer);
+  if (oc->rxBuffer) esp8266_heapFree(oc->rxBuffer);
+  if (oc->writing) otaWriteAbort();
   os_memset(oc, 0, sizeof(OtaConn));
 }
 
@@ -127,71 +182,333 @@ static uint32_t flashMaxSize[] = {
   (1024-4-16)*1024, (1024-4-16)*1024,                // 1024 KB firmware partitions
 };
 
+/*
+ * \brief: otaEraseNext erases the next flash sector of the image we're writing
+ */
+static void otaEraseNext(OtaWriter *w) {
+  os_printf("OTA Erasing 0x%05lx\n", w->erasedTo);
+  spi_flash_erase_sector(w->erasedTo/SPI_FLASH_SEC_SIZE);
+  w->erasedTo += SPI_FLASH_SEC_SIZE;
+}
+
+/*
+ * \brief: otaEraseTimerCb erases sectors ahead of the incoming data
+ *
+ * This runs between received packets, so we're not erasing while data is waiting to be written
+ */
+static void otaEraseTimerCb(void *arg) {
+  OtaWriter *w = arg;
+  if (w != otaWriter) return; // upload has finished
+  if (w->erasedTo < w->outStart + w->outLen)
+    otaEraseNext(w);
+  else
+    os_timer_disarm(&ota_erase_timer);
+}
+
+/*
+ * \brief: otaOutFlush writes any buffered image data to flash
+ */
+static bool otaOutFlush(OtaWriter *w) {
+  if (!w->outFill) return true;
+  uint32_t address = w->outStart + w->outPos - w->outFill;
+  // check that the image starts with an appropriate header
+  if (address == w->outStart && (w->err = check_header(w->outBuf)) != NULL)
+    return false;
+  // erase if the timer hasn't got this far yet
+  while (w->erasedTo < address + w->outFill)
+    otaEraseNext(w);
+  // pad to a whole number of words
+  while (w->outFill & 3) ((uint8_t*)w->outBuf)[w->outFill++] = 0xFF;
+  spi_flash_write(address, w->outBuf, w->outFill);
+  w->outFill = 0;
+  return true;
+}
+
+/*
+ * \brief: otaOutBytes adds bytes of the final image, writing to flash in OTA_CHUNK_SZ pieces
+ */
+static bool otaOutBytes(OtaWriter *w, const uint8_t *data, uint32_t len) {
+  if (len > w->outLen - w->outPos) {
+    w->err = "Image longer than header says";
+    return false;
+  }
+  while (len) {
+    uint32_t cpy = OTA_CHUNK_SZ - w->outFill;
+    if (cpy > len) cpy = len;
+    os_memcpy((uint8_t*)w->outBuf + w->outFill, data, cpy);
+    w->outFill += cpy;
+    w->outPos += cpy;
+    data += cpy;
+    len -= cpy;
+    if (w->outFill == OTA_CHUNK_SZ && !otaOutFlush(w)) return false;
+  }
+  return true;
+}
+
+/*
+ * \brief: otaOldByte returns a byte of the running firmware
+ */
+static uint8_t otaOldByte(OtaWriter *w, uint32_t pos) {
+  if (pos - w->oldBufPos >= sizeof(w->oldBuf)) {
+    w->oldBufPos = pos & ~(sizeof(w->oldBuf)-1);
+    spi_flash_read(w->oldStart + w->oldBufPos, w->oldBuf, sizeof(w->oldBuf));
+  }
+  return ((uint8_t*)w->oldBuf)[pos - w->oldBufPos];
+}
+
+/*
+ * \brief: otaDeltaBytes applies a piece of a delta patch (see OTA_HDR_DELTA)
+ */
+static bool otaDeltaBytes(OtaWriter *w, const uint8_t *data, uint32_t len) {
+  while (len) {
+    if (w->deltaHdrFill < OTA_DELTA_HDR_SZ) {
+      // record header
+      w->deltaHdr[w->deltaHdrFill++] = *data++;
+      len--;
+      if (w->deltaHdrFill == OTA_DELTA_HDR_SZ) {
+        uint8_t *h = w->deltaHdr;
+        w->diffLeft = h[0] | (h[1]<<8) | (h[2]<<16) | ((uint32_t)h[3]<<24);
+        w->extraLeft = h[4] | (h[5]<<8) | (h[6]<<16) | ((uint32_t)h[7]<<24);
+        w->seek = (int32_t)(h[8] | (h[9]<<8) | (h[10]<<16) | ((uint32_t)h[11]<<24));
+        if (w->oldPos + w->diffLeft > flashMaxSize[flashSizeMap]) {
+          w->err = "Delta reads past old firmware";
+          return false;
+        }
+      }
+    } else if (w->diffLeft) {
+      // old firmware plus difference
+      uint8_t buf[32];
+      uint32_t n = 0;
+      while (n < sizeof(buf) && n < len && n < w->diffLeft) {
+        buf[n] = (uint8_t)(data[n] + otaOldByte(w, w->oldPos + n));
+        n++;
+      }
+      if (!otaOutBytes(w, buf, n)) return false;
+      w->oldPos += n;
+      w->diffLeft -= n;
+      data += n;
+      len -= n;
+    } else if (w->extraLeft) {
+      // new data
+      uint32_t n = len < w->extraLeft ? len : w->extraLeft;
+      if (!otaOutBytes(w, data, n)) return false;
+      w->extraLeft -= n;
+      data += n;
+      len -= n;
+    }
+    if (w->deltaHdrFill == OTA_DELTA_HDR_SZ && !w->diffLeft && !w->extraLeft) {
+      // end of record
+      w->oldPos += (uint32_t)w->seek;
+      w->deltaHdrFill = 0;
+    }
+  }
+  return true;
+}
+
+/*
+ * \brief: otaDecodedBytes passes uncompressed upload data on to the right place
+ */
+static bool otaDecodedBytes(OtaWriter *w, const uint8_t *data, uint32_t len) {
+  if (w->flags & OTA_HDR_DELTA) return otaDeltaBytes(w, data, len);
+  return otaOutBytes(w, data, len);
+}
+
+#ifdef USE_HEATSHRINK
+/*
+ * \brief: otaHeatshrinkPoll passes everything the decoder has ready on
+ */
+static bool otaHeatshrinkPoll(OtaWriter *w) {
+  uint8_t buf[64];
+  size_t n;
+  HSD_poll_res pres;
+  do {
+    pres = heatshrink_decoder_poll(&w->hsd, buf, sizeof(buf), &n);
+    if (pres < 0) {
+      w->err = "Bad compressed data";
+      return false;
+    }
+    if (!otaDecodedBytes(w, buf, n)) return false;
+  } while (pres == HSDR_POLL_MORE);
+  return true;
+}
+#endif
+
+/*
+ * \brief: otaUploadBytes handles a piece of the request body of an upload
+ */
+static bool otaUploadBytes(OtaWriter *w, uint8_t *data, uint32_t len) {
+#ifdef USE_HEATSHRINK
+  if (w->flags & OTA_HDR_HEATSHRINK) {
+    while (len) {
+      size_t n;
+      if (heatshrink_decoder_sink(&w->hsd, data, len, &n) < 0) {
+        w->err = "Bad compressed data";
+        return false;
+      }
+      data += n;
+      len -= n;
+      if (!otaHeatshrinkPoll(w)) return false;
+    }
+    return true;
+  }
+#endif
+  return otaDecodedBytes(w, data, len);
+}
+
+/*
+ * \brief: otaUploadFinish writes out the end of an upload and checks it was complete
+ */
+static bool otaUploadFinish(OtaWriter *w) {
+#ifdef USE_HEATSHRINK
+  if (w->flags & OTA_HDR_HEATSHRINK) {
+    while (heatshrink_decoder_finish(&w->hsd) == HSDR_FINISH_MORE)
+      if (!otaHeatshrinkPoll(w)) return false;
+  }
+#endif
+  if (!otaOutFlush(w)) return false;
+  if (w->outPos != w->outLen) {
+    w->err = "Image shorter than header says";
+    return false;
+  }
+  return true;
+}
+
+/*
+ * \brief: otaWriteHeader works out what sort of image we have from its first bytes, and
+ * gets ready to write it
+ *
+ * Returns an error string if something is amiss
+ */
+static char *otaWriteHeader(OtaWriter *w) {
+  uint8_t *hdr = w->hdr;
+  uint32_t outLen = w->bodyLen;
+  bool isRaw = !(hdr[0]=='E' && hdr[1]=='S' && hdr[2]=='O');
+  if (!isRaw) {
+    w->flags = hdr[3];
+    outLen = hdr[4] | (hdr[5]<<8) | (hdr[6]<<16) | ((uint32_t)hdr[7]<<24);
+#ifndef USE_HEATSHRINK
+    if (w->flags & OTA_HDR_HEATSHRINK) return "Compressed images not supported";
+#endif
+    if (w->flags & ~(OTA_HDR_HEATSHRINK|OTA_HDR_DELTA)) return "Unknown image format";
+  }
+
+  // check overall size
+  if (outLen > flashMaxSize[flashSizeMap]) {
+    os_printf("OTA: FW too large: %ld > %ld\n", outLen, flashMaxSize[flashSizeMap]);
+    return "Firmware image too large";
+  } else if (outLen < OTA_CHUNK_SZ) {
+    os_printf("OTA: FW too small: %ld\n", outLen);
+    return "Firmware too small";
+  }
+
+  // let's see which partition we need to flash and what flash address that puts us at
+  uint8 id = system_upgrade_userbin_check();
+  w->outStart = id ? 0x1000 : flashUser2Addr[flashSizeMap];
+  w->oldStart = id ? flashUser2Addr[flashSizeMap] : 0x1000;
+  w->oldBufPos = 0x80000000; // nothing cached
+  w->outLen = outLen;
+  w->erasedTo = w->outStart;
+#ifdef USE_HEATSHRINK
+  heatshrink_decoder_reset(&w->hsd);
+#endif
+  os_printf("OTA: image of %ld bytes, flags %d\n", outLen, w->flags);
+
+  // erase ahead of the data in the background
+  os_timer_disarm(&ota_erase_timer);
+  os_timer_setfn(&ota_erase_timer, (os_timer_func_t *)otaEraseTimerCb, w);
+  os_timer_arm(&ota_erase_timer, OTA_ERASE_MS, 1);
+
+  // a raw image has no header, so what we have is the start of it
+  if (isRaw && !otaUploadBytes(w, hdr, OTA_HDR_SZ)) return w->err;
+  return NULL;
+}
+
+char *otaWriteBegin(uint32_t bodyLen) {
+  if (otaWriter) return "Update already in progress";
+  if (bodyLen < OTA_HDR_SZ) return "Firmware too small";
+  otaWriter = esp8266_heapAlloc(ESP_HEAP_OTA, sizeof(OtaWriter));
+  if (!otaWriter) return "Out of memory";
+  otaWriter->bodyLen = bodyLen;
+  return NULL;
+}
+
+char *otaWriteData(uint8_t *data, uint32_t len) {
+  OtaWriter *w = otaWriter;
+  if (!w) return "No update in progress";
+  char *err = NULL;
+  if (w->hdrFill < OTA_HDR_SZ) {
+    while (len && w->hdrFill < OTA_HDR_SZ) {
+      w->hdr[w->hdrFill++] = *data++;
+      len--;
+    }
+    if (w->hdrFill == OTA_HDR_SZ) err = otaWriteHeader(w);
+  }
+  if (!err && len && !otaUploadBytes(w, data, len)) err = w->err;
+  if (err) otaWriteAbort();
+  return err;
+}
+
+char *otaWriteEnd() {
+  OtaWriter *w = otaWriter;
+  if (!w) return "No update in progress";
+  char *err = NULL;
+  if (w->hdrFill < OTA_HDR_SZ) err = "Firmware too small";
+  else if (!otaUploadFinish(w)) err = w->err;
+  otaWriteAbort();
+  return err;
+}
+
+void otaWriteAbort() {
+  if (!otaWriter) return;
+  os_timer_disarm(&ota_erase_timer);
+  esp8266_heapFree(otaWriter);
+  otaWriter = NULL;
+}
+
 /*
  * \brief: otaHandleUpload handles a POST to update the firmware
  *
+ * The body is either a raw image or one with an OTA_HDR_SZ header (see above). Data is
+ * decompressed/patched as it arrives and written out in OTA_CHUNK_SZ pieces, while a timer
+ * erases flash ahead of it.
+ *
  * Returns the number of bytes consumed from the request, -1 if a response has been sent.
  */
 static int16_t otaHandleUpload(OtaConn *oc) {
   uint32_t offset = oc->rxBufOff;
+  uint16_t len = oc->rxBufFill;
 
   // assume no error yet...
   char *err = NULL;
   uint16_t code = 400;
 
-  // check overall size
-  if (oc->reqLen > flashMaxSize[flashSizeMap]) {
-    os_printf("OTA: FW too large: %ld > %ld\n", oc->reqLen, flashMaxSize[flashSizeMap]);
-    err = "Firmware image too large";
-  } else if (oc->reqLen < OTA_CHUNK_SZ) {
-    os_printf("OTA: FW too small: %ld\n", oc->reqLen);
-    err = "Firmware too small";
+  if (!oc->writing) {
+    err = otaWriteBegin(oc->reqLen);
+    oc->writing = err == NULL;
+  }
+  if (err == NULL) err = otaWriteData((uint8_t*)oc->rxBuffer, len);
+  if (err == NULL && offset + len == oc->reqLen) {
+    err = otaWriteEnd();
+    oc->writing = false;
+    if (err == NULL) {
+      sendResponse(oc, 200, "");
+      return -1;
+    }
   }
-
-  // check that we have at least OTA_CHUNK_SZ bytes buffered or it's the last chunk, else we can't write
-  if (oc->rxBufFill < OTA_CHUNK_SZ && offset+OTA_CHUNK_SZ <= oc->reqLen) return 0;
-  uint16_t toFlash = OTA_CHUNK_SZ;
-  if (oc->rxBufFill < toFlash) toFlash = oc->rxBufFill;
-
-  // check that data starts with an appropriate header
-  if (err == NULL && offset == 0) err = check_header(oc->rxBuffer+oc->rxBufOff);
 
   // return an error if there is one
   if (err != NULL) {
+    oc->writing = false;
     os_printf("OTA Error %d: %s\n", code, err);
     sendResponse(oc, code, err);
     return -1;
   }
-
-  // let's see which partition we need to flash and what flash address that puts us at
-  uint8 id = system_upgrade_userbin_check();
-  uint32_t address = id ? 0x1000 : flashUser2Addr[flashSizeMap];
-  address += offset;
-
-  // erase next flash block if necessary
-  if (address % SPI_FLASH_SEC_SIZE == 0){
-          os_printf("OTA Flashing 0x%05lx\n", address);
-          spi_flash_erase_sector(address/SPI_FLASH_SEC_SIZE);
-  }
-
-  // write the data
-  //os_printf("Writing %d bytes at 0x%05x (%d of %d)\n", connData->post->buffSize, address,
-  //		connData->post->received, connData->post->len);
-  spi_flash_write(address, (uint32 *)oc->rxBuffer, toFlash);
-
-  if (offset + toFlash == oc->reqLen) {
-    sendResponse(oc, 200, "");
-    return -1;
-  }
-  return toFlash;
+  return len;
 }
 
 static ETSTimer flash_reboot_timer;
 
-/*
- * \brief: otaRebootFirmware Handle request to reboot into the new firmware
- */
-static int16_t otaHandleReboot(OtaConn *oc) {
+char *otaSwitchPartition(bool reboot) {
   // sanity-check that the 'next' partition actually contains something that looks like
   // valid firmware
   uint8 id = system_upgrade_userbin_check();
@@ -201,6 +518,23 @@ static int16_t otaHandleReboot(OtaConn *oc) {
   uint32 buf[8];
   spi_flash_read(address, buf, sizeof(buf));
   char *err = check_header(buf);
+  if (err != NULL) return err;
+
+  system_upgrade_flag_set(UPGRADE_FLAG_FINISH);
+  if (reboot) {
+    // Schedule a reboot
+    os_timer_disarm(&flash_reboot_timer);
+    os_timer_setfn(&flash_reboot_timer, (os_timer_func_t *)system_upgrade_reboot, NULL);
+    os_timer_arm(&flash_reboot_timer, 2000, 1);
+  }
+  return NULL;
+}
+
+/*
+ * \brief: otaRebootFirmware Handle request to reboot into the new firmware
+ */
+static int16_t otaHandleReboot(OtaConn *oc) {
+  char *err = otaSwitchPartition(true);
   if (err != NULL) {
           os_printf("OTA Error %d: %s\n", 400, err);
           sendResponse(oc, 400, err);
@@ -209,13 +543,6 @@ static int16_t otaHandleReboot(OtaConn *oc) {
 
   // send empty OK response
   sendResponse(oc, 200, "");
-
-  // Schedule a reboot
-  system_upgrade_flag_set(UPGRADE_FLAG_FINISH);
-  os_timer_disarm(&flash_reboot_timer);
-  os_timer_setfn(&flash_reboot_timer, (os_timer_func_t *)system_upgrade_reboot, NULL);
-  os_timer_arm(&flash_reboot_timer, 2000, 1);
-
   return -1; // we're *done*
 }
 
@@ -293,7 +620,6 @@ static int16_t processHeader(OtaConn *oc) {
   return i+4;
 }
 
-static OtaConn otaConn[1]; // allocate a single connection for now
 static struct espconn otaListener; // listening socket
 static esp_tcp otaListenerTcp;
 
@@ -308,7 +634,7 @@ static void otaRecvCb(void *arg, char *data, unsigned short len) {
 
   // allocate a buffer if we have none
   if (oc->rxBuffer == NULL) {
-    oc->rxBuffer = os_zalloc(OTA_BUFF_SZ);
+    oc->rxBuffer = esp8266_heapAlloc(ESP_HEAP_OTA, OTA_BUFF_SZ);
     if (!oc->rxBuffer) goto error; // out of memory, disconnect
     oc->rxBufFill = 0;
   }
@@ -339,7 +665,7 @@ static void otaRecvCb(void *arg, char *data, unsigned short len) {
         // if request has no body, invoke handler here and bail out
         if (oc->reqLen == 0) {
           oc->rxBufFill = 0;
-          if (oc->rxBuffer) os_free(oc->rxBuffer);
+          if (oc->rxBuffer) esp8266_heapFree(oc->rxBuffer);
           oc->rxBuffer = NULL;
           (*oc->handler)(oc);
           return;
@@ -3,4 +3,15 @@
 
 void otaInit(int port);
 
+/* Writing a firmware image to the partition we're not running from. The data is a raw
+ * userN.bin or one made by scripts/ota_pack.py, and bodyLen is its length. All of these
+ * return an error message, or NULL if all is well - after an error the update is aborted. */
+char *otaWriteBegin(uint32_t bodyLen);
+char *otaWriteData(uint8_t *data, uint32_t len);
+char *otaWriteEnd();
+/// Stop writing a firmware image (if we were)
+void otaWriteAbort();
+/// Check the new firmware, and make it the one that boots (rebooting if asked)
+char *otaSwitchPartition(bool reboot);
+
 #endif
@@ -5,6 +5,7 @@
 #include <mem.h>
 #include <osapi.h>
 #include <espmissingincludes.h>
+#include "esp8266_board_utils.h"
 #include "pktbuf.h"
 
 #ifdef PKTBUF_DBG
@@ -25,10 +26,13 @@ PktBuf_Print(PktBuf *buf) {
 
 PktBuf *
 PktBuf_New(uint16_t length) {
-  PktBuf *buf = os_zalloc(length+sizeof(PktBuf));
+  if (length < PKTBUF_MIN_SIZE) length = PKTBUF_MIN_SIZE;
+  PktBuf *buf = esp8266_heapAlloc(ESP_HEAP_PKTBUF, length+sizeof(PktBuf));
   if (buf != NULL) {
     buf->next = NULL;
+    buf->size = length;
     buf->filled = 0;
+    buf->offset = 0;
     //os_printf("PktBuf_New: %p l=%d->%d d=%p\n",
     //    buf, length, length+sizeof(PktBuf), buf->data);
   }
@@ -67,6 +71,26 @@ PktBuf *
 PktBuf_ShiftFree(PktBuf *headBuf) {
   PktBuf *buf = headBuf->next;
   //os_printf("PktBuf_ShiftFree: (%p)->%p\n", headBuf, buf);
-  os_free(headBuf);
+  esp8266_heapFree(headBuf);
   return buf;
 }
+
+bool
+PktBuf_Coalesce(PktBuf *headBuf, const uint8_t *data, uint16_t length) {
+  if (headBuf == NULL) return false;
+  PktBuf *h = headBuf;
+  while (h->next != NULL) h = h->next;
+  if (h->size - h->filled < length) return false;
+  os_memcpy(h->data + h->filled, data, length);
+  h->filled += length;
+  //os_printf("PktBuf_Coalesce: %p +%d=%d\n", h, length, h->filled);
+  return true;
+}
+
+PktBuf *
+PktBuf_Consume(PktBuf *headBuf, uint16_t length) {
+  // Rather than moving the rest of the data up, just remember how much was read
+  headBuf->offset += length;
+  if (headBuf->offset < headBuf->filled) return headBuf;
+  return PktBuf_ShiftFree(headBuf);
+}
@@ -5,10 +5,21 @@
 
 typedef struct PktBuf {
   struct PktBuf *next;   // next buffer in chain
+  uint16_t      size;    // number of bytes allocated for data
   uint16_t      filled;  // number of bytes filled in buffer
+  uint16_t      offset;  // number of bytes already read from the start of data
   uint8_t       data[0]; // data in buffer
 } PktBuf;
 
+// Small packets get a buffer of at least this size, so that following ones can be coalesced
+#define PKTBUF_MIN_SIZE 128
+
+// Number of bytes in a buffer that haven't been read yet
+#define PktBuf_Available(buf) ((uint16_t)((buf)->filled - (buf)->offset))
+
+// Pointer to the first byte of a buffer that hasn't been read yet
+#define PktBuf_ReadPtr(buf) ((buf)->data + (buf)->offset)
+
 // Allocate a new packet buffer of given length
 PktBuf *PktBuf_New(uint16_t length);
 
@@ -24,4 +35,10 @@ PktBuf *PktBuf_Shift(PktBuf *headBuf);
 // Shift first buffer off queue, free it, return new head
 PktBuf *PktBuf_ShiftFree(PktBuf *headBuf);
 
+// Append data to the last buffer of a queue if it has room, returns true on success
+bool PktBuf_Coalesce(PktBuf *headBuf, const uint8_t *data, uint16_t length);
+
+// Mark bytes of the first buffer as read, freeing it once it's all read, return new head
+PktBuf *PktBuf_Consume(PktBuf *headBuf, uint16_t length);
+
 #endif
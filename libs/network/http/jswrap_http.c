@@ -17,6 +17,10 @@
 #include "jswrap_http.h"
 #include "jsvariterator.h"
 #include "socketserver.h"
+#include "jswrap_json.h"
+#ifdef USE_FILESYSTEM
+#include "jswrap_file.h"
+#endif
 
 #include "../network.h"
 
@@ -39,6 +43,27 @@ This is designed to be a cut-down version of the [node.js library](http://nodejs
 The HTTP server created by `require('http').createServer`
 */
 // there is a 'connect' event on httpSrv, but it's used by createServer and isn't node-compliant
+/*JSON{
+  "type" : "event",
+  "class" : "httpSrv",
+  "name" : "websocket",
+  "ifdef" : "USE_CRYPTO",
+  "params" : [
+    ["ws","JsVar","A `WebSocket` for the connection"],
+    ["req","JsVar","The `httpSRq` that asked for the upgrade (for its `url` and `headers`)"]
+  ]
+}
+If there's a listener for this event, requests that ask to upgrade to a WebSocket are
+accepted and passed to it rather than to the callback given to `createServer`.
+
+```
+var server = require("http").createServer(function(req, res) { ... });
+server.on("websocket", function(ws, req) {
+  ws.on("message", function(msg) { ws.send("You said "+msg); });
+});
+server.listen(80);
+```
+*/
 
 /*JSON{
   "type" : "class",
@@ -98,6 +123,63 @@ Return a string containing characters that have been received
 }
 Pipe this to a stream (an object with a 'write' method)
 */
+/*JSON{
+  "type" : "method",
+  "class" : "httpSRq",
+  "name" : "acceptsEncoding",
+  "generate" : "jswrap_httpSRq_acceptsEncoding",
+  "params" : [
+    ["encoding","JsVar","A content encoding, eg. `\"gzip\"`"]
+  ],
+  "return" : ["bool","True if the client's `Accept-Encoding` header allows this encoding"]
+}
+Check whether the client can accept a response with the given `Content-Encoding`,
+for instance to decide whether to send a pre-compressed page with `res.sendFlash`.
+*/
+bool jswrap_httpSRq_acceptsEncoding(JsVar *parent, JsVar *encoding) {
+  return serverRequestAcceptsEncoding(parent, encoding);
+}
+
+/*JSON{
+  "type" : "property",
+  "class" : "httpSRq",
+  "name" : "path",
+  "generate" : "jswrap_httpSRq_path",
+  "return" : ["JsVar","The path that was requested, without any query string"]
+}
+The path that was requested - `"/a"` for a request for `"/a?b=c"`. This is
+worked out each time it's used.
+*/
+JsVar *jswrap_httpSRq_path(JsVar *parent) {
+  JsVar *url = jsvObjectGetChild(parent, "url", 0);
+  if (!jsvIsString(url)) {
+    jsvUnLock(url);
+    return 0;
+  }
+  int queryStart = jsvGetStringIndexOf(url, '?');
+  JsVar *path = jsvNewFromStringVar(url, 0, (queryStart>=0) ? (size_t)queryStart : JSVAPPENDSTRINGVAR_MAXLENGTH);
+  jsvUnLock(url);
+  return path;
+}
+
+/*JSON{
+  "type" : "property",
+  "class" : "httpSRq",
+  "name" : "query",
+  "generate" : "jswrap_httpSRq_query",
+  "return" : ["JsVar","An object containing the query string's values"]
+}
+The values in the query string - `{b:"c"}` for a request for `"/a?b=c"`, or `{}`
+if there wasn't one. This is parsed each time it's used, so store it in a
+variable if you need it more than once.
+*/
+JsVar *jswrap_httpSRq_query(JsVar *parent) {
+  JsVar *url = jsvObjectGetChild(parent, "url", 0);
+  int queryStart = jsvIsString(url) ? jsvGetStringIndexOf(url, '?') : -1;
+  JsVar *query = (queryStart>=0) ? jswrap_url_parseQuery(url, (size_t)queryStart+1) : jsvNewObject();
+  jsvUnLock(url);
+  return query;
+}
 
 /*JSON{
   "type" : "class",
@@ -207,6 +289,28 @@ Return a string containing characters that have been received
   ]
 }
 Pipe this to a stream (an object with a 'write' method)
+
+Data is only received as fast as the destination takes it, so big downloads
+can be piped to a file without running out of memory.
+*/
+
+/*JSON{
+  "type" : "method",
+  "class" : "httpCRs",
+  "name" : "pause",
+  "generate_full" : "clientResponseSetPaused(parent, true)"
+}
+Stop calling the `data` event. Data stops being received too, so the server
+is made to wait rather than data building up in memory. Call `resume` to
+start again.
+*/
+/*JSON{
+  "type" : "method",
+  "class" : "httpCRs",
+  "name" : "resume",
+  "generate_full" : "clientResponseSetPaused(parent, false)"
+}
+Start calling the `data` event and receiving data again after `pause`
 */
 
 
@@ -220,7 +324,7 @@ Pipe this to a stream (an object with a 'write' method)
   "name" : "createServer",
   "generate" : "jswrap_http_createServer",
   "params" : [
-    ["callback","JsVar","A function(request,response) that will be called when a connection is made"]
+    ["callback","JsVar","A function(request,response) that will be called when a connection is made. Optional if `httpSrv.route` is used"]
   ],
   "return" : ["JsVar","Returns a new httpSrv object"],
   "return_object" : "httpSrv"
@@ -231,6 +335,7 @@ When a request to the server is made, the callback is called. In the callback yo
 */
 
 JsVar *jswrap_http_createServer(JsVar *callback) {
+  if (jsvIsUndefined(callback)) return serverNew(ST_HTTP, 0); // requests handled with httpSrv.route
   JsVar *skippedCallback = jsvSkipName(callback);
   if (!jsvIsFunction(skippedCallback)) {
     jsError("Expecting Callback Function but got %t", skippedCallback);
@@ -275,6 +380,11 @@ require("http").request(options, function(res) {
 
 You can easily pre-populate `options` from a URL using `var options = url.parse("http://www.example.com/foo.html")`
 
+If you make requests to the same server regularly, set `keepAlive: true` in `options`. If the server
+agrees (and sends a `Content-Length`), the connection is kept open for a few seconds after the response
+and the next `keepAlive` request to the same host and port uses it instead of connecting again.
+Hostname lookups are also cached for a minute, whether `keepAlive` is used or not.
+
 **Note:** if TLS/HTTPS is enabled, options can have `ca`, `key` and `cert` fields. See `tls.connect` for
 more information about these and how to use them.
 
@@ -307,6 +417,45 @@ require("http").get("http://pur3.co.uk/hello.txt", function(res) {
 
 See `http.request()` and [the Internet page](/Internet) and ` for more usage examples.
 */
+/*JSON{
+  "type" : "staticmethod",
+  "class" : "http",
+  "name" : "connectWebSocket",
+  "ifdef" : "USE_CRYPTO",
+  "generate" : "jswrap_http_connectWebSocket",
+  "params" : [
+    ["options","JsVar","A URL like `\"ws://example.com/path\"`, or an object containing host,port,path,headers fields"],
+    ["callback","JsVar","(optional) A function(ws) that will be called when the WebSocket is open"]
+  ],
+  "return" : ["JsVar","Returns a new WebSocket object"],
+  "return_object" : "WebSocket"
+}
+Open a WebSocket to a server. Framing, masking and replies to pings are all handled
+natively, and `message` events are fired with whole messages.
+
+```
+var ws = require("http").connectWebSocket("ws://example.com/chat", function() {
+  ws.send("Hello");
+});
+ws.on("message", function(msg) { console.log(msg); });
+```
+*/
+JsVar *jswrap_http_connectWebSocket(JsVar *options, JsVar *callback) {
+#ifdef USE_CRYPTO
+  if (!jsvIsUndefined(callback) && !jsvIsFunction(callback)) {
+    jsError("Expecting Callback Function but got %t", callback);
+    return 0;
+  }
+  JsVar *ws = jswrap_net_connect(options, 0, ST_WEBSOCKET);
+  if (!ws) return 0;
+  webSocketClientHandshake(ws);
+  if (callback) jsvObjectSetChild(ws, JS_EVENT_PREFIX"open", callback);
+  return ws;
+#else
+  return 0;
+#endif
+}
+
 JsVar *jswrap_http_get(JsVar *options, JsVar *callback) {
   JsNetwork net;
   if (!networkGetFromVarIfOnline(&net)) return 0;
@@ -356,6 +505,52 @@ Stop listening for new HTTP connections
 */
 // Re-use existing
 
+/*JSON{
+  "type" : "method",
+  "class" : "httpSrv",
+  "name" : "route",
+  "generate" : "jswrap_httpSrv_route",
+  "params" : [
+    ["method","JsVar","The HTTP method to handle, eg. `\"GET\"`, or `\"*\"` for any"],
+    ["path","JsVar","The path to handle, eg. `\"/api\"`. Paths under it (`\"/api/led\"`) are handled too, except for `\"/\"` which is just the root"],
+    ["handler","JsVar","A `function(req, res)`, or `{addr, len, type, encoding}` to send `len` bytes straight from flash memory (see `httpSRs.sendFlash`)"]
+  ],
+  "return" : ["JsVar","This server, so calls can be chained"]
+}
+Handle requests for a path without going through the server's callback. Requests
+are matched against routes natively, in the order they were added, and only the
+handler of the first one that matches is called. Requests that don't match any
+route go to the callback given to `createServer`, or get a `404` response if there
+wasn't one.
+
+```
+require("http").createServer()
+  .route("GET", "/", { addr : pageAddr, len : pageLen, type : "text/html" })
+  .route("GET", "/api/temp", function(req, res) { res.end(E.getTemperature()); })
+  .route("POST", "/api/led", function(req, res) { LED1.write(req.query.on); res.end(); })
+  .listen(80);
+```
+
+Pages in flash memory are sent without any JavaScript being run at all. Use
+`req.path` and `req.query` rather than `url.parse(req.url)` to get the parts of
+the URL - they're only worked out if they're used.
+*/
+JsVar *jswrap_httpSrv_route(JsVar *parent, JsVar *method, JsVar *path, JsVar *handler) {
+  if (!jsvIsString(path)) {
+    jsError("Expecting path to be a String but got %t", path);
+    return 0;
+  }
+  JsVar *addr = jsvIsObject(handler) ? jsvObjectGetChild(handler, "addr", 0) : 0;
+  bool isFlash = addr!=0;
+  jsvUnLock(addr);
+  if (!jsvIsFunction(handler) && !isFlash) {
+    jsError("Expecting handler to be a Function or {addr,len} but got %t", handler);
+    return 0;
+  }
+  serverAddRoute(parent, method, path, handler);
+  return jsvLockAgain(parent);
+}
+
 
 // ---------------------------------------------------------------------------------
 // ---------------------------------------------------------------------------------
@@ -405,6 +600,98 @@ void jswrap_httpSRs_writeHead(JsVar *parent, int statusCode, JsVar *headers) {
   serverResponseWriteHead(parent, statusCode, headers);
 }
 
+/*JSON{
+  "type" : "method",
+  "class" : "httpSRs",
+  "name" : "sendFlash",
+  "generate" : "jswrap_httpSRs_sendFlash",
+  "params" : [
+    ["addr","int","The address in flash memory to start sending from"],
+    ["length","int","The number of bytes to send"],
+    ["mimeType","JsVar","(optional) The Content-Type header to send, eg. `\"text/html\"`"],
+    ["encoding","JsVar","(optional) If the data is already compressed, how - eg. `\"gzip\"`"]
+  ]
+}
+Send data straight from flash memory and end the response. The data is read a
+chunk at a time as it can be sent, so it never has to fit in RAM.
+
+If `writeHead` hasn't been called, a `200` response is sent with `Content-Type`
+and `Content-Length` headers.
+
+If `encoding` is given, the data is sent as-is with a `Content-Encoding` header,
+so pre-compressed pages can be stored in flash. If the client's `Accept-Encoding`
+header doesn't allow it, a `406` response is sent instead - use
+`req.acceptsEncoding` first if you have an uncompressed version to fall back to.
+*/
+void jswrap_httpSRs_sendFlash(JsVar *parent, int addr, int length, JsVar *mimeType, JsVar *encoding) {
+  JsVar *source = jsvNewObject();
+  if (!source) return;
+  jsvObjectSetChildAndUnLock(source, "addr", jsvNewFromInteger(addr));
+  jsvObjectSetChildAndUnLock(source, "len", jsvNewFromInteger(length));
+  serverResponseSendSource(parent, source, mimeType, length, encoding);
+  jsvUnLock(source);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "httpSRs",
+  "name" : "json",
+  "generate" : "jswrap_httpSRs_json",
+  "params" : [
+    ["data","JsVar","The data to send as JSON"]
+  ]
+}
+Send `data` converted to JSON and end the response. The JSON is generated a
+chunk at a time as it can be sent, so big objects never have to exist as one
+string in RAM. It's regenerated for each chunk though, so this is slower than
+`res.end(JSON.stringify(data))`, and `data` shouldn't be modified until the
+response has been sent.
+
+If `writeHead` hasn't been called, a `200` response is sent with
+`Content-Type: application/json` and `Content-Length` headers.
+*/
+void jswrap_httpSRs_json(JsVar *parent, JsVar *data) {
+  JsVar *source = jsvNewObject();
+  if (!source) return;
+  // work out the length first so the connection can be kept alive
+  int length = (int)jsfGetJSONSlice(data, JSON_IGNORE_FUNCTIONS|JSON_NO_UNDEFINED, 0, 0, 0);
+  jsvObjectSetChild(source, "json", data);
+  jsvObjectSetChildAndUnLock(source, "pos", jsvNewFromInteger(0));
+  jsvObjectSetChildAndUnLock(source, "len", jsvNewFromInteger(length));
+  JsVar *mimeType = jsvNewFromString("application/json");
+  serverResponseSendSource(parent, source, mimeType, length, 0);
+  jsvUnLock2(mimeType, source);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "httpSRs",
+  "name" : "sendFile",
+  "ifdef" : "USE_FILESYSTEM",
+  "generate" : "jswrap_httpSRs_sendFile",
+  "params" : [
+    ["path","JsVar","The path of the file to send"],
+    ["mimeType","JsVar","(optional) The Content-Type header to send, eg. `\"text/html\"`"],
+    ["encoding","JsVar","(optional) If the file is already compressed, how - eg. `\"gzip\"`"]
+  ]
+}
+Send a file and end the response. The file is read a chunk at a time as it can
+be sent, so it never has to fit in RAM.
+
+If `writeHead` hasn't been called, a `200` response is sent with a `Content-Type`
+header. `encoding` works as it does for `sendFlash`.
+*/
+void jswrap_httpSRs_sendFile(JsVar *parent, JsVar *path, JsVar *mimeType, JsVar *encoding) {
+#ifdef USE_FILESYSTEM
+  JsVar *mode = jsvNewFromString("r");
+  JsVar *file = jswrap_E_openFile(path, mode);
+  jsvUnLock(mode);
+  if (!file) return; // error already reported
+  serverResponseSendSource(parent, file, mimeType, -1, encoding);
+  jsvUnLock(file);
+#endif
+}
+
 // ---------------------------------------------------------------------------------
 // ---------------------------------------------------------------------------------
 // ---------------------------------------------------------------------------------
@@ -434,4 +721,90 @@ Finish this HTTP request - optional data to append as an argument
 */
 // Re-use existing
 
+// ---------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------
+/*JSON{
+  "type" : "class",
+  "library" : "http",
+  "class" : "WebSocket",
+  "ifdef" : "USE_CRYPTO"
+}
+A WebSocket, created by `http.connectWebSocket` or passed to a server's `websocket` event
+*/
+/*JSON{
+  "type" : "event",
+  "class" : "WebSocket",
+  "name" : "open",
+  "ifdef" : "USE_CRYPTO"
+}
+Called when a WebSocket we connected has completed its handshake and is ready to use
+*/
+/*JSON{
+  "type" : "event",
+  "class" : "WebSocket",
+  "name" : "message",
+  "ifdef" : "USE_CRYPTO",
+  "params" : [
+    ["message","JsVar","A string containing the whole of the message"]
+  ]
+}
+Called when a message is received. Messages that were split into several frames are
+joined back together first.
+*/
+/*JSON{
+  "type" : "event",
+  "class" : "WebSocket",
+  "name" : "close",
+  "ifdef" : "USE_CRYPTO",
+  "params" : [
+    ["had_error","JsVar","A boolean indicating whether the connection had an error (use an error event handler to get error details)."]
+  ]
+}
+Called when the connection closes.
+*/
+/*JSON{
+  "type" : "event",
+  "class" : "WebSocket",
+  "name" : "error",
+  "ifdef" : "USE_CRYPTO",
+  "params" : [
+    ["details","JsVar","An error object with an error code (a negative integer) and a message."]
+  ]
+}
+There was an error on this WebSocket - for instance the handshake failed or the other end sent an
+invalid frame. A close event will follow.
+*/
+/*JSON{
+  "type" : "method",
+  "class" : "WebSocket",
+  "name" : "send",
+  "ifdef" : "USE_CRYPTO",
+  "generate" : "jswrap_webSocket_send",
+  "params" : [
+    ["data","JsVar","A string containing the message to send"]
+  ]
+}
+Send a message
+*/
+void jswrap_webSocket_send(JsVar *parent, JsVar *data) {
+#ifdef USE_CRYPTO
+  webSocketSend(parent, data);
+#endif
+}
 
+/*JSON{
+  "type" : "method",
+  "class" : "WebSocket",
+  "name" : "close",
+  "ifdef" : "USE_CRYPTO",
+  "generate" : "jswrap_webSocket_close"
+}
+Close the WebSocket
+*/
+void jswrap_webSocket_close(JsVar *parent) {
+#ifdef USE_CRYPTO
+  webSocketClose(parent);
+#endif
+}
@@ -14,6 +14,7 @@
 #include "jsvar.h"
 
 JsVar *jswrap_http_createServer(JsVar *callback);
+JsVar *jswrap_httpSrv_route(JsVar *parent, JsVar *method, JsVar *path, JsVar *handler);
 
 JsVar *jswrap_http_request(JsVar *options, JsVar *callback);
 JsVar *jswrap_http_get(JsVar *options, JsVar *callback);
@@ -21,6 +22,17 @@ JsVar *jswrap_http_get(JsVar *options, JsVar *callback);
 void jswrap_httpSRs_writeHead(JsVar *parent, int statusCode, JsVar *headers);
 bool jswrap_httpSRs_write(JsVar *parent, JsVar *data);
 void jswrap_httpSRs_end(JsVar *parent, JsVar *data);
+void jswrap_httpSRs_sendFlash(JsVar *parent, int addr, int length, JsVar *mimeType, JsVar *encoding);
+void jswrap_httpSRs_json(JsVar *parent, JsVar *data);
+void jswrap_httpSRs_sendFile(JsVar *parent, JsVar *path, JsVar *mimeType, JsVar *encoding);
+
+bool jswrap_httpSRq_acceptsEncoding(JsVar *parent, JsVar *encoding);
+JsVar *jswrap_httpSRq_path(JsVar *parent);
+JsVar *jswrap_httpSRq_query(JsVar *parent);
+
+JsVar *jswrap_http_connectWebSocket(JsVar *options, JsVar *callback);
+void jswrap_webSocket_send(JsVar *parent, JsVar *data);
+void jswrap_webSocket_close(JsVar *parent);
 
 bool jswrap_httpCRq_write(JsVar *parent, JsVar *data);
 void jswrap_httpCRq_end(JsVar *parent, JsVar *data);
@@ -67,6 +67,27 @@ require("NetworkJS").create({
   }
 });
 ```
+
+Calling `recv` and `send` for every socket on every idle pass can be slow,
+so a driver can instead handle all sockets at once by providing `sendAll`
+in place of `send` and `recv`:
+
+```
+require("NetworkJS").create({
+  create : ..., close : ..., accept : ...,
+  sendAll : function(data) {
+    // Called at most once per idle pass, only when there's something to send.
+    // data is an object mapping socket number to the String to send on it,
+    // eg. {1:"GET / HTTP/1.0\r\n\r\n"}. Optionally return an object of the
+    // same form containing data that couldn't be sent yet, and it'll be passed
+    // to sendAll again next time.
+  }
+});
+// ...then whenever the device gives us data for a socket:
+require("NetworkJS").receive(sckt, data);
+// ...or when the socket is closed:
+require("NetworkJS").receive(sckt);
+```
 */
 JsVar *jswrap_networkjs_create(JsVar *obj) {
   JsNetwork net;
@@ -79,3 +100,24 @@ JsVar *jswrap_networkjs_create(JsVar *obj) {
   networkState = NETWORKSTATE_ONLINE;
   return jsvLockAgain(obj);
 }
+
+/*JSON{
+  "type" : "staticmethod",
+  "class" : "NetworkJS",
+  "name" : "receive",
+  "generate" : "jswrap_networkjs_receive",
+  "params" : [
+    ["sckt","int","The socket number the data was received on"],
+    ["data","JsVar","The data received (a String or ArrayBuffer), or `undefined` if the socket has been closed"]
+  ],
+  "return" : ["int","The number of bytes now waiting to be read from the socket"]
+}
+For drivers created with a `sendAll` function (see `NetworkJS.create`), pass
+data that has been received on a socket back to Espruino. It is stored until
+the socket reads it, so no JS function has to be called to get it.
+*/
+int jswrap_networkjs_receive(int sckt, JsVar *data) {
+  int r = net_js_receive(sckt, data);
+  if (r<0) jsExceptionHere(JSET_ERROR, "NetworkJS driver doesn't have a sendAll function");
+  return r;
+}
@@ -14,3 +14,4 @@
 #include "jsvar.h"
 
 JsVar *jswrap_networkjs_create(JsVar *obj);
+int jswrap_networkjs_receive(int sckt, JsVar *data);
@@ -18,10 +18,27 @@
 
 #define JSNET_NAME "JSN"
 #define JSNET_DNS_NAME "DNS"
+// For batched drivers (that have a 'sendAll' function):
+#define JSNET_RX_NAME "JSNrx" // socket -> String of data that JS has pushed with NetworkJS.receive
+#define JSNET_TX_NAME "JSNtx" // socket -> String of data waiting for the next sendAll call
+#define JSNET_CLOSED_NAME "JSNcl" // socket -> true if JS has said it was closed
+#define JSNET_BATCH_FN "sendAll"
+#define JSNET_TX_CHUNKS 2 // how many chunks of data may be queued for each socket before send says it's busy
 
 // Set the built-in object for network access
 void net_js_setObj(JsVar *obj) {
   jsvObjectSetChild(execInfo.hiddenRoot, JSNET_NAME, obj);
+  JsVar *sendAll = jspGetNamedField(obj, JSNET_BATCH_FN, false);
+  if (jsvIsFunction(sendAll)) {
+    jsvObjectSetChildAndUnLock(execInfo.hiddenRoot, JSNET_RX_NAME, jsvNewObject());
+    jsvObjectSetChildAndUnLock(execInfo.hiddenRoot, JSNET_TX_NAME, jsvNewObject());
+    jsvObjectSetChildAndUnLock(execInfo.hiddenRoot, JSNET_CLOSED_NAME, jsvNewObject());
+  } else {
+    jsvRemoveNamedChild(execInfo.hiddenRoot, JSNET_RX_NAME);
+    jsvRemoveNamedChild(execInfo.hiddenRoot, JSNET_TX_NAME);
+    jsvRemoveNamedChild(execInfo.hiddenRoot, JSNET_CLOSED_NAME);
+  }
+  jsvUnLock(sendAll);
 }
 
 /// Call the named function on the object - whether it's built in, or predefined. Returns the return value of the function.
@@ -40,6 +57,108 @@ JsVar *callFn(char* name, int argCount, JsVar **argPtr) {
   return r;
 }
 
+/// Find the name of the entry for the socket in the given hiddenRoot object (or 0). Returns a LOCKED var
+static JsVar *net_js_findSocket(const char *objName, int sckt, bool create) {
+  JsVar *obj = jsvObjectGetChild(execInfo.hiddenRoot, objName, 0);
+  if (!obj) return 0;
+  JsVar *key = jsvNewFromInteger(sckt);
+  JsVar *name = key ? jsvFindChildFromVar(obj, key, create) : 0;
+  jsvUnLock2(key, obj);
+  return name;
+}
+
+/// Remove the entry for the socket from the given hiddenRoot object
+static void net_js_removeSocket(const char *objName, int sckt) {
+  JsVar *obj = jsvObjectGetChild(execInfo.hiddenRoot, objName, 0);
+  JsVar *key = jsvNewFromInteger(sckt);
+  JsVar *name = (obj && key) ? jsvFindChildFromVar(obj, key, false) : 0;
+  if (name) jsvRemoveChild(obj, name);
+  jsvUnLock3(name, key, obj);
+}
+
+/// Is the driver batched (has a sendAll function)?
+static bool net_js_isBatched() {
+  JsVar *tx = jsvObjectGetChild(execInfo.hiddenRoot, JSNET_TX_NAME, 0);
+  jsvUnLock(tx);
+  return tx!=0;
+}
+
+static void net_js_receive_cb(const unsigned char *data, size_t len, void *userData) {
+  jsvAppendStringBuf((JsVar*)userData, (const char*)data, len);
+}
+
+/// Data received by a batched driver (or undefined if the socket closed). Returns the number of bytes waiting, or -1
+int net_js_receive(int sckt, JsVar *data) {
+  if (!net_js_isBatched()) return -1;
+  networkSetSocketReady(sckt);
+  if (jsvIsUndefined(data) || jsvIsNull(data)) {
+    JsVar *name = net_js_findSocket(JSNET_CLOSED_NAME, sckt, true);
+    JsVar *t = jsvNewFromBool(true);
+    if (name) jsvSetValueOfName(name, t);
+    jsvUnLock2(t, name);
+  }
+  JsVar *name = net_js_findSocket(JSNET_RX_NAME, sckt, true);
+  if (!name) return -1;
+  JsVar *buf = jsvSkipName(name);
+  if (!buf) {
+    buf = jsvNewFromEmptyString();
+    jsvSetValueOfName(name, buf);
+  }
+  if (buf && jsvIsIterable(data))
+    jsvIterateBufferCallback(data, net_js_receive_cb, buf);
+  int r = buf ? (int)jsvGetStringLength(buf) : -1;
+  jsvUnLock2(buf, name);
+  return r;
+}
+
+/// Pass all the data waiting to be sent to the JS driver's sendAll function
+static void net_js_sendAll() {
+  JsVar *tx = jsvObjectGetChild(execInfo.hiddenRoot, JSNET_TX_NAME, 0);
+  if (!tx || !jsvGetFirstChild(tx)) {
+    jsvUnLock(tx);
+    return;
+  }
+  JsVar *newTx = jsvNewObject();
+  if (!newTx) {
+    jsvUnLock(tx);
+    return;
+  }
+  // swap in a new queue first, so JS can keep the object it's given
+  jsvObjectSetChild(execInfo.hiddenRoot, JSNET_TX_NAME, newTx);
+  JsVar *unsent = callFn(JSNET_BATCH_FN, 1, &tx);
+  if (jsvIsObject(unsent)) {
+    // anything JS couldn't send yet goes at the front of the queue
+    JsvObjectIterator it;
+    jsvObjectIteratorNew(&it, unsent);
+    while (jsvObjectIteratorHasValue(&it)) {
+      JsVar *key = jsvObjectIteratorGetKey(&it);
+      JsVar *data = jsvObjectIteratorGetValue(&it);
+      JsVar *name = jsvFindChildFromVar(newTx, key, true);
+      JsVar *queued = name ? jsvSkipName(name) : 0;
+      if (name && jsvIsString(data)) {
+        JsVar *str = jsvNewFromStringVar(data, 0, JSVAPPENDSTRINGVAR_MAXLENGTH);
+        if (str && queued) jsvAppendStringVarComplete(str, queued);
+        jsvSetValueOfName(name, str);
+        jsvUnLock(str);
+      }
+      jsvUnLock3(queued, name, data);
+      jsvUnLock(key);
+      jsvObjectIteratorNext(&it);
+    }
+    jsvObjectIteratorFree(&it);
+  }
+  jsvUnLock(unsent);
+  // The sockets we sent on can accept more data now
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, tx);
+  while (jsvObjectIteratorHasValue(&it)) {
+    networkSetSocketReady((int)jsvGetIntegerAndUnLock(jsvObjectIteratorGetKey(&it)));
+    jsvObjectIteratorNext(&it);
+  }
+  jsvObjectIteratorFree(&it);
+  jsvUnLock2(newTx, tx);
+}
+
 // ------------------------------------------------------------------------------------------------------------------------
 
 /// Get an IP address from a name. Sets out_ip_addr to 0 on failure
@@ -58,6 +177,7 @@ void net_js_idle(JsNetwork *net) {
 /// Call just before returning to idle loop. This checks for errors and tries to recover. Returns true if no errors.
 bool net_js_checkError(JsNetwork *net) {
   NOT_USED(net);
+  net_js_sendAll();
   return true;
 }
 
@@ -80,12 +200,24 @@ int net_js_createsocket(JsNetwork *net, uint32_t host, unsigned short port) {
   };
   int sckt = jsvGetIntegerAndUnLock(callFn("create", 2, args));
   jsvUnLockMany(2, args);
+  if (sckt>=0 && net_js_isBatched()) {
+    // the driver may reuse socket numbers - make sure nothing is left over
+    net_js_removeSocket(JSNET_RX_NAME, sckt);
+    net_js_removeSocket(JSNET_TX_NAME, sckt);
+    net_js_removeSocket(JSNET_CLOSED_NAME, sckt);
+  }
   return sckt;
 }
 
 /// destroys the given socket
 void net_js_closesocket(JsNetwork *net, int sckt) {
   NOT_USED(net);
+  if (net_js_isBatched()) {
+    // send anything that's left before the socket goes
+    net_js_sendAll();
+    net_js_removeSocket(JSNET_RX_NAME, sckt);
+    net_js_removeSocket(JSNET_CLOSED_NAME, sckt);
+  }
   JsVar *args[1] = {
       jsvNewFromInteger(sckt)
   };
@@ -105,9 +237,58 @@ int net_js_accept(JsNetwork *net, int serverSckt) {
   return sckt;
 }
 
+/// Batched drivers: take up to len bytes of the data JS has pushed for this socket. returns nBytes on success, 0 on no data, or -1 on failure
+int net_js_recvVar(JsNetwork *net, int sckt, JsVar **data, size_t len) {
+  NOT_USED(net);
+  int r = 0;
+  JsVar *name = net_js_findSocket(JSNET_RX_NAME, sckt, false);
+  JsVar *buf = name ? jsvSkipName(name) : 0;
+  size_t l = buf ? jsvGetStringLength(buf) : 0;
+  if (l > len) {
+    *data = jsvNewFromStringVar(buf, 0, len);
+    JsVar *rest = jsvNewFromStringVar(buf, len, JSVAPPENDSTRINGVAR_MAXLENGTH);
+    jsvSetValueOfName(name, rest);
+    jsvUnLock(rest);
+    networkSetSocketReady(sckt); // there's more to read
+    r = (int)len;
+  } else if (l > 0) {
+    *data = jsvLockAgain(buf);
+    jsvSetValueOfName(name, 0);
+    r = (int)l;
+    JsVar *closed = net_js_findSocket(JSNET_CLOSED_NAME, sckt, false);
+    if (closed) networkSetSocketReady(sckt); // report the close next time
+    jsvUnLock(closed);
+  } else {
+    JsVar *closed = net_js_findSocket(JSNET_CLOSED_NAME, sckt, false);
+    if (closed) {
+      net_js_removeSocket(JSNET_CLOSED_NAME, sckt);
+      r = -1;
+    }
+    jsvUnLock(closed);
+  }
+  jsvUnLock2(buf, name);
+  return r;
+}
+
 /// Receive data if possible. returns nBytes on success, 0 on no data, or -1 on failure
 int net_js_recv(JsNetwork *net, int sckt, void *buf, size_t len) {
   NOT_USED(net);
+  if (net_js_isBatched()) {
+    JsVar *data = 0;
+    int r = net_js_recvVar(net, sckt, &data, len);
+    if (data) {
+      JsvStringIterator it;
+      jsvStringIteratorNew(&it, data, 0);
+      char *p = (char*)buf;
+      while (jsvStringIteratorHasChar(&it)) {
+        *(p++) = jsvStringIteratorGetChar(&it);
+        jsvStringIteratorNext(&it);
+      }
+      jsvStringIteratorFree(&it);
+      jsvUnLock(data);
+    }
+    return r;
+  }
   JsVar *args[2] = {
       jsvNewFromInteger(sckt),
       jsvNewFromInteger((JsVarInt)len),
@@ -127,7 +308,23 @@ int net_js_recv(JsNetwork *net, int sckt, void *buf, size_t len) {
 
 /// Send data if possible. returns nBytes on success, 0 on no data, or -1 on failure
 int net_js_send(JsNetwork *net, int sckt, const void *buf, size_t len) {
-  NOT_USED(net);
+  if (net_js_isBatched()) {
+    // queue it up for the next sendAll call
+    JsVar *name = net_js_findSocket(JSNET_TX_NAME, sckt, true);
+    JsVar *queued = name ? jsvSkipName(name) : 0;
+    if (!queued) {
+      queued = jsvNewFromEmptyString();
+      if (name) jsvSetValueOfName(name, queued);
+    }
+    int r = 0;
+    if (!name || !queued) r = -1;
+    else if (jsvGetStringLength(queued) < (size_t)net->chunkSize*JSNET_TX_CHUNKS) {
+      jsvAppendStringBuf(queued, buf, len);
+      r = (int)len;
+    } // else full - try again after sendAll
+    jsvUnLock2(queued, name);
+    return r;
+  }
   JsVar *args[2] = {
       jsvNewFromInteger(sckt),
       jsvNewFromEmptyString()
@@ -150,5 +347,9 @@ void netSetCallbacks_js(JsNetwork *net) {
   net->recv = net_js_recv;
   net->send = net_js_send;
   net->chunkSize = 536;
+  if (net_js_isBatched()) {
+    net->recvVar = net_js_recvVar;
+    net->reportsReady = true; // net_js_receive says when there's data
+  }
 }
 
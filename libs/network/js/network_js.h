@@ -16,4 +16,7 @@
 // Set the built-in object for network access
 void net_js_setObj(JsVar *obj);
 
+/// Data received by a batched driver (or undefined if the socket closed). Returns the number of bytes waiting, or -1
+int net_js_receive(int sckt, JsVar *data);
+
 void netSetCallbacks_js(JsNetwork *net);
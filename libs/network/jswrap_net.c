@@ -17,6 +17,9 @@
 #include "jsvariterator.h"
 #include "socketserver.h"
 #include "network.h"
+#ifdef LINUX
+#include "network_linux.h"
+#endif
 
 /*JSON{
   "type" : "idle",
@@ -27,6 +30,11 @@ bool jswrap_net_idle() {
   if (!networkGetFromVar(&net)) return false;
   net.idle(&net);
   bool b = socketIdle(&net);
+#ifdef LINUX
+  // Open sockets with nothing to do don't need to keep us busy - jshSleep waits on them
+  if (net.data.type == JSNETWORKTYPE_SOCKET && !net_linux_isBusy())
+    b = false;
+#endif
   networkFree(&net);
   return b;
 }
@@ -45,6 +53,10 @@ void jswrap_net_init() {
 }*/
 void jswrap_net_kill() {
   JsNetwork net;
+  networkDNSCacheClear();
+#ifdef USE_TLS
+  netClearTLSSessions();
+#endif
   if (networkWasCreated()) {
     if (!networkGetFromVar(&net)) return;
     socketKill(&net);
@@ -83,6 +95,56 @@ This is useful in web servers for instance when handling a request.
 
 For instance `url.parse("/a?b=c&d=e",true)` returns `{"method":"GET","host":"","path":"/a?b=c&d=e","pathname":"/a","search":"?b=c&d=e","port":80,"query":{"b":"c","d":"e"}}`
 */
+/// Parse a query string like "a=b&c=d" (from index 'start') into a new object of keys and values
+JsVar *jswrap_url_parseQuery(JsVar *queryStr, size_t start) {
+  JsVar *query = jsvNewObject();
+  if (!query) return 0; // out of memory
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, queryStr, start);
+
+  JsVar *key = jsvNewFromEmptyString();
+  JsVar *val = jsvNewFromEmptyString();
+  bool hadEquals = false;
+
+  while (jsvStringIteratorHasChar(&it)) {
+    char ch = jsvStringIteratorGetChar(&it);
+    if (ch=='&') {
+      if (jsvGetStringLength(key)>0 || jsvGetStringLength(val)>0) {
+        key = jsvAsArrayIndexAndUnLock(key); // make sure "0" gets made into 0
+        key = jsvMakeIntoVariableName(key, val);
+        jsvAddName(query, key);
+        jsvUnLock2(key, val);
+        key = jsvNewFromEmptyString();
+        val = jsvNewFromEmptyString();
+        hadEquals = false;
+      }
+    } else if (!hadEquals && ch=='=') {
+      hadEquals = true;
+    } else {
+      // decode percent escape chars
+      if (ch=='%') {
+        jsvStringIteratorNext(&it);
+        ch = jsvStringIteratorGetChar(&it);
+        jsvStringIteratorNext(&it);
+        ch = (char)((chtod(ch)<<4) | chtod(jsvStringIteratorGetChar(&it)));
+      }
+
+      if (hadEquals) jsvAppendCharacter(val, ch);
+      else jsvAppendCharacter(key, ch);
+    }
+    jsvStringIteratorNext(&it);
+  }
+  jsvStringIteratorFree(&it);
+
+  if (jsvGetStringLength(key)>0 || jsvGetStringLength(val)>0) {
+    key = jsvAsArrayIndexAndUnLock(key); // make sure "0" gets made into 0
+    key = jsvMakeIntoVariableName(key, val);
+    jsvAddName(query, key);
+  }
+  jsvUnLock2(key, val);
+  return query;
+}
+
 JsVar *jswrap_url_parse(JsVar *url, bool parseQuery) {
   if (!jsvIsString(url)) return 0;
   JsVar *obj = jsvNewObject();
@@ -152,55 +214,10 @@ JsVar *jswrap_url_parse(JsVar *url, bool parseQuery) {
 
   jsvObjectSetChildAndUnLock(obj, "port", (portNumber<=0 || portNumber>65535) ? jsvNewWithFlags(JSV_NULL) : jsvNewFromInteger(portNumber));
 
-  JsVar *query = (searchStart>=0)?jsvNewFromStringVar(url, (size_t)(searchStart+1), JSVAPPENDSTRINGVAR_MAXLENGTH):jsvNewNull();
-  if (parseQuery && !jsvIsNull(query)) {
-    JsVar *queryStr = query;
-    jsvStringIteratorNew(&it, query, 0);
-    query = jsvNewObject();
-
-    JsVar *key = jsvNewFromEmptyString();
-    JsVar *val = jsvNewFromEmptyString();
-    bool hadEquals = false;
-
-    while (jsvStringIteratorHasChar(&it)) {
-      char ch = jsvStringIteratorGetChar(&it);
-      if (ch=='&') {
-        if (jsvGetStringLength(key)>0 || jsvGetStringLength(val)>0) {
-          key = jsvAsArrayIndexAndUnLock(key); // make sure "0" gets made into 0
-          jsvMakeIntoVariableName(key, val);
-          jsvAddName(query, key);
-          jsvUnLock2(key, val);
-          key = jsvNewFromEmptyString();
-          val = jsvNewFromEmptyString();
-          hadEquals = false;
-        }
-      } else if (!hadEquals && ch=='=') {
-        hadEquals = true;
-      } else {
-        // decode percent escape chars
-        if (ch=='%') {
-          jsvStringIteratorNext(&it);
-          ch = jsvStringIteratorGetChar(&it);
-          jsvStringIteratorNext(&it);
-          ch = (char)((chtod(ch)<<4) | chtod(jsvStringIteratorGetChar(&it)));
-        }
-
-        if (hadEquals) jsvAppendCharacter(val, ch);
-        else jsvAppendCharacter(key, ch);
-      }
-      jsvStringIteratorNext(&it);
-      charIdx++;
-    }
-    jsvStringIteratorFree(&it);
-    jsvUnLock(queryStr);
-
-    if (jsvGetStringLength(key)>0 || jsvGetStringLength(val)>0) {
-      key = jsvAsArrayIndexAndUnLock(key); // make sure "0" gets made into 0
-      jsvMakeIntoVariableName(key, val);
-      jsvAddName(query, key);
-    }
-    jsvUnLock2(key, val);
-  }
+  JsVar *query;
+  if (searchStart<0) query = jsvNewNull();
+  else if (parseQuery) query = jswrap_url_parseQuery(url, (size_t)(searchStart+1));
+  else query = jsvNewFromStringVar(url, (size_t)(searchStart+1), JSVAPPENDSTRINGVAR_MAXLENGTH);
   jsvObjectSetChildAndUnLock(obj, "query", query);
 
   return obj;
@@ -362,6 +379,25 @@ JsVar *jswrap_net_createServer(JsVar *callback) {
 
 
 
+/*JSON{
+  "type" : "staticmethod",
+  "class" : "net",
+  "name" : "setRecvWindow",
+  "generate" : "jswrap_net_setRecvWindow",
+  "params" : [
+    ["bytes","int","The number of bytes"]
+  ]
+}
+Set the default for how much received data can be queued up for each new
+socket before the network stops accepting more (see `Socket.setRecvWindow`)
+*/
+void jswrap_net_setRecvWindow(int bytes) {
+  JsNetwork net;
+  if (!networkGetFromVar(&net)) return;
+  netSetRecvWindow(&net, -1, bytes);
+  networkFree(&net);
+}
+
 /*JSON{
   "type" : "staticmethod",
   "class" : "net",
@@ -387,9 +423,9 @@ JsVar *jswrap_net_connect(JsVar *options, JsVar *callback, SocketType socketType
     return 0;
   }
 #ifdef USE_TLS
-  if ((socketType&ST_TYPE_MASK) == ST_HTTP) {
+  if ((socketType&ST_TYPE_MASK) != ST_NORMAL) {
     JsVar *protocol = jsvObjectGetChild(options, "protocol", 0);
-    if (protocol && jsvIsStringEqual(protocol, "https:")) {
+    if (protocol && (jsvIsStringEqual(protocol, "https:") || jsvIsStringEqual(protocol, "wss:") || jsvIsStringEqual(protocol, "mqtts:"))) {
       socketType |= ST_TLS;
     }
     jsvUnLock(protocol);
@@ -465,6 +501,10 @@ You can also:
 * Just specify the filename (<=100 characters) and it will be loaded and parsed if you have an SD card connected. For instance `options.key = "key.pem";`
 * Specify a function, which will be called to retrieve the data.  For instance `options.key = function() { eeprom.load_my_info(); };
 
+Instead of certificates you can use a pre-shared key by specifying `psk` (the raw key) and `pskIdentity`.
+
+The session is remembered for the last few servers connected to (by `host` and `port`), so the next connection to the same server can resume it rather than doing the whole key exchange again. Sessions are forgotten on `reset()` and `save()`.
+
 For more information about generating and using certificates, see:
 
 https://engineering.circle.com/https-authorized-certs-with-node-js/
@@ -475,6 +515,163 @@ https://engineering.circle.com/https-authorized-certs-with-node-js/
 // ---------------------------------------------------------------------------------
 // ---------------------------------------------------------------------------------
 
+/*JSON{
+  "type" : "library",
+  "class" : "dgram"
+}
+This library allows you to send and receive UDP datagrams
+
+This is designed to be a cut-down version of the [node.js library](http://nodejs.org/api/dgram.html).
+Only IPv4 is supported, and currently only the ESP8266 and Linux builds have UDP support.
+
+```
+var s = require("dgram").createSocket("udp4", function(msg, rinfo) {
+  print(rinfo.address+":"+rinfo.port+" sent "+JSON.stringify(msg));
+});
+s.bind(1234);
+s.send("Hello", 1234, "192.168.1.255");
+```
+*/
+/*JSON{
+  "type" : "class",
+  "library" : "dgram",
+  "class" : "dgramSocket"
+}
+A UDP socket, created by `require('dgram').createSocket`
+*/
+/*JSON{
+  "type" : "event",
+  "class" : "dgramSocket",
+  "name" : "message",
+  "params" : [
+    ["msg","JsVar","A string containing the data in the datagram"],
+    ["rinfo","JsVar","An object `{address, family, port, size}` describing where the datagram came from"]
+  ]
+}
+Called for each datagram received. All the datagrams the network has queued up
+are received together, so a burst of them doesn't need a trip round the idle loop each.
+
+Datagrams bigger than the network's chunk size (536 bytes on Linux, between 268
+and 1460 bytes on ESP8266 depending on free memory) are truncated.
+*/
+/*JSON{
+  "type" : "event",
+  "class" : "dgramSocket",
+  "name" : "listening"
+}
+Called when the socket has been bound to a port and can receive datagrams
+*/
+/*JSON{
+  "type" : "event",
+  "class" : "dgramSocket",
+  "name" : "close"
+}
+Called when the socket has closed
+*/
+/*JSON{
+  "type" : "event",
+  "class" : "dgramSocket",
+  "name" : "error",
+  "params" : [
+    ["details","JsVar","An error object with an error code (a negative integer) and a message."]
+  ]
+}
+There was an error on this socket and it is closing. See `Socket`'s error event for the error codes.
+*/
+
+/*JSON{
+  "type" : "staticmethod",
+  "class" : "dgram",
+  "name" : "createSocket",
+  "generate" : "jswrap_dgram_createSocket",
+  "params" : [
+    ["type","JsVar","The type of socket - `'udp4'`, or an object `{type:'udp4'}`"],
+    ["callback","JsVar","An optional `function(msg, rinfo)` that will be called when a datagram is received"]
+  ],
+  "return" : ["JsVar","Returns a new dgramSocket object"],
+  "return_object" : "dgramSocket"
+}
+Create a UDP socket. Call `bind` on it to receive datagrams sent to a port.
+*/
+JsVar *jswrap_dgram_createSocket(JsVar *type, JsVar *callback) {
+  JsVar *typeStr = jsvIsObject(type) ? jsvObjectGetChild(type, "type", 0) : jsvLockAgainSafe(type);
+  bool isUdp4 = jsvIsString(typeStr) && jsvIsStringEqual(typeStr, "udp4");
+  if (!isUdp4) jsError("Only 'udp4' sockets are supported, got %q", typeStr);
+  jsvUnLock(typeStr);
+  if (!isUdp4) return 0;
+  if (!jsvIsUndefined(callback) && !jsvIsFunction(callback)) {
+    jsError("Expecting Callback Function but got %t", callback);
+    return 0;
+  }
+  return dgramSocketNew(callback);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "dgramSocket",
+  "name" : "bind",
+  "generate" : "jswrap_dgram_socket_bind",
+  "params" : [
+    ["port","int32","The port to receive datagrams on (or 0 for any port)"],
+    ["callback","JsVar","An optional function to call when the socket is listening"]
+  ],
+  "return" : ["JsVar","The dgramSocket"]
+}
+Start receiving datagrams sent to the given port
+*/
+JsVar *jswrap_dgram_socket_bind(JsVar *parent, int port, JsVar *callback) {
+  JsNetwork net;
+  if (!networkGetFromVarIfOnline(&net)) return 0;
+
+  if (jsvIsFunction(callback))
+    jsvObjectSetChild(parent, JS_EVENT_PREFIX"listening", callback);
+  dgramSocketBind(&net, parent, port);
+  networkFree(&net);
+  return jsvLockAgain(parent);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "dgramSocket",
+  "name" : "send",
+  "generate" : "jswrap_dgram_socket_send",
+  "params" : [
+    ["msg","JsVar","A string containing the data to send"],
+    ["port","int32","The port to send to"],
+    ["address","JsVar","The IP address to send to, as a string (eg. `'192.168.1.10'`)"]
+  ]
+}
+Send a datagram. If the socket isn't bound yet, it is bound to any port first.
+*/
+void jswrap_dgram_socket_send(JsVar *parent, JsVar *msg, int port, JsVar *address) {
+  JsNetwork net;
+  if (!networkGetFromVarIfOnline(&net)) return;
+
+  dgramSocketSend(&net, parent, msg, port, address);
+  networkFree(&net);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "dgramSocket",
+  "name" : "close",
+  "generate" : "jswrap_dgram_socket_close"
+}
+Close the socket, once any datagrams that are queued have been sent
+*/
+void jswrap_dgram_socket_close(JsVar *parent) {
+  JsNetwork net;
+  if (!networkGetFromVarIfOnline(&net)) return;
+
+  dgramSocketClose(&net, parent);
+  networkFree(&net);
+}
+
+// ---------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------
+
 /*JSON{
   "type" : "method",
   "class" : "Server",
@@ -534,6 +731,101 @@ bool jswrap_net_socket_write(JsVar *parent, JsVar *data) {
   return false;
 }
 
+/*JSON{
+  "type" : "method",
+  "class" : "Socket",
+  "name" : "setRecvWindow",
+  "generate" : "jswrap_net_socket_setRecvWindow",
+  "params" : [
+    ["bytes","int","The number of bytes"]
+  ]
+}
+Set how much received data can be queued up for this socket before the network
+stops accepting more. Larger values allow faster downloads over slow links, but
+use more memory. The default is set with `require("net").setRecvWindow`.
+
+This only has an effect on network drivers that support it (currently ESP8266).
+*/
+void jswrap_net_socket_setRecvWindow(JsVar *parent, int bytes) {
+  JsNetwork net;
+  if (!networkGetFromVarIfOnline(&net)) return;
+  clientRequestSetRecvWindow(&net, parent, bytes);
+  networkFree(&net);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "Socket",
+  "name" : "setNoDelay",
+  "generate" : "jswrap_net_socket_setNoDelay",
+  "params" : [
+    ["noDelay","JsVar","`true` (or undefined) to send data without delay, `false` to allow it to be batched up"]
+  ]
+}
+When `noDelay` is true, `write` tries to send data immediately rather than
+leaving it for the next time around the idle loop, and the network is asked not
+to wait before sending small packets (Nagle's algorithm is disabled). This
+reduces latency for small, interactive messages.
+
+`setNoDelay(false)` lets the network combine small packets, which is more
+efficient when sending lots of small writes. On ESP8266, Nagle's algorithm is
+disabled for all sockets unless this is called.
+*/
+void jswrap_net_socket_setNoDelay(JsVar *parent, JsVar *noDelay) {
+  JsNetwork net;
+  if (!networkGetFromVarIfOnline(&net)) return;
+  clientRequestSetNoDelay(&net, parent, jsvIsUndefined(noDelay) || jsvGetBool(noDelay));
+  networkFree(&net);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "Socket",
+  "name" : "setFraming",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_stream_setFraming",
+  "params" : [
+    ["options","JsVar","An object describing how to split up received data, or `undefined` to pass data on as it arrives. See `Serial.setFraming`"]
+  ]
+}
+Rather than calling `on('data', ...)` with whatever data has been received,
+collect data and call it once for each complete frame - for example
+`{delimiter:"\n"}` for line-based protocols, or `{lengthPrefix:"u16be"}` for
+length-prefixed messages. See `Serial.setFraming` for all the options.
+*/
+
+/*JSON{
+  "type" : "method",
+  "class" : "Socket",
+  "name" : "getStats",
+  "generate" : "jswrap_net_socket_getStats",
+  "return" : ["JsVar","An object of statistics, or undefined"]
+}
+Return statistics about this socket from the network driver, for tuning throughput. On ESP8266 this is:
+
+```
+{
+  bytesIn, bytesOut,       // bytes received and sent
+  segmentsIn, segmentsOut, // TCP segments (or UDP datagrams) received and sent
+  recvHolds, recvUnholds,  // times receiving was paused because the receive window was full, and resumed
+  txWait,                  // milliseconds spent waiting for the network to take data we sent
+  allocFails,              // buffers we couldn't allocate
+  rxDropped,               // UDP datagrams dropped because the receive window was full
+  rxQueued, rxQueuedMax    // bytes received but not yet read now, and at most
+}
+```
+
+This returns `undefined` if the socket isn't connected, or the network driver doesn't keep statistics.
+See `ESP8266.getNetStats` for the totals for all sockets.
+*/
+JsVar *jswrap_net_socket_getStats(JsVar *parent) {
+  JsNetwork net;
+  if (!networkGetFromVarIfOnline(&net)) return 0;
+  JsVar *stats = clientRequestGetStats(&net, parent);
+  networkFree(&net);
+  return stats;
+}
+
 /*JSON{
   "type" : "method",
   "class" : "Socket",
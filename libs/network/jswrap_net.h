@@ -19,14 +19,25 @@ void jswrap_net_init();
 void jswrap_net_kill();
 
 JsVar *jswrap_url_parse(JsVar *url, bool parseQuery);
+/// Parse a query string like "a=b&c=d" (from index 'start') into a new object of keys and values
+JsVar *jswrap_url_parseQuery(JsVar *queryStr, size_t start);
 
 JsVar *jswrap_net_createServer(JsVar *callback);
 JsVar *jswrap_net_connect(JsVar *options, JsVar *callback, SocketType socketType);
 
+JsVar *jswrap_dgram_createSocket(JsVar *type, JsVar *callback);
+JsVar *jswrap_dgram_socket_bind(JsVar *parent, int port, JsVar *callback);
+void jswrap_dgram_socket_send(JsVar *parent, JsVar *msg, int port, JsVar *address);
+void jswrap_dgram_socket_close(JsVar *parent);
+
 void jswrap_net_server_listen(JsVar *parent, int port);
 void jswrap_net_server_close(JsVar *parent);
 
 bool jswrap_net_socket_write(JsVar *parent, JsVar *data);
+void jswrap_net_setRecvWindow(int bytes);
+void jswrap_net_socket_setRecvWindow(JsVar *parent, int bytes);
+void jswrap_net_socket_setNoDelay(JsVar *parent, JsVar *noDelay);
+JsVar *jswrap_net_socket_getStats(JsVar *parent);
 void jswrap_net_socket_end(JsVar *parent, JsVar *data);
 
 
@@ -25,10 +25,11 @@
  #include <winsock.h>
 #else
  #include <sys/socket.h>
- #include <sys/select.h>
+ #include <poll.h>
  #include <arpa/inet.h>
  #include <netdb.h>
  #include <netinet/in.h>
+ #include <netinet/tcp.h>
  #include <unistd.h>
  #include <fcntl.h>
  #include <stdio.h>
@@ -39,6 +40,127 @@
 
  #define closesocket(SOCK) close(SOCK)
 
+#ifdef __linux__
+/* Sockets are registered with epoll, and net_linux_idle asks it which have anything waiting - so
+ * idle sockets cost nothing each time around the idle loop, and jshSleep can block until one is
+ * ready. Sockets with fds too big for netSocketFlags are just checked every time. */
+ #include <sys/epoll.h>
+ #define NET_LINUX_EPOLL
+ #define NET_LINUX_MAX_FD 4096
+ #define NET_LINUX_EPOLL_EVENTS 64
+typedef enum {
+  NLSF_WATCHED = 1, ///< Registered with epoll
+  NLSF_READY = 2,   ///< epoll said there was something to read/accept (or an error)
+  NLSF_UDP = 4,     ///< A UDP socket
+} PACKED_FLAGS NetLinuxSocketFlags;
+static INSTANCE_LOCAL int netEpollFd = -1;
+static INSTANCE_LOCAL int netEpollSockets = 0; ///< How many sockets are registered
+static INSTANCE_LOCAL NetLinuxSocketFlags netSocketFlags[NET_LINUX_MAX_FD];
+#endif
+static INSTANCE_LOCAL bool netLinuxBusy; ///< Did anything happen this time around the idle loop?
+#ifdef NET_LINUX_EPOLL
+static INSTANCE_LOCAL bool netLinuxRepoll; ///< We sent/closed something since we last asked epoll (a local socket may now be ready)
+#endif
+
+/// Make the socket non-blocking, and register it with epoll (if we can)
+static void net_linux_addSocket(int sckt, bool isUDP) {
+#ifndef WIN32
+  fcntl(sckt, F_SETFL, fcntl(sckt, F_GETFL, 0) | O_NONBLOCK);
+#endif
+#ifdef NET_LINUX_EPOLL
+  if (sckt >= NET_LINUX_MAX_FD) return;
+  if (netEpollFd < 0) netEpollFd = epoll_create1(EPOLL_CLOEXEC);
+  if (netEpollFd < 0) return;
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN | EPOLLRDHUP; // errors and hangups are always reported
+  ev.data.fd = sckt;
+  if (epoll_ctl(netEpollFd, EPOLL_CTL_ADD, sckt, &ev) == 0) {
+    // READY to start with, so anything that arrived before it was registered is seen
+    netSocketFlags[sckt] = NLSF_WATCHED | NLSF_READY | (isUDP ? NLSF_UDP : 0);
+    netEpollSockets++;
+  }
+#else
+  NOT_USED(isUDP);
+#endif
+}
+
+/// Stop watching a socket (call before closing it)
+static void net_linux_removeSocket(int sckt) {
+#ifdef NET_LINUX_EPOLL
+  if (sckt < 0 || sckt >= NET_LINUX_MAX_FD || !(netSocketFlags[sckt]&NLSF_WATCHED)) return;
+  epoll_ctl(netEpollFd, EPOLL_CTL_DEL, sckt, NULL);
+  netSocketFlags[sckt] = 0;
+  netEpollSockets--;
+#else
+  NOT_USED(sckt);
+#endif
+}
+
+/// Ask epoll which sockets are ready, waiting up to timeoutMs. Returns the number that were
+static int net_linux_pollSockets(int timeoutMs) {
+#ifdef NET_LINUX_EPOLL
+  if (netEpollFd < 0 || !netEpollSockets) return 0;
+  struct epoll_event events[NET_LINUX_EPOLL_EVENTS];
+  int n = epoll_wait(netEpollFd, events, NET_LINUX_EPOLL_EVENTS, timeoutMs);
+  int i;
+  for (i=0;i<n;i++) {
+    int sckt = events[i].data.fd;
+    if (sckt >= 0 && sckt < NET_LINUX_MAX_FD)
+      netSocketFlags[sckt] |= NLSF_READY;
+  }
+  return (n>0) ? n : 0;
+#else
+  NOT_USED(timeoutMs);
+  return 0;
+#endif
+}
+
+/// Could the socket have anything to read/accept? If so, clear its ready flag - epoll will set it again if there's still more
+static bool net_linux_takeReady(int sckt) {
+#ifdef NET_LINUX_EPOLL
+  if (sckt >= 0 && sckt < NET_LINUX_MAX_FD && (netSocketFlags[sckt]&NLSF_WATCHED)) {
+    if (!(netSocketFlags[sckt]&NLSF_READY) && netLinuxRepoll) {
+      // Something we sent could already be waiting on another of our sockets - check now rather than next time around
+      netLinuxRepoll = false;
+      net_linux_pollSockets(0);
+    }
+    if (!(netSocketFlags[sckt]&NLSF_READY)) return false;
+    netSocketFlags[sckt] &= (NetLinuxSocketFlags)~NLSF_READY;
+  }
+#else
+  NOT_USED(sckt);
+#endif
+  return true;
+}
+
+bool net_linux_isBusy() {
+#ifdef NET_LINUX_EPOLL
+  return netLinuxBusy;
+#else
+  return true; // we can't tell if sockets are idle, so keep checking them
+#endif
+}
+
+bool net_linux_hasSockets() {
+#ifdef NET_LINUX_EPOLL
+  return netEpollSockets > 0;
+#else
+  return false; // net_linux_isBusy keeps the idle loop going instead
+#endif
+}
+
+bool net_linux_sleep(unsigned int usecs) {
+#ifdef NET_LINUX_EPOLL
+  if (netEpollFd < 0 || !netEpollSockets) return false;
+  net_linux_pollSockets((int)(usecs/1000));
+  return true;
+#else
+  NOT_USED(usecs);
+  return false;
+#endif
+}
+
 
 /// Get an IP address from a name. Sets out_ip_addr to 0 on failure
 void net_linux_gethostbyname(JsNetwork *net, char * hostName, uint32_t* out_ip_addr) {
@@ -51,6 +173,10 @@ void net_linux_gethostbyname(JsNetwork *net, char * hostName, uint32_t* out_ip_a
 /// Called on idle. Do any checks required for this device
 void net_linux_idle(JsNetwork *net) {
   NOT_USED(net);
+#ifdef NET_LINUX_EPOLL
+  netLinuxRepoll = false;
+#endif
+  netLinuxBusy = net_linux_pollSockets(0) > 0;
 }
 
 /// Call just before returning to idle loop. This checks for errors and tries to recover. Returns true if no errors.
@@ -76,6 +202,8 @@ int net_linux_createsocket(JsNetwork *net, uint32_t host, unsigned short port) {
     #ifdef WIN_OS
     u_long n = 1;
     ioctlsocket(sckt,FIONBIO,&n);
+    #else
+    net_linux_addSocket(sckt, false);
     #endif
 
     sin.sin_addr.s_addr = (in_addr_t)host;
@@ -91,6 +219,7 @@ int net_linux_createsocket(JsNetwork *net, uint32_t host, unsigned short port) {
      if (err != EINPROGRESS &&
          err != EWOULDBLOCK) {
        jsError("Connect failed (err %d)\n", err );
+       net_linux_removeSocket(sckt);
        closesocket(sckt);
        return -1;
      }
@@ -130,6 +259,7 @@ int net_linux_createsocket(JsNetwork *net, uint32_t host, unsigned short port) {
       closesocket(sckt);
       return -1;
     }
+    net_linux_addSocket(sckt, false);
   }
 
 #ifdef SO_NOSIGPIPE
@@ -142,27 +272,91 @@ int net_linux_createsocket(JsNetwork *net, uint32_t host, unsigned short port) {
   return sckt;
 }
 
+/// Create a UDP socket bound to the given local port (any port if 0). Returns >=0 on success
+int net_linux_createsocketUDP(JsNetwork *net, unsigned short port) {
+  NOT_USED(net);
+  int sckt = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (sckt<0) return sckt; // error
+
+  int optval = 1;
+  if (setsockopt(sckt,SOL_SOCKET,SO_REUSEADDR,(const char *)&optval,sizeof(optval)) < 0)
+    jsWarn("setsockopt(SO_REUSADDR) failed\n");
+  if (setsockopt(sckt,SOL_SOCKET,SO_BROADCAST,(const char *)&optval,sizeof(optval)) < 0)
+    jsWarn("setsockopt(SO_BROADCAST) failed\n");
+
+  sockaddr_in sin;
+  memset(&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = INADDR_ANY;
+  sin.sin_port = htons(port);
+  if (bind(sckt, (struct sockaddr*)&sin, sizeof(sin)) == SOCKET_ERROR) {
+    jsError("Socket bind failed");
+    closesocket(sckt);
+    return -1;
+  }
+  net_linux_addSocket(sckt, true);
+  return sckt;
+}
+
+static bool net_linux_isUDP(int sckt) {
+#ifdef NET_LINUX_EPOLL
+  if (sckt >= 0 && sckt < NET_LINUX_MAX_FD && (netSocketFlags[sckt]&NLSF_WATCHED))
+    return (netSocketFlags[sckt]&NLSF_UDP) != 0;
+#endif
+  int type = 0;
+  socklen_t len = sizeof(type);
+  return getsockopt(sckt, SOL_SOCKET, SO_TYPE, (char *)&type, &len)==0 && type==SOCK_DGRAM;
+}
+
+/// Receive as many whole datagrams as will fit in len, each preceded by a JsNetUDPPacketHeader
+static int net_linux_recvUDP(int sckt, unsigned char *buf, size_t len) {
+  size_t pos = 0;
+  while (pos + sizeof(JsNetUDPPacketHeader) < len) {
+    // peek at the size first, so a datagram that won't fit stays queued (unless it won't fit on its own)
+    size_t maxLen = len - pos - sizeof(JsNetUDPPacketHeader);
+    int size = (int)recv(sckt, NULL, 0, MSG_PEEK|MSG_TRUNC|MSG_DONTWAIT);
+    if (size<0) break; // nothing waiting
+    if (pos>0 && (size_t)size>maxLen) break;
+    sockaddr_in sin;
+    socklen_t sinLen = sizeof(sin);
+    int num = (int)recvfrom(sckt, &buf[pos+sizeof(JsNetUDPPacketHeader)], maxLen, MSG_DONTWAIT,
+                            (struct sockaddr *)&sin, &sinLen);
+    if (num<0) break;
+    JsNetUDPPacketHeader header;
+    memcpy(header.host, &sin.sin_addr.s_addr, sizeof(header.host));
+    header.port = ntohs(sin.sin_port);
+    header.length = (unsigned short)num;
+    memcpy(&buf[pos], &header, sizeof(header));
+    pos += sizeof(header) + (size_t)num;
+  }
+  return (int)pos;
+}
+
 /// destroys the given socket
 void net_linux_closesocket(JsNetwork *net, int sckt) {
   NOT_USED(net);
+  net_linux_removeSocket(sckt);
   closesocket(sckt);
+#ifdef NET_LINUX_EPOLL
+  netLinuxRepoll = true;
+#endif
 }
 
 /// If the given server socket can accept a connection, return it (or return < 0)
 int net_linux_accept(JsNetwork *net, int sckt) {
   NOT_USED(net);
   // TODO: look for unreffed servers?
-  fd_set s;
-  FD_ZERO(&s);
-  FD_SET(sckt,&s);
-  // check for waiting clients
-  struct timeval timeout;
-  timeout.tv_sec = 0;
-  timeout.tv_usec = 0;
-  int n = select(sckt+1,&s,NULL,NULL,&timeout);
+  if (!net_linux_takeReady(sckt)) return -1;
+  // check for waiting clients (poll rather than select, as fds may be >= FD_SETSIZE)
+  struct pollfd p = { .fd = sckt, .events = POLLIN };
+  int n = poll(&p, 1, 0);
   if (n>0) {
     // we have a client waiting to connect... try to connect and see what happens
     int theClient = accept(sckt,0,0);
+    if (theClient >= 0) {
+      net_linux_addSocket(theClient, false);
+      netLinuxBusy = true;
+    }
     return theClient;
   }
   return -1;
@@ -171,22 +365,22 @@ int net_linux_accept(JsNetwork *net, int sckt) {
 /// Receive data if possible. returns nBytes on success, 0 on no data, or -1 on failure
 int net_linux_recv(JsNetwork *net, int sckt, void *buf, size_t len) {
   NOT_USED(net);
+  if (!net_linux_takeReady(sckt)) return 0; // nothing waiting
+  netLinuxBusy = true;
+  if (net_linux_isUDP(sckt))
+    return net_linux_recvUDP(sckt, buf, len);
   int num = 0;
-  fd_set s;
-  FD_ZERO(&s);
-  FD_SET(sckt,&s);
-  // check for waiting clients
-  struct timeval timeout;
-  timeout.tv_sec = 0;
-  timeout.tv_usec = 0;
-  int n = select(sckt+1,&s,NULL,NULL,&timeout);
+  struct pollfd p = { .fd = sckt, .events = POLLIN };
+  int n = poll(&p, 1, 0);
   if (n==SOCKET_ERROR) {
+    if (errno==EINTR) return 0; // a signal (eg. the profiler) - try again next time
     // we probably disconnected
     return -1;
   } else if (n>0) {
     // receive data
     num = (int)recv(sckt,buf,len,0);
     if (num==0) num=-1; // select says data, but recv says 0 means connection is closed
+    else if (num<0 && (errno==EAGAIN || errno==EWOULDBLOCK)) num=0; // non-blocking - nothing after all
   }
 
   return num;
@@ -195,25 +389,54 @@ int net_linux_recv(JsNetwork *net, int sckt, void *buf, size_t len) {
 /// Send data if possible. returns nBytes on success, 0 on no data, or -1 on failure
 int net_linux_send(JsNetwork *net, int sckt, const void *buf, size_t len) {
   NOT_USED(net);
-  fd_set writefds;
-  FD_ZERO(&writefds);
-  FD_SET(sckt, &writefds);
-  struct timeval time;
-  time.tv_sec = 0;
-  time.tv_usec = 0;
-  int n = select(sckt+1, 0, &writefds, 0, &time);
+  struct pollfd p = { .fd = sckt, .events = POLLOUT };
+  int n = poll(&p, 1, 0);
   if (n==SOCKET_ERROR ) {
+    if (errno==EINTR) return 0; // a signal (eg. the profiler) - try again next time
      // we probably disconnected so just get rid of this
     return -1;
-  } else if (FD_ISSET(sckt, &writefds)) {
+  } else if (p.revents & (POLLOUT|POLLERR|POLLHUP)) {
+    netLinuxBusy = true;
     int flags = 0;
 #if !defined(SO_NOSIGPIPE) && defined(MSG_NOSIGNAL)
     flags |= MSG_NOSIGNAL;
 #endif
+    if (net_linux_isUDP(sckt)) {
+      // one datagram, preceded by the address to send it to
+      JsNetUDPPacketHeader header;
+      if (len < sizeof(header)) return -1;
+      memcpy(&header, buf, sizeof(header));
+      sockaddr_in sin;
+      memset(&sin, 0, sizeof(sin));
+      sin.sin_family = AF_INET;
+      memcpy(&sin.sin_addr.s_addr, header.host, sizeof(header.host));
+      sin.sin_port = htons(header.port);
+      n = (int)sendto(sckt, (const char *)buf+sizeof(header), header.length, flags,
+                      (struct sockaddr *)&sin, sizeof(sin));
+      if (n<0) return (errno==EAGAIN || errno==EWOULDBLOCK) ? 0 : n;
+#ifdef NET_LINUX_EPOLL
+      netLinuxRepoll = true;
+#endif
+      return (int)len;
+    }
     n = (int)send(sckt, buf, len, flags);
+    if (n<0 && (errno==EAGAIN || errno==EWOULDBLOCK)) return 0;
+#ifdef NET_LINUX_EPOLL
+    if (n>0) netLinuxRepoll = true;
+#endif
     return n;
-  } else
+  } else {
+    netLinuxBusy = true; // data is waiting to go - keep checking
     return 0; // just not ready
+  }
+}
+
+/// Turn Nagle's algorithm off (noDelay=true) or on
+void net_linux_setNoDelay(JsNetwork *net, int sckt, bool noDelay) {
+  NOT_USED(net);
+  int optval = noDelay ? 1 : 0;
+  if (setsockopt(sckt,IPPROTO_TCP,TCP_NODELAY,(const char *)&optval,sizeof(optval)) < 0)
+    jsWarn("setsockopt(TCP_NODELAY) failed\n");
 }
 
 void netSetCallbacks_linux(JsNetwork *net) {
@@ -225,5 +448,7 @@ void netSetCallbacks_linux(JsNetwork *net) {
   net->gethostbyname = net_linux_gethostbyname;
   net->recv = net_linux_recv;
   net->send = net_linux_send;
+  net->createsocketUDP = net_linux_createsocketUDP;
+  net->setNoDelay = net_linux_setNoDelay;
   net->chunkSize = 536;
 }
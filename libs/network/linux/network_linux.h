@@ -14,3 +14,9 @@
 #include "network.h"
 
 void netSetCallbacks_linux(JsNetwork *net);
+/// Did any socket have anything to do last time around the idle loop? If not, we can sleep
+bool net_linux_isBusy();
+/// Are there any open sockets being waited on? If so we should keep running even if we're not busy
+bool net_linux_hasSockets();
+/// Sleep for up to 'usecs', waking early if a socket becomes ready. Returns false if there are no sockets to wait on
+bool net_linux_sleep(unsigned int usecs);
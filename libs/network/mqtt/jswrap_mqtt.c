@@ -0,0 +1,223 @@
+/*
+ * This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+ *
+ * Copyright (C) 2013 Gordon Williams <gw@pur3.co.uk>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * ----------------------------------------------------------------------------
+ * This file is designed to be parsed during the build process
+ *
+ * Contains JavaScript MQTT Functions
+ * ----------------------------------------------------------------------------
+ */
+#include "jswrap_mqtt.h"
+#include "jswrap_net.h"
+#include "socketserver.h"
+#include "mqtt.h"
+
+#include "../network.h"
+
+/*JSON{
+  "type" : "library",
+  "class" : "mqtt",
+  "ifdef" : "USE_MQTT"
+}
+A native MQTT 3.1.1 client. Packets are encoded and decoded in C, and the connection
+is kept alive with pings automatically. QoS 0 and 1 are supported.
+
+```
+var mqtt = require("mqtt").connect("mqtt://test.mosquitto.org", { clientId : "espruino" });
+mqtt.on("connect", function() {
+  mqtt.subscribe("espruino/#");
+  mqtt.publish("espruino/hello", "world");
+});
+mqtt.on("message", function(topic, message) {
+  console.log(topic, message);
+});
+```
+*/
+
+/*JSON{
+  "type" : "class",
+  "library" : "mqtt",
+  "class" : "MQTT",
+  "ifdef" : "USE_MQTT"
+}
+A connection to an MQTT broker, created by `require("mqtt").connect`
+*/
+/*JSON{
+  "type" : "event",
+  "class" : "MQTT",
+  "name" : "connect",
+  "ifdef" : "USE_MQTT"
+}
+Called when the broker has accepted our connection
+*/
+/*JSON{
+  "type" : "event",
+  "class" : "MQTT",
+  "name" : "message",
+  "ifdef" : "USE_MQTT",
+  "params" : [
+    ["topic","JsVar","The topic the message was published to"],
+    ["message","JsVar","A string containing the message"]
+  ]
+}
+Called when a message is received on a topic we subscribed to
+*/
+/*JSON{
+  "type" : "event",
+  "class" : "MQTT",
+  "name" : "close",
+  "ifdef" : "USE_MQTT",
+  "params" : [
+    ["had_error","JsVar","A boolean indicating whether the connection had an error (use an error event handler to get error details)."]
+  ]
+}
+Called when the connection closes.
+*/
+/*JSON{
+  "type" : "event",
+  "class" : "MQTT",
+  "name" : "error",
+  "ifdef" : "USE_MQTT",
+  "params" : [
+    ["details","JsVar","An error object with an error code (a negative integer) and a message."]
+  ]
+}
+There was an error on this connection - for instance the broker refused it, or stopped replying to pings.
+*/
+
+/*JSON{
+  "type" : "staticmethod",
+  "class" : "mqtt",
+  "name" : "connect",
+  "ifdef" : "USE_MQTT",
+  "generate" : "jswrap_mqtt_connect",
+  "params" : [
+    ["server","JsVar","A URL like `\"mqtt://host:port\"` (or `mqtts://` for TLS), or an object containing host,port fields"],
+    ["options","JsVar","(optional) An object containing `clientId`, `username`, `password`, `keepalive` (seconds, default 60, 0 to disable), `clean` (default true), `maxQueue` (bytes waiting to be sent before `publish` fails, default 2048) and `maxInflight` (QoS 1 messages waiting for acknowledgement before `publish` fails, default 4)"]
+  ],
+  "return" : ["JsVar","Returns a new MQTT object"],
+  "return_object" : "MQTT"
+}
+Connect to an MQTT broker
+*/
+JsVar *jswrap_mqtt_connect(JsVar *server, JsVar *options) {
+  JsNetwork net;
+  if (!networkGetFromVarIfOnline(&net)) return 0;
+
+  if (jsvIsString(server))
+    server = jswrap_url_parse(server, false);
+  else
+    server = jsvLockAgainSafe(server);
+  if (!jsvIsObject(server)) {
+    jsError("Expecting Server to be a URL or an Object but it was %t", server);
+    jsvUnLock(server);
+    networkFree(&net);
+    return 0;
+  }
+  JsVar *port = jsvObjectGetChild(server, "port", 0);
+  if (!jsvIsNumeric(port)) {
+    bool tls = jsvIsStringEqualAndUnLock(jsvObjectGetChild(server, "protocol", 0), "mqtts:");
+    jsvObjectSetChildAndUnLock(server, "port", jsvNewFromInteger(tls ? MQTT_DEFAULT_TLS_PORT : MQTT_DEFAULT_PORT));
+  }
+  jsvUnLock(port);
+
+  JsVar *mqtt = jswrap_net_connect(server, 0, ST_MQTT);
+  if (mqtt)
+    mqttClientStart(&net, mqtt, jsvIsObject(options) ? options : server);
+  jsvUnLock(server);
+  networkFree(&net);
+  return mqtt;
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "MQTT",
+  "name" : "publish",
+  "ifdef" : "USE_MQTT",
+  "generate" : "jswrap_mqtt_publish",
+  "params" : [
+    ["topic","JsVar","The topic to publish to"],
+    ["message","JsVar","The message (converted to a string)"],
+    ["options","JsVar","(optional) An object containing `qos` (0 or 1, default 0) and `retain` (default false)"]
+  ],
+  "return" : ["bool","false if the message wasn't sent because too much data is waiting to be sent or acknowledged - try again later"]
+}
+Publish a message
+*/
+bool jswrap_mqtt_publish(JsVar *parent, JsVar *topic, JsVar *message, JsVar *options) {
+  int qos = 0;
+  bool retain = false;
+  if (jsvIsObject(options)) {
+    qos = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(options, "qos", 0));
+    retain = jsvGetBoolAndUnLock(jsvObjectGetChild(options, "retain", 0));
+  }
+  JsNetwork net;
+  if (!networkGetFromVarIfOnline(&net)) return false;
+  bool sent = mqttPublish(&net, parent, topic, message, qos, retain);
+  networkFree(&net);
+  return sent;
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "MQTT",
+  "name" : "subscribe",
+  "ifdef" : "USE_MQTT",
+  "generate" : "jswrap_mqtt_subscribe",
+  "params" : [
+    ["topic","JsVar","The topic to subscribe to (may contain `+` and `#` wildcards)"],
+    ["options","JsVar","(optional) An object containing `qos` (0 or 1, default 0)"]
+  ]
+}
+Subscribe to a topic - messages published to it are passed to the `message` event
+*/
+void jswrap_mqtt_subscribe(JsVar *parent, JsVar *topic, JsVar *options) {
+  int qos = 0;
+  if (jsvIsObject(options))
+    qos = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(options, "qos", 0));
+  JsNetwork net;
+  if (!networkGetFromVarIfOnline(&net)) return;
+  mqttSubscribe(&net, parent, topic, qos);
+  networkFree(&net);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "MQTT",
+  "name" : "unsubscribe",
+  "ifdef" : "USE_MQTT",
+  "generate" : "jswrap_mqtt_unsubscribe",
+  "params" : [
+    ["topic","JsVar","The topic to unsubscribe from"]
+  ]
+}
+Unsubscribe from a topic
+*/
+void jswrap_mqtt_unsubscribe(JsVar *parent, JsVar *topic) {
+  JsNetwork net;
+  if (!networkGetFromVarIfOnline(&net)) return;
+  mqttUnsubscribe(&net, parent, topic);
+  networkFree(&net);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "MQTT",
+  "name" : "end",
+  "ifdef" : "USE_MQTT",
+  "generate" : "jswrap_mqtt_end"
+}
+Disconnect from the broker, once everything queued has been sent
+*/
+void jswrap_mqtt_end(JsVar *parent) {
+  JsNetwork net;
+  if (!networkGetFromVarIfOnline(&net)) return;
+  mqttDisconnect(&net, parent);
+  networkFree(&net);
+}
@@ -0,0 +1,20 @@
+/*
+ * This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+ *
+ * Copyright (C) 2013 Gordon Williams <gw@pur3.co.uk>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * ----------------------------------------------------------------------------
+ * Contains JavaScript MQTT Functions
+ * ----------------------------------------------------------------------------
+ */
+#include "jsvar.h"
+
+JsVar *jswrap_mqtt_connect(JsVar *server, JsVar *options);
+bool jswrap_mqtt_publish(JsVar *parent, JsVar *topic, JsVar *message, JsVar *options);
+void jswrap_mqtt_subscribe(JsVar *parent, JsVar *topic, JsVar *options);
+void jswrap_mqtt_unsubscribe(JsVar *parent, JsVar *topic);
+void jswrap_mqtt_end(JsVar *parent);
@@ -0,0 +1,331 @@
+/*
+ * This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+ *
+ * Copyright (C) 2013 Gordon Williams <gw@pur3.co.uk>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * ----------------------------------------------------------------------------
+ * MQTT client - packet encoding/decoding on top of socketserver's sockets
+ * ----------------------------------------------------------------------------
+ */
+#include "mqtt.h"
+#include "socketserver.h"
+#include "socketerrors.h"
+#include "jsinteractive.h"
+#include "jshardware.h"
+
+#define MQTT_NAME_KEEP_ALIVE "mqKa"   // keep alive interval in ms, or 0
+#define MQTT_NAME_LAST_SENT "mqTx"    // time we last sent a packet
+#define MQTT_NAME_LAST_RECEIVED "mqRx" // time we last received a packet
+#define MQTT_NAME_PACKET_ID "mqId"    // the last packet ID we used
+#define MQTT_NAME_IN_FLIGHT "mqIf"    // object of QoS 1 packet IDs waiting for a PUBACK
+#define MQTT_NAME_MAX_QUEUE "mqMq"    // max bytes waiting to be sent before publish fails
+#define MQTT_NAME_MAX_IN_FLIGHT "mqMi" // max QoS 1 messages waiting for PUBACK before publish fails
+#define MQTT_NAME_CONNECTED "mqCn"    // boolean: we got CONNACK
+#define MQTT_NAME_ON_CONNECT JS_EVENT_PREFIX"connect"
+#define MQTT_NAME_ON_MESSAGE JS_EVENT_PREFIX"message"
+
+#ifndef MQTT_MAX_PACKET_LENGTH
+#define MQTT_MAX_PACKET_LENGTH 4096 // close the connection if we're sent a packet bigger than this
+#endif
+#define MQTT_DEFAULT_KEEP_ALIVE 60 // seconds
+#define MQTT_DEFAULT_MAX_QUEUE 2048
+#define MQTT_DEFAULT_MAX_IN_FLIGHT 4
+
+typedef enum {
+  MQTT_CONNECT = 1,
+  MQTT_CONNACK = 2,
+  MQTT_PUBLISH = 3,
+  MQTT_PUBACK = 4,
+  MQTT_SUBSCRIBE = 8,
+  MQTT_SUBACK = 9,
+  MQTT_UNSUBSCRIBE = 10,
+  MQTT_UNSUBACK = 11,
+  MQTT_PINGREQ = 12,
+  MQTT_PINGRESP = 13,
+  MQTT_DISCONNECT = 14,
+} MqttPacketType;
+
+static JsVarFloat mqttGetTime() {
+  return jshGetMillisecondsFromTime(jshGetSystemTime());
+}
+
+/// Create a packet with the fixed header for the given type/flags, and space for remainingLength bytes
+static JsVar *mqttNewPacket(MqttPacketType type, int flags, size_t remainingLength) {
+  char hdr[5];
+  size_t h = 0;
+  hdr[h++] = (char)(((int)type<<4) | flags);
+  do { // 7 bits at a time, top bit set if there's more
+    char b = (char)(remainingLength & 127);
+    remainingLength >>= 7;
+    if (remainingLength) b |= (char)0x80;
+    hdr[h++] = b;
+  } while (remainingLength && h<sizeof(hdr));
+  JsVar *packet = jsvNewFromEmptyString();
+  if (packet) jsvAppendStringBuf(packet, hdr, h);
+  return packet;
+}
+
+static void mqttAppendU16(JsVar *packet, unsigned int n) {
+  char buf[2] = { (char)(n>>8), (char)n };
+  jsvAppendStringBuf(packet, buf, 2);
+}
+
+/// Append a length-prefixed string
+static void mqttAppendString(JsVar *packet, JsVar *str) {
+  mqttAppendU16(packet, (unsigned int)jsvGetStringLength(str));
+  jsvAppendStringVarComplete(packet, str);
+}
+
+static unsigned int mqttNextPacketId(JsVar *mqtt) {
+  unsigned int id = (unsigned int)jsvGetIntegerAndUnLock(jsvObjectGetChild(mqtt, MQTT_NAME_PACKET_ID, 0));
+  id = (id & 0xFFFF) + 1; // IDs are 1..65535
+  if (id > 0xFFFF) id = 1;
+  jsvObjectSetChildAndUnLock(mqtt, MQTT_NAME_PACKET_ID, jsvNewFromInteger((JsVarInt)id));
+  return id;
+}
+
+static void mqttSend(JsNetwork *net, JsVar *mqtt, JsVar *packet) {
+  if (!packet) return;
+  clientRequestWrite(net, mqtt, packet);
+  jsvObjectSetChildAndUnLock(mqtt, MQTT_NAME_LAST_SENT, jsvNewFromFloat(mqttGetTime()));
+}
+
+// -----------------------------
+
+void mqttClientStart(JsNetwork *net, JsVar *mqtt, JsVar *options) {
+  JsVar *clientId = jsvObjectGetChild(options, "clientId", 0);
+  if (!jsvIsString(clientId)) {
+    jsvUnLock(clientId);
+    clientId = jsvVarPrintf("espruino_%x", jshGetRandomNumber());
+  }
+  JsVar *username = jsvObjectGetChild(options, "username", 0);
+  JsVar *password = jsvObjectGetChild(options, "password", 0);
+  if (!jsvIsString(username)) { jsvUnLock(username); username = 0; }
+  if (!jsvIsString(password)) { jsvUnLock(password); password = 0; }
+  JsVar *v = jsvObjectGetChild(options, "keepalive", 0);
+  int keepAlive = v ? (int)jsvGetInteger(v) : MQTT_DEFAULT_KEEP_ALIVE;
+  jsvUnLock(v);
+  if (keepAlive<0 || keepAlive>0xFFFF) keepAlive = MQTT_DEFAULT_KEEP_ALIVE;
+  v = jsvObjectGetChild(options, "clean", 0);
+  bool clean = v ? jsvGetBool(v) : true;
+  jsvUnLock(v);
+  v = jsvObjectGetChild(options, "maxQueue", 0);
+  jsvObjectSetChildAndUnLock(mqtt, MQTT_NAME_MAX_QUEUE, jsvNewFromInteger(v ? jsvGetInteger(v) : MQTT_DEFAULT_MAX_QUEUE));
+  jsvUnLock(v);
+  v = jsvObjectGetChild(options, "maxInflight", 0);
+  jsvObjectSetChildAndUnLock(mqtt, MQTT_NAME_MAX_IN_FLIGHT, jsvNewFromInteger(v ? jsvGetInteger(v) : MQTT_DEFAULT_MAX_IN_FLIGHT));
+  jsvUnLock(v);
+  jsvObjectSetChildAndUnLock(mqtt, MQTT_NAME_KEEP_ALIVE, jsvNewFromInteger(keepAlive*1000));
+  jsvObjectSetChildAndUnLock(mqtt, MQTT_NAME_LAST_RECEIVED, jsvNewFromFloat(mqttGetTime()));
+
+  size_t len = 10 + 2 + jsvGetStringLength(clientId);
+  if (username) len += 2 + jsvGetStringLength(username);
+  if (password) len += 2 + jsvGetStringLength(password);
+  JsVar *packet = mqttNewPacket(MQTT_CONNECT, 0, len);
+  if (packet) {
+    char flags = clean ? 0x02 : 0;
+    if (username) flags |= (char)0x80;
+    if (password) flags |= 0x40;
+    char vhdr[8] = { 0, 4, 'M', 'Q', 'T', 'T', 4/*protocol level - 3.1.1*/, flags };
+    jsvAppendStringBuf(packet, vhdr, sizeof(vhdr));
+    mqttAppendU16(packet, (unsigned int)keepAlive);
+    mqttAppendString(packet, clientId);
+    if (username) mqttAppendString(packet, username);
+    if (password) mqttAppendString(packet, password);
+    mqttSend(net, mqtt, packet);
+    jsvUnLock(packet);
+  }
+  jsvUnLock3(clientId, username, password);
+}
+
+bool mqttPublish(JsNetwork *net, JsVar *mqtt, JsVar *topic, JsVar *message, int qos, bool retain) {
+  if (qos<0 || qos>1) {
+    jsExceptionHere(JSET_ERROR, "Only QoS 0 and 1 are supported");
+    return false;
+  }
+  JsVar *topicStr = jsvAsString(topic, false);
+  JsVar *messageStr = jsvAsString(message, false);
+  if (!topicStr || !messageStr) {
+    jsvUnLock2(topicStr, messageStr);
+    return false;
+  }
+  size_t len = 2 + jsvGetStringLength(topicStr) + (qos ? 2 : 0) + jsvGetStringLength(messageStr);
+  // Don't let the queue of data to send grow without limit - just tell the caller to try later
+  bool full = socketGetPendingSendLength(mqtt) + len > (size_t)jsvGetIntegerAndUnLock(jsvObjectGetChild(mqtt, MQTT_NAME_MAX_QUEUE, 0));
+  JsVar *inFlight = 0;
+  if (!full && qos) {
+    inFlight = jsvObjectGetChild(mqtt, MQTT_NAME_IN_FLIGHT, JSV_OBJECT);
+    full = !inFlight || jsvGetChildren(inFlight) >= jsvGetIntegerAndUnLock(jsvObjectGetChild(mqtt, MQTT_NAME_MAX_IN_FLIGHT, 0));
+  }
+  if (!full) {
+    JsVar *packet = mqttNewPacket(MQTT_PUBLISH, (qos<<1) | (retain?1:0), len);
+    if (packet) {
+      mqttAppendString(packet, topicStr);
+      if (qos) {
+        unsigned int id = mqttNextPacketId(mqtt);
+        mqttAppendU16(packet, id);
+        JsVar *idVar = jsvNewFromInteger((JsVarInt)id);
+        JsVar *idName = jsvFindChildFromVar(inFlight, idVar, true);
+        JsVar *sentTime = jsvNewFromFloat(mqttGetTime());
+        if (idName) jsvSetValueOfName(idName, sentTime);
+        jsvUnLock3(sentTime, idName, idVar);
+      }
+      jsvAppendStringVarComplete(packet, messageStr);
+      mqttSend(net, mqtt, packet);
+      jsvUnLock(packet);
+    } else
+      full = true;
+  }
+  jsvUnLock3(inFlight, topicStr, messageStr);
+  return !full;
+}
+
+static void mqttSubscribeOrUnsubscribe(JsNetwork *net, JsVar *mqtt, JsVar *topic, int qos, bool subscribe) {
+  JsVar *topicStr = jsvAsString(topic, false);
+  if (!topicStr) return;
+  size_t len = 2 + 2 + jsvGetStringLength(topicStr) + (subscribe ? 1 : 0);
+  JsVar *packet = mqttNewPacket(subscribe ? MQTT_SUBSCRIBE : MQTT_UNSUBSCRIBE, 2/*reserved flags*/, len);
+  if (packet) {
+    mqttAppendU16(packet, mqttNextPacketId(mqtt));
+    mqttAppendString(packet, topicStr);
+    if (subscribe) {
+      char q = (char)(qos>0 ? 1 : 0); // we only handle QoS 0 and 1
+      jsvAppendStringBuf(packet, &q, 1);
+    }
+    mqttSend(net, mqtt, packet);
+    jsvUnLock(packet);
+  }
+  jsvUnLock(topicStr);
+}
+
+void mqttSubscribe(JsNetwork *net, JsVar *mqtt, JsVar *topic, int qos) {
+  mqttSubscribeOrUnsubscribe(net, mqtt, topic, qos, true);
+}
+
+void mqttUnsubscribe(JsNetwork *net, JsVar *mqtt, JsVar *topic) {
+  mqttSubscribeOrUnsubscribe(net, mqtt, topic, 0, false);
+}
+
+void mqttDisconnect(JsNetwork *net, JsVar *mqtt) {
+  JsVar *packet = mqttNewPacket(MQTT_DISCONNECT, 0, 0);
+  mqttSend(net, mqtt, packet);
+  jsvUnLock(packet);
+  clientRequestEnd(net, mqtt);
+}
+
+// -----------------------------
+
+static unsigned int mqttGetU16(JsVar *data, size_t pos) {
+  unsigned char buf[3] = {0,0,0}; // jsvGetStringChars may add a trailing 0
+  jsvGetStringChars(data, pos, (char*)buf, 2);
+  return ((unsigned int)buf[0]<<8) | buf[1];
+}
+
+/// Handle a single complete packet, whose body is at data[pos..pos+len]
+static int mqttHandlePacket(JsNetwork *net, JsVar *mqtt, int hdr, JsVar *data, size_t pos, size_t len) {
+  switch (hdr>>4) {
+  case MQTT_CONNACK: {
+    unsigned int returnCode = len>=2 ? (mqttGetU16(data, pos) & 0xFF) : 255;
+    if (returnCode) return SOCKET_ERR_MQTT_REFUSED;
+    jsvObjectSetChildAndUnLock(mqtt, MQTT_NAME_CONNECTED, jsvNewFromBool(true));
+    jsiQueueObjectCallbacks(mqtt, MQTT_NAME_ON_CONNECT, &mqtt, 1);
+    break;
+  }
+  case MQTT_PUBLISH: {
+    int qos = (hdr>>1)&3;
+    if (len<2) return SOCKET_ERR_MQTT_PACKET;
+    size_t topicLen = mqttGetU16(data, pos);
+    size_t payloadStart = 2 + topicLen + (qos ? 2 : 0);
+    if (qos>1 || payloadStart > len) return SOCKET_ERR_MQTT_PACKET;
+    JsVar *args[2];
+    args[0] = jsvNewFromStringVar(data, pos+2, topicLen);
+    args[1] = jsvNewFromStringVar(data, pos+payloadStart, len-payloadStart);
+    if (args[0] && args[1])
+      jsiQueueObjectCallbacks(mqtt, MQTT_NAME_ON_MESSAGE, args, 2);
+    jsvUnLock2(args[0], args[1]);
+    if (qos) {
+      JsVar *packet = mqttNewPacket(MQTT_PUBACK, 0, 2);
+      if (packet) {
+        mqttAppendU16(packet, mqttGetU16(data, pos+2+topicLen));
+        mqttSend(net, mqtt, packet);
+        jsvUnLock(packet);
+      }
+    }
+    break;
+  }
+  case MQTT_PUBACK: {
+    if (len<2) return SOCKET_ERR_MQTT_PACKET;
+    JsVar *inFlight = jsvObjectGetChild(mqtt, MQTT_NAME_IN_FLIGHT, 0);
+    if (inFlight) {
+      JsVar *id = jsvNewFromInteger((JsVarInt)mqttGetU16(data, pos));
+      JsVar *idName = jsvFindChildFromVar(inFlight, id, false);
+      if (idName) jsvRemoveChild(inFlight, idName);
+      jsvUnLock3(idName, id, inFlight);
+    }
+    break;
+  }
+  default: // SUBACK, UNSUBACK, PINGRESP - nothing to do
+    break;
+  }
+  return 0;
+}
+
+int mqttIdle(JsNetwork *net, JsVar *mqtt, JsVar **receiveData) {
+  JsVarFloat now = mqttGetTime();
+  int error = 0;
+  size_t pos = 0;
+  size_t len = *receiveData ? jsvGetStringLength(*receiveData) : 0;
+  while (len-pos >= 2) {
+    unsigned char hdr[6]; // type, up to 4 bytes of length, and the trailing 0 from jsvGetStringChars
+    size_t h = jsvGetStringChars(*receiveData, pos, (char*)hdr, 5);
+    // decode the remaining length
+    size_t packetLen = 0, hdrLen = 1;
+    int shift = 0;
+    bool complete = false;
+    while (hdrLen < h) {
+      packetLen |= (size_t)(hdr[hdrLen]&127) << shift;
+      shift += 7;
+      if (!(hdr[hdrLen++]&0x80)) {
+        complete = true;
+        break;
+      }
+    }
+    if (!complete) {
+      if (hdrLen >= 5) error = SOCKET_ERR_MQTT_PACKET;
+      break;
+    }
+    if (packetLen > MQTT_MAX_PACKET_LENGTH) {
+      error = SOCKET_ERR_MQTT_PACKET;
+      break;
+    }
+    if (len-pos < hdrLen+packetLen) break; // wait for the rest
+    error = mqttHandlePacket(net, mqtt, hdr[0], *receiveData, pos+hdrLen, packetLen);
+    pos += hdrLen+packetLen;
+    jsvObjectSetChildAndUnLock(mqtt, MQTT_NAME_LAST_RECEIVED, jsvNewFromFloat(now));
+    if (error) break;
+  }
+  if (pos) {
+    JsVar *rest = pos<len ? jsvNewFromStringVar(*receiveData, pos, JSVAPPENDSTRINGVAR_MAXLENGTH) : 0;
+    jsvUnLock(*receiveData);
+    *receiveData = rest;
+  }
+  if (error) return error;
+
+  // keep the connection alive
+  JsVarFloat keepAlive = jsvGetFloatAndUnLock(jsvObjectGetChild(mqtt, MQTT_NAME_KEEP_ALIVE, 0));
+  if (keepAlive > 0) {
+    // the broker should have replied to our ping by now
+    if (now - jsvGetFloatAndUnLock(jsvObjectGetChild(mqtt, MQTT_NAME_LAST_RECEIVED, 0)) > keepAlive*3/2)
+      return SOCKET_ERR_TIMEOUT;
+    if (now - jsvGetFloatAndUnLock(jsvObjectGetChild(mqtt, MQTT_NAME_LAST_SENT, 0)) >= keepAlive) {
+      JsVar *packet = mqttNewPacket(MQTT_PINGREQ, 0, 0);
+      mqttSend(net, mqtt, packet);
+      jsvUnLock(packet);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,38 @@
+/*
+ * This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+ *
+ * Copyright (C) 2013 Gordon Williams <gw@pur3.co.uk>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * ----------------------------------------------------------------------------
+ * MQTT client - packet encoding/decoding on top of socketserver's sockets
+ * ----------------------------------------------------------------------------
+ */
+#ifndef MQTT_H
+#define MQTT_H
+
+#include "jsutils.h"
+#include "jsvar.h"
+#include "network.h"
+
+#define MQTT_DEFAULT_PORT 1883
+#define MQTT_DEFAULT_TLS_PORT 8883
+
+/// Set up a new MQTT connection from its options, and queue the CONNECT packet
+void mqttClientStart(JsNetwork *net, JsVar *mqtt, JsVar *options);
+/** Publish a message. Returns false (and sends nothing) if the outbound queue
+ * or the number of unacknowledged QoS 1 messages is at its limit */
+bool mqttPublish(JsNetwork *net, JsVar *mqtt, JsVar *topic, JsVar *message, int qos, bool retain);
+void mqttSubscribe(JsNetwork *net, JsVar *mqtt, JsVar *topic, int qos);
+void mqttUnsubscribe(JsNetwork *net, JsVar *mqtt, JsVar *topic);
+/// Send DISCONNECT and close the connection once everything has been sent
+void mqttDisconnect(JsNetwork *net, JsVar *mqtt);
+
+/** Called from socketserver's idle loop - decode all complete packets in receiveData (anything left is
+ * for next time), and send pings to keep the connection alive. Returns 0, or a (negative) SocketError */
+int mqttIdle(JsNetwork *net, JsVar *mqtt, JsVar **receiveData);
+
+#endif // MQTT_H
@@ -12,6 +12,7 @@
  * ----------------------------------------------------------------------------
  */
 #include "network.h"
+#include "socketerrors.h"
 #include "jsparse.h"
 #include "jsinteractive.h"
 #ifdef USE_FILESYSTEM
@@ -34,11 +35,12 @@
 #if defined(USE_TLS)
   #include "mbedtls/ssl.h"
   #include "mbedtls/ctr_drbg.h"
+  #include "mbedtls/platform.h"
   #include "jswrap_crypto.h"
 #endif
 #include "network_js.h"
 
-JsNetworkState networkState =
+INSTANCE_LOCAL JsNetworkState networkState =
 #ifdef LINUX
     NETWORKSTATE_ONLINE
 #else
@@ -46,7 +48,11 @@ JsNetworkState networkState =
 #endif
     ;
 
-JsNetwork *networkCurrentStruct = 0;
+INSTANCE_LOCAL JsNetwork *networkCurrentStruct = 0;
+
+/** Sockets that drivers have said are ready (networkSetSocketReady), one bit for each
+ * socket number modulo 32. Sockets that share a bit just get polled when they needn't be. */
+static INSTANCE_LOCAL volatile uint32_t networkSocketsReady = 0;
 
 uint32_t networkParseIPAddress(const char *ip) {
   int n = 0;
@@ -148,6 +154,55 @@ unsigned long networkFlipIPAddress(unsigned long addr) {
       ((addr&0xFF000000)>>24);
 }
 
+#ifndef NET_DNS_CACHE_SIZE
+#define NET_DNS_CACHE_SIZE 4 // how many hostnames we remember the address of
+#endif
+#ifndef NET_DNS_CACHE_TTL
+#define NET_DNS_CACHE_TTL 60000 // milliseconds we trust a cached address for
+#endif
+#define NET_DNS_CACHE_NAME_LEN 32 // longer hostnames just aren't cached
+
+/** Addresses of hostnames we looked up recently. This is a plain array rather than JsVars
+ * because drivers that resolve asynchronously (ESP8266) add to it from their callbacks. */
+typedef struct {
+  char hostName[NET_DNS_CACHE_NAME_LEN];
+  uint32_t ip;
+  JsSysTime expires;
+} NetDNSCacheEntry;
+static INSTANCE_LOCAL NetDNSCacheEntry dnsCache[NET_DNS_CACHE_SIZE];
+
+/// Remember the address a hostname resolved to (for NET_DNS_CACHE_TTL)
+void networkDNSCacheAdd(const char *hostName, uint32_t ip) {
+  if (!ip || ip==0xFFFFFFFF || strlen(hostName) >= NET_DNS_CACHE_NAME_LEN) return;
+  JsSysTime now = jshGetSystemTime();
+  // reuse this hostname's entry, or else the one that expires first
+  int i, idx = 0;
+  for (i=0;i<NET_DNS_CACHE_SIZE;i++) {
+    if (!strcmp(dnsCache[i].hostName, hostName)) {
+      idx = i;
+      break;
+    }
+    if (dnsCache[i].expires < dnsCache[idx].expires) idx = i;
+  }
+  strcpy(dnsCache[idx].hostName, hostName);
+  dnsCache[idx].ip = ip;
+  dnsCache[idx].expires = now + jshGetTimeFromMilliseconds(NET_DNS_CACHE_TTL);
+}
+
+/// Return the cached address of a hostname, or 0
+static uint32_t networkDNSCacheGet(const char *hostName) {
+  JsSysTime now = jshGetSystemTime();
+  int i;
+  for (i=0;i<NET_DNS_CACHE_SIZE;i++)
+    if (dnsCache[i].expires > now && !strcmp(dnsCache[i].hostName, hostName))
+      return dnsCache[i].ip;
+  return 0;
+}
+
+void networkDNSCacheClear() {
+  memset(dnsCache, 0, sizeof(dnsCache));
+}
+
 /**
  * Get the IP address of a hostname.
  * Retrieve the IP address of a hostname and return it in the address of the
@@ -172,10 +227,13 @@ void networkGetHostByName(
   // first try and simply parse the IP address as a string
   *out_ip_addr = networkParseIPAddress(hostName);
 
-  // If we did not get an IP address from the string, then try and resolve it by
-  // calling the network gethostbyname.
+  // If we did not get an IP address from the string, and haven't looked it up recently,
+  // then try and resolve it by calling the network gethostbyname.
+  if (!*out_ip_addr)
+    *out_ip_addr = networkDNSCacheGet(hostName);
   if (!*out_ip_addr) {
     net->gethostbyname(net, hostName, out_ip_addr);
+    networkDNSCacheAdd(hostName, *out_ip_addr); // ignored if it's 0 or 0xFFFFFFFF (not found yet)
   }
 }
 
@@ -225,6 +283,12 @@ bool networkGetFromVar(JsNetwork *net) {
 
   // Now we know which kind of network we are working with, invoke the corresponding initialization
   // function to set the callbacks for this network tyoe.
+  net->recvVar = 0; // optional, so most drivers won't set these
+  net->setRecvWindow = 0;
+  net->setNoDelay = 0;
+  net->createsocketUDP = 0;
+  net->getStats = 0;
+  net->reportsReady = false;
   switch (net->data.type) {
 #if defined(USE_CC3000)
   case JSNETWORKTYPE_CC3000 : netSetCallbacks_cc3000(net); break;
@@ -277,9 +341,27 @@ JsNetwork *networkGetCurrent() {
 // ------------------------------------------------------------------------------
 #ifdef USE_TLS
 
+#ifndef TLS_SESSION_CACHE_SIZE
+#define TLS_SESSION_CACHE_SIZE 2 // how many servers we remember a TLS session for, so we can resume it
+#endif
+#define TLS_SESSION_CACHE_NAME "TLSs" // object in hiddenRoot of "host:port" -> session
+#define TLS_SESSION_KEY_LEN 48
+
+// Ask the server for records no bigger than our buffers (see MBEDTLS_SSL_MAX_CONTENT_LEN in config.h)
+#if MBEDTLS_SSL_MAX_CONTENT_LEN <= 512
+#define TLS_MAX_FRAG_LEN MBEDTLS_SSL_MAX_FRAG_LEN_512
+#elif MBEDTLS_SSL_MAX_CONTENT_LEN <= 1024
+#define TLS_MAX_FRAG_LEN MBEDTLS_SSL_MAX_FRAG_LEN_1024
+#elif MBEDTLS_SSL_MAX_CONTENT_LEN <= 2048
+#define TLS_MAX_FRAG_LEN MBEDTLS_SSL_MAX_FRAG_LEN_2048
+#elif MBEDTLS_SSL_MAX_CONTENT_LEN <= 4096
+#define TLS_MAX_FRAG_LEN MBEDTLS_SSL_MAX_FRAG_LEN_4096
+#endif
+
 typedef struct {
   int sckt;
   bool connecting; // are we in the process of connecting?
+  char sessionKey[TLS_SESSION_KEY_LEN]; // "host:port" to cache the session under, or empty
   mbedtls_ctr_drbg_context ctr_drbg;
   mbedtls_pk_context pkey;
   mbedtls_x509_crt owncert;
@@ -288,7 +370,13 @@ typedef struct {
   mbedtls_ssl_config conf;
 } SSLSocketData;
 
-BITFIELD_DECL(socketIsHTTPS, 32);
+#ifdef LINUX
+#define SOCKET_IS_HTTPS_MAX 1024 // Linux sockets are file descriptors, so can be quite big numbers
+#else
+#define SOCKET_IS_HTTPS_MAX 32
+#endif
+INSTANCE_LOCAL BITFIELD_DECL(socketIsHTTPS, SOCKET_IS_HTTPS_MAX);
+#define SOCKET_IS_HTTPS(sckt) ((sckt)>=0 && (sckt)<SOCKET_IS_HTTPS_MAX && BITFIELD_GET(socketIsHTTPS, sckt))
 
 static void ssl_debug( void *ctx, int level,
                       const char *file, int line, const char *str )
@@ -422,7 +510,7 @@ JsVar *decode_certificate_var(JsVar *var) {
 bool ssl_load_key(SSLSocketData *sd, JsVar *options) {
   JsVar *keyVar = jsvObjectGetChild(options, "key", 0);
   if (!keyVar) {
-    return false;
+    return true; // optional
   }
   int ret = -1;
   jsiConsolePrintf("Loading the Client Key...\n");
@@ -447,7 +535,7 @@ bool ssl_load_key(SSLSocketData *sd, JsVar *options) {
 bool ssl_load_owncert(SSLSocketData *sd, JsVar *options) {
   JsVar *certVar = jsvObjectGetChild(options, "cert", 0);
   if (!certVar) {
-    return false;
+    return true; // optional
   }
   int ret = -1;
   jsiConsolePrintf("Loading the Client certificate...\n");
@@ -471,7 +559,7 @@ bool ssl_load_owncert(SSLSocketData *sd, JsVar *options) {
 bool ssl_load_cacert(SSLSocketData *sd, JsVar *options) {
   JsVar *caVar = jsvObjectGetChild(options, "ca", 0);
   if (!caVar) {
-    return false;
+    return true; // optional
   }
   int ret = -1;
   jsiConsolePrintf("Loading the CA root certificate...\n");
@@ -494,6 +582,119 @@ bool ssl_load_cacert(SSLSocketData *sd, JsVar *options) {
   return true;
 }
 
+#if defined(MBEDTLS_KEY_EXCHANGE_PSK_ENABLED)
+/// Use a pre-shared key (options.psk and options.pskIdentity) if one was given
+bool ssl_load_psk(SSLSocketData *sd, JsVar *options) {
+  JsVar *pskVar = jsvObjectGetChild(options, "psk", 0);
+  if (!pskVar) {
+    return true; // optional
+  }
+  JsVar *identityVar = jsvObjectGetChild(options, "pskIdentity", 0);
+  int ret = MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+  if (identityVar) {
+    JSV_GET_AS_CHAR_ARRAY(pskPtr, pskLen, pskVar);
+    JSV_GET_AS_CHAR_ARRAY(identityPtr, identityLen, identityVar);
+    if (pskLen && pskPtr && identityLen && identityPtr) {
+      ret = mbedtls_ssl_conf_psk(&sd->conf, (const unsigned char *)pskPtr, pskLen,
+                                 (const unsigned char *)identityPtr, identityLen);
+    }
+  }
+  jsvUnLock2(pskVar, identityVar);
+  if (ret != 0) {
+    JsVar *e = jswrap_crypto_error_to_jsvar(ret);
+    jsError("HTTPS init failed! mbedtls_ssl_conf_psk (psk and pskIdentity needed): %v\n", e);
+    jsvUnLock(e);
+    return false;
+  }
+  return true;
+}
+#endif
+
+/// Work out the key ("host:port") sessions with the server in options are cached under
+static void ssl_getSessionKey(JsVar *options, char *key, size_t keyLen) {
+  key[0] = 0;
+  if (!jsvIsObject(options)) return;
+  JsVar *host = jsvObjectGetChild(options, "host", 0);
+  if (jsvIsString(host) && jsvGetStringLength(host)+7 < keyLen) {
+    int port = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(options, "port", 0));
+    espruino_snprintf(key, keyLen, "%v:%d", host, port);
+  }
+  jsvUnLock(host);
+}
+
+/** Remember the session from a completed handshake, so the next connection to the
+ * same server can resume it rather than doing the whole key exchange again. We don't
+ * keep the server's certificate as it isn't needed to resume, and is big. */
+static void ssl_saveSession(SSLSocketData *sd) {
+  const mbedtls_ssl_session *session = sd->ssl.session;
+  if (!sd->sessionKey[0] || !session) return;
+  mbedtls_ssl_session copy = *session;
+  size_t ticketLen = 0;
+#if defined(MBEDTLS_X509_CRT_PARSE_C)
+  copy.peer_cert = NULL;
+#endif
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+  ticketLen = copy.ticket_len;
+  copy.ticket = NULL;
+#endif
+  if (!copy.id_len && !ticketLen) return; // the server doesn't do resumption
+
+  JsVar *data = jsvNewFromEmptyString();
+  JsVar *cache = jsvObjectGetChild(execInfo.hiddenRoot, TLS_SESSION_CACHE_NAME, JSV_OBJECT);
+  if (data && cache) {
+    jsvAppendStringBuf(data, (const char *)&copy, sizeof(copy));
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    if (ticketLen) jsvAppendStringBuf(data, (const char *)session->ticket, ticketLen);
+#endif
+    JsVar *existing = jsvFindChildFromString(cache, sd->sessionKey, false);
+    if (!existing && jsvGetChildren(cache) >= TLS_SESSION_CACHE_SIZE) {
+      // forget the session we saved first
+      JsvObjectIterator it;
+      jsvObjectIteratorNew(&it, cache);
+      JsVar *oldest = jsvObjectIteratorGetKey(&it);
+      jsvObjectIteratorFree(&it);
+      if (oldest) jsvRemoveChild(cache, oldest);
+      jsvUnLock(oldest);
+    }
+    jsvUnLock(existing);
+    jsvObjectSetChild(cache, sd->sessionKey, data);
+  }
+  jsvUnLock2(data, cache);
+  memset(&copy, 0, sizeof(copy)); // don't leave the master secret on the stack
+}
+
+/// If we have a session saved for this server, ask to resume it
+static void ssl_loadSession(SSLSocketData *sd) {
+  if (!sd->sessionKey[0]) return;
+  JsVar *cache = jsvObjectGetChild(execInfo.hiddenRoot, TLS_SESSION_CACHE_NAME, 0);
+  JsVar *data = cache ? jsvObjectGetChild(cache, sd->sessionKey, 0) : 0;
+  jsvUnLock(cache);
+  if (!data) return;
+  mbedtls_ssl_session session;
+  if (jsvGetStringLength(data) >= sizeof(session)) {
+    char buf[sizeof(session)+1]; // jsvGetStringChars adds a trailing 0
+    jsvGetStringChars(data, 0, buf, sizeof(session));
+    memcpy(&session, buf, sizeof(session));
+    memset(buf, 0, sizeof(buf)); // don't leave the master secret on the stack
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    if (session.ticket_len) {
+      session.ticket = mbedtls_calloc(1, session.ticket_len+1); // +1 for the trailing 0
+      if (session.ticket)
+        jsvGetStringChars(data, sizeof(session), (char *)session.ticket, session.ticket_len);
+      else
+        session.ticket_len = 0;
+    }
+#endif
+    mbedtls_ssl_set_session(&sd->ssl, &session); // takes a copy
+    mbedtls_ssl_session_free(&session);
+  }
+  jsvUnLock(data);
+}
+
+void netClearTLSSessions() {
+  jsvRemoveNamedChild(execInfo.hiddenRoot, TLS_SESSION_CACHE_NAME);
+}
+
 bool ssl_newSocketData(int sckt, JsVar *options) {
   /* FIXME Warning:
    *
@@ -529,6 +730,7 @@ bool ssl_newSocketData(int sckt, JsVar *options) {
   // Now initialise this
   sd->sckt = sckt;
   sd->connecting = true;
+  ssl_getSessionKey(options, sd->sessionKey, sizeof(sd->sessionKey));
 
   jsiConsolePrintf( "Connecting with TLS...\n" );
 
@@ -581,6 +783,15 @@ bool ssl_newSocketData(int sckt, JsVar *options) {
       return false;
     }
   }
+#if defined(MBEDTLS_KEY_EXCHANGE_PSK_ENABLED)
+  if (jsvIsObject(options) && !ssl_load_psk(sd, options)) {
+    ssl_freeSocketData(sckt);
+    return false;
+  }
+#endif
+#ifdef TLS_MAX_FRAG_LEN
+  mbedtls_ssl_conf_max_frag_len( &sd->conf, TLS_MAX_FRAG_LEN );
+#endif
   // FIXME no cert checking!
   mbedtls_ssl_conf_authmode( &sd->conf, MBEDTLS_SSL_VERIFY_NONE );
   mbedtls_ssl_conf_ca_chain( &sd->conf, &sd->cacert, NULL );
@@ -595,7 +806,13 @@ bool ssl_newSocketData(int sckt, JsVar *options) {
     return false;
   }
 
-  if (( ret = mbedtls_ssl_set_hostname( &sd->ssl, "mbed TLS Server 1" )) != 0) {
+  // Send the real hostname (SNI), as servers may pick the certificate and session cache by it
+  char hostName[TLS_SESSION_KEY_LEN] = "mbed TLS Server 1";
+  JsVar *hostVar = jsvIsObject(options) ? jsvObjectGetChild(options, "host", 0) : 0;
+  if (jsvIsString(hostVar) && jsvGetStringLength(hostVar) < sizeof(hostName))
+    jsvGetString(hostVar, hostName, sizeof(hostName));
+  jsvUnLock(hostVar);
+  if (( ret = mbedtls_ssl_set_hostname( &sd->ssl, hostName )) != 0) {
     JsVar *e = jswrap_crypto_error_to_jsvar(ret);
     jsError("HTTPS init failed! mbedtls_ssl_set_hostname: %v\n", e );
     jsvUnLock(e);
@@ -604,6 +821,7 @@ bool ssl_newSocketData(int sckt, JsVar *options) {
   }
 
   mbedtls_ssl_set_bio( &sd->ssl, &sd->sckt, ssl_send, ssl_recv, NULL );
+  ssl_loadSession(sd);
 
   jsiConsolePrintf("Performing the SSL/TLS handshake...\n" );
 
@@ -648,6 +866,7 @@ SSLSocketData *ssl_getSocketData(int sckt) {
         return 0;
       }
       sd->connecting = false;
+      ssl_saveSession(sd);
     }
   }
 
@@ -658,18 +877,49 @@ SSLSocketData *ssl_getSocketData(int sckt) {
 #endif
 // ------------------------------------------------------------------------------
 
+void networkSetSocketReady(int sckt) {
+  if (sckt >= 0)
+    networkSocketsReady |= 1UL << (sckt & 31);
+}
+
+uint32_t networkTakeSocketsReady() {
+  jshInterruptOff();
+  uint32_t ready = networkSocketsReady;
+  networkSocketsReady = 0;
+  jshInterruptOn();
+  return ready;
+}
+
+bool networkIsSocketReady(JsNetwork *net, uint32_t ready, int sckt) {
+  if (!net->reportsReady || sckt < 0) return true;
+#ifdef USE_TLS
+  // mbedtls may have data buffered, or a handshake to carry on with
+  if (SOCKET_IS_HTTPS(sckt)) return true;
+#endif
+  return (ready >> (sckt & 31)) & 1;
+}
+
 bool netCheckError(JsNetwork *net) {
   return net->checkError(net);
 }
 
 int netCreateSocket(JsNetwork *net, uint32_t host, unsigned short port, NetCreateFlags flags, JsVar *options) {
-  int sckt = net->createsocket(net, host, port);
+  int sckt;
+  if (flags & NCF_UDP) {
+    if (!net->createsocketUDP) return SOCKET_ERR_UNSUPPORTED;
+    sckt = net->createsocketUDP(net, port);
+  } else
+    sckt = net->createsocket(net, host, port);
   if (sckt<0) return sckt;
 
 #ifdef USE_TLS
-  assert(sckt>=0 && sckt<32);
-  BITFIELD_SET(socketIsHTTPS, sckt, 0);
+  if (sckt < SOCKET_IS_HTTPS_MAX)
+    BITFIELD_SET(socketIsHTTPS, sckt, 0);
   if (flags & NCF_TLS) {
+    if (sckt >= SOCKET_IS_HTTPS_MAX) {
+      net->closesocket(net, sckt);
+      return SOCKET_ERR_MAX_SOCK;
+    }
     if (ssl_newSocketData(sckt, options)) {
       BITFIELD_SET(socketIsHTTPS, sckt, 1);
     } else {
@@ -682,7 +932,7 @@ int netCreateSocket(JsNetwork *net, uint32_t host, unsigned short port, NetCreat
 
 void netCloseSocket(JsNetwork *net, int sckt) {
 #ifdef USE_TLS
-  if (BITFIELD_GET(socketIsHTTPS, sckt)) {
+  if (SOCKET_IS_HTTPS(sckt)) {
     ssl_freeSocketData(sckt);
   }
 #endif
@@ -699,7 +949,7 @@ void netGetHostByName(JsNetwork *net, char * hostName, uint32_t* out_ip_addr) {
 
 int netRecv(JsNetwork *net, int sckt, void *buf, size_t len) {
 #ifdef USE_TLS
-  if (BITFIELD_GET(socketIsHTTPS, sckt)) {
+  if (SOCKET_IS_HTTPS(sckt)) {
     SSLSocketData *sd = ssl_getSocketData(sckt);
     if (!sd) return -1;
     if (sd->connecting) return 0; // busy
@@ -715,9 +965,41 @@ int netRecv(JsNetwork *net, int sckt, void *buf, size_t len) {
   }
 }
 
+int netRecvVar(JsNetwork *net, int sckt, JsVar **data, size_t len) {
+  if (net->recvVar
+#ifdef USE_TLS
+      && !SOCKET_IS_HTTPS(sckt)
+#endif
+      )
+    return net->recvVar(net, sckt, data, len);
+  // The driver can't create Strings itself, so go via a buffer
+  char *buf = alloca(len); // allocate on stack
+  int num = netRecv(net, sckt, buf, len);
+  if (num>0) {
+    *data = jsvNewFromEmptyString();
+    if (*data) jsvAppendStringBuf(*data, buf, (size_t)num);
+  }
+  return num;
+}
+
+void netSetRecvWindow(JsNetwork *net, int sckt, int bytes) {
+  if (net->setRecvWindow)
+    net->setRecvWindow(net, sckt, bytes);
+}
+
+void netSetNoDelay(JsNetwork *net, int sckt, bool noDelay) {
+  if (net->setNoDelay)
+    net->setNoDelay(net, sckt, noDelay);
+}
+
+JsVar *netGetStats(JsNetwork *net, int sckt) {
+  if (!net->getStats) return 0;
+  return net->getStats(net, sckt);
+}
+
 int netSend(JsNetwork *net, int sckt, const void *buf, size_t len) {
 #ifdef USE_TLS
-  if (BITFIELD_GET(socketIsHTTPS, sckt)) {
+  if (SOCKET_IS_HTTPS(sckt)) {
     SSLSocketData *sd = ssl_getSocketData(sckt);
     if (!sd) return -1;
     if (sd->connecting) return 0; // busy
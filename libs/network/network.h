@@ -28,7 +28,7 @@ typedef enum {
   NETWORKSTATE_INVOLUNTARY_DISCONNECT, // just randomly disconnected - maybe try and reconnect
 } PACKED_FLAGS JsNetworkState;
 
-extern JsNetworkState networkState; // FIXME put this in JsNetwork
+extern INSTANCE_LOCAL JsNetworkState networkState; // FIXME put this in JsNetwork
 
 // This is all code for handling multiple types of network access with one binary
 typedef enum {
@@ -70,10 +70,35 @@ typedef struct JsNetwork {
   void (*gethostbyname)(struct JsNetwork *net, char * hostName, uint32_t* out_ip_addr);
   /// Receive data if possible. returns nBytes on success, 0 on no data, or -1 on failure
   int (*recv)(struct JsNetwork *net, int sckt, void *buf, size_t len);
+  /** Optional (may be 0). Receive up to len bytes of data straight into a new String, which is
+   * returned in *data. This avoids copying via a buffer. Returns nBytes on success, 0 on no data, or -1 on failure */
+  int (*recvVar)(struct JsNetwork *net, int sckt, JsVar **data, size_t len);
+  /** Optional (may be 0). Set how many bytes may be queued for a socket before the driver stops
+   * accepting more from the network. If sckt<0, set the default for new sockets */
+  void (*setRecvWindow)(struct JsNetwork *net, int sckt, int bytes);
+  /// Optional (may be 0). Turn Nagle's algorithm off (noDelay=true) or back on for a TCP socket
+  void (*setNoDelay)(struct JsNetwork *net, int sckt, bool noDelay);
   /// Send data if possible. returns nBytes on success, 0 on no data, or -1 on failure
   int (*send)(struct JsNetwork *net, int sckt, const void *buf, size_t len);
+  /** Optional (may be 0). Create a UDP socket bound to the given local port (any port if 0). Returns >=0 on success.
+   * recv on a UDP socket returns as many whole datagrams as fit in len, each preceded by a JsNetUDPPacketHeader
+   * (a datagram that won't fit on its own is truncated), and send takes one datagram preceded by its header */
+  int (*createsocketUDP)(struct JsNetwork *net, unsigned short port);
+  /** Optional (may be 0). Return an object of statistics (bytes in/out, etc) for a socket,
+   * or totals for all sockets if sckt<0 */
+  JsVar *(*getStats)(struct JsNetwork *net, int sckt);
+  /** If true, the driver calls networkSetSocketReady whenever something happens on a socket, so
+   * sockets it hasn't marked as ready don't need polling (see networkIsSocketReady) */
+  bool reportsReady;
 } PACKED_FLAGS JsNetwork;
 
+/// The header before each datagram sent or received on a UDP socket
+typedef struct {
+  unsigned char host[4]; ///< IP address of the sender (received) or destination (sent), in order
+  unsigned short port;   ///< port of the sender or destination
+  unsigned short length; ///< number of bytes of data that follow
+} PACKED_FLAGS JsNetUDPPacketHeader;
+
 // ---------------------------------- these are in network.c
 // Get the relevant info for JsNetwork (done from a var in root scope)
 void networkCreate(JsNetwork *net, JsNetworkType type); // create the network object (ONLY to be used by network drivers)
@@ -84,10 +109,21 @@ void networkSet(JsNetwork *net);
 void networkFree(JsNetwork *net);
 
 JsNetwork *networkGetCurrent(); ///< Get the currently active network structure. can be 0!
+
+/// For drivers with reportsReady: note that data was received or sent, or the socket connected, closed or had an error
+void networkSetSocketReady(int sckt);
+/// Get the sockets marked as ready since this was last called (to pass to networkIsSocketReady), and clear them
+uint32_t networkTakeSocketsReady();
+/// Given the result of networkTakeSocketsReady, does this socket need polling? Always true if the driver doesn't report readiness
+bool networkIsSocketReady(JsNetwork *net, uint32_t ready, int sckt);
 // ---------------------------------------------------------
 
-/// Use this for getting the hostname, as it parses the name to see if it is an IP address first
+/// Use this for getting the hostname, as it parses the name to see if it is an IP address first (and caches lookups)
 void networkGetHostByName(JsNetwork *net, char * hostName, uint32_t* out_ip_addr);
+/// Remember the address a hostname resolved to - for drivers that resolve asynchronously
+void networkDNSCacheAdd(const char *hostName, uint32_t ip);
+/// Forget all cached hostname lookups
+void networkDNSCacheClear();
 uint32_t networkParseIPAddress(const char *ip);
 /* given 6 pairs of 8 bit hex numbers separated by ':', parse them into a
  * 6 byte array. returns false on failure */
@@ -101,13 +137,14 @@ unsigned long networkFlipIPAddress(unsigned long addr);
 
 typedef enum {
   NCF_NORMAL = 0,
-  NCF_TLS = 1
+  NCF_TLS = 1,
+  NCF_UDP = 2, ///< a UDP socket bound to the given port (host is ignored)
 } NetCreateFlags;
 
 /// Check for any errors and try and recover (CC3000 only really)
 bool netCheckError(JsNetwork *net);
 
-/// Create a socket (server (host==0) or client)
+/// Create a socket (server (host==0) or client, or UDP if flags has NCF_UDP)
 int netCreateSocket(JsNetwork *net, uint32_t host, unsigned short port, NetCreateFlags flags, JsVar *options);
 
 /// Ask this socket to close - it may not close immediately
@@ -119,6 +156,19 @@ int netAccept(JsNetwork *net, int sckt);
 
 void netGetHostByName(JsNetwork *net, char * hostName, uint32_t* out_ip_addr);
 int netRecv(JsNetwork *net, int sckt, void *buf, size_t len);
+/// Receive up to len bytes as a new String in *data (which is only set if >0 is returned)
+int netRecvVar(JsNetwork *net, int sckt, JsVar **data, size_t len);
 int netSend(JsNetwork *net, int sckt, const void *buf, size_t len);
+/// Set how many bytes may be received and queued for a socket (or the default if sckt<0), if the driver supports it
+void netSetRecvWindow(JsNetwork *net, int sckt, int bytes);
+/// Turn Nagle's algorithm off (noDelay=true) or on for a socket, if the driver supports it
+void netSetNoDelay(JsNetwork *net, int sckt, bool noDelay);
+/// Get statistics for a socket (or totals if sckt<0), or 0 if the driver doesn't keep them
+JsVar *netGetStats(JsNetwork *net, int sckt);
+
+#ifdef USE_TLS
+/// Forget the TLS sessions kept so connections can be resumed (on reset/save)
+void netClearTLSSessions();
+#endif
 
 #endif // _NETWORK_H
@@ -29,6 +29,12 @@ static char *socketErrors[] = {
   "SSL handshake failed",
   "invalid SSL data",
   "no response",
+  "headers too long",
+  "WebSocket handshake failed",
+  "invalid WebSocket frame",
+  "MQTT connection refused",
+  "invalid MQTT packet",
+  "not supported by this network",
 };
 
 char *socketErrorString(int error) {
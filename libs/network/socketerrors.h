@@ -32,7 +32,13 @@ typedef enum {
   SOCKET_ERR_SSL_HAND     = -13,
   SOCKET_ERR_SSL_INVALID  = -14,
   SOCKET_ERR_NO_RESP      = -15,
-  SOCKET_ERR_LAST         = -15, // not an error, just value of last error
+  SOCKET_ERR_HEADER_SIZE  = -16,
+  SOCKET_ERR_WS_HANDSHAKE = -17,
+  SOCKET_ERR_WS_FRAME     = -18,
+  SOCKET_ERR_MQTT_REFUSED = -19,
+  SOCKET_ERR_MQTT_PACKET  = -20,
+  SOCKET_ERR_UNSUPPORTED  = -21,
+  SOCKET_ERR_LAST         = -21, // not an error, just value of last error
 } SocketError;
 
 /// Return a pointer to an error string given the (negative) error code
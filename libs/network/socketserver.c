@@ -17,30 +17,114 @@
 #include "jsinteractive.h"
 #include "jshardware.h"
 #include "jswrap_stream.h"
+#include "jswrap_json.h"
+#ifdef USE_FILESYSTEM
+#include "jswrap_file.h"
+#endif
+#ifdef USE_CRYPTO
+#include "jswrap_functions.h"
+#include "mbedtls/include/mbedtls/sha1.h"
+#endif
+#ifdef USE_MQTT
+#include "mqtt.h"
+#endif
 
 #define HTTP_NAME_SOCKETTYPE "type" // normal socket or HTTP
 #define HTTP_NAME_PORT "port"
 #define HTTP_NAME_SOCKET "sckt"
 #define HTTP_NAME_HAD_HEADERS "hdrs"
+#define HTTP_NAME_HEADER_PARSER "hPrs" // HttpHeaderParser, while we're part way through the headers
 #define HTTP_NAME_RECEIVE_DATA "dRcv"
 #define HTTP_NAME_RECEIVE_COUNT "cRcv"
 #define HTTP_NAME_SEND_DATA "dSnd"
+#define HTTP_NAME_SEND_OFFSET "oSnd" // how much of dSnd has been sent
+#define HTTP_NAME_SEND_SOURCE "sSrc" // File, {addr,len} of flash or {json,pos,len} to read more data from when dSnd is empty
 #define HTTP_NAME_RESPONSE_VAR "res"
 #define HTTP_NAME_OPTIONS_VAR "opt"
 #define HTTP_NAME_SERVER_VAR "svr"
+#define HTTP_NAME_ROUTES "rts" // on an HTTP server: array of {m:method,p:path,h:handler}, see serverAddRoute
 #define HTTP_NAME_CHUNKED "chunked"
+#define HTTP_NAME_KEEP_ALIVE "keep" // boolean on a server response or client request: keep the connection open after it
+#define HTTP_NAME_POOL_KEY "pool"   // on a client request with keepAlive: "host:port" to keep its socket open under
+#define HTTP_NAME_CAN_CHUNK "cChk"  // boolean on a server response: the client can accept a chunked response
+#define HTTP_NAME_ACCEPT_ENCODING "aEnc" // the request's Accept-Encoding header, on a server response
+#define HTTP_NAME_NEXT_DATA "dNxt"  // data received after the end of this request, for the next one
+#define HTTP_NAME_IDLE_START "tIdl" // time a kept-alive connection started waiting for its next request
 #define HTTP_NAME_CLOSENOW "closeNow"  // boolean: gotta close
 #define HTTP_NAME_CONNECTED "conn"     // boolean: we are connected
 #define HTTP_NAME_CLOSE "close"        // close after sending
+#define HTTP_NAME_NO_DELAY "nDly"      // boolean: send data as soon as it's written, see clientRequestSetNoDelay
+#define HTTP_NAME_PAUSED "paused"      // boolean on a client response: don't deliver or receive data, see clientResponseSetPaused
 #define HTTP_NAME_ON_CONNECT JS_EVENT_PREFIX"connect"
 #define HTTP_NAME_ON_CLOSE JS_EVENT_PREFIX"close"
 #define HTTP_NAME_ON_END JS_EVENT_PREFIX"end"
 #define HTTP_NAME_ON_DRAIN JS_EVENT_PREFIX"drain"
 #define HTTP_NAME_ON_ERROR JS_EVENT_PREFIX"error"
+#define HTTP_NAME_ON_WEBSOCKET JS_EVENT_PREFIX"websocket"
+
+#define WS_NAME_SERVER "wsSv"   // boolean: we're the server end, so don't mask what we send
+#define WS_NAME_KEY "wsKy"      // the key a client sent, so it can check the server's reply
+#define WS_NAME_MESSAGE "wsMg"  // the fragments of a message received so far
+#define WS_NAME_CLOSING "wsCl"  // boolean: we've sent a close frame
+#define WS_NAME_ON_OPEN JS_EVENT_PREFIX"open"
+#define WS_NAME_ON_MESSAGE JS_EVENT_PREFIX"message"
+#define WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+#define DGRAM_NAME_ON_MESSAGE JS_EVENT_PREFIX"message"
+#define DGRAM_NAME_ON_LISTENING JS_EVENT_PREFIX"listening"
+
+typedef enum {
+  WS_OPCODE_CONTINUATION = 0,
+  WS_OPCODE_TEXT = 1,
+  WS_OPCODE_BINARY = 2,
+  WS_OPCODE_CLOSE = 8,
+  WS_OPCODE_PING = 9,
+  WS_OPCODE_PONG = 10,
+} WebSocketOpcode;
 
 #define HTTP_ARRAY_HTTP_CLIENT_CONNECTIONS "HttpCC"
 #define HTTP_ARRAY_HTTP_SERVERS "HttpS"
 #define HTTP_ARRAY_HTTP_SERVER_CONNECTIONS "HttpSC"
+#define HTTP_ARRAY_DGRAM_SOCKETS "HttpDG"
+#define HTTP_ARRAY_HTTP_CLIENT_POOL "HttpCP" // idle kept-alive client sockets, for the next request to the same server
+
+#ifndef HTTP_KEEP_ALIVE_TIMEOUT
+#define HTTP_KEEP_ALIVE_TIMEOUT 5000 // milliseconds to wait for the next request on a kept-alive connection
+#endif
+#ifndef HTTP_CLIENT_POOL_SIZE
+#define HTTP_CLIENT_POOL_SIZE 2 // how many idle kept-alive client sockets we keep open
+#endif
+#ifndef WEBSOCKET_MAX_MESSAGE_LENGTH
+#define WEBSOCKET_MAX_MESSAGE_LENGTH 16384 // close WebSockets that try to send us messages bigger than this
+#endif
+#ifndef DGRAM_MAX_LENGTH
+#define DGRAM_MAX_LENGTH 1472 // the most we'll send in one datagram (what fits in an Ethernet frame)
+#endif
+#ifndef HTTP_MAX_HEADER_LENGTH
+#define HTTP_MAX_HEADER_LENGTH 2048 // give up on a connection if its headers are longer than this
+#endif
+#ifndef SOCKET_POLL_INTERVAL
+#define SOCKET_POLL_INTERVAL 100 // milliseconds between looking at every connection, even if the network driver reports which are ready
+#endif
+
+/** If the network driver reports which sockets are ready, socketIdle only looks at the connections
+ * on those sockets. JS can write to or end a connection without the driver knowing though, so
+ * this is set whenever that happens and then every connection is looked at. */
+static INSTANCE_LOCAL bool socketsChanged = true;
+/// When socketIdle last looked at every connection
+static INSTANCE_LOCAL JsSysTime socketsLastPolled = 0;
+
+/// State for httpParseHeaders, kept between calls so received data is only scanned once
+typedef struct {
+  int pos;         ///< how much of the received data has been parsed
+  int lineStart;   ///< index of the start of the current line
+  int colonPos;    ///< index of the first ':' in the current line, or -1
+  int firstSpace;  ///< index of the first ' ' or '\r' in the first line, or -1
+  int secondSpace; ///< index of the second ' ' or '\r' in the first line, or -1
+  int firstEOL;    ///< index of the end of the first line, or -1
+  int lineNumber;
+  int newlineIdx;  ///< how much of '\r\n\r\n' we have just seen
+} HttpHeaderParser;
 
 #ifdef ESP8266
 // esp8266 debugging, need to remove this eventually
@@ -69,110 +153,173 @@ static void httpAppendHeaders(JsVar *string, JsVar *headerObject) {
   // free headers
 }
 
+/// Is the given header equal to 'value' (which should be lowercase), ignoring case?
+static bool httpHeaderIs(JsVar *headers, const char *name, const char *value) {
+  JsVar *v = jsvObjectGetChild(headers, name, 0);
+  bool eq = jsvHasCharacterData(v);
+  if (eq) {
+    JsvStringIterator it;
+    jsvStringIteratorNew(&it, v, 0);
+    while (jsvStringIteratorHasChar(&it) && *value) {
+      char ch = jsvStringIteratorGetChar(&it);
+      if (ch>='A' && ch<='Z') ch = (char)(ch + 'a' - 'A');
+      if (ch != *value) break;
+      value++;
+      jsvStringIteratorNext(&it);
+    }
+    eq = !*value && !jsvStringIteratorHasChar(&it);
+    jsvStringIteratorFree(&it);
+  }
+  jsvUnLock(v);
+  return eq;
+}
+
+/// Does an Accept-Encoding header value (eg. "gzip, deflate;q=0.5") allow the given encoding?
+static bool httpAcceptsEncoding(JsVar *acceptEncoding, JsVar *encoding) {
+  if (!jsvIsString(acceptEncoding) || !jsvIsString(encoding)) return false;
+  char accept[128], enc[16];
+  jsvGetString(acceptEncoding, accept, sizeof(accept));
+  size_t encLen = jsvGetString(encoding, enc, sizeof(enc));
+  char *p = accept;
+  while (*p) {
+    while (*p==' ' || *p==',') p++;
+    char *name = p;
+    while (*p && *p!=',' && *p!=';' && *p!=' ') p++;
+    size_t nameLen = (size_t)(p-name);
+    bool matches = nameLen==1 && *name=='*';
+    if (nameLen==encLen) {
+      size_t i;
+      matches = true;
+      for (i=0;i<nameLen;i++)
+        if ((name[i]|0x20) != (enc[i]|0x20)) matches = false; // ignore case
+    }
+    // check parameters - 'q=0' means this one is not acceptable
+    while (*p && *p!=',') {
+      if (*p=='q' && p[1]=='=') {
+        p += 2;
+        bool zero = *p=='0';
+        while (*p=='0' || *p=='.') p++;
+        if (zero && (*p<'1' || *p>'9')) matches = false;
+      } else p++;
+    }
+    if (matches) return true;
+  }
+  return false;
+}
+
+bool serverRequestAcceptsEncoding(JsVar *httpServerReqVar, JsVar *encoding) {
+  JsVar *headers = jsvObjectGetChild(httpServerReqVar, "headers", 0);
+  if (!headers) return false;
+  JsVar *acceptEncoding = jsvObjectGetChild(headers, "Accept-Encoding", 0);
+  bool accepts = httpAcceptsEncoding(acceptEncoding, encoding);
+  jsvUnLock2(acceptEncoding, headers);
+  return accepts;
+}
+
 // httpParseHeaders(&receiveData, reqVar, true) // server
 // httpParseHeaders(&receiveData, resVar, false) // client
-bool httpParseHeaders(JsVar **receiveData, JsVar *objectForData, bool isServer) {
-  // find /r/n/r/n
-  int newlineIdx = 0;
-  int strIdx = 0;
+int httpParseHeaders(JsVar **receiveData, JsVar *objectForData, bool isServer) {
+  HttpHeaderParser p;
+  JsVar *state = jsvObjectGetChild(objectForData, HTTP_NAME_HEADER_PARSER, 0);
+  if (state) {
+    char data[sizeof(p)+1]; // jsvGetStringChars adds a trailing 0
+    jsvGetStringChars(state, 0, data, sizeof(p));
+    memcpy(&p, data, sizeof(p));
+  } else {
+    p.pos = 0;
+    p.lineStart = 0;
+    p.colonPos = -1;
+    p.firstSpace = -1;
+    p.secondSpace = -1;
+    p.firstEOL = -1;
+    p.lineNumber = 0;
+    p.newlineIdx = 0;
+  }
+  JsVar *vHeaders = jsvObjectGetChild(objectForData, "headers", JSV_OBJECT);
+  if (!vHeaders) {
+    jsvUnLock(state);
+    return SOCKET_ERR_MEM;
+  }
+  // carry on from where we were last time, adding each header as its line completes
   int headerEnd = -1;
   JsvStringIterator it;
-  jsvStringIteratorNew(&it, *receiveData, 0);
+  jsvStringIteratorNew(&it, *receiveData, (size_t)p.pos);
   while (jsvStringIteratorHasChar(&it)) {
     char ch = jsvStringIteratorGetChar(&it);
+    if ((ch==' ' || ch=='\r') && p.lineNumber==0) {
+      if (p.firstSpace<0) p.firstSpace = p.pos;
+      else if (p.secondSpace<0) p.secondSpace = p.pos;
+    }
+    if (ch == ':' && p.colonPos<0) p.colonPos = p.pos;
     if (ch == '\r') {
-      if (newlineIdx==0) newlineIdx=1;
-      else if (newlineIdx==2) newlineIdx=3;
-    } else if (ch == '\n') {
-      if (newlineIdx==1) newlineIdx=2;
-      else if (newlineIdx==3) {
-        headerEnd = strIdx+1;
-        break;
+      if (p.firstEOL<0) p.firstEOL = p.pos;
+      if (p.lineNumber>0 && p.colonPos>p.lineStart && p.lineStart<p.pos) {
+        JsVar *hVal = jsvNewFromEmptyString();
+        if (hVal)
+          jsvAppendStringVar(hVal, *receiveData, (size_t)p.colonPos+2, (size_t)(p.pos-(p.colonPos+2)));
+        JsVar *hKey = jsvNewFromEmptyString();
+        if (hKey) {
+          jsvMakeIntoVariableName(hKey, hVal);
+          jsvAppendStringVar(hKey, *receiveData, (size_t)p.lineStart, (size_t)(p.colonPos-p.lineStart));
+          jsvAddName(vHeaders, hKey);
+          jsvUnLock(hKey);
+        }
+        jsvUnLock(hVal);
       }
-    } else newlineIdx=0;
+      p.lineNumber++;
+      p.colonPos = -1;
+    }
+    if (ch == '\r' || ch == '\n') {
+      p.lineStart = p.pos+1;
+    }
+    // look for \r\n\r\n
+    if (ch == '\r') {
+      if (p.newlineIdx==0) p.newlineIdx=1;
+      else if (p.newlineIdx==2) p.newlineIdx=3;
+    } else if (ch == '\n') {
+      if (p.newlineIdx==1) p.newlineIdx=2;
+      else if (p.newlineIdx==3) headerEnd = p.pos+1;
+    } else p.newlineIdx=0;
+    p.pos++;
+    if (headerEnd>=0) break;
     jsvStringIteratorNext(&it);
-    strIdx++;
   }
   jsvStringIteratorFree(&it);
-  // skip if we have no header
-  if (headerEnd<0) return false;
-  // Now parse the header
-  JsVar *vHeaders = jsvNewObject();
-  if (!vHeaders) return true;
-  jsvUnLock(jsvAddNamedChild(objectForData, vHeaders, "headers"));
-  strIdx = 0;
-  int firstSpace = -1;
-  int secondSpace = -1;
-  int firstEOL = -1;
-  int lineNumber = 0;
-  int lastLineStart = 0;
-  int colonPos = 0;
-  //jsiConsolePrintStringVar(receiveData);
-  jsvStringIteratorNew(&it, *receiveData, 0);
-    while (jsvStringIteratorHasChar(&it)) {
-      char ch = jsvStringIteratorGetChar(&it);
-      if (ch==' ' || ch=='\r') {
-        if (firstSpace<0) firstSpace = strIdx;
-        else if (secondSpace<0) secondSpace = strIdx;
-      }
-      if (ch == ':' && colonPos<0) colonPos = strIdx;
-      if (ch == '\r') {
-        if (firstEOL<0) firstEOL=strIdx;
-        if (lineNumber>0 && colonPos>lastLineStart && lastLineStart<strIdx) {
-          JsVar *hVal = jsvNewFromEmptyString();
-          if (hVal)
-            jsvAppendStringVar(hVal, *receiveData, (size_t)colonPos+2, (size_t)(strIdx-(colonPos+2)));
-          JsVar *hKey = jsvNewFromEmptyString();
-          if (hKey) {
-            jsvMakeIntoVariableName(hKey, hVal);
-            jsvAppendStringVar(hKey, *receiveData, (size_t)lastLineStart, (size_t)(colonPos-lastLineStart));
-            jsvAddName(vHeaders, hKey);
-            jsvUnLock(hKey);
-          }
-          jsvUnLock(hVal);
-        }
-        lineNumber++;
-        colonPos=-1;
-      }
-      if (ch == '\r' || ch == '\n') {
-        lastLineStart = strIdx+1;
-      }
+  jsvUnLock(vHeaders);
 
-      jsvStringIteratorNext(&it);
-      strIdx++;
+  if (headerEnd<0) {
+    if (p.pos > HTTP_MAX_HEADER_LENGTH) {
+      jsvUnLock(state);
+      jsvRemoveNamedChild(objectForData, HTTP_NAME_HEADER_PARSER);
+      return SOCKET_ERR_HEADER_SIZE;
     }
-    jsvStringIteratorFree(&it);
-  jsvUnLock(vHeaders);
+    // save where we got to for next time
+    if (!state) {
+      state = jsvNewStringOfLength(sizeof(p));
+      jsvObjectSetChild(objectForData, HTTP_NAME_HEADER_PARSER, state);
+    }
+    if (state) jsvSetString(state, (char*)&p, sizeof(p));
+    jsvUnLock(state);
+    return 0;
+  }
+  jsvUnLock(state);
+  jsvRemoveNamedChild(objectForData, HTTP_NAME_HEADER_PARSER);
   // try and pull out methods/etc
   if (isServer) {
-    jsvObjectSetChildAndUnLock(objectForData, "method", jsvNewFromStringVar(*receiveData, 0, (size_t)firstSpace));
-    jsvObjectSetChildAndUnLock(objectForData, "url", jsvNewFromStringVar(*receiveData, (size_t)(firstSpace+1), (size_t)(secondSpace-(firstSpace+1))));
+    jsvObjectSetChildAndUnLock(objectForData, "method", jsvNewFromStringVar(*receiveData, 0, (size_t)p.firstSpace));
+    jsvObjectSetChildAndUnLock(objectForData, "url", jsvNewFromStringVar(*receiveData, (size_t)(p.firstSpace+1), (size_t)(p.secondSpace-(p.firstSpace+1))));
+    if (p.firstEOL > p.secondSpace+6) // 'HTTP/x.x'
+      jsvObjectSetChildAndUnLock(objectForData, "httpVersion", jsvNewFromStringVar(*receiveData, (size_t)(p.secondSpace+6), (size_t)(p.firstEOL-(p.secondSpace+6))));
   } else {
-    jsvObjectSetChildAndUnLock(objectForData, "httpVersion", jsvNewFromStringVar(*receiveData, 5, (size_t)firstSpace-5));
-    jsvObjectSetChildAndUnLock(objectForData, "statusCode", jsvNewFromStringVar(*receiveData, (size_t)(firstSpace+1), (size_t)(secondSpace-(firstSpace+1))));
-    jsvObjectSetChildAndUnLock(objectForData, "statusMessage", jsvNewFromStringVar(*receiveData, (size_t)(secondSpace+1), (size_t)(firstEOL-(secondSpace+1))));
+    jsvObjectSetChildAndUnLock(objectForData, "httpVersion", jsvNewFromStringVar(*receiveData, 5, (size_t)p.firstSpace-5));
+    jsvObjectSetChildAndUnLock(objectForData, "statusCode", jsvNewFromStringVar(*receiveData, (size_t)(p.firstSpace+1), (size_t)(p.secondSpace-(p.firstSpace+1))));
+    jsvObjectSetChildAndUnLock(objectForData, "statusMessage", jsvNewFromStringVar(*receiveData, (size_t)(p.secondSpace+1), (size_t)(p.firstEOL-(p.secondSpace+1))));
   }
   // strip out the header
   JsVar *afterHeaders = jsvNewFromStringVar(*receiveData, (size_t)headerEnd, JSVAPPENDSTRINGVAR_MAXLENGTH);
   jsvUnLock(*receiveData);
   *receiveData = afterHeaders;
-  return true;
-}
-
-size_t httpStringGet(JsVar *v, char *str, size_t len) {
-  size_t l = len;
-  JsvStringIterator it;
-  jsvStringIteratorNew(&it, v, 0);
-  while (jsvStringIteratorHasChar(&it)) {
-    if (l--==0) {
-      jsvStringIteratorFree(&it);
-      return len;
-    }
-    *(str++) = jsvStringIteratorGetChar(&it);
-    jsvStringIteratorNext(&it);
-  }
-  jsvStringIteratorFree(&it);
-  return len-l;
+  return 1;
 }
 
 // -----------------------------
@@ -221,23 +368,32 @@ NO_INLINE static void _socketCloseAllConnections(JsNetwork *net) {
   _socketCloseAllConnectionsFor(net, HTTP_ARRAY_HTTP_SERVER_CONNECTIONS);
   _socketCloseAllConnectionsFor(net, HTTP_ARRAY_HTTP_CLIENT_CONNECTIONS);
   _socketCloseAllConnectionsFor(net, HTTP_ARRAY_HTTP_SERVERS);
+  _socketCloseAllConnectionsFor(net, HTTP_ARRAY_DGRAM_SOCKETS);
+  _socketCloseAllConnectionsFor(net, HTTP_ARRAY_HTTP_CLIENT_POOL);
 }
 
 // returns 0 on success and a (negative) error number on failure
 int socketSendData(JsNetwork *net, JsVar *connection, int sckt, JsVar **sendData) {
-  char *buf = alloca(net->chunkSize); // allocate on stack
+  char *buf = alloca(net->chunkSize+1); // allocate on stack, +1 for jsvGetStringChars' trailing 0
 
   assert(!jsvIsEmptyString(*sendData));
 
-  size_t bufLen = httpStringGet(*sendData, buf, net->chunkSize);
+  // How much of sendData we already sent. We don't cut it off straight away as that means copying everything that's left
+  size_t offset = (size_t)jsvGetIntegerAndUnLock(jsvObjectGetChild(connection,HTTP_NAME_SEND_OFFSET,0));
+  size_t bufLen = jsvGetStringChars(*sendData, offset, buf, (size_t)net->chunkSize);
   int num = netSend(net, sckt, buf, bufLen);
   if (num < 0) return num; // an error occurred
-  // Now cut what we managed to send off the beginning of sendData
   if (num > 0) {
+    offset += (size_t)num;
+    size_t len = jsvGetStringLength(*sendData);
     JsVar *newSendData = 0;
-    if (num < (int)jsvGetStringLength(*sendData)) {
-      // we didn't send all of it... cut out what we did send
-      newSendData = jsvNewFromStringVar(*sendData, (size_t)num, JSVAPPENDSTRINGVAR_MAXLENGTH);
+    if (offset < len) {
+      // we didn't send all of it... cut out what we did send, but only once it's more
+      // than what's left so the total amount copied is proportional to the data sent
+      if (offset > len-offset) {
+        newSendData = jsvNewFromStringVar(*sendData, offset, JSVAPPENDSTRINGVAR_MAXLENGTH);
+        offset = 0;
+      }
     } else {
       // we sent all of it! Issue a drain event, unless we want to close, then we shouldn't
       // callback for more data
@@ -246,14 +402,117 @@ int socketSendData(JsNetwork *net, JsVar *connection, int sckt, JsVar **sendData
         jsiQueueObjectCallbacks(connection, HTTP_NAME_ON_DRAIN, &connection, 1);
       }
       newSendData = jsvNewFromEmptyString();
+      offset = 0;
     }
-    jsvUnLock(*sendData);
-    *sendData = newSendData;
+    if (newSendData) {
+      jsvUnLock(*sendData);
+      *sendData = newSendData;
+    }
+    jsvObjectSetChildAndUnLock(connection, HTTP_NAME_SEND_OFFSET, jsvNewFromInteger((JsVarInt)offset));
   }
 
   return 0;
 }
 
+/// For sockets with setNoDelay(true), try and send what was just written straight away rather than waiting for socketIdle
+static void socketSendNow(JsNetwork *net, JsVar *connection, JsVar **sendData) {
+  if (!jsvGetBoolAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_NO_DELAY, 0))) return;
+  int sckt = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(connection,HTTP_NAME_SOCKET,0))-1; // so -1 if undefined
+  if (sckt<0 || jsvGetBoolAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_CLOSENOW, 0))) return;
+  // If this fails, sendData is left as it was and socketIdle will get the error when it tries again
+  if (socketSendData(net, connection, sckt, sendData) >= 0)
+    jsvObjectSetChild(connection, HTTP_NAME_SEND_DATA, *sendData);
+}
+
+/// If there's nothing left to send and we have a source of data (see serverResponseSendSource), read the next chunk from it
+static void socketFillSendData(JsNetwork *net, JsVar *socket, JsVar **sendData) {
+  if (*sendData && !jsvIsEmptyString(*sendData)) return;
+  JsVar *source = jsvObjectGetChild(socket, HTTP_NAME_SEND_SOURCE, 0);
+  if (!source) return;
+  JsVar *data = 0;
+  bool finished = true;
+  JsVar *addrVar = jsvObjectGetChild(source, "addr", 0);
+  JsVar *jsonVar;
+  if (addrVar) {
+    // flash memory
+    uint32_t addr = (uint32_t)jsvGetIntegerAndUnLock(addrVar);
+    uint32_t len = (uint32_t)jsvGetIntegerAndUnLock(jsvObjectGetChild(source, "len", 0));
+    uint32_t l = len < (uint32_t)net->chunkSize ? len : (uint32_t)net->chunkSize;
+    if (l) {
+      char *buf = alloca(l); // allocate on stack
+      jshFlashRead(buf, addr, l);
+      data = jsvNewFromEmptyString();
+      if (data) jsvAppendStringBuf(data, buf, l);
+      jsvObjectSetChildAndUnLock(source, "addr", jsvNewFromInteger((JsVarInt)(addr+l)));
+      jsvObjectSetChildAndUnLock(source, "len", jsvNewFromInteger((JsVarInt)(len-l)));
+      finished = len==l;
+    }
+  } else if ((jsonVar = jsvFindChildFromString(source, "json", false))) {
+    // an object to convert to JSON - we get the next part of the output each time
+    JsVar *obj = jsvSkipNameAndUnLock(jsonVar);
+    size_t pos = (size_t)jsvGetIntegerAndUnLock(jsvObjectGetChild(source, "pos", 0));
+    size_t len = (size_t)jsvGetIntegerAndUnLock(jsvObjectGetChild(source, "len", 0));
+    size_t l = len-pos < (size_t)net->chunkSize ? len-pos : (size_t)net->chunkSize;
+    if (pos < len) {
+      char *buf = alloca(l); // allocate on stack
+      jsfGetJSONSlice(obj, JSON_IGNORE_FUNCTIONS|JSON_NO_UNDEFINED, pos, buf, l);
+      data = jsvNewFromEmptyString();
+      if (data) jsvAppendStringBuf(data, buf, l);
+      jsvObjectSetChildAndUnLock(source, "pos", jsvNewFromInteger((JsVarInt)(pos+l)));
+      finished = pos+l >= len;
+    }
+    jsvUnLock(obj);
+  }
+#ifdef USE_FILESYSTEM
+  else {
+    // a File
+    data = jswrap_file_read(source, net->chunkSize);
+    finished = !data || jsvIsEmptyString(data);
+    if (finished) jswrap_file_close(source);
+  }
+#endif
+  if (finished)
+    jsvRemoveNamedChild(socket, HTTP_NAME_SEND_SOURCE);
+  jsvUnLock(source);
+  if (jsvGetBoolAndUnLock(jsvObjectGetChild(socket, HTTP_NAME_CHUNKED, 0))) {
+    // wrap up what we read as a chunk, and finish the response if that was the last of it
+    JsVar *chunk = jsvNewFromEmptyString();
+    if (chunk && !jsvIsEmptyString(data))
+      jsvAppendPrintf(chunk, "%x\r\n%v\r\n", jsvGetStringLength(data), data);
+    if (chunk && finished) {
+      jsvAppendString(chunk, "0\r\n\r\n");
+      jsvRemoveNamedChild(socket, HTTP_NAME_CHUNKED);
+    }
+    jsvUnLock(data);
+    data = chunk;
+  }
+  if (data) {
+    jsvUnLock(*sendData);
+    *sendData = data;
+    jsvObjectSetChild(socket, HTTP_NAME_SEND_DATA, *sendData);
+  }
+}
+
+static bool socketHasSendSource(JsVar *socket) {
+  JsVar *source = jsvObjectGetChild(socket, HTTP_NAME_SEND_SOURCE, 0);
+  jsvUnLock(source);
+  return source!=0;
+}
+
+/// Stop sending from a source of data, for instance because the connection has closed
+static void socketCloseSendSource(JsVar *socket) {
+  JsVar *source = jsvObjectGetChild(socket, HTTP_NAME_SEND_SOURCE, 0);
+  if (!source) return;
+#ifdef USE_FILESYSTEM
+  JsVar *addrVar = jsvObjectGetChild(source, "addr", 0);
+  JsVar *jsonVar = jsvFindChildFromString(source, "json", false);
+  if (!addrVar && !jsonVar) jswrap_file_close(source);
+  jsvUnLock2(addrVar, jsonVar);
+#endif
+  jsvUnLock(source);
+  jsvRemoveNamedChild(socket, HTTP_NAME_SEND_SOURCE);
+}
+
 // -----------------------------
 
 void socketInit() {
@@ -295,9 +554,554 @@ static bool fireErrorEvent(int error, JsVar *obj1, JsVar *obj2) {
 
 // -----------------------------
 
-bool socketServerConnectionsIdle(JsNetwork *net) {
-  char *buf = alloca(net->chunkSize); // allocate on stack
+/// Create a new request/response pair for a server connection on the given socket, and return the (locked) request
+static JsVar *httpServerConnectionNew(JsVar *server, int sckt) {
+  JsVar *req = jspNewObject(0, "httpSRq");
+  JsVar *res = jspNewObject(0, "httpSRs");
+  if (res && req) { // out of memory?
+    socketSetType(req, ST_HTTP);
+    JsVar *arr = socketGetArray(HTTP_ARRAY_HTTP_SERVER_CONNECTIONS, true);
+    if (arr) {
+      jsvArrayPush(arr, req);
+      jsvUnLock(arr);
+    }
+    jsvObjectSetChild(req, HTTP_NAME_RESPONSE_VAR, res);
+    jsvObjectSetChild(req, HTTP_NAME_SERVER_VAR, server);
+    jsvObjectSetChildAndUnLock(req, HTTP_NAME_SOCKET, jsvNewFromInteger(sckt+1));
+  } else {
+    jsvUnLock(req);
+    req = 0;
+  }
+  jsvUnLock(res);
+  return req;
+}
+
+/** Now we have a request's headers, work out whether the client wants to keep the connection open
+ * after it, and whether we can send it a chunked response */
+static void httpServerCheckRequest(JsVar *connection, JsVar *socket) {
+  JsVar *headers = jsvObjectGetChild(connection, "headers", 0);
+  if (!headers) return;
+  JsVar *version = jsvObjectGetChild(connection, "httpVersion", 0);
+  bool isHttp11 = jsvIsStringEqual(version, "1.1");
+  // responses to HEAD have no body, so mustn't have a final chunk either
+  if (isHttp11 && !jsvIsStringEqualAndUnLock(jsvObjectGetChild(connection, "method", 0), "HEAD"))
+    jsvObjectSetChildAndUnLock(socket, HTTP_NAME_CAN_CHUNK, jsvNewFromBool(true));
+  JsVar *acceptEncoding = jsvObjectGetChild(headers, "Accept-Encoding", 0);
+  if (acceptEncoding) jsvObjectSetChildAndUnLock(socket, HTTP_NAME_ACCEPT_ENCODING, acceptEncoding);
+  bool keepAlive = isHttp11 ?
+      !httpHeaderIs(headers, "Connection", "close") :
+      httpHeaderIs(headers, "Connection", "keep-alive");
+  // we can't tell where a chunked request body ends, so we wouldn't know where the next request starts
+  JsVar *encoding = jsvObjectGetChild(headers, "Transfer-Encoding", 0);
+  if (encoding) keepAlive = false;
+  jsvUnLock3(headers, version, encoding);
+  if (keepAlive)
+    jsvObjectSetChildAndUnLock(socket, HTTP_NAME_KEEP_ALIVE, jsvNewFromBool(true));
+}
+
+/// Does this route (see serverAddRoute) match the request's method and the path of its url (the first pathLen characters)?
+static bool httpRouteMatches(JsVar *route, JsVar *method, JsVar *url, size_t pathLen) {
+  JsVar *routeMethod = jsvObjectGetChild(route, "m", 0);
+  bool match = !routeMethod || jsvCompareString(routeMethod, method, 0, 0, false)==0;
+  jsvUnLock(routeMethod);
+  if (!match) return false;
+  JsVar *path = jsvObjectGetChild(route, "p", 0);
+  size_t len = jsvGetStringLength(path);
+  // the route's path must be the request's, or the start of it up to a '/' (but "/" on its own is only the root)
+  match = len<=pathLen && jsvCompareString(path, url, 0, 0, true)==0 &&
+      (len==pathLen || jsvGetCharInString(url, len)=='/' || (len>1 && jsvGetCharInString(path, len-1)=='/'));
+  jsvUnLock(path);
+  return match;
+}
+
+/** Give a request to the first of the server's routes that matches it. Returns false if there are
+ * no routes, or none matched and the request should go to the server's callback */
+static bool httpServerRoute(JsVar *server, JsVar *req, JsVar *res) {
+  JsVar *routes = jsvObjectGetChild(server, HTTP_NAME_ROUTES, 0);
+  if (!routes) return false;
+  JsVar *method = jsvObjectGetChild(req, "method", 0);
+  JsVar *url = jsvObjectGetChild(req, "url", 0);
+  int queryStart = jsvGetStringIndexOf(url, '?');
+  size_t pathLen = (queryStart>=0) ? (size_t)queryStart : jsvGetStringLength(url);
+  JsVar *handler = 0;
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, routes);
+  while (!handler && jsvObjectIteratorHasValue(&it)) {
+    JsVar *route = jsvObjectIteratorGetValue(&it);
+    if (httpRouteMatches(route, method, url, pathLen))
+      handler = jsvObjectGetChild(route, "h", 0);
+    jsvUnLock(route);
+    jsvObjectIteratorNext(&it);
+  }
+  jsvObjectIteratorFree(&it);
+  jsvUnLock3(routes, method, url);
+
+  if (!handler) {
+    JsVar *callback = jsvObjectGetChild(server, HTTP_NAME_ON_CONNECT, 0);
+    bool hasCallback = callback!=0;
+    jsvUnLock(callback);
+    if (hasCallback) return false;
+    // there's nothing else that could handle this
+    JsVar *headers = jsvNewObject();
+    if (headers) jsvObjectSetChildAndUnLock(headers, "Content-Length", jsvNewFromInteger(0));
+    serverResponseWriteHead(res, 404, headers);
+    jsvUnLock(headers);
+    serverResponseEnd(res);
+  } else if (jsvIsFunction(handler)) {
+    JsVar *args[2] = { req, res };
+    jsiQueueEvents(server, handler, args, 2);
+  } else {
+    // data in flash memory - send it without running any JS. Sending uses up the source, so make a new one
+    JsVar *source = jsvNewObject();
+    if (source) {
+      int length = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(handler, "len", 0));
+      jsvObjectSetChildAndUnLock(source, "addr", jsvObjectGetChild(handler, "addr", 0));
+      jsvObjectSetChildAndUnLock(source, "len", jsvNewFromInteger(length));
+      JsVar *mimeType = jsvObjectGetChild(handler, "type", 0);
+      JsVar *encoding = jsvObjectGetChild(handler, "encoding", 0);
+      serverResponseSendSource(res, source, mimeType, length, encoding);
+      jsvUnLock3(mimeType, encoding, source);
+    }
+  }
+  jsvUnLock(handler);
+  return true;
+}
+
+/// The current time in milliseconds, wrapping at 32 bits. Integer maths throughout, as a float (USE_FLOATS) can't hold the full time accurately
+static uint32_t httpGetIdleTime() {
+  return (uint32_t)(jshGetSystemTime() / jshGetTimeFromMilliseconds(1));
+}
+
+/// Mark a kept-alive connection as idle from now
+static void httpSetIdleStart(JsVar *obj) {
+  jsvObjectSetChildAndUnLock(obj, HTTP_NAME_IDLE_START, jsvNewFromInteger((JsVarInt)httpGetIdleTime()));
+}
+
+/// Has a connection marked with httpSetIdleStart been idle for longer than HTTP_KEEP_ALIVE_TIMEOUT?
+static bool httpIdleTimedOut(JsVar *obj) {
+  JsVar *idleStart = jsvObjectGetChild(obj, HTTP_NAME_IDLE_START, 0);
+  if (!idleStart) return false;
+  return httpGetIdleTime() - (uint32_t)jsvGetIntegerAndUnLock(idleStart) > HTTP_KEEP_ALIVE_TIMEOUT;
+}
+
+/// A kept-alive request has finished - start a new request on the same socket using any data we already have for it
+static void httpServerConnectionRenew(JsNetwork *net, JsVar *connection) {
+  JsVar *server = jsvObjectGetChild(connection, HTTP_NAME_SERVER_VAR, 0);
+  int sckt = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(connection,HTTP_NAME_SOCKET,0))-1;
+  JsVar *req = httpServerConnectionNew(server, sckt);
+  jsvUnLock(server);
+  if (!req) { // out of memory - just close it
+    _socketConnectionKill(net, connection);
+    return;
+  }
+  JsVar *nextData = jsvObjectGetChild(connection, HTTP_NAME_NEXT_DATA, 0);
+  if (nextData)
+    jsvObjectSetChildAndUnLock(req, HTTP_NAME_RECEIVE_DATA, nextData);
+  httpSetIdleStart(req);
+  jsvUnLock(req);
+  jsvObjectSetChild(connection, HTTP_NAME_SOCKET, 0); // the socket belongs to the new request now
+}
+
+/** Now we have a client request's response headers, work out whether we can keep the socket
+ * open for the next request to the same server once we've received the response */
+static void httpClientCheckResponse(JsVar *connection, JsVar *res) {
+  JsVar *poolKey = jsvObjectGetChild(connection, HTTP_NAME_POOL_KEY, 0);
+  JsVar *headers = jsvObjectGetChild(res, "headers", 0);
+  if (!poolKey || !headers) {
+    jsvUnLock2(poolKey, headers);
+    return;
+  }
+  JsVar *version = jsvObjectGetChild(res, "httpVersion", 0);
+  bool keepAlive = jsvIsStringEqual(version, "1.1") ?
+      !httpHeaderIs(headers, "Connection", "close") :
+      httpHeaderIs(headers, "Connection", "keep-alive");
+  // we can only tell where the response ends if we're told its length (and a HEAD response has no body)
+  JsVar *length = jsvObjectGetChild(headers, "Content-Length", 0);
+  JsVar *encoding = jsvObjectGetChild(headers, "Transfer-Encoding", 0);
+  JsVar *options = jsvObjectGetChild(connection, HTTP_NAME_OPTIONS_VAR, 0);
+  if (!length || encoding ||
+      jsvIsStringEqualAndUnLock(jsvObjectGetChild(options, "method", 0), "HEAD"))
+    keepAlive = false;
+  jsvUnLock3(version, length, encoding);
+  jsvUnLock3(options, headers, poolKey);
+  if (keepAlive)
+    jsvObjectSetChildAndUnLock(connection, HTTP_NAME_KEEP_ALIVE, jsvNewFromBool(true));
+}
+
+/** Returns >0 if we have received more than the whole of a kept-alive response, 0 if we
+ * have received exactly all of it and the socket can be reused, or <0 if it isn't finished */
+static JsVarInt httpClientResponseRemaining(JsVar *connection, JsVar *res) {
+  if (!jsvGetBoolAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_KEEP_ALIVE, 0))) return -1;
+  JsVar *headers = jsvObjectGetChild(res, "headers", 0);
+  JsVarInt contentLength = headers ? jsvGetIntegerAndUnLock(jsvObjectGetChild(headers, "Content-Length", 0)) : 0;
+  jsvUnLock(headers);
+  return jsvGetIntegerAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_RECEIVE_COUNT, 0)) - contentLength;
+}
+
+/// A kept-alive client request has finished - keep its socket open for the next request to the same server
+static void httpClientPoolAdd(JsNetwork *net, JsVar *connection) {
+  JsVar *arr = socketGetArray(HTTP_ARRAY_HTTP_CLIENT_POOL, true);
+  JsVar *entry = arr ? jsvNewObject() : 0;
+  if (!entry) { // out of memory - just close it
+    jsvUnLock(arr);
+    _socketConnectionKill(net, connection);
+    return;
+  }
+  if (jsvGetArrayLength(arr) >= HTTP_CLIENT_POOL_SIZE) {
+    // close the socket that has been idle longest
+    JsVar *oldest = jsvArrayPopFirst(arr);
+    _socketConnectionKill(net, oldest);
+    jsvUnLock(oldest);
+  }
+  jsvObjectSetChildAndUnLock(entry, HTTP_NAME_SOCKET, jsvObjectGetChild(connection, HTTP_NAME_SOCKET, 0));
+  jsvObjectSetChildAndUnLock(entry, HTTP_NAME_POOL_KEY, jsvObjectGetChild(connection, HTTP_NAME_POOL_KEY, 0));
+  httpSetIdleStart(entry);
+  jsvArrayPush(arr, entry);
+  jsvUnLock2(entry, arr);
+  jsvObjectSetChild(connection, HTTP_NAME_SOCKET, 0); // the pool has the socket now
+}
+
+/// Take an idle socket to the server with the given pool key out of the pool, or return -1
+static int httpClientPoolTake(JsVar *poolKey) {
+  JsVar *arr = socketGetArray(HTTP_ARRAY_HTTP_CLIENT_POOL, false);
+  if (!arr) return -1;
+  int sckt = -1;
+  JsVar *entryName = 0;
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, arr);
+  while (!entryName && jsvObjectIteratorHasValue(&it)) {
+    JsVar *entry = jsvObjectIteratorGetValue(&it);
+    JsVar *entryKey = jsvObjectGetChild(entry, HTTP_NAME_POOL_KEY, 0);
+    if (jsvIsBasicVarEqual(entryKey, poolKey)) {
+      sckt = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(entry, HTTP_NAME_SOCKET, 0))-1;
+      entryName = jsvObjectIteratorGetKey(&it);
+    }
+    jsvUnLock2(entryKey, entry);
+    jsvObjectIteratorNext(&it);
+  }
+  jsvObjectIteratorFree(&it);
+  if (entryName) jsvRemoveChild(arr, entryName);
+  jsvUnLock2(entryName, arr);
+  return sckt;
+}
+
+/// Close idle client sockets that have timed out, or that the server has closed
+static bool socketClientPoolIdle(JsNetwork *net) {
+  JsVar *arr = socketGetArray(HTTP_ARRAY_HTTP_CLIENT_POOL, false);
+  if (!arr) return false;
+  bool hadSockets = false;
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, arr);
+  while (jsvObjectIteratorHasValue(&it)) {
+    hadSockets = true;
+    JsVar *entry = jsvObjectIteratorGetValue(&it);
+    int sckt = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(entry, HTTP_NAME_SOCKET, 0))-1;
+    bool closeNow = httpIdleTimedOut(entry);
+    if (!closeNow) {
+      // the server shouldn't send anything until we make a request, so data means it's closing
+      char buf[1];
+      closeNow = netRecv(net, sckt, buf, sizeof(buf)) != 0;
+    }
+    if (closeNow) {
+      _socketConnectionKill(net, entry);
+      JsVar *entryName = jsvObjectIteratorGetKey(&it);
+      jsvObjectIteratorNext(&it);
+      jsvRemoveChild(arr, entryName);
+      jsvUnLock(entryName);
+    } else
+      jsvObjectIteratorNext(&it);
+    jsvUnLock(entry);
+  }
+  jsvObjectIteratorFree(&it);
+  jsvUnLock(arr);
+  return hadSockets;
+}
+
+// -----------------------------
+#ifdef USE_CRYPTO
+
+/// Work out what the server should reply with for a given Sec-WebSocket-Key
+static JsVar *webSocketGetAcceptKey(JsVar *key) {
+  char buf[64 + sizeof(WS_GUID)];
+  size_t l = jsvGetString(key, buf, 64);
+  if (l>=64) return 0; // keys are only meant to be 24 characters
+  strcpy(&buf[l], WS_GUID);
+  unsigned char hash[20];
+  mbedtls_sha1((unsigned char *)buf, l+strlen(WS_GUID), hash);
+  JsVar *hashStr = jsvNewStringOfLength(sizeof(hash));
+  if (!hashStr) return 0;
+  jsvSetString(hashStr, (char *)hash, sizeof(hash));
+  JsVar *acceptKey = jswrap_btoa(hashStr);
+  jsvUnLock(hashStr);
+  return acceptKey;
+}
+
+/// Append a single frame (always with FIN set) containing payload to sendData, masking it if we're the client
+static void webSocketAppendFrame(JsVar *sendData, WebSocketOpcode opcode, JsVar *payload, bool mask) {
+  size_t len = payload ? jsvGetStringLength(payload) : 0;
+  char hdr[14];
+  size_t h = 0;
+  char maskBit = mask ? (char)0x80 : 0;
+  hdr[h++] = (char)(0x80 | opcode);
+  if (len < 126) {
+    hdr[h++] = (char)(maskBit | (char)len);
+  } else if (len < 65536) {
+    hdr[h++] = (char)(maskBit | 126);
+    hdr[h++] = (char)(len >> 8);
+    hdr[h++] = (char)len;
+  } else {
+    hdr[h++] = (char)(maskBit | 127);
+    hdr[h++] = 0;
+    hdr[h++] = 0;
+    hdr[h++] = 0;
+    hdr[h++] = 0;
+    hdr[h++] = (char)(len >> 24);
+    hdr[h++] = (char)(len >> 16);
+    hdr[h++] = (char)(len >> 8);
+    hdr[h++] = (char)len;
+  }
+  char maskKey[4];
+  if (mask) {
+    unsigned int r = jshGetRandomNumber();
+    int i;
+    for (i=0;i<4;i++) {
+      maskKey[i] = (char)(r >> (i*8));
+      hdr[h++] = maskKey[i];
+    }
+  }
+  jsvAppendStringBuf(sendData, hdr, h);
+  if (!len) return;
+  if (!mask) {
+    jsvAppendStringVarComplete(sendData, payload);
+    return;
+  }
+  char buf[32];
+  size_t n = 0, i = 0;
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, payload, 0);
+  while (jsvStringIteratorHasChar(&it)) {
+    buf[n++] = (char)(jsvStringIteratorGetChar(&it) ^ maskKey[(i++)&3]);
+    if (n==sizeof(buf)) {
+      jsvAppendStringBuf(sendData, buf, n);
+      n = 0;
+    }
+    jsvStringIteratorNext(&it);
+  }
+  jsvStringIteratorFree(&it);
+  if (n) jsvAppendStringBuf(sendData, buf, n);
+}
+
+static void webSocketSendFrame(JsVar *webSocketVar, WebSocketOpcode opcode, JsVar *payload) {
+  JsVar *sendData = jsvObjectGetChild(webSocketVar, HTTP_NAME_SEND_DATA, 0);
+  if (!sendData) {
+    sendData = jsvNewFromEmptyString();
+    jsvObjectSetChild(webSocketVar, HTTP_NAME_SEND_DATA, sendData);
+  }
+  if (sendData) {
+    bool isServer = jsvGetBoolAndUnLock(jsvObjectGetChild(webSocketVar, WS_NAME_SERVER, 0));
+    webSocketAppendFrame(sendData, opcode, payload, !isServer);
+  }
+  jsvUnLock(sendData);
+}
+
+void webSocketSend(JsVar *webSocketVar, JsVar *data) {
+  socketsChanged = true;
+  if (jsvGetBoolAndUnLock(jsvObjectGetChild(webSocketVar, WS_NAME_CLOSING, 0))) return;
+  JsVar *s = jsvAsString(data, false);
+  if (s) webSocketSendFrame(webSocketVar, WS_OPCODE_TEXT, s);
+  jsvUnLock(s);
+}
+
+void webSocketClose(JsVar *webSocketVar) {
+  socketsChanged = true;
+  if (jsvGetBoolAndUnLock(jsvObjectGetChild(webSocketVar, WS_NAME_CLOSING, 0))) return;
+  JsVar *status = jsvNewFromString("\x03\xE8"); // 1000 = normal closure
+  webSocketSendFrame(webSocketVar, WS_OPCODE_CLOSE, status);
+  jsvUnLock(status);
+  jsvObjectSetChildAndUnLock(webSocketVar, WS_NAME_CLOSING, jsvNewFromBool(true));
+  jsvObjectSetChildAndUnLock(webSocketVar, HTTP_NAME_CLOSE, jsvNewFromBool(true));
+}
+
+/** Decode all the complete frames in receiveData, firing 'message' events and replying to pings and
+ * close frames. Anything left over is stored for next time. Returns 0, or a (negative) error */
+static int webSocketReceive(JsVar *webSocketVar, JsVar **receiveData) {
+  if (!*receiveData) return 0;
+  bool isServer = jsvGetBoolAndUnLock(jsvObjectGetChild(webSocketVar, WS_NAME_SERVER, 0));
+  size_t len = jsvGetStringLength(*receiveData);
+  size_t pos = 0;
+  int error = 0;
+  while (len-pos >= 2) {
+    unsigned char hdr[15]; // up to 14 bytes of header, and the trailing 0 from jsvGetStringChars
+    size_t h = jsvGetStringChars(*receiveData, pos, (char *)hdr, 14);
+    bool fin = (hdr[0]&0x80)!=0;
+    WebSocketOpcode opcode = (WebSocketOpcode)(hdr[0]&15);
+    bool masked = (hdr[1]&0x80)!=0;
+    size_t payloadLen = hdr[1]&127;
+    size_t hdrLen = 2;
+    if (payloadLen==126) {
+      hdrLen = 4;
+      payloadLen = ((size_t)hdr[2]<<8) | hdr[3];
+    } else if (payloadLen==127) {
+      hdrLen = 10;
+      if (hdr[2]|hdr[3]|hdr[4]|hdr[5]) payloadLen = WEBSOCKET_MAX_MESSAGE_LENGTH+1;
+      else payloadLen = ((size_t)hdr[6]<<24) | ((size_t)hdr[7]<<16) | ((size_t)hdr[8]<<8) | hdr[9];
+    }
+    if (masked) hdrLen += 4;
+    if (h < hdrLen) break; // wait for the rest of the header
+    // clients must mask what they send, and servers mustn't
+    if (masked != isServer || payloadLen > WEBSOCKET_MAX_MESSAGE_LENGTH) {
+      error = SOCKET_ERR_WS_FRAME;
+      break;
+    }
+    if (len-pos < hdrLen+payloadLen) break; // wait for the rest of the frame
+    JsVar *payload = jsvNewFromStringVar(*receiveData, pos+hdrLen, payloadLen);
+    if (!payload) break; // out of memory - try again later
+    pos += hdrLen+payloadLen;
+    if (masked) {
+      unsigned char *maskKey = &hdr[hdrLen-4];
+      size_t i = 0;
+      JsvStringIterator it;
+      jsvStringIteratorNew(&it, payload, 0);
+      while (jsvStringIteratorHasChar(&it)) {
+        jsvStringIteratorSetChar(&it, (char)(jsvStringIteratorGetChar(&it) ^ maskKey[(i++)&3]));
+        jsvStringIteratorNext(&it);
+      }
+      jsvStringIteratorFree(&it);
+    }
+    if (opcode==WS_OPCODE_PING) {
+      webSocketSendFrame(webSocketVar, WS_OPCODE_PONG, payload);
+    } else if (opcode==WS_OPCODE_CLOSE) {
+      // reply with a close frame of our own (unless we started closing) and close once it's sent
+      if (!jsvGetBoolAndUnLock(jsvObjectGetChild(webSocketVar, WS_NAME_CLOSING, 0))) {
+        webSocketSendFrame(webSocketVar, WS_OPCODE_CLOSE, payload);
+        jsvObjectSetChildAndUnLock(webSocketVar, WS_NAME_CLOSING, jsvNewFromBool(true));
+      }
+      jsvObjectSetChildAndUnLock(webSocketVar, HTTP_NAME_CLOSE, jsvNewFromBool(true));
+    } else if (opcode<=WS_OPCODE_BINARY) {
+      // add to any fragments we already had
+      JsVar *message = jsvObjectGetChild(webSocketVar, WS_NAME_MESSAGE, 0);
+      if (message) {
+        jsvAppendStringVarComplete(message, payload);
+        jsvUnLock(payload);
+        payload = message;
+        if (jsvGetStringLength(message) > WEBSOCKET_MAX_MESSAGE_LENGTH)
+          error = SOCKET_ERR_WS_FRAME;
+      }
+      if (fin) {
+        if (message) jsvRemoveNamedChild(webSocketVar, WS_NAME_MESSAGE);
+        jsiQueueObjectCallbacks(webSocketVar, WS_NAME_ON_MESSAGE, &payload, 1);
+      } else if (!message) {
+        jsvObjectSetChild(webSocketVar, WS_NAME_MESSAGE, payload);
+      }
+    } // else it's a pong, or something we don't understand - ignore it
+    jsvUnLock(payload);
+    if (error) break;
+  }
+  if (pos) {
+    JsVar *rest = pos<len ? jsvNewFromStringVar(*receiveData, pos, JSVAPPENDSTRINGVAR_MAXLENGTH) : 0;
+    jsvUnLock(*receiveData);
+    *receiveData = rest;
+    jsvObjectSetChild(webSocketVar, HTTP_NAME_RECEIVE_DATA, rest);
+  }
+  return error;
+}
+
+void webSocketClientHandshake(JsVar *webSocketVar) {
+  JsVar *options = jsvObjectGetChild(webSocketVar, HTTP_NAME_OPTIONS_VAR, 0);
+  if (!options) return;
+  // a random key, which the server has to hash to show it really understood us
+  char keyBytes[16];
+  int i;
+  for (i=0;i<16;i++) keyBytes[i] = (char)jshGetRandomNumber();
+  JsVar *keyStr = jsvNewStringOfLength(sizeof(keyBytes));
+  if (keyStr) jsvSetString(keyStr, keyBytes, sizeof(keyBytes));
+  JsVar *key = keyStr ? jswrap_btoa(keyStr) : 0;
+  jsvUnLock(keyStr);
+  if (!key) {
+    jsvUnLock(options);
+    return;
+  }
+  jsvObjectSetChild(webSocketVar, WS_NAME_KEY, key);
+
+  JsVar *path = jsvObjectGetChild(options, "path", 0);
+  if (!jsvIsString(path)) {
+    jsvUnLock(path);
+    path = jsvNewFromString("/");
+  }
+  JsVar *host = jsvObjectGetChild(options, "host", 0);
+  int port = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(options, "port", 0));
+  JsVar *sendData = jsvVarPrintf("GET %v HTTP/1.1\r\nUser-Agent: Espruino "JS_VERSION"\r\n", path);
+  if (sendData) {
+    if (port>0 && port!=80)
+      jsvAppendPrintf(sendData, "Host: %v:%d\r\n", host, port);
+    else
+      jsvAppendPrintf(sendData, "Host: %v\r\n", host);
+    jsvAppendPrintf(sendData, "Upgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Key: %v\r\nSec-WebSocket-Version: 13\r\n", key);
+    JsVar *headers = jsvObjectGetChild(options, "headers", 0);
+    if (jsvIsObject(headers)) httpAppendHeaders(sendData, headers);
+    jsvUnLock(headers);
+    jsvAppendString(sendData, "\r\n");
+    jsvObjectSetChildAndUnLock(webSocketVar, HTTP_NAME_SEND_DATA, sendData);
+  }
+  jsvUnLock2(path, host);
+  jsvUnLock2(key, options);
+}
+
+/// Check the server's response (already parsed into webSocketVar) accepts our upgrade request
+static bool webSocketClientCheckHandshake(JsVar *webSocketVar) {
+  JsVar *key = jsvObjectGetChild(webSocketVar, WS_NAME_KEY, 0);
+  JsVar *acceptKey = webSocketGetAcceptKey(key);
+  jsvUnLock(key);
+  jsvRemoveNamedChild(webSocketVar, WS_NAME_KEY);
+  JsVar *headers = jsvObjectGetChild(webSocketVar, "headers", 0);
+  JsVar *serverAcceptKey = headers ? jsvObjectGetChild(headers, "Sec-WebSocket-Accept", 0) : 0;
+  bool ok = jsvIsStringEqualAndUnLock(jsvObjectGetChild(webSocketVar, "statusCode", 0), "101") &&
+            acceptKey && serverAcceptKey && jsvCompareString(acceptKey, serverAcceptKey, 0, 0, false)==0;
+  jsvUnLock3(acceptKey, serverAcceptKey, headers);
+  return ok;
+}
+
+/** If a server request we just got the headers for asks to upgrade to a WebSocket (and the server
+ * has a 'websocket' listener), reply and hand its socket (and any data after the headers) over to a
+ * new WebSocket object. Returns true if it did */
+static bool webSocketServerUpgrade(JsVar *connection, JsVar *receiveData) {
+  JsVar *server = jsvObjectGetChild(connection, HTTP_NAME_SERVER_VAR, 0);
+  JsVar *listener = server ? jsvObjectGetChild(server, HTTP_NAME_ON_WEBSOCKET, 0) : 0;
+  JsVar *headers = jsvObjectGetChild(connection, "headers", 0);
+  JsVar *acceptKey = 0;
+  if (listener && headers && httpHeaderIs(headers, "Upgrade", "websocket")) {
+    JsVar *key = jsvObjectGetChild(headers, "Sec-WebSocket-Key", 0);
+    if (jsvIsString(key)) acceptKey = webSocketGetAcceptKey(key);
+    jsvUnLock(key);
+  }
+  jsvUnLock2(listener, headers);
+  JsVar *ws = acceptKey ? jspNewObject(0, "WebSocket") : 0;
+  JsVar *arr = ws ? socketGetArray(HTTP_ARRAY_HTTP_CLIENT_CONNECTIONS, true) : 0;
+  if (!arr) {
+    jsvUnLock3(server, acceptKey, ws);
+    return false;
+  }
+  socketSetType(ws, ST_WEBSOCKET);
+  jsvObjectSetChildAndUnLock(ws, WS_NAME_SERVER, jsvNewFromBool(true));
+  jsvObjectSetChildAndUnLock(ws, HTTP_NAME_CONNECTED, jsvNewFromBool(true));
+  jsvObjectSetChildAndUnLock(ws, HTTP_NAME_SOCKET, jsvObjectGetChild(connection, HTTP_NAME_SOCKET, 0));
+  jsvObjectSetChildAndUnLock(ws, HTTP_NAME_SEND_DATA, jsvVarPrintf(
+      "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: %v\r\n\r\n", acceptKey));
+  if (!jsvIsEmptyString(receiveData))
+    jsvObjectSetChild(ws, HTTP_NAME_RECEIVE_DATA, receiveData);
+  jsvArrayPush(arr, ws);
+  jsvObjectSetChild(connection, HTTP_NAME_SOCKET, 0); // the socket belongs to the WebSocket now
+  JsVar *args[2] = { ws, connection };
+  jsiQueueObjectCallbacks(server, HTTP_NAME_ON_WEBSOCKET, args, 2);
+  jsvUnLock2(arr, ws);
+  jsvUnLock2(server, acceptKey);
+  return true;
+}
+
+#endif // USE_CRYPTO
+// -----------------------------
 
+bool socketServerConnectionsIdle(JsNetwork *net, uint32_t ready) {
   JsVar *arr = socketGetArray(HTTP_ARRAY_HTTP_SERVER_CONNECTIONS,false);
   if (!arr) return false;
 
@@ -309,35 +1113,92 @@ bool socketServerConnectionsIdle(JsNetwork *net) {
     // Get connection, socket, and socket type
     // For normal sockets, socket==connection, but for HTTP we split it into a request and a response
     JsVar *connection = jsvObjectIteratorGetValue(&it);
+    int sckt = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(connection,HTTP_NAME_SOCKET,0))-1; // so -1 if undefined
+    if (!networkIsSocketReady(net, ready, sckt)) {
+      // nothing has happened on this socket
+      jsvUnLock(connection);
+      jsvObjectIteratorNext(&it);
+      continue;
+    }
     SocketType socketType = socketGetType(connection);
     JsVar *socket = ((socketType&ST_TYPE_MASK)==ST_HTTP) ? jsvObjectGetChild(connection,HTTP_NAME_RESPONSE_VAR,0) : jsvLockAgain(connection);
 
-    int sckt = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(connection,HTTP_NAME_SOCKET,0))-1; // so -1 if undefined
+    bool busy = false; // do we need to look at this connection again next time, even if the socket isn't ready?
     bool closeConnectionNow = jsvGetBoolAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_CLOSENOW, false));
+    bool renewConnection = false;
+    bool upgraded = false; // to a WebSocket
     int error = 0;
+    bool hadHeaders = jsvGetBoolAndUnLock(jsvObjectGetChild(connection,HTTP_NAME_HAD_HEADERS,0));
+    if (!hadHeaders) {
+      // close kept-alive connections if the next request doesn't arrive in time
+      if (httpIdleTimedOut(connection))
+        closeConnectionNow = true;
+    }
 
     if (!closeConnectionNow) {
-      int num = netRecv(net, sckt, buf, net->chunkSize);
+      JsVar *data = 0;
+      int num = netRecvVar(net, sckt, &data, (size_t)net->chunkSize);
       if (num<0) {
         // we probably disconnected so just get rid of this
         closeConnectionNow = true;
         error = num;
       } else {
-        // add it to our request string
-        if (num>0) {
-          JsVar *receiveData = jsvObjectGetChild(connection,HTTP_NAME_RECEIVE_DATA,0);
+        JsVar *receiveData = jsvObjectGetChild(connection,HTTP_NAME_RECEIVE_DATA,0);
+        // add it to our request string - or parse a pipelined request we received along with the last one
+        if (num>0 || (receiveData && !hadHeaders)) {
           JsVar *oldReceiveData = receiveData;
-          if (!receiveData) receiveData = jsvNewFromEmptyString();
+          if (!receiveData) {
+            // nothing pending, so just use what we received
+            receiveData = data;
+            data = 0;
+          } else if (data)
+            jsvAppendStringVarComplete(receiveData, data);
+          jsvUnLock(data);
+          data = 0;
           if (receiveData) {
-            jsvAppendStringBuf(receiveData, buf, (size_t)num);
-            bool hadHeaders = jsvGetBoolAndUnLock(jsvObjectGetChild(connection,HTTP_NAME_HAD_HEADERS,0));
-            if (!hadHeaders && httpParseHeaders(&receiveData, connection, true)) {
+            int parsed = hadHeaders ? 0 : httpParseHeaders(&receiveData, connection, true);
+            if (parsed < 0) {
+              closeConnectionNow = true;
+              error = parsed;
+            } else if (parsed > 0) {
               hadHeaders = true;
               jsvObjectSetChildAndUnLock(connection, HTTP_NAME_HAD_HEADERS, jsvNewFromBool(hadHeaders));
-              JsVar *server = jsvObjectGetChild(connection,HTTP_NAME_SERVER_VAR,0);
-              JsVar *args[2] = { connection, socket };
-              jsiQueueObjectCallbacks(server, HTTP_NAME_ON_CONNECT, args, ((socketType&ST_TYPE_MASK)==ST_HTTP) ? 2 : 1);
-              jsvUnLock(server);
+#ifdef USE_CRYPTO
+              upgraded = webSocketServerUpgrade(connection, receiveData);
+#endif
+              if (upgraded) {
+                // any data after the headers went to the WebSocket
+                jsvUnLock(receiveData);
+                receiveData = 0;
+              } else {
+                httpServerCheckRequest(connection, socket);
+                JsVar *server = jsvObjectGetChild(connection,HTTP_NAME_SERVER_VAR,0);
+                if ((socketType&ST_TYPE_MASK)!=ST_HTTP || !httpServerRoute(server, connection, socket)) {
+                  JsVar *args[2] = { connection, socket };
+                  jsiQueueObjectCallbacks(server, HTTP_NAME_ON_CONNECT, args, ((socketType&ST_TYPE_MASK)==ST_HTTP) ? 2 : 1);
+                }
+                jsvUnLock(server);
+              }
+            }
+            if (hadHeaders && !jsvIsEmptyString(receiveData) &&
+                jsvGetBoolAndUnLock(jsvObjectGetChild(socket, HTTP_NAME_KEEP_ALIVE, 0))) {
+              // anything after the end of this request's body is the start of the next request
+              JsVar *headers = jsvObjectGetChild(connection, "headers", 0);
+              JsVarInt remaining = headers ? jsvGetIntegerAndUnLock(jsvObjectGetChild(headers, "Content-Length", 0)) : 0;
+              remaining -= jsvGetIntegerAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_RECEIVE_COUNT, 0));
+              if (remaining < 0) remaining = 0;
+              jsvUnLock(headers);
+              if (jsvGetStringLength(receiveData) > (size_t)remaining) {
+                JsVar *nextData = jsvObjectGetChild(connection, HTTP_NAME_NEXT_DATA, 0);
+                if (nextData)
+                  jsvAppendStringVar(nextData, receiveData, (size_t)remaining, JSVAPPENDSTRINGVAR_MAXLENGTH);
+                else
+                  jsvObjectSetChildAndUnLock(connection, HTTP_NAME_NEXT_DATA, jsvNewFromStringVar(receiveData, (size_t)remaining, JSVAPPENDSTRINGVAR_MAXLENGTH));
+                jsvUnLock(nextData);
+                JsVar *body = jsvNewFromStringVar(receiveData, 0, (size_t)remaining);
+                jsvUnLock(receiveData);
+                receiveData = body;
+              }
             }
             if (hadHeaders && !jsvIsEmptyString(receiveData)) {
               // Keep track of how much we received (so we can close once we have it)
@@ -358,13 +1219,14 @@ bool socketServerConnectionsIdle(JsNetwork *net) {
             // if received data changed, update it
             if (receiveData != oldReceiveData)
               jsvObjectSetChild(connection,HTTP_NAME_RECEIVE_DATA,receiveData);
-            jsvUnLock(receiveData);
           }
         }
+        jsvUnLock2(receiveData, data);
       }
 
       // send data if possible
       JsVar *sendData = jsvObjectGetChild(socket,HTTP_NAME_SEND_DATA,0);
+      socketFillSendData(net, socket, &sendData);
       if (sendData && !jsvIsEmptyString(sendData)) {
         int sent = socketSendData(net, socket, sckt, &sendData);
         // FIXME? checking for errors is a bit iffy. With the esp8266 network that returns
@@ -380,7 +1242,7 @@ bool socketServerConnectionsIdle(JsNetwork *net) {
       }
       // only close if we want to close, have no data to send, and aren't receiving data
       bool wantClose = jsvGetBoolAndUnLock(jsvObjectGetChild(socket,HTTP_NAME_CLOSE,0));
-      if (wantClose && (!sendData || jsvIsEmptyString(sendData)) && num<=0) {
+      if (wantClose && (!sendData || jsvIsEmptyString(sendData)) && !socketHasSendSource(socket) && num<=0) {
         bool reallyCloseNow = true;
         if ((socketType&ST_TYPE_MASK)==ST_HTTP) {
           // Check if we had a Content-Length header - if so, we need to wait until we have received that amount
@@ -394,12 +1256,19 @@ bool socketServerConnectionsIdle(JsNetwork *net) {
             jsvUnLock(headers);
           }
         }
+        if (reallyCloseNow && jsvGetBoolAndUnLock(jsvObjectGetChild(socket,HTTP_NAME_KEEP_ALIVE,0))) {
+          // the client asked us to keep the connection open, so get ready for the next request instead
+          reallyCloseNow = false;
+          renewConnection = true;
+        }
         closeConnectionNow = reallyCloseNow;
-      } else if (num > 0)
-        closeConnectionNow = false; // guarantee that anything received is processed
+      } else if (num > 0 && error != SOCKET_ERR_HEADER_SIZE)
+        closeConnectionNow = false; // guarantee that anything received is processed (unless we're refusing it)
+      busy = num > 0 || (sendData && !jsvIsEmptyString(sendData)) || socketHasSendSource(socket);
       jsvUnLock(sendData);
     }
-    if (closeConnectionNow) {
+    if (closeConnectionNow || renewConnection) {
+      socketCloseSendSource(socket);
       // send out any data that we were POSTed
       JsVar *receiveData = jsvObjectGetChild(connection,HTTP_NAME_RECEIVE_DATA,0);
       bool hadHeaders = jsvGetBoolAndUnLock(jsvObjectGetChild(connection,HTTP_NAME_HAD_HEADERS,0));
@@ -418,13 +1287,25 @@ bool socketServerConnectionsIdle(JsNetwork *net) {
       jsiQueueObjectCallbacks(socket, HTTP_NAME_ON_CLOSE, params, 1);
       jsvUnLock(params[0]);
 
-      _socketConnectionKill(net, connection);
+      if (renewConnection) {
+        httpServerConnectionRenew(net, connection);
+        networkSetSocketReady(sckt); // the next request may have arrived already
+      } else
+        _socketConnectionKill(net, connection);
       JsVar *connectionName = jsvObjectIteratorGetKey(&it);
       jsvObjectIteratorNext(&it);
       jsvRemoveChild(arr, connectionName);
       jsvUnLock(connectionName);
-    } else
+    } else if (upgraded) {
+      // the WebSocket has this connection's socket now, so just forget about it
+      JsVar *connectionName = jsvObjectIteratorGetKey(&it);
+      jsvObjectIteratorNext(&it);
+      jsvRemoveChild(arr, connectionName);
+      jsvUnLock(connectionName);
+    } else {
+      if (busy) networkSetSocketReady(sckt);
       jsvObjectIteratorNext(&it);
+    }
     jsvUnLock2(connection, socket);
   }
   jsvObjectIteratorFree(&it);
@@ -437,7 +1318,8 @@ bool socketServerConnectionsIdle(JsNetwork *net) {
 void socketClientPushReceiveData(JsVar *connection, JsVar *socket, JsVar **receiveData) {
   if (*receiveData) {
     if (jsvIsEmptyString(*receiveData) ||
-        jswrap_stream_pushData(socket, *receiveData, false)) {
+        (!jsvGetBoolAndUnLock(jsvObjectGetChild(socket, HTTP_NAME_PAUSED, 0)) &&
+         jswrap_stream_pushData(socket, *receiveData, false))) {
       // clear - because we have issued a callback
       jsvObjectSetChild(connection,HTTP_NAME_RECEIVE_DATA,0);
       jsvUnLock(*receiveData);
@@ -446,9 +1328,7 @@ void socketClientPushReceiveData(JsVar *connection, JsVar *socket, JsVar **recei
   }
 }
 
-bool socketClientConnectionsIdle(JsNetwork *net) {
-  char *buf = alloca(net->chunkSize); // allocate on stack
-
+bool socketClientConnectionsIdle(JsNetwork *net, uint32_t ready) {
   JsVar *arr = socketGetArray(HTTP_ARRAY_HTTP_CLIENT_CONNECTIONS,false);
   if (!arr) return false;
 
@@ -460,6 +1340,14 @@ bool socketClientConnectionsIdle(JsNetwork *net) {
     // Get connection, socket, and socket type
     // For normal sockets, socket==connection, but for HTTP connection is httpCRq and socket is httpCRs
     JsVar *connection = jsvObjectIteratorGetValue(&it);
+    int sckt = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(connection,HTTP_NAME_SOCKET,0))-1; // so -1 if undefined
+    if (!networkIsSocketReady(net, ready, sckt)) {
+      // nothing has happened on this socket
+      jsvUnLock(connection);
+      jsvObjectIteratorNext(&it);
+      continue;
+    }
+    bool busy = false; // do we need to look at this connection again next time, even if the socket isn't ready?
     SocketType socketType = socketGetType(connection);
     JsVar *socket = ((socketType&ST_TYPE_MASK)==ST_HTTP) ? jsvObjectGetChild(connection,HTTP_NAME_RESPONSE_VAR,0) : jsvLockAgain(connection);
     bool socketClosed = false;
@@ -468,11 +1356,13 @@ bool socketClientConnectionsIdle(JsNetwork *net) {
     bool hadHeaders = false;
     int error = 0; // error code received from netXxxx functions
     bool isHttp = (socketType&ST_TYPE_MASK) == ST_HTTP;
+    bool isWebSocket = (socketType&ST_TYPE_MASK) == ST_WEBSOCKET;
+    bool isMqtt = (socketType&ST_TYPE_MASK) == ST_MQTT;
     bool closeConnectionNow = jsvGetBoolAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_CLOSENOW, false));
     bool alreadyConnected = jsvGetBoolAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_CONNECTED, false));
-    int sckt = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(connection,HTTP_NAME_SOCKET,0))-1; // so -1 if undefined
+    bool paused = isHttp && socket && jsvGetBoolAndUnLock(jsvObjectGetChild(socket, HTTP_NAME_PAUSED, 0));
     if (sckt>=0) {
-      if (isHttp)
+      if (isHttp || isWebSocket)
         hadHeaders = jsvGetBoolAndUnLock(jsvObjectGetChild(connection,HTTP_NAME_HAD_HEADERS,0));
       else
         hadHeaders = true;
@@ -480,8 +1370,30 @@ bool socketClientConnectionsIdle(JsNetwork *net) {
 
       /* We do this up here because we want to wait until we have been once
        * around the idle loop (=callbacks have been executed) before we run this */
-      if (hadHeaders)
+      if (hadHeaders) {
+#ifdef USE_CRYPTO
+        if (isWebSocket) {
+          error = webSocketReceive(connection, &receiveData);
+          if (error) closeConnectionNow = true;
+        } else
+#endif
+#ifdef USE_MQTT
+        if (isMqtt) {
+          // decode packets, and send pings if we need to keep the connection open
+          JsVar *oldReceiveData = receiveData;
+          if (!closeConnectionNow) error = mqttIdle(net, connection, &receiveData);
+          if (error) closeConnectionNow = true;
+          if (receiveData != oldReceiveData)
+            jsvObjectSetChild(connection, HTTP_NAME_RECEIVE_DATA, receiveData);
+        } else
+#endif
         socketClientPushReceiveData(connection, socket, &receiveData);
+      } else if (isWebSocket && jsvGetBoolAndUnLock(jsvObjectGetChild(connection, WS_NAME_SERVER, 0))) {
+        // The server end starts receiving next time around, once the 'websocket' listeners have been called
+        hadHeaders = true;
+        busy = true;
+        jsvObjectSetChildAndUnLock(connection, HTTP_NAME_HAD_HEADERS, jsvNewFromBool(hadHeaders));
+      }
 
       JsVar *sendData = jsvObjectGetChild(connection,HTTP_NAME_SEND_DATA,0);
       if (!closeConnectionNow) {
@@ -490,7 +1402,7 @@ bool socketClientConnectionsIdle(JsNetwork *net) {
           // don't try to send if we're already in error state
           int num = 0;
           if (error == 0) num = socketSendData(net, connection, sckt, &sendData);
-          if (num > 0 && !alreadyConnected && !isHttp) { // whoa, we sent something, must be connected!
+          if (num > 0 && !alreadyConnected && !isHttp && !isWebSocket && !isMqtt) { // whoa, we sent something, must be connected!
             jsiQueueObjectCallbacks(connection, HTTP_NAME_ON_CONNECT, &connection, 1);
             jsvObjectSetChildAndUnLock(connection, HTTP_NAME_CONNECTED, jsvNewFromBool(true));
             alreadyConnected = true;
@@ -500,14 +1412,18 @@ bool socketClientConnectionsIdle(JsNetwork *net) {
             error = num;
           }
           jsvObjectSetChild(connection, HTTP_NAME_SEND_DATA, sendData); // _http_send prob updated sendData
+          if (!jsvIsEmptyString(sendData)) busy = true;
         } else {
           // no data to send, do we want to close? do so.
           if (jsvGetBoolAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_CLOSE, false)))
             closeConnectionNow = true;
         }
-        // Now read data if possible (and we have space for it)
-        if (!receiveData || !hadHeaders) {
-          int num = netRecv(net, sckt, buf, net->chunkSize);
+        /* Now read data if possible (and we have space for it - WebSockets may be waiting for the rest of a frame).
+         * If paused we stop reading altogether, so the driver's (or the OS's) receive window fills up and
+         * the sender is made to wait */
+        if ((!receiveData && !paused) || !hadHeaders || isWebSocket || isMqtt) {
+          JsVar *data = 0;
+          int num = netRecvVar(net, sckt, &data, (size_t)net->chunkSize);
           //if (num != 0) printf("recv returned %d\r\n", num);
           if (!alreadyConnected && num == SOCKET_ERR_NO_CONN) {
             ; // ignore... it's just telling us we're not connected yet
@@ -518,7 +1434,7 @@ bool socketClientConnectionsIdle(JsNetwork *net) {
             if (!hadHeaders && error == SOCKET_ERR_CLOSED) error = SOCKET_ERR_NO_RESP;
           } else {
             // did we just get connected?
-            if (!alreadyConnected && !isHttp) {
+            if (!alreadyConnected && !isHttp && !isWebSocket && !isMqtt) {
               jsiQueueObjectCallbacks(connection, HTTP_NAME_ON_CONNECT, &connection, 1);
               jsvObjectSetChildAndUnLock(connection, HTTP_NAME_CONNECTED, jsvNewFromBool(true));
               alreadyConnected = true;
@@ -528,44 +1444,91 @@ bool socketClientConnectionsIdle(JsNetwork *net) {
             }
             // got data add it to our receive buffer
             if (num > 0) {
+              busy = true; // there may be more
+              bool hadHeadersBefore = hadHeaders;
               if (!receiveData) {
-                receiveData = jsvNewFromEmptyString();
+                // nothing pending, so just use what we received
+                receiveData = data;
+                data = 0;
                 jsvObjectSetChild(connection, HTTP_NAME_RECEIVE_DATA, receiveData);
-              }
+              } else if (data)
+                jsvAppendStringVarComplete(receiveData, data);
               if (receiveData) { // could be out of memory
-                jsvAppendStringBuf(receiveData, buf, (size_t)num);
                 if ((socketType&ST_TYPE_MASK)==ST_HTTP && !hadHeaders) {
                   // for HTTP see whether we now have full response headers
                   JsVar *resVar = jsvObjectGetChild(connection,HTTP_NAME_RESPONSE_VAR,0);
-                  if (httpParseHeaders(&receiveData, resVar, false)) {
+                  int parsed = httpParseHeaders(&receiveData, resVar, false);
+                  if (parsed < 0) {
+                    closeConnectionNow = true;
+                    error = parsed;
+                  } else if (parsed > 0) {
                     hadHeaders = true;
                     jsvObjectSetChildAndUnLock(connection, HTTP_NAME_HAD_HEADERS, jsvNewFromBool(hadHeaders));
+                    httpClientCheckResponse(connection, resVar);
                     jsiQueueObjectCallbacks(connection, HTTP_NAME_ON_CONNECT, &resVar, 1);
                   }
                   jsvUnLock(resVar);
                   jsvObjectSetChild(connection, HTTP_NAME_RECEIVE_DATA, receiveData);
                 }
+                if (isHttp && hadHeaders && jsvGetBoolAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_KEEP_ALIVE, 0))) {
+                  // Keep track of how much of the body we received, so we know when the socket is free again
+                  JsVarInt received = jsvGetIntegerAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_RECEIVE_COUNT, 0)) +
+                      (hadHeadersBefore ? num : (JsVarInt)jsvGetStringLength(receiveData));
+                  jsvObjectSetChildAndUnLock(connection, HTTP_NAME_RECEIVE_COUNT, jsvNewFromInteger(received));
+                  // If that's the whole response, close (or rather, pool) next time around - once
+                  // the callbacks have been executed and have added their 'data'/'close' listeners
+                  if (httpClientResponseRemaining(connection, socket) >= 0)
+                    jsvObjectSetChildAndUnLock(connection, HTTP_NAME_CLOSENOW, jsvNewFromBool(true));
+                }
+#ifdef USE_CRYPTO
+                if (isWebSocket && !hadHeaders) {
+                  // see whether we now have the server's reply to our upgrade request
+                  int parsed = httpParseHeaders(&receiveData, connection, false);
+                  if (parsed > 0 && !webSocketClientCheckHandshake(connection))
+                    parsed = SOCKET_ERR_WS_HANDSHAKE;
+                  if (parsed < 0) {
+                    closeConnectionNow = true;
+                    error = parsed;
+                  } else if (parsed > 0) {
+                    hadHeaders = true;
+                    jsvObjectSetChildAndUnLock(connection, HTTP_NAME_HAD_HEADERS, jsvNewFromBool(hadHeaders));
+                    jsiQueueObjectCallbacks(connection, WS_NAME_ON_OPEN, &connection, 1);
+                  }
+                  jsvObjectSetChild(connection, HTTP_NAME_RECEIVE_DATA, receiveData);
+                }
+#endif
               }
             }
           }
+          jsvUnLock(data);
         }
-        jsvUnLock(sendData);
       }
+      jsvUnLock(sendData);
     }
 
     if (closeConnectionNow) {
-      socketClientPushReceiveData(connection, socket, &receiveData);
+      if (isWebSocket || isMqtt) {
+        // anything left is an incomplete frame that we'll never get the rest of
+        jsvUnLock(receiveData);
+        receiveData = 0;
+        jsvObjectSetChild(connection, HTTP_NAME_RECEIVE_DATA, 0);
+      } else
+        socketClientPushReceiveData(connection, socket, &receiveData);
       if (!receiveData) {
         if ((socketType&ST_TYPE_MASK) != ST_HTTP)
           jsiQueueObjectCallbacks(socket, HTTP_NAME_ON_END, &socket, 1);
 
         // If we had data to send but the socket closed, this is an error
         JsVar *sendData = jsvObjectGetChild(connection,HTTP_NAME_SEND_DATA,0);
-        if (sendData && jsvGetStringLength(sendData) > 0 && error == SOCKET_ERR_CLOSED)
+        bool allSent = !sendData || jsvIsEmptyString(sendData);
+        if (!allSent && error == SOCKET_ERR_CLOSED)
           error = SOCKET_ERR_UNSENT_DATA;
         jsvUnLock(sendData);
 
-        _socketConnectionKill(net, connection);
+        if (isHttp && !error && allSent && httpClientResponseRemaining(connection, socket) == 0)
+          httpClientPoolAdd(net, connection); // keep the socket open for the next request to this server
+        else
+          _socketConnectionKill(net, connection);
         JsVar *connectionName = jsvObjectIteratorGetKey(&it);
         jsvObjectIteratorNext(&it);
         jsvRemoveChild(arr, connectionName);
@@ -584,6 +1547,8 @@ bool socketClientConnectionsIdle(JsNetwork *net) {
 
 
     if (!socketClosed) {
+      // data nobody has taken yet, or that's waiting for the rest of a frame, is looked at again
+      if (busy || (receiveData && !paused)) networkSetSocketReady(sckt);
       jsvObjectIteratorNext(&it);
     }
 
@@ -594,6 +1559,116 @@ bool socketClientConnectionsIdle(JsNetwork *net) {
   return hadSockets;
 }
 
+/// Send as many of the datagrams queued on a UDP socket as the network will take. Returns 0 or a (negative) error
+static int dgramSendData(JsNetwork *net, JsVar *socket, int sckt, JsVar **sendData) {
+  char *buf = alloca(sizeof(JsNetUDPPacketHeader) + DGRAM_MAX_LENGTH + 1); // allocate on stack, +1 for jsvGetStringChars' trailing 0
+  // As for socketSendData, we keep an offset rather than cutting off each datagram as it's sent
+  size_t offset = (size_t)jsvGetIntegerAndUnLock(jsvObjectGetChild(socket,HTTP_NAME_SEND_OFFSET,0));
+  size_t len = jsvGetStringLength(*sendData);
+  int error = 0;
+  while (offset < len) {
+    JsNetUDPPacketHeader header;
+    jsvGetStringChars(*sendData, offset, buf, sizeof(header)); // via buf, which has room for the trailing 0
+    memcpy(&header, buf, sizeof(header));
+    size_t datagramLen = sizeof(header) + header.length;
+    jsvGetStringChars(*sendData, offset, buf, datagramLen);
+    int num = netSend(net, sckt, buf, datagramLen);
+    if (num < 0) error = num;
+    if (num <= 0) break; // error, or the network can't take any more yet
+    offset += datagramLen;
+  }
+  JsVar *newSendData = 0;
+  if (offset >= len) {
+    newSendData = jsvNewFromEmptyString();
+    offset = 0;
+  } else if (offset > len-offset) {
+    newSendData = jsvNewFromStringVar(*sendData, offset, JSVAPPENDSTRINGVAR_MAXLENGTH);
+    offset = 0;
+  }
+  if (newSendData) {
+    jsvUnLock(*sendData);
+    *sendData = newSendData;
+  }
+  jsvObjectSetChildAndUnLock(socket, HTTP_NAME_SEND_OFFSET, jsvNewFromInteger((JsVarInt)offset));
+  return error;
+}
+
+/** Receive the datagrams waiting on a UDP socket and fire a 'message' event for each. The driver
+ * gives us all it has queued (that fits) in one go, so we only ask once. Returns 0 or a (negative) error */
+static int dgramReceive(JsNetwork *net, JsVar *socket, int sckt) {
+  size_t bufLen = sizeof(JsNetUDPPacketHeader) + (size_t)net->chunkSize;
+  char *buf = alloca(bufLen); // allocate on stack
+  int num = netRecv(net, sckt, buf, bufLen);
+  if (num < 0) return num;
+  size_t pos = 0;
+  while (pos + sizeof(JsNetUDPPacketHeader) <= (size_t)num) {
+    JsNetUDPPacketHeader header;
+    memcpy(&header, &buf[pos], sizeof(header));
+    pos += sizeof(header);
+    size_t len = header.length;
+    if (len > (size_t)num-pos) len = (size_t)num-pos;
+    JsVar *params[2];
+    params[0] = jsvNewStringOfLength((unsigned int)len);
+    params[1] = jsvNewObject();
+    if (params[0] && params[1]) {
+      jsvSetString(params[0], &buf[pos], len);
+      networkPutAddressAsString(params[1], "address", header.host, 4, 10, '.');
+      jsvObjectSetChildAndUnLock(params[1], "family", jsvNewFromString("IPv4"));
+      jsvObjectSetChildAndUnLock(params[1], "port", jsvNewFromInteger(header.port));
+      jsvObjectSetChildAndUnLock(params[1], "size", jsvNewFromInteger((JsVarInt)len));
+      jsiQueueObjectCallbacks(socket, DGRAM_NAME_ON_MESSAGE, params, 2);
+    }
+    jsvUnLock2(params[0], params[1]);
+    pos += len;
+  }
+  return 0;
+}
+
+bool socketDgramIdle(JsNetwork *net) {
+  JsVar *arr = socketGetArray(HTTP_ARRAY_DGRAM_SOCKETS,false);
+  if (!arr) return false;
+
+  bool hadSockets = false;
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, arr);
+  while (jsvObjectIteratorHasValue(&it)) {
+    hadSockets = true;
+    JsVar *socket = jsvObjectIteratorGetValue(&it);
+    int sckt = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(socket,HTTP_NAME_SOCKET,0))-1; // so -1 if undefined
+    int error = 0;
+    bool closeNow = false;
+
+    JsVar *sendData = jsvObjectGetChild(socket,HTTP_NAME_SEND_DATA,0);
+    if (sendData && !jsvIsEmptyString(sendData)) {
+      error = dgramSendData(net, socket, sckt, &sendData);
+      jsvObjectSetChild(socket, HTTP_NAME_SEND_DATA, sendData);
+    }
+    // close once everything queued has been sent
+    if (!sendData || jsvIsEmptyString(sendData))
+      closeNow = jsvGetBoolAndUnLock(jsvObjectGetChild(socket, HTTP_NAME_CLOSE, false));
+    jsvUnLock(sendData);
+    if (!error && !closeNow)
+      error = dgramReceive(net, socket, sckt);
+
+    if (error || closeNow) {
+      _socketConnectionKill(net, socket);
+      JsVar *socketName = jsvObjectIteratorGetKey(&it);
+      jsvObjectIteratorNext(&it);
+      jsvRemoveChild(arr, socketName);
+      jsvUnLock(socketName);
+      fireErrorEvent(error, socket, NULL);
+      jsiQueueObjectCallbacks(socket, HTTP_NAME_ON_CLOSE, 0, 0);
+    } else {
+      jsvObjectIteratorNext(&it);
+    }
+    jsvUnLock(socket);
+  }
+  jsvObjectIteratorFree(&it);
+  jsvUnLock(arr);
+
+  return hadSockets;
+}
+
 
 bool socketIdle(JsNetwork *net) {
   if (networkState != NETWORKSTATE_ONLINE) {
@@ -614,22 +1689,10 @@ bool socketIdle(JsNetwork *net) {
 
       int theClient = netAccept(net, sckt);
       if (theClient >= 0) {
+        networkSetSocketReady(theClient);
         SocketType socketType = socketGetType(server);
         if ((socketType&ST_TYPE_MASK) == ST_HTTP) {
-          JsVar *req = jspNewObject(0, "httpSRq");
-          JsVar *res = jspNewObject(0, "httpSRs");
-          if (res && req) { // out of memory?
-            socketSetType(req, ST_HTTP);
-            JsVar *arr = socketGetArray(HTTP_ARRAY_HTTP_SERVER_CONNECTIONS, true);
-            if (arr) {
-              jsvArrayPush(arr, req);
-              jsvUnLock(arr);
-            }
-            jsvObjectSetChild(req, HTTP_NAME_RESPONSE_VAR, res);
-            jsvObjectSetChild(req, HTTP_NAME_SERVER_VAR, server);
-            jsvObjectSetChildAndUnLock(req, HTTP_NAME_SOCKET, jsvNewFromInteger(theClient+1));
-          }
-          jsvUnLock2(req, res);
+          jsvUnLock(httpServerConnectionNew(server, theClient));
         } else {
           // Normal sockets
           JsVar *sock = jspNewObject(0, "Socket");
@@ -654,8 +1717,19 @@ bool socketIdle(JsNetwork *net) {
     jsvUnLock(arr);
   }
 
-  if (socketServerConnectionsIdle(net)) hadSockets = true;
-  if (socketClientConnectionsIdle(net)) hadSockets = true;
+  // Which connections do we need to look at?
+  uint32_t ready = networkTakeSocketsReady();
+  JsSysTime now = jshGetSystemTime();
+  if (socketsChanged || now-socketsLastPolled > jshGetTimeFromMilliseconds(SOCKET_POLL_INTERVAL)) {
+    // check for timeouts, and anything JS has done
+    ready = 0xFFFFFFFF;
+    socketsChanged = false;
+    socketsLastPolled = now;
+  }
+  if (socketServerConnectionsIdle(net, ready)) hadSockets = true;
+  if (socketClientConnectionsIdle(net, ready)) hadSockets = true;
+  if (socketDgramIdle(net)) hadSockets = true;
+  if (socketClientPoolIdle(net)) hadSockets = true;
   netCheckError(net);
   return hadSockets;
 }
@@ -666,11 +1740,25 @@ JsVar *serverNew(SocketType socketType, JsVar *callback) {
   JsVar *server = jspNewObject(0, ((socketType&ST_TYPE_MASK)==ST_HTTP) ? "httpSrv" : "Server");
   if (!server) return 0; // out of memory
   socketSetType(server, socketType);
-  jsvObjectSetChild(server, HTTP_NAME_ON_CONNECT, callback); // no unlock needed
+  if (callback) jsvObjectSetChild(server, HTTP_NAME_ON_CONNECT, callback); // no unlock needed
   return server;
 }
 
+void serverAddRoute(JsVar *server, JsVar *method, JsVar *path, JsVar *handler) {
+  JsVar *routes = jsvObjectGetChild(server, HTTP_NAME_ROUTES, JSV_ARRAY);
+  JsVar *route = jsvNewObject();
+  if (routes && route) {
+    if (jsvIsString(method) && !jsvIsStringEqual(method, "*"))
+      jsvObjectSetChild(route, "m", method);
+    jsvObjectSetChild(route, "p", path);
+    jsvObjectSetChild(route, "h", handler);
+    jsvArrayPush(routes, route);
+  }
+  jsvUnLock2(routes, route);
+}
+
 void serverListen(JsNetwork *net, JsVar *server, int port) {
+  socketsChanged = true;
   JsVar *arr = socketGetArray(HTTP_ARRAY_HTTP_SERVERS, true);
   if (!arr) return; // out of memory
 
@@ -689,6 +1777,7 @@ void serverListen(JsNetwork *net, JsVar *server, int port) {
 }
 
 void serverClose(JsNetwork *net, JsVar *server) {
+  socketsChanged = true;
   JsVar *arr = socketGetArray(HTTP_ARRAY_HTTP_SERVERS,false);
   if (arr) {
     // close socket
@@ -714,7 +1803,10 @@ JsVar *clientRequestNew(SocketType socketType, JsVar *options, JsVar *callback)
     if (!res) { jsvUnLock(arr); return 0; } // out of memory?
     req = jspNewObject(0, "httpCRq");
   } else {
-    req = jspNewObject(0, "Socket");
+    const char *className = "Socket";
+    if ((socketType&ST_TYPE_MASK)==ST_WEBSOCKET) className = "WebSocket";
+    if ((socketType&ST_TYPE_MASK)==ST_MQTT) className = "MQTT";
+    req = jspNewObject(0, className);
   }
   if (req) { // out of memory?
    socketSetType(req, socketType);
@@ -729,8 +1821,103 @@ JsVar *clientRequestNew(SocketType socketType, JsVar *options, JsVar *callback)
   jsvUnLock2(res, arr);
   return req;
 }
+JsVar *dgramSocketNew(JsVar *callback) {
+  JsVar *socket = jspNewObject(0, "dgramSocket");
+  if (!socket) return 0; // out of memory
+  socketSetType(socket, ST_UDP);
+  if (jsvIsFunction(callback))
+    jsvObjectSetChild(socket, DGRAM_NAME_ON_MESSAGE, callback); // no unlock needed
+  return socket;
+}
+
+void dgramSocketBind(JsNetwork *net, JsVar *socket, int port) {
+  JsVar *scktVar = jsvObjectGetChild(socket, HTTP_NAME_SOCKET, 0);
+  jsvUnLock(scktVar);
+  if (scktVar) {
+    jsError("Socket is already bound");
+    return;
+  }
+  JsVar *arr = socketGetArray(HTTP_ARRAY_DGRAM_SOCKETS, true);
+  if (!arr) return; // out of memory
+
+  int sckt = netCreateSocket(net, 0, (unsigned short)port, NCF_UDP, 0 /*options*/);
+  if (sckt<0) {
+    jsError("Unable to create UDP socket (%s)", socketErrorString(sckt));
+  } else {
+    jsvObjectSetChildAndUnLock(socket, HTTP_NAME_PORT, jsvNewFromInteger(port));
+    jsvObjectSetChildAndUnLock(socket, HTTP_NAME_SOCKET, jsvNewFromInteger(sckt+1));
+    jsvArrayPush(arr, socket);
+    jsiQueueObjectCallbacks(socket, DGRAM_NAME_ON_LISTENING, 0, 0);
+  }
+  jsvUnLock(arr);
+}
+
+void dgramSocketSend(JsNetwork *net, JsVar *socket, JsVar *data, int port, JsVar *address) {
+  char ipStr[16];
+  uint32_t ip = 0;
+  if (jsvIsString(address) && jsvGetStringLength(address) < sizeof(ipStr)) {
+    jsvGetString(address, ipStr, sizeof(ipStr));
+    ip = networkParseIPAddress(ipStr);
+  }
+  if (!ip) {
+    jsError("Expecting an IP address, got %q", address);
+    return;
+  }
+  if (port<=0 || port>65535) {
+    jsError("Invalid port %d", port);
+    return;
+  }
+  JsVar *str = jsvAsString(data, false);
+  if (!str) return; // out of memory
+  size_t len = jsvGetStringLength(str);
+  if (len > DGRAM_MAX_LENGTH) {
+    jsError("Datagram too long (%d bytes, max %d)", (int)len, DGRAM_MAX_LENGTH);
+    jsvUnLock(str);
+    return;
+  }
+  // like node.js, sending on an unbound socket binds it to any port
+  JsVar *scktVar = jsvObjectGetChild(socket, HTTP_NAME_SOCKET, 0);
+  jsvUnLock(scktVar);
+  if (!scktVar) dgramSocketBind(net, socket, 0);
+
+  JsNetUDPPacketHeader header;
+  memcpy(header.host, &ip, sizeof(header.host));
+  header.port = (unsigned short)port;
+  header.length = (unsigned short)len;
+  JsVar *sendData = jsvObjectGetChild(socket, HTTP_NAME_SEND_DATA, 0);
+  if (!sendData) {
+    sendData = jsvNewFromEmptyString();
+    jsvObjectSetChild(socket, HTTP_NAME_SEND_DATA, sendData);
+  }
+  if (sendData) {
+    jsvAppendStringBuf(sendData, (const char*)&header, sizeof(header));
+    jsvAppendStringVarComplete(sendData, str);
+  }
+  jsvUnLock2(sendData, str);
+}
+
+void dgramSocketClose(JsNetwork *net, JsVar *socket) {
+  NOT_USED(net);
+  JsVar *scktVar = jsvObjectGetChild(socket, HTTP_NAME_SOCKET, 0);
+  jsvUnLock(scktVar);
+  if (scktVar) {
+    // closed (after sending anything queued) in socketDgramIdle
+    jsvObjectSetChildAndUnLock(socket, HTTP_NAME_CLOSE, jsvNewFromBool(true));
+  } else {
+    // never bound, so there's nothing to close
+    jsiQueueObjectCallbacks(socket, HTTP_NAME_ON_CLOSE, 0, 0);
+  }
+}
+
+size_t socketGetPendingSendLength(JsVar *httpClientReqVar) {
+  JsVar *sendData = jsvObjectGetChild(httpClientReqVar, HTTP_NAME_SEND_DATA, 0);
+  size_t len = sendData ? jsvGetStringLength(sendData) : 0;
+  jsvUnLock(sendData);
+  return len;
+}
 
 void clientRequestWrite(JsNetwork *net, JsVar *httpClientReqVar, JsVar *data) {
+  socketsChanged = true;
   SocketType socketType = socketGetType(httpClientReqVar);
   // Append data to sendData
   JsVar *sendData = jsvObjectGetChild(httpClientReqVar, HTTP_NAME_SEND_DATA, 0);
@@ -744,7 +1931,9 @@ void clientRequestWrite(JsNetwork *net, JsVar *httpClientReqVar, JsVar *data) {
       // We're an HTTP client - make a header
       JsVar *method = jsvObjectGetChild(options, "method", 0);
       JsVar *path = jsvObjectGetChild(options, "path", 0);
-      sendData = jsvVarPrintf("%v %v HTTP/1.0\r\nUser-Agent: Espruino "JS_VERSION"\r\nConnection: close\r\n", method, path);
+      // keep-alive (if asked for) is all we need from HTTP/1.1, and staying at 1.0 means we never get chunked responses
+      bool keepAlive = jsvGetBoolAndUnLock(jsvObjectGetChild(options, "keepAlive", 0));
+      sendData = jsvVarPrintf("%v %v HTTP/1.0\r\nUser-Agent: Espruino "JS_VERSION"\r\nConnection: %s\r\n", method, path, keepAlive?"keep-alive":"close");
       jsvUnLock2(method, path);
       JsVar *headers = jsvObjectGetChild(options, "headers", 0);
       bool hasHostHeader = false;
@@ -792,6 +1981,8 @@ void clientRequestWrite(JsNetwork *net, JsVar *httpClientReqVar, JsVar *data) {
       }
       jsvUnLock(s);
     }
+    if ((socketType&ST_TYPE_MASK) == ST_NORMAL && !jsvIsEmptyString(sendData))
+      socketSendNow(net, httpClientReqVar, &sendData);
   }
   jsvUnLock(sendData);
   if ((socketType&ST_TYPE_MASK) == ST_HTTP) {
@@ -802,6 +1993,7 @@ void clientRequestWrite(JsNetwork *net, JsVar *httpClientReqVar, JsVar *data) {
 
 // Connect this connection/socket
 void clientRequestConnect(JsNetwork *net, JsVar *httpClientReqVar) {
+  socketsChanged = true;
   // Have we already connected? If so, don't go further
   if (jsvGetIntegerAndUnLock(jsvObjectGetChild(httpClientReqVar, HTTP_NAME_SOCKET, 0))>0)
     return;
@@ -819,6 +2011,29 @@ void clientRequestConnect(JsNetwork *net, JsVar *httpClientReqVar) {
     jsvGetString(hostNameVar, hostName, sizeof(hostName));
   jsvUnLock(hostNameVar);
 
+  NetCreateFlags flags = NCF_NORMAL;
+#ifdef USE_TLS
+  if (socketType & ST_TLS) {
+    flags |= NCF_TLS;
+    if (port==0) port = 443;
+  }
+#endif
+
+  if (port==0) port = 80;
+
+  if ((socketType&ST_TYPE_MASK) == ST_HTTP &&
+      jsvGetBoolAndUnLock(jsvObjectGetChild(options, "keepAlive", 0))) {
+    // reuse a socket that an earlier request to this server left open, if there is one
+    JsVar *poolKey = jsvVarPrintf("%s:%d%s", hostName, port, (flags&NCF_TLS)?"s":"");
+    int sckt = poolKey ? httpClientPoolTake(poolKey) : -1;
+    jsvObjectSetChildAndUnLock(httpClientReqVar, HTTP_NAME_POOL_KEY, poolKey);
+    if (sckt>=0) {
+      jsvObjectSetChildAndUnLock(httpClientReqVar, HTTP_NAME_SOCKET, jsvNewFromInteger(sckt+1));
+      jsvUnLock(options);
+      return;
+    }
+  }
+
   uint32_t host_addr = 0;
   networkGetHostByName(net, hostName, &host_addr);
 
@@ -831,16 +2046,6 @@ void clientRequestConnect(JsNetwork *net, JsVar *httpClientReqVar) {
     return;
   }
 
-  NetCreateFlags flags = NCF_NORMAL;
-#ifdef USE_TLS
-  if (socketType & ST_TLS) {
-    flags |= NCF_TLS;
-    if (port==0) port = 443;
-  }
-#endif
-
-  if (port==0) port = 80;
-
   int sckt =  netCreateSocket(net, host_addr, port, flags, options);
   if (sckt<0) {
     jsError("Unable to create socket\n");
@@ -856,7 +2061,33 @@ void clientRequestConnect(JsNetwork *net, JsVar *httpClientReqVar) {
 }
 
 // 'end' this connection
+void clientRequestSetRecvWindow(JsNetwork *net, JsVar *httpClientReqVar, int bytes) {
+  int sckt = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(httpClientReqVar,HTTP_NAME_SOCKET,0))-1; // so -1 if undefined
+  if (sckt>=0) netSetRecvWindow(net, sckt, bytes);
+}
+
+void clientRequestSetNoDelay(JsNetwork *net, JsVar *httpClientReqVar, bool noDelay) {
+  jsvObjectSetChildAndUnLock(httpClientReqVar, HTTP_NAME_NO_DELAY, jsvNewFromBool(noDelay));
+  int sckt = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(httpClientReqVar,HTTP_NAME_SOCKET,0))-1; // so -1 if undefined
+  if (sckt>=0) netSetNoDelay(net, sckt, noDelay);
+}
+
+void clientResponseSetPaused(JsVar *httpClientResVar, bool paused) {
+  socketsChanged = true;
+  if (paused)
+    jsvObjectSetChildAndUnLock(httpClientResVar, HTTP_NAME_PAUSED, jsvNewFromBool(true));
+  else
+    jsvRemoveNamedChild(httpClientResVar, HTTP_NAME_PAUSED);
+}
+
+JsVar *clientRequestGetStats(JsNetwork *net, JsVar *httpClientReqVar) {
+  int sckt = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(httpClientReqVar,HTTP_NAME_SOCKET,0))-1; // so -1 if undefined
+  if (sckt<0) return 0;
+  return netGetStats(net, sckt);
+}
+
 void clientRequestEnd(JsNetwork *net, JsVar *httpClientReqVar) {
+  socketsChanged = true;
   SocketType socketType = socketGetType(httpClientReqVar);
   if ((socketType&ST_TYPE_MASK) == ST_HTTP) {
     JsVar *finalData = 0;
@@ -881,6 +2112,7 @@ void clientRequestEnd(JsNetwork *net, JsVar *httpClientReqVar) {
 
 
 void serverResponseWriteHead(JsVar *httpServerResponseVar, int statusCode, JsVar *headers) {
+  socketsChanged = true;
   if (!jsvIsUndefined(headers) && !jsvIsObject(headers)) {
     jsError("Headers sent to writeHead should be an object");
     return;
@@ -894,8 +2126,40 @@ void serverResponseWriteHead(JsVar *httpServerResponseVar, int statusCode, JsVar
     return;
   }
 
-  sendData = jsvVarPrintf("HTTP/1.0 %d OK\r\nServer: Espruino "JS_VERSION"\r\n", statusCode);
+  JsVar *length = headers ? jsvObjectGetChild(headers, "Content-Length", 0) : 0;
+  bool hasLength = length!=0;
+  jsvUnLock(length);
+  bool chunked = headers && httpHeaderIs(headers, "Transfer-Encoding", "chunked");
+  bool addChunkedHeader = false;
+  if (!hasLength && !chunked &&
+      jsvGetBoolAndUnLock(jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_CAN_CHUNK, 0))) {
+    // If we don't know the length, chunk the response so the client can still tell where it ends
+    JsVar *encoding = headers ? jsvObjectGetChild(headers, "Transfer-Encoding", 0) : 0;
+    addChunkedHeader = !encoding && statusCode>=200 && statusCode!=204 && statusCode!=304; // these have no body
+    jsvUnLock(encoding);
+    chunked = addChunkedHeader;
+  }
+  if (chunked)
+    jsvObjectSetChildAndUnLock(httpServerResponseVar, HTTP_NAME_CHUNKED, jsvNewFromBool(true));
+
+  bool keepAlive = jsvGetBoolAndUnLock(jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_KEEP_ALIVE, 0));
+  bool addConnectionHeader = false;
+  if (keepAlive) {
+    // we can only keep the connection open if the client can tell where the response ends
+    JsVar *connection = headers ? jsvObjectGetChild(headers, "Connection", 0) : 0;
+    keepAlive = hasLength || chunked;
+    addConnectionHeader = keepAlive && !connection;
+    keepAlive = addConnectionHeader || (keepAlive && httpHeaderIs(headers, "Connection", "keep-alive"));
+    jsvUnLock(connection);
+    if (!keepAlive)
+      jsvRemoveNamedChild(httpServerResponseVar, HTTP_NAME_KEEP_ALIVE);
+  }
+
+  // chunked responses are only understood by HTTP/1.1 clients
+  sendData = jsvVarPrintf("HTTP/1.%d %d OK\r\nServer: Espruino "JS_VERSION"\r\n", chunked?1:0, statusCode);
   if (headers) httpAppendHeaders(sendData, headers);
+  if (addChunkedHeader) jsvAppendString(sendData, "Transfer-Encoding: chunked\r\n");
+  if (addConnectionHeader) jsvAppendString(sendData, "Connection: keep-alive\r\n");
   // finally add ending newline
   jsvAppendString(sendData, "\r\n");
   jsvObjectSetChildAndUnLock(httpServerResponseVar, HTTP_NAME_SEND_DATA, sendData);
@@ -903,6 +2167,7 @@ void serverResponseWriteHead(JsVar *httpServerResponseVar, int statusCode, JsVar
 
 
 void serverResponseWrite(JsVar *httpServerResponseVar, JsVar *data) {
+  socketsChanged = true;
   // Append data to sendData
   JsVar *sendData = jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_SEND_DATA, 0);
   if (!sendData) {
@@ -915,14 +2180,70 @@ void serverResponseWrite(JsVar *httpServerResponseVar, JsVar *data) {
   // check, just in case!
   if (sendData && !jsvIsUndefined(data)) {
     JsVar *s = jsvAsString(data, false);
-    if (s) jsvAppendStringVarComplete(sendData,s);
+    if (jsvGetBoolAndUnLock(jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_CHUNKED, 0))) {
+      // If we're sending 'chunked' data, we need to wrap it up, prefixed with the length.
+      // An empty chunk would end the response, so skip those
+      if (!jsvIsEmptyString(s)) jsvAppendPrintf(sendData, "%x\r\n%v\r\n", jsvGetStringLength(s), s);
+    } else if (s) {
+      jsvAppendStringVarComplete(sendData,s);
+    }
     jsvUnLock(s);
   }
   jsvUnLock(sendData);
 }
 
+void serverResponseSendSource(JsVar *httpServerResponseVar, JsVar *source, JsVar *mimeType, int length, JsVar *encoding) {
+  socketsChanged = true;
+  JsVar *sendData = jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_SEND_DATA, 0);
+  if (jsvIsString(encoding)) {
+    JsVar *acceptEncoding = jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_ACCEPT_ENCODING, 0);
+    bool accepted = httpAcceptsEncoding(acceptEncoding, encoding);
+    jsvUnLock(acceptEncoding);
+    if (!accepted) {
+      // we can't decode it here, so all we can do is tell the client
+      jsvObjectSetChild(httpServerResponseVar, HTTP_NAME_SEND_SOURCE, source);
+      socketCloseSendSource(httpServerResponseVar);
+      if (!sendData) {
+        JsVar *headers = jsvNewObject();
+        if (headers) jsvObjectSetChildAndUnLock(headers, "Content-Length", jsvNewFromInteger(0));
+        serverResponseWriteHead(httpServerResponseVar, 406, headers);
+        jsvUnLock(headers);
+      }
+      jsvUnLock(sendData);
+      serverResponseEnd(httpServerResponseVar);
+      return;
+    }
+  }
+  if (!sendData) {
+    // write headers if they weren't written already
+    JsVar *headers = jsvNewObject();
+    if (headers) {
+      if (jsvIsString(mimeType)) jsvObjectSetChild(headers, "Content-Type", mimeType);
+      if (length>=0) jsvObjectSetChildAndUnLock(headers, "Content-Length", jsvNewFromInteger(length));
+      if (jsvIsString(encoding)) {
+        jsvObjectSetChild(headers, "Content-Encoding", encoding);
+        jsvObjectSetChildAndUnLock(headers, "Vary", jsvNewFromString("Accept-Encoding"));
+      }
+      serverResponseWriteHead(httpServerResponseVar, 200, headers);
+      jsvUnLock(headers);
+    }
+  }
+  jsvUnLock(sendData);
+  jsvObjectSetChild(httpServerResponseVar, HTTP_NAME_SEND_SOURCE, source);
+  serverResponseEnd(httpServerResponseVar);
+}
+
 void serverResponseEnd(JsVar *httpServerResponseVar) {
+  socketsChanged = true;
   serverResponseWrite(httpServerResponseVar, 0); // force connection->sendData to be created even if data not called
+  if (!socketHasSendSource(httpServerResponseVar) && // if we have a source, the final chunk is sent after it
+      jsvGetBoolAndUnLock(jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_CHUNKED, 0))) {
+    // If we were sending 'chunked' data, we need to finish up
+    JsVar *sendData = jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_SEND_DATA, 0);
+    if (sendData) jsvAppendString(sendData, "0\r\n\r\n");
+    jsvUnLock(sendData);
+    jsvRemoveNamedChild(httpServerResponseVar, HTTP_NAME_CHUNKED);
+  }
   // TODO: This should only close the connection once the received data length == contentLength header
   jsvObjectSetChildAndUnLock(httpServerResponseVar, HTTP_NAME_CLOSE, jsvNewFromBool(true));
 }
@@ -22,11 +22,12 @@
 typedef enum {
   ST_NORMAL = 0, // standard socket client/server
   ST_HTTP   = 1, // HTTP client/server
-  // WebSockets?
-  // UDP?
+  ST_WEBSOCKET = 2, // WebSocket client, or the server end of an upgraded HTTP connection
+  ST_MQTT   = 3, // MQTT client
+  ST_UDP    = 4, // UDP (dgram) socket
 
-  ST_TYPE_MASK = 3,
-  ST_TLS    = 4, // do the given connection with TLS
+  ST_TYPE_MASK = 7,
+  ST_TLS    = 8, // do the given connection with TLS
 } SocketType;
 
 
@@ -39,14 +40,50 @@ bool socketIdle(JsNetwork *net);
 JsVar *serverNew(SocketType socketType, JsVar *callback);
 void serverListen(JsNetwork *net, JsVar *httpServerVar, int port);
 void serverClose(JsNetwork *net, JsVar *server);
+/** Send HTTP requests for method (or any method if "*") and path (or paths under it, unless path is "/") to handler, which is
+ * a function(req,res) or {addr,len,type,encoding} of data in flash memory. The first route added that matches is used */
+void serverAddRoute(JsVar *server, JsVar *method, JsVar *path, JsVar *handler);
 
 JsVar *clientRequestNew(SocketType socketType, JsVar *options, JsVar *callback);
+/// How many bytes are waiting to be sent on this connection
+size_t socketGetPendingSendLength(JsVar *httpClientReqVar);
 void clientRequestWrite(JsNetwork *net, JsVar *httpClientReqVar, JsVar *data);
 void clientRequestConnect(JsNetwork *net, JsVar *httpClientReqVar);
 void clientRequestEnd(JsNetwork *net, JsVar *httpClientReqVar);
+void clientRequestSetRecvWindow(JsNetwork *net, JsVar *httpClientReqVar, int bytes);
+/// Turn Nagle's algorithm off (noDelay=true) or on, and whether data is sent as soon as it's written
+void clientRequestSetNoDelay(JsNetwork *net, JsVar *httpClientReqVar, bool noDelay);
+/// Stop (or restart) delivering and receiving data for an HTTP client response, so the sender has to wait
+void clientResponseSetPaused(JsVar *httpClientResVar, bool paused);
+/// Get the network driver's statistics for this connection's socket, or 0
+JsVar *clientRequestGetStats(JsNetwork *net, JsVar *httpClientReqVar);
 
 void serverResponseWriteHead(JsVar *httpServerResponseVar, int statusCode, JsVar *headers);
 void serverResponseWrite(JsVar *httpServerResponseVar, JsVar *data);
 void serverResponseEnd(JsVar *httpServerResponseVar);
+/** Send the whole of source (a File, or an object {addr,len} of flash memory) a chunk at a time, then end the response.
+ * If encoding is a string, source is already encoded with it (eg. "gzip"), and is only sent if the client accepts that */
+void serverResponseSendSource(JsVar *httpServerResponseVar, JsVar *source, JsVar *mimeType, int length, JsVar *encoding);
+
+/// Did the client say (with an Accept-Encoding header) that it can accept the given Content-Encoding?
+bool serverRequestAcceptsEncoding(JsVar *httpServerReqVar, JsVar *encoding);
+
+/// Create a new UDP socket (callback is added as a 'message' listener)
+JsVar *dgramSocketNew(JsVar *callback);
+/// Bind the UDP socket to a local port (any port if 0), and start receiving
+void dgramSocketBind(JsNetwork *net, JsVar *dgramSocketVar, int port);
+/// Queue a datagram to send to the given IP address and port, binding to any port first if needed
+void dgramSocketSend(JsNetwork *net, JsVar *dgramSocketVar, JsVar *data, int port, JsVar *address);
+/// Close the UDP socket
+void dgramSocketClose(JsNetwork *net, JsVar *dgramSocketVar);
+
+#ifdef USE_CRYPTO
+/// Add the HTTP upgrade request to a new WebSocket client (from clientRequestNew) so it is sent once connected
+void webSocketClientHandshake(JsVar *webSocketVar);
+/// Send data as a text message
+void webSocketSend(JsVar *webSocketVar, JsVar *data);
+/// Start closing the WebSocket - the connection closes once the close frame has been sent
+void webSocketClose(JsVar *webSocketVar);
+#endif
 
 #endif // SOCKETSERVER_H
@@ -32,7 +32,7 @@ extern int os_printf_plus(const char *format, ...)  __attribute__((format(printf
 
 #ifdef LINUX
 #define PORT 2323 // avoid needing root permissions
-bool telnetEnabled = false; // whether telnet should be enabled or not. Set in main.c
+INSTANCE_LOCAL bool telnetEnabled = false; // whether telnet should be enabled or not. Set in main.c
 #else
 #define PORT 23
 #endif
@@ -44,25 +44,37 @@ void telnetStop(JsNetwork *net);
 bool telnetAccept(JsNetwork *net);
 bool telnetSendBuf(JsNetwork *net);
 bool telnetRecv(JsNetwork *net);
+void telnetClearTx();
 
 // Telnet console data structures
 
 #define MODE_OFF 0    // telnet console is off
 #define MODE_ON  1    // telnet console is on
 
-#define TX_CHUNK 1072         // size of chunks read from JS, buffered, and sent on socket
+#define TX_CHUNK 1460          // biggest single send on the socket - one TCP MSS
+#define TX_BUF_SIZE (2*TX_CHUNK) // ring buffer of console output waiting to be sent
+#define TX_STAGE_SIZE 128      // chars collected before being added to the overflow string
+#define TX_OVERFLOW_MAX 4096   // overflow size at which we wait for the network to catch up
+#define TX_WAIT_MS 2000        // how long we'll wait for the network before giving up on it
+
+/// Console output that didn't fit in txBuf, in hiddenRoot
+#define TX_OVERFLOW_NAME JS_HIDDEN_CHAR_STR"tnTx"
 
 // Data structure for a telnet console server
 typedef struct {
   int          sock;             // listening server socket, 0=none
   int          cliSock;          // active client socket, 0=none
-  char         txBuf[TX_CHUNK];  // transmit buffer
-  uint16_t     txBufLen;         // number of chars in tx buffer
+  char         txBuf[TX_BUF_SIZE]; // ring buffer of data to transmit
+  uint16_t     txHead;           // index of the first char in txBuf
+  uint16_t     txLen;            // number of chars in txBuf
+  char         txStage[TX_STAGE_SIZE]; // chars waiting to go on the end of the overflow string
+  uint8_t      txStageLen;       // number of chars in txStage
+  bool         txOverflow;       // there's data in the overflow string (or txStage)
   IOEventFlags oldConsole;       // device the console was stolen from
 } TelnetServer;
 
-static TelnetServer tnSrv;        // the telnet server, only one right now
-static uint8_t      tnSrvMode;    // current mode for the telnet server
+static INSTANCE_LOCAL TelnetServer tnSrv;        // the telnet server, only one right now
+static INSTANCE_LOCAL uint8_t      tnSrvMode;    // current mode for the telnet server
 
 /*JSON{
   "type"  : "library",
@@ -130,6 +142,7 @@ void jswrap_telnet_init(void) {
 */
 void jswrap_telnet_kill(void) {
   tnSrvMode = MODE_OFF;
+  telnetClearTx();
 }
 
 /*JSON{
@@ -195,6 +208,7 @@ void telnetStop(JsNetwork *net) {
   tnSrv.cliSock = 0;
   if (tnSrv.sock != 0) netCloseSocket(net, tnSrv.sock);
   tnSrv.sock = 0;
+  telnetClearTx();
 }
 
 // Attempt to accept a connection, returns true if it did something
@@ -207,6 +221,7 @@ bool telnetAccept(JsNetwork *net) {
   // if we already have a client, then disconnect it
   if (tnSrv.cliSock != 0) {
     netCloseSocket(net, tnSrv.cliSock);
+    telnetClearTx();
   }
   // if the console is not already telnet, then change it
   IOEventFlags console = jsiGetConsoleDevice();
@@ -220,57 +235,148 @@ bool telnetAccept(JsNetwork *net) {
   return true;
 }
 
+// Forget about any output we haven't sent
+void telnetClearTx() {
+  tnSrv.txHead = 0;
+  tnSrv.txLen = 0;
+  tnSrv.txStageLen = 0;
+  if (tnSrv.txOverflow) jsvRemoveNamedChild(execInfo.hiddenRoot, TX_OVERFLOW_NAME);
+  tnSrv.txOverflow = false;
+}
+
 // Close the connection and release the console device
 void telnetRelease(JsNetwork *net) {
   if (!(tnSrv.sock && tnSrv.cliSock)) return;
   printf("tnSrv: released console from sock %d\n", tnSrv.cliSock);
   netCloseSocket(net, tnSrv.cliSock);
   tnSrv.cliSock = 0;
+  telnetClearTx();
   if (!jsiIsConsoleDeviceForced()) jsiSetConsoleDevice(tnSrv.oldConsole, false);
 }
 
+static INSTANCE_LOCAL bool ovf;
+
+// Move staged chars onto the end of the overflow string. Returns false if we're out of memory
+static bool telnetFlushStage() {
+  if (!tnSrv.txStageLen) return true;
+  JsVar *overflow = jsvObjectGetChild(execInfo.hiddenRoot, TX_OVERFLOW_NAME, JSV_STRING_0);
+  if (!overflow) return false;
+  jsvAppendStringBuf(overflow, tnSrv.txStage, tnSrv.txStageLen);
+  jsvUnLock(overflow);
+  tnSrv.txStageLen = 0;
+  return true;
+}
+
+// Move as much overflow as will fit into the ring buffer
+static void telnetRefillTx() {
+  if (!tnSrv.txOverflow) return;
+  telnetFlushStage();
+  JsVar *overflow = jsvObjectGetChild(execInfo.hiddenRoot, TX_OVERFLOW_NAME, 0);
+  size_t len = jsvGetStringLength(overflow);
+  size_t used = 0;
+  if (!tnSrv.txLen) tnSrv.txHead = 0;
+  // not jsvGetStringChars, as its trailing 0 would land on unsent data or past the end of txBuf
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, overflow, 0);
+  while (used < len && tnSrv.txLen < TX_BUF_SIZE) {
+    // copy into the free space after the data, then the space before it
+    size_t tail = ((size_t)tnSrv.txHead + tnSrv.txLen) % TX_BUF_SIZE;
+    size_t n = (tail >= tnSrv.txHead) ? TX_BUF_SIZE - tail : tnSrv.txHead - tail;
+    if (n > len - used) n = len - used;
+    for (size_t i=0;i<n;i++) {
+      tnSrv.txBuf[tail+i] = jsvStringIteratorGetChar(&it);
+      jsvStringIteratorNext(&it);
+    }
+    tnSrv.txLen = (uint16_t)(tnSrv.txLen + n);
+    used += n;
+  }
+  jsvStringIteratorFree(&it);
+  if (used == len) {
+    jsvRemoveNamedChild(execInfo.hiddenRoot, TX_OVERFLOW_NAME);
+    tnSrv.txOverflow = tnSrv.txStageLen != 0; // we couldn't flush the stage
+  } else if (used) {
+    JsVar *rest = jsvNewFromStringVar(overflow, used, JSVAPPENDSTRINGVAR_MAXLENGTH);
+    if (rest) jsvObjectSetChild(execInfo.hiddenRoot, TX_OVERFLOW_NAME, rest);
+    jsvUnLock(rest);
+  }
+  jsvUnLock(overflow);
+}
+
 // Attempt to send buffer on an established client connection, returns true if it sent something
 bool telnetSendBuf(JsNetwork *net) {
   if (tnSrv.sock == 0 || tnSrv.cliSock == 0) return false;
 
   // if we have nothing buffered, that's it
-  if (tnSrv.txBufLen == 0) return false;
-
-  // try to send the tx buffer
-  int sent = netSend(net, tnSrv.cliSock, tnSrv.txBuf, tnSrv.txBufLen);
-  if (sent == tnSrv.txBufLen) {
-    tnSrv.txBufLen = 0;
-  } else if (sent > 0) {
-    // shift remaining chars up in the buffer
-    memmove(tnSrv.txBuf, tnSrv.txBuf+sent, (size_t)(tnSrv.txBufLen-sent));
-    tnSrv.txBufLen -= (uint16_t)sent;
+  if (tnSrv.txLen == 0) telnetRefillTx();
+  if (tnSrv.txLen == 0) return false;
+
+  // send straight out of the ring buffer - as much as is contiguous, up to a whole packet
+  size_t len = tnSrv.txLen;
+  if (len > (size_t)(TX_BUF_SIZE - tnSrv.txHead)) len = (size_t)(TX_BUF_SIZE - tnSrv.txHead);
+  if (len > TX_CHUNK) len = TX_CHUNK;
+  int sent = netSend(net, tnSrv.cliSock, &tnSrv.txBuf[tnSrv.txHead], len);
+  if (sent > 0) {
+    tnSrv.txHead = (uint16_t)((tnSrv.txHead + sent) % TX_BUF_SIZE);
+    tnSrv.txLen = (uint16_t)(tnSrv.txLen - sent);
+    telnetRefillTx();
   } else if (sent < 0) {
     telnetRelease(net);
   }
-  if (sent != 0) {
-    //printf("tnSrv: sent sock=%d, %d bytes, %d left\n", tnSrv.sock, sent, tnSrv.txBufLen);
-  }
   return sent != 0;
 }
 
-static bool ovf;
+// Wait for the network to take some of our output, returns false if it didn't
+static bool telnetWaitForSend() {
+#ifdef ESP8266
+  // sends only complete from SDK callbacks, which can't run until we return
+  return false;
+#else
+  JsNetwork net;
+  if (!networkGetFromVarIfOnline(&net)) return false;
+  JsSysTime timeout = jshGetSystemTime() + jshGetTimeFromMilliseconds(TX_WAIT_MS);
+  bool sent = false;
+  while (!sent && tnSrv.cliSock && jshGetSystemTime() < timeout)
+    sent = telnetSendBuf(&net);
+  networkFree(&net);
+  return sent;
+#endif
+}
+
+/// Is the transmit ring full, so telnetSendChar would have to store data in a string (or wait)?
+bool telnetIsSendBufferFull() {
+  if (tnSrv.sock == 0 || tnSrv.cliSock == 0) return false; // data is just discarded
+  return tnSrv.txOverflow || tnSrv.txLen >= TX_BUF_SIZE;
+}
 
 void telnetSendChar(char ch) {
   if (tnSrv.sock == 0 || tnSrv.cliSock == 0) return;
-  if (tnSrv.txBufLen >= TX_CHUNK) {
-    // buffer overflow :-(
-    if (!ovf) {
-      printf("tnSrv: send overflow!\n");
-      ovf = true;
-    }
+  if (!tnSrv.txOverflow && tnSrv.txLen < TX_BUF_SIZE) {
+    tnSrv.txBuf[(tnSrv.txHead + tnSrv.txLen) % TX_BUF_SIZE] = ch;
+    tnSrv.txLen++;
   } else {
+    // the ring buffer is full - keep the rest in a string until there's space
+    tnSrv.txOverflow = true;
+    if (tnSrv.txStageLen == TX_STAGE_SIZE) {
+      // don't let the output get too far ahead of the network
+      JsVar *overflow = jsvObjectGetChild(execInfo.hiddenRoot, TX_OVERFLOW_NAME, 0);
+      size_t overflowLen = jsvGetStringLength(overflow);
+      jsvUnLock(overflow);
+      if (overflowLen >= TX_OVERFLOW_MAX) telnetWaitForSend();
+      if (!telnetFlushStage()) {
+        // out of memory :-(
+        if (!ovf) {
+          printf("tnSrv: send overflow!\n");
+          ovf = true;
+        }
+        return;
+      }
+    }
     ovf = false;
-    tnSrv.txBuf[tnSrv.txBufLen++] = ch;
+    tnSrv.txStage[tnSrv.txStageLen++] = ch;
   }
 
-  // if the buffer has a bunch of chars then try to send, else it'll happen
-  // at idle time.
-  if (tnSrv.txBufLen < TX_CHUNK/4) return;
+  // once we have a whole packet, try to send it - else it'll happen at idle time
+  if (tnSrv.txLen < TX_CHUNK) return;
   JsNetwork net;
   if (!networkGetFromVarIfOnline(&net)) return;
   telnetSendBuf(&net);
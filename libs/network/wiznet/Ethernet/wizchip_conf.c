@@ -169,6 +169,14 @@ void reg_wizchip_spi_cbfunc(uint8_t (*spi_rb)(void), void (*spi_wb)(uint8_t wb))
    }
 }
 
+void reg_wizchip_spiburst_cbfunc(void (*spi_rb)(uint8_t* pBuf, uint16_t len), void (*spi_wb)(uint8_t* pBuf, uint16_t len))
+{
+   while(!(WIZCHIP.if_mode & _WIZCHIP_IO_MODE_SPI_));
+
+   WIZCHIP.IF.SPI._read_burst   = spi_rb;
+   WIZCHIP.IF.SPI._write_burst  = spi_wb;
+}
+
 int8_t ctlwizchip(ctlwizchip_type cwtype, void* arg)
 {
    uint8_t tmp = 0;
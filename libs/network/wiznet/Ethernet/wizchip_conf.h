@@ -188,6 +188,8 @@ typedef struct __WIZCHIP
       {
          uint8_t (*_read_byte)   (void);
          void    (*_write_byte)  (uint8_t wb);
+         void    (*_read_burst)  (uint8_t* pBuf, uint16_t len);  ///< optional - 0 to use _read_byte
+         void    (*_write_burst) (uint8_t* pBuf, uint16_t len);  ///< optional - 0 to use _write_byte
       }SPI;
       // To be added
       //
@@ -395,6 +397,14 @@ void reg_wizchip_bus_cbfunc(uint8_t (*bus_rb)(uint32_t addr), void (*bus_wb)(uin
  */
 void reg_wizchip_spi_cbfunc(uint8_t (*spi_rb)(void), void (*spi_wb)(uint8_t wb));
 
+/**
+ *@brief Registers call back functions for SPI burst (block) transfers.
+ *@param spi_rb : callback function to read a block of bytes using SPI
+ *@param spi_wb : callback function to write a block of bytes using SPI
+ *@note If these are not registered (or are null), bytes are transferred one at a time.
+ */
+void reg_wizchip_spiburst_cbfunc(void (*spi_rb)(uint8_t* pBuf, uint16_t len), void (*spi_wb)(uint8_t* pBuf, uint16_t len));
+
 /**
  * @ingroup extra_functions
  * @brief Controls to the WIZCHIP.
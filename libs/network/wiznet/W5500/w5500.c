@@ -70,10 +70,22 @@ uint8_t  WIZCHIP_READ(uint32_t AddrSel)
       #error "Unsupported _WIZCHIP_IO_SPI_ in W5500 !!!"
    #endif
 
-   WIZCHIP.IF.SPI._write_byte((AddrSel & 0x00FF0000) >> 16);
-   WIZCHIP.IF.SPI._write_byte((AddrSel & 0x0000FF00) >>  8);
-   WIZCHIP.IF.SPI._write_byte((AddrSel & 0x000000FF) >>  0);
-   ret = WIZCHIP.IF.SPI._read_byte();
+   if (WIZCHIP.IF.SPI._read_burst && WIZCHIP.IF.SPI._write_burst)
+   {
+      uint8_t spi_data[3];
+      spi_data[0] = (AddrSel & 0x00FF0000) >> 16;
+      spi_data[1] = (AddrSel & 0x0000FF00) >>  8;
+      spi_data[2] = (AddrSel & 0x000000FF) >>  0;
+      WIZCHIP.IF.SPI._write_burst(spi_data, 3);
+      WIZCHIP.IF.SPI._read_burst(&ret, 1);
+   }
+   else
+   {
+      WIZCHIP.IF.SPI._write_byte((AddrSel & 0x00FF0000) >> 16);
+      WIZCHIP.IF.SPI._write_byte((AddrSel & 0x0000FF00) >>  8);
+      WIZCHIP.IF.SPI._write_byte((AddrSel & 0x000000FF) >>  0);
+      ret = WIZCHIP.IF.SPI._read_byte();
+   }
 
 #elif ( (_WIZCHIP_IO_MODE_ & _WIZCHIP_IO_MODE_BUS_) )
 
@@ -108,10 +120,22 @@ void     WIZCHIP_WRITE(uint32_t AddrSel, uint8_t wb )
       #error "Unsupported _WIZCHIP_IO_SPI_ in W5500 !!!"
    #endif
 
-   WIZCHIP.IF.SPI._write_byte((AddrSel & 0x00FF0000) >> 16);
-   WIZCHIP.IF.SPI._write_byte((AddrSel & 0x0000FF00) >>  8);
-   WIZCHIP.IF.SPI._write_byte((AddrSel & 0x000000FF) >>  0);
-   WIZCHIP.IF.SPI._write_byte(wb);
+   if (WIZCHIP.IF.SPI._write_burst)
+   {
+      uint8_t spi_data[4];
+      spi_data[0] = (AddrSel & 0x00FF0000) >> 16;
+      spi_data[1] = (AddrSel & 0x0000FF00) >>  8;
+      spi_data[2] = (AddrSel & 0x000000FF) >>  0;
+      spi_data[3] = wb;
+      WIZCHIP.IF.SPI._write_burst(spi_data, 4);
+   }
+   else
+   {
+      WIZCHIP.IF.SPI._write_byte((AddrSel & 0x00FF0000) >> 16);
+      WIZCHIP.IF.SPI._write_byte((AddrSel & 0x0000FF00) >>  8);
+      WIZCHIP.IF.SPI._write_byte((AddrSel & 0x000000FF) >>  0);
+      WIZCHIP.IF.SPI._write_byte(wb);
+   }
 
 #elif ( (_WIZCHIP_IO_MODE_ & _WIZCHIP_IO_MODE_BUS_) )
 
@@ -141,11 +165,24 @@ void     WIZCHIP_READ_BUF (uint32_t AddrSel, uint8_t* pBuf, uint16_t len)
 
    #if  ( _WIZCHIP_IO_MODE_ == _WIZCHIP_IO_MODE_SPI_VDM_ )
       AddrSel |= (_W5500_SPI_READ_ | _W5500_SPI_VDM_OP_);
-      WIZCHIP.IF.SPI._write_byte((AddrSel & 0x00FF0000) >> 16);
-      WIZCHIP.IF.SPI._write_byte((AddrSel & 0x0000FF00) >>  8);
-      WIZCHIP.IF.SPI._write_byte((AddrSel & 0x000000FF) >>  0);
-      for(i = 0; i < len; i++,j)
-        pBuf[i] = WIZCHIP.IF.SPI._read_byte();
+      if (WIZCHIP.IF.SPI._read_burst && WIZCHIP.IF.SPI._write_burst)
+      {
+         // send the address and read the data as blocks rather than a byte at a time
+         uint8_t spi_data[3];
+         spi_data[0] = (AddrSel & 0x00FF0000) >> 16;
+         spi_data[1] = (AddrSel & 0x0000FF00) >>  8;
+         spi_data[2] = (AddrSel & 0x000000FF) >>  0;
+         WIZCHIP.IF.SPI._write_burst(spi_data, 3);
+         WIZCHIP.IF.SPI._read_burst(pBuf, len);
+      }
+      else
+      {
+         WIZCHIP.IF.SPI._write_byte((AddrSel & 0x00FF0000) >> 16);
+         WIZCHIP.IF.SPI._write_byte((AddrSel & 0x0000FF00) >>  8);
+         WIZCHIP.IF.SPI._write_byte((AddrSel & 0x000000FF) >>  0);
+         for(i = 0; i < len; i++,j)
+           pBuf[i] = WIZCHIP.IF.SPI._read_byte();
+      }
    #elif( _WIZCHIP_IO_MODE_ == _WIZCHIP_IO_MODE_SPI_FDM_ )
       AddrSel |= (_W5500_SPI_READ_ | _W5500_SPI_FDM_OP_LEN4_);
       for(i = 0; i < len/4; i++, j)
@@ -218,11 +255,24 @@ void     WIZCHIP_WRITE_BUF(uint32_t AddrSel, uint8_t* pBuf, uint16_t len)
 
    #if  ( _WIZCHIP_IO_MODE_ == _WIZCHIP_IO_MODE_SPI_VDM_ )
       AddrSel |= (_W5500_SPI_WRITE_ | _W5500_SPI_VDM_OP_);
-      WIZCHIP.IF.SPI._write_byte((AddrSel & 0x00FF0000) >> 16);
-      WIZCHIP.IF.SPI._write_byte((AddrSel & 0x0000FF00) >>  8);
-      WIZCHIP.IF.SPI._write_byte((AddrSel & 0x000000FF) >>  0);
-      for(i = 0; i < len; i++,j)
-         WIZCHIP.IF.SPI._write_byte(pBuf[i]);
+      if (WIZCHIP.IF.SPI._write_burst)
+      {
+         // send the address and data as blocks rather than a byte at a time
+         uint8_t spi_data[3];
+         spi_data[0] = (AddrSel & 0x00FF0000) >> 16;
+         spi_data[1] = (AddrSel & 0x0000FF00) >>  8;
+         spi_data[2] = (AddrSel & 0x000000FF) >>  0;
+         WIZCHIP.IF.SPI._write_burst(spi_data, 3);
+         WIZCHIP.IF.SPI._write_burst(pBuf, len);
+      }
+      else
+      {
+         WIZCHIP.IF.SPI._write_byte((AddrSel & 0x00FF0000) >> 16);
+         WIZCHIP.IF.SPI._write_byte((AddrSel & 0x0000FF00) >>  8);
+         WIZCHIP.IF.SPI._write_byte((AddrSel & 0x000000FF) >>  0);
+         for(i = 0; i < len; i++,j)
+            WIZCHIP.IF.SPI._write_byte(pBuf[i]);
+      }
    #elif( _WIZCHIP_IO_MODE_ == _WIZCHIP_IO_MODE_SPI_FDM_ )
       AddrSel |= (_W5500_SPI_WRITE_ | _W5500_SPI_FDM_OP_LEN4_);
       for(i = 0; i < len/4; i++, j)
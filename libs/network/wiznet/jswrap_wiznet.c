@@ -57,6 +57,34 @@ uint8_t wizchip_read() {
    return wizchip_rw(0xFF);
 }
 
+#define WIZCHIP_BURST_CHUNK 64
+
+/// Read a block of data - much faster than calling wizchip_read for each byte
+static void wizchip_read_burst(uint8_t *pBuf, uint16_t len) {
+  assert(networkGetCurrent());
+  unsigned char tx[WIZCHIP_BURST_CHUNK];
+  memset(tx, 0xFF, sizeof(tx));
+  while (len) {
+    uint16_t n = (len < WIZCHIP_BURST_CHUNK) ? len : WIZCHIP_BURST_CHUNK;
+    jshSPISendMany(networkGetCurrent()->data.device, tx, pBuf, n);
+    pBuf += n;
+    len = (uint16_t)(len - n);
+  }
+}
+
+/// Write a block of data - much faster than calling wizchip_write for each byte
+static void wizchip_write_burst(uint8_t *pBuf, uint16_t len) {
+  assert(networkGetCurrent());
+  // we don't want what comes back, but it has to be read or we'd get it from the next read
+  unsigned char rx[WIZCHIP_BURST_CHUNK];
+  while (len) {
+    uint16_t n = (len < WIZCHIP_BURST_CHUNK) ? len : WIZCHIP_BURST_CHUNK;
+    jshSPISendMany(networkGetCurrent()->data.device, pBuf, rx, n);
+    pBuf += n;
+    len = (uint16_t)(len - n);
+  }
+}
+
 
 /*JSON{
   "type" : "library",
@@ -71,14 +99,15 @@ Library for communication with the WIZnet Ethernet module
   "generate" : "jswrap_wiznet_connect",
   "params" : [
     ["spi", "JsVar", "Device to use for SPI (or undefined to use the default)"],
-    ["cs", "pin", "The pin to use for Chip Select"]
+    ["cs", "pin", "The pin to use for Chip Select"],
+    ["irq", "pin", "(optional) The pin connected to the WIZnet's INTn output. If given, sockets are only checked when the WIZnet reports activity on them"]
   ],
   "return" : ["JsVar","An Ethernet Object"],
   "return_object" : "Ethernet"
 }
 Initialise the WIZnet module and return an Ethernet object
 */
-JsVar *jswrap_wiznet_connect(JsVar *spi, Pin cs) {
+JsVar *jswrap_wiznet_connect(JsVar *spi, Pin cs, Pin irq) {
 
   IOEventFlags spiDevice;
   if (spi) {
@@ -106,6 +135,7 @@ JsVar *jswrap_wiznet_connect(JsVar *spi, Pin cs) {
   networkCreate(&net, JSNETWORKTYPE_W5500);
   net.data.device = spiDevice;
   net.data.pinCS = cs;
+  net.data.pinIRQ = jshIsPinValid(irq) ? irq : PIN_UNDEFINED;
   networkSet(&net);
 
   JsVar *ethObj = jspNewObject(0, "Ethernet");
@@ -117,6 +147,7 @@ JsVar *jswrap_wiznet_connect(JsVar *spi, Pin cs) {
   // Initialise WIZnet functions
   reg_wizchip_cs_cbfunc(wizchip_select, wizchip_deselect);
   reg_wizchip_spi_cbfunc(wizchip_read, wizchip_write);
+  reg_wizchip_spiburst_cbfunc(wizchip_read_burst, wizchip_write_burst);
 
   /* wizchip initialize*/
   uint8_t tmp;
@@ -138,6 +169,16 @@ JsVar *jswrap_wiznet_connect(JsVar *spi, Pin cs) {
     }
   } while (tmp == PHY_LINK_OFF);
 
+  if (net.data.pinIRQ != PIN_UNDEFINED) {
+    // INTn goes low when data is received, or a socket connects or disconnects
+    uint8_t sn;
+    for (sn=0;sn<_WIZCHIP_SOCK_NUM_;sn++)
+      setSn_IMR(sn, WIZNET_SOCKET_IRQS);
+    setSIMR(0xFF);
+    jshPinSetState(net.data.pinIRQ, JSHPINSTATE_GPIO_IN_PULLUP);
+    jshPinWatch(net.data.pinIRQ, true); // so that INTn wakes us up if we're asleep
+  }
+
   networkFree(&net);
 
   networkState = NETWORKSTATE_ONLINE;
@@ -14,7 +14,7 @@
 #include "jsvar.h"
 #include "jspin.h"
 
-JsVar *jswrap_wiznet_connect(JsVar *spi, Pin cs);
+JsVar *jswrap_wiznet_connect(JsVar *spi, Pin cs, Pin irq);
 
 JsVar *jswrap_ethernet_getIP(JsVar *wlanObj);
 bool jswrap_ethernet_setIP(JsVar *wlanObj, JsVar *options);
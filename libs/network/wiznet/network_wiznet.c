@@ -59,7 +59,17 @@ void net_wiznet_gethostbyname(JsNetwork *net, char * hostName, uint32_t* out_ip_
 
 /// Called on idle. Do any checks required for this device
 void net_wiznet_idle(JsNetwork *net) {
-  NOT_USED(net);
+  // INTn is low while there are socket interrupts we haven't cleared
+  if (net->data.pinIRQ != PIN_UNDEFINED && !jshPinGetValue(net->data.pinIRQ)) {
+    uint8_t sir = getSIR();
+    uint8_t sn;
+    for (sn=0;sn<_WIZCHIP_SOCK_NUM_;sn++) {
+      if (sir & (1<<sn)) {
+        setSn_IR(sn, getSn_IR(sn) & WIZNET_SOCKET_IRQS);
+        networkSetSocketReady(sn);
+      }
+    }
+  }
 }
 
 /// Call just before returning to idle loop. This checks for errors and tries to recover. Returns true if no errors.
@@ -181,6 +191,8 @@ void netSetCallbacks_wiznet(JsNetwork *net) {
   net->gethostbyname = net_wiznet_gethostbyname;
   net->recv = net_wiznet_recv;
   net->send = net_wiznet_send;
-  net->chunkSize = 536;
+  net->chunkSize = 1460; // a whole TCP segment - each socket has 2kB of buffer on the W5500
+  // with INTn connected, we know which sockets have had something happen
+  net->reportsReady = net->data.pinIRQ != PIN_UNDEFINED;
 }
 
@@ -13,6 +13,9 @@
  */
 #include "network.h"
 
+/// Socket interrupts that make INTn go low if an IRQ pin was given (SENDOK/TIMEOUT are handled in socket.c)
+#define WIZNET_SOCKET_IRQS (Sn_IR_RECV|Sn_IR_DISCON|Sn_IR_CON)
+
 uint8_t net_wiznet_getFreeSocket();
 
 void netSetCallbacks_wiznet(JsNetwork *net);
@@ -134,7 +134,7 @@ def get_arguments(jsondata):
   if "params" in jsondata:
     for param in jsondata["params"]:
       args.append(param[0]);
-      if param[1]=="JsVarArray": args.append("...");
+      if param[1]=="JsVarArray" or param[1]=="JsVarArgs": args.append("...");
   return "("+", ".join(args)+")"
 
 def get_surround(jsondata):
@@ -347,7 +347,7 @@ for jsondata in detail:
       if len(param)>2: desc=param[2]
       if isinstance(desc, list): desc = '<br/>'.join(desc)
       extra = ""
-      if  param[1]=="JsVarArray": extra = ", ...";
+      if  param[1]=="JsVarArray" or param[1]=="JsVarArgs": extra = ", ...";
       html("   <p class=\"param\"><b> "+param[0]+extra+"</b> "+htmlify(desc)+"</p>")
   if "return" in jsondata:
     html("  <h4>Returns</h4>")
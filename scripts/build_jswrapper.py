@@ -70,6 +70,7 @@ def toArgumentType(argName):
   if argName=="": return "JSWAT_VOID";
   if argName=="JsVar": return "JSWAT_JSVAR";
   if argName=="JsVarArray": return "JSWAT_ARGUMENT_ARRAY";
+  if argName=="JsVarArgs": return "JSWAT_ARGUMENT_LIST";
   if argName=="bool": return "JSWAT_BOOL";
   if argName=="pin": return "JSWAT_PIN";
   if argName=="int32": return "JSWAT_INT32";
@@ -82,6 +83,7 @@ def toCType(argName):
   if argName=="": return "void";
   if argName=="JsVar": return "JsVar*";
   if argName=="JsVarArray": return "JsVar*";
+  if argName=="JsVarArgs": return "JsVar**, int";
   if argName=="bool": return "bool";
   if argName=="pin": return "Pin";
   if argName=="int32": return "int";
@@ -134,12 +136,71 @@ def getCDeclaration(jsondata, name):
     s.append(toCType(param[1]));
   return toCType(result[0])+" "+name+"("+",".join(s)+")";
 
+# Hash used for the perfect hash tables - this must match jswSymbolHash/jswSymbolHashSlot
+def symbolHash(name):
+  h = 0x811C9DC5
+  for c in name:
+    h = ((h ^ ord(c)) * 16777619) & 0xFFFFFFFF
+  return h
+
+def symbolHashSlot(h, seed, mask):
+  x = (h ^ (seed * 0x9E3779B1)) & 0xFFFFFFFF
+  x = x ^ (x >> 16)
+  x = (x * 0x85EBCA6B) & 0xFFFFFFFF
+  x = x ^ (x >> 13)
+  return x & mask
+
+# Build a perfect hash for the given (sorted) names using 'hash and displace':
+# each name goes in a bucket, and each bucket gets a seed that puts all of its
+# names into free slots. Returns (seeds, slots, mask) where slots contains
+# the symbol index or 255 if empty. If a name is in the list twice (eg.
+# OneWire.search) the last one is used, as it has the most arguments
+def buildSymbolHash(allNames):
+  if len(allNames)>255: raise Exception("Too many symbols for perfect hash")
+  names = []
+  indices = []
+  for idx in range(len(allNames)):
+    if allNames[idx] in names:
+      indices[names.index(allNames[idx])] = idx
+    else:
+      names.append(allNames[idx])
+      indices.append(idx)
+  if len(names)==0: return ([0], [255], 0)
+  size = 1
+  while size < len(names): size = size*2
+  while True:
+    bucketCount = max(1, (len(names)+3)//4)
+    while bucketCount <= len(names):
+      buckets = [[] for i in range(bucketCount)]
+      for idx in range(len(names)):
+        h = symbolHash(names[idx])
+        buckets[(h >> 16) % bucketCount].append((idx, h))
+      slots = [255] * size
+      seeds = [0] * bucketCount
+      ok = True
+      # biggest buckets first, as they're hardest to place
+      for b in sorted(range(bucketCount), key=lambda b: -len(buckets[b])):
+        if len(buckets[b])==0: continue
+        for seed in range(256):
+          pos = [symbolHashSlot(h, seed, size-1) for (idx, h) in buckets[b]]
+          if len(set(pos))==len(pos) and all(slots[p]==255 for p in pos):
+            break
+        else:
+          ok = False
+          break
+        seeds[b] = seed
+        for i in range(len(pos)): slots[pos[i]] = indices[buckets[b][i][0]]
+      if ok: return (seeds, slots, size-1)
+      bucketCount = bucketCount*2
+    size = size*2
+
 def codeOutSymbolTable(builtin):
   codeName = builtin["name"]
   # sort by name
   builtin["functions"] = sorted(builtin["functions"], key=lambda n: n["name"]);
   # output tables
   listSymbols = []
+  listNames = []
   listChars = ""
   strLen = 0
   for sym in builtin["functions"]:
@@ -149,6 +210,7 @@ def codeOutSymbolTable(builtin):
       continue # don't include libraries on global namespace
     if "generate" in sym:
       listSymbols.append("{"+", ".join([str(strLen), getArgumentSpecifier(sym), "(void (*)(void))"+sym["generate"]])+"}")
+      listNames.append(symName)
       listChars = listChars + symName + "\\0";
       strLen = strLen + len(symName) + 1
     else:
@@ -156,6 +218,13 @@ def codeOutSymbolTable(builtin):
   builtin["symbolTableChars"] = "\""+listChars+"\"";
   builtin["symbolTableCount"] = str(len(listSymbols));
   codeOut("static const JswSymPtr jswSymbols_"+codeName+"[] FLASH_SECT = {\n  "+",\n  ".join(listSymbols)+"\n};");
+  (seeds, slots, mask) = buildSymbolHash(listNames)
+  builtin["symbolTableHashSeedCount"] = str(len(seeds));
+  builtin["symbolTableHashMask"] = str(mask);
+  codeOut("#ifndef SAVE_ON_FLASH");
+  codeOut("static const unsigned char jswSymbols_"+codeName+"_seeds[] FLASH_SECT = { "+", ".join(map(str,seeds))+" };");
+  codeOut("static const unsigned char jswSymbols_"+codeName+"_slots[] FLASH_SECT = { "+", ".join(map(str,slots))+" };");
+  codeOut("#endif");
 
 def codeOutBuiltins(indent, builtin):
   codeOut(indent+"jswBinarySearch(&jswSymbolTables["+builtin["indexName"]+"], parent, name);");
@@ -250,10 +319,13 @@ for jsondata in jsondatas:
       result = getResult(jsondata);
       if hasThis(jsondata): s.append("JsVar *parent");
       for param in params:
-        s.append(toCType(param[1])+" "+param[0]);
+        if param[1]=="JsVarArgs": s.append("JsVar **argPtr, int argCount");
+        else: s.append(toCType(param[1])+" "+param[0]);
      
     codeOut("static "+toCType(result[0])+" "+jsondata["generate"]+"("+", ".join(s)+") {");
-    if result[0]:
+    if result[0]=="float": # constants are doubles, but JsVarFloat may be a float (USE_FLOATS)
+      codeOut("  return (JsVarFloat)("+jsondata["generate_full"]+");");
+    elif result[0]:
       codeOut("  return "+jsondata["generate_full"]+";");
     else:
       codeOut("  "+jsondata["generate_full"]+";");  
@@ -265,10 +337,118 @@ codeOut('// --------------------------------------------------------------------
 codeOut('// -----------------------------------------------------------------------------------------');
 codeOut('');
 
+# Native functions with these signatures get called directly from jswCallFunctionFast rather
+# than having jsnCallFunction unpack the argument specifier bit by bit. We pick the most common
+# signatures, plus any used by functions that often get called in tight loops.
+FAST_CALL_MIN_COUNT = 3
+FAST_CALL_HOT = [ "digitalWrite", "digitalRead", "analogRead", "analogWrite", "getTime", "peek8", "poke8" ]
+
+def toArgumentGetter(argName, expr):
+  if argName=="JsVar": return expr
+  if argName=="bool": return "jsvGetBool("+expr+")"
+  if argName=="pin": return "jshGetPinFromVar("+expr+")"
+  if argName=="int32" or argName=="int": return "("+toCType(argName)+")jsvGetInteger("+expr+")"
+  if argName=="float": return "jsvGetFloat("+expr+")"
+
+def toResultVar(argName, expr):
+  if argName=="JsVar": return expr
+  if argName=="bool": return "jsvNewFromBool("+expr+")"
+  if argName=="pin": return "jsvNewFromPin("+expr+")"
+  if argName=="int32" or argName=="int": return "jsvNewFromInteger("+expr+")"
+  if argName=="float": return "jsvNewFromFloat("+expr+")"
+
+fastCalls = {}
+for jsondata in jsondatas:
+  if not "generate" in jsondata or not "name" in jsondata or jsondata["type"]=="object" or jsondata["type"]=="variable" or common.is_property(jsondata):
+    continue
+  params = getParams(jsondata)
+  if len(params)>4 or any(param[1]=="JsVarArray" or param[1]=="JsVarArgs" for param in params):
+    continue
+  spec = getArgumentSpecifier(jsondata)
+  if not spec in fastCalls:
+    fastCalls[spec] = { "count" : 0, "hot" : False, "this" : hasThis(jsondata),
+                        "params" : [param[1] for param in params], "result" : getResult(jsondata)[0] }
+  fastCalls[spec]["count"] += 1
+  if jsondata["name"] in FAST_CALL_HOT and not "class" in jsondata:
+    fastCalls[spec]["hot"] = True
+
 codeOut("""
-// Binary search coded to allow for JswSyms to be in flash on the esp8266 where they require
-// word accesses
+#ifndef SAVE_ON_FLASH
+#define JSW_ARG(n) (((n)<paramCount) ? paramData[n] : 0)
+bool jswCallFunctionFast(void *function, JsnArgumentType argumentSpecifier, JsVar *thisParam, JsVar **paramData, int paramCount, JsVar **result) {
+  switch ((int)argumentSpecifier) {""")
+for spec in sorted(fastCalls, key=lambda spec: -fastCalls[spec]["count"]):
+  call = fastCalls[spec]
+  if call["count"]<FAST_CALL_MIN_COUNT and not call["hot"]:
+    continue
+  cTypes = []
+  args = []
+  if call["this"]:
+    cTypes.append("JsVar*")
+    args.append("thisParam")
+  for n in range(len(call["params"])):
+    cTypes.append(toCType(call["params"][n]))
+    args.append(toArgumentGetter(call["params"][n], "JSW_ARG("+str(n)+")"))
+  expr = "(("+toCType(call["result"])+" (*)("+(",".join(cTypes) or "void")+"))function)("+", ".join(args)+")"
+  codeOut("  case "+spec+":")
+  if call["result"]:
+    codeOut("    *result = "+toResultVar(call["result"], expr)+";")
+  else:
+    codeOut("    "+expr+";")
+    codeOut("    *result = 0;")
+  codeOut("    return true;")
+codeOut("""  default:
+    return false;
+  }
+}
+#endif""")
+
+codeOut("""
+#ifndef SAVE_ON_FLASH
+// Hash of a symbol name - this must match symbolHash in build_jswrapper.py
+static uint32_t jswSymbolHash(const char *name) {
+  uint32_t h = 0x811C9DC5;
+  while (*name) h = (h ^ (unsigned char)*(name++)) * 16777619;
+  return h;
+}
+
+// Which slot a symbol hashes to with the given seed - must match symbolHashSlot in build_jswrapper.py
+static unsigned int jswSymbolHashSlot(uint32_t h, unsigned char seed, unsigned short mask) {
+  uint32_t x = h ^ (seed * 0x9E3779B1);
+  x ^= x >> 16;
+  x *= 0x85EBCA6B;
+  x ^= x >> 13;
+  return x & mask;
+}
+#endif
+
+static JsVar *jswGetSymbol(const JswSymPtr *sym, JsVar *parent) {
+  unsigned short functionSpec = READ_FLASH_UINT16(&sym->functionSpec);
+  if ((functionSpec & JSWAT_EXECUTE_IMMEDIATELY_MASK) == JSWAT_EXECUTE_IMMEDIATELY)
+    return jsnCallFunction(sym->functionPtr, functionSpec, parent, 0, 0);
+#ifndef SAVE_ON_FLASH
+  return jsvNewNativeFunctionShared(sym->functionPtr, functionSpec);
+#else
+  return jsvNewNativeFunction(sym->functionPtr, functionSpec);
+#endif
+}
+
+// Search coded to allow for JswSyms to be in flash on the esp8266 where they require
+// word accesses. Normally this uses the perfect hash built by build_jswrapper.py, so
+// only one string comparison is needed, but SAVE_ON_FLASH builds do a binary search
 JsVar *jswBinarySearch(const JswSymList *symbolsPtr, JsVar *parent, const char *name) {
+#ifndef SAVE_ON_FLASH
+  uint32_t h = jswSymbolHash(name);
+  unsigned char seedCount = READ_FLASH_UINT8(&symbolsPtr->hashSeedCount);
+  unsigned short mask = READ_FLASH_UINT16(&symbolsPtr->hashMask);
+  unsigned char seed = READ_FLASH_UINT8(&symbolsPtr->hashSeeds[(h >> 16) % seedCount]);
+  unsigned char idx = READ_FLASH_UINT8(&symbolsPtr->hashSlots[jswSymbolHashSlot(h, seed, mask)]);
+  if (idx == 255) return 0;
+  const JswSymPtr *sym = &symbolsPtr->symbols[idx];
+  unsigned short strOffset = READ_FLASH_UINT16(&sym->strOffset);
+  if (FLASH_STRCMP(name, &symbolsPtr->symbolChars[strOffset])) return 0;
+  return jswGetSymbol(sym, parent);
+#else
   uint8_t symbolCount = READ_FLASH_UINT8(&symbolsPtr->symbolCount);
   int searchMin = 0;
   int searchMax = symbolCount - 1;
@@ -278,10 +458,7 @@ JsVar *jswBinarySearch(const JswSymList *symbolsPtr, JsVar *parent, const char *
     unsigned short strOffset = READ_FLASH_UINT16(&sym->strOffset);
     int cmp = FLASH_STRCMP(name, &symbolsPtr->symbolChars[strOffset]);
     if (cmp==0) {
-      unsigned short functionSpec = READ_FLASH_UINT16(&sym->functionSpec);
-      if ((functionSpec & JSWAT_EXECUTE_IMMEDIATELY_MASK) == JSWAT_EXECUTE_IMMEDIATELY)
-        return jsnCallFunction(sym->functionPtr, functionSpec, parent, 0, 0);
-      return jsvNewNativeFunction(sym->functionPtr, functionSpec);
+      return jswGetSymbol(sym, parent);
     } else {
       if (cmp<0) {
         // searchMin is the same
@@ -293,8 +470,8 @@ JsVar *jswBinarySearch(const JswSymList *symbolsPtr, JsVar *parent, const char *
     }
   }
   return 0;
+#endif
 }
-
 """);
 
 codeOut('// -----------------------------------------------------------------------------------------');
@@ -359,7 +536,11 @@ codeOut('');
 codeOut('const JswSymList jswSymbolTables[] FLASH_SECT = {');
 for b in builtins:
   builtin = builtins[b]
-  codeOut("  {"+", ".join(["jswSymbols_"+builtin["name"], "jswSymbols_"+builtin["name"]+"_str", builtin["symbolTableCount"]])+"},");
+  codeOut("  {"+", ".join(["jswSymbols_"+builtin["name"], "jswSymbols_"+builtin["name"]+"_str", builtin["symbolTableCount"]])+",");
+  codeOut("#ifndef SAVE_ON_FLASH");
+  codeOut("   "+", ".join(["jswSymbols_"+builtin["name"]+"_seeds", "jswSymbols_"+builtin["name"]+"_slots", builtin["symbolTableHashSeedCount"], builtin["symbolTableHashMask"]]));
+  codeOut("#endif");
+  codeOut("  },");
 codeOut('};');
 
 codeOut('');
@@ -264,11 +264,17 @@ codeOut("");
 codeOut("#define RAM_TOTAL ("+str(board.chip['ram'])+"*1024)")
 codeOut("#define FLASH_TOTAL ("+str(board.chip['flash'])+"*1024)")
 codeOut("");
-if LINUX:
+if LINUX and 'VARIABLES' in os.environ:
+  # A fixed number of variables, so refs (and JsVars) are as small as on a microcontroller - for benchmarking
+  codeOut("#define JSVAR_CACHE_SIZE                "+str(int(os.environ['VARIABLES']))+" // Number of JavaScript variables in RAM")
+elif LINUX:
   codeOut('#define RESIZABLE_JSVARS // Allocate variables in blocks using malloc')
   #codeOut("#define JSVAR_CACHE_SIZE                "+str(200)+" // Number of JavaScript variables in RAM")
 else:
   codeOut("#define JSVAR_CACHE_SIZE                "+str(variables)+" // Number of JavaScript variables in RAM")
+  if "variables_heap_reserve" in board.info:
+    codeOut("#define JSVAR_MALLOC                    // Allocate variables at boot from the heap, up to JSVAR_CACHE_SIZE")
+    codeOut("#define JSVAR_HEAP_RESERVE              "+str(board.info["variables_heap_reserve"])+" // Bytes of heap to leave for everything else")
   codeOut("#define FLASH_AVAILABLE_FOR_CODE        "+str(int(flash_available_for_code)))
   if board.chip["class"]=="EFM32":
     codeOut("// FLASH_PAGE_SIZE defined in em_device.h");
@@ -310,18 +316,24 @@ codeOut("");
 if LINUX:
   bufferSizeIO = 256
   bufferSizeTX = 256
-  bufferSizeTimer = 16
+  bufferSizeTimer = 64
+  bufferSizeBulk = 4096
 else:
   bufferSizeIO = 64 if board.chip["ram"]<20 else 128
   bufferSizeTX = 32 if board.chip["ram"]<20 else 128
-  bufferSizeTimer = 4 if board.chip["ram"]<20 else 16
+  bufferSizeTimer = 4 if board.chip["ram"]<20 else (16 if board.chip["ram"]<64 else 32)
+  bufferSizeBulk = 0 if board.chip["ram"]<20 else (512 if board.chip["ram"]<64 else 1024)
 
 if 'util_timer_tasks' in board.info:
   bufferSizeTimer = board.info['util_timer_tasks']
+if 'io_bulk_buffer' in board.info:
+  bufferSizeBulk = board.info['io_bulk_buffer']
 
 codeOut("#define IOBUFFERMASK "+str(bufferSizeIO-1)+" // (max 255) amount of items in event buffer - events take ~9 bytes each")
 codeOut("#define TXBUFFERMASK "+str(bufferSizeTX-1)+" // (max 255)")
-codeOut("#define UTILTIMERTASK_TASKS ("+str(bufferSizeTimer)+") // Must be power of 2 - and max 256")
+codeOut("#define UTILTIMERTASK_TASKS ("+str(bufferSizeTimer)+") // (max 65535) utility timer tasks (for digitalPulse, software PWM, Waveform, etc) - ~27 bytes each")
+if bufferSizeBulk>0:
+  codeOut("#define IOBULKBUFFERMASK "+str(bufferSizeBulk-1)+" // (max 65535) bytes of characters for bulk events (see jshPushIOCharEvents)")
 
 codeOut("");
 
@@ -39,7 +39,7 @@ function getBasicTernType(t) {
   if (["int","float","int32"].indexOf(t)>=0) return "number";
   if (t=="pin") return "+Pin";
   if (t=="bool") return "bool";
-  if (t=="JsVarArray") return "?"; // TODO: not right. Should be variable arg count
+  if (t=="JsVarArray" || t=="JsVarArgs") return "?"; // TODO: not right. Should be variable arg count
   return "?";
 }
 
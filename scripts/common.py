@@ -59,7 +59,7 @@ if "check_output" not in dir( subprocess ):
 #         "needs_parentName":true,           // optional - if for a method, this makes the first 2 args parent+parentName (not just parent)
 #         "generate_full|generate|wrap" : "*(JsVarInt*)&x",
 #         "description" : " Convert the floating point value given into an integer representing the bits contained in it",
-#         "params" : [ [ "x" , "float|int|int32|bool|pin|JsVar|JsVarName|JsVarArray", "A floating point number"] ],
+#         "params" : [ [ "x" , "float|int|int32|bool|pin|JsVar|JsVarName|JsVarArray|JsVarArgs", "A floating point number"] ],
 #                               // float - parses into a JsVarFloat which is passed to the function
 #                               // int - parses into a JsVarInt which is passed to the function
 #                               // int32 - parses into a 32 bit int
@@ -67,6 +67,7 @@ if "check_output" not in dir( subprocess ):
 #                               // pin - parses into a pin
 #                               // JsVar - passes a JsVar* to the function (after skipping names)
 #                               // JsVarArray - parses this AND ANY SUBSEQUENT ARGUMENTS into a JsVar of type JSV_ARRAY. THIS IS ALWAYS DEFINED, EVEN IF ZERO LENGTH. Currently it must be the only parameter
+#                               // JsVarArgs - like JsVarArray, but passes 'JsVar **argPtr, int argCount' pointing at the caller's arguments, so no array is allocated. Must be the last parameter
 #         "return" : ["int|float|JsVar", "The integer representation of x"],
 #         "return_object" : "ObjectName", // optional - used for tern's code analysis - so for example we can do hints for openFile(...).yyy
 #         "no_create_links":1                // optional - if this is set then hyperlinks are not created when this name is mentioned (good example = bit() )
@@ -319,6 +320,7 @@ def get_ifdef_description(d):
   if d=="RELEASE": return "release builds"
   if d=="LINUX": return "Linux-based builds"
   if d=="USE_USB_HID": return "devices that support USB HID (Espruino Espruino Pico)"
+  if d=="ALLOC_PROFILE": return "builds with ALLOC_PROFILE=1 set"
   print("WARNING: Unknown ifdef '"+d+"' in common.get_ifdef_description")
   return d
 
@@ -0,0 +1,561 @@
+#!/usr/bin/python
+
+# This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+#
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, You can obtain one at http://mozilla.org/MPL/2.0/.
+#
+# ----------------------------------------------------------------------------------------
+# Compile JS functions marked "compiled" into ESP8266 (Xtensa lx106) machine code
+#
+#   compile_xtensa.py in.js out.js
+#
+# Nothing runs this automatically - run it on your code yourself, then upload out.js. The
+# firmware must have been built with ESP8266_NATIVE_CODE=1 so there is IRAM to run it from.
+#
+# Each function of the form:
+#
+#   function name(a, b) {
+#     "compiled";
+#     ...
+#   }
+#
+# is replaced with `var name = E.nativeCall(0, "int(int,int)", atob("..."));` and everything
+# else is copied unchanged. The device copies the code into IRAM (see esp8266_nativeCodeAlloc).
+#
+# Compiled functions may only use 32 bit integers (arithmetic wraps rather than becoming a
+# float), with:
+#
+#  * up to 4 arguments, and local variables declared with `var`
+#  * if/else, while, do/while, for, break, continue, return
+#  * = += -= *= &= |= ^= <<= >>= >>>= ++ --
+#  * + - * & | ^ ~ << >> >>> == != === !== < <= > >= && || ! ?:
+#  * peek8/16/32(addr) and poke8/16/32(addr, value) - use E.getAddressOf(typedArray, true)
+#    to pass in the address of a typed array's data
+#
+# There's no divide instruction on the lx106, so `/` and `%` aren't supported, and compiled
+# functions can't call other functions.
+# ----------------------------------------------------------------------------------------
+
+import sys
+import re
+import base64
+
+class CompileError(Exception):
+  pass
+
+# ---------------------------------------------------------------------------- Tokeniser
+
+TOKEN_RE = re.compile(r"""
+  (?P<space>\s+|//[^\n]*|/\*.*?\*/) |
+  (?P<num>0[xX][0-9a-fA-F]+|0[bB][01]+|\d+) |
+  (?P<id>[A-Za-z_$][A-Za-z0-9_$]*) |
+  (?P<str>"(?:[^"\\\n]|\\.)*"|'(?:[^'\\\n]|\\.)*'|`(?:[^`\\]|\\.)*`) |
+  (?P<op>>>>=|===|!==|>>>|<<=|>>=|==|!=|<=|>=|&&|\|\||\+\+|--|\+=|-=|\*=|&=|\|=|\^=|<<|>>|[-+*/%&|^~!<>=?:;,(){}\[\]]) |
+  (?P<other>.)
+""", re.S | re.X)
+
+def tokenise(src):
+  tokens = []
+  pos = 0
+  while pos < len(src):
+    m = TOKEN_RE.match(src, pos)
+    if not m.group("space"):
+      kind = m.lastgroup
+      tokens.append((kind, m.group(kind), m.start(), m.end()))
+    pos = m.end()
+  tokens.append(("eof", "", len(src), len(src)))
+  return tokens
+
+# ---------------------------------------------------------------------------- Instruction encoding
+
+TEMP_REGS = list(range(2, 12)) # a2..a11 - arguments are moved to the stack so all are free
+ARG_REGS = 4                   # a2..a5 - E.nativeCall signatures can only have 4 arguments
+MAX_FRAME = 112                # addi can only adjust the stack by -128..127
+
+def rrr(op2, op1, r, s, t): return bytes([(t << 4), (r << 4) | s, (op2 << 4) | op1])
+def rri8(r, s, t, imm8, op0=2): return bytes([(t << 4) | op0, (r << 4) | s, imm8 & 0xFF])
+
+BRANCH_OP = { "==" : 0x1, "!=" : 0x9, "<" : 0x2, ">=" : 0xA }
+NEGATE = { "==" : "!=", "!=" : "==", "<" : ">=", ">=" : "<" }
+BINARY_OP = { "+" : (0x8, 0), "-" : (0xC, 0), "&" : (0x1, 0), "|" : (0x2, 0), "^" : (0x3, 0), "*" : (0x8, 2) }
+LOAD_OP = { "peek8" : (0x0, 0), "peek16" : (0x1, 1), "peek32" : (0x2, 2) } # r, log2(size)
+STORE_OP = { "poke8" : (0x4, 0), "poke16" : (0x5, 1), "poke32" : (0x6, 2) }
+
+class Code:
+  def __init__(self):
+    self.code = bytearray()
+    self.labels = {}
+    self.fixups = [] # (position of J, label)
+    self.labelCount = 0
+
+  def emit(self, b): self.code += b
+  def pos(self): return len(self.code)
+  def newLabel(self):
+    self.labelCount += 1
+    return self.labelCount
+  def setLabel(self, label): self.labels[label] = self.pos()
+
+  def j(self, label):
+    self.fixups.append((self.pos(), label))
+    self.emit(bytes([6, 0, 0]))
+  def mov(self, r, s):
+    if r != s: self.emit(rrr(0x2, 0, r, s, s)) # or r,s,s
+  def movi(self, t, value):
+    value &= 0xFFFFFFFF
+    if value >= 0x80000000: value -= 0x100000000
+    if -2048 <= value <= 2047:
+      self.emit(rri8(0xA, (value >> 8) & 0xF, t, value))
+    else: # l32r can only load from before itself - so jump over the literal
+      over = self.newLabel()
+      self.j(over)
+      while self.pos() % 4: self.emit(b"\0")
+      self.emit(bytes([(value >> (8*i)) & 0xFF for i in range(4)]))
+      self.setLabel(over)
+      self.emit(bytes([(t << 4) | 1, 0xFF, 0xFF])) # l32r t, (literal just before)
+  def addi(self, t, s, imm): self.emit(rri8(0xC, s, t, imm))
+  def l32i(self, t, s, offset): self.emit(rri8(0x2, s, t, offset >> 2))
+  def s32i(self, t, s, offset): self.emit(rri8(0x6, s, t, offset >> 2))
+  def branchSkip(self, op, s, t): self.emit(rri8(BRANCH_OP[op], s, t, 2, 7)) # skip the next 3 byte instruction
+  def beqzSkip(self, s): self.emit(bytes([0x16, (2 << 4) | s, 0]))
+  def bnezSkip(self, s): self.emit(bytes([0x56, (2 << 4) | s, 0]))
+  def ret(self): self.emit(bytes([0x80, 0, 0]))
+
+  def link(self):
+    for (p, label) in self.fixups:
+      offset = self.labels[label] - (p + 4)
+      if offset < -131072 or offset > 131071: raise CompileError("Function too big")
+      offset &= 0x3FFFF
+      self.code[p:p+3] = bytes([((offset & 3) << 6) | 6, (offset >> 2) & 0xFF, (offset >> 10) & 0xFF])
+    return bytes(self.code)
+
+# ---------------------------------------------------------------------------- Compiler
+
+class Compiler:
+  def __init__(self, tokens, i):
+    self.tokens = tokens
+    self.i = i
+    self.c = Code()
+    self.free = list(TEMP_REGS)
+    self.vars = {}
+    self.loops = [] # (break label, continue label)
+
+  # --- tokens
+  def tk(self): return self.tokens[self.i][1]
+  def kind(self): return self.tokens[self.i][0]
+  def next(self):
+    t = self.tokens[self.i]
+    self.i += 1
+    return t[1]
+  def match(self, s):
+    if self.tk() != s: raise CompileError("Expected '%s' but got '%s'" % (s, self.tk()))
+    return self.next()
+  def ident(self):
+    if self.kind() != "id": raise CompileError("Expected an identifier but got '%s'" % self.tk())
+    return self.next()
+
+  # --- registers and variables
+  def alloc(self):
+    if not self.free: raise CompileError("Expression too complex")
+    self.free.sort()
+    return self.free.pop(0)
+  def release(self, r): self.free.append(r)
+  def addVar(self, name):
+    if not name in self.vars:
+      if len(self.vars)*4 >= MAX_FRAME: raise CompileError("Too many variables")
+      self.vars[name] = len(self.vars)*4
+    return self.vars[name]
+  def varOffset(self, name):
+    if not name in self.vars: raise CompileError("Unknown variable '%s'" % name)
+    return self.vars[name]
+
+  # --- functions
+  def function(self):
+    self.match("function")
+    name = self.ident()
+    self.match("(")
+    args = []
+    while self.tk() != ")":
+      args.append(self.ident())
+      if self.tk() != ")": self.match(",")
+    self.match(")")
+    if len(args) > ARG_REGS: raise CompileError("Too many arguments")
+    self.match("{")
+    self.next() # "compiled"
+    if self.tk() == ";": self.next()
+    # prologue - the frame size gets filled in once we know how many variables there are
+    self.c.addi(1, 1, 0)
+    for n in range(len(args)):
+      self.c.s32i(2+n, 1, self.addVar(args[n]))
+    self.epilogue = self.c.newLabel()
+    while self.tk() != "}":
+      self.statement()
+    self.match("}")
+    self.c.movi(2, 0) # no return - return 0
+    self.c.setLabel(self.epilogue)
+    frame = (len(self.vars)*4 + 15) & ~15
+    self.c.addi(1, 1, frame)
+    self.c.ret()
+    self.c.code[2] = (-frame) & 0xFF
+    signature = "int(" + ",".join(["int"]*len(args)) + ")"
+    return (name, signature, self.c.link())
+
+  # --- statements
+  def block(self):
+    if self.tk() == "{":
+      self.next()
+      while self.tk() != "}": self.statement()
+      self.next()
+    else:
+      self.statement()
+
+  def statement(self):
+    t = self.tk()
+    if t == "{":
+      self.block()
+    elif t == ";":
+      self.next()
+    elif t == "var":
+      self.next()
+      while True:
+        name = self.ident()
+        offset = self.addVar(name)
+        if self.tk() == "=":
+          self.next()
+          r = self.expression()
+          self.c.s32i(r, 1, offset)
+          self.release(r)
+        if self.tk() != ",": break
+        self.next()
+      self.semicolon()
+    elif t == "if":
+      self.next()
+      self.match("(")
+      elseLabel = self.c.newLabel()
+      self.condition(elseLabel)
+      self.match(")")
+      self.block()
+      if self.tk() == "else":
+        self.next()
+        endLabel = self.c.newLabel()
+        self.c.j(endLabel)
+        self.c.setLabel(elseLabel)
+        self.block()
+        self.c.setLabel(endLabel)
+      else:
+        self.c.setLabel(elseLabel)
+    elif t == "while":
+      self.next()
+      start, end = self.c.newLabel(), self.c.newLabel()
+      self.c.setLabel(start)
+      self.match("(")
+      self.condition(end)
+      self.match(")")
+      self.loop(end, start)
+      self.c.j(start)
+      self.c.setLabel(end)
+    elif t == "do":
+      self.next()
+      start, cont, end = self.c.newLabel(), self.c.newLabel(), self.c.newLabel()
+      self.c.setLabel(start)
+      self.loop(end, cont)
+      self.c.setLabel(cont)
+      self.match("while")
+      self.match("(")
+      self.condition(end)
+      self.match(")")
+      self.c.j(start)
+      self.c.setLabel(end)
+      self.semicolon()
+    elif t == "for":
+      self.next()
+      self.match("(")
+      if self.tk() != ";":
+        if self.tk() == "var": self.statement() # eats the ';'
+        else:
+          self.release(self.expression())
+          self.match(";")
+      else: self.next()
+      start, cont, end = self.c.newLabel(), self.c.newLabel(), self.c.newLabel()
+      self.c.setLabel(start)
+      if self.tk() != ";": self.condition(end)
+      self.match(";")
+      # the step is parsed now, but its code has to go after the body
+      stepStart = self.i
+      depth = 0
+      while depth or self.tk() != ")":
+        if self.tk() == "(": depth += 1
+        if self.tk() == ")": depth -= 1
+        if self.kind() == "eof": raise CompileError("Unterminated for loop")
+        self.next()
+      self.match(")")
+      self.loop(end, cont)
+      self.c.setLabel(cont)
+      bodyEnd = self.i
+      self.i = stepStart
+      if self.tk() != ")": self.release(self.expression())
+      self.i = bodyEnd
+      self.c.j(start)
+      self.c.setLabel(end)
+    elif t == "break" or t == "continue":
+      self.next()
+      if not self.loops: raise CompileError("'%s' outside of a loop" % t)
+      self.c.j(self.loops[-1][0 if t == "break" else 1])
+      self.semicolon()
+    elif t == "return":
+      self.next()
+      if self.tk() == ";" or self.tk() == "}":
+        self.c.movi(2, 0)
+      else:
+        r = self.expression()
+        self.c.mov(2, r)
+        self.release(r)
+      self.c.j(self.epilogue)
+      self.semicolon()
+    else:
+      self.release(self.expression())
+      self.semicolon()
+
+  def loop(self, breakLabel, continueLabel):
+    self.loops.append((breakLabel, continueLabel))
+    self.block()
+    self.loops.pop()
+
+  def semicolon(self):
+    if self.tk() == ";": self.next()
+
+  # --- expressions. Each returns the register holding the result
+
+  def condition(self, falseLabel):
+    """ Parse an expression, jumping to falseLabel if it is 0 """
+    r = self.expression()
+    self.c.bnezSkip(r)
+    self.c.j(falseLabel)
+    self.release(r)
+
+  def expression(self):
+    return self.assignment()
+
+  ASSIGN_OPS = [ "=", "+=", "-=", "*=", "&=", "|=", "^=", "<<=", ">>=", ">>>=" ]
+
+  def assignment(self):
+    if self.kind() == "id" and self.tokens[self.i+1][1] in self.ASSIGN_OPS:
+      name = self.ident()
+      offset = self.varOffset(name)
+      op = self.next()
+      r = self.assignment()
+      if op != "=":
+        v = self.alloc()
+        self.c.l32i(v, 1, offset)
+        self.binaryOp(op[:-1], v, r)
+        self.release(r)
+        r = v
+      self.c.s32i(r, 1, offset)
+      return r
+    return self.ternary()
+
+  def ternary(self):
+    r = self.logicalOr()
+    if self.tk() != "?": return r
+    self.next()
+    elseLabel, endLabel = self.c.newLabel(), self.c.newLabel()
+    self.c.bnezSkip(r)
+    self.c.j(elseLabel)
+    a = self.assignment()
+    self.c.mov(r, a)
+    self.release(a)
+    self.c.j(endLabel)
+    self.match(":")
+    self.c.setLabel(elseLabel)
+    b = self.assignment()
+    self.c.mov(r, b)
+    self.release(b)
+    self.c.setLabel(endLabel)
+    return r
+
+  def logicalOr(self):
+    r = self.logicalAnd()
+    while self.tk() == "||":
+      self.next()
+      end = self.c.newLabel()
+      self.c.beqzSkip(r) # already true - skip the rest
+      self.c.j(end)
+      b = self.logicalAnd()
+      self.c.mov(r, b)
+      self.release(b)
+      self.c.setLabel(end)
+    return r
+
+  def logicalAnd(self):
+    r = self.binary(0)
+    while self.tk() == "&&":
+      self.next()
+      end = self.c.newLabel()
+      self.c.bnezSkip(r) # already false - skip the rest
+      self.c.j(end)
+      b = self.binary(0)
+      self.c.mov(r, b)
+      self.release(b)
+      self.c.setLabel(end)
+    return r
+
+  PRECEDENCE = [ ["|"], ["^"], ["&"], ["==", "!=", "===", "!=="], ["<", "<=", ">", ">="], ["<<", ">>", ">>>"], ["+", "-"], ["*", "/", "%"] ]
+
+  def binary(self, level):
+    if level == len(self.PRECEDENCE): return self.unary()
+    r = self.binary(level+1)
+    while self.tk() in self.PRECEDENCE[level]:
+      op = self.next()
+      b = self.binary(level+1)
+      self.binaryOp(op, r, b)
+      self.release(b)
+    return r
+
+  def binaryOp(self, op, r, b):
+    """ r = r op b """
+    if op in BINARY_OP:
+      (op2, op1) = BINARY_OP[op]
+      self.c.emit(rrr(op2, op1, r, r, b))
+    elif op == "<<":
+      self.c.emit(rrr(0x4, 0, 1, b, 0)) # ssl b
+      self.c.emit(rrr(0xA, 1, r, r, 0)) # sll r, r
+    elif op == ">>" or op == ">>>":
+      self.c.emit(rrr(0x4, 0, 0, b, 0)) # ssr b
+      self.c.emit(rrr(0xB if op == ">>" else 0x9, 1, r, 0, r)) # sra/srl r, r
+    elif op in [ "==", "!=", "===", "!==", "<", "<=", ">", ">=" ]:
+      op = op[:2] if op in [ "===", "!==" ] else op
+      (s, t) = (r, b)
+      if op == ">" or op == "<=": # swap, as there's only blt and bge
+        (s, t) = (b, r)
+        op = "<" if op == ">" else ">="
+      v = self.alloc()
+      self.c.movi(v, 1)
+      self.c.branchSkip(op, s, t)
+      self.c.movi(v, 0)
+      self.c.mov(r, v)
+      self.release(v)
+    else:
+      raise CompileError("Operator '%s' isn't supported in compiled code" % op)
+
+  def unary(self):
+    t = self.tk()
+    if t == "-" or t == "~" or t == "!" or t == "+":
+      self.next()
+      r = self.unary()
+      if t == "-":
+        self.c.emit(rrr(0x6, 0, r, 0, r)) # neg
+      elif t == "~":
+        v = self.alloc()
+        self.c.movi(v, -1)
+        self.c.emit(rrr(0x3, 0, r, r, v)) # xor
+        self.release(v)
+      elif t == "!":
+        v = self.alloc()
+        self.c.movi(v, 1)
+        self.c.beqzSkip(r)
+        self.c.movi(v, 0)
+        self.c.mov(r, v)
+        self.release(v)
+      return r
+    if t == "++" or t == "--":
+      self.next()
+      offset = self.varOffset(self.ident())
+      r = self.alloc()
+      self.c.l32i(r, 1, offset)
+      self.c.addi(r, r, 1 if t == "++" else -1)
+      self.c.s32i(r, 1, offset)
+      return r
+    return self.postfix()
+
+  def postfix(self):
+    if self.kind() == "id" and self.tokens[self.i+1][1] in [ "++", "--" ]:
+      offset = self.varOffset(self.ident())
+      op = self.next()
+      r, v = self.alloc(), self.alloc()
+      self.c.l32i(r, 1, offset)
+      self.c.addi(v, r, 1 if op == "++" else -1)
+      self.c.s32i(v, 1, offset)
+      self.release(v)
+      return r
+    return self.primary()
+
+  def primary(self):
+    kind, t = self.kind(), self.tk()
+    if kind == "num":
+      self.next()
+      r = self.alloc()
+      self.c.movi(r, int(t[2:], 2) if t[:2].lower() == "0b" else int(t, 0) if t[:2].lower() == "0x" else int(t))
+      return r
+    if t == "true" or t == "false":
+      self.next()
+      r = self.alloc()
+      self.c.movi(r, 1 if t == "true" else 0)
+      return r
+    if t == "(":
+      self.next()
+      r = self.expression()
+      self.match(")")
+      return r
+    if kind == "id":
+      name = self.next()
+      if name in LOAD_OP or name in STORE_OP:
+        self.match("(")
+        addr = self.expression()
+        if name in LOAD_OP:
+          (op, size) = LOAD_OP[name]
+          self.c.emit(rri8(op, addr, addr, 0)) # l8ui/l16ui/l32i addr, addr, 0
+          self.match(")")
+          return addr
+        (op, size) = STORE_OP[name]
+        self.match(",")
+        v = self.expression()
+        self.match(")")
+        self.c.emit(rri8(op, addr, v, 0)) # s8i/s16i/s32i v, addr, 0
+        self.release(addr)
+        return v
+      if self.tk() == "(": raise CompileError("Compiled code can't call '%s'" % name)
+      r = self.alloc()
+      self.c.l32i(r, 1, self.varOffset(name))
+      return r
+    raise CompileError("Unexpected '%s'" % t)
+
+# ---------------------------------------------------------------------------- Main
+
+def lineOf(src, pos): return src.count("\n", 0, pos) + 1
+
+def compileSource(src):
+  tokens = tokenise(src)
+  out = ""
+  last = 0
+  i = 0
+  while tokens[i][0] != "eof":
+    if tokens[i][1] == "function" and tokens[i+1][0] == "id":
+      # find the start of the body, and see if it's marked as compiled
+      j = i
+      while tokens[j][1] != "{" and tokens[j][0] != "eof": j += 1
+      if tokens[j+1][0] == "str" and tokens[j+1][1][1:-1] == "compiled":
+        compiler = Compiler(tokens, i)
+        try:
+          (name, signature, code) = compiler.function()
+        except CompileError as e:
+          raise CompileError("Line %d: %s" % (lineOf(src, tokens[compiler.i][2]), e))
+        out += src[last:tokens[i][2]]
+        out += 'var %s = E.nativeCall(0, "%s", atob("%s"));' % (name, signature, base64.b64encode(code).decode("ascii"))
+        last = tokens[compiler.i-1][3]
+        i = compiler.i
+        continue
+    i += 1
+  return out + src[last:]
+
+def main():
+  if len(sys.argv) != 3:
+    sys.exit("Usage: compile_xtensa.py in.js out.js")
+  try:
+    out = compileSource(open(sys.argv[1]).read())
+  except CompileError as e:
+    sys.exit("%s: %s" % (sys.argv[1], e))
+  open(sys.argv[2], "w").write(out)
+
+if __name__ == "__main__":
+  main()
@@ -0,0 +1,112 @@
+#!/usr/bin/python
+
+# This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+#
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, You can obtain one at http://mozilla.org/MPL/2.0/.
+#
+# ----------------------------------------------------------------------------------------
+# Pack an ESP8266 userN.bin for a smaller over-the-air update (see libs/network/esp8266/ota.c)
+#
+#   ota_pack.py [-z] [-d running.bin] new.bin out.ota
+#
+#   -z             heatshrink compress the image (window 8, lookahead 6)
+#   -d old.bin     send a delta against old.bin, which must be what the device is running
+#                  (user1.bin if it will be sent user2.bin and vice versa)
+#
+# The result can be POSTed to /flash/upload just like a .bin, eg. with scripts/wiflash.sh
+# ----------------------------------------------------------------------------------------
+
+import sys
+import struct
+import getopt
+
+OTA_HDR_HEATSHRINK = 1
+OTA_HDR_DELTA = 2
+HS_WINDOW_BITS = 8
+HS_LOOKAHEAD_BITS = 6
+DELTA_MIN_MATCH = 8
+
+def heatshrink_compress(data):
+  """ Compress with heatshrink, using the settings of libs/compression/heatshrink/heatshrink_config.h """
+  bits = []
+  window = 1 << HS_WINDOW_BITS
+  lookahead = 1 << HS_LOOKAHEAD_BITS
+  i = 0
+  while i < len(data):
+    # find the longest match in the window (matches may overlap the current position)
+    start = max(0, i - window)
+    best_len = 0
+    best_pos = 0
+    k = 2 # a backref is 15 bits, so only worth it for 2+ bytes
+    while k <= lookahead and i + k <= len(data):
+      p = data.rfind(data[i:i+k], start, i + k - 1)
+      if p < 0: break
+      best_len = k
+      best_pos = p
+      k += 1
+    if best_len:
+      bits.append("0" + format(i - best_pos - 1, "0%db" % HS_WINDOW_BITS) +
+                  format(best_len - 1, "0%db" % HS_LOOKAHEAD_BITS))
+      i += best_len
+    else:
+      bits.append("1" + format(data[i], "08b"))
+      i += 1
+  s = "".join(bits)
+  s += "0" * (-len(s) % 8)
+  return bytes(int(s[j:j+8], 2) for j in range(0, len(s), 8))
+
+def delta(old, new):
+  """ Create a patch in the streaming bsdiff-style format that ota.c applies """
+  index = {}
+  for p in range(len(old) - DELTA_MIN_MATCH, -1, -1):
+    index[old[p:p+DELTA_MIN_MATCH]] = p
+  out = []
+  diff = b""
+  old_end = 0
+  extra_from = 0
+  pos = 0
+  while pos + DELTA_MIN_MATCH <= len(new):
+    cand = index.get(new[pos:pos+DELTA_MIN_MATCH])
+    if cand is None:
+      pos += 1
+      continue
+    # extend the match, allowing the odd different byte (eg. changed addresses)
+    end = pos
+    last_match = pos
+    while end < len(new) and cand + end - pos < len(old):
+      if new[end] == old[cand + end - pos]: last_match = end + 1
+      elif end - last_match >= 8: break
+      end += 1
+    end = last_match
+    out.append(struct.pack("<IIi", len(diff), pos - extra_from, cand - old_end) +
+               diff + new[extra_from:pos])
+    diff = bytes((new[j] - old[cand + j - pos]) & 255 for j in range(pos, end))
+    old_end = cand + end - pos
+    extra_from = pos = end
+  out.append(struct.pack("<IIi", len(diff), len(new) - extra_from, 0) + diff + new[extra_from:])
+  return b"".join(out)
+
+def main():
+  try:
+    opts, args = getopt.getopt(sys.argv[1:], "zd:")
+  except getopt.GetoptError as e:
+    sys.exit(str(e))
+  if len(args) != 2:
+    sys.exit("Usage: ota_pack.py [-z] [-d running.bin] new.bin out.ota")
+  new = open(args[0], "rb").read()
+  flags = 0
+  payload = new
+  for o, a in opts:
+    if o == "-d":
+      flags |= OTA_HDR_DELTA
+      payload = delta(open(a, "rb").read(), new)
+  if any(o == "-z" for o, a in opts):
+    flags |= OTA_HDR_HEATSHRINK
+    payload = heatshrink_compress(payload)
+  open(args[1], "wb").write(b"ESO" + struct.pack("<BI", flags, len(new)) + payload)
+  print("%s: %d bytes -> %d bytes" % (args[1], len(new), 8 + len(payload)))
+
+if __name__ == "__main__":
+  main()
@@ -0,0 +1,39 @@
+#!/bin/node
+/* Converts the output of E.getTrace() (from a build made with 'make TRACE=1')
+ into the JSON format that chrome://tracing (or https://ui.perfetto.dev) can load.
+
+ On the device:  print(JSON.stringify(E.getTrace()))
+ Save the output to a file, then:
+
+   node scripts/trace_to_chrome.js trace.json > chrome.json
+*/
+var fs = require('fs');
+
+if (process.argv.length!=3) {
+  console.log("USAGE: node scripts/trace_to_chrome.js trace.json");
+  process.exit(1);
+}
+
+// Espruino's JSON.stringify writes typed arrays as 'new Uint32Array([...])'
+var text = fs.readFileSync(process.argv[2]).toString().replace(/new \w+Array\((\[[^\]]*\])\)/g, "$1");
+// ignore anything else that was captured from the console
+var input = JSON.parse(text.substring(text.indexOf("{"), text.lastIndexOf("}")+1));
+var trace = input.trace;
+
+var events = [];
+for (var i=0;i+1<trace.length;i+=2) {
+  var id = trace[i+1]>>>16;
+  var arg = trace[i+1]&0xFFFF;
+  var e = {
+    name : input.names[id] || ("id"+id),
+    ph : input.phases[id] || "i",
+    ts : trace[i],
+    pid : 1,
+    tid : 1,
+    args : { arg : arg }
+  };
+  if (e.ph=="i") e.s = "t"; // instant events are scoped to the thread
+  events.push(e);
+}
+
+console.log(JSON.stringify({ traceEvents : events, displayTimeUnit : "ms" }, null, 1));
@@ -10,7 +10,8 @@ show_help() {
 Usage: ${0##*/} [-options...] hostname user1.bin user2.bin
 Flash the esp8266 running esphttpd at <hostname> with either <user1.bin> or <user2.bin>
 depending on its current state. Reboot the esp8266 after flashing and wait for it to come
-up again.
+up again. The images can also be .ota files from scripts/ota_pack.py, which are
+compressed and/or a delta against the firmware that is running, so much smaller.
   -v                    Be verbose
   -h                    show this help
 
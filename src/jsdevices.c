@@ -14,6 +14,7 @@
 #include "jsdevices.h"
 #include "jsparse.h"
 #include "jsinteractive.h"
+#include "jstrace.h"
 
 #ifdef LINUX
 #include <stdio.h>
@@ -25,7 +26,10 @@
 
 // ----------------------------------------------------------------------------
 //                                                              WATCH CALLBACKS
-JshEventCallbackCallback jshEventCallbacks[EV_EXTI_MAX+1-EV_EXTI0];
+INSTANCE_LOCAL JshEventCallbackCallback jshEventCallbacks[EV_EXTI_MAX+1-EV_EXTI0];
+INSTANCE_LOCAL JshEventBuffer *jshEventBuffers[EV_EXTI_MAX+1-EV_EXTI0];
+INSTANCE_LOCAL JshEventAction *jshEventActions[EV_EXTI_MAX+1-EV_EXTI0];
+INSTANCE_LOCAL JshEventDebounce *jshEventDebounces[EV_EXTI_MAX+1-EV_EXTI0];
 
 // ----------------------------------------------------------------------------
 //                                                         DATA TRANSMIT BUFFER
@@ -41,12 +45,14 @@ typedef struct {
 /**
  * An array of items to transmit.
  */
-volatile TxBufferItem txBuffer[TXBUFFERMASK+1];
+INSTANCE_LOCAL volatile TxBufferItem txBuffer[TXBUFFERMASK+1];
 
 /**
- * The head and tail of the list.
+ * The head and tail of the list. Only jshTransmit moves the head, and only
+ * jshGetCharToTransmit moves the tail, so neither needs IRQs disabled. Each
+ * writes the item (or finishes reading it) before moving its pointer.
  */
-volatile unsigned char txHead=0, txTail=0;
+INSTANCE_LOCAL volatile unsigned char txHead=0, txTail=0;
 
 typedef enum {
   SDS_NONE,
@@ -54,14 +60,31 @@ typedef enum {
   SDS_XON_PENDING = 2,
   SDS_XOFF_SENT = 4, // sending XON clears this
   SDS_FLOW_CONTROL_XON_XOFF = 8, // flow control enabled
+  SDS_XOFF_HELD = 16, // the JS stream buffer is full - don't send XON even if the IO buffer empties
 } PACKED_FLAGS JshSerialDeviceState;
-JshSerialDeviceState jshSerialDeviceStates[EV_SERIAL1+USART_COUNT-EV_SERIAL_START];
+INSTANCE_LOCAL JshSerialDeviceState jshSerialDeviceStates[EV_SERIAL1+USART_COUNT-EV_SERIAL_START];
 #define TO_SERIAL_DEVICE_STATE(X) ((X)-EV_SERIAL_START)
 
 // ----------------------------------------------------------------------------
 //                                                              IO EVENT BUFFER
-volatile IOEvent ioBuffer[IOBUFFERMASK+1];
-volatile unsigned char ioHead=0, ioTail=0;
+/* Events are only ever read in the main loop, which can't run while an IRQ
+ * is adding one - so an event only has to be written before ioHead is moved.
+ * IRQs are only disabled where different IRQs could add events at once
+ * (jshPushIOCharEvent/jshPushIOCharEvents) or where we rearrange the queue. */
+INSTANCE_LOCAL volatile IOEvent ioBuffer[IOBUFFERMASK+1];
+INSTANCE_LOCAL volatile unsigned char ioHead=0, ioTail=0;
+
+#ifdef IOBULKBUFFERMASK
+/**
+ * Characters for EV_CHARS_BULK events. These are added at the head by jshPushIOCharEvents.
+ * The tail is the start of the oldest bulk event still in ioBuffer, or of the bulk event
+ * that was popped last (so the caller can still read it) - see jshIOBulkRelease.
+ */
+INSTANCE_LOCAL volatile char ioBulkBuffer[IOBULKBUFFERMASK+1];
+INSTANCE_LOCAL volatile unsigned short ioBulkHead=0, ioBulkTail=0;
+/// Set when a bulk event has been popped (or couldn't be added), and its characters need releasing
+INSTANCE_LOCAL bool ioBulkPopped = false;
+#endif
 
 // ----------------------------------------------------------------------------
 
@@ -83,13 +106,35 @@ void jshResetDevices() {
     jshSerialDeviceStates[i] = SDS_NONE;
   jshSerialDeviceStates[TO_SERIAL_DEVICE_STATE(EV_USBSERIAL)] = SDS_FLOW_CONTROL_XON_XOFF;
   // set up callbacks for events
-  for (i=EV_EXTI0;i<=EV_EXTI_MAX;i++)
+  for (i=EV_EXTI0;i<=EV_EXTI_MAX;i++) {
     jshEventCallbacks[i-EV_EXTI0] = 0;
+    jshEventBuffers[i-EV_EXTI0] = 0;
+    jshEventActions[i-EV_EXTI0] = 0;
+    jshEventDebounces[i-EV_EXTI0] = 0;
+  }
 
 }
 
 // ----------------------------------------------------------------------------
 
+/**
+ * Would jshTransmit have to wait for space in the transmit buffer before it could send to this device?
+ */
+bool jshTransmitWouldBlock(IOEventFlags device) {
+  if (device==EV_LOOPBACKA || device==EV_LOOPBACKB || device==EV_NONE)
+    return false;
+#ifdef USE_TELNET
+  if (device == EV_TELNET) {
+    extern bool telnetIsSendBufferFull();
+    return telnetIsSendBufferFull();
+  }
+#endif
+#ifdef LINUX
+  if (device==DEFAULT_CONSOLE_DEVICE) return false; // stdout
+#endif
+  return ((txHead+1)&TXBUFFERMASK)==txTail;
+}
+
 /**
  * Queue a character for transmission.
  */
@@ -154,11 +199,50 @@ void jshTransmit(
   // Save the device and data for the new character to be transmitted.
   txBuffer[txHead].flags = device;
   txBuffer[txHead].data = data;
+  jshMemoryBarrier(); // the IRQ mustn't see txHead move before the data is there
   txHead = txHeadNext;
 
   jshUSARTKick(device); // set up interrupts if required
 }
 
+/**
+ * Queue many characters for transmission. For UARTs this adds as many as will
+ * fit before kicking the device, rather than kicking it for every character.
+ */
+void jshTransmitChars(
+    IOEventFlags device,        //!< The device to be used for transmission.
+    const unsigned char *data,  //!< The characters to transmit.
+    unsigned int count          //!< The number of characters.
+  ) {
+  // Other devices are special-cased by jshTransmit
+  if (device<EV_SERIAL1 || device>EV_SERIAL_MAX) {
+    while (count--) jshTransmit(device, *(data++));
+    return;
+  }
+  while (count) {
+    unsigned int space = (unsigned char)(txTail-txHead-1) & TXBUFFERMASK;
+    if (!space) {
+      // buffer full - jshTransmit waits for space
+      jshTransmit(device, *(data++));
+      count--;
+      continue;
+    }
+    if (space > count) space = count;
+    unsigned char head = txHead;
+    unsigned int i;
+    for (i=0;i<space;i++) {
+      txBuffer[head].flags = device;
+      txBuffer[head].data = data[i];
+      head = (unsigned char)((head+1)&TXBUFFERMASK);
+    }
+    jshMemoryBarrier(); // the IRQ mustn't see txHead move before the data is there
+    txHead = head;
+    data += space;
+    count -= space;
+    jshUSARTKick(device); // set up interrupts if required
+  }
+}
+
 // Return the device at the top of the transmit queue (or EV_NONE)
 IOEventFlags jshGetDeviceToTransmit() {
   if (!jshHasTransmitData()) return EV_NONE;
@@ -169,7 +253,7 @@ IOEventFlags jshGetDeviceToTransmit() {
  * Try and get a character for transmission.
  * \return The next byte to transmit or -1 if there is none.
  */
-int jshGetCharToTransmit(
+int CALLED_FROM_INTERRUPT jshGetCharToTransmit(
     IOEventFlags device // The device being looked at for a transmission.
   ) {
   if (DEVICE_IS_USART(device)) {
@@ -185,7 +269,9 @@ int jshGetCharToTransmit(
   }
 
   unsigned char tempTail = txTail;
-  while (txHead != tempTail) {
+  unsigned char head = txHead;
+  jshMemoryBarrier(); // read the head before the items it covers
+  while (head != tempTail) {
     if (IOEVENTFLAGS_GETTYPE(txBuffer[tempTail].flags) == device) {
       unsigned char data = txBuffer[tempTail].data;
       if (tempTail != txTail) { // so we weren't right at the back of the queue
@@ -198,6 +284,7 @@ int jshGetCharToTransmit(
           last = (unsigned char)((this+TXBUFFERMASK)&TXBUFFERMASK);
         }
       }
+      jshMemoryBarrier(); // finish with the item before jshTransmit can reuse it
       txTail = (unsigned char)((txTail+1)&TXBUFFERMASK); // advance the tail
       return data; // return data
     }
@@ -206,6 +293,36 @@ int jshGetCharToTransmit(
   return -1; // no data :(
 }
 
+/**
+ * Get up to maxChars characters to transmit in one go, for instance to fill
+ * a UART's FIFO. After the first character (which jshGetCharToTransmit gets,
+ * handling flow control), we just take the characters for this device that
+ * are at the front of the queue.
+ * \return The number of characters put in buf.
+ */
+int CALLED_FROM_INTERRUPT jshGetCharsToTransmit(
+    IOEventFlags device, //!< The device being looked at for a transmission.
+    unsigned char *buf,  //!< Where to put the characters.
+    int maxChars         //!< The most characters to get.
+  ) {
+  if (maxChars<=0) return 0;
+  int c = jshGetCharToTransmit(device);
+  if (c<0) return 0;
+  int n = 0;
+  buf[n++] = (unsigned char)c;
+  unsigned char tail = txTail;
+  unsigned char head = txHead;
+  jshMemoryBarrier(); // read the head before the items it covers
+  while (n<maxChars && tail!=head &&
+         IOEVENTFLAGS_GETTYPE(txBuffer[tail].flags) == device) {
+    buf[n++] = txBuffer[tail].data;
+    tail = (unsigned char)((tail+1)&TXBUFFERMASK);
+  }
+  jshMemoryBarrier(); // finish with the items before jshTransmit can reuse them
+  txTail = tail;
+  return n;
+}
+
 void jshTransmitFlush() {
   jsiSetBusy(BUSY_TRANSMIT, true);
   while (jshHasTransmitData()) ; // wait for send to finish
@@ -252,6 +369,16 @@ void CALLED_FROM_INTERRUPT jshIOEventOverflowed() {
 }
 
 
+static INSTANCE_LOCAL volatile bool consoleIsBinary;
+
+void jshSetConsoleBinary(bool isBinary) {
+  consoleIsBinary = isBinary;
+}
+
+bool jshIsConsoleBinary() {
+  return consoleIsBinary;
+}
+
 /**
  * Send a character to the specified device.
  */
@@ -260,7 +387,7 @@ void jshPushIOCharEvent(
     char charData         // !< The character to send to the device.
   ) {
   // Check for a CTRL+C
-  if (charData==3 && channel==jsiGetConsoleDevice()) {
+  if (charData==3 && channel==jsiGetConsoleDevice() && !consoleIsBinary) {
     // Ctrl-C - force interrupt
     execInfo.execute |= EXEC_CTRL_C;
     return;
@@ -306,6 +433,58 @@ void jshPushIOCharEvent(
   ioBuffer[oldHead].data.chars[0] = charData;
 }
 
+/**
+ * Push many characters at once. If there's space in the bulk buffer, they are
+ * copied there and we use just one event. Otherwise we fall back to
+ * jshPushIOCharEvent for each character.
+ */
+void jshPushIOCharEvents(
+    IOEventFlags channel, //!< The device the characters came from.
+    char *data,           //!< The characters.
+    unsigned int count    //!< The number of characters.
+  ) {
+  unsigned int i;
+#ifdef IOBULKBUFFERMASK
+  // A few characters fit in a normal event, and Ctrl-C needs handling by jshPushIOCharEvent
+  if (count > IOEVENT_MAXCHARS &&
+      !(channel==jsiGetConsoleDevice() && !consoleIsBinary && memchr(data, 3, count))) {
+    // Set flow control if either buffer is getting full
+    if (DEVICE_IS_USART(channel) &&
+        (jshGetEventsUsed() > IOBUFFER_XOFF || jshGetBulkCharsUsed() > IOBULKBUFFERMASK*6/8))
+      jshSetFlowControlXON(channel, false);
+
+    /* Other IRQs may push characters too, so IRQs must be off while we
+     * reserve space - but not while we copy the characters in. */
+    jshInterruptOff();
+    unsigned short start = ioBulkHead;
+    bool hasSpace = count <= IOBULKBUFFERMASK - (unsigned int)jshGetBulkCharsUsed();
+    if (hasSpace)
+      ioBulkHead = (unsigned short)((start+count) & IOBULKBUFFERMASK);
+    jshInterruptOn();
+    if (hasSpace) {
+      for (i=0;i<count;i++)
+        ioBulkBuffer[(start+i) & IOBULKBUFFERMASK] = data[i];
+      jshInterruptOff();
+      unsigned char nextHead = (unsigned char)((ioHead+1) & IOBUFFERMASK);
+      if (ioTail != nextHead) {
+        ioBuffer[ioHead].flags = channel | EV_CHARS_BULK;
+        ioBuffer[ioHead].data.bulk.start = start;
+        ioBuffer[ioHead].data.bulk.length = (unsigned short)count;
+        jshMemoryBarrier(); // write the event before it's added
+        ioHead = nextHead;
+        jshInterruptOn();
+        return;
+      }
+      jshInterruptOn();
+      // no event space - get the next jshPopIOEvent to free the characters we copied
+      ioBulkPopped = true;
+    }
+    // no space - try with normal events
+  }
+#endif
+  for (i=0;i<count;i++) jshPushIOCharEvent(channel, data[i]);
+}
+
 /**
  * Signal an IO watch event as having happened.
  */
@@ -324,8 +503,52 @@ void CALLED_FROM_INTERRUPT jshPushIOWatchEvent(
     return;
   }
 
+  // If there's something to do right away, do it - and we may not need an event at all
+  JshEventAction *action = jshEventActions[channel-EV_EXTI0];
+  if (action) {
+    if (!action->edge || (action->edge>0) == state) {
+      if (action->outPin != PIN_UNDEFINED) {
+        action->outState = action->outToggle ? !action->outState : state;
+        jshPinSetValue(action->outPin, action->outState);
+      }
+      if (action->count) {
+        if (action->dirPin == PIN_UNDEFINED || jshPinGetValue(action->dirPin) != state)
+          (*action->count)++;
+        else
+          (*action->count)--;
+      }
+    }
+    if (!action->pushEvent) return;
+  }
+
   JsSysTime time = jshGetSystemTime();
 
+  // If debouncing, just note the change - only the first change of a burst needs an event
+  JshEventDebounce *debounce = jshEventDebounces[channel-EV_EXTI0];
+  if (debounce) {
+    debounce->time = (uint32_t)time;
+    debounce->state = state;
+    jshMemoryBarrier(); // write the change before it's marked as pending
+    if (debounce->pending) return;
+    debounce->pending = true;
+  }
+
+  // If edges are buffered, just store this one and only push an event if one isn't pending
+  JshEventBuffer *buffer = jshEventBuffers[channel-EV_EXTI0];
+  if (buffer) {
+    unsigned short nextHead = (unsigned short)(buffer->head+1);
+    if (nextHead == buffer->size) nextHead = 0;
+    if (nextHead == buffer->tail) {
+      jshIOEventOverflowed();
+      return; // buffer full - dump this edge!
+    }
+    buffer->data[buffer->head] = ((unsigned int)time & ~1U) | (state?1:0);
+    jshMemoryBarrier(); // write the edge before it's added
+    buffer->head = nextHead;
+    if (buffer->pending) return;
+    buffer->pending = true;
+  }
+
 #ifdef USE_TRIGGER
   // TODO: move to using jshSetEventCallback
   if (trigHandleEXTI(channel | (state?EV_EXTI_IS_HIGH:0), time))
@@ -342,6 +565,7 @@ void CALLED_FROM_INTERRUPT jshPushIOEvent(
     IOEventFlags channel, //!< The event to add to the queue.
     JsSysTime time        //!< The time that the event is thought to have happened.
   ) {
+  JSTRACE(JST_IO_EVENT, channel);
   unsigned char nextHead = (unsigned char)((ioHead+1) & IOBUFFERMASK);
   if (ioTail == nextHead) {
     jshIOEventOverflowed();
@@ -349,19 +573,70 @@ void CALLED_FROM_INTERRUPT jshPushIOEvent(
   }
   ioBuffer[ioHead].flags = channel;
   ioBuffer[ioHead].data.time = (unsigned int)time;
+  jshMemoryBarrier(); // write the event before it's added
   ioHead = nextHead;
 }
 
+#ifdef IOBULKBUFFERMASK
+/**
+ * If a bulk event was popped, the caller has now finished with its characters.
+ * Move the bulk buffer's tail up to the oldest bulk event left in ioBuffer.
+ */
+static void jshIOBulkRelease() {
+  if (!ioBulkPopped) return;
+  ioBulkPopped = false;
+  /* Read the bulk head first - any event added after this point has its
+   * characters after it, so it's safe to use if we find no bulk events */
+  unsigned short newTail = ioBulkHead;
+  jshMemoryBarrier();
+  unsigned char head = ioHead;
+  jshMemoryBarrier();
+  unsigned char i = ioTail;
+  while (i!=head) {
+    if (DEVICE_IS_USART(IOEVENTFLAGS_GETTYPE(ioBuffer[i].flags)) &&
+        IOEVENTFLAGS_ISBULK(ioBuffer[i].flags)) {
+      newTail = ioBuffer[i].data.bulk.start;
+      break;
+    }
+    i = (unsigned char)((i+1) & IOBUFFERMASK);
+  }
+  ioBulkTail = newTail;
+}
+
+/// Called when an event has been taken off ioBuffer
+static void jshIOBulkPopped(IOEvent *event) {
+  if (DEVICE_IS_USART(IOEVENTFLAGS_GETTYPE(event->flags)) &&
+      IOEVENTFLAGS_ISBULK(event->flags))
+    ioBulkPopped = true;
+}
+
+/// How many characters are in the bulk buffer?
+int jshGetBulkCharsUsed() {
+  return (ioBulkHead - ioBulkTail) & IOBULKBUFFERMASK;
+}
+#endif
+
 // returns true on success
 bool jshPopIOEvent(IOEvent *result) {
+#ifdef IOBULKBUFFERMASK
+  jshIOBulkRelease();
+#endif
   if (ioHead==ioTail) return false;
+  jshMemoryBarrier(); // read ioHead before the event
   *result = ioBuffer[ioTail];
+  jshMemoryBarrier(); // read the event before it can be reused
   ioTail = (unsigned char)((ioTail+1) & IOBUFFERMASK);
+#ifdef IOBULKBUFFERMASK
+  jshIOBulkPopped(result);
+#endif
   return true;
 }
 
 // returns true on success
 bool jshPopIOEventOfType(IOEventFlags eventType, IOEvent *result) {
+#ifdef IOBULKBUFFERMASK
+  jshIOBulkRelease();
+#endif
   // Special case for top - it's easier!
   if (IOEVENTFLAGS_GETTYPE(ioBuffer[ioTail].flags) == eventType)
     return jshPopIOEvent(result);
@@ -384,6 +659,9 @@ bool jshPopIOEventOfType(IOEventFlags eventType, IOEvent *result) {
       // finally update the tail pointer, and return
       ioTail = (unsigned char)((ioTail+1) & IOBUFFERMASK);
       jshInterruptOn();
+#ifdef IOBULKBUFFERMASK
+      jshIOBulkPopped(result);
+#endif
       return true;
     }
     i = (unsigned char)((i+1) & IOBUFFERMASK);
@@ -414,9 +692,30 @@ bool jshHasEventSpaceForChars(int n) {
   int spacesNeeded = 4 + (n/IOEVENT_MAXCHARS); // be sensible - leave a little spare
   int spaceUsed = jshGetEventsUsed();
   int spaceLeft = IOBUFFERMASK+1-spaceUsed;
+#ifdef IOBULKBUFFERMASK
+  // jshPushIOCharEvents can use one event and the bulk buffer
+  if (spaceLeft > 4 && IOBULKBUFFERMASK-jshGetBulkCharsUsed() >= n)
+    return true;
+#endif
   return spaceLeft > spacesNeeded;
 }
 
+unsigned int jshGetIOEventCharCount(IOEvent *event) {
+#ifdef IOBULKBUFFERMASK
+  if (IOEVENTFLAGS_ISBULK(event->flags))
+    return event->data.bulk.length;
+#endif
+  return (unsigned int)IOEVENTFLAGS_GETCHARS(event->flags);
+}
+
+char jshGetIOEventChar(IOEvent *event, unsigned int i) {
+#ifdef IOBULKBUFFERMASK
+  if (IOEVENTFLAGS_ISBULK(event->flags))
+    return ioBulkBuffer[(event->data.bulk.start+i) & IOBULKBUFFERMASK];
+#endif
+  return event->data.chars[i];
+}
+
 // ----------------------------------------------------------------------------
 //                                                                      DEVICES
 
@@ -547,7 +846,7 @@ void jshSetFlowControlXON(IOEventFlags device, bool hostShouldTransmit) {
     JshSerialDeviceState *deviceState = &jshSerialDeviceStates[TO_SERIAL_DEVICE_STATE(device)];
     if ((*deviceState) & SDS_FLOW_CONTROL_XON_XOFF) {
       if (hostShouldTransmit) {
-        if (((*deviceState)&(SDS_XOFF_SENT|SDS_XON_PENDING)) == SDS_XOFF_SENT) {
+        if (((*deviceState)&(SDS_XOFF_SENT|SDS_XON_PENDING|SDS_XOFF_HELD)) == SDS_XOFF_SENT) {
           jshInterruptOff();
           (*deviceState) |= SDS_XON_PENDING;
           jshInterruptOn();
@@ -565,6 +864,25 @@ void jshSetFlowControlXON(IOEventFlags device, bool hostShouldTransmit) {
   }
 }
 
+/// Stop the host transmitting until called again with hold=false, regardless of how full the IO buffer is
+void jshSetFlowControlHold(IOEventFlags device, bool hold) {
+  if (!DEVICE_IS_USART(device)) return;
+  JshSerialDeviceState *deviceState = &jshSerialDeviceStates[TO_SERIAL_DEVICE_STATE(device)];
+  if (hold == (((*deviceState)&SDS_XOFF_HELD)!=0)) return;
+  if (hold) {
+    jshSetFlowControlXON(device, false);
+    jshInterruptOff();
+    (*deviceState) |= SDS_XOFF_HELD;
+    jshInterruptOn();
+  } else {
+    jshInterruptOff();
+    (*deviceState) &= ~SDS_XOFF_HELD;
+    jshInterruptOn();
+    // if the IO buffer is still full, this will be turned off again as soon as data is received
+    jshSetFlowControlXON(device, true);
+  }
+}
+
 /// Gets a device's object from a device, or return 0 if it doesn't exist
 JsVar *jshGetDeviceObject(IOEventFlags device) {
   const char *deviceStr = jshGetDeviceString(device);
@@ -591,3 +909,39 @@ void jshSetEventCallback(
   assert(channel>=EV_EXTI0 && channel<=EV_EXTI_MAX);
   jshEventCallbacks[channel-EV_EXTI0] = callback;
 }
+
+/// Record changes on this channel into a ring buffer rather than one IOEvent each (0 to stop)
+void jshSetEventBuffer(
+    IOEventFlags channel,   //!< The channel to record
+    JshEventBuffer *buffer  //!< The buffer to record into, or 0
+  ) {
+  assert(channel>=EV_EXTI0 && channel<=EV_EXTI_MAX);
+  jshEventBuffers[channel-EV_EXTI0] = buffer;
+}
+
+/// Perform this action from the IRQ whenever the channel changes (0 to stop)
+void jshSetEventAction(
+    IOEventFlags channel,   //!< The channel to act on
+    JshEventAction *action  //!< The action to perform, or 0
+  ) {
+  assert(channel>=EV_EXTI0 && channel<=EV_EXTI_MAX);
+  jshEventActions[channel-EV_EXTI0] = action;
+}
+
+/// Debounce changes on this channel in the IRQ (0 to stop)
+void jshSetEventDebounce(
+    IOEventFlags channel,        //!< The channel to debounce
+    JshEventDebounce *debounce   //!< The debounce state, or 0
+  ) {
+  assert(channel>=EV_EXTI0 && channel<=EV_EXTI_MAX);
+  jshEventDebounces[channel-EV_EXTI0] = debounce;
+}
+
+/// Are any channels waiting for changes to settle?
+bool jshIsEventDebouncePending() {
+  int i;
+  for (i=0;i<=EV_EXTI_MAX-EV_EXTI0;i++)
+    if (jshEventDebounces[i] && jshEventDebounces[i]->pending)
+      return true;
+  return false;
+}
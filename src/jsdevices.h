@@ -93,6 +93,7 @@ typedef enum {
   EV_CHARS_ONE = EV_TYPE_MASK+1,
   EV_CHARS_SHIFT = GET_BIT_NUMBER(EV_CHARS_ONE),
   EV_CHARS_MASK = 3 * EV_CHARS_ONE, // see IOEVENT_MAXCHARS
+  EV_CHARS_BULK = EV_CHARS_MASK, // if IOBULKBUFFERMASK, the characters are in the bulk buffer
   // ----------------------------------------- SERIAL STATUS
   EV_SERIAL_STATUS_FRAMING_ERR = EV_TYPE_MASK+1,
   EV_SERIAL_STATUS_PARITY_ERR = EV_SERIAL_STATUS_FRAMING_ERR<<1,
@@ -118,11 +119,24 @@ typedef enum {
 #define IOEVENTFLAGS_GETTYPE(X) ((X)&EV_TYPE_MASK)
 #define IOEVENTFLAGS_GETCHARS(X) ((((X)&EV_CHARS_MASK)>>EV_CHARS_SHIFT)+1)
 #define IOEVENTFLAGS_SETCHARS(X,CHARS) ((X)=(((X)&(IOEventFlags)~EV_CHARS_MASK) | (((CHARS)-1)<<EV_CHARS_SHIFT)))
+#ifdef IOBULKBUFFERMASK
+#define IOEVENT_MAXCHARS 3 // See EV_CHARS_MASK - the last value is EV_CHARS_BULK
+/// Is this a character event whose data is in the bulk buffer? Use jshGetIOEventChar to read it
+#define IOEVENTFLAGS_ISBULK(X) (((X)&EV_CHARS_MASK)==EV_CHARS_BULK)
+#else
 #define IOEVENT_MAXCHARS 4 // See EV_CHARS_MASK
+#define IOEVENTFLAGS_ISBULK(X) false
+#endif
 
 typedef union {
   unsigned int time; ///< BOTTOM 32 BITS of time the event occurred
   char chars[IOEVENT_MAXCHARS]; ///< Characters received
+#ifdef IOBULKBUFFERMASK
+  struct {
+    unsigned short start; ///< Index of the first character in the bulk buffer
+    unsigned short length; ///< Number of characters
+  } PACKED_FLAGS bulk; ///< Characters received, for EV_CHARS_BULK
+#endif
 } PACKED_FLAGS IOEventData;
 
 // IO Events - these happen when a pin changes
@@ -133,16 +147,23 @@ typedef struct IOEvent {
 
 void jshPushIOEvent(IOEventFlags channel, JsSysTime time);
 void jshPushIOWatchEvent(IOEventFlags channel); // push an even when a pin changes state
+/// While set, Ctrl-C from the console is passed on as data rather than interrupting (for binary uploads)
+void jshSetConsoleBinary(bool isBinary);
+/// Is the console passing Ctrl-C on as data? (see jshSetConsoleBinary)
+bool jshIsConsoleBinary();
 /// Push a single character event (for example USART RX)
 void jshPushIOCharEvent(IOEventFlags channel, char charData);
-/// Push many character events at once (for example USB RX)
-static inline void jshPushIOCharEvents(IOEventFlags channel, char *data, unsigned int count) {
-  // TODO: optimise me!
-  unsigned int i;
-  for (i=0;i<count;i++) jshPushIOCharEvent(channel, data[i]);
-}
-bool jshPopIOEvent(IOEvent *result); ///< returns true on success
-bool jshPopIOEventOfType(IOEventFlags eventType, IOEvent *result); ///< returns true on success
+/** Push many character events at once (for example USB RX, or a UART's FIFO).
+ * If there's space in the bulk buffer this is one event however many characters there are */
+void jshPushIOCharEvents(IOEventFlags channel, char *data, unsigned int count);
+/** Returns true on success. If the event is a character event, the characters can be read
+ * with jshGetIOEventChar until the next event is popped */
+bool jshPopIOEvent(IOEvent *result);
+bool jshPopIOEventOfType(IOEventFlags eventType, IOEvent *result); ///< returns true on success, see jshPopIOEvent
+/// How many characters are in this character event?
+unsigned int jshGetIOEventCharCount(IOEvent *event);
+/// Get a character from a character event that has just been popped
+char jshGetIOEventChar(IOEvent *event, unsigned int i);
 /// Do we have any events pending? Will jshPopIOEvent return true?
 bool jshHasEvents();
 /// Check if the top event is for the given device
@@ -154,6 +175,11 @@ int jshGetEventsUsed();
 /// Do we have enough space for N characters?
 bool jshHasEventSpaceForChars(int n);
 
+#ifdef IOBULKBUFFERMASK
+/// How many characters are in the bulk buffer? compare this to IOBULKBUFFERMASK
+int jshGetBulkCharsUsed();
+#endif
+
 const char *jshGetDeviceString(IOEventFlags device);
 IOEventFlags jshFromDeviceString(const char *device);
 
@@ -164,6 +190,10 @@ JsVar *jshGetDeviceObject(IOEventFlags device);
 //                                                         DATA TRANSMIT BUFFER
 /// Queue a character for transmission
 void jshTransmit(IOEventFlags device, unsigned char data);
+/// Would jshTransmit have to wait for space in the buffer before sending to this device?
+bool jshTransmitWouldBlock(IOEventFlags device);
+/// Queue many characters for transmission, kicking the device once for each block added
+void jshTransmitChars(IOEventFlags device, const unsigned char *data, unsigned int count);
 /// Wait for transmit to finish
 void jshTransmitFlush();
 /// Clear everything from a device
@@ -176,11 +206,16 @@ bool jshHasTransmitData();
 IOEventFlags jshGetDeviceToTransmit();
 /// Try and get a character for transmission - could just return -1 if nothing
 int jshGetCharToTransmit(IOEventFlags device);
+/// Get up to maxChars characters for transmission (eg. to fill a FIFO) - returns how many were got
+int jshGetCharsToTransmit(IOEventFlags device, unsigned char *buf, int maxChars);
 
 
 /// Set whether the host should transmit or not
 void jshSetFlowControlXON(IOEventFlags device, bool hostShouldTransmit);
 
+/// Stop the host transmitting until called again with hold=false, regardless of how full the IO buffer is
+void jshSetFlowControlHold(IOEventFlags device, bool hold);
+
 /// Set whether to use flow control on the given device or not
 void jshSetFlowControlEnabled(IOEventFlags device, bool xOnXOff);
 
@@ -190,4 +225,54 @@ typedef void(*JshEventCallbackCallback)(bool state);
 /// Set a callback function to be called when an event occurs
 void jshSetEventCallback(IOEventFlags channel, JshEventCallbackCallback callback);
 
+/** A ring of pin state changes, filled from the IRQ for a watch with `buffer` set. This
+ * lives at the start of a flat string, followed by 'size' uint32_t entries. */
+typedef struct {
+  IOEventFlags channel;            ///< The channel this is recording, or EV_NONE
+  volatile bool pending;           ///< An event has been pushed that the edges haven't been read for
+  unsigned short size;             ///< Number of entries in 'data'
+  volatile unsigned short head;    ///< Next entry to write
+  volatile unsigned short tail;    ///< Next entry to read
+  uint32_t data[];                 ///< The bottom 32 bits of jshGetSystemTime, with bit 0 as the pin state
+} JshEventBuffer;
+
+/** Record changes on this channel into a ring buffer rather than one IOEvent each (0 to stop).
+ * Only one event is pushed until the buffer is read, so bursts don't fill the event queue */
+void jshSetEventBuffer(IOEventFlags channel, JshEventBuffer *buffer);
+
+/** Something to do straight from the IRQ when a pin changes, for a watch with `irq` set to
+ * an object - so it happens within microseconds rather than when the interpreter gets to it.
+ * This lives at the start of a flat string. */
+typedef struct {
+  IOEventFlags channel;            ///< The channel this is attached to, or EV_NONE
+  signed char edge;                ///< Only act on rising (1) or falling (-1) edges, or both (0)
+  bool pushEvent;                  ///< Also push an IOEvent so the watch's callback is called
+  bool outToggle;                  ///< Toggle outPin, rather than copying the watched pin's state to it
+  volatile bool outState;          ///< The state outPin was last set to
+  unsigned char outPin;            ///< Pin to change, or PIN_UNDEFINED (Pin isn't defined yet as jspin.h includes us)
+  unsigned char dirPin;                      ///< If set, count up when this differs from the watched pin and down when it matches (quadrature)
+  volatile int32_t *count;         ///< Counter to change, or 0. Filled in by jsiWatchIRQStart as it points into another flat string
+} JshEventAction;
+
+/// Perform this action from the IRQ whenever the channel changes (0 to stop)
+void jshSetEventAction(IOEventFlags channel, JshEventAction *action);
+
+/** Debounce state for a watch with `debounce` set. The IRQ just notes each change here, and
+ * only pushes an event for the first change of a burst (to wake the idle loop up). jsiIdle then
+ * waits until the pin has been stable for 'debounce' before reporting the settled state. This
+ * lives at the start of a flat string. */
+typedef struct {
+  IOEventFlags channel;            ///< The channel this is debouncing, or EV_NONE
+  volatile bool pending;           ///< The pin has changed and not settled yet
+  volatile bool state;             ///< The pin's state after the most recent change
+  bool lastState;                  ///< The last settled state that was reported
+  uint32_t debounce;               ///< How long the pin must be stable for, in jshGetSystemTime units
+  volatile uint32_t time;          ///< The bottom 32 bits of jshGetSystemTime for the most recent change
+} JshEventDebounce;
+
+/// Debounce changes on this channel in the IRQ (0 to stop)
+void jshSetEventDebounce(IOEventFlags channel, JshEventDebounce *debounce);
+/// Are any channels waiting for changes to settle?
+bool jshIsEventDebouncePending();
+
 #endif /* JSDEVICES_H_ */
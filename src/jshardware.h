@@ -230,6 +230,9 @@ typedef struct {
   unsigned char parity; ///< 0=none, 1=odd, 2=even
   unsigned char stopbits; ///< 1 or 2
   bool xOnXOff; ///< XON XOFF flow control?
+  unsigned short rxBufferSize; ///< bytes to buffer received data in, or 0 for the default (not all devices)
+  unsigned char rxThreshold; ///< RX FIFO level to interrupt at, or 0 for the default (not all devices)
+  unsigned char rxTimeout; ///< character times of silence to interrupt after, or 0 for the default (not all devices)
 } PACKED_FLAGS JshUSARTInfo;
 
 /// Initialise a JshUSARTInfo struct to default settings
@@ -290,6 +293,14 @@ void jshSPISetup(IOEventFlags device, JshSPIInfo *inf);
  * of the previous send (or -1). If data<0, no data is sent and the function
  * waits for data to be returned */
 int jshSPISend(IOEventFlags device, int data);
+/** Send 'count' bytes from 'tx' through the given SPI device, and put the response
+ * in 'rx' (if it isn't 0). Any data returned from earlier calls to jshSPISend is
+ * discarded. Returns false if the device can't send */
+bool jshSPISendMany(IOEventFlags device, unsigned char *tx, unsigned char *rx, size_t count);
+/** Like jshSPISendMany, but return straight away and push an IO event of type 'device'
+ * once everything has been sent. 'tx' and 'rx' must stay valid until then. Returns
+ * false if the device can't send in the background */
+bool jshSPISendAsync(IOEventFlags device, unsigned char *tx, unsigned char *rx, size_t count);
 /** Send 16 bit data through the given SPI device. */
 void jshSPISend16(IOEventFlags device, int data);
 /** Set whether to send 16 bits or 8 over SPI */
@@ -354,6 +365,39 @@ void jshUtilTimerReschedule(JsSysTime period);
 /// Stop the timer
 void jshUtilTimerDisable();
 
+#ifdef ESP8266
+/* Waveform output on the I2S data pin, using DMA rather than the utility timer.
+ * `data`/`data2` must stay valid (flat strings) until it has finished. Returns
+ * false if this pin/frequency can't be done this way or I2S is busy. */
+bool jshI2SWaveformStart(Pin pin, JsVarFloat freq, uint8_t *data, uint8_t *data2, uint32_t length, bool is16Bit, bool repeat);
+/// The buffer (0 or 1) currently being output, or -1 if finished
+int jshI2SWaveformGetBuffer();
+/// Stop I2S Waveform output
+void jshI2SWaveformStop();
+/* Send WS2812 neopixel data on the I2S data pin using DMA, in the background. Returns
+ * false if it can't be done this way (so it should be bit-banged instead). */
+bool jshI2SNeopixelWrite(Pin pin, uint8_t *data, uint32_t length);
+/// Returns true once when a jshI2SNeopixelWrite has finished
+bool jshI2SNeopixelIdle();
+/// Set the pins (D0..D15) with bits set in setMask and clear those in clearMask, with one register write for each
+void jshPinsSetValues(uint32_t setMask, uint32_t clearMask);
+/// Software SPI (mode 0, MSB first, no MISO) on any pins, writing the GPIO registers directly
+void jshSPISendSoftware(Pin pinMOSI, Pin pinSCK, const unsigned char *tx, size_t count);
+#define JSH_PWM_HARDWARE_MAX 8 ///< the most pins jshPWMHardwareSetup can handle
+/* Set up the SDK's hardware PWM on up to JSH_PWM_HARDWARE_MAX pins - afterwards
+ * jshPinAnalogOutput uses it for them. Can only be done once. */
+bool jshPWMHardwareSetup(Pin *pins, int count, JsVarFloat freq);
+/// Set the duty cycles of several hardware PWM pins so they all change together
+void jshPWMHardwareWrite(Pin *pins, JsVarFloat *values, int count);
+#endif
+
+#ifdef LINUX
+/// The file that emulated flash is mapped from (or 0 for none). Set before jshInit
+extern const char *jshFlashFilename;
+/// Return where emulated flash at addr can be read from directly, or 0 if it's not in flash
+char *jshFlashGetMemMapAddress(uint32_t addr, uint32_t len);
+#endif
+
 // ---------------------------------------------- LOW LEVEL
 
 #ifdef ARM
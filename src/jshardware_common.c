@@ -22,6 +22,9 @@ void jshUSARTInitInfo(JshUSARTInfo *inf) {
   inf->parity   = DEFAULT_PARITY; // PARITY_NONE = 0, PARITY_ODD = 1, PARITY_EVEN = 2 FIXME: enum?
   inf->stopbits = DEFAULT_STOPBITS;
   inf->xOnXOff = false;
+  inf->rxBufferSize = 0;
+  inf->rxThreshold = 0;
+  inf->rxTimeout = 0;
 }
 
 void jshSPIInitInfo(JshSPIInfo *inf) {
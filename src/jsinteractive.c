@@ -19,10 +19,14 @@
 #include "jswrapper.h"
 #include "jswrap_json.h"
 #include "jswrap_io.h"
+#include "jswrap_spi_i2c.h"
 #include "jswrap_stream.h"
 #include "jswrap_flash.h" // load and save to flash
 #include "jswrap_object.h" // jswrap_object_keys_or_property_names
+#include "jswrap_espruino.h" // jswrap_espruino_setBootCode
+#include "jswrap_cache.h" // jswrap_cache_freeMemory
 #include "jsnative.h" // jsnSanityTest
+#include "jstrace.h"
 
 #ifdef ARM
 #define CHAR_DELETE_SEND 0x08
@@ -35,6 +39,8 @@
 #ifdef ESP8266
 extern void jshPrintBanner(void); // prints a debugging banner while we're in beta
 extern void jshSoftInit(void);    // re-inits wifi after a soft-reset
+extern bool jswrap_ESP8266_hasWakeData(void); // woken from deep sleep with variables in RTC memory?
+extern void jswrap_ESP8266_wake(void); // restores those variables and emits E.on('wake')
 #endif
 
 // ----------------------------------------------------------------------------
@@ -47,28 +53,49 @@ typedef enum {
   IS_HAD_27_91_NUMBER, ///< Esc [ then 0-9
 } PACKED_FLAGS InputState;
 
-JsVar *events = 0; // Array of events to execute
-JsVarRef timerArray = 0; // Linked List of timers to check and run
-JsVarRef watchArray = 0; // Linked List of input watches to check and run
+/* A queue of events to execute. This is a ring buffer of JsVarRefs in a flat
+ * string, so queueing an event doesn't need any JsVars to be allocated. Each
+ * event is argCount, callback, this, then argCount arguments. Everything but
+ * argCount is referenced (or 0), and as GC/defrag can't look inside the string,
+ * they find the references with jsiEventsForEachRef */
+typedef struct {
+  JsVar *slots; ///< Flat string of JsVarRefs, allocated when needed
+  unsigned int start; ///< The first slot in 'slots' that is used
+  unsigned int used; ///< The number of slots in 'slots' that are used
+} JsiEventQueue;
+static INSTANCE_LOCAL JsiEventQueue events; ///< Events to execute (from IRQs, emit, callbacks, etc)
+static INSTANCE_LOCAL JsiEventQueue microtasks; ///< Run as soon as the current event, timer or watch has finished (eg. Promise callbacks)
+static INSTANCE_LOCAL bool microtasksRunning = false; ///< Are we in jsiExecuteMicrotasks?
+#define JSI_EVENTS_INITIAL_SLOTS 32
+static void jsiEventsClear(JsiEventQueue *q);
+INSTANCE_LOCAL JsVarRef timerArray = 0; // Linked List of timers to check and run
+INSTANCE_LOCAL JsVarRef watchArray = 0; // Linked List of input watches to check and run
 // ----------------------------------------------------------------------------
-IOEventFlags consoleDevice = DEFAULT_CONSOLE_DEVICE; ///< The console device for user interaction
-Pin pinBusyIndicator = DEFAULT_BUSY_PIN_INDICATOR;
-Pin pinSleepIndicator = DEFAULT_SLEEP_PIN_INDICATOR;
-JsiStatus jsiStatus;
-JsSysTime jsiLastIdleTime;  ///< The last time we went around the idle loop - use this for timers
-uint32_t jsiTimeSinceCtrlC;
+INSTANCE_LOCAL IOEventFlags consoleDevice = DEFAULT_CONSOLE_DEVICE; ///< The console device for user interaction
+INSTANCE_LOCAL Pin pinBusyIndicator = DEFAULT_BUSY_PIN_INDICATOR;
+INSTANCE_LOCAL Pin pinSleepIndicator = DEFAULT_SLEEP_PIN_INDICATOR;
+INSTANCE_LOCAL JsiStatus jsiStatus;
+INSTANCE_LOCAL JsSysTime jsiLastIdleTime;  ///< The last time we went around the idle loop - use this for timers
+INSTANCE_LOCAL JsSysTime jsiNextTimerTime; ///< The earliest time any timer wants to run at (or 0 if we must scan the timers again)
+INSTANCE_LOCAL JsSysTime jsiTimerSlack = 0; ///< Slack given to new timers created with setTimeout/setInterval
+#ifndef SAVE_ON_FLASH
+INSTANCE_LOCAL JsiTaskStats jsiTaskStats[JSI_TASK_STATS];
+INSTANCE_LOCAL JsSysTime jsiTaskBudget = 0;
+#endif
+INSTANCE_LOCAL uint32_t jsiTimeSinceCtrlC;
 // ----------------------------------------------------------------------------
-JsVar *inputLine = 0; ///< The current input line
-JsvStringIterator inputLineIterator; ///< Iterator that points to the end of the input line
-int inputLineLength = -1;
-bool inputLineRemoved = false;
-size_t inputCursorPos = 0; ///< The position of the cursor in the input line
-InputState inputState = 0; ///< state for dealing with cursor keys
-uint16_t inputStateNumber; ///< Number from when `Esc [ 1234` is sent - for storing line number
-uint16_t jsiLineNumberOffset; ///< When we execute code, this is the 'offset' we apply to line numbers in error/debug
-bool hasUsedHistory = false; ///< Used to speed up - if we were cycling through history and then edit, we need to copy the string
-unsigned char loopsIdling; ///< How many times around the loop have we been entirely idle?
-bool interruptedDuringEvent; ///< Were we interrupted while executing an event? If so may want to clear timers
+INSTANCE_LOCAL JsVar *inputLine = 0; ///< The current input line
+INSTANCE_LOCAL JsvStringIterator inputLineIterator; ///< Iterator that points to the end of the input line
+INSTANCE_LOCAL int inputLineLength = -1;
+INSTANCE_LOCAL bool inputLineRemoved = false;
+INSTANCE_LOCAL size_t inputCursorPos = 0; ///< The position of the cursor in the input line
+INSTANCE_LOCAL InputState inputState = 0; ///< state for dealing with cursor keys
+INSTANCE_LOCAL uint32_t inputStateNumber; ///< Number from when `Esc [ 1234` is sent - for storing line number or upload length
+static void jsiUploadEnd();
+INSTANCE_LOCAL uint16_t jsiLineNumberOffset; ///< When we execute code, this is the 'offset' we apply to line numbers in error/debug
+INSTANCE_LOCAL bool hasUsedHistory = false; ///< Used to speed up - if we were cycling through history and then edit, we need to copy the string
+INSTANCE_LOCAL unsigned char loopsIdling; ///< How many times around the loop have we been entirely idle?
+INSTANCE_LOCAL bool interruptedDuringEvent; ///< Were we interrupted while executing an event? If so may want to clear timers
 // ----------------------------------------------------------------------------
 
 #ifdef USE_DEBUGGER
@@ -171,6 +198,10 @@ bool jsiIsConsoleDeviceForced() {
  * Send a character to the console.
  */
 NO_INLINE void jsiConsolePrintChar(char data) {
+  if ((jsiStatus & JSIS_CONSOLE_NONBLOCKING) && jshTransmitWouldBlock(consoleDevice)) {
+    jsErrorFlags |= JSERR_CONSOLE_FULL;
+    return;
+  }
   jshTransmit(consoleDevice, (unsigned char)data);
 }
 
@@ -389,6 +420,9 @@ void jsiClearInputLine() {
   inputLine = jsvNewFromEmptyString();
 }
 
+static INSTANCE_LOCAL JsiBusyDevice business = 0;
+static INSTANCE_LOCAL JsiBusyDevice businessSinceLastGet = 0; ///< Devices that have been busy since jsiGetBusy
+
 /**
  * ??? What does this do ???.
  */
@@ -396,17 +430,22 @@ void jsiSetBusy(
     JsiBusyDevice device, //!< ???
     bool isBusy           //!< ???
   ) {
-  static JsiBusyDevice business = 0;
-
-  if (isBusy)
+  if (isBusy) {
     business |= device;
-  else
+    businessSinceLastGet |= device;
+  } else
     business &= (JsiBusyDevice)~device;
 
   if (pinBusyIndicator != PIN_UNDEFINED)
     jshPinOutput(pinBusyIndicator, business!=0);
 }
 
+JsiBusyDevice jsiGetBusy() {
+  JsiBusyDevice b = business | businessSinceLastGet;
+  businessSinceLastGet = 0;
+  return b;
+}
+
 /**
  * Set the status of a pin as a function of whether we are asleep.
  * When called, if a pin is set for a sleep indicator, we set the pin to be true
@@ -429,7 +468,12 @@ static JsVarRef _jsiInitNamedArray(const char *name) {
 // 'claim' anything we are using
 void jsiSoftInit(bool hasBeenReset) {
   jsErrorFlags = 0;
-  events = jsvNewEmptyArray();
+#ifndef SAVE_ON_FLASH
+  memset(jsiTaskStats, 0, sizeof(jsiTaskStats)); // the callbacks they refer to are gone
+#endif
+  memset(&events, 0, sizeof(events)); // allocated when needed
+  memset(&microtasks, 0, sizeof(microtasks));
+  microtasksRunning = false;
   inputLine = jsvNewFromEmptyString();
   inputCursorPos = 0;
   jsiLineNumberOffset = 0;
@@ -448,6 +492,8 @@ void jsiSoftInit(bool hasBeenReset) {
   // when adding an interval from onInit (called below)
   jsiLastIdleTime = jshGetSystemTime();
   jsiTimeSinceCtrlC = 0xFFFFFFFF;
+  // Timers are stored relative to jsiLastIdleTime while saved - make them absolute again
+  jsiTimersShift(jsiLastIdleTime);
 
   // Run wrapper initialisation stuff
   jswInit();
@@ -470,7 +516,8 @@ void jsiSoftInit(bool hasBeenReset) {
     while (jsvObjectIteratorHasValue(&it)) {
       JsVar *watch = jsvObjectIteratorGetValue(&it);
       JsVar *watchPin = jsvObjectGetChild(watch, "pin", 0);
-      jshPinWatch(jshGetPinFromVar(watchPin), true);
+      IOEventFlags exti = jshPinWatch(jshGetPinFromVar(watchPin), true);
+      if (exti) jsiWatchIRQStart(watch, exti);
       jsvUnLock2(watchPin, watch);
       jsvObjectIteratorNext(&it);
     }
@@ -513,6 +560,7 @@ void jsiDumpJSON(vcbprintf_callback user_callback, void *user_data, JsVar *data,
     // if it doesn't, print JSON
     jsfGetJSONWithCallback(data, JSON_NEWLINES | JSON_PRETTY | JSON_SHOW_DEVICES, user_callback, user_data);
   }
+  jsvUnLock(name);
 }
 
 NO_INLINE static void jsiDumpEvent(vcbprintf_callback user_callback, void *user_data, JsVar *parentName, JsVar *eventKeyName, JsVar *eventFn) {
@@ -680,11 +728,12 @@ void jsiSoftKill() {
   // Stop all active timer tasks
   jstReset();
   // Unref Watches/etc
-  if (events) {
-    jsvUnLock(events);
-    events=0;
-  }
+  jsiEventsClear(&events);
+  jsiEventsClear(&microtasks);
+  jsiUploadEnd();
   if (timerArray) {
+    // Store timers relative to the last idle time, so they still make sense when reloaded
+    jsiTimersShift(-jsiLastIdleTime);
     jsvUnRefRef(timerArray);
     timerArray=0;
   }
@@ -696,6 +745,7 @@ void jsiSoftKill() {
     while (jsvObjectIteratorHasValue(&it)) {
       JsVar *watchPtr = jsvObjectIteratorGetValue(&it);
       JsVar *watchPin = jsvObjectGetChild(watchPtr, "pin", 0);
+      jsiWatchIRQStop(watchPtr);
       jshPinWatch(jshGetPinFromVar(watchPin), false);
       jsvUnLock2(watchPin, watchPtr);
       jsvObjectIteratorNext(&it);
@@ -729,6 +779,12 @@ void jsiSemiInit(bool autoLoad) {
   /* If flash contains any code, then we should
      Try and load from it... */
   bool loadFlash = autoLoad && jsfFlashContainsCode();
+#ifdef ESP8266
+  /* If we've woken from ESP8266.deepSleep with variables kept in RTC memory,
+     don't spend time loading the saved state - boot code handles E.on('wake') */
+  bool wake = autoLoad && jswrap_ESP8266_hasWakeData();
+  if (wake) loadFlash = false;
+#endif
   if (loadFlash) {
     jspSoftKill();
     jsvSoftKill();
@@ -742,6 +798,7 @@ void jsiSemiInit(bool autoLoad) {
 
 #ifdef ESP8266
   jshSoftInit();
+  if (wake) jswrap_ESP8266_wake();
 #endif
 
   if (jsiEcho()) { // intentionally not using jsiShowInputLine()
@@ -784,6 +841,7 @@ void jsiInit(bool autoLoad) {
 #else
   consoleDevice = EV_LIMBO;
 #endif
+  loopsIdling = 0; // a fresh interpreter hasn't idled yet
 
 #ifndef RELEASE
   jsnSanityTest();
@@ -847,11 +905,21 @@ int jsiCountBracketsInInput() {
 
 /// Tries to get rid of some memory (by clearing command history). Returns true if it got rid of something, false if it didn't.
 bool jsiFreeMoreMemory() {
+  bool freed = false;
   JsVar *history = jsvObjectGetChild(execInfo.hiddenRoot, JSI_HISTORY_NAME, 0);
-  if (!history) return 0;
-  JsVar *item = jsvArrayPopFirst(history);
-  bool freed = item!=0;
-  jsvUnLock2(item, history);
+  if (history) {
+    JsVar *item = jsvArrayPopFirst(history);
+    freed = item!=0;
+    jsvUnLock2(item, history);
+  }
+#ifndef SAVE_ON_FLASH
+  // pre-tokenised function code will just be recreated if it's needed
+  if (!freed) freed = jspFreeFunctionTokens();
+  // shared strings/functions we're keeping in case they're needed again
+  if (!freed) freed = jsvReleaseInternedStrings() | jsvReleaseNativeFunctions() | jspReleaseFunctionScopes();
+  // anything the user has put in an E.Cache, oldest first
+  if (!freed) freed = jswrap_cache_freeMemory();
+#endif
   // TODO: could also free the array structure?
   // TODO: could look at all streams (Serial1/HTTP/etc) and see if their buffers contain data that could be removed
 
@@ -1325,6 +1393,76 @@ void jsiHandleNewLine(bool execute) {
 }
 
 
+/* Binary upload - code sent as a block, rather than typed in a character at a time:
+ *   -> Esc [ <length> U   (or B to save it with E.setBootCode rather than run it)
+ *   <- ACK (6) when we're ready for the data, NAK (21) if there's not enough memory
+ *   -> <length> bytes of code, then the CRC32 of them (4 bytes, little endian)
+ *   <- ACK once the code has been run/saved, NAK if the CRC didn't match
+ * The data isn't echoed or line-edited, and Ctrl-C is passed through as data. */
+static INSTANCE_LOCAL JsVar *uploadData;          ///< flat string the upload is written into
+static INSTANCE_LOCAL uint32_t uploadPos;         ///< number of bytes of the upload (including CRC) received
+static INSTANCE_LOCAL uint32_t uploadLen;         ///< length of the upload's data (0 = no upload)
+static INSTANCE_LOCAL uint32_t uploadCRC;         ///< CRC32 sent after the data
+static INSTANCE_LOCAL bool uploadIsBootCode;      ///< save the data with E.setBootCode rather than running it
+static INSTANCE_LOCAL JsSysTime uploadLastTime;   ///< when we last got data, for JSI_UPLOAD_TIMEOUT
+#define JSI_UPLOAD_TIMEOUT 2000    ///< milliseconds without data before we give up on an upload
+
+static void jsiUploadEnd() {
+  jsvUnLock(uploadData);
+  uploadData = 0;
+  uploadLen = 0;
+  jshSetConsoleBinary(false);
+}
+
+static void jsiUploadStart(uint32_t len, bool isBootCode) {
+  if (!len) return;
+  uploadData = jsvNewFlatStringOfLength(len);
+  if (!uploadData) {
+    jsiConsolePrintChar(0x15); // NAK
+    return;
+  }
+  uploadLen = len;
+  uploadPos = 0;
+  uploadCRC = 0;
+  uploadIsBootCode = isBootCode;
+  uploadLastTime = jshGetSystemTime();
+  jshSetConsoleBinary(true);
+  jsiConsolePrintChar(0x06); // ACK
+}
+
+/// Handle a character of a binary upload
+static void jsiUploadChar(char ch) {
+  if (uploadPos < uploadLen) {
+    jsvGetFlatStringPointer(uploadData)[uploadPos++] = ch;
+    return;
+  }
+  uploadCRC |= ((uint32_t)(unsigned char)ch) << (8*(uploadPos++ - uploadLen));
+  if (uploadPos < uploadLen+4) return;
+  // we have everything - check it
+  jshSetConsoleBinary(false);
+  uint32_t crc = 0xFFFFFFFF;
+  unsigned char *data = (unsigned char*)jsvGetFlatStringPointer(uploadData);
+  uint32_t i;
+  for (i=0;i<uploadLen;i++) crc = jsfCRC32Byte(crc, data[i]);
+  if (~crc != uploadCRC) {
+    jsiUploadEnd();
+    jsiConsolePrintChar(0x15); // NAK
+    return;
+  }
+  JsVar *code = jsvLockAgain(uploadData);
+  bool isBootCode = uploadIsBootCode;
+  jsiUploadEnd();
+  if (isBootCode) {
+    jswrap_espruino_setBootCode(code, false);
+  } else {
+    jsvUnLock(jspEvaluateVar(code, 0, jsiLineNumberOffset));
+    jsiLineNumberOffset = 0;
+  }
+  jsvUnLock(code);
+  jsiCheckErrors();
+  jsiConsolePrintChar(0x06); // ACK
+}
+
 void jsiHandleChar(char ch) {
   // jsiConsolePrintf("[%d:%d]\n", inputState, ch);
   //
@@ -1348,11 +1486,16 @@ void jsiHandleChar(char ch) {
   // 27 then 91 then 52 ('4') then 126 - numpad end
   // 27 then 91 then 53 ('5') then 126 - pgup
   // 27 then 91 then 54 ('6') then 126 - pgdn
+  // 27 then 91 then 48-57 (numeric digits) then 'U' or 'B' - binary upload (see jsiUploadStart)
 
   // 27 then 79 then 70 - home
   // 27 then 79 then 72 - end
   // 27 then 10 - alt enter
 
+  if (uploadLen) {
+    jsiUploadChar(ch);
+    return;
+  }
 
   if (ch == 0) {
     inputState = IS_NONE; // ignore 0 - it's scary
@@ -1386,7 +1529,7 @@ void jsiHandleChar(char ch) {
   } else if (inputState==IS_HAD_27_91) {
     inputState = IS_NONE;
     if (ch>='0' && ch<='9') {
-      inputStateNumber = (uint16_t)(ch-'0');
+      inputStateNumber = (uint32_t)(ch-'0');
       inputState = IS_HAD_27_91_NUMBER;
     } else if (ch==68) { // left
       if (inputCursorPos>0 && jsvGetCharInString(inputLine,inputCursorPos-1)!='\n') {
@@ -1417,9 +1560,10 @@ void jsiHandleChar(char ch) {
     }
   } else if (inputState==IS_HAD_27_91_NUMBER) {
     if (ch>='0' && ch<='9') {
-      inputStateNumber = (uint16_t)(10*inputStateNumber + ch - '0');
+      inputStateNumber = (uint32_t)(10*inputStateNumber + (uint32_t)(ch - '0'));
     } else {
-      if (ch=='d') jsiLineNumberOffset = inputStateNumber;
+      if (ch=='d') jsiLineNumberOffset = (uint16_t)inputStateNumber;
+      else if (ch=='U' || ch=='B') jsiUploadStart(inputStateNumber, ch=='B');
       else if (ch=='H' /* 75 */) {
         if (inputStateNumber==2) jsiClearInputLine(); // Erase current line
       } else if (ch==126) {
@@ -1457,24 +1601,97 @@ void jsiHandleChar(char ch) {
   }
 }
 
-/// Queue a function, string, or array (of funcs/strings) to be executed next time around the idle loop
-void jsiQueueEvents(JsVar *object, JsVar *callback, JsVar **args, int argCount) { // an array of functions, a string, or a single function
-  assert(argCount<10);
-
-  JsVar *event = jsvNewObject();
-  if (event) { // Could be out of memory error!
-    jsvUnLock(jsvAddNamedChild(event, callback, "func"));
+/// Get the slots in an event queue, and how many there are
+static JsVarRef *jsiEventsGetSlots(JsiEventQueue *q, unsigned int *size) {
+  if (!q->slots) {
+    *size = 0;
+    return 0;
+  }
+  *size = (unsigned int)(jsvGetCharactersInVar(q->slots) / sizeof(JsVarRef));
+  return (JsVarRef*)jsvGetFlatStringPointer(q->slots);
+}
+
+/// Make sure there is room for the given number of slots in an event queue. Returns false if out of memory
+static bool jsiEventsMakeRoom(JsiEventQueue *q, unsigned int slots) {
+  unsigned int size;
+  jsiEventsGetSlots(q, &size);
+  if (q->used+slots <= size) return true;
+  unsigned int newSize = size ? size*2 : JSI_EVENTS_INITIAL_SLOTS;
+  while (newSize < q->used+slots) newSize *= 2;
+  JsVar *newEvents = jsvNewFlatStringOfLength((unsigned int)(newSize*sizeof(JsVarRef)));
+  if (!newEvents) return false;
+  // copy the events that are queued over, so they start at slot 0
+  JsVarRef *oldSlots = jsiEventsGetSlots(q, &size);
+  JsVarRef *newSlots = (JsVarRef*)jsvGetFlatStringPointer(newEvents);
+  unsigned int i;
+  for (i=0;i<q->used;i++)
+    newSlots[i] = oldSlots[(q->start+i)%size];
+  jsvUnLock(q->slots);
+  q->slots = newEvents;
+  q->start = 0;
+  return true;
+}
 
-    if (argCount) {
-      JsVar *arr = jsvNewArray(args, argCount);
-      if (arr) {
-        jsvUnLock2(jsvAddNamedChild(event, arr, "args"), arr);
-      }
+static void jsiEventQueueForEachRef(JsiEventQueue *q, void (*callback)(JsVarRef *ref)) {
+  unsigned int size;
+  JsVarRef *slots = jsiEventsGetSlots(q, &size);
+  unsigned int i = 0;
+  while (i<q->used) {
+    unsigned int count = (unsigned int)slots[(q->start+i)%size] + 3;
+    unsigned int j;
+    for (j=1;j<count;j++) {
+      JsVarRef *ref = &slots[(q->start+i+j)%size];
+      if (*ref) callback(ref);
     }
-    if (object) jsvUnLock(jsvAddNamedChild(event, object, "this"));
+    i += count;
+  }
+}
+
+void jsiEventsForEachRef(void (*callback)(JsVarRef *ref)) {
+  jsiEventQueueForEachRef(&events, callback);
+  jsiEventQueueForEachRef(&microtasks, callback);
+}
+
+static void jsiEventsUnRef(JsVarRef *ref) {
+  jsvUnRefRef(*ref);
+}
+
+/// Remove everything from an event queue
+static void jsiEventsClear(JsiEventQueue *q) {
+  jsiEventQueueForEachRef(q, jsiEventsUnRef);
+  jsvUnLock(q->slots);
+  q->slots = 0;
+  q->start = 0;
+  q->used = 0;
+}
 
-    jsvArrayPushAndUnLock(events, event);
+/// Add an event to the end of a queue
+static void jsiEventsPush(JsiEventQueue *q, JsVar *object, JsVar *callback, JsVar **args, int argCount) {
+  assert(argCount<10);
+  if (!jsiEventsMakeRoom(q, (unsigned int)argCount+3)) {
+    jsErrorFlags |= JSERR_MEMORY;
+    return;
   }
+  unsigned int size;
+  JsVarRef *slots = jsiEventsGetSlots(q, &size);
+  unsigned int end = q->start+q->used;
+  slots[(end++)%size] = (JsVarRef)argCount;
+  slots[(end++)%size] = callback ? jsvGetRef(jsvRef(callback)) : 0;
+  slots[(end++)%size] = object ? jsvGetRef(jsvRef(object)) : 0;
+  int i;
+  for (i=0;i<argCount;i++)
+    slots[(end++)%size] = args[i] ? jsvGetRef(jsvRef(args[i])) : 0;
+  q->used += (unsigned int)argCount+3;
+}
+
+/// Queue a function, string, or array (of funcs/strings) to be executed next time around the idle loop
+void jsiQueueEvents(JsVar *object, JsVar *callback, JsVar **args, int argCount) { // an array of functions, a string, or a single function
+  jsiEventsPush(&events, object, callback, args, argCount);
+}
+
+/// Queue a function to be executed as soon as the current event, timer or watch callback has finished
+void jsiQueueMicrotask(JsVar *object, JsVar *callback, JsVar **args, int argCount) {
+  jsiEventsPush(&microtasks, object, callback, args, argCount);
 }
 
 bool jsiObjectHasCallbacks(JsVar *object, const char *callbackName) {
@@ -1498,24 +1715,102 @@ void jsiExecuteObjectCallbacks(JsVar *object, const char *callbackName, JsVar **
   jsvUnLock(callback);
 }
 
+/// Take the first event off a queue. vars gets callback, this, then the arguments (locked), and the amount of vars is returned
+static unsigned int jsiEventsPop(JsiEventQueue *q, JsVar **vars) {
+  unsigned int size;
+  JsVarRef *slots = jsiEventsGetSlots(q, &size);
+  unsigned int i, count = (unsigned int)slots[q->start] + 2;
+  for (i=0;i<count;i++) {
+    JsVarRef ref = slots[(q->start+1+i)%size];
+    vars[i] = ref ? jsvLock(ref) : 0;
+    if (vars[i]) jsvUnRef(vars[i]);
+  }
+  q->start = (q->start+count+1)%size;
+  q->used -= count+1;
+  return count;
+}
+
+#ifndef SAVE_ON_FLASH
+/// Record that 'callback' was run because of 'type', from 'startTime' until now (see E.getTaskStats)
+static void jsiTaskStatsRecord(JsiTaskType type, JsVar *callback, JsSysTime startTime) {
+  JsSysTime time = jshGetSystemTime() - startTime;
+  JsVar *fn = jsvSkipName(callback);
+  JsVarRef ref = jsvGetRef(fn);
+  int i;
+  // the last entry is 'other', for when we've run out
+  for (i=0;i<JSI_TASK_STATS-1;i++) {
+    JsiTaskStats *s = &jsiTaskStats[i];
+    if (s->callback==ref && s->type==type) break;
+    if (!s->callback) {
+      s->callback = ref;
+      s->type = (unsigned char)type;
+      JsVar *name = jsvIsFunction(fn) ? jsvObjectGetChild(fn, JSPARSE_FUNCTION_NAME_NAME, 0) : 0;
+      JsVar *line = (jsvIsFunction(fn) && !name) ? jsvObjectGetChild(fn, JSPARSE_FUNCTION_LINENUMBER_NAME, 0) : 0;
+      if (name)
+        jsvGetString(name, s->name, sizeof(s->name));
+      else if (line)
+        espruino_snprintf(s->name, sizeof(s->name), "line %d", (int)jsvGetInteger(line));
+      else
+        strncpy(s->name, jsvIsArray(fn) ? "listeners" : "anonymous", sizeof(s->name));
+      jsvUnLock2(name, line);
+      break;
+    }
+  }
+  JsiTaskStats *s = &jsiTaskStats[i];
+  if (i==JSI_TASK_STATS-1) strncpy(s->name, "other", sizeof(s->name));
+  s->calls++;
+  s->total += time;
+  if (time > s->max) s->max = time;
+  jsvUnLock(fn);
+  if (jsiTaskBudget && time > jsiTaskBudget) {
+    const char *types[] = {"Event","Timer","Watch"};
+    jsWarn("%s callback %s took %dms", types[type], s->name, (int)jshGetMillisecondsFromTime(time));
+  }
+}
+#endif
+
+/// Execute the first event in a queue
+static void jsiEventsExecuteFirst(JsiEventQueue *q) {
+  JsVar *vars[12]; // callback, this, args
+  unsigned int count = jsiEventsPop(q, vars);
+#ifndef SAVE_ON_FLASH
+  JsSysTime startTime = jshGetSystemTime();
+#endif
+  // events may be queued (and the queue reallocated) while this runs
+  jsiExecuteEventCallback(vars[1], vars[0], count-2, &vars[2]);
+#ifndef SAVE_ON_FLASH
+  jsiTaskStatsRecord(JSI_TASK_EVENT, vars[0], startTime);
+#endif
+  jsvUnLockMany(count, vars);
+}
+
+/// If a burst of events made a queue big, free it
+static void jsiEventsShrink(JsiEventQueue *q) {
+  unsigned int size;
+  jsiEventsGetSlots(q, &size);
+  if (!q->used && size > JSI_EVENTS_INITIAL_SLOTS) jsiEventsClear(q);
+}
+
+void jsiExecuteMicrotasks() {
+  // microtasks queued by microtasks get run by the loop below
+  if (microtasksRunning || !microtasks.used) return;
+  microtasksRunning = true;
+  while (microtasks.used)
+    jsiEventsExecuteFirst(&microtasks);
+  jsiEventsShrink(&microtasks);
+  microtasksRunning = false;
+}
+
 void jsiExecuteEvents() {
-  bool hasEvents = !jsvArrayIsEmpty(events);
+  bool hasEvents = events.used || microtasks.used;
   if (hasEvents) jsiSetBusy(BUSY_INTERACTIVE, true);
-  while (!jsvArrayIsEmpty(events)) {
-    JsVar *event = jsvSkipNameAndUnLock(jsvArrayPopFirst(events));
-    // Get function to execute
-    JsVar *func = jsvObjectGetChild(event, "func", 0);
-    JsVar *thisVar = jsvObjectGetChild(event, "this", 0);
-    JsVar *argsArray = jsvObjectGetChild(event, "args", 0);
-    // free actual event
-    jsvUnLock(event);
-    // now run..
-    jsiExecuteEventCallbackArgsArray(thisVar, func, argsArray);
-    jsvUnLock(argsArray);
-    //jsPrint("Event Done\n");
-    jsvUnLock2(func, thisVar);
+  jsiExecuteMicrotasks(); // anything left from code executed outside of events
+  while (events.used) {
+    jsiEventsExecuteFirst(&events);
+    jsiExecuteMicrotasks();
   }
   if (hasEvents) {
+    jsiEventsShrink(&events);
     jsiSetBusy(BUSY_INTERACTIVE, false);
     if (jspIsInterrupted() || jsiTimeSinceCtrlC<CTRL_C_TIME_FOR_BREAK)
       interruptedDuringEvent = true;
@@ -1549,9 +1844,10 @@ NO_INLINE bool jsiExecuteEventCallback(JsVar *thisVar, JsVar *callbackVar, unsig
       jsvObjectIteratorNew(&it, callbackNoNames);
       while (ok && jsvObjectIteratorHasValue(&it)) {
         JsVar *child = jsvObjectIteratorGetValue(&it);
+        // move on first, as the listener may remove itself (eg. `once`)
+        jsvObjectIteratorNext(&it);
         ok &= jsiExecuteEventCallback(thisVar, child, argCount, argPtr);
         jsvUnLock(child);
-        jsvObjectIteratorNext(&it);
       }
       jsvObjectIteratorFree(&it);
     } else if (jsvIsFunction(callbackNoNames)) {
@@ -1603,6 +1899,244 @@ bool jsiIsWatchingPin(Pin pin) {
   return isWatched;
 }
 
+void jsiWatchIRQStart(JsVar *watchPtr, IOEventFlags exti) {
+  JsVar *bufferVar = jsvObjectGetChild(watchPtr, "buffer", 0);
+  if (bufferVar) {
+    JshEventBuffer *buffer = (JshEventBuffer*)jsvGetFlatStringPointer(bufferVar);
+    buffer->channel = exti;
+    buffer->pending = false;
+    buffer->head = 0;
+    buffer->tail = 0;
+    jshSetEventBuffer(exti, buffer);
+    jsvUnLock(bufferVar);
+  }
+  JsVar *debounceVar = jsvObjectGetChild(watchPtr, "dbnc", 0);
+  if (debounceVar) {
+    JshEventDebounce *debounce = (JshEventDebounce*)jsvGetFlatStringPointer(debounceVar);
+    debounce->channel = exti;
+    debounce->pending = false;
+    debounce->state = debounce->lastState = jshPinGetValue(jshGetPinFromVarAndUnLock(jsvObjectGetChild(watchPtr, "pin", 0)));
+    jshSetEventDebounce(exti, debounce);
+    jsvUnLock(debounceVar);
+  }
+  JsVar *actionVar = jsvObjectGetChild(watchPtr, "action", 0);
+  if (actionVar) {
+    JshEventAction *action = (JshEventAction*)jsvGetFlatStringPointer(actionVar);
+    // the counter is a flat typed array, so won't move - but it may have since save()/load()
+    JsVar *countVar = jsvObjectGetChild(watchPtr, "count", 0);
+    size_t len = 0;
+    action->count = countVar ? (volatile int32_t*)jsvGetDataPointer(countVar, &len) : 0;
+    jsvUnLock(countVar);
+    if (action->outPin != PIN_UNDEFINED)
+      action->outState = jshPinGetValue(action->outPin);
+    action->channel = exti;
+    jshSetEventAction(exti, action);
+    jsvUnLock(actionVar);
+  }
+}
+
+void jsiWatchIRQStop(JsVar *watchPtr) {
+  JsVar *bufferVar = jsvObjectGetChild(watchPtr, "buffer", 0);
+  if (bufferVar) {
+    JshEventBuffer *buffer = (JshEventBuffer*)jsvGetFlatStringPointer(bufferVar);
+    if (buffer->channel) jshSetEventBuffer(buffer->channel, 0);
+    buffer->channel = EV_NONE;
+    jsvUnLock(bufferVar);
+  }
+  JsVar *debounceVar = jsvObjectGetChild(watchPtr, "dbnc", 0);
+  if (debounceVar) {
+    JshEventDebounce *debounce = (JshEventDebounce*)jsvGetFlatStringPointer(debounceVar);
+    if (debounce->channel) jshSetEventDebounce(debounce->channel, 0);
+    debounce->channel = EV_NONE;
+    jsvUnLock(debounceVar);
+  }
+  JsVar *actionVar = jsvObjectGetChild(watchPtr, "action", 0);
+  if (actionVar) {
+    JshEventAction *action = (JshEventAction*)jsvGetFlatStringPointer(actionVar);
+    if (action->channel) jshSetEventAction(action->channel, 0);
+    action->channel = EV_NONE;
+    jsvUnLock(actionVar);
+  }
+}
+
+/** Read all the edges recorded for a watch with `buffer` set into a Uint32Array, and
+ * call the watch's callback with it. Returns true if the watch was removed */
+static bool jsiHandleWatchBuffer(JsvObjectIterator *it, JsVar *watchArrayPtr, JsVar *watchPtr, JsVar *bufferVar, Pin pin) {
+  JshEventBuffer *buffer = (JshEventBuffer*)jsvGetFlatStringPointer(bufferVar);
+  // clear this first, so any edge added while we read gets another event
+  buffer->pending = false;
+  jshMemoryBarrier();
+  unsigned int head = buffer->head;
+  unsigned int tail = buffer->tail;
+  if (head == tail) return false;
+  unsigned int count = (head + buffer->size - tail) % buffer->size;
+  JsVar *edges = jsvNewTypedArray(ARRAYBUFFERVIEW_UINT32, (JsVarInt)count);
+  if (!edges) return false;
+  // Like IOEvents, only the bottom 32 bits of the time are stored - see jsiIdle
+  JsSysTime time = jshGetSystemTime();
+  JsvArrayBufferIterator ait;
+  jsvArrayBufferIteratorNew(&ait, edges, 0);
+  while (tail != head) {
+    unsigned int edge = buffer->data[tail];
+    JsSysTime t = time;
+    if (((unsigned int)t) < (edge & ~1U))
+      t = t - 0x100000000LL;
+    t = (t & ~0xFFFFFFFFLL) | (JsSysTime)(edge & ~1U);
+    unsigned int us = (unsigned int)jsiGetTicksFromTime(t);
+    jsvArrayBufferIteratorSetIntegerValue(&ait, (JsVarInt)((us<<1) | (edge&1)));
+    jsvArrayBufferIteratorNext(&ait);
+    if (++tail == buffer->size) tail = 0;
+  }
+  jsvArrayBufferIteratorFree(&ait);
+  jshMemoryBarrier(); // read the edges before we free their space
+  buffer->tail = (unsigned short)tail;
+
+  JsVar *watchCallback = jsvObjectGetChild(watchPtr, "callback", 0);
+  bool watchRecurring = jsvGetBoolAndUnLock(jsvObjectGetChild(watchPtr,  "recur", 0));
+#ifndef SAVE_ON_FLASH
+  JsSysTime startTime = jshGetSystemTime();
+#endif
+  if (!jsiExecuteEventCallback(0, watchCallback, 1, &edges) && watchRecurring) {
+    jsError("Ctrl-C while processing watch - removing it.");
+    jsErrorFlags |= JSERR_CALLBACK;
+    watchRecurring = false;
+  }
+#ifndef SAVE_ON_FLASH
+  jsiTaskStatsRecord(JSI_TASK_WATCH, watchCallback, startTime);
+#endif
+  jsiExecuteMicrotasks();
+  jsvUnLock2(edges, watchCallback);
+  if (watchRecurring) return false;
+  jsiWatchIRQStop(watchPtr);
+  jsvObjectIteratorRemoveAndGotoNext(it, watchArrayPtr);
+  if (!jsiIsWatchingPin(pin))
+    jshPinWatch(pin, false);
+  return true;
+}
+
+/// Create the 'time' value given to a watch's callback - seconds, or integer microseconds if the watch was set with 'ticks:true'
+static JsVar *jsiNewWatchTime(JsVar *watchPtr, JsSysTime time) {
+  if (jsvGetBoolAndUnLock(jsvObjectGetChild(watchPtr, "ticks", 0)))
+    return jsvNewFromInteger(jsiGetTicksFromTime(time));
+  return jsvNewFromFloat(jshGetMillisecondsFromTime(time)/1000);
+}
+
+/** Call a watch's callback for a change to 'pinIsHigh' at 'eventTime' (if it's for an edge the
+ * watch wants), removing the watch if it isn't recurring. Returns true if it was removed */
+static bool jsiExecuteWatch(JsvObjectIterator *it, JsVar *watchArrayPtr, JsVar *watchPtr, Pin pin, bool pinIsHigh, JsSysTime eventTime) {
+  bool hasDeletedWatch = false;
+  JsVar *timePtr = jsiNewWatchTime(watchPtr, eventTime);
+  if (jsiShouldExecuteWatch(watchPtr, pinIsHigh)) { // edge triggering
+    JsVar *watchCallback = jsvObjectGetChild(watchPtr, "callback", 0);
+    bool watchRecurring = jsvGetBoolAndUnLock(jsvObjectGetChild(watchPtr,  "recur", 0));
+    JsVar *data = jsvNewObject();
+    if (data) {
+      jsvObjectSetChildAndUnLock(data, "lastTime", jsvObjectGetChild(watchPtr, "lastTime", 0));
+      // set both data.time, and watch.lastTime in one go
+      jsvObjectSetChild(data, "time", timePtr); // no unlock
+      jsvObjectSetChildAndUnLock(data, "pin", jsvNewFromPin(pin));
+      jsvObjectSetChildAndUnLock(data, "state", jsvNewFromBool(pinIsHigh));
+    }
+#ifndef SAVE_ON_FLASH
+    JsSysTime startTime = jshGetSystemTime();
+#endif
+    if (!jsiExecuteEventCallback(0, watchCallback, 1, &data) && watchRecurring) {
+      jsError("Ctrl-C while processing watch - removing it.");
+      jsErrorFlags |= JSERR_CALLBACK;
+      watchRecurring = false;
+    }
+#ifndef SAVE_ON_FLASH
+    jsiTaskStatsRecord(JSI_TASK_WATCH, watchCallback, startTime);
+#endif
+    jsiExecuteMicrotasks();
+    jsvUnLock(data);
+    if (!watchRecurring) {
+      // free all
+      jsiWatchIRQStop(watchPtr);
+      jsvObjectIteratorRemoveAndGotoNext(it, watchArrayPtr);
+      hasDeletedWatch = true;
+      if (!jsiIsWatchingPin(pin))
+        jshPinWatch(pin, false);
+    }
+    jsvUnLock(watchCallback);
+  }
+  jsvObjectSetChildAndUnLock(watchPtr, "lastTime", timePtr);
+  return hasDeletedWatch;
+}
+
+void jsiWatchStopIRQDebounce(Pin pin) {
+  JsVar *watchArrayPtr = jsvLock(watchArray);
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, watchArrayPtr);
+  while (jsvObjectIteratorHasValue(&it)) {
+    JsVar *watchPtr = jsvObjectIteratorGetValue(&it);
+    JsVar *debounceVar = jsvObjectGetChild(watchPtr, "dbnc", 0);
+    if (debounceVar && jshGetPinFromVarAndUnLock(jsvObjectGetChild(watchPtr, "pin", 0)) == pin) {
+      JshEventDebounce *debounce = (JshEventDebounce*)jsvGetFlatStringPointer(debounceVar);
+      if (debounce->channel) jshSetEventDebounce(debounce->channel, 0);
+      jsvObjectSetChildAndUnLock(watchPtr, "state", jsvNewFromBool(debounce->lastState));
+      JsVar *debounceName = jsvFindChildFromString(watchPtr, "dbnc", false);
+      if (debounceName) jsvRemoveChild(watchPtr, debounceName);
+      jsvUnLock(debounceName);
+    }
+    jsvUnLock2(debounceVar, watchPtr);
+    jsvObjectIteratorNext(&it);
+  }
+  jsvObjectIteratorFree(&it);
+  jsvUnLock(watchArrayPtr);
+}
+
+/** Report changes on watches debounced in the IRQ that have now settled. Returns the
+ * time until the next pending one could settle, or JSSYSTIME_MAX */
+static JsSysTime jsiHandleWatchDebounces() {
+  if (!jshIsEventDebouncePending()) return JSSYSTIME_MAX;
+  JsSysTime timeUntilNext = JSSYSTIME_MAX;
+  JsSysTime now = jshGetSystemTime();
+  JsVar *watchArrayPtr = jsvLock(watchArray);
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, watchArrayPtr);
+  while (jsvObjectIteratorHasValue(&it)) {
+    bool hasDeletedWatch = false;
+    JsVar *watchPtr = jsvObjectIteratorGetValue(&it);
+    JsVar *debounceVar = jsvObjectGetChild(watchPtr, "dbnc", 0);
+    if (debounceVar) {
+      JshEventDebounce *debounce = (JshEventDebounce*)jsvGetFlatStringPointer(debounceVar);
+      if (debounce->pending) {
+        uint32_t time = debounce->time;
+        uint32_t elapsed = (uint32_t)now - time;
+        if (elapsed < debounce->debounce) { // still settling
+          if (debounce->debounce - elapsed < timeUntilNext)
+            timeUntilNext = debounce->debounce - elapsed;
+        } else {
+          debounce->pending = false;
+          jshMemoryBarrier();
+          if (debounce->time != time) {
+            // changed again as we looked - keep waiting
+            debounce->pending = true;
+            timeUntilNext = 0;
+          } else if (debounce->state != debounce->lastState) {
+            debounce->lastState = debounce->state;
+            // like IOEvents, only the bottom 32 bits of the time are stored
+            JsSysTime eventTime = now;
+            if (((uint32_t)eventTime) < time)
+              eventTime = eventTime - 0x100000000LL;
+            eventTime = (eventTime & ~0xFFFFFFFFLL) | (JsSysTime)time;
+            Pin pin = jshGetPinFromVarAndUnLock(jsvObjectGetChild(watchPtr, "pin", 0));
+            hasDeletedWatch = jsiExecuteWatch(&it, watchArrayPtr, watchPtr, pin, debounce->lastState, eventTime);
+          }
+        }
+      }
+      jsvUnLock(debounceVar);
+    }
+    jsvUnLock(watchPtr);
+    if (!hasDeletedWatch)
+      jsvObjectIteratorNext(&it);
+  }
+  jsvObjectIteratorFree(&it);
+  jsvUnLock(watchArrayPtr);
+  return timeUntilNext;
+}
+
 /** Take an event for a UART and handle the chareacters we're getting, potentially
  * grabbing more characters as well if it's easy. If more character events are
  * grabbed, the number of extra events (not characters) is returned */
@@ -1624,17 +2158,17 @@ int jsiHandleIOEventForUSART(JsVar *usartClass, IOEvent *event) {
     JsvStringIterator it;
     jsvStringIteratorNew(&it, stringData, 0);
 
-    int i, chars = IOEVENTFLAGS_GETCHARS(event->flags);
+    unsigned int i, chars = jshGetIOEventCharCount(event);
     while (chars) {
       for (i=0;i<chars;i++) {
-        char ch = (char)(event->data.chars[i] & ((1<<bytesize)-1)); // mask
+        char ch = (char)(jshGetIOEventChar(event, i) & ((1<<bytesize)-1)); // mask
         jsvStringIteratorAppend(&it, ch);
       }
       // look down the stack and see if there is more data
       if (jshIsTopEvent(IOEVENTFLAGS_GETTYPE(event->flags))) {
         jshPopIOEvent(event);
         eventsHandled++;
-        chars = IOEVENTFLAGS_GETCHARS(event->flags);
+        chars = jshGetIOEventCharCount(event);
       } else
         chars = 0;
     }
@@ -1648,13 +2182,59 @@ int jsiHandleIOEventForUSART(JsVar *usartClass, IOEvent *event) {
 }
 
 void jsiHandleIOEventForConsole(IOEvent *event) {
-  int i, c = IOEVENTFLAGS_GETCHARS(event->flags);
+  unsigned int i, c = jshGetIOEventCharCount(event);
   jsiSetBusy(BUSY_INTERACTIVE, true);
-  for (i=0;i<c;i++) jsiHandleChar(event->data.chars[i]);
+  if (uploadLen) {
+    uploadLastTime = jshGetSystemTime();
+    // binary upload - no need to copy the characters anywhere else first
+    i = 0;
+    while (i<c && uploadLen) jsiUploadChar(jshGetIOEventChar(event, i++));
+    while (i<c) jsiHandleChar(jshGetIOEventChar(event, i++));
+  } else if (IOEVENTFLAGS_ISBULK(event->flags)) {
+    /* Handling a character may execute code that pops more events (eg. the
+     * debugger), so copy the characters out of the bulk buffer first */
+    JsVar *chars = jsvNewFromEmptyString();
+    if (chars) {
+      JsvStringIterator it;
+      jsvStringIteratorNew(&it, chars, 0);
+      for (i=0;i<c;i++)
+        jsvStringIteratorAppend(&it, jshGetIOEventChar(event, i));
+      jsvStringIteratorFree(&it);
+      jsvStringIteratorNew(&it, chars, 0);
+      while (jsvStringIteratorHasChar(&it)) {
+        jsiHandleChar(jsvStringIteratorGetChar(&it));
+        jsvStringIteratorNext(&it);
+      }
+      jsvStringIteratorFree(&it);
+      jsvUnLock(chars);
+    }
+  } else {
+    for (i=0;i<c;i++) jsiHandleChar(event->data.chars[i]);
+  }
   jsiSetBusy(BUSY_INTERACTIVE, false);
 }
 
+#ifndef SAVE_ON_FLASH
+/// Fire E.on('lowMemory') if the allocator asked us to, or re-arm it once memory has recovered
+static void jsiHandleLowMemory() {
+  if (jsvLowMemoryState==JSV_LOWMEM_PENDING) {
+    jsvLowMemoryState = JSV_LOWMEM_FIRED;
+    JsVar *E = jsvObjectGetChild(execInfo.root, "E", 0);
+    if (E) {
+      JsVar *freeVars = jsvNewFromInteger((JsVarInt)(jsvGetMemoryTotal() - jsvGetMemoryUsage()));
+      jsiExecuteObjectCallbacks(E, JS_EVENT_PREFIX"lowMemory", &freeVars, 1);
+      jsvUnLock2(freeVars, E);
+    }
+  } else if (jsvLowMemoryState==JSV_LOWMEM_FIRED) {
+    unsigned int threshold = jsvLowMemoryThreshold ? jsvLowMemoryThreshold : JS_VARS_BEFORE_IDLE_GC;
+    if (jsvMoreFreeVariablesThan(threshold*2))
+      jsvLowMemoryState = JSV_LOWMEM_ARMED;
+  }
+}
+#endif
+
 void jsiIdle() {
+  JSTRACE(JST_IDLE_BEGIN, 0);
   // This is how many times we have been here and not done anything.
   // It will be zeroed if we do stuff later
   if (loopsIdling<255) loopsIdling++;
@@ -1666,6 +2246,13 @@ void jsiIdle() {
   // Just process what was in the event queue at the start
   int maxEvents = jshGetEventsUsed();
 
+  // give up on a binary upload if the data stops coming
+  if (uploadLen && jshGetSystemTime() > uploadLastTime + jshGetTimeFromMilliseconds(JSI_UPLOAD_TIMEOUT)) {
+    jsiUploadEnd();
+    jsiConsolePrintChar(0x15); // NAK
+  }
+
+  JSTRACE(JST_IO_BEGIN, maxEvents);
   while ((maxEvents--)>0 && jshPopIOEvent(&event)) {
     jsiSetBusy(BUSY_INTERACTIVE, true);
     wasBusy = true;
@@ -1694,6 +2281,11 @@ void jsiIdle() {
           jsiExecuteObjectCallbacks(usartClass, JS_EVENT_PREFIX"parity", 0, 0);
       }
       jsvUnLock(usartClass);
+    } else if (DEVICE_IS_SPI(eventType)) { // ------------------------------------------------ SPI SEND ASYNC DONE
+      JsVar *spiClass = jsvSkipNameAndUnLock(jsiGetClassNameFromDevice(eventType));
+      if (jsvIsObject(spiClass))
+        jswrap_spi_asyncComplete(spiClass);
+      jsvUnLock(spiClass);
     } else if (DEVICE_IS_EXTI(eventType)) { // ---------------------------------------------------------------- PIN WATCH
       // we have an event... find out what it was for...
       // Check everything in our Watch array
@@ -1704,8 +2296,13 @@ void jsiIdle() {
         bool hasDeletedWatch = false;
         JsVar *watchPtr = jsvObjectIteratorGetValue(&it);
         Pin pin = jshGetPinFromVarAndUnLock(jsvObjectGetChild(watchPtr, "pin", 0));
+        JsVar *watchBuffer = jsvObjectGetChild(watchPtr, "buffer", 0);
 
-        if (jshIsEventForPin(&event, pin)) {
+        if (watchBuffer) {
+          if (jshIsEventForPin(&event, pin))
+            hasDeletedWatch = jsiHandleWatchBuffer(&it, watchArrayPtr, watchPtr, watchBuffer, pin);
+          jsvUnLock(watchBuffer);
+        } else if (jshIsEventForPin(&event, pin)) {
           /** Work out event time. Events time is only stored in 32 bits, so we need to
            * use the correct 'high' 32 bits from the current time.
            *
@@ -1725,7 +2322,11 @@ void jsiIdle() {
 
           bool executeNow = false;
           JsVarInt debounce = jsvGetIntegerAndUnLock(jsvObjectGetChild(watchPtr, "debounce", 0));
-          if (debounce<=0) {
+          JsVar *irqDebounce = jsvObjectGetChild(watchPtr, "dbnc", 0);
+          if (irqDebounce) {
+            // Debounced in the IRQ - this was just the first change, jsiHandleWatchDebounces reports it once settled
+            jsvUnLock(irqDebounce);
+          } else if (debounce<=0) {
             executeNow = true;
           } else { // Debouncing - use timeouts to ensure we only fire at the right time
             // store the current state of the pin
@@ -1734,8 +2335,12 @@ void jsiIdle() {
 
             JsVar *timeout = jsvObjectGetChild(watchPtr, "timeout", 0);
             if (timeout) { // if we had a timeout, update the callback time
-              JsSysTime timeoutTime = jsiLastIdleTime + (JsSysTime)jsvGetLongIntegerAndUnLock(jsvObjectGetChild(timeout, "time", 0));
-              jsvUnLock(jsvObjectSetChild(timeout, "time", jsvNewFromLongInteger((JsSysTime)(eventTime - jsiLastIdleTime) + debounce)));
+              JsiTimerData timeoutData;
+              jsiTimerGetData(timeout, &timeoutData);
+              JsSysTime timeoutTime = timeoutData.time;
+              timeoutData.time = eventTime + debounce;
+              jsiTimerSetData(timeout, &timeoutData);
+              jsiTimersChanged();
               if (eventTime > timeoutTime) {
                 // timeout should have fired, but we didn't get around to executing it!
                 // Do it now (with the old timeout time)
@@ -1744,15 +2349,16 @@ void jsiIdle() {
                 pinIsHigh = oldWatchState;
               }
             } else { // else create a new timeout
-              timeout = jsvNewObject();
+              JsVar *watchCallback = jsvObjectGetChild(watchPtr, "callback", 0);
+              timeout = jsiTimerNew(eventTime + debounce, 0, 0, watchCallback);
+              jsvUnLock(watchCallback);
               if (timeout) {
                 jsvObjectSetChild(timeout, "watch", watchPtr); // no unlock
-                jsvObjectSetChildAndUnLock(timeout, "time", jsvNewFromLongInteger((JsSysTime)(eventTime - jsiLastIdleTime) + debounce));
-                jsvObjectSetChildAndUnLock(timeout, "callback", jsvObjectGetChild(watchPtr, "callback", 0));
                 jsvObjectSetChildAndUnLock(timeout, "lastTime", jsvObjectGetChild(watchPtr, "lastTime", 0));
                 jsvObjectSetChildAndUnLock(timeout, "pin", jsvNewFromPin(pin));
                 // Add to timer array
                 jsiTimerAdd(timeout);
+                jsiTimersChanged();
                 // Add to our watch
                 jsvObjectSetChild(watchPtr, "timeout", timeout); // no unlock
               }
@@ -1761,36 +2367,8 @@ void jsiIdle() {
           }
 
           // If we want to execute this watch right now...
-          if (executeNow) {
-            JsVar *timePtr = jsvNewFromFloat(jshGetMillisecondsFromTime(eventTime)/1000);
-            if (jsiShouldExecuteWatch(watchPtr, pinIsHigh)) { // edge triggering
-              JsVar *watchCallback = jsvObjectGetChild(watchPtr, "callback", 0);
-              bool watchRecurring = jsvGetBoolAndUnLock(jsvObjectGetChild(watchPtr,  "recur", 0));
-              JsVar *data = jsvNewObject();
-              if (data) {
-                jsvObjectSetChildAndUnLock(data, "lastTime", jsvObjectGetChild(watchPtr, "lastTime", 0));
-                // set both data.time, and watch.lastTime in one go
-                jsvObjectSetChild(data, "time", timePtr); // no unlock
-                jsvObjectSetChildAndUnLock(data, "pin", jsvNewFromPin(pin));
-                jsvObjectSetChildAndUnLock(data, "state", jsvNewFromBool(pinIsHigh));
-              }
-              if (!jsiExecuteEventCallback(0, watchCallback, 1, &data) && watchRecurring) {
-                jsError("Ctrl-C while processing watch - removing it.");
-                jsErrorFlags |= JSERR_CALLBACK;
-                watchRecurring = false;
-              }
-              jsvUnLock(data);
-              if (!watchRecurring) {
-                // free all
-                jsvObjectIteratorRemoveAndGotoNext(&it, watchArrayPtr);
-                hasDeletedWatch = true;
-                if (!jsiIsWatchingPin(pin))
-                  jshPinWatch(pin, false);
-              }
-              jsvUnLock(watchCallback);
-            }
-            jsvObjectSetChildAndUnLock(watchPtr, "lastTime", timePtr);
-          }
+          if (executeNow)
+            hasDeletedWatch = jsiExecuteWatch(&it, watchArrayPtr, watchPtr, pin, pinIsHigh, eventTime);
         }
 
         jsvUnLock(watchPtr);
@@ -1801,17 +2379,27 @@ void jsiIdle() {
       jsvUnLock(watchArrayPtr);
     }
   }
+  JSTRACE(JST_IO_END, 0);
+
+  // Report any debounced pin changes that have settled
+  JsSysTime debounceTimeUntilNext = jsiHandleWatchDebounces();
 
   // Reset Flow control if it was set...
-  if (jshGetEventsUsed() < IOBUFFER_XON) {
+  if (jshGetEventsUsed() < IOBUFFER_XON
+#ifdef IOBULKBUFFERMASK
+      && jshGetBulkCharsUsed() < IOBULKBUFFERMASK*3/8
+#endif
+      ) {
     jshSetFlowControlXON(EV_USBSERIAL, true);
     int i;
     for (i=0;i<USART_COUNT;i++)
       jshSetFlowControlXON(EV_SERIAL1+i, true);
   }
 
+  // Run any microtasks queued by code typed in/uploaded (or from before we were called)
+  jsiExecuteMicrotasks();
+
   // Check timers
-  JsSysTime minTimeUntilNext = JSSYSTIME_MAX;
   JsSysTime time = jshGetSystemTime();
   JsSysTime timePassed = time - jsiLastIdleTime;
   jsiLastIdleTime = time;
@@ -1821,106 +2409,136 @@ void jsiIdle() {
   if (oldTimeSinceCtrlC > jsiTimeSinceCtrlC)
     jsiTimeSinceCtrlC = 0xFFFFFFFF;
 
-  jsiStatus = jsiStatus & ~JSIS_TIMERS_CHANGED;
-  JsVar *timerArrayPtr = jsvLock(timerArray);
-  JsvObjectIterator it;
-  jsvObjectIteratorNew(&it, timerArrayPtr);
-  while (jsvObjectIteratorHasValue(&it) && !(jsiStatus & JSIS_TIMERS_CHANGED)) {
-    bool hasDeletedTimer = false;
-    JsVar *timerPtr = jsvObjectIteratorGetValue(&it);
-    JsSysTime timerTime = (JsSysTime)jsvGetLongIntegerAndUnLock(jsvObjectGetChild(timerPtr, "time", 0));
-    JsSysTime timeUntilNext = timerTime - timePassed;
-
-    if (timeUntilNext<=0) {
-      // we're now doing work
-      jsiSetBusy(BUSY_INTERACTIVE, true);
-      wasBusy = true;
-      JsVar *timerCallback = jsvObjectGetChild(timerPtr, "callback", 0);
-      JsVar *watchPtr = jsvObjectGetChild(timerPtr, "watch", 0); // for debounce - may be undefined
-      bool exec = true;
-      JsVar *data = 0;
-      if (watchPtr) {
-        data = jsvNewObject();
-        // if we were from a watch then we were delayed by the debounce time...
-        if (data) {
-          JsVarInt delay = jsvGetIntegerAndUnLock(jsvObjectGetChild(watchPtr, "debounce", 0));
-          // Create the 'time' variable that will be passed to the user
-          JsVar *timePtr = jsvNewFromFloat(jshGetMillisecondsFromTime(jsiLastIdleTime+timeUntilNext-delay)/1000);
-          // if it was a watch, set the last state up
-          bool state = jsvGetBoolAndUnLock(jsvObjectSetChild(data, "state", jsvObjectGetChild(watchPtr, "state", 0)));
-          exec = jsiShouldExecuteWatch(watchPtr, state);
-          // set up the lastTime variable of data to what was in the watch
-          jsvObjectSetChildAndUnLock(data, "lastTime", jsvObjectGetChild(watchPtr, "lastTime", 0));
-          // set up the watches lastTime to this one
-          jsvObjectSetChild(watchPtr, "lastTime", timePtr); // don't unlock
-          jsvObjectSetChildAndUnLock(data, "time", timePtr);
-        }
-      }
-      JsVar *interval = jsvObjectGetChild(timerPtr, "interval", 0);
-      if (exec) {
-        bool execResult;
-        if (data) {
-          execResult = jsiExecuteEventCallback(0, timerCallback, 1, &data);
-        } else {
-          JsVar *argsArray = jsvObjectGetChild(timerPtr, "args", 0);
-          execResult = jsiExecuteEventCallbackArgsArray(0, timerCallback, argsArray);
-          jsvUnLock(argsArray);
-        }
-        if (!execResult && interval) {
-          jsError("Ctrl-C while processing interval - removing it.");
-          jsErrorFlags |= JSERR_CALLBACK;
-          // by setting interval to 0, we now think we've for a Timeout,
-          // which will get removed.
-          jsvUnLock(interval);
-          interval = 0;
+  /* Timer times are absolute, so nothing needs updating on each idle - and
+   * unless something has changed or the earliest timer is due we don't
+   * even have to look at the timers. A timer is 'due' at its time plus
+   * its slack, but when we do look, everything past its time gets run -
+   * so timers with slack get batched up into one wakeup. */
+  if (time >= jsiNextTimerTime) {
+    JSTRACE(JST_TIMERS_BEGIN, 0);
+    JsSysTime nextTimerTime = JSSYSTIME_MAX;
+    jsiStatus = jsiStatus & ~JSIS_TIMERS_CHANGED;
+    JsVar *timerArrayPtr = jsvLock(timerArray);
+    JsvObjectIterator it;
+    jsvObjectIteratorNew(&it, timerArrayPtr);
+    while (jsvObjectIteratorHasValue(&it) && !(jsiStatus & JSIS_TIMERS_CHANGED)) {
+      bool hasDeletedTimer = false;
+      JsVar *timerPtr = jsvObjectIteratorGetValue(&it);
+      JsiTimerData timerData;
+      jsiTimerGetData(timerPtr, &timerData);
+      JsSysTime timerTime = timerData.time;
+
+      if (timerTime<=time) {
+        // we're now doing work
+        jsiSetBusy(BUSY_INTERACTIVE, true);
+        wasBusy = true;
+        JsVar *timerCallback = jsvObjectGetChild(timerPtr, "callback", 0);
+        JsVar *watchPtr = jsvObjectGetChild(timerPtr, "watch", 0); // for debounce - may be undefined
+        bool exec = true;
+        JsVar *data = 0;
+        if (watchPtr) {
+          data = jsvNewObject();
+          // if we were from a watch then we were delayed by the debounce time...
+          if (data) {
+            JsVarInt delay = jsvGetIntegerAndUnLock(jsvObjectGetChild(watchPtr, "debounce", 0));
+            // Create the 'time' variable that will be passed to the user
+            JsVar *timePtr = jsiNewWatchTime(watchPtr, timerTime-delay);
+            // if it was a watch, set the last state up
+            bool state = jsvGetBoolAndUnLock(jsvObjectSetChild(data, "state", jsvObjectGetChild(watchPtr, "state", 0)));
+            exec = jsiShouldExecuteWatch(watchPtr, state);
+            // set up the lastTime variable of data to what was in the watch
+            jsvObjectSetChildAndUnLock(data, "lastTime", jsvObjectGetChild(watchPtr, "lastTime", 0));
+            // set up the watches lastTime to this one
+            jsvObjectSetChild(watchPtr, "lastTime", timePtr); // don't unlock
+            jsvObjectSetChildAndUnLock(data, "time", timePtr);
+          }
         }
-      }
-      jsvUnLock(data);
-      if (watchPtr) { // if we had a watch pointer, be sure to remove us from it
-        jsvObjectSetChild(watchPtr, "timeout", 0);
-        // Deal with non-recurring watches
+        bool interval = timerData.interval!=0;
         if (exec) {
-          bool watchRecurring = jsvGetBoolAndUnLock(jsvObjectGetChild(watchPtr,  "recur", 0));
-          if (!watchRecurring) {
-            JsVar *watchArrayPtr = jsvLock(watchArray);
-            JsVar *watchNamePtr = jsvGetArrayIndexOf(watchArrayPtr, watchPtr, true);
-            if (watchNamePtr) {
-              jsvRemoveChild(watchArrayPtr, watchNamePtr);
-              jsvUnLock(watchNamePtr);
+          bool execResult;
+#ifndef SAVE_ON_FLASH
+          JsSysTime startTime = jshGetSystemTime();
+#endif
+          JSTRACE(JST_TIMER_BEGIN, watchPtr!=0);
+          if (data) {
+            execResult = jsiExecuteEventCallback(0, timerCallback, 1, &data);
+          } else {
+            JsVar *argsArray = jsvObjectGetChild(timerPtr, "args", 0);
+            execResult = jsiExecuteEventCallbackArgsArray(0, timerCallback, argsArray);
+            jsvUnLock(argsArray);
+          }
+          JSTRACE(JST_TIMER_END, 0);
+#ifndef SAVE_ON_FLASH
+          jsiTaskStatsRecord(watchPtr ? JSI_TASK_WATCH : JSI_TASK_TIMER, timerCallback, startTime);
+#endif
+          if (!execResult && interval) {
+            jsError("Ctrl-C while processing interval - removing it.");
+            jsErrorFlags |= JSERR_CALLBACK;
+            // by clearing interval, we now think we've got a Timeout,
+            // which will get removed.
+            interval = false;
+          }
+          jsiExecuteMicrotasks();
+        }
+        jsvUnLock(data);
+        if (watchPtr) { // if we had a watch pointer, be sure to remove us from it
+          jsvObjectSetChild(watchPtr, "timeout", 0);
+          // Deal with non-recurring watches
+          if (exec) {
+            bool watchRecurring = jsvGetBoolAndUnLock(jsvObjectGetChild(watchPtr,  "recur", 0));
+            if (!watchRecurring) {
+              jsiWatchIRQStop(watchPtr);
+              JsVar *watchArrayPtr = jsvLock(watchArray);
+              JsVar *watchNamePtr = jsvGetArrayIndexOf(watchArrayPtr, watchPtr, true);
+              if (watchNamePtr) {
+                jsvRemoveChild(watchArrayPtr, watchNamePtr);
+                jsvUnLock(watchNamePtr);
+              }
+              jsvUnLock(watchArrayPtr);
+              Pin pin = jshGetPinFromVarAndUnLock(jsvObjectGetChild(watchPtr, "pin", 0));
+              if (!jsiIsWatchingPin(pin))
+                jshPinWatch(pin, false);
             }
-            jsvUnLock(watchArrayPtr);
-            Pin pin = jshGetPinFromVarAndUnLock(jsvObjectGetChild(watchPtr, "pin", 0));
-            if (!jsiIsWatchingPin(pin))
-              jshPinWatch(pin, false);
           }
+          jsvUnLock(watchPtr);
         }
-        jsvUnLock(watchPtr);
-      }
 
-      if (interval) {
-        timeUntilNext = timeUntilNext + jsvGetLongIntegerAndUnLock(interval);
-      } else {
-        // free
-        // Beware... may have already been removed!
-        jsvObjectIteratorRemoveAndGotoNext(&it, timerArrayPtr);
-        hasDeletedTimer = true;
-        timeUntilNext = -1;
+        if (interval) {
+          /* Re-read in case the callback called changeInterval, then move
+           * the time on from when we were *meant* to run */
+          jsiTimerGetData(timerPtr, &timerData);
+          if (timerData.time == timerTime)
+            timerData.time += timerData.interval;
+          timerTime = timerData.time;
+          jsiTimerSetData(timerPtr, &timerData);
+        } else {
+          // free
+          // Beware... may have already been removed!
+          jsvObjectIteratorRemoveAndGotoNext(&it, timerArrayPtr);
+          hasDeletedTimer = true;
+        }
+        jsvUnLock(timerCallback);
       }
-      jsvUnLock(timerCallback);
-
-    }
-    // update the time until the next timer
-    if (timeUntilNext>=0 && timeUntilNext < minTimeUntilNext)
-      minTimeUntilNext = timeUntilNext;
-    // update the timer's time
-    if (!hasDeletedTimer) {
-      jsvObjectSetChildAndUnLock(timerPtr, "time", jsvNewFromLongInteger(timeUntilNext));
-      jsvObjectIteratorNext(&it);
+      if (!hasDeletedTimer) {
+        // remember the earliest time any timer needs to run
+        if (timerTime + timerData.slack < nextTimerTime)
+          nextTimerTime = timerTime + timerData.slack;
+        jsvObjectIteratorNext(&it);
+      }
+      jsvUnLock(timerPtr);
     }
-    jsvUnLock(timerPtr);
+    jsvObjectIteratorFree(&it);
+    jsvUnLock(timerArrayPtr);
+    // If the timers changed while we were executing, jsiNextTimerTime has been reset so we scan again
+    if (!(jsiStatus & JSIS_TIMERS_CHANGED))
+      jsiNextTimerTime = nextTimerTime;
+    JSTRACE(JST_TIMERS_END, 0);
   }
-  jsvObjectIteratorFree(&it);
-  jsvUnLock(timerArrayPtr);
+  JsSysTime minTimeUntilNext = JSSYSTIME_MAX;
+  if (jsiNextTimerTime != JSSYSTIME_MAX)
+    minTimeUntilNext = (jsiNextTimerTime > time) ? (jsiNextTimerTime - time) : 0;
+  if (debounceTimeUntilNext < minTimeUntilNext)
+    minTimeUntilNext = debounceTimeUntilNext;
   /* We might have left the timers loop with stuff to do because the contents of it
    * changed. It's not a big deal because it could only have changed because a timer
    * got executed - so `wasBusy` got set and we know we're going to go around the
@@ -1928,10 +2546,12 @@ void jsiIdle() {
    */
 
   // Check for events that might need to be processed from other libraries
+  JSTRACE(JST_LIBIDLE_BEGIN, 0);
   if (jswIdle()) wasBusy = true;
+  JSTRACE(JST_LIBIDLE_END, 0);
 
   // Just in case we got any events to do and didn't clear loopsIdling before
-  if (wasBusy || !jsvArrayIsEmpty(events) )
+  if (wasBusy || events.used || microtasks.used)
     loopsIdling = 0;
 
   if (wasBusy)
@@ -1939,7 +2559,13 @@ void jsiIdle() {
 
   // execute any outstanding events
   if (!jspIsInterrupted()) {
+#ifndef SAVE_ON_FLASH
+    if (jsvLowMemoryState!=JSV_LOWMEM_ARMED)
+      jsiHandleLowMemory();
+#endif
+    JSTRACE(JST_EVENTS_BEGIN, 0);
     jsiExecuteEvents();
+    JSTRACE(JST_EVENTS_END, 0);
   }
   if (interruptedDuringEvent) {
     jspSetInterrupted(false);
@@ -1992,6 +2618,22 @@ void jsiIdle() {
   /* if we've been around this loop, there is nothing to do, and
    * we have a spare 10ms then let's do some Garbage Collection
    * if we think we need to */
+#ifndef SAVE_ON_FLASH
+  /* If incremental GC is enabled (E.setGCMode) just do a small slice of
+   * it each time around the loop, so we never stall for long. We start
+   * earlier than normal, as we need time to finish before memory runs out */
+  bool gcInProgress = false;
+  if (jsvGCIncremental) {
+    // finish freeing anything big that was released
+    gcInProgress = jsvFreeQueueDrain(jsvGCSliceTime);
+    if (!gcInProgress && (jsvIsGarbageCollectingIncrementally() ||
+        !jsvMoreFreeVariablesThan(jsvGetMemoryTotal()/8))) {
+      jsiSetBusy(BUSY_INTERACTIVE, true);
+      gcInProgress = jsvGarbageCollectIncremental(jsvGCSliceTime);
+      jsiSetBusy(BUSY_INTERACTIVE, false);
+    }
+  } else
+#endif
   if (loopsIdling==1 &&
       minTimeUntilNext > jshGetTimeFromMilliseconds(10) &&
       !jsvMoreFreeVariablesThan(JS_VARS_BEFORE_IDLE_GC)) {
@@ -2004,8 +2646,12 @@ void jsiIdle() {
   if (jsiStatus & JSIS_WATCHDOG_AUTO)
     jshKickWatchDog();
 
+  JSTRACE(JST_IDLE_END, 0);
   // Go to sleep!
   if (loopsIdling>1 && // once around the idle loop without having done any work already (just in case)
+#ifndef SAVE_ON_FLASH
+      !gcInProgress && // don't sleep before the GC has finished
+#endif
 #ifdef USB
       !jshIsUSBSERIALConnected() && // if USB is on, no point sleeping (later, sleep might be more drastic)
 #endif
@@ -2107,11 +2753,12 @@ void jsiDumpState(vcbprintf_callback user_callback, void *user_data) {
   while (jsvObjectIteratorHasValue(&it)) {
     JsVar *timer = jsvObjectIteratorGetValue(&it);
     JsVar *timerCallback = jsvSkipOneNameAndUnLock(jsvFindChildFromString(timer, "callback", false));
-    JsVar *timerInterval = jsvObjectGetChild(timer, "interval", 0);
-    user_callback(timerInterval ? "setInterval(" : "setTimeout(", user_data);
+    JsiTimerData timerData;
+    jsiTimerGetData(timer, &timerData);
+    user_callback(timerData.interval ? "setInterval(" : "setTimeout(", user_data);
     jsiDumpJSON(user_callback, user_data, timerCallback, 0);
-    cbprintf(user_callback, user_data, ", %f);\n", jshGetMillisecondsFromTime(timerInterval ? jsvGetLongInteger(timerInterval) : jsvGetLongIntegerAndUnLock(jsvObjectGetChild(timer, "time", 0))));
-    jsvUnLock2(timerInterval, timerCallback);
+    cbprintf(user_callback, user_data, ", %f);\n", jshGetMillisecondsFromTime(timerData.interval ? timerData.interval : (timerData.time - jsiLastIdleTime)));
+    jsvUnLock(timerCallback);
     // next
     jsvUnLock(timer);
     jsvObjectIteratorNext(&it);
@@ -2128,6 +2775,7 @@ void jsiDumpState(vcbprintf_callback user_callback, void *user_data) {
     int watchEdge = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(watch, "edge", 0));
     JsVar *watchPin = jsvObjectGetChild(watch, "pin", 0);
     JsVarInt watchDebounce = jsvGetIntegerAndUnLock(jsvObjectGetChild(watch, "debounce", 0));
+    JsVar *watchBuffer = jsvObjectGetChild(watch, "buffer", 0);
     user_callback("setWatch(", user_data);
     jsiDumpJSON(user_callback, user_data, watchCallback, 0);
     cbprintf(user_callback, user_data, ", %j, { repeat:%s, edge:'%s'",
@@ -2136,6 +2784,32 @@ void jsiDumpState(vcbprintf_callback user_callback, void *user_data) {
             (watchEdge<0)?"falling":((watchEdge>0)?"rising":"both"));
     if (watchDebounce>0)
       cbprintf(user_callback, user_data, ", debounce : %f", jshGetMillisecondsFromTime(watchDebounce));
+    if (watchBuffer)
+      cbprintf(user_callback, user_data, ", buffer : %d", ((JshEventBuffer*)jsvGetFlatStringPointer(watchBuffer))->size - 1);
+    jsvUnLock(watchBuffer);
+    if (jsvGetBoolAndUnLock(jsvObjectGetChild(watch, "ticks", 0)))
+      user_callback(", ticks : true", user_data);
+    JsVar *watchAction = jsvObjectGetChild(watch, "action", 0);
+    if (watchAction) {
+      JshEventAction *action = (JshEventAction*)jsvGetFlatStringPointer(watchAction);
+      user_callback(", irq : {", user_data);
+      const char *sep = " ";
+      if (action->outPin != PIN_UNDEFINED) {
+        cbprintf(user_callback, user_data, "%s%s : %p", sep, action->outToggle?"toggle":"write", action->outPin);
+        sep = ", ";
+      }
+      JsVar *watchCount = jsvObjectGetChild(watch, "count", 0);
+      if (watchCount) {
+        cbprintf(user_callback, user_data, "%scount : ", sep);
+        jsiDumpJSON(user_callback, user_data, watchCount, 0);
+        sep = ", ";
+      }
+      jsvUnLock(watchCount);
+      if (action->dirPin != PIN_UNDEFINED)
+        cbprintf(user_callback, user_data, "%sdir : %p", sep, action->dirPin);
+      user_callback(" }", user_data);
+    }
+    jsvUnLock(watchAction);
     user_callback(" });\n", user_data);
     jsvUnLock2(watchPin, watchCallback);
     // next
@@ -2148,6 +2822,41 @@ void jsiDumpState(vcbprintf_callback user_callback, void *user_data) {
   jsiDumpHardwareInitialisation(user_callback, user_data, true);
 }
 
+JsVar *jsiTimerNew(JsSysTime time, JsSysTime interval, JsSysTime slack, JsVar *callback) {
+  JsVar *timerPtr = jsvNewObject();
+  if (!timerPtr) return 0;
+  JsVar *dataVar = jsvNewFlatStringOfLength(sizeof(JsiTimerData));
+  if (!dataVar) {
+    jsvUnLock(timerPtr);
+    return 0;
+  }
+  jsvObjectSetChildAndUnLock(timerPtr, JSI_TIMER_DATA_NAME, dataVar);
+  JsiTimerData data;
+  data.time = time;
+  data.interval = interval;
+  data.slack = slack;
+  jsiTimerSetData(timerPtr, &data);
+  jsvObjectSetChild(timerPtr, "callback", callback); // intentionally no unlock
+  return timerPtr;
+}
+
+bool jsiTimerGetData(JsVar *timerPtr, JsiTimerData *data) {
+  JsVar *dataVar = jsvObjectGetChild(timerPtr, JSI_TIMER_DATA_NAME, 0);
+  bool ok = jsvIsFlatString(dataVar);
+  // copy out, as the flat string's data may not be aligned for 64 bit access
+  if (ok) memcpy(data, jsvGetFlatStringPointer(dataVar), sizeof(JsiTimerData));
+  else memset(data, 0, sizeof(JsiTimerData));
+  jsvUnLock(dataVar);
+  return ok;
+}
+
+void jsiTimerSetData(JsVar *timerPtr, const JsiTimerData *data) {
+  JsVar *dataVar = jsvObjectGetChild(timerPtr, JSI_TIMER_DATA_NAME, 0);
+  if (jsvIsFlatString(dataVar))
+    memcpy(jsvGetFlatStringPointer(dataVar), data, sizeof(JsiTimerData));
+  jsvUnLock(dataVar);
+}
+
 JsVarInt jsiTimerAdd(JsVar *timerPtr) {
   JsVar *timerArrayPtr = jsvLock(timerArray);
   JsVarInt itemIndex = jsvArrayAddToEnd(timerArrayPtr, timerPtr, 1) - 1;
@@ -2157,6 +2866,37 @@ JsVarInt jsiTimerAdd(JsVar *timerPtr) {
 
 void jsiTimersChanged() {
   jsiStatus |= JSIS_TIMERS_CHANGED;
+  jsiNextTimerTime = 0; // force the timers to be checked on the next idle
+}
+
+void jsiTimersShift(JsSysTime diff) {
+  if (!timerArray) return;
+  JsVar *timerArrayPtr = jsvLock(timerArray);
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, timerArrayPtr);
+  while (jsvObjectIteratorHasValue(&it)) {
+    JsVar *timerPtr = jsvObjectIteratorGetValue(&it);
+    JsiTimerData timerData;
+    if (jsiTimerGetData(timerPtr, &timerData)) {
+      timerData.time += diff;
+      jsiTimerSetData(timerPtr, &timerData);
+    }
+    jsvUnLock(timerPtr);
+    jsvObjectIteratorNext(&it);
+  }
+  jsvObjectIteratorFree(&it);
+  jsvUnLock(timerArrayPtr);
+  jsiTimersChanged();
+}
+
+JsVarInt jsiGetTicksFromTime(JsSysTime time) {
+  static JsSysTime timeForSecond = 0;
+  if (!timeForSecond) timeForSecond = jshGetTimeFromMilliseconds(1000);
+  // Linux and ESP8266 already count in microseconds. Otherwise split the
+  // division up so we don't overflow (and don't need floating point)
+  if (timeForSecond != 1000000)
+    time = (time / timeForSecond)*1000000 + ((time % timeForSecond)*1000000) / timeForSecond;
+  return (JsVarInt)(uint32_t)time;
 }
 
 #ifdef USE_DEBUGGER
@@ -2225,7 +2965,8 @@ void jsiDebuggerPrintScope(JsVar *scope) {
     JsVar *v = jsvObjectIteratorGetValue(&it);
     size_t l = jsvGetStringLength(ks);
 
-    if (!jsvIsStringEqual(ks, JSPARSE_RETURN_VAR)) {
+    if (!jsvIsStringEqual(ks, JSPARSE_RETURN_VAR) &&
+        !jsvIsStringEqual(ks, JSPARSE_FUNCTION_SCOPE_PARENT_NAME)) {
       found = true;
       jsiConsolePrintChar(' ');
       if (jsvIsFunctionParameter(k)) {
@@ -22,6 +22,7 @@
 #define JSI_HISTORY_NAME "history"
 #define JSI_INIT_CODE_NAME "init"
 #define JSI_ONINIT_NAME "onInit"
+#define JSI_TIMER_DATA_NAME JS_HIDDEN_CHAR_STR"tmr" // flat string containing a timer's JsiTimerData
 
 /// autoLoad = do we load the current state if it exists?
 void jsiInit(bool autoLoad);
@@ -41,9 +42,18 @@ bool jsiFreeMoreMemory();
 
 bool jsiHasTimers(); // are there timers still left to run?
 bool jsiIsWatchingPin(Pin pin); // are there any watches for the given pin?
+void jsiWatchIRQStart(JsVar *watchPtr, IOEventFlags exti); // if the watch has `buffer` or an `irq` action set, start recording edges/acting on exti
+void jsiWatchIRQStop(JsVar *watchPtr); // stop a watch with `buffer` or an `irq` action from using the IRQ - call before removing the watch
+void jsiWatchStopIRQDebounce(Pin pin); // another watch is being added to this pin, so stop debouncing watches on it in the IRQ (they fall back to timers)
 
+/// Call the callback for each reference held by the event and microtask queues (so GC and defrag can find/update them)
+void jsiEventsForEachRef(void (*callback)(JsVarRef *ref));
 /// Queue a function, string, or array (of funcs/strings) to be executed next time around the idle loop
 void jsiQueueEvents(JsVar *object, JsVar *callback, JsVar **args, int argCount);
+/// Queue a function to be executed as soon as the current event, timer or watch callback has finished (before any other events)
+void jsiQueueMicrotask(JsVar *object, JsVar *callback, JsVar **args, int argCount);
+/// Execute everything in the microtask queue (including microtasks queued while doing so)
+void jsiExecuteMicrotasks();
 /// Return true if the object has callbacks...
 bool jsiObjectHasCallbacks(JsVar *object, const char *callbackName);
 /// Queue up callbacks for other things (touchscreen? network?)
@@ -105,6 +115,8 @@ typedef enum {
 } JsiBusyDevice;
 /// Shows a busy indicator, if one is set up
 void jsiSetBusy(JsiBusyDevice device, bool isBusy);
+/// Return which devices are busy or have been busy since the last call (eg. for a CPU frequency governor)
+JsiBusyDevice jsiGetBusy();
 
 /// Flags for jsiSetSleep
 typedef enum {
@@ -139,24 +151,61 @@ typedef enum {
   JSIS_TODO_MASK = JSIS_TODO_FLASH_SAVE|JSIS_TODO_FLASH_LOAD|JSIS_TODO_RESET,
   JSIS_CONSOLE_FORCED = 512, // see jsiSetConsoleDevice
   JSIS_WATCHDOG_AUTO = 1024, // Automatically kick the watchdog timer on idle
+  JSIS_CONSOLE_NONBLOCKING = 2048, // Drop console output rather than waiting when the transmit buffer is full (see E.setConsoleBlocking)
 
   JSIS_ECHO_OFF_MASK = JSIS_ECHO_OFF|JSIS_ECHO_OFF_FOR_LINE
 } PACKED_FLAGS JsiStatus;
 
-extern JsiStatus jsiStatus;
+extern INSTANCE_LOCAL JsiStatus jsiStatus;
 bool jsiEcho();
 
-extern Pin pinBusyIndicator;
-extern Pin pinSleepIndicator;
-extern JsSysTime jsiLastIdleTime; ///< The last time we went around the idle loop - use this for timers
+extern INSTANCE_LOCAL Pin pinBusyIndicator;
+extern INSTANCE_LOCAL Pin pinSleepIndicator;
+extern INSTANCE_LOCAL JsSysTime jsiLastIdleTime; ///< The last time we went around the idle loop - use this for timers
 
 void jsiDumpState(vcbprintf_callback user_callback, void *user_data);
-#define TIMER_MIN_INTERVAL 0.1 // in milliseconds
-extern JsVarRef timerArray; // Linked List of timers to check and run
-extern JsVarRef watchArray; // Linked List of input watches to check and run
-
+#define TIMER_MIN_INTERVAL ((JsVarFloat)0.1) // in milliseconds
+extern INSTANCE_LOCAL JsVarRef timerArray; // Linked List of timers to check and run
+extern INSTANCE_LOCAL JsVarRef watchArray; // Linked List of input watches to check and run
+
+/// Native part of a timer, stored in a flat string (JSI_TIMER_DATA_NAME) inside each timer object
+typedef struct {
+  JsSysTime time;     ///< Absolute time at which the timer should next run
+  JsSysTime interval; ///< Time between runs for an interval, or 0 for a timeout
+  JsSysTime slack;    ///< How late the timer may run, so it can share a wakeup with other timers
+} JsiTimerData;
+
+extern INSTANCE_LOCAL JsSysTime jsiTimerSlack; ///< Slack given to new timers created with setTimeout/setInterval
+extern JsVar *jsiTimerNew(JsSysTime time, JsSysTime interval, JsSysTime slack, JsVar *callback); // Create a timer object (not yet added)
+extern bool jsiTimerGetData(JsVar *timerPtr, JsiTimerData *data); // Read a timer's time/interval
+extern void jsiTimerSetData(JsVar *timerPtr, const JsiTimerData *data); // Write a timer's time/interval
 extern JsVarInt jsiTimerAdd(JsVar *timerPtr);
 extern void jsiTimersChanged(); // Flag timers changed so we can skip out of the loop if needed
+extern void jsiTimersShift(JsSysTime diff); // Add diff to the (absolute) time of every timer
+extern JsVarInt jsiGetTicksFromTime(JsSysTime time); // System time in microseconds, wrapped to 32 bits (see E.getTicks)
+
+#ifndef SAVE_ON_FLASH
+#define JSI_TASK_STATS 16 ///< How many different callbacks we record execution times for
+
+/// What caused a callback to be run from the idle loop
+typedef enum {
+  JSI_TASK_EVENT,
+  JSI_TASK_TIMER,
+  JSI_TASK_WATCH,
+} JsiTaskType;
+
+/// Execution times for one callback run from the idle loop (see E.getTaskStats)
+typedef struct {
+  JsVarRef callback; ///< The callback that was executed (0 if unused)
+  unsigned char type; ///< JsiTaskType
+  char name[12]; ///< The function's name, or where it was defined
+  unsigned int calls; ///< How many times it has been run
+  JsSysTime total; ///< The total time it has taken
+  JsSysTime max; ///< The longest it has taken in one go
+} JsiTaskStats;
+extern INSTANCE_LOCAL JsiTaskStats jsiTaskStats[JSI_TASK_STATS];
+extern INSTANCE_LOCAL JsSysTime jsiTaskBudget; ///< Warn when a callback takes longer than this (0 = never)
+#endif
 // end for jswrap_interactive/io.c ------------------------------------------------
 
 #ifdef USE_DEBUGGER
@@ -13,7 +13,7 @@
  */
 #include "jslex.h"
 
-JsLex *lex;
+INSTANCE_LOCAL JsLex *lex;
 
 JsLex *jslSetLex(JsLex *l) {
   JsLex *old = lex;
@@ -38,7 +38,7 @@ static ALWAYS_INLINE char jslNextCh() {
 }
 
 /// Move on to the next character
-static void NO_INLINE jslGetNextCh() {
+static void NO_INLINE HOT_PATH jslGetNextCh() {
   lex->currCh = jslNextCh();
 
   /** NOTE: In this next bit, we DON'T LOCK OR UNLOCK.
@@ -62,6 +62,61 @@ static void NO_INLINE jslGetNextCh() {
   }
 }
 
+#ifndef SAVE_ON_FLASH
+/** Move on to the next character. Most of the time the next character is in the
+ * same block of the string (and for flat and native strings, like code run from
+ * flash, it always is), so we just increment and only call jslGetNextCh when
+ * we need to go to the next block */
+static ALWAYS_INLINE void jslGetNextChInline() {
+  if (lex->it.charIdx+1 < lex->it.charsInVar) {
+    lex->currCh = (char)READ_FLASH_UINT8(&lex->it.ptr[lex->it.charIdx++]);
+  } else
+    jslGetNextCh();
+}
+
+/// Flags for each (ASCII) character, so we can check them with a single lookup
+typedef enum {
+  JSLCF_ID = 1, ///< can be part of an identifier
+  JSLCF_NUMERIC = 2, ///< 0-9
+  JSLCF_HEX = 4, ///< 0-9, a-f, A-F
+  JSLCF_WHITESPACE = 8, ///< see isWhitespace
+} PACKED_FLAGS JslCharFlags;
+
+#define _ID JSLCF_ID
+#define _NU (JSLCF_ID|JSLCF_NUMERIC|JSLCF_HEX)
+#define _HX (JSLCF_ID|JSLCF_HEX)
+#define _WS JSLCF_WHITESPACE
+static const JslCharFlags jslCharFlags[128] = {
+  0,  0,  0,  0,  0,  0,  0,  0,  0,  _WS,_WS,_WS,_WS,_WS,0,  0,   // 0x00: tab, \n, vtab, form feed, \r
+  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,   // 0x10
+  _WS,0,  0,  0,  _ID,0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,   // 0x20: space, $
+  _NU,_NU,_NU,_NU,_NU,_NU,_NU,_NU,_NU,_NU,0,  0,  0,  0,  0,  0,   // 0x30: 0-9
+  0,  _HX,_HX,_HX,_HX,_HX,_HX,_ID,_ID,_ID,_ID,_ID,_ID,_ID,_ID,_ID, // 0x40: A-O
+  _ID,_ID,_ID,_ID,_ID,_ID,_ID,_ID,_ID,_ID,_ID,0,  0,  0,  0,  _ID, // 0x50: P-Z, _
+  0,  _HX,_HX,_HX,_HX,_HX,_HX,_ID,_ID,_ID,_ID,_ID,_ID,_ID,_ID,_ID, // 0x60: a-o
+  _ID,_ID,_ID,_ID,_ID,_ID,_ID,_ID,_ID,_ID,_ID,0,  0,  0,  0,  0,   // 0x70: p-z
+};
+#undef _ID
+#undef _NU
+#undef _HX
+#undef _WS
+
+/// Does the given character have any of the given flags?
+static ALWAYS_INLINE bool jslCharIs(char ch, JslCharFlags flags) {
+  return ((unsigned char)ch)<128 && (jslCharFlags[(unsigned char)ch] & flags);
+}
+#define jslIsIDChar(ch) jslCharIs(ch, JSLCF_ID)
+#define jslIsNumeric(ch) jslCharIs(ch, JSLCF_NUMERIC)
+#define jslIsHexadecimal(ch) jslCharIs(ch, JSLCF_HEX)
+#define jslIsWhitespace(ch) (jslCharIs(ch, JSLCF_WHITESPACE) || ((unsigned char)(ch))==0xA0)
+#else
+#define jslGetNextChInline jslGetNextCh
+#define jslIsIDChar(ch) (isAlpha(ch) || isNumeric(ch) || (ch)=='$')
+#define jslIsNumeric isNumeric
+#define jslIsHexadecimal isHexadecimal
+#define jslIsWhitespace isWhitespace
+#endif
+
 static ALWAYS_INLINE void jslTokenAppendChar(char ch) {
   /* Add character to buffer but check it isn't too big.
    * Also Leave ONE character at the end for null termination */
@@ -210,23 +265,71 @@ static ALWAYS_INLINE void jslSingleChar() {
   jslGetNextCh();
 }
 
-void jslGetNextToken() {
+#ifndef SAVE_ON_FLASH
+/// Can this token be the end of a value (so another value after it must be a new statement)?
+static bool jslIsValueEnd(int tk) {
+  return tk==LEX_ID || tk==LEX_INT || tk==LEX_FLOAT || tk==LEX_STR || tk==LEX_REGEX ||
+         tk==')' || tk==']' || tk=='}' || tk==LEX_PLUSPLUS || tk==LEX_MINUSMINUS ||
+         tk==LEX_R_TRUE || tk==LEX_R_FALSE || tk==LEX_R_NULL ||
+         tk==LEX_R_UNDEFINED || tk==LEX_R_THIS;
+}
+
+/// Lex a regular expression literal like /ab+c/g (we're on the first '/')
+static void jslLexRegex() {
+  lex->tokenValue = jsvNewFromEmptyString();
+  if (!lex->tokenValue) {
+    lex->tk = LEX_EOF;
+    return;
+  }
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, lex->tokenValue, 0);
+  bool inClass = false; // '/' doesn't end the pattern inside [...]
+  jslGetNextCh();
+  while (lex->currCh && lex->currCh!='\n' && (inClass || lex->currCh!='/')) {
+    if (lex->currCh=='\\') {
+      jsvStringIteratorAppend(&it, lex->currCh);
+      jslGetNextCh();
+      if (!lex->currCh || lex->currCh=='\n') break;
+    } else if (lex->currCh=='[') {
+      inClass = true;
+    } else if (lex->currCh==']') {
+      inClass = false;
+    }
+    jsvStringIteratorAppend(&it, lex->currCh);
+    jslGetNextCh();
+  }
+  jsvStringIteratorFree(&it);
+  if (lex->currCh!='/') {
+    lex->tk = LEX_UNFINISHED_STR;
+    return;
+  }
+  jslGetNextCh();
+  // flags
+  while (jslIsIDChar(lex->currCh)) {
+    jslTokenAppendChar(lex->currCh);
+    jslGetNextCh();
+  }
+  lex->tk = LEX_REGEX;
+}
+#endif
+
+void HOT_PATH jslGetNextToken() {
   jslGetNextToken_start:
   // Skip whitespace
-  while (isWhitespace(lex->currCh))
-    jslGetNextCh();
+  while (jslIsWhitespace(lex->currCh))
+    jslGetNextChInline();
   // Search for comments
   if (lex->currCh=='/') {
     // newline comments
     if (jslNextCh()=='/') {
-      while (lex->currCh && lex->currCh!='\n') jslGetNextCh();
+      while (lex->currCh && lex->currCh!='\n') jslGetNextChInline();
       jslGetNextCh();
       goto jslGetNextToken_start;
     }
     // block comments
     if (jslNextCh()=='*') {
       while (lex->currCh && !(lex->currCh=='*' && jslNextCh()=='/'))
-        jslGetNextCh();
+        jslGetNextChInline();
       if (!lex->currCh) {
         lex->tk = LEX_UNFINISHED_COMMENT;
         return; /* an unfinished multi-line comment. When in interactive console,
@@ -237,8 +340,12 @@ void jslGetNextToken() {
       goto jslGetNextToken_start;
     }
   }
+#ifndef SAVE_ON_FLASH
+  int lastTk = lex->tk; // to tell a regular expression from a divide
+#endif
   lex->tk = LEX_EOF;
   lex->tokenl = 0; // clear token string
+  lex->tokenSlot = 0;
   if (lex->tokenValue) {
     jsvUnLock(lex->tokenValue);
     lex->tokenValue = 0;
@@ -252,14 +359,36 @@ void jslGetNextToken() {
   // tokens
   if (((unsigned char)lex->currCh) < jslJumpTableStart ||
       ((unsigned char)lex->currCh) > jslJumpTableEnd) {
-    // if unhandled by the jump table, just pass it through as a single character
-    jslSingleChar();
+    if (((unsigned char)lex->currCh) >= LEX_TOKEN_START &&
+        ((unsigned char)lex->currCh) < LEX_TOKEN_END) {
+      // pre-tokenised operator or reserved word (see jslTokenise)
+      lex->tk = (short)(LEX_EQUAL + ((unsigned char)lex->currCh) - LEX_TOKEN_START);
+      if (lex->tk >= LEX_R_LIST_START) {
+        // reserved words can still be used as IDs (eg. `obj.default`)
+        jslTokenAsString(lex->tk, lex->token, JSLEX_MAX_TOKEN_LENGTH);
+        lex->tokenl = (unsigned char)strlen(lex->token);
+      }
+      jslGetNextCh();
+    } else if (((unsigned char)lex->currCh) == LEX_SLOT_CHAR) {
+      // pre-tokenised reference to a local variable (see jslTokenise)
+      jslGetNextCh();
+      lex->tokenSlot = (unsigned char)(((unsigned char)lex->currCh) - LEX_SLOT_BASE + 1);
+      jslGetNextCh();
+      while (jslIsIDChar(lex->currCh)) {
+        jslTokenAppendChar(lex->currCh);
+        jslGetNextChInline();
+      }
+      lex->tk = LEX_ID;
+    } else {
+      // if unhandled by the jump table, just pass it through as a single character
+      jslSingleChar();
+    }
   } else {
     switch(jslJumpTable[((unsigned char)lex->currCh) - jslJumpTableStart]) {
     case JSLJT_ID: {
-      while (isAlpha(lex->currCh) || isNumeric(lex->currCh) || lex->currCh=='$') {
+      while (jslIsIDChar(lex->currCh)) {
         jslTokenAppendChar(lex->currCh);
-        jslGetNextCh();
+        jslGetNextChInline();
       }
       lex->tk = LEX_ID;
       // We do fancy stuff here to reduce number of compares (hopefully GCC creates a jump table)
@@ -334,9 +463,9 @@ void jslGetNextToken() {
             }
           }
           lex->tk = LEX_INT;
-          while (isNumeric(lex->currCh) || (!canBeFloating && isHexadecimal(lex->currCh))) {
+          while (jslIsNumeric(lex->currCh) || (!canBeFloating && jslIsHexadecimal(lex->currCh))) {
             jslTokenAppendChar(lex->currCh);
-            jslGetNextCh();
+            jslGetNextChInline();
           }
           if (canBeFloating && lex->currCh=='.') {
             lex->tk = LEX_FLOAT;
@@ -346,9 +475,9 @@ void jslGetNextToken() {
         }
         // parse fractional part
         if (lex->tk == LEX_FLOAT) {
-          while (isNumeric(lex->currCh)) {
+          while (jslIsNumeric(lex->currCh)) {
             jslTokenAppendChar(lex->currCh);
-            jslGetNextCh();
+            jslGetNextChInline();
           }
         }
         // do fancy e-style floating point
@@ -482,7 +611,15 @@ void jslGetNextToken() {
         lex->tk = LEX_MULEQUAL;
         jslGetNextCh();
       } break;
-      case JSLJT_FORWARDSLASH: jslSingleChar();
+      case JSLJT_FORWARDSLASH:
+#ifndef SAVE_ON_FLASH
+      // after a value it's a divide, otherwise a regular expression
+      if (!jslIsValueEnd(lastTk)) {
+        jslLexRegex();
+        break;
+      }
+#endif
+      jslSingleChar();
       if (lex->currCh=='=') {
         lex->tk = LEX_DIVEQUAL;
         jslGetNextCh();
@@ -556,6 +693,10 @@ void jslInit(JsVar *var) {
   lex->tokenLastStart = 0;
   lex->tokenl = 0;
   lex->tokenValue = 0;
+  lex->tokenSlot = 0;
+  lex->slotCount = 0;
+  lex->slots = 0;
+  lex->sourceTokenised = false;
   lex->lineNumberOffset = 0;
   // set up iterator
   jsvStringIteratorNew(&lex->it, lex->sourceVar, 0);
@@ -583,6 +724,7 @@ void jslSeekTo(size_t seekToChar) {
   jsvUnLock(lex->it.var); // see jslGetNextCh
   lex->tokenStart.it.var = 0;
   lex->tokenStart.currCh = 0;
+  lex->tk = LEX_EOF; // so a '/' at the start is a regex, not a divide
   jslPreload();
 }
 
@@ -594,6 +736,7 @@ void jslSeekToP(JslCharPos *seekToChar) {
   lex->currCh = seekToChar->currCh;
   lex->tokenStart.it.var = 0;
   lex->tokenStart.currCh = 0;
+  lex->tk = LEX_EOF; // so a '/' at the start is a regex, not a divide
   jslGetNextToken();
 }
 
@@ -619,6 +762,7 @@ void jslTokenAsString(int token, char *str, size_t len) {
   case LEX_FLOAT : strncpy(str, "FLOAT", len); return;
   case LEX_STR : strncpy(str, "STRING", len); return;
   case LEX_UNFINISHED_STR : strncpy(str, "UNFINISHED STRING", len); return;
+  case LEX_REGEX : strncpy(str, "REGEX", len); return;
   }
   if (token>=LEX_EQUAL && token<LEX_R_LIST_END) {
     const char tokenNames[] =
@@ -653,7 +797,7 @@ void jslTokenAsString(int token, char *str, size_t len) {
         /*LEX_R_DO :       */ "do\0"
         /*LEX_R_WHILE :    */ "while\0"
         /*LEX_R_FOR :      */ "for\0"
-        /*LEX_R_BREAK :    */ "return\0"
+        /*LEX_R_BREAK :    */ "break\0"
         /*LEX_R_CONTINUE   */ "continue\0"
         /*LEX_R_FUNCTION   */ "function\0"
         /*LEX_R_RETURN     */ "return\0"
@@ -811,6 +955,241 @@ JsVar *jslNewFromLexer(JslCharPos *charFrom, size_t charTo) {
   return var;
 }
 
+#ifndef SAVE_ON_FLASH
+/// Return the index of the character just after the current token
+static size_t jslGetTokenEnd() {
+  return jsvStringIteratorGetIndex(&lex->it)-1;
+}
+
+/** Could this token merge with a preceding one of the same class if there
+ * was no whitespace between them? 0 if it can't merge. */
+static int jslGetTokenMergeClass(int tk) {
+  if (tk==LEX_ID || tk==LEX_INT || tk==LEX_FLOAT) return 1;
+  if (tk>0 && tk<LEX_ID && strchr("+-*/%&|^<>=!", tk)) return 2;
+  return 0;
+}
+
+/// Append characters from the lexer's source between the two indices
+static void jslTokeniseAppendSource(JsvStringIterator *dst, size_t start, size_t end) {
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, lex->sourceVar, start);
+  while (start++<end && jsvStringIteratorHasChar(&it)) {
+    jsvStringIteratorAppend(dst, jsvStringIteratorGetChar(&it));
+    jsvStringIteratorNext(&it);
+  }
+  jsvStringIteratorFree(&it);
+}
+
+/// Count the newlines in the lexer's source between the two indices
+static int jslTokeniseCountNewLines(size_t start, size_t end) {
+  int lines = 0;
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, lex->sourceVar, start);
+  while (start++<end && jsvStringIteratorHasChar(&it)) {
+    if (jsvStringIteratorGetChar(&it)=='\n') lines++;
+    jsvStringIteratorNext(&it);
+  }
+  jsvStringIteratorFree(&it);
+  return lines;
+}
+
+/// Skip over a function definition (when the current token is 'function')
+static void jslTokeniseSkipFunction() {
+  int depth = 0;
+  while (lex->tk!=LEX_EOF) {
+    if (lex->tk=='{') depth++;
+    else if (lex->tk=='}' && --depth==0) break;
+    jslGetNextToken();
+  }
+}
+
+/// Return the index of the current token's identifier in 'locals', or -1
+static int jslTokeniseFindLocal(JsVar *locals) {
+  int idx = 0;
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, locals);
+  while (jsvObjectIteratorHasValue(&it)) {
+    JsVar *name = jsvObjectIteratorGetValue(&it);
+    bool match = jsvIsStringEqual(name, jslGetTokenValueAsString());
+    jsvUnLock(name);
+    if (match) break;
+    idx++;
+    jsvObjectIteratorNext(&it);
+  }
+  if (!jsvObjectIteratorHasValue(&it)) idx = -1;
+  jsvObjectIteratorFree(&it);
+  return idx;
+}
+
+/** Add the names of all variables declared with 'var' in this code (but not
+ * in nested functions) to 'locals'. We err on the side of missing some out -
+ * they'll just be looked up by name */
+static void jslTokeniseFindVars(JsVar *locals) {
+  while (lex->tk!=LEX_EOF) {
+    if (lex->tk==LEX_R_FUNCTION) {
+      jslTokeniseSkipFunction();
+    } else if (lex->tk==LEX_R_VAR) {
+      // var a [= expr] [, b [= expr]] - stop at ';', 'in', or the end of the statement
+      jslGetNextToken();
+      bool expectName = true;
+      int depth = 0, lastTk = LEX_R_VAR;
+      while (lex->tk!=LEX_EOF) {
+        int tk = lex->tk;
+        if (expectName) {
+          if (tk!=LEX_ID) break;
+          if (jslTokeniseFindLocal(locals)<0 && jsvGetArrayLength(locals)<LEX_MAX_SLOTS)
+            jsvArrayPushAndUnLock(locals, jsvNewFromString(jslGetTokenValueAsString()));
+          expectName = false;
+        } else if (tk=='(' || tk=='[' || tk=='{') {
+          depth++;
+        } else if (tk==')' || tk==']' || tk=='}') {
+          if (depth==0) break;
+          depth--;
+        } else if (tk==LEX_R_FUNCTION) {
+          jslTokeniseSkipFunction();
+          tk = '}';
+        } else if (depth==0) {
+          if (tk==';' || tk==LEX_R_IN ||
+              (jslIsValueEnd(lastTk) && jslIsValueEnd(tk) && tk!=')' && tk!=']' && tk!='}'))
+            break; // end of statement (including without a semicolon)
+          if (tk==',') expectName = true;
+        }
+        lastTk = tk;
+        jslGetNextToken();
+      }
+      continue;
+    }
+    jslGetNextToken();
+  }
+}
+
+JsVar *jslTokenise(JsVar *code, JsVar *locals) {
+  JsVar *tokens = jsvNewFromEmptyString();
+  if (!tokens) return 0;
+  bool ok = true;
+  JsLex newLex;
+  JsLex *oldLex = jslSetLex(&newLex);
+  jslInit(code);
+  if (locals) {
+    jslTokeniseFindVars(locals);
+    jslReset();
+  }
+  JsvStringIterator dst;
+  jsvStringIteratorNew(&dst, tokens, 0);
+  int lastTk = LEX_EOF;
+  size_t lastEnd = 0;
+  while (lex->tk!=LEX_EOF) {
+    int tk = lex->tk;
+    if (tk==LEX_UNFINISHED_STR || tk==LEX_UNFINISHED_COMMENT ||
+        (jsErrorFlags&JSERR_MEMORY)) {
+      ok = false;
+      break;
+    }
+    size_t start = jsvStringIteratorGetIndex(&lex->tokenStart.it)-1;
+    // keep line breaks, so line numbers in errors and debug still match the source
+    int newLines = jslTokeniseCountNewLines(lastEnd, start);
+    if (newLines) lastTk = LEX_EOF; // a newline separates tokens as well as a space
+    while (newLines--) jsvStringIteratorAppend(&dst, '\n');
+    if (tk>=LEX_EQUAL && tk<LEX_R_LIST_END && (tk!=LEX_R_FUNCTION || !locals)) {
+      jsvStringIteratorAppend(&dst, (char)(LEX_TOKEN_START + tk - LEX_EQUAL));
+    } else {
+      int mergeClass = jslGetTokenMergeClass(tk==LEX_R_FUNCTION ? LEX_ID : tk);
+      if ((mergeClass && mergeClass==jslGetTokenMergeClass(lastTk)) ||
+          (lastTk==LEX_INT && tk=='.'))
+        jsvStringIteratorAppend(&dst, ' ');
+      if (tk==LEX_R_FUNCTION) {
+        /* Leave nested functions as source code when tagging locals - they
+         * have their own scope, so the slots would be wrong */
+        jslTokeniseSkipFunction();
+        tk = '}';
+      } else if (tk==LEX_ID && locals && lastTk!='.') {
+        int slot = jslTokeniseFindLocal(locals);
+        if (slot>=0) {
+          jsvStringIteratorAppend(&dst, (char)LEX_SLOT_CHAR);
+          jsvStringIteratorAppend(&dst, (char)(LEX_SLOT_BASE + slot));
+        }
+      }
+      jslTokeniseAppendSource(&dst, start, jslGetTokenEnd());
+    }
+    lastTk = tk;
+    lastEnd = jslGetTokenEnd();
+    jslGetNextToken();
+  }
+  jsvStringIteratorFree(&dst);
+  jslKill();
+  jslSetLex(oldLex);
+  if (!ok) {
+    jsvUnLock(tokens);
+    return 0;
+  }
+  return tokens;
+}
+
+/** Which class of character is this, for deciding if text either side of a
+ * token would merge into it and need a space in between (see jslGetTokenMergeClass) */
+static int jslGetCharMergeClass(char ch) {
+  if (isAlpha(ch) || isNumeric(ch) || ch=='$') return 1;
+  if (ch && strchr("+-*/%&|^<>=!", ch)) return 2;
+  return 0;
+}
+
+void jslPrintTokenisedString(JsVar *code, vcbprintf_callback user_callback, void *user_data) {
+  char buf[JSLEX_MAX_TOKEN_LENGTH];
+  char quote = 0; // if we're in a string, template or regex, the character that'll end it
+  bool inClass = false; // in a regex's [...], where '/' doesn't end it
+  bool valueEnd = false; // could the last thing be the end of a value? If not, '/' starts a regex (see jslGetNextToken)
+  int lastClass = 0; // merge class of the last character we output
+  bool lastWasToken = false; // was the last thing we output an expanded token?
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, code, 0);
+  while (jsvStringIteratorHasChar(&it)) {
+    char ch = jsvStringIteratorGetChar(&it);
+    unsigned char uch = (unsigned char)ch;
+    jsvStringIteratorNext(&it);
+    bool isToken = !quote && uch>=LEX_TOKEN_START && uch<LEX_TOKEN_END;
+    bool quoted = quote!=0; // characters in strings/regexes never merge with anything
+    if (isToken) {
+      int tk = LEX_EQUAL + uch - LEX_TOKEN_START;
+      jslTokenAsString(tk, buf, sizeof(buf));
+      valueEnd = jslIsValueEnd(tk);
+    } else if (!quote && uch==LEX_SLOT_CHAR) {
+      jsvStringIteratorNext(&it); // skip the slot index
+      continue;
+    } else {
+      if (quote) {
+        if (ch=='\\') { // escaped character
+          buf[0] = ch;
+          buf[1] = jsvStringIteratorGetChar(&it);
+          buf[2] = 0;
+          jsvStringIteratorNext(&it);
+          user_callback(buf, user_data);
+          continue;
+        }
+        if (quote=='/' && (ch=='[' || ch==']')) inClass = ch=='[';
+        else if (ch==quote && !inClass) {
+          quote = 0;
+          valueEnd = true;
+        }
+      } else if (ch=='"' || ch=='\'' || ch=='`' || (ch=='/' && !valueEnd)) {
+        quote = ch;
+      } else if (!jslIsWhitespace(ch) && ch!='.') { // '.' could be in a number or a member access
+        valueEnd = jslGetCharMergeClass(ch)==1 || ch==')' || ch==']' || ch=='}';
+      }
+      buf[0] = ch;
+      buf[1] = 0;
+    }
+    // source text was already spaced correctly, but tokens weren't
+    int cls = jslGetCharMergeClass(buf[0]);
+    if ((isToken || lastWasToken) && cls && cls==lastClass)
+      user_callback(" ", user_data);
+    user_callback(buf, user_data);
+    lastClass = (quote || quoted) ? 0 : jslGetCharMergeClass(buf[strlen(buf)-1]);
+    lastWasToken = isToken;
+  }
+  jsvStringIteratorFree(&it);
+}
+#endif
+
 /// Return the line number at the current character position (this isn't fast as it searches the string)
 unsigned int jslGetLineNumber() {
   size_t line;
@@ -849,14 +1228,30 @@ void jslPrintTokenLineMarker(vcbprintf_callback user_callback, void *user_data,
 
   // print the string until the end of the line, or 60 chars (whichever is lesS)
   int chars = 0;
+  size_t idx = startOfLine;
   JsvStringIterator it;
   jsvStringIteratorNew(&it, lex->sourceVar, startOfLine);
   while (jsvStringIteratorHasChar(&it) && chars<60) {
     char ch = jsvStringIteratorGetChar(&it);
     if (ch == '\n') break;
-    char buf[2];
+    char buf[JSLEX_MAX_TOKEN_LENGTH+1];
     buf[0] = ch;
     buf[1] = 0;
+    size_t rawChars = 1;
+    if (((unsigned char)ch) >= LEX_TOKEN_START && ((unsigned char)ch) < LEX_TOKEN_END) {
+      // pre-tokenised code (see jslTokenise) - print the token as text
+      int tk = LEX_EQUAL + ((unsigned char)ch) - LEX_TOKEN_START;
+      jslTokenAsString(tk, buf, JSLEX_MAX_TOKEN_LENGTH);
+      if (tk >= LEX_R_LIST_START) strcat(buf, " ");
+    } else if (((unsigned char)ch) == LEX_SLOT_CHAR) {
+      // followed by the slot index of a local variable - don't print either
+      buf[0] = 0;
+      rawChars = 2;
+      jsvStringIteratorNext(&it);
+    }
+    // keep the marker under the right character
+    if (idx < tokenPos) col = col + strlen(buf) - rawChars;
+    idx += rawChars;
     user_callback(buf, user_data);
     chars++;
     jsvStringIteratorNext(&it);
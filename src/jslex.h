@@ -26,6 +26,7 @@ typedef enum LEX_TYPES {
     LEX_STR,
     LEX_UNFINISHED_STR,
     LEX_UNFINISHED_COMMENT,
+    LEX_REGEX, ///< A regular expression literal - the pattern is in tokenValue, and the flags in token
 
     LEX_EQUAL,
     LEX_TYPEEQUAL,
@@ -86,6 +87,17 @@ typedef enum LEX_TYPES {
     LEX_R_LIST_END /* always the last entry */
 } LEX_TYPES;
 
+/** In pre-tokenised code (see jslTokenise), characters from LEX_TOKEN_START
+ * up to LEX_TOKEN_END are operators and reserved words, starting from LEX_EQUAL.
+ * This starts above 0xA0, which is treated as whitespace (no break space) */
+#define LEX_TOKEN_START 0xB0
+#define LEX_TOKEN_END (LEX_TOKEN_START + LEX_R_LIST_END - LEX_EQUAL)
+/** In pre-tokenised code, an identifier that is a local variable of the
+ * function is preceded by LEX_SLOT_CHAR and then (LEX_SLOT_BASE + index) */
+#define LEX_SLOT_CHAR LEX_TOKEN_END
+#define LEX_SLOT_BASE 0x80
+#define LEX_MAX_SLOTS 127
+
 typedef struct JslCharPos {
   JsvStringIterator it;
   char currCh;
@@ -105,6 +117,10 @@ typedef struct JsLex
   char token[JSLEX_MAX_TOKEN_LENGTH]; ///< Data contained in the token we have here
   JsVar *tokenValue; ///< JsVar containing the current token - used only for strings
   unsigned char tokenl; ///< the current length of token
+  unsigned char tokenSlot; ///< For LEX_ID in pre-tokenised code, 1 + the index in 'slots' of the local variable it refers to, or 0
+  unsigned char slotCount; ///< How many items in 'slots'
+  JsVarRef *slots; ///< Names of the function's local variables, for tokens with tokenSlot set (see jslTokenise)
+  bool sourceTokenised; ///< Was the code we're lexing pre-tokenised when its function was defined? (see E.setFlags)
 
   /** Amount we add to the line number when we're reporting to the user
    * 1-based, so 0 means NO LINE NUMBER KNOWN */
@@ -121,7 +137,7 @@ typedef struct JsLex
 } JsLex;
 
 // The lexer
-extern JsLex *lex;
+extern INSTANCE_LOCAL JsLex *lex;
 /// Set the lexer - return the old one
 JsLex *jslSetLex(JsLex *l);
 
@@ -145,6 +161,21 @@ void jslGetNextToken(); ///< Get the text token from our text string
 
 JsVar *jslNewFromLexer(JslCharPos *charFrom, size_t charTo); // Create a new STRING from part of the lexer
 
+/** Create a pre-tokenised copy of the given code, with whitespace and comments
+ * removed and operators/reserved words stored as single characters. Line
+ * breaks are kept so that line numbers still match the source. Returns 0 on
+ * failure.
+ *
+ * If 'locals' is an array (of the function's parameter names) then names
+ * declared with 'var' are added to it, and identifiers in it are tagged with
+ * their index so they can be found without a search (see JsLex.slots). Nested
+ * function definitions are then left as source. */
+JsVar *jslTokenise(JsVar *code, JsVar *locals);
+
+/** Print code that may have been pre-tokenised with jslTokenise, turning
+ * tokens back into text (and adding spaces wherever they are needed) */
+void jslPrintTokenisedString(JsVar *code, vcbprintf_callback user_callback, void *user_data);
+
 /// Return the line number at the current character position (this isn't fast as it searches the string)
 unsigned int jslGetLineNumber();
 
@@ -15,6 +15,7 @@
 #include "jsnative.h"
 #include "jshardware.h"
 #include "jsinteractive.h"
+#include <string.h> // memcpy
 
 // none of this is used at the moment
 
@@ -41,8 +42,20 @@
   #endif
 #endif
 
+/// The bits of a float return value (JsVarFloat may only be 32 bits - see USE_FLOATS)
+static uint64_t jsnFloatResult(JsVarFloat f) {
+  uint64_t r = 0;
+  memcpy(&r, &f, sizeof(f));
+  return r;
+}
+
 /** Call a function with the given argument specifiers */
 JsVar *jsnCallFunction(void *function, JsnArgumentType argumentSpecifier, JsVar *thisParam, JsVar **paramData, int paramCount) {
+#ifndef SAVE_ON_FLASH
+  JsVar *fastResult;
+  if (jswCallFunctionFast(function, argumentSpecifier, thisParam, paramData, paramCount, &fastResult))
+    return fastResult;
+#endif
   JsnArgumentType returnType = (JsnArgumentType)(argumentSpecifier&JSWAT_MASK);
   JsVar *argsArray = 0; // if JSWAT_ARGUMENT_ARRAY is ever used (note it'll only ever be used once)
   int paramNumber = 0; // how many parameters we have
@@ -78,7 +91,7 @@ JsVar *jsnCallFunction(void *function, JsnArgumentType argumentSpecifier, JsVar
     }
 #endif
 
-    if (argCount > MAX_ARGS - (JSWAT_IS_64BIT(argType)?2:1)) {
+    if (argCount > MAX_ARGS - ((JSWAT_IS_64BIT(argType) || argType==JSWAT_ARGUMENT_LIST)?2:1)) {
       // TODO: can we ever hit this because of JsnArgumentType's restrictions?
       jsError("INTERNAL: too many arguments for jsnCallFunction");
     }
@@ -102,6 +115,19 @@ JsVar *jsnCallFunction(void *function, JsnArgumentType argumentSpecifier, JsVar
       argData[argCount++] = (size_t)argsArray;
       break;
     }
+    case JSWAT_ARGUMENT_LIST: { // pointer and count of all subsequent arguments
+      int listCount = paramCount - (paramNumber-1);
+      argData[argCount++] = (size_t)(paramData + (paramNumber-1));
+#ifdef USE_ARG_REORDERING
+      if (!(argCount&1)) { // the count is a separate 32 bit argument
+        argCount += alignedLongsAfter*2;
+        alignedLongsAfter = 0;
+      }
+#endif
+      argData[argCount++] = (size_t)((listCount>0) ? listCount : 0);
+      paramNumber = paramCount;
+      break;
+    }
     case JSWAT_BOOL: // boolean
       argData[argCount++] = jsvGetBool(param);
       break;
@@ -115,6 +141,10 @@ JsVar *jsnCallFunction(void *function, JsnArgumentType argumentSpecifier, JsVar
       JsVarFloat f = jsvGetFloat(param);
 #ifdef USE_X86_CDECL
       doubleData[doubleCount++] = f;
+#elif defined(USE_FLOATS) // single precision fits in one register
+      uint32_t i;
+      memcpy(&i, &f, sizeof(i));
+      argData[argCount++] = (size_t)i;
 #else
       uint64_t i = *(uint64_t*)&f;
 #if USE_64BIT
@@ -157,7 +187,7 @@ JsVar *jsnCallFunction(void *function, JsnArgumentType argumentSpecifier, JsVar
       if (returnType==JSWAT_JSVARFLOAT) {
         // On x86, doubles are returned in a floating point unit register
         JsVarFloat f = ((JsVarFloat (*)(size_t,size_t,size_t,size_t,JsVarFloat,JsVarFloat,JsVarFloat,JsVarFloat))function)(argData[0],argData[1],argData[2],argData[3],doubleData[0],doubleData[1],doubleData[2],doubleData[3]);
-        result = *(uint64_t *)&f;
+        result = jsnFloatResult(f);
       } else {
         if (JSWAT_IS_64BIT(returnType))
           result = ((uint64_t (*)(size_t,size_t,size_t,size_t,JsVarFloat,JsVarFloat,JsVarFloat,JsVarFloat))function)(argData[0],argData[1],argData[2],argData[3],doubleData[0],doubleData[1],doubleData[2],doubleData[3]);
@@ -167,7 +197,7 @@ JsVar *jsnCallFunction(void *function, JsnArgumentType argumentSpecifier, JsVar
     } else if (returnType==JSWAT_JSVARFLOAT) {
       // On x86, doubles are returned in a floating point unit register
       JsVarFloat f = ((JsVarFloat (*)(size_t,size_t,size_t,size_t))function)(argData[0],argData[1],argData[2],argData[3]);
-      result = *(uint64_t*)&f;
+      result = jsnFloatResult(f);
     } else
 #endif
     {
@@ -175,7 +205,7 @@ JsVar *jsnCallFunction(void *function, JsnArgumentType argumentSpecifier, JsVar
 #ifdef USE_FLOAT_RETURN_FIX
         assert(returnType==JSWAT_JSVARFLOAT);
         JsVarFloat f = ((JsVarFloat (*)(size_t,size_t,size_t,size_t))function)(argData[0],argData[1],argData[2],argData[3]);
-        result = *(uint64_t*)&f;
+        result = jsnFloatResult(f);
 #else
         result = ((uint64_t (*)(size_t,size_t,size_t,size_t))function)(argData[0],argData[1],argData[2],argData[3]);
 #endif
@@ -188,7 +218,7 @@ JsVar *jsnCallFunction(void *function, JsnArgumentType argumentSpecifier, JsVar
     if (returnType==JSWAT_JSVARFLOAT) {
       // On x86, doubles are returned in a floating point unit register
       JsVarFloat f = ((JsVarFloat (*)(size_t,size_t,size_t,size_t,size_t,size_t,size_t,size_t,size_t,size_t,size_t,size_t))function)(argData[0],argData[1],argData[2],argData[3],argData[4],argData[5],argData[6],argData[7],argData[8],argData[9],argData[10],argData[11]);
-      result = *(uint64_t*)&f;
+      result = jsnFloatResult(f);
     } else
 #endif
     {
@@ -196,7 +226,7 @@ JsVar *jsnCallFunction(void *function, JsnArgumentType argumentSpecifier, JsVar
 #ifdef USE_FLOAT_RETURN_FIX
         assert(returnType==JSWAT_JSVARFLOAT);
         JsVarFloat f = ((JsVarFloat (*)(size_t,size_t,size_t,size_t,size_t,size_t,size_t,size_t,size_t,size_t,size_t,size_t))function)(argData[0],argData[1],argData[2],argData[3],argData[4],argData[5],argData[6],argData[7],argData[8],argData[9],argData[10],argData[11]);
-        result = *(uint64_t*)&f;
+        result = jsnFloatResult(f);
 #else
         result = ((uint64_t (*)(size_t,size_t,size_t,size_t,size_t,size_t,size_t,size_t,size_t,size_t,size_t,size_t))function)(argData[0],argData[1],argData[2],argData[3],argData[4],argData[5],argData[6],argData[7],argData[8],argData[9],argData[10],argData[11]);
 #endif
@@ -214,7 +244,8 @@ JsVar *jsnCallFunction(void *function, JsnArgumentType argumentSpecifier, JsVar
   case JSWAT_ARGUMENT_ARRAY: // a JsVar array containing all subsequent arguments
     return (JsVar*)(size_t)result;
   case JSWAT_BOOL: // boolean
-    return jsvNewFromBool(result!=0);
+    // only the bottom byte is defined on some ABIs (eg. x86-64)
+    return jsvNewFromBool((result&0xFF)!=0);
   case JSWAT_PIN:
     return jsvNewFromPin((Pin)result);
   case JSWAT_INT32: // 32 bit int
@@ -229,7 +260,7 @@ JsVar *jsnCallFunction(void *function, JsnArgumentType argumentSpecifier, JsVar
 
 // -----------------------------------------------------------------------------------------
 
-JsVarFloat sanity_pi() { return 3.141592; }
+JsVarFloat sanity_pi() { return (JsVarFloat)3.141592; }
 int32_t sanity_int_pass(int32_t hello) { return (hello*10)+5; }
 int32_t sanity_int_flt_int(int32_t a, JsVarFloat b, int32_t c) {
   return a + (int32_t)(b*100) + c*10000;
@@ -238,7 +269,7 @@ int32_t sanity_int_flt_int(int32_t a, JsVarFloat b, int32_t c) {
 /** Perform sanity tests to ensure that  jsnCallFunction is working as expected */
 void jsnSanityTest() {
   JsVar *args[4];
-  if (jsvGetFloatAndUnLock(jsnCallFunction(sanity_pi, JSWAT_JSVARFLOAT, 0, 0, 0)) != 3.141592)
+  if (jsvGetFloatAndUnLock(jsnCallFunction(sanity_pi, JSWAT_JSVARFLOAT, 0, 0, 0)) != (JsVarFloat)3.141592)
     jsiConsolePrint("WARNING: jsnative.c sanity check failed (returning double values)");
 
   args[0] = jsvNewFromInteger(1234);
@@ -27,6 +27,8 @@
   (N)==JSWAT_ARGUMENT_ARRAY || \
   (N)==JSWAT_JSVARFLOAT \
  )
+#elif defined(USE_FLOATS)
+#define JSWAT_IS_64BIT(N) (false)
 #else
 #define JSWAT_IS_64BIT(N) (\
   (N)==JSWAT_JSVARFLOAT \
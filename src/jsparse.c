@@ -19,10 +19,20 @@
 #include "jswrap_functions.h" // insane check for eval in jspeFunctionCall
 #include "jswrap_json.h" // for jsfPrintJSON
 #include "jswrap_espruino.h" // for jswrap_espruino_memoryArea
+#include "jswrap_regexp.h" // for jswrap_regexp_constructor
+#include "jstimer.h" // for jstExecuteFn
+#ifdef LINUX
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
 
 /* Info about execution when Parsing - this saves passing it on the stack
  * for each call */
-JsExecInfo execInfo;
+INSTANCE_LOCAL JsExecInfo execInfo;
+#ifndef SAVE_ON_FLASH
+INSTANCE_LOCAL bool jspPretokenise = false;
+#endif
 
 // ----------------------------------------------- Forward decls
 JsVar *jspeAssignmentExpression();
@@ -217,6 +227,20 @@ JsVar *jspeiGetScopesAsVar() {
   if (execInfo.scopeCount==1)
     return jsvLockAgain(execInfo.scopes[0]);
 
+  /* If we're directly inside a function call, link its scope to the scopes
+   * the function was defined in. Every closure created in this call can then
+   * share the one scope rather than each getting a new array of scopes. */
+  if (execInfo.scopeCount==execInfo.scopeParentCount) {
+    JsVar *scope = execInfo.scopes[execInfo.scopeCount-1];
+    JsVar *parentName = jsvFindChildFromString(scope, JSPARSE_FUNCTION_SCOPE_PARENT_NAME, true);
+    if (parentName) {
+      if (!jsvGetFirstChild(parentName))
+        jsvSetValueOfName(parentName, execInfo.scopeParent);
+      jsvUnLock(parentName);
+      return jsvLockAgain(scope);
+    }
+  }
+
   JsVar *arr = jsvNewEmptyArray();
   int i;
   for (i=0;i<execInfo.scopeCount;i++) {
@@ -233,17 +257,28 @@ JsVar *jspeiGetScopesAsVar() {
 
 void jspeiLoadScopesFromVar(JsVar *arr) {
   execInfo.scopeCount = 0;
+  // Follow links from function call scopes back to the scopes they were called in
+  JsVar *chain[JSPARSE_MAX_SCOPES];
+  int chainCount = 0;
+  JsVar *scope = jsvLockAgainSafe(arr);
+  while (scope && !jsvIsArray(scope) && chainCount<JSPARSE_MAX_SCOPES) {
+    chain[chainCount++] = scope;
+    scope = jsvObjectGetChild(scope, JSPARSE_FUNCTION_SCOPE_PARENT_NAME, 0);
+  }
 
-  if (jsvIsArray(arr)) {
+  if (jsvIsArray(scope)) {
     JsvObjectIterator it;
-    jsvObjectIteratorNew(&it, arr);
-    while (jsvObjectIteratorHasValue(&it)) {
+    jsvObjectIteratorNew(&it, scope);
+    while (jsvObjectIteratorHasValue(&it) && execInfo.scopeCount+chainCount<JSPARSE_MAX_SCOPES) {
       execInfo.scopes[execInfo.scopeCount++] = jsvObjectIteratorGetValue(&it);
       jsvObjectIteratorNext(&it);
     }
     jsvObjectIteratorFree(&it);
-  } else
-    execInfo.scopes[execInfo.scopeCount++] = jsvLockAgain(arr);
+  }
+  jsvUnLock(scope);
+  // outermost scope first
+  while (chainCount)
+    execInfo.scopes[execInfo.scopeCount++] = chain[--chainCount];
 }
 // -----------------------------------------------
 bool jspCheckStackPosition() {
@@ -406,10 +441,28 @@ NO_INLINE JsVar *jspeFunctionDefinition(bool parseNamedFunction) {
         int s = (int)jsvStringIteratorGetIndex(&funcBegin.it) - 1;
         funcCodeVar->varData.nativeStr.ptr = lex->sourceVar->varData.nativeStr.ptr + s;
         funcCodeVar->varData.nativeStr.len = (uint16_t)(lastTokenEnd - s);
+        if (jsvIsStringView(lex->sourceVar)) // keep what we point into allocated
+          jsvSetFirstChild(funcCodeVar, jsvRefRef(jsvGetFirstChild(lex->sourceVar)));
       }
     } else {
       funcCodeVar = jslNewFromLexer(&funcBegin, (size_t)lastTokenEnd);
+#ifndef SAVE_ON_FLASH
+      if (jspPretokenise && funcCodeVar) {
+        // store the code without whitespace/comments, and with tokens as single chars
+        JsVar *tokens = jslTokenise(funcCodeVar, 0);
+        if (tokens) {
+          jsvUnLock(funcCodeVar);
+          funcCodeVar = tokens;
+          funcVar->varData.function.codeTokenised = true;
+        }
+      }
+#endif
     }
+#ifndef SAVE_ON_FLASH
+    // code copied out of pre-tokenised code is pre-tokenised too
+    if (lex->sourceTokenised)
+      funcVar->varData.function.codeTokenised = true;
+#endif
     jsvUnLock2(jsvAddNamedChild(funcVar, funcCodeVar, JSPARSE_FUNCTION_CODE_NAME), funcCodeVar);
     // scope var
     JsVar *funcScopeVar = jspeiGetScopesAsVar();
@@ -457,6 +510,113 @@ NO_INLINE bool jspeParseFunctionCallBrackets() {
  *
  * functionName is used only for error reporting - and can be 0
  */
+#ifndef SAVE_ON_FLASH
+/** Count calls to a function, and once it has been called JSPARSE_TOKENISE_CALL_COUNT
+ * times store a pre-tokenised copy of its code. 'tokensName' is the function's
+ * JSPARSE_FUNCTION_TOKENS_NAME child (if it has one). Returns the code to execute,
+ * unlocking functionCode if it isn't that.
+ *
+ * 'locals' is the function's JSPARSE_FUNCTION_LOCALS_NAME array (if it has one).
+ * It is updated if the code gets tokenised, and is unlocked and set to 0 if
+ * we're not returning tokens. */
+static JsVar *jspeGetFunctionCode(JsVar *function, JsVar *functionCode, JsVar *tokensName, JsVar **locals) {
+  if (tokensName) {
+    // we already have tokens
+    JsVar *tokens = jsvSkipName(tokensName);
+    if (jsvIsString(tokens)) {
+      jsvUnLock(functionCode);
+      return tokens;
+    }
+    jsvUnLock(tokens);
+  } else {
+    // the count lives in the function itself, so it doesn't cost a variable
+    int8_t *calls = &function->varData.function.tokeniseCalls;
+    if (*calls>=0 && ++*calls >= JSPARSE_TOKENISE_CALL_COUNT) { // <0 if we failed to tokenise before
+      // Start our list of local variables with the parameter names
+      jsvUnLock(*locals);
+      *locals = jsvNewEmptyArray();
+      JsvObjectIterator it;
+      jsvObjectIteratorNew(&it, function);
+      while (*locals && jsvObjectIteratorHasValue(&it)) {
+        JsVar *param = jsvObjectIteratorGetKey(&it);
+        if (jsvIsFunctionParameter(param) && jsvGetArrayLength(*locals)<LEX_MAX_SLOTS)
+          jsvArrayPushAndUnLock(*locals, jsvNewFromStringVar(param, 0, JSVAPPENDSTRINGVAR_MAXLENGTH));
+        jsvUnLock(param);
+        jsvObjectIteratorNext(&it);
+      }
+      jsvObjectIteratorFree(&it);
+      JsVar *tokens = jslTokenise(functionCode, *locals);
+      if (tokens) {
+        jsvObjectSetChild(function, JSPARSE_FUNCTION_TOKENS_NAME, tokens);
+        jsvObjectSetChild(function, JSPARSE_FUNCTION_LOCALS_NAME, *locals);
+        jsvUnLock(functionCode);
+        return tokens;
+      }
+      *calls = -1;
+    }
+  }
+  jsvUnLock(*locals);
+  *locals = 0;
+  return functionCode;
+}
+
+/// Remove all pre-tokenised function code (see jspeGetFunctionCode). Returns true if something was freed
+bool jspFreeFunctionTokens() {
+  bool freed = false;
+  JsVarRef i;
+  for (i=1;i<=jsvGetMemoryTotal();i++) {
+    JsVar *v = _jsvGetAddressOf(i);
+    // skip anything the incremental GC is about to free
+    if (jsvIsFunction(v) && !jsvIsNative(v) && !(v->flags&JSV_GARBAGE_COLLECT)) {
+      JsVar *function = jsvLock(i);
+      JsVar *tokensName = jsvFindChildFromString(function, JSPARSE_FUNCTION_TOKENS_NAME, false);
+      // only remove if nobody else (an iterator or the lexer) is using it
+      if (tokensName && jsvGetLocks(tokensName)==1) {
+        jsvRemoveChild(function, tokensName);
+        function->varData.function.tokeniseCalls = 0; // start counting again
+        JsVar *localsName = jsvFindChildFromString(function, JSPARSE_FUNCTION_LOCALS_NAME, false);
+        if (localsName) jsvRemoveChild(function, localsName);
+        jsvUnLock(localsName);
+        freed = true;
+      }
+      jsvUnLock2(tokensName, function);
+    } else if (jsvIsFlatString(v)) {
+      i = (JsVarRef)(i+jsvGetFlatStringBlocks(v));
+    }
+  }
+  return freed;
+}
+
+/* Every call to a non-native function needs a scope to hold its parameters
+ * and local variables. When nothing keeps hold of a scope after the call
+ * (eg. a closure) we empty it and keep it here, locked, for the next call. */
+#define JSP_FUNCTION_SCOPE_CACHE_SIZE 4
+static INSTANCE_LOCAL JsVarRef jspFunctionScopeCache[JSP_FUNCTION_SCOPE_CACHE_SIZE];
+static INSTANCE_LOCAL unsigned char jspFunctionScopeCacheCount;
+
+static JsVar *jspeNewFunctionScope() {
+  if (jspFunctionScopeCacheCount)
+    return _jsvGetAddressOf(jspFunctionScopeCache[--jspFunctionScopeCacheCount]);
+  return jsvNewWithFlags(JSV_FUNCTION);
+}
+
+static void jspeFreeFunctionScope(JsVar *functionRoot) {
+  if (jspFunctionScopeCacheCount<JSP_FUNCTION_SCOPE_CACHE_SIZE &&
+      jsvGetRefs(functionRoot)==0 && jsvGetLocks(functionRoot)==1) {
+    jsvRemoveAllChildren(functionRoot);
+    jspFunctionScopeCache[jspFunctionScopeCacheCount++] = jsvGetRef(functionRoot);
+  } else
+    jsvUnLock(functionRoot);
+}
+
+bool jspReleaseFunctionScopes() {
+  bool released = jspFunctionScopeCacheCount!=0;
+  while (jspFunctionScopeCacheCount)
+    jsvUnLock(_jsvGetAddressOf(jspFunctionScopeCache[--jspFunctionScopeCacheCount]));
+  return released;
+}
+#endif
+
 NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *thisArg, bool isParsing, int argCount, JsVar **argPtr) {
   if (JSP_SHOULD_EXECUTE && !function) {
     if (functionName)
@@ -573,7 +733,13 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
 
 
       if (nativePtr) {
+#ifdef ALLOC_PROFILE
+        unsigned char oldAllocSite = jsvAllocProfileEnter((size_t)nativePtr, functionName);
+#endif
         returnVar = jsnCallFunction(nativePtr, function->varData.native.argTypes, thisVar, argPtr, argCount);
+#ifdef ALLOC_PROFILE
+        jsvAllocProfileLeave(oldAllocSite);
+#endif
       } else {
         assert(0); // in case something went horribly wrong
         returnVar = 0;
@@ -588,9 +754,11 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
 
     } else { // ----------------------------------------------------- NOT NATIVE
       // create a new symbol table entry for execution of this function
-      // OPT: can we cache this function execution environment + param variables?
-      // OPT: Probably when calling a function ONCE, use it, otherwise when recursing, make new?
+#ifndef SAVE_ON_FLASH
+      JsVar *functionRoot = jspeNewFunctionScope();
+#else
       JsVar *functionRoot = jsvNewWithFlags(JSV_FUNCTION);
+#endif
       if (!functionRoot) { // out of memory
         jspSetError(false);
         jsvUnLock(thisVar);
@@ -601,6 +769,10 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
       JsVar *functionCode = 0;
       JsVar *functionInternalName = 0;
       uint16_t functionLineNumber = 0;
+#ifndef SAVE_ON_FLASH
+      JsVar *functionTokensName = 0;
+      JsVar *functionLocals = 0;
+#endif
 
       /** NOTE: We expect that the function object will have:
        *
@@ -686,6 +858,10 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
           else if (jsvIsStringEqual(param, JSPARSE_FUNCTION_NAME_NAME)) functionInternalName = jsvSkipName(param);
           else if (jsvIsStringEqual(param, JSPARSE_FUNCTION_THIS_NAME)) thisVar = jsvSkipName(param);
           else if (jsvIsStringEqual(param, JSPARSE_FUNCTION_LINENUMBER_NAME)) functionLineNumber = (uint16_t)jsvGetIntegerAndUnLock(jsvSkipName(param));
+#ifndef SAVE_ON_FLASH
+          else if (jsvIsStringEqual(param, JSPARSE_FUNCTION_TOKENS_NAME)) functionTokensName = jsvLockAgain(param);
+          else if (jsvIsStringEqual(param, JSPARSE_FUNCTION_LOCALS_NAME)) functionLocals = jsvSkipName(param);
+#endif
           else if (jsvIsFunctionParameter(param)) {
             JsVar *paramName = jsvCopy(param);
             // paramName is already a name (it's a function parameter)
@@ -700,6 +876,13 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
       }
       jsvObjectIteratorFree(&it);
 
+#ifndef SAVE_ON_FLASH
+      // Use pre-tokenised code if the function is called often
+      if (functionCode)
+        functionCode = jspeGetFunctionCode(function, functionCode, functionTokensName, &functionLocals);
+      jsvUnLock(functionTokensName);
+#endif
+
       // setup a the function's name (if a named function)
       if (functionInternalName) {
         JsVar *name = jsvMakeIntoVariableName(jsvNewFromStringVar(functionInternalName,0,JSVAPPENDSTRINGVAR_MAXLENGTH), function);
@@ -716,15 +899,19 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
         for (i=0;i<execInfo.scopeCount;i++)
           oldScopes[i] = execInfo.scopes[i];
         // if we have a scope var, load it up. We may not have one if there were no scopes apart from root
+        JsVar *oldScopeParent = execInfo.scopeParent;
+        int oldScopeParentCount = execInfo.scopeParentCount;
         if (functionScope) {
           jspeiLoadScopesFromVar(functionScope);
-          jsvUnLock(functionScope);
         } else {
           // no scope var defined? We have no scopes at all!
           execInfo.scopeCount = 0;
         }
         // add the function's execute space to the symbol table so we can recurse
         if (jspeiAddScope(functionRoot)) {
+          // so closures can link back to functionScope (see jspeiGetScopesAsVar)
+          execInfo.scopeParent = functionScope;
+          execInfo.scopeParentCount = functionScope ? execInfo.scopeCount : 0;
           /* Adding scope may have failed - we may have descended too deep - so be sure
            * not to pull somebody else's scope off
            */
@@ -756,10 +943,37 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
 #endif
 
 
+#ifndef SAVE_ON_FLASH
+            /* Pre-tokenised code refers to local variables by index, so look
+             * up the ones that exist now (parameters). Others get filled in
+             * by jspeStatementVar when they are defined. */
+            unsigned char slotCount = (unsigned char)(functionLocals ? jsvGetArrayLength(functionLocals) : 0);
+            JsVarRef *slots = slotCount ? (JsVarRef*)alloca(sizeof(JsVarRef)*slotCount) : 0;
+            if (slotCount) {
+              JsvObjectIterator lit;
+              jsvObjectIteratorNew(&lit, functionLocals);
+              for (i=0;i<slotCount;i++) {
+                JsVar *localName = jsvObjectIteratorGetValue(&lit);
+                JsVar *local = localName ? jsvFindChildFromVar(functionRoot, localName, false) : 0;
+                jsvUnLock(localName);
+                slots[i] = jsvGetRef(local); // left locked until the function returns
+                jsvObjectIteratorNext(&lit);
+              }
+              jsvObjectIteratorFree(&lit);
+            }
+#endif
             JsLex newLex;
             JsLex *oldLex = jslSetLex(&newLex);
+#ifdef ALLOC_PROFILE
+            unsigned char oldAllocSite = jsvAllocProfileEnter((size_t)jsvGetRef(function), functionName);
+#endif
             jslInit(functionCode);
             newLex.lineNumberOffset = functionLineNumber;
+#ifndef SAVE_ON_FLASH
+            newLex.slots = slots;
+            newLex.slotCount = slotCount;
+            newLex.sourceTokenised = function->varData.function.codeTokenised;
+#endif
             JSP_SAVE_EXECUTE();
             // force execute without any previous state
 #ifdef USE_DEBUGGER
@@ -767,6 +981,9 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
 #else
             execInfo.execute = EXEC_YES | (execInfo.execute&(EXEC_CTRL_C_MASK|EXEC_ERROR_MASK));
 #endif
+            JsVar **oldReturnVar = execInfo.returnVar;
+            // 'return' writes straight into returnVar (but not from inside an implicit return)
+            execInfo.returnVar = jsvIsFunctionReturn(function) ? 0 : &returnVar;
             if (jsvIsFunctionReturn(function)) {
               #ifdef USE_DEBUGGER
                 // we didn't parse a statement so wouldn't trigger the debugger otherwise
@@ -779,17 +996,10 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
               if (lex->tk != ';' && lex->tk != '}')
                 returnVar = jsvSkipNameAndUnLock(jspeExpression());
             } else {
-              // setup a return variable
-              JsVar *returnVarName = jsvAddNamedChild(functionRoot, 0, JSPARSE_RETURN_VAR);
               // parse the whole block
               jspeBlockNoBrackets();
-              /* get the real return var before we remove it from our function.
-               * We can unlock below because returnVarName is still part of
-               * functionRoot, so won't get freed. */
-              returnVar = jsvSkipNameAndUnLock(returnVarName);
-              if (returnVarName) // could have failed with out of memory
-                jsvSetValueOfName(returnVarName, 0); // remove return value (which helps stops circular references)
             }
+            execInfo.returnVar = oldReturnVar;
             JsExecFlags hasError = execInfo.execute&(EXEC_ERROR_MASK|EXEC_CTRL_C_MASK);
             JSP_RESTORE_EXECUTE(); // because return will probably have set execute to false
 
@@ -810,6 +1020,13 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
 
             jslKill();
             jslSetLex(oldLex);
+#ifdef ALLOC_PROFILE
+            jsvAllocProfileLeave(oldAllocSite);
+#endif
+#ifndef SAVE_ON_FLASH
+            for (i=0;i<slotCount;i++)
+              if (slots[i]) jsvUnLock(_jsvGetAddressOf(slots[i]));
+#endif
 
             if (hasError) {
               execInfo.execute |= hasError; // propogate error
@@ -840,9 +1057,16 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
         for (i=0;i<oldScopeCount;i++)
           execInfo.scopes[i] = oldScopes[i];
         execInfo.scopeCount = oldScopeCount;
+        execInfo.scopeParent = oldScopeParent;
+        execInfo.scopeParentCount = oldScopeParentCount;
       }
-      jsvUnLock(functionCode);
+      jsvUnLock2(functionCode, functionScope);
+#ifndef SAVE_ON_FLASH
+      jspeFreeFunctionScope(functionRoot);
+      jsvUnLock(functionLocals);
+#else
       jsvUnLock(functionRoot);
+#endif
     }
 
     jsvUnLock(thisVar);
@@ -855,6 +1079,45 @@ NO_INLINE JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *t
   } else return 0;
 }
 
+bool jspNativeCallStart(JspNativeCall *call, JsVar *function, JsVar *thisArg) {
+  if (!jsvIsNativeFunction(function)) return false;
+  call->ptr = jsvGetNativeFunctionPtr(function);
+  if (!call->ptr || call->ptr==jswrap_eval) return false;
+  // bound arguments or 'this' need jspeFunctionCall to add them
+  if (jsvGetFirstChild(function)) {
+    JsVar *param = jsvLock(jsvGetFirstChild(function));
+    bool isBound = jsvIsFunctionParameter(param);
+    jsvUnLock(param);
+    if (isBound) return false;
+  }
+  JsVar *boundThis = jsvFindChildFromString(function, JSPARSE_FUNCTION_THIS_NAME, false);
+  jsvUnLock(boundThis);
+  if (boundThis) return false;
+
+  call->argTypes = function->varData.native.argTypes;
+  call->thisArg = thisArg;
+  call->oldThisVar = execInfo.thisVar;
+  execInfo.thisVar = jsvRef(thisArg ? thisArg : execInfo.root);
+  return true;
+}
+
+JsVar *jspNativeCall(JspNativeCall *call, int argCount, JsVar **argPtr) {
+  if (!JSP_SHOULD_EXECUTE) return 0;
+#ifdef ALLOC_PROFILE
+  unsigned char oldAllocSite = jsvAllocProfileEnter((size_t)call->ptr, 0);
+#endif
+  JsVar *returnVar = jsnCallFunction(call->ptr, call->argTypes, call->thisArg, argPtr, argCount);
+#ifdef ALLOC_PROFILE
+  jsvAllocProfileLeave(oldAllocSite);
+#endif
+  return returnVar;
+}
+
+void jspNativeCallEnd(JspNativeCall *call) {
+  jsvUnRef(execInfo.thisVar);
+  execInfo.thisVar = call->oldThisVar;
+}
+
 // Find a variable (or built-in function) based on the current scopes
 JsVar *jspGetNamedVariable(const char *tokenName) {
   JsVar *a = JSP_SHOULD_EXECUTE ? jspeiFindInScopes(tokenName) : 0;
@@ -946,7 +1209,11 @@ JsVar *jspGetNamedField(JsVar *object, const char* name, bool returnName) {
   JsVar *child = 0;
   // if we're an object (or pretending to be one)
   if (jsvHasChildren(object))
+#ifndef SAVE_ON_FLASH
+    child = jsvFindChildFromStringCached(object, name);
+#else
     child = jsvFindChildFromString(object, name, false);
+#endif
 
   if (!child) {
     child = jspGetNamedFieldInParents(object, name, returnName);
@@ -1047,8 +1314,10 @@ NO_INLINE JsVar *jspeFactorMember(JsVar *a, JsVar **parentResult) {
         parent = aVar;
         jsvUnLock(a);
         a = child;
+      } else if (jslIsIDOrReservedWord(lex)) {
+        // Not executing, just skip - reserved words are valid names, eg. map.delete(x)
+        jslGetNextToken(lex);
       } else {
-        // Not executing, just match
         JSP_MATCH_WITH_RETURN(LEX_ID, a);
       }
     } else if (lex->tk == '[') { // ------------------------------------- Array Access
@@ -1311,9 +1580,15 @@ NO_INLINE JsVar *jspeFactorDelete() {
   return result;
 }
 
-NO_INLINE JsVar *jspeFactor() {
+NO_INLINE HOT_PATH JsVar *jspeFactor() {
   if (lex->tk==LEX_ID) {
-    JsVar *a = jspGetNamedVariable(jslGetTokenValueAsString(lex));
+    JsVar *a;
+#ifndef SAVE_ON_FLASH
+    if (lex->tokenSlot && lex->tokenSlot<=lex->slotCount && lex->slots[lex->tokenSlot-1] && JSP_SHOULD_EXECUTE)
+      a = jsvLock(lex->slots[lex->tokenSlot-1]); // local variable from pre-tokenised code
+    else
+#endif
+      a = jspGetNamedVariable(jslGetTokenValueAsString(lex));
     JSP_ASSERT_MATCH(LEX_ID);
     return a;
   } else if (lex->tk==LEX_INT) {
@@ -1345,7 +1620,7 @@ NO_INLINE JsVar *jspeFactor() {
     return JSP_SHOULD_EXECUTE ? jsvNewFromBool(false) : 0;
   } else if (lex->tk==LEX_R_NULL) {
     JSP_ASSERT_MATCH(LEX_R_NULL);
-    return JSP_SHOULD_EXECUTE ? jsvNewWithFlags(JSV_NULL) : 0;
+    return JSP_SHOULD_EXECUTE ? jsvNewNull() : 0;
   } else if (lex->tk==LEX_R_UNDEFINED) {
     JSP_ASSERT_MATCH(LEX_R_UNDEFINED);
     return 0;
@@ -1358,6 +1633,18 @@ NO_INLINE JsVar *jspeFactor() {
       JSP_ASSERT_MATCH(LEX_STR);
       return 0;
     }
+#ifndef SAVE_ON_FLASH
+  } else if (lex->tk==LEX_REGEX) {
+    JsVar *a = 0;
+    if (JSP_SHOULD_EXECUTE) {
+      JsVar *pattern = jslGetTokenValueAsVar();
+      JsVar *flags = jsvNewFromString(jslGetTokenValueAsString());
+      a = jswrap_regexp_constructor(pattern, flags);
+      jsvUnLock2(pattern, flags);
+    }
+    JSP_ASSERT_MATCH(LEX_REGEX);
+    return a;
+#endif
   } else if (lex->tk=='{') {
     return jspeFactorObject();
   } else if (lex->tk=='[') {
@@ -1479,7 +1766,7 @@ unsigned int jspeGetBinaryExpressionPrecedence(int op) {
   }
 }
 
-NO_INLINE JsVar *__jspeBinaryExpression(JsVar *a, unsigned int lastPrecedence) {
+NO_INLINE HOT_PATH JsVar *__jspeBinaryExpression(JsVar *a, unsigned int lastPrecedence) {
   /* This one's a bit strange. Basically all the ops have their own precedence, it's not
    * like & and | share the same precedence. We don't want to recurse for each one,
    * so instead we do this.
@@ -1648,7 +1935,7 @@ NO_INLINE JsVar *__jspeAssignmentExpression(JsVar *lhs) {
         else if (op==LEX_RSHIFTUNSIGNEDEQUAL) op=LEX_RSHIFTUNSIGNED;
         if (op=='+' && jsvIsName(lhs)) {
           JsVar *currentValue = jsvSkipName(lhs);
-          if (jsvIsString(currentValue) && !jsvIsFlatString(currentValue) && jsvGetRefs(currentValue)==1) {
+          if (jsvIsBasicString(currentValue) && jsvGetRefs(currentValue)==1) {
             /* A special case for string += where this is the only use of the string,
              * as we may be able to do a simple append (rather than clone + append)*/
             JsVar *str = jsvAsString(rhs, false);
@@ -1764,6 +2051,11 @@ NO_INLINE JsVar *jspeStatementVar() {
         jspSetError(false);
         return lastDefined;
       }
+#ifndef SAVE_ON_FLASH
+      // remember where a local variable is so pre-tokenised code doesn't have to search
+      if (lex->tokenSlot && lex->tokenSlot<=lex->slotCount && !lex->slots[lex->tokenSlot-1])
+        lex->slots[lex->tokenSlot-1] = jsvGetRef(jsvLockAgain(a));
+#endif
     }
     JSP_MATCH_WITH_CLEANUP_AND_RETURN(LEX_ID, jsvUnLock(a), lastDefined);
     // now do stuff defined with dots
@@ -1950,6 +2242,140 @@ NO_INLINE JsVar *jspeStatementDoOrWhile(bool isWhile) {
   return 0;
 }
 
+#ifndef SAVE_ON_FLASH
+/// Details of a simple 'for (...; i<n; i++)' loop, so it can be run without re-parsing
+typedef struct {
+  JsVar *counter; ///< Name of the loop counter
+  JsVar *limit; ///< Name of the limit, or 0 if limitValue is a constant
+  bool limitIsLength; ///< If true, compare against limit.length
+  JsVarInt limitValue; ///< Constant limit (if limit==0)
+  int op; ///< The comparison
+  JsVarInt step; ///< What we add to the counter each iteration
+} JspForLoop;
+
+/// Get an integer from a name, returning false if it isn't one
+static bool jspForLoopGetInt(JsVar *name, bool getLength, JsVarInt *value) {
+  if (!getLength && jsvIsNameInt(name)) {
+    *value = (JsVarInt)jsvGetFirstChildSigned(name);
+    return true;
+  }
+  JsVar *v = jsvSkipName(name);
+  if (getLength) {
+    JsVar *obj = v;
+    v = (jsvIsArray(obj) || jsvIsArrayBuffer(obj) || jsvIsString(obj)) ?
+        jspGetNamedField(obj, "length", false) : 0;
+    jsvUnLock(obj);
+  }
+  bool ok = jsvIsSimpleInt(v);
+  if (ok) *value = v->varData.integer;
+  jsvUnLock(v);
+  return ok;
+}
+
+/** Look at the condition and iterator of a for loop, and if they're of the
+ * form 'i<n' and 'i++' for variables (or constants) that are in scope then
+ * fill in 'loop' and return true. Lexer position is set to 'iterStart' afterwards */
+static bool jspForLoopDetect(JslCharPos *condStart, JslCharPos *iterStart, JspForLoop *loop) {
+  char counterName[JSLEX_MAX_TOKEN_LENGTH];
+  char limitName[JSLEX_MAX_TOKEN_LENGTH];
+  bool found = false;
+  loop->counter = 0;
+  loop->limit = 0;
+  loop->limitIsLength = false;
+  loop->limitValue = 0;
+  // condition: ID op (INT|ID|ID.length) ';'
+  jslSeekToP(condStart);
+  if (lex->tk != LEX_ID) return false;
+  strncpy(counterName, jslGetTokenValueAsString(lex), sizeof(counterName));
+  jslGetNextToken(lex);
+  loop->op = lex->tk;
+  if (loop->op!='<' && loop->op!=LEX_LEQUAL && loop->op!='>' && loop->op!=LEX_GEQUAL && loop->op!=LEX_NEQUAL)
+    return false;
+  jslGetNextToken(lex);
+  limitName[0] = 0;
+  if (lex->tk == LEX_INT) {
+    long long v = stringToInt(jslGetTokenValueAsString(lex));
+    if (v<-2147483648LL || v>2147483647LL) return false; // must fit in a JsVarInt
+    loop->limitValue = (JsVarInt)v;
+    jslGetNextToken(lex);
+  } else if (lex->tk == LEX_ID) {
+    strncpy(limitName, jslGetTokenValueAsString(lex), sizeof(limitName));
+    jslGetNextToken(lex);
+    if (lex->tk == '.') {
+      jslGetNextToken(lex);
+      if (lex->tk != LEX_ID || strcmp(jslGetTokenValueAsString(lex), "length")) return false;
+      loop->limitIsLength = true;
+      jslGetNextToken(lex);
+    }
+  } else return false;
+  if (lex->tk != ';') return false;
+  // iterator: ID++ | ++ID | ID-- | --ID | ID+=INT | ID-=INT, then ')'
+  jslSeekToP(iterStart);
+  bool preOp = lex->tk==LEX_PLUSPLUS || lex->tk==LEX_MINUSMINUS;
+  if (preOp) {
+    loop->step = (lex->tk==LEX_PLUSPLUS) ? 1 : -1;
+    jslGetNextToken(lex);
+  }
+  if (lex->tk != LEX_ID || strcmp(jslGetTokenValueAsString(lex), counterName)) return false;
+  jslGetNextToken(lex);
+  if (!preOp) {
+    if (lex->tk==LEX_PLUSPLUS || lex->tk==LEX_MINUSMINUS) {
+      loop->step = (lex->tk==LEX_PLUSPLUS) ? 1 : -1;
+      jslGetNextToken(lex);
+    } else if (lex->tk==LEX_PLUSEQUAL || lex->tk==LEX_MINUSEQUAL) {
+      bool minus = lex->tk==LEX_MINUSEQUAL;
+      jslGetNextToken(lex);
+      if (lex->tk != LEX_INT) return false;
+      long long v = stringToInt(jslGetTokenValueAsString(lex));
+      if (v<-2147483648LL || v>2147483647LL) return false; // must fit in a JsVarInt
+      loop->step = (JsVarInt)(minus ? -v : v);
+      jslGetNextToken(lex);
+    } else return false;
+  }
+  if (lex->tk == ')') {
+    // Now find the variables themselves
+    loop->counter = jspeiFindInScopes(counterName);
+    if (limitName[0]) loop->limit = jspeiFindInScopes(limitName);
+    JsVarInt v;
+    found = loop->counter && (!limitName[0] || loop->limit) &&
+        jspForLoopGetInt(loop->counter, false, &v);
+    if (!found) {
+      jsvUnLock2(loop->counter, loop->limit);
+      loop->counter = 0;
+      loop->limit = 0;
+    }
+  }
+  jslSeekToP(iterStart);
+  return found;
+}
+
+/** Check a for loop's condition without parsing. Returns 1/0 for true/false,
+ * or -1 if it's no longer a simple integer comparison */
+static int jspForLoopCondition(JspForLoop *loop) {
+  JsVarInt counter, limit = loop->limitValue;
+  if (!jspForLoopGetInt(loop->counter, false, &counter)) return -1;
+  if (loop->limit && !jspForLoopGetInt(loop->limit, loop->limitIsLength, &limit)) return -1;
+  switch (loop->op) {
+    case '<': return counter<limit;
+    case LEX_LEQUAL: return counter<=limit;
+    case '>': return counter>limit;
+    case LEX_GEQUAL: return counter>=limit;
+    default: return counter!=limit;
+  }
+}
+
+/// Step a for loop's counter without parsing. Returns false if it's no longer an integer.
+static bool jspForLoopIterate(JspForLoop *loop) {
+  JsVarInt counter;
+  if (!jspForLoopGetInt(loop->counter, false, &counter)) return false;
+  JsVar *v = jsvNewFromLongInteger((long long)counter + (long long)loop->step);
+  if (!v) return false; // out of memory
+  jsvSetValueOfName(loop->counter, v);
+  jsvUnLock(v);
+  return true;
+}
+#endif
+
 NO_INLINE JsVar *jspeStatementFor() {
   JSP_ASSERT_MATCH(LEX_R_FOR);
   JSP_MATCH('(');
@@ -1995,6 +2421,7 @@ NO_INLINE JsVar *jspeStatementFor() {
       if (jsvIsIterable(array)) {
         JsvIsInternalChecker checkerFunction = jsvGetInternalFunctionCheckerFor(array);
         JsVar *foundPrototype = 0;
+        JsVar *iterating = jsvLockAgain(array); // array, or its prototype
 
         JsvIterator it;
         jsvIteratorNew(&it, array);
@@ -2013,7 +2440,7 @@ NO_INLINE JsVar *jspeStatementFor() {
                 jsvCopyNameOnly(loopIndexVar, false/*no copy children*/, false/*not a name*/) :
                 loopIndexVar;
             if (indexValue) { // could be out of memory
-              assert(!jsvIsName(indexValue) && jsvGetRefs(indexValue)==0);
+              assert(!jsvIsName(indexValue));
               jsvSetValueOfName(forStatement, indexValue);
               if (indexValue!=loopIndexVar) jsvUnLock(indexValue);
 
@@ -2024,6 +2451,9 @@ NO_INLINE JsVar *jspeStatementFor() {
               jspDebuggerLoopIfCtrlC();
               jsvUnLock(jspeBlockOrStatement());
               if (!wasInLoop) execInfo.execute &= (JsExecFlags)~EXEC_IN_LOOP;
+              // the loop body may have deleted the next key
+              if (it.type==JSVI_OBJECT && jsvIsName(loopIndexVar))
+                jsvObjectIteratorSkipRemoved(&it.it.obj, iterating, loopIndexVar);
 
               if (execInfo.execute & EXEC_CONTINUE)
                 execInfo.execute = EXEC_YES;
@@ -2039,12 +2469,14 @@ NO_INLINE JsVar *jspeStatementFor() {
           if (!jsvIteratorHasElement(&it) && foundPrototype) {
             jsvIteratorFree(&it);
             jsvIteratorNew(&it, foundPrototype);
-            jsvUnLock(foundPrototype);
+            jsvUnLock(iterating);
+            iterating = foundPrototype;
             foundPrototype = 0;
           }
         }
         assert(!foundPrototype);
         jsvIteratorFree(&it);
+        jsvUnLock(iterating);
       } else if (!jsvIsUndefined(array)) {
         jsExceptionHere(JSET_ERROR, "FOR loop can only iterate over Arrays, Strings or Objects, not %t", array);
       }
@@ -2102,19 +2534,32 @@ NO_INLINE JsVar *jspeStatementFor() {
       jslSeekToP(&forIterStart);
       if (lex->tk != ')') jsvUnLock(jspeExpression());
     }
+#ifndef SAVE_ON_FLASH
+    // For simple 'i<n;i++' loops we can skip parsing the condition and iterator
+    JspForLoop fastLoop;
+    bool isFastLoop = !hasHadBreak && JSP_SHOULD_EXECUTE && loopCond &&
+        jspForLoopDetect(&forCondStart, &forIterStart, &fastLoop);
+#endif
     while (!hasHadBreak && JSP_SHOULD_EXECUTE && loopCond
 #ifdef JSPARSE_MAX_LOOP_ITERATIONS
         && loopCount-->0
 #endif
     ) {
-      jslSeekToP(&forCondStart);
-      ;
-      if (lex->tk == ';') {
-        loopCond = true;
-      } else {
-        JsVar *cond = jspeAssignmentExpression();
-        loopCond = jsvGetBoolAndUnLock(jsvSkipName(cond));
-        jsvUnLock(cond);
+#ifndef SAVE_ON_FLASH
+      int fastCond = isFastLoop ? jspForLoopCondition(&fastLoop) : -1;
+      if (fastCond>=0) {
+        loopCond = fastCond!=0;
+      } else
+#endif
+      {
+        jslSeekToP(&forCondStart);
+        if (lex->tk == ';') {
+          loopCond = true;
+        } else {
+          JsVar *cond = jspeAssignmentExpression();
+          loopCond = jsvGetBoolAndUnLock(jsvSkipName(cond));
+          jsvUnLock(cond);
+        }
       }
       if (JSP_SHOULD_EXECUTE && loopCond) {
         jslSeekToP(&forBodyStart);
@@ -2130,10 +2575,19 @@ NO_INLINE JsVar *jspeStatementFor() {
         }
       }
       if (JSP_SHOULD_EXECUTE && loopCond && !hasHadBreak) {
-        jslSeekToP(&forIterStart);
-        if (lex->tk != ')') jsvUnLock(jspeExpression());
+#ifndef SAVE_ON_FLASH
+        if (!isFastLoop || !jspForLoopIterate(&fastLoop))
+#endif
+        {
+          jslSeekToP(&forIterStart);
+          if (lex->tk != ')') jsvUnLock(jspeExpression());
+        }
       }
     }
+#ifndef SAVE_ON_FLASH
+    if (isFastLoop)
+      jsvUnLock2(fastLoop.counter, fastLoop.limit);
+#endif
     jslSeekToP(&forBodyEnd);
 
     jslCharPosFree(&forCondStart);
@@ -2213,10 +2667,9 @@ NO_INLINE JsVar *jspeStatementReturn() {
     result = jsvSkipNameAndUnLock(jspeExpression());
   }
   if (JSP_SHOULD_EXECUTE) {
-    JsVar *resultVar = jspeiFindOnTop(JSPARSE_RETURN_VAR, false);
-    if (resultVar) {
-      jspReplaceWith(resultVar, result);
-      jsvUnLock(resultVar);
+    if (execInfo.returnVar) {
+      jsvUnLock(*execInfo.returnVar);
+      *execInfo.returnVar = jsvLockAgainSafe(result);
       jspSetNoExecute(); // Stop anything else in this function executing
     } else {
       jsExceptionHere(JSET_SYNTAXERROR, "RETURN statement, but not in a function.\n");
@@ -2286,6 +2739,7 @@ NO_INLINE JsVar *jspeStatement() {
       lex->tk==LEX_INT ||
       lex->tk==LEX_FLOAT ||
       lex->tk==LEX_STR ||
+      lex->tk==LEX_REGEX ||
       lex->tk==LEX_R_NEW ||
       lex->tk==LEX_R_NULL ||
       lex->tk==LEX_R_UNDEFINED ||
@@ -2448,9 +2902,19 @@ void jspSoftInit() {
   // Root now has a lock and a ref
   execInfo.hiddenRoot = jsvObjectGetChild(execInfo.root, JS_HIDDEN_CHAR_STR, JSV_OBJECT);
   execInfo.execute = EXEC_YES;
+#ifndef SAVE_ON_FLASH
+  jsvCreateConstants();
+#endif
 }
 
 void jspSoftKill() {
+#ifndef SAVE_ON_FLASH
+  jspProfileStop();
+  jsvReleaseNativeFunctions();
+  jsvReleaseInternedStrings();
+  jsvReleaseConstants();
+  jspReleaseFunctionScopes();
+#endif
   jsvUnLock(execInfo.hiddenRoot);
   execInfo.hiddenRoot = 0;
   jsvUnLock(execInfo.root);
@@ -2458,6 +2922,105 @@ void jspSoftKill() {
   // Root is now left with just a ref
 }
 
+#ifndef SAVE_ON_FLASH
+INSTANCE_LOCAL JspProfileSite jspProfileSites[JSP_PROFILE_SITES];
+INSTANCE_LOCAL uint32_t jspProfileIdle;
+INSTANCE_LOCAL uint32_t jspProfileDropped;
+#ifdef LINUX
+/* Linux has no utility timer, so a thread sends us SIGPROF instead. The sample is taken in
+ * the signal handler, which runs on the interpreter's own thread so sees its state */
+typedef struct {
+  volatile bool running;
+  pthread_t interpreter; ///< the thread to sample
+  useconds_t period;
+} JspProfileThreadInfo;
+static INSTANCE_LOCAL JspProfileThreadInfo jspProfileInfo;
+static INSTANCE_LOCAL pthread_t jspProfileThread;
+#endif
+
+/** Record where the interpreter is right now. This is called from an
+ * interrupt, so it only reads the lexer and can't lock anything */
+static void CALLED_FROM_INTERRUPT jspProfileSample(JsSysTime time) {
+  NOT_USED(time);
+  JsLex *l = lex;
+  if (!l) {
+    jspProfileIdle++;
+    return;
+  }
+  JsVarRef source = jsvGetRef(l->sourceVar);
+  uint32_t pos = (uint32_t)l->tokenLastStart;
+  unsigned int i, idx = ((unsigned int)source*31 + pos) % JSP_PROFILE_SITES;
+  for (i=0;i<JSP_PROFILE_SITES;i++) {
+    JspProfileSite *site = &jspProfileSites[idx];
+    if (!site->source) {
+      site->source = source;
+      site->lineNumberOffset = l->lineNumberOffset;
+      site->tokenPos = pos;
+    }
+    if (site->source==source && site->tokenPos==pos) {
+      site->count++;
+      return;
+    }
+    idx = (idx+1) % JSP_PROFILE_SITES;
+  }
+  jspProfileDropped++;
+}
+
+#ifdef LINUX
+static void jspProfileSignal(int sig) {
+  NOT_USED(sig);
+  jspProfileSample(0);
+}
+
+static void *jspProfileThreadFn(void *arg) {
+  JspProfileThreadInfo *info = (JspProfileThreadInfo*)arg;
+  while (info->running) {
+    usleep(info->period);
+    if (info->running) pthread_kill(info->interpreter, SIGPROF);
+  }
+  return 0;
+}
+#endif
+
+bool jspProfileStart(JsVarFloat freq) {
+  jspProfileStop();
+  memset(jspProfileSites, 0, sizeof(jspProfileSites));
+  jspProfileIdle = 0;
+  jspProfileDropped = 0;
+  if (!(freq>0)) return false;
+#ifdef LINUX
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = jspProfileSignal;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  if (sigaction(SIGPROF, &sa, NULL)) return false;
+  jspProfileInfo.period = (useconds_t)(1000000 / freq);
+  jspProfileInfo.interpreter = pthread_self();
+  jspProfileInfo.running = true;
+  sigset_t allSignals, oldSignals; // signals should still go to the interpreter's thread
+  sigfillset(&allSignals);
+  pthread_sigmask(SIG_BLOCK, &allSignals, &oldSignals);
+  bool ok = pthread_create(&jspProfileThread, NULL, jspProfileThreadFn, &jspProfileInfo) == 0;
+  pthread_sigmask(SIG_SETMASK, &oldSignals, NULL);
+  if (!ok) jspProfileInfo.running = false;
+  return ok;
+#else
+  return jstExecuteFn(jspProfileSample, jshGetTimeFromMilliseconds(1000 / freq), true);
+#endif
+}
+
+void jspProfileStop() {
+#ifdef LINUX
+  if (!jspProfileInfo.running) return;
+  jspProfileInfo.running = false;
+  pthread_join(jspProfileThread, NULL);
+#else
+  jstStopExecuteFn(jspProfileSample);
+#endif
+}
+#endif
+
 void jspInit() {
   jspSoftInit();
 }
@@ -2487,6 +3050,7 @@ JsVar *jspEvaluateVar(JsVar *str, JsVar *scope, uint16_t lineNumberOffset) {
   if (scope) {
     // if we're adding a scope, make sure it's the *only* scope
     execInfo.scopeCount = 0;
+    execInfo.scopeParentCount = 0;
     scopeAdded = jspeiAddScope(scope);
   }
 
@@ -63,6 +63,32 @@ JsVar *jspEvaluateVar(JsVar *str, JsVar *scope, uint16_t lineNumberOffset);
 JsVar *jspEvaluate(const char *str, bool stringIsStatic);
 JsVar *jspExecuteFunction(JsVar *func, JsVar *thisArg, int argCount, JsVar **argPtr);
 
+#ifndef SAVE_ON_FLASH
+/// Remove all pre-tokenised function code to free memory. Returns true if something was freed
+bool jspFreeFunctionTokens();
+/// Free the empty function scopes kept for reuse by jspeFunctionCall. Returns true if there were any
+bool jspReleaseFunctionScopes();
+/// Should function code be stored pre-tokenised when it is defined? (see E.setFlags)
+extern INSTANCE_LOCAL bool jspPretokenise;
+
+#define JSP_PROFILE_SITES 64 ///< How many different places in the code the profiler can count samples for
+
+/// Samples taken at one place in the code (see E.startProfile)
+typedef struct {
+  JsVarRef source; ///< The code string that was executing (0 if unused)
+  uint16_t lineNumberOffset; ///< The lexer's lineNumberOffset for 'source'
+  uint32_t tokenPos; ///< Where in 'source' the last token started
+  uint32_t count; ///< How many samples were taken here
+} JspProfileSite;
+extern INSTANCE_LOCAL JspProfileSite jspProfileSites[JSP_PROFILE_SITES];
+extern INSTANCE_LOCAL uint32_t jspProfileIdle; ///< Samples taken while no JS code was executing
+extern INSTANCE_LOCAL uint32_t jspProfileDropped; ///< Samples that didn't fit in jspProfileSites
+/// Clear the profile and start sampling where the interpreter is 'freq' times a second
+bool jspProfileStart(JsVarFloat freq);
+/// Stop sampling - the results are left in jspProfileSites
+void jspProfileStop();
+#endif
+
 /// Evaluate a JavaScript module and return its exports
 JsVar *jspEvaluateModule(JsVar *moduleContents);
 
@@ -124,15 +150,20 @@ typedef struct {
   // TODO: could store scopes as JsVar array for speed
   JsVar *scopes[JSPARSE_MAX_SCOPES];
   int scopeCount;
+  /// When scopeCount==scopeParentCount, scopes[0..scopeCount-2] were loaded from this (a function's JSPARSE_FUNCTION_SCOPE_NAME)
+  JsVar *scopeParent;
+  int scopeParentCount;
   /// Value of 'this' reserved word
   JsVar *thisVar;
+  /// Where a 'return' statement puts its value - 0 if not in a function
+  JsVar **returnVar;
 
   volatile JsExecFlags execute;
 } JsExecInfo;
 
 /* Info about execution when Parsing - this saves passing it on the stack
  * for each call */
-extern JsExecInfo execInfo;
+extern INSTANCE_LOCAL JsExecInfo execInfo;
 
 /// flags for jspParseFunction
 typedef enum {
@@ -164,6 +195,22 @@ JsVar *jspParse();
  */
 JsVar *jspeFunctionCall(JsVar *function, JsVar *functionName, JsVar *thisArg, bool isParsing, int argCount, JsVar **argPtr);
 
+/// A native function that is being called repeatedly, eg. as the callback for Array.map
+typedef struct {
+  void *ptr;
+  uint16_t argTypes; ///< Actually a list of JsnArgumentType
+  JsVar *thisArg;
+  JsVar *oldThisVar;
+} JspNativeCall;
+
+/** If 'function' is a native function without bound arguments, set 'call' up so that it can
+ * be called with jspNativeCall without all of jspeFunctionCall's checks and setup for each call,
+ * and return true. If so, jspNativeCallEnd must be called afterwards. */
+bool jspNativeCallStart(JspNativeCall *call, JsVar *function, JsVar *thisArg);
+/// Call a function set up with jspNativeCallStart (returns 0 without calling it if we shouldn't be executing)
+JsVar *jspNativeCall(JspNativeCall *call, int argCount, JsVar **argPtr);
+void jspNativeCallEnd(JspNativeCall *call);
+
 
 // Find a variable (or built-in function) based on the current scopes
 JsVar *jspGetNamedVariable(const char *tokenName);
@@ -27,7 +27,7 @@
 // ----------------------------------------------------------------------------
 
 // Whether a pin's state has been set manually or not
-BITFIELD_DECL(jshPinStateIsManual, JSH_PIN_COUNT);
+INSTANCE_LOCAL BITFIELD_DECL(jshPinStateIsManual, JSH_PIN_COUNT);
 
 // ----------------------------------------------------------------------------
 
@@ -44,6 +44,10 @@ int jsspiFastSoftwareFunc(
     return -1;
   }
   JshSPIInfo *inf = (JshSPIInfo*)info;
+#ifdef ESP8266
+  unsigned char byte = (unsigned char)data;
+  jshSPISendSoftware(inf->pinMOSI, inf->pinSCK, &byte, 1);
+#else
   // fast path for common case
   int bit;
   for (bit=7;bit>=0;bit--) {
@@ -51,6 +55,7 @@ int jsspiFastSoftwareFunc(
     jshPinSetValue(inf->pinSCK, 1 );
     jshPinSetValue(inf->pinSCK, 0 );
   }
+#endif
   return 0xFF;
 }
 
@@ -181,7 +186,7 @@ bool jsspiGetSendFunction(
     // Debug
     // jsiConsolePrintf("SPI is software\n");
     JsVar *options = jsvObjectGetChild(spiDevice, DEVICE_OPTIONS_NAME, 0);
-    static JshSPIInfo inf;
+    static INSTANCE_LOCAL JshSPIInfo inf;
     jsspiPopulateSPIInfo(&inf, options);
     jsvUnLock(options);
 
@@ -207,7 +212,23 @@ bool jsspiSend(JsVar *spiDevice, JsSpiSendFlags flags, char *buf, size_t len) {
   spi_sender_data spiSendData;
   if (!jsspiGetSendFunction(spiDevice, &spiSend, &spiSendData))
     return false;
-  // TODO: we could go faster if JSSPI_NO_RECEIVE is set
+  // Hardware SPI can send the whole buffer in one go
+  if (spiSend == jsspiHardwareFunc) {
+    IOEventFlags device = *(IOEventFlags*)&spiSendData;
+    unsigned char *rx = (flags&JSSPI_NO_RECEIVE) ? 0 : (unsigned char *)buf;
+    if (jshSPISendMany(device, (unsigned char *)buf, rx, len)) {
+      if (flags & JSSPI_WAIT) jshSPIWait(device);
+      return true;
+    }
+  }
+#ifdef ESP8266
+  if (spiSend == jsspiFastSoftwareFunc) {
+    jshSPISendSoftware(spiSendData.pinMOSI, spiSendData.pinSCK, (unsigned char *)buf, len);
+    if (!(flags&JSSPI_NO_RECEIVE))
+      memset(buf, 0xFF, len);
+    return true;
+  }
+#endif
 
   size_t txPtr = 0;
   size_t rxPtr = 0;
@@ -19,6 +19,11 @@ typedef int (*spi_sender)(int data, spi_sender_data *info);
 
 bool jsspiPopulateSPIInfo(JshSPIInfo *inf, JsVar *options);
 
+// Send functions for hardware SPI, software SPI in mode 0/MSB/transmit only, and any software SPI
+int jsspiHardwareFunc(int data, spi_sender_data *info);
+int jsspiFastSoftwareFunc(int data, spi_sender_data *info);
+int jsspiSoftwareFunc(int data, spi_sender_data *info);
+
 // Get the correct SPI send function (and the data to send to it)
 bool jsspiGetSendFunction(JsVar *spiDevice, spi_sender *spiSend, spi_sender_data *spiSendData);
 
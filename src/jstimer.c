@@ -15,21 +15,65 @@
 #include "jsparse.h"
 #include "jsinteractive.h"
 
-UtilTimerTask utilTimerTasks[UTILTIMERTASK_TASKS];
-volatile unsigned char utilTimerTasksHead = 0;
-volatile unsigned char utilTimerTasksTail = 0;
+/** A binary heap ordered by time, so utilTimerTasks[0] is always the next task to run. Inserting
+ * and removing is O(log n), and the IRQ can always find the next task straight away. */
+INSTANCE_LOCAL UtilTimerTask utilTimerTasks[UTILTIMERTASK_TASKS];
+INSTANCE_LOCAL volatile unsigned short utilTimerTasksCount = 0;
+
+
+INSTANCE_LOCAL volatile bool utilTimerOn = false;
+INSTANCE_LOCAL unsigned int utilTimerBit;
+INSTANCE_LOCAL bool utilTimerInIRQ = false;
+INSTANCE_LOCAL unsigned int utilTimerData;
+INSTANCE_LOCAL uint16_t utilTimerReload0H, utilTimerReload0L, utilTimerReload1H, utilTimerReload1L;
+
+
+/// Move the task at 'i' towards the root until its parent isn't later than it
+static void CALLED_FROM_INTERRUPT utilTimerSiftUp(unsigned int i) {
+  UtilTimerTask task = utilTimerTasks[i];
+  while (i>0) {
+    unsigned int parent = (i-1)>>1;
+    if (utilTimerTasks[parent].time <= task.time) break;
+    utilTimerTasks[i] = utilTimerTasks[parent];
+    i = parent;
+  }
+  utilTimerTasks[i] = task;
+}
 
+/// Move the task at 'i' away from the root until neither child is earlier than it
+static void CALLED_FROM_INTERRUPT utilTimerSiftDown(unsigned int i) {
+  UtilTimerTask task = utilTimerTasks[i];
+  unsigned int count = utilTimerTasksCount;
+  while (true) {
+    unsigned int child = i*2+1;
+    if (child >= count) break;
+    if (child+1 < count && utilTimerTasks[child+1].time < utilTimerTasks[child].time)
+      child++;
+    if (task.time <= utilTimerTasks[child].time) break;
+    utilTimerTasks[i] = utilTimerTasks[child];
+    i = child;
+  }
+  utilTimerTasks[i] = task;
+}
 
-volatile bool utilTimerOn = false;
-unsigned int utilTimerBit;
-bool utilTimerInIRQ = false;
-unsigned int utilTimerData;
-uint16_t utilTimerReload0H, utilTimerReload0L, utilTimerReload1H, utilTimerReload1L;
+/// The time of the task at 'i' has changed - move it to the right place in the heap
+static void CALLED_FROM_INTERRUPT utilTimerTaskTimeChanged(unsigned int i) {
+  utilTimerSiftDown(i);
+  utilTimerSiftUp(i);
+}
 
+/// Remove the task at 'i', filling the gap with the last task
+static void CALLED_FROM_INTERRUPT utilTimerRemoveTaskAt(unsigned int i) {
+  unsigned int last = --utilTimerTasksCount;
+  if (i != last) {
+    utilTimerTasks[i] = utilTimerTasks[last];
+    utilTimerTaskTimeChanged(i);
+  }
+}
 
 #ifndef SAVE_ON_FLASH
 
-static void jstUtilTimerSetupBuffer(UtilTimerTask *task) {
+static void CALLED_FROM_INTERRUPT jstUtilTimerSetupBuffer(UtilTimerTask *task) {
   task->data.buffer.var = _jsvGetAddressOf(task->data.buffer.currentBuffer);
   if (jsvIsFlatString(task->data.buffer.var)) {
     task->data.buffer.charIdx = sizeof(JsVar);
@@ -40,7 +84,7 @@ static void jstUtilTimerSetupBuffer(UtilTimerTask *task) {
   }
 }
 
-static void jstUtilTimerInterruptHandlerNextByte(UtilTimerTask *task) {
+static void CALLED_FROM_INTERRUPT jstUtilTimerInterruptHandlerNextByte(UtilTimerTask *task) {
   // move to next element in var
   task->data.buffer.charIdx++;
   if (task->data.buffer.charIdx >= task->data.buffer.endIdx) {
@@ -75,13 +119,13 @@ static inline unsigned char *jstUtilTimerInterruptHandlerByte(UtilTimerTask *tas
 }
 #endif
 
-void jstUtilTimerInterruptHandler() {
+void CALLED_FROM_INTERRUPT jstUtilTimerInterruptHandler() {
   if (utilTimerOn) {
     utilTimerInIRQ = true;
     JsSysTime time = jshGetSystemTime();
     // execute any timers that are due
-    while (utilTimerTasksTail!=utilTimerTasksHead && utilTimerTasks[utilTimerTasksTail].time <= time) {
-      UtilTimerTask *task = &utilTimerTasks[utilTimerTasksTail];
+    while (utilTimerTasksCount && utilTimerTasks[0].time <= time) {
+      UtilTimerTask *task = &utilTimerTasks[0];
       void (*executeFn)(JsSysTime time) = 0;
 
       // actually perform the task
@@ -127,11 +171,10 @@ void jstUtilTimerInterruptHandler() {
         jstUtilTimerInterruptHandlerNextByte(task);
         task->data.buffer.currentValue = (unsigned short)sum;
         // now search for other tasks writing to this pin... (polyphony)
-        int t = (utilTimerTasksTail+1) & (UTILTIMERTASK_TASKS-1);
-        while (t!=utilTimerTasksHead) {
+        unsigned int t;
+        for (t=1;t<utilTimerTasksCount;t++) {
           if (UET_IS_BUFFER_WRITE_EVENT(utilTimerTasks[t].type))
             sum += ((int)(unsigned int)utilTimerTasks[t].data.buffer.currentValue) - 32768;
-          t = (t+1) & (UTILTIMERTASK_TASKS-1);
         }
         // saturate
         if (sum<0) sum = 0;
@@ -150,21 +193,11 @@ void jstUtilTimerInterruptHandler() {
         unsigned int t = ((unsigned int)(time+task->repeatInterval - task->time)) / task->repeatInterval;
         if (t<1) t=1;
         task->time = task->time + (JsSysTime)task->repeatInterval*t;
-        // do an in-place bubble sort to ensure that times are still in the right order
-        unsigned char ta = utilTimerTasksTail;
-        unsigned char tb = (ta+1) & (UTILTIMERTASK_TASKS-1);
-        while (tb != utilTimerTasksHead) {
-          if (utilTimerTasks[ta].time > utilTimerTasks[tb].time) {
-            UtilTimerTask task = utilTimerTasks[ta];
-            utilTimerTasks[ta] = utilTimerTasks[tb];
-            utilTimerTasks[tb] = task;
-          }
-          ta = tb;
-          tb = (tb+1) & (UTILTIMERTASK_TASKS-1);
-        }
+        // it's now later, so move it down the heap
+        utilTimerSiftDown(0);
       } else {
         // Otherwise no repeat - just go straight to the next one!
-        utilTimerTasksTail = (utilTimerTasksTail+1) & (UTILTIMERTASK_TASKS-1);
+        utilTimerRemoveTaskAt(0);
       }
 
       // execute the function if we had one (we do this now, because if we did it earlier we'd have to cope with everything changing)
@@ -172,8 +205,8 @@ void jstUtilTimerInterruptHandler() {
     }
 
     // re-schedule the timer if there is something left to do
-    if (utilTimerTasksTail != utilTimerTasksHead) {
-      jshUtilTimerReschedule(utilTimerTasks[utilTimerTasksTail].time - time);
+    if (utilTimerTasksCount) {
+      jshUtilTimerReschedule(utilTimerTasks[0].time - time);
     } else {
       utilTimerOn = false;
       jshUtilTimerDisable();
@@ -196,8 +229,7 @@ void jstUtilTimerWaitEmpty() {
 
 /// Is the timer full - can it accept any other signals?
 static bool utilTimerIsFull() {
-  unsigned char nextHead = (utilTimerTasksHead+1) & (UTILTIMERTASK_TASKS-1);
-  return nextHead == utilTimerTasksTail;
+  return utilTimerTasksCount >= UTILTIMERTASK_TASKS;
 }
 
 // Queue a task up to be executed when a timer fires... return false on failure
@@ -208,30 +240,17 @@ bool utilTimerInsertTask(UtilTimerTask *task) {
 
   if (!utilTimerInIRQ) jshInterruptOff();
 
-  // find out where to insert
-  unsigned char insertPos = utilTimerTasksTail;
-  while (insertPos != utilTimerTasksHead && utilTimerTasks[insertPos].time < task->time)
-    insertPos = (insertPos+1) & (UTILTIMERTASK_TASKS-1);
-
-  bool haveChangedTimer = insertPos==utilTimerTasksTail;
-  //jsiConsolePrintf("Insert at %d, Tail is %d\n",insertPos,utilTimerTasksTail);
-  // shift items forward
-  int i = utilTimerTasksHead;
-  while (i != insertPos) {
-    unsigned char next = (i+UTILTIMERTASK_TASKS-1) & (UTILTIMERTASK_TASKS-1);
-    utilTimerTasks[i] = utilTimerTasks[next];
-    i = next;
-  }
-  // add new item
-  utilTimerTasks[insertPos] = *task;
-  // increase task list size
-  utilTimerTasksHead = (utilTimerTasksHead+1) & (UTILTIMERTASK_TASKS-1);
+  // if this will be the first task, the timer needs setting up for it
+  bool haveChangedTimer = !utilTimerTasksCount || task->time <= utilTimerTasks[0].time;
+  // add to the end of the heap and move it up to where it belongs
+  unsigned int i = utilTimerTasksCount++;
+  utilTimerTasks[i] = *task;
+  utilTimerSiftUp(i);
 
-  //jsiConsolePrint("Head is %d\n", utilTimerTasksHead);
   // now set up timer if not already set up...
   if (!utilTimerOn || haveChangedTimer) {
     utilTimerOn = true;
-    jshUtilTimerStart(utilTimerTasks[utilTimerTasksTail].time - jshGetSystemTime());
+    jshUtilTimerStart(utilTimerTasks[0].time - jshGetSystemTime());
   }
 
   if (!utilTimerInIRQ) jshInterruptOn();
@@ -241,50 +260,33 @@ bool utilTimerInsertTask(UtilTimerTask *task) {
 /// Remove the task that that 'checkCallback' returns true for. Returns false if none found
 bool utilTimerRemoveTask(bool (checkCallback)(UtilTimerTask *task, void* data), void *checkCallbackData) {
   jshInterruptOff();
-  unsigned char ptr = utilTimerTasksHead;
-  if (ptr != utilTimerTasksTail) {
-    unsigned char endPtr = ((utilTimerTasksTail+UTILTIMERTASK_TASKS-1) & (UTILTIMERTASK_TASKS-1));
-    ptr = (ptr+UTILTIMERTASK_TASKS-1) & (UTILTIMERTASK_TASKS-1);
-    // now we're at the last timer task - work back until we've just gone back past utilTimerTasksTail
-    while (ptr != endPtr) {
-      if (checkCallback(&utilTimerTasks[ptr], checkCallbackData)) {
-        // shift tail back along
-        unsigned char next = (ptr+UTILTIMERTASK_TASKS-1) & (UTILTIMERTASK_TASKS-1);
-        while (next!=endPtr) {
-          utilTimerTasks[ptr] = utilTimerTasks[next];
-          ptr = next;
-          next = (ptr+UTILTIMERTASK_TASKS-1) & (UTILTIMERTASK_TASKS-1);
-        }
-        // move 'end' pointer back
-        utilTimerTasksTail = (utilTimerTasksTail+1) & (UTILTIMERTASK_TASKS-1);
-        jshInterruptOn();
-        return true;
-      }
-      ptr = (ptr+UTILTIMERTASK_TASKS-1) & (UTILTIMERTASK_TASKS-1);
+  // search backwards, as later tasks tend to be at the end of the heap
+  unsigned int i = utilTimerTasksCount;
+  while (i--) {
+    if (checkCallback(&utilTimerTasks[i], checkCallbackData)) {
+      utilTimerRemoveTaskAt(i);
+      jshInterruptOn();
+      return true;
     }
   }
   jshInterruptOn();
   return false;
 }
 
-/// If 'checkCallback' returns true for a task, set 'task' to it and return true. Returns false if none found
+/// If 'checkCallback' returns true for a task, set 'task' to the latest one and return true. Returns false if none found
 bool utilTimerGetLastTask(bool (checkCallback)(UtilTimerTask *task, void* data), void *checkCallbackData, UtilTimerTask *task) {
+  bool found = false;
   jshInterruptOff();
-  unsigned char ptr = utilTimerTasksHead;
-  if (ptr != utilTimerTasksTail) {
-    ptr = (ptr+UTILTIMERTASK_TASKS-1) & (UTILTIMERTASK_TASKS-1);
-    // now we're at the last timer task - work back until we've just gone back past utilTimerTasksTail
-    while (ptr != ((utilTimerTasksTail+UTILTIMERTASK_TASKS-1) & (UTILTIMERTASK_TASKS-1))) {
-      if (checkCallback(&utilTimerTasks[ptr], checkCallbackData)) {
-        *task = utilTimerTasks[ptr];
-        jshInterruptOn();
-        return true;
-      }
-      ptr = (ptr+UTILTIMERTASK_TASKS-1) & (UTILTIMERTASK_TASKS-1);
+  unsigned int i;
+  for (i=0;i<utilTimerTasksCount;i++) {
+    if ((!found || utilTimerTasks[i].time > task->time) &&
+        checkCallback(&utilTimerTasks[i], checkCallbackData)) {
+      *task = utilTimerTasks[i];
+      found = true;
     }
   }
   jshInterruptOn();
-  return false;
+  return found;
 }
 
 // --------------------------------------------------------------------------------------------
@@ -359,8 +361,8 @@ bool jstPinPWM(JsVarFloat freq, JsVarFloat dutyCycle, Pin pin) {
     return false;
   }
   // do calculations...
-  JsSysTime pulseLength = jshGetTimeFromMilliseconds(dutyCycle * 1000.0 / freq);
-  JsSysTime period = jshGetTimeFromMilliseconds(1000.0 / freq);
+  JsSysTime pulseLength = jshGetTimeFromMilliseconds(dutyCycle * 1000 / freq);
+  JsSysTime period = jshGetTimeFromMilliseconds(1000 / freq);
   if (period > 0xFFFFFFFF) {
     jsWarn("Frequency of %f Hz is too slow", freq);
     period = 0xFFFFFFFF;
@@ -368,19 +370,17 @@ bool jstPinPWM(JsVarFloat freq, JsVarFloat dutyCycle, Pin pin) {
 
   // First, search for existing PWM tasks
   UtilTimerTask *ptaskon=0, *ptaskoff=0;
+  unsigned int ptaskoffIdx = 0;
   jshInterruptOff();
-  unsigned char ptr = utilTimerTasksHead;
-  if (ptr != utilTimerTasksTail) {
-    ptr = (ptr+UTILTIMERTASK_TASKS-1) & (UTILTIMERTASK_TASKS-1);
-    // now we're at the last timer task - work back until we've just gone back past utilTimerTasksTail
-    while (ptr != ((utilTimerTasksTail+UTILTIMERTASK_TASKS-1) & (UTILTIMERTASK_TASKS-1))) {
-      if (jstPinTaskChecker(&utilTimerTasks[ptr], (void*)&pin)) {
-        if (utilTimerTasks[ptr].data.set.value)
-          ptaskon = &utilTimerTasks[ptr];
-        else
-          ptaskoff = &utilTimerTasks[ptr];
+  unsigned int i;
+  for (i=0;i<utilTimerTasksCount;i++) {
+    if (jstPinTaskChecker(&utilTimerTasks[i], (void*)&pin)) {
+      if (utilTimerTasks[i].data.set.value) {
+        ptaskon = &utilTimerTasks[i];
+      } else {
+        ptaskoff = &utilTimerTasks[i];
+        ptaskoffIdx = i;
       }
-      ptr = (ptr+UTILTIMERTASK_TASKS-1) & (UTILTIMERTASK_TASKS-1);
     }
   }
   if (ptaskon && ptaskoff) {
@@ -391,6 +391,8 @@ bool jstPinPWM(JsVarFloat freq, JsVarFloat dutyCycle, Pin pin) {
       ptaskoff->time = ptaskon->time + pulseLength - (unsigned int)period;
     ptaskon->repeatInterval = (unsigned int)period;
     ptaskoff->repeatInterval = (unsigned int)period;
+    // keep the heap in order (this may move ptaskon/ptaskoff, so do it last)
+    utilTimerTaskTimeChanged(ptaskoffIdx);
     /* don't bother rescheduling - everything will work out next time
      * the timer fires anyway. */
     // All done - just return!
@@ -416,7 +418,6 @@ bool jstPinPWM(JsVarFloat freq, JsVarFloat dutyCycle, Pin pin) {
   taskoff.type = UET_SET;
   taskon.data.set.pins[0] = pin;
   taskoff.data.set.pins[0] = pin;
-  int i;
   for (i=1;i<UTILTIMERTASK_PIN_COUNT;i++) {
     taskon.data.set.pins[i] = PIN_UNDEFINED;
     taskoff.data.set.pins[i] = PIN_UNDEFINED;
@@ -457,9 +458,9 @@ bool jstSetWakeUp(JsSysTime period) {
   // work out if we're waiting for a timer,
   // and if so, when it's going to be
   jshInterruptOff();
-  if (utilTimerTasksTail!=utilTimerTasksHead) {
+  if (utilTimerTasksCount) {
     hasTimer = true;
-    nextTime = utilTimerTasks[utilTimerTasksTail].time;
+    nextTime = utilTimerTasks[0].time;
   }
   jshInterruptOn();
 
@@ -481,13 +482,12 @@ void jstClearWakeUp() {
   bool removedTimer = false;
   jshInterruptOff();
   // while the first item is a wakeup, remove it
-  while (utilTimerTasksTail!=utilTimerTasksHead &&
-      utilTimerTasks[utilTimerTasksTail].type == UET_WAKEUP) {
-    utilTimerTasksTail = (utilTimerTasksTail+1) & (UTILTIMERTASK_TASKS-1);
+  while (utilTimerTasksCount && utilTimerTasks[0].type == UET_WAKEUP) {
+    utilTimerRemoveTaskAt(0);
     removedTimer = true;
   }
   // if the queue is now empty, and we stop the timer
-  if (utilTimerTasksTail==utilTimerTasksHead && removedTimer)
+  if (!utilTimerTasksCount && removedTimer)
     jshUtilTimerDisable();
   jshInterruptOn();
 }
@@ -506,7 +506,8 @@ bool jstStartSignal(JsSysTime startTime, JsSysTime period, Pin pin, JsVar *curre
     task.data.buffer.pinFunction = jshGetCurrentPinFunction(pin);
     if (!task.data.buffer.pinFunction) return false; // no pin function found...
   } else if (UET_IS_BUFFER_READ_EVENT(type)) {
-#ifndef LINUX
+#if !defined(LINUX) && !defined(ESP8266)
+    // (the ESP8266's one ADC input isn't on a GPIO - jshPinAnalogFast reads it for any pin)
     if (pinInfo[pin].analog == JSH_ANALOG_NONE) return false; // no analog...
 #endif
     task.data.buffer.pin = pin;
@@ -539,22 +540,31 @@ bool jstStopBufferTimerTask(JsVar *var) {
 
 void jstReset() {
   jshUtilTimerDisable();
-  utilTimerTasksTail = utilTimerTasksHead = 0;
+  utilTimerTasksCount = 0;
 }
 
 void jstDumpUtilityTimers() {
   int i;
   UtilTimerTask uTimerTasks[UTILTIMERTASK_TASKS];
   jshInterruptOff();
-  for (i=0;i<UTILTIMERTASK_TASKS;i++)
+  unsigned int uTimerTasksCount = utilTimerTasksCount;
+  for (i=0;i<(int)uTimerTasksCount;i++)
     uTimerTasks[i] = utilTimerTasks[i];
-  unsigned char uTimerTasksHead = utilTimerTasksHead;
-  unsigned char uTimerTasksTail = utilTimerTasksTail;
   jshInterruptOn();
+  // the heap is only partly sorted, so sort our copy to print it in order
+  unsigned int t;
+  for (t=1;t<uTimerTasksCount;t++) {
+    UtilTimerTask task = uTimerTasks[t];
+    i = (int)t;
+    while (i>0 && uTimerTasks[i-1].time > task.time) {
+      uTimerTasks[i] = uTimerTasks[i-1];
+      i--;
+    }
+    uTimerTasks[i] = task;
+  }
 
-  unsigned char t = uTimerTasksTail;
   bool hadTimers = false;
-  while (t!=uTimerTasksHead) {
+  for (t=0;t<uTimerTasksCount;t++) {
     hadTimers = true;
 
     UtilTimerTask task = uTimerTasks[t];
@@ -578,8 +588,6 @@ void jstDumpUtilityTimers() {
     case UET_EXECUTE : jsiConsolePrintf("EXECUTE %x\n", task.data.execute); break;
     default : jsiConsolePrintf("Unknown type %d\n", task.type); break;
     }
-
-    t = (t+1) & (UTILTIMERTASK_TASKS-1);
   }
   if (!hadTimers)
       jsiConsolePrintf("No Timers found.\n");
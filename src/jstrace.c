@@ -0,0 +1,102 @@
+/*
+ * This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+ *
+ * Copyright (C) 2013 Gordon Williams <gw@pur3.co.uk>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * ----------------------------------------------------------------------------
+ * Timing trace points, built in with 'make TRACE=1'
+ * ----------------------------------------------------------------------------
+ */
+#include "jstrace.h"
+#include "jshardware.h"
+#include "jsvariterator.h"
+
+#ifndef JSTRACE_SIZE
+#define JSTRACE_SIZE 256 // records - must be a power of 2
+#endif
+
+typedef struct {
+  uint32_t time; ///< low 32 bits of jshGetSystemTime - only differences are used
+  uint16_t id;   ///< JsTraceId
+  uint16_t arg;
+} PACKED_FLAGS JsTraceRecord;
+
+static INSTANCE_LOCAL JsTraceRecord jstraceBuffer[JSTRACE_SIZE];
+static INSTANCE_LOCAL volatile unsigned int jstraceHead = 0; ///< total records written (index is head&(JSTRACE_SIZE-1))
+static INSTANCE_LOCAL volatile bool jstracePaused = false;
+
+static const char *jstraceNames[JST_COUNT] = {
+  "idle","idle",
+  "io","io",
+  "timers","timers",
+  "timer","timer",
+  "libIdle","libIdle",
+  "events","events",
+  "gc","gc",
+  "ioEvent",
+  "netRecv",
+  "netSent",
+};
+/// Chrome trace phase - B=begin, E=end, i=instant
+static const char jstracePhases[JST_COUNT+1] = "BEBEBEBEBEBEBEiii";
+
+void CALLED_FROM_INTERRUPT jstraceAdd(JsTraceId id, unsigned int arg) {
+  if (jstracePaused) return;
+  uint32_t time = (uint32_t)jshGetSystemTime();
+  jshInterruptOff();
+  JsTraceRecord *r = &jstraceBuffer[jstraceHead & (JSTRACE_SIZE-1)];
+  jstraceHead++;
+  jshInterruptOn();
+  r->time = time;
+  r->id = (uint16_t)id;
+  r->arg = (uint16_t)arg;
+}
+
+JsVar *jstraceGet(bool clear) {
+  // stop recording while we read, or allocating the result (and GC) would add to the buffer
+  jstracePaused = true;
+  unsigned int head = jstraceHead;
+  unsigned int count = head<JSTRACE_SIZE ? head : JSTRACE_SIZE;
+  unsigned int first = head - count;
+
+  JsVar *result = jsvNewObject();
+  if (!result) {
+    jstracePaused = false;
+    return 0;
+  }
+  JsVar *names = jsvNewEmptyArray();
+  if (names) {
+    int i;
+    for (i=0;i<JST_COUNT;i++)
+      jsvArrayPushAndUnLock(names, jsvNewFromString(jstraceNames[i]));
+  }
+  jsvObjectSetChildAndUnLock(result, "names", names);
+  jsvObjectSetChildAndUnLock(result, "phases", jsvNewFromString(jstracePhases));
+  // two words per record: microseconds since the first record, then (id<<16)|arg
+  JsVar *trace = jsvNewTypedArray(ARRAYBUFFERVIEW_UINT32, (JsVarInt)count*2);
+  if (trace) {
+    uint32_t startTime = jstraceBuffer[first & (JSTRACE_SIZE-1)].time;
+    JsvArrayBufferIterator it;
+    jsvArrayBufferIteratorNew(&it, trace, 0);
+    unsigned int i;
+    for (i=first;i<head;i++) {
+      JsTraceRecord *r = &jstraceBuffer[i & (JSTRACE_SIZE-1)];
+      // subtract as uint32_t so a wrap of the low 32 bits doesn't matter
+      JsSysTime delta = (JsSysTime)(uint32_t)(r->time - startTime);
+      jsvArrayBufferIteratorSetIntegerValue(&it, (JsVarInt)(jshGetMillisecondsFromTime(delta)*1000));
+      jsvArrayBufferIteratorNext(&it);
+      jsvArrayBufferIteratorSetIntegerValue(&it, (JsVarInt)(((uint32_t)r->id<<16) | r->arg));
+      jsvArrayBufferIteratorNext(&it);
+    }
+    jsvArrayBufferIteratorFree(&it);
+  }
+  jsvObjectSetChildAndUnLock(result, "trace", trace);
+
+  if (clear) jstraceHead = 0;
+  jstracePaused = false;
+  return result;
+}
@@ -0,0 +1,59 @@
+/*
+ * This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+ *
+ * Copyright (C) 2013 Gordon Williams <gw@pur3.co.uk>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * ----------------------------------------------------------------------------
+ * Timing trace points, built in with 'make TRACE=1'
+ *
+ * Each JSTRACE() writes a small binary record (time, id, arg) into a ring
+ * buffer in RAM, which can be read with E.getTrace() and converted for
+ * chrome://tracing with scripts/trace_to_chrome.js. When USE_TRACE isn't
+ * defined JSTRACE() compiles to nothing.
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef JSTRACE_H
+#define JSTRACE_H
+
+#include "jsutils.h"
+#include "jsvar.h"
+
+/// What happened. Keep in step with the names and phases in jstrace.c
+typedef enum {
+  JST_IDLE_BEGIN,    ///< jsiIdle started
+  JST_IDLE_END,      ///< jsiIdle finished, and we're about to sleep
+  JST_IO_BEGIN,      ///< started handling the IO queue
+  JST_IO_END,
+  JST_TIMERS_BEGIN,  ///< started checking timers
+  JST_TIMERS_END,
+  JST_TIMER_BEGIN,   ///< running a timer or watch callback (arg=1 for a watch)
+  JST_TIMER_END,
+  JST_LIBIDLE_BEGIN, ///< started the libraries' idle handlers (jswIdle)
+  JST_LIBIDLE_END,
+  JST_EVENTS_BEGIN,  ///< started executing queued events
+  JST_EVENTS_END,
+  JST_GC_BEGIN,      ///< garbage collection started (arg=1 for an incremental slice)
+  JST_GC_END,
+  JST_IO_EVENT,      ///< jshPushIOEvent (arg=channel)
+  JST_NET_RECV,      ///< ESP8266 received data (arg=bytes)
+  JST_NET_SENT,      ///< ESP8266 finished sending
+  JST_COUNT
+} PACKED_FLAGS JsTraceId;
+
+#ifdef USE_TRACE
+/// Add a record to the trace buffer - can be called from an IRQ
+void jstraceAdd(JsTraceId id, unsigned int arg);
+/// Return the trace as a JS object (see E.getTrace), optionally clearing it
+JsVar *jstraceGet(bool clear);
+
+#define JSTRACE(id, arg) jstraceAdd(id, (unsigned int)(arg))
+#else
+#define JSTRACE(id, arg) do { } while(0)
+#endif
+
+#endif // JSTRACE_H
@@ -21,7 +21,7 @@
 
 /** Error flags for things that we don't really want to report on the console,
  * but which are good to know about */
-JsErrorFlags jsErrorFlags;
+INSTANCE_LOCAL JsErrorFlags jsErrorFlags;
 
 
 bool isWhitespace(char ch) {
@@ -70,7 +70,7 @@ const char *escapeCharacter(char ch) {
   if (ch=='\t') return "\\t";
   if (ch=='\\') return "\\\\";
   if (ch=='"') return "\\\"";
-  static char buf[5];
+  static INSTANCE_LOCAL char buf[5];
   if (ch<32 || ch>=127) {
     /** just encode as hex - it's more understandable
      * and doesn't have the issue of "\16"+"1" != "\161" */
@@ -333,7 +333,7 @@ NO_INLINE void jsExceptionHere_flash(JsExceptionType type, const char *ffmt, ...
 #endif
 
 NO_INLINE void jsAssertFail(const char *file, int line, const char *expr) {
-  static bool inAssertFail = false;
+  static INSTANCE_LOCAL bool inAssertFail = false;
   bool wasInAssertFail = inAssertFail;
   inAssertFail = true;
   jsiConsoleRemoveInputLine();
@@ -466,6 +466,22 @@ unsigned char *flash_memcpy(unsigned char *dst, const unsigned char *src, size_t
 #endif
 
 
+#ifdef USE_FLOATS
+/// Powers of 10 that can be stored exactly in a float
+static const JsVarFloat floatPowersOf10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10
+};
+#else
+/// Powers of 10 that can be stored exactly in a double
+static const JsVarFloat floatPowersOf10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+#endif
+#define FLOAT_POWERS_OF_10 22
+/// Once the mantissa is this big we stop adding digits to it (so it can't overflow)
+#define FLOAT_PARSE_MANTISSA_MAX 100000000000000000ULL
+
 /**
  * Convert a string to a JS float variable where the string is of a specific radix.
  * \return A JS float variable.
@@ -492,27 +508,29 @@ JsVarFloat stringToFloatWithRadix(
 
 
   JsVarFloat v = 0;
-  JsVarFloat mul = 0.1;
-
-  // handle integer part
-  while (*s) {
-    int digit = chtod(*s);
-    if (digit<0 || digit>=radix)
-      break;
-    v = (v*radix) + digit;
-    s++;
-  }
 
   if (radix == 10) {
+    /* Collect the digits in an integer, and the position of the decimal
+     * point in an exponent, then scale by a power of 10 just once at the
+     * end. It's faster (and more accurate) than floating point maths for
+     * every digit. */
+    unsigned long long mantissa = 0;
+    int exponent = 0;
+    while (*s >= '0' && *s <= '9') {
+      if (mantissa < FLOAT_PARSE_MANTISSA_MAX)
+        mantissa = mantissa*10 + (unsigned int)(*s - '0');
+      else
+        exponent++; // too many digits to store - they only affect the scale
+      s++;
+    }
     // handle decimal point
     if (*s == '.') {
       s++; // skip .
-
-      while (*s) {
-        if (*s >= '0' && *s <= '9')
-          v += mul*(*s - '0');
-        else break;
-        mul /= 10;
+      while (*s >= '0' && *s <= '9') {
+        if (mantissa < FLOAT_PARSE_MANTISSA_MAX) {
+          mantissa = mantissa*10 + (unsigned int)(*s - '0');
+          exponent--;
+        }
         s++;
       }
     }
@@ -527,21 +545,36 @@ JsVarFloat stringToFloatWithRadix(
       }
       int e = 0;
       while (*s) {
-        if (*s >= '0' && *s <= '9')
-          e = (e*10) + (*s - '0');
-        else break;
+        if (*s >= '0' && *s <= '9') {
+          if (e < 10000) e = (e*10) + (*s - '0');
+        } else break;
         s++;
       }
       if (isENegated) e=-e;
-      // TODO: faster INTEGER pow? Normal pow has floating point inaccuracies
-      while (e>0) {
-        v*=10;
-        e--;
+      exponent += e;
+    }
+    v = (JsVarFloat)mantissa;
+    if (mantissa) {
+      while (exponent > FLOAT_POWERS_OF_10) {
+        v *= floatPowersOf10[FLOAT_POWERS_OF_10];
+        exponent -= FLOAT_POWERS_OF_10;
       }
-      while (e<0) {
-        v/=10;
-        e++;
+      while (exponent < -FLOAT_POWERS_OF_10) {
+        v /= floatPowersOf10[FLOAT_POWERS_OF_10];
+        exponent += FLOAT_POWERS_OF_10;
       }
+      // dividing by an exact power of 10 rounds correctly, multiplying by the inverse wouldn't
+      if (exponent < 0) v /= floatPowersOf10[-exponent];
+      else v *= floatPowersOf10[exponent];
+    }
+  } else {
+    // handle integer part
+    while (*s) {
+      int digit = chtod(*s);
+      if (digit<0 || digit>=radix)
+        break;
+      v = (v*(JsVarFloat)radix) + (JsVarFloat)digit;
+      s++;
     }
   }
   // check that we managed to parse something at least
@@ -594,7 +627,7 @@ void itostr_extra(JsVarInt vals,char *str,bool signedVal, unsigned int base) {
 }
 
 void ftoa_bounded_extra(JsVarFloat val,char *str, size_t len, int radix, int fractionalDigits) {
-  const JsVarFloat stopAtError = 0.0000001;
+  const JsVarFloat stopAtError = (JsVarFloat)0.0000001;
   if (isnan(val)) strncpy(str,"NaN",len);
   else if (!isfinite(val)) {
     if (val<0) strncpy(str,"-Infinity",len);
@@ -610,23 +643,67 @@ void ftoa_bounded_extra(JsVarFloat val,char *str, size_t len, int radix, int fra
     if (((JsVarInt)(val+stopAtError)) == (1+(JsVarInt)val))
       val = (JsVarFloat)(1+(JsVarInt)val);
 
+#ifndef USE_NO_FLOATS
+    if (radix==10 && fractionalDigits<0 && val<1e15) {
+      /* Fast path: print the integer and fractional parts as integers,
+       * rather than working out each digit with floating point maths. We
+       * print no more significant digits than the float can hold, so
+       * values like 12345.678 don't come out as 12345.67799999999 */
+      unsigned long long intPart = (unsigned long long)val;
+      int intDigits = 0;
+      unsigned long long n;
+      for (n=intPart;n;n/=10) intDigits++;
+      int fracDigits = ((sizeof(JsVarFloat)==4) ? 7 : 15) - intDigits;
+      if (fracDigits > 11) fracDigits = 11;
+      if (fracDigits < 0) fracDigits = 0;
+      unsigned long long fracPart = (unsigned long long)((val - (JsVarFloat)intPart)*floatPowersOf10[fracDigits] + 0.5);
+      if (fracPart >= (unsigned long long)floatPowersOf10[fracDigits]) { // rounded up to the next integer
+        fracPart = 0;
+        intPart++;
+      }
+      while (fracDigits && (fracPart%10)==0) {
+        fracPart /= 10;
+        fracDigits--;
+      }
+      // write the digits backwards into a buffer, then copy them out
+      char buf[32];
+      char *p = &buf[sizeof(buf)];
+      int i;
+      for (i=0;i<fracDigits;i++) {
+        *(--p) = (char)('0' + (int)(fracPart%10));
+        fracPart /= 10;
+      }
+      if (fracDigits) *(--p) = '.';
+      do {
+        *(--p) = (char)('0' + (int)(intPart%10));
+        intPart /= 10;
+      } while (intPart);
+      while (p < &buf[sizeof(buf)]) {
+        if (--len <= 0) { *str=0; return; } // bounds check
+        *(str++) = *(p++);
+      }
+      *str = 0;
+      return;
+    }
+#endif
+
     JsVarFloat d = 1;
-    while (d*radix <= val) d*=radix;
+    while (d*(JsVarFloat)radix <= val) d*=(JsVarFloat)radix;
     while (d >= 1) {
       int v = (int)(val / d);
-      val -= v*d;
+      val -= (JsVarFloat)v*d;
       if (--len <= 0) { *str=0; return; } // bounds check
       *(str++) = itoch(v);
-      d /= radix;
+      d /= (JsVarFloat)radix;
     }
 #ifndef USE_NO_FLOATS
     if (((fractionalDigits<0) && val>0) || fractionalDigits>0) {
       if (--len <= 0) { *str=0; return; } // bounds check
       *(str++)='.';
-      val*=radix;
+      val*=(JsVarFloat)radix;
       while (((fractionalDigits<0) && (fractionalDigits>-12) && (val > stopAtError)) || (fractionalDigits > 0)) {
         int v = (int)(val+((fractionalDigits==1) ? 0.4 : 0.00000001) );
-        val = (val-v)*radix;
+        val = (val-(JsVarFloat)v)*(JsVarFloat)radix;
         if (--len <= 0) { *str=0; return; } // bounds check
         if (v==radix) v=radix-1;
         *(str++)=itoch(v);
@@ -706,29 +783,46 @@ void vcbprintf(
         if (*fmt=='x') { rad=16; fmt++; signedVal = false; }
         itostr_extra(va_arg(argp, JsVarInt), buf, signedVal, rad); user_callback(buf,user_data);
       } break;
-      case 'f': ftoa_bounded(va_arg(argp, JsVarFloat), buf, sizeof(buf)); user_callback(buf,user_data);  break;
+      case 'f': ftoa_bounded((JsVarFloat)va_arg(argp, double/*JsVarFloat*/), buf, sizeof(buf)); user_callback(buf,user_data);  break;
       case 's': user_callback(va_arg(argp, char *), user_data); break;
       case 'c': buf[0]=(char)va_arg(argp, int/*char*/);buf[1]=0; user_callback(buf, user_data); break;
       case 'q':
       case 'v': {
         bool quoted = fmtChar=='q';
         if (quoted) user_callback("\"",user_data);
-        JsVar *v = jsvAsString(va_arg(argp, JsVar*), false/*no unlock*/);
-        buf[1] = 0;
-        if (jsvIsString(v)) {
-          JsvStringIterator it;
-          jsvStringIteratorNew(&it, v, 0);
-          // OPT: this could be faster than it is (sending whole blocks at once)
-          while (jsvStringIteratorHasChar(&it)) {
-            buf[0] = jsvStringIteratorGetChar(&it);
-            if (quoted) {
-              user_callback(escapeCharacter(buf[0]), user_data);
-            } else {
-              user_callback(buf,user_data);
+        JsVar *v = va_arg(argp, JsVar*);
+        const char *constChar = jsvHasCharacterData(v) ? 0 : jsvGetConstString(v);
+        /* Strings (and names) are iterated directly, and simple values are
+         * formatted into buf, so we don't allocate any variables here. Only
+         * objects/arrays/functions need converting with jsvAsString */
+        if (constChar || jsvIsPin(v) || jsvIsInt(v) || jsvIsFloat(v)) {
+          char str[JS_NUMBER_BUFFER_SIZE];
+          if (constChar) strncpy(str, constChar, sizeof(str));
+          else if (jsvIsPin(v)) jshGetPinString(str, (Pin)v->varData.integer);
+          else jsvGetString(v, str, sizeof(str));
+          if (quoted) {
+            const char *c = str;
+            while (*c) user_callback(escapeCharacter(*(c++)), user_data);
+          } else
+            user_callback(str, user_data);
+        } else {
+          v = jsvHasCharacterData(v) ? jsvLockAgain(v) : jsvAsString(v, false/*no unlock*/);
+          buf[1] = 0;
+          if (jsvHasCharacterData(v)) {
+            JsvStringIterator it;
+            jsvStringIteratorNew(&it, v, 0);
+            // OPT: this could be faster than it is (sending whole blocks at once)
+            while (jsvStringIteratorHasChar(&it)) {
+              buf[0] = jsvStringIteratorGetChar(&it);
+              if (quoted) {
+                user_callback(escapeCharacter(buf[0]), user_data);
+              } else {
+                user_callback(buf,user_data);
+              }
+              jsvStringIteratorNext(&it);
             }
-            jsvStringIteratorNext(&it);
+            jsvStringIteratorFree(&it);
           }
-          jsvStringIteratorFree(&it);
           jsvUnLock(v);
         }
         if (quoted) user_callback("\"",user_data);
@@ -802,12 +896,19 @@ int espruino_snprintf( char * s, size_t n, const char * fmt, ... ) {
 extern int LINKER_END_VAR; // should be 'void', but 'int' avoids warnings
 #endif
 
+#ifndef ARM
+INSTANCE_LOCAL char *jsuStackLowest = 0;
+#endif
+
 /** get the amount of free stack we have, in bytes */
 size_t jsuGetFreeStack() {
 #ifdef ARM
   void *frame = __builtin_frame_address(0);
   return (size_t)((char*)&LINKER_END_VAR) - (size_t)((char*)frame);
 #else
+  // we don't know how big the stack is, but remember how deep it has got
+  char *frame = (char*)__builtin_frame_address(0);
+  if (!jsuStackLowest || frame < jsuStackLowest) jsuStackLowest = frame;
   return 100000000; // lots.
 #endif
 }
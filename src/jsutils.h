@@ -100,7 +100,11 @@ int flash_strcmp(const char *mem, const char *flash);
 #endif
 
 
-#if defined(ESP8266)
+#if defined(ESP8266) && defined(ESP8266_EMULATOR)
+/** In the host emulator, code that would be in IRAM goes in a section the linker gives
+    start/stop symbols for, so its flash cache model knows not to count it */
+#define CALLED_FROM_INTERRUPT __attribute__((section("esp8266_iram")))
+#elif defined(ESP8266)
 /** For the esp8266 we need to add CALLED_FROM_INTERRUPT to all functions that may execute at
     interrupt time so they get loaded into static RAM instead of flash. We define
     it as a no-op for everyone else. This is identical the ICACHE_RAM_ATTR used elsewhere. */
@@ -109,6 +113,28 @@ int flash_strcmp(const char *mem, const char *flash);
 #define CALLED_FROM_INTERRUPT
 #endif
 
+#if defined(LINUX) && defined(__GNUC__)
+/** On Linux each thread can run its own interpreter (see `./espruino --threads`), so
+    variables that hold an interpreter's state are marked INSTANCE_LOCAL. It goes after
+    'static' or 'extern' and before anything else. Other targets only ever have one. */
+#define INSTANCE_LOCAL __thread
+#else
+#define INSTANCE_LOCAL
+#endif
+
+#if defined(ESP8266) && defined(IRAM_HOT_PATHS)
+/** Building with IRAM_HOT_PATHS=1 puts the interpreter's hottest functions (marked HOT_PATH)
+    into IRAM (the .iram.hot sections in the linker scripts), so they don't fight WiFi
+    for the flash cache. There's only 32KB of IRAM, so only mark what profiling justifies. */
+#ifdef ESP8266_EMULATOR
+#define HOT_PATH __attribute__((section("esp8266_iram"))) // see CALLED_FROM_INTERRUPT
+#else
+#define HOT_PATH __attribute__((section(".iram.hot.text")))
+#endif
+#else
+#define HOT_PATH
+#endif
+
 
 
 #if !defined(__USB_TYPE_H) && !defined(CPLUSPLUS) && !defined(__cplusplus) // it is defined in this file too!
@@ -126,9 +152,18 @@ int flash_strcmp(const char *mem, const char *flash);
 
 /* Number of Js Variables allowed and Js Reference format.
 
-   JsVarRef = uint8_t -> 15 bytes/JsVar   so JSVAR_CACHE_SIZE = (RAM - 3000) / 15
-   JsVarRef = uint16_t -> 20 bytes/JsVar   so JSVAR_CACHE_SIZE = (RAM - 3000) / 20
-   JsVarRef = uint32_t -> 26 bytes/JsVar   so JSVAR_CACHE_SIZE = (RAM - 3000) / 26
+   On 32 bit platforms:
+
+   <= 254 vars  -> 8 bit refs                   -> 12 bytes/JsVar
+   <= 1023 vars -> 10 bit refs (JSVARREF_PACKED_BITS) -> 12 bytes/JsVar
+   otherwise    -> 16 bit refs                  -> 16 bytes/JsVar
+   RESIZABLE_JSVARS -> 32 bit refs              -> 28 bytes/JsVar
+
+   12 byte JsVars are the smallest we can get while keeping int/float data
+   word aligned, and 10 bit refs are the most that fit in them (the two top
+   bits of lastChild already use the spare bits in the flags). Packed refs
+   cost a little speed as they're read/written by functions - see
+   benchmark/lock_unlock.js
 
    NOTE: JSVAR_CACHE_SIZE must be at least 2 less than the number we can fit in JsVarRef
          See jshardware.c FLASH constants - all this must be able to fit in flash
@@ -206,10 +241,20 @@ int flash_strcmp(const char *mem, const char *flash);
 typedef int32_t JsVarInt;
 typedef uint32_t JsVarIntUnsigned;
 #ifdef USE_FLOATS
+/* Single precision (`USE_FLOATS=1 make`). Faster on FPUs without double
+ * support, but only ~7 significant digits - so integers above 2^24 that
+ * don't fit in JsVarInt, and Date/getTime values, lose precision */
 typedef float JsVarFloat;
 #else
 typedef double JsVarFloat;
 #endif
+#ifdef USE_FLOATS
+#define JSVARFLOAT_MIN 1.17549435e-38f ///< FLT_MIN
+#define JSVARFLOAT_MAX 3.40282347e+38f ///< FLT_MAX
+#else
+#define JSVARFLOAT_MIN DBL_MIN
+#define JSVARFLOAT_MAX DBL_MAX
+#endif
 
 #define JSSYSTIME_MAX 0x7FFFFFFFFFFFFFFFLL
 typedef int64_t JsSysTime;
@@ -223,6 +268,7 @@ typedef int64_t JsSysTime;
 #define JS_VARS_BEFORE_IDLE_GC 32 ///< If we have less free variables than this, do a garbage collect on Idle
 
 #define JSPARSE_MAX_SCOPES  8
+#define JSPARSE_TOKENISE_CALL_COUNT 4 ///< How many times a function is called before we pre-tokenise its code
 
 #define STRINGIFY_HELPER(x) #x
 #define STRINGIFY(x) STRINGIFY_HELPER(x)
@@ -238,9 +284,12 @@ typedef int64_t JsSysTime;
 #define JS_HIDDEN_CHAR_STR "\xFF"
 #define JSPARSE_FUNCTION_CODE_NAME JS_HIDDEN_CHAR_STR"cod" // the function's code!
 #define JSPARSE_FUNCTION_SCOPE_NAME JS_HIDDEN_CHAR_STR"sco" // the scope of the function's definition
+#define JSPARSE_FUNCTION_SCOPE_PARENT_NAME JS_HIDDEN_CHAR_STR"par" // in a function call's scope, the scope of the function's definition
 #define JSPARSE_FUNCTION_THIS_NAME JS_HIDDEN_CHAR_STR"ths" // the 'this' variable - for bound functions
 #define JSPARSE_FUNCTION_NAME_NAME JS_HIDDEN_CHAR_STR"nam" // for named functions (a = function foo() { foo(); })
 #define JSPARSE_FUNCTION_LINENUMBER_NAME JS_HIDDEN_CHAR_STR"lin" // The line number offset of the function
+#define JSPARSE_FUNCTION_TOKENS_NAME JS_HIDDEN_CHAR_STR"tkn" // pre-tokenised code (see jslTokenise)
+#define JSPARSE_FUNCTION_LOCALS_NAME JS_HIDDEN_CHAR_STR"lcl" // names of local variables referred to in pre-tokenised code
 #define JS_EVENT_PREFIX "#on"
 
 #define JSPARSE_EXCEPTION_VAR "except" // when exceptions are thrown, they're stored in the root scope
@@ -268,6 +317,16 @@ typedef int64_t JsSysTime;
 /// Used when we have enums we want to squash down
 #define PACKED_FLAGS  __attribute__ ((__packed__))
 
+/** Ensure that memory accesses before this happen before any after it. Used for
+ * the queues in jsdevices.c, which are written in an IRQ and read in the main loop */
+#if defined(ESP8266)
+#define jshMemoryBarrier() __asm__ __volatile__("memw" : : : "memory")
+#elif defined(__GNUC__)
+#define jshMemoryBarrier() __sync_synchronize()
+#else
+#define jshMemoryBarrier()
+#endif
+
 /// Used before functions that we want to ensure are not inlined (eg. "void NO_INLINE foo() {}")
 #define NO_INLINE __attribute__ ((noinline))
 
@@ -395,11 +454,12 @@ typedef enum {
   JSERR_LOW_MEMORY = 8, ///< Memory is running low - Espruino had to run a garbage collection pass or remove some of the command history
   JSERR_MEMORY = 16, ///< Espruino ran out of memory and was unable to allocate some data that it needed.
   JSERR_MEMORY_BUSY = 32, ///< Espruino was busy doing something with memory (eg. garbage collection) so an IRQ couldn't allocate memory
+  JSERR_CONSOLE_FULL = 64, ///< The console's transmit buffer was full, and output was dropped (see E.setConsoleBlocking)
 } PACKED_FLAGS JsErrorFlags;
 
 /** Error flags for things that we don't really want to report on the console,
  * but which are good to know about */
-extern JsErrorFlags jsErrorFlags;
+extern INSTANCE_LOCAL JsErrorFlags jsErrorFlags;
 
 JsVarFloat stringToFloatWithRadix(const char *s, int forceRadix);
 JsVarFloat stringToFloat(const char *str);
@@ -449,5 +509,9 @@ int espruino_snprintf( char * s, size_t n, const char * fmt, ... );
 
 /** get the amount of free stack we have, in bytes */
 size_t jsuGetFreeStack();
+#ifndef ARM
+/// The lowest stack frame jsuGetFreeStack has been called from (for measuring stack use)
+extern INSTANCE_LOCAL char *jsuStackLowest;
+#endif
 
 #endif /* JSUTILS_H_ */
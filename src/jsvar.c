@@ -20,6 +20,7 @@
 #include "jswrap_math.h" // for jswrap_math_mod
 #include "jswrap_object.h" // for jswrap_object_toString
 #include "jswrap_arraybuffer.h" // for jsvNewTypedArray
+#include "jstrace.h"
 
 #ifdef DEBUG
   /** When freeing, clear the references (nextChild/etc) in the JsVar.
@@ -36,17 +37,106 @@
  */
 
 #ifdef RESIZABLE_JSVARS
-JsVar **jsVarBlocks = 0;
-unsigned int jsVarsSize = 0;
+INSTANCE_LOCAL JsVar **jsVarBlocks = 0;
+INSTANCE_LOCAL unsigned int jsVarsSize = 0;
 #define JSVAR_BLOCK_SIZE 4096
 #define JSVAR_BLOCK_SHIFT 12
+#elif defined(JSVAR_MALLOC)
+/* The variables are allocated by jsvInit, with jsvSetMemoryTotal setting
+ * how many beforehand (up to JSVAR_CACHE_SIZE, which sets the size of refs) */
+INSTANCE_LOCAL JsVar *jsVars = NULL;
+INSTANCE_LOCAL unsigned int jsVarsSize = JSVAR_CACHE_SIZE;
 #else
 JsVar jsVars[JSVAR_CACHE_SIZE];
-unsigned int jsVarsSize = JSVAR_CACHE_SIZE;
+INSTANCE_LOCAL unsigned int jsVarsSize = JSVAR_CACHE_SIZE;
 #endif
 
-volatile JsVarRef jsVarFirstEmpty; ///< reference of first unused variable (variables are in a linked list)
-volatile bool isMemoryBusy; ///< Are we doing garbage collection or similar, so can't access memory?
+INSTANCE_LOCAL volatile JsVarRef jsVarFirstEmpty; ///< reference of first unused variable (variables are in a linked list)
+INSTANCE_LOCAL volatile bool isMemoryBusy; ///< Are we doing garbage collection or similar, so can't access memory?
+
+#ifndef SAVE_ON_FLASH
+/// State of the incremental garbage collector - see jsvGarbageCollectIncremental
+typedef enum {
+  JSVGC_IDLE,   ///< Not collecting
+  JSVGC_MARK,   ///< Scanning through memory marking children of things that are used
+  JSVGC_UNLINK, ///< Unreferencing used vars that unused ones point to
+  JSVGC_SWEEP,  ///< Freeing everything that wasn't marked
+} JsvGCState;
+static INSTANCE_LOCAL JsvGCState jsvGCState = JSVGC_IDLE;
+static INSTANCE_LOCAL JsVarRef jsvGCPos; ///< Where we are in the current pass over memory
+static INSTANCE_LOCAL bool jsvGCMarkChanged; ///< Did we mark any new vars in this pass?
+INSTANCE_LOCAL bool jsvGCIncremental = false;
+
+/* The name of the last element found by jsvFindArrayChild in each of the
+ * most recently used arrays, so that accessing elements in order (or near
+ * each other) doesn't have to search from one end of the array each time.
+ * There's no space for this in the array var itself, so it's kept here, with
+ * a few entries so loops like 'c[i]=a[i]+b[i]' don't keep evicting each
+ * other. Entries are cleared if their name is freed. */
+#define JSV_ARRAY_CURSORS 4
+typedef struct {
+  JsVarRef parent;
+  JsVarRef child;
+} JsvArrayCursor;
+static INSTANCE_LOCAL JsvArrayCursor jsvArrayCursors[JSV_ARRAY_CURSORS];
+static INSTANCE_LOCAL unsigned char jsvArrayCursorNext; ///< the entry to replace next
+
+/* Where we know blocks of recently used long strings are, so we don't have to
+ * walk every block from the start of the string each time:
+ *  - 'block' is where jsvStringIteratorNew last seeked to, so seeking forwards
+ *    again (eg. 'str.charCodeAt(i)' in a loop) can start from there.
+ *  - 'tail' is the last block when we last appended to the string or got its
+ *    length, so building up a long string a bit at a time ('s += x' in a loop)
+ *    or checking 's.length' only has to walk what has been added since.
+ * Blocks can't be removed from a string without being freed, so these are
+ * cleared if either the string or the block is freed. */
+#define JSV_STRING_HINTS 4
+/// Don't bother remembering blocks near the start of a string - walking to them is quick
+#define JSV_STRING_HINT_MIN_INDEX (JSVAR_DATA_STRING_MAX_LEN*3)
+typedef struct {
+  JsVarRef str;
+  JsVarRef block;
+  JsVarRef tail;
+  size_t blockIndex; ///< index in the string of the first character in block
+  size_t tailIndex; ///< index in the string of the first character in tail
+} JsvStringHint;
+static INSTANCE_LOCAL JsvStringHint jsvStringHints[JSV_STRING_HINTS];
+static INSTANCE_LOCAL unsigned char jsvStringHintNext; ///< the entry to replace next
+INSTANCE_LOCAL JsSysTime jsvGCSliceTime = 0;
+#endif
+
+/* Names of the children of freed objects and arrays, linked with nextSibling,
+ * that are waiting to be unreferenced (see jsvFreePtr). Freeing them from here
+ * one at a time rather than recursively means freeing a deeply nested
+ * structure can't overflow the stack, and (with incremental GC) freeing a big
+ * one can be spread over several idle loops so it doesn't stall callbacks. */
+static INSTANCE_LOCAL JsVarRef jsvFreeQueueFirst;
+static INSTANCE_LOCAL JsVarRef jsvFreeQueueLast;
+static INSTANCE_LOCAL bool jsvFreeQueueBusy; ///< Are we already emptying the free queue further up the stack?
+#ifndef SAVE_ON_FLASH
+/// With incremental GC, how many names to free in one go before leaving the rest for jsiIdle
+#define JSV_FREE_QUEUE_SLICE 64
+#endif
+
+INSTANCE_LOCAL unsigned int jsvGCCount = 0;
+#ifndef SAVE_ON_FLASH
+INSTANCE_LOCAL unsigned int jsvAllocCount = 0;
+INSTANCE_LOCAL unsigned int jsvLowMemoryThreshold = 0;
+volatile JsvLowMemoryState jsvLowMemoryState = JSV_LOWMEM_ARMED;
+INSTANCE_LOCAL unsigned int jsvDefragCount = 0;
+#endif
+
+#ifdef ALLOC_PROFILE
+INSTANCE_LOCAL JsvAllocSite jsvAllocSites[JSV_ALLOC_PROFILE_SITES];
+INSTANCE_LOCAL unsigned int jsvAllocUsed; ///< How many vars are in use
+INSTANCE_LOCAL unsigned int jsvAllocPeak; ///< The most vars that have been in use at once
+static INSTANCE_LOCAL unsigned char jsvAllocSite; ///< Index in jsvAllocSites of what is currently executing
+#ifdef RESIZABLE_JSVARS
+static INSTANCE_LOCAL unsigned char *jsvAllocTags = 0; ///< For each var, the index of the site that allocated it
+#else
+static INSTANCE_LOCAL unsigned char jsvAllocTags[JSVAR_CACHE_SIZE];
+#endif
+#endif
 
 // ----------------------------------------------------------------------------
 // ----------------------------------------------------------------------------
@@ -62,6 +152,7 @@ ALWAYS_INLINE bool jsvIsBasicString(const JsVar *v) { return v && (v->flags&JSV_
 ALWAYS_INLINE bool jsvIsStringExt(const JsVar *v) { return v && (v->flags&JSV_VARTYPEMASK)>=JSV_STRING_EXT_0 && (v->flags&JSV_VARTYPEMASK)<=JSV_STRING_EXT_MAX; } ///< The extra bits dumped onto the end of a string to store more data
 ALWAYS_INLINE bool jsvIsFlatString(const JsVar *v) { return v && (v->flags&JSV_VARTYPEMASK)==JSV_FLAT_STRING; }
 ALWAYS_INLINE bool jsvIsNativeString(const JsVar *v) { return v && (v->flags&JSV_VARTYPEMASK)==JSV_NATIVE_STRING; }
+ALWAYS_INLINE bool jsvIsStringView(const JsVar *v) { return jsvIsNativeString(v) && jsvGetFirstChild(v); }
 ALWAYS_INLINE bool jsvIsNumeric(const JsVar *v) { return v && (v->flags&JSV_VARTYPEMASK)>=_JSV_NUMERIC_START && (v->flags&JSV_VARTYPEMASK)<=_JSV_NUMERIC_END; }
 ALWAYS_INLINE bool jsvIsFunction(const JsVar *v) { return v && ((v->flags&JSV_VARTYPEMASK)==JSV_FUNCTION || (v->flags&JSV_VARTYPEMASK)==JSV_FUNCTION_RETURN); }
 ALWAYS_INLINE bool jsvIsFunctionReturn(const JsVar *v) { return v && ((v->flags&JSV_VARTYPEMASK)==JSV_FUNCTION_RETURN); } ///< Is this a function with an implicit 'return' at the start?
@@ -116,6 +207,60 @@ JsVar *_jsvGetAddressOf(JsVarRef ref) {
   return jsvGetAddressOf(ref);
 }
 
+#ifdef ALLOC_PROFILE
+/// Record that a var has been allocated by whatever is executing
+static void jsvAllocProfileAlloc(JsVarRef ref) {
+  JsvAllocSite *site = &jsvAllocSites[jsvAllocSite];
+  jsvAllocTags[ref-1] = jsvAllocSite;
+  site->allocs++;
+  if (++site->live > site->peak) site->peak = site->live;
+  if (++jsvAllocUsed > jsvAllocPeak) jsvAllocPeak = jsvAllocUsed;
+}
+
+/// Record that a var has been freed
+static void jsvAllocProfileFree(JsVarRef ref) {
+  JsvAllocSite *site = &jsvAllocSites[jsvAllocTags[ref-1]];
+  if (site->live) site->live--;
+  if (jsvAllocUsed) jsvAllocUsed--;
+}
+
+/// Resize the tag array to match the amount of vars we have
+static void jsvAllocProfileResize(unsigned int oldSize) {
+#ifdef RESIZABLE_JSVARS
+  jsvAllocTags = realloc(jsvAllocTags, jsVarsSize);
+  memset(&jsvAllocTags[oldSize], 0, jsVarsSize-oldSize);
+#else
+  NOT_USED(oldSize);
+#endif
+}
+
+/** Start attributing allocations to the given key (a native function pointer
+ * or a JS function's ref). Returns the old site, for jsvAllocProfileLeave */
+unsigned char jsvAllocProfileEnter(size_t key, JsVar *name) {
+  unsigned char old = jsvAllocSite;
+  unsigned char i;
+  // 0 is 'global' and the last entry is 'other', for when we've run out
+  for (i=1;i<JSV_ALLOC_PROFILE_SITES-1;i++) {
+    if (jsvAllocSites[i].key == key) break;
+    if (!jsvAllocSites[i].key) {
+      jsvAllocSites[i].key = key;
+      if (name)
+        jsvGetString(name, jsvAllocSites[i].name, sizeof(jsvAllocSites[i].name));
+      else
+        strncpy(jsvAllocSites[i].name, "anonymous", sizeof(jsvAllocSites[i].name));
+      break;
+    }
+  }
+  jsvAllocSite = i;
+  return old;
+}
+
+/// Go back to attributing allocations to the site before jsvAllocProfileEnter
+void jsvAllocProfileLeave(unsigned char site) {
+  jsvAllocSite = site;
+}
+#endif
+
 #ifdef JSVARREF_PACKED_BITS
 #define JSVARREF_PACKED_BIT_MASK ((1U<<JSVARREF_PACKED_BITS)-1)
 JsVarRef jsvGetFirstChild(const JsVar *v) { return (JsVarRef)(v->varData.ref.firstChild | (((v->varData.ref.pack)&JSVARREF_PACKED_BIT_MASK))<<8); }
@@ -206,11 +351,51 @@ void jsvClearEmptyVarList() {
   isMemoryBusy = false;
 }
 
+#ifndef SAVE_ON_FLASH
+/** String views point into memory that may be somewhere else when they are
+ * loaded back, so for saving we store them as an offset from the start of the
+ * string they're a view of. toOffset=false turns them back into pointers. */
+static void jsvStringViewsRelocate(bool toOffset) {
+  JsVarRef i;
+  for (i=1;i<=jsVarsSize;i++)  {
+    JsVar *var = jsvGetAddressOf(i);
+    if (jsvIsStringView(var)) {
+      size_t base = (size_t)jsvGetFlatStringPointer(jsvGetAddressOf(jsvGetFirstChild(var)));
+      var->varData.nativeStr.ptr = (char*)(toOffset ?
+          (size_t)var->varData.nativeStr.ptr - base :
+          (size_t)var->varData.nativeStr.ptr + base);
+    } else if (jsvIsFlatString(var)) {
+      i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
+    }
+  }
+}
+#endif
+
 void jsvSoftInit() {
   jsvCreateEmptyVarList();
+  jsvFreeQueueFirst = 0;
+  jsvFreeQueueLast = 0;
+#ifndef SAVE_ON_FLASH
+  memset(jsvStringHints, 0, sizeof(jsvStringHints)); // memory may have been loaded from flash
+#endif
+#ifndef SAVE_ON_FLASH
+  jsvStringViewsRelocate(false);
+#endif
+#ifdef ALLOC_PROFILE
+  // we don't know who allocated anything that's already here (eg. loaded from flash)
+  memset(jsvAllocTags, 0, jsVarsSize);
+  jsvAllocUsed = jsvGetMemoryUsage();
+  jsvAllocSites[0].live = jsvAllocUsed;
+#endif
+#ifndef SAVE_ON_FLASH
+  jsvLookupCacheInvalidate(0); // memory may have been loaded from flash
+#endif
 }
 
 void jsvSoftKill() {
+#ifndef SAVE_ON_FLASH
+  jsvStringViewsRelocate(true);
+#endif
   jsvClearEmptyVarList();
 }
 
@@ -234,9 +419,23 @@ void jsvInit() {
   jsVarsSize = JSVAR_BLOCK_SIZE;
   jsVarBlocks = malloc(sizeof(JsVar*)); // just 1
   jsVarBlocks[0] = malloc(sizeof(JsVar) * JSVAR_BLOCK_SIZE);
+#elif defined(JSVAR_MALLOC)
+  // Only allocated once - a reset reuses the same variables
+  while (!jsVars && jsVarsSize) {
+    jsVars = (JsVar *)malloc(sizeof(JsVar) * jsVarsSize);
+    if (!jsVars) jsVarsSize -= jsVarsSize/8+1; // not enough heap - try with fewer
+  }
 #endif
 
   jsVarFirstEmpty = jsvInitJsVars(1/*first*/, jsVarsSize);
+#ifdef ALLOC_PROFILE
+  memset(jsvAllocSites, 0, sizeof(jsvAllocSites));
+  strncpy(jsvAllocSites[0].name, "global", sizeof(jsvAllocSites[0].name));
+  strncpy(jsvAllocSites[JSV_ALLOC_PROFILE_SITES-1].name, "other", sizeof(jsvAllocSites[0].name));
+  jsvAllocSite = 0;
+  jsvAllocPeak = 0;
+  jsvAllocProfileResize(0);
+#endif
   jsvSoftInit();
 }
 
@@ -248,6 +447,10 @@ void jsvKill() {
   free(jsVarBlocks);
   jsVarBlocks = 0;
   jsVarsSize = 0;
+#ifdef ALLOC_PROFILE
+  free(jsvAllocTags);
+  jsvAllocTags = 0;
+#endif
 #endif
 }
 
@@ -289,8 +492,8 @@ unsigned int jsvGetMemoryTotal() {
 void jsvSetMemoryTotal(unsigned int jsNewVarCount) {
 #ifdef RESIZABLE_JSVARS
   assert(!isMemoryBusy);
-  isMemoryBusy = true;
   if (jsNewVarCount <= jsVarsSize) return; // never allow us to have less!
+  isMemoryBusy = true;
   // When resizing, we just allocate a bunch more
   unsigned int oldSize = jsVarsSize;
   unsigned int oldBlockCount = jsVarsSize >> JSVAR_BLOCK_SHIFT;
@@ -306,8 +509,16 @@ void jsvSetMemoryTotal(unsigned int jsNewVarCount) {
    * is 0 (because jsiFreeMoreMemory returned 0) so we can just assign it.  */
   assert(!jsVarFirstEmpty);
   jsVarFirstEmpty = jsvInitJsVars(oldSize+1, jsVarsSize-oldSize);
+#ifdef ALLOC_PROFILE
+  jsvAllocProfileResize(oldSize);
+#endif
   // jsiConsolePrintf("Resized memory from %d blocks to %d\n", oldBlockCount, newBlockCount);
   isMemoryBusy = false;
+#elif defined(JSVAR_MALLOC)
+  // This can only be done before jsvInit allocates the variables
+  assert(!jsVars);
+  if (jsNewVarCount > JSVAR_CACHE_SIZE) jsNewVarCount = JSVAR_CACHE_SIZE;
+  jsVarsSize = jsNewVarCount;
 #else
   NOT_USED(jsNewVarCount);
   assert(0);
@@ -343,6 +554,57 @@ void jsvShowAllocated() {
   }
 }
 
+#ifndef SAVE_ON_FLASH
+const char *jsvMemoryMapTypeNames[JSVM_TYPES] = {
+  "name", "string", "flatString", "stringExt", "object", "array",
+  "function", "arrayBuffer", "number", "other"
+};
+
+static JsvMemoryMapType jsvGetMemoryMapType(const JsVar *v) {
+  if (jsvIsName(v)) return JSVM_NAME;
+  if (jsvIsFlatString(v)) return JSVM_FLAT_STRING;
+  if (jsvIsString(v)) return JSVM_STRING;
+  if (jsvIsStringExt(v)) return JSVM_STRING_EXT;
+  if (jsvIsArray(v)) return JSVM_ARRAY;
+  if (jsvIsFunction(v)) return JSVM_FUNCTION;
+  if (jsvIsArrayBuffer(v)) return JSVM_ARRAYBUFFER;
+  if (jsvIsObject(v)) return JSVM_OBJECT;
+  if (jsvIsNumeric(v) || jsvIsBoolean(v)) return JSVM_NUMBER;
+  return JSVM_OTHER;
+}
+
+/** Scan through all of memory, finding runs of free blocks (which is what
+ * jsvNewFlatStringOfLength needs) and how many blocks each type uses */
+void jsvGetMemoryMap(JsvMemoryMap *map) {
+  memset(map, 0, sizeof(JsvMemoryMap));
+  unsigned int run = 0;
+  unsigned int i;
+  for (i=1;i<=jsVarsSize+1;i++) {
+    JsVar *v = i<=jsVarsSize ? jsvGetAddressOf((JsVarRef)i) : 0;
+    if (v && (v->flags&JSV_VARTYPEMASK) == JSV_UNUSED) {
+      run++;
+      continue;
+    }
+    if (run) {
+      if (run > map->largestFree) map->largestFree = run;
+      int bucket = 0;
+      while (bucket<JSV_MEMORY_MAP_RUNS-1 && (run>>(bucket+1))) bucket++;
+      map->freeRuns[bucket]++;
+      run = 0;
+    }
+    if (!v) break;
+    JsvMemoryMapType type = jsvGetMemoryMapType(v);
+    map->blocks[type]++;
+    if (jsvGetLocks(v)) map->locked++;
+    if (jsvIsFlatString(v)) {
+      unsigned int b = (unsigned int)jsvGetFlatStringBlocks(v);
+      map->blocks[type] += b;
+      i += b;
+    }
+  }
+}
+#endif
+
 bool jsvHasCharacterData(const JsVar *v) {
   return jsvIsString(v) || jsvIsStringExt(v);
 }
@@ -357,7 +619,7 @@ bool jsvHasChildren(const JsVar *v) {
 
 /// Is this variable a type that uses firstChild to point to a single Variable (ie. it doesn't have multiple children)
 bool jsvHasSingleChild(const JsVar *v) {
-  return jsvIsArrayBuffer(v) ||
+  return jsvIsArrayBuffer(v) || jsvIsNativeString(v) ||
       (jsvIsName(v) && !jsvIsNameWithValue(v));
 }
 
@@ -398,10 +660,25 @@ JsVar *jsvNewWithFlags(JsVarFlags flags) {
     } while (!__sync_bool_compare_and_swap(&jsVarFirstEmpty, empty, next));
     assert(v->flags == JSV_UNUSED);*/
     jsvResetVariable(v, flags); // setup variable, and add one lock
+#ifndef SAVE_ON_FLASH
+    jsvAllocCount++;
+    // Walking the free list isn't free, so only check every 64 allocations
+    if (jsvLowMemoryThreshold && !(jsvAllocCount&63) &&
+        jsvLowMemoryState==JSV_LOWMEM_ARMED &&
+        !jsvMoreFreeVariablesThan(jsvLowMemoryThreshold))
+      jsvLowMemoryState = JSV_LOWMEM_PENDING;
+#endif
+#ifdef ALLOC_PROFILE
+    jsvAllocProfileAlloc(jsvGetRef(v));
+#endif
     // return pointer
     return v;
   }
   jsErrorFlags |= JSERR_LOW_MEMORY;
+#ifndef SAVE_ON_FLASH
+  if (jsvLowMemoryState==JSV_LOWMEM_ARMED)
+    jsvLowMemoryState = JSV_LOWMEM_PENDING;
+#endif
   /* we don't have memory - second last hope - run garbage collector */
   if (jsvGarbageCollect()) {
     return jsvNewWithFlags(flags); // if it freed something, continue
@@ -427,7 +704,23 @@ JsVar *jsvNewWithFlags(JsVarFlags flags) {
 
 ALWAYS_INLINE void jsvFreePtrInternal(JsVar *var) {
   assert(jsvGetLocks(var)==0);
+#ifndef SAVE_ON_FLASH
+  int i;
+  for (i=0;i<JSV_ARRAY_CURSORS;i++)
+    if (jsvArrayCursors[i].child == jsvGetRef(var)) jsvArrayCursors[i].parent = 0;
+  if (jsvIsBasicString(var) || jsvIsStringExt(var)) {
+    for (i=0;i<JSV_STRING_HINTS;i++) {
+      JsvStringHint *hint = &jsvStringHints[i];
+      if (hint->str == jsvGetRef(var)) hint->str = 0;
+      if (hint->block == jsvGetRef(var)) hint->block = 0;
+      if (hint->tail == jsvGetRef(var)) hint->tail = 0;
+    }
+  }
+#endif
   var->flags = JSV_UNUSED;
+#ifdef ALLOC_PROFILE
+  jsvAllocProfileFree(jsvGetRef(var));
+#endif
   // add this to our free list
   jshInterruptOff(); // to allow this to be used from an IRQ
   jsvSetNextSibling(var, jsVarFirstEmpty);
@@ -435,6 +728,8 @@ ALWAYS_INLINE void jsvFreePtrInternal(JsVar *var) {
   jshInterruptOn();
 }
 
+static bool jsvFreeQueueFree(unsigned int count, JsSysTime endTime);
+
 ALWAYS_INLINE void jsvFreePtr(JsVar *var) {
   /* To be here, we're not supposed to be part of anything else. If
    * we were, we'd have been freed by jsvGarbageCollect */
@@ -467,6 +762,15 @@ ALWAYS_INLINE void jsvFreePtr(JsVar *var) {
 #ifdef CLEAR_MEMORY_ON_FREE
     jsvSetLastChild(var, 0);
 #endif // CLEAR_MEMORY_ON_FREE
+#ifndef SAVE_ON_FLASH
+    if (stringDataRef && jsvIsName(var) && !jsvIsStringExt(jsvGetAddressOf(stringDataRef))) {
+      // the rest of the name is in a shared string (see jsvInternTable)
+      JsVar *rest = jsvLock(stringDataRef);
+      jsvUnRef(rest);
+      jsvUnLock(rest);
+      stringDataRef = 0;
+    }
+#endif
     while (stringDataRef) {
       JsVar *child = jsvGetAddressOf(stringDataRef);
       assert(jsvIsStringExt(child));
@@ -495,19 +799,24 @@ ALWAYS_INLINE void jsvFreePtr(JsVar *var) {
     can be ints or strings */
 
   if (jsvHasChildren(var)) {
+#ifndef SAVE_ON_FLASH
+    jsvLookupCacheInvalidate(jsvGetRef(var));
+#endif
     JsVarRef childref = jsvGetFirstChild(var);
+    JsVarRef lastref = jsvGetLastChild(var);
 #ifdef CLEAR_MEMORY_ON_FREE
     jsvSetFirstChild(var, 0);
     jsvSetLastChild(var, 0);
 #endif // CLEAR_MEMORY_ON_FREE
-    while (childref) {
-      JsVar *child = jsvLock(childref);
-      assert(jsvIsName(child));
-      childref = jsvGetNextSibling(child);
-      jsvSetPrevSibling(child, 0);
-      jsvSetNextSibling(child, 0);
-      jsvUnRef(child);
-      jsvUnLock(child);
+    if (childref) {
+      // The children are already linked together, so add them all to the free queue
+      jshInterruptOff();
+      if (jsvFreeQueueLast)
+        jsvSetNextSibling(jsvGetAddressOf(jsvFreeQueueLast), childref);
+      else
+        jsvFreeQueueFirst = childref;
+      jsvFreeQueueLast = lastref;
+      jshInterruptOn();
     }
   } else {
 #ifdef CLEAR_MEMORY_ON_FREE
@@ -530,6 +839,45 @@ ALWAYS_INLINE void jsvFreePtr(JsVar *var) {
 
   // free!
   jsvFreePtrInternal(var);
+
+  if (jsvFreeQueueFirst) {
+#ifndef SAVE_ON_FLASH
+    if (jsvGCIncremental)
+      jsvFreeQueueFree(JSV_FREE_QUEUE_SLICE, 0);
+    else
+#endif
+      jsvFreeQueueFree(0, 0);
+  }
+}
+
+/** Unreference the names in the free queue. Stops after 'count' names (if nonzero)
+ * or at endTime (if nonzero). Returns true if there are more left */
+static bool jsvFreeQueueFree(unsigned int count, JsSysTime endTime) {
+  if (jsvFreeQueueBusy) return true;
+  jsvFreeQueueBusy = true;
+  unsigned int n = 0;
+  while (jsvFreeQueueFirst) {
+    n++;
+    if (count && n>count) break;
+    // only check the time every so often, as it may be slow
+    if (endTime && (n&15)==0 && jshGetSystemTime() > endTime) break;
+    jshInterruptOff();
+    JsVar *child = jsvLock(jsvFreeQueueFirst);
+    jsvFreeQueueFirst = jsvGetNextSibling(child);
+    if (!jsvFreeQueueFirst) jsvFreeQueueLast = 0;
+    jshInterruptOn();
+    assert(jsvIsName(child));
+    jsvSetPrevSibling(child, 0);
+    jsvSetNextSibling(child, 0);
+    jsvUnRef(child);
+    jsvUnLock(child); // may free the child's value, adding more to the queue
+  }
+  jsvFreeQueueBusy = false;
+  return jsvFreeQueueFirst!=0;
+}
+
+bool jsvFreeQueueDrain(JsSysTime budget) {
+  return jsvFreeQueueFree(0, budget ? jshGetSystemTime()+budget : 0);
 }
 
 /// Get a reference from a var - SAFE for null vars
@@ -550,9 +898,12 @@ ALWAYS_INLINE JsVarRef jsvGetRef(JsVar *var) {
 }
 
 /// Lock this reference and return a pointer - UNSAFE for null refs
-ALWAYS_INLINE JsVar *jsvLock(JsVarRef ref) {
+ALWAYS_INLINE HOT_PATH JsVar *jsvLock(JsVarRef ref) {
   JsVar *var = jsvGetAddressOf(ref);
   //var->locks++;
+#ifndef SAVE_ON_FLASH
+  if (var->flags & JSV_CONSTANT) return var; // constants are always locked
+#endif
   assert(jsvGetLocks(var) < JSV_LOCK_MAX);
   var->flags += JSV_LOCK_ONE;
 #ifdef DEBUG
@@ -565,8 +916,11 @@ ALWAYS_INLINE JsVar *jsvLock(JsVarRef ref) {
 }
 
 /// Lock this pointer and return a pointer - UNSAFE for null pointer
-ALWAYS_INLINE JsVar *jsvLockAgain(JsVar *var) {
+ALWAYS_INLINE HOT_PATH JsVar *jsvLockAgain(JsVar *var) {
   assert(var);
+#ifndef SAVE_ON_FLASH
+  if (var->flags & JSV_CONSTANT) return var; // constants are always locked
+#endif
   assert(jsvGetLocks(var) < JSV_LOCK_MAX);
   var->flags += JSV_LOCK_ONE;
   return var;
@@ -591,8 +945,11 @@ static NO_INLINE void jsvUnLockFreeIfNeeded(JsVar *var) {
 
 
 /// Unlock this variable - this is SAFE for null variables
-ALWAYS_INLINE void jsvUnLock(JsVar *var) {
+ALWAYS_INLINE HOT_PATH void jsvUnLock(JsVar *var) {
   if (!var) return;
+#ifndef SAVE_ON_FLASH
+  if (var->flags & JSV_CONSTANT) return; // constants are always locked
+#endif
   assert(jsvGetLocks(var)>0);
   var->flags -= JSV_LOCK_ONE;
   // Now see if we can properly free the data
@@ -620,6 +977,14 @@ NO_INLINE void jsvUnLockMany(unsigned int count, JsVar **vars) {
 /// Reference - set this variable as used by something
 JsVar *jsvRef(JsVar *var) {
   assert(var && jsvHasRef(var));
+#ifndef SAVE_ON_FLASH
+  /* If we're part way through marking for the incremental GC, anything that gets
+   * linked to must be marked (we may already have scanned its new parent) */
+  if (jsvGCState==JSVGC_MARK && (var->flags&JSV_GARBAGE_COLLECT)) {
+    var->flags &= (JsVarFlags)~JSV_GARBAGE_COLLECT;
+    jsvGCMarkChanged = true;
+  }
+#endif
   jsvSetRefs(var, (JsVarRefCounter)(jsvGetRefs(var)+1));
   assert(jsvGetRefs(var));
   return var;
@@ -694,6 +1059,18 @@ JsVar *jsvNewFlatStringOfLength(unsigned int byteLength) {
         flatString->varData.integer = (JsVarInt)byteLength;
         // clear data
         memset((char*)&flatString[1], 0, sizeof(JsVar)*(blocks-1));
+#ifndef SAVE_ON_FLASH
+        jsvAllocCount += (unsigned int)blocks;
+#endif
+#ifdef ALLOC_PROFILE
+        for (j=(JsVarRef)(i+1-blocks);j<=i;j++)
+          jsvAllocProfileAlloc(j);
+#endif
+#ifndef SAVE_ON_FLASH
+        // don't let the incremental GC start its next slice inside the string's data
+        if (jsvGCPos>(JsVarRef)(i+1-blocks) && jsvGCPos<=i)
+          jsvGCPos = (JsVarRef)(i+1-blocks);
+#endif
         // break out of the loop, and we'll return 'flatString'
         i++; // we are already at the final block
         break;
@@ -805,17 +1182,83 @@ JsVar *jsvNewStringOfLength(unsigned int byteLength) {
   return first;
 }
 
+#ifndef SAVE_ON_FLASH
+/* Small integers, booleans and null get created all the time (loop counters,
+ * comparisons, etc), so rather than allocating new vars we keep one copy of
+ * each. These are flagged with JSV_CONSTANT so locking them does nothing,
+ * and anything that would modify them (like jsvMakeIntoVariableName)
+ * makes a copy first. They're created by jsvCreateConstants, and the range
+ * is kept small so they don't use up much of a small device's memory. */
+#define JSV_CONSTANT_INT_MIN (-1)
+#define JSV_CONSTANT_INT_MAX 15
+#define JSV_CONSTANT_FALSE (JSV_CONSTANT_INT_MAX+1-JSV_CONSTANT_INT_MIN)
+#define JSV_CONSTANT_TRUE (JSV_CONSTANT_FALSE+1)
+#define JSV_CONSTANT_NULL (JSV_CONSTANT_FALSE+2)
+#define JSV_CONSTANT_COUNT (JSV_CONSTANT_FALSE+3)
+static INSTANCE_LOCAL JsVarRef jsvConstants[JSV_CONSTANT_COUNT];
+
+static JsVar *jsvGetConstant(unsigned int idx, JsVarFlags flags, JsVarInt value) {
+  if (jsvConstants[idx]) return jsvGetAddressOf(jsvConstants[idx]);
+  JsVar *var = jsvNewWithFlags(flags);
+  if (!var) return 0; // no memory
+  var->varData.integer = value;
+  var->flags |= JSV_CONSTANT; // keeps the one lock forever
+  jsvConstants[idx] = jsvGetRef(var);
+  return var;
+}
+
+/** Allocate all shared constants up front (so they don't look like a leak
+ * when they first get used). Called once the root has been created */
+void jsvCreateConstants() {
+  JsVarInt i;
+  for (i=JSV_CONSTANT_INT_MIN;i<=JSV_CONSTANT_INT_MAX;i++)
+    jsvNewFromInteger(i);
+  jsvNewFromBool(false);
+  jsvNewFromBool(true);
+  jsvNewNull();
+}
+
+/** Stop sharing constants, turning them back into normal vars (which get
+ * freed if nothing references them). Called before memory is saved/killed */
+void jsvReleaseConstants() {
+  unsigned int i;
+  for (i=0;i<JSV_CONSTANT_COUNT;i++) {
+    if (jsvConstants[i]) {
+      JsVar *var = jsvGetAddressOf(jsvConstants[i]);
+      jsvConstants[i] = 0;
+      var->flags &= (JsVarFlags)~JSV_CONSTANT;
+      jsvUnLock(var);
+    }
+  }
+}
+#endif
+
 JsVar *jsvNewFromInteger(JsVarInt value) {
+#ifndef SAVE_ON_FLASH
+  if (value>=JSV_CONSTANT_INT_MIN && value<=JSV_CONSTANT_INT_MAX)
+    return jsvGetConstant((unsigned int)(value-JSV_CONSTANT_INT_MIN), JSV_INTEGER, value);
+#endif
   JsVar *var = jsvNewWithFlags(JSV_INTEGER);
   if (!var) return 0; // no memory
   var->varData.integer = value;
   return var;
 }
 JsVar *jsvNewFromBool(bool value) {
+#ifndef SAVE_ON_FLASH
+  return jsvGetConstant(value ? JSV_CONSTANT_TRUE : JSV_CONSTANT_FALSE, JSV_BOOLEAN, value ? 1 : 0);
+#else
   JsVar *var = jsvNewWithFlags(JSV_BOOLEAN);
   if (!var) return 0; // no memory
   var->varData.integer = value ? 1 : 0;
   return var;
+#endif
+}
+JsVar *jsvNewNull() {
+#ifndef SAVE_ON_FLASH
+  return jsvGetConstant(JSV_CONSTANT_NULL, JSV_NULL, 0);
+#else
+  return jsvNewWithFlags(JSV_NULL);
+#endif
 }
 JsVar *jsvNewFromFloat(JsVarFloat value) {
   JsVar *var = jsvNewWithFlags(JSV_FLOAT);
@@ -831,8 +1274,98 @@ JsVar *jsvNewFromLongInteger(long long value) {
 }
 
 
+#ifndef SAVE_ON_FLASH
+/* Names longer than JSVAR_DATA_STRING_NAME_LEN characters would normally
+ * need their own STRING_EXTs for the rest of their characters. Instead we
+ * put the rest in a normal string that's shared (and refcounted) between all
+ * names with the same characters, so lastChild of the name points to a
+ * JSV_STRING rather than a JSV_STRING_EXT. A small hash table, which holds a
+ * lock on each of these strings, lets us find them again. */
+#define JSV_INTERN_TABLE_SIZE 32 // must be a power of 2
+#define JSV_INTERN_MAX_REFS 200 // refs may only be 8 bits
+static INSTANCE_LOCAL JsVarRef jsvInternTable[JSV_INTERN_TABLE_SIZE];
+
+bool jsvIsInternedName(const JsVar *v) {
+  return jsvIsName(v) && jsvIsString(v) && jsvGetLastChild(v) &&
+         !jsvIsStringExt(jsvGetAddressOf(jsvGetLastChild(v)));
+}
+
+/// Return a locked string (shared if possible) containing the characters in 'var' from 'start' onwards
+static JsVar *jsvGetInternedString(JsVar *var, size_t start) {
+  unsigned int hash = 0;
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, var, start);
+  while (jsvStringIteratorHasChar(&it)) {
+    hash = hash*31 + (unsigned char)jsvStringIteratorGetChar(&it);
+    jsvStringIteratorNext(&it);
+  }
+  jsvStringIteratorFree(&it);
+  JsVarRef *entry = &jsvInternTable[hash & (JSV_INTERN_TABLE_SIZE-1)];
+  if (*entry) {
+    JsVar *str = jsvGetAddressOf(*entry);
+    if (jsvGetRefs(str) < JSV_INTERN_MAX_REFS &&
+        jsvCompareString(var, str, start, 0, false)==0)
+      return jsvLockAgain(str);
+    *entry = 0;
+    jsvUnLock(str);
+  }
+  JsVar *str = jsvNewFromStringVar(var, start, JSVAPPENDSTRINGVAR_MAXLENGTH);
+  if (str) *entry = jsvGetRef(jsvLockAgain(str));
+  return str;
+}
+
+bool jsvReleaseInternedStrings() {
+  bool released = false;
+  unsigned int i;
+  for (i=0;i<JSV_INTERN_TABLE_SIZE;i++) {
+    if (jsvInternTable[i]) {
+      JsVar *str = jsvGetAddressOf(jsvInternTable[i]);
+      jsvInternTable[i] = 0;
+      jsvUnLock(str);
+      released = true;
+    }
+  }
+  return released;
+}
+#endif
+
+/// Return a locked chain of STRING_EXTs containing the characters in 'str' from 'start' onwards
+static JsVar *jsvNewStringExtsFromStringVar(JsVar *str, size_t start) {
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, str, start);
+  JsVar *startExt = jsvNewWithFlags(JSV_STRING_EXT_0);
+  JsVar *ext = jsvLockAgainSafe(startExt);
+  size_t nChars = 0;
+  while (ext && jsvStringIteratorHasChar(&it)) {
+    if (nChars >= JSVAR_DATA_STRING_MAX_LEN) {
+      jsvSetCharactersInVar(ext, nChars);
+      JsVar *ext2 = jsvNewWithFlags(JSV_STRING_EXT_0);
+      if (ext2) {
+        jsvSetLastChild(ext, jsvGetRef(ext2));
+      }
+      jsvUnLock(ext);
+      ext = ext2;
+      nChars = 0;
+    }
+    ext->varData.str[nChars++] = jsvStringIteratorGetChar(&it);
+    jsvStringIteratorNext(&it);
+  }
+  jsvStringIteratorFree(&it);
+  if (ext) {
+    jsvSetCharactersInVar(ext, nChars);
+    jsvUnLock(ext);
+  }
+  return startExt;
+}
+
 JsVar *jsvMakeIntoVariableName(JsVar *var, JsVar *valueOrZero) {
   if (!var) return 0;
+#ifndef SAVE_ON_FLASH
+  if (var->flags & JSV_CONSTANT) { // copy on write
+    var = jsvCopy(var);
+    if (!var) return 0;
+  }
+#endif
   assert(jsvGetRefs(var)==0); // make sure it's unused
   assert(jsvIsSimpleInt(var) || jsvIsString(var));
   JsVarFlags varType = (var->flags & JSV_VARTYPEMASK);
@@ -848,34 +1381,25 @@ JsVar *jsvMakeIntoVariableName(JsVar *var, JsVar *valueOrZero) {
     }
     var->flags = (JsVarFlags)(var->flags & ~JSV_VARTYPEMASK) | t;
   } else if (varType>=JSV_STRING_0 && varType<=JSV_STRING_MAX) {
+#ifndef SAVE_ON_FLASH
+    // Put the rest of a long name in a shared string (see jsvInternTable)
+    JsVar *rest = 0;
+    if ((varType-JSV_STRING_0) > JSVAR_DATA_STRING_NAME_LEN)
+      rest = jsvGetInternedString(var, JSVAR_DATA_STRING_NAME_LEN);
+    if (rest) {
+      jsvSetCharactersInVar(var, JSVAR_DATA_STRING_NAME_LEN);
+      jsvSetLastChild(var, jsvGetRef(jsvRef(rest)));
+      jsvSetNextSibling(var, 0);
+      jsvSetPrevSibling(var, 0);
+      jsvSetFirstChild(var, 0);
+      jsvUnLock(rest);
+    } else
+#endif
     if ((varType-JSV_STRING_0) > JSVAR_DATA_STRING_NAME_LEN) {
       /* Argh. String is too large to fit in a JSV_NAME! We must chomp make
        * new STRINGEXTs to put the data in
        */
-      JsvStringIterator it;
-      jsvStringIteratorNew(&it, var, JSVAR_DATA_STRING_NAME_LEN);
-      JsVar *startExt = jsvNewWithFlags(JSV_STRING_EXT_0);
-      JsVar *ext = jsvLockAgainSafe(startExt);
-      size_t nChars = 0;
-      while (ext && jsvStringIteratorHasChar(&it)) {
-        if (nChars >= JSVAR_DATA_STRING_MAX_LEN) {
-          jsvSetCharactersInVar(ext, nChars);
-          JsVar *ext2 = jsvNewWithFlags(JSV_STRING_EXT_0);
-          if (ext2) {
-            jsvSetLastChild(ext, jsvGetRef(ext2));
-          }
-          jsvUnLock(ext);
-          ext = ext2;
-          nChars = 0;
-        }
-        ext->varData.str[nChars++] = jsvStringIteratorGetChar(&it);
-        jsvStringIteratorNext(&it);
-      }
-      jsvStringIteratorFree(&it);
-      if (ext) {
-        jsvSetCharactersInVar(ext, nChars);
-        jsvUnLock(ext);
-      }
+      JsVar *startExt = jsvNewStringExtsFromStringVar(var, JSVAR_DATA_STRING_NAME_LEN);
       jsvSetCharactersInVar(var, JSVAR_DATA_STRING_NAME_LEN);
       jsvSetLastChild(var, jsvGetRef(startExt));
       jsvSetNextSibling(var, 0);
@@ -908,10 +1432,9 @@ void jsvMakeFunctionParameter(JsVar *v) {
 }
 
 JsVar *jsvNewFromPin(int pin) {
-  JsVar *v = jsvNewFromInteger((JsVarInt)pin);
-  if (v) {
-    v->flags = (JsVarFlags)((v->flags & ~JSV_VARTYPEMASK) | JSV_PIN);
-  }
+  JsVar *v = jsvNewWithFlags(JSV_PIN);
+  if (!v) return 0; // no memory
+  v->varData.integer = (JsVarInt)pin;
   return v;
 }
 
@@ -941,6 +1464,47 @@ JsVar *jsvNewNativeFunction(void (*ptr)(void), unsigned short argTypes) {
   return func;
 }
 
+#ifndef SAVE_ON_FLASH
+/* Built-in functions (like Math.sin) used to get a brand new native function
+ * var every time they were looked up. Instead we keep a small direct-mapped
+ * cache of the ones we created, each holding one lock so it can't be freed
+ * or moved. If something has added properties to a cached function we make
+ * a new one rather than handing those properties out to other callers. */
+#define JSV_NATIVE_CACHE_SIZE 16 // must be a power of 2
+static INSTANCE_LOCAL JsVarRef jsvNativeCache[JSV_NATIVE_CACHE_SIZE];
+
+JsVar *jsvNewNativeFunctionShared(void (*ptr)(void), unsigned short argTypes) {
+  JsVarRef *entry = &jsvNativeCache[(((size_t)ptr>>2) ^ argTypes) & (JSV_NATIVE_CACHE_SIZE-1)];
+  if (*entry) {
+    JsVar *func = jsvGetAddressOf(*entry);
+    if (func->varData.native.ptr==ptr &&
+        func->varData.native.argTypes==argTypes &&
+        !jsvGetFirstChild(func))
+      return jsvLockAgain(func);
+    *entry = 0;
+    jsvUnLock(func);
+  }
+  JsVar *func = jsvNewNativeFunction(ptr, argTypes);
+  if (func) *entry = jsvGetRef(jsvLockAgain(func));
+  return func;
+}
+
+/// Unlock everything in the native function cache. Called before memory is saved/killed
+bool jsvReleaseNativeFunctions() {
+  bool released = false;
+  unsigned int i;
+  for (i=0;i<JSV_NATIVE_CACHE_SIZE;i++) {
+    if (jsvNativeCache[i]) {
+      JsVar *func = jsvGetAddressOf(jsvNativeCache[i]);
+      jsvNativeCache[i] = 0;
+      jsvUnLock(func);
+      released = true;
+    }
+  }
+  return released;
+}
+#endif
+
 void *jsvGetNativeFunctionPtr(const JsVar *function) {
   /* see descriptions in jsvar.h. If we have a child called JSPARSE_FUNCTION_CODE_NAME
    * then we execute code straight from that */
@@ -990,6 +1554,12 @@ bool jsvIsBasicVarEqual(JsVar *a, JsVar *b) {
       }
     }
   } else if (jsvIsString(a) && jsvIsString(b)) {
+#ifndef SAVE_ON_FLASH
+    /* If both names share the rest of their characters (see jsvInternTable)
+     * we only have to compare the first few */
+    if (jsvIsInternedName(a) && jsvGetLastChild(a)==jsvGetLastChild(b) && jsvIsName(b))
+      return memcmp(a->varData.str, b->varData.str, JSVAR_DATA_STRING_NAME_LEN)==0;
+#endif
     JsvStringIterator ita, itb;
     jsvStringIteratorNew(&ita, a, 0);
     jsvStringIteratorNew(&itb, b, 0);
@@ -1253,21 +1823,79 @@ bool jsvIsEmptyString(JsVar *v) {
   return jsvGetCharactersInVar(v)==0;
 }
 
+#ifndef SAVE_ON_FLASH
+/// Find what we know about where the blocks of basic string str are (or 0)
+static JsvStringHint *jsvStringHintFind(JsVar *str) {
+  JsVarRef ref = jsvGetRef(str);
+  int i;
+  for (i=0;i<JSV_STRING_HINTS;i++)
+    if (jsvStringHints[i].str == ref)
+      return &jsvStringHints[i];
+  return 0;
+}
+
+/// Find the hint for basic string str, or replace an old one if there isn't one
+static JsvStringHint *jsvStringHintAdd(JsVar *str) {
+  JsvStringHint *hint = jsvStringHintFind(str);
+  if (!hint) {
+    hint = &jsvStringHints[jsvStringHintNext];
+    jsvStringHintNext = (unsigned char)((jsvStringHintNext+1) % JSV_STRING_HINTS);
+    memset(hint, 0, sizeof(JsvStringHint));
+    hint->str = jsvGetRef(str);
+  }
+  return hint;
+}
+
+/// Remember that tail (starting at character tailIndex) is the last block of basic string str
+static void jsvStringHintSetTail(JsVar *str, JsVar *tail, size_t tailIndex) {
+  if (tailIndex < JSV_STRING_HINT_MIN_INDEX) return;
+  JsvStringHint *hint = jsvStringHintAdd(str);
+  hint->tail = jsvGetRef(tail);
+  hint->tailIndex = tailIndex;
+}
+#endif
+
 size_t jsvGetStringLength(const JsVar *v) {
   size_t strLength = 0;
   const JsVar *var = v;
   JsVar *newVar = 0;
   if (!jsvHasCharacterData(v)) return 0;
 
-  while (var) {
-    JsVarRef ref = jsvGetLastChild(var);
-    strLength += jsvGetCharactersInVar(var);
+#ifndef SAVE_ON_FLASH
+  // Start counting from the furthest block we already know the position of
+  bool isBasicString = jsvIsBasicString(v);
+  if (isBasicString) {
+    JsvStringHint *hint = jsvStringHintFind((JsVar*)v);
+    if (hint) {
+      JsVarRef start = hint->tail;
+      strLength = hint->tailIndex;
+      if (hint->block && (!start || hint->blockIndex > strLength)) {
+        start = hint->block;
+        strLength = hint->blockIndex;
+      }
+      if (start) var = newVar = jsvLock(start);
+    }
+  }
+#endif
 
+  while (true) {
+    JsVarRef ref = jsvGetLastChild(var);
+    size_t chars = jsvGetCharactersInVar(var);
+    if (!ref) {
+#ifndef SAVE_ON_FLASH
+      // remember the end of the string for next time
+      if (isBasicString && var!=v)
+        jsvStringHintSetTail((JsVar*)v, (JsVar*)var, strLength);
+#endif
+      strLength += chars;
+      break;
+    }
+    strLength += chars;
     // Go to next
-    jsvUnLock(newVar); // note use of if (ref), not var
-    var = newVar = ref ? jsvLock(ref) : 0;
+    jsvUnLock(newVar);
+    var = newVar = jsvLock(ref);
   }
-  jsvUnLock(newVar); // note use of if (ref), not var
+  jsvUnLock(newVar);
   return strLength;
 }
 
@@ -1316,6 +1944,16 @@ char *jsvGetDataPointer(JsVar *v, size_t *len) {
   return 0;
 }
 
+char *jsvGetWritableDataPointer(JsVar *v, size_t *len) {
+  if (jsvIsArrayBuffer(v)) {
+    JsVar *d = jsvGetArrayBufferBackingString(v);
+    bool isFlat = jsvIsFlatString(d);
+    jsvUnLock(d);
+    if (!isFlat) return 0;
+  } else if (!jsvIsFlatString(v)) return 0;
+  return jsvGetDataPointer(v, len);
+}
+
 //  IN A STRING  get the number of lines in the string (min=1)
 size_t jsvGetLinesInString(JsVar *v) {
   size_t lines = 1;
@@ -1400,25 +2038,65 @@ size_t jsvGetIndexFromLineAndCol(JsVar *v, size_t line, size_t col) {
   return n;
 }
 
+#ifndef SAVE_ON_FLASH
+JsVar *jsvStringSeekHintGet(JsVar *str, size_t idx, size_t *blockIndex) {
+  JsvStringHint *hint = jsvStringHintFind(str);
+  if (!hint || !hint->block || hint->blockIndex > idx) return 0;
+  *blockIndex = hint->blockIndex;
+  return jsvLock(hint->block);
+}
+
+void jsvStringSeekHintSet(JsVar *str, JsVar *block, size_t blockIndex) {
+  if (blockIndex < JSV_STRING_HINT_MIN_INDEX) return;
+  JsvStringHint *hint = jsvStringHintAdd(str);
+  hint->block = jsvGetRef(block);
+  hint->blockIndex = blockIndex;
+}
+#endif
+
+/// Create a string iterator at the end of var, ready for jsvStringIteratorAppend
+static void jsvAppendIteratorNew(JsvStringIterator *dst, JsVar *var) {
+#ifndef SAVE_ON_FLASH
+  /* If we know where this string ended last time, carry on from that block
+   * rather than the start. Anything appended since will just be after it. */
+  JsvStringHint *hint = jsvIsBasicString(var) ? jsvStringHintFind(var) : 0;
+  if (hint && hint->tail) {
+    jsvStringIteratorNew(dst, jsvGetAddressOf(hint->tail), 0);
+    dst->varIndex = hint->tailIndex;
+  } else
+#endif
+    jsvStringIteratorNew(dst, var, 0);
+  jsvStringIteratorGotoEnd(dst);
+}
+
+/// Free an iterator from jsvAppendIteratorNew, remembering where var now ends
+static void jsvAppendIteratorFree(JsvStringIterator *dst, JsVar *var) {
+#ifndef SAVE_ON_FLASH
+  if (dst->var && jsvIsBasicString(var))
+    jsvStringHintSetTail(var, dst->var, dst->varIndex);
+#else
+  NOT_USED(var);
+#endif
+  jsvStringIteratorFree(dst);
+}
+
 void jsvAppendString(JsVar *var, const char *str) {
   assert(jsvIsString(var));
   JsvStringIterator dst;
-  jsvStringIteratorNew(&dst, var, 0);
-  jsvStringIteratorGotoEnd(&dst);
+  jsvAppendIteratorNew(&dst, var);
   // now start appending
   /* This isn't as fast as something single-purpose, but it's not that bad,
    * and is less likely to break :) */
   while (*str)
     jsvStringIteratorAppend(&dst, *(str++));
-  jsvStringIteratorFree(&dst);
+  jsvAppendIteratorFree(&dst, var);
 }
 
 // Append the given string to this one - but does not use null-terminated strings
 void jsvAppendStringBuf(JsVar *var, const char *str, size_t length) {
   assert(jsvIsString(var));
   JsvStringIterator dst;
-  jsvStringIteratorNew(&dst, var, 0);
-  jsvStringIteratorGotoEnd(&dst);
+  jsvAppendIteratorNew(&dst, var);
   // now start appending
   /* This isn't as fast as something single-purpose, but it's not that bad,
    * and is less likely to break :) */
@@ -1426,7 +2104,7 @@ void jsvAppendStringBuf(JsVar *var, const char *str, size_t length) {
     jsvStringIteratorAppend(&dst, *(str++));
     length--;
   }
-  jsvStringIteratorFree(&dst);
+  jsvAppendIteratorFree(&dst, var);
 }
 
 /// Special version of append designed for use with vcbprintf_callback (See jsvAppendPrintf)
@@ -1467,10 +2145,15 @@ JsVar *jsvVarPrintf( const char *fmt, ...) {
 /** Append str to var. Both must be strings. stridx = start char or str, maxLength = max number of characters (can be JSVAPPENDSTRINGVAR_MAXLENGTH) */
 void jsvAppendStringVar(JsVar *var, const JsVar *str, size_t stridx, size_t maxLength) {
   assert(jsvIsString(var));
+  if (var==str) {
+    // appending a string to itself - stop where it ends now, or we'd never finish
+    size_t length = jsvGetStringLength(str);
+    if (stridx>=length) return;
+    if (maxLength > length-stridx) maxLength = length-stridx;
+  }
 
   JsvStringIterator dst;
-  jsvStringIteratorNew(&dst, var, 0);
-  jsvStringIteratorGotoEnd(&dst);
+  jsvAppendIteratorNew(&dst, var);
   // now start appending
   /* This isn't as fast as something single-purpose, but it's not that bad,
      * and is less likely to break :) */
@@ -1482,7 +2165,7 @@ void jsvAppendStringVar(JsVar *var, const JsVar *str, size_t stridx, size_t maxL
     jsvStringIteratorNext(&it);
   }
   jsvStringIteratorFree(&it);
-  jsvStringIteratorFree(&dst);
+  jsvAppendIteratorFree(&dst, var);
 }
 
 /** Create a new variable from a substring. argument must be a string. stridx = start char or str, maxLength = max number of characters (can be JSVAPPENDSTRINGVAR_MAXLENGTH) */
@@ -1492,6 +2175,75 @@ JsVar *jsvNewFromStringVar(const JsVar *str, size_t stridx, size_t maxLength) {
   return var;
 }
 
+#ifndef JSV_STRING_VIEW_MAX_RATIO
+/* Views keep the whole of the string they point into allocated, so we don't
+ * make them if they are less than 1/JSV_STRING_VIEW_MAX_RATIO of its length */
+#define JSV_STRING_VIEW_MAX_RATIO 32
+#endif
+
+JsVar *jsvNewStringView(JsVar *str, size_t stridx, size_t maxLength) {
+#ifndef SAVE_ON_FLASH
+  JsVarRef parentRef = 0;
+  char *ptr = 0;
+  if (jsvIsFlatString(str) && !jsvGetFirstChild(str)) { // not writable (see jsvFlatStringMakeWritable)
+    parentRef = jsvGetRef(str);
+    ptr = jsvGetFlatStringPointer(str);
+  } else if (jsvIsStringView(str)) {
+    parentRef = jsvGetFirstChild(str);
+    ptr = str->varData.nativeStr.ptr;
+  }
+  if (parentRef) {
+    size_t len = jsvGetCharactersInVar(str);
+    if (stridx > len) stridx = len;
+    if (maxLength > len-stridx) maxLength = len-stridx;
+  }
+  // Only if it saves memory, and the pointer+length don't overwrite firstChild
+  if (parentRef && maxLength > JSVAR_DATA_STRING_LEN && maxLength <= 0xFFFF &&
+      maxLength*JSV_STRING_VIEW_MAX_RATIO >= jsvGetCharactersInVar(jsvGetAddressOf(parentRef)) &&
+      sizeof(char*)+sizeof(uint16_t) <= JSVAR_DATA_STRING_NAME_LEN+2*JSVARREF_SIZE) {
+    JsVar *v = jsvNewWithFlags(JSV_NATIVE_STRING);
+    if (!v) return 0; // out of memory
+    v->varData.nativeStr.ptr = ptr + stridx;
+    v->varData.nativeStr.len = (uint16_t)maxLength;
+    jsvSetFirstChild(v, jsvRefRef(parentRef));
+    return v;
+  }
+#endif
+  return jsvNewFromStringVar(str, stridx, maxLength);
+}
+
+bool jsvFlatStringMakeWritable(JsVar *flatStr) {
+  bool ok = true;
+#ifndef SAVE_ON_FLASH
+  JsVarRef ref = jsvGetRef(flatStr);
+  /* Flat strings don't otherwise use firstChild, so mark that the string may be
+   * written by pointing it at itself. jsvNewStringView won't make views of it then */
+  jsvSetFirstChild(flatStr, ref);
+  JsVarRef i;
+  for (i=1;i<=jsVarsSize;i++) {
+    JsVar *var = jsvGetAddressOf(i);
+    if (jsvIsStringView(var) && jsvGetFirstChild(var)==ref) {
+      // copy the characters, then move them into the view's var so everything using it sees the copy
+      JsVar *copy = jsvNewFromStringVar(var, 0, JSVAPPENDSTRINGVAR_MAXLENGTH);
+      if (!copy) { // out of memory
+        ok = false;
+        continue;
+      }
+      memcpy(&var->varData, &copy->varData, JSVAR_DATA_STRING_LEN);
+      jsvSetLastChild(var, jsvGetLastChild(copy));
+      var->flags = (var->flags & (JsVarFlags)~JSV_VARTYPEMASK) | (copy->flags & JSV_VARTYPEMASK);
+      jsvSetLastChild(copy, 0); // its STRING_EXTs belong to var now
+      jsvUnLock(copy);
+      jsvUnRef(flatStr);
+    } else if (jsvIsFlatString(var))
+      i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
+  }
+#else
+  NOT_USED(flatStr);
+#endif
+  return ok;
+}
+
 /** Append all of str to var. Both must be strings.  */
 void jsvAppendStringVarComplete(JsVar *var, const JsVar *str) {
   jsvAppendStringVar(var, str, 0, JSVAPPENDSTRINGVAR_MAXLENGTH);
@@ -1615,6 +2367,9 @@ long long jsvGetLongIntegerAndUnLock(JsVar *v) {
 
 
 void jsvSetInteger(JsVar *v, JsVarInt value) {
+#ifndef SAVE_ON_FLASH
+  assert(!(v->flags & JSV_CONSTANT)); // must not change shared constants
+#endif
   assert(jsvIsInt(v));
   v->varData.integer  = value;
 }
@@ -1897,6 +2652,13 @@ bool jsvIsStringEqualAndUnLock(JsVar *var, const char *str) {
  * For a basic strcmp, do: jsvCompareString(a,b,0,0,false)
  *  */
 int jsvCompareString(JsVar *va, JsVar *vb, size_t starta, size_t startb, bool equalAtEndOfString) {
+#ifndef SAVE_ON_FLASH
+  // names sharing the rest of their characters (see jsvInternTable)
+  if (!starta && !startb && jsvIsInternedName(va) && jsvGetLastChild(va)==jsvGetLastChild(vb) && jsvIsName(vb)) {
+    int cmp = memcmp(va->varData.str, vb->varData.str, JSVAR_DATA_STRING_NAME_LEN);
+    if (!cmp) return 0;
+  }
+#endif
   JsvStringIterator ita, itb;
   jsvStringIteratorNew(&ita, va, starta);
   jsvStringIteratorNew(&itb, vb, startb);
@@ -1958,8 +2720,187 @@ int jsvCompareInteger(JsVar *va, JsVar *vb) {
     return 0;
 }
 
+#ifndef SAVE_ON_FLASH
+static uint16_t jsvHashString(const char *name) {
+  uint16_t hash = 0;
+  while (*name) hash = (uint16_t)((hash*31) + (unsigned char)*(name++));
+  return hash;
+}
+
+/// Same as jsvHashString, but for the characters in a JsVar
+static uint16_t jsvHashVar(JsVar *v) {
+  uint16_t hash = 0;
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, v, 0);
+  while (jsvStringIteratorHasChar(&it)) {
+    hash = (uint16_t)((hash*31) + (unsigned char)jsvStringIteratorGetChar(&it));
+    jsvStringIteratorNext(&it);
+  }
+  jsvStringIteratorFree(&it);
+  return hash;
+}
+
+/* Objects with more than JSV_OBJECT_INDEX_THRESHOLD children get an index,
+ * stored as the first child (JSV_OBJECT_INDEX_NAME). Its value is a flat
+ * string containing an open-addressed hash table of JsVarRefs of the object's
+ * string-named children. The first entry is the number of refs in the table.
+ * It is maintained by jsvAddName/jsvRemoveChild, dropped if it gets too full
+ * and then rebuilt the next time a lookup has to walk the whole object. */
+#define JSV_OBJECT_INDEX_NAME JS_HIDDEN_CHAR_STR"idx"
+#define JSV_OBJECT_INDEX_THRESHOLD 16
+
+/// Return the (unlocked) name of the object's index, or 0
+static JsVar *jsvObjectGetIndexName(JsVar *parent) {
+  if (!jsvIsObject(parent) || !jsvGetFirstChild(parent)) return 0;
+  JsVar *first = jsvGetAddressOf(jsvGetFirstChild(parent));
+  if (jsvIsName(first) && first->varData.str[0]==JS_HIDDEN_CHAR &&
+      jsvIsStringEqual(first, JSV_OBJECT_INDEX_NAME))
+    return first;
+  return 0;
+}
+
+/// Get the hash table from an index's name, and the amount of entries in it
+static JsVarRef *jsvObjectIndexGetTable(JsVar *indexName, unsigned int *size) {
+  JsVar *flat = jsvGetAddressOf(jsvGetFirstChild(indexName));
+  *size = (unsigned int)(jsvGetCharactersInVar(flat)/sizeof(JsVarRef)) - 1;
+  return (JsVarRef*)jsvGetFlatStringPointer(flat);
+}
+
+static void jsvObjectIndexInsert(JsVarRef *table, unsigned int size, uint16_t hash, JsVarRef ref) {
+  unsigned int i = hash & (size-1);
+  while (table[1+i]) i = (i+1) & (size-1);
+  table[1+i] = ref;
+}
+
+/// Create an index for the given object
+static void jsvObjectIndexCreate(JsVar *parent) {
+  if (isMemoryBusy) return;
+  unsigned int count = 0;
+  JsVarRef childref = jsvGetFirstChild(parent);
+  while (childref) {
+    count++;
+    childref = jsvGetNextSibling(jsvGetAddressOf(childref));
+  }
+  unsigned int size = 8;
+  while (size < count*2) size <<= 1;
+  // allocate everything first, as allocation could garbage collect
+  JsVar *indexName = jsvNewFromString(JSV_OBJECT_INDEX_NAME);
+  if (!indexName) return;
+  JsVar *flat = jsvNewFlatStringOfLength((unsigned int)((size+1)*sizeof(JsVarRef)));
+  if (!flat) {
+    jsvUnLock(indexName);
+    return;
+  }
+  JsVarRef *table = (JsVarRef*)jsvGetFlatStringPointer(flat);
+  memset(table, 0, (size+1)*sizeof(JsVarRef));
+  childref = jsvGetFirstChild(parent);
+  while (childref) {
+    JsVar *child = jsvGetAddressOf(childref);
+    if (jsvIsString(child)) {
+      jsvObjectIndexInsert(table, size, jsvHashVar(child), childref);
+      table[0]++;
+    }
+    childref = jsvGetNextSibling(child);
+  }
+  indexName = jsvMakeIntoVariableName(indexName, flat);
+  jsvUnLock(flat);
+  // Link in as the first child, so we can find it quickly
+  JsVarRef indexRef = jsvGetRef(jsvRef(indexName));
+  JsVarRef first = jsvGetFirstChild(parent);
+  if (first) {
+    jsvSetPrevSibling(jsvGetAddressOf(first), indexRef);
+    jsvSetNextSibling(indexName, first);
+  } else {
+    jsvSetLastChild(parent, indexRef);
+  }
+  jsvSetFirstChild(parent, indexRef);
+  jsvUnLock(indexName);
+}
+
+/// Add a newly added child to the object's index, if it has one
+static void jsvObjectIndexAdd(JsVar *parent, JsVar *child) {
+  JsVar *indexName = jsvObjectGetIndexName(parent);
+  if (!indexName || indexName==child || !jsvIsString(child)) return;
+  unsigned int size;
+  JsVarRef *table = jsvObjectIndexGetTable(indexName, &size);
+  if ((unsigned int)(table[0]+1)*4 > size*3) {
+    // too full - remove it, and it'll be rebuilt bigger when needed
+    jsvRemoveChild(parent, indexName);
+    return;
+  }
+  jsvObjectIndexInsert(table, size, jsvHashVar(child), jsvGetRef(child));
+  table[0]++;
+}
+
+/// Remove a child from the object's index, if it has one
+static void jsvObjectIndexRemove(JsVar *parent, JsVar *child) {
+  JsVar *indexName = jsvObjectGetIndexName(parent);
+  if (!indexName || indexName==child || !jsvIsString(child)) return;
+  unsigned int size;
+  JsVarRef *table = jsvObjectIndexGetTable(indexName, &size);
+  JsVarRef childref = jsvGetRef(child);
+  unsigned int i = jsvHashVar(child) & (size-1);
+  while (table[1+i] && table[1+i]!=childref) i = (i+1) & (size-1);
+  if (!table[1+i]) return; // not in the index
+  table[1+i] = 0;
+  table[0]--;
+  // re-insert everything after it in the same run, so lookups don't stop early
+  i = (i+1) & (size-1);
+  while (table[1+i]) {
+    JsVarRef ref = table[1+i];
+    table[1+i] = 0;
+    jsvObjectIndexInsert(table, size, jsvHashVar(jsvGetAddressOf(ref)), ref);
+    i = (i+1) & (size-1);
+  }
+}
+
+/// Find a child using the object's index. Returns a LOCKED var, or 0 if not found
+static JsVar *jsvObjectIndexFind(JsVar *indexName, const char *name) {
+  unsigned int size;
+  JsVarRef *table = jsvObjectIndexGetTable(indexName, &size);
+  unsigned int i = jsvHashString(name) & (size-1);
+  while (table[1+i]) {
+    JsVar *child = jsvGetAddressOf(table[1+i]);
+    if (jsvIsStringEqual(child, name)) return jsvLockAgain(child);
+    i = (i+1) & (size-1);
+  }
+  return 0;
+}
+
+/// Like jsvObjectIndexFind, but using a string JsVar as the name
+static JsVar *jsvObjectIndexFindVar(JsVar *indexName, JsVar *childName) {
+  unsigned int size;
+  JsVarRef *table = jsvObjectIndexGetTable(indexName, &size);
+  unsigned int i = jsvHashVar(childName) & (size-1);
+  while (table[1+i]) {
+    JsVar *child = jsvGetAddressOf(table[1+i]);
+    if (jsvIsBasicVarEqual(child, childName)) return jsvLockAgain(child);
+    i = (i+1) & (size-1);
+  }
+  return 0;
+}
+#endif
+
 /** Copy only a name, not what it points to. ALTHOUGH the link to what it points to is maintained unless linkChildren=false
     If keepAsName==false, this will be converted into a normal variable */
+#ifndef SAVE_ON_FLASH
+/** Make dst's lastChild share the rest of src's interned name (see jsvInternTable). If
+ * that string already has as many references as it can take, give dst its own STRING_EXTs */
+static void jsvCopyInternedRest(JsVar *dst, JsVar *src) {
+  JsVar *rest = jsvLock(jsvGetLastChild(src));
+  if (jsvGetRefs(rest) < JSV_INTERN_MAX_REFS) {
+    jsvSetLastChild(dst, jsvGetRef(jsvRef(rest)));
+  } else {
+    JsVar *ext = jsvNewStringExtsFromStringVar(rest, 0);
+    if (ext) { // could be out of memory
+      jsvSetLastChild(dst, jsvGetRef(ext)); // no ref for stringext
+      jsvUnLock(ext);
+    }
+  }
+  jsvUnLock(rest);
+}
+#endif
+
 JsVar *jsvCopyNameOnly(JsVar *src, bool linkChildren, bool keepAsName) {
   assert(jsvIsName(src));
   JsVarFlags flags = src->flags;
@@ -1999,6 +2940,11 @@ JsVar *jsvCopyNameOnly(JsVar *src, bool linkChildren, bool keepAsName) {
       // If it had extra string data it should have been handled above
       assert(keepAsName || !jsvGetLastChild(src));
       // copy extra bits of string if there were any
+#ifndef SAVE_ON_FLASH
+      if (jsvIsInternedName(src)) {
+        jsvCopyInternedRest(dst, src);
+      } else
+#endif
       if (jsvGetLastChild(src)) {
         JsVar *child = jsvLock(jsvGetLastChild(src));
         JsVar *childCopy = jsvCopy(child);
@@ -2037,6 +2983,8 @@ JsVar *jsvCopy(JsVar *src) {
         assert(jsvGetFirstChild(dst) == 0);
       }
       assert(jsvGetLastChild(dst) == 0);
+      if (jsvIsStringView(dst))
+        jsvRefRef(jsvGetFirstChild(dst)); // both reference the string we're a view of
   } else {
     // stringexts use the extra pointers after varData to store characters
     // see jsvGetMaxCharactersInVar
@@ -2059,6 +3007,11 @@ JsVar *jsvCopy(JsVar *src) {
 
   if (jsvHasStringExt(src)) {
     // copy extra bits of string if there were any
+#ifndef SAVE_ON_FLASH
+    if (jsvIsInternedName(src)) {
+      jsvCopyInternedRest(dst, src);
+    } else
+#endif
     if (jsvGetLastChild(src)) {
       JsVar *child = jsvLock(jsvGetLastChild(src));
       JsVar *childCopy = jsvCopy(child);
@@ -2072,6 +3025,11 @@ JsVar *jsvCopy(JsVar *src) {
     // Copy children..
     JsVarRef vr;
     vr = jsvGetFirstChild(src);
+#ifndef SAVE_ON_FLASH
+    // don't copy the index - it refers to src's children
+    if (jsvObjectGetIndexName(src))
+      vr = jsvGetNextSibling(jsvGetAddressOf(vr));
+#endif
     while (vr) {
       JsVar *name = jsvLock(vr);
       JsVar *child = jsvCopyNameOnly(name, true/*link children*/, true/*keep as name*/); // NO DEEP COPY!
@@ -2141,6 +3099,9 @@ void jsvAddName(JsVar *parent, JsVar *namedChild) {
     jsvSetFirstChild(parent, r);
     jsvSetLastChild(parent, r);
   }
+#ifndef SAVE_ON_FLASH
+  jsvObjectIndexAdd(parent, namedChild);
+#endif
 }
 
 JsVar *jsvAddNamedChild(JsVar *parent, JsVar *child, const char *name) {
@@ -2224,18 +3185,35 @@ JsVar *jsvFindChildFromString(JsVar *parent, const char *name, bool addIfNotFoun
   }
 
   assert(jsvHasChildren(parent));
-  JsVarRef childref = jsvGetFirstChild(parent);
-  while (childref) {
-    // Don't Lock here, just use GetAddressOf - to try and speed up the finding
-    // TODO: We can do this now, but when/if we move to cacheing vars, it'll break
-    JsVar *child = jsvGetAddressOf(childref);
-    if (*(int*)fastCheck==*(int*)child->varData.str && // speedy check of first 4 bytes
-        jsvIsStringEqual(child, name)) {
-      // found it! unlock parent but leave child locked
-      return jsvLockAgain(child);
+#ifndef SAVE_ON_FLASH
+  JsVar *indexName = jsvObjectGetIndexName(parent);
+  if (indexName) {
+    JsVar *child = jsvObjectIndexFind(indexName, name);
+    if (child || !addIfNotFound) return child;
+  } else {
+    unsigned int count = 0;
+#endif
+    JsVarRef childref = jsvGetFirstChild(parent);
+    while (childref) {
+      // Don't Lock here, just use GetAddressOf - to try and speed up the finding
+      // TODO: We can do this now, but when/if we move to cacheing vars, it'll break
+      JsVar *child = jsvGetAddressOf(childref);
+      if (*(int*)fastCheck==*(int*)child->varData.str && // speedy check of first 4 bytes
+          jsvIsStringEqual(child, name)) {
+        // found it! unlock parent but leave child locked
+        return jsvLockAgain(child);
+      }
+      childref = jsvGetNextSibling(child);
+#ifndef SAVE_ON_FLASH
+      count++;
+#endif
     }
-    childref = jsvGetNextSibling(child);
+#ifndef SAVE_ON_FLASH
+    // we had to look through a lot of children - create an index
+    if (count > JSV_OBJECT_INDEX_THRESHOLD && jsvIsObject(parent))
+      jsvObjectIndexCreate(parent);
   }
+#endif
 
   JsVar *child = 0;
   if (addIfNotFound) {
@@ -2246,6 +3224,61 @@ JsVar *jsvFindChildFromString(JsVar *parent, const char *name, bool addIfNotFoun
   return child;
 }
 
+#ifndef SAVE_ON_FLASH
+/* Cache of (parent, name hash) -> child for jsvFindChildFromStringCached.
+ * Entries only ever point to a parent's own children, so adding a child
+ * can't make them wrong - but removing a child (jsvRemoveChild), freeing the
+ * parent (jsvFreePtr) or garbage collecting can, and these invalidate it. */
+typedef struct {
+  JsVarRef parent;
+  JsVarRef child;
+  uint16_t hash;
+} JsvLookupCacheEntry;
+
+#define JSV_LOOKUP_CACHE_SIZE 16 // must be a power of 2
+static INSTANCE_LOCAL JsvLookupCacheEntry jsvLookupCache[JSV_LOOKUP_CACHE_SIZE];
+static INSTANCE_LOCAL unsigned int jsvLookupCacheHits, jsvLookupCacheMisses;
+
+JsVar *jsvFindChildFromStringCached(JsVar *parent, const char *name) {
+  if (jsvIsArray(parent)) // arrays get children removed without jsvRemoveChild
+    return jsvFindChildFromString(parent, name, false);
+  uint16_t hash = jsvHashString(name);
+  JsVarRef parentRef = jsvGetRef(parent);
+  JsvLookupCacheEntry *entry = &jsvLookupCache[(hash ^ parentRef) & (JSV_LOOKUP_CACHE_SIZE-1)];
+  if (entry->parent==parentRef && entry->hash==hash) {
+    JsVar *child = jsvGetAddressOf(entry->child);
+    // check, as two names may have had the same hash
+    if (jsvIsName(child) && jsvIsStringEqual(child, name)) {
+      jsvLookupCacheHits++;
+      return jsvLockAgain(child);
+    }
+  }
+  jsvLookupCacheMisses++;
+  JsVar *child = jsvFindChildFromString(parent, name, false);
+  if (child) {
+    entry->parent = parentRef;
+    entry->child = jsvGetRef(child);
+    entry->hash = hash;
+  }
+  return child;
+}
+
+void jsvLookupCacheInvalidate(JsVarRef parent) {
+  int i;
+  for (i=0;i<JSV_ARRAY_CURSORS;i++)
+    if (!parent || jsvArrayCursors[i].parent==parent)
+      jsvArrayCursors[i].parent = 0;
+  for (i=0;i<JSV_LOOKUP_CACHE_SIZE;i++)
+    if (!parent || jsvLookupCache[i].parent==parent)
+      jsvLookupCache[i].parent = 0;
+}
+
+void jsvGetLookupCacheStats(unsigned int *hits, unsigned int *misses) {
+  *hits = jsvLookupCacheHits;
+  *misses = jsvLookupCacheMisses;
+}
+#endif
+
 /// See jsvIsNewChild - for fields that don't exist yet
 JsVar *jsvCreateNewChild(JsVar *parent, JsVar *index, JsVar *child) {
   JsVar *newChild = jsvAsName(index);
@@ -2263,7 +3296,15 @@ JsVar *jsvCreateNewChild(JsVar *parent, JsVar *index, JsVar *child) {
 
 /** Try and turn the supplied variable into a name. If not, make a new one. This locks again. */
 JsVar *jsvAsName(JsVar *var) {
-  if (jsvGetRefs(var) == 0) {
+  if (jsvIsFlatString(var) || jsvIsNativeString(var)) {
+    // names can't use flat/native storage - make a normal string
+    return jsvMakeIntoVariableName(jsvNewFromStringVar(var, 0, JSVAPPENDSTRINGVAR_MAXLENGTH), 0);
+  }
+  if (jsvGetRefs(var) == 0
+#ifndef SAVE_ON_FLASH
+      && !(var->flags & JSV_CONSTANT)
+#endif
+      ) {
     // Not reffed - great! let's just use it
     if (!jsvIsName(var))
       var = jsvMakeIntoVariableName(var, 0);
@@ -2273,9 +3314,118 @@ JsVar *jsvAsName(JsVar *var) {
   }
 }
 
+#ifndef SAVE_ON_FLASH
+/// Return the cursor for this array if it's still one of its elements, or 0
+static JsvArrayCursor *jsvArrayCursorGet(JsVar *arr) {
+  JsVarRef arrRef = jsvGetRef(arr);
+  JsvArrayCursor *cursor = 0;
+  int i;
+  for (i=0;i<JSV_ARRAY_CURSORS;i++)
+    if (jsvArrayCursors[i].parent == arrRef)
+      cursor = &jsvArrayCursors[i];
+  if (!cursor) return 0;
+  JsVarRef r = cursor->child;
+  JsVar *child = jsvGetAddressOf(r);
+  // elements can be unlinked without jsvRemoveChild, so check the links both ways
+  bool valid = jsvIsName(child);
+  if (valid) {
+    JsVarRef prev = jsvGetPrevSibling(child);
+    JsVarRef next = jsvGetNextSibling(child);
+    valid = (prev ? jsvGetNextSibling(jsvGetAddressOf(prev))==r : jsvGetFirstChild(arr)==r) &&
+            (next ? jsvGetPrevSibling(jsvGetAddressOf(next))==r : jsvGetLastChild(arr)==r);
+  }
+  if (!valid) {
+    cursor->parent = 0;
+    return 0;
+  }
+  return cursor;
+}
+
+/// Remember where the given element of the array is
+static void jsvArrayCursorSet(JsVar *arr, JsVarRef child) {
+  JsVarRef arrRef = jsvGetRef(arr);
+  int i;
+  for (i=0;i<JSV_ARRAY_CURSORS;i++)
+    if (jsvArrayCursors[i].parent == arrRef) {
+      jsvArrayCursors[i].child = child;
+      return;
+    }
+  JsvArrayCursor *cursor = &jsvArrayCursors[jsvArrayCursorNext];
+  jsvArrayCursorNext = (unsigned char)((jsvArrayCursorNext+1) % JSV_ARRAY_CURSORS);
+  cursor->parent = arrRef;
+  cursor->child = child;
+}
+#endif
+
+/** Find the name of the element at 'index' in an array. Integer names in
+ * arrays are kept in order, so we start from whichever of the first element,
+ * the last element or the last one we found is nearest, and stop as soon as
+ * we have gone past the index. Returns a LOCKED name, or 0 */
+static JsVar *jsvFindArrayChild(JsVar *arr, JsVarInt index) {
+  JsVarRef starts[3] = { jsvGetFirstChild(arr), jsvGetLastChild(arr), 0 };
+#ifndef SAVE_ON_FLASH
+  JsvArrayCursor *cursor = jsvArrayCursorGet(arr);
+  if (cursor) starts[2] = cursor->child;
+#endif
+  JsVarRef childref = jsvGetFirstChild(arr);
+  JsVarInt distance = -1;
+  bool forwards = true;
+  int i;
+  for (i=0;i<3;i++) {
+    if (!starts[i]) continue;
+    JsVar *start = jsvGetAddressOf(starts[i]);
+    if (!jsvIsInt(start)) continue; // eg. a non-index property
+    JsVarInt d = index - start->varData.integer;
+    JsVarInt ad = d<0 ? -d : d;
+    if (distance<0 || ad<distance) {
+      childref = starts[i];
+      distance = ad;
+      forwards = d>=0;
+    }
+  }
+
+  while (childref) {
+    JsVar *child = jsvLock(childref);
+    if (jsvIsInt(child)) {
+      JsVarInt childIndex = child->varData.integer;
+      if (childIndex == index) {
+#ifndef SAVE_ON_FLASH
+        jsvArrayCursorSet(arr, childref);
+#endif
+        return child;
+      }
+      if (forwards ? childIndex>index : childIndex<index) {
+        // gone past where it would be - it's not here
+        jsvUnLock(child);
+        return 0;
+      }
+    }
+    childref = forwards ? jsvGetNextSibling(child) : jsvGetPrevSibling(child);
+    jsvUnLock(child);
+  }
+  return 0;
+}
+
 /** Non-recursive finding */
 JsVar *jsvFindChildFromVar(JsVar *parent, JsVar *childName, bool addIfNotFound) {
   JsVar *child;
+  if (jsvIsArray(parent) && jsvIsInt(childName)) {
+    child = jsvFindArrayChild(parent, childName->varData.integer);
+    if (child || !addIfNotFound) return child;
+    child = jsvAsName(childName);
+    jsvAddName(parent, child);
+    return child;
+  }
+#ifndef SAVE_ON_FLASH
+  JsVar *indexName = jsvIsString(childName) ? jsvObjectGetIndexName(parent) : 0;
+  if (indexName) {
+    child = jsvObjectIndexFindVar(indexName, childName);
+    if (child || !addIfNotFound) return child;
+    child = jsvAsName(childName);
+    jsvAddName(parent, child);
+    return child;
+  }
+#endif
   JsVarRef childref = jsvGetFirstChild(parent);
 
   while (childref) {
@@ -2299,6 +3449,10 @@ JsVar *jsvFindChildFromVar(JsVar *parent, JsVar *childName, bool addIfNotFound)
 void jsvRemoveChild(JsVar *parent, JsVar *child) {
   assert(jsvHasChildren(parent));
   assert(jsvIsName(child));
+#ifndef SAVE_ON_FLASH
+  jsvLookupCacheInvalidate(jsvGetRef(parent));
+  jsvObjectIndexRemove(parent, child);
+#endif
   JsVarRef childref = jsvGetRef(child);
   bool wasChild = false;
   // unlink from parent
@@ -2498,55 +3652,7 @@ size_t jsvCountJsVarsUsed(JsVar *v) {
 
 
 JsVar *jsvGetArrayItem(const JsVar *arr, JsVarInt index) {
-  JsVarRef childref = jsvGetLastChild(arr);
-  JsVarInt lastArrayIndex = 0;
-  // Look at last non-string element!
-  while (childref) {
-    JsVar *child = jsvLock(childref);
-    if (jsvIsInt(child)) {
-      lastArrayIndex = child->varData.integer;
-      // it was the last element... sorted!
-      if (lastArrayIndex == index) {
-        return jsvSkipNameAndUnLock(child);
-      }
-      jsvUnLock(child);
-      break;
-    }
-    // if not an int, keep going
-    childref = jsvGetPrevSibling(child);
-    jsvUnLock(child);
-  }
-  // it's not in this array - don't search the whole lot...
-  if (index > lastArrayIndex)
-    return 0;
-  // otherwise is it more than halfway through?
-  if (index > lastArrayIndex/2) {
-    // it's in the final half of the array (probably) - search backwards
-    while (childref) {
-      JsVar *child = jsvLock(childref);
-
-      assert(jsvIsInt(child));
-      if (child->varData.integer == index) {
-        return jsvSkipNameAndUnLock(child);
-      }
-      childref = jsvGetPrevSibling(child);
-      jsvUnLock(child);
-    }
-  } else {
-    // it's in the first half of the array (probably) - search forwards
-    childref = jsvGetFirstChild(arr);
-    while (childref) {
-      JsVar *child = jsvLock(childref);
-
-      assert(jsvIsInt(child));
-      if (child->varData.integer == index) {
-        return jsvSkipNameAndUnLock(child);
-      }
-      childref = jsvGetNextSibling(child);
-      jsvUnLock(child);
-    }
-  }
-  return 0; // undefined
+  return jsvSkipNameAndUnLock(jsvFindArrayChild((JsVar*)arr, index));
 }
 
 // Get all elements from arr and put them in itemPtr (unless it'd overflow).
@@ -2773,16 +3879,97 @@ void jsvArrayInsertBefore(JsVar *arr, JsVar *beforeIndex, JsVar *element) {
     jsvArrayPush(arr, element);
 }
 
+/** Get the value of an int or float (or of a name that points to one)
+ * without locking or allocating anything. Returns JSV_INTEGER or JSV_FLOAT,
+ * or JSV_UNUSED if it's any other type */
+static JsVarFlags jsvMathsOpGetNumber(JsVar *v, JsVarInt *i, JsVarFloat *f) {
+  if (!v) return JSV_UNUSED;
+  if (jsvIsNameInt(v)) {
+    *i = (JsVarInt)jsvGetFirstChildSigned(v);
+    return JSV_INTEGER;
+  }
+  if (jsvIsName(v)) {
+    if (jsvIsNameWithValue(v) || jsvIsArrayBufferName(v) || !jsvGetFirstChild(v))
+      return JSV_UNUSED;
+    v = jsvGetAddressOf(jsvGetFirstChild(v));
+  }
+  if (jsvIsSimpleInt(v)) {
+    *i = v->varData.integer;
+    return JSV_INTEGER;
+  }
+  if (jsvIsFloat(v)) {
+    *f = v->varData.floating;
+    return JSV_FLOAT;
+  }
+  return JSV_UNUSED;
+}
+
+/** Fast path for jsvMathsOpSkipNames when both arguments are plain numbers
+ * (the most common case in loops) - this avoids locking values and creating
+ * temporary vars for names. Returns false if it couldn't handle the op. */
+static bool jsvMathsOpNumeric(JsVar *a, JsVar *b, int op, JsVar **result) {
+  JsVarInt ia = 0, ib = 0;
+  JsVarFloat fa = 0, fb = 0;
+  JsVarFlags ta = jsvMathsOpGetNumber(a, &ia, &fa);
+  if (ta==JSV_UNUSED) return false;
+  JsVarFlags tb = jsvMathsOpGetNumber(b, &ib, &fb);
+  if (tb==JSV_UNUSED) return false;
+  if (ta==JSV_INTEGER && tb==JSV_INTEGER) {
+    switch (op) {
+    case '+': *result = jsvNewFromLongInteger((long long)ia + (long long)ib); return true;
+    case '-': *result = jsvNewFromLongInteger((long long)ia - (long long)ib); return true;
+    case '*': *result = jsvNewFromLongInteger((long long)ia * (long long)ib); return true;
+    case '/': *result = jsvNewFromFloat((JsVarFloat)ia/(JsVarFloat)ib); return true;
+    case '%': *result = ib ? jsvNewFromInteger(ia%ib) : jsvNewFromFloat(NAN); return true;
+    case '&': *result = jsvNewFromInteger(ia&ib); return true;
+    case '|': *result = jsvNewFromInteger(ia|ib); return true;
+    case '^': *result = jsvNewFromInteger(ia^ib); return true;
+    case LEX_LSHIFT: *result = jsvNewFromInteger(ia << ib); return true;
+    case LEX_RSHIFT: *result = jsvNewFromInteger(ia >> ib); return true;
+    case LEX_RSHIFTUNSIGNED: *result = jsvNewFromInteger((JsVarInt)(((JsVarIntUnsigned)ia) >> ib)); return true;
+    case LEX_TYPEEQUAL:
+    case LEX_EQUAL:     *result = jsvNewFromBool(ia==ib); return true;
+    case LEX_NTYPEEQUAL:
+    case LEX_NEQUAL:    *result = jsvNewFromBool(ia!=ib); return true;
+    case '<':           *result = jsvNewFromBool(ia<ib); return true;
+    case LEX_LEQUAL:    *result = jsvNewFromBool(ia<=ib); return true;
+    case '>':           *result = jsvNewFromBool(ia>ib); return true;
+    case LEX_GEQUAL:    *result = jsvNewFromBool(ia>=ib); return true;
+    default: return false;
+    }
+  }
+  if (ta==JSV_INTEGER) fa = (JsVarFloat)ia;
+  if (tb==JSV_INTEGER) fb = (JsVarFloat)ib;
+  switch (op) {
+  case '+': *result = jsvNewFromFloat(fa+fb); return true;
+  case '-': *result = jsvNewFromFloat(fa-fb); return true;
+  case '*': *result = jsvNewFromFloat(fa*fb); return true;
+  case '/': *result = jsvNewFromFloat(fa/fb); return true;
+  case '%': *result = jsvNewFromFloat(jswrap_math_mod(fa, fb)); return true;
+  case LEX_TYPEEQUAL:
+  case LEX_EQUAL:     *result = jsvNewFromBool(fa==fb); return true;
+  case LEX_NTYPEEQUAL:
+  case LEX_NEQUAL:    *result = jsvNewFromBool(fa!=fb); return true;
+  case '<':           *result = jsvNewFromBool(fa<fb); return true;
+  case LEX_LEQUAL:    *result = jsvNewFromBool(fa<=fb); return true;
+  case '>':           *result = jsvNewFromBool(fa>fb); return true;
+  case LEX_GEQUAL:    *result = jsvNewFromBool(fa>=fb); return true;
+  default: return false; // bitwise ops need conversion to int
+  }
+}
+
 /** Same as jsvMathsOpPtr, but if a or b are a name, skip them
  * and go to what they point to. Also handle the case where
  * they may be objects with valueOf functions. */
 JsVar *jsvMathsOpSkipNames(JsVar *a, JsVar *b, int op) {
+  JsVar *res;
+  if (jsvMathsOpNumeric(a, b, op, &res)) return res;
   JsVar *pa = jsvSkipName(a);
   JsVar *pb = jsvSkipName(b);
   JsVar *oa = jsvGetValueOf(pa);
   JsVar *ob = jsvGetValueOf(pb);
   jsvUnLock2(pa, pb);
-  JsVar *res = jsvMathsOp(oa,ob,op);
+  res = jsvMathsOp(oa,ob,op);
   jsvUnLock2(oa, ob);
   return res;
 }
@@ -2799,9 +3986,10 @@ bool jsvMathsOpTypeEqual(JsVar *a, JsVar *b) {
   // check type first, then call again to check data
   bool eql = (a==0) == (b==0);
   if (a && b) {
-    // Check whether both are numbers, otherwise check the variable
-    // type flags themselves
+    // Check whether both are numbers or both are strings (which may be stored
+    // differently - eg. flat or not), otherwise check the variable type flags themselves
     eql = ((jsvIsInt(a)||jsvIsFloat(a)) && (jsvIsInt(b)||jsvIsFloat(b))) ||
+        (jsvIsString(a) && jsvIsString(b)) ||
         ((a->flags & JSV_VARTYPEMASK) == (b->flags & JSV_VARTYPEMASK));
   }
   if (eql) {
@@ -3119,10 +4307,21 @@ void jsvTrace(JsVar *var, int indent) {
 }
 
 
-/** Recursively mark the variable */
-static void jsvGarbageCollectMarkUsed(JsVar *var) {
-  var->flags &= (JsVarFlags)~JSV_GARBAGE_COLLECT;
+/// How many vars can be waiting to have their children marked during GC
+#define JSV_GC_MARK_STACK_SIZE 32
+
+/** Vars that have been marked but whose children haven't been. This is a
+ * fixed size so GC uses a constant amount of stack however deep the data
+ * is - if it fills up we note it and rescan memory afterwards */
+typedef struct {
+  JsVarRef refs[JSV_GC_MARK_STACK_SIZE];
+  unsigned int count;
+  bool overflowed;
+} JsvGCMarkStack;
 
+/// Mark a var as used, and if the stack is given, queue it so its children get marked
+static void jsvGarbageCollectMarkVar(JsVar *var, JsvGCMarkStack *stack) {
+  var->flags &= (JsVarFlags)~JSV_GARBAGE_COLLECT;
   if (jsvHasCharacterData(var)) {
     // non-recursively scan strings
     JsVarRef child = jsvGetLastChild(var);
@@ -3133,29 +4332,88 @@ static void jsvGarbageCollectMarkUsed(JsVar *var) {
       child = jsvGetLastChild(childVar);
     }
   }
-  // intentionally no else
+  if (stack && (jsvHasSingleChild(var) || jsvHasChildren(var))) {
+    if (stack->count < JSV_GC_MARK_STACK_SIZE)
+      stack->refs[stack->count++] = jsvGetRef(var);
+    else
+      stack->overflowed = true;
+  }
+}
+
+/// Mark the direct children of a var (see jsvGarbageCollectMarkVar). Return true if anything new was marked
+static bool jsvGarbageCollectMarkChildren(JsVar *var, JsvGCMarkStack *stack) {
+  bool marked = false;
   if (jsvHasSingleChild(var)) {
     if (jsvGetFirstChild(var)) {
       JsVar *childVar = jsvGetAddressOf(jsvGetFirstChild(var));
-      if (childVar->flags & JSV_GARBAGE_COLLECT)
-        jsvGarbageCollectMarkUsed(childVar);
+      if (childVar->flags & JSV_GARBAGE_COLLECT) {
+        jsvGarbageCollectMarkVar(childVar, stack);
+        marked = true;
+      }
     }
   } else if (jsvHasChildren(var)) {
     JsVarRef child = jsvGetFirstChild(var);
     while (child) {
-      JsVar *childVar;
-      childVar = jsvGetAddressOf(child);
-      if (childVar->flags & JSV_GARBAGE_COLLECT)
-        jsvGarbageCollectMarkUsed(childVar);
+      JsVar *childVar = jsvGetAddressOf(child);
+      if (childVar->flags & JSV_GARBAGE_COLLECT) {
+        jsvGarbageCollectMarkVar(childVar, stack);
+        marked = true;
+      }
       child = jsvGetNextSibling(childVar);
     }
   }
+  return marked;
 }
 
+/// Mark the children of everything on the stack, until it's empty
+static void jsvGarbageCollectMarkStack(JsvGCMarkStack *stack) {
+  while (stack->count)
+    jsvGarbageCollectMarkChildren(jsvGetAddressOf(stack->refs[--stack->count]), stack);
+}
+
+/// The stack used while marking from jsvGarbageCollectMarkRef, or 0 for incremental GC
+static INSTANCE_LOCAL JsvGCMarkStack *jsvGCRefStack;
+
+/// Mark a var that is referenced from outside of a JsVar (see jsiEventsForEachRef)
+static void jsvGarbageCollectMarkRef(JsVarRef *ref) {
+  JsVar *var = jsvGetAddressOf(*ref);
+  if (!(var->flags & JSV_GARBAGE_COLLECT)) return;
+  jsvGarbageCollectMarkVar(var, jsvGCRefStack);
+  if (jsvGCRefStack)
+    jsvGarbageCollectMarkStack(jsvGCRefStack);
+#ifndef SAVE_ON_FLASH
+  else
+    jsvGCMarkChanged = true; // so incremental GC marks its children
+#endif
+}
+
+#ifndef SAVE_ON_FLASH
+/** If 'var' is a name that's being garbage collected but the rest of its
+ * characters are in a shared string that's still in use (see
+ * jsvInternTable), unreference that string. Return true if it did */
+static bool jsvGarbageCollectUnRefInterned(JsVar *var) {
+  if (!jsvIsName(var) || !jsvIsString(var) || !jsvGetLastChild(var)) return false;
+  JsVar *rest = jsvGetAddressOf(jsvGetLastChild(var)); // not locked
+  if (rest->flags==JSV_UNUSED || // already GC'd
+      (rest->flags&JSV_GARBAGE_COLLECT) || // marked for GC (so are STRING_EXTs of this name)
+      jsvIsStringExt(rest))
+    return false;
+  jsvUnRef(rest);
+  return true;
+}
+#endif
+
 /** Run a garbage collection sweep - return true if things have been freed */
 bool jsvGarbageCollect() {
   if (isMemoryBusy) return false;
+  // anything in the free queue is unreachable, so finish freeing it properly first
+  bool freedQueue = jsvFreeQueueFirst!=0;
+  jsvFreeQueueDrain(0);
   isMemoryBusy = true;
+  JSTRACE(JST_GC_BEGIN, 0);
+#ifndef SAVE_ON_FLASH
+  jsvGCState = JSVGC_IDLE; // we're doing everything now
+#endif
   JsVarRef i;
   // clear garbage collect flags
   for (i=1;i<=jsVarsSize;i++)  {
@@ -3167,21 +4425,44 @@ bool jsvGarbageCollect() {
         i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
     }
   }
-  // recursively add 'native' vars
+  // mark 'native' vars, and everything they link to
+  JsvGCMarkStack stack;
+  stack.count = 0;
+  stack.overflowed = false;
   for (i=1;i<=jsVarsSize;i++)  {
     JsVar *var = jsvGetAddressOf(i);
     if ((var->flags & JSV_GARBAGE_COLLECT) && // not already GC'd
-        jsvGetLocks(var)>0) // or it is locked
-      jsvGarbageCollectMarkUsed(var);
+        jsvGetLocks(var)>0) { // or it is locked
+      jsvGarbageCollectMarkVar(var, &stack);
+      jsvGarbageCollectMarkStack(&stack);
+    }
     // if we have a flat string, skip that many blocks
     if (jsvIsFlatString(var))
       i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
   }
+  // mark everything that's waiting in the event queue
+  jsvGCRefStack = &stack;
+  jsiEventsForEachRef(jsvGarbageCollectMarkRef);
+  jsvGCRefStack = 0;
+  /* If the stack filled up, some marked vars never had their children
+   * marked - so scan through memory for them until we don't overflow */
+  while (stack.overflowed) {
+    stack.overflowed = false;
+    for (i=1;i<=jsVarsSize;i++)  {
+      JsVar *var = jsvGetAddressOf(i);
+      if ((var->flags&JSV_VARTYPEMASK) != JSV_UNUSED &&
+          !(var->flags & JSV_GARBAGE_COLLECT) &&
+          jsvGarbageCollectMarkChildren(var, &stack))
+        jsvGarbageCollectMarkStack(&stack);
+      if (jsvIsFlatString(var))
+        i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
+    }
+  }
   /* now sweep for things that we can GC!
    * Also update the free list - this means that every new variable that
    * gets allocated gets allocated towards the start of memory, which
    * hopefully helps compact everything towards the start. */
-  bool freedSomething = false;
+  bool freedSomething = freedQueue;
   jsVarFirstEmpty = 0;
   JsVar firstVar; // temporary var to simplify code in the loop below
   jsvSetNextSibling(&firstVar, 0);
@@ -3195,6 +4476,9 @@ bool jsvGarbageCollect() {
         unsigned int count = (unsigned int)jsvGetFlatStringBlocks(var);
         // Free the first block
         var->flags = JSV_UNUSED;
+#ifdef ALLOC_PROFILE
+        jsvAllocProfileFree(i);
+#endif
         // add this to our free list
         jsvSetNextSibling(lastEmpty, i);
         lastEmpty = var;
@@ -3203,6 +4487,9 @@ bool jsvGarbageCollect() {
           i++;
           var = jsvGetAddressOf((JsVarRef)(i));
           var->flags = JSV_UNUSED;
+#ifdef ALLOC_PROFILE
+          jsvAllocProfileFree(i);
+#endif
           // add this to our free list
           jsvSetNextSibling(lastEmpty, i);
           lastEmpty = var;
@@ -3223,6 +4510,9 @@ bool jsvGarbageCollect() {
               jsvUnRef(child);
           }
         }
+#ifndef SAVE_ON_FLASH
+        jsvGarbageCollectUnRefInterned(var);
+#endif
         /* Sanity checks here. We're making sure that any variables that are
          * linked from this one have either already been garbage collected or
          * are marked for GC */
@@ -3240,6 +4530,9 @@ bool jsvGarbageCollect() {
             (jsvGetAddressOf(jsvGetNextSibling(var))->flags&JSV_GARBAGE_COLLECT));
         // free!
         var->flags = JSV_UNUSED;
+#ifdef ALLOC_PROFILE
+        jsvAllocProfileFree(i);
+#endif
         // add this to our free list
         jsvSetNextSibling(lastEmpty, i);
         lastEmpty = var;
@@ -3257,10 +4550,270 @@ bool jsvGarbageCollect() {
    * our fake 'firstVar' variable */
   jsvSetNextSibling(lastEmpty, 0);
   jsVarFirstEmpty = jsvGetNextSibling(&firstVar);
+#ifndef SAVE_ON_FLASH
+  if (freedSomething) jsvLookupCacheInvalidate(0);
+#endif
+  jsvGCCount++;
+  JSTRACE(JST_GC_END, freedSomething);
   isMemoryBusy = false;
   return freedSomething;
 }
 
+#ifndef SAVE_ON_FLASH
+bool jsvIsGarbageCollectingIncrementally() {
+  return jsvGCState != JSVGC_IDLE;
+}
+
+/** Do part of a garbage collection, taking roughly 'budget' time. Rather than
+ * recursing, this makes repeated passes over memory marking the children of
+ * everything that's marked until nothing changes. Anything that is linked to
+ * with jsvRef in the mean time gets marked (see jsvRef), and once a pass
+ * has marked nothing we check atomically that everything locked is marked.
+ * Unmarked vars are then unreachable, so they can be freed in slices too.
+ * Returns true if the collection isn't finished yet. */
+bool jsvGarbageCollectIncremental(JsSysTime budget) {
+  if (isMemoryBusy) return jsvGCState!=JSVGC_IDLE;
+  // anything in the free queue is unreachable, so finish freeing it properly first
+  jsvFreeQueueDrain(0);
+  isMemoryBusy = true;
+  JSTRACE(JST_GC_BEGIN, 1);
+  JsSysTime endTime = jshGetSystemTime() + budget;
+  JsVarRef i;
+  if (jsvGCState == JSVGC_IDLE) {
+    // flag everything as unused - this is fast so we do it all at once
+    for (i=1;i<=jsVarsSize;i++)  {
+      JsVar *var = jsvGetAddressOf(i);
+      if ((var->flags&JSV_VARTYPEMASK) != JSV_UNUSED) {
+        var->flags |= (JsVarFlags)JSV_GARBAGE_COLLECT;
+        if (jsvIsFlatString(var))
+          i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
+      }
+    }
+    jsvGCState = JSVGC_MARK;
+    jsvGCPos = 1;
+    jsvGCMarkChanged = false;
+  }
+  bool freedSomething = false;
+  unsigned int count = 0;
+  while (jsvGCState != JSVGC_IDLE) {
+    // only check the time every so often, as it may be slow
+    if (((++count)&31)==0 && jshGetSystemTime() > endTime)
+      break;
+    if (jsvGCPos > jsVarsSize) { // end of a pass
+      if (jsvGCState == JSVGC_MARK) {
+        if (!jsvGCMarkChanged) {
+          // check nothing that is locked got missed
+          for (i=1;i<=jsVarsSize;i++)  {
+            JsVar *var = jsvGetAddressOf(i);
+            if ((var->flags & JSV_GARBAGE_COLLECT) && jsvGetLocks(var)>0) {
+              var->flags &= (JsVarFlags)~JSV_GARBAGE_COLLECT;
+              jsvGCMarkChanged = true;
+            }
+            if (jsvIsFlatString(var))
+              i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
+          }
+          jsiEventsForEachRef(jsvGarbageCollectMarkRef);
+        }
+        if (jsvGCMarkChanged)
+          jsvGCMarkChanged = false; // go around again
+        else
+          jsvGCState = JSVGC_UNLINK;
+      } else if (jsvGCState == JSVGC_UNLINK) {
+        jsvGCState = JSVGC_SWEEP;
+      } else {
+        jsvGCState = JSVGC_IDLE;
+        jsvGCCount++;
+      }
+      jsvGCPos = 1;
+      continue;
+    }
+    JsVar *var = jsvGetAddressOf(jsvGCPos);
+    JsVarRef next = (JsVarRef)(jsvGCPos+1);
+    if (var->flags & JSV_GARBAGE_COLLECT) {
+      if (jsvGCState == JSVGC_MARK) {
+        if (jsvGetLocks(var)>0) {
+          jsvGarbageCollectMarkVar(var, 0);
+          jsvGCMarkChanged = true;
+        }
+      } else if (jsvGCState == JSVGC_UNLINK) {
+        /* If this links to something that's used, unreference it. We do
+         * this before freeing anything, so the var we link to can't have
+         * been freed and reallocated. */
+        if (jsvHasSingleChild(var) && jsvGetFirstChild(var)) {
+          JsVar *child = jsvGetAddressOf(jsvGetFirstChild(var));
+          if (child->flags!=JSV_UNUSED && !(child->flags&JSV_GARBAGE_COLLECT))
+            jsvUnRef(child);
+          jsvSetFirstChild(var, 0);
+        }
+        if (jsvGarbageCollectUnRefInterned(var))
+          jsvSetLastChild(var, 0);
+      } else { // JSVGC_SWEEP
+        freedSomething = true;
+        if (jsvIsFlatString(var)) {
+          unsigned int blocks = (unsigned int)jsvGetFlatStringBlocks(var);
+          next = (JsVarRef)(next+blocks);
+          while (blocks--) {
+            JsVar *p = jsvGetAddressOf((JsVarRef)(jsvGCPos+blocks+1));
+            p->flags = JSV_UNUSED;
+            jsvFreePtrInternal(p);
+          }
+        }
+        var->flags = JSV_UNUSED;
+        jsvFreePtrInternal(var);
+      }
+    }
+    if (jsvGCState == JSVGC_MARK && !(var->flags & JSV_GARBAGE_COLLECT) &&
+        var->flags != JSV_UNUSED) {
+      jsvGarbageCollectMarkVar(var, 0); // for any string data
+      if (jsvGarbageCollectMarkChildren(var, 0))
+        jsvGCMarkChanged = true;
+    }
+    if (jsvIsFlatString(var))
+      next = (JsVarRef)(next+jsvGetFlatStringBlocks(var));
+    jsvGCPos = next;
+  }
+  if (freedSomething) jsvLookupCacheInvalidate(0);
+  JSTRACE(JST_GC_END, freedSomething);
+  isMemoryBusy = false;
+  return jsvGCState != JSVGC_IDLE;
+}
+
+/// Can jsvDefragment move this var?
+static bool jsvDefragCanMove(JsVar *var) {
+  return (var->flags&JSV_VARTYPEMASK) != JSV_UNUSED &&
+         jsvGetLocks(var)==0 && // something may have a pointer to it
+         !jsvIsRoot(var) &&
+         !jsvIsFlatString(var);
+}
+
+/// If ref is to a var that jsvDefragment has moved, return where it has moved to
+static JsVarRef jsvDefragRemap(JsVarRef ref) {
+  if (!ref) return 0;
+  JsVar *v = jsvGetAddressOf(ref);
+  // nothing else can link to a free var, so an unused var must have been moved
+  if (v->flags == JSV_UNUSED) return jsvGetNextSibling(v);
+  return ref;
+}
+
+static void jsvDefragRemapRef(JsVarRef *ref) {
+  *ref = jsvDefragRemap(*ref);
+}
+
+/** Move unlocked vars from the end of memory into the gaps at the start,
+ * so that free memory is contiguous and big flat strings can be allocated.
+ * Anything that isn't locked may move - so the caller must not be holding
+ * any JsVarRefs to unlocked vars (see E.defrag). Returns the amount of vars
+ * that were moved. */
+unsigned int jsvDefragment() {
+  // get rid of garbage first - it'd stop us moving what's behind it
+  jsvGarbageCollect();
+  if (isMemoryBusy) return 0;
+  isMemoryBusy = true;
+  JsVarRef i;
+  /* Work out the split point. Everything movable above it can be moved into
+   * the gaps below it, so we move as little as possible */
+  unsigned int movable = 0;
+  for (i=1;i<=jsVarsSize;i++)  {
+    JsVar *var = jsvGetAddressOf(i);
+    if (jsvDefragCanMove(var)) movable++;
+    if (jsvIsFlatString(var))
+      i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
+  }
+  unsigned int holes = 0, movableBelow = 0;
+  JsVarRef split = 0;
+  for (i=1;i<=jsVarsSize && holes < movable-movableBelow;i++)  {
+    JsVar *var = jsvGetAddressOf(i);
+    split = i;
+    if (var->flags == JSV_UNUSED) holes++;
+    else if (jsvDefragCanMove(var)) movableBelow++;
+    if (jsvIsFlatString(var))
+      i = split = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
+  }
+  /* Now move vars from above the split into holes below it, leaving the
+   * new address in the old var's nextSibling */
+  unsigned int moved = 0;
+  JsVarRef lo = 1, hi = (JsVarRef)(split+1);
+  while (true) {
+    while (lo<=split && jsvGetAddressOf(lo)->flags != JSV_UNUSED) {
+      JsVar *var = jsvGetAddressOf(lo);
+      if (jsvIsFlatString(var))
+        lo = (JsVarRef)(lo+jsvGetFlatStringBlocks(var));
+      lo++;
+    }
+    while (hi<=jsVarsSize && !jsvDefragCanMove(jsvGetAddressOf(hi))) {
+      JsVar *var = jsvGetAddressOf(hi);
+      if (jsvIsFlatString(var))
+        hi = (JsVarRef)(hi+jsvGetFlatStringBlocks(var));
+      hi++;
+    }
+    if (lo>split || hi>jsVarsSize) break;
+    JsVar *src = jsvGetAddressOf(hi);
+    JsVar *dst = jsvGetAddressOf(lo);
+    *dst = *src;
+#ifdef ALLOC_PROFILE
+    jsvAllocTags[lo-1] = jsvAllocTags[hi-1];
+#endif
+    src->flags = JSV_UNUSED;
+    jsvSetNextSibling(src, lo);
+    moved++;
+    lo++;
+    hi++;
+  }
+  if (moved) {
+    // Now update every link to something that moved
+    for (i=1;i<=jsVarsSize;i++)  {
+      JsVar *var = jsvGetAddressOf(i);
+      if (var->flags == JSV_UNUSED) continue;
+      if (jsvIsName(var) && !jsvIsArrayBufferName(var)) {
+        jsvSetNextSibling(var, jsvDefragRemap(jsvGetNextSibling(var)));
+        jsvSetPrevSibling(var, jsvDefragRemap(jsvGetPrevSibling(var)));
+      }
+      if (jsvHasSingleChild(var) || jsvHasChildren(var))
+        jsvSetFirstChild(var, jsvDefragRemap(jsvGetFirstChild(var)));
+      if (jsvHasChildren(var) || jsvHasCharacterData(var))
+        jsvSetLastChild(var, jsvDefragRemap(jsvGetLastChild(var)));
+      if (jsvIsFlatString(var))
+        i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
+    }
+    jsiEventsForEachRef(jsvDefragRemapRef);
+    /* Object indexes store links to names too. We do these after, as
+     * finding the index means comparing names, which may have moved */
+    for (i=1;i<=jsVarsSize;i++)  {
+      JsVar *var = jsvGetAddressOf(i);
+      JsVar *indexName = jsvObjectGetIndexName(var);
+      if (indexName) {
+        unsigned int n, size;
+        JsVarRef *table = jsvObjectIndexGetTable(indexName, &size);
+        for (n=1;n<=size;n++)
+          table[n] = jsvDefragRemap(table[n]);
+      }
+      if (jsvIsFlatString(var))
+        i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
+    }
+    // Finally rebuild the free list, in order, so we allocate from the start
+    JsVar firstVar; // temporary var to simplify code in the loop below
+    jsvSetNextSibling(&firstVar, 0);
+    JsVar *lastEmpty = &firstVar;
+    for (i=1;i<=jsVarsSize;i++)  {
+      JsVar *var = jsvGetAddressOf(i);
+      if (var->flags == JSV_UNUSED) {
+        jsvSetNextSibling(lastEmpty, i);
+        lastEmpty = var;
+      } else if (jsvIsFlatString(var))
+        i = (JsVarRef)(i+jsvGetFlatStringBlocks(var));
+    }
+    jsvSetNextSibling(lastEmpty, 0);
+    jsVarFirstEmpty = jsvGetNextSibling(&firstVar);
+    jsvLookupCacheInvalidate(0);
+    // strings may have moved
+    memset(jsvStringHints, 0, sizeof(jsvStringHints));
+    jsvDefragCount++;
+  }
+  isMemoryBusy = false;
+  return moved;
+}
+#endif
+
 
 /** Remove whitespace to the right of a string - on MULTIPLE LINES */
 JsVar *jsvStringTrimRight(JsVar *srcString) {
@@ -3411,6 +4964,7 @@ void *jsvMalloc(size_t size) {
 }
 
 void jsvFree(void *ptr) {
+  if (!ptr) return; // like free(), as mbedtls frees pointers it never allocated
   JsVar *flatStr = jsvGetFlatStringFromPointer((char *)ptr);
   //jsiConsolePrintf("jsvFree var %d at %d (%d bytes)\n", jsvGetRef(flatStr), ptr, jsvGetLength(flatStr));
 
@@ -89,8 +89,11 @@ typedef enum {
     JSV_LASTCHILD_BIT9 = JSV_LASTCHILD_BIT8<<1,
     JSV_LASTCHILD_BIT_MASK = JSV_LASTCHILD_BIT8|JSV_LASTCHILD_BIT9,
     JSV_LASTCHILD_BIT_SHIFT = GET_BIT_NUMBER(JSV_LASTCHILD_BIT8),
+    JSV_CONSTANT = JSV_LASTCHILD_BIT9<<1, ///< A shared constant (see jsvNewFromInteger) - it is never freed, and locks are ignored
+#else
+    JSV_CONSTANT = NEXT_POWER_2(JSV_LOCK_MASK), ///< A shared constant (see jsvNewFromInteger) - it is never freed, and locks are ignored
 #endif
-    // 3 bits left over here on most systems, 1 on JSVARREF_PACKED_BITS
+    // 2 bits left over here on most systems, 0 on JSVARREF_PACKED_BITS
     JSV_VARIABLEINFOMASK = JSV_VARTYPEMASK | JSV_NATIVE, // if we're copying a variable, this is all the stuff we want to copy
 } PACKED_FLAGS JsVarFlags; // aiming to get this in 2 bytes!
 
@@ -132,6 +135,12 @@ typedef struct {
   uint16_t argTypes; ///< Actually a list of JsnArgumentType
 } PACKED_FLAGS JsVarDataNative;
 
+/// Data for non-native functions (varData isn't otherwise used for them)
+typedef struct {
+  int8_t tokeniseCalls; ///< Calls so far, until we pre-tokenise its code. -1 if that failed (see jspeGetFunctionCode)
+  bool codeTokenised; ///< JSPARSE_FUNCTION_CODE_NAME was pre-tokenised when the function was defined (see E.setFlags)
+} PACKED_FLAGS JsVarDataFunction;
+
 /// Data for native strings
 typedef struct {
   char *ptr;
@@ -193,6 +202,7 @@ typedef union {
     JsVarFloat floating; ///< The contents of this variable if it is a double
     JsVarDataArrayBufferView arraybuffer; ///< information for array buffer views.
     JsVarDataNative native; ///< A native function
+    JsVarDataFunction function; ///< A non-native function
     JsVarDataNativeStr nativeStr; ///< A native string
     JsVarDataRef ref; ///< References
 } PACKED_FLAGS JsVarData;
@@ -250,6 +260,7 @@ typedef struct {
  * NAME_INT_INT/NAME_INT_BOOL are the same as NAME_INT, except 'child' contains the value rather than a pointer
  * NAME_STRING_INT is the same as NAME_STRING, except 'child' contains the value rather than a pointer
  * FLAT_STRING uses the variable blocks that follow it as flat storage for all the data
+ * Non-native FUNCTIONs use varData for JsVarDataFunction (see jspeFunctionDefinition)
  * NATIVE_FUNCTION's nativePtr is a pointer to code if there is no child called JSPARSE_FUNCTION_CODE_NAME, but if there is one, it's an index into that child
  *
  * For Objects that represent hardware devices, 'nativePtr' is actually set to a special string that
@@ -291,13 +302,35 @@ void jsvInit();
 void jsvKill();
 void jsvSoftInit(); ///< called when loading from flash
 void jsvSoftKill(); ///< called when saving to flash
+#ifndef SAVE_ON_FLASH
+void jsvCreateConstants(); ///< Allocate the shared small int/bool/null constants (see jsvNewFromInteger)
+void jsvReleaseConstants(); ///< Stop sharing small int/bool/null constants (see jsvNewFromInteger)
+#endif
 JsVar *jsvFindOrCreateRoot(); ///< Find or create the ROOT variable item - used mainly if recovering from a saved state.
 unsigned int jsvGetMemoryUsage(); ///< Get number of memory records (JsVars) used
 unsigned int jsvGetMemoryTotal(); ///< Get total amount of memory records
 bool jsvIsMemoryFull(); ///< Get whether memory is full or not
 bool jsvMoreFreeVariablesThan(unsigned int vars); ///< Return whether there are more free variables than the parameter (faster than checking no of vars used)
 void jsvShowAllocated(); ///< Show what is still allocated, for debugging memory problems
-/// Try and allocate more memory - only works if RESIZABLE_JSVARS is defined
+#ifndef SAVE_ON_FLASH
+/// Kinds of variable counted by jsvGetMemoryMap
+typedef enum {
+  JSVM_NAME, JSVM_STRING, JSVM_FLAT_STRING, JSVM_STRING_EXT, JSVM_OBJECT, JSVM_ARRAY,
+  JSVM_FUNCTION, JSVM_ARRAYBUFFER, JSVM_NUMBER, JSVM_OTHER,
+  JSVM_TYPES
+} JsvMemoryMapType;
+#define JSV_MEMORY_MAP_RUNS 8 ///< Free runs are counted in buckets of 1, 2-3, 4-7, ... 128+ blocks
+typedef struct {
+  unsigned int largestFree; ///< Largest run of contiguous free blocks
+  unsigned int freeRuns[JSV_MEMORY_MAP_RUNS]; ///< How many runs of free blocks there are of each length
+  unsigned int blocks[JSVM_TYPES]; ///< How many blocks are used by each kind of variable
+  unsigned int locked; ///< How many variables are locked
+} JsvMemoryMap;
+extern const char *jsvMemoryMapTypeNames[JSVM_TYPES];
+void jsvGetMemoryMap(JsvMemoryMap *map); ///< Scan memory for fragmentation and usage by type
+#endif
+/** Try and allocate more memory - only works if RESIZABLE_JSVARS is defined.
+ * With JSVAR_MALLOC, this sets how many variables jsvInit will allocate */
 void jsvSetMemoryTotal(unsigned int jsNewVarCount);
 
 
@@ -307,9 +340,19 @@ JsVar *jsvNewFlatStringOfLength(unsigned int byteLength); ///< Try and create a
 JsVar *jsvNewFromString(const char *str); ///< Create a new string
 JsVar *jsvNewStringOfLength(unsigned int byteLength); ///< Create a new string of the given length - full of 0s
 static ALWAYS_INLINE JsVar *jsvNewFromEmptyString() { JsVar *v = jsvNewWithFlags(JSV_STRING_0); return v; } ;///< Create a new empty string
-static ALWAYS_INLINE JsVar *jsvNewNull() { return jsvNewWithFlags(JSV_NULL); } ;///< Create a new null variable
+JsVar *jsvNewNull(); ///< Create a new null variable
 /** Create a new variable from a substring. argument must be a string. stridx = start char or str, maxLength = max number of characters (can be JSVAPPENDSTRINGVAR_MAXLENGTH)  */
 JsVar *jsvNewFromStringVar(const JsVar *str, size_t stridx, size_t maxLength);
+/** As jsvNewFromStringVar, but if str is a flat string (or a view of one) this may return a 'view' -
+ * a native string that points at the characters in the flat string and holds a reference to it. The
+ * result must not be modified - use it where a new string would only be read (eg. String.substr) */
+JsVar *jsvNewStringView(JsVar *str, size_t stridx, size_t maxLength);
+/** Call before a flat string's data is handed out somewhere it can be written (eg. E.toArrayBuffer).
+ * Turns any views of it (see jsvNewStringView) back into normal strings, and stops new views being
+ * made, so writes never show up in substrings. Returns false if out of memory */
+bool jsvFlatStringMakeWritable(JsVar *flatStr);
+/** Create a new integer. Small integers, booleans and null may be shared
+ * constants, so values from these must not be modified - see jsvReleaseConstants */
 JsVar *jsvNewFromInteger(JsVarInt value);
 JsVar *jsvNewFromBool(bool value);
 JsVar *jsvNewFromFloat(JsVarFloat value);
@@ -317,12 +360,22 @@ JsVar *jsvNewFromFloat(JsVarFloat value);
 JsVar *jsvNewFromLongInteger(long long value);
 // Turns var into a Variable name that links to the given value... No locking so no need to unlock var
 JsVar *jsvMakeIntoVariableName(JsVar *var, JsVar *valueOrZero);
+#ifndef SAVE_ON_FLASH
+/// Does this name share the rest of its characters with other names? (see jsvMakeIntoVariableName)
+bool jsvIsInternedName(const JsVar *v);
+bool jsvReleaseInternedStrings(); ///< Forget the shared strings used by long names (they're freed when no names use them). Returns true if there were any
+#endif
 void jsvMakeFunctionParameter(JsVar *v);
 JsVar *jsvNewFromPin(int pin);
 JsVar *jsvNewObject(); ///< Create a new object
 JsVar *jsvNewEmptyArray(); ///< Create a new array
 JsVar *jsvNewArray(JsVar **elements, int elementCount); ///< Create an array containing the given elements
 JsVar *jsvNewNativeFunction(void (*ptr)(void), unsigned short argTypes); ///< Create an array containing the given elements
+#ifndef SAVE_ON_FLASH
+/// Like jsvNewNativeFunction, but may return an existing (shared) var for the same function
+JsVar *jsvNewNativeFunctionShared(void (*ptr)(void), unsigned short argTypes);
+bool jsvReleaseNativeFunctions(); ///< Stop sharing the vars returned by jsvNewNativeFunctionShared. Returns true if there were any
+#endif
 JsVar *jsvNewArrayBufferFromString(JsVar *str, unsigned int lengthOrZero); ///< Create a new ArrayBuffer backed by the given string. If length is not specified, it will be worked out
 
 void *jsvGetNativeFunctionPtr(const JsVar *function); ///< Get the actual pointer from a native function - this may not be the contents of varData.native.ptr
@@ -376,6 +429,7 @@ extern ALWAYS_INLINE bool jsvIsBasicString(const JsVar *v); ///< Just a string (
 extern ALWAYS_INLINE bool jsvIsStringExt(const JsVar *v); ///< The extra bits dumped onto the end of a string to store more data
 extern ALWAYS_INLINE bool jsvIsFlatString(const JsVar *v);
 extern ALWAYS_INLINE bool jsvIsNativeString(const JsVar *v);
+extern ALWAYS_INLINE bool jsvIsStringView(const JsVar *v); ///< A native string that points into (and references) a flat string - see jsvNewStringView
 extern ALWAYS_INLINE bool jsvIsNumeric(const JsVar *v);
 extern ALWAYS_INLINE bool jsvIsFunction(const JsVar *v);
 extern ALWAYS_INLINE bool jsvIsFunctionReturn(const JsVar *v); ///< Is this a function with an implicit 'return' at the start?
@@ -514,6 +568,11 @@ size_t jsvGetFlatStringBlocks(const JsVar *v); ///< return the number of blocks
 char *jsvGetFlatStringPointer(JsVar *v); ///< Get a pointer to the data in this flat string
 JsVar *jsvGetFlatStringFromPointer(char *v); ///< Given a pointer to the first element of a flat string, return the flat string itself (DANGEROUS!)
 char *jsvGetDataPointer(JsVar *v, size_t *len); ///< If the variable points to a *flat* area of memory, return a pointer (and set length). Otherwise return 0.
+char *jsvGetWritableDataPointer(JsVar *v, size_t *len); ///< Like jsvGetDataPointer, but only for data in RAM that can be written - not memory-mapped data like E.memoryArea
+#ifndef SAVE_ON_FLASH
+JsVar *jsvStringSeekHintGet(JsVar *str, size_t idx, size_t *blockIndex); ///< If we know where a block of basic string str at or before idx is (see jsvStringIteratorNew), return it locked and set blockIndex to the index of its first character
+void jsvStringSeekHintSet(JsVar *str, JsVar *block, size_t blockIndex); ///< Remember that block (starting at character blockIndex) is part of basic string str
+#endif
 size_t jsvGetLinesInString(JsVar *v); ///<  IN A STRING get the number of lines in the string (min=1)
 size_t jsvGetCharsOnLine(JsVar *v, size_t line); ///<  IN A STRING Get the number of characters on a line - lines start at 1
 void jsvGetLineAndCol(JsVar *v, size_t charIdx, size_t *line, size_t *col); ///< IN A STRING, get the 1-based line and column of the given character. Both values must be non-null
@@ -647,6 +706,11 @@ JsVar *jsvSetNamedChild(JsVar *parent, JsVar *child, const char *name); // Add a
 JsVar *jsvSetValueOfName(JsVar *name, JsVar *src); // Set the value of a child created with jsvAddName,jsvAddNamedChild. Returns the UNLOCKED name argument
 JsVar *jsvFindChildFromString(JsVar *parent, const char *name, bool createIfNotFound); // Non-recursive finding of child with name. Returns a LOCKED var
 JsVar *jsvFindChildFromVar(JsVar *parent, JsVar *childName, bool addIfNotFound); // Non-recursive finding of child with name. Returns a LOCKED var
+#ifndef SAVE_ON_FLASH
+JsVar *jsvFindChildFromStringCached(JsVar *parent, const char *name); // Like jsvFindChildFromString, but uses a cache of recent lookups. Returns a LOCKED var
+void jsvLookupCacheInvalidate(JsVarRef parent); ///< Remove cached lookups for the given parent - or everything if parent==0
+void jsvGetLookupCacheStats(unsigned int *hits, unsigned int *misses); ///< Get the hit/miss counts for jsvFindChildFromStringCached
+#endif
 
 /// Remove a child - note that the child MUST ACTUALLY BE A CHILD! and should be a name, not a value.
 void jsvRemoveChild(JsVar *parent, JsVar *child);
@@ -686,6 +750,56 @@ void jsvTrace(JsVar *var, int indent);
 
 /** Run a garbage collection sweep - return true if things have been freed */
 bool jsvGarbageCollect();
+/** Free the children of freed objects that are still waiting in the free queue, taking
+ * roughly 'budget' time (or as long as needed if 0). Returns true if there are more left */
+bool jsvFreeQueueDrain(JsSysTime budget);
+extern INSTANCE_LOCAL unsigned int jsvGCCount; ///< How many garbage collections have been completed
+#ifndef SAVE_ON_FLASH
+extern INSTANCE_LOCAL unsigned int jsvAllocCount; ///< How many vars have been allocated (it wraps around)
+typedef enum {
+  JSV_LOWMEM_ARMED,   ///< Waiting for free variables to drop below jsvLowMemoryThreshold
+  JSV_LOWMEM_PENDING, ///< The allocator found memory low - the 'lowMemory' event should be fired from idle
+  JSV_LOWMEM_FIRED,   ///< Event fired - waiting for memory to recover before we re-arm
+} PACKED_FLAGS JsvLowMemoryState;
+/// If nonzero, when fewer than this many variables are free jsvNewWithFlags sets jsvLowMemoryState to pending
+extern INSTANCE_LOCAL unsigned int jsvLowMemoryThreshold;
+extern volatile JsvLowMemoryState jsvLowMemoryState;
+#endif
+#ifndef SAVE_ON_FLASH
+/** Do part of a garbage collection, taking roughly 'budget' time. Returns
+ * true if the collection isn't finished yet (see E.setGCMode) */
+bool jsvGarbageCollectIncremental(JsSysTime budget);
+/// Is an incremental garbage collection part way through?
+bool jsvIsGarbageCollectingIncrementally();
+extern INSTANCE_LOCAL bool jsvGCIncremental; ///< Should jsiIdle collect garbage incrementally?
+extern INSTANCE_LOCAL JsSysTime jsvGCSliceTime; ///< How long should each slice of incremental GC take?
+/** Move unlocked vars into gaps at the start of memory so free space is
+ * contiguous. Returns the amount of vars moved (see E.defrag) */
+unsigned int jsvDefragment();
+extern INSTANCE_LOCAL unsigned int jsvDefragCount; ///< How many times jsvDefragment has moved vars (so anything holding JsVarRefs knows to update them)
+#endif
+
+#ifdef ALLOC_PROFILE
+#define JSV_ALLOC_PROFILE_SITES 16 ///< How many different things we record allocations for
+
+/// Allocations made by one native or JS function (see E.getAllocStats)
+typedef struct {
+  size_t key; ///< A native function's pointer, or a JS function's ref (0 if unused)
+  char name[12]; ///< The name the function was called with
+  unsigned int allocs; ///< How many vars have been allocated
+  unsigned int live; ///< How many of those vars are still in use
+  unsigned int peak; ///< The most vars from here that have been in use at once
+  unsigned int lastAllocs; ///< 'allocs' when the stats were last read
+} JsvAllocSite;
+extern INSTANCE_LOCAL JsvAllocSite jsvAllocSites[JSV_ALLOC_PROFILE_SITES];
+extern INSTANCE_LOCAL unsigned int jsvAllocUsed; ///< How many vars are in use
+extern INSTANCE_LOCAL unsigned int jsvAllocPeak; ///< The most vars that have been in use at once
+/** Start attributing allocations to the given key (a native function pointer
+ * or a JS function's ref). Returns the old site, for jsvAllocProfileLeave */
+unsigned char jsvAllocProfileEnter(size_t key, JsVar *name);
+/// Go back to attributing allocations to the site before jsvAllocProfileEnter
+void jsvAllocProfileLeave(unsigned char site);
+#endif
 
 /** Remove whitespace to the right of a string - on MULTIPLE LINES */
 JsVar *jsvStringTrimRight(JsVar *srcString);
@@ -128,6 +128,66 @@ static void jsvIterateCallbackToBytesCb(int data, void *userData) {
     cbData->buf[cbData->idx] = (unsigned char)data;
   cbData->idx++;
 }
+/// Call callback for each block of a String, from index 'start' for 'len' characters
+static void jsvIterateBufferCallbackString(JsVar *str, size_t start, size_t len, void (*callback)(const unsigned char *data, size_t len, void *callbackData), void *callbackData) {
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, str, start);
+  while (len && jsvStringIteratorHasChar(&it)) {
+    size_t n = it.charsInVar - it.charIdx;
+    if (n > len) n = len;
+    callback((const unsigned char *)&it.ptr[it.charIdx], n, callbackData);
+    len -= n;
+    // skip to the start of the next block
+    it.charIdx = it.charsInVar-1;
+    jsvStringIteratorNext(&it);
+  }
+  jsvStringIteratorFree(&it);
+}
+
+typedef struct {
+  void (*callback)(const unsigned char *data, size_t len, void *callbackData);
+  void *callbackData;
+  unsigned char buf[32];
+  size_t len;
+} JsvIterateBufferCallbackData;
+static void jsvIterateBufferCallbackCb(int data, void *userData) {
+  JsvIterateBufferCallbackData *cbData = (JsvIterateBufferCallbackData*)userData;
+  cbData->buf[cbData->len++] = (unsigned char)data;
+  if (cbData->len == sizeof(cbData->buf)) {
+    cbData->callback(cbData->buf, cbData->len, cbData->callbackData);
+    cbData->len = 0;
+  }
+}
+
+/** Like jsvIterateCallback, but calls callback with blocks of bytes. Flat Strings and ArrayBuffers
+ * are passed in one go, and normal Strings a block at a time, so nothing is copied. Anything else
+ * is passed through a small buffer - so arbitrarily big data can be handled without using
+ * much RAM or stack. */
+void jsvIterateBufferCallback(JsVar *data, void (*callback)(const unsigned char *data, size_t len, void *callbackData), void *callbackData) {
+  size_t len;
+  char *ptr = jsvGetDataPointer(data, &len);
+  if (ptr) {
+    // for ArrayBuffers, len is the number of elements
+    if (jsvIsArrayBuffer(data)) len *= JSV_ARRAYBUFFER_GET_SIZE(data->varData.arraybuffer.type);
+    if (len) callback((const unsigned char *)ptr, len, callbackData);
+  } else if (jsvIsString(data)) {
+    jsvIterateBufferCallbackString(data, 0, jsvGetStringLength(data), callback, callbackData);
+  } else if (jsvIsArrayBuffer(data)) {
+    JsVar *str = jsvGetArrayBufferBackingString(data);
+    jsvIterateBufferCallbackString(str, data->varData.arraybuffer.byteOffset,
+        (size_t)jsvGetArrayBufferLength(data)*JSV_ARRAYBUFFER_GET_SIZE(data->varData.arraybuffer.type),
+        callback, callbackData);
+    jsvUnLock(str);
+  } else {
+    JsvIterateBufferCallbackData cbData;
+    cbData.callback = callback;
+    cbData.callbackData = callbackData;
+    cbData.len = 0;
+    jsvIterateCallback(data, jsvIterateBufferCallbackCb, (void*)&cbData);
+    if (cbData.len) callback(cbData.buf, cbData.len, callbackData);
+  }
+}
+
 /** Write all data in array to the data pointer (of size dataSize bytes) */
 unsigned int jsvIterateCallbackToBytes(JsVar *var, unsigned char *data, unsigned int dataSize) {
   JsvIterateCallbackToBytesData cbData;
@@ -138,6 +198,23 @@ unsigned int jsvIterateCallbackToBytes(JsVar *var, unsigned char *data, unsigned
   return cbData.idx;
 }
 
+static void jsvIterateBufferToBytesCb(const unsigned char *data, size_t len, void *userData) {
+  JsvIterateCallbackToBytesData *cbData = (JsvIterateCallbackToBytesData*)userData;
+  if (len > cbData->length - cbData->idx) len = cbData->length - cbData->idx;
+  memmove(&cbData->buf[cbData->idx], data, len); // data may be in the same buffer
+  cbData->idx += (unsigned int)len;
+}
+
+/** Copy the raw bytes of a String or ArrayBuffer to the data pointer (of size dataSize bytes) a block at a time */
+unsigned int jsvIterateBufferToBytes(JsVar *var, unsigned char *data, unsigned int dataSize) {
+  JsvIterateCallbackToBytesData cbData;
+  cbData.buf = (unsigned char *)data;
+  cbData.idx = 0;
+  cbData.length = dataSize;
+  jsvIterateBufferCallback(var, jsvIterateBufferToBytesCb, (void*)&cbData);
+  return cbData.idx;
+}
+
 // --------------------------------------------------------------------------------------------
 
 void jsvStringIteratorNew(JsvStringIterator *it, JsVar *str, size_t startIdx) {
@@ -153,6 +230,22 @@ void jsvStringIteratorNew(JsvStringIterator *it, JsVar *str, size_t startIdx) {
   } else{
     it->ptr = &it->var->varData.str[0];
   }
+#ifndef SAVE_ON_FLASH
+  // If we're seeking past the first block, start from a block we found before if we can
+  bool useSeekHint = startIdx >= it->charsInVar && jsvIsBasicString(str);
+  if (useSeekHint) {
+    size_t blockIndex;
+    JsVar *block = jsvStringSeekHintGet(str, startIdx, &blockIndex);
+    if (block) {
+      jsvUnLock(it->var);
+      it->var = block;
+      it->ptr = &block->varData.str[0];
+      it->varIndex = blockIndex;
+      it->charIdx = startIdx - blockIndex;
+      it->charsInVar = jsvGetCharactersInVar(block);
+    }
+  }
+#endif
   while (it->charIdx>0 && it->charIdx >= it->charsInVar) {
     it->charIdx -= it->charsInVar;
     it->varIndex += it->charsInVar;
@@ -173,6 +266,10 @@ void jsvStringIteratorNew(JsvStringIterator *it, JsVar *str, size_t startIdx) {
       }
     }
   }
+#ifndef SAVE_ON_FLASH
+  if (useSeekHint && it->var!=str)
+    jsvStringSeekHintSet(str, it->var, it->varIndex);
+#endif
 }
 
 JsvStringIterator jsvStringIteratorClone(JsvStringIterator *it) {
@@ -182,7 +279,8 @@ JsvStringIterator jsvStringIteratorClone(JsvStringIterator *it) {
 }
 
 void jsvStringIteratorSetChar(JsvStringIterator *it, char c) {
-  if (jsvStringIteratorHasChar(it))
+  // Native strings reference memory elsewhere (eg. flash via E.memoryArea) so are read-only
+  if (jsvStringIteratorHasChar(it) && !jsvIsNativeString(it->var))
     it->ptr[it->charIdx] = c;
 }
 
@@ -275,6 +373,20 @@ void jsvObjectIteratorRemoveAndGotoNext(JsvObjectIterator *it, JsVar *parent) {
   }
 }
 
+/// Is child still in parent's list of children? (jsvRemoveChild clears the sibling links)
+static bool jsvObjectIteratorIsInParent(JsVar *parent, JsVar *child) {
+  return jsvGetPrevSibling(child) || jsvGetNextSibling(child) ||
+         jsvGetFirstChild(parent)==jsvGetRef(child);
+}
+
+void jsvObjectIteratorSkipRemoved(JsvObjectIterator *it, JsVar *parent, JsVar *prev) {
+  if (!it->var || jsvObjectIteratorIsInParent(parent, it->var)) return;
+  jsvUnLock(it->var);
+  it->var = 0;
+  if (prev && jsvObjectIteratorIsInParent(parent, prev) && jsvGetNextSibling(prev))
+    it->var = jsvLock(jsvGetNextSibling(prev));
+}
+
 // --------------------------------------------------------------------------------------------
 void   jsvArrayBufferIteratorNew(JsvArrayBufferIterator *it, JsVar *arrayBuffer, size_t index) {
   assert(jsvIsArrayBuffer(arrayBuffer));
@@ -286,7 +398,7 @@ void   jsvArrayBufferIteratorNew(JsvArrayBufferIterator *it, JsVar *arrayBuffer,
 
   it->byteLength += it->byteOffset; // because we'll check if we have more bytes using this
   it->byteOffset = it->byteOffset + index*JSV_ARRAYBUFFER_GET_SIZE(it->type);
-  if (it->byteOffset>=(it->byteLength+1-JSV_ARRAYBUFFER_GET_SIZE(it->type))) {
+  if (it->byteOffset+JSV_ARRAYBUFFER_GET_SIZE(it->type) > it->byteLength) {
     jsvUnLock(arrayBufferData);
     it->type = ARRAYBUFFERVIEW_UNDEFINED;
     return;
@@ -303,10 +415,35 @@ ALWAYS_INLINE JsvArrayBufferIterator jsvArrayBufferIteratorClone(JsvArrayBufferI
   return i;
 }
 
+/** Read data from memory-mapped data (a native string - eg. flash memory from E.memoryArea).
+ * On ESP8266 flash can only be read 32 bits at a time, so rather than doing a 32 bit read for
+ * every byte we read each word that the data covers once. */
+static void jsvArrayBufferIteratorReadNative(char *data, const char *ptr, unsigned int dataLen) {
+#ifdef USE_FLASH_MEMORY
+  size_t addr = (size_t)ptr;
+  while (dataLen) {
+    uint32_t word = *(volatile uint32_t*)(addr & ~(size_t)3);
+    unsigned int i = (unsigned int)(addr & 3);
+    for (;i<4 && dataLen;i++,dataLen--,addr++)
+      *(data++) = ((char*)&word)[i];
+  }
+#else
+  memcpy(data, ptr, dataLen);
+#endif
+}
+
 static void jsvArrayBufferIteratorGetValueData(JsvArrayBufferIterator *it, char *data) {
   if (it->type == ARRAYBUFFERVIEW_UNDEFINED) return;
   assert(!it->hasAccessedElement); // we just haven't implemented this case yet
   unsigned int i,dataLen = JSV_ARRAYBUFFER_GET_SIZE(it->type);
+  if (dataLen!=1 && it->it.ptr && jsvIsNativeString(it->it.var) &&
+      it->it.charIdx+dataLen <= it->it.charsInVar) {
+    jsvArrayBufferIteratorReadNative(data, &it->it.ptr[it->it.charIdx], dataLen);
+    // native strings are one block, so we can just skip over the data
+    it->it.charIdx += dataLen;
+    it->hasAccessedElement = true;
+    return;
+  }
   for (i=0;i<dataLen;i++) {
     data[i] = jsvStringIteratorGetChar(&it->it);
     if (dataLen!=1) jsvStringIteratorNext(&it->it);
@@ -330,7 +467,7 @@ static JsVarFloat jsvArrayBufferIteratorDataToFloat(JsvArrayBufferIterator *it,
   unsigned int dataLen = JSV_ARRAYBUFFER_GET_SIZE(it->type);
   JsVarFloat v = 0;
   if (dataLen==4) v = *(float*)data;
-  else if (dataLen==8) v = *(double*)data;
+  else if (dataLen==8) v = (JsVarFloat)*(double*)data;
   else assert(0);
   return v;
 }
@@ -401,42 +538,54 @@ static void jsvArrayBufferIteratorFloatToData(char *data,  unsigned int dataLen,
   else assert(0);
 }
 
+static void jsvArrayBufferIteratorSetValueData(JsvArrayBufferIterator *it, char *data) {
+  assert(!it->hasAccessedElement); // we just haven't implemented this case yet
+  unsigned int i,dataLen = JSV_ARRAYBUFFER_GET_SIZE(it->type);
+  for (i=0;i<dataLen;i++) {
+    jsvStringIteratorSetChar(&it->it, data[i]);
+    if (dataLen!=1) jsvStringIteratorNext(&it->it);
+  }
+  if (dataLen!=1) it->hasAccessedElement = true;
+}
+
 void jsvArrayBufferIteratorSetIntegerValue(JsvArrayBufferIterator *it, JsVarInt v) {
   if (it->type == ARRAYBUFFERVIEW_UNDEFINED) return;
-  assert(!it->hasAccessedElement); // we just haven't implemented this case yet
   char data[8];
-  unsigned int i,dataLen = JSV_ARRAYBUFFER_GET_SIZE(it->type);
+  unsigned int dataLen = JSV_ARRAYBUFFER_GET_SIZE(it->type);
 
   if (JSV_ARRAYBUFFER_IS_FLOAT(it->type)) {
     jsvArrayBufferIteratorFloatToData(data, dataLen, it->type, (JsVarFloat)v);
   } else {
     jsvArrayBufferIteratorIntToData(data, dataLen, it->type, v);
   }
+  jsvArrayBufferIteratorSetValueData(it, data);
+}
 
-  for (i=0;i<dataLen;i++) {
-    jsvStringIteratorSetChar(&it->it, data[i]);
-    if (dataLen!=1) jsvStringIteratorNext(&it->it);
+void jsvArrayBufferIteratorSetFloatValue(JsvArrayBufferIterator *it, JsVarFloat v) {
+  if (it->type == ARRAYBUFFERVIEW_UNDEFINED) return;
+  char data[8];
+  unsigned int dataLen = JSV_ARRAYBUFFER_GET_SIZE(it->type);
+
+  if (JSV_ARRAYBUFFER_IS_FLOAT(it->type)) {
+    jsvArrayBufferIteratorFloatToData(data, dataLen, it->type, v);
+  } else {
+    // the same conversion as jsvGetInteger
+    jsvArrayBufferIteratorIntToData(data, dataLen, it->type, isfinite(v) ? (JsVarInt)(long long)v : 0);
   }
-  if (dataLen!=1) it->hasAccessedElement = true;
+  jsvArrayBufferIteratorSetValueData(it, data);
 }
 
 void   jsvArrayBufferIteratorSetValue(JsvArrayBufferIterator *it, JsVar *value) {
   if (it->type == ARRAYBUFFERVIEW_UNDEFINED) return;
-  assert(!it->hasAccessedElement); // we just haven't implemented this case yet
   char data[8];
-  unsigned int i,dataLen = JSV_ARRAYBUFFER_GET_SIZE(it->type);
+  unsigned int dataLen = JSV_ARRAYBUFFER_GET_SIZE(it->type);
 
   if (JSV_ARRAYBUFFER_IS_FLOAT(it->type)) {
     jsvArrayBufferIteratorFloatToData(data, dataLen, it->type, jsvGetFloat(value));
   } else {
     jsvArrayBufferIteratorIntToData(data, dataLen, it->type, jsvGetInteger(value));
   }
-
-  for (i=0;i<dataLen;i++) {
-    jsvStringIteratorSetChar(&it->it, data[i]);
-    if (dataLen!=1) jsvStringIteratorNext(&it->it);
-  }
-  if (dataLen!=1) it->hasAccessedElement = true;
+  jsvArrayBufferIteratorSetValueData(it, data);
 }
 
 void jsvArrayBufferIteratorSetByteValue(JsvArrayBufferIterator *it, char c) {
@@ -463,7 +612,7 @@ JsVar* jsvArrayBufferIteratorGetIndex(JsvArrayBufferIterator *it) {
 bool   jsvArrayBufferIteratorHasElement(JsvArrayBufferIterator *it) {
   if (it->type == ARRAYBUFFERVIEW_UNDEFINED) return false;
   if (it->hasAccessedElement) return true;
-  return it->byteOffset <= (it->byteLength-JSV_ARRAYBUFFER_GET_SIZE(it->type));
+  return it->byteOffset+JSV_ARRAYBUFFER_GET_SIZE(it->type) <= it->byteLength;
 }
 
 void   jsvArrayBufferIteratorNext(JsvArrayBufferIterator *it) {
@@ -30,6 +30,14 @@ int jsvIterateCallbackCount(JsVar *var);
 /** Write all data in array to the data pointer (of size dataSize bytes) */
 unsigned int jsvIterateCallbackToBytes(JsVar *var, unsigned char *data, unsigned int dataSize);
 
+/** Copy the raw bytes of a String or ArrayBuffer to the data pointer (of size dataSize bytes) a
+ * block at a time, rather than calling back for each element. Returns the number of bytes copied */
+unsigned int jsvIterateBufferToBytes(JsVar *var, unsigned char *data, unsigned int dataSize);
+
+/** Like jsvIterateCallback, but calls callback with blocks of bytes without copying Strings or
+ * ArrayBuffers - so big data can be handled without needing RAM or stack for all of it */
+void jsvIterateBufferCallback(JsVar *data, void (*callback)(const unsigned char *data, size_t len, void *callbackData), void *callbackData);
+
 // --------------------------------------------------------------------------------------------
 typedef struct JsvStringIterator {
   size_t charIdx; ///< index of character in var
@@ -148,6 +156,10 @@ void jsvObjectIteratorNext(JsvObjectIterator *it);
 /// Remove the current element and move to next element. Needs the parent supplied (the JsVar passed to jsvObjectIteratorNew) as we don't store it
 void jsvObjectIteratorRemoveAndGotoNext(JsvObjectIterator *it, JsVar *parent);
 
+/** If the current element has since been removed from the parent (eg. by code run while iterating), move
+ * to the element after prev (the one we were on before) instead - or to the end if that was removed too */
+void jsvObjectIteratorSkipRemoved(JsvObjectIterator *it, JsVar *parent, JsVar *prev);
+
 static ALWAYS_INLINE void jsvObjectIteratorFree(JsvObjectIterator *it) {
   jsvUnLock(it->var);
 }
@@ -180,6 +192,7 @@ JsVarFloat jsvArrayBufferIteratorGetFloatValue(JsvArrayBufferIterator *it);
 void   jsvArrayBufferIteratorSetValue(JsvArrayBufferIterator *it, JsVar *value);
 void   jsvArrayBufferIteratorSetValueAndRewind(JsvArrayBufferIterator *it, JsVar *value);
 void   jsvArrayBufferIteratorSetIntegerValue(JsvArrayBufferIterator *it, JsVarInt value);
+void   jsvArrayBufferIteratorSetFloatValue(JsvArrayBufferIterator *it, JsVarFloat value);
 void   jsvArrayBufferIteratorSetByteValue(JsvArrayBufferIterator *it, char c); ///< special case for when we know we're writing to a byte array
 JsVar* jsvArrayBufferIteratorGetIndex(JsvArrayBufferIterator *it);
 bool   jsvArrayBufferIteratorHasElement(JsvArrayBufferIterator *it);
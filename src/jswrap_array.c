@@ -141,7 +141,7 @@ JsVar *jswrap_array_join(JsVar *parent, JsVar *filler) {
   "name" : "push",
   "generate" : "jswrap_array_push",
   "params" : [
-    ["arguments","JsVarArray","One or more arguments to add"]
+    ["arguments","JsVarArgs","One or more arguments to add"]
   ],
   "return" : ["int","The new size of the array"]
 }
@@ -149,18 +149,12 @@ Push a new value onto the end of this array'
 
 This is the opposite of `[1,2,3].unshift(0)`, which adds one or more elements to the beginning of the array.
  */
-JsVarInt jswrap_array_push(JsVar *parent, JsVar *args) {
+JsVarInt jswrap_array_push(JsVar *parent, JsVar **argPtr, int argCount) {
   if (!jsvIsArray(parent)) return -1;
   JsVarInt len = -1;
-  JsvObjectIterator it;
-  jsvObjectIteratorNew(&it, args);
-  while (jsvObjectIteratorHasValue(&it)) {
-    JsVar *el = jsvObjectIteratorGetValue(&it);
-    len = jsvArrayPush(parent, el);
-    jsvUnLock(el);
-    jsvObjectIteratorNext(&it);
-  }
-  jsvObjectIteratorFree(&it);
+  int i;
+  for (i=0;i<argCount;i++)
+    len = jsvArrayPush(parent, argPtr[i]);
   if (len<0) 
     len = jsvGetArrayLength(parent);
   return len;
@@ -179,6 +173,19 @@ Remove and return the value on the end of this array.
 This is the opposite of `[1,2,3].shift()`, which removes an element from the beginning of the array.
  */
 
+/** Get a variable containing 'index' to pass to a native callback. If the last one we passed
+ * (lastIndex) wasn't kept by the callback, it's reused rather than allocating a new one. */
+JsVar *_jswrap_array_reuseIndex(JsVar *lastIndex, JsVarInt index) {
+  // shared constants (small integers) can't be changed, but cost nothing to 'allocate' anyway
+  if (lastIndex && !(lastIndex->flags & JSV_CONSTANT) && jsvIsInt(lastIndex) &&
+      jsvGetRefs(lastIndex)==0 && jsvGetLocks(lastIndex)==1) {
+    jsvSetInteger(lastIndex, index);
+    return lastIndex;
+  }
+  jsvUnLock(lastIndex);
+  return jsvNewFromInteger(index);
+}
+
 JsVar *_jswrap_array_iterate_with_callback(const char *name, JsVar *parent, JsVar *funcVar, JsVar *thisVar, bool wantArray, bool isBoolCallback, bool expectedValue) {
   if (!jsvIsIterable(parent)) {
     jsExceptionHere(JSET_ERROR, "Array.%s can only be called on something iterable", name);
@@ -197,6 +204,10 @@ JsVar *_jswrap_array_iterate_with_callback(const char *name, JsVar *parent, JsVa
     result = jsvNewEmptyArray();
   bool isDone = false;
   if (result || !wantArray) {
+    // built-in functions (eg. Math.abs) can be called directly, without jspeFunctionCall's setup for each element
+    JspNativeCall nativeCall;
+    bool isNative = jspNativeCallStart(&nativeCall, funcVar, thisVar);
+    JsVar *nativeIndex = 0;
     JsvIterator it;
     jsvIteratorNew(&it, parent);
     while (jsvIteratorHasElement(&it) && !isDone) {
@@ -206,10 +217,17 @@ JsVar *_jswrap_array_iterate_with_callback(const char *name, JsVar *parent, JsVa
 
         JsVar *args[3], *cb_result;
         args[0] = jsvIteratorGetValue(&it);
-        args[1] = jsvNewFromInteger(idxValue); // child is a variable name, create a new variable for the index
         args[2] = parent;
-        cb_result = jspeFunctionCall(funcVar, 0, thisVar, false, 3, args);
-        jsvUnLockMany(2,args);
+        if (isNative) {
+          nativeIndex = _jswrap_array_reuseIndex(nativeIndex, idxValue);
+          args[1] = nativeIndex;
+          cb_result = jspNativeCall(&nativeCall, 3, args);
+          jsvUnLock(args[0]);
+        } else {
+          args[1] = jsvNewFromInteger(idxValue); // child is a variable name, create a new variable for the index
+          cb_result = jspeFunctionCall(funcVar, 0, thisVar, false, 3, args);
+          jsvUnLockMany(2,args);
+        }
         if (cb_result) {
           bool matched;
           if (isBoolCallback)
@@ -222,7 +240,7 @@ JsVar *_jswrap_array_iterate_with_callback(const char *name, JsVar *parent, JsVa
             } else { // map
               JsVar *name = jsvNewFromInteger(idxValue);
               if (name) { // out of memory?
-                jsvMakeIntoVariableName(name, cb_result);
+                name = jsvMakeIntoVariableName(name, cb_result);
                 jsvAddName(result, name);
                 jsvUnLock(name);
               }
@@ -239,6 +257,8 @@ JsVar *_jswrap_array_iterate_with_callback(const char *name, JsVar *parent, JsVa
       jsvIteratorNext(&it);
     }
     jsvIteratorFree(&it);
+    jsvUnLock(nativeIndex);
+    if (isNative) jspNativeCallEnd(&nativeCall);
   }
   /* boolean result depends on whether the loop terminated
      early for 'some' or completed for 'every' */
@@ -609,10 +629,21 @@ Returns true if the provided object is an array
  */
 
 
-NO_INLINE static JsVarInt _jswrap_array_sort_compare(JsVar *a, JsVar *b, JsVar *compareFn) {
+NO_INLINE static JsVarInt _jswrap_array_sort_compare(JsVar *a, JsVar *b, JsVar *compareFn, bool numeric) {
   if (compareFn) {
     JsVar *args[2] = {a,b};
     return jsvGetIntegerAndUnLock(jspeFunctionCall(compareFn, 0, 0, false, 2, args));
+  } else if (numeric) {
+    JsVarFloat fa = jsvGetFloat(a), fb = jsvGetFloat(b);
+    bool na = isnan(fa), nb = isnan(fb);
+    if (na || nb) return (JsVarInt)na - (JsVarInt)nb; // NaN goes last
+    return (fa<fb) ? -1 : ((fa>fb) ? 1 : 0);
+  } else if ((jsvIsInt(a) || jsvIsFloat(a)) && (jsvIsInt(b) || jsvIsFloat(b))) {
+    // numbers are still compared as strings, but we don't have to allocate them
+    char sa[JS_NUMBER_BUFFER_SIZE], sb[JS_NUMBER_BUFFER_SIZE];
+    jsvGetString(a, sa, sizeof(sa));
+    jsvGetString(b, sb, sizeof(sb));
+    return strcmp(sa, sb);
   } else {
     JsVar *sa = jsvAsString(a, false);
     JsVar *sb = jsvAsString(b, false);
@@ -622,7 +653,7 @@ NO_INLINE static JsVarInt _jswrap_array_sort_compare(JsVar *a, JsVar *b, JsVar *
   }
 }
 
-NO_INLINE static void _jswrap_array_sort(JsvIterator *head, int n, JsVar *compareFn) {
+NO_INLINE static void _jswrap_array_sort(JsvIterator *head, int n, JsVar *compareFn, bool numeric) {
   if (n < 2) return; // sort done!
 
   JsvIterator pivot = jsvIteratorClone(head);
@@ -640,7 +671,7 @@ NO_INLINE static void _jswrap_array_sort(JsvIterator *head, int n, JsVar *compar
   /* Partition and count sizes. */
   while (--n && !jspIsInterrupted()) {
     JsVar *itValue = jsvIteratorGetValue(&it);
-    JsVarInt cmp = _jswrap_array_sort_compare(itValue, pivotValue, compareFn);
+    JsVarInt cmp = _jswrap_array_sort_compare(itValue, pivotValue, compareFn, numeric);
     if (cmp<=0) {
       if (cmp<0) pivotLowest = false;
       nlo++;
@@ -682,14 +713,154 @@ NO_INLINE static void _jswrap_array_sort(JsvIterator *head, int n, JsVar *compar
   // now recurse. Do RHS first because we can
   // free the pivot early if we do this
   jsvIteratorNext(&pivot);
-  _jswrap_array_sort(&pivot, nhigh, compareFn);
+  _jswrap_array_sort(&pivot, nhigh, compareFn, numeric);
   jsvIteratorFree(&pivot);
   // LHS
   /* If the pivot is the lowest number in this chunk of numbers, then
    * we know that anything to the left of it must be joint equal to it.
    * In that casem there's no need to sort it. */
   if (!pivotLowest)
-    _jswrap_array_sort(head, nlo, compareFn);
+    _jswrap_array_sort(head, nlo, compareFn, numeric);
+}
+
+/// Compare the values of two array element names
+static JsVarInt _jswrap_array_sort_compare_names(JsVarRef a, JsVarRef b, JsVar *compareFn) {
+  JsVar *va = jsvSkipName(_jsvGetAddressOf(a));
+  JsVar *vb = jsvSkipName(_jsvGetAddressOf(b));
+  JsVarInt cmp = _jswrap_array_sort_compare(va, vb, compareFn, false);
+  jsvUnLock2(va, vb);
+  return cmp;
+}
+
+/** Sort an Array whose elements are exactly 0..length-1 by merge sorting
+ * the element names and then relinking them in the new order. Returns false
+ * if the array isn't like that (or we're out of memory) so the quicksort
+ * must be used instead. The merge sort is stable, and needs no swapping of
+ * values. */
+static bool _jswrap_array_mergesort(JsVar *array, JsVar *compareFn) {
+  JsVarInt n = jsvGetArrayLength(array);
+  if (n < 2) return n>=0;
+  // check it's dense
+  JsVarInt i = 0;
+  JsVarRef ref = jsvGetFirstChild(array);
+  while (ref) {
+    JsVar *child = _jsvGetAddressOf(ref);
+    if (!jsvIsInt(child) || child->varData.integer!=i) return false;
+    i++;
+    ref = jsvGetNextSibling(child);
+  }
+  if (i != n) return false;
+  // space for the names, and the same again to merge into
+  JsVar *buf = jsvNewFlatStringOfLength((unsigned int)(sizeof(JsVarRef)*(size_t)n*2));
+  if (!buf) return false;
+  JsVarRef *refs = (JsVarRef*)jsvGetFlatStringPointer(buf);
+  JsVarRef *tmp = refs + n;
+  ref = jsvGetFirstChild(array);
+  for (i=0;i<n;i++) {
+    refs[i] = ref;
+    // lock, so nothing a compare function does can free them
+    ref = jsvGetNextSibling(jsvLock(ref));
+  }
+
+  JsVarInt width;
+  for (width=1; width<n && !jspIsInterrupted(); width*=2) {
+    JsVarInt lo;
+    for (lo=0; lo<n; lo+=width*2) {
+      JsVarInt mid = lo+width, hi = lo+width*2;
+      if (mid > n) mid = n;
+      if (hi > n) hi = n;
+      JsVarInt a = lo, b = mid, o = lo;
+      while (a<mid && b<hi)
+        tmp[o++] = (_jswrap_array_sort_compare_names(refs[b], refs[a], compareFn) < 0) ? refs[b++] : refs[a++];
+      while (a<mid) tmp[o++] = refs[a++];
+      while (b<hi) tmp[o++] = refs[b++];
+    }
+    JsVarRef *t = refs;
+    refs = tmp;
+    tmp = t;
+  }
+
+  /* Relink the names in their new order - unless a compare function has
+   * changed which elements are in the array while we were sorting */
+  bool unchanged = !jspIsInterrupted() && jsvGetArrayLength(array)==n;
+  for (i=0;i<n && unchanged;i++) {
+    JsVar *child = _jsvGetAddressOf(refs[i]);
+    JsVarRef prev = jsvGetPrevSibling(child), next = jsvGetNextSibling(child);
+    unchanged = jsvIsInt(child) &&
+                (prev ? jsvGetNextSibling(_jsvGetAddressOf(prev))==refs[i] : jsvGetFirstChild(array)==refs[i]) &&
+                (next ? jsvGetPrevSibling(_jsvGetAddressOf(next))==refs[i] : jsvGetLastChild(array)==refs[i]);
+  }
+  if (unchanged) {
+    for (i=0;i<n;i++) {
+      JsVar *child = _jsvGetAddressOf(refs[i]);
+      child->varData.integer = i;
+      jsvSetPrevSibling(child, i ? refs[i-1] : 0);
+      jsvSetNextSibling(child, (i<n-1) ? refs[i+1] : 0);
+    }
+    jsvSetFirstChild(array, refs[0]);
+    jsvSetLastChild(array, refs[n-1]);
+#ifndef SAVE_ON_FLASH
+    jsvLookupCacheInvalidate(jsvGetRef(array));
+#endif
+  }
+  for (i=0;i<n;i++)
+    jsvUnLock(_jsvGetAddressOf(refs[i]));
+  jsvUnLock(buf);
+  return true;
+}
+
+/// a<b for integer typed array elements
+#define TYPED_ARRAY_LESS(a,b) ((a)<(b))
+/// a<b for float typed array elements, with NaN ordered after everything else as JS does
+#define TYPED_ARRAY_LESS_FLOAT(a,b) ((a)<(b) || (isnan(b) && !isnan(a)))
+
+/// In-place heap sort of numbers, for typed arrays without a compare function
+#define TYPED_ARRAY_HEAPSORT(NAME, T, LESS) \
+static void NAME(T *d, size_t n) { \
+  size_t start = n/2, end = n; \
+  while (end > 1) { \
+    if (start > 0) { \
+      start--; /* still building the heap */ \
+    } else { \
+      end--; /* move the largest to the end */ \
+      T t = d[end]; d[end] = d[0]; d[0] = t; \
+    } \
+    size_t root = start; \
+    while (root*2+1 < end) { \
+      size_t child = root*2+1; \
+      if (child+1 < end && LESS(d[child], d[child+1])) child++; \
+      if (!LESS(d[root], d[child])) break; \
+      T t = d[root]; d[root] = d[child]; d[child] = t; \
+      root = child; \
+    } \
+  } \
+}
+TYPED_ARRAY_HEAPSORT(_jswrap_array_sort_u8, uint8_t, TYPED_ARRAY_LESS)
+TYPED_ARRAY_HEAPSORT(_jswrap_array_sort_i8, int8_t, TYPED_ARRAY_LESS)
+TYPED_ARRAY_HEAPSORT(_jswrap_array_sort_u16, uint16_t, TYPED_ARRAY_LESS)
+TYPED_ARRAY_HEAPSORT(_jswrap_array_sort_i16, int16_t, TYPED_ARRAY_LESS)
+TYPED_ARRAY_HEAPSORT(_jswrap_array_sort_u32, uint32_t, TYPED_ARRAY_LESS)
+TYPED_ARRAY_HEAPSORT(_jswrap_array_sort_i32, int32_t, TYPED_ARRAY_LESS)
+TYPED_ARRAY_HEAPSORT(_jswrap_array_sort_f32, float, TYPED_ARRAY_LESS_FLOAT)
+TYPED_ARRAY_HEAPSORT(_jswrap_array_sort_f64, double, TYPED_ARRAY_LESS_FLOAT)
+
+/// Sort a typed array's data directly if it's flat. Returns false if it isn't
+static bool _jswrap_array_sort_typed(JsVar *array) {
+  size_t n;
+  char *ptr = jsvGetWritableDataPointer(array, &n);
+  JsVarDataArrayBufferViewType type = array->varData.arraybuffer.type;
+  if (!ptr || ((size_t)ptr & (JSV_ARRAYBUFFER_GET_SIZE(type)-1))) return false;
+  switch (type) {
+  case ARRAYBUFFERVIEW_INT8: _jswrap_array_sort_i8((int8_t*)ptr, n); break;
+  case ARRAYBUFFERVIEW_UINT16: _jswrap_array_sort_u16((uint16_t*)ptr, n); break;
+  case ARRAYBUFFERVIEW_INT16: _jswrap_array_sort_i16((int16_t*)ptr, n); break;
+  case ARRAYBUFFERVIEW_UINT32: _jswrap_array_sort_u32((uint32_t*)ptr, n); break;
+  case ARRAYBUFFERVIEW_INT32: _jswrap_array_sort_i32((int32_t*)ptr, n); break;
+  case ARRAYBUFFERVIEW_FLOAT32: _jswrap_array_sort_f32((float*)ptr, n); break;
+  case ARRAYBUFFERVIEW_FLOAT64: _jswrap_array_sort_f64((double*)ptr, n); break;
+  default: _jswrap_array_sort_u8((uint8_t*)ptr, n); break;
+  }
+  return true;
 }
 
 /*JSON{
@@ -703,13 +874,21 @@ NO_INLINE static void _jswrap_array_sort(JsvIterator *head, int n, JsVar *compar
   ],
   "return" : ["JsVar","This array object"]
 }
-Do an in-place quicksort of the array
+Do an in-place sort of the array. This is stable (elements that compare
+equal stay in the same order) unless the array is sparse.
  */
 JsVar *jswrap_array_sort (JsVar *array, JsVar *compareFn) {
   if (!jsvIsUndefined(compareFn) && !jsvIsFunction(compareFn)) {
     jsExceptionHere(JSET_ERROR, "Expecting compare function, got %t", compareFn);
     return 0;
   }
+  // typed arrays are sorted as numbers, not strings
+  bool numeric = jsvIsArrayBuffer(array) && !compareFn;
+  if (numeric && _jswrap_array_sort_typed(array))
+    return jsvLockAgain(array);
+  if (jsvIsArray(array) && _jswrap_array_mergesort(array, compareFn))
+    return jsvLockAgain(array);
+
   JsvIterator it;
 
   /* Arrays can be sparse and the iterators don't handle this
@@ -734,7 +913,7 @@ JsVar *jswrap_array_sort (JsVar *array, JsVar *compareFn) {
   }
 
   jsvIteratorNew(&it, array);
-  _jswrap_array_sort(&it, n, compareFn);
+  _jswrap_array_sort(&it, n, compareFn, numeric);
   jsvIteratorFree(&it);
   return jsvLockAgain(array);
 }
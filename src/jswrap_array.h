@@ -17,8 +17,9 @@ JsVar *jswrap_array_constructor(JsVar *args);
 bool jswrap_array_contains(JsVar *parent, JsVar *value);
 JsVar *jswrap_array_indexOf(JsVar *parent, JsVar *value);
 JsVar *jswrap_array_join(JsVar *parent, JsVar *filler);
-JsVarInt jswrap_array_push(JsVar *parent, JsVar *args);
+JsVarInt jswrap_array_push(JsVar *parent, JsVar **argPtr, int argCount);
 JsVar *jswrap_array_map(JsVar *parent, JsVar *funcVar, JsVar *thisVar);
+JsVar *_jswrap_array_reuseIndex(JsVar *lastIndex, JsVarInt index);
 JsVar *jswrap_array_shift(JsVar *parent);
 JsVarInt jswrap_array_unshift(JsVar *parent, JsVar *elements);
 JsVar *jswrap_array_slice(JsVar *parent, JsVarInt start, JsVar *endVar);
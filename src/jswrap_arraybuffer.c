@@ -14,7 +14,9 @@
  * ----------------------------------------------------------------------------
  */
 #include "jswrap_arraybuffer.h"
+#include "jswrap_array.h"
 #include "jsparse.h"
+#include "jswrapper.h"
 #include "jsinteractive.h"
 
 /*JSON{
@@ -317,12 +319,46 @@ Create a typed array based on the given input. Either an existing Array Buffer,
 Create a typed array based on the given input. Either an existing Array Buffer, an Integer as a Length, or a simple array. If an ArrayBuffer view (eg. Uint8Array rather than ArrayBuffer) is given, it will be completely copied rather than referenced.
  */
 
+/// Can the raw bytes of an array of type 'src' be copied into one of type 'dst' without changing any values?
+static bool jswrap_arraybufferview_isByteCopyable(JsVarDataArrayBufferViewType src, JsVarDataArrayBufferViewType dst) {
+  if (src==ARRAYBUFFERVIEW_ARRAYBUFFER) src = ARRAYBUFFERVIEW_UINT8;
+  if (dst==ARRAYBUFFERVIEW_ARRAYBUFFER) dst = ARRAYBUFFERVIEW_UINT8;
+  if (src==dst) return true;
+  // integers of the same size wrap around to the same bits - but clamping needs the actual value
+  return JSV_ARRAYBUFFER_GET_SIZE(src)==JSV_ARRAYBUFFER_GET_SIZE(dst) &&
+         !JSV_ARRAYBUFFER_IS_FLOAT(src) && !JSV_ARRAYBUFFER_IS_FLOAT(dst) &&
+         !(JSV_ARRAYBUFFER_IS_CLAMPED(dst) && JSV_ARRAYBUFFER_IS_SIGNED(src));
+}
+
+/** If 'dst' is stored in one block of memory and the raw bytes of 'src' (a String or
+ * ArrayBuffer) can be copied straight into it, copy them in from element 'offset' and
+ * return true. Otherwise the caller has to copy element by element. */
+static bool jswrap_arraybufferview_copyBytes(JsVar *dst, size_t offset, JsVar *src) {
+  JsVarDataArrayBufferViewType dstType = dst->varData.arraybuffer.type;
+  JsVarDataArrayBufferViewType srcType;
+  if (jsvIsString(src)) srcType = ARRAYBUFFERVIEW_UINT8;
+  else if (jsvIsArrayBuffer(src)) srcType = src->varData.arraybuffer.type;
+  else return false;
+  if (!jswrap_arraybufferview_isByteCopyable(srcType, dstType)) return false;
+  size_t len;
+  char *ptr = jsvGetWritableDataPointer(dst, &len);
+  if (!ptr) return false;
+  if (offset>=len) return true; // nothing to copy
+  size_t elementSize = JSV_ARRAYBUFFER_GET_SIZE(dstType);
+  jsvIterateBufferToBytes(src, (unsigned char*)&ptr[offset*elementSize], (unsigned int)((len-offset)*elementSize));
+  return true;
+}
+
 JsVar *jswrap_typedarray_constructor(JsVarDataArrayBufferViewType type, JsVar *arr, JsVarInt byteOffset, JsVarInt length) {
   JsVar *arrayBuffer = 0;
-  // Only allow use of byteOffset/length if we're passing an ArrayBuffer - NOT A VIEW.
+  // Only allow use of byteOffset/length if we're passing an ArrayBuffer (or memory area) - NOT A VIEW.
   bool copyData = false;
   if (jsvIsArrayBuffer(arr) && arr->varData.arraybuffer.type==ARRAYBUFFERVIEW_ARRAYBUFFER) {
     arrayBuffer = jsvLockAgain(arr);
+  } else if (jsvIsNativeString(arr)) {
+    /* A memory area (eg. flash, from E.memoryArea) - reference it directly so the data doesn't
+     * use any RAM. Native strings can't be written, so this is read-only. */
+    arrayBuffer = jsvNewArrayBufferFromString(arr, 0);
   } else if (jsvIsNumeric(arr)) {
     length = jsvGetInteger(arr);
     byteOffset = 0;
@@ -337,7 +373,10 @@ JsVar *jswrap_typedarray_constructor(JsVarDataArrayBufferViewType type, JsVar *a
     jsExceptionHere(JSET_ERROR, "Unsupported first argument of type %t\n", arr);
     return 0;
   }
-  if (length==0) length = (JsVarInt)(jsvGetArrayBufferLength(arrayBuffer) / JSV_ARRAYBUFFER_GET_SIZE(type));
+  if (length==0) {
+    JsVarInt bufferLength = (JsVarInt)jsvGetArrayBufferLength(arrayBuffer);
+    length = (byteOffset < bufferLength) ? (JsVarInt)((size_t)(bufferLength-byteOffset) / JSV_ARRAYBUFFER_GET_SIZE(type)) : 0;
+  }
   JsVar *typedArr = jsvNewWithFlags(JSV_ARRAYBUFFER);
   if (typedArr) {
     typedArr->varData.arraybuffer.type = type;
@@ -345,7 +384,7 @@ JsVar *jswrap_typedarray_constructor(JsVarDataArrayBufferViewType type, JsVar *a
     typedArr->varData.arraybuffer.length = (unsigned short)length;
     jsvSetFirstChild(typedArr, jsvGetRef(jsvRef(arrayBuffer)));
 
-    if (copyData) {
+    if (copyData && !(jsvIsArrayBuffer(arr) && jswrap_arraybufferview_copyBytes(typedArr, 0, arr))) {
       // if we were given an array, populate this ArrayBuffer
       JsvIterator it;
       jsvIteratorNew(&it, arr);
@@ -413,6 +452,22 @@ void jswrap_arraybufferview_set(JsVar *parent, JsVar *arr, int offset) {
     jsExceptionHere(JSET_ERROR, "Expecting first argument to be an array, not %t", arr);
     return;
   }
+  if (jswrap_arraybufferview_copyBytes(parent, (size_t)offset, arr))
+    return;
+  // if arr is a view of the same data we'd overwrite it as we copied, so copy it first
+  arr = jsvLockAgain(arr);
+  if (jsvIsArrayBuffer(arr)) {
+    JsVar *srcStr = jsvGetArrayBufferBackingString(arr);
+    JsVar *dstStr = jsvGetArrayBufferBackingString(parent);
+    if (srcStr == dstStr) {
+      JsVar *copy = jswrap_typedarray_constructor(arr->varData.arraybuffer.type, arr, 0, 0);
+      jsvUnLock(arr);
+      arr = copy;
+    }
+    jsvUnLock2(srcStr, dstStr);
+    if (!arr) return; // out of memory
+  }
+
   JsvIterator itsrc;
   jsvIteratorNew(&itsrc, arr);
   JsvArrayBufferIterator itdst;
@@ -433,6 +488,7 @@ void jswrap_arraybufferview_set(JsVar *parent, JsVar *arr, int offset) {
   }
   jsvArrayBufferIteratorFree(&itdst);
   jsvIteratorFree(&itsrc);
+  jsvUnLock(arr);
 }
 
 
@@ -472,6 +528,45 @@ JsVar *jswrap_arraybufferview_map(JsVar *parent, JsVar *funcVar, JsVar *thisVar)
   JsVar *array = jsvNewTypedArray(arrayBufferType, (JsVarInt)jsvGetArrayBufferLength(parent));
   if (!array) return 0;
 
+  JspNativeCall nativeCall;
+  if (jspNativeCallStart(&nativeCall, funcVar, thisVar)) {
+    // a built-in function - call it directly, and if it just takes and returns a number, don't box values at all
+    bool isFloatFn = nativeCall.argTypes == (JSWAT_JSVARFLOAT | (JSWAT_JSVARFLOAT<<JSWAT_BITS));
+    bool isIntFn = nativeCall.argTypes == (JSWAT_INT32 | (JSWAT_INT32<<JSWAT_BITS));
+    JsVar *nativeIndex = 0;
+    JsvArrayBufferIterator itsrc, itdst;
+    jsvArrayBufferIteratorNew(&itsrc, parent, 0);
+    jsvArrayBufferIteratorNew(&itdst, array, 0);
+    while (jsvArrayBufferIteratorHasElement(&itsrc) && !jspHasError()) {
+      if (isFloatFn) {
+        JsVarFloat v = jsvArrayBufferIteratorGetFloatValue(&itsrc);
+        jsvArrayBufferIteratorSetFloatValue(&itdst, ((JsVarFloat (*)(JsVarFloat))nativeCall.ptr)(v));
+      } else if (isIntFn) {
+        JsVarInt v = jsvArrayBufferIteratorGetIntegerValue(&itsrc);
+        jsvArrayBufferIteratorSetIntegerValue(&itdst, ((JsVarInt (*)(JsVarInt))nativeCall.ptr)(v));
+      } else {
+        JsVar *args[3], *mapped;
+        nativeIndex = _jswrap_array_reuseIndex(nativeIndex, (JsVarInt)itsrc.index);
+        args[0] = jsvArrayBufferIteratorGetValue(&itsrc);
+        args[1] = nativeIndex;
+        args[2] = parent;
+        mapped = jspNativeCall(&nativeCall, 3, args);
+        jsvUnLock(args[0]);
+        if (mapped) {
+          jsvArrayBufferIteratorSetValue(&itdst, mapped);
+          jsvUnLock(mapped);
+        }
+      }
+      jsvArrayBufferIteratorNext(&itsrc);
+      jsvArrayBufferIteratorNext(&itdst);
+    }
+    jsvArrayBufferIteratorFree(&itsrc);
+    jsvArrayBufferIteratorFree(&itdst);
+    jsvUnLock(nativeIndex);
+    jspNativeCallEnd(&nativeCall);
+    return array;
+  }
+
   // now iterate
   JsvIterator it; // TODO: if we really are limited to ArrayBuffers, this could be an ArrayBufferIterator.
   jsvIteratorNew(&it, parent);
@@ -505,6 +600,111 @@ JsVar *jswrap_arraybufferview_map(JsVar *parent, JsVar *funcVar, JsVar *thisVar)
 }
 
 
+/*JSON{
+  "type" : "method",
+  "class" : "ArrayBufferView",
+  "name" : "slice",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_arraybufferview_slice",
+  "params" : [
+    ["start","int","Start index"],
+    ["end","JsVar","End index (optional)"]
+  ],
+  "return" : ["JsVar","A new array"],
+  "return_object" : "ArrayBufferView"
+}
+Return a copy of a portion of this array (in a new array of the same type).
+ */
+JsVar *jswrap_arraybufferview_slice(JsVar *parent, JsVarInt start, JsVar *endVar) {
+  if (!jsvIsArrayBuffer(parent)) {
+    jsExceptionHere(JSET_ERROR, "ArrayBufferView.slice can only be called on an ArrayBufferView");
+    return 0;
+  }
+  JsVarInt len = (JsVarInt)jsvGetArrayBufferLength(parent);
+  JsVarInt end = jsvIsUndefined(endVar) ? len : jsvGetInteger(endVar);
+  if (start<0) start += len;
+  if (start<0) start = 0;
+  if (start>len) start = len;
+  if (end<0) end += len;
+  if (end<start) end = start;
+  if (end>len) end = len;
+
+  JsVarDataArrayBufferViewType type = parent->varData.arraybuffer.type;
+  JsVar *array = jsvNewTypedArray(type, end-start);
+  if (!array) return 0;
+  // it's the same type, so we can just copy the bytes
+  size_t elementSize = JSV_ARRAYBUFFER_GET_SIZE(type);
+  size_t srcLen, dstLen, byteCount = (size_t)(end-start)*elementSize;
+  char *src = jsvGetWritableDataPointer(parent, &srcLen); // not memory-mapped, as that may need special reads
+  char *dst = jsvGetWritableDataPointer(array, &dstLen);
+  if (src && dst) {
+    memcpy(dst, &src[(size_t)start*elementSize], byteCount);
+  } else {
+    JsVar *srcStr = jsvGetArrayBufferBackingString(parent);
+    JsVar *dstStr = jsvGetArrayBufferBackingString(array);
+    JsvStringIterator itsrc, itdst;
+    jsvStringIteratorNew(&itsrc, srcStr, parent->varData.arraybuffer.byteOffset + (size_t)start*elementSize);
+    jsvStringIteratorNew(&itdst, dstStr, array->varData.arraybuffer.byteOffset);
+    while (byteCount--) {
+      jsvStringIteratorSetChar(&itdst, jsvStringIteratorGetChar(&itsrc));
+      jsvStringIteratorNext(&itsrc);
+      jsvStringIteratorNext(&itdst);
+    }
+    jsvStringIteratorFree(&itsrc);
+    jsvStringIteratorFree(&itdst);
+    jsvUnLock2(srcStr, dstStr);
+  }
+  return array;
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "ArrayBufferView",
+  "name" : "fill",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_arraybufferview_fill",
+  "params" : [
+    ["value","JsVar","The value to fill the array with"],
+    ["start","int","Optional. The index to start from (or 0). If start is negative, it is treated as length+start where length is the length of the array"],
+    ["end","JsVar","Optional. The index to end at (or the array length). If end is negative, it is treated as length+end."]
+  ],
+  "return" : ["JsVar","This array"],
+  "return_object" : "ArrayBufferView"
+}
+Fill this array with the given value, for every index `>= start` and `< end`
+ */
+JsVar *jswrap_arraybufferview_fill(JsVar *parent, JsVar *value, JsVarInt start, JsVar *endVar) {
+  size_t len;
+  char *ptr = jsvIsArrayBuffer(parent) ? jsvGetWritableDataPointer(parent, &len) : 0;
+  if (!ptr) return jswrap_array_fill(parent, value, start, endVar);
+
+  JsVarInt length = (JsVarInt)len;
+  if (start < 0) start = start + length;
+  if (start < 0) return 0;
+  JsVarInt end = jsvIsNumeric(endVar) ? jsvGetInteger(endVar) : length;
+  if (end < 0) end = end + length;
+  if (end < 0) return 0;
+  if (end > length) end = length;
+  if (start < end) {
+    // convert the value once by setting the first element, then copy its bytes to the rest
+    jsvArrayBufferSet(parent, (size_t)start, value);
+    size_t elementSize = JSV_ARRAYBUFFER_GET_SIZE(parent->varData.arraybuffer.type);
+    size_t done = elementSize, byteCount = (size_t)(end-start)*elementSize;
+    ptr += (size_t)start*elementSize;
+    if (elementSize==1) {
+      memset(&ptr[1], ptr[0], byteCount-1);
+    } else {
+      while (done < byteCount) {
+        size_t n = (done < byteCount-done) ? done : byteCount-done;
+        memcpy(&ptr[done], ptr, n);
+        done += n;
+      }
+    }
+  }
+  return jsvLockAgain(parent);
+}
+
+
 // -----------------------------------------------------------------------------------------------------
 //                                                                      Steal Array's methods for this
 // -----------------------------------------------------------------------------------------------------
@@ -576,44 +776,378 @@ Execute `previousValue=initialValue` and then `previousValue = callback(previous
 /*JSON{
   "type" : "method",
   "class" : "ArrayBufferView",
-  "name" : "fill",
+  "name" : "reverse",
   "ifndef" : "SAVE_ON_FLASH",
-  "generate" : "jswrap_array_fill",
-  "params" : [
-    ["value","JsVar","The value to fill the array with"],
-    ["start","int","Optional. The index to start from (or 0). If start is negative, it is treated as length+start where length is the length of the array"],
-    ["end","JsVar","Optional. The index to end at (or the array length). If end is negative, it is treated as length+end."]
-  ],
+  "generate" : "jswrap_array_reverse",
   "return" : ["JsVar","This array"],
   "return_object" : "ArrayBufferView"
 }
-Fill this array with the given value, for every index `>= start` and `< end`
+Reverse the contents of this arraybuffer in-place
  */
+
+
+/*JSON{
+  "type" : "class",
+  "class" : "DataView",
+  "ifndef" : "SAVE_ON_FLASH"
+}
+This class lets you read and write numbers of different sizes and types, in either
+byte order, at any byte offset in an ArrayBuffer. It's handy for parsing and creating
+binary data such as packets from other devices, eg:
+
+```
+var d = new DataView(E.toArrayBuffer(packet));
+var temperature = d.getInt16(2, true) / 100; // little endian
+```
+
+Unlike `Int16Array/etc`, the offsets don't have to be aligned to the size of the value.
+ */
+
+/*JSON{
+  "type" : "constructor",
+  "class" : "DataView",
+  "name" : "DataView",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_dataview_constructor",
+  "params" : [
+    ["buffer","JsVar","The ArrayBuffer (or a typed array, in which case its ArrayBuffer is used from the start of the array)"],
+    ["byteOffset","int","The offset in bytes from the start of `buffer` (optional)"],
+    ["byteLength","JsVar","The length in bytes (optional - if not specified the DataView extends to the end of `buffer`)"]
+  ],
+  "return" : ["JsVar","A DataView object"],
+  "return_object" : "DataView"
+}
+Create a DataView to access the data in an ArrayBuffer
+ */
+JsVar *jswrap_dataview_constructor(JsVar *buffer, JsVarInt byteOffset, JsVar *byteLengthVar) {
+  if (!jsvIsArrayBuffer(buffer)) {
+    jsExceptionHere(JSET_TYPEERROR, "Expecting an ArrayBuffer, got %t", buffer);
+    return 0;
+  }
+  JsVar *arrayBuffer;
+  JsVarInt bufferLength = (JsVarInt)(buffer->varData.arraybuffer.length * JSV_ARRAYBUFFER_GET_SIZE(buffer->varData.arraybuffer.type));
+  if (buffer->varData.arraybuffer.type == ARRAYBUFFERVIEW_ARRAYBUFFER) {
+    arrayBuffer = jsvLockAgain(buffer);
+  } else {
+    // a view on an ArrayBuffer - use the ArrayBuffer, with the view's offset
+    arrayBuffer = jsvLock(jsvGetFirstChild(buffer));
+    byteOffset += buffer->varData.arraybuffer.byteOffset;
+    bufferLength += buffer->varData.arraybuffer.byteOffset;
+  }
+  JsVarInt byteLength = jsvIsUndefined(byteLengthVar) ? bufferLength-byteOffset : jsvGetInteger(byteLengthVar);
+  if (byteOffset<0 || byteLength<0 || byteOffset+byteLength>bufferLength) {
+    jsExceptionHere(JSET_ERROR, "DataView offset or length is outside the bounds of the buffer");
+    jsvUnLock(arrayBuffer);
+    return 0;
+  }
+  JsVar *dataView = jspNewObject(0, "DataView");
+  if (dataView) {
+    jsvObjectSetChild(dataView, "buffer", arrayBuffer);
+    jsvObjectSetChildAndUnLock(dataView, "byteOffset", jsvNewFromInteger(byteOffset));
+    jsvObjectSetChildAndUnLock(dataView, "byteLength", jsvNewFromInteger(byteLength));
+  }
+  jsvUnLock(arrayBuffer);
+  return dataView;
+}
+
+/** Read or write 'size' bytes at 'offset' in a DataView, to or from 'data' (which is
+ * little endian, like all the platforms we run on). Returns false if out of bounds. */
+static bool jswrap_dataview_access(JsVar *parent, JsVarInt offset, size_t size, char *data, bool isWrite, bool littleEndian) {
+  JsVar *arrayBuffer = jsvObjectGetChild(parent, "buffer", 0);
+  JsVarInt byteOffset = jsvGetIntegerAndUnLock(jsvObjectGetChild(parent, "byteOffset", 0));
+  JsVarInt byteLength = jsvGetIntegerAndUnLock(jsvObjectGetChild(parent, "byteLength", 0));
+  if (!jsvIsArrayBuffer(arrayBuffer) || offset<0 || offset+(JsVarInt)size>byteLength) {
+    jsvUnLock(arrayBuffer);
+    jsExceptionHere(JSET_ERROR, "Offset is outside the bounds of the DataView");
+    return false;
+  }
+  size_t index = (size_t)(byteOffset + offset) + arrayBuffer->varData.arraybuffer.byteOffset;
+  JsVar *str = jsvGetArrayBufferBackingString(arrayBuffer);
+  jsvUnLock(arrayBuffer);
+  size_t i;
+  // if the data is in one block of memory, access it directly
+  char *ptr = 0;
+  if (jsvIsFlatString(str)) ptr = jsvGetFlatStringPointer(str);
+  if (ptr) {
+    ptr += index;
+    for (i=0;i<size;i++) {
+      size_t j = littleEndian ? i : size-1-i;
+      if (isWrite) ptr[j] = data[i];
+      else data[i] = ptr[j];
+    }
+  } else {
+    JsvStringIterator it;
+    jsvStringIteratorNew(&it, str, index);
+    for (i=0;i<size;i++) {
+      size_t j = littleEndian ? i : size-1-i;
+      if (isWrite) jsvStringIteratorSetChar(&it, data[j]);
+      else data[j] = jsvStringIteratorGetChar(&it);
+      jsvStringIteratorNext(&it);
+    }
+    jsvStringIteratorFree(&it);
+  }
+  jsvUnLock(str);
+  return true;
+}
+
+/// Read a value of the given type from a DataView
+JsVar *jswrap_dataview_get(JsVar *parent, JsVarDataArrayBufferViewType type, JsVarInt byteOffset, bool littleEndian) {
+  size_t size = JSV_ARRAYBUFFER_GET_SIZE(type);
+  char data[8];
+  if (!jswrap_dataview_access(parent, byteOffset, size, data, false, littleEndian))
+    return 0;
+  if (type == ARRAYBUFFERVIEW_FLOAT32) {
+    float f;
+    memcpy(&f, data, sizeof(f));
+    return jsvNewFromFloat(f);
+  } else if (type == ARRAYBUFFERVIEW_FLOAT64) {
+    double d;
+    memcpy(&d, data, sizeof(d));
+    return jsvNewFromFloat((JsVarFloat)d);
+  }
+  uint32_t v = 0;
+  memcpy(&v, data, size);
+  if (type == ARRAYBUFFERVIEW_INT8) return jsvNewFromInteger((int8_t)v);
+  if (type == ARRAYBUFFERVIEW_INT16) return jsvNewFromInteger((int16_t)v);
+  if (type == ARRAYBUFFERVIEW_INT32) return jsvNewFromInteger((int32_t)v);
+  return jsvNewFromLongInteger((long long)v);
+}
+
+/// Write a value of the given type to a DataView
+void jswrap_dataview_set(JsVar *parent, JsVarDataArrayBufferViewType type, JsVarInt byteOffset, JsVar *value, bool littleEndian) {
+  size_t size = JSV_ARRAYBUFFER_GET_SIZE(type);
+  char data[8];
+  if (type == ARRAYBUFFERVIEW_FLOAT32) {
+    float f = (float)jsvGetFloat(value);
+    memcpy(data, &f, sizeof(f));
+  } else if (type == ARRAYBUFFERVIEW_FLOAT64) {
+    double d = (double)jsvGetFloat(value);
+    memcpy(data, &d, sizeof(d));
+  } else {
+    // as with typed arrays, values are truncated to the size of the type
+    uint32_t v = (uint32_t)jsvGetLongInteger(value);
+    memcpy(data, &v, size);
+  }
+  jswrap_dataview_access(parent, byteOffset, size, data, true, littleEndian);
+}
+
 /*JSON{
   "type" : "method",
-  "class" : "ArrayBufferView",
-  "name" : "reverse",
+  "class" : "DataView",
+  "name" : "getInt8",
   "ifndef" : "SAVE_ON_FLASH",
-  "generate" : "jswrap_array_reverse",
-  "return" : ["JsVar","This array"],
-  "return_object" : "ArrayBufferView"
+  "generate_full" : "jswrap_dataview_get(parent, ARRAYBUFFERVIEW_INT8, byteOffset, false)",
+  "params" : [
+    ["byteOffset","int","The offset in bytes"]
+  ],
+  "return" : ["JsVar","The value"]
 }
-Reverse the contents of this arraybuffer in-place
+Read a signed byte
  */
 /*JSON{
   "type" : "method",
-  "class" : "ArrayBufferView",
-  "name" : "slice",
+  "class" : "DataView",
+  "name" : "getUint8",
   "ifndef" : "SAVE_ON_FLASH",
-  "generate" : "jswrap_array_slice",
+  "generate_full" : "jswrap_dataview_get(parent, ARRAYBUFFERVIEW_UINT8, byteOffset, false)",
   "params" : [
-    ["start","int","Start index"],
-    ["end","JsVar","End index (optional)"]
+    ["byteOffset","int","The offset in bytes"]
   ],
-  "return" : ["JsVar","A new array"],
-  "return_object" : "Array"
+  "return" : ["JsVar","The value"]
 }
-Return a copy of a portion of this array (in a new array).
-
- **Note:** This currently returns a normal Array, not an ArrayBuffer
+Read an unsigned byte
+ */
+/*JSON{
+  "type" : "method",
+  "class" : "DataView",
+  "name" : "getInt16",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate_full" : "jswrap_dataview_get(parent, ARRAYBUFFERVIEW_INT16, byteOffset, littleEndian)",
+  "params" : [
+    ["byteOffset","int","The offset in bytes"],
+    ["littleEndian","bool","Whether the value is stored little endian (optional - big endian by default)"]
+  ],
+  "return" : ["JsVar","The value"]
+}
+Read a signed 16 bit integer
+ */
+/*JSON{
+  "type" : "method",
+  "class" : "DataView",
+  "name" : "getUint16",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate_full" : "jswrap_dataview_get(parent, ARRAYBUFFERVIEW_UINT16, byteOffset, littleEndian)",
+  "params" : [
+    ["byteOffset","int","The offset in bytes"],
+    ["littleEndian","bool","Whether the value is stored little endian (optional - big endian by default)"]
+  ],
+  "return" : ["JsVar","The value"]
+}
+Read an unsigned 16 bit integer
+ */
+/*JSON{
+  "type" : "method",
+  "class" : "DataView",
+  "name" : "getInt32",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate_full" : "jswrap_dataview_get(parent, ARRAYBUFFERVIEW_INT32, byteOffset, littleEndian)",
+  "params" : [
+    ["byteOffset","int","The offset in bytes"],
+    ["littleEndian","bool","Whether the value is stored little endian (optional - big endian by default)"]
+  ],
+  "return" : ["JsVar","The value"]
+}
+Read a signed 32 bit integer
+ */
+/*JSON{
+  "type" : "method",
+  "class" : "DataView",
+  "name" : "getUint32",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate_full" : "jswrap_dataview_get(parent, ARRAYBUFFERVIEW_UINT32, byteOffset, littleEndian)",
+  "params" : [
+    ["byteOffset","int","The offset in bytes"],
+    ["littleEndian","bool","Whether the value is stored little endian (optional - big endian by default)"]
+  ],
+  "return" : ["JsVar","The value"]
+}
+Read an unsigned 32 bit integer
+ */
+/*JSON{
+  "type" : "method",
+  "class" : "DataView",
+  "name" : "getFloat32",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate_full" : "jswrap_dataview_get(parent, ARRAYBUFFERVIEW_FLOAT32, byteOffset, littleEndian)",
+  "params" : [
+    ["byteOffset","int","The offset in bytes"],
+    ["littleEndian","bool","Whether the value is stored little endian (optional - big endian by default)"]
+  ],
+  "return" : ["JsVar","The value"]
+}
+Read a 32 bit floating point number
+ */
+/*JSON{
+  "type" : "method",
+  "class" : "DataView",
+  "name" : "getFloat64",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate_full" : "jswrap_dataview_get(parent, ARRAYBUFFERVIEW_FLOAT64, byteOffset, littleEndian)",
+  "params" : [
+    ["byteOffset","int","The offset in bytes"],
+    ["littleEndian","bool","Whether the value is stored little endian (optional - big endian by default)"]
+  ],
+  "return" : ["JsVar","The value"]
+}
+Read a 64 bit floating point number
+ */
+/*JSON{
+  "type" : "method",
+  "class" : "DataView",
+  "name" : "setInt8",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate_full" : "jswrap_dataview_set(parent, ARRAYBUFFERVIEW_INT8, byteOffset, value, false)",
+  "params" : [
+    ["byteOffset","int","The offset in bytes"],
+    ["value","JsVar","The value to write"]
+  ]
+}
+Write a signed byte
+ */
+/*JSON{
+  "type" : "method",
+  "class" : "DataView",
+  "name" : "setUint8",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate_full" : "jswrap_dataview_set(parent, ARRAYBUFFERVIEW_UINT8, byteOffset, value, false)",
+  "params" : [
+    ["byteOffset","int","The offset in bytes"],
+    ["value","JsVar","The value to write"]
+  ]
+}
+Write an unsigned byte
+ */
+/*JSON{
+  "type" : "method",
+  "class" : "DataView",
+  "name" : "setInt16",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate_full" : "jswrap_dataview_set(parent, ARRAYBUFFERVIEW_INT16, byteOffset, value, littleEndian)",
+  "params" : [
+    ["byteOffset","int","The offset in bytes"],
+    ["value","JsVar","The value to write"],
+    ["littleEndian","bool","Whether to store the value little endian (optional - big endian by default)"]
+  ]
+}
+Write a signed 16 bit integer
+ */
+/*JSON{
+  "type" : "method",
+  "class" : "DataView",
+  "name" : "setUint16",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate_full" : "jswrap_dataview_set(parent, ARRAYBUFFERVIEW_UINT16, byteOffset, value, littleEndian)",
+  "params" : [
+    ["byteOffset","int","The offset in bytes"],
+    ["value","JsVar","The value to write"],
+    ["littleEndian","bool","Whether to store the value little endian (optional - big endian by default)"]
+  ]
+}
+Write an unsigned 16 bit integer
+ */
+/*JSON{
+  "type" : "method",
+  "class" : "DataView",
+  "name" : "setInt32",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate_full" : "jswrap_dataview_set(parent, ARRAYBUFFERVIEW_INT32, byteOffset, value, littleEndian)",
+  "params" : [
+    ["byteOffset","int","The offset in bytes"],
+    ["value","JsVar","The value to write"],
+    ["littleEndian","bool","Whether to store the value little endian (optional - big endian by default)"]
+  ]
+}
+Write a signed 32 bit integer
+ */
+/*JSON{
+  "type" : "method",
+  "class" : "DataView",
+  "name" : "setUint32",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate_full" : "jswrap_dataview_set(parent, ARRAYBUFFERVIEW_UINT32, byteOffset, value, littleEndian)",
+  "params" : [
+    ["byteOffset","int","The offset in bytes"],
+    ["value","JsVar","The value to write"],
+    ["littleEndian","bool","Whether to store the value little endian (optional - big endian by default)"]
+  ]
+}
+Write an unsigned 32 bit integer
+ */
+/*JSON{
+  "type" : "method",
+  "class" : "DataView",
+  "name" : "setFloat32",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate_full" : "jswrap_dataview_set(parent, ARRAYBUFFERVIEW_FLOAT32, byteOffset, value, littleEndian)",
+  "params" : [
+    ["byteOffset","int","The offset in bytes"],
+    ["value","JsVar","The value to write"],
+    ["littleEndian","bool","Whether to store the value little endian (optional - big endian by default)"]
+  ]
+}
+Write a 32 bit floating point number
+ */
+/*JSON{
+  "type" : "method",
+  "class" : "DataView",
+  "name" : "setFloat64",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate_full" : "jswrap_dataview_set(parent, ARRAYBUFFERVIEW_FLOAT64, byteOffset, value, littleEndian)",
+  "params" : [
+    ["byteOffset","int","The offset in bytes"],
+    ["value","JsVar","The value to write"],
+    ["littleEndian","bool","Whether to store the value little endian (optional - big endian by default)"]
+  ]
+}
+Write a 64 bit floating point number
  */
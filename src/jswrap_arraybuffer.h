@@ -17,3 +17,9 @@ JsVar *jswrap_arraybuffer_constructor(JsVarInt byteLength);
 JsVar *jswrap_typedarray_constructor(JsVarDataArrayBufferViewType type, JsVar *arr, JsVarInt byteOffset, JsVarInt length);
 void jswrap_arraybufferview_set(JsVar *parent, JsVar *arr, int offset);
 JsVar *jswrap_arraybufferview_map(JsVar *parent, JsVar *funcVar, JsVar *thisVar);
+JsVar *jswrap_arraybufferview_slice(JsVar *parent, JsVarInt start, JsVar *endVar);
+JsVar *jswrap_arraybufferview_fill(JsVar *parent, JsVar *value, JsVarInt start, JsVar *endVar);
+
+JsVar *jswrap_dataview_constructor(JsVar *buffer, JsVarInt byteOffset, JsVar *byteLengthVar);
+JsVar *jswrap_dataview_get(JsVar *parent, JsVarDataArrayBufferViewType type, JsVarInt byteOffset, bool littleEndian);
+void jswrap_dataview_set(JsVar *parent, JsVarDataArrayBufferViewType type, JsVarInt byteOffset, JsVar *value, bool littleEndian);
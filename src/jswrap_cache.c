@@ -0,0 +1,315 @@
+/*
+ * This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+ *
+ * Copyright (C) 2013 Gordon Williams <gw@pur3.co.uk>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * ----------------------------------------------------------------------------
+ * This file is designed to be parsed during the build process
+ *
+ * LRU cache that gives memory back when the allocator runs out
+ * ----------------------------------------------------------------------------
+ */
+#include "jswrap_cache.h"
+#include "jsparse.h"
+#include "jsinteractive.h"
+
+/* Entries are kept in a hidden object, least recently used first - using an
+ * entry moves its name to the end. The number of vars each entry uses is
+ * measured when it's stored, and the running total is kept in a flat string
+ * that's changed in place, so that evicting never has to allocate (we may be
+ * called from the allocator). Every Cache is also in an array in hiddenRoot
+ * so that jsiFreeMoreMemory can find them. */
+#define JS_CACHE_DATA_NAME JS_HIDDEN_CHAR_STR"cd"
+#define JS_CACHE_INFO_NAME JS_HIDDEN_CHAR_STR"ci"
+#define JS_CACHE_LIST_NAME "caches"
+
+typedef struct {
+  JsVarInt maxVars; ///< Most vars the entries may use
+  JsVarInt used;    ///< Vars the entries use right now
+} JsCacheInfo;
+
+/*JSON{
+  "type" : "class",
+  "class" : "Cache",
+  "ifndef" : "SAVE_ON_FLASH"
+}
+A key/value store that keeps to a maximum number of variables, throwing away
+the least recently used entries to make room. It is created with `E.Cache`.
+
+When Espruino runs out of memory, entries are also thrown away (oldest first,
+from every Cache) before the allocation fails - so a Cache is a good place for
+things that can be recreated if needed, like parsed configuration or fragments
+of HTTP responses.
+
+```
+var cache = E.Cache(200);
+function getConfig(name) {
+  var c = cache.get(name);
+  if (c===undefined) {
+    c = JSON.parse(require("Storage").read(name));
+    cache.set(name, c);
+  }
+  return c;
+}
+```
+
+The size of each entry is measured with the same method as `E.getSizeOf`
+when it is stored, so it is best not to modify objects once they are in the cache.
+ */
+
+/*JSON{
+  "type" : "staticmethod",
+  "class" : "E",
+  "name" : "Cache",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_cache_constructor",
+  "params" : [
+    ["maxVars","int","The maximum number of variables the cache's entries may use"]
+  ],
+  "return" : ["JsVar","A new Cache"],
+  "return_object" : "Cache"
+}
+Create a new `Cache`, which will use at most `maxVars` variables for its entries.
+ */
+JsVar *jswrap_cache_constructor(JsVarInt maxVars) {
+  if (maxVars<=0) {
+    jsExceptionHere(JSET_ERROR, "maxVars must be greater than 0");
+    return 0;
+  }
+  JsVar *list = jsvObjectGetChild(execInfo.hiddenRoot, JS_CACHE_LIST_NAME, JSV_ARRAY);
+  JsVar *cache = jspNewObject(0, "Cache");
+  JsVar *data = jsvNewObject();
+  JsVar *info = jsvNewFlatStringOfLength(sizeof(JsCacheInfo));
+  if (list && cache && data && info) {
+    JsCacheInfo *ci = (JsCacheInfo*)jsvGetFlatStringPointer(info);
+    ci->maxVars = maxVars;
+    ci->used = 0;
+    jsvObjectSetChild(cache, JS_CACHE_DATA_NAME, data);
+    jsvObjectSetChild(cache, JS_CACHE_INFO_NAME, info);
+    jsvArrayPush(list, cache);
+  } else {
+    jsvUnLock(cache);
+    cache = 0;
+  }
+  jsvUnLock3(list, data, info);
+  return cache;
+}
+
+/// Get the cache's size info, or 0. The info var must be unlocked after use
+static JsCacheInfo *_jswrap_cache_getInfo(JsVar *cache, JsVar **info) {
+  *info = jsvObjectGetChild(cache, JS_CACHE_INFO_NAME, 0);
+  if (jsvIsFlatString(*info) && jsvGetLength(*info)>=(JsVarInt)sizeof(JsCacheInfo))
+    return (JsCacheInfo*)jsvGetFlatStringPointer(*info);
+  return 0;
+}
+
+/// Add to the number of vars used by the cache. This changes the info in place so never allocates
+static void _jswrap_cache_addUsed(JsVar *cache, JsVarInt delta) {
+  JsVar *info;
+  JsCacheInfo *ci = _jswrap_cache_getInfo(cache, &info);
+  if (ci) {
+    ci->used += delta;
+    if (ci->used<0) ci->used = 0;
+  }
+  jsvUnLock(info);
+}
+
+/// Remove the entry with this name from the cache's data
+static void _jswrap_cache_remove(JsVar *cache, JsVar *data, JsVar *name) {
+  _jswrap_cache_addUsed(cache, -(JsVarInt)jsvCountJsVarsUsed(name));
+  jsvRemoveChild(data, name);
+}
+
+/// Remove the least recently used entry. Returns false if the cache was empty
+static bool _jswrap_cache_evictOldest(JsVar *cache, JsVar *data) {
+  JsVarRef ref = jsvGetFirstChild(data);
+  if (!ref) return false;
+  JsVar *name = jsvLock(ref);
+  _jswrap_cache_remove(cache, data, name);
+  jsvUnLock(name);
+  return true;
+}
+
+/// Find the name of the entry for this key (or 0)
+static JsVar *_jswrap_cache_find(JsVar *data, JsVar *key) {
+  if (!data) return 0;
+  JsVar *k = jsvAsArrayIndex(key);
+  JsVar *name = k ? jsvFindChildFromVar(data, k, false) : 0;
+  jsvUnLock(k);
+  return name;
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "Cache",
+  "name" : "get",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_cache_get",
+  "params" : [
+    ["key","JsVar","The key to look up"]
+  ],
+  "return" : ["JsVar","The value stored for `key`, or `undefined` if there isn't one (or it has been thrown away)"]
+}
+Get a value from the cache, and mark it as the most recently used.
+ */
+JsVar *jswrap_cache_get(JsVar *parent, JsVar *key) {
+  JsVar *data = jsvObjectGetChild(parent, JS_CACHE_DATA_NAME, 0);
+  JsVar *name = _jswrap_cache_find(data, key);
+  JsVar *value = 0;
+  if (name) {
+    // move to the end - we keep our lock on it, so it won't be freed
+    jsvRemoveChild(data, name);
+    jsvAddName(data, name);
+    value = jsvSkipName(name);
+  }
+  jsvUnLock2(name, data);
+  return value;
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "Cache",
+  "name" : "set",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_cache_set",
+  "params" : [
+    ["key","JsVar","The key to store the value under"],
+    ["value","JsVar","The value to store"]
+  ]
+}
+Store a value in the cache, throwing away the least recently used entries
+if they don't all fit. If the value on its own is bigger than the cache, it is
+not stored.
+ */
+void jswrap_cache_set(JsVar *parent, JsVar *key, JsVar *value) {
+  JsVar *data = jsvObjectGetChild(parent, JS_CACHE_DATA_NAME, 0);
+  if (!data) return;
+  JsVar *info;
+  JsCacheInfo *ci = _jswrap_cache_getInfo(parent, &info);
+  JsVarInt maxVars = ci ? ci->maxVars : 0;
+  jsvUnLock(info);
+  JsVar *name = _jswrap_cache_find(data, key);
+  if (name) {
+    _jswrap_cache_remove(parent, data, name);
+    jsvUnLock(name);
+  }
+  JsVar *k = jsvAsArrayIndex(key);
+  name = k ? jsvFindChildFromVar(data, k, true) : 0;
+  jsvUnLock(k);
+  if (name) {
+    jsvSetValueOfName(name, value);
+    JsVarInt size = (JsVarInt)jsvCountJsVarsUsed(name);
+    if (size > maxVars) {
+      jsvRemoveChild(data, name); // too big to ever fit
+    } else {
+      _jswrap_cache_addUsed(parent, size);
+      while (jswrap_cache_used(parent) > maxVars &&
+             _jswrap_cache_evictOldest(parent, data));
+    }
+    jsvUnLock(name);
+  }
+  jsvUnLock(data);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "Cache",
+  "name" : "has",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_cache_has",
+  "params" : [
+    ["key","JsVar","The key to look up"]
+  ],
+  "return" : ["bool","Whether the cache contains a value for `key`"]
+}
+Unlike `get`, this doesn't change which entry was most recently used.
+ */
+bool jswrap_cache_has(JsVar *parent, JsVar *key) {
+  JsVar *data = jsvObjectGetChild(parent, JS_CACHE_DATA_NAME, 0);
+  JsVar *name = _jswrap_cache_find(data, key);
+  jsvUnLock2(name, data);
+  return name!=0;
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "Cache",
+  "name" : "delete",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_cache_delete",
+  "params" : [
+    ["key","JsVar","The key to remove"]
+  ],
+  "return" : ["bool","Whether there was a value for `key`"]
+}
+Remove a value from the cache.
+ */
+bool jswrap_cache_delete(JsVar *parent, JsVar *key) {
+  JsVar *data = jsvObjectGetChild(parent, JS_CACHE_DATA_NAME, 0);
+  JsVar *name = _jswrap_cache_find(data, key);
+  if (name) _jswrap_cache_remove(parent, data, name);
+  jsvUnLock2(name, data);
+  return name!=0;
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "Cache",
+  "name" : "clear",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_cache_clear"
+}
+Remove everything from the cache.
+ */
+void jswrap_cache_clear(JsVar *parent) {
+  JsVar *data = jsvObjectGetChild(parent, JS_CACHE_DATA_NAME, 0);
+  if (data) jsvRemoveAllChildren(data);
+  jsvUnLock(data);
+  _jswrap_cache_addUsed(parent, -jswrap_cache_used(parent));
+}
+
+/*JSON{
+  "type" : "property",
+  "class" : "Cache",
+  "name" : "used",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_cache_used",
+  "return" : ["int","The number of variables used by the cache's entries"]
+}
+ */
+JsVarInt jswrap_cache_used(JsVar *parent) {
+  JsVar *info;
+  JsCacheInfo *ci = _jswrap_cache_getInfo(parent, &info);
+  JsVarInt used = ci ? ci->used : 0;
+  jsvUnLock(info);
+  return used;
+}
+
+bool jswrap_cache_freeMemory() {
+  JsVar *list = jsvObjectGetChild(execInfo.hiddenRoot, JS_CACHE_LIST_NAME, 0);
+  if (!list) return false;
+  bool freed = false;
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, list);
+  while (!freed && jsvObjectIteratorHasValue(&it)) {
+    JsVar *cache = jsvObjectIteratorGetValue(&it);
+    if (cache && jsvGetRefs(cache)<=1 && jsvGetLocks(cache)==1) {
+      // Nothing but this list refers to it, so free the whole thing
+      jsvUnLock(cache);
+      jsvObjectIteratorRemoveAndGotoNext(&it, list);
+      freed = true;
+    } else {
+      JsVar *data = cache ? jsvObjectGetChild(cache, JS_CACHE_DATA_NAME, 0) : 0;
+      if (data) freed = _jswrap_cache_evictOldest(cache, data);
+      jsvUnLock2(data, cache);
+      jsvObjectIteratorNext(&it);
+    }
+  }
+  jsvObjectIteratorFree(&it);
+  jsvUnLock(list);
+  return freed;
+}
@@ -0,0 +1,25 @@
+/*
+ * This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+ *
+ * Copyright (C) 2013 Gordon Williams <gw@pur3.co.uk>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * ----------------------------------------------------------------------------
+ * LRU cache that gives memory back when the allocator runs out
+ * ----------------------------------------------------------------------------
+ */
+#include "jsvar.h"
+
+JsVar *jswrap_cache_constructor(JsVarInt maxVars);
+JsVar *jswrap_cache_get(JsVar *parent, JsVar *key);
+void jswrap_cache_set(JsVar *parent, JsVar *key, JsVar *value);
+bool jswrap_cache_has(JsVar *parent, JsVar *key);
+bool jswrap_cache_delete(JsVar *parent, JsVar *key);
+void jswrap_cache_clear(JsVar *parent);
+JsVarInt jswrap_cache_used(JsVar *parent);
+
+/// Called when memory has run out - evict the oldest entry from a Cache. Returns true if something was freed
+bool jswrap_cache_freeMemory();
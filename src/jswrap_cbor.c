@@ -0,0 +1,475 @@
+/*
+ * This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+ *
+ * Copyright (C) 2013 Gordon Williams <gw@pur3.co.uk>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * ----------------------------------------------------------------------------
+ * This file is designed to be parsed during the build process
+ *
+ * CBOR (RFC 7049) binary encoding and decoding of JsVars
+ * ----------------------------------------------------------------------------
+ */
+#include "jswrap_cbor.h"
+#include "jswrap_arraybuffer.h"
+#include "jsvariterator.h"
+#include "jsparse.h"
+
+#ifndef SAVE_ON_FLASH
+
+#define CBOR_MAX_DEPTH 32 // stop decoding if arrays/maps are nested deeper than this
+
+typedef enum {
+  CBOR_UINT = 0,
+  CBOR_NEGINT = 1,
+  CBOR_BYTES = 2,
+  CBOR_TEXT = 3,
+  CBOR_ARRAY = 4,
+  CBOR_MAP = 5,
+  CBOR_TAG = 6,
+  CBOR_SIMPLE = 7,
+} CborMajorType;
+
+#define CBOR_FALSE 0xF4
+#define CBOR_TRUE 0xF5
+#define CBOR_NULL 0xF6
+#define CBOR_UNDEFINED 0xF7
+#define CBOR_FLOAT16 0xF9
+#define CBOR_FLOAT32 0xFA
+#define CBOR_FLOAT64 0xFB
+#define CBOR_BREAK 0xFF
+
+/// RFC 8746 tags for (little endian) typed arrays
+static const struct {
+  unsigned char tag;
+  JsVarDataArrayBufferViewType type;
+} cborTypedArrayTags[] = {
+  { 64, ARRAYBUFFERVIEW_UINT8 },
+  { 68, ARRAYBUFFERVIEW_UINT8 | ARRAYBUFFERVIEW_CLAMPED },
+  { 69, ARRAYBUFFERVIEW_UINT16 },
+  { 70, ARRAYBUFFERVIEW_UINT32 },
+  { 72, ARRAYBUFFERVIEW_INT8 },
+  { 77, ARRAYBUFFERVIEW_INT16 },
+  { 78, ARRAYBUFFERVIEW_INT32 },
+  { 85, ARRAYBUFFERVIEW_FLOAT32 },
+  { 86, ARRAYBUFFERVIEW_FLOAT64 },
+};
+#define CBOR_TYPED_ARRAY_TAGS (sizeof(cborTypedArrayTags)/sizeof(cborTypedArrayTags[0]))
+
+// -----------------------------------------------------------------------------------------
+
+typedef struct {
+  JsvStringIterator it;
+  bool error;
+} CborEncoder;
+
+static void cborAppendBytes(CborEncoder *e, const unsigned char *data, size_t len) {
+  while (len--) jsvStringIteratorAppend(&e->it, (char)*(data++));
+}
+
+/// Append a major type and its argument, using as few bytes as possible
+static void cborAppendHead(CborEncoder *e, CborMajorType major, unsigned long long value) {
+  unsigned char buf[9];
+  size_t bytes;
+  if (value < 24) {
+    buf[0] = (unsigned char)value;
+    bytes = 0;
+  } else if (value <= 0xFF) {
+    buf[0] = 24;
+    bytes = 1;
+  } else if (value <= 0xFFFF) {
+    buf[0] = 25;
+    bytes = 2;
+  } else if (value <= 0xFFFFFFFFULL) {
+    buf[0] = 26;
+    bytes = 4;
+  } else {
+    buf[0] = 27;
+    bytes = 8;
+  }
+  buf[0] |= (unsigned char)(major<<5);
+  size_t i;
+  for (i=0;i<bytes;i++)
+    buf[bytes-i] = (unsigned char)(value >> (8*i)); // big endian
+  cborAppendBytes(e, buf, bytes+1);
+}
+
+static void cborAppendSimple(CborEncoder *e, unsigned char b) {
+  jsvStringIteratorAppend(&e->it, (char)b);
+}
+
+static void cborAppendStringChars(CborEncoder *e, JsVar *str, size_t startIdx, size_t len) {
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, str, startIdx);
+  while (len-- && jsvStringIteratorHasChar(&it)) {
+    jsvStringIteratorAppend(&e->it, jsvStringIteratorGetChar(&it));
+    jsvStringIteratorNext(&it);
+  }
+  jsvStringIteratorFree(&it);
+}
+
+static void cborEncodeNumber(CborEncoder *e, JsVarFloat f) {
+  if (f == (JsVarFloat)(long long)f && f > -9.2e18 && f < 9.2e18) { // a whole number
+    long long i = (long long)f;
+    if (i >= 0) cborAppendHead(e, CBOR_UINT, (unsigned long long)i);
+    else cborAppendHead(e, CBOR_NEGINT, (unsigned long long)(-1-i));
+    return;
+  }
+  unsigned char buf[9];
+  size_t bytes, i;
+  float f32 = (float)f;
+  if (isnan(f) || (JsVarFloat)f32 == f) {
+    uint32_t bits;
+    if (isnan(f)) bits = 0x7FC00000;
+    else memcpy(&bits, &f32, sizeof(f32));
+    buf[0] = CBOR_FLOAT32;
+    bytes = 4;
+    for (i=0;i<bytes;i++) buf[bytes-i] = (unsigned char)(bits >> (8*i));
+  } else { // never with USE_FLOATS, as f32==f
+    double f64 = (double)f;
+    uint64_t bits;
+    memcpy(&bits, &f64, sizeof(f64));
+    buf[0] = CBOR_FLOAT64;
+    bytes = 8;
+    for (i=0;i<bytes;i++) buf[bytes-i] = (unsigned char)(bits >> (8*i));
+  }
+  cborAppendBytes(e, buf, bytes+1);
+}
+
+static bool cborIsEncodable(JsVar *v) {
+  return !jsvIsFunction(v);
+}
+
+static void cborEncode(CborEncoder *e, JsVar *v) {
+  if (e->error) return;
+  if (!v || jsvIsUndefined(v) || !cborIsEncodable(v)) {
+    cborAppendSimple(e, CBOR_UNDEFINED);
+  } else if (jsvIsNull(v)) {
+    cborAppendSimple(e, CBOR_NULL);
+  } else if (jsvIsBoolean(v)) {
+    cborAppendSimple(e, jsvGetBool(v) ? CBOR_TRUE : CBOR_FALSE);
+  } else if (jsvIsInt(v) || jsvIsPin(v)) {
+    JsVarInt i = jsvGetInteger(v);
+    if (i >= 0) cborAppendHead(e, CBOR_UINT, (unsigned long long)i);
+    else cborAppendHead(e, CBOR_NEGINT, (unsigned long long)(-1-(long long)i));
+  } else if (jsvIsFloat(v)) {
+    cborEncodeNumber(e, jsvGetFloat(v));
+  } else if (jsvIsString(v)) {
+    size_t len = jsvGetStringLength(v);
+    cborAppendHead(e, CBOR_TEXT, len);
+    cborAppendStringChars(e, v, 0, len);
+  } else if (jsvIsArrayBuffer(v)) {
+    JsVarDataArrayBufferViewType type = v->varData.arraybuffer.type;
+    if (type != ARRAYBUFFERVIEW_ARRAYBUFFER) {
+      size_t i;
+      for (i=0;i<CBOR_TYPED_ARRAY_TAGS;i++)
+        if (cborTypedArrayTags[i].type == type)
+          cborAppendHead(e, CBOR_TAG, cborTypedArrayTags[i].tag);
+    }
+    // the data itself is a byte string straight out of the backing string
+    size_t len = v->varData.arraybuffer.length * JSV_ARRAYBUFFER_GET_SIZE(type);
+    JsVar *backing = jsvGetArrayBufferBackingString(v);
+    cborAppendHead(e, CBOR_BYTES, len);
+    cborAppendStringChars(e, backing, v->varData.arraybuffer.byteOffset, len);
+    jsvUnLock(backing);
+  } else if (jsvIsArray(v) || jsvIsObject(v)) {
+    if (v->flags & JSV_IS_RECURSING) {
+      jsExceptionHere(JSET_ERROR, "Can't encode a recursive structure");
+      e->error = true;
+      return;
+    }
+    v->flags |= JSV_IS_RECURSING;
+    JsvObjectIterator it;
+    if (jsvIsArray(v)) {
+      JsVarInt length = jsvGetArrayLength(v);
+      JsVarInt idx = 0;
+      cborAppendHead(e, CBOR_ARRAY, (unsigned long long)length);
+      // arrays can be sparse, so fill any gaps with undefined
+      jsvObjectIteratorNew(&it, v);
+      while (jsvObjectIteratorHasValue(&it) && !e->error) {
+        JsVarInt index = jsvGetIntegerAndUnLock(jsvObjectIteratorGetKey(&it));
+        if (index >= idx && index < length) {
+          while (idx < index) {
+            cborAppendSimple(e, CBOR_UNDEFINED);
+            idx++;
+          }
+          JsVar *item = jsvObjectIteratorGetValue(&it);
+          cborEncode(e, item);
+          jsvUnLock(item);
+          idx++;
+        }
+        jsvObjectIteratorNext(&it);
+      }
+      jsvObjectIteratorFree(&it);
+      while (idx++ < length) cborAppendSimple(e, CBOR_UNDEFINED);
+    } else {
+      // count the fields first, as functions and hidden fields are skipped
+      size_t count = 0;
+      JsvIsInternalChecker checkerFunction = jsvGetInternalFunctionCheckerFor(v);
+      jsvObjectIteratorNew(&it, v);
+      while (jsvObjectIteratorHasValue(&it)) {
+        JsVar *key = jsvObjectIteratorGetKey(&it);
+        JsVar *item = jsvObjectIteratorGetValue(&it);
+        if (!(checkerFunction && checkerFunction(key)) && cborIsEncodable(item)) count++;
+        jsvUnLock2(key, item);
+        jsvObjectIteratorNext(&it);
+      }
+      jsvObjectIteratorFree(&it);
+      cborAppendHead(e, CBOR_MAP, count);
+      jsvObjectIteratorNew(&it, v);
+      while (jsvObjectIteratorHasValue(&it) && !e->error) {
+        JsVar *key = jsvObjectIteratorGetKey(&it);
+        JsVar *item = jsvObjectIteratorGetValue(&it);
+        if (!(checkerFunction && checkerFunction(key)) && cborIsEncodable(item)) {
+          JsVar *keyStr = jsvAsString(key, false); // integer keys are still strings in JS
+          cborEncode(e, keyStr);
+          jsvUnLock(keyStr);
+          cborEncode(e, item);
+        }
+        jsvUnLock2(key, item);
+        jsvObjectIteratorNext(&it);
+      }
+      jsvObjectIteratorFree(&it);
+    }
+    v->flags &= ~JSV_IS_RECURSING;
+  } else {
+    cborAppendSimple(e, CBOR_UNDEFINED);
+  }
+}
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "toCBOR",
+  "generate" : "jswrap_espruino_toCBOR",
+  "params" : [
+    ["data","JsVar","The data to encode"]
+  ],
+  "return" : ["JsVar","A Uint8Array containing the encoded data"],
+  "return_object" : "Uint8Array"
+}
+Encode data as [CBOR](http://cbor.io/) - a binary equivalent of JSON that is much
+smaller for numbers and binary data. Integers and floats use as few bytes as they
+can, and typed arrays are stored as their raw bytes (tagged with their type as in
+RFC 8746) rather than as lists of numbers. Functions are skipped.
+
+To send the result as a String (for instance over a socket or MQTT) use `E.toString`.
+*/
+JsVar *jswrap_espruino_toCBOR(JsVar *data) {
+  JsVar *str = jsvNewFromEmptyString();
+  if (!str) return 0;
+  CborEncoder e;
+  e.error = false;
+  jsvStringIteratorNew(&e.it, str, 0);
+  cborEncode(&e, data);
+  jsvStringIteratorFree(&e.it);
+  JsVar *result = 0;
+  if (!e.error) {
+    JsVar *arrayBuffer = jsvNewArrayBufferFromString(str, 0);
+    result = jswrap_typedarray_constructor(ARRAYBUFFERVIEW_UINT8, arrayBuffer, 0, 0);
+    jsvUnLock(arrayBuffer);
+  }
+  jsvUnLock(str);
+  return result;
+}
+
+// -----------------------------------------------------------------------------------------
+
+typedef struct {
+  JsVar *str; ///< the string we're decoding from
+  JsvStringIterator it;
+  size_t endIdx; ///< index in str after the last byte we can decode
+  int depth;
+  bool error;
+} CborDecoder;
+
+static int cborGetByte(CborDecoder *d) {
+  if (jsvStringIteratorGetIndex(&d->it) >= d->endIdx) {
+    d->error = true;
+    return 0;
+  }
+  int b = (unsigned char)jsvStringIteratorGetChar(&d->it);
+  jsvStringIteratorNextInline(&d->it);
+  return b;
+}
+
+static unsigned long long cborGetBytes(CborDecoder *d, int bytes) {
+  unsigned long long v = 0;
+  while (bytes--) v = (v<<8) | (unsigned long long)cborGetByte(d);
+  return v;
+}
+
+/// Get the argument for the given initial byte's 'additional info'
+static unsigned long long cborGetArgument(CborDecoder *d, int info) {
+  if (info < 24) return (unsigned long long)info;
+  if (info <= 27) return cborGetBytes(d, 1<<(info-24));
+  d->error = true; // indefinite lengths aren't supported
+  return 0;
+}
+
+/// Get a string of len bytes from the input, and move past it
+static JsVar *cborGetString(CborDecoder *d, unsigned long long len) {
+  size_t idx = jsvStringIteratorGetIndex(&d->it);
+  if (len > d->endIdx - idx) {
+    d->error = true;
+    return 0;
+  }
+  JsVar *s = jsvNewFromStringVar(d->str, idx, (size_t)len);
+  while (len--) jsvStringIteratorNextInline(&d->it);
+  return s;
+}
+
+static JsVarFloat cborHalfToFloat(unsigned int half) {
+  int exp = (half >> 10) & 0x1F;
+  int mant = half & 0x3FF;
+  JsVarFloat val;
+  if (exp == 0) val = (JsVarFloat)ldexp(mant, -24);
+  else if (exp != 31) val = (JsVarFloat)ldexp(mant + 1024, exp - 25);
+  else val = mant == 0 ? INFINITY : NAN;
+  return (half & 0x8000) ? -val : val;
+}
+
+static JsVar *cborDecode(CborDecoder *d) {
+  int b = cborGetByte(d);
+  if (d->error) return 0;
+  CborMajorType major = (CborMajorType)(b>>5);
+  int info = b&31;
+  if (major == CBOR_SIMPLE) {
+    switch (b) {
+    case CBOR_FALSE: return jsvNewFromBool(false);
+    case CBOR_TRUE: return jsvNewFromBool(true);
+    case CBOR_NULL: return jsvNewNull();
+    case CBOR_UNDEFINED: return 0;
+    case CBOR_FLOAT16: return jsvNewFromFloat(cborHalfToFloat((unsigned int)cborGetBytes(d, 2)));
+    case CBOR_FLOAT32: {
+      uint32_t bits = (uint32_t)cborGetBytes(d, 4);
+      float f;
+      memcpy(&f, &bits, sizeof(f));
+      return jsvNewFromFloat((JsVarFloat)f);
+    }
+    case CBOR_FLOAT64: {
+      uint64_t bits = cborGetBytes(d, 8);
+      double f;
+      memcpy(&f, &bits, sizeof(f));
+      return jsvNewFromFloat((JsVarFloat)f);
+    }
+    default:
+      d->error = true;
+      return 0;
+    }
+  }
+  unsigned long long arg = cborGetArgument(d, info);
+  if (d->error) return 0;
+  switch (major) {
+  case CBOR_UINT:
+    return (arg <= 0x7FFFFFFFFFFFFFFFULL) ? jsvNewFromLongInteger((long long)arg) : jsvNewFromFloat((JsVarFloat)arg);
+  case CBOR_NEGINT:
+    return (arg <= 0x7FFFFFFFFFFFFFFFULL) ? jsvNewFromLongInteger(-1-(long long)arg) : jsvNewFromFloat(-1-(JsVarFloat)arg);
+  case CBOR_TEXT:
+    return cborGetString(d, arg);
+  case CBOR_BYTES: {
+    JsVar *s = cborGetString(d, arg);
+    JsVar *arrayBuffer = s ? jsvNewArrayBufferFromString(s, 0) : 0;
+    jsvUnLock(s);
+    return arrayBuffer;
+  }
+  case CBOR_TAG: {
+    JsVar *item = cborDecode(d);
+    if (!jsvIsArrayBuffer(item)) return item; // unknown tags are ignored
+    size_t i;
+    for (i=0;i<CBOR_TYPED_ARRAY_TAGS;i++) {
+      if (cborTypedArrayTags[i].tag == arg) {
+        JsVarDataArrayBufferViewType type = cborTypedArrayTags[i].type;
+        size_t len = jsvGetArrayBufferLength(item);
+        if (len % JSV_ARRAYBUFFER_GET_SIZE(type)) {
+          d->error = true;
+          jsvUnLock(item);
+          return 0;
+        }
+        // decode straight into a typed array using the bytes we just read
+        JsVar *arr = jswrap_typedarray_constructor(type, item, 0, (JsVarInt)(len / JSV_ARRAYBUFFER_GET_SIZE(type)));
+        jsvUnLock(item);
+        return arr;
+      }
+    }
+    return item;
+  }
+  case CBOR_ARRAY:
+  case CBOR_MAP: {
+    if (++d->depth > CBOR_MAX_DEPTH || arg > d->endIdx) { // every item needs at least one byte
+      d->error = true;
+      return 0;
+    }
+    JsVar *v = (major == CBOR_ARRAY) ? jsvNewEmptyArray() : jsvNewObject();
+    while (v && arg-- && !d->error) {
+      if (major == CBOR_ARRAY) {
+        JsVar *item = cborDecode(d);
+        jsvArrayPush(v, item);
+        jsvUnLock(item);
+      } else {
+        JsVar *keyVar = cborDecode(d);
+        JsVar *key = jsvAsArrayIndexAndUnLock(jsvAsString(keyVar, false));
+        jsvUnLock(keyVar);
+        JsVar *item = d->error ? 0 : cborDecode(d);
+        if (key && !d->error) {
+          key = jsvMakeIntoVariableName(key, item);
+          jsvAddName(v, key);
+        }
+        jsvUnLock2(key, item);
+      }
+    }
+    d->depth--;
+    return v;
+  }
+  default:
+    d->error = true;
+    return 0;
+  }
+}
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "fromCBOR",
+  "generate" : "jswrap_espruino_fromCBOR",
+  "params" : [
+    ["data","JsVar","A String, ArrayBuffer or Uint8Array containing CBOR data"]
+  ],
+  "return" : ["JsVar","The decoded data"]
+}
+Decode [CBOR](http://cbor.io/) data, for instance from `E.toCBOR`. Byte strings
+become `ArrayBuffer`s, and tagged typed arrays (RFC 8746) are decoded straight
+into the matching typed array. Indefinite-length items aren't supported.
+*/
+JsVar *jswrap_espruino_fromCBOR(JsVar *data) {
+  CborDecoder d;
+  size_t startIdx = 0;
+  if (jsvIsArrayBuffer(data) && JSV_ARRAYBUFFER_GET_SIZE(data->varData.arraybuffer.type)==1) {
+    d.str = jsvGetArrayBufferBackingString(data);
+    startIdx = data->varData.arraybuffer.byteOffset;
+    d.endIdx = startIdx + data->varData.arraybuffer.length;
+  } else {
+    d.str = jsvAsString(data, false);
+    d.endIdx = jsvGetStringLength(d.str);
+  }
+  if (!d.str) return 0;
+  d.depth = 0;
+  d.error = false;
+  jsvStringIteratorNew(&d.it, d.str, startIdx);
+  JsVar *result = cborDecode(&d);
+  if (d.error) {
+    jsExceptionHere(JSET_ERROR, "Invalid CBOR data at position %d", (int)(jsvStringIteratorGetIndex(&d.it)-startIdx));
+    jsvUnLock(result);
+    result = 0;
+  }
+  jsvStringIteratorFree(&d.it);
+  jsvUnLock(d.str);
+  return result;
+}
+
+#endif // SAVE_ON_FLASH
@@ -34,9 +34,9 @@ const char *DAYNAMES = "Sun\0Mon\0Tue\0Wed\0Thu\0Fri\0Sat";
 
 TimeInDay getTimeFromMilliSeconds(JsVarFloat ms_in) {
   TimeInDay t;
-  t.daysSinceEpoch = (int)(ms_in / MSDAY);
+  t.daysSinceEpoch = (int)(ms_in / (JsVarFloat)MSDAY);
   
-  int ms = (int)(ms_in - ((JsVarFloat)t.daysSinceEpoch * MSDAY));
+  int ms = (int)(ms_in - ((JsVarFloat)t.daysSinceEpoch * (JsVarFloat)MSDAY));
   if (ms<0) {
     ms += MSDAY;
     t.daysSinceEpoch--;
@@ -52,7 +52,7 @@ TimeInDay getTimeFromMilliSeconds(JsVarFloat ms_in) {
 }
 
 JsVarFloat fromTimeInDay(TimeInDay *td) {
-  return (JsVarFloat)(td->ms + (((td->hour*60+td->min - td->zone)*60+td->sec)*1000) + (JsVarFloat)td->daysSinceEpoch*MSDAY);
+  return (JsVarFloat)(td->ms + (((td->hour*60+td->min - td->zone)*60+td->sec)*1000)) + (JsVarFloat)td->daysSinceEpoch*(JsVarFloat)MSDAY;
 }
 
 // First calculate the number of four-year-interval, so calculation
@@ -20,6 +20,17 @@
 #include "jswrapper.h"
 #include "jsinteractive.h"
 #include "jstimer.h"
+#include "jstrace.h"
+#ifdef USE_HEATSHRINK
+#include "compress_heatshrink.h"
+#endif
+
+#ifdef ESP8266
+extern uint8_t system_get_cpu_freq(void); // for E.benchmark
+#endif
+#ifdef ESP8266_NATIVE_CODE
+extern void *esp8266_nativeCodeAlloc(const void *code, size_t len); // for E.nativeCall
+#endif
 
 /*JSON{
   "type" : "class",
@@ -49,6 +60,36 @@ rather than replacing the last one. This allows you to write modular code -
 something that was not possible with `onInit`.
  */
 
+/*JSON{
+  "type" : "event",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "lowMemory",
+  "params" : [
+    ["freeVars","JsVar","The number of variables that are free"]
+  ]
+}
+This event is called when Espruino is running low on memory, so you can
+release things that aren't needed (or can be recreated later) before
+allocations start to fail.
+
+By default it is only called once memory has actually run out (and everything
+Espruino could free by itself, including any `E.Cache` entries, has been freed).
+Use `E.setLowMemoryThreshold(vars)` to have it called when fewer than `vars`
+variables are free.
+
+The allocator can't run JavaScript itself, so the event is fired from the idle
+loop shortly afterwards. It is fired once, and then not again until memory
+has recovered.
+
+```
+E.setLowMemoryThreshold(200);
+E.on('lowMemory', function(freeVars) {
+  delete myBigLookupTable;
+});
+```
+ */
+
 /*JSON{
   "type" : "staticmethod",
   "class" : "E",
@@ -122,6 +163,13 @@ If you're executing a thumb function, you'll almost certainly need to set the bo
 Note it's not guaranteed that the call signature you provide can be used - there are limits on the number of arguments allowed.
 
 When supplying `data`, if it is a 'flat string' then it will be used directly, otherwise it'll be converted to a flat string and used.
+
+On ESP8266 code can't be executed from RAM. In builds made with
+`ESP8266_NATIVE_CODE=1`, `data` is copied into a small area of IRAM (1kB)
+instead. Identical code is only copied once, and code that no function uses
+any more (eg. because it was replaced) is freed when more space is needed.
+`scripts/compile_xtensa.py` can compile simple integer JS functions into
+`E.nativeCall`s that use this.
  */
 JsVar *jswrap_espruino_nativeCall(JsVarInt addr, JsVar *signature, JsVar *data) {
   unsigned int argTypes = 0;
@@ -159,6 +207,21 @@ JsVar *jswrap_espruino_nativeCall(JsVarInt addr, JsVar *signature, JsVar *data)
     return 0;
   }
 
+#ifdef ESP8266_NATIVE_CODE
+  /* The CPU can't execute code from DRAM where the JsVars are, so copy it
+   * to IRAM and make 'addr' absolute */
+  if (data) {
+    JSV_GET_AS_CHAR_ARRAY(codePtr, codeLen, data);
+    if (!codePtr) return 0;
+    void *code = esp8266_nativeCodeAlloc(codePtr, codeLen);
+    if (!code) {
+      jsExceptionHere(JSET_ERROR, "Not enough IRAM for native code");
+      return 0;
+    }
+    addr += (JsVarInt)(size_t)code;
+    data = 0;
+  }
+#endif
   JsVar *fn = jsvNewNativeFunction((void *)(size_t)addr, (unsigned short)argTypes);
   if (data) {
     JsVar *flat = jsvAsFlatString(data);
@@ -190,6 +253,154 @@ JsVarFloat jswrap_espruino_clip(JsVarFloat x, JsVarFloat min, JsVarFloat max) {
 }
 
 
+/// A typed array whose data is all in one place, so the maths functions below can access it directly
+typedef struct {
+  char *ptr;
+  size_t count; ///< number of elements
+  JsVarDataArrayBufferViewType type;
+} EspruinoFlatArray;
+
+/// If arr is an ArrayBuffer or typed array stored in one flat block of RAM, fill in 'fa' and return true
+static bool espruinoGetFlatArray(JsVar *arr, EspruinoFlatArray *fa) {
+  if (!jsvIsArrayBuffer(arr)) return false;
+  fa->type = arr->varData.arraybuffer.type;
+  fa->ptr = jsvGetWritableDataPointer(arr, &fa->count);
+  // views can start at any byte offset, but we can only load aligned values directly
+  return fa->ptr && ((size_t)fa->ptr & (JSV_ARRAYBUFFER_GET_SIZE(fa->type)-1))==0;
+}
+
+static JsVarFloat espruinoFlatArrayGet(const EspruinoFlatArray *fa, size_t i) {
+  switch (fa->type) {
+  case ARRAYBUFFERVIEW_INT8: return ((int8_t*)fa->ptr)[i];
+  case ARRAYBUFFERVIEW_UINT16: return ((uint16_t*)fa->ptr)[i];
+  case ARRAYBUFFERVIEW_INT16: return ((int16_t*)fa->ptr)[i];
+  case ARRAYBUFFERVIEW_UINT32: return (JsVarFloat)((uint32_t*)fa->ptr)[i];
+  case ARRAYBUFFERVIEW_INT32: return (JsVarFloat)((int32_t*)fa->ptr)[i];
+  case ARRAYBUFFERVIEW_FLOAT32: return ((float*)fa->ptr)[i];
+  case ARRAYBUFFERVIEW_FLOAT64: return (JsVarFloat)((double*)fa->ptr)[i];
+  default: return ((uint8_t*)fa->ptr)[i];
+  }
+}
+
+/// Set an element, converting the value the same way as setting it on the typed array from JS would
+static void espruinoFlatArraySet(const EspruinoFlatArray *fa, size_t i, JsVarFloat v) {
+  if (fa->type == ARRAYBUFFERVIEW_FLOAT32) { ((float*)fa->ptr)[i] = (float)v; return; }
+  if (fa->type == ARRAYBUFFERVIEW_FLOAT64) { ((double*)fa->ptr)[i] = (double)v; return; }
+  long long iv = isfinite(v) ? (long long)v : 0;
+  if (JSV_ARRAYBUFFER_IS_CLAMPED(fa->type)) {
+    if (iv<0) iv=0;
+    if (iv>255) iv=255;
+  }
+  switch (JSV_ARRAYBUFFER_GET_SIZE(fa->type)) {
+  case 2: ((uint16_t*)fa->ptr)[i] = (uint16_t)iv; break;
+  case 4: ((uint32_t*)fa->ptr)[i] = (uint32_t)iv; break;
+  default: ((uint8_t*)fa->ptr)[i] = (uint8_t)iv; break;
+  }
+}
+
+/* Run CODE for every element I of a flat array, with V set to its value.
+Each element type gets its own loop, so there's no per-element switch and
+the compiler is free to unroll/vectorise it. */
+#define FLAT_ARRAY_LOOP(T, FA, I, V, CODE) { \
+    const T *_d = (const T*)(FA).ptr; \
+    for (I=0;I<(FA).count;I++) { JsVarFloat V = (JsVarFloat)_d[I]; CODE } \
+  }
+#define FLAT_ARRAY_FOREACH(FA, I, V, CODE) \
+  switch ((FA).type) { \
+  case ARRAYBUFFERVIEW_INT8: FLAT_ARRAY_LOOP(int8_t, FA, I, V, CODE); break; \
+  case ARRAYBUFFERVIEW_UINT16: FLAT_ARRAY_LOOP(uint16_t, FA, I, V, CODE); break; \
+  case ARRAYBUFFERVIEW_INT16: FLAT_ARRAY_LOOP(int16_t, FA, I, V, CODE); break; \
+  case ARRAYBUFFERVIEW_UINT32: FLAT_ARRAY_LOOP(uint32_t, FA, I, V, CODE); break; \
+  case ARRAYBUFFERVIEW_INT32: FLAT_ARRAY_LOOP(int32_t, FA, I, V, CODE); break; \
+  case ARRAYBUFFERVIEW_FLOAT32: FLAT_ARRAY_LOOP(float, FA, I, V, CODE); break; \
+  case ARRAYBUFFERVIEW_FLOAT64: FLAT_ARRAY_LOOP(double, FA, I, V, CODE); break; \
+  default: FLAT_ARRAY_LOOP(uint8_t, FA, I, V, CODE); break; \
+  }
+
+#define RINGBUFFER_BUFFER_NAME JS_HIDDEN_CHAR_STR"rb" // typed array holding the samples
+#define RINGBUFFER_HEAD_NAME JS_HIDDEN_CHAR_STR"rh" // index of the oldest sample in the buffer
+#define RINGBUFFER_COUNT_NAME JS_HIDDEN_CHAR_STR"rn" // number of samples stored
+
+/// The state of a RingBuffer, loaded from its object
+typedef struct {
+  JsVar *buf; ///< locked backing typed array
+  size_t head, count, capacity;
+  EspruinoFlatArray fa;
+  bool isFlat; ///< if true, 'fa' can be used to access buf directly
+} EspruinoRingBuffer;
+
+/// If rb is a RingBuffer, fill in 'r' (which must be freed with espruinoRingBufferFree) and return true
+static bool espruinoRingBufferLoad(JsVar *rb, EspruinoRingBuffer *r) {
+  if (!jsvIsObject(rb)) return false;
+  r->buf = jsvObjectGetChild(rb, RINGBUFFER_BUFFER_NAME, 0);
+  if (!jsvIsArrayBuffer(r->buf)) {
+    jsvUnLock(r->buf);
+    return false;
+  }
+  r->capacity = jsvGetArrayBufferLength(r->buf);
+  r->head = (size_t)jsvGetIntegerAndUnLock(jsvObjectGetChild(rb, RINGBUFFER_HEAD_NAME, 0));
+  r->count = (size_t)jsvGetIntegerAndUnLock(jsvObjectGetChild(rb, RINGBUFFER_COUNT_NAME, 0));
+  if (r->head >= r->capacity) r->head = 0;
+  if (r->count > r->capacity) r->count = r->capacity;
+  r->isFlat = espruinoGetFlatArray(r->buf, &r->fa);
+  return true;
+}
+
+static void espruinoRingBufferFree(EspruinoRingBuffer *r) {
+  jsvUnLock(r->buf);
+}
+
+static void espruinoRingBufferSave(JsVar *rb, EspruinoRingBuffer *r) {
+  jsvObjectSetChildAndUnLock(rb, RINGBUFFER_HEAD_NAME, jsvNewFromInteger((JsVarInt)r->head));
+  jsvObjectSetChildAndUnLock(rb, RINGBUFFER_COUNT_NAME, jsvNewFromInteger((JsVarInt)r->count));
+}
+
+/// Index in the backing buffer of the i'th oldest sample
+static size_t espruinoRingBufferIndex(EspruinoRingBuffer *r, size_t i) {
+  i += r->head;
+  return (i >= r->capacity) ? i - r->capacity : i;
+}
+
+/** Split the samples (oldest first) into at most 2 runs that are contiguous in
+ * the backing buffer. Only valid if r->isFlat. Returns the number of runs. */
+static int espruinoRingBufferGetRuns(EspruinoRingBuffer *r, EspruinoFlatArray runs[2]) {
+  size_t elementSize = JSV_ARRAYBUFFER_GET_SIZE(r->fa.type);
+  size_t first = r->capacity - r->head;
+  if (first > r->count) first = r->count;
+  runs[0] = r->fa;
+  runs[0].ptr += r->head*elementSize;
+  runs[0].count = first;
+  if (first == r->count) return 1;
+  runs[1] = r->fa;
+  runs[1].count = r->count - first;
+  return 2;
+}
+
+/** Work out sum((v-mean)^power) over all samples in a RingBuffer, where power
+ * is 1 or 2. Used for E.sum and E.variance */
+static JsVarFloat espruinoRingBufferSum(EspruinoRingBuffer *r, JsVarFloat mean, int power) {
+  JsVarFloat sum = 0;
+  size_t i;
+  if (r->isFlat) {
+    EspruinoFlatArray runs[2];
+    int n, runCount = espruinoRingBufferGetRuns(r, runs);
+    for (n=0;n<runCount;n++) {
+      if (power==2) {
+        FLAT_ARRAY_FOREACH(runs[n], i, v, v -= mean; sum += v*v;);
+      } else {
+        FLAT_ARRAY_FOREACH(runs[n], i, v, sum += v - mean;);
+      }
+    }
+  } else {
+    for (i=0;i<r->count;i++) {
+      JsVarFloat v = jsvGetFloatAndUnLock(jsvArrayBufferGet(r->buf, espruinoRingBufferIndex(r, i))) - mean;
+      sum += (power==2) ? v*v : v;
+    }
+  }
+  return sum;
+}
+
+
 /*JSON{
   "type" : "staticmethod",
   "ifndef" : "SAVE_ON_FLASH",
@@ -201,14 +412,26 @@ JsVarFloat jswrap_espruino_clip(JsVarFloat x, JsVarFloat min, JsVarFloat max) {
   ],
   "return" : ["float","The sum of the given buffer"]
 }
-Sum the contents of the given Array, String or ArrayBuffer and return the result
+Sum the contents of the given Array, String, ArrayBuffer or `E.RingBuffer` and return the result
  */
 JsVarFloat jswrap_espruino_sum(JsVar *arr) {
+  EspruinoRingBuffer ring;
+  if (espruinoRingBufferLoad(arr, &ring)) {
+    JsVarFloat sum = espruinoRingBufferSum(&ring, 0, 1);
+    espruinoRingBufferFree(&ring);
+    return sum;
+  }
   if (!(jsvIsString(arr) || jsvIsArray(arr) || jsvIsArrayBuffer(arr))) {
     jsExceptionHere(JSET_ERROR, "Expecting first argument to be an array, not %t", arr);
     return NAN;
   }
   JsVarFloat sum = 0;
+  EspruinoFlatArray fa;
+  if (espruinoGetFlatArray(arr, &fa)) {
+    size_t i;
+    FLAT_ARRAY_FOREACH(fa, i, v, sum += v;);
+    return sum;
+  }
 
   JsvIterator itsrc;
   jsvIteratorNew(&itsrc, arr);
@@ -232,14 +455,26 @@ JsVarFloat jswrap_espruino_sum(JsVar *arr) {
   ],
   "return" : ["float","The variance of the given buffer"]
 }
-Work out the variance of the contents of the given Array, String or ArrayBuffer and return the result. This is equivalent to `v=0;for (i in arr) v+=Math.pow(mean-arr[i],2)`
+Work out the variance of the contents of the given Array, String, ArrayBuffer or `E.RingBuffer` and return the result. This is equivalent to `v=0;for (i in arr) v+=Math.pow(mean-arr[i],2)`
  */
 JsVarFloat jswrap_espruino_variance(JsVar *arr, JsVarFloat mean) {
+  EspruinoRingBuffer ring;
+  if (espruinoRingBufferLoad(arr, &ring)) {
+    JsVarFloat variance = espruinoRingBufferSum(&ring, mean, 2);
+    espruinoRingBufferFree(&ring);
+    return variance;
+  }
   if (!(jsvIsIterable(arr))) {
     jsExceptionHere(JSET_ERROR, "Expecting first argument to be iterable, not %t", arr);
     return NAN;
   }
   JsVarFloat variance = 0;
+  EspruinoFlatArray fa;
+  if (espruinoGetFlatArray(arr, &fa)) {
+    size_t i;
+    FLAT_ARRAY_FOREACH(fa, i, v, v -= mean; variance += v*v;);
+    return variance;
+  }
 
   JsvIterator itsrc;
   jsvIteratorNew(&itsrc, arr);
@@ -275,6 +510,20 @@ JsVarFloat jswrap_espruino_convolve(JsVar *arr1, JsVar *arr2, int offset) {
     return NAN;
   }
   JsVarFloat conv = 0;
+  int l = (int)jsvGetLength(arr2);
+  if (!l) return 0;
+  offset = offset % l;
+  if (offset<0) offset += l;
+
+  EspruinoFlatArray fa1, fa2;
+  if (espruinoGetFlatArray(arr1, &fa1) && espruinoGetFlatArray(arr2, &fa2)) {
+    size_t i, j = (size_t)offset;
+    for (i=0;i<fa1.count;i++) {
+      conv += espruinoFlatArrayGet(&fa1, i) * espruinoFlatArrayGet(&fa2, j);
+      if (++j >= fa2.count) j=0;
+    }
+    return conv;
+  }
 
   JsvIterator it1;
   jsvIteratorNew(&it1, arr1);
@@ -282,9 +531,6 @@ JsVarFloat jswrap_espruino_convolve(JsVar *arr1, JsVar *arr2, int offset) {
   jsvIteratorNew(&it2, arr2);
 
   // get iterator2 at the correct offset
-  int l = (int)jsvGetLength(arr2);
-  offset = offset % l;
-  if (offset<0) offset += l;
   while (offset-->0)
     jsvIteratorNext(&it2);
 
@@ -304,6 +550,221 @@ JsVarFloat jswrap_espruino_convolve(JsVar *arr1, JsVar *arr2, int offset) {
   return conv;
 }
 
+/*JSON{
+  "type" : "class",
+  "class" : "RingBuffer",
+  "ifndef" : "SAVE_ON_FLASH"
+}
+A fixed-size buffer of numbers, stored in a typed array, that is ideal for
+keeping a history of recent samples. Adding a value when the buffer is full
+drops the oldest one, and adding, removing and reading values all take the
+same time however big the buffer is.
+
+Create one with `E.RingBuffer`. `E.sum` and `E.variance` work directly on a
+RingBuffer's contents.
+*/
+/*JSON{
+  "type" : "staticmethod",
+  "class" : "E",
+  "name" : "RingBuffer",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_espruino_ringbuffer",
+  "params" : [
+    ["type","JsVar","The typed array constructor to store values with, eg. `Float32Array` or `Int16Array`"],
+    ["length","int","The maximum number of values to store"]
+  ],
+  "return" : ["JsVar","A RingBuffer"],
+  "return_object" : "RingBuffer"
+}
+Create a RingBuffer that holds up to `length` numbers, stored in a typed array
+of the given type. For instance:
+
+```
+var history = E.RingBuffer(Float32Array, 100);
+setInterval(function() {
+  history.push(E.getTemperature());
+  var mean = E.sum(history) / history.length;
+  print(mean, Math.sqrt(E.variance(history, mean) / history.length));
+}, 1000);
+```
+ */
+JsVar *jswrap_espruino_ringbuffer(JsVar *type, int length) {
+  if (length<=0) {
+    jsExceptionHere(JSET_ERROR, "Invalid length for RingBuffer");
+    return 0;
+  }
+  if (!jsvIsFunction(type)) {
+    jsExceptionHere(JSET_ERROR, "Expecting a typed array constructor, not %t", type);
+    return 0;
+  }
+  JsVar *lenVar = jsvNewFromInteger(length);
+  JsVar *buf = jspeFunctionCall(type, 0, 0, false, 1, &lenVar);
+  jsvUnLock(lenVar);
+  if (!jsvIsArrayBuffer(buf) || buf->varData.arraybuffer.type==ARRAYBUFFERVIEW_ARRAYBUFFER) {
+    if (!jspHasError())
+      jsExceptionHere(JSET_ERROR, "Expecting a typed array constructor, not %t", type);
+    jsvUnLock(buf);
+    return 0;
+  }
+  JsVar *rb = jspNewObject(0, "RingBuffer");
+  if (rb) {
+    jsvObjectSetChild(rb, RINGBUFFER_BUFFER_NAME, buf);
+    jsvObjectSetChildAndUnLock(rb, RINGBUFFER_HEAD_NAME, jsvNewFromInteger(0));
+    jsvObjectSetChildAndUnLock(rb, RINGBUFFER_COUNT_NAME, jsvNewFromInteger(0));
+  }
+  jsvUnLock(buf);
+  return rb;
+}
+
+/*JSON{
+  "type" : "property",
+  "class" : "RingBuffer",
+  "name" : "length",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_ringbuffer_length",
+  "return" : ["int","The number of values in the RingBuffer"]
+}
+ */
+int jswrap_ringbuffer_length(JsVar *parent) {
+  return (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(parent, RINGBUFFER_COUNT_NAME, 0));
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "RingBuffer",
+  "name" : "push",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_ringbuffer_push",
+  "params" : [
+    ["value","JsVar","The value to add"]
+  ],
+  "return" : ["int","The number of values in the RingBuffer"]
+}
+Add a value to the end of the RingBuffer. If the RingBuffer is full, the oldest
+value is removed to make space.
+ */
+int jswrap_ringbuffer_push(JsVar *parent, JsVar *value) {
+  EspruinoRingBuffer ring;
+  if (!espruinoRingBufferLoad(parent, &ring)) return 0;
+  size_t idx = espruinoRingBufferIndex(&ring, ring.count);
+  if (ring.isFlat)
+    espruinoFlatArraySet(&ring.fa, idx, jsvGetFloat(value));
+  else
+    jsvArrayBufferSet(ring.buf, idx, value);
+  if (ring.count < ring.capacity)
+    ring.count++;
+  else // full - we just overwrote the oldest value
+    ring.head = espruinoRingBufferIndex(&ring, 1);
+  espruinoRingBufferSave(parent, &ring);
+  espruinoRingBufferFree(&ring);
+  return (int)ring.count;
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "RingBuffer",
+  "name" : "shift",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_ringbuffer_shift",
+  "return" : ["JsVar","The oldest value, or `undefined` if the RingBuffer is empty"]
+}
+Remove the oldest value from the RingBuffer and return it
+ */
+JsVar *jswrap_ringbuffer_shift(JsVar *parent) {
+  EspruinoRingBuffer ring;
+  if (!espruinoRingBufferLoad(parent, &ring)) return 0;
+  JsVar *value = 0;
+  if (ring.count) {
+    value = jsvArrayBufferGet(ring.buf, ring.head);
+    ring.head = espruinoRingBufferIndex(&ring, 1);
+    ring.count--;
+    espruinoRingBufferSave(parent, &ring);
+  }
+  espruinoRingBufferFree(&ring);
+  return value;
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "RingBuffer",
+  "name" : "get",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_ringbuffer_get",
+  "params" : [
+    ["index","int","The index of the value, where 0 is the oldest. Negative values count back from the newest, so -1 is the newest"]
+  ],
+  "return" : ["JsVar","The value, or `undefined` if there is no value at that index"]
+}
+Get a value from the RingBuffer without removing it
+ */
+JsVar *jswrap_ringbuffer_get(JsVar *parent, int index) {
+  EspruinoRingBuffer ring;
+  if (!espruinoRingBufferLoad(parent, &ring)) return 0;
+  JsVar *value = 0;
+  if (index<0) index += (int)ring.count;
+  if (index>=0 && (size_t)index<ring.count)
+    value = jsvArrayBufferGet(ring.buf, espruinoRingBufferIndex(&ring, (size_t)index));
+  espruinoRingBufferFree(&ring);
+  return value;
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "RingBuffer",
+  "name" : "clear",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_ringbuffer_clear"
+}
+Remove all values from the RingBuffer
+ */
+void jswrap_ringbuffer_clear(JsVar *parent) {
+  EspruinoRingBuffer ring;
+  if (!espruinoRingBufferLoad(parent, &ring)) return;
+  ring.head = 0;
+  ring.count = 0;
+  espruinoRingBufferSave(parent, &ring);
+  espruinoRingBufferFree(&ring);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "RingBuffer",
+  "name" : "toArray",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_ringbuffer_toArray",
+  "return" : ["JsVar","A new typed array containing the values, oldest first"]
+}
+Copy the values in the RingBuffer into a new typed array of the same type, with
+the oldest value first
+ */
+JsVar *jswrap_ringbuffer_toArray(JsVar *parent) {
+  EspruinoRingBuffer ring;
+  if (!espruinoRingBufferLoad(parent, &ring)) return 0;
+  JsVarDataArrayBufferViewType type = ring.buf->varData.arraybuffer.type;
+  JsVar *arr = jsvNewTypedArray(type, (JsVarInt)ring.count);
+  if (arr) {
+    EspruinoFlatArray dst;
+    if (ring.isFlat && espruinoGetFlatArray(arr, &dst)) {
+      EspruinoFlatArray runs[2];
+      int n, runCount = espruinoRingBufferGetRuns(&ring, runs);
+      size_t elementSize = JSV_ARRAYBUFFER_GET_SIZE(type);
+      for (n=0;n<runCount;n++) {
+        memcpy(dst.ptr, runs[n].ptr, runs[n].count*elementSize);
+        dst.ptr += runs[n].count*elementSize;
+      }
+    } else {
+      size_t i;
+      for (i=0;i<ring.count;i++) {
+        JsVar *v = jsvArrayBufferGet(ring.buf, espruinoRingBufferIndex(&ring, i));
+        jsvArrayBufferSet(arr, i, v);
+        jsvUnLock(v);
+      }
+    }
+  }
+  espruinoRingBufferFree(&ring);
+  return arr;
+}
+
 // http://paulbourke.net/miscellaneous/dft/
 /*
    This computes an in-place complex-to-complex FFT
@@ -364,10 +825,10 @@ short FFT(short int dir,long m,double *x,double *y)
       u2 = u1 * c2 + u2 * c1;
       u1 = z;
     }
-    c2 = jswrap_math_sqrt((1.0 - c1) / 2.0);
+    c2 = jswrap_math_sqrt((JsVarFloat)((1.0 - c1) / 2.0));
     if (dir == 1)
       c2 = -c2;
-    c1 = jswrap_math_sqrt((1.0 + c1) / 2.0);
+    c1 = jswrap_math_sqrt((JsVarFloat)((1.0 + c1) / 2.0));
   }
 
   /* Scaling for forward transform */
@@ -381,6 +842,157 @@ short FFT(short int dir,long m,double *x,double *y)
   return(TRUE);
 }
 
+/* Fixed point FFT, for Int16Array/Int32Array data. This works in place on
+the array's own memory and does all maths with integers, so it's much faster
+than FFT() on chips without an FPU, and needs no big double buffers. */
+
+#define FFT_FIXED_MAX_BITS 10 ///< fftSinTable covers FFTs of up to 1<<FFT_FIXED_MAX_BITS points
+/// The first quarter of a sine wave, sin(2*pi*i/1024) in Q15
+static const int16_t fftSinTable[(1<<FFT_FIXED_MAX_BITS)/4+1] IN_FLASH_MEMORY = {
+  0, 201, 402, 603, 804, 1005, 1206, 1407, 1608, 1809, 2009, 2210,
+  2410, 2611, 2811, 3012, 3212, 3412, 3612, 3811, 4011, 4210, 4410, 4609,
+  4808, 5007, 5205, 5404, 5602, 5800, 5998, 6195, 6393, 6590, 6786, 6983,
+  7179, 7375, 7571, 7767, 7962, 8157, 8351, 8545, 8739, 8933, 9126, 9319,
+  9512, 9704, 9896, 10087, 10278, 10469, 10659, 10849, 11039, 11228, 11417, 11605,
+  11793, 11980, 12167, 12353, 12539, 12725, 12910, 13094, 13279, 13462, 13645, 13828,
+  14010, 14191, 14372, 14553, 14732, 14912, 15090, 15269, 15446, 15623, 15800, 15976,
+  16151, 16325, 16499, 16673, 16846, 17018, 17189, 17360, 17530, 17700, 17869, 18037,
+  18204, 18371, 18537, 18703, 18868, 19032, 19195, 19357, 19519, 19680, 19841, 20000,
+  20159, 20317, 20475, 20631, 20787, 20942, 21096, 21250, 21403, 21554, 21705, 21856,
+  22005, 22154, 22301, 22448, 22594, 22739, 22884, 23027, 23170, 23311, 23452, 23592,
+  23731, 23870, 24007, 24143, 24279, 24413, 24547, 24680, 24811, 24942, 25072, 25201,
+  25329, 25456, 25582, 25708, 25832, 25955, 26077, 26198, 26319, 26438, 26556, 26674,
+  26790, 26905, 27019, 27133, 27245, 27356, 27466, 27575, 27683, 27790, 27896, 28001,
+  28105, 28208, 28310, 28411, 28510, 28609, 28706, 28803, 28898, 28992, 29085, 29177,
+  29268, 29358, 29447, 29534, 29621, 29706, 29791, 29874, 29956, 30037, 30117, 30195,
+  30273, 30349, 30424, 30498, 30571, 30643, 30714, 30783, 30852, 30919, 30985, 31050,
+  31113, 31176, 31237, 31297, 31356, 31414, 31470, 31526, 31580, 31633, 31685, 31736,
+  31785, 31833, 31880, 31926, 31971, 32014, 32057, 32098, 32137, 32176, 32213, 32250,
+  32285, 32318, 32351, 32382, 32412, 32441, 32469, 32495, 32521, 32545, 32567, 32589,
+  32609, 32628, 32646, 32663, 32678, 32692, 32705, 32717, 32728, 32737, 32745, 32752,
+  32757, 32761, 32765, 32766, 32767
+};
+
+/// sin(2*pi*i/1024) in Q15
+static int32_t fftSin(unsigned int i) {
+  const unsigned int quarter = (1<<FFT_FIXED_MAX_BITS)/4;
+  i &= (1<<FFT_FIXED_MAX_BITS)-1;
+  bool negative = i >= quarter*2;
+  if (negative) i -= quarter*2;
+  if (i > quarter) i = quarter*2 - i;
+  int32_t v = (int16_t)READ_FLASH_UINT16(&fftSinTable[i]);
+  return negative ? -v : v;
+}
+
+static uint32_t fftIntSqrt(unsigned long long v) {
+  unsigned long long r = 0, bit = 1ULL << 62;
+  while (bit > v) bit >>= 2;
+  while (bit) {
+    if (v >= r + bit) {
+      v -= r + bit;
+      r = (r >> 1) + bit;
+    } else
+      r >>= 1;
+    bit >>= 2;
+  }
+  return (uint32_t)r;
+}
+
+/* In-place radix-2 FFT of 2^m points, the same as FFT() but with integers.
+Each stage of the forward transform halves the values, which both stops them
+overflowing and gives the same 1/n scaling as FFT(). The inverse transform
+isn't scaled, so values that don't fit the type are saturated. ACC must be
+big enough to hold the product of a value and a Q15 twiddle factor. */
+#define FFT_FIXED(NAME, T, ACC, TMIN, TMAX) \
+static void NAME(bool inverse, int m, T *x, T *y) { \
+  int n = 1<<m, i, j, k, l, l1, l2; \
+  /* bit reversal */ \
+  j = 0; \
+  for (i=0;i<n-1;i++) { \
+    if (i < j) { \
+      T t = x[i]; x[i] = x[j]; x[j] = t; \
+      t = y[i]; y[i] = y[j]; y[j] = t; \
+    } \
+    k = n >> 1; \
+    while (k <= j) { j -= k; k >>= 1; } \
+    j += k; \
+  } \
+  l2 = 1; \
+  for (l=0;l<m;l++) { \
+    l1 = l2; \
+    l2 <<= 1; \
+    for (j=0;j<l1;j++) { \
+      unsigned int angle = (unsigned int)(j << (FFT_FIXED_MAX_BITS-l-1)); \
+      ACC u1 = fftSin(angle + (1<<FFT_FIXED_MAX_BITS)/4); \
+      ACC u2 = inverse ? fftSin(angle) : -fftSin(angle); \
+      for (i=j;i<n;i+=l2) { \
+        int i1 = i + l1; \
+        ACC t1 = (u1 * x[i1] - u2 * y[i1]) >> 15; \
+        ACC t2 = (u1 * y[i1] + u2 * x[i1]) >> 15; \
+        ACC a1 = x[i] - t1, a2 = y[i] - t2, b1 = x[i] + t1, b2 = y[i] + t2; \
+        if (inverse) { \
+          x[i1] = (T)(a1<TMIN ? TMIN : (a1>TMAX ? TMAX : a1)); \
+          y[i1] = (T)(a2<TMIN ? TMIN : (a2>TMAX ? TMAX : a2)); \
+          x[i] = (T)(b1<TMIN ? TMIN : (b1>TMAX ? TMAX : b1)); \
+          y[i] = (T)(b2<TMIN ? TMIN : (b2>TMAX ? TMAX : b2)); \
+        } else { \
+          x[i1] = (T)(a1 >> 1); \
+          y[i1] = (T)(a2 >> 1); \
+          x[i] = (T)(b1 >> 1); \
+          y[i] = (T)(b2 >> 1); \
+        } \
+      } \
+    } \
+  } \
+}
+FFT_FIXED(FFT16, int16_t, int32_t, -32768, 32767)
+FFT_FIXED(FFT32, int32_t, long long, -2147483648LL, 2147483647LL)
+
+/// Try and do the FFT with integers, in place. Returns false if we can't and FFT() must be used
+static bool jswrap_espruino_FFT_fixed(JsVar *arrReal, JsVar *arrImag, bool inverse) {
+  EspruinoFlatArray faReal, faImag;
+  if (!espruinoGetFlatArray(arrReal, &faReal) ||
+      (faReal.type!=ARRAYBUFFERVIEW_INT16 && faReal.type!=ARRAYBUFFERVIEW_INT32))
+    return false;
+  int m = 0;
+  while ((1U<<m) < faReal.count) m++;
+  if (m<1 || m>FFT_FIXED_MAX_BITS || (1U<<m)!=faReal.count) return false;
+  bool hasImag = jsvIsIterable(arrImag);
+  size_t elementSize = JSV_ARRAYBUFFER_GET_SIZE(faReal.type);
+  if (hasImag) {
+    if (!espruinoGetFlatArray(arrImag, &faImag) ||
+        faImag.type!=faReal.type || faImag.count!=faReal.count)
+      return false;
+  } else {
+    // no imaginary array, so we need a blank one
+    faImag.count = faReal.count;
+    if (jsuGetFreeStack() < 100+elementSize*faImag.count) return false;
+    faImag.ptr = (char*)alloca(elementSize*faImag.count);
+    memset(faImag.ptr, 0, elementSize*faImag.count);
+  }
+
+  size_t i;
+  if (faReal.type==ARRAYBUFFERVIEW_INT16) {
+    int16_t *x = (int16_t*)faReal.ptr, *y = (int16_t*)faImag.ptr;
+    FFT16(inverse, m, x, y);
+    // as FFT(), if there's an imaginary array the real one gets the modulus
+    if (hasImag)
+      for (i=0;i<faReal.count;i++) {
+        uint32_t v = fftIntSqrt((unsigned long long)((int32_t)x[i]*x[i] + (int32_t)y[i]*y[i]));
+        x[i] = (int16_t)(v>32767 ? 32767 : v);
+      }
+  } else {
+    int32_t *x = (int32_t*)faReal.ptr, *y = (int32_t*)faImag.ptr;
+    FFT32(inverse, m, x, y);
+    if (hasImag)
+      for (i=0;i<faReal.count;i++) {
+        uint32_t v = fftIntSqrt((unsigned long long)((long long)x[i]*x[i] + (long long)y[i]*y[i]));
+        x[i] = (int32_t)(v>2147483647U ? 2147483647U : v);
+      }
+  }
+  return true;
+}
+
 /*JSON{
   "type" : "staticmethod",
   "ifndef" : "SAVE_ON_FLASH",
@@ -394,6 +1006,8 @@ short FFT(short int dir,long m,double *x,double *y)
   ]
 }
 Performs a Fast Fourier Transform (fft) on the supplied data and writes it back into the original arrays. Note that if only one array is supplied, the data written back is the modulus of the complex result `sqrt(r*r+i*i)`.
+
+If the data is in an `Int16Array` or `Int32Array` (and the imaginary array, if given, is the same type and length) with a power of 2 length of up to 1024, the FFT is done in place with fixed point maths. This is much faster on devices without an FPU and uses very little extra memory, so is ideal for analysing ADC readings. The forward transform is scaled by `1/length` as usual, which also keeps the results in range.
  */
 void jswrap_espruino_FFT(JsVar *arrReal, JsVar *arrImag, bool inverse) {
   if (!(jsvIsIterable(arrReal)) ||
@@ -402,6 +1016,9 @@ void jswrap_espruino_FFT(JsVar *arrReal, JsVar *arrImag, bool inverse) {
     return;
   }
 
+  if (jswrap_espruino_FFT_fixed(arrReal, arrImag, inverse))
+    return;
+
   // get length and work out power of 2
   size_t l = (size_t)jsvGetLength(arrReal);
   size_t pow2 = 1;
@@ -426,16 +1043,27 @@ void jswrap_espruino_FFT(JsVar *arrReal, JsVar *arrImag, bool inverse) {
   }
 
   // load data
+  EspruinoFlatArray faReal, faImag;
+  bool flatReal = espruinoGetFlatArray(arrReal, &faReal);
   JsvIterator it;
-  jsvIteratorNew(&it, arrReal);
-  i=0;
-  while (jsvIteratorHasElement(&it)) {
-    vReal[i++] = jsvIteratorGetFloatValue(&it);
-    jsvIteratorNext(&it);
+  if (flatReal) {
+    size_t n;
+    FLAT_ARRAY_FOREACH(faReal, n, v, vReal[n] = v;);
+  } else {
+    jsvIteratorNew(&it, arrReal);
+    i=0;
+    while (jsvIteratorHasElement(&it)) {
+      vReal[i++] = jsvIteratorGetFloatValue(&it);
+      jsvIteratorNext(&it);
+    }
+    jsvIteratorFree(&it);
   }
-  jsvIteratorFree(&it);
 
-  if (jsvIsIterable(arrImag)) {
+  if (espruinoGetFlatArray(arrImag, &faImag)) {
+    size_t n;
+    if (faImag.count > pow2) faImag.count = pow2;
+    FLAT_ARRAY_FOREACH(faImag, n, v, vImag[n] = v;);
+  } else if (jsvIsIterable(arrImag)) {
     jsvIteratorNew(&it, arrImag);
     i=0;
     while (i<pow2 && jsvIteratorHasElement(&it)) {
@@ -451,25 +1079,36 @@ void jswrap_espruino_FFT(JsVar *arrReal, JsVar *arrImag, bool inverse) {
   // Put the results back
   bool useModulus = jsvIsIterable(arrImag);
 
-  jsvIteratorNew(&it, arrReal);
-  i=0;
-  while (jsvIteratorHasElement(&it)) {
-    JsVarFloat f;
-    if (useModulus)
-      f = jswrap_math_sqrt(vReal[i]*vReal[i] + vImag[i]*vImag[i]);
-    else
-      f = vReal[i];
-
-    jsvUnLock(jsvIteratorSetValue(&it, jsvNewFromFloat(f)));
-    i++;
-    jsvIteratorNext(&it);
+  if (flatReal) {
+    size_t n;
+    for (n=0;n<faReal.count;n++)
+      espruinoFlatArraySet(&faReal, n, useModulus ? jswrap_math_sqrt((JsVarFloat)(vReal[n]*vReal[n] + vImag[n]*vImag[n])) : (JsVarFloat)vReal[n]);
+  } else {
+    jsvIteratorNew(&it, arrReal);
+    i=0;
+    while (jsvIteratorHasElement(&it)) {
+      JsVarFloat f;
+      if (useModulus)
+        f = jswrap_math_sqrt((JsVarFloat)(vReal[i]*vReal[i] + vImag[i]*vImag[i]));
+      else
+        f = (JsVarFloat)vReal[i];
+
+      jsvUnLock(jsvIteratorSetValue(&it, jsvNewFromFloat(f)));
+      i++;
+      jsvIteratorNext(&it);
+    }
+    jsvIteratorFree(&it);
   }
-  jsvIteratorFree(&it);
-  if (jsvIsIterable(arrImag)) {
+  if (espruinoGetFlatArray(arrImag, &faImag)) {
+    size_t n;
+    if (faImag.count > pow2) faImag.count = pow2;
+    for (n=0;n<faImag.count;n++)
+      espruinoFlatArraySet(&faImag, n, (JsVarFloat)vImag[n]);
+  } else if (jsvIsIterable(arrImag)) {
     jsvIteratorNew(&it, arrImag);
     i=0;
     while (jsvIteratorHasElement(&it)) {
-      jsvUnLock(jsvIteratorSetValue(&it, jsvNewFromFloat(vImag[i++])));
+      jsvUnLock(jsvIteratorSetValue(&it, jsvNewFromFloat((JsVarFloat)vImag[i++])));
       jsvIteratorNext(&it);
     }
     jsvIteratorFree(&it);
@@ -478,77 +1117,325 @@ void jswrap_espruino_FFT(JsVar *arrReal, JsVar *arrImag, bool inverse) {
 
 /*JSON{
   "type" : "staticmethod",
-  "class" : "E",
-  "name" : "interpolate",
   "ifndef" : "SAVE_ON_FLASH",
-  "generate" : "jswrap_espruino_interpolate",
+  "class" : "E",
+  "name" : "dot",
+  "generate" : "jswrap_espruino_dot",
   "params" : [
-    ["array","JsVar","A Typed Array to interpolate between"],
-    ["index","float","Floating point index to access"]
+    ["arr1","JsVar","An array"],
+    ["arr2","JsVar","An array"]
   ],
-  "return" : ["float","The result of interpolating between (int)index and (int)(index+1)"]
+  "return" : ["float","The dot product of the two arrays"]
 }
-Interpolate between two adjacent values in the Typed Array
+Work out the dot product of two arrays - the sum of `arr1[i]*arr2[i]`. If
+one array is longer than the other, the extra elements are ignored.
  */
-JsVarFloat jswrap_espruino_interpolate(JsVar *array, JsVarFloat findex) {
-  if (!jsvIsArrayBuffer(array)) return 0;
-  size_t idx = (size_t)findex;
-  JsVarFloat a = findex - (int)idx;
-  if (findex<0) {
-    idx = 0;
-    a = 0;
+JsVarFloat jswrap_espruino_dot(JsVar *arr1, JsVar *arr2) {
+  if (!(jsvIsIterable(arr1)) ||
+      !(jsvIsIterable(arr2))) {
+    jsExceptionHere(JSET_ERROR, "Expecting first 2 arguments to be iterable, not %t and %t", arr1, arr2);
+    return NAN;
   }
-  if (findex>=jsvGetArrayBufferLength(array)-1) {
-    idx = jsvGetArrayBufferLength(array)-1;
-    a = 0;
+  JsVarFloat dot = 0;
+  EspruinoFlatArray fa1, fa2;
+  if (espruinoGetFlatArray(arr1, &fa1) && espruinoGetFlatArray(arr2, &fa2)) {
+    size_t i, n = fa1.count < fa2.count ? fa1.count : fa2.count;
+    if (fa1.type == fa2.type) {
+      // same types - just one array needs fetching with a switch
+      fa1.count = n;
+      FLAT_ARRAY_FOREACH(fa1, i, v, dot += v * espruinoFlatArrayGet(&fa2, i););
+    } else {
+      for (i=0;i<n;i++)
+        dot += espruinoFlatArrayGet(&fa1, i) * espruinoFlatArrayGet(&fa2, i);
+    }
+    return dot;
   }
-  JsvArrayBufferIterator it;
-  jsvArrayBufferIteratorNew(&it, array, idx);
-  JsVarFloat fa = jsvArrayBufferIteratorGetFloatValue(&it);
-  jsvArrayBufferIteratorNext(&it);
-  JsVarFloat fb = jsvArrayBufferIteratorGetFloatValue(&it);
-  jsvArrayBufferIteratorFree(&it);
-  return fa*(1-a) + fb*a;
+
+  JsvIterator it1, it2;
+  jsvIteratorNew(&it1, arr1);
+  jsvIteratorNew(&it2, arr2);
+  while (jsvIteratorHasElement(&it1) && jsvIteratorHasElement(&it2)) {
+    dot += jsvIteratorGetFloatValue(&it1) * jsvIteratorGetFloatValue(&it2);
+    jsvIteratorNext(&it1);
+    jsvIteratorNext(&it2);
+  }
+  jsvIteratorFree(&it1);
+  jsvIteratorFree(&it2);
+  return dot;
 }
 
 /*JSON{
   "type" : "staticmethod",
-  "class" : "E",
-  "name" : "interpolate2d",
   "ifndef" : "SAVE_ON_FLASH",
-  "generate" : "jswrap_espruino_interpolate2d",
+  "class" : "E",
+  "name" : "scale",
+  "generate" : "jswrap_espruino_scale",
   "params" : [
-    ["array","JsVar","A Typed Array to interpolate between"],
-    ["width","int32","Integer 'width' of 2d array"],
-    ["x","float","Floating point X index to access"],
-    ["y","float","Floating point Y index to access"]
-  ],
-  "return" : ["float","The result of interpolating in 2d between the 4 surrounding cells"]
+    ["arr","JsVar","An array to modify"],
+    ["scale","float","The amount to multiply each element by"],
+    ["offset","float","The amount to add to each element after multiplying"]
+  ]
 }
-Interpolate between four adjacent values in the Typed Array, in 2D.
+Multiply every element of the array by `scale` and add `offset`, in place.
+This is equivalent to `for (i in arr) arr[i] = arr[i]*scale + offset`
  */
-JsVarFloat jswrap_espruino_interpolate2d(JsVar *array, int width, JsVarFloat x, JsVarFloat y) {
-  if (!jsvIsArrayBuffer(array)) return 0;
-  int yidx = (int)y;
-  JsVarFloat ay = y-yidx;
-  if (y<0) {
-    yidx = 0;
-    ay = 0;
+void jswrap_espruino_scale(JsVar *arr, JsVarFloat scale, JsVarFloat offset) {
+  if (!(jsvIsIterable(arr))) {
+    jsExceptionHere(JSET_ERROR, "Expecting first argument to be iterable, not %t", arr);
+    return;
   }
-
-  JsVarFloat findex = x + (JsVarFloat)(yidx*width);
-  size_t idx = (size_t)findex;
-  JsVarFloat ax = findex-(int)idx;
-  if (x<0) {
-    idx = (size_t)(yidx*width);
-    ax = 0;
+  EspruinoFlatArray fa;
+  if (espruinoGetFlatArray(arr, &fa)) {
+    size_t i;
+    for (i=0;i<fa.count;i++)
+      espruinoFlatArraySet(&fa, i, espruinoFlatArrayGet(&fa, i)*scale + offset);
+    return;
   }
 
-  JsvArrayBufferIterator it;
-  jsvArrayBufferIteratorNew(&it, array, idx);
+  JsvIterator it;
+  jsvIteratorNew(&it, arr);
+  while (jsvIteratorHasElement(&it)) {
+    JsVarFloat v = jsvIteratorGetFloatValue(&it);
+    jsvUnLock(jsvIteratorSetValue(&it, jsvNewFromFloat(v*scale + offset)));
+    jsvIteratorNext(&it);
+  }
+  jsvIteratorFree(&it);
+}
 
-  JsVarFloat xa,xb;
-  int i;
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "add",
+  "generate" : "jswrap_espruino_add",
+  "params" : [
+    ["arr","JsVar","An array to modify"],
+    ["src","JsVar","An array to add to it"]
+  ]
+}
+Add each element of `src` to the same element of `arr`, in place. This is
+equivalent to `for (i in arr) arr[i] += src[i]`. If one array is longer than
+the other, the extra elements are ignored.
+ */
+void jswrap_espruino_add(JsVar *arr, JsVar *src) {
+  if (!(jsvIsIterable(arr)) ||
+      !(jsvIsIterable(src))) {
+    jsExceptionHere(JSET_ERROR, "Expecting first 2 arguments to be iterable, not %t and %t", arr, src);
+    return;
+  }
+  EspruinoFlatArray fa, fs;
+  if (espruinoGetFlatArray(arr, &fa) && espruinoGetFlatArray(src, &fs)) {
+    size_t i, n = fa.count < fs.count ? fa.count : fs.count;
+    for (i=0;i<n;i++)
+      espruinoFlatArraySet(&fa, i, espruinoFlatArrayGet(&fa, i) + espruinoFlatArrayGet(&fs, i));
+    return;
+  }
+
+  JsvIterator it, itsrc;
+  jsvIteratorNew(&it, arr);
+  jsvIteratorNew(&itsrc, src);
+  while (jsvIteratorHasElement(&it) && jsvIteratorHasElement(&itsrc)) {
+    JsVarFloat v = jsvIteratorGetFloatValue(&it) + jsvIteratorGetFloatValue(&itsrc);
+    jsvUnLock(jsvIteratorSetValue(&it, jsvNewFromFloat(v)));
+    jsvIteratorNext(&it);
+    jsvIteratorNext(&itsrc);
+  }
+  jsvIteratorFree(&it);
+  jsvIteratorFree(&itsrc);
+}
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "minmax",
+  "generate" : "jswrap_espruino_minmax",
+  "params" : [
+    ["arr","JsVar","The array to search"]
+  ],
+  "return" : ["JsVar","An object `{min, max}`, or undefined if the array is empty"]
+}
+Find the smallest and largest values in the given Array, String or ArrayBuffer
+ */
+JsVar *jswrap_espruino_minmax(JsVar *arr) {
+  if (!(jsvIsIterable(arr))) {
+    jsExceptionHere(JSET_ERROR, "Expecting first argument to be iterable, not %t", arr);
+    return 0;
+  }
+  JsVarFloat min = INFINITY, max = -INFINITY;
+  bool found = false;
+  EspruinoFlatArray fa;
+  if (espruinoGetFlatArray(arr, &fa)) {
+    size_t i;
+    FLAT_ARRAY_FOREACH(fa, i, v, if (v<min) min=v; if (v>max) max=v;);
+    found = fa.count>0;
+  } else {
+    JsvIterator it;
+    jsvIteratorNew(&it, arr);
+    while (jsvIteratorHasElement(&it)) {
+      JsVarFloat v = jsvIteratorGetFloatValue(&it);
+      if (v<min) min=v;
+      if (v>max) max=v;
+      found = true;
+      jsvIteratorNext(&it);
+    }
+    jsvIteratorFree(&it);
+  }
+  if (!found) return 0;
+  JsVar *r = jsvNewObject();
+  if (!r) return 0;
+  jsvObjectSetChildAndUnLock(r, "min", jsvNewFromFloat(min));
+  jsvObjectSetChildAndUnLock(r, "max", jsvNewFromFloat(max));
+  return r;
+}
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "histogram",
+  "generate" : "jswrap_espruino_histogram",
+  "params" : [
+    ["arr","JsVar","The array of values"],
+    ["bins","JsVar","The number of bins, or a typed array of counts to add to"],
+    ["min","float","The value at the start of the first bin"],
+    ["max","float","The value at the end of the last bin"]
+  ],
+  "return" : ["JsVar","The typed array of counts"]
+}
+Count how many of the values in `arr` fall into each of `bins` equally
+sized bins between `min` and `max`. Values outside that range are ignored.
+
+If `bins` is a number, a new `Uint32Array` of counts is returned. If it is a
+typed array, the counts are added to it - so a histogram can be built up from
+data arriving in chunks:
+
+```
+var h = new Uint16Array(10);
+function onData(d) { E.histogram(d, h, 0, 1024); }
+```
+ */
+JsVar *jswrap_espruino_histogram(JsVar *arr, JsVar *bins, JsVarFloat min, JsVarFloat max) {
+  if (!(jsvIsIterable(arr))) {
+    jsExceptionHere(JSET_ERROR, "Expecting first argument to be iterable, not %t", arr);
+    return 0;
+  }
+  JsVar *counts;
+  if (jsvIsArrayBuffer(bins)) {
+    counts = jsvLockAgain(bins);
+  } else if (jsvIsNumeric(bins) && jsvGetInteger(bins)>0) {
+    counts = jsvNewTypedArray(ARRAYBUFFERVIEW_UINT32, jsvGetInteger(bins));
+    if (!counts) return 0;
+  } else {
+    jsExceptionHere(JSET_ERROR, "Expecting bins to be a number or typed array, not %t", bins);
+    return 0;
+  }
+  size_t binCount = (size_t)jsvGetArrayBufferLength(counts);
+  if (!binCount || !(max>min)) return counts;
+  JsVarFloat binScale = (JsVarFloat)binCount / (max-min);
+
+  EspruinoFlatArray fc, fa;
+  bool flatCounts = espruinoGetFlatArray(counts, &fc);
+  JsvIterator it;
+  bool flatArr = espruinoGetFlatArray(arr, &fa);
+  size_t i;
+  if (!flatArr) jsvIteratorNew(&it, arr);
+  for (i=0; flatArr ? i<fa.count : jsvIteratorHasElement(&it); i++) {
+    JsVarFloat v;
+    if (flatArr) {
+      v = espruinoFlatArrayGet(&fa, i);
+    } else {
+      v = jsvIteratorGetFloatValue(&it);
+      jsvIteratorNext(&it);
+    }
+    if (!(v>=min && v<=max)) continue; // also skips NaN
+    size_t bin = (size_t)((v-min)*binScale);
+    if (bin >= binCount) bin = binCount-1; // v==max
+    if (flatCounts) {
+      espruinoFlatArraySet(&fc, bin, espruinoFlatArrayGet(&fc, bin)+1);
+    } else {
+      JsVar *c = jsvNewFromInteger(jsvGetIntegerAndUnLock(jsvArrayBufferGet(counts, bin))+1);
+      jsvArrayBufferSet(counts, bin, c);
+      jsvUnLock(c);
+    }
+  }
+  if (!flatArr) jsvIteratorFree(&it);
+  return counts;
+}
+
+/*JSON{
+  "type" : "staticmethod",
+  "class" : "E",
+  "name" : "interpolate",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_espruino_interpolate",
+  "params" : [
+    ["array","JsVar","A Typed Array to interpolate between"],
+    ["index","float","Floating point index to access"]
+  ],
+  "return" : ["float","The result of interpolating between (int)index and (int)(index+1)"]
+}
+Interpolate between two adjacent values in the Typed Array
+ */
+JsVarFloat jswrap_espruino_interpolate(JsVar *array, JsVarFloat findex) {
+  if (!jsvIsArrayBuffer(array)) return 0;
+  size_t idx = (size_t)findex;
+  JsVarFloat a = findex - (JsVarFloat)idx;
+  if (findex<0) {
+    idx = 0;
+    a = 0;
+  }
+  if (findex>=jsvGetArrayBufferLength(array)-1) {
+    idx = jsvGetArrayBufferLength(array)-1;
+    a = 0;
+  }
+  JsvArrayBufferIterator it;
+  jsvArrayBufferIteratorNew(&it, array, idx);
+  JsVarFloat fa = jsvArrayBufferIteratorGetFloatValue(&it);
+  jsvArrayBufferIteratorNext(&it);
+  JsVarFloat fb = jsvArrayBufferIteratorGetFloatValue(&it);
+  jsvArrayBufferIteratorFree(&it);
+  return fa*(1-a) + fb*a;
+}
+
+/*JSON{
+  "type" : "staticmethod",
+  "class" : "E",
+  "name" : "interpolate2d",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_espruino_interpolate2d",
+  "params" : [
+    ["array","JsVar","A Typed Array to interpolate between"],
+    ["width","int32","Integer 'width' of 2d array"],
+    ["x","float","Floating point X index to access"],
+    ["y","float","Floating point Y index to access"]
+  ],
+  "return" : ["float","The result of interpolating in 2d between the 4 surrounding cells"]
+}
+Interpolate between four adjacent values in the Typed Array, in 2D.
+ */
+JsVarFloat jswrap_espruino_interpolate2d(JsVar *array, int width, JsVarFloat x, JsVarFloat y) {
+  if (!jsvIsArrayBuffer(array)) return 0;
+  int yidx = (int)y;
+  JsVarFloat ay = y-(JsVarFloat)yidx;
+  if (y<0) {
+    yidx = 0;
+    ay = 0;
+  }
+
+  JsVarFloat findex = x + (JsVarFloat)(yidx*width);
+  size_t idx = (size_t)findex;
+  JsVarFloat ax = findex-(JsVarFloat)idx;
+  if (x<0) {
+    idx = (size_t)(yidx*width);
+    ax = 0;
+  }
+
+  JsvArrayBufferIterator it;
+  jsvArrayBufferIteratorNew(&it, array, idx);
+
+  JsVarFloat xa,xb;
+  int i;
 
   xa = jsvArrayBufferIteratorGetFloatValue(&it);
   jsvArrayBufferIteratorNext(&it);
@@ -629,6 +1516,8 @@ Get and reset the error flags. Returns an array that can contain:
 `'LOW_MEMORY'`: Memory is running low - Espruino had to run a garbage collection pass or remove some of the command history
 
 `'MEMORY'`: Espruino ran out of memory and was unable to allocate some data that it needed.
+
+`'CONSOLE_FULL'`: Console output was dropped because the transmit buffer was full. This only happens after `E.setConsoleBlocking(false)`.
  */
 JsVar *jswrap_espruino_getErrorFlags() {
   JsVar *arr = jsvNewEmptyArray();
@@ -639,10 +1528,792 @@ JsVar *jswrap_espruino_getErrorFlags() {
   if (jsErrorFlags&JSERR_LOW_MEMORY) jsvArrayPushAndUnLock(arr, jsvNewFromString("LOW_MEMORY"));
   if (jsErrorFlags&JSERR_MEMORY) jsvArrayPushAndUnLock(arr, jsvNewFromString("MEMORY"));
   if (jsErrorFlags&JSERR_MEMORY_BUSY) jsvArrayPushAndUnLock(arr, jsvNewFromString("JSERR_MEMORY_BUSY"));
+  if (jsErrorFlags&JSERR_CONSOLE_FULL) jsvArrayPushAndUnLock(arr, jsvNewFromString("CONSOLE_FULL"));
   jsErrorFlags = JSERR_NONE;
   return arr;
 }
 
+/*JSON{
+  "type" : "staticmethod",
+  "class" : "E",
+  "name" : "setConsoleBlocking",
+  "generate" : "jswrap_espruino_setConsoleBlocking",
+  "params" : [
+    ["blocking","bool","If true (the default), wait for space when the console's transmit buffer is full. If false, drop the output"]
+  ]
+}
+Normally if the console's transmit buffer fills up (for instance because of
+lots of `console.log` calls), Espruino waits until there is space in it,
+stalling any other code.
+
+With `E.setConsoleBlocking(false)` output that won't fit in the buffer is
+dropped instead, and `E.getErrorFlags()` will report `CONSOLE_FULL`. This is
+useful for debug logging from time-critical code. The setting is reset when
+Espruino is reset.
+ */
+void jswrap_espruino_setConsoleBlocking(bool blocking) {
+  if (blocking)
+    jsiStatus &= ~JSIS_CONSOLE_NONBLOCKING;
+  else
+    jsiStatus |= JSIS_CONSOLE_NONBLOCKING;
+}
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "setGCMode",
+  "generate" : "jswrap_espruino_setGCMode",
+  "params" : [
+    ["options","JsVar","An object containing `{incremental:bool, sliceUs:int}`"]
+  ]
+}
+Set how Espruino collects garbage when it is idle. By default, when memory
+is low the whole of memory is garbage collected in one go, which can take a
+few milliseconds on larger devices.
+
+With `E.setGCMode({incremental:true})` garbage is instead collected in small
+slices of at most `sliceUs` microseconds (default 500) each time around the
+idle loop, so callbacks don't get delayed. Freeing a large array or object
+that is no longer used is also spread over the idle loop in this mode.
+
+`E.setGCMode({incremental:false})` returns to the default behaviour.
+ */
+#ifndef SAVE_ON_FLASH
+void jswrap_espruino_setGCMode(JsVar *options) {
+  bool incremental = jsvGCIncremental;
+  JsVarInt sliceUs = 500;
+  jsvConfigObject configs[] = {
+      {"incremental", JSV_BOOLEAN, &incremental},
+      {"sliceUs", JSV_INTEGER, &sliceUs}
+  };
+  if (!jsvReadConfigObject(options, configs, sizeof(configs) / sizeof(jsvConfigObject)))
+    return; // error already displayed by jsvReadConfigObject
+  if (sliceUs<1) sliceUs=1;
+  jsvGCIncremental = incremental;
+  jsvGCSliceTime = jshGetTimeFromMilliseconds((JsVarFloat)sliceUs/1000);
+  // if we're turning it off, finish what we started
+  if (!incremental) {
+    jsvFreeQueueDrain(0);
+    if (jsvIsGarbageCollectingIncrementally())
+      jsvGarbageCollect();
+  }
+}
+#endif
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "setLowMemoryThreshold",
+  "generate" : "jswrap_espruino_setLowMemoryThreshold",
+  "params" : [
+    ["vars","int","Fire `E.on('lowMemory', ...)` when fewer than this many variables are free, or 0 to only fire it when memory has run out"]
+  ]
+}
+Set when the `lowMemory` event on `E` is fired. See `E.on('lowMemory', ...)`.
+ */
+#ifndef SAVE_ON_FLASH
+void jswrap_espruino_setLowMemoryThreshold(JsVarInt vars) {
+  jsvLowMemoryThreshold = vars>0 ? (unsigned int)vars : 0;
+  jsvLowMemoryState = JSV_LOWMEM_ARMED;
+}
+#endif
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "setTimerSlack",
+  "generate" : "jswrap_espruino_setTimerSlack",
+  "params" : [
+    ["slack","float","The time in milliseconds that timers may be delayed by"]
+  ]
+}
+Allow timers created after this call with `setTimeout` or `setInterval` to
+run up to `slack` milliseconds late. Espruino then wakes up when the first
+timer's slack runs out and runs every timer that is due at the same time,
+so several timers with nearby deadlines cause one wakeup rather than many.
+
+Intervals are still scheduled from when they were *meant* to run, so
+they don't drift. The default is 0 (no slack), and timers used to debounce
+`setWatch` never have slack.
+
+```
+E.setTimerSlack(50);
+setInterval(readSensor, 1000);
+setInterval(flashLED, 980); // likely runs in the same wakeup as readSensor
+```
+ */
+#ifndef SAVE_ON_FLASH
+void jswrap_espruino_setTimerSlack(JsVarFloat slack) {
+  if (slack<0) slack=0;
+  jsiTimerSlack = jshGetTimeFromMilliseconds(slack);
+}
+#endif
+
+/*JSON{
+  "type" : "staticmethod",
+  "class" : "E",
+  "name" : "getTicks",
+  "generate" : "jswrap_espruino_getTicks",
+  "return" : ["int","The system time in microseconds, as a 32 bit integer"]
+}
+Return the current system time in microseconds as an integer. Unlike
+`getTime()` no floating point maths is needed, which is much faster on
+devices without an FPU (eg. ESP8266).
+
+The value wraps around every 71 minutes, so to find how much time has
+passed use `(E.getTicks()-start)|0`:
+
+```
+var start = E.getTicks();
+doSomething();
+print(((E.getTicks()-start)|0) + "us");
+```
+
+`setWatch` can also report times in the same way with `ticks:true`.
+ */
+JsVarInt jswrap_espruino_getTicks() {
+  return jsiGetTicksFromTime(jshGetSystemTime());
+}
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "getTaskStats",
+  "generate" : "jswrap_espruino_getTaskStats",
+  "params" : [
+    ["clear","bool","If true, clear the statistics after returning them"]
+  ],
+  "return" : ["JsVar","An array of execution times for each callback"]
+}
+Return how long each timer, watch and event callback has taken to execute,
+slowest first:
+
+```
+[ {
+    type : "timer",   // "timer", "watch" or "event"
+    name : "foo",     // the function's name, or the line it was defined on
+    calls : 12,       // how many times it has run
+    total : 345.6,    // milliseconds spent running it in total
+    max : 78.9        // the longest it has taken in one go, in milliseconds
+  }, ... ]
+```
+
+A callback that runs for a long time stops anything else happening, which
+on some devices (for instance ESP8266) can cause WiFi to fail or the device to
+reset. Once 15 different callbacks have been seen, others are listed as
+`other`. See also `E.setTaskBudget`.
+ */
+#ifndef SAVE_ON_FLASH
+JsVar *jswrap_espruino_getTaskStats(bool clear) {
+  // take a copy first, so callbacks can't change it while we're working
+  JsiTaskStats stats[JSI_TASK_STATS];
+  memcpy(stats, jsiTaskStats, sizeof(stats));
+  if (clear) memset(jsiTaskStats, 0, sizeof(jsiTaskStats));
+  // sort, slowest first
+  int i, j;
+  for (i=1;i<JSI_TASK_STATS;i++) {
+    JsiTaskStats t = stats[i];
+    for (j=i;j>0 && stats[j-1].total<t.total;j--)
+      stats[j] = stats[j-1];
+    stats[j] = t;
+  }
+  const char *types[] = {"event","timer","watch"};
+  JsVar *arr = jsvNewEmptyArray();
+  for (i=0;i<JSI_TASK_STATS && arr;i++) {
+    JsiTaskStats *t = &stats[i];
+    if (!t->calls) continue;
+    JsVar *o = jsvNewObject();
+    if (!o) break;
+    jsvObjectSetChildAndUnLock(o, "type", jsvNewFromString(types[t->type]));
+    jsvObjectSetChildAndUnLock(o, "name", jsvNewFromString(t->name));
+    jsvObjectSetChildAndUnLock(o, "calls", jsvNewFromInteger((JsVarInt)t->calls));
+    jsvObjectSetChildAndUnLock(o, "total", jsvNewFromFloat(jshGetMillisecondsFromTime(t->total)));
+    jsvObjectSetChildAndUnLock(o, "max", jsvNewFromFloat(jshGetMillisecondsFromTime(t->max)));
+    jsvArrayPushAndUnLock(arr, o);
+  }
+  return arr;
+}
+#endif
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifdef" : "USE_TRACE",
+  "class" : "E",
+  "name" : "getTrace",
+  "generate" : "jswrap_espruino_getTrace",
+  "params" : [
+    ["clear","bool","If true, clear the trace after returning it"]
+  ],
+  "return" : ["JsVar","An object containing the trace"]
+}
+**Only available in builds made with `make TRACE=1`**
+
+Return the most recent timing trace points (idle loop phases, garbage
+collection, IO events, timer callbacks, and on ESP8266 WiFi send/receive):
+
+```
+{
+  names : ["idle","idle","io",...], // the name of each trace id
+  phases : "BEBE...",               // B=begin, E=end, i=instant, for each id
+  trace : new Uint32Array([         // two words per record, oldest first
+    time, // microseconds since the first record
+    (id<<16) | arg,
+    ...
+  ])
+}
+```
+
+Tracing is recorded into a fixed-size ring in RAM, so only the last few
+hundred records are kept. Copy the output of
+`print(JSON.stringify(E.getTrace()))` into a file and convert it with
+`node scripts/trace_to_chrome.js trace.json > chrome.json`, then load
+it in `chrome://tracing`.
+ */
+#ifdef USE_TRACE
+JsVar *jswrap_espruino_getTrace(bool clear) {
+  return jstraceGet(clear);
+}
+#endif
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "setTaskBudget",
+  "generate" : "jswrap_espruino_setTaskBudget",
+  "params" : [
+    ["budget","float","The time in milliseconds a callback may run for before a warning is given (0 to disable)"]
+  ]
+}
+Print a warning when a single timer, watch or event callback takes longer
+than `budget` milliseconds to execute, for instance:
+
+```
+E.setTaskBudget(20);
+setInterval(function slow() { for (var i=0;i<10000;i++); }, 1000);
+// WARNING: Timer callback slow took 102ms
+```
+
+See `E.getTaskStats` for the times of every callback.
+ */
+#ifndef SAVE_ON_FLASH
+void jswrap_espruino_setTaskBudget(JsVarFloat budget) {
+  if (!(budget>0)) budget=0;
+  jsiTaskBudget = jshGetTimeFromMilliseconds(budget);
+}
+#endif
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "setFlags",
+  "generate" : "jswrap_espruino_setFlags",
+  "params" : [
+    ["flags","JsVar","An object containing `{pretokenise:bool, saveCodeInFlash:bool, fastLoad:bool}`"]
+  ]
+}
+Set flags that change how Espruino works.
+
+With `E.setFlags({pretokenise:true})`, the code of any function defined
+afterwards is stored with whitespace and comments removed and with
+operators and reserved words stored as single characters. This uses less
+memory and is faster to execute. When the function is printed (eg. with
+`dump()` or `E.dumpStr`) it is turned back into readable text, but
+original formatting and comments are lost. Line breaks are kept, so error
+messages still report the correct line numbers. Code written with
+`E.setBootCode` while this is set is stored the same way.
+
+With `E.setFlags({saveCodeInFlash:true})`, `save()` writes the code of each
+function into flash alongside the saved state, and the function then runs
+directly from flash rather than keeping a copy in RAM. This frees up memory
+for variables, although code in flash may be slower to access. This only
+has an effect on devices where flash memory can be read directly.
+
+With `E.setFlags({fastLoad:true})`, `save()` writes the saved state as
+separate pages rather than compressing it all at once. Pages of unused
+memory are skipped, and pages that don't compress well are stored as-is,
+so loading after a reset or wake from deep sleep is much quicker, at the
+expense of using more flash. See `E.getBootTimings()`.
+ */
+#ifndef SAVE_ON_FLASH
+void jswrap_espruino_setFlags(JsVar *flags) {
+  bool pretokenise = jspPretokenise;
+  bool saveCodeInFlash = jsfSaveCodeInFlash;
+  bool fastLoad = jsfSaveFastLoad;
+  jsvConfigObject configs[] = {
+      {"pretokenise", JSV_BOOLEAN, &pretokenise},
+      {"saveCodeInFlash", JSV_BOOLEAN, &saveCodeInFlash},
+      {"fastLoad", JSV_BOOLEAN, &fastLoad}
+  };
+  if (!jsvReadConfigObject(flags, configs, sizeof(configs) / sizeof(jsvConfigObject)))
+    return; // error already displayed by jsvReadConfigObject
+  jspPretokenise = pretokenise;
+  jsfSaveCodeInFlash = saveCodeInFlash;
+  jsfSaveFastLoad = fastLoad;
+}
+#endif
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "getBootTimings",
+  "generate" : "jsfGetBootTimings",
+  "return" : ["JsVar","An object containing timing information"]
+}
+Return information about how long it took to start up from saved code:
+
+```
+{
+  loadState : 12.5,     // milliseconds taken to load the saved state
+  bootCode : 3.1,       // milliseconds taken to execute boot code (see E.setBootCode)
+  emptyPages : 120,     // For E.setFlags({fastLoad:true}), pages of unused memory
+  rawPages : 2,         //   ... pages that were copied directly
+  compressedPages : 30  //   ... and pages that were decompressed
+}
+```
+ */
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "defrag",
+  "generate" : "jswrap_espruino_defrag",
+  "return" : ["int","The number of variables that were moved"]
+}
+Collect garbage, then move variables so that all of the free memory is in one
+contiguous block.
+
+Big `ArrayBuffer`s and other flat strings need a run of free variables next
+to each other, so after a lot of allocation you may find that they can't be
+allocated even when `process.memory().free` reports there is plenty of memory.
+Calling `E.defrag()` first fixes this.
+
+This won't do anything while the utility timer is in use (for instance
+while `analogWrite` with `soft:true` or `Waveform` are running), as it has
+direct pointers to variables.
+ */
+#ifndef SAVE_ON_FLASH
+int jswrap_espruino_defrag() {
+  if (jstUtilTimerIsRunning()) return 0;
+  // These are only referenced, so keep them where they are
+  JsVar *timers = timerArray ? jsvLock(timerArray) : 0;
+  JsVar *watches = watchArray ? jsvLock(watchArray) : 0;
+  int moved = (int)jsvDefragment();
+  jsvUnLock2(timers, watches);
+  return moved;
+}
+#endif
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "getMemoryMap",
+  "generate" : "jswrap_espruino_getMemoryMap",
+  "return" : ["JsVar","An object describing how memory is used"]
+}
+Run a Garbage Collection pass, and return information on how fragmented
+memory is and what is using it:
+
+```
+{
+  free : 1200,        // free blocks
+  largestFree : 900,  // the largest run of contiguous free blocks
+  freeRuns : [ 12, 3, 0, 1, 0, 0, 0, 1 ], // runs of 1, 2-3, 4-7, 8-15, ... 128+ free blocks
+  locked : 5,         // variables that are currently locked
+  types : { name : 120, string : 40, flatString : 0, ... } // blocks used by each type
+}
+```
+
+`largestFree` is the biggest flat string or typed array (in blocks) that can
+currently be allocated - even if `free` is large, if memory is fragmented it
+may be small. `E.defrag()` can help.
+ */
+#ifndef SAVE_ON_FLASH
+JsVar *jswrap_espruino_getMemoryMap() {
+  jsvGarbageCollect();
+  JsvMemoryMap map;
+  jsvGetMemoryMap(&map);
+  JsVar *obj = jsvNewObject();
+  if (!obj) return 0;
+  int i;
+  unsigned int used = 0;
+  for (i=0;i<JSVM_TYPES;i++)
+    used += map.blocks[i];
+  jsvObjectSetChildAndUnLock(obj, "free", jsvNewFromInteger((JsVarInt)(jsvGetMemoryTotal()-used)));
+  jsvObjectSetChildAndUnLock(obj, "largestFree", jsvNewFromInteger((JsVarInt)map.largestFree));
+  JsVar *runs = jsvNewEmptyArray();
+  for (i=0;i<JSV_MEMORY_MAP_RUNS && runs;i++)
+    jsvArrayPushAndUnLock(runs, jsvNewFromInteger((JsVarInt)map.freeRuns[i]));
+  jsvObjectSetChildAndUnLock(obj, "freeRuns", runs);
+  jsvObjectSetChildAndUnLock(obj, "locked", jsvNewFromInteger((JsVarInt)map.locked));
+  JsVar *types = jsvNewObject();
+  for (i=0;i<JSVM_TYPES && types;i++)
+    jsvObjectSetChildAndUnLock(types, jsvMemoryMapTypeNames[i], jsvNewFromInteger((JsVarInt)map.blocks[i]));
+  jsvObjectSetChildAndUnLock(obj, "types", types);
+  return obj;
+}
+#endif
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifdef" : "ALLOC_PROFILE",
+  "class" : "E",
+  "name" : "getAllocStats",
+  "generate" : "jswrap_espruino_getAllocStats",
+  "return" : ["JsVar","An object containing allocation statistics"]
+}
+**Note:** This is only available in builds made with `ALLOC_PROFILE=1`
+
+Return information on which functions have allocated variables:
+
+```
+{
+  used : 123,   // variables in use
+  peak : 456,   // the most variables that have been in use at once
+  sites : [ {
+    name : "foo", // the name of the function
+    live : 12,    // how many variables it allocated that are still in use
+    peak : 34,    // the most of its variables that have been in use at once
+    allocs : 56,  // how many variables it has allocated in total
+    perSec : 7.8  // allocations per second since E.getAllocStats was last called
+  }, ... ]
+}
+```
+
+Allocations made outside any function are listed as `global`, and once 14
+different functions have been seen, others are listed as `other`.
+ */
+#ifdef ALLOC_PROFILE
+JsVar *jswrap_espruino_getAllocStats() {
+  static JsSysTime lastTime = 0;
+  JsSysTime time = jshGetSystemTime();
+  JsVarFloat seconds = lastTime ? jshGetMillisecondsFromTime(time-lastTime)/1000 : 0;
+  lastTime = time;
+  // take a copy first, so the vars we allocate don't get counted
+  JsvAllocSite sites[JSV_ALLOC_PROFILE_SITES];
+  memcpy(sites, jsvAllocSites, sizeof(sites));
+  unsigned int used = jsvAllocUsed, peak = jsvAllocPeak;
+  int i;
+  for (i=0;i<JSV_ALLOC_PROFILE_SITES;i++)
+    jsvAllocSites[i].lastAllocs = jsvAllocSites[i].allocs;
+
+  JsVar *obj = jsvNewObject();
+  if (!obj) return 0;
+  jsvObjectSetChildAndUnLock(obj, "used", jsvNewFromInteger((JsVarInt)used));
+  jsvObjectSetChildAndUnLock(obj, "peak", jsvNewFromInteger((JsVarInt)peak));
+  JsVar *arr = jsvNewEmptyArray();
+  for (i=0;i<JSV_ALLOC_PROFILE_SITES && arr;i++) {
+    JsvAllocSite *site = &sites[i];
+    if (!site->allocs && !site->live) continue;
+    JsVar *s = jsvNewObject();
+    if (!s) break;
+    jsvObjectSetChildAndUnLock(s, "name", jsvNewFromString(site->name));
+    jsvObjectSetChildAndUnLock(s, "live", jsvNewFromInteger((JsVarInt)site->live));
+    jsvObjectSetChildAndUnLock(s, "peak", jsvNewFromInteger((JsVarInt)site->peak));
+    jsvObjectSetChildAndUnLock(s, "allocs", jsvNewFromInteger((JsVarInt)site->allocs));
+    jsvObjectSetChildAndUnLock(s, "perSec", jsvNewFromFloat(seconds>0 ? (site->allocs-site->lastAllocs)/seconds : 0));
+    jsvArrayPushAndUnLock(arr, s);
+  }
+  jsvObjectSetChildAndUnLock(obj, "sites", arr);
+  return obj;
+}
+#endif
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "startProfile",
+  "generate" : "jswrap_espruino_startProfile",
+  "params" : [
+    ["freq","float","How many times a second to take a sample (default 1000)"]
+  ],
+  "return" : ["bool","True if the profiler was started"]
+}
+Start a sampling profiler. `freq` times a second the line of JavaScript that
+is being executed is recorded, and `E.stopProfile()` returns where most of
+the time was spent:
+
+```
+E.startProfile();
+doSomethingSlow();
+print(E.stopProfile());
+```
+
+Samples are taken from the utility timer, so this adds very little overhead.
+Time spent in a built-in function is counted against the line that called it.
+ */
+#ifndef SAVE_ON_FLASH
+bool jswrap_espruino_startProfile(JsVarFloat freq) {
+  if (!(freq>0)) freq = 1000;
+  return jspProfileStart(freq);
+}
+
+/// Is 'source' the code (or pre-tokenised code) of the function 'func'?
+static bool jswrap_espruino_isFunctionSource(JsVar *func, JsVarRef source) {
+  JsVar *code = jsvFindChildFromString(func, JSPARSE_FUNCTION_CODE_NAME, false);
+  bool match = code && jsvGetFirstChild(code)==source;
+  jsvUnLock(code);
+  if (!match) {
+    JsVar *tokens = jsvFindChildFromString(func, JSPARSE_FUNCTION_TOKENS_NAME, false);
+    match = tokens && jsvGetFirstChild(tokens)==source;
+    jsvUnLock(tokens);
+  }
+  return match;
+}
+
+/// Find the name of the function whose code is 'source', looking up to 'depth' objects down from 'parent'
+static JsVar *jswrap_espruino_findFunctionName(JsVar *parent, JsVarRef source, int depth) {
+  JsvIsInternalChecker checker = jsvGetInternalFunctionCheckerFor(parent);
+  JsVar *found = 0;
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, parent);
+  while (!found && jsvObjectIteratorHasValue(&it)) {
+    JsVar *key = jsvObjectIteratorGetKey(&it);
+    if (!checker || !checker(key)) {
+      JsVar *value = jsvSkipName(key);
+      if (jsvIsFunction(value) && !jsvIsNative(value) && jswrap_espruino_isFunctionSource(value, source)) {
+        found = jsvAsString(key, false);
+      } else if (depth>0 && (jsvIsObject(value) || jsvIsFunction(value))) {
+        JsVar *childName = jswrap_espruino_findFunctionName(value, source, depth-1);
+        if (childName) found = jsvVarPrintf("%v.%v", key, childName);
+        jsvUnLock(childName);
+      }
+      jsvUnLock(value);
+    }
+    jsvUnLock(key);
+    jsvObjectIteratorNext(&it);
+  }
+  jsvObjectIteratorFree(&it);
+  return found;
+}
+
+/// The samples taken on one line of code (see E.stopProfile)
+typedef struct {
+  JsVar *name; ///< The function's name (an empty string if it wasn't found)
+  uint32_t line;
+  uint32_t count;
+} JswProfileLine;
+#endif
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "stopProfile",
+  "generate" : "jswrap_espruino_stopProfile",
+  "return" : ["JsVar","An object containing the samples that were taken"]
+}
+Stop the profiler started with `E.startProfile()`, and return where the
+samples were taken:
+
+```
+{
+  samples : 1234,  // the total number of samples
+  idle : 56,       // samples taken while no JavaScript was executing
+  dropped : 0,     // samples that there was no room to record
+  lines : [ {      // the lines samples were taken on, most first
+    name : "foo",  // the function the line is in ("" if it couldn't be found)
+    line : 12,     // the line number
+    count : 345    // how many samples were taken on that line
+  }, ... ]
+}
+```
+
+Functions are looked for in global variables, and in objects and prototypes
+up to two levels down from them. Samples are recorded for up to 64 different
+places in the code.
+ */
+#ifndef SAVE_ON_FLASH
+JsVar *jswrap_espruino_stopProfile() {
+  jspProfileStop();
+  uint32_t samples = jspProfileIdle + jspProfileDropped;
+  /* Merge the samples for each line of code. A function may have been
+   * executed both from its code and from its pre-tokenised code, so this
+   * is done by name rather than by source */
+  JswProfileLine lines[JSP_PROFILE_SITES];
+  int i, j, lineCount = 0;
+  for (i=0;i<JSP_PROFILE_SITES;i++) {
+    JspProfileSite *site = &jspProfileSites[i];
+    if (!site->count) continue;
+    samples += site->count;
+    // the var may have been freed since, so check it's still code before locking it
+    if (site->source > jsvGetMemoryTotal() || !jsvIsString(_jsvGetAddressOf(site->source)))
+      continue;
+    JsVar *source = jsvLock(site->source);
+    size_t line = 0, col = 0;
+    if (site->tokenPos <= jsvGetStringLength(source))
+      jsvGetLineAndCol(source, site->tokenPos, &line, &col);
+    jsvUnLock(source);
+    if (!line) continue;
+    if (site->lineNumberOffset)
+      line += (size_t)site->lineNumberOffset - 1;
+    JsVar *name = jswrap_espruino_findFunctionName(execInfo.root, site->source, 2);
+    if (!name) name = jsvNewFromEmptyString();
+    for (j=0;j<lineCount;j++)
+      if (lines[j].line==line && jsvCompareString(lines[j].name, name, 0, 0, false)==0) break;
+    if (j==lineCount) {
+      lines[j].name = jsvLockAgain(name);
+      lines[j].line = (uint32_t)line;
+      lines[j].count = 0;
+      lineCount++;
+    }
+    lines[j].count += site->count;
+    jsvUnLock(name);
+  }
+  // sort, most samples first
+  for (i=1;i<lineCount;i++) {
+    JswProfileLine l = lines[i];
+    for (j=i;j>0 && lines[j-1].count<l.count;j--)
+      lines[j] = lines[j-1];
+    lines[j] = l;
+  }
+
+  JsVar *obj = jsvNewObject();
+  JsVar *arr = jsvNewEmptyArray();
+  if (obj) {
+    jsvObjectSetChildAndUnLock(obj, "samples", jsvNewFromInteger((JsVarInt)samples));
+    jsvObjectSetChildAndUnLock(obj, "idle", jsvNewFromInteger((JsVarInt)jspProfileIdle));
+    jsvObjectSetChildAndUnLock(obj, "dropped", jsvNewFromInteger((JsVarInt)jspProfileDropped));
+    jsvObjectSetChild(obj, "lines", arr);
+  }
+  for (i=0;i<lineCount;i++) {
+    JsVar *l = arr ? jsvNewObject() : 0;
+    if (l) {
+      jsvObjectSetChild(l, "name", lines[i].name);
+      jsvObjectSetChildAndUnLock(l, "line", jsvNewFromInteger((JsVarInt)lines[i].line));
+      jsvObjectSetChildAndUnLock(l, "count", jsvNewFromInteger((JsVarInt)lines[i].count));
+      jsvArrayPushAndUnLock(arr, l);
+    }
+    jsvUnLock(lines[i].name);
+  }
+  jsvUnLock(arr);
+  return obj;
+}
+#endif
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "benchmark",
+  "generate" : "jswrap_espruino_benchmark",
+  "params" : [
+    ["fn","JsVar","The function to call"],
+    ["iterations","int","How many times to call it (default 100)"]
+  ],
+  "return" : ["JsVar","An object containing the timings, or undefined if `fn` threw an exception"]
+}
+Call `fn` `iterations` times and time each call:
+
+```
+E.benchmark(function() { "abc".split(""); }, 1000)
+={ iterations: 1000,
+   min: 49.8,     // microseconds per call
+   median: 51.2,
+   max: 183.4,
+   allocs: 5      // variables allocated per call
+ }
+```
+
+The time and allocations of calling an empty function are subtracted, so
+only the function's body is measured. On ESP8266 the CPU's cycle counter is
+used, so very short functions can be timed accurately. Elsewhere the system
+time is used.
+ */
+#ifndef SAVE_ON_FLASH
+/* A fine-grained timer for E.benchmark - the CPU's cycle counter where we can
+ * read it, otherwise the system time */
+#ifdef ESP8266
+static ALWAYS_INLINE uint32_t jswrap_espruino_benchmarkTime() {
+  uint32_t ccount;
+  __asm__ __volatile__("rsr %0,ccount":"=a" (ccount));
+  return ccount;
+}
+static JsVarFloat jswrap_espruino_benchmarkMicroseconds(uint32_t t) {
+  return (JsVarFloat)t / system_get_cpu_freq();
+}
+#else
+static ALWAYS_INLINE uint32_t jswrap_espruino_benchmarkTime() {
+  return (uint32_t)jshGetSystemTime();
+}
+static JsVarFloat jswrap_espruino_benchmarkMicroseconds(uint32_t t) {
+  return jshGetMillisecondsFromTime((JsSysTime)t)*1000;
+}
+#endif
+
+/** Call fn 'iterations' times, writing how long each call took into 'times'
+ * (sorted) and the number of vars allocated into 'allocs'. Returns false on an exception */
+static bool jswrap_espruino_benchmarkRun(JsVar *fn, int iterations, JsVar *timesVar, unsigned int *allocs) {
+  int i, j;
+  unsigned int allocStart = jsvAllocCount;
+  for (i=0;i<iterations;i++) {
+    uint32_t t = jswrap_espruino_benchmarkTime();
+    jsvUnLock(jspExecuteFunction(fn, 0, 0, 0));
+    t = jswrap_espruino_benchmarkTime() - t;
+    // get the pointer each time, as the function may have moved memory about
+    ((uint32_t*)jsvGetFlatStringPointer(timesVar))[i] = t;
+    if (jspHasError()) return false;
+  }
+  *allocs = jsvAllocCount - allocStart;
+  // sort, for the median
+  uint32_t *times = (uint32_t*)jsvGetFlatStringPointer(timesVar);
+  for (i=1;i<iterations;i++) {
+    uint32_t t = times[i];
+    for (j=i;j>0 && times[j-1]>t;j--)
+      times[j] = times[j-1];
+    times[j] = t;
+  }
+  return true;
+}
+
+JsVar *jswrap_espruino_benchmark(JsVar *fn, int iterations) {
+  if (!jsvIsFunction(fn)) {
+    jsExceptionHere(JSET_ERROR, "Expecting a function, got %t", fn);
+    return 0;
+  }
+  if (iterations<=0) iterations = 100;
+  JsVar *timesVar = jsvNewFlatStringOfLength((unsigned int)(sizeof(uint32_t)*(size_t)iterations));
+  JsVar *emptyFn = jspEvaluate("(function(){})", false);
+  if (!timesVar || !emptyFn) {
+    jsvUnLock2(timesVar, emptyFn);
+    jsExceptionHere(JSET_ERROR, "Not enough memory for %d iterations", iterations);
+    return 0;
+  }
+  // work out the overhead of calling a function first
+  unsigned int emptyAllocs = 0, allocs = 0;
+  jswrap_espruino_benchmarkRun(emptyFn, iterations, timesVar, &emptyAllocs);
+  uint32_t *times = (uint32_t*)jsvGetFlatStringPointer(timesVar);
+  uint32_t overhead = times[iterations/2];
+  bool ok = jswrap_espruino_benchmarkRun(fn, iterations, timesVar, &allocs);
+  jsvUnLock(emptyFn);
+  if (!ok) {
+    jsvUnLock(timesVar);
+    return 0;
+  }
+  times = (uint32_t*)jsvGetFlatStringPointer(timesVar);
+  uint32_t min = times[0], median = times[iterations/2], max = times[iterations-1];
+  jsvUnLock(timesVar);
+
+  JsVar *obj = jsvNewObject();
+  if (!obj) return 0;
+  jsvObjectSetChildAndUnLock(obj, "iterations", jsvNewFromInteger(iterations));
+  jsvObjectSetChildAndUnLock(obj, "min", jsvNewFromFloat(jswrap_espruino_benchmarkMicroseconds(min>overhead ? min-overhead : 0)));
+  jsvObjectSetChildAndUnLock(obj, "median", jsvNewFromFloat(jswrap_espruino_benchmarkMicroseconds(median>overhead ? median-overhead : 0)));
+  jsvObjectSetChildAndUnLock(obj, "max", jsvNewFromFloat(jswrap_espruino_benchmarkMicroseconds(max>overhead ? max-overhead : 0)));
+  jsvObjectSetChildAndUnLock(obj, "allocs", jsvNewFromFloat(allocs>emptyAllocs ? (JsVarFloat)(allocs-emptyAllocs)/(JsVarFloat)iterations : 0));
+  return obj;
+}
+#endif
+
 /*JSON{
   "type" : "staticmethod",
   "class" : "E",
@@ -660,6 +2331,17 @@ Note that this is an ArrayBuffer, not a Uint8Array. To get one of those, do: `ne
  */
 JsVar *jswrap_espruino_toArrayBuffer(JsVar *str) {
   if (!jsvIsString(str)) return 0;
+  if (jsvIsStringView(str)) {
+    // writes to the ArrayBuffer would change the string this is a view of too
+    str = jsvAsFlatString(str);
+    if (!str) return 0; // out of memory
+    JsVar *arr = jsvNewArrayBufferFromString(str, 0);
+    jsvUnLock(str);
+    return arr;
+  }
+  // substrings that are views of this would change too, so they get their own copies
+  if (jsvIsFlatString(str) && !jsvFlatStringMakeWritable(str))
+    return 0; // out of memory
   return jsvNewArrayBufferFromString(str, 0);
 }
 
@@ -720,6 +2402,26 @@ JsVar *jswrap_espruino_toUint8Array(JsVar *args) {
   JsVar *arr = jsvNewTypedArray(ARRAYBUFFERVIEW_UINT8, jsvIterateCallbackCount(args));
   if (!arr) return 0;
 
+  size_t len;
+  unsigned char *ptr = (unsigned char *)jsvGetDataPointer(arr, &len);
+  if (ptr) {
+    // Strings and byte arrays can be copied a block at a time
+    unsigned int idx = 0;
+    JsvIterator it;
+    jsvIteratorNew(&it, args);
+    while (jsvIteratorHasElement(&it)) {
+      JsVar *v = jsvIteratorGetValue(&it);
+      if (jsvIsString(v) || (jsvIsArrayBuffer(v) && JSV_ARRAYBUFFER_GET_SIZE(v->varData.arraybuffer.type)==1))
+        idx += jsvIterateBufferToBytes(v, &ptr[idx], (unsigned int)len-idx);
+      else
+        idx += jsvIterateCallbackToBytes(v, &ptr[idx], (unsigned int)len-idx);
+      jsvUnLock(v);
+      jsvIteratorNext(&it);
+    }
+    jsvIteratorFree(&it);
+    return arr;
+  }
+
   JsvArrayBufferIterator it;
   jsvArrayBufferIteratorNew(&it, arr, 0);
   jsvIterateCallback(args, (void (*)(int,  void *))_jswrap_espruino_toUint8Array_char, &it);
@@ -728,6 +2430,85 @@ JsVar *jswrap_espruino_toUint8Array(JsVar *args) {
   return arr;
 }
 
+/*JSON{
+  "type" : "staticmethod",
+  "ifdef" : "USE_HEATSHRINK",
+  "class" : "E",
+  "name" : "compress",
+  "generate" : "jswrap_espruino_compress",
+  "params" : [
+    ["data","JsVar","The data to compress (a String, Array or ArrayBuffer)"]
+  ],
+  "return" : ["JsVar","A String containing the compressed data"],
+  "return_object" : "String"
+}
+Compress the given data using the same heatshrink compression that is used when
+saving code to Flash. The result can be passed to `E.decompress`, or used directly
+with `Graphics.drawImage` (with `compressed:true`) or `Graphics.setFontCustom`.
+*/
+#ifdef USE_HEATSHRINK
+void _jswrap_espruino_compress_cb(unsigned char ch, uint32_t *cbdata) {
+  jsvStringIteratorAppend((JsvStringIterator*)cbdata, (char)ch);
+}
+
+JsVar *jswrap_espruino_compress(JsVar *data) {
+  JSV_GET_AS_CHAR_ARRAY(dataPtr, dataLen, data);
+  if (!dataPtr) return 0;
+  JsVar *str = jsvNewFromEmptyString();
+  if (!str) return 0;
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, str, 0);
+  heatshrink_encode((unsigned char*)dataPtr, dataLen, _jswrap_espruino_compress_cb, (uint32_t*)&it);
+  jsvStringIteratorFree(&it);
+  return str;
+}
+#endif
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifdef" : "USE_HEATSHRINK",
+  "class" : "E",
+  "name" : "decompress",
+  "generate" : "jswrap_espruino_decompress",
+  "params" : [
+    ["data","JsVar","Data created with `E.compress`"]
+  ],
+  "return" : ["JsVar","A String containing the decompressed data"],
+  "return_object" : "String"
+}
+Decompress data that was created with `E.compress`
+*/
+#ifdef USE_HEATSHRINK
+int _jswrap_espruino_decompress_cb(uint32_t *cbdata) {
+  JsvIterator *it = (JsvIterator*)cbdata;
+  if (!jsvIteratorHasElement(it)) return -1;
+  int ch = (int)(jsvIteratorGetIntegerValue(it) & 255);
+  jsvIteratorNext(it);
+  return ch;
+}
+
+JsVar *jswrap_espruino_decompress(JsVar *data) {
+  if (!jsvIsIterable(data)) {
+    jsExceptionHere(JSET_TYPEERROR, "Expecting a String, Array or ArrayBuffer, got %t", data);
+    return 0;
+  }
+  JsVar *str = jsvNewFromEmptyString();
+  if (!str) return 0;
+  JsvIterator in;
+  jsvIteratorNew(&in, data);
+  heatshrink_stream hs;
+  heatshrink_stream_init(&hs, _jswrap_espruino_decompress_cb, (uint32_t*)&in);
+  JsvStringIterator out;
+  jsvStringIteratorNew(&out, str, 0);
+  int ch;
+  while ((ch = heatshrink_stream_read(&hs)) >= 0)
+    jsvStringIteratorAppend(&out, (char)ch);
+  jsvStringIteratorFree(&out);
+  jsvIteratorFree(&in);
+  return str;
+}
+#endif
+
 /*JSON{
   "type" : "staticmethod",
   "class" : "E",
@@ -745,8 +2526,14 @@ a specific memory address. It can be used in order to use sections of
 Flash memory directly in Espruino (for example to execute code straight
 from flash memory with `eval(E.memoryArea( ... ))`)
 
+A memory area can also be passed to a typed array constructor, for instance
+`new Uint16Array(E.memoryArea(addr, len))`, to view data stored in flash
+(like lookup tables) without using any RAM. Views like this are read-only -
+writes to them are ignored.
+
 **Note:** This is only tested on STM32-based platforms (Espruino Original
-and Espruino Pico) at the moment.
+and Espruino Pico) at the moment. On Linux it can only reference the emulated
+flash memory (see `require("Flash").getFree()`).
 */
 JsVar *jswrap_espruino_memoryArea(int addr, int len) {
   if (len<0) return 0;
@@ -754,9 +2541,18 @@ JsVar *jswrap_espruino_memoryArea(int addr, int len) {
     jsExceptionHere(JSET_ERROR, "Memory area too long! Max is 65535 bytes\n");
     return 0;
   }
+  char *ptr = (char*)(size_t)addr;
+#ifdef LINUX
+  // emulated flash is mapped somewhere else entirely - don't let it be used to read random memory
+  ptr = jshFlashGetMemMapAddress((uint32_t)addr, (uint32_t)len);
+  if (!ptr) {
+    jsExceptionHere(JSET_ERROR, "Memory area isn't in flash\n");
+    return 0;
+  }
+#endif
   JsVar *v = jsvNewWithFlags(JSV_NATIVE_STRING);
   if (!v) return 0;
-  v->varData.nativeStr.ptr = (char*)addr;
+  v->varData.nativeStr.ptr = ptr;
   v->varData.nativeStr.len = (uint16_t)len;
   return v;
 }
@@ -789,6 +2585,17 @@ To remove boot code that has been saved previously, use `E.setBootCode("")`
 void jswrap_espruino_setBootCode(JsVar *code, bool alwaysExec) {
   JsvSaveFlashFlags flags = 0;
   if (alwaysExec) flags |= SFF_BOOT_CODE_ALWAYS;
+#ifndef SAVE_ON_FLASH
+  if (jspPretokenise && jsvIsString(code)) {
+    // strip whitespace and comments - functions defined by it then run from smaller code
+    JsVar *tokens = jslTokenise(code, 0);
+    if (tokens) {
+      jsfSaveToFlash(flags, tokens);
+      jsvUnLock(tokens);
+      return;
+    }
+  }
+#endif
   jsfSaveToFlash(flags, code);
 }
 
@@ -949,6 +2756,37 @@ JsVar *jswrap_espruino_getSizeOf(JsVar *v, int depth) {
   return jsvNewFromInteger((JsVarInt)jsvCountJsVarsUsed(v));
 }
 
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "getAddressOf",
+  "generate" : "jswrap_espruino_getAddressOf",
+  "params" : [
+    ["v","JsVar","A variable to get the address of"],
+    ["flatAddress","bool","If `true` and `v` is stored in one flat area of memory (eg. a typed array or flat string), return the address of its data"]
+  ],
+  "return" : ["int","The address of the variable, or 0 if `flatAddress` was set but the data isn't stored flat"]
+}
+ADVANCED: Return the address in memory of the given variable. This is mainly
+useful for passing the data in a typed array to a function created with
+`E.nativeCall`, for instance:
+
+```
+var a = new Uint8Array(100); // larger typed arrays are allocated flat
+var addr = E.getAddressOf(a, true);
+```
+
+The address is only valid until the variable is freed, or moved by `E.defrag`.
+ */
+JsVarInt jswrap_espruino_getAddressOf(JsVar *v, bool flatAddress) {
+  if (flatAddress) {
+    size_t len = 0;
+    return (JsVarInt)(size_t)jsvGetDataPointer(v, &len);
+  }
+  return (JsVarInt)(size_t)v;
+}
+
 /*JSON{
   "type" : "staticmethod",
     "ifndef" : "SAVE_ON_FLASH",
@@ -1095,7 +2933,7 @@ JsVarInt jswrap_espruino_HSBtoRGB(JsVarFloat hue, JsVarFloat sat, JsVarFloat bri
   else {
     hue *= 6;
     hi = (int)hue;
-    hfrac = hue - hi;
+    hfrac = hue - (JsVarFloat)hi;
     hi = hi % 6;
 
     bri *= 255;
@@ -20,7 +20,19 @@ JsVarFloat jswrap_espruino_clip(JsVarFloat x, JsVarFloat min, JsVarFloat max);
 JsVarFloat jswrap_espruino_sum(JsVar *arr);
 JsVarFloat jswrap_espruino_variance(JsVar *arr, JsVarFloat mean);
 JsVarFloat jswrap_espruino_convolve(JsVar *a, JsVar *b, int offset);
+JsVar *jswrap_espruino_ringbuffer(JsVar *type, int length);
+int jswrap_ringbuffer_length(JsVar *parent);
+int jswrap_ringbuffer_push(JsVar *parent, JsVar *value);
+JsVar *jswrap_ringbuffer_shift(JsVar *parent);
+JsVar *jswrap_ringbuffer_get(JsVar *parent, int index);
+void jswrap_ringbuffer_clear(JsVar *parent);
+JsVar *jswrap_ringbuffer_toArray(JsVar *parent);
 void jswrap_espruino_FFT(JsVar *arrReal, JsVar *arrImag, bool inverse);
+JsVarFloat jswrap_espruino_dot(JsVar *arr1, JsVar *arr2);
+void jswrap_espruino_scale(JsVar *arr, JsVarFloat scale, JsVarFloat offset);
+void jswrap_espruino_add(JsVar *arr, JsVar *src);
+JsVar *jswrap_espruino_minmax(JsVar *arr);
+JsVar *jswrap_espruino_histogram(JsVar *arr, JsVar *bins, JsVarFloat min, JsVarFloat max);
 
 JsVarFloat jswrap_espruino_interpolate(JsVar *array, JsVarFloat findex);
 JsVarFloat jswrap_espruino_interpolate2d(JsVar *array, int width, JsVarFloat x, JsVarFloat y);
@@ -28,9 +40,26 @@ JsVarFloat jswrap_espruino_interpolate2d(JsVar *array, int width, JsVarFloat x,
 void jswrap_espruino_enableWatchdog(JsVarFloat time, JsVar *isAuto);
 void jswrap_espruino_kickWatchdog();
 JsVar *jswrap_espruino_getErrorFlags();
+void jswrap_espruino_setConsoleBlocking(bool blocking);
+void jswrap_espruino_setGCMode(JsVar *options);
+void jswrap_espruino_setLowMemoryThreshold(JsVarInt vars);
+void jswrap_espruino_setTimerSlack(JsVarFloat slack);
+JsVarInt jswrap_espruino_getTicks();
+JsVar *jswrap_espruino_getTaskStats(bool clear);
+JsVar *jswrap_espruino_getTrace(bool clear);
+void jswrap_espruino_setTaskBudget(JsVarFloat budget);
+void jswrap_espruino_setFlags(JsVar *flags);
+int jswrap_espruino_defrag();
+JsVar *jswrap_espruino_getMemoryMap();
+JsVar *jswrap_espruino_getAllocStats();
+bool jswrap_espruino_startProfile(JsVarFloat freq);
+JsVar *jswrap_espruino_stopProfile();
+JsVar *jswrap_espruino_benchmark(JsVar *fn, int iterations);
 JsVar *jswrap_espruino_toArrayBuffer(JsVar *str);
 JsVar *jswrap_espruino_toUint8Array(JsVar *args);
 JsVar *jswrap_espruino_toString(JsVar *args);
+JsVar *jswrap_espruino_compress(JsVar *data);
+JsVar *jswrap_espruino_decompress(JsVar *data);
 JsVar *jswrap_espruino_memoryArea(int addr, int len);
 void jswrap_espruino_setBootCode(JsVar *code, bool alwaysExec);
 int jswrap_espruino_setClock(JsVar *options);
@@ -38,6 +67,7 @@ int jswrap_espruino_setClock(JsVar *options);
 int jswrap_espruino_reverseByte(int v);
 void jswrap_espruino_dumpTimers();
 JsVar *jswrap_espruino_getSizeOf(JsVar *v, int depth);
+JsVarInt jswrap_espruino_getAddressOf(JsVar *v, bool flatAddress);
 void jswrap_espruino_mapInPlace(JsVar *from, JsVar *to, JsVar *map, JsVarInt bits);
 JsVar *jswrap_e_dumpStr();
 JsVarInt jswrap_espruino_HSBtoRGB(JsVarFloat hue, JsVarFloat sat, JsVarFloat bri);
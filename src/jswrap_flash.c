@@ -17,15 +17,22 @@
 #include "jshardware.h"
 #include "jsvariterator.h"
 #include "jsinteractive.h"
+#include "jsparse.h"
 
 #ifdef USE_HEATSHRINK
   #include "compress_heatshrink.h"
   #define COMPRESS heatshrink_encode
   #define DECOMPRESS heatshrink_decode
+  #define COMPRESS_DICT(data, len, cb, cbdata) heatshrink_encode_dict(data, len, (const unsigned char*)jsfStateDictionary, sizeof(jsfStateDictionary)-1, cb, cbdata)
+  #define DECOMPRESS_DICT(cb, cbdata, data) heatshrink_decode_dict(cb, cbdata, (const unsigned char*)jsfStateDictionary, sizeof(jsfStateDictionary)-1, data)
+  #define COMPRESS_HAS_DICT true
 #else
   #include "compress_rle.h"
   #define COMPRESS rle_encode
   #define DECOMPRESS rle_decode
+  #define COMPRESS_DICT rle_encode
+  #define DECOMPRESS_DICT rle_decode
+  #define COMPRESS_HAS_DICT false
 #endif
 
 #ifdef LINUX
@@ -33,6 +40,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifndef __MINGW32__
+#include <sys/mman.h>
+#endif
 #endif
 
 /*JSON{
@@ -183,25 +196,114 @@ JsVar *jswrap_flash_read(int length, int addr) {
 }
 
 
+/// CRC32 lookup table, 4 bits at a time
+static const uint32_t jsfCRCTable[16] = {
+  0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+  0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+uint32_t jsfCRC32Byte(uint32_t crc, unsigned char ch) {
+  crc ^= ch;
+  crc = (crc >> 4) ^ jsfCRCTable[crc & 15];
+  crc = (crc >> 4) ^ jsfCRCTable[crc & 15];
+  return crc;
+}
+
 #ifndef LINUX
-// cbdata = uint32_t[end_address, address, data]
-void jsfSaveToFlash_writecb(unsigned char ch, uint32_t *cbdata) {
-  // Only write if we can fit in flash
-  if (cbdata[1]<cbdata[0]) {
-    // write only a word at a time
-    cbdata[2]=(uint32_t)(ch<<24) | (cbdata[2]>>8);
-    if ((cbdata[1]&3)==3)
-      jshFlashWrite(&cbdata[2], cbdata[1]&(uint32_t)~3, 4);
+/// Number of bytes we buffer up before writing to flash (must be a multiple of 4)
+#define JSF_WRITE_BUFFER_SIZE 128
+
+/// State used by jsfSaveToFlash_writecb
+typedef struct {
+  uint32_t endAddr;    ///< end of available flash
+  uint32_t addr;       ///< address the next byte will be written to
+  uint32_t erasedAddr; ///< flash has been erased up to (but not including) this address
+  uint32_t crc;        ///< CRC32 of data written since jsfFlashWriterResetCRC
+  uint32_t bufferAddr; ///< address that the start of the buffer will be written to
+  uint32_t buffer[JSF_WRITE_BUFFER_SIZE/4];
+} JsfFlashWriter;
+
+void jsfSaveToFlash_writecb(unsigned char ch, uint32_t *cbdata);
+
+/// Get the CRC32 of the given area of flash
+static uint32_t jsfGetFlashCRC32(uint32_t addr, uint32_t len) {
+  uint32_t crc = 0xFFFFFFFF;
+  unsigned char buf[32];
+  while (len) {
+    uint32_t l = len > sizeof(buf) ? (uint32_t)sizeof(buf) : len;
+    jshFlashRead(buf, addr, l);
+    uint32_t i;
+    for (i=0;i<l;i++) crc = jsfCRC32Byte(crc, buf[i]);
+    addr += l;
+    len -= l;
   }
-  // inc address ptr
-  cbdata[1]++;
-  if ((cbdata[1]&1023)==0) jsiConsolePrint(".");
+  return ~crc;
 }
-// cbdata = uint32_t[address, errorcount]
-void jsfSaveToFlash_checkcb(unsigned char ch, uint32_t *cbdata) {
-  unsigned char data;
-  jshFlashRead(&data,cbdata[0]++, 1);
-  if (data!=ch) cbdata[1]++; // error count
+
+/// Erase any pages of flash between writer->erasedAddr and the given address
+static void jsfFlashWriterEraseTo(JsfFlashWriter *writer, uint32_t addr) {
+  uint32_t pageStart, pageLength;
+  while (writer->erasedAddr < addr && writer->erasedAddr < writer->endAddr) {
+    if (!jshFlashGetPage(writer->erasedAddr, &pageStart, &pageLength)) {
+      writer->erasedAddr = addr; // not in a page - nothing we can do
+      return;
+    }
+    jshFlashErasePage(pageStart);
+    writer->erasedAddr = pageStart+pageLength;
+  }
+}
+
+/** Start writing at the given address. Only the first page is erased now - others
+ * are erased just before they are written to, so we only erase what we need */
+static void jsfFlashWriterInit(JsfFlashWriter *writer, uint32_t startAddr, uint32_t endAddr) {
+  writer->endAddr = endAddr;
+  writer->addr = startAddr;
+  writer->bufferAddr = startAddr;
+  writer->erasedAddr = startAddr;
+  writer->crc = 0xFFFFFFFF;
+  jsfFlashWriterEraseTo(writer, startAddr+1);
+}
+
+/// Write out anything in the buffer (padded to a word), so that writer->addr is word aligned
+static void jsfFlashWriterFlush(JsfFlashWriter *writer) {
+  while (writer->addr & 3) jsfSaveToFlash_writecb(0, (uint32_t*)writer);
+  uint32_t len = writer->addr - writer->bufferAddr;
+  if (len && writer->bufferAddr < writer->endAddr) {
+    if (writer->bufferAddr+len > writer->endAddr)
+      len = writer->endAddr - writer->bufferAddr;
+    jsfFlashWriterEraseTo(writer, writer->bufferAddr+len);
+    jshFlashWrite(writer->buffer, writer->bufferAddr, len);
+  }
+  // make sure anything skipped over is erased, so it can be written to later
+  jsfFlashWriterEraseTo(writer, writer->addr);
+  writer->bufferAddr = writer->addr;
+}
+
+/// Skip over some bytes (a multiple of 4) so they can be written with jshFlashWrite later
+static void jsfFlashWriterSkip(JsfFlashWriter *writer, uint32_t len) {
+  jsfFlashWriterFlush(writer);
+  writer->addr += len;
+  writer->bufferAddr = writer->addr;
+  jsfFlashWriterEraseTo(writer, writer->addr);
+}
+
+/// Reset the CRC of written data, returning the CRC of what was written before
+static uint32_t jsfFlashWriterResetCRC(JsfFlashWriter *writer) {
+  uint32_t crc = ~writer->crc;
+  writer->crc = 0xFFFFFFFF;
+  return crc;
+}
+
+// cbdata = JsfFlashWriter
+void jsfSaveToFlash_writecb(unsigned char ch, uint32_t *cbdata) {
+  JsfFlashWriter *writer = (JsfFlashWriter*)cbdata;
+  writer->crc = jsfCRC32Byte(writer->crc, ch);
+  ((unsigned char*)writer->buffer)[writer->addr - writer->bufferAddr] = ch;
+  // inc address ptr
+  writer->addr++;
+  if (writer->addr - writer->bufferAddr >= JSF_WRITE_BUFFER_SIZE)
+    jsfFlashWriterFlush(writer);
+  if ((writer->addr&1023)==0) jsiConsolePrint(".");
 }
 // cbdata = uint32_t[end_address, address]
 int jsfLoadFromFlash_readcb(uint32_t *cbdata) {
@@ -211,14 +313,228 @@ int jsfLoadFromFlash_readcb(uint32_t *cbdata) {
   return data;
 }
 #else
+/** On Linux, saved state is built up in memory and then written with one call,
+ * and it's loaded straight out of the file mapped into memory */
+typedef struct {
+  unsigned char *data;
+  size_t len;  ///< amount of data (or amount written so far)
+  size_t size; ///< amount allocated when writing
+  size_t pos;  ///< where the next byte is read from
+  bool failed; ///< ran out of memory when writing
+} JsfStateBuffer;
+
 int jsfLoadFromFlash_readcb(uint32_t *cbdata) {
-  unsigned char ch;
-  if (fread(&ch,1,1,(FILE*)cbdata)==1) return ch;
-  return -1;
+  JsfStateBuffer *b = (JsfStateBuffer*)cbdata;
+  if (b->pos >= b->len) return -1;
+  return b->data[b->pos++];
 }
 
 void jsfSaveToFlash_writecb(unsigned char ch, uint32_t *cbdata) {
-  fwrite(&ch,1,1,(FILE*)cbdata);
+  JsfStateBuffer *b = (JsfStateBuffer*)cbdata;
+  if (b->len >= b->size) {
+    size_t size = b->size ? b->size*2 : 65536;
+    unsigned char *data = b->failed ? 0 : (unsigned char*)realloc(b->data, size);
+    if (!data) {
+      b->failed = true;
+      return;
+    }
+    b->data = data;
+    b->size = size;
+  }
+  b->data[b->len++] = ch;
+}
+
+/// Write everything in the buffer to the given file, then free it. Returns false on failure
+static bool jsfStateBufferWriteFile(JsfStateBuffer *b, const char *filename) {
+  bool ok = !b->failed;
+  if (ok) {
+    FILE *f = fopen(filename, "wb");
+    ok = f && fwrite(b->data, 1, b->len, f)==b->len;
+    if (f && fclose(f)) ok = false;
+  }
+  free(b->data);
+  memset(b, 0, sizeof(JsfStateBuffer));
+  return ok;
+}
+
+/// Map the given file into the buffer so it can be read. Returns false on failure
+static bool jsfStateBufferMapFile(JsfStateBuffer *b, const char *filename) {
+  memset(b, 0, sizeof(JsfStateBuffer));
+  int fd = open(filename, O_RDONLY);
+  if (fd<0) return false;
+  struct stat st;
+  if (fstat(fd, &st)==0 && st.st_size>0) {
+#ifndef __MINGW32__
+    void *p = mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED) {
+      b->data = (unsigned char*)p;
+      b->len = (size_t)st.st_size;
+    }
+#else
+    b->data = (unsigned char*)malloc((size_t)st.st_size);
+    if (b->data && read(fd, b->data, (size_t)st.st_size)==st.st_size)
+      b->len = (size_t)st.st_size;
+#endif
+  }
+  close(fd);
+  return b->len>0;
+}
+
+static void jsfStateBufferUnmap(JsfStateBuffer *b) {
+#ifndef __MINGW32__
+  if (b->data) munmap(b->data, b->len);
+#else
+  free(b->data);
+#endif
+  memset(b, 0, sizeof(JsfStateBuffer));
+}
+#endif
+
+#ifndef SAVE_ON_FLASH
+/// Read a block of data as for jsfLoadFromFlash_readcb. Returns false if there wasn't enough
+static bool jsfLoadFromFlash_read(uint32_t *cbdata, unsigned char *dest, size_t len) {
+#ifdef LINUX
+  JsfStateBuffer *b = (JsfStateBuffer*)cbdata;
+  if (b->pos+len > b->len) return false;
+  memcpy(dest, &b->data[b->pos], len);
+  b->pos += len;
+  return true;
+#else
+  if (cbdata[1]+len > cbdata[0]) return false;
+  jshFlashRead(dest, cbdata[1], (uint32_t)len);
+  cbdata[1] += (uint32_t)len;
+  return true;
+#endif
+}
+
+/// Number of variables in each page of saved state when using E.setFlags({fastLoad:true})
+#define JSF_STATE_PAGE_VARS 32
+#define JSF_STATE_PAGE_SIZE (JSF_STATE_PAGE_VARS*sizeof(JsVar))
+/// Page header - the page only contains unused variables (which are all zero)
+#define JSF_PAGE_EMPTY 0
+/// Page header - the page's data is stored uncompressed
+#define JSF_PAGE_RAW 0xFFFF
+
+typedef struct {
+  unsigned char data[JSF_STATE_PAGE_SIZE];
+  size_t len;
+} JsfPageBuffer;
+
+typedef struct {
+  uint32_t *cbdata; ///< what we pass to jsfLoadFromFlash_readcb
+  size_t remaining; ///< bytes left in this page
+} JsfPageReader;
+
+typedef struct {
+  JsSysTime stateTime; ///< time taken to load saved state
+  JsSysTime bootCodeTime; ///< time taken to execute boot code
+  unsigned int emptyPages, rawPages, compressedPages;
+} JsfBootTimings;
+
+INSTANCE_LOCAL bool jsfSaveFastLoad = false;
+static INSTANCE_LOCAL JsfBootTimings jsfBootTimings;
+
+/* Each page is compressed on its own, so heatshrink's window starts off empty
+ * for every page. Instead we start it off containing names the interpreter
+ * itself uses for variables and the words most common in function code, so
+ * even the first time they're in a page they can be back-references. It only
+ * helps the first window's worth of data, so isn't used for unpaged state. */
+FLASH_STR(jsfStateDictionary,
+    JSPARSE_FUNCTION_CODE_NAME JSPARSE_FUNCTION_SCOPE_NAME JSI_TIMER_DATA_NAME
+    JSI_TIMERS_NAME JSI_WATCHES_NAME "callbackrecuredgeinterval"
+    JSPARSE_INHERITS_VAR JSPARSE_CONSTRUCTOR_VAR JSPARSE_PROTOTYPE_VAR
+    "functionreturn undefinedthis.var else if (for (new truefalse"
+    "console.log(JSON.stringify(");
+
+static void jsfPageBuffer_writecb(unsigned char ch, uint32_t *cbdata) {
+  JsfPageBuffer *buf = (JsfPageBuffer*)cbdata;
+  if (buf->len < sizeof(buf->data)) buf->data[buf->len] = ch;
+  buf->len++;
+}
+
+static int jsfPageReader_readcb(uint32_t *cbdata) {
+  JsfPageReader *reader = (JsfPageReader*)cbdata;
+  if (!reader->remaining) return -1;
+  reader->remaining--;
+  return jsfLoadFromFlash_readcb(reader->cbdata);
+}
+
+/** Write all variables as a series of pages that can each be restored on their
+ * own. Each page starts with a 16 bit header: JSF_PAGE_EMPTY, JSF_PAGE_RAW followed
+ * by the page's data, or the length of the compressed data that follows. Unused
+ * memory is skipped entirely, and pages that don't compress well are just copied
+ * when loading, which is much faster than decompressing everything. Pages are
+ * compressed with jsfStateDictionary if COMPRESS_HAS_DICT. */
+static void jsfWritePagedState(void (*callback)(unsigned char ch, uint32_t *cbdata), uint32_t *cbdata) {
+  unsigned char *data = (unsigned char*)_jsvGetAddressOf(1);
+  size_t dataSize = jsvGetMemoryTotal() * sizeof(JsVar);
+  JsfPageBuffer buf;
+  size_t pageStart, i;
+  for (pageStart=0; pageStart<dataSize; pageStart+=JSF_STATE_PAGE_SIZE) {
+    unsigned char *page = &data[pageStart];
+    size_t pageSize = dataSize-pageStart;
+    if (pageSize > JSF_STATE_PAGE_SIZE) pageSize = JSF_STATE_PAGE_SIZE;
+    bool empty = true;
+    for (i=0;empty && i<pageSize;i++)
+      empty = !page[i];
+    uint16_t header = JSF_PAGE_EMPTY;
+    if (!empty) {
+      buf.len = 0;
+      COMPRESS_DICT(page, pageSize, jsfPageBuffer_writecb, (uint32_t*)&buf);
+      // Only worth decompressing if it saves a lot of space
+      header = (buf.len <= pageSize/2) ? (uint16_t)buf.len : JSF_PAGE_RAW;
+    }
+    callback((unsigned char)header, cbdata);
+    callback((unsigned char)(header>>8), cbdata);
+    if (header == JSF_PAGE_RAW) {
+      for (i=0;i<pageSize;i++) callback(page[i], cbdata);
+    } else {
+      for (i=0;i<header;i++) callback(buf.data[i], cbdata);
+    }
+  }
+}
+
+/// Load variables written with jsfWritePagedState (dict=whether it was with jsfStateDictionary). Returns false if the data is invalid
+static bool jsfReadPagedState(uint32_t *cbdata, bool dict) {
+  unsigned char *data = (unsigned char*)_jsvGetAddressOf(1);
+  size_t dataSize = jsvGetMemoryTotal() * sizeof(JsVar);
+  size_t pageStart;
+  for (pageStart=0; pageStart<dataSize; pageStart+=JSF_STATE_PAGE_SIZE) {
+    unsigned char *page = &data[pageStart];
+    size_t pageSize = dataSize-pageStart;
+    if (pageSize > JSF_STATE_PAGE_SIZE) pageSize = JSF_STATE_PAGE_SIZE;
+    int lo = jsfLoadFromFlash_readcb(cbdata);
+    int hi = jsfLoadFromFlash_readcb(cbdata);
+    if (lo<0 || hi<0) return false;
+    uint16_t header = (uint16_t)(lo | (hi<<8));
+    if (header == JSF_PAGE_EMPTY) {
+      memset(page, 0, pageSize);
+      jsfBootTimings.emptyPages++;
+    } else if (header == JSF_PAGE_RAW) {
+      if (!jsfLoadFromFlash_read(cbdata, page, pageSize)) return false;
+      jsfBootTimings.rawPages++;
+    } else {
+      if (header > pageSize) return false;
+      JsfPageReader reader;
+      reader.cbdata = cbdata;
+      reader.remaining = header;
+      if (dict) DECOMPRESS_DICT(jsfPageReader_readcb, (uint32_t*)&reader, page);
+      else DECOMPRESS(jsfPageReader_readcb, (uint32_t*)&reader, page);
+      jsfBootTimings.compressedPages++;
+    }
+  }
+  return true;
+}
+
+JsVar *jsfGetBootTimings() {
+  JsVar *obj = jsvNewObject();
+  if (!obj) return 0;
+  jsvObjectSetChildAndUnLock(obj, "loadState", jsvNewFromFloat(jshGetMillisecondsFromTime(jsfBootTimings.stateTime)));
+  jsvObjectSetChildAndUnLock(obj, "bootCode", jsvNewFromFloat(jshGetMillisecondsFromTime(jsfBootTimings.bootCodeTime)));
+  jsvObjectSetChildAndUnLock(obj, "emptyPages", jsvNewFromInteger((JsVarInt)jsfBootTimings.emptyPages));
+  jsvObjectSetChildAndUnLock(obj, "rawPages", jsvNewFromInteger((JsVarInt)jsfBootTimings.rawPages));
+  jsvObjectSetChildAndUnLock(obj, "compressedPages", jsvNewFromInteger((JsVarInt)jsfBootTimings.compressedPages));
+  return obj;
 }
 #endif
 
@@ -231,7 +547,9 @@ void jsfSaveToFlash_writecb(unsigned char ch, uint32_t *cbdata) {
 
 /* On Linux systems:
  *
- *   State data is saved to espruino.state
+ *   State data is saved to espruino.state, after a word containing the
+ *     number of variables (with STATE_FILE_PAGED set if written by jsfWritePagedState,
+ *     and STATE_FILE_DICT if its pages used jsfStateDictionary)
  *   Boot code (text JS) is saved to espruino.boot
  *
  * On embedded systems:
@@ -239,33 +557,199 @@ void jsfSaveToFlash_writecb(unsigned char ch, uint32_t *cbdata) {
  *   Code is saved starting from FLASH_SAVED_CODE_START.
  *   A magic number written to FLASH_MAGIC_LOCATION (the end of saved code)
  *     determines whether flash data has been successfully written or not
+ *   The two words before it (FLASH_CRC_LOCATION) are the CRC32 of the boot
+ *     code and the CRC32 of the saved state, worked out as they were written
  *   The first word at FLASH_SAVED_CODE_START is the amount of Boot code
  *      that is saved
  *   The second word at FLASH_SAVED_CODE_START+4 is the end address of
  *      decompressed JS code
  *   Boot code starts at FLASH_SAVED_CODE_START+8
  *   Saved state starts at FLASH_SAVED_CODE_START+8+boot_code_length
+ *   With JSVAR_MALLOC, the word before the CRCs (FLASH_VARS_LOCATION) is
+ *      the number of variables there were when the state was saved
+ *
+ *   If BOOT_CODE_PAGED_STATE is set in the first word, the saved state
+ *      is written as pages by jsfWritePagedState
+ *   If BOOT_CODE_DICT_STATE is also set, those pages were compressed
+ *      with jsfStateDictionary
+ *   If BOOT_CODE_HAS_FUNCTION_CODE is set in the first word, the boot code
+ *      is followed (at the next word boundary) by a word containing the
+ *      address of the saved state. Between the two is the code of all
+ *      functions, which the saved state references directly with native
+ *      strings (see E.setFlags({saveCodeInFlash:true}))
  *
  */
 
 #define BOOT_CODE_LENGTH_MASK 0x00FFFFFF
+#define BOOT_CODE_DICT_STATE  0x10000000
+#define BOOT_CODE_PAGED_STATE 0x20000000
+#define BOOT_CODE_HAS_FUNCTION_CODE 0x40000000
 #define BOOT_CODE_RUN_ALWAYS  0x80000000
 
+#define STATE_FILE_PAGED 0x80000000
+#define STATE_FILE_DICT  0x40000000
+
 #define FLASH_BOOT_CODE_INFO_LOCATION FLASH_SAVED_CODE_START
 #define FLASH_STATE_END_LOCATION (FLASH_SAVED_CODE_START+4)
 #define FLASH_DATA_LOCATION (FLASH_SAVED_CODE_START+8)
+#define FLASH_CRC_LOCATION (FLASH_MAGIC_LOCATION-8)
+#ifdef JSVAR_MALLOC
+/* The variable pool is sized at boot, so the number of variables it had
+ * when saved is stored before the CRCs - state can only be loaded into a
+ * pool at least that big */
+#define FLASH_VARS_LOCATION (FLASH_CRC_LOCATION-4)
+#define FLASH_DATA_END_LOCATION FLASH_VARS_LOCATION
+#else
+#define FLASH_DATA_END_LOCATION FLASH_CRC_LOCATION
+#endif
+
+#ifndef SAVE_ON_FLASH
+INSTANCE_LOCAL bool jsfSaveCodeInFlash = false;
+#endif
+
+#ifndef LINUX
+/// Get the address in flash that saved state starts at
+static uint32_t jsfGetStateStartAddress(uint32_t bootCodeInfo) {
+  uint32_t addr = FLASH_DATA_LOCATION + (bootCodeInfo & BOOT_CODE_LENGTH_MASK);
+  if (bootCodeInfo & BOOT_CODE_HAS_FUNCTION_CODE) {
+    addr = (addr+3) & (uint32_t)~3;
+    jshFlashRead(&addr, addr, 4);
+  }
+  return addr;
+}
+
+/// Does flash contain the magic number written after a successful save?
+static bool jsfFlashHasMagic() {
+  uint32_t magic;
+  jshFlashRead(&magic, FLASH_MAGIC_LOCATION, sizeof(magic));
+  return magic == (uint32_t)FLASH_MAGIC;
+}
+
+/// Check the boot code in flash against the CRC32 saved with it
+static bool jsfFlashBootCodeValid() {
+  uint32_t bootCodeInfo, crc;
+  jshFlashRead(&bootCodeInfo, FLASH_BOOT_CODE_INFO_LOCATION, 4);
+  jshFlashRead(&crc, FLASH_CRC_LOCATION, 4);
+  uint32_t len = bootCodeInfo & BOOT_CODE_LENGTH_MASK;
+  return FLASH_DATA_LOCATION+len <= FLASH_DATA_END_LOCATION &&
+         jsfGetFlashCRC32(FLASH_DATA_LOCATION, len) == crc;
+}
+
+/// Check the saved state in flash against the CRC32 saved with it
+static bool jsfFlashStateValid() {
+  uint32_t bootCodeInfo, end, crc;
+  jshFlashRead(&bootCodeInfo, FLASH_BOOT_CODE_INFO_LOCATION, 4);
+  jshFlashRead(&end, FLASH_STATE_END_LOCATION, 4);
+  jshFlashRead(&crc, FLASH_CRC_LOCATION+4, 4);
+  uint32_t start = jsfGetStateStartAddress(bootCodeInfo);
+  return start >= FLASH_DATA_LOCATION && start <= end && end <= FLASH_DATA_END_LOCATION &&
+         jsfGetFlashCRC32(start, end-start) == crc;
+}
+#endif
+
+#ifdef FLASH_CODE_XIP
+char *jsfGetMemoryMappedAddress(uint32_t addr) {
+#ifdef ESP8266
+  // flash is memory mapped at 0x40200000, but only the first megabyte
+  return (addr < 0x100000) ? (char*)(size_t)(0x40200000+addr) : 0;
+#else
+  return (char*)(size_t)addr;
+#endif
+}
+
+/// Call the callback for the code of every function in memory
+static bool jsfForEachFunctionCode(bool (*callback)(JsVar *codeName, void *data), void *data) {
+  bool ok = true;
+  JsVarRef i;
+  for (i=1;ok && i<=jsvGetMemoryTotal();i++) {
+    JsVar *v = _jsvGetAddressOf(i);
+    if (jsvIsFunction(v) && !jsvIsNative(v)) {
+      JsVar *function = jsvLock(i);
+      JsVar *codeName = jsvFindChildFromString(function, JSPARSE_FUNCTION_CODE_NAME, false);
+      if (codeName) ok = callback(codeName, data);
+      jsvUnLock2(codeName, function);
+    } else if (jsvIsFlatString(v)) {
+      i = (JsVarRef)(i+jsvGetFlatStringBlocks(v));
+    }
+  }
+  return ok;
+}
+
+/// If function code references flash between the two addresses in data, copy it into RAM
+static bool jsfCopyFunctionCodeToRAM(JsVar *codeName, void *data) {
+  JsVar *code = jsvSkipName(codeName);
+  char *start = jsfGetMemoryMappedAddress(((uint32_t*)data)[0]);
+  char *end = jsfGetMemoryMappedAddress(((uint32_t*)data)[1]);
+  bool ok = true;
+  if (jsvIsNativeString(code) && start && end &&
+      code->varData.nativeStr.ptr >= start && code->varData.nativeStr.ptr < end) {
+    JsVar *copy = jsvNewFromStringVar(code, 0, JSVAPPENDSTRINGVAR_MAXLENGTH);
+    if (copy) jsvSetValueOfName(codeName, copy);
+    else ok = false;
+    jsvUnLock(copy);
+  }
+  jsvUnLock(code);
+  return ok;
+}
+
+bool jsfCopyFunctionCodeOutOfFlash(uint32_t start, uint32_t end) {
+  uint32_t range[2] = { start, end };
+  return jsfForEachFunctionCode(jsfCopyFunctionCodeToRAM, range);
+}
+
+/** Write function code into flash (data is a JsfFlashWriter), and replace
+ * the code in RAM with a native string that references the flash */
+static bool jsfWriteFunctionCodeToFlash(JsVar *codeName, void *data) {
+  JsfFlashWriter *writer = (JsfFlashWriter*)data;
+  JsVar *code = jsvSkipName(codeName);
+  size_t len = jsvIsString(code) ? jsvGetStringLength(code) : 0;
+  uint32_t addr = writer->addr;
+  char *ptr = jsfGetMemoryMappedAddress(addr);
+  // Only worth it if the code doesn't fit in a single JsVar anyway
+  if (ptr && !jsvIsNativeString(code) && len > JSVAR_DATA_STRING_LEN && len <= 0xFFFF &&
+      addr+len+4 < writer->endAddr) {
+    JsvStringIterator it;
+    jsvStringIteratorNew(&it, code, 0);
+    while (jsvStringIteratorHasChar(&it)) {
+      jsfSaveToFlash_writecb((unsigned char)jsvStringIteratorGetChar(&it), (uint32_t*)writer);
+      jsvStringIteratorNext(&it);
+    }
+    jsvStringIteratorFree(&it);
+    // make sure everything is actually written
+    jsfFlashWriterFlush(writer);
+    // check it was written ok before we start using it
+    bool match = true;
+    jsvStringIteratorNew(&it, code, 0);
+    while (match && jsvStringIteratorHasChar(&it)) {
+      unsigned char ch;
+      jshFlashRead(&ch, addr++, 1);
+      match = ch == (unsigned char)jsvStringIteratorGetChar(&it);
+      jsvStringIteratorNext(&it);
+    }
+    jsvStringIteratorFree(&it);
+    JsVar *native = match ? jsvNewWithFlags(JSV_NATIVE_STRING) : 0;
+    if (native) {
+      native->varData.nativeStr.ptr = ptr;
+      native->varData.nativeStr.len = (uint16_t)len;
+      jsvSetValueOfName(codeName, native);
+      jsvUnLock(native);
+    }
+  }
+  jsvUnLock(code);
+  return true;
+}
+#endif
 
 void jsfSaveToFlash(JsvSaveFlashFlags flags, JsVar *bootCode) {
 #ifdef LINUX
   if (bootCode) {
     FILE *f = fopen("espruino.boot","wb");
     if (f) {
-      JsvStringIterator it;
-      jsvStringIteratorNew(&it, bootCode, 0);
-      while (jsvStringIteratorHasChar(&it)) {
-        char ch = jsvStringIteratorGetChar(&it);
-        fwrite(&ch, 1, 1, f);
-        jsvStringIteratorNext(&it);
+      char buf[256+1]; // +1 for the trailing 0 from jsvGetStringChars
+      size_t pos = 0, len;
+      while ((len = jsvGetStringChars(bootCode, pos, buf, 256))) {
+        fwrite(buf, 1, len, f);
+        pos += len;
       }
       fclose(f);
     } else {
@@ -274,39 +758,50 @@ void jsfSaveToFlash(JsvSaveFlashFlags flags, JsVar *bootCode) {
   }
 
   if (flags & SFF_SAVE_STATE) {
-    FILE *f = fopen("espruino.state","wb");
-    if (f) {
-      unsigned int jsVarCount = jsvGetMemoryTotal();
-      jsiConsolePrintf("\nSaving %d bytes...", jsVarCount*sizeof(JsVar));
-      fwrite(&jsVarCount, sizeof(unsigned int), 1, f);
-      /*JsVarRef i;
-      for (i=1;i<=jsVarCount;i++) {
-        fwrite(_jsvGetAddressOf(i),1,sizeof(JsVar),f);
-      }*/
-      COMPRESS((unsigned char*)_jsvGetAddressOf(1), jsVarCount*sizeof(JsVar), jsfSaveToFlash_writecb, (uint32_t*)f);
-      fclose(f);
-      jsiConsolePrint("\nDone!\n");
+    JsfStateBuffer b;
+    memset(&b, 0, sizeof(b));
+    unsigned int jsVarCount = jsvGetMemoryTotal();
+    jsiConsolePrintf("\nSaving %d bytes...", jsVarCount*sizeof(JsVar));
+    unsigned int header = jsVarCount;
+#ifndef SAVE_ON_FLASH
+    if (jsfSaveFastLoad) header |= STATE_FILE_PAGED | (COMPRESS_HAS_DICT ? STATE_FILE_DICT : 0);
+#endif
+    size_t i;
+    for (i=0;i<sizeof(header);i++)
+      jsfSaveToFlash_writecb(((unsigned char*)&header)[i], (uint32_t*)&b);
+#ifndef SAVE_ON_FLASH
+    if (jsfSaveFastLoad)
+      jsfWritePagedState(jsfSaveToFlash_writecb, (uint32_t*)&b);
+    else
+#endif
+      COMPRESS((unsigned char*)_jsvGetAddressOf(1), jsVarCount*sizeof(JsVar), jsfSaveToFlash_writecb, (uint32_t*)&b);
+    if (!jsfStateBufferWriteFile(&b, "espruino.state")) {
+      jsiConsolePrint("\nFile write of espruino.state failed... \n");
+      return;
+    }
+    jsiConsolePrint("\nDone!\n");
 
-  #ifdef DEBUG
-      jsiConsolePrint("Checking...\n");
-      FILE *f = fopen("espruino.state","rb");
-      fread(&jsVarCount, sizeof(unsigned int), 1, f);
-      if (jsVarCount != jsvGetMemoryTotal())
+#ifdef DEBUG
+    jsiConsolePrint("Checking...\n");
+    if (jsfStateBufferMapFile(&b, "espruino.state")) {
+      memcpy(&header, b.data, sizeof(header));
+      b.pos = sizeof(header);
+      if (header != jsVarCount)
         jsiConsolePrint("Error: memory sizes different\n");
-      unsigned char *decomp = (unsigned char*)malloc(jsVarCount*sizeof(JsVar));
-      DECOMPRESS(jsfLoadFromFlash_readcb, (uint32_t *)f, decomp);
-      fclose(f);
-      unsigned char *comp = (unsigned char *)_jsvGetAddressOf(1);
-      size_t j;
-      for (j=0;j<jsVarCount*sizeof(JsVar);j++)
-        if (decomp[j]!=comp[j])
-          jsiConsolePrintf("Error at %d: original %d, decompressed %d\n", j, comp[j], decomp[j]);
-      free(decomp);
-      jsiConsolePrint("Done!\n");
-  #endif
-    } else {
-      jsiConsolePrint("\nFile open of espruino.state failed... \n");
+      else {
+        unsigned char *decomp = (unsigned char*)malloc(jsVarCount*sizeof(JsVar));
+        DECOMPRESS(jsfLoadFromFlash_readcb, (uint32_t *)&b, decomp);
+        unsigned char *comp = (unsigned char *)_jsvGetAddressOf(1);
+        size_t j;
+        for (j=0;j<jsVarCount*sizeof(JsVar);j++)
+          if (decomp[j]!=comp[j])
+            jsiConsolePrintf("Error at %d: original %d, decompressed %d\n", j, comp[j], decomp[j]);
+        free(decomp);
+      }
+      jsfStateBufferUnmap(&b);
     }
+    jsiConsolePrint("Done!\n");
+#endif
   }
 #else // !LINUX
   unsigned int dataSize = jsvGetMemoryTotal() * sizeof(JsVar);
@@ -316,7 +811,9 @@ void jsfSaveToFlash(JsvSaveFlashFlags flags, JsVar *bootCode) {
   bool success = false;
   uint32_t writtenBytes;
   uint32_t endOfData;
-  uint32_t cbData[3];
+  uint32_t bootCodeCRC = 0, stateCRC = 0;
+  uint32_t stateStart = 0;
+  JsfFlashWriter writer;
 
   /* If we didn't specify boot code this time, but boot code was set previously,
    * load it into RAM so we can keep it. */
@@ -345,38 +842,46 @@ void jsfSaveToFlash(JsvSaveFlashFlags flags, JsVar *bootCode) {
 
   while (tryAgain) {
     tryAgain = false;
+#ifdef FLASH_CODE_XIP
+    /* Any function code that was saved into flash last time is about to be
+     * erased, so copy it back into RAM. Boot code we're keeping is written
+     * back to the same place, so code in that can stay where it is. */
+    uint32_t codeStart = jsvIsString(bootCode) ? FLASH_SAVED_CODE_START : FLASH_DATA_LOCATION+bootCodeLen;
+    // When saving state, variables have already been 'soft killed'
+    if (flags & SFF_SAVE_STATE) jsvSoftInit();
+    bool copied = jsfCopyFunctionCodeOutOfFlash(codeStart, FLASH_MAGIC_LOCATION);
+    if (flags & SFF_SAVE_STATE) jsvSoftKill();
+    if (!copied) {
+      jsiConsolePrint("\nERROR: Not enough memory to copy function code out of flash\n");
+      return;
+    }
+#endif
     jsiConsolePrint("Erasing Flash...");
-    uint32_t addr = FLASH_SAVED_CODE_START;
-    if (jshFlashGetPage((uint32_t)addr, &pageStart, &pageLength)) {
+    /* Erase the page with the magic number first, so if we fail part way through
+     * we don't think the flash has valid code in it. Other pages are erased as
+     * they are written to, so we don't waste time erasing pages we don't use. */
+    if (jshFlashGetPage(FLASH_MAGIC_LOCATION, &pageStart, &pageLength))
       jshFlashErasePage(pageStart);
-      while (pageStart+pageLength < FLASH_MAGIC_LOCATION) { // until end address
-        jsiConsolePrint(".");
-        addr = pageStart+pageLength; // next page
-        if (!jshFlashGetPage((uint32_t)addr, &pageStart, &pageLength)) break;
-        jshFlashErasePage(pageStart);
-      }
-    }
+    jsfFlashWriterInit(&writer, FLASH_SAVED_CODE_START, FLASH_DATA_END_LOCATION);
+    jsfFlashWriterSkip(&writer, FLASH_DATA_LOCATION-FLASH_SAVED_CODE_START);
     // Now start writing
-    cbData[0] = FLASH_MAGIC_LOCATION; // end of available flash
-    cbData[1] = FLASH_DATA_LOCATION;
-    cbData[2] = 0; // word data (can only save a word ata a time)
     jsiConsolePrint("\nWriting...");
     // boot code....
     if (jsvIsString(bootCode)) {
       bootCodeLen = (uint32_t)jsvGetStringLength(bootCode);
       if (bootCodeLen) {
         // Only write code if we actually have any
-        originalBootCodeInfo = bootCodeLen;
+        originalBootCodeInfo = bootCodeLen+1; // including the terminating 0
         if (flags & SFF_BOOT_CODE_ALWAYS)
           originalBootCodeInfo |= BOOT_CODE_RUN_ALWAYS;
         JsvStringIterator it;
         jsvStringIteratorNew(&it, bootCode, 0);
         while (jsvStringIteratorHasChar(&it)) {
-          jsfSaveToFlash_writecb(jsvStringIteratorGetChar(&it), cbData);
+          jsfSaveToFlash_writecb((unsigned char)jsvStringIteratorGetChar(&it), (uint32_t*)&writer);
           jsvStringIteratorNext(&it);
         }
         // terminate with a 0!
-        jsfSaveToFlash_writecb(0, cbData);
+        jsfSaveToFlash_writecb(0, (uint32_t*)&writer);
         bootCodeLen++;
       }
 
@@ -385,23 +890,51 @@ void jsfSaveToFlash(JsvSaveFlashFlags flags, JsVar *bootCode) {
       assert(originalBootCode && bootCodeLen);
       size_t i;
       for (i=0;i<bootCodeLen;i++)
-        jsfSaveToFlash_writecb(originalBootCode[i], cbData);
+        jsfSaveToFlash_writecb((unsigned char)originalBootCode[i], (uint32_t*)&writer);
+    }
+    bootCodeCRC = jsfFlashWriterResetCRC(&writer);
+    originalBootCodeInfo &= (uint32_t)~BOOT_CODE_HAS_FUNCTION_CODE;
+#ifdef FLASH_CODE_XIP
+    if ((flags & SFF_SAVE_STATE) && jsfSaveCodeInFlash) {
+      // leave a word (word aligned) for the address the state starts at
+      jsfFlashWriterFlush(&writer);
+      uint32_t stateStartLocation = writer.addr;
+      jsfFlashWriterSkip(&writer, 4);
+      jsvSoftInit();
+      jsfForEachFunctionCode(jsfWriteFunctionCodeToFlash, &writer);
+      jsvSoftKill();
+      jsfFlashWriterFlush(&writer);
+      if (writer.addr < writer.endAddr)
+        jshFlashWrite(&writer.addr, stateStartLocation, 4);
+      originalBootCodeInfo |= BOOT_CODE_HAS_FUNCTION_CODE;
     }
+#endif
+    originalBootCodeInfo &= (uint32_t)~(BOOT_CODE_PAGED_STATE|BOOT_CODE_DICT_STATE);
+#ifndef SAVE_ON_FLASH
+    if ((flags & SFF_SAVE_STATE) && jsfSaveFastLoad)
+      originalBootCodeInfo |= BOOT_CODE_PAGED_STATE | (COMPRESS_HAS_DICT ? BOOT_CODE_DICT_STATE : 0);
+#endif
     // write size of boot code to flash
     jshFlashWrite(&originalBootCodeInfo, FLASH_BOOT_CODE_INFO_LOCATION, 4);
     // state....
+    jsfFlashWriterResetCRC(&writer);
+    stateStart = writer.addr;
     if (flags & SFF_SAVE_STATE) {
-      COMPRESS((unsigned char*)basePtr, dataSize, jsfSaveToFlash_writecb, cbData);
+#ifndef SAVE_ON_FLASH
+      if (originalBootCodeInfo & BOOT_CODE_PAGED_STATE)
+        jsfWritePagedState(jsfSaveToFlash_writecb, (uint32_t*)&writer);
+      else
+#endif
+      COMPRESS((unsigned char*)basePtr, dataSize, jsfSaveToFlash_writecb, (uint32_t*)&writer);
     }
-    endOfData = cbData[1];
+    endOfData = writer.addr;
+    stateCRC = jsfFlashWriterResetCRC(&writer);
     // make sure we write everything in buffer
-    jsfSaveToFlash_writecb(0,cbData);
-    jsfSaveToFlash_writecb(0,cbData);
-    jsfSaveToFlash_writecb(0,cbData);
+    jsfFlashWriterFlush(&writer);
     writtenBytes = endOfData - FLASH_SAVED_CODE_START;
 
-    if (cbData[1]>=cbData[0]) {
-      jsiConsolePrintf("\nERROR: Too big to save to flash (%d vs %d bytes)\n", writtenBytes, FLASH_MAGIC_LOCATION-FLASH_SAVED_CODE_START);
+    if (endOfData>=writer.endAddr) {
+      jsiConsolePrintf("\nERROR: Too big to save to flash (%d vs %d bytes)\n", writtenBytes, FLASH_DATA_END_LOCATION-FLASH_SAVED_CODE_START);
       jsvSoftInit();
       jspSoftInit();
       if (jsiFreeMoreMemory()) {
@@ -419,23 +952,32 @@ void jsfSaveToFlash(JsvSaveFlashFlags flags, JsVar *bootCode) {
   if (success) {
     jsiConsolePrintf("\nCompressed %d bytes to %d", dataSize, writtenBytes);
     jshFlashWrite(&endOfData, FLASH_STATE_END_LOCATION, 4); // write position of end of data, at start of address space
+    // CRCs of what we meant to write, so we can check flash against them when loading
+    uint32_t crcs[2] = { bootCodeCRC, stateCRC };
+    jshFlashWrite(crcs, FLASH_CRC_LOCATION, sizeof(crcs));
+#ifdef JSVAR_MALLOC
+    uint32_t varCount = jsvGetMemoryTotal();
+    jshFlashWrite(&varCount, FLASH_VARS_LOCATION, 4);
+#endif
 
     uint32_t magic = FLASH_MAGIC;
     jshFlashWrite(&magic, FLASH_MAGIC_LOCATION, 4);
 
 
     jsiConsolePrint("\nChecking...");
-    cbData[0] = FLASH_DATA_LOCATION;
-    if (bootCodeLen) {
-      cbData[0] += bootCodeLen;
+    // Check what we wrote against the CRCs of what we meant to write
+    uint32_t errors = 0;
+    if (!jsfFlashBootCodeValid()) {
+      jsiConsolePrint("\nBoot code is corrupt");
+      errors++;
+    }
+    if (jsfGetStateStartAddress(originalBootCodeInfo) != stateStart ||
+        !jsfFlashStateValid()) {
+      jsiConsolePrint("\nSaved state is corrupt");
+      errors++;
     }
-    cbData[1] = 0; // increment if fails
-    // TODO: check boot code written ok
-    if (flags & SFF_SAVE_STATE)
-      COMPRESS((unsigned char*)basePtr, dataSize, jsfSaveToFlash_checkcb, cbData);
-    uint32_t errors = cbData[1];
 
-    if (!jsfFlashContainsCode()) {
+    if (!jsfFlashHasMagic()) {
       jsiConsolePrint("\nFlash Magic Byte is wrong");
 
       errors++;
@@ -452,47 +994,78 @@ void jsfSaveToFlash(JsvSaveFlashFlags flags, JsVar *bootCode) {
 
 /// Load the RAM image from flash (this is the actual interpreter state)
 void jsfLoadStateFromFlash() {
+#ifndef SAVE_ON_FLASH
+  JsSysTime startTime = jshGetSystemTime();
+  memset(&jsfBootTimings, 0, sizeof(jsfBootTimings));
+#endif
 #ifdef LINUX
-  FILE *f = fopen("espruino.state","rb");
-  if (f) {
+  JsfStateBuffer b;
+  if (jsfStateBufferMapFile(&b, "espruino.state") && b.len>=sizeof(unsigned int)) {
     unsigned int jsVarCount;
-    fread(&jsVarCount, sizeof(unsigned int), 1, f);
+    memcpy(&jsVarCount, b.data, sizeof(jsVarCount));
+    b.pos = sizeof(jsVarCount);
+    bool paged = (jsVarCount & STATE_FILE_PAGED) != 0;
+#ifndef SAVE_ON_FLASH
+    bool dict = (jsVarCount & STATE_FILE_DICT) != 0;
+#endif
+    jsVarCount &= ~(STATE_FILE_PAGED|STATE_FILE_DICT);
 
     jsiConsolePrintf("\nDecompressing to %d bytes...", jsVarCount*sizeof(JsVar));
     jsvSetMemoryTotal(jsVarCount);
-    /*JsVarRef i;
-    for (i=1;i<=jsVarCount;i++) {
-      fread(_jsvGetAddressOf(i),1,sizeof(JsVar),f);
-    }*/
-    DECOMPRESS(jsfLoadFromFlash_readcb, (uint32_t*)f, (unsigned char*)_jsvGetAddressOf(1));
-    fclose(f);
+    if (!paged) {
+      DECOMPRESS(jsfLoadFromFlash_readcb, (uint32_t*)&b, (unsigned char*)_jsvGetAddressOf(1));
+#ifndef SAVE_ON_FLASH
+    } else if (!jsfReadPagedState((uint32_t*)&b, dict)) {
+      jsiConsolePrint("\nInvalid saved state!\n");
+#endif
+    }
   } else {
     jsiConsolePrint("\nFile open of espruino.state failed... \n");
   }
+  jsfStateBufferUnmap(&b);
 #else // !LINUX
-  if (!jsfFlashContainsCode()) {
+  if (!jsfFlashHasMagic()) {
     jsiConsolePrintf("No code in flash!\n");
     return;
   }
+  if (!jsfFlashStateValid()) {
+    jsiConsolePrintf("Saved state in flash is corrupt!\n");
+    return;
+  }
+#ifdef JSVAR_MALLOC
+  uint32_t varCount;
+  jshFlashRead(&varCount, FLASH_VARS_LOCATION, 4);
+  if (varCount > jsvGetMemoryTotal()) {
+    jsiConsolePrintf("Saved state needs %d variables, but only %d are available!\n", varCount, jsvGetMemoryTotal());
+    return;
+  }
+#endif
 
   //  unsigned int dataSize = jsvGetMemoryTotal() * sizeof(JsVar);
   uint32_t *basePtr = (uint32_t *)_jsvGetAddressOf(1);
 
   uint32_t cbData[2];
-  uint32_t bootCodeLen;
-  jshFlashRead(&bootCodeLen, FLASH_BOOT_CODE_INFO_LOCATION, 4); // length of boot code
-  bootCodeLen &= BOOT_CODE_LENGTH_MASK;
+  uint32_t bootCodeInfo;
+  jshFlashRead(&bootCodeInfo, FLASH_BOOT_CODE_INFO_LOCATION, 4); // length of boot code
   jshFlashRead(&cbData[0], FLASH_STATE_END_LOCATION, 4); // end address
-  cbData[1] = FLASH_DATA_LOCATION; // start address
-  if (bootCodeLen) cbData[1] += bootCodeLen;
+  cbData[1] = jsfGetStateStartAddress(bootCodeInfo); // start address
   uint32_t len = cbData[0]-FLASH_SAVED_CODE_START;
   if (len>1000000) {
     jsiConsolePrintf("Invalid saved code in flash!\n");
     return;
   }
   jsiConsolePrintf("Loading %d bytes from flash...\n", len);
+#ifndef SAVE_ON_FLASH
+  if (bootCodeInfo & BOOT_CODE_PAGED_STATE) {
+    if (!jsfReadPagedState(cbData, (bootCodeInfo & BOOT_CODE_DICT_STATE) != 0))
+      jsiConsolePrintf("Invalid saved state in flash!\n");
+  } else
+#endif
   DECOMPRESS(jsfLoadFromFlash_readcb, cbData, (unsigned char*)basePtr);
 #endif
+#ifndef SAVE_ON_FLASH
+  jsfBootTimings.stateTime = jshGetSystemTime() - startTime;
+#endif
 }
 
 /** Load bootup code from flash (this is textual JS code). return true if it exists and was executed.
@@ -513,7 +1086,7 @@ bool jsfLoadBootCodeFromFlash(bool isReset) {
   code[len] = 0;
   fclose(f);
 #else // !LINUX
-  if (!jsfFlashContainsCode()) return false;
+  if (!jsfFlashHasMagic()) return false;
 
   uint32_t bootCodeInfo;
   jshFlashRead(&bootCodeInfo, FLASH_BOOT_CODE_INFO_LOCATION, 4); // length of boot code
@@ -521,10 +1094,26 @@ bool jsfLoadBootCodeFromFlash(bool isReset) {
   if (!bootCodeLen) return false;
   // Don't execute code if we've reset and code shouldn't always be run
   if (isReset && !(bootCodeInfo & BOOT_CODE_RUN_ALWAYS)) return false;
+  if (!jsfFlashBootCodeValid()) {
+    jsiConsolePrintf("Boot code in flash is corrupt!\n");
+    return false;
+  }
 
   code = (char *)(FLASH_DATA_LOCATION);
 #endif
+#ifndef SAVE_ON_FLASH
+  JsSysTime startTime = jshGetSystemTime();
+#endif
+#ifdef LINUX
+  // code was malloced (and the pointer may not fit in a memory area on 64 bit), so copy it
+  jsvUnLock(jspEvaluate(code, false));
+  free(code);
+#else
   jsvUnLock(jspEvaluate(code, true /* We are expecting this ptr to hang around */));
+#endif
+#ifndef SAVE_ON_FLASH
+  jsfBootTimings.bootCodeTime = jshGetSystemTime() - startTime;
+#endif
   return true;
 }
 
@@ -534,8 +1123,6 @@ bool jsfFlashContainsCode() {
   if (f) fclose(f);
   return f!=0;
 #else // !LINUX
-  int magic;
-  jshFlashRead(&magic, FLASH_MAGIC_LOCATION, sizeof(magic));
-  return magic == (int)FLASH_MAGIC;
+  return jsfFlashHasMagic() && jsfFlashBootCodeValid() && jsfFlashStateValid();
 #endif
 }
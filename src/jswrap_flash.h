@@ -24,6 +24,26 @@ typedef enum {
   SFF_BOOT_CODE_ALWAYS = 2 // When saving boot code, ensure it should always be run - even after reset
 } JsvSaveFlashFlags;
 
+#if !defined(LINUX) && !defined(SAVE_ON_FLASH)
+#define FLASH_CODE_XIP // function code can be saved into flash and run from there
+#endif
+
+#ifdef FLASH_CODE_XIP
+/// Get a pointer that the given address in flash can be read from directly, or 0
+char *jsfGetMemoryMappedAddress(uint32_t addr);
+/// Copy any function code that is run from flash between start and end into RAM (eg. before erasing it). Returns false if out of memory
+bool jsfCopyFunctionCodeOutOfFlash(uint32_t start, uint32_t end);
+#endif
+
+#ifndef SAVE_ON_FLASH
+/// When saving, should function code be written into flash and executed from there?
+extern INSTANCE_LOCAL bool jsfSaveCodeInFlash;
+/// When saving, should state be written as pages that are faster to load?
+extern INSTANCE_LOCAL bool jsfSaveFastLoad;
+/// Return an object describing how long loading saved state and boot code took
+JsVar *jsfGetBootTimings();
+#endif
+
 /// Save contents of JsVars into Flash. If bootCode is specified, save bootup code too.
 void jsfSaveToFlash(JsvSaveFlashFlags flags, JsVar *bootCode);
 /// Load the RAM image from flash (this is the actual interpreter state)
@@ -32,5 +52,7 @@ void jsfLoadStateFromFlash();
  * isReset should be set if we're loading after a reset (eg, does the user expect this to be run or not)
  */
 bool jsfLoadBootCodeFromFlash(bool isReset);
-/// Returns true if flash contains something useful
+/// Returns true if flash contains saved code that matches the CRCs saved with it
 bool jsfFlashContainsCode();
+/// Add a byte to a CRC32 (start with 0xFFFFFFFF, and invert the result)
+uint32_t jsfCRC32Byte(uint32_t crc, unsigned char ch);
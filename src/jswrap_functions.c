@@ -28,7 +28,7 @@
 }
 A variable containing the arguments given to the function
  */
-extern JsExecInfo execInfo;
+extern INSTANCE_LOCAL JsExecInfo execInfo;
 JsVar *jswrap_arguments() {
   JsVar *scope = 0;
   if (execInfo.scopeCount>0)
@@ -199,23 +199,144 @@ bool jswrap_isNaN(JsVar *v) {
 }
 
 
-NO_INLINE static int jswrap_btoa_encode(int c) {
-  c = c & 0x3F;
-  if (c<26) return 'A'+c;
-  if (c<52) return 'a'+c-26;
-  if (c<62) return '0'+c-52;
-  if (c==62) return '+';
-  return '/'; // c==63
+static const char jswrap_base64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+#define BASE64_INVALID (-1)
+#define BASE64_PADDING (-2)
+/// Sextet values for the characters '+' to 'z'. -1 = not base64, -2 = padding ('=')
+static const signed char jswrap_base64_values[] = {
+  62,-1,-1,-1,63,52,53,54,55,56,
+  57,58,59,60,61,-1,-1,-1,-2,-1,
+  -1,-1, 0, 1, 2, 3, 4, 5, 6, 7,
+   8, 9,10,11,12,13,14,15,16,17,
+  18,19,20,21,22,23,24,25,-1,-1,
+  -1,-1,-1,-1,26,27,28,29,30,31,
+  32,33,34,35,36,37,38,39,40,41,
+  42,43,44,45,46,47,48,49,50,51
+};
+
+static ALWAYS_INLINE int jswrap_btoa_encode(uint32_t c) {
+  return jswrap_base64_chars[c & 0x3F];
+}
+
+static ALWAYS_INLINE int jswrap_atob_decode(char ch) {
+  int c = (unsigned char)ch;
+  if (c<'+' || c>'z') return BASE64_INVALID;
+  return jswrap_base64_values[c-'+'];
 }
 
-NO_INLINE static int jswrap_atob_decode(int c) {
-  c = c & 0xFF;
-  if (c>='A' && c<='Z') return c-'A';
-  if (c>='a' && c<='z') return 26+c-'a';
-  if (c>='0' && c<='9') return 52+c-'0';
-  if (c=='+') return 62;
-  if (c=='/') return 63;
-  return -1; // not found
+/// Encode len bytes of src into dst, which must have space for ((len+2)/3)*4 characters
+static void jswrap_btoa_encodeBlock(const unsigned char *src, size_t len, char *dst) {
+  while (len>=3) {
+    uint32_t triple = ((uint32_t)src[0]<<16) | ((uint32_t)src[1]<<8) | src[2];
+    dst[0] = (char)jswrap_btoa_encode(triple >> 18);
+    dst[1] = (char)jswrap_btoa_encode(triple >> 12);
+    dst[2] = (char)jswrap_btoa_encode(triple >> 6);
+    dst[3] = (char)jswrap_btoa_encode(triple);
+    src += 3;
+    dst += 4;
+    len -= 3;
+  }
+  if (len) {
+    uint32_t triple = ((uint32_t)src[0]<<16) | ((len>1) ? ((uint32_t)src[1]<<8) : 0);
+    dst[0] = (char)jswrap_btoa_encode(triple >> 18);
+    dst[1] = (char)jswrap_btoa_encode(triple >> 12);
+    dst[2] = (char)((len>1) ? jswrap_btoa_encode(triple >> 6) : '=');
+    dst[3] = '=';
+  }
+}
+
+/// State for decoding base64, which can be fed data a block at a time
+typedef struct {
+  uint32_t bits; ///< sextets of the group of 4 we're decoding
+  int count; ///< how many sextets are in 'bits'
+  unsigned char *dst; ///< If set, where to write decoded data
+  JsvStringIterator *it; ///< If set (and dst isn't), overwrite the characters of this string with decoded data
+  size_t dstLen; ///< Maximum number of bytes to decode
+  size_t written; ///< Number of bytes decoded so far. If neither dst or it are set, this just counts
+} JswBase64Decoder;
+
+static void jswrap_atob_output(JswBase64Decoder *d, uint32_t triple, int bytes) {
+  int i;
+  for (i=0;i<bytes && d->written<d->dstLen;i++) {
+    unsigned char ch = (unsigned char)(triple >> (16-8*i));
+    if (d->dst) d->dst[d->written] = ch;
+    else if (d->it) {
+      jsvStringIteratorSetChar(d->it, (char)ch);
+      jsvStringIteratorNext(d->it);
+    }
+    d->written++;
+  }
+}
+
+/// Output whatever is in a partially decoded group of 4
+static void jswrap_atob_flush(JswBase64Decoder *d) {
+  if (d->count>1)
+    jswrap_atob_output(d, d->bits << (6*(4-d->count)), d->count-1);
+  d->bits = 0;
+  d->count = 0;
+}
+
+static void jswrap_atob_decodeChar(JswBase64Decoder *d, char ch) {
+  int sextet = jswrap_atob_decode(ch);
+  if (sextet>=0) {
+    d->bits = (d->bits<<6) | (uint32_t)sextet;
+    if (++d->count == 4) {
+      jswrap_atob_output(d, d->bits, 3);
+      d->bits = 0;
+      d->count = 0;
+    }
+  } else if (sextet==BASE64_PADDING)
+    jswrap_atob_flush(d);
+  // anything else (eg. whitespace) is ignored
+}
+
+static void jswrap_atob_decodeBlock(JswBase64Decoder *d, const char *src, size_t len) {
+  while (len) {
+    // Decode whole groups of 4 characters at once where we can
+    while (!d->count && len>=4 && d->written+3<=d->dstLen) {
+      int a = jswrap_atob_decode(src[0]);
+      int b = jswrap_atob_decode(src[1]);
+      int c = jswrap_atob_decode(src[2]);
+      int e = jswrap_atob_decode(src[3]);
+      if ((a|b|c|e)<0) break; // padding or whitespace - handle one char at a time
+      uint32_t triple = ((uint32_t)a<<18) | ((uint32_t)b<<12) | ((uint32_t)c<<6) | (uint32_t)e;
+      if (d->dst) {
+        unsigned char *out = &d->dst[d->written];
+        out[0] = (unsigned char)(triple >> 16);
+        out[1] = (unsigned char)(triple >> 8);
+        out[2] = (unsigned char)triple;
+        d->written += 3;
+      } else
+        jswrap_atob_output(d, triple, 3);
+      src += 4;
+      len -= 4;
+    }
+    if (!len) return;
+    jswrap_atob_decodeChar(d, *src);
+    src++;
+    len--;
+  }
+}
+
+/// Decode all of the base64 string 'str' with the given decoder
+static void jswrap_atob_decodeString(JswBase64Decoder *d, JsVar *str) {
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, str, 0);
+  while (jsvStringIteratorHasChar(&it) && d->written<d->dstLen && !jspIsInterrupted()) {
+    if (jsvIsNativeString(it.var)) {
+      // Memory-mapped data may need special reads (eg. flash on ESP8266) so go a char at a time
+      jswrap_atob_decodeChar(d, jsvStringIteratorGetChar(&it));
+      jsvStringIteratorNext(&it);
+    } else {
+      // Decode everything in this block of the string at once
+      jswrap_atob_decodeBlock(d, &it.ptr[it.charIdx], it.charsInVar - it.charIdx);
+      it.charIdx = it.charsInVar-1;
+      jsvStringIteratorNext(&it);
+    }
+  }
+  jsvStringIteratorFree(&it);
+  jswrap_atob_flush(d);
 }
 
 /*JSON{
@@ -229,12 +350,30 @@ NO_INLINE static int jswrap_atob_decode(int c) {
   "return" : ["JsVar","A base64 encoded string"]
 }
 Encode the supplied string (or array) into a base64 string
+
+Large amounts of data can be encoded a piece at a time by passing in chunks
+that are a multiple of 3 bytes long (for instance views made with
+`new Uint8Array(data.buffer, offset, length)`)
+and concatenating the results.
  */
 JsVar *jswrap_btoa(JsVar *binaryData) {
   if (!jsvIsIterable(binaryData)) {
     jsExceptionHere(JSET_ERROR, "Expecting a string or array, got %t", binaryData);
     return 0;
   }
+  // If the data is all in one block of RAM, encode it straight into a flat string
+  size_t srcLen = 0;
+  unsigned char *src = (unsigned char*)jsvGetWritableDataPointer(binaryData, &srcLen);
+  if (src && jsvIsArrayBuffer(binaryData) && JSV_ARRAYBUFFER_GET_SIZE(binaryData->varData.arraybuffer.type)!=1)
+    src = 0; // each element isn't a byte
+  if (src && srcLen) {
+    JsVar *base64Data = jsvNewFlatStringOfLength((unsigned int)(((srcLen+2)/3)*4));
+    if (base64Data) {
+      jswrap_btoa_encodeBlock(src, srcLen, jsvGetFlatStringPointer(base64Data));
+      return base64Data;
+    }
+  }
+
   JsVar* base64Data = jsvNewFromEmptyString();
   if (!base64Data) return 0;
   JsvIterator itsrc;
@@ -260,7 +399,7 @@ JsVar *jswrap_btoa(JsVar *binaryData) {
     } else
       padding = 2;
 
-    int triple = (octet_a << 0x10) + (octet_b << 0x08) + octet_c;
+    uint32_t triple = (uint32_t)((octet_a << 0x10) + (octet_b << 0x08) + octet_c);
 
     jsvStringIteratorAppend(&itdst, (char)jswrap_btoa_encode(triple >> 18));
     jsvStringIteratorAppend(&itdst, (char)jswrap_btoa_encode(triple >> 12));
@@ -285,46 +424,98 @@ JsVar *jswrap_btoa(JsVar *binaryData) {
   "return" : ["JsVar","A string containing the decoded data"]
 }
 Decode the supplied base64 string into a normal string
+
+To decode straight into an ArrayBuffer without making a string, use
+`E.base64Decode`.
  */
 JsVar *jswrap_atob(JsVar *base64Data) {
   if (!jsvIsString(base64Data)) {
     jsExceptionHere(JSET_ERROR, "Expecting a string, got %t", base64Data);
     return 0;
   }
-  JsVar* binaryData = jsvNewFromEmptyString();
-  if (!binaryData) return 0;
-  JsvStringIterator itsrc;
-  JsvStringIterator itdst;
-  jsvStringIteratorNew(&itsrc, base64Data, 0);
-  jsvStringIteratorNew(&itdst, binaryData, 0);
-  // skip whitespace
-  while (jsvStringIteratorHasChar(&itsrc) &&
-      isWhitespace(jsvStringIteratorGetChar(&itsrc)))
-    jsvStringIteratorNext(&itsrc);
-
-  while (jsvStringIteratorHasChar(&itsrc) && !jspIsInterrupted()) {
-    uint32_t triple = 0;
-    int i, valid=0;
-    for (i=0;i<4;i++) {
-      if (jsvStringIteratorHasChar(&itsrc)) {
-        int sextet = jswrap_atob_decode(jsvStringIteratorGetChar(&itsrc));
-        jsvStringIteratorNext(&itsrc);
-        if (sextet>=0) {
-          triple |= (unsigned int)(sextet) << ((3-i)*6);
-          valid=i;
-        }
-      }
-    }
+  // First work out how much data there is, so we can allocate it in one go
+  JswBase64Decoder d;
+  memset(&d, 0, sizeof(d));
+  d.dstLen = (size_t)-1;
+  jswrap_atob_decodeString(&d, base64Data);
+  size_t len = d.written;
+  if (!len || jspIsInterrupted()) return jsvNewFromEmptyString();
 
-    if (valid>0) jsvStringIteratorAppend(&itdst, (char)(triple >> 16));
-    if (valid>1) jsvStringIteratorAppend(&itdst, (char)(triple >> 8));
-    if (valid>2) jsvStringIteratorAppend(&itdst, (char)(triple));
+  memset(&d, 0, sizeof(d));
+  d.dstLen = len;
+  JsVar *binaryData = jsvNewFlatStringOfLength((unsigned int)len);
+  if (binaryData) {
+    d.dst = (unsigned char*)jsvGetFlatStringPointer(binaryData);
+    jswrap_atob_decodeString(&d, base64Data);
+  } else {
+    // Not enough contiguous memory - write into a normal string instead
+    binaryData = jsvNewStringOfLength((unsigned int)len);
+    if (!binaryData) return 0;
+    JsvStringIterator itdst;
+    jsvStringIteratorNew(&itdst, binaryData, 0);
+    d.it = &itdst;
+    jswrap_atob_decodeString(&d, base64Data);
+    jsvStringIteratorFree(&itdst);
   }
+  return binaryData;
+}
 
-  jsvStringIteratorFree(&itsrc);
-  jsvStringIteratorFree(&itdst);
+/*JSON{
+  "type" : "staticmethod",
+  "class" : "E",
+  "name" : "base64Decode",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_espruino_base64Decode",
+  "params" : [
+    ["base64Data","JsVar","A string of base64 data to decode"],
+    ["buffer","JsVar","An ArrayBuffer or typed array to decode the data into"],
+    ["offset","int","[optional] The byte offset in `buffer` to start writing at"]
+  ],
+  "return" : ["int","The number of bytes written"]
+}
+Decode the supplied base64 string straight into the bytes of an ArrayBuffer,
+without creating an intermediate string like `atob` does. Decoding stops when
+the buffer is full.
 
-  return binaryData;
+Large amounts of data can be decoded a piece at a time:
+
+```
+var buf = new Uint8Array(1024), n = 0;
+// each chunk must be a multiple of 4 base64 characters
+n += E.base64Decode(chunk1, buf, n);
+n += E.base64Decode(chunk2, buf, n);
+```
+ */
+int jswrap_espruino_base64Decode(JsVar *base64Data, JsVar *buffer, int offset) {
+  if (!jsvIsString(base64Data)) {
+    jsExceptionHere(JSET_ERROR, "Expecting a string, got %t", base64Data);
+    return 0;
+  }
+  if (!jsvIsArrayBuffer(buffer)) {
+    jsExceptionHere(JSET_ERROR, "Expecting an ArrayBuffer, got %t", buffer);
+    return 0;
+  }
+  size_t byteLength = jsvGetArrayBufferLength(buffer) * JSV_ARRAYBUFFER_GET_SIZE(buffer->varData.arraybuffer.type);
+  if (offset<0 || (size_t)offset>=byteLength) return 0;
+
+  JswBase64Decoder d;
+  memset(&d, 0, sizeof(d));
+  d.dstLen = byteLength - (size_t)offset;
+  size_t len;
+  char *ptr = jsvGetWritableDataPointer(buffer, &len);
+  if (ptr) {
+    d.dst = (unsigned char*)ptr + offset;
+    jswrap_atob_decodeString(&d, base64Data);
+  } else {
+    JsVar *backingString = jsvGetArrayBufferBackingString(buffer);
+    JsvStringIterator it;
+    jsvStringIteratorNew(&it, backingString, buffer->varData.arraybuffer.byteOffset + (size_t)offset);
+    d.it = &it;
+    jswrap_atob_decodeString(&d, base64Data);
+    jsvStringIteratorFree(&it);
+    jsvUnLock(backingString);
+  }
+  return (int)d.written;
 }
 
 /*JSON{
@@ -23,5 +23,6 @@ bool jswrap_isNaN(JsVar *v);
 
 JsVar *jswrap_btoa(JsVar *binaryData);
 JsVar *jswrap_atob(JsVar *base64Data);
+int jswrap_espruino_base64Decode(JsVar *base64Data, JsVar *buffer, int offset);
 JsVar *jswrap_encodeURIComponent(JsVar *arg);
 JsVar *jswrap_decodeURIComponent(JsVar *arg);
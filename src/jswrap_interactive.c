@@ -185,12 +185,12 @@ The safest way to do a full reset is to hit the reset button.
   "name" : "print",
   "generate" : "jswrap_interface_print",
   "params" : [
-    ["text","JsVarArray",""]
+    ["text","JsVarArgs",""]
   ]
 }
 Print the supplied string(s) to the console
 
- **Note:** If you're connected to a computer (not a wall adaptor) via USB but **you are not running a terminal app** then when you print data Espruino may pause execution and wait until the computer requests the data it is trying to print.
+ **Note:** If you're connected to a computer (not a wall adaptor) via USB but **you are not running a terminal app** then when you print data Espruino may pause execution and wait until the computer requests the data it is trying to print. Use `E.setConsoleBlocking(false)` to drop the data instead.
  */
 /*JSON{
   "type" : "staticmethod",
@@ -198,31 +198,25 @@ Print the supplied string(s) to the console
   "name" : "log",
   "generate" : "jswrap_interface_print",
   "params" : [
-    ["text","JsVarArray","One or more arguments to print"]
+    ["text","JsVarArgs","One or more arguments to print"]
   ]
 }
 Print the supplied string(s) to the console
 
- **Note:** If you're connected to a computer (not a wall adaptor) via USB but **you are not running a terminal app** then when you print data Espruino may pause execution and wait until the computer requests the data it is trying to print.
+ **Note:** If you're connected to a computer (not a wall adaptor) via USB but **you are not running a terminal app** then when you print data Espruino may pause execution and wait until the computer requests the data it is trying to print. Use `E.setConsoleBlocking(false)` to drop the data instead.
  */
-void jswrap_interface_print(JsVar *v) {
-  assert(jsvIsArray(v));
-
+void jswrap_interface_print(JsVar **argPtr, int argCount) {
   jsiConsoleRemoveInputLine();
-  JsvObjectIterator it;
-  jsvObjectIteratorNew(&it, v);
-  while (jsvObjectIteratorHasValue(&it)) {
-    JsVar *v = jsvObjectIteratorGetValue(&it);
+  int i;
+  for (i=0;i<argCount;i++) {
+    JsVar *v = argPtr[i];
+    if (i>0)
+      jsiConsolePrint(" ");
     if (jsvIsString(v))
       jsiConsolePrintStringVar(v);
     else
       jsfPrintJSON(v, JSON_PRETTY | JSON_NEWLINES);
-    jsvUnLock(v);
-    jsvObjectIteratorNext(&it);
-    if (jsvObjectIteratorHasValue(&it))
-      jsiConsolePrint(" ");
   }
-  jsvObjectIteratorFree(&it);
   jsiConsolePrint("\n");
 }
 
@@ -330,8 +324,11 @@ Set the current system time in seconds (to the nearest second)
  */
 void jswrap_interactive_setTime(JsVarFloat time) {
   JsSysTime stime = jshGetTimeFromMilliseconds(time*1000);
-  jsiLastIdleTime = stime;
+  JsSysTime oldTime = jshGetSystemTime();
   jshSetSystemTime(stime);
+  jsiLastIdleTime = jshGetSystemTime();
+  // timers are stored as absolute times, so move them along with the clock
+  jsiTimersShift(jsiLastIdleTime - oldTime);
 }
 
 
@@ -442,21 +439,17 @@ JsVar *_jswrap_interface_setTimeoutOrInterval(JsVar *func, JsVarFloat interval,
     jsExceptionHere(JSET_ERROR, "Function or String not supplied!");
   } else {
     // Create a new timer
-    JsVar *timerPtr = jsvNewObject();
     if (interval<TIMER_MIN_INTERVAL) interval=TIMER_MIN_INTERVAL;
     JsSysTime intervalInt = jshGetTimeFromMilliseconds(interval);
-    jsvObjectSetChildAndUnLock(timerPtr, "time", jsvNewFromLongInteger((jshGetSystemTime() - jsiLastIdleTime) + intervalInt));
-    if (!isTimeout) {
-      jsvObjectSetChildAndUnLock(timerPtr, "interval", jsvNewFromLongInteger(intervalInt));
+    JsVar *timerPtr = jsiTimerNew(jshGetSystemTime() + intervalInt, isTimeout ? 0 : intervalInt, jsiTimerSlack, func);
+    if (timerPtr) {
+      if (jsvGetArrayLength(args))
+        jsvObjectSetChild(timerPtr, "args", args); // intentionally no unlock
+      // Add to array
+      itemIndex = jsvNewFromInteger(jsiTimerAdd(timerPtr));
+      jsvUnLock(timerPtr);
+      jsiTimersChanged(); // mark timers as changed
     }
-    jsvObjectSetChild(timerPtr, "callback", func); // intentionally no unlock
-    if (jsvGetArrayLength(args))
-      jsvObjectSetChild(timerPtr, "args", args); // intentionally no unlock
-
-    // Add to array
-    itemIndex = jsvNewFromInteger(jsiTimerAdd(timerPtr));
-    jsvUnLock(timerPtr);
-    jsiTimersChanged(); // mark timers as changed
   }
   return itemIndex;
 }
@@ -564,12 +557,12 @@ void jswrap_interface_changeInterval(JsVar *idVar, JsVarFloat interval) {
   JsVar *timerName = jsvIsBasic(idVar) ? jsvFindChildFromVar(timerArrayPtr, idVar, false) : 0;
   if (timerName) {
     JsVar *timer = jsvSkipNameAndUnLock(timerName);
-    JsVar *v;
-    JsVarInt intervalInt = (JsVarInt)jshGetTimeFromMilliseconds(interval);
-    v = jsvNewFromInteger(intervalInt);
-    jsvUnLock2(jsvSetNamedChild(timer, v, "interval"), v);
-    v = jsvNewFromInteger((JsVarInt)(jshGetSystemTime()-jsiLastIdleTime) + intervalInt);
-    jsvUnLock3(jsvSetNamedChild(timer, v, "time"), v, timer);
+    JsiTimerData data;
+    jsiTimerGetData(timer, &data);
+    data.interval = jshGetTimeFromMilliseconds(interval);
+    data.time = jshGetSystemTime() + data.interval;
+    jsiTimerSetData(timer, &data);
+    jsvUnLock(timer);
     // timerName already unlocked
     jsiTimersChanged(); // mark timers as changed
   } else {
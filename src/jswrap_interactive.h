@@ -18,7 +18,7 @@ void jswrap_interface_setBusyIndicator(JsVar *pinVar);
 void jswrap_interface_setSleepIndicator(JsVar *pinVar);
 void jswrap_interface_setDeepSleep(bool sleep);
 void jswrap_interface_trace(JsVar *root);
-void jswrap_interface_print(JsVar *v);
+void jswrap_interface_print(JsVar **argPtr, int argCount);
 void jswrap_interface_edit(JsVar *funcName);
 void jswrap_interface_echo(bool echoOn);
 void jswrap_interactive_setTime(JsVarFloat time);
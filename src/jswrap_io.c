@@ -234,6 +234,141 @@ void jswrap_io_digitalPulse(Pin pin, bool value, JsVar *times) {
   }
 }
 
+#ifndef SAVE_ON_FLASH
+#define JSWRAP_IO_PORT_NAME JS_HIDDEN_CHAR_STR"prt" // flat string containing a Port's JswrapIoPort
+#define JSWRAP_IO_PORT_MAX_PINS 32
+typedef struct {
+  uint32_t fastMask; ///< ESP8266: GPIO register bits of all the pins, if they can be written with jshPinsSetValues. Otherwise 0
+  unsigned char count;
+  Pin pins[JSWRAP_IO_PORT_MAX_PINS]; ///< the first pin is the most significant bit
+} JswrapIoPort;
+
+/// Get the pins of a Port created with E.createPort. Returns false if it isn't one
+static bool _jswrap_io_getPort(JsVar *portVar, JswrapIoPort *port) {
+  JsVar *dataVar = jsvIsObject(portVar) ? jsvObjectGetChild(portVar, JSWRAP_IO_PORT_NAME, 0) : 0;
+  bool ok = jsvIsFlatString(dataVar);
+  // copy out, as the flat string's data may not be aligned for 32 bit access
+  if (ok) memcpy(port, jsvGetFlatStringPointer(dataVar), sizeof(JswrapIoPort));
+  jsvUnLock(dataVar);
+  return ok;
+}
+
+/// Write the bottom port->count bits of value to the port's pins
+static void _jswrap_io_portWrite(JswrapIoPort *port, uint32_t value) {
+  int i;
+#ifdef ESP8266
+  if (port->fastMask) {
+    uint32_t set = 0;
+    for (i=port->count-1; i>=0; i--) {
+      if (value&1) set |= 1U<<port->pins[i];
+      value >>= 1;
+    }
+    jshPinsSetValues(set, port->fastMask & ~set);
+    return;
+  }
+#endif
+  for (i=port->count-1; i>=0; i--) {
+    jshPinSetValue(port->pins[i], value&1);
+    value >>= 1;
+  }
+}
+
+/*JSON{
+  "type" : "class",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "Port"
+}
+A group of pins that are written together, created with `E.createPort`. The pins are
+checked and set up once, so writing to them is much faster than `digitalWrite` with an
+array of pins. On ESP8266, if all the pins are D0..D15 they all change at once.
+
+A Port can also be given to `digitalWrite` and `shiftOut` in place of an array of pins.
+ */
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "createPort",
+  "generate" : "jswrap_io_createPort",
+  "params" : [
+    ["pins","JsVar","An array of up to 32 pins, with the most significant bit first"]
+  ],
+  "return" : ["JsVar","A Port"],
+  "return_object" : "Port"
+}
+Create a `Port` for writing to several pins at once, for instance for a parallel LCD:
+
+```
+var lcd = E.createPort([D12,D14,D4,D5]);
+lcd.write(0b1010); // D12 and D4 high, D14 and D5 low
+```
+
+Pins that haven't been set up with `pinMode` are made outputs. Each pin should only
+be in the array once.
+ */
+JsVar *jswrap_io_createPort(JsVar *pins) {
+  if (!jsvIsArray(pins)) {
+    jsExceptionHere(JSET_TYPEERROR, "Expecting an array of pins, got %t", pins);
+    return 0;
+  }
+  JswrapIoPort port;
+  memset(&port, 0, sizeof(port));
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, pins);
+  while (jsvObjectIteratorHasValue(&it)) {
+    Pin pin = jshGetPinFromVarAndUnLock(jsvObjectIteratorGetValue(&it));
+    jsvObjectIteratorNext(&it);
+    if (port.count>=JSWRAP_IO_PORT_MAX_PINS || !jshIsPinValid(pin)) {
+      jsvObjectIteratorFree(&it);
+      if (port.count>=JSWRAP_IO_PORT_MAX_PINS)
+        jsExceptionHere(JSET_ERROR, "Too many pins! %d Maximum.", JSWRAP_IO_PORT_MAX_PINS);
+      else
+        jsExceptionHere(JSET_ERROR, "Invalid pin");
+      return 0;
+    }
+    port.pins[port.count++] = pin;
+  }
+  jsvObjectIteratorFree(&it);
+
+  int i;
+#ifdef ESP8266
+  for (i=0; i<port.count && port.pins[i]<16; i++)
+    port.fastMask |= 1U<<port.pins[i];
+  if (i<port.count) port.fastMask = 0; // D16 isn't in the GPIO registers
+#endif
+  for (i=0; i<port.count; i++)
+    if (!jshGetPinStateIsManual(port.pins[i]))
+      jshPinSetState(port.pins[i], JSHPINSTATE_GPIO_OUT);
+
+  JsVar *portVar = jspNewObject(0, "Port");
+  JsVar *dataVar = jsvNewFlatStringOfLength(sizeof(JswrapIoPort));
+  if (portVar && dataVar) {
+    memcpy(jsvGetFlatStringPointer(dataVar), &port, sizeof(JswrapIoPort));
+    jsvObjectSetChild(portVar, JSWRAP_IO_PORT_NAME, dataVar);
+  }
+  jsvUnLock(dataVar);
+  return portVar;
+}
+
+/*JSON{
+  "type" : "method",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "Port",
+  "name" : "write",
+  "generate" : "jswrap_port_write",
+  "params" : [
+    ["value","int","The value to write - the last pin in the Port gets the least significant bit"]
+  ]
+}
+Set all the pins in the Port at once
+ */
+void jswrap_port_write(JsVar *parent, JsVarInt value) {
+  JswrapIoPort port;
+  if (_jswrap_io_getPort(parent, &port))
+    _jswrap_io_portWrite(&port, (uint32_t)value);
+}
+#endif
+
 /*JSON{
   "type"     : "function",
   "name"     : "digitalWrite",
@@ -253,6 +388,9 @@ as an array of bits where the last array element is the least significant bit.
 In this case, pin values are set least significant bit first (from the right-hand side
 of the array of pins). This means you can use the same pin multiple times, for
 example `digitalWrite([A1,A1,A0,A0],0b0101)` would pulse A0 followed by A1.
+
+If you write to the same group of pins often, `E.createPort` is much faster, and the
+resulting `Port` can be passed to `digitalWrite` in place of the array.
 */
 
 /**
@@ -262,6 +400,14 @@ void jswrap_io_digitalWrite(
     JsVar *pinVar, //!< A pin or pins.
     JsVarInt value //!< The value of the output.
   ) {
+#ifndef SAVE_ON_FLASH
+  // Handle the case where it is a Port from E.createPort
+  JswrapIoPort port;
+  if (_jswrap_io_getPort(pinVar, &port)) {
+    _jswrap_io_portWrite(&port, (uint32_t)value);
+    return;
+  }
+#endif
   // Handle the case where it is an array of pins.
   if (jsvIsArray(pinVar)) {
     JsVarRef pinName = jsvGetLastChild(pinVar); // NOTE: start at end and work back!
@@ -423,6 +569,9 @@ typedef struct {
 #ifdef STM32
   volatile uint32_t *addrs[jswrap_io_shiftOutDataMax];
   volatile uint32_t *clkAddr;
+#endif
+#ifndef SAVE_ON_FLASH
+  JswrapIoPort *port; // if set, data is written with this rather than 'pins'
 #endif
   bool clkPol; // clock polarity
 
@@ -434,6 +583,12 @@ void jswrap_io_shiftOutCallback(int val, void *data) {
   jswrap_io_shiftOutData *d = (jswrap_io_shiftOutData*)data;
   int n, i;
   for (i=0;i<d->repeat;i++) {
+#ifndef SAVE_ON_FLASH
+    if (d->port) {
+      _jswrap_io_portWrite(d->port, (uint32_t)val);
+      val = (d->cnt<32) ? val>>d->cnt : 0;
+    } else
+#endif
     for (n=d->cnt-1; n>=0; n--) {
   #ifdef STM32
       if (d->addrs[n])
@@ -463,7 +618,7 @@ void jswrap_io_shiftOutCallback(int val, void *data) {
   "name" : "shiftOut",
   "generate" : "jswrap_io_shiftOut",
   "params" : [
-    ["pins","JsVar","A pin, or an array of pins to use"],
+    ["pins","JsVar","A pin, an array of pins, or a `Port` from `E.createPort` to use"],
     ["options","JsVar","Options, for instance the clock (see below)"],
     ["data","JsVar","The data to shift out"]
   ]
@@ -499,6 +654,14 @@ pulsed in the polarity given.
 `repeat` is the amount of times shift data out for each array item. For instance
 we may want to shift 8 bits out through 2 pins - in which case we need to set
 repeat to 4.
+
+Passing a `Port` rather than an array of pins is faster, and isn't limited to 8 pins.
+For instance for a chain of 74HC595 shift registers:
+
+```
+var sr = E.createPort([B5]);
+shiftOut(sr, { clk : B3, repeat : 8 }, [0xFF,0x0F,0xF0]);
+```
  */
 void jswrap_io_shiftOut(JsVar *pins, JsVar *options, JsVar *data) {
   jswrap_io_shiftOutData d;
@@ -518,6 +681,14 @@ void jswrap_io_shiftOut(JsVar *pins, JsVar *options, JsVar *data) {
   d.clkPol = d.clkPol?1:0;
   if (d.repeat<1) d.repeat=1;
 
+#ifndef SAVE_ON_FLASH
+  JswrapIoPort port;
+  d.port = 0;
+  if (_jswrap_io_getPort(pins, &port)) {
+    d.port = &port;
+    d.cnt = port.count;
+  } else
+#endif
   if (jsvIsArray(pins)) {
     JsvObjectIterator it;
     jsvObjectIteratorNew(&it, pins);
@@ -536,9 +707,12 @@ void jswrap_io_shiftOut(JsVar *pins, JsVar *options, JsVar *data) {
     d.pins[d.cnt++] = jshGetPinFromVar(pins);
   }
 
-  // Set pins as outputs
-  int i;
-  for (i=0;i<d.cnt;i++) {
+  // Set pins as outputs (a Port's pins were set up by E.createPort)
+  int i, pinCount = d.cnt;
+#ifndef SAVE_ON_FLASH
+  if (d.port) pinCount = 0;
+#endif
+  for (i=0;i<pinCount;i++) {
     if (jshIsPinValid(d.pins[i])) {
       if (!jshGetPinStateIsManual(d.pins[i]))
         jshPinSetState(d.pins[i], JSHPINSTATE_GPIO_OUT);
@@ -563,9 +737,9 @@ void jswrap_io_shiftOut(JsVar *pins, JsVar *options, JsVar *data) {
   "name" : "setWatch",
   "generate" : "jswrap_interface_setWatch",
   "params" : [
-    ["function", "JsVar", "A Function or String to be executed"],
+    ["function", "JsVar", "A Function or String to be executed, or `undefined` if `irq` is an object"],
     ["pin", "pin", "The pin to watch"],
-    ["options", "JsVar",[ "If this is a boolean or integer, it determines whether to call this once (false = default) or every time a change occurs (true)","If this is an object, it can contain the following information: ```{ repeat: true/false(default), edge:'rising'/'falling'/'both'(default), debounce:10}```. `debounce` is the time in ms to wait for bounces to subside, or 0."]]
+    ["options", "JsVar",[ "If this is a boolean or integer, it determines whether to call this once (false = default) or every time a change occurs (true)","If this is an object, it can contain the following information: ```{ repeat: true/false(default), edge:'rising'/'falling'/'both'(default), debounce:10, buffer:0}```. `debounce` is the time in ms to wait for bounces to subside, or 0. `buffer` is the number of pin changes to record before calling the function with all of them at once (see below), or 0. `irq` can be an object of things to do directly from the IRQ (see below). `ticks:true` makes `time` and `lastTime` integer microseconds (see below)."]]
   ],
   "return" : ["JsVar","An ID that can be passed to clearWatch"]
 }
@@ -580,12 +754,51 @@ The function may also take an argument, which is an object of type `{state:bool,
 For instance, if you want to measure the length of a positive pulse you could use `setWatch(function(e) { console.log(e.time-e.lastTime); }, BTN, { repeat:true, edge:'falling' });`. 
 This will only be called on the falling edge of the pulse, but will be able to measure the width of the pulse because `e.lastTime` is the time of the rising edge.
 
+If `ticks:true` is set in options, `time` and `lastTime` are integers in microseconds, the same as
+`E.getTicks()` returns, rather than floating point seconds. This is faster on devices without an FPU
+(eg. ESP8266). They wrap around every 71 minutes, so take differences with `(e.time-e.lastTime)|0`.
+
+If `debounce` is set and this is the only watch on the pin, debouncing is done in the interrupt: bounces
+never reach the event queue, and the function is only called once the pin has been stable for `debounce`
+milliseconds (and with a different state to last time). `time` is then the time of the final change.
+
 Internally, an interrupt writes the time of the pin's state change into a queue, and the function
 supplied to `setWatch` is executed only from the main message loop. However, if the callback is a 
 native function `void (bool state)` then you can add `irq:true` to options, which will cause the 
 function to be called from within the IRQ. When doing this, interrupts will happen on both edges 
 and there will be no debouncing.
 
+If `buffer:n` is set in options, the interrupt records up to `n` pin changes into a buffer rather than
+queueing an event for each one, and the function is called with a `Uint32Array` of every change
+recorded since it was last called. This is much faster for rapidly changing signals (eg. counting pulses
+or decoding IR). For each element, bit 0 is the pin's new state and the other 31 bits are the time
+of the change in microseconds (`e>>>1`, which wraps around every 35 minutes). Changes on both edges are
+recorded, `debounce` is ignored, and the watch must be the only one on its pin. If more than `n` changes
+happen before the function can be called, newer changes are lost and `E.getErrorFlags()` will
+report `FIFO_FULL`.
+
+For signals that need a response faster than the interpreter can give one, `irq` can instead be an
+object describing something to do directly from within the IRQ, without any JavaScript running:
+
+ * `toggle:pin` toggles `pin` each time the watch fires
+ * `write:pin` sets `pin` to the new state of the watched pin
+ * `count:arr` increments the first element of `arr` each time the watch fires. `arr` must be an
+ `Int32Array` or `Uint32Array` stored in one block (eg. `new Int32Array(16)` - see `E.getAddressOf`)
+ * `dir:pin` (with `count`) decrements rather than increments when `pin` is the same as the new state
+ of the watched pin - which decodes a quadrature encoder with its two outputs on the watched pin and `pin`
+
+`edge` is respected, `debounce` is ignored, and the watch must be the only one on its pin. The function
+can be `undefined`, in which case no events are queued at all and the watch stays until `clearWatch` is
+called. For example, to count rising edges on `D4` with no work for the interpreter:
+
+```
+var counter = new Int32Array(16);
+setWatch(undefined, D4, { repeat:true, edge:'rising', irq:{ count:counter } });
+// later... counter[0] is the number of edges
+```
+
+To capture the times of changes, use `buffer` as described above.
+
 **Note:** The STM32 chip (used in the [Espruino Board](/EspruinoBoard) and [Pico](/Pico)) cannot
 watch two pins with the same number - eg `A0` and `B0`.
 
@@ -606,12 +819,19 @@ JsVar *jswrap_interface_setWatch(
   }
 
   bool repeat = false;
+  bool ticks = false;
   JsVarFloat debounce = 0;
   int edge = 0;
   bool isIRQ = false;
+  JsVarInt bufferSize = 0;
+  bool hasAction = false;
+  Pin actionOutPin = PIN_UNDEFINED, actionDirPin = PIN_UNDEFINED;
+  bool actionToggle = false;
+  JsVar *actionCount = 0;
   if (jsvIsObject(repeatOrObject)) {
     JsVar *v;
     repeat = jsvGetBoolAndUnLock(jsvObjectGetChild(repeatOrObject, "repeat", 0));
+    ticks = jsvGetBoolAndUnLock(jsvObjectGetChild(repeatOrObject, "ticks", 0));
     debounce = jsvGetFloatAndUnLock(jsvObjectGetChild(repeatOrObject, "debounce", 0));
     if (isnan(debounce) || debounce<0) debounce=0;
     v = jsvObjectGetChild(repeatOrObject, "edge", 0);
@@ -628,12 +848,81 @@ JsVar *jswrap_interface_setWatch(
       jsExceptionHere(JSET_TYPEERROR, "'edge' in setWatch should be a string - either 'rising', 'falling' or 'both'");
       return 0;
     }
-    isIRQ = jsvGetBoolAndUnLock(jsvObjectGetChild(repeatOrObject, "irq", 0));
+    v = jsvObjectGetChild(repeatOrObject, "irq", 0);
+    if (jsvIsObject(v)) {
+      // Something to do right from the IRQ - toggle/write a pin and/or change a counter
+      JsVar *p = jsvObjectGetChild(v, "toggle", 0);
+      if (p) {
+        actionOutPin = jshGetPinFromVar(p);
+        actionToggle = true;
+      } else {
+        p = jsvObjectGetChild(v, "write", 0);
+        if (p) actionOutPin = jshGetPinFromVar(p);
+      }
+      if (p && !jshIsPinValid(actionOutPin)) {
+        jsvUnLock2(p, v);
+        jsExceptionHere(JSET_ERROR, "Invalid pin for irq.toggle/irq.write");
+        return 0;
+      }
+      jsvUnLock(p);
+      p = jsvObjectGetChild(v, "dir", 0);
+      if (p) {
+        actionDirPin = jshGetPinFromVar(p);
+        jsvUnLock(p);
+        if (!jshIsPinValid(actionDirPin)) {
+          jsvUnLock(v);
+          jsExceptionHere(JSET_ERROR, "Invalid pin for irq.dir");
+          return 0;
+        }
+      }
+      actionCount = jsvObjectGetChild(v, "count", 0);
+      jsvUnLock(v);
+      if (actionCount) {
+        // The IRQ writes the counter directly, so it has to be somewhere that won't move
+        size_t len = 0;
+        char *countPtr = 0;
+        if (jsvIsArrayBuffer(actionCount) &&
+            (actionCount->varData.arraybuffer.type == ARRAYBUFFERVIEW_INT32 ||
+             actionCount->varData.arraybuffer.type == ARRAYBUFFERVIEW_UINT32))
+          countPtr = jsvGetDataPointer(actionCount, &len);
+        if (!countPtr || ((size_t)countPtr)&3) {
+          jsvUnLock(actionCount);
+          jsExceptionHere(JSET_ERROR, "irq.count should be an Int32Array stored in one block (eg. new Int32Array(16))");
+          return 0;
+        }
+      }
+      if (actionOutPin == PIN_UNDEFINED && !actionCount) {
+        jsExceptionHere(JSET_ERROR, "irq should contain toggle, write or count");
+        return 0;
+      }
+      hasAction = true;
+    } else
+      isIRQ = jsvGetBoolAndUnLock(v);
+    bufferSize = jsvGetIntegerAndUnLock(jsvObjectGetChild(repeatOrObject, "buffer", 0));
+    if (bufferSize<0 || bufferSize>=0xFFFF) {
+      jsExceptionHere(JSET_ERROR, "'buffer' in setWatch should be between 0 and 65534");
+      return 0;
+    }
+    if (bufferSize) {
+      if (jsiIsWatchingPin(pin)) {
+        jsExceptionHere(JSET_ERROR, "buffer set, but watch is already used");
+        return 0;
+      }
+      debounce = 0;
+    }
+    if (hasAction) {
+      if (jsiIsWatchingPin(pin)) {
+        jsvUnLock(actionCount);
+        jsExceptionHere(JSET_ERROR, "irq set, but watch is already used");
+        return 0;
+      }
+      debounce = 0;
+    }
   } else
     repeat = jsvGetBool(repeatOrObject);
 
   JsVarInt itemIndex = -1;
-  if (!jsvIsFunction(func) && !jsvIsString(func)) {
+  if (!jsvIsFunction(func) && !jsvIsString(func) && !(hasAction && jsvIsUndefined(func))) {
     jsExceptionHere(JSET_ERROR, "Function or String not supplied!");
   } else {
     // Create a new watch object which may contain:
@@ -647,18 +936,70 @@ JsVar *jswrap_interface_setWatch(
     if (watchPtr) {
       jsvObjectSetChildAndUnLock(watchPtr, "pin", jsvNewFromPin(pin));
       if (repeat) jsvObjectSetChildAndUnLock(watchPtr, "recur", jsvNewFromBool(repeat));
-      if (debounce>0) jsvObjectSetChildAndUnLock(watchPtr, "debounce", jsvNewFromInteger((JsVarInt)jshGetTimeFromMilliseconds(debounce)));
+      if (ticks) jsvObjectSetChildAndUnLock(watchPtr, "ticks", jsvNewFromBool(ticks));
+      if (debounce>0) {
+        JsSysTime debounceTime = jshGetTimeFromMilliseconds(debounce);
+        jsvObjectSetChildAndUnLock(watchPtr, "debounce", jsvNewFromInteger((JsVarInt)debounceTime));
+        // If this is the only watch on the pin, debounce in the IRQ so bounces never make it to the event queue
+        JsVar *debounceVar = jsiIsWatchingPin(pin) ? 0 : jsvNewFlatStringOfLength((unsigned int)sizeof(JshEventDebounce));
+        if (debounceVar) {
+          JshEventDebounce *irqDebounce = (JshEventDebounce*)jsvGetFlatStringPointer(debounceVar);
+          irqDebounce->channel = EV_NONE;
+          irqDebounce->pending = false;
+          irqDebounce->debounce = (debounceTime > 0x7FFFFFFF) ? 0x7FFFFFFF : (uint32_t)debounceTime;
+          jsvObjectSetChildAndUnLock(watchPtr, "dbnc", debounceVar);
+        }
+      }
       if (edge) jsvObjectSetChildAndUnLock(watchPtr, "edge", jsvNewFromInteger(edge));
       jsvObjectSetChild(watchPtr, "callback", func); // no unlock intentionally
+      if (bufferSize) {
+        // one more entry than asked for, so a full ring can be told from an empty one
+        JsVar *bufferVar = jsvNewFlatStringOfLength((unsigned int)(sizeof(JshEventBuffer) + (size_t)(bufferSize+1)*sizeof(uint32_t)));
+        if (!bufferVar) {
+          jsError("Not enough memory for watch buffer");
+          jsvUnLock(watchPtr);
+          return 0;
+        }
+        JshEventBuffer *buffer = (JshEventBuffer*)jsvGetFlatStringPointer(bufferVar);
+        buffer->channel = EV_NONE;
+        buffer->size = (unsigned short)(bufferSize+1);
+        jsvObjectSetChildAndUnLock(watchPtr, "buffer", bufferVar);
+      }
+      if (hasAction) {
+        JsVar *actionVar = jsvNewFlatStringOfLength((unsigned int)sizeof(JshEventAction));
+        if (!actionVar) {
+          jsError("Not enough memory for watch irq");
+          jsvUnLock2(watchPtr, actionCount);
+          return 0;
+        }
+        JshEventAction *action = (JshEventAction*)jsvGetFlatStringPointer(actionVar);
+        action->channel = EV_NONE;
+        action->edge = (signed char)edge;
+        action->pushEvent = !jsvIsUndefined(func);
+        action->outToggle = actionToggle;
+        action->outPin = actionOutPin;
+        action->dirPin = actionDirPin;
+        action->count = 0;
+        jsvObjectSetChildAndUnLock(watchPtr, "action", actionVar);
+        if (actionCount) jsvObjectSetChild(watchPtr, "count", actionCount);
+        if (actionOutPin!=PIN_UNDEFINED && !jshGetPinStateIsManual(actionOutPin))
+          jshPinSetState(actionOutPin, JSHPINSTATE_GPIO_OUT);
+      }
     }
 
     // If nothing already watching the pin, set up a watch
     IOEventFlags exti = EV_NONE;
     if (!jsiIsWatchingPin(pin))
       exti = jshPinWatch(pin, true);
+    else // the IRQ can only debounce for one watch per pin
+      jsiWatchStopIRQDebounce(pin);
     // disable event callbacks by default
     if (exti) {
       jshSetEventCallback(exti, 0);
+      jshSetEventBuffer(exti, 0);
+      jshSetEventAction(exti, 0);
+      jshSetEventDebounce(exti, 0);
+      if (watchPtr) jsiWatchIRQStart(watchPtr, exti);
       if (isIRQ) {
         if (jsvIsNativeFunction(func)) {
           jshSetEventCallback(exti, (JshEventCallbackCallback)jsvGetNativeFunctionPtr(func));
@@ -678,6 +1019,7 @@ JsVar *jswrap_interface_setWatch(
 
 
   }
+  jsvUnLock(actionCount);
   return (itemIndex>=0) ? jsvNewFromInteger(itemIndex) : 0/*undefined*/;
 }
 
@@ -700,6 +1042,7 @@ void jswrap_interface_clearWatch(JsVar *idVar) {
     while (jsvObjectIteratorHasValue(&it)) {
       JsVar *watchPtr = jsvObjectIteratorGetValue(&it);
       JsVar *watchPin = jsvObjectGetChild(watchPtr, "pin", 0);
+      jsiWatchIRQStop(watchPtr);
       jshPinWatch(jshGetPinFromVar(watchPin), false);
       jsvUnLock2(watchPin, watchPtr);
       jsvObjectIteratorNext(&it);
@@ -715,6 +1058,7 @@ void jswrap_interface_clearWatch(JsVar *idVar) {
     if (watchNamePtr) { // child is a 'name'
       JsVar *watchPtr = jsvSkipName(watchNamePtr);
       Pin pin = jshGetPinFromVarAndUnLock(jsvObjectGetChild(watchPtr, "pin", 0));
+      jsiWatchIRQStop(watchPtr);
       jsvUnLock(watchPtr);
 
       JsVar *watchArrayPtr = jsvLock(watchArray);
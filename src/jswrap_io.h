@@ -19,6 +19,8 @@ void jswrap_io_poke(JsVarInt addr, JsVar *data, int wordSize);
 
 void jswrap_io_analogWrite(Pin pin, JsVarFloat value, JsVar *options);
 void jswrap_io_digitalPulse(Pin pin, bool value, JsVar *times);
+JsVar *jswrap_io_createPort(JsVar *pins);
+void jswrap_port_write(JsVar *parent, JsVarInt value);
 void jswrap_io_digitalWrite(JsVar *pinVar, JsVarInt value);
 JsVarInt jswrap_io_digitalRead(JsVar *pinVar);
 void jswrap_io_pinMode(Pin pin, JsVar *mode);
@@ -53,77 +53,166 @@ JsVar *jswrap_json_stringify(JsVar *v) {
 }
 
 
-JsVar *jswrap_json_parse_internal() {
-  switch (lex->tk) {
-  case LEX_R_TRUE:  jslGetNextToken(lex); return jsvNewFromBool(true);
-  case LEX_R_FALSE: jslGetNextToken(lex); return jsvNewFromBool(false);
-  case LEX_R_NULL:  jslGetNextToken(lex); return jsvNewWithFlags(JSV_NULL);
-  case '-': {
-    jslGetNextToken(lex);
-    if (lex->tk!=LEX_INT && lex->tk!=LEX_FLOAT) return 0;
-    JsVar *v = jswrap_json_parse_internal(lex);
-    JsVar *zero = jsvNewFromInteger(0);
-    JsVar *r = jsvMathsOp(zero, v, '-');
-    jsvUnLock2(v, zero);
-    return r;
+/// State for parsing JSON directly from a string, without using the lexer
+typedef struct {
+  JsvStringIterator it;
+  size_t endIdx; ///< index in the string after the last character we should parse
+  char ch; ///< the current character, or 0 at the end
+} JsonParser;
+
+static void jsonNextCh(JsonParser *p) {
+  jsvStringIteratorNextInline(&p->it);
+  p->ch = (jsvStringIteratorGetIndex(&p->it) < p->endIdx) ? jsvStringIteratorGetChar(&p->it) : 0;
+}
+
+static void jsonSkipWhitespace(JsonParser *p) {
+  while (p->ch==' ' || p->ch=='\t' || p->ch=='\n' || p->ch=='\r')
+    jsonNextCh(p);
+}
+
+/// Move on if the current character is ch (and any whitespace after it)
+static bool jsonMatch(JsonParser *p, char ch) {
+  if (p->ch != ch) return false;
+  jsonNextCh(p);
+  jsonSkipWhitespace(p);
+  return true;
+}
+
+/// If the text at the current position is str, skip over it
+static bool jsonMatchWord(JsonParser *p, const char *str) {
+  while (*str) {
+    if (p->ch != *(str++)) return false;
+    jsonNextCh(p);
   }
-  case LEX_INT: {
-    long long v = stringToInt(jslGetTokenValueAsString(lex));
-    jslGetNextToken(lex);
-    return jsvNewFromLongInteger(v);
+  jsonSkipWhitespace(p);
+  return true;
+}
+
+static int jsonHexDigit(JsonParser *p) {
+  int d = chtod(p->ch);
+  if (d<0 || d>15) return -1;
+  jsonNextCh(p);
+  return d;
+}
+
+static JsVar *jsonParseString(JsonParser *p) {
+  char delim = p->ch; // we allow single quotes too, as JSON.parse always has
+  jsonNextCh(p);
+  JsVar *str = jsvNewFromEmptyString();
+  if (!str) return 0;
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, str, 0);
+  while (p->ch && p->ch!=delim) {
+    char ch = p->ch;
+    jsonNextCh(p);
+    if (ch == '\\') {
+      ch = p->ch;
+      jsonNextCh(p);
+      switch (ch) {
+      case 'n' : ch = 0x0A; break;
+      case 'b' : ch = 0x08; break;
+      case 'f' : ch = 0x0C; break;
+      case 'r' : ch = 0x0D; break;
+      case 't' : ch = 0x09; break;
+      case 'u' :
+      case 'x' : { // hex digits
+        int digits = (ch=='u') ? 4 : 2, code = 0;
+        while (digits--) {
+          int d = jsonHexDigit(p);
+          if (d<0) {
+            jsvStringIteratorFree(&it);
+            jsvUnLock(str);
+            return 0;
+          }
+          code = (code<<4) | d;
+        }
+        // We don't support unicode, so we just take the bottom 8 bits
+        ch = (char)code;
+      } break;
+      default: break; // for anything else, just push the character through
+      }
+    }
+    jsvStringIteratorAppend(&it, ch);
   }
-  case LEX_FLOAT: {
-    JsVarFloat v = stringToFloat(jslGetTokenValueAsString(lex));
-    jslGetNextToken(lex);
-    return jsvNewFromFloat(v);
+  jsvStringIteratorFree(&it);
+  if (!jsonMatch(p, delim)) { // unfinished string
+    jsvUnLock(str);
+    return 0;
   }
-  case LEX_STR: {
-    JsVar *a = jslGetTokenValueAsVar(lex);
-    jslGetNextToken(lex);
-    return a;
+  return str;
+}
+
+static JsVar *jsonParseNumber(JsonParser *p) {
+  char buf[JSLEX_MAX_TOKEN_LENGTH];
+  size_t len = 0;
+  bool isFloat = false;
+  while (isNumeric(p->ch) || p->ch=='-' || p->ch=='+' || p->ch=='.' || p->ch=='e' || p->ch=='E') {
+    if (len+1 >= sizeof(buf)) return 0;
+    if (!isNumeric(p->ch) && !(len==0 && p->ch=='-')) isFloat = true;
+    buf[len++] = p->ch;
+    jsonNextCh(p);
   }
+  buf[len] = 0;
+  jsonSkipWhitespace(p);
+  if (!len || (len==1 && buf[0]=='-')) return 0;
+  if (isFloat) {
+    JsVarFloat v = stringToFloat(buf);
+    if (isnan(v)) return 0;
+    return jsvNewFromFloat(v);
+  }
+  return jsvNewFromLongInteger(stringToInt(buf));
+}
+
+static JsVar *jsonParseValue(JsonParser *p) {
+  switch (p->ch) {
+  case 't': return jsonMatchWord(p, "true") ? jsvNewFromBool(true) : 0;
+  case 'f': return jsonMatchWord(p, "false") ? jsvNewFromBool(false) : 0;
+  case 'n': return jsonMatchWord(p, "null") ? jsvNewNull() : 0;
+  case '"':
+  case '\'': return jsonParseString(p);
   case '[': {
     JsVar *arr = jsvNewEmptyArray(); if (!arr) return 0;
-    jslGetNextToken(lex); // [
-    while (lex->tk != ']') {
-      JsVar *value = jswrap_json_parse_internal(lex);
+    jsonMatch(p, '[');
+    while (p->ch != ']') {
+      JsVar *value = jsonParseValue(p);
       if (!value ||
-          (lex->tk!=']' && !jslMatch(','))) {
+          (p->ch!=']' && !jsonMatch(p, ','))) {
         jsvUnLock2(value, arr);
         return 0;
       }
       jsvArrayPush(arr, value);
       jsvUnLock(value);
     }
-    if (!jslMatch(']')) {
-      jsvUnLock(arr);
-      return 0;
-    }
+    jsonMatch(p, ']');
     return arr;
   }
   case '{': {
     JsVar *obj = jsvNewObject(); if (!obj) return 0;
-    jslGetNextToken(lex); // {
-    while (lex->tk == LEX_STR) {
-      JsVar *key = jsvAsArrayIndexAndUnLock(jslGetTokenValueAsVar(lex));
-      jslGetNextToken(lex);
+    jsonMatch(p, '{');
+    while (p->ch == '"' || p->ch == '\'') {
+      JsVar *key = jsvAsArrayIndexAndUnLock(jsonParseString(p));
       JsVar *value = 0;
-      if (!jslMatch(':') ||
-          !(value=jswrap_json_parse_internal(lex)) ||
-          (lex->tk!='}' && !jslMatch(','))) {
+      if (!key ||
+          !jsonMatch(p, ':') ||
+          !(value=jsonParseValue(p)) ||
+          (p->ch!='}' && !jsonMatch(p, ','))) {
         jsvUnLock3(key, value, obj);
         return 0;
       }
-      jsvAddName(obj, jsvMakeIntoVariableName(key, value));
+      key = jsvMakeIntoVariableName(key, value);
+      jsvAddName(obj, key);
       jsvUnLock2(value, key);
     }
-    if (!jslMatch('}')) {
+    if (!jsonMatch(p, '}')) {
       jsvUnLock(obj);
       return 0;
     }
     return obj;
   }
-  default: return 0; // undefined = error
+  default:
+    if (isNumeric(p->ch) || p->ch=='-')
+      return jsonParseNumber(p);
+    return 0; // undefined = error
   }
 }
 
@@ -139,17 +228,35 @@ JsVar *jswrap_json_parse_internal() {
 }
 Parse the given JSON string into a JavaScript object
 
-NOTE: This implementation uses eval() internally, and as such it is unsafe as it can allow arbitrary JS commands to be executed.
+The string is parsed directly (without using the JavaScript parser), so it can't execute any code.
+`string` can also be an `ArrayBuffer` or `Uint8Array` containing the text.
  */
 JsVar *jswrap_json_parse(JsVar *v) {
-  JsLex lex;
-  JsVar *str = jsvAsString(v, false);
-  JsLex *oldLex = jslSetLex(&lex);
-  jslInit(str);
+  JsVar *str;
+  size_t startIdx = 0, endIdx;
+  if (jsvIsArrayBuffer(v) && JSV_ARRAYBUFFER_GET_SIZE(v->varData.arraybuffer.type)==1) {
+    // parse straight out of the ArrayBuffer's memory
+    str = jsvGetArrayBufferBackingString(v);
+    startIdx = v->varData.arraybuffer.byteOffset;
+    endIdx = startIdx + v->varData.arraybuffer.length;
+  } else {
+    str = jsvAsString(v, false);
+    endIdx = jsvGetStringLength(str);
+  }
+  if (!str) return 0;
+  JsonParser p;
+  jsvStringIteratorNew(&p.it, str, startIdx);
+  p.endIdx = endIdx;
+  p.ch = (startIdx < endIdx) ? jsvStringIteratorGetChar(&p.it) : 0;
+  jsonSkipWhitespace(&p);
+  JsVar *res = jsonParseValue(&p);
+  if (!res || p.ch) {
+    jsExceptionHere(JSET_SYNTAXERROR, "Invalid JSON at position %d", (int)(jsvStringIteratorGetIndex(&p.it)-startIdx));
+    jsvUnLock(res);
+    res = 0;
+  }
+  jsvStringIteratorFree(&p.it);
   jsvUnLock(str);
-  JsVar *res = jswrap_json_parse_internal();
-  jslKill();
-  jslSetLex(oldLex);
   return res;
 }
 
@@ -189,6 +296,13 @@ void jsfGetJSONForFunctionWithCallback(JsVar *var, JSONFlags flags, vcbprintf_ca
       } else {
         const char *prefix = jsvIsFunctionReturn(var) ? "return " : "";
         bool hadNewLine = jsvGetStringIndexOf(codeVar,'\n')>0;
+#ifndef SAVE_ON_FLASH
+        if (var->varData.function.codeTokenised) { // see E.setFlags
+          cbprintf(user_callback, user_data, hadNewLine?"{\n  %s":"{%s", prefix);
+          jslPrintTokenisedString(codeVar, user_callback, user_data);
+          cbprintf(user_callback, user_data, hadNewLine?"\n}":"}");
+        } else
+#endif
         cbprintf(user_callback, user_data, hadNewLine?"{\n  %s%v\n}":"{%s%v}", prefix, codeVar);
       }
     } else cbprintf(user_callback, user_data, "{}");
@@ -250,7 +364,7 @@ void jsfGetJSONWithCallback(JsVar *var, JSONFlags flags, vcbprintf_callback user
           }
           JsVar *item = jsvGetArrayItem(var, (JsVarInt)i);
           if (jsvIsUndefined(item) && (flags&JSON_NO_UNDEFINED))
-            item = jsvNewWithFlags(JSV_NULL);
+            item = jsvNewNull();
           bool newNeedsNewLine = (flags&JSON_NEWLINES) && jsonNeedsNewLine(item);
           if (needNewLine || newNeedsNewLine) {
             jsonNewLine(nflags, user_callback, user_data);
@@ -287,9 +401,14 @@ void jsfGetJSONWithCallback(JsVar *var, JSONFlags flags, vcbprintf_callback user
           if (!limited || it.index<JSON_LIMITED_AMOUNT || it.index>=length-JSON_LIMITED_AMOUNT) {
             if (it.index>0) cbprintf(user_callback, user_data, (flags&JSON_PRETTY)?", ":",");
             if (limited && it.index==length-JSON_LIMITED_AMOUNT) cbprintf(user_callback, user_data, JSON_LIMIT_TEXT);
-            JsVar *item = jsvArrayBufferIteratorGetValue(&it);
-            jsfGetJSONWithCallback(item, nflags, user_callback, user_data);
-            jsvUnLock(item);
+            // format the number directly rather than allocating a var for it
+            JsVarInt i = JSV_ARRAYBUFFER_IS_FLOAT(it.type) ? 0 : jsvArrayBufferIteratorGetIntegerValue(&it);
+            if (JSV_ARRAYBUFFER_IS_FLOAT(it.type))
+              cbprintf(user_callback, user_data, "%f", jsvArrayBufferIteratorGetFloatValue(&it));
+            else if (it.type == ARRAYBUFFERVIEW_UINT32 && i<0) // too big for a JsVarInt
+              cbprintf(user_callback, user_data, "%f", (JsVarFloat)(uint32_t)i);
+            else
+              cbprintf(user_callback, user_data, "%L", i);
           }
           jsvArrayBufferIteratorNext(&it);
         }
@@ -373,6 +492,33 @@ void jsfGetJSON(JsVar *var, JsVar *result, JSONFlags flags) {
   jsvStringIteratorFree(&it);
 }
 
+typedef struct {
+  size_t pos; ///< how many characters of JSON have been output so far
+  size_t start; ///< index of first character to copy into buf
+  char *buf;
+  size_t len; ///< maximum characters to copy into buf
+} JsonSliceInfo;
+
+static void jsfGetJSONSliceCallback(const char *str, void *user_data) {
+  JsonSliceInfo *info = (JsonSliceInfo*)user_data;
+  while (*str) {
+    if (info->pos >= info->start && info->pos < info->start+info->len)
+      info->buf[info->pos - info->start] = *str;
+    info->pos++;
+    str++;
+  }
+}
+
+size_t jsfGetJSONSlice(JsVar *var, JSONFlags flags, size_t start, char *buf, size_t len) {
+  JsonSliceInfo info;
+  info.pos = 0;
+  info.start = start;
+  info.buf = buf;
+  info.len = len;
+  jsfGetJSONWithCallback(var, flags, jsfGetJSONSliceCallback, &info);
+  return info.pos;
+}
+
 void jsfPrintJSON(JsVar *var, JSONFlags flags) {
   jsfGetJSONWithCallback(var, flags, (vcbprintf_callback)jsiConsolePrintString, 0);
 }
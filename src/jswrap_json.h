@@ -36,6 +36,11 @@ void jsfGetJSONWithCallback(JsVar *var, JSONFlags flags, vcbprintf_callback user
 /* Convenience function for using jsfGetJSONWithCallback - print to var */
 void jsfGetJSON(JsVar *var, JsVar *result, JSONFlags flags);
 
+/* Convert to JSON, but only copy len characters starting at 'start' into buf (which isn't null-terminated).
+ * Returns the length of the whole JSON string. This lets big objects be output a bit at a time without
+ * ever storing the full string - at the cost of converting the whole object each time. */
+size_t jsfGetJSONSlice(JsVar *var, JSONFlags flags, size_t start, char *buf, size_t len);
+
 /* Convenience function for using jsfGetJSONWithCallback - print to console */
 void jsfPrintJSON(JsVar *var, JSONFlags flags);
 /* Convenience function for using jsfGetJSONForFunctionWithCallback - print to console */
@@ -0,0 +1,829 @@
+/*
+ * This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+ *
+ * Copyright (C) 2013 Gordon Williams <gw@pur3.co.uk>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * ----------------------------------------------------------------------------
+ * This file is designed to be parsed during the build process
+ *
+ * ES6 Map and Set implementation
+ * ----------------------------------------------------------------------------
+ */
+#include "jswrap_map.h"
+#include "jsparse.h"
+#include "jsinteractive.h"
+#include "jswrapper.h"
+
+/* A Map keeps its keys and values in two hidden arrays, in insertion order,
+ * with a value's element having the same index as its key's. A Set only has
+ * the keys array. So lookups don't have to walk the arrays, there's also a
+ * flat string containing an open-addressed hash table. After a header, each
+ * slot holds the JsVarRef of a key's element (the name in the keys array)
+ * followed, for a Map, by the JsVarRef of the value's element. */
+#define JS_MAP_KEYS_NAME JS_HIDDEN_CHAR_STR"mk"
+#define JS_MAP_VALUES_NAME JS_HIDDEN_CHAR_STR"mv"
+#define JS_MAP_TABLE_NAME JS_HIDDEN_CHAR_STR"mh"
+
+#define JS_MAP_HDR_COUNT 0  // number of entries in the table
+#define JS_MAP_HDR_KEYS 1   // ref of the keys array - if it's different, the Map has been copied
+#define JS_MAP_HDR_DEFRAG 2 // jsvDefragCount when the table was built - if it's different, refs may have moved
+#define JS_MAP_HDR_LEN 3
+#define JS_MAP_MIN_SLOTS 8
+
+#ifndef SAVE_ON_FLASH
+#define JS_MAP_DEFRAG_COUNT ((JsVarRef)jsvDefragCount)
+#else
+#define JS_MAP_DEFRAG_COUNT 0 // there's no jsvDefragment
+#endif
+
+/*JSON{
+  "type" : "class",
+  "class" : "Map",
+  "ifndef" : "SAVE_ON_FLASH"
+}
+This is the built-in class for ES6 Maps, which hold key/value pairs in the order
+they were added. Unlike an Object, any value (including an Object) can be a key,
+keys aren't converted to strings (so `1` and `"1"` are different keys), and
+lookups use a hash table so they stay fast with many entries.
+
+Espruino doesn't have iterators, so `keys()`, `values()` and `entries()` return Arrays.
+*/
+/*JSON{
+  "type" : "class",
+  "class" : "Set",
+  "ifndef" : "SAVE_ON_FLASH"
+}
+This is the built-in class for ES6 Sets, which hold unique values in the order
+they were added. Values aren't converted to strings, and lookups use a hash table
+so they stay fast with many entries.
+
+Espruino doesn't have iterators, so `keys()`, `values()` and `entries()` return Arrays.
+*/
+
+/// Hash a key, so that keys that are equal (see _jswrap_map_keyEqual) have the same hash
+static unsigned int _jswrap_map_hash(JsVar *key) {
+  if (!key) return 0;
+  if (jsvIsString(key)) {
+    unsigned int hash = 0;
+    JsvStringIterator it;
+    jsvStringIteratorNew(&it, key, 0);
+    while (jsvStringIteratorHasChar(&it)) {
+      hash = hash*31 + (unsigned char)jsvStringIteratorGetChar(&it);
+      jsvStringIteratorNext(&it);
+    }
+    jsvStringIteratorFree(&it);
+    return hash;
+  }
+  if (jsvIsInt(key)) return (unsigned int)jsvGetInteger(key);
+  if (jsvIsFloat(key)) {
+    JsVarFloat f = jsvGetFloat(key);
+    if (isnan(f)) return 0x7FF80000;
+    if (f >= -2147483648.0 && f < 2147483648.0 && f == (JsVarFloat)(int)f)
+      return (unsigned int)(int)f; // the same as the integer, and 0 for -0
+    unsigned int hash = 0, n;
+    for (n=0;n<sizeof(f);n++)
+      hash = hash*31 + ((unsigned char*)&f)[n];
+    return hash;
+  }
+  if (jsvIsBoolean(key)) return jsvGetBool(key) ? 1 : 0;
+  if (jsvIsNull(key)) return 0;
+  return jsvGetRef(key); // anything else is only equal to itself
+}
+
+/// Are two keys the same? Like ===, except that NaN is equal to NaN
+static bool _jswrap_map_keyEqual(JsVar *a, JsVar *b) {
+  if (a==b) return true;
+  if (!a || !b) return false;
+  if (jsvIsString(a) || jsvIsString(b))
+    return jsvIsString(a) && jsvIsString(b) && jsvCompareString(a, b, 0, 0, false)==0;
+  if ((jsvIsInt(a) || jsvIsFloat(a)) && (jsvIsInt(b) || jsvIsFloat(b))) {
+    if (jsvIsInt(a) && jsvIsInt(b)) return jsvGetInteger(a) == jsvGetInteger(b);
+    JsVarFloat fa = jsvGetFloat(a), fb = jsvGetFloat(b);
+    return fa==fb || (isnan(fa) && isnan(fb));
+  }
+  if (jsvIsBoolean(a) && jsvIsBoolean(b)) return jsvGetBool(a) == jsvGetBool(b);
+  if (jsvIsNull(a) && jsvIsNull(b)) return true;
+  return false;
+}
+
+/// Does the key in this element (a name in the keys array) equal the given key?
+static bool _jswrap_map_elementIsKey(JsVarRef element, JsVar *key) {
+  JsVar *k = jsvSkipNameAndUnLock(jsvLock(element));
+  bool equal = _jswrap_map_keyEqual(k, key);
+  jsvUnLock(k);
+  return equal;
+}
+
+/// Get the ref of the next element in an array
+static JsVarRef _jswrap_map_nextRef(JsVarRef element) {
+  JsVar *e = jsvLock(element);
+  JsVarRef next = jsvGetNextSibling(e);
+  jsvUnLock(e);
+  return next;
+}
+
+/// Get the table's slots, and the number of them
+static JsVarRef *_jswrap_map_getSlots(JsVar *table, unsigned int stride, unsigned int *slots) {
+  *slots = (unsigned int)(jsvGetCharactersInVar(table)/sizeof(JsVarRef) - JS_MAP_HDR_LEN) / stride;
+  return (JsVarRef*)jsvGetFlatStringPointer(table);
+}
+
+/// Find the slot for the key in the table - either the one it's in, or the empty one it should go in
+static unsigned int _jswrap_map_probe(JsVarRef *t, unsigned int slots, unsigned int stride, JsVar *key, unsigned int hash) {
+  unsigned int i = hash & (slots-1);
+  while (t[JS_MAP_HDR_LEN + i*stride] && !_jswrap_map_elementIsKey(t[JS_MAP_HDR_LEN + i*stride], key))
+    i = (i+1) & (slots-1);
+  return i;
+}
+
+/// Put an element (and its value's element, for a Map) in the first free slot for its hash
+static void _jswrap_map_insert(JsVarRef *t, unsigned int slots, unsigned int stride, JsVarRef keyElement, JsVarRef valueElement) {
+  JsVar *k = jsvSkipNameAndUnLock(jsvLock(keyElement));
+  unsigned int i = _jswrap_map_hash(k) & (slots-1);
+  jsvUnLock(k);
+  while (t[JS_MAP_HDR_LEN + i*stride]) i = (i+1) & (slots-1);
+  t[JS_MAP_HDR_LEN + i*stride] = keyElement;
+  if (stride>1) t[JS_MAP_HDR_LEN + i*stride + 1] = valueElement;
+}
+
+/// Build a new hash table for the map, big enough to add one more entry. Returns it locked, or 0 if out of memory
+static JsVar *_jswrap_map_buildTable(JsVar *parent, JsVar *keys, JsVar *values) {
+  unsigned int stride = values ? 2 : 1;
+  unsigned int count = (unsigned int)jsvGetChildren(keys);
+  unsigned int slots = JS_MAP_MIN_SLOTS;
+  while (slots < (count+1)*2) slots <<= 1;
+  // remove the old one first, so we've got the memory for the new one
+  JsVar *old = jsvFindChildFromString(parent, JS_MAP_TABLE_NAME, false);
+  if (old) {
+    jsvRemoveChild(parent, old);
+    jsvUnLock(old);
+  }
+  JsVar *table = jsvNewFlatStringOfLength((unsigned int)((JS_MAP_HDR_LEN + slots*stride)*sizeof(JsVarRef)));
+  if (!table) return 0; // we'll just search the arrays
+  JsVarRef *t = (JsVarRef*)jsvGetFlatStringPointer(table);
+  memset(t, 0, (JS_MAP_HDR_LEN + slots*stride)*sizeof(JsVarRef));
+  t[JS_MAP_HDR_COUNT] = (JsVarRef)count;
+  t[JS_MAP_HDR_KEYS] = jsvGetRef(keys);
+  t[JS_MAP_HDR_DEFRAG] = JS_MAP_DEFRAG_COUNT;
+  JsVarRef k = jsvGetFirstChild(keys);
+  JsVarRef v = values ? jsvGetFirstChild(values) : 0;
+  while (k) {
+    _jswrap_map_insert(t, slots, stride, k, v);
+    k = _jswrap_map_nextRef(k);
+    if (v) v = _jswrap_map_nextRef(v);
+  }
+  jsvObjectSetChild(parent, JS_MAP_TABLE_NAME, table);
+  return table;
+}
+
+/// Get the map's hash table (locked), building it if it's missing or out of date. Returns 0 if out of memory
+static JsVar *_jswrap_map_getTable(JsVar *parent, JsVar *keys, JsVar *values) {
+  JsVar *table = jsvObjectGetChild(parent, JS_MAP_TABLE_NAME, 0);
+  if (jsvIsFlatString(table)) {
+    JsVarRef *t = (JsVarRef*)jsvGetFlatStringPointer(table);
+    if (t[JS_MAP_HDR_KEYS]==jsvGetRef(keys) && t[JS_MAP_HDR_DEFRAG]==JS_MAP_DEFRAG_COUNT)
+      return table;
+  }
+  jsvUnLock(table);
+  return _jswrap_map_buildTable(parent, keys, values);
+}
+
+/// Get the (locked) keys or values array of a map, creating it if asked
+static JsVar *_jswrap_map_getArray(JsVar *parent, const char *name, bool create) {
+  if (!jsvIsObject(parent)) return 0;
+  JsVar *arr = jsvObjectGetChild(parent, name, create ? JSV_ARRAY : 0);
+  if (!jsvIsArray(arr)) {
+    jsvUnLock(arr);
+    return 0;
+  }
+  return arr;
+}
+
+/** Find a key in a map. Returns the (locked) element of the keys array it's in,
+ * or 0. For a Map, *valueElement is set to the (locked) element in the values array. */
+static JsVar *_jswrap_map_find(JsVar *parent, JsVar *keys, JsVar *values, JsVar *key, JsVar **valueElement) {
+  if (valueElement) *valueElement = 0;
+  unsigned int stride = values ? 2 : 1;
+  JsVar *table = _jswrap_map_getTable(parent, keys, values);
+  if (table) {
+    unsigned int slots;
+    JsVarRef *t = _jswrap_map_getSlots(table, stride, &slots);
+    unsigned int i = _jswrap_map_probe(t, slots, stride, key, _jswrap_map_hash(key));
+    JsVar *element = 0;
+    if (t[JS_MAP_HDR_LEN + i*stride]) {
+      element = jsvLock(t[JS_MAP_HDR_LEN + i*stride]);
+      if (valueElement && values) *valueElement = jsvLock(t[JS_MAP_HDR_LEN + i*stride + 1]);
+    }
+    jsvUnLock(table);
+    return element;
+  }
+  // no memory for a table - search the arrays
+  JsVarRef k = jsvGetFirstChild(keys);
+  JsVarRef v = values ? jsvGetFirstChild(values) : 0;
+  while (k) {
+    if (_jswrap_map_elementIsKey(k, key)) {
+      if (valueElement && v) *valueElement = jsvLock(v);
+      return jsvLock(k);
+    }
+    k = _jswrap_map_nextRef(k);
+    if (v) v = _jswrap_map_nextRef(v);
+  }
+  return 0;
+}
+
+/// Append an element to the array, returning it (locked)
+static JsVar *_jswrap_map_push(JsVar *arr, JsVar *value) {
+  JsVar *element = jsvMakeIntoVariableName(jsvNewFromInteger(jsvGetArrayLength(arr)), value);
+  if (element) jsvAddName(arr, element);
+  return element;
+}
+
+/// Add a key (and value, for a Map) that isn't in the map yet
+static void _jswrap_map_add(JsVar *parent, JsVar *keys, JsVar *values, JsVar *key, JsVar *value) {
+  JsVar *keyElement = _jswrap_map_push(keys, key);
+  if (!keyElement) return;
+  JsVar *valueElement = 0;
+  if (values) {
+    valueElement = _jswrap_map_push(values, value);
+    if (!valueElement) {
+      jsvRemoveChild(keys, keyElement);
+      jsvUnLock(keyElement);
+      return;
+    }
+  }
+  unsigned int stride = values ? 2 : 1;
+  JsVar *table = jsvObjectGetChild(parent, JS_MAP_TABLE_NAME, 0);
+  if (jsvIsFlatString(table)) {
+    unsigned int slots;
+    JsVarRef *t = _jswrap_map_getSlots(table, stride, &slots);
+    if ((unsigned int)(t[JS_MAP_HDR_COUNT]+1)*4 > slots*3) {
+      // too full - build a bigger one, which will include this element
+      jsvUnLock(_jswrap_map_buildTable(parent, keys, values));
+    } else {
+      _jswrap_map_insert(t, slots, stride, jsvGetRef(keyElement), values ? jsvGetRef(valueElement) : 0);
+      t[JS_MAP_HDR_COUNT]++;
+    }
+  }
+  jsvUnLock3(table, keyElement, valueElement);
+}
+
+/// Remove a key's element (and value's element, for a Map) from the map
+static void _jswrap_map_remove(JsVar *parent, JsVar *keys, JsVar *values, JsVar *key, JsVar *keyElement, JsVar *valueElement) {
+  unsigned int stride = values ? 2 : 1;
+  // _jswrap_map_find has just made sure any table is up to date
+  JsVar *table = jsvObjectGetChild(parent, JS_MAP_TABLE_NAME, 0);
+  if (jsvIsFlatString(table)) {
+    unsigned int slots;
+    JsVarRef *t = _jswrap_map_getSlots(table, stride, &slots);
+    JsVarRef ref = jsvGetRef(keyElement);
+    unsigned int i = _jswrap_map_hash(key) & (slots-1);
+    while (t[JS_MAP_HDR_LEN + i*stride] && t[JS_MAP_HDR_LEN + i*stride]!=ref)
+      i = (i+1) & (slots-1);
+    if (t[JS_MAP_HDR_LEN + i*stride]) {
+      // remove it, then re-insert everything after it in the same run so lookups don't stop early
+      t[JS_MAP_HDR_LEN + i*stride] = 0;
+      t[JS_MAP_HDR_COUNT]--;
+      i = (i+1) & (slots-1);
+      while (t[JS_MAP_HDR_LEN + i*stride]) {
+        JsVarRef k = t[JS_MAP_HDR_LEN + i*stride];
+        JsVarRef v = stride>1 ? t[JS_MAP_HDR_LEN + i*stride + 1] : 0;
+        t[JS_MAP_HDR_LEN + i*stride] = 0;
+        _jswrap_map_insert(t, slots, stride, k, v);
+        i = (i+1) & (slots-1);
+      }
+    }
+  }
+  jsvUnLock(table);
+  jsvRemoveChild(keys, keyElement);
+  if (values && valueElement) jsvRemoveChild(values, valueElement);
+}
+
+/** Get the element after this one in the array. If this one has been removed
+ * (eg. by a forEach callback) it's the first with a greater index. */
+static JsVar *_jswrap_map_nextElement(JsVar *arr, JsVar *element) {
+  JsVarRef r;
+  if (jsvGetRefs(element)) {
+    r = jsvGetNextSibling(element);
+  } else {
+    JsVarInt index = jsvGetInteger(element);
+    r = jsvGetFirstChild(arr);
+    while (r) {
+      JsVar *e = jsvLock(r);
+      bool after = jsvGetInteger(e) > index;
+      jsvUnLock(e);
+      if (after) break;
+      r = _jswrap_map_nextRef(r);
+    }
+  }
+  return r ? jsvLock(r) : 0;
+}
+
+/// Call the function for each entry, as function(value, key, map)
+static void _jswrap_map_forEach(JsVar *parent, JsVar *funcVar, JsVar *thisVar, bool isMap) {
+  if (!jsvIsFunction(funcVar)) {
+    jsExceptionHere(JSET_TYPEERROR, "forEach: Expecting a function, got %t", funcVar);
+    return;
+  }
+  JsVar *keys = _jswrap_map_getArray(parent, JS_MAP_KEYS_NAME, false);
+  JsVar *values = isMap ? _jswrap_map_getArray(parent, JS_MAP_VALUES_NAME, false) : 0;
+  if (!keys || (isMap && !values)) {
+    jsvUnLock2(keys, values);
+    return;
+  }
+  JsVar *k = jsvGetFirstChild(keys) ? jsvLock(jsvGetFirstChild(keys)) : 0;
+  JsVar *v = (values && jsvGetFirstChild(values)) ? jsvLock(jsvGetFirstChild(values)) : 0;
+  while (k && !jspIsInterrupted()) {
+    JsVar *args[3];
+    args[1] = jsvSkipName(k);
+    args[0] = v ? jsvSkipName(v) : jsvLockAgainSafe(args[1]);
+    args[2] = parent;
+    jsvUnLock(jspeFunctionCall(funcVar, 0, thisVar, false, 3, args));
+    jsvUnLock2(args[0], args[1]);
+    JsVar *nextK = _jswrap_map_nextElement(keys, k);
+    JsVar *nextV = v ? _jswrap_map_nextElement(values, v) : 0;
+    jsvUnLock2(k, v);
+    k = nextK;
+    v = nextV;
+  }
+  jsvUnLock2(k, v);
+  jsvUnLock2(keys, values);
+}
+
+/// Return an array of the keys, values or [key,value] entries
+static JsVar *_jswrap_map_toArray(JsVar *parent, bool isMap, bool wantKeys, bool wantValues) {
+  JsVar *result = jsvNewEmptyArray();
+  JsVar *keys = _jswrap_map_getArray(parent, JS_MAP_KEYS_NAME, false);
+  JsVar *values = isMap ? _jswrap_map_getArray(parent, JS_MAP_VALUES_NAME, false) : 0;
+  if (!result || !keys || (isMap && !values)) {
+    jsvUnLock2(keys, values);
+    return result;
+  }
+  JsVarRef k = jsvGetFirstChild(keys);
+  JsVarRef v = values ? jsvGetFirstChild(values) : 0;
+  while (k) {
+    JsVar *key = jsvSkipNameAndUnLock(jsvLock(k));
+    JsVar *value = v ? jsvSkipNameAndUnLock(jsvLock(v)) : jsvLockAgainSafe(key);
+    if (wantKeys && wantValues) {
+      JsVar *entry = jsvNewEmptyArray();
+      if (entry) {
+        jsvArrayPush(entry, key);
+        jsvArrayPush(entry, value);
+        jsvArrayPushAndUnLock(result, entry);
+      }
+    } else {
+      jsvArrayPush(result, wantKeys ? key : value);
+    }
+    jsvUnLock2(key, value);
+    k = _jswrap_map_nextRef(k);
+    if (v) v = _jswrap_map_nextRef(v);
+  }
+  jsvUnLock2(keys, values);
+  return result;
+}
+
+/// Return the number of entries
+static JsVarInt _jswrap_map_getSize(JsVar *parent) {
+  JsVar *keys = _jswrap_map_getArray(parent, JS_MAP_KEYS_NAME, false);
+  if (!keys) return 0;
+  JsVarInt size = jsvGetChildren(keys);
+  jsvUnLock(keys);
+  return size;
+}
+
+/// Remove all entries
+static void _jswrap_map_clear(JsVar *parent, bool isMap) {
+  JsVar *keys = _jswrap_map_getArray(parent, JS_MAP_KEYS_NAME, false);
+  JsVar *values = isMap ? _jswrap_map_getArray(parent, JS_MAP_VALUES_NAME, false) : 0;
+  // the arrays keep their lengths, so new entries get higher indices (see _jswrap_map_nextElement)
+  if (keys) jsvRemoveAllChildren(keys);
+  if (values) jsvRemoveAllChildren(values);
+  jsvUnLock2(keys, values);
+  JsVar *table = jsvFindChildFromString(parent, JS_MAP_TABLE_NAME, false);
+  if (table) {
+    jsvRemoveChild(parent, table);
+    jsvUnLock(table);
+  }
+}
+
+/// Find the key, and if it's in the map return its value (or true for a Set)
+static JsVar *_jswrap_map_get(JsVar *parent, JsVar *key, bool isMap, bool *found) {
+  *found = false;
+  JsVar *keys = _jswrap_map_getArray(parent, JS_MAP_KEYS_NAME, false);
+  JsVar *values = isMap ? _jswrap_map_getArray(parent, JS_MAP_VALUES_NAME, false) : 0;
+  JsVar *result = 0;
+  if (keys && (!isMap || values)) {
+    JsVar *valueElement;
+    JsVar *keyElement = _jswrap_map_find(parent, keys, values, key, &valueElement);
+    if (keyElement) {
+      *found = true;
+      result = valueElement ? jsvSkipName(valueElement) : 0;
+    }
+    jsvUnLock2(keyElement, valueElement);
+  }
+  jsvUnLock2(keys, values);
+  return result;
+}
+
+/// Set the value for a key (adding it if needed). Returns parent
+static JsVar *_jswrap_map_set(JsVar *parent, JsVar *key, JsVar *value, bool isMap) {
+  JsVar *keys = _jswrap_map_getArray(parent, JS_MAP_KEYS_NAME, true);
+  JsVar *values = isMap ? _jswrap_map_getArray(parent, JS_MAP_VALUES_NAME, true) : 0;
+  if (keys && (!isMap || values)) {
+    JsVar *valueElement;
+    JsVar *keyElement = _jswrap_map_find(parent, keys, values, key, &valueElement);
+    if (keyElement) {
+      if (valueElement) jsvSetValueOfName(valueElement, value);
+    } else {
+      // -0 is stored as 0
+      JsVar *k = (jsvIsFloat(key) && jsvGetFloat(key)==0) ? jsvNewFromInteger(0) : jsvLockAgainSafe(key);
+      _jswrap_map_add(parent, keys, values, k, value);
+      jsvUnLock(k);
+    }
+    jsvUnLock2(keyElement, valueElement);
+  }
+  jsvUnLock2(keys, values);
+  return jsvLockAgain(parent);
+}
+
+/// Remove a key. Returns true if it was there
+static bool _jswrap_map_delete(JsVar *parent, JsVar *key, bool isMap) {
+  JsVar *keys = _jswrap_map_getArray(parent, JS_MAP_KEYS_NAME, false);
+  JsVar *values = isMap ? _jswrap_map_getArray(parent, JS_MAP_VALUES_NAME, false) : 0;
+  bool found = false;
+  if (keys && (!isMap || values)) {
+    JsVar *valueElement;
+    JsVar *keyElement = _jswrap_map_find(parent, keys, values, key, &valueElement);
+    if (keyElement) {
+      found = true;
+      _jswrap_map_remove(parent, keys, values, key, keyElement, valueElement);
+    }
+    jsvUnLock2(keyElement, valueElement);
+  }
+  jsvUnLock2(keys, values);
+  return found;
+}
+
+/// Create a new, empty map
+static JsVar *_jswrap_map_new(const char *className, bool isMap) {
+  JsVar *obj = jspNewObject(0, className);
+  if (!obj) return 0;
+  jsvObjectSetChildAndUnLock(obj, JS_MAP_KEYS_NAME, jsvNewEmptyArray());
+  if (isMap) jsvObjectSetChildAndUnLock(obj, JS_MAP_VALUES_NAME, jsvNewEmptyArray());
+  return obj;
+}
+
+/*JSON{
+  "type" : "constructor",
+  "class" : "Map",
+  "name" : "Map",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_map_constructor",
+  "params" : [
+    ["iterable","JsVar","[optional] An array of `[key, value]` arrays to add to the Map"]
+  ],
+  "return" : ["JsVar","A new Map"],
+  "return_object" : "Map"
+}
+Create a new Map, eg. `new Map([["a",1],["b",2]])`
+ */
+JsVar *jswrap_map_constructor(JsVar *iterable) {
+  JsVar *map = _jswrap_map_new("Map", true);
+  if (!map || jsvIsUndefined(iterable) || jsvIsNull(iterable)) return map;
+  if (!jsvIsIterable(iterable)) {
+    jsExceptionHere(JSET_TYPEERROR, "Expecting an array of [key, value] arrays, got %t", iterable);
+    return map;
+  }
+  JsvIterator it;
+  jsvIteratorNew(&it, iterable);
+  while (jsvIteratorHasElement(&it) && !jspIsInterrupted()) {
+    JsVar *entry = jsvIteratorGetValue(&it);
+    if (jsvIsObject(entry) || jsvIsArray(entry)) {
+      JsVar *key = jsvGetArrayItem(entry, 0);
+      JsVar *value = jsvGetArrayItem(entry, 1);
+      jsvUnLock3(_jswrap_map_set(map, key, value, true), key, value);
+    } else {
+      jsExceptionHere(JSET_TYPEERROR, "Expecting [key, value] array, got %t", entry);
+    }
+    jsvUnLock(entry);
+    jsvIteratorNext(&it);
+  }
+  jsvIteratorFree(&it);
+  return map;
+}
+
+/*JSON{
+  "type" : "constructor",
+  "class" : "Set",
+  "name" : "Set",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_set_constructor",
+  "params" : [
+    ["iterable","JsVar","[optional] An array of values to add to the Set"]
+  ],
+  "return" : ["JsVar","A new Set"],
+  "return_object" : "Set"
+}
+Create a new Set, eg. `new Set([1,2,3])`
+ */
+JsVar *jswrap_set_constructor(JsVar *iterable) {
+  JsVar *set = _jswrap_map_new("Set", false);
+  if (!set || jsvIsUndefined(iterable) || jsvIsNull(iterable)) return set;
+  if (!jsvIsIterable(iterable)) {
+    jsExceptionHere(JSET_TYPEERROR, "Expecting an array, got %t", iterable);
+    return set;
+  }
+  JsvIterator it;
+  jsvIteratorNew(&it, iterable);
+  while (jsvIteratorHasElement(&it) && !jspIsInterrupted()) {
+    JsVar *value = jsvIteratorGetValue(&it);
+    jsvUnLock2(_jswrap_map_set(set, value, 0, false), value);
+    jsvIteratorNext(&it);
+  }
+  jsvIteratorFree(&it);
+  return set;
+}
+
+/*JSON{
+  "type" : "property",
+  "class" : "Map",
+  "name" : "size",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_map_size",
+  "return" : ["int","The number of entries in the Map"]
+}
+ */
+JsVarInt jswrap_map_size(JsVar *parent) {
+  return _jswrap_map_getSize(parent);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "Map",
+  "name" : "get",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_map_get",
+  "params" : [
+    ["key","JsVar","The key"]
+  ],
+  "return" : ["JsVar","The value for the key, or undefined"]
+}
+ */
+JsVar *jswrap_map_get(JsVar *parent, JsVar *key) {
+  bool found;
+  return _jswrap_map_get(parent, key, true, &found);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "Map",
+  "name" : "set",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_map_set",
+  "params" : [
+    ["key","JsVar","The key"],
+    ["value","JsVar","The value"]
+  ],
+  "return" : ["JsVar","The Map"]
+}
+Set the value for a key, adding it to the end of the Map if it isn't there already
+ */
+JsVar *jswrap_map_set(JsVar *parent, JsVar *key, JsVar *value) {
+  return _jswrap_map_set(parent, key, value, true);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "Map",
+  "name" : "has",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_map_has",
+  "params" : [
+    ["key","JsVar","The key"]
+  ],
+  "return" : ["bool","Whether the key is in the Map"]
+}
+ */
+bool jswrap_map_has(JsVar *parent, JsVar *key) {
+  bool found;
+  jsvUnLock(_jswrap_map_get(parent, key, true, &found));
+  return found;
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "Map",
+  "name" : "delete",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_map_delete",
+  "params" : [
+    ["key","JsVar","The key"]
+  ],
+  "return" : ["bool","Whether the key was in the Map"]
+}
+ */
+bool jswrap_map_delete(JsVar *parent, JsVar *key) {
+  return _jswrap_map_delete(parent, key, true);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "Map",
+  "name" : "clear",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_map_clear"
+}
+Remove all entries
+ */
+void jswrap_map_clear(JsVar *parent) {
+  _jswrap_map_clear(parent, true);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "Map",
+  "name" : "forEach",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_map_forEach",
+  "params" : [
+    ["function","JsVar","Function to call as `function(value, key, map)`"],
+    ["thisArg","JsVar","if specified, the function is called with 'this' set to thisArg (optional)"]
+  ]
+}
+Call a function for each entry, in the order they were added
+ */
+void jswrap_map_forEach(JsVar *parent, JsVar *funcVar, JsVar *thisVar) {
+  _jswrap_map_forEach(parent, funcVar, thisVar, true);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "Map",
+  "name" : "keys",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_map_keys",
+  "return" : ["JsVar","An array of the keys"]
+}
+ */
+JsVar *jswrap_map_keys(JsVar *parent) {
+  return _jswrap_map_toArray(parent, true, true, false);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "Map",
+  "name" : "values",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_map_values",
+  "return" : ["JsVar","An array of the values"]
+}
+ */
+JsVar *jswrap_map_values(JsVar *parent) {
+  return _jswrap_map_toArray(parent, true, false, true);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "Map",
+  "name" : "entries",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_map_entries",
+  "return" : ["JsVar","An array of `[key, value]` arrays"]
+}
+ */
+JsVar *jswrap_map_entries(JsVar *parent) {
+  return _jswrap_map_toArray(parent, true, true, true);
+}
+
+/*JSON{
+  "type" : "property",
+  "class" : "Set",
+  "name" : "size",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_set_size",
+  "return" : ["int","The number of values in the Set"]
+}
+ */
+JsVarInt jswrap_set_size(JsVar *parent) {
+  return _jswrap_map_getSize(parent);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "Set",
+  "name" : "add",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_set_add",
+  "params" : [
+    ["value","JsVar","The value"]
+  ],
+  "return" : ["JsVar","The Set"]
+}
+Add a value to the end of the Set, if it isn't there already
+ */
+JsVar *jswrap_set_add(JsVar *parent, JsVar *value) {
+  return _jswrap_map_set(parent, value, 0, false);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "Set",
+  "name" : "has",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_set_has",
+  "params" : [
+    ["value","JsVar","The value"]
+  ],
+  "return" : ["bool","Whether the value is in the Set"]
+}
+ */
+bool jswrap_set_has(JsVar *parent, JsVar *value) {
+  bool found;
+  jsvUnLock(_jswrap_map_get(parent, value, false, &found));
+  return found;
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "Set",
+  "name" : "delete",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_set_delete",
+  "params" : [
+    ["value","JsVar","The value"]
+  ],
+  "return" : ["bool","Whether the value was in the Set"]
+}
+ */
+bool jswrap_set_delete(JsVar *parent, JsVar *value) {
+  return _jswrap_map_delete(parent, value, false);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "Set",
+  "name" : "clear",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_set_clear"
+}
+Remove all values
+ */
+void jswrap_set_clear(JsVar *parent) {
+  _jswrap_map_clear(parent, false);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "Set",
+  "name" : "forEach",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_set_forEach",
+  "params" : [
+    ["function","JsVar","Function to call as `function(value, value, set)`"],
+    ["thisArg","JsVar","if specified, the function is called with 'this' set to thisArg (optional)"]
+  ]
+}
+Call a function for each value, in the order they were added
+ */
+void jswrap_set_forEach(JsVar *parent, JsVar *funcVar, JsVar *thisVar) {
+  _jswrap_map_forEach(parent, funcVar, thisVar, false);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "Set",
+  "name" : "values",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_set_values",
+  "return" : ["JsVar","An array of the values"]
+}
+ */
+/*JSON{
+  "type" : "method",
+  "class" : "Set",
+  "name" : "keys",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_set_values",
+  "return" : ["JsVar","An array of the values"]
+}
+The same as `values()`
+ */
+JsVar *jswrap_set_values(JsVar *parent) {
+  return _jswrap_map_toArray(parent, false, false, true);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "Set",
+  "name" : "entries",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_set_entries",
+  "return" : ["JsVar","An array of `[value, value]` arrays"]
+}
+ */
+JsVar *jswrap_set_entries(JsVar *parent) {
+  return _jswrap_map_toArray(parent, false, true, true);
+}
@@ -0,0 +1,36 @@
+/*
+ * This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+ *
+ * Copyright (C) 2013 Gordon Williams <gw@pur3.co.uk>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * ----------------------------------------------------------------------------
+ * ES6 Map and Set implementation
+ * ----------------------------------------------------------------------------
+ */
+#include "jsvar.h"
+
+JsVar *jswrap_map_constructor(JsVar *iterable);
+JsVarInt jswrap_map_size(JsVar *parent);
+JsVar *jswrap_map_get(JsVar *parent, JsVar *key);
+JsVar *jswrap_map_set(JsVar *parent, JsVar *key, JsVar *value);
+bool jswrap_map_has(JsVar *parent, JsVar *key);
+bool jswrap_map_delete(JsVar *parent, JsVar *key);
+void jswrap_map_clear(JsVar *parent);
+void jswrap_map_forEach(JsVar *parent, JsVar *funcVar, JsVar *thisVar);
+JsVar *jswrap_map_keys(JsVar *parent);
+JsVar *jswrap_map_values(JsVar *parent);
+JsVar *jswrap_map_entries(JsVar *parent);
+
+JsVar *jswrap_set_constructor(JsVar *iterable);
+JsVarInt jswrap_set_size(JsVar *parent);
+JsVar *jswrap_set_add(JsVar *parent, JsVar *value);
+bool jswrap_set_has(JsVar *parent, JsVar *value);
+bool jswrap_set_delete(JsVar *parent, JsVar *value);
+void jswrap_set_clear(JsVar *parent);
+void jswrap_set_forEach(JsVar *parent, JsVar *funcVar, JsVar *thisVar);
+JsVar *jswrap_set_values(JsVar *parent);
+JsVar *jswrap_set_entries(JsVar *parent);
@@ -19,6 +19,7 @@
 #include "jsparse.h"
 #include "jsinteractive.h"
 #include "jswrapper.h"
+#include "jswrap_storage.h"
 #ifdef USE_FILESYSTEM
 #include "jswrap_fs.h"
 #endif
@@ -78,13 +79,20 @@ JsVar *jswrap_require(JsVar *moduleName) {
     JsVar *fileContents = 0;
     //if (jsvIsStringEqual(moduleName,"http")) {}
     //if (jsvIsStringEqual(moduleName,"fs")) {}
+#ifndef SAVE_ON_FLASH
+    /* Modules stored in flash with Modules.addFlash (or Storage.write). Where
+     * possible the code is run straight from flash, so it doesn't use RAM */
+    fileContents = jsfStorageReadDirect(moduleName);
+#endif
 #ifdef USE_FILESYSTEM
-    JsVar *modulePath = jsvNewFromString("node_modules/");
-    if (!modulePath) { jsvUnLock(moduleExportName); return 0; } // out of memory
-    jsvAppendStringVarComplete(modulePath, moduleName);
-    jsvAppendString(modulePath,".js");
-    fileContents = jswrap_fs_readFile(modulePath);
-    jsvUnLock(modulePath);
+    if (!fileContents) {
+      JsVar *modulePath = jsvNewFromString("node_modules/");
+      if (!modulePath) { jsvUnLock(moduleExportName); return 0; } // out of memory
+      jsvAppendStringVarComplete(modulePath, moduleName);
+      jsvAppendString(modulePath,".js");
+      fileContents = jswrap_fs_readFile(modulePath);
+      jsvUnLock(modulePath);
+    }
 #endif
     if (!fileContents || jsvIsStringEqual(fileContents,"")) {
       jsvUnLock2(moduleExportName, fileContents);
@@ -211,3 +219,52 @@ void jswrap_modules_addCached(JsVar *id, JsVar *sourceCode) {
   jsvUnLock(moduleList);
 
 }
+
+/*JSON{
+  "type" : "staticmethod",
+  "class" : "Modules",
+  "name" : "addFlash",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_modules_addFlash",
+  "params" : [
+    ["id","JsVar","The module name to add"],
+    ["sourcecode","JsVar","The module's sourcecode"]
+  ],
+  "return" : ["bool","True if the module was stored"]
+}
+Store the given module in flash memory (using the `Storage` library), so
+that `require(id)` can load it even after a reset.
+
+The code is stored with whitespace and comments removed. On devices where
+flash memory can be read directly, `require` executes the module straight
+from flash and the code of its functions stays there, so even large modules
+use very little RAM.
+
+Unlike `Modules.addCached`, the module isn't loaded until `require` is called.
+ */
+#ifndef SAVE_ON_FLASH
+bool jswrap_modules_addFlash(JsVar *id, JsVar *sourceCode) {
+  if (!jsvIsString(id) || !jsvIsString(sourceCode)) {
+    jsExceptionHere(JSET_ERROR, "Both arguments to addFlash must be strings");
+    return false;
+  }
+  JsVar *tokens = jslTokenise(sourceCode, 0);
+  if (!tokens) {
+    jsExceptionHere(JSET_ERROR, "Unable to tokenise module");
+    return false;
+  }
+  bool ok = jswrap_storage_write(id, tokens);
+  jsvUnLock(tokens);
+  // make sure the next require loads the new version
+  JsVar *moduleList = jswrap_modules_getModuleList();
+  if (moduleList) {
+    JsVar *moduleExportName = jsvFindChildFromVar(moduleList, id, false);
+    if (moduleExportName) {
+      jsvRemoveChild(moduleList, moduleExportName);
+      jsvUnLock(moduleExportName);
+    }
+    jsvUnLock(moduleList);
+  }
+  return ok;
+}
+#endif
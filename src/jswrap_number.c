@@ -89,7 +89,7 @@ JsVar *jswrap_number_constructor(JsVar *args) {
   "type" : "staticproperty",
   "class" : "Number",
   "name" : "MAX_VALUE",
-  "generate_full" : "DBL_MAX",
+  "generate_full" : "JSVARFLOAT_MAX",
   "return" : ["float","Maximum representable value"]
 }*/
 
@@ -97,7 +97,7 @@ JsVar *jswrap_number_constructor(JsVar *args) {
   "type" : "staticproperty",
   "class" : "Number",
   "name" : "MIN_VALUE",
-  "generate_full" : "DBL_MIN",
+  "generate_full" : "JSVARFLOAT_MIN",
   "return" : ["float","Smallest representable value"]
 }*/
 
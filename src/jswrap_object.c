@@ -255,6 +255,10 @@ void jswrap_object_keys_or_property_names_cb(
   }
 }
 
+static void jswrap_object_keys_push_cb(void *data, JsVar *name) {
+  jsvArrayPush((JsVar*)data, name);
+}
+
 JsVar *jswrap_object_keys_or_property_names(
     JsVar *obj,
     bool includeNonEnumerable,  ///< include 'hidden' items
@@ -263,11 +267,71 @@ JsVar *jswrap_object_keys_or_property_names(
   JsVar *arr = jsvNewEmptyArray();
   if (!arr) return 0;
 
-  jswrap_object_keys_or_property_names_cb(obj, includeNonEnumerable, includePrototype, (void (*)(void *, JsVar *))jsvArrayAddUnique, arr);
+  /* An object's own keys are unique, so only check for duplicates (which
+   * is O(n^2)) if we're adding built-in or prototype names too */
+  if (includeNonEnumerable || includePrototype)
+    jswrap_object_keys_or_property_names_cb(obj, includeNonEnumerable, includePrototype, (void (*)(void *, JsVar *))jsvArrayAddUnique, arr);
+  else
+    jswrap_object_keys_or_property_names_cb(obj, false, false, jswrap_object_keys_push_cb, arr);
 
   return arr;
 }
 
+/*JSON{
+  "type" : "staticmethod",
+  "class" : "Object",
+  "name" : "values",
+  "generate_full" : "jswrap_object_values_or_entries(object, false)",
+  "params" : [
+    ["object","JsVar","The object to return values for"]
+  ],
+  "return" : ["JsVar","An array of values - one for each key on the given object"]
+}
+Return all enumerable values of the given object
+ */
+/*JSON{
+  "type" : "staticmethod",
+  "class" : "Object",
+  "name" : "entries",
+  "generate_full" : "jswrap_object_values_or_entries(object, true)",
+  "params" : [
+    ["object","JsVar","The object to return keys and values for"]
+  ],
+  "return" : ["JsVar","An array of `[key,value]` pairs - one for each key on the given object"]
+}
+Return all enumerable keys and values of the given object, as `[key,value]` pairs
+ */
+JsVar *jswrap_object_values_or_entries(JsVar *object, bool returnEntries) {
+  JsVar *arr = jsvNewEmptyArray();
+  if (!arr || !jsvIsIterable(object)) return arr;
+  JsvIsInternalChecker checkerFunction = jsvGetInternalFunctionCheckerFor(object);
+
+  // Get values straight from the iterator rather than looking up each key
+  JsvIterator it;
+  jsvIteratorNew(&it, object);
+  while (jsvIteratorHasElement(&it)) {
+    JsVar *key = jsvIteratorGetKey(&it);
+    if (!(checkerFunction && checkerFunction(key))) {
+      JsVar *value = jsvIteratorGetValue(&it);
+      if (returnEntries) {
+        JsVar *name = jsvAsArrayIndexAndUnLock(jsvCopyNameOnly(key, false, false));
+        JsVar *entry = jsvNewEmptyArray();
+        if (entry) {
+          jsvArrayPush(entry, name);
+          jsvArrayPush(entry, value);
+          jsvArrayPush(arr, entry);
+        }
+        jsvUnLock3(entry, name, value);
+      } else
+        jsvArrayPushAndUnLock(arr, value);
+    }
+    jsvUnLock(key);
+    jsvIteratorNext(&it);
+  }
+  jsvIteratorFree(&it);
+  return arr;
+}
+
 /*JSON{
   "type" : "staticmethod",
   "class" : "Object",
@@ -531,6 +595,36 @@ bool jswrap_boolean_constructor(JsVar *value) {
 // --------------------------------------------------------------------------
 //                                            These should be in EventEmitter
 
+#define JS_ONCE_LISTENER_NAME JS_HIDDEN_CHAR_STR"cb" // the real listener, on the wrapper `once` makes
+#define JS_ONCE_EVENT_NAME JS_HIDDEN_CHAR_STR"ev" // the event name, on the wrapper `once` makes
+#define JS_ONCE_EMITTER_NAME JS_HIDDEN_CHAR_STR"obj" // the object emitting, on the wrapper `once` makes
+
+/** Find the child of parent that holds the listeners for an event (eg. `#ondata`
+ * for 'data'). This doesn't allocate unless the event name is long or the child
+ * needs creating. Returns a LOCKED name, or 0 */
+static JsVar *_jswrap_object_findEventList(JsVar *parent, JsVar *event, bool createIfNotFound) {
+  char eventName[32];
+  if (jsvGetStringLength(event)+sizeof(JS_EVENT_PREFIX) <= sizeof(eventName)) {
+    strcpy(eventName, JS_EVENT_PREFIX);
+    jsvGetString(event, &eventName[sizeof(JS_EVENT_PREFIX)-1], sizeof(eventName)+1-sizeof(JS_EVENT_PREFIX));
+    return jsvFindChildFromString(parent, eventName, createIfNotFound);
+  }
+  JsVar *eventNameVar = jsvVarPrintf(JS_EVENT_PREFIX"%v",event);
+  if (!eventNameVar) return 0; // no memory
+  JsVar *eventList = jsvFindChildFromVar(parent, eventNameVar, createIfNotFound);
+  jsvUnLock(eventNameVar);
+  return eventList;
+}
+
+/// Is the listener in an event list the one given (or a wrapper for it made by `once`)?
+static bool _jswrap_object_isListener(JsVar *item, JsVar *listener) {
+  if (item == listener) return true;
+  if (!jsvIsNativeFunction(item)) return false;
+  JsVar *l = jsvObjectGetChild(item, JS_ONCE_LISTENER_NAME, 0);
+  jsvUnLock(l);
+  return l && l==listener;
+}
+
 /** A convenience function for adding event listeners */
 void jswrap_object_addEventListener(JsVar *parent, const char *eventName, void (*callback)(), JsnArgumentType argTypes) {
   JsVar *n = jsvNewFromString(eventName);
@@ -565,11 +659,8 @@ void jswrap_object_on(JsVar *parent, JsVar *event, JsVar *listener) {
     return;
   }
 
-  JsVar *eventName = jsvVarPrintf(JS_EVENT_PREFIX"%v",event);
-  if (!eventName) return; // no memory
-
-  JsVar *eventList = jsvFindChildFromVar(parent, eventName, true);
-  jsvUnLock(eventName);
+  JsVar *eventList = _jswrap_object_findEventList(parent, event, true);
+  if (!eventList) return; // no memory
   JsVar *eventListeners = jsvSkipName(eventList);
   if (jsvIsUndefined(eventListeners)) {
     // just add
@@ -591,15 +682,55 @@ void jswrap_object_on(JsVar *parent, JsVar *event, JsVar *listener) {
   /* Special case if we're a data listener and data has already arrived then
    * we queue an event immediately. */
   if (jsvIsStringEqual(event, "data")) {
-    JsVar *buf = jsvObjectGetChild(parent, STREAM_BUFFER_NAME, 0);
-    if (jsvIsString(buf)) {
-      jsiQueueObjectCallbacks(parent, STREAM_CALLBACK_NAME, &buf, 1);
-      jsvRemoveNamedChild(parent, STREAM_BUFFER_NAME);
-    }
+    JsVar *buf = jswrap_stream_takeData(parent);
+    if (buf) jsiQueueObjectCallbacks(parent, STREAM_CALLBACK_NAME, &buf, 1);
     jsvUnLock(buf);
   }
 }
 
+/// Called in place of a listener added with `once` - removes itself, then calls the real listener
+static void _jswrap_object_once_fire(JsVar *wrapper, JsVar *args) {
+  JsVar *emitter = jsvObjectGetChild(wrapper, JS_ONCE_EMITTER_NAME, 0);
+  JsVar *event = jsvObjectGetChild(wrapper, JS_ONCE_EVENT_NAME, 0);
+  JsVar *listener = jsvObjectGetChild(wrapper, JS_ONCE_LISTENER_NAME, 0);
+  if (emitter && listener) {
+    jswrap_object_removeListener(emitter, event, listener);
+    jsiExecuteEventCallbackArgsArray(emitter, listener, args);
+  }
+  jsvUnLock3(emitter, event, listener);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "Object",
+  "name" : "once",
+  "generate" : "jswrap_object_once",
+  "params" : [
+    ["event","JsVar","The name of the event, for instance 'data'"],
+    ["listener","JsVar","The listener to call when this event is received"]
+  ]
+}
+Register an event listener for this object that is removed after the first time
+it is called, for instance ```http.once('close', function() {...})```. See Node.js's EventEmitter.
+
+The listener can be removed before it is called with `removeListener(event, listener)`.
+ */
+void jswrap_object_once(JsVar *parent, JsVar *event, JsVar *listener) {
+  if (!jsvIsFunction(listener)) {
+    jsWarn("Second argument to EventEmitter.once(..) must be a function");
+    return;
+  }
+  JsVar *wrapper = jsvNewNativeFunction((void (*)(void))_jswrap_object_once_fire, JSWAT_VOID|JSWAT_THIS_ARG|(JSWAT_ARGUMENT_ARRAY<<JSWAT_BITS));
+  if (!wrapper) return; // no memory
+  // 'this' is the wrapper itself, so it can find what it's wrapping
+  jsvObjectSetChild(wrapper, JSPARSE_FUNCTION_THIS_NAME, wrapper);
+  jsvObjectSetChild(wrapper, JS_ONCE_EMITTER_NAME, parent);
+  jsvObjectSetChild(wrapper, JS_ONCE_EVENT_NAME, event);
+  jsvObjectSetChild(wrapper, JS_ONCE_LISTENER_NAME, listener);
+  jswrap_object_on(parent, event, wrapper);
+  jsvUnLock(wrapper);
+}
+
 /*JSON{
   "type" : "method",
   "class" : "Object",
@@ -621,11 +752,11 @@ void jswrap_object_emit(JsVar *parent, JsVar *event, JsVar *argArray) {
     jsWarn("First argument to EventEmitter.emit(..) must be a string");
     return;
   }
-  JsVar *eventName = jsvVarPrintf(JS_EVENT_PREFIX"%s",event);
-  if (!eventName) return; // no memory
+  JsVar *callback = jsvSkipNameAndUnLock(_jswrap_object_findEventList(parent, event, false));
+  if (!callback) return; // nothing listening, so don't bother with the arguments
 
   // extract data
-  const unsigned int MAX_ARGS = 4;
+  const unsigned int MAX_ARGS = 8;
   JsVar *args[MAX_ARGS];
   unsigned int n = 0;
   JsvObjectIterator it;
@@ -640,10 +771,7 @@ void jswrap_object_emit(JsVar *parent, JsVar *event, JsVar *argArray) {
   }
   jsvObjectIteratorFree(&it);
 
-
-  JsVar *callback = jsvSkipNameAndUnLock(jsvFindChildFromVar(parent, eventName, 0));
-  jsvUnLock(eventName);
-  if (callback) jsiQueueEvents(parent, callback, args, (int)n);
+  jsiQueueEvents(parent, callback, args, (int)n);
   jsvUnLock(callback);
 
   // unlock
@@ -676,23 +804,30 @@ void jswrap_object_removeListener(JsVar *parent, JsVar *event, JsVar *callback)
     return;
   }
   if (jsvIsString(event)) {
-    // remove the whole child containing listeners
-    JsVar *eventName = jsvVarPrintf(JS_EVENT_PREFIX"%s",event);
-    if (!eventName) return; // no memory
-    JsVar *eventListName = jsvFindChildFromVar(parent, eventName, true);
-    jsvUnLock(eventName);
+    JsVar *eventListName = _jswrap_object_findEventList(parent, event, false);
     JsVar *eventList = jsvSkipName(eventListName);
     if (eventList) {
-      if (eventList == callback) {
+      if (_jswrap_object_isListener(eventList, callback)) {
         // there's no array, it was a single item
         jsvRemoveChild(parent, eventListName);
       } else if (jsvIsArray(eventList)) {
-        // it's an array, search for the index
-        JsVar *idx = jsvGetArrayIndexOf(eventList, callback, true);
-        if (idx) {
-          jsvRemoveChild(eventList, idx);
-          jsvUnLock(idx);
+        // it's an array, search for the listener
+        JsvObjectIterator it;
+        jsvObjectIteratorNew(&it, eventList);
+        while (jsvObjectIteratorHasValue(&it)) {
+          JsVar *item = jsvObjectIteratorGetValue(&it);
+          bool found = _jswrap_object_isListener(item, callback);
+          jsvUnLock(item);
+          if (found) {
+            jsvObjectIteratorRemoveAndGotoNext(&it, eventList);
+            break;
+          }
+          jsvObjectIteratorNext(&it);
         }
+        jsvObjectIteratorFree(&it);
+        // Remove the list if it's empty, so jsiObjectHasCallbacks knows there are no listeners
+        if (!jsvGetFirstChild(eventList))
+          jsvRemoveChild(parent, eventListName);
       }
       jsvUnLock(eventList);
     }
@@ -721,11 +856,7 @@ void jswrap_object_removeAllListeners(JsVar *parent, JsVar *event) {
   }
   if (jsvIsString(event)) {
     // remove the whole child containing listeners
-    JsVar *eventName = jsvVarPrintf(JS_EVENT_PREFIX"%s",event);
-    if (!eventName) return; // no memory
-
-    JsVar *eventList = jsvFindChildFromVar(parent, eventName, true);
-    jsvUnLock(eventName);
+    JsVar *eventList = _jswrap_object_findEventList(parent, event, false);
     if (eventList) {
       jsvRemoveChild(parent, eventList);
       jsvUnLock(eventList);
@@ -888,8 +1019,10 @@ JsVar *jswrap_function_bind(JsVar *parent, JsVar *thisArg, JsVar *argsArray) {
   JsVar *fn;
   if (jsvIsNativeFunction(parent))
     fn = jsvNewNativeFunction(parent->varData.native.ptr, parent->varData.native.argTypes);
-  else
+  else {
     fn = jsvNewWithFlags(jsvIsFunctionReturn(parent) ? JSV_FUNCTION_RETURN : JSV_FUNCTION);
+    if (fn) fn->varData.function = parent->varData.function; // we share its code
+  }
   if (!fn) return 0;
 
   // Old function info
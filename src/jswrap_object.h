@@ -31,6 +31,7 @@ JsVar *jswrap_object_keys_or_property_names(
     JsVar *obj,
     bool includeNonEnumerable,
     bool includePrototype);
+JsVar *jswrap_object_values_or_entries(JsVar *object, bool returnEntries);
 JsVar *jswrap_object_create(JsVar *proto, JsVar *propertiesObject);
 JsVar *jswrap_object_getOwnPropertyDescriptor(JsVar *parent, JsVar *name);
 bool jswrap_object_hasOwnProperty(JsVar *parent, JsVar *name);
@@ -40,6 +41,7 @@ JsVar *jswrap_object_getPrototypeOf(JsVar *object);
 JsVar *jswrap_object_setPrototypeOf(JsVar *object, JsVar *proto);
 
 void jswrap_object_on(JsVar *parent, JsVar *event, JsVar *listener);
+void jswrap_object_once(JsVar *parent, JsVar *event, JsVar *listener);
 void jswrap_object_emit(JsVar *parent, JsVar *event, JsVar *argArray);
 void jswrap_object_removeListener(JsVar *parent, JsVar *event, JsVar *callback);
 void jswrap_object_removeAllListeners(JsVar *parent, JsVar *event);
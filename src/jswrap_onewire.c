@@ -29,8 +29,11 @@ static Pin onewire_getpin(JsVar *parent) {
 }
 
 
+/* The bit timing functions are CALLED_FROM_INTERRUPT so that on the ESP8266 they're
+ * in IRAM, and a flash cache miss can't stretch a pulse. */
+
 /** Reset one-wire, return true if a device was present */
-static bool NO_INLINE OneWireReset(Pin pin) {
+static bool NO_INLINE CALLED_FROM_INTERRUPT OneWireReset(Pin pin) {
   jshPinSetState(pin, JSHPINSTATE_GPIO_OUT_OPENDRAIN);
   //jshInterruptOff();
   jshPinSetValue(pin, 0);
@@ -44,7 +47,7 @@ static bool NO_INLINE OneWireReset(Pin pin) {
 }
 
 /** Write 'bits' bits, and return what was read (to read, you must send all 1s) */
-static JsVarInt NO_INLINE OneWireRead(Pin pin, int bits) {
+static JsVarInt NO_INLINE CALLED_FROM_INTERRUPT OneWireRead(Pin pin, int bits) {
   jshPinSetState(pin, JSHPINSTATE_GPIO_OUT_OPENDRAIN);
   JsVarInt result = 0;
   JsVarInt mask = 1;
@@ -65,7 +68,7 @@ static JsVarInt NO_INLINE OneWireRead(Pin pin, int bits) {
 }
 
 /** Write 'bits' bits, and return what was read (to read, you must send all 1s) */
-static void NO_INLINE OneWireWrite(Pin pin, int bits, unsigned long long data) {
+static void NO_INLINE CALLED_FROM_INTERRUPT OneWireWrite(Pin pin, int bits, unsigned long long data) {
   jshPinSetState(pin, JSHPINSTATE_GPIO_OUT_OPENDRAIN);
   unsigned long long mask = 1;
   while (bits-- > 0) {
@@ -88,6 +91,53 @@ static void NO_INLINE OneWireWrite(Pin pin, int bits, unsigned long long data) {
   }
 }
 
+/** Decode a ROM address string (as returned by search) - returns false if it's not valid */
+static bool onewire_getrom(JsVar *rom, unsigned long long *romdata) {
+  if (!jsvIsString(rom) || jsvGetStringLength(rom)!=16) {
+    jsWarn("Invalid OneWire device address");
+    return false;
+  }
+  *romdata = 0;
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, rom, 0);
+  int i;
+  for (i=0;i<8;i++) {
+    char b[3];
+    b[0] = jsvStringIteratorGetChar(&it);
+    jsvStringIteratorNext(&it);
+    b[1] = jsvStringIteratorGetChar(&it);
+    jsvStringIteratorNext(&it);
+    b[2] = 0;
+    *romdata = *romdata | (((unsigned long long)stringToIntWithRadix(b,16,0)) << (i*8));
+
+  }
+  jsvStringIteratorFree(&it);
+  return true;
+}
+
+/** Reset, then select the device with the given ROM */
+static void OneWireSelect(Pin pin, unsigned long long romdata) {
+  OneWireReset(pin);
+  OneWireWrite(pin, 8, 0x55);
+  OneWireWrite(pin, 64, romdata);
+}
+
+/** The Dallas/Maxim CRC8 of 'len' bytes */
+static unsigned char OneWireCRC8(unsigned char *data, int len) {
+  unsigned char crc = 0;
+  while (len--) {
+    unsigned char b = *data++;
+    int i;
+    for (i=0;i<8;i++) {
+      bool mix = (crc ^ b) & 1;
+      crc >>= 1;
+      if (mix) crc ^= 0x8C;
+      b >>= 1;
+    }
+  }
+  return crc;
+}
+
 /*JSON{
   "type" : "constructor",
   "class" : "OneWire",
@@ -137,34 +187,9 @@ Select a ROM - always performs a reset first
 void jswrap_onewire_select(JsVar *parent, JsVar *rom) {
   Pin pin = onewire_getpin(parent);
   if (!jshIsPinValid(pin)) return;
-  if (!jsvIsString(rom) || jsvGetStringLength(rom)!=16) {
-    jsWarn("Invalid OneWire device address");
-    return;
-  }
-
-  // perform a reset
-  OneWireReset(pin);
-
-  // decode the address
-  unsigned long long romdata = 0;
-  JsvStringIterator it;
-  jsvStringIteratorNew(&it, rom, 0);
-  int i;
-  for (i=0;i<8;i++) {
-    char b[3];
-    b[0] = jsvStringIteratorGetChar(&it);
-    jsvStringIteratorNext(&it);
-    b[1] = jsvStringIteratorGetChar(&it);
-    jsvStringIteratorNext(&it);
-    b[2] = 0;
-    romdata = romdata | (((unsigned long long)stringToIntWithRadix(b,16,0)) << (i*8));
-
-  }
-  jsvStringIteratorFree(&it);
-
-  // finally write data out
-  OneWireWrite(pin, 8, 0x55);
-  OneWireWrite(pin, 64, romdata);
+  unsigned long long romdata;
+  if (!onewire_getrom(rom, &romdata)) return;
+  OneWireSelect(pin, romdata);
 }
 
 /*JSON{
@@ -423,3 +448,72 @@ JsVar *jswrap_onewire_search(JsVar *parent, int command) {
   return array;
 }
 
+/*JSON{
+  "type" : "method",
+  "class" : "OneWire",
+  "name" : "readAll",
+  "generate" : "jswrap_onewire_readAll",
+  "params" : [
+    ["command","int32","The command byte to send to each device (eg. `0xBE` to read a DS18B20's scratchpad)"],
+    ["count","int32","The number of bytes to read from each device, including a CRC8 in the last byte"],
+    ["roms","JsVar","(optional) An array of devices to read from. If not specified, `OneWire.search()` is used to find them"]
+  ],
+  "return" : ["JsVar","A Uint8Array with `count` bytes for each device, in the same order as `roms`"]
+}
+Select each device in turn, send `command`, and read `count` bytes back - all without returning to JavaScript.
+
+The last of each device's bytes must be a CRC8 of the others (as with a DS18B20 scratchpad). If the CRC
+doesn't match (or the device doesn't respond), all that device's bytes are set to `0xFF`.
+ */
+JsVar *jswrap_onewire_readAll(JsVar *parent, int command, int count, JsVar *roms) {
+  Pin pin = onewire_getpin(parent);
+  if (!jshIsPinValid(pin)) return 0;
+  if (count<=0 || count>255) {
+    jsExceptionHere(JSET_ERROR, "Invalid count %d", count);
+    return 0;
+  }
+
+  JsVar *devices = jsvIsUndefined(roms) ? jswrap_onewire_search(parent, 0) : jsvLockAgain(roms);
+  if (!jsvIsArray(devices)) {
+    jsExceptionHere(JSET_ERROR, "Expecting an array of ROMs, got %t", devices);
+    jsvUnLock(devices);
+    return 0;
+  }
+  int nDevices = (int)jsvGetArrayLength(devices);
+  JsVar *arr = jsvNewTypedArray(ARRAYBUFFERVIEW_UINT8, nDevices*count);
+  if (!arr) {
+    jsvUnLock(devices);
+    return 0;
+  }
+
+  unsigned char buf[255];
+  JsvArrayBufferIterator ait;
+  jsvArrayBufferIteratorNew(&ait, arr, 0);
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, devices);
+  while (jsvObjectIteratorHasValue(&it)) {
+    JsVar *rom = jsvObjectIteratorGetValue(&it);
+    unsigned long long romdata;
+    bool ok = onewire_getrom(rom, &romdata);
+    jsvUnLock(rom);
+    if (ok) {
+      OneWireSelect(pin, romdata);
+      OneWireWrite(pin, 8, (unsigned long long)command);
+      int i;
+      for (i=0;i<count;i++)
+        buf[i] = (unsigned char)OneWireRead(pin, 8);
+      ok = OneWireCRC8(buf, count-1) == buf[count-1];
+    }
+    if (!ok) memset(buf, 0xFF, (size_t)count);
+    int i;
+    for (i=0;i<count;i++) {
+      jsvArrayBufferIteratorSetByteValue(&ait, (char)buf[i]);
+      jsvArrayBufferIteratorNext(&ait);
+    }
+    jsvObjectIteratorNext(&it);
+  }
+  jsvObjectIteratorFree(&it);
+  jsvArrayBufferIteratorFree(&ait);
+  jsvUnLock(devices);
+  return arr;
+}
@@ -23,12 +23,24 @@
  *    * When the pipe closes, unless 'end=false' on initialisation, we call
  *      'end' on destination, and 'close' on source.
  *
+ * If no chunkSize is given, it starts at 64 bytes and doubles each time the
+ * source fills a whole chunk, up to PIPE_MAX_CHUNK_SIZE. If the source has a
+ * native 'readInto' (eg. File) and the destination's 'write' is native (File,
+ * Serial, Socket - which have all copied or sent the data by the time they
+ * return) then every chunk is read into the same flat buffer, so no Strings
+ * are allocated for the transfer.
+ *
  * ----------------------------------------------------------------------------
  */
 
 #include "jswrap_pipe.h"
 #include "jswrap_object.h"
 #include "jswrap_stream.h"
+#include "jswrap_arraybuffer.h"
+
+#ifndef PIPE_MAX_CHUNK_SIZE
+#define PIPE_MAX_CHUNK_SIZE 512
+#endif
 
 static JsVar* pipeGetArray(bool create) {
   return jsvObjectGetChild(execInfo.hiddenRoot, "pipes", create ? JSV_ARRAY : 0);
@@ -42,9 +54,8 @@ static void handlePipeClose(JsVar *arr, JsvObjectIterator *it, JsVar* pipe) {
   JsVar *source = jsvObjectGetChild(pipe,"source",0);
   JsVar *destination = jsvObjectGetChild(pipe,"destination",0);
   if (source && destination) {
-    JsVar *buffer = jsvObjectGetChild(source, STREAM_BUFFER_NAME, 0);
-    if (buffer && jsvGetStringLength(buffer)) {
-      jsvObjectSetChild(source, STREAM_BUFFER_NAME, 0); // remove outstanding data
+    JsVar *buffer = jswrap_stream_takeData(source); // remove outstanding data
+    if (buffer) {
       /* call write fn - we ignore drain/etc here because the source has
       just closed and we want to get this sorted quickly */
       JsVar *writeFunc = jspGetNamedField(destination, "write", false);
@@ -54,7 +65,7 @@ static void handlePipeClose(JsVar *arr, JsvObjectIterator *it, JsVar* pipe) {
       jsvUnLock(writeFunc);
       // update position
       JsVar *position = jsvObjectGetChild(pipe,"position",0);
-      jsvSetInteger(position, jsvGetInteger(position) + (JsVarInt)jsvGetStringLength(buffer));
+      jsvObjectSetChildAndUnLock(pipe,"position",jsvNewFromInteger(jsvGetInteger(position) + (JsVarInt)jsvGetStringLength(buffer)));
       jsvUnLock(position);
     }
     jsvUnLock(buffer);
@@ -97,6 +108,23 @@ static void handlePipeClose(JsVar *arr, JsvObjectIterator *it, JsVar* pipe) {
   jsvUnLock(idx);
 }
 
+/// The source filled a whole chunk, so double the chunk size (up to chunkMax) to get through the data in fewer steps
+static void pipeGrowChunkSize(JsVar *pipe, JsVarInt chunkSize) {
+  JsVarInt chunkMax = jsvGetIntegerAndUnLock(jsvObjectGetChild(pipe,"chunkMax",0));
+  if (chunkSize >= chunkMax) return;
+  chunkSize *= 2;
+  if (chunkSize > chunkMax) chunkSize = chunkMax;
+  JsVar *reuseBuffer = jsvObjectGetChild(pipe,"buffer",0);
+  if (reuseBuffer) {
+    jsvUnLock(reuseBuffer);
+    char *ptr;
+    reuseBuffer = jsvNewArrayBufferWithPtr((unsigned int)chunkSize, &ptr);
+    if (!reuseBuffer) return; // not enough memory - just keep the old size
+    jsvObjectSetChildAndUnLock(pipe,"buffer",reuseBuffer);
+  }
+  jsvObjectSetChildAndUnLock(pipe,"chunkSize",jsvNewFromInteger(chunkSize));
+}
+
 static bool handlePipe(JsVar *arr, JsvObjectIterator *it, JsVar* pipe) {
   bool paused = jsvGetBoolAndUnLock(jsvObjectGetChild(pipe,"drainWait",0));
   if (paused) return false;
@@ -108,12 +136,27 @@ static bool handlePipe(JsVar *arr, JsvObjectIterator *it, JsVar* pipe) {
 
   bool dataTransferred = false;
   if(source && destination && chunkSize && position) {
-    JsVar *readFunc = jspGetNamedField(source, "read", false);
+    JsVar *reuseBuffer = jsvObjectGetChild(pipe,"buffer",0);
+    JsVar *readFunc = jspGetNamedField(source, reuseBuffer ? "readInto" : "read", false);
     JsVar *writeFunc = jspGetNamedField(destination, "write", false);
     if (jsvIsFunction(readFunc) && jsvIsFunction(writeFunc)) { // do the objects have the necessary methods on them?
-      JsVar *buffer = jspExecuteFunction(readFunc, source, 1, &chunkSize);
+      JsVar *buffer = 0;
+      bool filledChunk = false;
+      if (reuseBuffer) {
+        // read into our buffer, and only make a new view of it if we got less than a whole chunk
+        JsVar *args[3] = { reuseBuffer, jsvNewFromInteger(0), chunkSize };
+        JsVarInt len = jsvGetIntegerAndUnLock(jspExecuteFunction(readFunc, source, 3, args));
+        jsvUnLock(args[1]);
+        filledChunk = len >= jsvGetInteger(chunkSize);
+        if (filledChunk)
+          buffer = jsvLockAgain(reuseBuffer);
+        else if (len > 0)
+          buffer = jswrap_typedarray_constructor(ARRAYBUFFERVIEW_UINT8, reuseBuffer, 0, len);
+      } else
+        buffer = jspExecuteFunction(readFunc, source, 1, &chunkSize);
       if(buffer) {
         JsVarInt bufferSize = jsvGetLength(buffer);
+        if (!reuseBuffer) filledChunk = bufferSize >= jsvGetInteger(chunkSize);
         if (bufferSize>0) {
           JsVar *response = jspExecuteFunction(writeFunc, destination, 1, &buffer);
           if (jsvIsBoolean(response) && jsvGetBool(response)==false) {
@@ -121,7 +164,8 @@ static bool handlePipe(JsVar *arr, JsvObjectIterator *it, JsVar* pipe) {
             jsvObjectSetChildAndUnLock(pipe,"drainWait",jsvNewFromBool(true));
           }
           jsvUnLock(response);
-          jsvSetInteger(position, jsvGetInteger(position) + bufferSize);
+          jsvObjectSetChildAndUnLock(pipe,"position",jsvNewFromInteger(jsvGetInteger(position) + bufferSize));
+          if (filledChunk) pipeGrowChunkSize(pipe, jsvGetInteger(chunkSize));
         }
         jsvUnLock(buffer);
         dataTransferred = true; // so we don't close the pipe if we get an empty string
@@ -132,7 +176,7 @@ static bool handlePipe(JsVar *arr, JsvObjectIterator *it, JsVar* pipe) {
       if(!jsvIsFunction(writeFunc))
         jsExceptionHere(JSET_ERROR, "Destination Stream does not implement the required write(buffer) method.");
     }
-    jsvUnLock2(readFunc, writeFunc);
+    jsvUnLock3(readFunc, writeFunc, reuseBuffer);
   }
 
   if(!dataTransferred) { // when no more chunks are possible, execute the callback
@@ -242,7 +286,7 @@ static void jswrap_pipe_dst_close_listener(JsVar *destination) {
   "params" : [
     ["source","JsVar","The source file/stream that will send content."],
     ["destination","JsVar","The destination file/stream that will receive content from the source."],
-    ["options","JsVar",["An optional object `{ chunkSize : int=64, end : bool=true, complete : function }`","chunkSize : The amount of data to pipe from source to destination at a time","complete : a function to call when the pipe activity is complete","end : call the 'end' function on the destination when the source is finished"]]
+    ["options","JsVar",["An optional object `{ chunkSize : int=64, end : bool=true, complete : function, reuseBuffer : bool }`","chunkSize : The amount of data to pipe from source to destination at a time. If not specified, this starts at 64 bytes and grows (up to 512 bytes) while the source has more data","complete : a function to call when the pipe activity is complete","end : call the 'end' function on the destination when the source is finished","reuseBuffer : if the source has a `readInto(buffer,offset,length)` method (eg. a File), read each chunk into the same buffer rather than allocating a new String. Only use this if the destination has finished with the data by the time `write` returns. This is done automatically if the destination is a built-in File, Serial or Socket, and can be disabled with `reuseBuffer:false`"]]
   ]
 }*/
 void jswrap_pipe(JsVar* source, JsVar* dest, JsVar* options) {
@@ -256,7 +300,11 @@ void jswrap_pipe(JsVar* source, JsVar* dest, JsVar* options) {
     if(jsvIsFunction(readFunc)) {
       if(jsvIsFunction(writeFunc)) {
         JsVarInt chunkSize = 64;
+        JsVarInt chunkMax = PIPE_MAX_CHUNK_SIZE;
         bool callEnd = true;
+        JsVar *readIntoFunc = jspGetNamedField(source, "readInto", false);
+        // Native destinations are done with the data when 'write' returns, so we can reuse the buffer
+        bool reuseBuffer = jsvIsNativeFunction(readIntoFunc) && jsvIsNativeFunction(writeFunc);
         // parse Options Object
         if (jsvIsObject(options)) {
           JsVar *c;
@@ -267,10 +315,12 @@ void jswrap_pipe(JsVar* source, JsVar* dest, JsVar* options) {
           }
           c = jsvObjectGetChild(options, "end", false);
           if (c) callEnd = jsvGetBoolAndUnLock(c);
+          c = jsvObjectGetChild(options, "reuseBuffer", false);
+          if (c) reuseBuffer = jsvGetBoolAndUnLock(c);
           c = jsvObjectGetChild(options, "chunkSize", false);
           if (c) {
             if (jsvIsNumeric(c) && jsvGetInteger(c)>0)
-              chunkSize = jsvGetInteger(c);
+              chunkMax = chunkSize = jsvGetInteger(c);
             else
               jsExceptionHere(JSET_TYPEERROR, "chunkSize must be an integer > 0");
             jsvUnLock(c);
@@ -284,7 +334,14 @@ void jswrap_pipe(JsVar* source, JsVar* dest, JsVar* options) {
         jswrap_object_addEventListener(dest, "close", jswrap_pipe_dst_close_listener, JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)));
         // set up the rest of the pipe
         jsvObjectSetChildAndUnLock(pipe, "chunkSize", jsvNewFromInteger(chunkSize));
+        jsvObjectSetChildAndUnLock(pipe, "chunkMax", jsvNewFromInteger(chunkMax));
         jsvObjectSetChildAndUnLock(pipe, "end", jsvNewFromBool(callEnd));
+        if (reuseBuffer && jsvIsFunction(readIntoFunc)) {
+          // one flat buffer that every chunk is read into
+          char *ptr;
+          jsvObjectSetChildAndUnLock(pipe, "buffer", jsvNewArrayBufferWithPtr((unsigned int)chunkSize, &ptr));
+        }
+        jsvUnLock(readIntoFunc);
         jsvUnLock3(jsvAddNamedChild(pipe, position, "position"), 
                    jsvAddNamedChild(pipe, source, "source"), 
                    jsvAddNamedChild(pipe, dest, "destination"));
@@ -122,6 +122,7 @@ Run a Garbage Collection pass, and return an object containing information on me
 * `usage` : Memory that has been used (in blocks)
 * `total` : Total memory (in blocks)
 * `history` : Memory used for command history - that is freed if memory is low. Note that this is INCLUDED in the figure for 'free'
+* `lookupHits`/`lookupMisses` : The number of object property lookups that were/weren't found in Espruino's lookup cache
 * `stackEndAddress` : (on ARM) the address (that can be used with peek/poke/etc) of the END of the stack. The stack grows down, so unless you do a lot of recursion the bytes above this can be used.
 * `flash_start` : (on ARM) the address of the start of flash memory (usually `0x8000000`)
 * `flash_binary_end` : (on ARM) the address in flash memory of the end of Espruino's firmware.
@@ -130,6 +131,8 @@ Run a Garbage Collection pass, and return an object containing information on me
 
 Memory units are specified in 'blocks', which are around 16 bytes each (depending on your device). See http://www.espruino.com/Performance for more information.
 
+To see how fragmented memory is, and what is using it, see `E.getMemoryMap()`
+
 **Note:** To find free areas of flash memory, see `require('Flash').getFree()`
  */
 JsVar *jswrap_process_memory() {
@@ -148,6 +151,12 @@ JsVar *jswrap_process_memory() {
     jsvObjectSetChildAndUnLock(obj, "usage", jsvNewFromInteger((JsVarInt)usage));
     jsvObjectSetChildAndUnLock(obj, "total", jsvNewFromInteger((JsVarInt)total));
     jsvObjectSetChildAndUnLock(obj, "history", jsvNewFromInteger((JsVarInt)history));
+#ifndef SAVE_ON_FLASH
+    unsigned int lookupHits, lookupMisses;
+    jsvGetLookupCacheStats(&lookupHits, &lookupMisses);
+    jsvObjectSetChildAndUnLock(obj, "lookupHits", jsvNewFromInteger((JsVarInt)lookupHits));
+    jsvObjectSetChildAndUnLock(obj, "lookupMisses", jsvNewFromInteger((JsVarInt)lookupMisses));
+#endif
 
 #ifdef ARM
     extern int LINKER_END_VAR; // end of ram used (variables) - should be 'void', but 'int' avoids warnings
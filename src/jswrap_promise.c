@@ -22,7 +22,8 @@
 #define JS_PROMISE_CATCH_NAME JS_HIDDEN_CHAR_STR"cat"
 #define JS_PROMISE_COUNT_NAME JS_HIDDEN_CHAR_STR"cnt"
 #define JS_PROMISE_RESULT_NAME JS_HIDDEN_CHAR_STR"res"
-
+#define JS_PROMISE_RESOLVED_NAME JS_HIDDEN_CHAR_STR"rsv" // the value, once resolved
+#define JS_PROMISE_REJECTED_NAME JS_HIDDEN_CHAR_STR"rjt" // the reason, once rejected
 
 /*JSON{
   "type" : "class",
@@ -32,30 +33,48 @@
 This is the built-in class for ES6 Promises
 */
 
-void _jswrap_promise_resolve(JsVar *promise, JsVar *data) {
-  JsVar *fn = jsvObjectGetChild(promise, JS_PROMISE_THEN_NAME, 0);
-  jsiExecuteEventCallback(promise, fn, 1, &data);
-  jsvUnLock(fn);
+/// Return the name holding the value of a settled promise (locked), or 0 if it's still pending
+static JsVar *_jswrap_promise_getSettled(JsVar *promise, bool *isRejected) {
+  JsVar *n = jsvFindChildFromString(promise, JS_PROMISE_RESOLVED_NAME, false);
+  *isRejected = !n;
+  if (!n) n = jsvFindChildFromString(promise, JS_PROMISE_REJECTED_NAME, false);
+  return n;
 }
-void _jswrap_promise_queueresolve(JsVar *promise, JsVar *data) {
-  JsVar *fn = jsvNewNativeFunction((void (*)(void))_jswrap_promise_resolve, JSWAT_VOID|JSWAT_THIS_ARG|(JSWAT_JSVAR<<JSWAT_BITS));
-  if (!fn) return;
-  jsvObjectSetChild(fn, JSPARSE_FUNCTION_THIS_NAME, promise);
-  jsiQueueEvents(promise, fn, &data, 1);
-  jsvUnLock(fn);
+
+static void _jswrap_promise_removeChild(JsVar *promise, const char *name) {
+  JsVar *n = jsvFindChildFromString(promise, name, false);
+  if (n) {
+    jsvRemoveChild(promise, n);
+    jsvUnLock(n);
+  }
+}
+
+/** Resolve or reject a promise. The callbacks it has are queued as a microtask
+ * (so they're run as soon as the current event has finished) and are then
+ * forgotten - any added later get queued as soon as they are added. */
+static void _jswrap_promise_settle(JsVar *promise, JsVar *data, bool isRejected) {
+  bool wasRejected;
+  JsVar *settled = _jswrap_promise_getSettled(promise, &wasRejected);
+  if (settled) { // can only be settled once
+    jsvUnLock(settled);
+    return;
+  }
+  jsvObjectSetChild(promise, isRejected ? JS_PROMISE_REJECTED_NAME : JS_PROMISE_RESOLVED_NAME, data);
+  JsVar *fn = jsvObjectGetChild(promise, isRejected ? JS_PROMISE_CATCH_NAME : JS_PROMISE_THEN_NAME, 0);
+  if (fn) {
+    jsiQueueMicrotask(promise, fn, &data, 1);
+    jsvUnLock(fn);
+  }
+  _jswrap_promise_removeChild(promise, JS_PROMISE_THEN_NAME);
+  _jswrap_promise_removeChild(promise, JS_PROMISE_CATCH_NAME);
 }
 
-void _jswrap_promise_reject(JsVar *promise, JsVar *data) {
-  JsVar *fn = jsvObjectGetChild(promise, JS_PROMISE_CATCH_NAME, 0);
-  jsiExecuteEventCallback(promise, fn, 1, &data);
-  jsvUnLock(fn);
+void _jswrap_promise_queueresolve(JsVar *promise, JsVar *data) {
+  _jswrap_promise_settle(promise, data, false);
 }
+
 void _jswrap_promise_queuereject(JsVar *promise, JsVar *data) {
-  JsVar *fn = jsvNewNativeFunction((void (*)(void))_jswrap_promise_reject, JSWAT_VOID|JSWAT_THIS_ARG|(JSWAT_JSVAR<<JSWAT_BITS));
-  if (!fn) return;
-  jsvObjectSetChild(fn, JSPARSE_FUNCTION_THIS_NAME, promise);
-  jsiQueueEvents(promise, fn, &data, 1);
-  jsvUnLock(fn);
+  _jswrap_promise_settle(promise, data, true);
 }
 
 void jswrap_promise_all_resolve(JsVar *promise, JsVar *data) {
@@ -169,8 +188,8 @@ JsVar *jswrap_promise_all(JsVar *arr) {
   ],
   "return" : ["JsVar","A new Promise"]
 }
-Return a new promise that is already resolved (at idle it'll
-call `.then`)
+Return a new promise that is already resolved (once the current
+code has finished executing it'll call `.then`)
 */
 JsVar *jswrap_promise_resolve(JsVar *data) {
   JsVar *promise = jspNewObject(0, "Promise");
@@ -190,8 +209,8 @@ JsVar *jswrap_promise_resolve(JsVar *data) {
   ],
   "return" : ["JsVar","A new Promise"]
 }
-Return a new promise that is already rejected (at idle it'll
-call `.catch`)
+Return a new promise that is already rejected (once the current
+code has finished executing it'll call `.catch`)
 */
 JsVar *jswrap_promise_reject(JsVar *data) {
   JsVar *promise = jspNewObject(0, "Promise");
@@ -200,11 +219,24 @@ JsVar *jswrap_promise_reject(JsVar *data) {
   return promise;
 }
 
-void _jswrap_promise_add(JsVar *parent, JsVar *callback, const char *name) {
+void _jswrap_promise_add(JsVar *parent, JsVar *callback, bool isCatch) {
   if (!jsvIsFunction(callback)) {
     jsExceptionHere(JSET_TYPEERROR, "Callback must be a function, got %t", callback);
     return;
   }
+  bool isRejected;
+  JsVar *settled = _jswrap_promise_getSettled(parent, &isRejected);
+  if (settled) {
+    // Already settled, so the callback can be queued right away
+    if (isRejected == isCatch) {
+      JsVar *value = jsvSkipName(settled);
+      jsiQueueMicrotask(parent, callback, &value, 1);
+      jsvUnLock(value);
+    }
+    jsvUnLock(settled);
+    return;
+  }
+  const char *name = isCatch ? JS_PROMISE_CATCH_NAME : JS_PROMISE_THEN_NAME;
   JsVar *c = jsvObjectGetChild(parent, name, 0);
   if (!c) {
     jsvObjectSetChild(parent, name, callback);
@@ -234,7 +266,7 @@ void _jswrap_promise_add(JsVar *parent, JsVar *callback, const char *name) {
 }
  */
 JsVar *jswrap_promise_then(JsVar *parent, JsVar *callback) {
-  _jswrap_promise_add(parent, callback, JS_PROMISE_THEN_NAME);
+  _jswrap_promise_add(parent, callback, false);
   return jsvLockAgain(parent);
 }
 
@@ -251,6 +283,6 @@ JsVar *jswrap_promise_then(JsVar *parent, JsVar *callback) {
 }
  */
 JsVar *jswrap_promise_catch(JsVar *parent, JsVar *callback) {
-  _jswrap_promise_add(parent, callback, JS_PROMISE_CATCH_NAME);
+  _jswrap_promise_add(parent, callback, true);
   return jsvLockAgain(parent);
 }
@@ -0,0 +1,936 @@
+/*
+ * This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+ *
+ * Copyright (C) 2013 Gordon Williams <gw@pur3.co.uk>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * ----------------------------------------------------------------------------
+ * This file is designed to be parsed during the build process
+ *
+ * JavaScript RegExp Functions
+ *
+ * Patterns are compiled once (when the RegExp is created) into bytecode for
+ * a Pike VM, which is stored in a flat string on the RegExp. The VM runs all
+ * the possible ways of matching side by side, so it reads the string just
+ * once, forwards, with a single string iterator, and the time taken is
+ * linear in the length of the string - there's no backtracking to blow up.
+ * ----------------------------------------------------------------------------
+ */
+#include "jswrap_regexp.h"
+#include "jsparse.h"
+#include "jsvariterator.h"
+
+#define REGEXP_CODE_NAME JS_HIDDEN_CHAR_STR"re"
+#define REGEXP_MAX_GROUPS 10 ///< capture groups, including the whole match
+#define REGEXP_MAX_REPEAT 100 ///< biggest number allowed in {n,m}
+#ifndef REGEXP_MAX_STEPS
+#define REGEXP_MAX_STEPS 1000000 ///< after this many VM steps we give up on a match
+#endif
+
+// The compiled code starts with a header of flags, then the number of groups
+#define REGEXP_FLAG_GLOBAL     1
+#define REGEXP_FLAG_IGNORECASE 2
+#define REGEXP_FLAG_MULTILINE  4
+#define REGEXP_HEADER_SIZE     2
+
+typedef enum {
+  RE_MATCH,  ///< the whole pattern has matched
+  RE_CHAR,   ///< [ch] match a character
+  RE_ANY,    ///< match any character except newlines
+  RE_CLASS,  ///< [32 byte bitmap] match any character in the set
+  RE_SPLIT,  ///< [x:16 y:16] carry on at both x and y (relative to this op), preferring x
+  RE_JMP,    ///< [x:16] carry on at x (relative to this op)
+  RE_SAVE,   ///< [n] store the current position in capture slot n
+  RE_BOL,    ///< start of the string (or line if multiline)
+  RE_EOL,    ///< end of the string (or line if multiline)
+  RE_WORDB,  ///< word boundary
+  RE_NWORDB, ///< not a word boundary
+} RegExpOp;
+
+static int regexpOpLength(unsigned char op) {
+  switch (op) {
+  case RE_CHAR:
+  case RE_SAVE: return 2;
+  case RE_CLASS: return 33;
+  case RE_SPLIT: return 5;
+  case RE_JMP: return 3;
+  default: return 1;
+  }
+}
+
+static int regexpGet16(const unsigned char *p) {
+  return (int16_t)(p[0] | (p[1]<<8));
+}
+
+static char regexpLowerCase(char ch) {
+  return (ch>='A' && ch<='Z') ? (char)(ch+'a'-'A') : ch;
+}
+
+static bool regexpIsWordChar(int ch) {
+  return (ch>='a' && ch<='z') || (ch>='A' && ch<='Z') || (ch>='0' && ch<='9') || ch=='_';
+}
+
+// --------------------------------------------------------------------------------------------
+
+typedef struct {
+  const char *p, *end;  ///< the part of the pattern still to compile
+  unsigned char *code;  ///< where to write code, or 0 if we're only working out how long it is
+  size_t len;           ///< length of the code so far
+  unsigned char flags;
+  unsigned char groups; ///< capture groups so far, including the whole match
+  const char *error;
+} RegExpCompiler;
+
+static void regexpEmit(RegExpCompiler *c, int b) {
+  if (c->code) c->code[c->len] = (unsigned char)b;
+  c->len++;
+}
+
+/// Write a JMP or SPLIT into space we've already made at 'at'
+static void regexpPutJump(RegExpCompiler *c, size_t at, RegExpOp op, int x, int y) {
+  if (!c->code) return;
+  unsigned char *p = &c->code[at];
+  p[0] = (unsigned char)op;
+  p[1] = (unsigned char)x;
+  p[2] = (unsigned char)(x>>8);
+  if (op==RE_SPLIT) {
+    p[3] = (unsigned char)y;
+    p[4] = (unsigned char)(y>>8);
+  }
+}
+
+/// Make room for n bytes at 'at', so we can put an op before code we've already compiled
+static void regexpInsert(RegExpCompiler *c, size_t at, size_t n) {
+  if (c->code) memmove(&c->code[at+n], &c->code[at], c->len-at);
+  c->len += n;
+}
+
+/// Append a copy of the code at 'from'
+static void regexpCopy(RegExpCompiler *c, size_t from, size_t n) {
+  if (c->code) memcpy(&c->code[c->len], &c->code[from], n);
+  c->len += n;
+}
+
+static void regexpEmitChar(RegExpCompiler *c, char ch) {
+  regexpEmit(c, RE_CHAR);
+  regexpEmit(c, (c->flags&REGEXP_FLAG_IGNORECASE) ? regexpLowerCase(ch) : ch);
+}
+
+static void regexpSetAdd(unsigned char *set, int ch) {
+  set[(ch>>3)&31] |= (unsigned char)(1<<(ch&7));
+}
+
+/// Add the characters for \d, \w, \s (or their inverses) to a set
+static void regexpSetAddEscape(unsigned char *set, char e) {
+  unsigned char s[32];
+  memset(s, 0, sizeof(s));
+  int ch;
+  for (ch=0;ch<256;ch++) {
+    char l = regexpLowerCase(e);
+    if ((l=='d' && ch>='0' && ch<='9') ||
+        (l=='w' && regexpIsWordChar(ch)) ||
+        (l=='s' && (ch==' ' || (ch>=9 && ch<=13) || ch==0xA0)))
+      regexpSetAdd(s, ch);
+  }
+  for (ch=0;ch<32;ch++)
+    set[ch] |= (e>='A' && e<='Z') ? (unsigned char)~s[ch] : s[ch];
+}
+
+static void regexpEmitClass(RegExpCompiler *c, unsigned char *set, bool negate) {
+  int i;
+  if (c->flags&REGEXP_FLAG_IGNORECASE) {
+    for (i='A';i<='Z';i++) {
+      if (set[i>>3] & (1<<(i&7))) regexpSetAdd(set, i+'a'-'A');
+      if (set[(i+'a'-'A')>>3] & (1<<((i+'a'-'A')&7))) regexpSetAdd(set, i);
+    }
+  }
+  regexpEmit(c, RE_CLASS);
+  for (i=0;i<32;i++)
+    regexpEmit(c, negate ? (unsigned char)~set[i] : set[i]);
+}
+
+static int regexpHex(RegExpCompiler *c, int digits) {
+  int v = 0, i;
+  if (c->end - c->p < digits) return -1;
+  for (i=0;i<digits;i++) {
+    int d = chtod(c->p[i]);
+    if (d<0 || d>15) return -1;
+    v = v*16 + d;
+  }
+  c->p += digits;
+  return v;
+}
+
+/// Parse the escape after a backslash that stands for a single character
+static int regexpEscapeChar(RegExpCompiler *c) {
+  char e = *c->p++;
+  int v;
+  switch (e) {
+  case 'n': return '\n';
+  case 'r': return '\r';
+  case 't': return '\t';
+  case 'v': return '\v';
+  case 'f': return '\f';
+  case '0': return 0;
+  case 'x': v = regexpHex(c, 2); return v<0 ? 'x' : v;
+  case 'u': v = regexpHex(c, 4); return v<0 ? 'u' : (v&255); // we only have 8 bit characters
+  case 'c':
+    if (c->p<c->end && ((*c->p>='a' && *c->p<='z') || (*c->p>='A' && *c->p<='Z')))
+      return (*c->p++)&31;
+    return 'c';
+  default: return (unsigned char)e;
+  }
+}
+
+/// Compile a [...] character class (after the '[')
+static void regexpCompileClass(RegExpCompiler *c) {
+  unsigned char set[32];
+  memset(set, 0, sizeof(set));
+  bool negate = false;
+  if (c->p<c->end && *c->p=='^') {
+    negate = true;
+    c->p++;
+  }
+  while (c->p<c->end && *c->p!=']') {
+    int lo, hi;
+    if (*c->p=='\\') {
+      c->p++;
+      if (c->p>=c->end) break;
+      if (*c->p && strchr("dDwWsS", *c->p)) {
+        regexpSetAddEscape(set, *c->p++);
+        continue;
+      }
+      if (*c->p=='b') { // backspace in a class
+        c->p++;
+        lo = 8;
+      } else lo = regexpEscapeChar(c);
+    } else lo = (unsigned char)*c->p++;
+    hi = lo;
+    if (c->end-c->p>=2 && c->p[0]=='-' && c->p[1]!=']') {
+      c->p++;
+      if (*c->p=='\\') {
+        c->p++;
+        if (c->p>=c->end || (*c->p && strchr("dDwWsS", *c->p))) break;
+        hi = regexpEscapeChar(c);
+      } else hi = (unsigned char)*c->p++;
+      if (hi<lo) {
+        c->error = "Invalid range";
+        return;
+      }
+    }
+    for (;lo<=hi;lo++) regexpSetAdd(set, lo);
+  }
+  if (c->p>=c->end || *c->p!=']') {
+    c->error = "Missing ]";
+    return;
+  }
+  c->p++;
+  regexpEmitClass(c, set, negate);
+}
+
+static void regexpCompileAlternatives(RegExpCompiler *c);
+
+static void regexpCompileAtom(RegExpCompiler *c) {
+  char ch = *c->p++;
+  switch (ch) {
+  case '(': {
+    int group = -1;
+    if (c->p<c->end && *c->p=='?') {
+      if (c->end-c->p<2 || c->p[1]!=':') {
+        c->error = "Unsupported group";
+        return;
+      }
+      c->p += 2;
+    } else {
+      if (c->groups>=REGEXP_MAX_GROUPS) {
+        c->error = "Too many groups";
+        return;
+      }
+      group = c->groups++;
+      regexpEmit(c, RE_SAVE);
+      regexpEmit(c, group*2);
+    }
+    regexpCompileAlternatives(c);
+    if (c->error) return;
+    if (c->p>=c->end || *c->p!=')') {
+      c->error = "Missing )";
+      return;
+    }
+    c->p++;
+    if (group>=0) {
+      regexpEmit(c, RE_SAVE);
+      regexpEmit(c, group*2+1);
+    }
+  } break;
+  case '[': regexpCompileClass(c); break;
+  case '.': regexpEmit(c, RE_ANY); break;
+  case '^': regexpEmit(c, RE_BOL); break;
+  case '$': regexpEmit(c, RE_EOL); break;
+  case '*':
+  case '+':
+  case '?': c->error = "Nothing to repeat"; break;
+  case '\\':
+    if (c->p>=c->end) {
+      c->error = "\\ at end of pattern";
+    } else if (*c->p && strchr("dDwWsS", *c->p)) {
+      unsigned char set[32];
+      memset(set, 0, sizeof(set));
+      regexpSetAddEscape(set, *c->p++);
+      regexpEmitClass(c, set, false);
+    } else if (*c->p=='b' || *c->p=='B') {
+      regexpEmit(c, (*c->p++=='b') ? RE_WORDB : RE_NWORDB);
+    } else if (*c->p>='1' && *c->p<='9') {
+      c->error = "Backreferences not supported";
+    } else {
+      regexpEmitChar(c, (char)regexpEscapeChar(c));
+    }
+    break;
+  default: regexpEmitChar(c, ch); break;
+  }
+}
+
+/// Parse {n}, {n,} or {n,m}, returning false (and leaving it to be a literal '{') if it isn't one
+static bool regexpParseBraces(RegExpCompiler *c, int *min, int *max) {
+  const char *p = c->p+1;
+  int n = 0, m;
+  if (p>=c->end || !isNumeric(*p)) return false;
+  while (p<c->end && isNumeric(*p)) n = n*10 + (*p++ - '0');
+  m = n;
+  if (p<c->end && *p==',') {
+    p++;
+    m = -1;
+    if (p<c->end && isNumeric(*p)) {
+      m = 0;
+      while (p<c->end && isNumeric(*p)) m = m*10 + (*p++ - '0');
+    }
+  }
+  if (p>=c->end || *p!='}') return false;
+  c->p = p+1;
+  if (n>REGEXP_MAX_REPEAT || m>REGEXP_MAX_REPEAT || (m>=0 && m<n)) {
+    c->error = "Invalid repeat";
+    return false;
+  }
+  *min = n;
+  *max = m;
+  return true;
+}
+
+/** Repeat the code from 'atom' to the end between min and max (-1 = any
+ * number of) times, by making copies of it */
+static void regexpRepeat(RegExpCompiler *c, size_t atom, int min, int max, bool lazy) {
+  int L = (int)(c->len - atom);
+  size_t src = atom;
+  int i;
+  if (max==0) { // x{0} - just remove it
+    c->len = atom;
+    return;
+  }
+  if (min==1 && max<0) { // x+ - loop back
+    regexpInsert(c, c->len, 5);
+    if (lazy) regexpPutJump(c, c->len-5, RE_SPLIT, 5, -L);
+    else regexpPutJump(c, c->len-5, RE_SPLIT, -L, 5);
+    return;
+  }
+  if (min==0) {
+    // make the code we have optional
+    regexpInsert(c, atom, 5);
+    src = atom+5;
+    if (max<0) { // x* - loop back
+      if (lazy) regexpPutJump(c, atom, RE_SPLIT, 8+L, 5);
+      else regexpPutJump(c, atom, RE_SPLIT, 5, 8+L);
+      regexpInsert(c, c->len, 3);
+      regexpPutJump(c, c->len-3, RE_JMP, -(5+L), 0);
+      return;
+    }
+    if (lazy) regexpPutJump(c, atom, RE_SPLIT, 5+L, 5);
+    else regexpPutJump(c, atom, RE_SPLIT, 5, 5+L);
+  } else min--;
+  if (max>0) max--;
+  for (i=0;i<min;i++)
+    regexpCopy(c, src, (size_t)L);
+  if (max<0) { // then any number more
+    size_t at = c->len;
+    regexpInsert(c, c->len, 5);
+    if (lazy) regexpPutJump(c, at, RE_SPLIT, 8+L, 5);
+    else regexpPutJump(c, at, RE_SPLIT, 5, 8+L);
+    regexpCopy(c, src, (size_t)L);
+    regexpInsert(c, c->len, 3);
+    regexpPutJump(c, c->len-3, RE_JMP, -(5+L), 0);
+  } else {
+    for (i=min;i<max;i++) { // then optional copies
+      size_t at = c->len;
+      regexpInsert(c, c->len, 5);
+      if (lazy) regexpPutJump(c, at, RE_SPLIT, 5+L, 5);
+      else regexpPutJump(c, at, RE_SPLIT, 5, 5+L);
+      regexpCopy(c, src, (size_t)L);
+    }
+  }
+}
+
+static void regexpCompileSequence(RegExpCompiler *c) {
+  while (!c->error && c->p<c->end && *c->p!='|' && *c->p!=')') {
+    size_t atom = c->len;
+    regexpCompileAtom(c);
+    if (c->error || c->p>=c->end) return;
+    int min = -2, max = -1;
+    if (*c->p=='*') { min = 0; c->p++; }
+    else if (*c->p=='+') { min = 1; c->p++; }
+    else if (*c->p=='?') { min = 0; max = 1; c->p++; }
+    else if (*c->p=='{' && !regexpParseBraces(c, &min, &max)) min = -2;
+    if (c->error) return;
+    if (min>=0) {
+      bool lazy = c->p<c->end && *c->p=='?';
+      if (lazy) c->p++;
+      regexpRepeat(c, atom, min, max, lazy);
+    }
+  }
+}
+
+static void regexpCompileAlternatives(RegExpCompiler *c) {
+  size_t start = c->len;
+  regexpCompileSequence(c);
+  while (!c->error && c->p<c->end && *c->p=='|') {
+    c->p++;
+    // SPLIT between everything so far, and what comes after the JMP
+    int L = (int)(c->len - start);
+    regexpInsert(c, start, 5);
+    regexpPutJump(c, start, RE_SPLIT, 5, 5+L+3);
+    size_t jmp = c->len;
+    regexpInsert(c, c->len, 3);
+    regexpCompileSequence(c);
+    regexpPutJump(c, jmp, RE_JMP, (int)(c->len-jmp), 0);
+  }
+}
+
+static void regexpCompilePattern(RegExpCompiler *c) {
+  regexpEmit(c, c->flags);
+  regexpEmit(c, 0); // number of groups - filled in at the end
+  regexpEmit(c, RE_SAVE);
+  regexpEmit(c, 0);
+  regexpCompileAlternatives(c);
+  if (!c->error && c->p<c->end) c->error = "Unmatched )";
+  regexpEmit(c, RE_SAVE);
+  regexpEmit(c, 1);
+  regexpEmit(c, RE_MATCH);
+  if (c->code) c->code[1] = c->groups;
+  if (c->len > 32767) c->error = "Pattern too big";
+}
+
+/** Compile a pattern into a flat string of bytecode. Returns 0 and sets
+ * 'error' if the pattern is invalid */
+static JsVar *regexpCompile(JsVar *pattern, unsigned char flags, const char **error) {
+  size_t patternLen = jsvGetStringLength(pattern);
+  JsVar *patternFlat = 0;
+  const char *p = "";
+  if (patternLen) {
+    if (jsvIsFlatString(pattern)) {
+      patternFlat = jsvLockAgain(pattern);
+    } else {
+      patternFlat = jsvNewFlatStringOfLength((unsigned int)patternLen+1); // +1 for jsvGetStringChars' trailing 0
+      if (!patternFlat) return 0; // out of memory
+      jsvGetStringChars(pattern, 0, jsvGetFlatStringPointer(patternFlat), patternLen);
+    }
+    p = jsvGetFlatStringPointer(patternFlat);
+  }
+  RegExpCompiler c;
+  memset(&c, 0, sizeof(c));
+  c.flags = flags;
+  c.groups = 1;
+  c.p = p;
+  c.end = p+patternLen;
+  // once to find out how big the code is...
+  regexpCompilePattern(&c);
+  JsVar *code = 0;
+  if (c.error) {
+    *error = c.error;
+  } else {
+    // ...and again to write it
+    code = jsvNewFlatStringOfLength((unsigned int)c.len);
+    if (code) {
+      c.code = (unsigned char*)jsvGetFlatStringPointer(code);
+      c.len = 0;
+      c.groups = 1;
+      c.p = p;
+      regexpCompilePattern(&c);
+    }
+  }
+  jsvUnLock(patternFlat);
+  return code;
+}
+
+// --------------------------------------------------------------------------------------------
+
+typedef struct {
+  const unsigned char *code; ///< the code (after the header)
+  unsigned char flags;
+  int nsave;        ///< capture slots for each thread (2 per group)
+  int *threads[2];  ///< lists of threads waiting for a character. Each is its pc followed by its capture slots
+  int count[2];     ///< number of threads in each list
+  uint32_t *marks;  ///< marks[pc]==gen if pc is already in the list we're adding to
+  uint32_t gen;
+  int pos;          ///< index in the string of 'ch'
+  int prevCh, ch;   ///< the characters before and at pos, or -1
+  unsigned int steps;
+} RegExpMatcher;
+
+/// Add a thread at pc to the list, following any ops that don't need a character straight away
+static void regexpAddThread(RegExpMatcher *m, int list, int pc, int *caps) {
+  if (m->marks[pc]==m->gen) return;
+  m->marks[pc] = m->gen;
+  m->steps++;
+  const unsigned char *op = &m->code[pc];
+  switch (*op) {
+  case RE_JMP:
+    regexpAddThread(m, list, pc+regexpGet16(op+1), caps);
+    break;
+  case RE_SPLIT:
+    regexpAddThread(m, list, pc+regexpGet16(op+1), caps);
+    regexpAddThread(m, list, pc+regexpGet16(op+3), caps);
+    break;
+  case RE_SAVE: {
+    int old = caps[op[1]];
+    caps[op[1]] = m->pos;
+    regexpAddThread(m, list, pc+2, caps);
+    caps[op[1]] = old;
+  } break;
+  case RE_BOL:
+    if (m->prevCh<0 || ((m->flags&REGEXP_FLAG_MULTILINE) && m->prevCh=='\n'))
+      regexpAddThread(m, list, pc+1, caps);
+    break;
+  case RE_EOL:
+    if (m->ch<0 || ((m->flags&REGEXP_FLAG_MULTILINE) && m->ch=='\n'))
+      regexpAddThread(m, list, pc+1, caps);
+    break;
+  case RE_WORDB:
+  case RE_NWORDB:
+    if ((regexpIsWordChar(m->prevCh) != regexpIsWordChar(m->ch)) == (*op==RE_WORDB))
+      regexpAddThread(m, list, pc+1, caps);
+    break;
+  default: {
+    int *t = &m->threads[list][m->count[list]++ * (1+m->nsave)];
+    t[0] = pc;
+    memcpy(&t[1], caps, sizeof(int)*(size_t)m->nsave);
+  }
+  }
+}
+
+/** Search for the RegExp with the given code in str, starting at startIdx.
+ * Returns the number of groups (including the whole match) and fills in
+ * their start and end indices in 'caps' (-1 if a group didn't match), or
+ * returns 0 if there was no match. */
+static int regexpMatch(JsVar *codeVar, JsVar *str, int startIdx, int *caps) {
+  size_t codeLen = jsvGetStringLength(codeVar) - REGEXP_HEADER_SIZE;
+  const unsigned char *header = (const unsigned char*)jsvGetFlatStringPointer(codeVar);
+  RegExpMatcher m;
+  m.flags = header[0];
+  m.nsave = header[1]*2;
+  // work out how many threads could be waiting at once (one per op that needs a character)
+  int maxThreads = 0;
+  size_t pc = 0;
+  while (pc<codeLen) {
+    unsigned char op = header[REGEXP_HEADER_SIZE+pc];
+    if (op==RE_MATCH || op==RE_CHAR || op==RE_ANY || op==RE_CLASS) maxThreads++;
+    pc += (size_t)regexpOpLength(op);
+  }
+  size_t listSize = (size_t)maxThreads * (size_t)(1+m.nsave);
+  JsVar *scratch = jsvNewFlatStringOfLength((unsigned int)(sizeof(int)*(listSize*2 + (size_t)m.nsave) + sizeof(uint32_t)*codeLen));
+  if (!scratch) {
+    jsExceptionHere(JSET_ERROR, "Not enough memory to match RegExp");
+    return 0;
+  }
+  int *start = (int*)jsvGetFlatStringPointer(scratch);
+  m.threads[0] = &start[m.nsave];
+  m.threads[1] = &m.threads[0][listSize];
+  m.marks = (uint32_t*)&m.threads[1][listSize];
+  memset(m.marks, 0, sizeof(uint32_t)*codeLen);
+  for (pc=0;pc<(size_t)m.nsave;pc++) start[pc] = -1;
+  m.code = &header[REGEXP_HEADER_SIZE];
+  m.gen = 1;
+  m.count[0] = 0;
+  m.steps = 0;
+  m.pos = startIdx;
+  m.prevCh = startIdx>0 ? (unsigned char)jsvGetCharInString(str, (size_t)startIdx-1) : -1;
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, str, (size_t)startIdx);
+  m.ch = jsvStringIteratorHasChar(&it) ? (unsigned char)jsvStringIteratorGetChar(&it) : -1;
+
+  bool matched = false;
+  int list = 0;
+  while (true) {
+    // until we have a match, try starting one at every position
+    if (!matched) regexpAddThread(&m, list, 0, start);
+    else if (!m.count[list]) break;
+    // move on a character - the threads we add next are at the next position
+    int ch = m.ch;
+    if (ch>=0) {
+      jsvStringIteratorNext(&it);
+      m.ch = jsvStringIteratorHasChar(&it) ? (unsigned char)jsvStringIteratorGetChar(&it) : -1;
+    }
+    m.prevCh = ch;
+    m.pos++;
+    m.gen++;
+    int next = 1-list;
+    m.count[next] = 0;
+    int i;
+    for (i=0;i<m.count[list];i++) {
+      int *t = &m.threads[list][i * (1+m.nsave)];
+      const unsigned char *op = &m.code[t[0]];
+      bool ok = false;
+      m.steps++;
+      switch (*op) {
+      case RE_MATCH:
+        // the threads after this one are less preferred, so drop them
+        matched = true;
+        memcpy(caps, &t[1], sizeof(int)*(size_t)m.nsave);
+        i = m.count[list];
+        break;
+      case RE_CHAR:
+        ok = ch>=0 && (unsigned char)((m.flags&REGEXP_FLAG_IGNORECASE) ? regexpLowerCase((char)ch) : ch) == op[1];
+        break;
+      case RE_ANY:
+        ok = ch>=0 && ch!='\n' && ch!='\r';
+        break;
+      case RE_CLASS:
+        ok = ch>=0 && (op[1+(ch>>3)] & (1<<(ch&7)));
+        break;
+      }
+      if (ok) regexpAddThread(&m, next, t[0]+regexpOpLength(*op), &t[1]);
+    }
+    if (m.steps > REGEXP_MAX_STEPS) {
+      jsExceptionHere(JSET_ERROR, "RegExp took too long to match");
+      matched = false;
+      break;
+    }
+    if (ch<0) break; // end of the string
+    list = next;
+  }
+  jsvStringIteratorFree(&it);
+  jsvUnLock(scratch);
+  return matched ? m.nsave/2 : 0;
+}
+
+// --------------------------------------------------------------------------------------------
+
+/// Get the compiled code for a RegExp (or 0 if it isn't one)
+static JsVar *regexpGetCode(JsVar *regex) {
+  if (!jsvIsObject(regex)) return 0;
+  JsVar *code = jsvObjectGetChild(regex, REGEXP_CODE_NAME, 0);
+  if (!jsvIsFlatString(code)) {
+    jsvUnLock(code);
+    return 0;
+  }
+  return code;
+}
+
+static unsigned char regexpGetFlags(JsVar *code) {
+  return (unsigned char)jsvGetFlatStringPointer(code)[0];
+}
+
+bool jswrap_regexp_isRegExp(JsVar *v) {
+  JsVar *code = regexpGetCode(v);
+  jsvUnLock(code);
+  return code!=0;
+}
+
+/// Make the result of exec - an array of the match and groups, with 'index' and 'input'
+static JsVar *regexpMatchArray(JsVar *str, int *caps, int groups) {
+  JsVar *arr = jsvNewEmptyArray();
+  if (!arr) return 0;
+  int i;
+  for (i=0;i<groups;i++) {
+    if (caps[i*2]>=0 && caps[i*2+1]>=0) { // groups that didn't match are left undefined
+      JsVar *v = jsvNewFromStringVar(str, (size_t)caps[i*2], (size_t)(caps[i*2+1]-caps[i*2]));
+      JsVar *idx = jsvMakeIntoVariableName(jsvNewFromInteger(i), v);
+      if (idx) jsvAddName(arr, idx);
+      jsvUnLock2(idx, v);
+    }
+  }
+  jsvSetArrayLength(arr, groups, false);
+  jsvObjectSetChildAndUnLock(arr, "index", jsvNewFromInteger(caps[0]));
+  jsvObjectSetChild(arr, "input", str);
+  return arr;
+}
+
+/*JSON{
+  "type" : "class",
+  "class" : "RegExp",
+  "ifndef" : "SAVE_ON_FLASH"
+}
+The built-in class for handling Regular Expressions
+
+Espruino supports character classes (`[a-z]`, `\d`, `\w`, `\s` and their
+inverses), `.`, `^`, `$`, `\b`, groups (capturing and `(?:...)`),
+alternatives with `|`, and the repeats `*`, `+`, `?` and `{n,m}` (with lazy
+versions). Backreferences and lookahead are not supported.
+
+Matching takes a time proportional to the length of the string, and gives up
+with an error if it takes too long.
+*/
+/*JSON{
+  "type" : "constructor",
+  "class" : "RegExp",
+  "name" : "RegExp",
+  "generate" : "jswrap_regexp_constructor",
+  "params" : [
+    ["regex","JsVar","A regular expression as a string"],
+    ["flags","JsVar","Flags for the regular expression as a string - `g` (global), `i` (ignore case) and `m` (multiline)"]
+  ],
+  "return" : ["JsVar","A RegExp object"],
+  "ifndef" : "SAVE_ON_FLASH"
+}
+Creates a RegExp object, for instance `new RegExp("ab+c", "g")`. You can also
+write `/ab+c/g`.
+ */
+JsVar *jswrap_regexp_constructor(JsVar *pattern, JsVar *flags) {
+  JsVar *source;
+  if (jswrap_regexp_isRegExp(pattern)) {
+    source = jsvObjectGetChild(pattern, "source", 0);
+    if (jsvIsUndefined(flags)) flags = jsvObjectGetChild(pattern, "flags", 0);
+    else jsvLockAgain(flags);
+  } else {
+    source = jsvIsUndefined(pattern) ? jsvNewFromString("(?:)") : jsvAsString(pattern, false);
+    flags = jsvLockAgainSafe(flags);
+  }
+  unsigned char f = 0;
+  if (!jsvIsUndefined(flags)) {
+    flags = jsvAsString(flags, true);
+    JsvStringIterator it;
+    jsvStringIteratorNew(&it, flags, 0);
+    while (jsvStringIteratorHasChar(&it)) {
+      char ch = jsvStringIteratorGetChar(&it);
+      if (ch=='g') f |= REGEXP_FLAG_GLOBAL;
+      else if (ch=='i') f |= REGEXP_FLAG_IGNORECASE;
+      else if (ch=='m') f |= REGEXP_FLAG_MULTILINE;
+      else {
+        jsExceptionHere(JSET_SYNTAXERROR, "Unsupported RegExp flag '%c'", ch);
+        f = 0xFF;
+        break;
+      }
+      jsvStringIteratorNext(&it);
+    }
+    jsvStringIteratorFree(&it);
+  }
+  jsvUnLock(flags);
+  if (!source || f==0xFF) {
+    jsvUnLock(source);
+    return 0;
+  }
+
+  const char *error = 0;
+  JsVar *code = regexpCompile(source, f, &error);
+  if (!code) {
+    if (error) jsExceptionHere(JSET_SYNTAXERROR, "%s in RegExp /%v/", error, source);
+    jsvUnLock(source);
+    return 0;
+  }
+  JsVar *regex = jspNewObject(0, "RegExp");
+  if (regex) {
+    jsvObjectSetChild(regex, "source", source);
+    char flagStr[4], *fp = flagStr;
+    if (f&REGEXP_FLAG_GLOBAL) *(fp++) = 'g';
+    if (f&REGEXP_FLAG_IGNORECASE) *(fp++) = 'i';
+    if (f&REGEXP_FLAG_MULTILINE) *(fp++) = 'm';
+    *fp = 0;
+    jsvObjectSetChildAndUnLock(regex, "flags", jsvNewFromString(flagStr));
+    jsvObjectSetChildAndUnLock(regex, "lastIndex", jsvNewFromInteger(0));
+    jsvObjectSetChild(regex, REGEXP_CODE_NAME, code);
+  }
+  jsvUnLock2(source, code);
+  return regex;
+}
+
+/** Run the RegExp on str (which must be a string), starting from lastIndex
+ * for global RegExps. Returns the number of groups matched (see regexpMatch)
+ * and updates lastIndex. */
+static int regexpExec(JsVar *regex, JsVar *str, int *caps) {
+  JsVar *code = regexpGetCode(regex);
+  if (!code) {
+    jsExceptionHere(JSET_TYPEERROR, "Expecting a RegExp, got %t", regex);
+    return 0;
+  }
+  bool global = (regexpGetFlags(code)&REGEXP_FLAG_GLOBAL)!=0;
+  int startIdx = 0, groups = 0;
+  if (global) startIdx = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(regex, "lastIndex", 0));
+  if (startIdx>=0 && startIdx<=(int)jsvGetStringLength(str))
+    groups = regexpMatch(code, str, startIdx, caps);
+  if (global)
+    jsvObjectSetChildAndUnLock(regex, "lastIndex", jsvNewFromInteger(groups ? caps[1] : 0));
+  jsvUnLock(code);
+  return groups;
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "RegExp",
+  "name" : "exec",
+  "generate" : "jswrap_regexp_exec",
+  "params" : [
+    ["str","JsVar","A string to match on"]
+  ],
+  "return" : ["JsVar","A result array, or null"],
+  "ifndef" : "SAVE_ON_FLASH"
+}
+Search for the RegExp in `str`, and return an array of the match followed by
+the groups, with `index` (the position of the match) and `input` set - or
+`null` if there was no match. eg:
+
+```
+/(\d+)-(\d+)/.exec("Ranges 10-20") == ["10-20", "10", "20"]
+```
+
+For a global RegExp (`g` flag) the search starts from `lastIndex`, which is
+set to the end of the match - so you can call `exec` repeatedly to find each
+match.
+ */
+JsVar *jswrap_regexp_exec(JsVar *parent, JsVar *arg) {
+  JsVar *str = jsvAsString(arg, false);
+  if (!str) return 0;
+  int caps[REGEXP_MAX_GROUPS*2];
+  int groups = regexpExec(parent, str, caps);
+  JsVar *result = groups ? regexpMatchArray(str, caps, groups) : jsvNewNull();
+  jsvUnLock(str);
+  return result;
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "RegExp",
+  "name" : "test",
+  "generate" : "jswrap_regexp_test",
+  "params" : [
+    ["str","JsVar","A string to match on"]
+  ],
+  "return" : ["bool","true for a match, or false"],
+  "ifndef" : "SAVE_ON_FLASH"
+}
+Return true if the RegExp matches `str`
+ */
+bool jswrap_regexp_test(JsVar *parent, JsVar *arg) {
+  JsVar *str = jsvAsString(arg, false);
+  if (!str) return false;
+  int caps[REGEXP_MAX_GROUPS*2];
+  int groups = regexpExec(parent, str, caps);
+  jsvUnLock(str);
+  return groups!=0;
+}
+
+JsVar *jswrap_regexp_match(JsVar *regex, JsVar *str) {
+  JsVar *code = regexpGetCode(regex);
+  if (!code) return 0;
+  bool global = (regexpGetFlags(code)&REGEXP_FLAG_GLOBAL)!=0;
+  jsvUnLock(code);
+  if (!global) return jswrap_regexp_exec(regex, str);
+  // global - return an array of all the matches
+  JsVar *result = jsvNewNull();
+  jsvObjectSetChildAndUnLock(regex, "lastIndex", jsvNewFromInteger(0));
+  int caps[REGEXP_MAX_GROUPS*2];
+  while (regexpExec(regex, str, caps)) {
+    if (jsvIsNull(result)) {
+      jsvUnLock(result);
+      result = jsvNewEmptyArray();
+      if (!result) break;
+    }
+    jsvArrayPushAndUnLock(result, jsvNewFromStringVar(str, (size_t)caps[0], (size_t)(caps[1]-caps[0])));
+    if (caps[1]==caps[0]) // empty match - move on or we'd match here forever
+      jsvObjectSetChildAndUnLock(regex, "lastIndex", jsvNewFromInteger(caps[1]+1));
+  }
+  return result;
+}
+
+/// Append the replacement for a match, expanding $&, $1, etc
+static void regexpAppendReplacement(JsVar *result, JsVar *replace, JsVar *str, int *caps, int groups) {
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, replace, 0);
+  while (jsvStringIteratorHasChar(&it)) {
+    char ch = jsvStringIteratorGetChar(&it);
+    jsvStringIteratorNext(&it);
+    if (ch=='$' && jsvStringIteratorHasChar(&it)) {
+      char n = jsvStringIteratorGetChar(&it);
+      int group = -1;
+      if (n=='&') group = 0;
+      else if (n>='1' && n<='9' && n-'0'<groups) group = n-'0';
+      if (group>=0) {
+        if (caps[group*2]>=0 && caps[group*2+1]>=0)
+          jsvAppendStringVar(result, str, (size_t)caps[group*2], (size_t)(caps[group*2+1]-caps[group*2]));
+        jsvStringIteratorNext(&it);
+        continue;
+      }
+      if (n=='$') jsvStringIteratorNext(&it);
+    }
+    jsvAppendCharacter(result, ch);
+  }
+  jsvStringIteratorFree(&it);
+}
+
+JsVar *jswrap_regexp_replace(JsVar *regex, JsVar *str, JsVar *replace) {
+  JsVar *code = regexpGetCode(regex);
+  if (!code) return 0;
+  bool global = (regexpGetFlags(code)&REGEXP_FLAG_GLOBAL)!=0;
+  bool isFunction = jsvIsFunction(replace);
+  replace = isFunction ? jsvLockAgain(replace) : jsvAsString(replace, false);
+  JsVar *result = jsvNewFromEmptyString();
+  int caps[REGEXP_MAX_GROUPS*2];
+  int groups, idx = 0, last = 0, len = (int)jsvGetStringLength(str);
+  while (result && replace && idx<=len && (groups = regexpMatch(code, str, idx, caps))) {
+    jsvAppendStringVar(result, str, (size_t)last, (size_t)(caps[0]-last));
+    if (isFunction) {
+      // call replace(match, p1, p2, ..., offset, string)
+      JsVar *args[REGEXP_MAX_GROUPS+2];
+      int i, n = 0;
+      for (i=0;i<groups;i++)
+        args[n++] = (caps[i*2]>=0 && caps[i*2+1]>=0) ? jsvNewFromStringVar(str, (size_t)caps[i*2], (size_t)(caps[i*2+1]-caps[i*2])) : 0;
+      args[n++] = jsvNewFromInteger(caps[0]);
+      args[n++] = jsvLockAgain(str);
+      JsVar *r = jspExecuteFunction(replace, 0, n, args);
+      jsvUnLockMany((unsigned)n, args);
+      if (r) {
+        r = jsvAsString(r, true);
+        if (r) jsvAppendStringVarComplete(result, r);
+        jsvUnLock(r);
+      }
+      if (jspHasError()) break;
+    } else {
+      regexpAppendReplacement(result, replace, str, caps, groups);
+    }
+    last = caps[1];
+    if (!global) break;
+    idx = (caps[1]>caps[0]) ? caps[1] : caps[1]+1;
+  }
+  if (result) jsvAppendStringVar(result, str, (size_t)last, JSVAPPENDSTRINGVAR_MAXLENGTH);
+  if (global) jsvObjectSetChildAndUnLock(regex, "lastIndex", jsvNewFromInteger(0));
+  jsvUnLock2(replace, code);
+  return result;
+}
+
+JsVar *jswrap_regexp_split(JsVar *regex, JsVar *str) {
+  JsVar *code = regexpGetCode(regex);
+  if (!code) return 0;
+  JsVar *result = jsvNewEmptyArray();
+  int caps[REGEXP_MAX_GROUPS*2];
+  int groups, p = 0, q = 0, len = (int)jsvGetStringLength(str);
+  if (!len) {
+    // an empty string only splits to nothing if the RegExp matches it
+    if (result && !regexpMatch(code, str, 0, caps))
+      jsvArrayPush(result, str);
+    jsvUnLock(code);
+    return result;
+  }
+  while (result && q<len && (groups = regexpMatch(code, str, q, caps)) && caps[0]<len) {
+    if (caps[1]==p) { // an empty match where the last one ended - try one character on
+      q = caps[0]+1;
+      continue;
+    }
+    jsvArrayPushAndUnLock(result, jsvNewFromStringVar(str, (size_t)p, (size_t)(caps[0]-p)));
+    // groups are added to the array too (undefined if they didn't match)
+    int i;
+    for (i=1;i<groups;i++)
+      jsvArrayPushAndUnLock(result, (caps[i*2]>=0 && caps[i*2+1]>=0) ? jsvNewFromStringVar(str, (size_t)caps[i*2], (size_t)(caps[i*2+1]-caps[i*2])) : 0);
+    p = q = caps[1];
+  }
+  if (result) jsvArrayPushAndUnLock(result, jsvNewFromStringVar(str, (size_t)p, JSVAPPENDSTRINGVAR_MAXLENGTH));
+  jsvUnLock(code);
+  return result;
+}
@@ -0,0 +1,27 @@
+/*
+ * This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+ *
+ * Copyright (C) 2013 Gordon Williams <gw@pur3.co.uk>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * ----------------------------------------------------------------------------
+ * JavaScript RegExp Functions
+ * ----------------------------------------------------------------------------
+ */
+#include "jsvar.h"
+
+JsVar *jswrap_regexp_constructor(JsVar *pattern, JsVar *flags);
+JsVar *jswrap_regexp_exec(JsVar *parent, JsVar *str);
+bool jswrap_regexp_test(JsVar *parent, JsVar *str);
+
+/// Is this a RegExp object?
+bool jswrap_regexp_isRegExp(JsVar *v);
+/// String.match with a RegExp
+JsVar *jswrap_regexp_match(JsVar *regex, JsVar *str);
+/// String.replace with a RegExp - replace is a string (which may contain $1, $& etc) or a function
+JsVar *jswrap_regexp_replace(JsVar *regex, JsVar *str, JsVar *replace);
+/// String.split with a RegExp
+JsVar *jswrap_regexp_split(JsVar *regex, JsVar *str);
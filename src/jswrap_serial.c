@@ -189,6 +189,12 @@ Unless `force` is set to true, changes in the connection state of the board
 Setup this Serial port with the given baud rate and options.
 
 If not specified in options, the default pins are used (usually the lowest numbered pins on the lowest port that supports this peripheral)
+
+On ESP8266, `Serial1` also accepts these options for receiving fast streams of data:
+
+* `rxBuffer` - bytes of received data to hold while Espruino is busy (default 512)
+* `rxThreshold` - interrupt when the RX FIFO has this many bytes in, 1..127 (default 100)
+* `rxTimeout` - interrupt when nothing has been received for this many character times, 1..127 (default 2)
  */
 void jswrap_serial_setup(JsVar *parent, JsVar *baud, JsVar *options) {
   IOEventFlags device = jsiGetDeviceFromClass(parent);
@@ -204,14 +210,21 @@ void jswrap_serial_setup(JsVar *parent, JsVar *baud, JsVar *options) {
 
   JsVar *parity = 0;
   JsVar *flow = 0;
+  // JSV_INTEGER writes a JsVarInt, so don't point it at the smaller fields in inf
+  JsVarInt bytesize = inf.bytesize;
+  JsVarInt stopbits = inf.stopbits;
+  JsVarInt rxBuffer = 0, rxThreshold = 0, rxTimeout = 0;
   jsvConfigObject configs[] = {
       {"rx", JSV_PIN, &inf.pinRX},
       {"tx", JSV_PIN, &inf.pinTX},
       {"ck", JSV_PIN, &inf.pinCK},
-      {"bytesize", JSV_INTEGER, &inf.bytesize},
-      {"stopbits", JSV_INTEGER, &inf.stopbits},
+      {"bytesize", JSV_INTEGER, &bytesize},
+      {"stopbits", JSV_INTEGER, &stopbits},
       {"parity", JSV_OBJECT /* a variable */, &parity},
       {"flow", JSV_OBJECT /* a variable */, &flow},
+      {"rxBuffer", JSV_INTEGER, &rxBuffer},
+      {"rxThreshold", JSV_INTEGER, &rxThreshold},
+      {"rxTimeout", JSV_INTEGER, &rxTimeout},
   };
 
 
@@ -226,6 +239,15 @@ void jswrap_serial_setup(JsVar *parent, JsVar *baud, JsVar *options) {
 
   bool ok = true;
   if (jsvReadConfigObject(options, configs, sizeof(configs) / sizeof(jsvConfigObject))) {
+    inf.bytesize = (unsigned char)bytesize;
+    inf.stopbits = (unsigned char)stopbits;
+    if (rxBuffer<0 || rxBuffer>65535 || rxThreshold<0 || rxThreshold>127 || rxTimeout<0 || rxTimeout>127) {
+      jsExceptionHere(JSET_ERROR, "Invalid rxBuffer, rxThreshold or rxTimeout");
+      ok = false;
+    }
+    inf.rxBufferSize = (unsigned short)rxBuffer;
+    inf.rxThreshold = (unsigned char)rxThreshold;
+    inf.rxTimeout = (unsigned char)rxTimeout;
     // sort out parity
     inf.parity = 0;
     if(jsvIsString(parity)) {
@@ -275,22 +297,41 @@ void jswrap_serial_setup(JsVar *parent, JsVar *baud, JsVar *options) {
 }
 
 
+/// Characters waiting to be sent with jshTransmitChars
+typedef struct {
+  IOEventFlags device;
+  unsigned int len;
+  unsigned char buf[32];
+} JswSerialPrintData;
+
+static void _jswrap_serial_print_flush(JswSerialPrintData *d) {
+  jshTransmitChars(d->device, d->buf, d->len);
+  d->len = 0;
+}
 static void _jswrap_serial_print_cb(int data, void *userData) {
-  IOEventFlags device = *(IOEventFlags*)userData;
-  jshTransmit(device, (unsigned char)data);
+  JswSerialPrintData *d = (JswSerialPrintData*)userData;
+  d->buf[d->len++] = (unsigned char)data;
+  if (d->len >= sizeof(d->buf)) _jswrap_serial_print_flush(d);
 }
-void _jswrap_serial_print(JsVar *parent, JsVar *arg, bool isPrint, bool newLine) {
+void _jswrap_serial_print(JsVar *parent, JsVar **argPtr, int argCount, bool isPrint, bool newLine) {
   NOT_USED(parent);
-  IOEventFlags device = jsiGetDeviceFromClass(parent);
-  if (!DEVICE_IS_USART(device)) return;
-
-  if (isPrint) arg = jsvAsString(arg, false);
-  jsvIterateCallback(arg, _jswrap_serial_print_cb, (void*)&device);
-  if (isPrint) jsvUnLock(arg);
+  JswSerialPrintData d;
+  d.device = jsiGetDeviceFromClass(parent);
+  d.len = 0;
+  if (!DEVICE_IS_USART(d.device)) return;
+
+  int i;
+  for (i=0;i<argCount;i++) {
+    JsVar *arg = argPtr[i];
+    if (isPrint) arg = jsvAsString(arg, false);
+    jsvIterateCallback(arg, _jswrap_serial_print_cb, (void*)&d);
+    if (isPrint) jsvUnLock(arg);
+  }
   if (newLine) {
-    _jswrap_serial_print_cb((unsigned char)'\r', (void*)&device);
-    _jswrap_serial_print_cb((unsigned char)'\n', (void*)&device);
+    _jswrap_serial_print_cb((unsigned char)'\r', (void*)&d);
+    _jswrap_serial_print_cb((unsigned char)'\n', (void*)&d);
   }
+  _jswrap_serial_print_flush(&d);
 }
 
 /*JSON{
@@ -320,10 +361,10 @@ Print a line to the serial port with a newline (`\r\n`) at the end of it.
  **Note:** This function converts data to a string first, eg `Serial.print([1,2,3])` is equivalent to `Serial.print("1,2,3"). If you'd like to write raw bytes, use `Serial.write`.
  */
 void jswrap_serial_print(JsVar *parent, JsVar *str) {
-  _jswrap_serial_print(parent, str, true, false);
+  _jswrap_serial_print(parent, &str, 1, true, false);
 }
 void jswrap_serial_println(JsVar *parent,  JsVar *str) {
-  _jswrap_serial_print(parent, str, true, true);
+  _jswrap_serial_print(parent, &str, 1, true, true);
 }
 /*JSON{
   "type" : "method",
@@ -331,15 +372,15 @@ void jswrap_serial_println(JsVar *parent,  JsVar *str) {
   "name" : "write",
   "generate" : "jswrap_serial_write",
   "params" : [
-    ["data","JsVarArray","One or more items to write. May be ints, strings, arrays, or objects of the form `{data: ..., count:#}`."]
+    ["data","JsVarArgs","One or more items to write. May be ints, strings, arrays, or objects of the form `{data: ..., count:#}`."]
   ]
 }
 Write a character or array of data to the serial port
 
 This method writes unmodified data, eg `Serial.write([1,2,3])` is equivalent to `Serial.write("\1\2\3")`. If you'd like data converted to a string first, use `Serial.print`.
  */
-void jswrap_serial_write(JsVar *parent, JsVar *args) {
-  _jswrap_serial_print(parent, args, false, false);
+void jswrap_serial_write(JsVar *parent, JsVar **argPtr, int argCount) {
+  _jswrap_serial_print(parent, argPtr, argCount, false, false);
 }
 
 /*JSON{
@@ -382,6 +423,32 @@ Return how many bytes are available to read. If there is already a listener for
 Return a string containing characters that have been received
  */
 
+/*JSON{
+  "type" : "method",
+  "class" : "Serial",
+  "name" : "setFraming",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_stream_setFraming",
+  "params" : [
+    ["options","JsVar",["An object describing how to split up received data, or `undefined` to pass data on as it arrives","delimiter : a string (up to 8 characters) that ends each frame, eg. `'\\r\\n'`. It is not included in the data","length : every frame is this many bytes long","lengthPrefix : each frame starts with its length - `'u8'`, `'u16le'`, `'u16be'`, `'u32le'` or `'u32be'`. The length is not included in the data","idleTimeout : if no data has arrived for this many milliseconds, pass on any partial frame","maxLength : if more than this many bytes (default 1024) arrive without a complete frame, pass them on anyway"]]
+  ]
+}
+Rather than calling `on('data', ...)` with whatever data has been received,
+collect data and call it once for each complete frame. For example to get one
+`data` event per line from a GPS or modem:
+
+```
+Serial1.setFraming({delimiter:"\r\n"});
+Serial1.on('data', line => print(JSON.stringify(line)));
+```
+
+Only one of `delimiter`, `length` or `lengthPrefix` can be used. `idleTimeout`
+can be used on its own (eg. for Modbus RTU, where a frame ends when the line goes
+quiet) or with one of the other options to pass on a partial frame.
+
+Framing only applies when there is a `data` listener - `read` returns the data as received.
+ */
+
 /*JSON{
   "type" : "method",
   "class" : "Serial",
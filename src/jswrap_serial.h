@@ -17,5 +17,5 @@
 void jswrap_serial_setup(JsVar *parent, JsVar *baud, JsVar *options);
 void jswrap_serial_print(JsVar *parent, JsVar *str);
 void jswrap_serial_println(JsVar *parent, JsVar *str);
-void jswrap_serial_write(JsVar *parent, JsVar *data);
+void jswrap_serial_write(JsVar *parent, JsVar **argPtr, int argCount);
 void jswrap_serial_onData(JsVar *parent, JsVar *funcVar);
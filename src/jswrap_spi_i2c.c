@@ -180,6 +180,49 @@ void jswrap_spi_send_cb(
 }
 
 
+/**
+ * If this data is stored as bytes in one flat area of memory (a flat or native
+ * String, or an 8 bit typed array of one), return a pointer to it. Otherwise 0.
+ */
+static unsigned char *jswrap_spi_getFlatData(
+    JsVar *data, //!< The data to be sent
+    size_t *len  //!< Set to the number of bytes
+  ) {
+  if (!jsvIsString(data) &&
+      !(jsvIsArrayBuffer(data) && JSV_ARRAYBUFFER_GET_SIZE(data->varData.arraybuffer.type)==1))
+    return 0;
+  unsigned char *ptr = (unsigned char *)jsvGetDataPointer(data, len);
+  return (ptr && *len) ? ptr : 0;
+}
+
+/**
+ * Allocate somewhere flat to put the response to sending 'len' bytes - a String
+ * if 'isString', otherwise a Uint8Array. Returns 0 if there's no flat memory.
+ */
+static JsVar *jswrap_spi_newFlatResponse(
+    bool isString,      //!< Whether the data sent was a String
+    size_t len,         //!< The number of bytes
+    unsigned char **rx  //!< Set to the response's data
+  ) {
+  char *ptr = 0;
+  JsVar *dst = 0;
+  if (isString) {
+    dst = jsvNewFlatStringOfLength((unsigned int)len);
+    if (dst) ptr = jsvGetFlatStringPointer(dst);
+  } else {
+    JsVar *buf = jsvNewArrayBufferWithPtr((unsigned int)len, &ptr);
+    if (buf) dst = jswrap_typedarray_constructor(ARRAYBUFFERVIEW_UINT8, buf, 0, 0);
+    jsvUnLock(buf);
+  }
+  if (!ptr) {
+    jsvUnLock(dst);
+    return 0;
+  }
+  *rx = (unsigned char *)ptr;
+  return dst;
+}
+
+
 /**
  * Send data through SPI.
  * The data can be in a variety of formats including:
@@ -212,8 +255,26 @@ JsVar *jswrap_spi_send(
 
   // Now that we are setup, we can send the data.
 
+  // If it's flat data going to hardware SPI, try and send it all in one go
+  size_t len;
+  unsigned char *tx = DEVICE_IS_SPI(device) ? jswrap_spi_getFlatData(srcdata, &len) : 0;
+  if (tx) {
+    // we need somewhere flat to put the response too
+    unsigned char *rx;
+    dst = jswrap_spi_newFlatResponse(jsvIsString(srcdata), len, &rx);
+    if (!dst || !jshSPISendMany(device, tx, rx, len)) {
+      // fall back to sending a byte at a time
+      jsvUnLock(dst);
+      dst = 0;
+      tx = 0;
+    }
+  }
+
+  if (tx) {
+    // already sent
+  }
   // Handle the data being a single byte value
-  if (jsvIsNumeric(srcdata)) {
+  else if (jsvIsNumeric(srcdata)) {
     int r = data.spiSend((unsigned char)jsvGetInteger(srcdata), &data.spiSendData);
     if (r<0) r = data.spiSend(-1, &data.spiSendData);
     dst = jsvNewFromInteger(r); // retrieve the byte (no send!)
@@ -307,8 +368,30 @@ void jswrap_spi_write(
 
   // assert NSS
   if (nss_pin!=PIN_UNDEFINED) jshPinOutput(nss_pin, false);
-  // Write data
-  jsvIterateCallback(args, (void (*)(int,  void *))spiSend, &spiSendData);
+  // Write data - anything that's flat can be sent in one go
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, args);
+  while (jsvObjectIteratorHasValue(&it)) {
+    JsVar *item = jsvObjectIteratorGetValue(&it);
+    size_t len;
+    unsigned char *tx = jswrap_spi_getFlatData(item, &len);
+    bool sent = false;
+    if (tx) {
+      if (DEVICE_IS_SPI(device)) {
+        sent = jshSPISendMany(device, tx, 0, len);
+#ifdef ESP8266
+      } else if (spiSend == jsspiFastSoftwareFunc) {
+        jshSPISendSoftware(spiSendData.pinMOSI, spiSendData.pinSCK, tx, len);
+        sent = true;
+#endif
+      }
+    }
+    if (!sent)
+      jsvIterateCallback(item, (void (*)(int,  void *))spiSend, &spiSendData);
+    jsvUnLock(item);
+    jsvObjectIteratorNext(&it);
+  }
+  jsvObjectIteratorFree(&it);
   // Wait until SPI send is finished, and flush data
   if (DEVICE_IS_SPI(device))
     jshSPIWait(device);
@@ -316,6 +399,103 @@ void jswrap_spi_write(
   if (nss_pin!=PIN_UNDEFINED) jshPinOutput(nss_pin, true);
 }
 
+#define JSI_SPI_ASYNC_NAME JS_HIDDEN_CHAR_STR"async"
+
+/*JSON{
+  "type" : "method",
+  "class" : "SPI",
+  "name" : "sendAsync",
+  "generate" : "jswrap_spi_sendAsync",
+  "params" : [
+    ["data","JsVar","The data to send - either an Integer, Array, String, or Object of the form `{data: ..., count:#}`"],
+    ["callback","JsVar","A function to call with the data received (as `SPI.send` would return it) once everything has been sent"]
+  ]
+}
+Send data down SPI in the background, and call `callback` with the data received when it's finished.
+Other code (eg. networking) keeps running meanwhile, so this is useful for long transfers like display updates.
+
+Only one `sendAsync` can be in progress on each SPI device at a time, and you shouldn't use the SPI device
+for anything else until `callback` has been called. Devices that can't send in the background (and software SPI)
+send the data straight away, but still call `callback` afterwards.
+ */
+void jswrap_spi_sendAsync(
+    JsVar *parent,   //!< A description of the SPI device to send data through.
+    JsVar *srcdata,  //!< The data to send through SPI.
+    JsVar *callback  //!< The function to call when done
+  ) {
+  if (!jsvIsFunction(callback)) {
+    jsExceptionHere(JSET_ERROR, "Expecting a callback function, got %t", callback);
+    return;
+  }
+  JsVar *async = jsvObjectGetChild(parent, JSI_SPI_ASYNC_NAME, 0);
+  if (async) {
+    jsvUnLock(async);
+    jsExceptionHere(JSET_ERROR, "SPI.sendAsync is already in progress");
+    return;
+  }
+  IOEventFlags device = jsiGetDeviceFromClass(parent);
+
+  if (DEVICE_IS_SPI(device) && jshIsDeviceInitialised(device)) {
+    // The data is read from an IRQ, so it needs to be flat. If it isn't, copy it
+    size_t len;
+    JsVar *txVar = 0;
+    unsigned char *tx = jswrap_spi_getFlatData(srcdata, &len);
+    if (tx) {
+      txVar = jsvLockAgain(srcdata);
+    } else if (!jsvIsNumeric(srcdata)) {
+      len = (size_t)jsvIterateCallbackCount(srcdata);
+      char *ptr = 0;
+      if (len) txVar = jsvNewArrayBufferWithPtr((unsigned int)len, &ptr);
+      if (txVar) {
+        jsvIterateCallbackToBytes(srcdata, (unsigned char *)ptr, (unsigned int)len);
+        tx = (unsigned char *)ptr;
+      }
+    }
+    unsigned char *rx;
+    JsVar *dst = tx ? jswrap_spi_newFlatResponse(jsvIsString(srcdata), len, &rx) : 0;
+    if (dst) async = jsvNewObject();
+    if (async) {
+      jshSPISetReceive(device, true);
+      if (jshSPISendAsync(device, tx, rx, len)) {
+        // keep the data referenced until the transfer has finished - see jswrap_spi_asyncComplete
+        jsvObjectSetChild(async, "data", txVar);
+        jsvObjectSetChild(async, "result", dst);
+        jsvObjectSetChild(async, "callback", callback);
+        jsvObjectSetChild(parent, JSI_SPI_ASYNC_NAME, async);
+      } else {
+        jsvUnLock(async);
+        async = 0;
+      }
+    }
+    jsvUnLock2(txVar, dst);
+    if (async) {
+      jsvUnLock(async);
+      return;
+    }
+  }
+
+  // We can't do it in the background - send now and call back later
+  JsVar *result = jswrap_spi_send(parent, srcdata, PIN_UNDEFINED);
+  jsiQueueEvents(parent, callback, &result, 1);
+  jsvUnLock(result);
+}
+
+/**
+ * Called from the idle loop when an SPI device's background transfer (from
+ * jshSPISendAsync) has finished.
+ */
+void jswrap_spi_asyncComplete(
+    JsVar *parent  //!< The SPI device
+  ) {
+  JsVar *async = jsvObjectGetChild(parent, JSI_SPI_ASYNC_NAME, 0);
+  if (!async) return;
+  jsvRemoveNamedChild(parent, JSI_SPI_ASYNC_NAME);
+  JsVar *callback = jsvObjectGetChild(async, "callback", 0);
+  JsVar *result = jsvObjectGetChild(async, "result", 0);
+  jsiQueueEvents(parent, callback, &result, 1);
+  jsvUnLock3(result, callback, async);
+}
+
 /*JSON{
   "type" : "method",
   "class" : "SPI",
@@ -577,6 +757,37 @@ void jswrap_i2c_writeTo(JsVar *parent, JsVar *addressVar, JsVar *args) {
     jshI2CWrite(device, (unsigned char)address, (int)dataLen, (unsigned char*)dataPtr, sendStop);
 }
 
+/// Copy the data that was received into a new Uint8Array
+static JsVar *i2c_newUint8Array(unsigned char *buf, int nBytes) {
+  JsVar *array = jsvNewTypedArray(ARRAYBUFFERVIEW_UINT8, nBytes);
+  if (array) {
+    JsvArrayBufferIterator it;
+    jsvArrayBufferIteratorNew(&it, array, 0);
+    unsigned int i;
+    for (i=0;i<(unsigned)nBytes;i++) {
+      jsvArrayBufferIteratorSetByteValue(&it, (char)buf[i]);
+      jsvArrayBufferIteratorNext(&it);
+    }
+    jsvArrayBufferIteratorFree(&it);
+  }
+  return array;
+}
+
+/// Read nBytes from the given I2C device and return them as a Uint8Array
+static JsVar *i2c_read(IOEventFlags device, int address, int nBytes, bool sendStop) {
+  if (nBytes<=0)
+    return 0;
+  if ((unsigned int)nBytes+256 > jsuGetFreeStack()) {
+    jsExceptionHere(JSET_ERROR, "Not enough free stack to receive this amount of data");
+    return 0;
+  }
+  unsigned char *buf = (unsigned char *)alloca((size_t)nBytes);
+
+  jshI2CRead(device, (unsigned char)address, nBytes, buf, sendStop);
+
+  return i2c_newUint8Array(buf, nBytes);
+}
+
 /*JSON{
   "type" : "method",
   "class" : "I2C",
@@ -598,26 +809,112 @@ JsVar *jswrap_i2c_readFrom(JsVar *parent, JsVar *addressVar, int nBytes) {
   bool sendStop = true;
   int address = i2c_get_address(addressVar, &sendStop);
 
-  if (nBytes<=0)
+  return i2c_read(device, address, nBytes, sendStop);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "I2C",
+  "name" : "readReg",
+  "generate" : "jswrap_i2c_readReg",
+  "params" : [
+    ["address","int32","The 7 bit address of the device"],
+    ["reg","int32","The register to read from"],
+    ["quantity","int32","The number of bytes to read"]
+  ],
+  "return" : ["JsVar","The data that was returned - as a Uint8Array"],
+  "return_object" : "Uint8Array"
+}
+Read `quantity` bytes starting at register `reg` of the given slave device, and return them as a Uint8Array.
+
+This writes the register number without a STOP, then reads after a repeated START. It's the same as
+`I2C.writeTo({address:a, stop:false}, reg); I2C.readFrom(a, quantity)` but in one call.
+ */
+JsVar *jswrap_i2c_readReg(JsVar *parent, int address, int reg, int nBytes) {
+  IOEventFlags device = jsiGetDeviceFromClass(parent);
+  if (!DEVICE_IS_I2C(device)) return 0;
+
+  unsigned char regByte = (unsigned char)reg;
+  jshI2CWrite(device, (unsigned char)address, 1, &regByte, false);
+  if (jspHasError()) return 0; // eg. no ACK
+  return i2c_read(device, address, nBytes, true);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "I2C",
+  "name" : "transfer",
+  "generate" : "jswrap_i2c_transfer",
+  "params" : [
+    ["address","int32","The 7 bit address of the device"],
+    ["operations","JsVar","An array of operations to perform - see below"]
+  ],
+  "return" : ["JsVar","All the data that was read, one after the other - as a Uint8Array"],
+  "return_object" : "Uint8Array"
+}
+Perform a whole sequence of I2C operations on one device without returning to JavaScript in between. Each operation is an object, and may be:
+
+* `{w:data}` - write `data` (anything `I2C.writeTo` accepts)
+* `{r:n}` - read `n` bytes
+* `{delayUs:n}` - wait for `n` microseconds
+
+Only the last operation sends a STOP, so a read after a write is done with a repeated START. For example
+`I2C1.transfer(0x68, [{w:0x3B},{r:14}])` reads 14 bytes starting at register `0x3B`.
+ */
+JsVar *jswrap_i2c_transfer(JsVar *parent, int address, JsVar *operations) {
+  IOEventFlags device = jsiGetDeviceFromClass(parent);
+  if (!DEVICE_IS_I2C(device)) return 0;
+  if (!jsvIsArray(operations)) {
+    jsExceptionHere(JSET_ERROR, "Expecting an array of operations, got %t", operations);
     return 0;
+  }
+
+  // work out how much we're going to read so we can receive it all in one go
+  int nOps = (int)jsvGetArrayLength(operations);
+  int nBytes = 0;
+  int i;
+  for (i=0;i<nOps;i++) {
+    JsVar *op = jsvGetArrayItem(operations, i);
+    if (jsvIsObject(op)) nBytes += jsvGetIntegerAndUnLock(jsvObjectGetChild(op, "r", 0));
+    jsvUnLock(op);
+  }
+  if (nBytes<0) nBytes = 0;
   if ((unsigned int)nBytes+256 > jsuGetFreeStack()) {
     jsExceptionHere(JSET_ERROR, "Not enough free stack to receive this amount of data");
     return 0;
   }
   unsigned char *buf = (unsigned char *)alloca((size_t)nBytes);
-
-  jshI2CRead(device, (unsigned char)address, nBytes, buf, sendStop);
-
-  JsVar *array = jsvNewTypedArray(ARRAYBUFFERVIEW_UINT8, nBytes);
-  if (array) {
-    JsvArrayBufferIterator it;
-    jsvArrayBufferIteratorNew(&it, array, 0);
-    unsigned int i;
-    for (i=0;i<(unsigned)nBytes;i++) {
-      jsvArrayBufferIteratorSetByteValue(&it, (char)buf[i]);
-      jsvArrayBufferIteratorNext(&it);
+  int bufIdx = 0;
+
+  for (i=0;i<nOps && !jspHasError();i++) {
+    bool sendStop = i==nOps-1;
+    JsVar *op = jsvGetArrayItem(operations, i);
+    JsVar *v;
+    if (!jsvIsObject(op)) {
+      jsExceptionHere(JSET_ERROR, "Expecting an object for operation %d, got %t", i, op);
+    } else if ((v = jsvObjectGetChild(op, "w", 0))) {
+      JSV_GET_AS_CHAR_ARRAY(dataPtr, dataLen, v);
+      if (dataPtr && dataLen)
+        jshI2CWrite(device, (unsigned char)address, (int)dataLen, (unsigned char*)dataPtr, sendStop);
+      jsvUnLock(v);
+    } else if ((v = jsvObjectGetChild(op, "r", 0))) {
+      int n = jsvGetIntegerAndUnLock(v);
+      if (n>0 && bufIdx+n<=nBytes) {
+        jshI2CRead(device, (unsigned char)address, n, &buf[bufIdx], sendStop);
+        bufIdx += n;
+      }
+    } else if ((v = jsvObjectGetChild(op, "delayUs", 0))) {
+      int us = jsvGetIntegerAndUnLock(v);
+      while (us>0) { // jshDelayMicroseconds is only good for up to 1ms
+        jshDelayMicroseconds(us>1000 ? 1000 : us);
+        us -= 1000;
+      }
+    } else {
+      jsExceptionHere(JSET_ERROR, "Unknown I2C operation %d", i);
     }
-    jsvArrayBufferIteratorFree(&it);
+    jsvUnLock(op);
   }
-  return array;
+  if (jspHasError()) return 0;
+
+  return i2c_newUint8Array(buf, bufIdx);
 }
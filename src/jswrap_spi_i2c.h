@@ -20,7 +20,11 @@ JsVar *jswrap_spi_send(JsVar *parent, JsVar *data, Pin nss_pin);
 void jswrap_spi_send4bit(JsVar *parent, JsVar *srcdata, int bit0, int bit1, Pin nss_pin);
 void jswrap_spi_send8bit(JsVar *parent, JsVar *srcdata, int bit0, int bit1, Pin nss_pin);
 void jswrap_spi_write(JsVar *parent, JsVar *args);
+void jswrap_spi_sendAsync(JsVar *parent, JsVar *srcdata, JsVar *callback);
+void jswrap_spi_asyncComplete(JsVar *parent);
 
 void jswrap_i2c_setup(JsVar *parent, JsVar *options);
 void jswrap_i2c_writeTo(JsVar *parent, JsVar *addressVar, JsVar *data);
 JsVar *jswrap_i2c_readFrom(JsVar *parent, JsVar *addressVar, int nBytes);
+JsVar *jswrap_i2c_readReg(JsVar *parent, int address, int reg, int nBytes);
+JsVar *jswrap_i2c_transfer(JsVar *parent, int address, JsVar *operations);
@@ -0,0 +1,642 @@
+/*
+ * This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+ *
+ * Copyright (C) 2013 Gordon Williams <gw@pur3.co.uk>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * ----------------------------------------------------------------------------
+ * This file is designed to be parsed during the build process
+ *
+ * JavaScript key/value storage in free flash memory
+ * ----------------------------------------------------------------------------
+ */
+#include "jswrap_storage.h"
+#include "jswrap_flash.h"
+#include "jshardware.h"
+#include "jsvariterator.h"
+#include "jsinteractive.h"
+
+/*JSON{
+  "type" : "library",
+  "class" : "Storage",
+  "ifndef" : "SAVE_ON_FLASH"
+}
+This module allows small amounts of data (for instance settings) to be kept
+in the free flash memory reported by `require("Flash").getFree()`, without
+having to use `save()`.
+
+```
+var s = require("Storage");
+s.write("config", JSON.stringify({ interval : 60 }));
+var config = JSON.parse(s.read("config"));
+```
+
+Rather than erasing and re-writing flash each time, new values are added to
+the end of a log. When the log is full, the current values are copied into
+a second area of flash and the first is erased (see `Storage.compact`).
+This is much faster than `save()`, and spreads wear over the flash memory.
+ */
+
+#ifndef SAVE_ON_FLASH
+
+#define JSF_STORAGE_MAGIC 0x3053564B // "KVS0"
+#define JSF_STORAGE_MAX_KEY_LEN 64
+/// Each half of the storage area starts with a magic number and a generation count
+#define JSF_STORAGE_AREA_HEADER 8
+
+/* The header for each record. It's followed by the key, then the data, padded
+ * to a multiple of 4 bytes. The key and data are written first, and then
+ * dataLen/keyLen/keyCheck, so that an interrupted write is never seen as a
+ * valid record. */
+typedef struct {
+  uint32_t dataLen;  ///< 0xFFFFFFFF if there's no record here - the end of the log
+  uint16_t keyLen;
+  uint16_t keyCheck; ///< ~keyLen, so we can tell if the header is valid
+  uint32_t replaced; ///< 0xFFFFFFFF while this is the current value for the key, 0 when replaced or erased
+} JsfStorageHeader;
+
+/// The storage area is split into two halves. Only one is in use at a time
+typedef struct {
+  uint32_t start[2];
+  uint32_t end[2];
+} JsfStorageArea;
+
+/// Buffers data so it can be written to flash a word at a time
+typedef struct {
+  uint32_t addr; ///< address the buffer will be written to
+  uint32_t len;  ///< number of bytes in the buffer
+  uint32_t buffer[8];
+} JsfStorageWriter;
+
+/// Compares data with what is in flash
+typedef struct {
+  uint32_t addr;
+  bool match;
+} JsfStorageCompare;
+
+static INSTANCE_LOCAL JsfStorageArea jsfStorageArea;
+static INSTANCE_LOCAL bool jsfStorageAreaFound = false;
+
+/// Find the area of flash we're using, and split it in two on a page boundary. Returns false (with no exception) if there isn't one
+static bool jsfStorageFindArea(JsfStorageArea *area) {
+  if (jsfStorageAreaFound) {
+    *area = jsfStorageArea;
+    return true;
+  }
+  // use the biggest area of free flash
+  uint32_t addr = 0, length = 0;
+  JsVar *freeAreas = jshFlashGetFree();
+  if (jsvIsArray(freeAreas)) {
+    JsvObjectIterator it;
+    jsvObjectIteratorNew(&it, freeAreas);
+    while (jsvObjectIteratorHasValue(&it)) {
+      JsVar *freeArea = jsvObjectIteratorGetValue(&it);
+      uint32_t a = (uint32_t)jsvGetIntegerAndUnLock(jsvObjectGetChild(freeArea, "addr", 0));
+      uint32_t l = (uint32_t)jsvGetIntegerAndUnLock(jsvObjectGetChild(freeArea, "length", 0));
+      if (l > length) {
+        addr = a;
+        length = l;
+      }
+      jsvUnLock(freeArea);
+      jsvObjectIteratorNext(&it);
+    }
+    jsvObjectIteratorFree(&it);
+  }
+  jsvUnLock(freeAreas);
+  // split at whichever page boundary is nearest the middle
+  uint32_t pageStart, pageLength;
+  uint32_t middle = addr + length/2;
+  uint32_t split = 0;
+  if (length && jshFlashGetPage(middle, &pageStart, &pageLength))
+    split = (middle-pageStart < pageStart+pageLength-middle) ? pageStart : pageStart+pageLength;
+  if (split <= addr || split >= addr+length)
+    return false;
+  jsfStorageArea.start[0] = addr;
+  jsfStorageArea.end[0] = split;
+  jsfStorageArea.start[1] = split;
+  jsfStorageArea.end[1] = addr+length;
+  jsfStorageAreaFound = true;
+  *area = jsfStorageArea;
+  return true;
+}
+
+/// Find the area of flash we're using, throwing an exception if there isn't one
+static bool jsfStorageGetArea(JsfStorageArea *area) {
+  if (jsfStorageFindArea(area)) return true;
+  jsExceptionHere(JSET_ERROR, "Not enough free flash memory for Storage (at least 2 pages needed)");
+  return false;
+}
+
+/// Erase one half of the storage area. Returns false if it couldn't be erased
+static bool jsfStorageEraseHalf(JsfStorageArea *area, int half) {
+#ifdef FLASH_CODE_XIP
+  // Modules loaded with require may be running code straight out of this half
+  if (!jsfCopyFunctionCodeOutOfFlash(area->start[half], area->end[half])) {
+    jsExceptionHere(JSET_ERROR, "Not enough memory to copy function code out of Storage");
+    return false;
+  }
+#endif
+  uint32_t addr = area->start[half];
+  uint32_t pageStart, pageLength;
+  while (addr < area->end[half] && jshFlashGetPage(addr, &pageStart, &pageLength)) {
+    jshFlashErasePage(pageStart);
+    addr = pageStart+pageLength;
+  }
+  return true;
+}
+
+/// Get the generation count of the given half, or return false if it isn't in use
+static bool jsfStorageGetGeneration(JsfStorageArea *area, int half, uint32_t *generation) {
+  uint32_t header[2];
+  jshFlashRead(header, area->start[half], sizeof(header));
+  *generation = header[1];
+  return header[0]==JSF_STORAGE_MAGIC && header[1]!=0xFFFFFFFF;
+}
+
+/// Mark the given half as being in use
+static void jsfStorageSetGeneration(JsfStorageArea *area, int half, uint32_t generation) {
+  uint32_t header[2];
+  header[0] = JSF_STORAGE_MAGIC;
+  header[1] = generation;
+  jshFlashWrite(header, area->start[half], sizeof(header));
+}
+
+/// Get the half that's currently in use, or -1. If create is set, set the area up if it's not in use
+static int jsfStorageGetActiveHalf(JsfStorageArea *area, bool create) {
+  uint32_t gen0, gen1;
+  bool valid0 = jsfStorageGetGeneration(area, 0, &gen0);
+  bool valid1 = jsfStorageGetGeneration(area, 1, &gen1);
+  // if compaction was interrupted after it finished writing, both are valid - use the newest
+  if (valid0 && valid1) return (gen1 > gen0) ? 1 : 0;
+  if (valid0) return 0;
+  if (valid1) return 1;
+  if (!create || !jsfStorageEraseHalf(area, 0)) return -1;
+  jsfStorageSetGeneration(area, 0, 0);
+  return 0;
+}
+
+/// Read the header of a record. Returns false if we're at the end of the log
+static bool jsfStorageGetHeader(uint32_t addr, uint32_t end, JsfStorageHeader *header) {
+  if (addr+sizeof(JsfStorageHeader) > end) return false;
+  jshFlashRead(header, addr, sizeof(JsfStorageHeader));
+  return header->dataLen != 0xFFFFFFFF;
+}
+
+static uint32_t jsfStorageGetRecordSize(const JsfStorageHeader *header) {
+  return (uint32_t)sizeof(JsfStorageHeader) + ((header->keyLen + header->dataLen + 3) & ~3u);
+}
+
+/// Is the header sensible? If not, a write was probably interrupted
+static bool jsfStorageIsHeaderValid(uint32_t addr, uint32_t end, const JsfStorageHeader *header) {
+  return (uint16_t)(header->keyCheck ^ header->keyLen) == 0xFFFFu && // keyCheck is ~keyLen
+         header->keyLen <= JSF_STORAGE_MAX_KEY_LEN &&
+         header->dataLen <= end-addr &&
+         jsfStorageGetRecordSize(header) <= end-addr;
+}
+
+static bool jsfStorageIsCurrent(const JsfStorageHeader *header) {
+  return header->replaced == 0xFFFFFFFF;
+}
+
+static bool jsfStorageKeyEquals(uint32_t addr, const JsfStorageHeader *header, const char *key, size_t keyLen) {
+  char buf[JSF_STORAGE_MAX_KEY_LEN];
+  if (header->keyLen != keyLen) return false;
+  jshFlashRead(buf, addr+(uint32_t)sizeof(JsfStorageHeader), (uint32_t)keyLen);
+  return memcmp(buf, key, keyLen)==0;
+}
+
+/** Search the log for the current record with the given key, returning its address
+ * or 0. endAddr is set to the first free address, or the end of the area if the log
+ * is corrupt and should be compacted before it is written to again. */
+static uint32_t jsfStorageFind(JsfStorageArea *area, int half, const char *key, size_t keyLen, uint32_t *endAddr) {
+  uint32_t addr = area->start[half] + JSF_STORAGE_AREA_HEADER;
+  uint32_t end = area->end[half];
+  uint32_t found = 0;
+  JsfStorageHeader header;
+  while (jsfStorageGetHeader(addr, end, &header)) {
+    if (!jsfStorageIsHeaderValid(addr, end, &header)) {
+      addr = end;
+      break;
+    }
+    if (key && jsfStorageIsCurrent(&header) && jsfStorageKeyEquals(addr, &header, key, keyLen))
+      found = addr;
+    addr += jsfStorageGetRecordSize(&header);
+  }
+  if (endAddr) *endAddr = addr;
+  return found;
+}
+
+static bool jsfStorageIsErased(uint32_t addr, uint32_t len) {
+  uint32_t buf[8];
+  while (len) {
+    uint32_t l = len > sizeof(buf) ? (uint32_t)sizeof(buf) : len;
+    jshFlashRead(buf, addr, l);
+    uint32_t i;
+    for (i=0;i<l;i++)
+      if (((unsigned char*)buf)[i] != 0xFF) return false;
+    addr += l;
+    len -= l;
+  }
+  return true;
+}
+
+static void jsfStorageWriterFlush(JsfStorageWriter *writer) {
+  if (!writer->len) return;
+  uint32_t len = (writer->len+3) & ~3u;
+  while (writer->len < len)
+    ((unsigned char*)writer->buffer)[writer->len++] = 0xFF;
+  jshFlashWrite(writer->buffer, writer->addr, len);
+  writer->addr += len;
+  writer->len = 0;
+}
+
+static void jsfStorageWriterPut(JsfStorageWriter *writer, unsigned char ch) {
+  ((unsigned char*)writer->buffer)[writer->len++] = ch;
+  if (writer->len == sizeof(writer->buffer))
+    jsfStorageWriterFlush(writer);
+}
+
+static void jsfStorageWriterCallback(int item, void *callbackData) {
+  jsfStorageWriterPut((JsfStorageWriter*)callbackData, (unsigned char)item);
+}
+
+static void jsfStorageCompareCallback(int item, void *callbackData) {
+  JsfStorageCompare *compare = (JsfStorageCompare*)callbackData;
+  if (!compare->match) return;
+  unsigned char ch;
+  jshFlashRead(&ch, compare->addr++, 1);
+  compare->match = ch == (unsigned char)item;
+}
+
+/// Write a record, with data from flash (if dataAddr!=0) or from a JsVar
+static bool jsfStorageWriteRecord(JsfStorageArea *area, int half, uint32_t addr, const char *key, size_t keyLen, JsVar *data, uint32_t dataAddr, uint32_t dataLen) {
+  JsfStorageHeader header;
+  header.dataLen = dataLen;
+  header.keyLen = (uint16_t)keyLen;
+  header.keyCheck = (uint16_t)~header.keyLen;
+  uint32_t size = jsfStorageGetRecordSize(&header);
+  if (addr+size > area->end[half] || !jsfStorageIsErased(addr, size))
+    return false;
+  JsfStorageWriter writer;
+  writer.addr = addr+(uint32_t)sizeof(JsfStorageHeader);
+  writer.len = 0;
+  size_t i;
+  for (i=0;i<keyLen;i++)
+    jsfStorageWriterPut(&writer, (unsigned char)key[i]);
+  if (dataAddr) {
+    uint32_t l;
+    for (l=0;l<dataLen;l++) {
+      unsigned char ch;
+      jshFlashRead(&ch, dataAddr+l, 1);
+      jsfStorageWriterPut(&writer, ch);
+    }
+  } else {
+    jsvIterateCallback(data, jsfStorageWriterCallback, &writer);
+  }
+  jsfStorageWriterFlush(&writer);
+  // now the data is there, write the header (but leave 'replaced' erased)
+  jshFlashWrite(&header, addr, 8);
+  return true;
+}
+
+static void jsfStorageMarkReplaced(uint32_t addr) {
+  uint32_t replaced = 0;
+  jshFlashWrite(&replaced, addr+8, 4);
+}
+
+/** Copy all current records into the other half of the storage area, and start
+ * using that. Returns the half now in use, or -1 on failure */
+static int jsfStorageCompact(JsfStorageArea *area) {
+  int from = jsfStorageGetActiveHalf(area, true);
+  int to = from ? 0 : 1;
+  uint32_t generation;
+  if (from<0) return -1;
+  jsfStorageGetGeneration(area, from, &generation);
+  if (!jsfStorageEraseHalf(area, to)) return -1;
+  uint32_t addr = area->start[from] + JSF_STORAGE_AREA_HEADER;
+  uint32_t toAddr = area->start[to] + JSF_STORAGE_AREA_HEADER;
+  JsfStorageHeader header;
+  while (jsfStorageGetHeader(addr, area->end[from], &header) &&
+         jsfStorageIsHeaderValid(addr, area->end[from], &header)) {
+    if (jsfStorageIsCurrent(&header)) {
+      char key[JSF_STORAGE_MAX_KEY_LEN];
+      jshFlashRead(key, addr+(uint32_t)sizeof(JsfStorageHeader), header.keyLen);
+      uint32_t dataAddr = addr+(uint32_t)sizeof(JsfStorageHeader)+header.keyLen;
+      if (!jsfStorageWriteRecord(area, to, toAddr, key, header.keyLen, 0, dataAddr, header.dataLen)) {
+        // The old half is still intact, so nothing is lost
+        jsExceptionHere(JSET_ERROR, "Not enough free space to compact Storage");
+        return -1;
+      }
+      toAddr += jsfStorageGetRecordSize(&header);
+    }
+    addr += jsfStorageGetRecordSize(&header);
+  }
+  // Only now is everything copied do we mark the new half as in use
+  jsfStorageSetGeneration(area, to, generation+1);
+  return to;
+}
+
+/// Get a key as a string, returning false (and throwing an exception) if it's not valid
+static bool jsfStorageGetKey(JsVar *key, char *keyBuf, size_t *keyLen) {
+  if (!jsvIsString(key) || jsvGetStringLength(key)==0 || jsvGetStringLength(key)>JSF_STORAGE_MAX_KEY_LEN) {
+    jsExceptionHere(JSET_ERROR, "Key must be a string of between 1 and %d characters", JSF_STORAGE_MAX_KEY_LEN);
+    return false;
+  }
+  *keyLen = jsvGetStringChars(key, 0, keyBuf, JSF_STORAGE_MAX_KEY_LEN);
+  return true;
+}
+
+/// Find the data stored under a key. Returns its address and sets len, or returns 0 (without an exception) if there isn't any
+static uint32_t jsfStorageFindData(const char *key, size_t keyLen, uint32_t *len) {
+  JsfStorageArea area;
+  if (!jsfStorageFindArea(&area)) return 0;
+  int half = jsfStorageGetActiveHalf(&area, false);
+  if (half<0) return 0;
+  uint32_t addr = jsfStorageFind(&area, half, key, keyLen, 0);
+  if (!addr) return 0;
+  JsfStorageHeader header;
+  jshFlashRead(&header, addr, sizeof(header));
+  *len = header.dataLen;
+  return addr + (uint32_t)sizeof(JsfStorageHeader) + header.keyLen;
+}
+
+/// Copy data out of flash into a new string
+static JsVar *jsfStorageReadData(uint32_t addr, uint32_t len) {
+  JsVar *str = jsvNewFromEmptyString();
+  if (!str) return 0;
+  char buf[32];
+  while (len) {
+    uint32_t l = len > sizeof(buf) ? (uint32_t)sizeof(buf) : len;
+    jshFlashRead(buf, addr, l);
+    jsvAppendStringBuf(str, buf, l);
+    addr += l;
+    len -= l;
+  }
+  return str;
+}
+#endif
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "Storage",
+  "name" : "write",
+  "generate" : "jswrap_storage_write",
+  "params" : [
+    ["key","JsVar","The key to store the data under (a string of up to 64 characters)"],
+    ["data","JsVar","The data to write - a string, array of bytes or ArrayBuffer"]
+  ],
+  "return" : ["bool","True on success, false on failure"]
+}
+Write data to flash, replacing anything already stored under the same key.
+
+If the data is the same as what is already stored, nothing is written.
+ */
+bool jswrap_storage_write(JsVar *key, JsVar *data) {
+#ifndef SAVE_ON_FLASH
+  JsfStorageArea area;
+  char keyBuf[JSF_STORAGE_MAX_KEY_LEN+1]; // +1 for jsvGetStringChars' trailing 0
+  size_t keyLen;
+  if (!jsfStorageGetKey(key, keyBuf, &keyLen) || !jsfStorageGetArea(&area)) return false;
+  uint32_t dataLen = (uint32_t)jsvIterateCallbackCount(data);
+  int half = jsfStorageGetActiveHalf(&area, true);
+  if (half<0) return false;
+  uint32_t endAddr;
+  uint32_t oldAddr = jsfStorageFind(&area, half, keyBuf, keyLen, &endAddr);
+  if (oldAddr) {
+    // Don't wear the flash out if nothing has changed
+    JsfStorageHeader header;
+    jshFlashRead(&header, oldAddr, sizeof(header));
+    if (header.dataLen == dataLen) {
+      JsfStorageCompare compare;
+      compare.addr = oldAddr+(uint32_t)sizeof(JsfStorageHeader)+header.keyLen;
+      compare.match = true;
+      jsvIterateCallback(data, jsfStorageCompareCallback, &compare);
+      if (compare.match) return true;
+    }
+  }
+  if (!jsfStorageWriteRecord(&area, half, endAddr, keyBuf, keyLen, data, 0, dataLen)) {
+    // out of space - compact and try again
+    half = jsfStorageCompact(&area);
+    if (half<0) return false;
+    oldAddr = jsfStorageFind(&area, half, keyBuf, keyLen, &endAddr);
+    if (!jsfStorageWriteRecord(&area, half, endAddr, keyBuf, keyLen, data, 0, dataLen)) {
+      jsExceptionHere(JSET_ERROR, "Not enough free space in Storage");
+      return false;
+    }
+  }
+  if (oldAddr) jsfStorageMarkReplaced(oldAddr);
+  return true;
+#else
+  NOT_USED(key);
+  NOT_USED(data);
+  return false;
+#endif
+}
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "Storage",
+  "name" : "read",
+  "generate" : "jswrap_storage_read",
+  "params" : [
+    ["key","JsVar","The key the data was stored under"]
+  ],
+  "return" : ["JsVar","A string of data, or undefined if nothing is stored under that key"]
+}
+Read data that was written with `Storage.write`
+ */
+JsVar *jswrap_storage_read(JsVar *key) {
+#ifndef SAVE_ON_FLASH
+  char keyBuf[JSF_STORAGE_MAX_KEY_LEN+1]; // +1 for jsvGetStringChars' trailing 0
+  size_t keyLen;
+  if (!jsfStorageGetKey(key, keyBuf, &keyLen)) return 0;
+  JsfStorageArea area;
+  if (!jsfStorageGetArea(&area)) return 0;
+  uint32_t len;
+  uint32_t addr = jsfStorageFindData(keyBuf, keyLen, &len);
+  if (!addr) return 0;
+  return jsfStorageReadData(addr, len);
+#else
+  NOT_USED(key);
+  return 0;
+#endif
+}
+
+#ifndef SAVE_ON_FLASH
+JsVar *jsfStorageReadDirect(JsVar *key) {
+  char keyBuf[JSF_STORAGE_MAX_KEY_LEN+1]; // +1 for jsvGetStringChars' trailing 0
+  if (!jsvIsString(key) || jsvGetStringLength(key)>JSF_STORAGE_MAX_KEY_LEN) return 0;
+  size_t keyLen = jsvGetStringChars(key, 0, keyBuf, JSF_STORAGE_MAX_KEY_LEN);
+  uint32_t len;
+  uint32_t addr = jsfStorageFindData(keyBuf, keyLen, &len);
+  if (!addr) return 0;
+#ifdef FLASH_CODE_XIP
+  char *ptr = jsfGetMemoryMappedAddress(addr);
+  if (ptr && len<=0xFFFF) {
+    JsVar *str = jsvNewWithFlags(JSV_NATIVE_STRING);
+    if (str) {
+      str->varData.nativeStr.ptr = ptr;
+      str->varData.nativeStr.len = (uint16_t)len;
+    }
+    return str;
+  }
+#endif
+  return jsfStorageReadData(addr, len);
+}
+#endif
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "Storage",
+  "name" : "erase",
+  "generate" : "jswrap_storage_erase",
+  "params" : [
+    ["key","JsVar","The key the data was stored under"]
+  ],
+  "return" : ["bool","True if there was data stored under this key"]
+}
+Remove the data stored under the given key. The space it used is reclaimed
+the next time Storage is compacted.
+ */
+bool jswrap_storage_erase(JsVar *key) {
+#ifndef SAVE_ON_FLASH
+  JsfStorageArea area;
+  char keyBuf[JSF_STORAGE_MAX_KEY_LEN+1]; // +1 for jsvGetStringChars' trailing 0
+  size_t keyLen;
+  if (!jsfStorageGetKey(key, keyBuf, &keyLen) || !jsfStorageGetArea(&area)) return false;
+  int half = jsfStorageGetActiveHalf(&area, false);
+  if (half<0) return false;
+  uint32_t addr = jsfStorageFind(&area, half, keyBuf, keyLen, 0);
+  if (addr) jsfStorageMarkReplaced(addr);
+  return addr!=0;
+#else
+  NOT_USED(key);
+  return false;
+#endif
+}
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "Storage",
+  "name" : "list",
+  "generate" : "jswrap_storage_list",
+  "return" : ["JsVar","An array of keys"]
+}
+List all the keys that have data stored under them
+ */
+JsVar *jswrap_storage_list() {
+#ifndef SAVE_ON_FLASH
+  JsfStorageArea area;
+  JsVar *keys = jsvNewEmptyArray();
+  if (!keys || !jsfStorageGetArea(&area)) return keys;
+  int half = jsfStorageGetActiveHalf(&area, false);
+  if (half<0) return keys;
+  uint32_t addr = area.start[half] + JSF_STORAGE_AREA_HEADER;
+  JsfStorageHeader header;
+  while (jsfStorageGetHeader(addr, area.end[half], &header) &&
+         jsfStorageIsHeaderValid(addr, area.end[half], &header)) {
+    if (jsfStorageIsCurrent(&header)) {
+      char key[JSF_STORAGE_MAX_KEY_LEN+1];
+      jshFlashRead(key, addr+(uint32_t)sizeof(JsfStorageHeader), header.keyLen);
+      key[header.keyLen] = 0;
+      jsvArrayPushAndUnLock(keys, jsvNewFromString(key));
+    }
+    addr += jsfStorageGetRecordSize(&header);
+  }
+  return keys;
+#else
+  return 0;
+#endif
+}
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "Storage",
+  "name" : "compact",
+  "generate" : "jswrap_storage_compact"
+}
+Copy the current data into the other half of the storage area, freeing up
+the space used by data that has been replaced or erased.
+
+This happens automatically when `Storage.write` runs out of space, but you
+can call it yourself at a convenient time so writes stay quick.
+ */
+void jswrap_storage_compact() {
+#ifndef SAVE_ON_FLASH
+  JsfStorageArea area;
+  if (jsfStorageGetArea(&area))
+    jsfStorageCompact(&area);
+#endif
+}
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "Storage",
+  "name" : "eraseAll",
+  "generate" : "jswrap_storage_eraseAll"
+}
+Erase everything in the storage area
+ */
+void jswrap_storage_eraseAll() {
+#ifndef SAVE_ON_FLASH
+  JsfStorageArea area;
+  if (!jsfStorageGetArea(&area)) return;
+  if (jsfStorageEraseHalf(&area, 0))
+    jsfStorageEraseHalf(&area, 1);
+#endif
+}
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "Storage",
+  "name" : "getStats",
+  "generate" : "jswrap_storage_getStats",
+  "return" : ["JsVar","An object containing `{totalBytes, freeBytes, trashBytes, keys}`"]
+}
+Return information about how the storage area is being used. `freeBytes`
+can be written without compacting, and `trashBytes` will be freed by
+compacting.
+ */
+JsVar *jswrap_storage_getStats() {
+#ifndef SAVE_ON_FLASH
+  JsfStorageArea area;
+  if (!jsfStorageGetArea(&area)) return 0;
+  JsVar *obj = jsvNewObject();
+  if (!obj) return 0;
+  int half = jsfStorageGetActiveHalf(&area, false);
+  uint32_t total = area.end[0] - area.start[0];
+  uint32_t freeBytes = total - JSF_STORAGE_AREA_HEADER, trash = 0, keys = 0;
+  if (half>=0) {
+    total = area.end[half] - area.start[half];
+    uint32_t addr = area.start[half] + JSF_STORAGE_AREA_HEADER;
+    JsfStorageHeader header;
+    while (jsfStorageGetHeader(addr, area.end[half], &header) &&
+           jsfStorageIsHeaderValid(addr, area.end[half], &header)) {
+      if (jsfStorageIsCurrent(&header)) keys++;
+      else trash += jsfStorageGetRecordSize(&header);
+      addr += jsfStorageGetRecordSize(&header);
+    }
+    if (addr+sizeof(JsfStorageHeader) <= area.end[half] && !jsfStorageGetHeader(addr, area.end[half], &header))
+      freeBytes = area.end[half] - addr;
+    else
+      freeBytes = 0;
+  }
+  jsvObjectSetChildAndUnLock(obj, "totalBytes", jsvNewFromInteger((JsVarInt)total));
+  jsvObjectSetChildAndUnLock(obj, "freeBytes", jsvNewFromInteger((JsVarInt)freeBytes));
+  jsvObjectSetChildAndUnLock(obj, "trashBytes", jsvNewFromInteger((JsVarInt)trash));
+  jsvObjectSetChildAndUnLock(obj, "keys", jsvNewFromInteger((JsVarInt)keys));
+  return obj;
+#else
+  return 0;
+#endif
+}
@@ -0,0 +1,30 @@
+/*
+ * This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+ *
+ * Copyright (C) 2013 Gordon Williams <gw@pur3.co.uk>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * ----------------------------------------------------------------------------
+ * JavaScript key/value storage in free flash memory
+ * ----------------------------------------------------------------------------
+ */
+#include "jsvar.h"
+
+bool jswrap_storage_write(JsVar *key, JsVar *data);
+JsVar *jswrap_storage_read(JsVar *key);
+bool jswrap_storage_erase(JsVar *key);
+JsVar *jswrap_storage_list();
+void jswrap_storage_compact();
+void jswrap_storage_eraseAll();
+JsVar *jswrap_storage_getStats();
+
+#ifndef SAVE_ON_FLASH
+/** Read data written with Storage.write, or return 0 (without an exception)
+ * if there isn't any. Where flash is memory mapped this is a native string
+ * that points at the data in flash, so it uses no RAM. Otherwise it's a copy,
+ * like Storage.read */
+JsVar *jsfStorageReadDirect(JsVar *key);
+#endif
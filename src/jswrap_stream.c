@@ -19,6 +19,7 @@
  */
 #include "jswrap_stream.h"
 #include "jsinteractive.h"
+#include "jshardware.h"
 
 // force this because we don't currently export anything
 /*JSON{
@@ -26,13 +27,33 @@
   "include" : "jswrap_stream.c"
 }*/
 
+/* Data received when there's no listener is stored in a ring buffer - a
+ * flat string starting with a StreamRing header - so that reading a little
+ * at a time doesn't copy all of the remaining data each time. */
+typedef struct {
+  uint16_t start;  ///< index of the first byte of data
+  uint16_t length; ///< number of bytes of data
+  uint16_t size;   ///< size of the data area
+} StreamRing;
+
+/// Get the header and a pointer to the data area of a ring buffer, or return 0 if it isn't one
+static char *streamGetRing(JsVar *buf, StreamRing *ring) {
+  if (!jsvIsFlatString(buf)) return 0;
+  char *ptr = jsvGetFlatStringPointer(buf);
+  memcpy(ring, ptr, sizeof(StreamRing));
+  return ptr + sizeof(StreamRing);
+}
+
+static void streamSetRing(JsVar *buf, const StreamRing *ring) {
+  memcpy(jsvGetFlatStringPointer(buf), ring, sizeof(StreamRing));
+}
+
 // Return how many bytes are available to read
 JsVarInt jswrap_stream_available(JsVar *parent) {
   if (!jsvIsObject(parent)) return 0;
   JsVar *buf = jsvObjectGetChild(parent, STREAM_BUFFER_NAME, 0);
-  JsVarInt chars = 0;
-  if (jsvIsString(buf))
-    chars = (JsVarInt)jsvGetStringLength(buf);
+  StreamRing ring;
+  JsVarInt chars = streamGetRing(buf, &ring) ? ring.length : 0;
   jsvUnLock(buf);
   return chars;
 }
@@ -41,26 +62,330 @@ JsVarInt jswrap_stream_available(JsVar *parent) {
 JsVar *jswrap_stream_read(JsVar *parent, JsVarInt chars) {
   if (!jsvIsObject(parent)) return 0;
   JsVar *buf = jsvObjectGetChild(parent, STREAM_BUFFER_NAME, 0);
-  JsVar *data = 0;
+  JsVar *data = jsvNewFromEmptyString();
+  StreamRing ring;
+  char *ringData = streamGetRing(buf, &ring);
+  if (ringData && data) {
+    size_t len = ring.length;
+    if (chars > 0 && (size_t)chars < len) len = (size_t)chars;
+    // copy out in (up to) two parts, as the data may wrap around
+    size_t first = (size_t)(ring.size - ring.start);
+    if (first > len) first = len;
+    jsvAppendStringBuf(data, &ringData[ring.start], first);
+    jsvAppendStringBuf(data, ringData, len - first);
+    ring.start = (uint16_t)((ring.start + len) % ring.size);
+    ring.length = (uint16_t)(ring.length - len);
+    streamSetRing(buf, &ring);
+    // if we stopped a Serial device sending, let it start again once the buffer has emptied a bit
+    if (ring.length <= ring.size/4)
+      jshSetFlowControlHold(jsiGetDeviceFromClass(parent), false);
+  }
+  jsvUnLock(buf);
+  return data;
+}
+
+/// Remove and return all buffered data, or 0 if there is none
+JsVar *jswrap_stream_takeData(JsVar *parent) {
+  if (!jswrap_stream_available(parent)) return 0;
+  JsVar *data = jswrap_stream_read(parent, 0);
+  jsvRemoveNamedChild(parent, STREAM_BUFFER_NAME);
+  return data;
+}
+
+#ifndef SAVE_ON_FLASH
+#define STREAM_MAX_DELIMITER 8
+
+typedef enum {
+  SFM_NONE,      ///< No frame boundaries - just pass data on after idleTimeout
+  SFM_DELIMITER, ///< Frames end with 'delimiter'
+  SFM_LENGTH,    ///< Frames are all 'length' bytes long
+  SFM_PREFIX,    ///< Frames start with a 'prefixSize' byte length
+} PACKED_FLAGS StreamFramingMode;
+
+/// The framing for a stream - stored in a string in STREAM_FRAMING_NAME
+typedef struct {
+  StreamFramingMode mode;
+  unsigned char prefixSize;  ///< SFM_PREFIX: 1, 2 or 4 bytes
+  bool prefixBigEndian;      ///< SFM_PREFIX: is the length big endian?
+  unsigned char delimiterLen;
+  char delimiter[STREAM_MAX_DELIMITER+1]; ///< +1 for the 0 jsvGetStringChars adds
+  uint32_t length;           ///< SFM_LENGTH: the length of each frame
+  uint32_t maxLength;        ///< If we have more than this and no frame, pass on what we have
+  uint32_t idleTimeout;      ///< milliseconds, or 0. If no data arrives for this long, pass on what we have
+  JsSysTime lastData;        ///< When data was last received (if idleTimeout!=0)
+} StreamFraming;
+
+/// Read the framing for a stream back out of the string it is stored in
+static void streamGetFraming(JsVar *framingVar, StreamFraming *f) {
+  char data[sizeof(StreamFraming)+1]; // jsvGetStringChars adds a trailing 0
+  jsvGetStringChars(framingVar, 0, data, sizeof(StreamFraming));
+  memcpy(f, data, sizeof(StreamFraming));
+}
+
+/// Array of streams with partial frames waiting on an idleTimeout
+static JsVar *streamGetFramedArray(bool create) {
+  return jsvObjectGetChild(execInfo.hiddenRoot, "framed", create ? JSV_ARRAY : 0);
+}
+
+/// Call the on('data') handler - if it errors, remove it and return false
+static bool streamExecuteCallback(JsVar *parent, JsVar *callback, JsVar *data) {
+  if (jsiExecuteEventCallback(parent, callback, 1, &data))
+    return true;
+  jsError("Error processing Serial data handler - removing it.");
+  jsErrorFlags |= JSERR_CALLBACK;
+  jsvRemoveNamedChild(parent, STREAM_CALLBACK_NAME);
+  return false;
+}
+
+/** If there's a complete frame in buf, return true and set the start and
+ * length of its data, and where the next frame starts */
+static bool streamGetFrame(const StreamFraming *f, JsVar *buf, size_t bufLen, size_t *start, size_t *len, size_t *next) {
+  switch (f->mode) {
+  case SFM_DELIMITER: {
+    JsvStringIterator it;
+    jsvStringIteratorNew(&it, buf, 0);
+    bool found = false;
+    while (!found && jsvStringIteratorHasChar(&it)) {
+      if (jsvStringIteratorGetChar(&it) == f->delimiter[0]) {
+        size_t idx = jsvStringIteratorGetIndex(&it);
+        char d[STREAM_MAX_DELIMITER+1];
+        if (f->delimiterLen==1 ||
+            (jsvGetStringChars(buf, idx, d, f->delimiterLen)==f->delimiterLen &&
+             memcmp(d, f->delimiter, f->delimiterLen)==0)) {
+          *start = 0;
+          *len = idx;
+          *next = idx + f->delimiterLen;
+          found = true;
+        }
+      }
+      jsvStringIteratorNext(&it);
+    }
+    jsvStringIteratorFree(&it);
+    return found;
+  }
+  case SFM_LENGTH:
+    if (bufLen < f->length) return false;
+    *start = 0;
+    *len = f->length;
+    *next = f->length;
+    return true;
+  case SFM_PREFIX: {
+    unsigned char p[5];
+    if (bufLen < f->prefixSize) return false;
+    jsvGetStringChars(buf, 0, (char*)p, f->prefixSize);
+    uint32_t l = 0;
+    for (int i=0;i<f->prefixSize;i++)
+      l |= (uint32_t)p[f->prefixBigEndian ? (f->prefixSize-1-i) : i] << (i*8);
+    if (bufLen - f->prefixSize < l) return false;
+    *start = f->prefixSize;
+    *len = l;
+    *next = f->prefixSize + l;
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
+/** Add data to the stream's partial frame, and call the on('data')
+ * handler once for each complete frame. This MAY CLAIM dataString */
+static void streamPushFrames(JsVar *parent, JsVar *callback, JsVar *framingVar, JsVar *dataString) {
+  StreamFraming f;
+  streamGetFraming(framingVar, &f);
+  if (f.idleTimeout) {
+    f.lastData = jshGetSystemTime();
+    jsvSetString(framingVar, (char*)&f, sizeof(f));
+  }
+
+  JsVar *buf = jsvObjectGetChild(parent, STREAM_FRAME_BUFFER_NAME, 0);
   if (jsvIsString(buf)) {
-    size_t len = jsvGetStringLength(buf);
-    if (chars <= 0 || (size_t)chars>=len) {
-      // return the whole buffer and remove it
-      data = buf;
-      buf = 0;
-      jsvRemoveNamedChild(parent, STREAM_BUFFER_NAME);
-    } else {
-      // return just part of the buffer, and shorten it accordingly
-      data = jsvNewFromStringVar(buf, 0, (size_t)chars);
-      JsVar *newBuf = jsvNewFromStringVar(buf, (size_t)chars, JSVAPPENDSTRINGVAR_MAXLENGTH);
-      jsvObjectSetChildAndUnLock(parent, STREAM_BUFFER_NAME, newBuf);
+    jsvAppendStringVarComplete(buf, dataString);
+  } else {
+    jsvUnLock(buf);
+    buf = jsvLockAgain(dataString);
+  }
+
+  bool ok = true, changed = false;
+  while (ok && !changed && buf) {
+    size_t bufLen = jsvGetStringLength(buf);
+    size_t start, len, next;
+    JsVar *frame;
+    if (streamGetFrame(&f, buf, bufLen, &start, &len, &next)) {
+      frame = jsvNewFromStringVar(buf, start, len);
+    } else if (bufLen > f.maxLength) {
+      // we're never going to get a whole frame - pass on what we have
+      frame = jsvLockAgain(buf);
+      next = bufLen;
+    } else break;
+    JsVar *rest = (next < bufLen) ? jsvNewFromStringVar(buf, next, JSVAPPENDSTRINGVAR_MAXLENGTH) : 0;
+    jsvUnLock(buf);
+    buf = rest;
+    if (frame) ok = streamExecuteCallback(parent, callback, frame);
+    jsvUnLock(frame);
+    // the handler may have called setFraming
+    JsVar *currentFraming = jsvObjectGetChild(parent, STREAM_FRAMING_NAME, 0);
+    changed = currentFraming != framingVar;
+    jsvUnLock(currentFraming);
+  }
+
+  if (!ok) {
+    jsvRemoveNamedChild(parent, STREAM_FRAME_BUFFER_NAME);
+  } else if (changed) {
+    // handle the rest of the data with the new framing (setFraming cleared the old partial frame)
+    if (buf) jswrap_stream_pushData(parent, buf, true);
+  } else if (buf) {
+    jsvObjectSetChild(parent, STREAM_FRAME_BUFFER_NAME, buf);
+    if (f.idleTimeout) {
+      JsVar *arr = streamGetFramedArray(true);
+      if (arr) jsvArrayAddUnique(arr, parent);
+      jsvUnLock(arr);
     }
-  } else
-    data = jsvNewFromEmptyString();
+  } else {
+    jsvRemoveNamedChild(parent, STREAM_FRAME_BUFFER_NAME);
+  }
   jsvUnLock(buf);
-  return data;
 }
 
+/** Set framing options for the stream */
+void jswrap_stream_setFraming(JsVar *parent, JsVar *options) {
+  if (!jsvIsObject(parent)) return;
+  jsvRemoveNamedChild(parent, STREAM_FRAME_BUFFER_NAME);
+  if (jsvIsUndefined(options) || jsvIsNull(options)) {
+    jsvRemoveNamedChild(parent, STREAM_FRAMING_NAME);
+    return;
+  }
+
+  StreamFraming f;
+  memset(&f, 0, sizeof(f));
+  JsVar *delimiter = 0, *lengthPrefix = 0;
+  JsVarInt length = 0, maxLength = STREAM_MAX_FRAME_SIZE;
+  JsVarFloat idleTimeout = 0;
+  jsvConfigObject configs[] = {
+      {"delimiter", JSV_OBJECT /* a variable */, &delimiter},
+      {"length", JSV_INTEGER, &length},
+      {"lengthPrefix", JSV_OBJECT /* a variable */, &lengthPrefix},
+      {"maxLength", JSV_INTEGER, &maxLength},
+      {"idleTimeout", JSV_FLOAT, &idleTimeout},
+  };
+  if (!jsvReadConfigObject(options, configs, sizeof(configs) / sizeof(jsvConfigObject)))
+    return;
+
+  bool ok = true;
+  int modes = 0;
+  if (delimiter) {
+    modes++;
+    f.mode = SFM_DELIMITER;
+    size_t l = jsvIsString(delimiter) ? jsvGetStringLength(delimiter) : 0;
+    if (l<1 || l>STREAM_MAX_DELIMITER) {
+      jsExceptionHere(JSET_ERROR, "Expecting a delimiter of 1 to %d characters, got %q", STREAM_MAX_DELIMITER, delimiter);
+      ok = false;
+    } else
+      f.delimiterLen = (unsigned char)jsvGetStringChars(delimiter, 0, f.delimiter, l);
+  }
+  if (length) {
+    modes++;
+    f.mode = SFM_LENGTH;
+    f.length = (uint32_t)length;
+    if (length<0) {
+      jsExceptionHere(JSET_ERROR, "Invalid length %d", length);
+      ok = false;
+    }
+  }
+  if (lengthPrefix) {
+    modes++;
+    f.mode = SFM_PREFIX;
+    if (jsvIsStringEqual(lengthPrefix, "u8")) {
+      f.prefixSize = 1;
+    } else if (jsvIsStringEqual(lengthPrefix, "u16le") || jsvIsStringEqual(lengthPrefix, "u16be")) {
+      f.prefixSize = 2;
+    } else if (jsvIsStringEqual(lengthPrefix, "u32le") || jsvIsStringEqual(lengthPrefix, "u32be")) {
+      f.prefixSize = 4;
+    } else {
+      jsExceptionHere(JSET_ERROR, "Invalid lengthPrefix %q", lengthPrefix);
+      ok = false;
+    }
+    f.prefixBigEndian = f.prefixSize>1 && jsvGetCharInString(lengthPrefix, 3)=='b';
+  }
+  if (modes>1) {
+    jsExceptionHere(JSET_ERROR, "Only one of delimiter, length or lengthPrefix can be used");
+    ok = false;
+  }
+  if (ok && !modes && idleTimeout<=0) {
+    jsExceptionHere(JSET_ERROR, "Expecting delimiter, length, lengthPrefix or idleTimeout");
+    ok = false;
+  }
+  if (ok && maxLength<=0) {
+    jsExceptionHere(JSET_ERROR, "Invalid maxLength %d", maxLength);
+    ok = false;
+  }
+  jsvUnLock2(delimiter, lengthPrefix);
+  if (!ok) return;
+  f.maxLength = (uint32_t)maxLength;
+  if (idleTimeout>0)
+    f.idleTimeout = (idleTimeout<1) ? 1 : (uint32_t)idleTimeout;
+
+  JsVar *framingVar = jsvNewStringOfLength(sizeof(f));
+  if (!framingVar) return; // out of memory
+  jsvSetString(framingVar, (char*)&f, sizeof(f));
+  jsvObjectSetChildAndUnLock(parent, STREAM_FRAMING_NAME, framingVar);
+}
+
+/*JSON{
+  "type" : "idle",
+  "generate" : "jswrap_stream_idle",
+  "ifndef" : "SAVE_ON_FLASH"
+}*/
+bool jswrap_stream_idle() {
+  JsVar *arr = streamGetFramedArray(false);
+  if (!arr) return false;
+  bool wasBusy = false;
+  JsSysTime time = jshGetSystemTime();
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, arr);
+  while (jsvObjectIteratorHasValue(&it)) {
+    JsVar *stream = jsvObjectIteratorGetValue(&it);
+    JsVar *framingVar = jsvObjectGetChild(stream, STREAM_FRAMING_NAME, 0);
+    JsVar *buf = jsvObjectGetChild(stream, STREAM_FRAME_BUFFER_NAME, 0);
+    bool waiting = false;
+    if (framingVar && buf) {
+      StreamFraming f;
+      streamGetFraming(framingVar, &f);
+      if (time - f.lastData < jshGetTimeFromMilliseconds((JsVarFloat)f.idleTimeout)) {
+        waiting = true;
+      } else {
+        // nothing received for idleTimeout - pass on what we have
+        jsvRemoveNamedChild(stream, STREAM_FRAME_BUFFER_NAME);
+        JsVar *callback = jsvFindChildFromString(stream, STREAM_CALLBACK_NAME, false);
+        if (callback) streamExecuteCallback(stream, callback, buf);
+        jsvUnLock(callback);
+      }
+    }
+    jsvUnLock3(stream, framingVar, buf);
+    if (waiting) {
+      wasBusy = true;
+      jsvObjectIteratorNext(&it);
+    } else
+      jsvObjectIteratorRemoveAndGotoNext(&it, arr);
+  }
+  jsvObjectIteratorFree(&it);
+  jsvUnLock(arr);
+  return wasBusy;
+}
+
+/*JSON{
+  "type" : "kill",
+  "generate" : "jswrap_stream_kill",
+  "ifndef" : "SAVE_ON_FLASH"
+}*/
+void jswrap_stream_kill() {
+  JsVar *arr = streamGetFramedArray(false);
+  if (arr) {
+    jsvRemoveAllChildren(arr);
+    jsvUnLock(arr);
+  }
+}
+#endif
+
 /** Push data into a stream. To be used by Espruino (not a user).
  * This either calls the on('data') handler if it exists, or it
  * puts the data in a buffer. This MAY CLAIM the string that is
@@ -77,6 +402,14 @@ bool jswrap_stream_pushData(JsVar *parent, JsVar *dataString, bool force) {
 
   JsVar *callback = jsvFindChildFromString(parent, STREAM_CALLBACK_NAME, false);
   if (callback) {
+#ifndef SAVE_ON_FLASH
+    JsVar *framingVar = jsvObjectGetChild(parent, STREAM_FRAMING_NAME, 0);
+    if (framingVar) {
+      streamPushFrames(parent, callback, framingVar, dataString);
+      jsvUnLock2(framingVar, callback);
+      return true;
+    }
+#endif
     if (!jsiExecuteEventCallback(parent, callback, 1, &dataString)) {
       jsError("Error processing Serial data handler - removing it.");
       jsErrorFlags |= JSERR_CALLBACK;
@@ -84,24 +417,51 @@ bool jswrap_stream_pushData(JsVar *parent, JsVar *dataString, bool force) {
     }
     jsvUnLock(callback);
   } else {
-    // No callback - try and add buffer
+    // No callback - try and add to the buffer
     JsVar *buf = jsvObjectGetChild(parent, STREAM_BUFFER_NAME, 0);
-    if (!jsvIsString(buf)) {
-      // no buffer, just set this one up
-      jsvObjectSetChild(parent, STREAM_BUFFER_NAME, dataString);
-    } else {
-      // append (if there is room!)
-      size_t bufLen = jsvGetStringLength(buf);
-      size_t dataLen = jsvGetStringLength(dataString);
-      if (bufLen + dataLen > STREAM_MAX_BUFFER_SIZE) {
-        if (force) jsErrorFlags |= JSERR_BUFFER_FULL;
-        // jsWarn("String buffer overflowed maximum size (%d)", STREAM_MAX_BUFFER_SIZE);
-        ok = false;
-      }
-      if ((ok || force) && (bufLen < STREAM_MAX_BUFFER_SIZE))
-        jsvAppendStringVar(buf, dataString, 0, STREAM_MAX_BUFFER_SIZE-bufLen);
+    size_t dataLen = jsvGetStringLength(dataString);
+    StreamRing ring;
+    char *ringData = streamGetRing(buf, &ring);
+    if (!ringData || (ring.length==0 && ring.size<dataLen)) {
+      // no buffer (or it's empty and too small for this data) - set one up
       jsvUnLock(buf);
+      ring.start = 0;
+      ring.length = 0;
+      ring.size = STREAM_MAX_BUFFER_SIZE;
+      if (dataLen > ring.size) ring.size = (uint16_t)((dataLen < 0xFFFF) ? dataLen : 0xFFFF);
+      buf = jsvNewFlatStringOfLength((unsigned int)(sizeof(StreamRing) + ring.size));
+      if (buf) {
+        streamSetRing(buf, &ring);
+        ringData = streamGetRing(buf, &ring);
+        jsvObjectSetChild(parent, STREAM_BUFFER_NAME, buf);
+      } else
+        ringData = 0;
+    }
+    // append (if there is room!)
+    size_t space = ringData ? (size_t)(ring.size - ring.length) : 0;
+    if (dataLen > space) {
+      if (force) jsErrorFlags |= JSERR_BUFFER_FULL;
+      // jsWarn("String buffer overflowed maximum size (%d)", STREAM_MAX_BUFFER_SIZE);
+      ok = false;
+    }
+    if (ringData && (ok || force)) {
+      if (dataLen > space) dataLen = space;
+      size_t idx = (size_t)((ring.start + ring.length) % ring.size);
+      JsvStringIterator it;
+      jsvStringIteratorNew(&it, dataString, 0);
+      for (size_t i=0;i<dataLen;i++) {
+        ringData[idx] = jsvStringIteratorGetChar(&it);
+        jsvStringIteratorNext(&it);
+        if (++idx == ring.size) idx = 0;
+      }
+      jsvStringIteratorFree(&it);
+      ring.length = (uint16_t)(ring.length + dataLen);
+      streamSetRing(buf, &ring);
+      // nearly full - if this is a Serial device, ask it to stop sending
+      if (ring.length >= ring.size*3/4)
+        jshSetFlowControlHold(jsiGetDeviceFromClass(parent), true);
     }
+    jsvUnLock(buf);
   }
   return ok;
 }
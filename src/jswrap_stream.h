@@ -14,12 +14,17 @@
 #include "jsvar.h"
 
 
-#define STREAM_BUFFER_NAME JS_HIDDEN_CHAR_STR"buf" // the buffer to store data in when no listener is defined
+#define STREAM_BUFFER_NAME JS_HIDDEN_CHAR_STR"buf" // ring buffer (flat string) to store data in when no listener is defined
 #define STREAM_CALLBACK_NAME JS_EVENT_PREFIX"data"
-#define STREAM_MAX_BUFFER_SIZE 512
+#define STREAM_MAX_BUFFER_SIZE 512 // size of the ring buffer (unless a single chunk of data received is bigger)
+#define STREAM_FRAMING_NAME JS_HIDDEN_CHAR_STR"frm" // framing options set with setFraming
+#define STREAM_FRAME_BUFFER_NAME JS_HIDDEN_CHAR_STR"fbuf" // the partial frame received so far
+#define STREAM_MAX_FRAME_SIZE 1024 // default maxLength for framing - data is passed on as-is if a frame gets bigger than this
 
 JsVarInt jswrap_stream_available(JsVar *parent);
 JsVar *jswrap_stream_read(JsVar *parent, JsVarInt chars);
+/// Remove and return all buffered data, or 0 if there is none
+JsVar *jswrap_stream_takeData(JsVar *parent);
 
 /** Push data into a stream. To be used by Espruino (not a user).
  * This either calls the on('data') handler if it exists, or it
@@ -32,3 +37,9 @@ JsVar *jswrap_stream_read(JsVar *parent, JsVarInt chars);
  */
 bool jswrap_stream_pushData(JsVar *parent, JsVar *dataString, bool force);
 
+/** Set how data pushed with jswrap_stream_pushData is split up
+ * before it is passed to the on('data') handler. */
+void jswrap_stream_setFraming(JsVar *parent, JsVar *options);
+bool jswrap_stream_idle();
+void jswrap_stream_kill();
+
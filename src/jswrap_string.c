@@ -14,6 +14,7 @@
  * ----------------------------------------------------------------------------
  */
 #include "jswrap_string.h"
+#include "jswrap_regexp.h"
 #include "jsvariterator.h"
 
 /*JSON{
@@ -156,6 +157,77 @@ Return the index of substring in this string, or -1 if not found
 }
 Return the last index of substring in this string, or -1 if not found
  */
+/// The longest search string that jswrap_string_find uses a skip table for
+#define STRING_FIND_MAX_NEEDLE 64
+
+/** Return the first index >= startIdx of needle in str (both strings), or -1.
+ * For search strings of up to STRING_FIND_MAX_NEEDLE characters this is a
+ * Boyer-Moore-Horspool search, which skips ahead by up to the length of the
+ * search string each time. Flat strings are searched directly in memory,
+ * and others are read once with one string iterator, keeping the characters
+ * we're currently comparing against in a small ring buffer. */
+static int jswrap_string_find(JsVar *str, JsVar *needle, int startIdx) {
+  int strLength = (int)jsvGetStringLength(str);
+  int m = (int)jsvGetStringLength(needle);
+  if (startIdx<0) startIdx=0;
+  if (startIdx+m > strLength) return -1;
+  if (m==0) return startIdx;
+  if (m > STRING_FIND_MAX_NEEDLE) {
+    // too big for our buffers - just compare at every position
+    int idx;
+    for (idx=startIdx;idx<=strLength-m;idx++)
+      if (jsvCompareString(str, needle, (size_t)idx, 0, true)==0)
+        return idx;
+    return -1;
+  }
+
+  char pat[STRING_FIND_MAX_NEEDLE+1]; // jsvGetStringChars adds a trailing 0
+  jsvGetStringChars(needle, 0, pat, (size_t)m);
+  // how far we can move on if the last character of the window is 'c'
+  unsigned char skip[256];
+  memset(skip, m, sizeof(skip));
+  int i;
+  for (i=0;i<m-1;i++)
+    skip[(unsigned char)pat[i]] = (unsigned char)(m-1-i);
+  unsigned char last = (unsigned char)pat[m-1];
+  int pos = startIdx; // start of the window we're comparing against
+
+  if (jsvIsFlatString(str)) {
+    const char *s = jsvGetFlatStringPointer(str);
+    while (pos <= strLength-m) {
+      unsigned char c = (unsigned char)s[pos+m-1];
+      if (c==last && memcmp(&s[pos], pat, (size_t)(m-1))==0)
+        return pos;
+      pos += skip[c];
+    }
+    return -1;
+  }
+
+  char window[STRING_FIND_MAX_NEEDLE]; // character n of str is at window[n%m]
+  int got = 0; // how many characters of the window we've read
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, str, (size_t)startIdx);
+  while (pos <= strLength-m) {
+    while (got<m) {
+      window[(pos+got)%m] = jsvStringIteratorGetChar(&it);
+      jsvStringIteratorNext(&it);
+      got++;
+    }
+    unsigned char c = (unsigned char)window[(pos+m-1)%m];
+    if (c==last) {
+      for (i=0;i<m-1 && window[(pos+i)%m]==pat[i];i++);
+      if (i==m-1) {
+        jsvStringIteratorFree(&it);
+        return pos;
+      }
+    }
+    pos += skip[c];
+    got -= skip[c];
+  }
+  jsvStringIteratorFree(&it);
+  return -1;
+}
+
 int jswrap_string_indexOf(JsVar *parent, JsVar *substring, JsVar *fromIndex, bool lastIndexOf) {
   if (!jsvIsString(parent)) return 0;
   // slow, but simple!
@@ -189,6 +261,11 @@ int jswrap_string_indexOf(JsVar *parent, JsVar *substring, JsVar *fromIndex, boo
     }
   }
 
+  if (!lastIndexOf) {
+    idx = jswrap_string_find(parent, substring, idx);
+    jsvUnLock(substring);
+    return idx;
+  }
   for (;idx!=end;idx+=dir) {
     if (jsvCompareString(parent, substring, (size_t)idx, 0, true)==0) {
       jsvUnLock(substring);
@@ -210,9 +287,18 @@ int jswrap_string_indexOf(JsVar *parent, JsVar *substring, JsVar *fromIndex, boo
   ],
   "return" : ["JsVar","This string with `subStr` replaced"]
 }
-Search and replace ONE occurrance of `subStr` with `newSubStr` and return the result. This doesn't alter the original string. Regular expressions not supported.
+Search and replace ONE occurrance of `subStr` with `newSubStr` and return the result. This doesn't alter the original string.
+
+`subStr` can also be a RegExp, in which case every match is replaced if it has
+the `g` flag. `newSubStr` can then contain `$&` (the match) and `$1`-`$9` (the
+groups), or be a function called with the match, groups, index and string
+that returns the replacement.
  */
 JsVar *jswrap_string_replace(JsVar *parent, JsVar *subStr, JsVar *newSubStr) {
+#ifndef SAVE_ON_FLASH
+  if (jswrap_regexp_isRegExp(subStr))
+    return jswrap_regexp_replace(subStr, parent, newSubStr);
+#endif
   JsVar *str = jsvAsString(parent, false);
   subStr = jsvAsString(subStr, false);
   newSubStr = jsvAsString(newSubStr, false);
@@ -231,6 +317,32 @@ JsVar *jswrap_string_replace(JsVar *parent, JsVar *subStr, JsVar *newSubStr) {
 }
 
 
+/*JSON{
+  "type" : "method",
+  "class" : "String",
+  "name" : "match",
+  "generate" : "jswrap_string_match",
+  "params" : [
+    ["regex","JsVar","A RegExp (or a string to make one from) to search for"]
+  ],
+  "return" : ["JsVar","An array of matches, or null"],
+  "ifndef" : "SAVE_ON_FLASH"
+}
+Match this string against a RegExp. Without the `g` flag this returns the same
+as `RegExp.exec` - the match, followed by its groups. With `g` it returns an
+array of every match. Returns `null` if nothing matched.
+ */
+JsVar *jswrap_string_match(JsVar *parent, JsVar *regex) {
+  if (!jsvIsString(parent)) return 0;
+  if (jswrap_regexp_isRegExp(regex))
+    return jswrap_regexp_match(regex, parent);
+  regex = jswrap_regexp_constructor(regex, 0);
+  if (!regex) return 0;
+  JsVar *result = jswrap_regexp_match(regex, parent);
+  jsvUnLock(regex);
+  return result;
+}
+
 /*JSON{
   "type" : "method",
   "class" : "String",
@@ -243,7 +355,6 @@ JsVar *jswrap_string_replace(JsVar *parent, JsVar *subStr, JsVar *newSubStr) {
   "return" : ["JsVar","The part of this string between start and end"]
 }*/
 JsVar *jswrap_string_substring(JsVar *parent, JsVarInt pStart, JsVar *vEnd) {
-  JsVar *res;
   JsVarInt pEnd = jsvIsUndefined(vEnd) ? JSVAPPENDSTRINGVAR_MAXLENGTH : (int)jsvGetInteger(vEnd);
   if (pStart<0) pStart=0;
   if (pEnd<0) pEnd=0;
@@ -252,10 +363,7 @@ JsVar *jswrap_string_substring(JsVar *parent, JsVarInt pStart, JsVar *vEnd) {
     pStart = pEnd;
     pEnd = l;
   }
-  res = jsvNewFromEmptyString();
-  if (!res) return 0; // out of memory
-  jsvAppendStringVar(res, parent, (size_t)pStart, (size_t)(pEnd-pStart));
-  return res;
+  return jsvNewStringView(parent, (size_t)pStart, (size_t)(pEnd-pStart));
 }
 
 /*JSON{
@@ -270,15 +378,11 @@ JsVar *jswrap_string_substring(JsVar *parent, JsVarInt pStart, JsVar *vEnd) {
   "return" : ["JsVar","Part of this string from start for len characters"]
 }*/
 JsVar *jswrap_string_substr(JsVar *parent, JsVarInt pStart, JsVar *vLen) {
-  JsVar *res;
   JsVarInt pLen = jsvIsUndefined(vLen) ? JSVAPPENDSTRINGVAR_MAXLENGTH : (int)jsvGetInteger(vLen);
   if (pLen<0) pLen = 0;
   if (pStart<0) pStart += (JsVarInt)jsvGetStringLength(parent);
   if (pStart<0) pStart = 0;
-  res = jsvNewFromEmptyString();
-  if (!res) return 0; // out of memory
-  jsvAppendStringVar(res, parent, (size_t)pStart, (size_t)pLen);
-  return res;
+  return jsvNewStringView(parent, (size_t)pStart, (size_t)pLen);
 }
 
 /*JSON{
@@ -293,17 +397,13 @@ JsVar *jswrap_string_substr(JsVar *parent, JsVarInt pStart, JsVar *vLen) {
   "return" : ["JsVar","Part of this string from start for len characters"]
 }*/
 JsVar *jswrap_string_slice(JsVar *parent, JsVarInt pStart, JsVar *vEnd) {
-  JsVar *res;
   JsVarInt pEnd = jsvIsUndefined(vEnd) ? JSVAPPENDSTRINGVAR_MAXLENGTH : (int)jsvGetInteger(vEnd);
   if (pStart<0) pStart += (JsVarInt)jsvGetStringLength(parent);
   if (pEnd<0) pEnd += (JsVarInt)jsvGetStringLength(parent);
   if (pStart<0) pStart = 0;
   if (pEnd<0) pEnd = 0;
-  res = jsvNewFromEmptyString();
-  if (!res) return 0; // out of memory
-  if (pEnd>pStart)
-    jsvAppendStringVar(res, parent, (size_t)pStart, (size_t)(pEnd-pStart));
-  return res;
+  if (pEnd<=pStart) return jsvNewFromEmptyString();
+  return jsvNewStringView(parent, (size_t)pStart, (size_t)(pEnd-pStart));
 }
 
 
@@ -318,8 +418,15 @@ JsVar *jswrap_string_slice(JsVar *parent, JsVarInt pStart, JsVar *vEnd) {
   "return" : ["JsVar","Part of this string from start for len characters"]
 }
 Return an array made by splitting this string up by the separator. eg. ```'1,2,3'.split(',')==[1,2,3]```
+
+The separator can also be a RegExp, in which case any groups it matches are
+added to the array too. eg. ```'a1b2c'.split(/(\d)/)==['a','1','b','2','c']```
  */
 JsVar *jswrap_string_split(JsVar *parent, JsVar *split) {
+#ifndef SAVE_ON_FLASH
+  if (jswrap_regexp_isRegExp(split))
+    return jswrap_regexp_split(split, parent);
+#endif
   JsVar *array = jsvNewEmptyArray();
   if (!array) return 0; // out of memory
 
@@ -329,23 +436,28 @@ JsVar *jswrap_string_split(JsVar *parent, JsVar *split) {
   }
 
   split = jsvAsString(split, false);
-
-  int idx, last = 0;
-  int splitlen = jsvIsUndefined(split) ? 0 : (int)jsvGetStringLength(split);
-  int l = (int)jsvGetStringLength(parent) + 1 - splitlen;
-
-  for (idx=0;idx<=l;idx++) {
-    if (splitlen==0 && idx==0) continue; // special case for where split string is ""
-    if (idx==l || splitlen==0 || jsvCompareString(parent, split, (size_t)idx, 0, true)==0) {
-      if (idx==l) {
-        idx=l+splitlen; // if the last element, do to the end of the string
-        if (splitlen==0) break;
-      }
-
-      JsVar *part = jsvNewFromStringVar(parent, (size_t)last, (size_t)(idx-last));
+  if (!split) return array; // out of memory
+
+  int splitlen = (int)jsvGetStringLength(split);
+  if (splitlen==0) {
+    // special case for where split string is "" - one character per element
+    int idx, l = (int)jsvGetStringLength(parent);
+    for (idx=0;idx<l;idx++) {
+      JsVar *part = jsvNewFromStringVar(parent, (size_t)idx, 1);
+      if (!part) break; // out of memory
+      jsvArrayPush(array, part);
+      jsvUnLock(part);
+    }
+  } else {
+    int last = 0;
+    while (true) {
+      int idx = jswrap_string_find(parent, split, last);
+      // if not found, the last element goes to the end of the string
+      JsVar *part = jsvNewStringView(parent, (size_t)last, (idx<0) ? JSVAPPENDSTRINGVAR_MAXLENGTH : (size_t)(idx-last));
       if (!part) break; // out of memory
       jsvArrayPush(array, part);
       jsvUnLock(part);
+      if (idx<0) break;
       last = idx+splitlen;
     }
   }
@@ -46,6 +46,20 @@ static JsVar *jswrap_waveform_getBuffer(JsVar *waveform, int bufferNumber, bool
   return backingString;
 }
 
+/// Stop whatever is outputting/inputting this waveform - returns false on failure
+static bool jswrap_waveform_stopSignal(JsVar *waveform) {
+#ifdef ESP8266
+  if (jsvGetBoolAndUnLock(jsvObjectGetChild(waveform, "i2s", 0))) {
+    jshI2SWaveformStop();
+    return true;
+  }
+#endif
+  JsVar *buffer = jswrap_waveform_getBuffer(waveform,0,0);
+  bool stopped = jstStopBufferTimerTask(buffer);
+  jsvUnLock(buffer);
+  return stopped;
+}
+
 
 /*JSON{
   "type" : "idle",
@@ -63,29 +77,37 @@ bool jswrap_waveform_idle() {
       bool running = jsvGetBoolAndUnLock(jsvObjectGetChild(waveform, "running", 0));
       if (running) {
         JsVar *buffer = jswrap_waveform_getBuffer(waveform,0,0);
-        UtilTimerTask task;
-        // Search for a timer task
-        if (!jstGetLastBufferTimerTask(buffer, &task)) {
-          // if the timer task is now gone...
+        int currentBuffer = 0; // or -1 if finished
+#ifdef ESP8266
+        if (jsvGetBoolAndUnLock(jsvObjectGetChild(waveform, "i2s", 0))) {
+          currentBuffer = jshI2SWaveformGetBuffer();
+        } else
+#endif
+        {
+          UtilTimerTask task;
+          // Search for a timer task
+          if (!jstGetLastBufferTimerTask(buffer, &task)) {
+            currentBuffer = -1; // the timer task is now gone...
+          } else if (task.data.buffer.nextBuffer &&
+                     task.data.buffer.nextBuffer != task.data.buffer.currentBuffer) {
+            // if it is a double-buffered task
+            currentBuffer = (jsvGetRef(buffer)==task.data.buffer.currentBuffer) ? 0 : 1;
+          }
+        }
+        if (currentBuffer < 0) {
           JsVar *arrayBuffer = jsvObjectGetChild(waveform, "buffer", 0);
           jsiQueueObjectCallbacks(waveform, JS_EVENT_PREFIX"finish", &arrayBuffer, 1);
           jsvUnLock(arrayBuffer);
           running = false;
           jsvObjectSetChildAndUnLock(waveform, "running", jsvNewFromBool(running));
         } else {
-          // If the timer task is still there...
-          if (task.data.buffer.nextBuffer &&
-              task.data.buffer.nextBuffer != task.data.buffer.currentBuffer) {
-            // if it is a double-buffered task
-            int currentBuffer = (jsvGetRef(buffer)==task.data.buffer.currentBuffer) ? 0 : 1;
-            int oldBuffer = jsvGetIntegerAndUnLock(jsvObjectGetChild(waveform, "currentBuffer", JSV_INTEGER));
-            if (oldBuffer != currentBuffer) {
-              // buffers have changed - fire off a 'buffer' event with the buffer that needs to be filled
-              jsvObjectSetChildAndUnLock(waveform, "currentBuffer", jsvNewFromInteger(currentBuffer));
-              JsVar *arrayBuffer = jsvObjectGetChild(waveform, (currentBuffer==0) ? "buffer2" : "buffer", 0);
-              jsiQueueObjectCallbacks(waveform, JS_EVENT_PREFIX"buffer", &arrayBuffer, 1);
-              jsvUnLock(arrayBuffer);
-            }
+          int oldBuffer = jsvGetIntegerAndUnLock(jsvObjectGetChild(waveform, "currentBuffer", JSV_INTEGER));
+          if (oldBuffer != currentBuffer) {
+            // buffers have changed - fire off a 'buffer' event with the buffer that needs to be filled
+            jsvObjectSetChildAndUnLock(waveform, "currentBuffer", jsvNewFromInteger(currentBuffer));
+            JsVar *arrayBuffer = jsvObjectGetChild(waveform, (currentBuffer==0) ? "buffer2" : "buffer", 0);
+            jsiQueueObjectCallbacks(waveform, JS_EVENT_PREFIX"buffer", &arrayBuffer, 1);
+            jsvUnLock(arrayBuffer);
           }
         }
         jsvUnLock(buffer);
@@ -116,12 +138,8 @@ void jswrap_waveform_kill() { // be sure to remove all waveforms...
     while (jsvObjectIteratorHasValue(&it)) {
       JsVar *waveform = jsvObjectIteratorGetValue(&it);
       bool running = jsvGetBoolAndUnLock(jsvObjectGetChild(waveform, "running", 0));
-      if (running) {
-        JsVar *buffer = jswrap_waveform_getBuffer(waveform,0,0);
-        if (!jstStopBufferTimerTask(buffer)) {
-          jsExceptionHere(JSET_ERROR, "Waveform couldn't be stopped");
-        }
-        jsvUnLock(buffer);
+      if (running && !jswrap_waveform_stopSignal(waveform)) {
+        jsExceptionHere(JSET_ERROR, "Waveform couldn't be stopped");
       }
       jsvUnLock(waveform);
       // if not running, remove waveform from this list
@@ -203,11 +221,14 @@ static void jswrap_waveform_start(JsVar *waveform, Pin pin, JsVarFloat freq, JsV
   }
 
   JsSysTime startTime = jshGetSystemTime();
+  bool startNow = true;
   bool repeat = false;
   if (jsvIsObject(options)) {
     JsVarFloat t = jsvGetFloatAndUnLock(jsvObjectGetChild(options, "time", 0));
-    if (isfinite(t) && t>0)
+    if (isfinite(t) && t>0) {
       startTime = jshGetTimeFromMilliseconds(t*1000);
+      startNow = false;
+    }
     repeat = jsvGetBoolAndUnLock(jsvObjectGetChild(options, "repeat", 0));
   } else if (!jsvIsUndefined(options)) {
     jsExceptionHere(JSET_ERROR, "Expecting options to be undefined or an Object, not %t", options);
@@ -217,18 +238,34 @@ static void jswrap_waveform_start(JsVar *waveform, Pin pin, JsVarFloat freq, JsV
   JsVar *buffer = jswrap_waveform_getBuffer(waveform,0, &is16Bit);
   JsVar *buffer2 = jswrap_waveform_getBuffer(waveform,1,0);
 
-  UtilTimerEventType eventType;
+  bool useI2S = false;
+#ifdef ESP8266
+  // Output on the I2S data pin can be done with DMA, which is far faster than the utility timer
+  useI2S = isWriting && startNow && jsvIsFlatString(buffer) &&
+           (!buffer2 || jsvIsFlatString(buffer2)) &&
+           jshI2SWaveformStart(pin, freq,
+               (uint8_t*)jsvGetFlatStringPointer(buffer),
+               buffer2 ? (uint8_t*)jsvGetFlatStringPointer(buffer2) : 0,
+               (uint32_t)jsvGetStringLength(buffer) / (is16Bit ? 2 : 1),
+               is16Bit, repeat);
+  jsvObjectSetChildAndUnLock(waveform, "i2s", jsvNewFromBool(useI2S));
+#else
+  NOT_USED(startNow);
+#endif
 
-  if (is16Bit) {
-    eventType = isWriting ? UET_WRITE_SHORT : UET_READ_SHORT;
-  } else {
-    eventType = isWriting ? UET_WRITE_BYTE : UET_READ_BYTE;
-  }
+  if (!useI2S) {
+    UtilTimerEventType eventType;
 
+    if (is16Bit) {
+      eventType = isWriting ? UET_WRITE_SHORT : UET_READ_SHORT;
+    } else {
+      eventType = isWriting ? UET_WRITE_BYTE : UET_READ_BYTE;
+    }
 
-  // And finally set it up
-  if (!jstStartSignal(startTime, jshGetTimeFromMilliseconds(1000.0 / freq), pin, buffer, repeat?(buffer2?buffer2:buffer):0, eventType))
-    jsWarn("Unable to schedule a timer");
+    // And finally set it up
+    if (!jstStartSignal(startTime, jshGetTimeFromMilliseconds(1000 / freq), pin, buffer, repeat?(buffer2?buffer2:buffer):0, eventType))
+      jsWarn("Unable to schedule a timer");
+  }
   jsvUnLock2(buffer,buffer2);
 
   jsvObjectSetChildAndUnLock(waveform, "running", jsvNewFromBool(true));
@@ -254,6 +291,8 @@ static void jswrap_waveform_start(JsVar *waveform, Pin pin, JsVarFloat freq, JsV
   ]
 }
 Will start outputting the waveform on the given pin - the pin must have previously been initialised with analogWrite. If not repeating, it'll emit a `finish` event when it is done.
+
+On ESP8266, output on `D3` (GPIO3, the I2S data pin - normally Serial1's RX) is done with I2S and DMA rather than a timer interrupt, so audio-rate output is possible. The ESP8266 has no DAC, so samples are output as a pulse-density modulated bitstream (32 bits per sample) that needs an RC low-pass filter to turn back into an analog signal. This only works for frequencies between roughly 1300Hz and 1MHz and when `time` isn't specified.
  */
 void jswrap_waveform_startOutput(JsVar *waveform, Pin pin, JsVarFloat freq, JsVar *options) {
   jswrap_waveform_start(waveform, pin, freq, options, true/*write*/);
@@ -295,11 +334,9 @@ void jswrap_waveform_stop(JsVar *waveform) {
     jsExceptionHere(JSET_ERROR, "Waveform is not running");
     return;
   }
-  JsVar *buffer = jswrap_waveform_getBuffer(waveform,0,0);
-  if (!jstStopBufferTimerTask(buffer)) {
+  if (!jswrap_waveform_stopSignal(waveform)) {
     jsExceptionHere(JSET_ERROR, "Waveform couldn't be stopped");
   }
-  jsvUnLock(buffer);
   // now run idle loop as this will issue the finish event and will clean up
   jswrap_waveform_idle();
 }
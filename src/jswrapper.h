@@ -43,7 +43,8 @@ typedef enum {
   JSWAT_INT32, // 32 bit int
   JSWAT_PIN, // A pin
   JSWAT_JSVARFLOAT, // 64 bit float
-  JSWAT__LAST = JSWAT_JSVARFLOAT,
+  JSWAT_ARGUMENT_LIST, // 'JsVar **argPtr, int argCount' for all subsequent arguments, without making an array
+  JSWAT__LAST = JSWAT_ARGUMENT_LIST,
   JSWAT_MASK = NEXT_POWER_2(JSWAT__LAST)-1,
 
   // should this just be executed right away and the value returned? Used to encode constants in the symbol table
@@ -78,9 +79,22 @@ typedef struct {
   const JswSymPtr *symbols;
   const char *symbolChars;
   unsigned char symbolCount;
+#ifndef SAVE_ON_FLASH
+  // Perfect hash of the symbol names (built by build_jswrapper.py)
+  const unsigned char *hashSeeds; ///< hashSeedCount seeds, one per bucket
+  const unsigned char *hashSlots; ///< hashMask+1 symbol indices, 255 = empty
+  unsigned char hashSeedCount;
+  unsigned short hashMask;
+#endif
 } PACKED_JSW_SYM JswSymList;
 
-/// Do a binary search of the symbol table list
+#ifndef SAVE_ON_FLASH
+/** Call a native function directly if its argument specifier is one of the common ones that
+ * build_jswrapper.py made a call for, putting the return value in result. Returns false otherwise */
+bool jswCallFunctionFast(void *function, JsnArgumentType argumentSpecifier, JsVar *thisParam, JsVar **paramData, int paramCount, JsVar **result);
+#endif
+
+/// Search the symbol table list for the given name (see build_jswrapper.py)
 JsVar *jswBinarySearch(const JswSymList *symbolsPtr, JsVar *parent, const char *name);
 
 /** If 'name' is something that belongs to an internal function, execute it.  */
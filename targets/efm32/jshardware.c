@@ -823,6 +823,16 @@ int jshSPISend(IOEventFlags device, int data) {
   return -1;
 }
 
+bool jshSPISendMany(IOEventFlags device, unsigned char *tx, unsigned char *rx, size_t count) {
+  /* EFM32 TODO */
+  return false;
+}
+
+bool jshSPISendAsync(IOEventFlags device, unsigned char *tx, unsigned char *rx, size_t count) {
+  /* EFM32 TODO */
+  return false;
+}
+
 /** Send 16 bit data through the given SPI device. */
 void jshSPISend16(IOEventFlags device, int data) {
   /* EFM32 TODO */
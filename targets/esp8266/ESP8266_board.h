@@ -20,8 +20,38 @@
 // Define the task ids for the APP event handler
 #define TASK_APP_MAINLOOP ((os_signal_t)1)
 #define TASK_APP_RX_DATA ((os_signal_t)2)
+#define TASK_APP_WAKE ((os_signal_t)3)
 
 // Task priority for main loop
 #define TASK_APP_QUEUE USER_TASK_PRIO_0
 
+// The longest jshSleep will suspend the main loop for, in case a wakeup is missed
+#define MAINLOOP_MAX_SLEEP_MS 100
+
+// The longest the main loop may run back-to-back iterations before yielding
+// to the SDK - WiFi gets starved if we keep the CPU for more than ~10ms
+#define MAINLOOP_MAX_RUN_US 10000
+
+// The WiFi power manager (Wifi.setConfig's powersave:'auto') only lets the radio sleep once
+// Espruino and the network have been idle for this long (ms)
+#define POWER_IDLE_MS 200
+// ... and the next timer is at least this far away for modem sleep (ms)
+#define POWER_MODEM_MIN_MS 20
+// ... or this far away for light sleep, which suspends the CPU too (a few DTIM beacon intervals, ms)
+#define POWER_LIGHT_MIN_MS 500
+
+// Layout of the 512 bytes of "user data" in RTC RAM, which is kept over deep sleep (in 4 byte words)
+#define RTC_TIME_ADDR (256/4)            // the time, saved by jshardware.c
+#define RTC_WAKE_ADDR (RTC_TIME_ADDR+8)  // variables kept by ESP8266.deepSleep
+#define RTC_WIFI_ADDR ((256+512-32)/4)   // the last 32 bytes: the AP we connected to, for Wifi fast reconnect
+
+void esp8266_sleepMainLoop(uint32 interval);
+void esp8266_wakeMainLoop();
+void esp8266_setLoopPolicy(uint32 maxRunUs, uint32 minYieldUs);
+void esp8266_setCPUGovernor(uint32 idleMs);
+void esp8266_setPowerManager(bool on);
+bool esp8266_getPowerManager();
+void esp8266_powerWakeRadio();
+uint32 esp8266_getWatchedPins();
+
 #endif /* TARGETS_ESP8266_ESP8266_BOARD_H_ */
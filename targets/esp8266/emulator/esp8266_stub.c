@@ -43,6 +43,7 @@
 
 #include "esp8266_stub.h"
 #include "esp8266_stub_sockets.h"
+#include "esp8266_stub_perf.h"
 
 /**
  * \brief A holder for the ESP8266 initialization done callback.
@@ -204,6 +205,7 @@ static void checkForRecvData(struct stub_ESP8266Socket *pSocket) {
       pSocket->pEspconn->proto.tcp->reconnect_callback(pSocket->pEspconn, rc);
     }
   } else if (rc > 0) {
+    esp8266_stub_netShape(rc);
     if (pSocket->pEspconn->recv_callback != NULL) {
       pSocket->pEspconn->recv_callback(pSocket->pEspconn, (char *)buf, rc);
     }
@@ -243,6 +245,7 @@ int main(int argc, char *argv[]) {
   setvbuf(stdout, NULL, _IONBF, 0);
   setvbuf(stderr, NULL, _IONBF, 0);
 
+  esp8266_stub_perfInit();
   stubInit();
 
   // Invoke the user supplied entry point.
@@ -441,10 +444,9 @@ uint8 system_get_cpu_freq(void) {
   return 80;
 }
 
-// TODO: Needs implemented - system_get_free_heap_size
 uint32 system_get_free_heap_size(void) {
-  printf("ESPSTUB: %s: %d\n",__FILE__, __LINE__);
-  return 0;
+  //printf("ESPSTUB: system_get_free_heap_size: %s: %d\n",__FILE__, __LINE__);
+  return esp8266_stub_heapGetFree();
 }
 
 uint8 espconn_tcp_get_max_con(void) {
@@ -492,14 +494,29 @@ void uart_div_modify() {
   printf("ESPSTUB: uart_div_modify: %s: %d\n",__FILE__, __LINE__);
 }
 
+// The heap is limited to the size of a real ESP8266's - see esp8266_stub_perf.c
 void vPortFree(void *ptr) {
   //printf("ESPSTUB: vPortFree: %s: %d\n",__FILE__, __LINE__);
-  free(ptr);
+  esp8266_stub_heapFree(ptr);
 }
 
 void* pvPortMalloc(size_t size) {
   //printf("ESPSTUB: %s: %d\n",__FILE__, __LINE__);
-  return malloc(size);
+  return esp8266_stub_heapAlloc(size);
+}
+
+void* pvPortZalloc(size_t size) {
+  //printf("ESPSTUB: %s: %d\n",__FILE__, __LINE__);
+  void *ptr = esp8266_stub_heapAlloc(size);
+  if (ptr != NULL) {
+    memset(ptr, 0, size);
+  }
+  return ptr;
+}
+
+void* pvPortRealloc(void *ptr, size_t size) {
+  //printf("ESPSTUB: %s: %d\n",__FILE__, __LINE__);
+  return esp8266_stub_heapRealloc(ptr, size);
 }
 
 // TODO: Needs implemented - ets_install_putc1
@@ -576,6 +593,8 @@ sint8 espconn_send(struct espconn *pEspconn, uint8 *buf, uint16 length) {
   if (rc == -1) {
     return -99;
   }
+  // Take as long as it would over WiFi
+  esp8266_stub_netShape(length);
   if (pEspconn->sent_callback != NULL) {
     pEspconn->sent_callback(pEspconn);
   }
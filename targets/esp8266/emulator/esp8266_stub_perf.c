@@ -0,0 +1,328 @@
+/*
+ * This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+ *
+ * Copyright (C) 2015 Gordon Williams <gw@pur3.co.uk>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * ----------------------------------------------------------------------------
+ * This file is designed to be parsed during the build process
+ *
+ * Contains ESP8266 board specific functions.
+ * ----------------------------------------------------------------------------
+ */
+
+/**
+ * A rough performance model of a real ESP8266, so the effect of a change can be
+ * seen before it is flashed onto hardware:
+ *
+ * o The heap is limited to what a real chip has free.
+ * o Socket traffic is slowed down to the throughput WiFi actually manages.
+ * o When the code being run is built with -finstrument-functions, the time spent
+ *   in each function is recorded, along with the misses it causes in an emulated
+ *   flash cache. At exit these are turned into an estimate of ESP8266 cycles.
+ *
+ * The estimates are only good for comparing one build with another - the host's
+ * code layout isn't the chip's, so which functions fight over cache lines differs.
+ */
+#ifdef __linux__
+#define _GNU_SOURCE // for dladdr
+#include <dlfcn.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include "esp8266_stub_perf.h"
+
+/// This file's own functions mustn't be profiled, or they'd recurse
+#define NO_PROFILE __attribute__((no_instrument_function))
+
+// Defaults for the environment variables that can be used to change the model
+#define DEFAULT_HEAP_SIZE     (48*1024) //!< ESP8266_HEAP: bytes of heap free on a real chip when user_init is called
+#define DEFAULT_NET_KBPS      1000      //!< ESP8266_NET_KBPS: TCP throughput over WiFi in kbits/sec, or 0 for unlimited
+#define DEFAULT_CYCLES_PER_NS 10        //!< ESP8266_CYCLES_PER_NS: ESP8266 cycles that 1ns of host CPU time equates to
+
+#define ESP8266_CPU_MHZ       80
+#define HEAP_BLOCK_OVERHEAD   8         //!< bytes the SDK's allocator uses for each block
+
+#define CACHE_SIZE            32768     //!< The flash cache is 32KB...
+#define CACHE_LINE            32        //!< ...of 32 byte lines...
+#define CACHE_WAYS            2         //!< ...2 way set associative
+#define CACHE_SETS            (CACHE_SIZE/(CACHE_LINE*CACHE_WAYS))
+#define CACHE_MISS_CYCLES     150       //!< Reading a line over 40MHz QIO SPI is ~75 flash clocks
+
+#define PERF_FUNCTIONS        8192      //!< Most functions we record (must be a power of 2)
+#define PERF_STACK            256       //!< Deepest call stack we record
+
+typedef struct {
+  void *fn;
+  uint32_t calls;
+  uint64_t hostNs;      //!< Time spent in this function, not counting functions it called
+  uint64_t cacheMisses;
+} PerfFunction;
+
+static size_t g_heapSize;
+static size_t g_heapUsed;
+
+static uint32_t g_netKbps;
+static uint64_t g_netFreeAt; //!< Time (in us) when the emulated WiFi link is next free
+
+static bool g_perfEnabled;
+static uint32_t g_cyclesPerNs;
+static uint64_t g_perfOverheadNs; //!< Time that recording a call adds to its caller
+static uint64_t g_perfSelfNs;     //!< Time that recording a call adds to the function itself
+static PerfFunction g_perfFunctions[PERF_FUNCTIONS];
+static struct {
+  PerfFunction *f;
+  uint64_t start;
+  uint64_t childNs;
+} g_perfStack[PERF_STACK];
+static int g_perfDepth;
+
+static uintptr_t g_cacheTags[CACHE_SETS][CACHE_WAYS]; //!< Line number+1 in each way, 0 if empty
+static uint8_t g_cacheNextWay[CACHE_SETS];           //!< The least recently used way
+
+#ifndef _WIN32
+// Set up by the linker for code marked CALLED_FROM_INTERRUPT or HOT_PATH (see jsutils.h)
+extern char __start_esp8266_iram[] __attribute__((weak));
+extern char __stop_esp8266_iram[] __attribute__((weak));
+#endif
+
+
+static PerfFunction *perfFind(void *fn) NO_PROFILE;
+void __cyg_profile_func_enter(void *fn, void *callSite) NO_PROFILE;
+void __cyg_profile_func_exit(void *fn, void *callSite) NO_PROFILE;
+
+static uint64_t NO_PROFILE nowNs() {
+#ifdef _WIN32
+  LARGE_INTEGER freq, count;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&count);
+  return (uint64_t)(count.QuadPart * 1000000000.0 / freq.QuadPart);
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000000 + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static void NO_PROFILE sleepUs(uint64_t us) {
+#ifdef _WIN32
+  Sleep((DWORD)((us+999)/1000));
+#else
+  usleep((useconds_t)us);
+#endif
+}
+
+static uint32_t NO_PROFILE getEnvInt(const char *name, uint32_t defaultValue) {
+  const char *s = getenv(name);
+  return s ? (uint32_t)strtoul(s, NULL, 0) : defaultValue;
+}
+
+static void NO_PROFILE perfSignalHandler(int sig) {
+  exit(0); // esp8266_stub_perfReport is called by atexit
+}
+
+void NO_PROFILE esp8266_stub_perfInit() {
+  g_heapSize = getEnvInt("ESP8266_HEAP", DEFAULT_HEAP_SIZE);
+  g_heapUsed = 0;
+  g_netKbps = getEnvInt("ESP8266_NET_KBPS", DEFAULT_NET_KBPS);
+  g_netFreeAt = 0;
+  g_cyclesPerNs = getEnvInt("ESP8266_CYCLES_PER_NS", DEFAULT_CYCLES_PER_NS);
+  g_perfEnabled = getEnvInt("ESP8266_PERF", 0) != 0;
+  if (g_perfEnabled) {
+    // Work out how long recording a call takes, so it can be taken off the caller's time
+    int i;
+    uint64_t start = nowNs();
+    for (i=0; i<1000; i++) {
+      __cyg_profile_func_enter((void *)esp8266_stub_perfInit, NULL);
+      __cyg_profile_func_exit((void *)esp8266_stub_perfInit, NULL);
+    }
+    g_perfOverheadNs = (nowNs() - start) / 1000;
+    g_perfSelfNs = perfFind((void *)esp8266_stub_perfInit)->hostNs / 1000;
+    memset(g_perfFunctions, 0, sizeof(g_perfFunctions));
+    memset(g_cacheTags, 0, sizeof(g_cacheTags));
+    atexit(esp8266_stub_perfReport);
+    signal(SIGINT, perfSignalHandler);
+  }
+}
+
+// ---------------------------------------------------------------------------- Heap
+
+void * NO_PROFILE esp8266_stub_heapAlloc(size_t size) {
+  if (g_heapUsed + size + HEAP_BLOCK_OVERHEAD > g_heapSize) return NULL;
+  size_t *block = (size_t *)malloc(sizeof(size_t)*2 + size); // two words keeps it 8 byte aligned
+  if (block == NULL) return NULL;
+  block[0] = size;
+  g_heapUsed += size + HEAP_BLOCK_OVERHEAD;
+  return &block[2];
+}
+
+void * NO_PROFILE esp8266_stub_heapRealloc(void *ptr, size_t size) {
+  if (ptr == NULL) return esp8266_stub_heapAlloc(size);
+  size_t *block = ((size_t *)ptr) - 2;
+  size_t oldSize = block[0];
+  if (g_heapUsed - oldSize + size > g_heapSize) return NULL;
+  block = (size_t *)realloc(block, sizeof(size_t)*2 + size);
+  if (block == NULL) return NULL;
+  block[0] = size;
+  g_heapUsed = g_heapUsed - oldSize + size;
+  return &block[2];
+}
+
+void NO_PROFILE esp8266_stub_heapFree(void *ptr) {
+  if (ptr == NULL) return;
+  size_t *block = ((size_t *)ptr) - 2;
+  g_heapUsed -= block[0] + HEAP_BLOCK_OVERHEAD;
+  free(block);
+}
+
+uint32_t NO_PROFILE esp8266_stub_heapGetFree() {
+  return (uint32_t)(g_heapSize - g_heapUsed);
+}
+
+// ---------------------------------------------------------------------------- Network
+
+void NO_PROFILE esp8266_stub_netShape(size_t bytes) {
+  if (g_netKbps == 0) return;
+  uint64_t now = nowNs() / 1000;
+  if (g_netFreeAt < now) g_netFreeAt = now;
+  g_netFreeAt += (uint64_t)bytes * 8000 / g_netKbps;
+  if (g_netFreeAt > now) sleepUs(g_netFreeAt - now);
+}
+
+// ---------------------------------------------------------------------------- CPU
+
+/**
+ * \brief Fetch the code at addr through the emulated flash cache.
+ * \return The number of cache misses (0 or 1).
+ */
+static int NO_PROFILE cacheAccess(void *addr) {
+#ifndef _WIN32
+  if (__start_esp8266_iram && (char *)addr >= __start_esp8266_iram && (char *)addr < __stop_esp8266_iram)
+    return 0; // in IRAM, so not cached
+#endif
+  uintptr_t line = (uintptr_t)addr / CACHE_LINE;
+  unsigned int set = (unsigned int)(line % CACHE_SETS);
+  uintptr_t tag = line + 1;
+  int way;
+  for (way=0; way<CACHE_WAYS; way++) {
+    if (g_cacheTags[set][way] == tag) {
+      g_cacheNextWay[set] = (uint8_t)((way + 1) % CACHE_WAYS);
+      return 0;
+    }
+  }
+  way = g_cacheNextWay[set];
+  g_cacheTags[set][way] = tag;
+  g_cacheNextWay[set] = (uint8_t)((way + 1) % CACHE_WAYS);
+  return 1;
+}
+
+/**
+ * \brief Find the record for a function, adding one if needed.
+ * \return NULL if there's no space for it.
+ */
+static PerfFunction * NO_PROFILE perfFind(void *fn) {
+  uint32_t i = (uint32_t)(((uintptr_t)fn >> 2) * 2654435761u);
+  int n;
+  for (n=0; n<PERF_FUNCTIONS; n++, i++) {
+    PerfFunction *f = &g_perfFunctions[i & (PERF_FUNCTIONS-1)];
+    if (f->fn == fn) return f;
+    if (f->fn == NULL) {
+      f->fn = fn;
+      return f;
+    }
+  }
+  return NULL;
+}
+
+void NO_PROFILE __cyg_profile_func_enter(void *fn, void *callSite) {
+  if (!g_perfEnabled) return;
+  if (g_perfDepth < PERF_STACK) {
+    PerfFunction *f = perfFind(fn);
+    if (f) {
+      f->calls++;
+      f->cacheMisses += (uint64_t)cacheAccess(fn);
+    }
+    g_perfStack[g_perfDepth].f = f;
+    g_perfStack[g_perfDepth].childNs = 0;
+    g_perfStack[g_perfDepth].start = nowNs();
+  }
+  g_perfDepth++;
+}
+
+void NO_PROFILE __cyg_profile_func_exit(void *fn, void *callSite) {
+  if (!g_perfEnabled || g_perfDepth == 0) return;
+  uint64_t now = nowNs();
+  g_perfDepth--;
+  if (g_perfDepth >= PERF_STACK) return;
+  uint64_t totalNs = now - g_perfStack[g_perfDepth].start;
+  PerfFunction *f = g_perfStack[g_perfDepth].f;
+  if (f && totalNs > g_perfStack[g_perfDepth].childNs)
+    f->hostNs += totalNs - g_perfStack[g_perfDepth].childNs;
+  if (g_perfDepth > 0) {
+    // the caller has to be fetched again to carry on after the call
+    PerfFunction *caller = g_perfStack[g_perfDepth-1].f;
+    if (caller) caller->cacheMisses += (uint64_t)cacheAccess(callSite);
+    g_perfStack[g_perfDepth-1].childNs += totalNs + g_perfOverheadNs;
+  }
+}
+
+static uint64_t NO_PROFILE perfGetCycles(PerfFunction *f) {
+  uint64_t overhead = f->calls * g_perfSelfNs;
+  uint64_t ns = f->hostNs > overhead ? f->hostNs - overhead : 0;
+  return ns * g_cyclesPerNs + f->cacheMisses * CACHE_MISS_CYCLES;
+}
+
+/// Sort by cycles, most first, with unused records at the end
+static int NO_PROFILE perfCompare(const void *a, const void *b) {
+  PerfFunction *fa = (PerfFunction *)a, *fb = (PerfFunction *)b;
+  if (!fa->fn || !fb->fn) return (fa->fn == NULL) - (fb->fn == NULL);
+  uint64_t ca = perfGetCycles(fa);
+  uint64_t cb = perfGetCycles(fb);
+  return (ca < cb) - (ca > cb);
+}
+
+void NO_PROFILE esp8266_stub_perfReport() {
+  if (!g_perfEnabled) return;
+  g_perfEnabled = false;
+  qsort(g_perfFunctions, PERF_FUNCTIONS, sizeof(PerfFunction), perfCompare);
+
+  uint64_t totalCycles = 0, totalMisses = 0;
+  int i;
+  for (i=0; i<PERF_FUNCTIONS && g_perfFunctions[i].fn; i++) {
+    totalCycles += perfGetCycles(&g_perfFunctions[i]);
+    totalMisses += g_perfFunctions[i].cacheMisses;
+  }
+  const char *filename = getenv("ESP8266_PERF_REPORT");
+  FILE *out = filename ? fopen(filename, "w") : NULL;
+  if (out == NULL) out = stderr;
+  fprintf(out, "ESP8266 estimate: %llu cycles (%.3f s at %dMHz), %llu flash cache misses\n",
+      (unsigned long long)totalCycles, totalCycles / (ESP8266_CPU_MHZ * 1000000.0), ESP8266_CPU_MHZ,
+      (unsigned long long)totalMisses);
+  fprintf(out, "%14s %6s %10s %10s  function\n", "cycles", "%", "calls", "misses");
+  for (i=0; i<PERF_FUNCTIONS && g_perfFunctions[i].fn && i<50; i++) {
+    PerfFunction *f = &g_perfFunctions[i];
+    uint64_t cycles = perfGetCycles(f);
+    const char *name = NULL;
+#ifdef __linux__
+    Dl_info info;
+    if (dladdr(f->fn, &info)) name = info.dli_sname;
+#endif
+    fprintf(out, "%14llu %6.2f %10u %10llu  ", (unsigned long long)cycles,
+        totalCycles ? cycles * 100.0 / totalCycles : 0.0, f->calls, (unsigned long long)f->cacheMisses);
+    if (name) fprintf(out, "%s\n", name);
+    else fprintf(out, "%p\n", f->fn);
+  }
+  if (out != stderr) fclose(out);
+}
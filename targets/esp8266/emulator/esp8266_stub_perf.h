@@ -0,0 +1,49 @@
+/*
+ * This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+ *
+ * Copyright (C) 2015 Gordon Williams <gw@pur3.co.uk>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * ----------------------------------------------------------------------------
+ * This file is designed to be parsed during the build process
+ *
+ * Contains ESP8266 board specific functions.
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef ESP8266_STUB_PERF_H_
+#define ESP8266_STUB_PERF_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Performance model for the emulator - see README.md. Everything is set up
+ * from environment variables by esp8266_stub_perfInit.
+ */
+void esp8266_stub_perfInit();
+
+/**
+ * \brief Allocate from the emulated heap, which is the size of a real ESP8266's.
+ * \return NULL if there isn't enough free.
+ */
+void *esp8266_stub_heapAlloc(size_t size);
+void *esp8266_stub_heapRealloc(void *ptr, size_t size);
+void esp8266_stub_heapFree(void *ptr);
+uint32_t esp8266_stub_heapGetFree();
+
+/**
+ * \brief Wait for as long as sending or receiving this many bytes over WiFi would take.
+ */
+void esp8266_stub_netShape(size_t bytes);
+
+/**
+ * \brief Write the profile of the emulated CPU (if enabled) out.
+ */
+void esp8266_stub_perfReport();
+
+#endif /* ESP8266_STUB_PERF_H_ */
@@ -26,6 +26,19 @@
 typedef long long int64_t;
 
 #include "jsutils.h"
+#include "jsvar.h"
+#include "esp8266_board_utils.h"
+
+EspHeapStats esp8266_heapStats = { .lowestFreeHeap = 0xFFFFFFFF };
+const char *esp8266_heapSubsystemNames[ESP_HEAP_SUBSYSTEMS] = {
+  "pktbuf", "tx", "espconn", "ota"
+};
+
+// Prepended to each tracked allocation so we know what to subtract when it's freed
+typedef struct {
+  uint32 size;
+  uint32 sys;   // 8 bytes keeps the data aligned as os_malloc's would be
+} EspHeapHeader;
 
 /**
  * Convert an ESP8266 error code to a string.
@@ -94,3 +107,145 @@ void esp8266_board_writeString(
 void esp8266_log(char *message) {
   os_printf("%s", message);
 }
+
+/**
+ * Update the lowest free heap we have seen.
+ * Called on each tracked allocation and from the main loop, so SDK allocations
+ * that we can't wrap still show up in the low-water mark.
+ */
+void esp8266_heapCheckFree() {
+  uint32 free = system_get_free_heap_size();
+  if (free < esp8266_heapStats.lowestFreeHeap)
+    esp8266_heapStats.lowestFreeHeap = free;
+}
+
+/**
+ * Allocate zeroed memory from the C heap (outside the JsVar pool), counting
+ * it against the given subsystem.
+ * \return The memory, or NULL if there wasn't enough.
+ */
+void *esp8266_heapAlloc(
+    EspHeapSubsystem sys, //!< What the memory is used for
+    size_t size           //!< How many bytes are needed
+  ) {
+  EspHeapHeader *h = (EspHeapHeader *)os_zalloc(sizeof(EspHeapHeader) + size);
+  if (h == NULL) {
+    esp8266_heapStats.failures++;
+    return NULL;
+  }
+  h->size = size;
+  h->sys = sys;
+  esp8266_heapStats.bytes[sys] += size;
+  if (esp8266_heapStats.bytes[sys] > esp8266_heapStats.peak[sys])
+    esp8266_heapStats.peak[sys] = esp8266_heapStats.bytes[sys];
+  esp8266_heapCheckFree();
+  return h + 1;
+}
+
+/**
+ * Free memory allocated with esp8266_heapAlloc.
+ */
+void esp8266_heapFree(
+    void *ptr //!< The memory to free, may be NULL
+  ) {
+  if (ptr == NULL) return;
+  EspHeapHeader *h = ((EspHeapHeader *)ptr) - 1;
+  esp8266_heapStats.bytes[h->sys] -= h->size;
+  os_free(h);
+}
+
+#ifdef ESP8266_NATIVE_CODE
+#define NATIVE_CODE_WORDS 256 // 1kB
+/* Each block is a header word followed by the code. The header has the size
+ * of the block in words in the top 16 bits, and the length of the code in
+ * bytes in the bottom 16 (0 if the block is free) */
+#define NATIVE_BLOCK(words, len) (((uint32)(words)<<16) | (uint32)(len))
+#define NATIVE_BLOCK_WORDS(header) ((header)>>16)
+#define NATIVE_BLOCK_LEN(header) ((header)&0xFFFF)
+// Put in IRAM by the .iram.native section of the linker scripts
+static uint32 nativeCode[NATIVE_CODE_WORDS] __attribute__((section(".iram.native")));
+// The word after the last block
+static uint32 *nativeCodeEnd = nativeCode;
+
+/// Does a native function (eg. from E.nativeCall) still point into this code?
+static bool nativeCodeInUse(const uint32 *code, size_t len) {
+  JsVarRef i;
+  for (i=1;i<=jsvGetMemoryTotal();i++) {
+    JsVar *v = _jsvGetAddressOf(i);
+    if (jsvIsNativeFunction(v)) {
+      const char *ptr = (const char *)v->varData.native.ptr;
+      if (ptr >= (const char *)code && ptr < (const char *)code + len) return true;
+    } else if (jsvIsFlatString(v)) {
+      i = (JsVarRef)(i+jsvGetFlatStringBlocks(v));
+    }
+  }
+  return false;
+}
+
+/**
+ * Copy machine code into IRAM so it can be executed. Code can't be run from the
+ * JsVar pool as that is in DRAM, which the CPU can't fetch instructions from.
+ *
+ * If exactly the same code has been copied in before (eg. the function was
+ * uploaded again) the existing copy is returned. Otherwise, blocks that no
+ * native function points into any more (eg. the function was replaced) are
+ * freed first. IRAM only supports 32 bit accesses, so everything is done a
+ * word at a time.
+ * \return The address of the code, or NULL if there wasn't enough space.
+ */
+void *esp8266_nativeCodeAlloc(
+    const void *code, //!< The code to copy
+    size_t len        //!< The length of the code in bytes
+  ) {
+  if (len == 0 || len > NATIVE_CODE_WORDS*4) return NULL;
+  size_t words = (len+3) >> 2;
+  uint32 lastWord = 0;
+  os_memcpy(&lastWord, (const char *)code + ((words-1)<<2), len - ((words-1)<<2));
+  uint32 *block;
+  for (block = nativeCode; block < nativeCodeEnd; block += 1 + NATIVE_BLOCK_WORDS(*block)) {
+    if (NATIVE_BLOCK_LEN(*block) == len) {
+      size_t i;
+      for (i=0;i<words;i++) {
+        uint32 w = lastWord;
+        if (i+1 < words) os_memcpy(&w, (const char *)code + (i<<2), 4);
+        if (block[1+i] != w) break;
+      }
+      if (i==words) return &block[1];
+    }
+  }
+  // Free unused blocks, merging neighbouring free blocks together
+  uint32 *lastFree = NULL;
+  for (block = nativeCode; block < nativeCodeEnd; block += 1 + NATIVE_BLOCK_WORDS(*block)) {
+    if (NATIVE_BLOCK_LEN(*block) && !nativeCodeInUse(&block[1], NATIVE_BLOCK_LEN(*block)))
+      *block = NATIVE_BLOCK(NATIVE_BLOCK_WORDS(*block), 0);
+    if (NATIVE_BLOCK_LEN(*block)) {
+      lastFree = NULL;
+    } else if (lastFree) {
+      *lastFree = NATIVE_BLOCK(NATIVE_BLOCK_WORDS(*lastFree) + 1 + NATIVE_BLOCK_WORDS(*block), 0);
+      block = lastFree;
+    } else {
+      lastFree = block;
+    }
+  }
+  if (lastFree) nativeCodeEnd = lastFree; // free space at the end is just unused
+  // Use the first free block that's big enough, or add one on the end
+  for (block = nativeCode; block < nativeCodeEnd; block += 1 + NATIVE_BLOCK_WORDS(*block))
+    if (!NATIVE_BLOCK_LEN(*block) && NATIVE_BLOCK_WORDS(*block) >= words) break;
+  if (block == nativeCodeEnd) {
+    if (nativeCodeEnd + 1 + words > nativeCode + NATIVE_CODE_WORDS)
+      return NULL;
+    nativeCodeEnd = block + 1 + words;
+  } else if (NATIVE_BLOCK_WORDS(*block) > words) {
+    // split off what we don't need as a new free block
+    block[1+words] = NATIVE_BLOCK(NATIVE_BLOCK_WORDS(*block) - words - 1, 0);
+  }
+  *block = NATIVE_BLOCK(words, len);
+  for (size_t i=0;i+1<words;i++) {
+    uint32 w;
+    os_memcpy(&w, (const char *)code + (i<<2), 4);
+    block[1+i] = w;
+  }
+  block[words] = lastWord;
+  return &block[1];
+}
+#endif
@@ -21,4 +21,34 @@
 const char *esp8266_errorToString(sint8 err);
 void        esp8266_board_writeString(uint8 *buffer, size_t length);
 
+// Subsystems whose C heap (os_malloc) use is tracked - see esp8266_heapAlloc
+typedef enum {
+  ESP_HEAP_PKTBUF,  // received socket data (PktBuf_New)
+  ESP_HEAP_TX,      // socket data waiting to be sent (currentTx)
+  ESP_HEAP_ESPCONN, // espconn structures for outbound/listening sockets
+  ESP_HEAP_OTA,     // over-the-air update buffers
+  ESP_HEAP_SUBSYSTEMS
+} EspHeapSubsystem;
+
+typedef struct {
+  uint32 bytes[ESP_HEAP_SUBSYSTEMS]; // bytes currently allocated
+  uint32 peak[ESP_HEAP_SUBSYSTEMS];  // most bytes that have been allocated at once
+  uint32 failures;                   // allocations that failed
+  uint32 lowestFreeHeap;             // lowest system_get_free_heap_size seen
+} EspHeapStats;
+
+extern EspHeapStats esp8266_heapStats;
+extern const char *esp8266_heapSubsystemNames[ESP_HEAP_SUBSYSTEMS];
+// Allocate zeroed memory from the C heap, counting it against 'sys'
+void       *esp8266_heapAlloc(EspHeapSubsystem sys, size_t size);
+// Free memory allocated with esp8266_heapAlloc (NULL is ignored)
+void        esp8266_heapFree(void *ptr);
+// Update the free heap low-water mark
+void        esp8266_heapCheckFree();
+
+#ifdef ESP8266_NATIVE_CODE
+// Copy machine code into the IRAM reserved for E.nativeCall, returning where it now is (or NULL if full)
+void       *esp8266_nativeCodeAlloc(const void *code, size_t len);
+#endif
+
 #endif /* TARGETS_ESP8266_ESP8266_BOARD_UTILS_H_ */
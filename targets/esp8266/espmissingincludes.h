@@ -59,6 +59,8 @@ void ets_timer_setfn(ETSTimer *t, ETSTimerFunc *fn, void *parg);
 
 void ets_update_cpu_frequency(int freqmhz);
 
+void system_adc_read_fast(uint16 *adc_addr, uint16 adc_num, uint8 adc_clk_div);
+
 int os_snprintf(char *str, size_t size, const char *format, ...) __attribute__((format(printf, 3, 4)));
 int os_printf_plus(const char *format, ...)  __attribute__((format(printf, 1, 2)));
 
@@ -34,6 +34,7 @@
 #include "ets_sys.h"
 #include "osapi.h"
 #include "gpio.h"
+#include "user_interface.h"
 #include "espmissingincludes.h"
 
 #include "i2c_master.h"
@@ -44,10 +45,33 @@
   gpio_output_set(set, set^both, both, 0);\
 } while(0)
 
-// For ~100khz at 80Mhz or 160Mhz:
-//#define i2c_master_wait    os_delay_us
-// For ~250khz at 160Mhz:
-#define i2c_master_wait(x)    os_delay_us(x/4) // do{}while(0)
+// The delays below add up to about I2C_MASTER_UNITS_PER_BIT for each clock
+// cycle on the bus. One unit is i2cUnitCycles CPU cycles, which we busy-wait
+// for on the cycle counter - os_delay_us is far too coarse for 400kHz
+#define I2C_MASTER_UNITS_PER_BIT 8
+#define I2C_MASTER_DEFAULT_BITRATE 100000
+
+LOCAL uint32 i2cBitrate = I2C_MASTER_DEFAULT_BITRATE;
+LOCAL uint32 i2cUnitCycles;
+
+static inline uint32 i2c_master_ccount(void) {
+  uint32 r;
+  __asm__ __volatile__("rsr %0,ccount":"=a"(r));
+  return r;
+}
+
+LOCAL void ICACHE_FLASH_ATTR
+i2c_master_setTiming(void)
+{
+    i2cUnitCycles = (system_get_cpu_freq()*1000000) / (i2cBitrate*I2C_MASTER_UNITS_PER_BIT);
+    if (!i2cUnitCycles) i2cUnitCycles = 1;
+}
+
+#define i2c_master_wait(x) do {\
+  uint32 start = i2c_master_ccount();\
+  uint32 cycles = (x)*i2cUnitCycles;\
+  while (i2c_master_ccount()-start < cycles);\
+} while(0)
 
 #define i2c_master_getDC(void) ((GPIO_REG_READ(GPIO_IN_ADDRESS) >> pinSDA) & 1)
 
@@ -101,7 +125,7 @@ i2c_master_getDC(void)
  * Parameters   : NONE
  * Returns      : NONE
 *******************************************************************************/
-void ICACHE_FLASH_ATTR
+void CALLED_FROM_INTERRUPT
 i2c_master_init(void)
 {
     uint8 i;
@@ -140,6 +164,8 @@ i2c_master_gpio_init(uint8 scl, uint8 sda, uint32 bitrate)
 {
     pinSCL = scl;
     pinSDA = sda;
+    i2cBitrate = bitrate ? bitrate : I2C_MASTER_DEFAULT_BITRATE;
+    i2c_master_setTiming();
 
 #if 0
     ETS_GPIO_INTR_DISABLE();
@@ -177,9 +203,11 @@ i2c_master_gpio_init(uint8 scl, uint8 sda, uint32 bitrate)
  * Parameters   : NONE
  * Returns      : NONE
 *******************************************************************************/
-void ICACHE_FLASH_ATTR
+void CALLED_FROM_INTERRUPT
 i2c_master_start(void)
 {
+    // the CPU frequency may have changed since setup
+    i2c_master_setTiming();
     i2c_master_setDC(1, m_nLastSCL);
     i2c_master_wait(5);
     i2c_master_setDC(1, 1);
@@ -194,7 +222,7 @@ i2c_master_start(void)
  * Parameters   : NONE
  * Returns      : NONE
 *******************************************************************************/
-void ICACHE_FLASH_ATTR
+void CALLED_FROM_INTERRUPT
 i2c_master_stop(void)
 {
     i2c_master_wait(5);
@@ -213,7 +241,7 @@ i2c_master_stop(void)
  * Parameters   : uint8 level - 0 or 1
  * Returns      : NONE
 *******************************************************************************/
-void ICACHE_FLASH_ATTR
+void CALLED_FROM_INTERRUPT
 i2c_master_setAck(uint8 level)
 {
     i2c_master_setDC(level, 0);
@@ -232,7 +260,7 @@ i2c_master_setAck(uint8 level)
  * Parameters   : NONE
  * Returns      : uint8 - ack value, 0 or 1
 *******************************************************************************/
-uint8 ICACHE_FLASH_ATTR
+uint8 CALLED_FROM_INTERRUPT
 i2c_master_getAck(void)
 {
     uint8 retVal;
@@ -253,7 +281,7 @@ i2c_master_getAck(void)
 * Parameters   : NONE
 * Returns      : true : get ack ; false : get nack
 *******************************************************************************/
-bool ICACHE_FLASH_ATTR
+bool CALLED_FROM_INTERRUPT
 i2c_master_checkAck(void)
 {
     if(i2c_master_getAck()){
@@ -269,7 +297,7 @@ i2c_master_checkAck(void)
 * Parameters   : NONE
 * Returns      : NONE
 *******************************************************************************/
-void ICACHE_FLASH_ATTR
+void CALLED_FROM_INTERRUPT
 i2c_master_send_ack(void)
 {
     i2c_master_setAck(0x0);
@@ -280,7 +308,7 @@ i2c_master_send_ack(void)
 * Parameters   : NONE
 * Returns      : NONE
 *******************************************************************************/
-void ICACHE_FLASH_ATTR
+void CALLED_FROM_INTERRUPT
 i2c_master_send_nack(void)
 {
     i2c_master_setAck(0x1);
@@ -292,7 +320,7 @@ i2c_master_send_nack(void)
  * Parameters   : NONE
  * Returns      : uint8 - readed value
 *******************************************************************************/
-uint8 ICACHE_FLASH_ATTR
+uint8 CALLED_FROM_INTERRUPT
 i2c_master_readByte(void)
 {
     uint8 retVal = 0;
@@ -322,7 +350,7 @@ i2c_master_readByte(void)
  * Parameters   : uint8 wrdata - write value
  * Returns      : NONE
 *******************************************************************************/
-void ICACHE_FLASH_ATTR
+void CALLED_FROM_INTERRUPT
 i2c_master_writeByte(uint8 wrdata)
 {
     uint8 dat;
@@ -0,0 +1,119 @@
+/*
+ * This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * ----------------------------------------------------------------------------
+ * I2S and SLC (DMA) registers of the ESP8266 - the SDK only ships these with
+ * its examples, so the ones we need are copied here (names as in the SDK's
+ * i2s_reg.h and slc_register.h)
+ * ----------------------------------------------------------------------------
+ */
+#ifndef I2S_REGISTER_H_INCLUDED
+#define I2S_REGISTER_H_INCLUDED
+
+#define i2c_bbpll                          0x67
+#define i2c_bbpll_hostid                   4
+#define i2c_bbpll_en_audio_clock_out       4
+#define i2c_bbpll_en_audio_clock_out_msb   7
+#define i2c_bbpll_en_audio_clock_out_lsb   7
+
+extern void rom_i2c_writeReg_Mask(int block, int host_id, int reg_add, int Msb, int Lsb, int indata);
+#define I2S_CLK_ENABLE() \
+  rom_i2c_writeReg_Mask(i2c_bbpll, i2c_bbpll_hostid, i2c_bbpll_en_audio_clock_out, \
+                        i2c_bbpll_en_audio_clock_out_msb, i2c_bbpll_en_audio_clock_out_lsb, 1)
+
+#define I2S_BASE_FREQ       160000000
+
+//===== I2S =====
+
+#define REG_I2S_BASE        0x60000e00
+
+#define I2SCONF             (REG_I2S_BASE + 0x0008)
+#define I2S_BCK_DIV_NUM         0x0000003F
+#define I2S_BCK_DIV_NUM_S       22
+#define I2S_CLKM_DIV_NUM        0x0000003F
+#define I2S_CLKM_DIV_NUM_S      16
+#define I2S_BITS_MOD            0x0000000F
+#define I2S_BITS_MOD_S          12
+#define I2S_RECE_MSB_SHIFT      BIT11
+#define I2S_TRANS_MSB_SHIFT     BIT10
+#define I2S_I2S_RX_START        BIT5
+#define I2S_I2S_TX_START        BIT4
+#define I2S_MSB_RIGHT           BIT3
+#define I2S_RIGHT_FIRST         BIT2
+#define I2S_RECE_SLAVE_MOD      BIT1
+#define I2S_TRANS_SLAVE_MOD     BIT0
+#define I2S_I2S_RESET_MASK      0x0000000F
+
+#define I2SINT_CLR          (REG_I2S_BASE + 0x0018)
+#define I2SINT_ENA          (REG_I2S_BASE + 0x0014)
+
+#define I2S_FIFO_CONF       (REG_I2S_BASE + 0x0020)
+#define I2S_I2S_DSCR_EN         BIT12
+#define I2S_I2S_TX_FIFO_MOD     0x00000007
+#define I2S_I2S_TX_FIFO_MOD_S   10
+#define I2S_I2S_RX_FIFO_MOD     0x00000007
+#define I2S_I2S_RX_FIFO_MOD_S   13
+
+#define I2SCONF_CHAN        (REG_I2S_BASE + 0x002c)
+#define I2S_TX_CHAN_MOD         0x00000007
+#define I2S_TX_CHAN_MOD_S       0
+#define I2S_RX_CHAN_MOD         0x00000003
+#define I2S_RX_CHAN_MOD_S       3
+
+//===== SLC =====
+
+#define REG_SLC_BASE        0x60000B00
+
+#define SLC_CONF0           (REG_SLC_BASE + 0x0)
+#define SLC_MODE                0x00000003
+#define SLC_MODE_S              12
+#define SLC_DATA_BURST_EN       BIT9
+#define SLC_DSCR_BURST_EN       BIT8
+#define SLC_RXLINK_RST          BIT1
+#define SLC_TXLINK_RST          BIT0
+
+#define SLC_INT_STATUS      (REG_SLC_BASE + 0x8)
+#define SLC_INT_ENA         (REG_SLC_BASE + 0xC)
+#define SLC_INT_CLR         (REG_SLC_BASE + 0x10)
+#define SLC_RX_EOF_INT_ST       BIT17
+#define SLC_RX_EOF_INT_ENA      BIT17
+
+#define SLC_RX_LINK         (REG_SLC_BASE + 0x24)
+#define SLC_TX_LINK         (REG_SLC_BASE + 0x28)
+#define SLC_RXLINK_START        BIT29
+#define SLC_RXLINK_STOP         BIT28
+#define SLC_RXLINK_DESCADDR_MASK 0x000FFFFF
+#define SLC_TXLINK_START        BIT29
+#define SLC_TXLINK_STOP         BIT28
+#define SLC_TXLINK_DESCADDR_MASK 0x000FFFFF
+
+#define SLC_RX_EOF_DES_ADDR (REG_SLC_BASE + 0x48)
+
+#define SLC_RX_DSCR_CONF    (REG_SLC_BASE + 0x90)
+#define SLC_INFOR_NO_REPLACE    BIT9
+#define SLC_TOKEN_NO_REPLACE    BIT8
+
+#ifndef ETS_SLC_INUM
+#define ETS_SLC_INUM 1
+#endif
+#define ETS_SLC_INTR_ATTACH(func, arg) ets_isr_attach(ETS_SLC_INUM, (func), (void *)(arg))
+#define ETS_SLC_INTR_ENABLE()  ETS_INTR_ENABLE(ETS_SLC_INUM)
+#define ETS_SLC_INTR_DISABLE() ETS_INTR_DISABLE(ETS_SLC_INUM)
+
+/// SLC DMA descriptor - the hardware walks a linked list of these
+struct slc_queue_item {
+  uint32_t blocksize : 12;
+  uint32_t datalen   : 12;
+  uint32_t unused    :  5;
+  uint32_t sub_sof   :  1;
+  uint32_t eof       :  1;
+  uint32_t owner     :  1;
+  uint32_t buf_ptr;
+  uint32_t next_link_ptr;
+};
+
+#endif // I2S_REGISTER_H_INCLUDED
@@ -38,6 +38,8 @@ typedef long long int64_t;
 #include "jspininfo.h"
 #include "jswrap_esp8266.h"
 #include <jswrap_esp8266_network.h>
+#include "ESP8266_board.h"
+#include "i2s_register.h"
 
 // The maximum time that we can safely delay/block without risking a watch dog
 // timer error or other undesirable WiFi interaction.  The time is measured in
@@ -53,27 +55,55 @@ typedef long long int64_t;
 #define FLASH_PAGE_SHIFT 12 // 4KB
 #define FLASH_PAGE (1<<FLASH_PAGE_SHIFT)
 
-// Address in RTC RAM where we save the time
-#define RTC_TIME_ADDR (256/4) // start of "user data" in RTC RAM
-
 
 static bool g_spiInitialized = false;
 static int  g_lastSPIRead = -1;
 
-// Hardware PWM is broken
-#ifdef HARDWARE_PWM
-struct PWMRecord {
-  bool enabled; //!< Has this PWM been enabled previously?
-};
-static uint32 g_pwmFreq;
-static struct PWMRecord g_PWMRecords[JSH_PIN_COUNT];
-#else
 // Whether a pin is being used for soft PWM or not
 BITFIELD_DECL(jshPinSoftPWM, JSH_PIN_COUNT);
-#endif
+
+// Hardware PWM using the SDK's pwm driver. pwm_init can only be called once, so the
+// pins are chosen up-front with jshPWMHardwareSetup - analogWrite then uses it for them.
+// All channels share one period.
+#define PWM_CHANNEL_MAX  JSH_PWM_HARDWARE_MAX
+#define PWM_PERIOD_MIN   1000  // us - the SDK driver only does 100Hz..1kHz
+#define PWM_PERIOD_MAX   10000
+static uint8 g_pwmChannels;                   //!< number of channels set up, or 0
+static Pin g_pwmPins[PWM_CHANNEL_MAX];
+static uint16 g_pwmValues[PWM_CHANNEL_MAX];   //!< duty cycles, 0..65535
+static uint32 g_pwmPeriod;                    //!< period in us
 
 static uint8 g_pinState[JSH_PIN_COUNT];
 
+/// The hardware PWM channel for a pin, or -1
+static int pwmGetChannel(Pin pin) {
+  int i;
+  for (i=0; i<g_pwmChannels; i++)
+    if (g_pwmPins[i] == pin) return i;
+  return -1;
+}
+
+/// Give all the hardware PWM channels their new duty cycles, from the next period
+static void pwmApply() {
+  if (!g_pwmChannels) return;
+  // duty is in units of 45ns
+  uint32 dutyMax = g_pwmPeriod * 1000 / 45;
+  int i;
+  for (i=0; i<g_pwmChannels; i++)
+    pwm_set_duty((uint32)(((uint64)g_pwmValues[i] * dutyMax) / 65535), (uint8)i);
+  pwm_start();
+}
+
+/// Change the period shared by all hardware PWM channels, if 'freq' is in range
+static void pwmSetPeriod(JsVarFloat freq) {
+  uint32 period = (uint32)(1000000 / freq);
+  if (period<PWM_PERIOD_MIN) period = PWM_PERIOD_MIN;
+  if (period>PWM_PERIOD_MAX) period = PWM_PERIOD_MAX;
+  if (period == g_pwmPeriod) return;
+  g_pwmPeriod = period;
+  pwm_set_period(period);
+}
+
 
 
 
@@ -121,16 +151,10 @@ void jshInit() {
 
   ETS_GPIO_INTR_ENABLE();
 
-#ifndef HARDWARE_PWM
   BITFIELD_CLEAR(jshPinSoftPWM);
-#endif
 
   // Initialize something for each of the possible pins.
   for (int i=0; i<JSH_PIN_COUNT; i++) {
-#ifdef HARDWARE_PWM
-    // For each of the PWM records, flag the PWM as having been not initialized.
-    g_PWMRecords[i].enabled = false;
-#endif
     g_pinState[i] = 0;
   }
 
@@ -164,6 +188,7 @@ static void CALLED_FROM_INTERRUPT intrHandlerCB(
       gpio_pin_intr_state_set(GPIO_ID_PIN(pin), GPIO_PIN_INTR_ANYEDGE);
     }
   }
+  esp8266_wakeMainLoop();
   //os_printf_plus("<< intrHandlerCB\n");
 }
 
@@ -171,6 +196,7 @@ static void CALLED_FROM_INTERRUPT intrHandlerCB(
  * Reset the Espruino environment.
  */
 void jshReset() {
+  while (spi_transfer_async_busy()) ; // it may be writing into variables we're about to free
   jshResetDevices();
   os_printf("> jshReset\n");
 
@@ -218,15 +244,21 @@ int jshGetSerialNumber(unsigned char *data, int maxChars) {
 
 //===== Interrupts and sleeping
 
-void jshInterruptOff() { ets_intr_lock(); }
-void jshInterruptOn()  { ets_intr_unlock(); }
+void CALLED_FROM_INTERRUPT jshInterruptOff() { ets_intr_lock(); }
+void CALLED_FROM_INTERRUPT jshInterruptOn()  { ets_intr_unlock(); }
 
 /// Enter simple sleep mode (can be woken up by interrupts). Returns true on success
 bool jshSleep(JsSysTime timeUntilWake) {
-  int time = (int) timeUntilWake;
   //os_printf("jshSleep %lld\n", timeUntilWake);
-  // **** TODO: fix this, this is garbage, we need to tell the idle loop to suspend
-  //jshDelayMicroseconds(time);
+  // We can't block here, so instead tell the main loop not to run again until
+  // it's needed. The SDK then idles the CPU (and with wifi powersave set to
+  // 'light', lets it light-sleep). Pin/UART/network activity wakes it early.
+  JsVarFloat ms = jshGetMillisecondsFromTime(timeUntilWake);
+  if (ms >= 1) {
+    // esp8266_sleepMainLoop caps this, but the power manager wants the full time
+    if (ms > 0xFFFFFFFF) ms = 0xFFFFFFFF;
+    esp8266_sleepMainLoop((uint32)ms);
+  }
   return true;
 } // End of jshSleep
 
@@ -235,7 +267,7 @@ bool jshSleep(JsSysTime timeUntilWake) {
  * Note that for the ESP8266 we must NOT CPU block for more than
  * 10 milliseconds or else we may starve the WiFi subsystem.
  */
-void jshDelayMicroseconds(int microsec) {
+void CALLED_FROM_INTERRUPT jshDelayMicroseconds(int microsec) {
   // Keep things simple and make the user responsible if they sleep for too long...
   if (microsec > 0) {
     //os_printf("Delay %d us\n", microsec);
@@ -357,6 +389,12 @@ void jshPinSetState(
     BITFIELD_SET(jshPinSoftPWM, pin, 0);
     jstPinPWM(0,0,pin);
   }
+  // hardware PWM can't be stopped, but we can keep the pin low
+  int pwmChannel = pwmGetChannel(pin);
+  if (pwmChannel>=0 && g_pwmValues[pwmChannel]) {
+    g_pwmValues[pwmChannel] = 0;
+    pwmApply();
+  }
 
   //os_printf("> ESP8266: jshPinSetState %d, %s, pup=%d, od=%d\n",
   //    pin, pinStateToString(state), JSHPINSTATE_IS_PULLUP(state), JSHPINSTATE_IS_OPENDRAIN(state));
@@ -431,7 +469,7 @@ JshPinState jshPinGetState(Pin pin) {
 /**
  * Set the value of the corresponding pin.
  */
-void jshPinSetValue(
+void CALLED_FROM_INTERRUPT jshPinSetValue( // can be called at interrupt time
     Pin pin,   //!< The pin to have its value changed.
     bool value //!< The new value of the pin.
   ) {
@@ -442,6 +480,15 @@ void jshPinSetValue(
 }
 
 
+/**
+ * Set and clear several GPIO pins (D0..D15) at once, for E.createPort. Bit N of each
+ * mask is pin N. This DOES NOT change pin state OR CHECK PIN VALIDITY.
+ */
+void CALLED_FROM_INTERRUPT jshPinsSetValues(uint32_t setMask, uint32_t clearMask) {
+  GPIO_REG_WRITE(GPIO_OUT_W1TS_ADDRESS, setMask);
+  GPIO_REG_WRITE(GPIO_OUT_W1TC_ADDRESS, clearMask);
+}
+
 /**
  * Get the value of the corresponding pin.
  * \return The current value of the pin.
@@ -459,7 +506,7 @@ JsVarFloat jshPinAnalog(Pin pin) {
   return (JsVarFloat)system_adc_read() / 1023.0;
 }
 
-int jshPinAnalogFast(Pin pin) {
+int CALLED_FROM_INTERRUPT jshPinAnalogFast(Pin pin) { // called from the utility timer for Waveform.startInput
   //os_printf("> ESP8266: jshPinAnalogFast: pin=%d\n", pin);
   return (int)system_adc_read() << 6; // left-align to 16 bits
 }
@@ -473,42 +520,14 @@ JshPinFunction jshPinAnalogOutput(Pin pin, JsVarFloat value, JsVarFloat freq, Js
   if (value>1) value=1;
   if (!isfinite(freq)) freq=0;
 
-#ifdef HARDWARE_PWM
-  os_printf("> jshPinAnalogOutput - jshPinAnalogOutput: pin=%d, value(x100)=%d, freq=%d\n", pin, (int)(value*100), (int)freq);
-  // Check that the value is between 0.0 and 1.0
-  if (value < 0 || value > 1.0) {
+  int pwmChannel = pwmGetChannel(pin);
+  if (pwmChannel>=0) {
+    if (freq>0) pwmSetPeriod(freq);
+    g_pwmValues[pwmChannel] = (uint16)(value*65535);
+    pwmApply();
     return 0;
   }
 
-  // If PWM for the pin has not previously been enabled, enable it now.
-  if (g_PWMRecords[pin].enabled == false) {
-    g_PWMRecords[pin].enabled = true;
-    g_pwmFreq = (uint32)freq;
-    // Set the default frequency to 1KHz if no supplied frequency.
-    if (g_pwmFreq == 0) {
-      g_pwmFreq = 1000;
-    }
-
-    // Initialize the PWM subsystem
-    uint32 duty = 0;
-    uint32 pinInfoList[3] = {g_PERIPHS[pin], g_pinGPIOFunc[pin], pin};
-    pwm_init(g_pwmFreq * 1000000, &duty, 1, &pinInfoList);
-
-    // Start the PWM subsystem
-    pwm_start();
-  }
-
-  // If the period/frequency has changed, update the period.
-  if ((uint32)freq != 0 && (uint32)freq != g_pwmFreq) {
-    g_pwmFreq = (uint32)freq;
-    pwm_set_period(g_pwmFreq * 1000000);
-  }
-
-  uint32 duty = value * 1000000 / 0.045 / g_pwmFreq;
-  os_printf(" - Duty: %d (units of 45 nsecs)\n", duty);
-  pwm_set_duty(duty, 0);
-
-#else
   // Software PWM
 
   if (jshIsPinValid(pin)/* && (flags&(JSAOF_ALLOW_SOFTWARE|JSAOF_FORCE_SOFTWARE))*/) {
@@ -528,7 +547,66 @@ JshPinFunction jshPinAnalogOutput(Pin pin, JsVarFloat value, JsVarFloat freq, Js
   //if (jshIsPinValid(pin))
 //    jsiConsolePrint("You need to use analogWrite(pin, val, {soft:true}) for Software PWM on this pin\n");
   return 0;
-#endif
+}
+
+/**
+ * Set up hardware PWM on the given pins (at most 8), with all duty cycles at 0. The SDK
+ * only allows this once per boot, and the frequency must be 100Hz..1kHz.
+ */
+bool jshPWMHardwareSetup(Pin *pins, int count, JsVarFloat freq) {
+  if (g_pwmChannels) {
+    jsExceptionHere(JSET_ERROR, "Hardware PWM can only be set up once");
+    return false;
+  }
+  if (count<1 || count>PWM_CHANNEL_MAX) {
+    jsExceptionHere(JSET_ERROR, "Hardware PWM needs 1..%d pins", PWM_CHANNEL_MAX);
+    return false;
+  }
+  if (!(freq>0)) freq = 1000; // also catches NaN (undefined)
+  uint32 period = (uint32)(1000000 / freq);
+  if (period<PWM_PERIOD_MIN || period>PWM_PERIOD_MAX) {
+    jsExceptionHere(JSET_ERROR, "Hardware PWM frequency must be 100..1000Hz");
+    return false;
+  }
+  uint32 duty[PWM_CHANNEL_MAX];
+  uint32 pinInfoList[PWM_CHANNEL_MAX][3];
+  int i;
+  for (i=0; i<count; i++) {
+    if (!jshIsPinValid(pins[i]) || (pins[i]>=6 && pins[i]<=11) || pins[i]>15) {
+      jsExceptionHere(JSET_ERROR, "Pin %p can't be used for hardware PWM", pins[i]);
+      return false;
+    }
+    duty[i] = 0;
+    pinInfoList[i][0] = g_PERIPHS[pins[i]];
+    pinInfoList[i][1] = g_pinGPIOFunc[pins[i]];
+    pinInfoList[i][2] = pins[i];
+  }
+  for (i=0; i<count; i++) {
+    jshPinSetState(pins[i], JSHPINSTATE_GPIO_OUT); // also stops any software PWM
+    g_pwmPins[i] = pins[i];
+    g_pwmValues[i] = 0;
+  }
+  g_pwmPeriod = period;
+  pwm_init(period, duty, count, pinInfoList);
+  g_pwmChannels = (uint8)count;
+  pwm_start();
+  return true;
+}
+
+/**
+ * Set the duty cycles (0..1) of several hardware PWM pins at once - they all change
+ * at the start of the same PWM period. Pins that aren't set up for it are ignored.
+ */
+void jshPWMHardwareWrite(Pin *pins, JsVarFloat *values, int count) {
+  int i;
+  for (i=0; i<count; i++) {
+    int ch = pwmGetChannel(pins[i]);
+    JsVarFloat v = values[i];
+    if (v<0) v=0;
+    if (v>1) v=1;
+    if (ch>=0) g_pwmValues[ch] = (uint16)(v*65535);
+  }
+  pwmApply();
 }
 
 
@@ -581,12 +659,9 @@ void jshPinPulse(
     bool pulsePolarity,   //!< The value to be pulsed into the pin.
     JsVarFloat pulseTime  //!< The duration in milliseconds to hold the pin.
 ) {
-#if 0
-  // Implementation using the utility timer. This doesn't work well on the esp8266, because the
-  // utility timer uses tasks and these are not pre-emptible. So the timer won't actually fire
-  // until the main espruino task becomes idle, which messes up timings. It also locks-up things
-  // when someone defines a pulse train that is longer than the timer queue, because then the
-  // main task busy-waits for the timer queue to drain a bit, which never happens.
+#if 1
+  // Implementation using the utility timer. Now that this runs off the FRC1 hardware timer
+  // interrupt (rather than an SDK task) the pulse ends accurately even while JS is running.
   if (!jshIsPinValid(pin)) {
     jsExceptionHere(JSET_ERROR, "Invalid pin!");
     return;
@@ -608,7 +683,7 @@ void jshPinPulse(
   }
 #endif
 
-#if 1
+#if 0
   // Implementation using busy-waiting. Ugly and if the pulse train exceeds 10ms one risks WDT
   // resets, but it actually works...
   jshPinOutput(pin, pulsePolarity);
@@ -632,6 +707,16 @@ bool jshCanWatch(
 }
 
 
+// Bit mask of the pins being watched
+static uint32 watchedPins = 0;
+
+/**
+ * Get a bit mask of the pins being watched (the power manager won't light-sleep if any are).
+ */
+uint32 esp8266_getWatchedPins() {
+  return watchedPins;
+}
+
 /**
  * Do what ever is necessary to watch a pin.
  * \return The event flag for this pin.
@@ -651,9 +736,11 @@ IOEventFlags jshPinWatch(
         jshPinSetState(pin, JSHPINSTATE_GPIO_IN);
       }
       gpio_pin_intr_state_set(GPIO_ID_PIN(pin), GPIO_PIN_INTR_ANYEDGE);
+      watchedPins |= 1 << pin;
     } else {
       // Stop watching the given pin
       gpio_pin_intr_state_set(GPIO_ID_PIN(pin), GPIO_PIN_INTR_DISABLE);
+      watchedPins &= ~(1 << pin);
     }
     ETS_GPIO_INTR_ENABLE();
   } else {
@@ -728,6 +815,9 @@ void jshUSARTSetup(IOEventFlags device, JshUSARTInfo *inf) {
   else assert(0);
   UartDev.flow_ctrl = NONE_CTRL;
 
+  // UART1 can only transmit, so receive buffering is only for UART0
+  if (uart_no == UART0)
+    uart_rx_setup(inf->rxBufferSize, inf->rxThreshold, inf->rxTimeout);
   uart_config(uart_no);
 }
 
@@ -735,27 +825,45 @@ bool jshIsUSBSERIALConnected() {
   return false; // "On non-USB boards this just returns false"
 }
 
+/**
+ * Fill a UART's TX FIFO with as much data as we have for it, or as will fit.
+ * If there may be more, enable the TX FIFO empty interrupt so the interrupt
+ * handler (uart0_rx_intr_handler) can call us again to top it up.
+ */
+void CALLED_FROM_INTERRUPT esp8266_uartTransmit(
+    uint8 uart_no //!< The UART to fill.
+) {
+  IOEventFlags device = uart_no == UART0 ? EV_SERIAL1 : EV_SERIAL2;
+  uint32 used = (READ_PERI_REG(UART_STATUS(uart_no)) >> UART_TXFIFO_CNT_S) & UART_TXFIFO_CNT;
+  int space = UART_FIFO_LEN - 1 - (int)used;
+  unsigned char buf[UART_FIFO_LEN];
+  int n, sent = 0;
+  while (sent < space && (n = jshGetCharsToTransmit(device, buf, space - sent)) > 0) {
+    for (int i=0; i<n; i++)
+      WRITE_PERI_REG(UART_FIFO(uart_no), buf[i]);
+    sent += n;
+  }
+  if (sent < space) // we sent everything
+    CLEAR_PERI_REG_MASK(UART_INT_ENA(uart_no), UART_TXFIFO_EMPTY_INT_ENA);
+  else
+    SET_PERI_REG_MASK(UART_INT_ENA(uart_no), UART_TXFIFO_EMPTY_INT_ENA);
+}
+
 /**
  * Kick a device into action (if required).
  *
  * For instance we may need
- * to set up interrupts.  In this ESP8266 implementation, we transmit all the
- * data that can be found associated with the device.
+ * to set up interrupts.  In this ESP8266 implementation, we fill the UART's
+ * FIFO, and the TX FIFO empty interrupt sends the rest of the data.
  */
 void jshUSARTKick(
     IOEventFlags device //!< The device to be kicked.
 ) {
-  // transmit anything that is sitting in the uart output buffers
   if (device == EV_SERIAL1 || device == EV_SERIAL2) {
-    // Get the next character to transmit.  We will have reached the end when
-    // the value of the character to transmit is -1.
-    int c = jshGetCharToTransmit(device);
-    uint8_t uart = device == EV_SERIAL1 ? 0 : 1;
-
-    while (c >= 0) {
-      uart_tx_one_char(uart, c);
-      c = jshGetCharToTransmit(device);
-    }
+    // the interrupt handler takes data from txBuffer too, so stop it while we do
+    ETS_UART_INTR_DISABLE();
+    esp8266_uartTransmit(device == EV_SERIAL1 ? UART0 : UART1);
+    ETS_UART_INTR_ENABLE();
   }
 }
 
@@ -806,6 +914,7 @@ int jshSPISend(
     return -1;
   }
   //os_printf("> jshSPISend - device=%d, data=%x\n", device, data);
+  while (spi_transfer_async_busy()) ; // wait for jshSPISendAsync
   int retData = g_lastSPIRead;
   if (data >=0) {
     g_lastSPIRead = spi_transaction(HSPI, 8, (uint32)data);
@@ -817,6 +926,58 @@ int jshSPISend(
 }
 
 
+/**
+ * Send 'count' bytes from 'tx' through the given SPI device, putting the response in
+ * 'rx' (if it isn't 0). This loads up to 64 bytes at a time into the HSPI W0..W15
+ * registers, rather than doing a whole SPI transaction per byte.
+ */
+bool jshSPISendMany(
+    IOEventFlags device, //!< The identity of the SPI device through which data is being sent.
+    unsigned char *tx,   //!< The data to send.
+    unsigned char *rx,   //!< Where to put the received data, or 0.
+    size_t count         //!< The number of bytes to send.
+) {
+  if (device != EV_SPI1) {
+    return false;
+  }
+  while (spi_transfer_async_busy()) ; // wait for jshSPISendAsync
+  // anything sent with jshSPISend has already been received, so that's just dropped
+  g_lastSPIRead = -1;
+  while (count) {
+    uint32 n = count > SPI_TRANSFER_MAX ? SPI_TRANSFER_MAX : (uint32)count;
+    spi_transfer(HSPI, tx, rx, n);
+    tx += n;
+    if (rx) rx += n;
+    count -= n;
+  }
+  return true;
+}
+
+
+static void CALLED_FROM_INTERRUPT spiAsyncDone() {
+  jshPushIOEvent(EV_SPI1, jshGetSystemTime());
+  esp8266_wakeMainLoop();
+}
+
+/**
+ * Send 'count' bytes from 'tx' through the given SPI device in the background, putting
+ * the response in 'rx' (if it isn't 0). An EV_SPI1 event is pushed when it's done.
+ */
+bool jshSPISendAsync(
+    IOEventFlags device, //!< The identity of the SPI device through which data is being sent.
+    unsigned char *tx,   //!< The data to send - must stay valid until the event.
+    unsigned char *rx,   //!< Where to put the received data, or 0.
+    size_t count         //!< The number of bytes to send.
+) {
+  if (device != EV_SPI1 || !count) {
+    return false;
+  }
+  while (spi_transfer_async_busy()) ;
+  g_lastSPIRead = -1;
+  return spi_transfer_async(tx, rx, (uint32)count, spiAsyncDone);
+}
+
+
 /**
  * Send 16 bit data through the given SPI device.
  */
@@ -831,6 +992,7 @@ void jshSPISend16(
     return;
   }
 
+  while (spi_transfer_async_busy()) ;
   spi_transaction(HSPI, 16, (uint32)data);
   //os_printf("< jshSPISend16\n");
 }
@@ -855,10 +1017,29 @@ void jshSPIWait(
     IOEventFlags device //!< Unknown
 ) {
   //os_printf("> jshSPIWait - device=%d\n", device);
-  while(spi_busy(HSPI)) ;
+  while(spi_transfer_async_busy() || spi_busy(HSPI)) ;
   //os_printf("< jshSPIWait\n");
 }
 
+/**
+ * Software SPI for jsspiFastSoftwareFunc - mode 0, MSB first and transmit only. This writes
+ * the GPIO set/clear registers directly from IRAM rather than calling jshPinSetValue for
+ * each edge, which gets several MHz on any pins.
+ */
+void CALLED_FROM_INTERRUPT jshSPISendSoftware(Pin pinMOSI, Pin pinSCK, const unsigned char *tx, size_t count) {
+  uint32_t mosi = 1U<<pinMOSI;
+  uint32_t sck = 1U<<pinSCK;
+  while (count--) {
+    unsigned char data = *tx++;
+    int bit;
+    for (bit=7; bit>=0; bit--) {
+      GPIO_REG_WRITE(((data>>bit)&1) ? GPIO_OUT_W1TS_ADDRESS : GPIO_OUT_W1TC_ADDRESS, mosi);
+      GPIO_REG_WRITE(GPIO_OUT_W1TS_ADDRESS, sck);
+      GPIO_REG_WRITE(GPIO_OUT_W1TC_ADDRESS, sck);
+    }
+  }
+}
+
 /** Set whether to use the receive interrupt or not */
 void jshSPISetReceive(IOEventFlags device, bool isReceive) {
   //os_printf("> jshSPISetReceive - device=%d, isReceive=%d\n", device, isReceive);
@@ -1090,32 +1271,360 @@ static void systemTimeInit(void) {
 
 //===== Utility timer =====
 
-// The utility timer uses the SDK timer in microsecond mode.
+// The utility timer uses the FRC1 hardware timer (free as long as the SDK's hardware PWM
+// isn't used), so tasks run from an interrupt with microsecond accuracy rather than from an
+// SDK task. FRC1 counts down at APB_CLK/16 (5MHz) from a 23 bit value, so periods longer
+// than UTIL_TIMER_MAX_US are done in several steps. We use the normal interrupt rather than
+// the NMI so that jshInterruptOff still protects jstimer's task queue.
+
+#define FRC1_ENABLE_TIMER  BIT7
+#define FRC1_DIVIDED_BY_16 4
+#define FRC1_EDGE_INT      0
+#define UTIL_TIMER_TICKS_PER_US ((APB_CLK_FREQ>>4)/1000000)
+#define UTIL_TIMER_MAX_US  (0x7FFFFF / UTIL_TIMER_TICKS_PER_US)
+#define UTIL_TIMER_MIN_US  10 // any less and we'd spend all our time in the interrupt
+
+static volatile uint32_t utilTimerRemaining; //!< us left to wait after the current FRC1 period
+
+static void CALLED_FROM_INTERRUPT utilTimerArm(uint32_t us) {
+  if (us > UTIL_TIMER_MAX_US) {
+    utilTimerRemaining = us - UTIL_TIMER_MAX_US;
+    us = UTIL_TIMER_MAX_US;
+  } else {
+    utilTimerRemaining = 0;
+  }
+  RTC_REG_WRITE(FRC1_LOAD_ADDRESS, us * UTIL_TIMER_TICKS_PER_US);
+}
 
-os_timer_t utilTimer;
+static void CALLED_FROM_INTERRUPT utilTimerIntrHandler(void *arg) {
+  RTC_CLR_REG_MASK(FRC1_INT_ADDRESS, FRC1_INT_CLR_MASK);
+  if (utilTimerRemaining) { // long period - not there yet
+    utilTimerArm(utilTimerRemaining < UTIL_TIMER_MIN_US ? UTIL_TIMER_MIN_US : utilTimerRemaining);
+    return;
+  }
+  jstUtilTimerInterruptHandler();
+}
 
 static void utilTimerInit(void) {
   //os_printf("UStimer init\n");
-  os_timer_disarm(&utilTimer);
-  os_timer_setfn(&utilTimer, jstUtilTimerInterruptHandler, NULL);
+  ETS_FRC1_INTR_DISABLE();
+  TM1_EDGE_INT_DISABLE();
+  RTC_REG_WRITE(FRC1_CTRL_ADDRESS, FRC1_DIVIDED_BY_16 | FRC1_ENABLE_TIMER | FRC1_EDGE_INT);
+  ETS_FRC_TIMER1_INTR_ATTACH(utilTimerIntrHandler, NULL);
 }
 
-void jshUtilTimerDisable() {
+void CALLED_FROM_INTERRUPT jshUtilTimerDisable() {
   //os_printf("UStimer disarm\n");
-  os_timer_disarm(&utilTimer);
+  TM1_EDGE_INT_DISABLE();
+  ETS_FRC1_INTR_DISABLE();
 }
 
-void jshUtilTimerStart(JsSysTime period) {
+void CALLED_FROM_INTERRUPT jshUtilTimerStart(JsSysTime period) {
   //if (period < 100.0 || period > 10000) os_printf("UStimer arm %ldus\n", (uint32_t)period);
-  if (period<1) period=1;
-  os_timer_arm_us(&utilTimer, (uint32_t)period, 0);
+  if (period < UTIL_TIMER_MIN_US) period = UTIL_TIMER_MIN_US;
+  if (period > 0xFFFFFFFF) period = 0xFFFFFFFF;
+  utilTimerArm((uint32_t)period);
+  TM1_EDGE_INT_ENABLE();
+  ETS_FRC1_INTR_ENABLE();
 }
 
-void jshUtilTimerReschedule(JsSysTime period) {
-  jshUtilTimerDisable();
+void CALLED_FROM_INTERRUPT jshUtilTimerReschedule(JsSysTime period) {
   jshUtilTimerStart(period);
 }
 
+//===== I2S waveform output =====
+
+// A Waveform output on GPIO3 (the I2S data pin) is clocked out by the I2S peripheral and
+// its SLC DMA engine rather than by the utility timer. There's no DAC, so each sample
+// becomes one 32 bit frame of pulse-density modulated bits - put an RC filter on the pin
+// to get an analog signal back. The SLC end-of-frame interrupt refills each DMA buffer in
+// the ring as it finishes, straight from the Waveform's buffer/buffer2.
+
+#define I2S_PIN          3
+#define I2S_DMA_BUFFERS  4
+#define I2S_DMA_SAMPLES  128
+
+static struct slc_queue_item i2sDesc[I2S_DMA_BUFFERS];
+static uint32_t i2sDMAData[I2S_DMA_BUFFERS][I2S_DMA_SAMPLES];
+static uint32_t i2sPDM[33]; //!< 32 bit words with 0..32 bits set, evenly spread
+
+static struct {
+  uint8_t *data[2];        //!< samples of buffer and buffer2 (or 0)
+  uint32_t length;         //!< number of samples in each buffer
+  uint32_t pos;            //!< next sample to output from data[current]
+  uint32_t error;          //!< pulse density rounding error, carried to the next sample
+  bool is16Bit;
+  bool repeat;
+  uint8_t drain;           //!< DMA buffers left to play out after the last sample
+  volatile int8_t current; //!< buffer being output, or -1 when stopped
+} i2sWave = { .current = -1 };
+
+/// Neopixel data being sent with I2S - see jshI2SNeopixelWrite
+static struct {
+  uint32_t *data;                //!< expanded bit patterns (and latch), or 0
+  struct slc_queue_item *desc;   //!< DMA descriptors for 'data'
+  volatile bool busy;            //!< still sending
+} i2sPixels;
+
+static void CALLED_FROM_INTERRUPT i2sWaveFill(uint32_t *dst) {
+  int i;
+  for (i=0; i<I2S_DMA_SAMPLES; i++) {
+    if (i2sWave.pos >= i2sWave.length) {
+      if (!i2sWave.repeat) break;
+      if (i2sWave.data[1]) {
+        // the other buffer is now free to be refilled - let jswrap_waveform_idle know
+        i2sWave.current = !i2sWave.current;
+        esp8266_wakeMainLoop();
+      }
+      i2sWave.pos = 0;
+    }
+    uint8_t *p = i2sWave.data[i2sWave.current];
+    uint32_t v = i2sWave.is16Bit ? ((uint16_t*)p)[i2sWave.pos] : p[i2sWave.pos]*0x101U;
+    i2sWave.pos++;
+    v = (v<<5) + i2sWave.error; // bits to set, as 16.16 fixed point
+    i2sWave.error = v & 0xFFFF;
+    dst[i] = i2sPDM[v>>16];
+  }
+  if (i<I2S_DMA_SAMPLES) { // finished - pad with silence and wait for it to be output
+    while (i<I2S_DMA_SAMPLES) dst[i++] = 0;
+    if (!i2sWave.drain) i2sWave.drain = I2S_DMA_BUFFERS;
+  }
+}
+
+/// Stop the I2S transmitter and its DMA
+static void CALLED_FROM_INTERRUPT i2sHalt() {
+  ETS_SLC_INTR_DISABLE();
+  WRITE_PERI_REG(SLC_INT_ENA, 0);
+  CLEAR_PERI_REG_MASK(I2SCONF, I2S_I2S_TX_START);
+  SET_PERI_REG_MASK(SLC_RX_LINK, SLC_RXLINK_STOP);
+}
+
+static void CALLED_FROM_INTERRUPT i2sWaveHalt() {
+  i2sHalt();
+  i2sWave.current = -1;
+  esp8266_wakeMainLoop();
+}
+
+static void CALLED_FROM_INTERRUPT i2sIntrHandler(void *arg) {
+  uint32_t status = READ_PERI_REG(SLC_INT_STATUS);
+  WRITE_PERI_REG(SLC_INT_CLR, 0xFFFFFFFF);
+  if (!(status & SLC_RX_EOF_INT_ST)) return;
+  if (i2sWave.drain && !--i2sWave.drain) {
+    i2sWaveHalt();
+    return;
+  }
+  struct slc_queue_item *desc = (struct slc_queue_item *)READ_PERI_REG(SLC_RX_EOF_DES_ADDR);
+  i2sWaveFill((uint32_t *)desc->buf_ptr);
+}
+
+/**
+ * Start the I2S transmitter on GPIO3 with a bit clock of 160MHz/(bck*clkm), outputting
+ * the DMA descriptors starting at 'desc'. 'handler' is called for SLC interrupts.
+ */
+static void i2sStart(struct slc_queue_item *desc, int bck, int clkm, void (*handler)(void *)) {
+  // SLC DMA, feeding the I2S transmitter from the descriptors
+  ETS_SLC_INTR_DISABLE();
+  WRITE_PERI_REG(SLC_INT_ENA, 0);
+  WRITE_PERI_REG(SLC_INT_CLR, 0xFFFFFFFF);
+  SET_PERI_REG_MASK(SLC_CONF0, SLC_RXLINK_RST | SLC_TXLINK_RST);
+  CLEAR_PERI_REG_MASK(SLC_CONF0, SLC_RXLINK_RST | SLC_TXLINK_RST);
+  CLEAR_PERI_REG_MASK(SLC_CONF0, SLC_MODE << SLC_MODE_S);
+  SET_PERI_REG_MASK(SLC_CONF0, 1 << SLC_MODE_S);
+  SET_PERI_REG_MASK(SLC_RX_DSCR_CONF, SLC_INFOR_NO_REPLACE | SLC_TOKEN_NO_REPLACE);
+  // the TX link (I2S input) is unused, but has to point at a valid descriptor
+  WRITE_PERI_REG(SLC_TX_LINK, (uint32_t)&desc[0] & SLC_TXLINK_DESCADDR_MASK);
+  WRITE_PERI_REG(SLC_RX_LINK, (uint32_t)&desc[0] & SLC_RXLINK_DESCADDR_MASK);
+  ETS_SLC_INTR_ATTACH(handler, NULL);
+  WRITE_PERI_REG(SLC_INT_ENA, SLC_RX_EOF_INT_ENA);
+  ETS_SLC_INTR_ENABLE();
+  SET_PERI_REG_MASK(SLC_TX_LINK, SLC_TXLINK_START);
+  SET_PERI_REG_MASK(SLC_RX_LINK, SLC_RXLINK_START);
+
+  // I2S transmitter, 16 bit stereo frames (so 32 bits per sample)
+  PIN_FUNC_SELECT(PERIPHS_IO_MUX_U0RXD_U, FUNC_I2SO_DATA);
+  I2S_CLK_ENABLE();
+  WRITE_PERI_REG(I2SINT_CLR, 0x3F);
+  WRITE_PERI_REG(I2SINT_ENA, 0);
+  SET_PERI_REG_MASK(I2SCONF, I2S_I2S_RESET_MASK);
+  CLEAR_PERI_REG_MASK(I2SCONF, I2S_I2S_RESET_MASK);
+  CLEAR_PERI_REG_MASK(I2S_FIFO_CONF, (I2S_I2S_TX_FIFO_MOD << I2S_I2S_TX_FIFO_MOD_S) |
+                                     (I2S_I2S_RX_FIFO_MOD << I2S_I2S_RX_FIFO_MOD_S));
+  SET_PERI_REG_MASK(I2S_FIFO_CONF, I2S_I2S_DSCR_EN);
+  CLEAR_PERI_REG_MASK(I2SCONF_CHAN, (I2S_TX_CHAN_MOD << I2S_TX_CHAN_MOD_S) |
+                                    (I2S_RX_CHAN_MOD << I2S_RX_CHAN_MOD_S));
+  CLEAR_PERI_REG_MASK(I2SCONF, I2S_TRANS_SLAVE_MOD | (I2S_BITS_MOD << I2S_BITS_MOD_S) |
+                               (I2S_BCK_DIV_NUM << I2S_BCK_DIV_NUM_S) |
+                               (I2S_CLKM_DIV_NUM << I2S_CLKM_DIV_NUM_S));
+  SET_PERI_REG_MASK(I2SCONF, I2S_RIGHT_FIRST | I2S_MSB_RIGHT | I2S_RECE_SLAVE_MOD |
+                             I2S_RECE_MSB_SHIFT | I2S_TRANS_MSB_SHIFT |
+                             ((uint32_t)bck << I2S_BCK_DIV_NUM_S) |
+                             ((uint32_t)clkm << I2S_CLKM_DIV_NUM_S));
+  SET_PERI_REG_MASK(I2SCONF, I2S_I2S_TX_START);
+}
+
+/**
+ * Start outputting a Waveform's samples on the I2S data pin using DMA. Returns false
+ * (so the utility timer should be used) if the pin or frequency can't be handled, or
+ * I2S is already busy with another Waveform or neopixel data.
+ */
+bool jshI2SWaveformStart(Pin pin, JsVarFloat freq, uint8_t *data, uint8_t *data2, uint32_t length, bool is16Bit, bool repeat) {
+  if (pin != I2S_PIN || i2sWave.current >= 0 || i2sPixels.busy || !length) return false;
+  // The bit clock (32x the sample rate) is 160MHz divided by bck*clkm, each 2..63
+  JsVarFloat div = I2S_BASE_FREQ / (freq * 32);
+  int bck, bestBck = 0, bestClkm = 0;
+  JsVarFloat bestErr = 0.01; // any worse and the utility timer will be more accurate
+  for (bck=2; bck<=63; bck++) {
+    int clkm = (int)(div / bck + 0.5);
+    if (clkm < 2 || clkm > 63) continue;
+    JsVarFloat err = (bck*clkm - div) / div;
+    if (err < 0) err = -err;
+    if (err < bestErr) {
+      bestErr = err;
+      bestBck = bck;
+      bestClkm = clkm;
+    }
+  }
+  if (!bestBck) return false;
+
+  if (!i2sPDM[32]) {
+    int n, b;
+    for (n=0; n<=32; n++)
+      for (b=0; b<32; b++)
+        if (((b+1)*n)/32 != (b*n)/32) i2sPDM[n] |= 1U<<b;
+  }
+
+  i2sWave.data[0] = data;
+  i2sWave.data[1] = data2;
+  i2sWave.length = length;
+  i2sWave.pos = 0;
+  i2sWave.error = 0;
+  i2sWave.is16Bit = is16Bit;
+  i2sWave.repeat = repeat;
+  i2sWave.drain = 0;
+  i2sWave.current = 0;
+  int i;
+  for (i=0; i<I2S_DMA_BUFFERS; i++) {
+    i2sDesc[i].owner = 1;
+    i2sDesc[i].eof = 1;
+    i2sDesc[i].sub_sof = 0;
+    i2sDesc[i].unused = 0;
+    i2sDesc[i].datalen = i2sDesc[i].blocksize = sizeof(i2sDMAData[i]);
+    i2sDesc[i].buf_ptr = (uint32_t)i2sDMAData[i];
+    i2sDesc[i].next_link_ptr = (uint32_t)&i2sDesc[(i+1) % I2S_DMA_BUFFERS];
+    i2sWaveFill(i2sDMAData[i]);
+  }
+
+  i2sStart(i2sDesc, bestBck, bestClkm, i2sIntrHandler);
+  return true;
+}
+
+/// The buffer (0 or 1) that I2S is currently outputting, or -1 if it has finished
+int jshI2SWaveformGetBuffer() {
+  return i2sWave.current;
+}
+
+/// Stop I2S waveform output
+void jshI2SWaveformStop() {
+  if (i2sWave.current >= 0) i2sWaveHalt();
+}
+
+//===== I2S neopixel output =====
+
+// WS2812 LEDs on GPIO3 are driven by I2S DMA too, so interrupts (and WiFi) aren't held
+// off while the data is sent. At a 3.2MHz bit clock each LED bit is 4 I2S bits (1000
+// for a 0, 1100 for a 1), so each byte of LED data becomes one 32 bit word, which is
+// sent high halfword first. The data is expanded into a buffer up-front, and only the
+// last DMA descriptor raises an interrupt, to say that the whole frame has been sent.
+
+#define I2S_NEOPIXEL_BCK   5  // 160MHz/(5*10) = 3.2MHz
+#define I2S_NEOPIXEL_CLKM  10
+#define I2S_NEOPIXEL_LATCH 32 // words of zeros on the end - 320us, for the reset/latch
+#define I2S_DESC_MAX       4092 // bytes of data in a DMA descriptor (12 bits, word aligned)
+
+static void CALLED_FROM_INTERRUPT i2sPixelIntrHandler(void *arg) {
+  uint32_t status = READ_PERI_REG(SLC_INT_STATUS);
+  WRITE_PERI_REG(SLC_INT_CLR, 0xFFFFFFFF);
+  if (!(status & SLC_RX_EOF_INT_ST)) return;
+  i2sHalt();
+  i2sPixels.busy = false;
+  esp8266_wakeMainLoop();
+}
+
+/**
+ * Send WS2812 data on the I2S data pin using DMA. Returns false (so it should be
+ * bit-banged) if the pin can't be used, I2S is busy with a Waveform, or there's
+ * not enough memory. Otherwise it returns straight away, and jshI2SNeopixelIdle
+ * returns true once it's finished.
+ */
+bool jshI2SNeopixelWrite(Pin pin, uint8_t *data, uint32_t length) {
+  if (pin != I2S_PIN || i2sWave.current >= 0 || !length) return false;
+  while (i2sPixels.busy); // wait for the last frame to go
+  jshI2SNeopixelIdle(); // free its buffers
+
+  uint32_t words = length + I2S_NEOPIXEL_LATCH;
+  uint32_t nDesc = (words*4 + I2S_DESC_MAX-1) / I2S_DESC_MAX;
+  i2sPixels.data = (uint32_t *)os_malloc(words*4);
+  i2sPixels.desc = (struct slc_queue_item *)os_malloc(nDesc*sizeof(struct slc_queue_item));
+  if (!i2sPixels.data || !i2sPixels.desc) {
+    jshI2SNeopixelIdle();
+    return false;
+  }
+
+  uint32_t i;
+  for (i=0; i<length; i++) {
+    uint8_t pix = data[i];
+    uint32_t bits = 0;
+    int b;
+    for (b=7; b>=0; b--)
+      bits = (bits<<4) | ((pix>>b)&1 ? 0xC : 0x8);
+    i2sPixels.data[i] = bits;
+  }
+  for (; i<words; i++) i2sPixels.data[i] = 0;
+
+  uint8_t *ptr = (uint8_t *)i2sPixels.data;
+  uint32_t bytesLeft = words*4;
+  for (i=0; i<nDesc; i++) {
+    uint32_t n = bytesLeft>I2S_DESC_MAX ? I2S_DESC_MAX : bytesLeft;
+    i2sPixels.desc[i].owner = 1;
+    i2sPixels.desc[i].eof = i==nDesc-1;
+    i2sPixels.desc[i].sub_sof = 0;
+    i2sPixels.desc[i].unused = 0;
+    i2sPixels.desc[i].datalen = i2sPixels.desc[i].blocksize = n;
+    i2sPixels.desc[i].buf_ptr = (uint32_t)ptr;
+    i2sPixels.desc[i].next_link_ptr = i==nDesc-1 ? 0 : (uint32_t)&i2sPixels.desc[i+1];
+    ptr += n;
+    bytesLeft -= n;
+  }
+
+  i2sPixels.busy = true;
+  i2sStart(i2sPixels.desc, I2S_NEOPIXEL_BCK, I2S_NEOPIXEL_CLKM, i2sPixelIntrHandler);
+  return true;
+}
+
+/// Returns true (once) when an I2S neopixel write has just finished, and frees its buffers
+bool jshI2SNeopixelIdle() {
+  if (i2sPixels.busy || !i2sPixels.data) return false;
+  os_free(i2sPixels.data);
+  os_free(i2sPixels.desc);
+  i2sPixels.data = 0;
+  i2sPixels.desc = 0;
+  return true;
+}
+
+/* Writing/erasing flash (or reading above 1MB) disables the flash cache, and the
+ * utility timer and I2S interrupts call code that lives in flash - so hold them off
+ * until the operation is finished. An interrupt that became due meanwhile is latched
+ * and runs as soon as we unmask it. */
+static void utilTimerPause() {
+  ETS_FRC1_INTR_DISABLE();
+  ETS_SLC_INTR_DISABLE();
+}
+
+static void utilTimerResume() {
+  if (jstUtilTimerIsRunning()) ETS_FRC1_INTR_ENABLE();
+  if (i2sWave.current >= 0 || i2sPixels.busy) ETS_SLC_INTR_ENABLE();
+}
+
 //===== Miscellaneous =====
 
 bool jshIsDeviceInitialised(IOEventFlags device) {
@@ -1187,7 +1696,9 @@ void jshFlashRead(
    } else { // Above 1Mb read...
 	//os_printf("jshFlashRead: above 1mb!");
 	SpiFlashOpResult res;
+	utilTimerPause();
 	res = spi_flash_read(addr, buf, len);
+	utilTimerResume();
     if (res != SPI_FLASH_RESULT_OK)
       os_printf("ESP8266: jshFlashRead %s\n",
     res == SPI_FLASH_RESULT_ERR ? "error" : "timeout");
@@ -1215,7 +1726,9 @@ void jshFlashWrite(
 
   // since things are guaranteed to be aligned we can just call the SDK :-)
   SpiFlashOpResult res;
+  utilTimerPause();
   res = spi_flash_write(addr, buf, len);
+  utilTimerResume();
   if (res != SPI_FLASH_RESULT_OK)
     os_printf("ESP8266: jshFlashWrite %s\n",
       res == SPI_FLASH_RESULT_ERR ? "error" : "timeout");
@@ -1283,7 +1796,9 @@ void jshFlashErasePage(
   //os_printf("jshFlashErasePage: addr=0x%lx\n", addr);
 
   SpiFlashOpResult res;
+  utilTimerPause();
   res = spi_flash_erase_sector(addr >> FLASH_PAGE_SHIFT);
+  utilTimerResume();
   if (res != SPI_FLASH_RESULT_OK)
     os_printf("ESP8266: jshFlashErase%s\n",
       res == SPI_FLASH_RESULT_ERR ? "error" : "timeout");
@@ -1295,6 +1810,7 @@ unsigned int jshSetSystemClock(JsVar *options) {
     jsExceptionHere(JSET_ERROR, "Invalid frequency value, must be 80 or 160.");
     return 0;
   }
+  esp8266_setCPUGovernor(0); // a fixed frequency was asked for
   system_update_cpu_freq(newFreq);
   return system_get_cpu_freq()*1000000;
 }
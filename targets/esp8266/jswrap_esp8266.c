@@ -30,7 +30,17 @@ typedef long long int64_t;
 
 #include <jswrap_esp8266.h>
 #include <network_esp8266.h>
+#include <esp8266_board_utils.h>
+#include "ESP8266_board.h"
 #include "jsinteractive.h" // Pull in the jsiConsolePrint function
+#include "jswrap_json.h"
+#include "jswrap_arraybuffer.h"
+#include "jswrap_interactive.h"
+#include "jswrap_object.h"
+#include "jswrap_net.h"
+#include "jswrap_http.h"
+#include "sha2.h"
+#include "ota.h"
 #include <log.h>
 
 #define _BV(bit) (1 << (bit))
@@ -173,6 +183,33 @@ void jswrap_ESP8266_dumpSocketInfo(void) {
   esp8266_dumpAllSocketData();
 }
 
+//===== ESP8266.getNetStats
+
+/*JSON{
+  "type"     : "staticmethod",
+  "class"    : "ESP8266",
+  "name"     : "getNetStats",
+  "generate" : "jswrap_ESP8266_getNetStats",
+  "return"   : ["JsVar", "An object containing network counters since boot"]
+}
+Returns counters for all sockets since boot, for tuning network throughput:
+
+* `bytesIn`, `bytesOut` - bytes received and sent
+* `segmentsIn`, `segmentsOut` - TCP segments (or UDP datagrams) received and sent
+* `recvHolds`, `recvUnholds` - how often receiving was paused because too much data was queued
+* `txWait` - milliseconds spent waiting for sent data to be acknowledged
+* `allocFails` - buffers that couldn't be allocated
+* `rxDropped` - UDP datagrams dropped because the receive window was full
+* `rxQueued`, `rxQueuedMax` - bytes queued for reading now, and the most ever queued on one socket
+* `sockets` - sockets in use
+* `freeHeap` - free heap in bytes
+
+Use `socket.getStats()` for the same counters for one socket.
+ */
+JsVar *jswrap_ESP8266_getNetStats(void) {
+  return net_ESP8266_BOARD_getStats(NULL, -1);
+}
+
 //===== ESP8266.setCPUFreq
 
 /*JSON{
@@ -197,6 +234,70 @@ void jswrap_ESP8266_setCPUFreq(
   jshSetSystemClock(jsFreq);
 }
 
+//===== ESP8266.setCPUGovernor
+
+/*JSON{
+  "type"     : "staticmethod",
+  "class"    : "ESP8266",
+  "name"     : "setCPUGovernor",
+  "generate" : "jswrap_ESP8266_setCPUGovernor",
+  "params"   : [
+    ["idleMs", "int", "How long Espruino must be idle before dropping to 80Mhz, or 0 to turn the governor off"]
+  ]
+}
+Automatically change the CPU frequency depending on how busy Espruino is. The ESP8266 runs
+at 160Mhz while JavaScript is executing, data is being sent or events are waiting, and drops
+back to 80Mhz once it has been idle for `idleMs` milliseconds (eg. `200`). This gets the most
+speed when it's needed while saving power the rest of the time.
+
+Calling `E.setClock()` or `ESP8266.setCPUFreq()` turns the governor off.
+
+**Warning**: the same caveats about I/O timing as `ESP8266.setCPUFreq()` apply.
+*/
+void jswrap_ESP8266_setCPUGovernor(
+    JsVarInt idleMs //!< Idle time before dropping to 80MHz, 0 = off
+  ) {
+  esp8266_setCPUGovernor(idleMs>0 ? (uint32)idleMs : 0);
+}
+
+//===== ESP8266.setLoopPolicy
+
+/*JSON{
+  "type"     : "staticmethod",
+  "class"    : "ESP8266",
+  "name"     : "setLoopPolicy",
+  "generate" : "jswrap_ESP8266_setLoopPolicy",
+  "params"   : [
+    ["options", "JsVar", "An object `{maxRunUs, minYieldUs}`"]
+  ]
+}
+Set how Espruino's main loop shares the CPU with the WiFi stack.
+
+By default Espruino handles one batch of events and then hands control back to the SDK,
+which gives WiFi the lowest latency. For more throughput (eg. when handling lots of
+incoming data or pin events):
+
+* `maxRunUs` - keep handling events back-to-back for up to this many microseconds
+  (max 10000, as WiFi needs the CPU at least every 10ms). 0 (the default) runs once.
+* `minYieldUs` - if there is still work to do afterwards, leave the CPU to the SDK for at
+  least this long (rounded up to milliseconds). 0 (the default) runs again as soon as the
+  SDK has had its turn.
+
+When there is nothing to do, Espruino sleeps until the next timer or event regardless.
+
+*/
+void jswrap_ESP8266_setLoopPolicy(
+    JsVar *options //!< Object with maxRunUs and minYieldUs fields
+  ) {
+  if (!jsvIsObject(options)) {
+    jsExceptionHere(JSET_TYPEERROR, "Expecting an object, got %t", options);
+    return;
+  }
+  JsVarInt maxRunUs = jsvGetIntegerAndUnLock(jsvObjectGetChild(options, "maxRunUs", 0));
+  JsVarInt minYieldUs = jsvGetIntegerAndUnLock(jsvObjectGetChild(options, "minYieldUs", 0));
+  esp8266_setLoopPolicy(maxRunUs>0 ? (uint32)maxRunUs : 0, minYieldUs>0 ? (uint32)minYieldUs : 0);
+}
+
 //===== ESP8266.getState
 
 /*JSON{
@@ -215,6 +316,12 @@ Returns an object that contains details about the state of the ESP8266 with the
 * `flashMap`     - Configured flash size&map: '512KB:256/256' .. '4MB:512/512'
 * `flashKB`      - Configured flash size in KB as integer
 * `flashChip`    - Type of flash chip as string with manufacturer & chip, ex: '0xEF 0x4016`
+* `chunkSize`    - How many bytes of network data are currently moved at a time (this depends on free memory)
+* `heap`         - C heap (outside of JS variables) used by networking:
+  * `lowestFree` - the lowest `freeHeap` has been since boot
+  * `failures`   - how many tracked allocations have failed
+  * `pktbuf`, `tx`, `espconn`, `ota` - `{bytes, peak}` currently allocated for received
+    data, data being sent, socket structures and OTA updates
 
 */
 JsVar *jswrap_ESP8266_getState() {
@@ -237,6 +344,22 @@ JsVar *jswrap_ESP8266_getState() {
   char buff[16];
   os_sprintf(buff, "0x%02lx 0x%04lx", fid & 0xff, chip);
   jsvObjectSetChildAndUnLock(esp8266State, "flashChip",   jsvNewFromString(buff));
+  jsvObjectSetChildAndUnLock(esp8266State, "chunkSize",   jsvNewFromInteger(net_ESP8266_BOARD_getChunkSize()));
+
+  esp8266_heapCheckFree();
+  JsVar *heap = jsvNewObject();
+  if (heap) {
+    jsvObjectSetChildAndUnLock(heap, "lowestFree", jsvNewFromInteger(esp8266_heapStats.lowestFreeHeap));
+    jsvObjectSetChildAndUnLock(heap, "failures", jsvNewFromInteger(esp8266_heapStats.failures));
+    for (int i=0; i<ESP_HEAP_SUBSYSTEMS; i++) {
+      JsVar *sys = jsvNewObject();
+      if (!sys) break;
+      jsvObjectSetChildAndUnLock(sys, "bytes", jsvNewFromInteger(esp8266_heapStats.bytes[i]));
+      jsvObjectSetChildAndUnLock(sys, "peak", jsvNewFromInteger(esp8266_heapStats.peak[i]));
+      jsvObjectSetChildAndUnLock(heap, esp8266_heapSubsystemNames[i], sys);
+    }
+    jsvObjectSetChildAndUnLock(esp8266State, "heap", heap);
+  }
 
   return esp8266State;
 }
@@ -307,6 +430,18 @@ JsVar *jswrap_ESP8266_crc32(JsVar *jsData) {
 // one : high typ 700ns, min 500ns; low typ 600ns, max 5us
 // latch: low min 6us
 
+/// The callback for a neopixelWrite that is being sent with I2S
+#define NEOPIXEL_CALLBACK_NAME JS_HIDDEN_CHAR_STR"npx"
+
+/// Queue the callback for a finished I2S neopixelWrite, if there is one
+static void neopixelCallback() {
+  JsVar *callback = jsvObjectGetChild(execInfo.hiddenRoot, NEOPIXEL_CALLBACK_NAME, 0);
+  if (!callback) return;
+  jsvRemoveNamedChild(execInfo.hiddenRoot, NEOPIXEL_CALLBACK_NAME);
+  jsiQueueEvents(0, callback, 0, 0);
+  jsvUnLock(callback);
+}
+
 /*JSON{
  "type"     : "staticmethod",
  "class"    : "ESP8266",
@@ -314,10 +449,18 @@ JsVar *jswrap_ESP8266_crc32(JsVar *jsData) {
  "generate" : "jswrap_ESP8266_neopixelWrite",
  "params"   : [
    ["pin", "pin", "Pin for output signal."],
-   ["arrayOfData", "JsVar", "Array of LED data."]
+   ["arrayOfData", "JsVar", "Array of LED data."],
+   ["callback", "JsVar", "An optional function to call when the data has been sent."]
  ]
-}*/
-void jswrap_ESP8266_neopixelWrite(Pin pin, JsVar *jsArrayOfData) {
+}
+Send data to WS2812 (neopixel) LEDs.
+
+On GPIO3 (RX) the data is sent by the I2S peripheral using DMA, so this returns straight away
+and interrupts (and so WiFi) keep working while the LEDs are updated - use `callback` to know
+when the next frame can be sent. On other pins the data is sent with interrupts disabled,
+and `callback` is called as soon as possible afterwards.
+*/
+void jswrap_ESP8266_neopixelWrite(Pin pin, JsVar *jsArrayOfData, JsVar *callback) {
   if (!jshIsPinValid(pin)) {
     jsExceptionHere(JSET_ERROR, "Pin is not valid.");
     return;
@@ -341,6 +484,20 @@ void jswrap_ESP8266_neopixelWrite(Pin pin, JsVar *jsArrayOfData) {
     return;
   }
 
+  if (callback && !jsvIsFunction(callback)) {
+    jsExceptionHere(JSET_ERROR, "Callback must be a function.");
+    return;
+  }
+
+  if (jshI2SNeopixelWrite(pin, (uint8_t *)pixels, dataLength)) {
+    // jshI2SNeopixelWrite waited for any previous frame, so call back for that now
+    neopixelCallback();
+    // the data has been copied - let jswrap_ESP8266_idle call back when it's sent
+    if (callback) jsvObjectSetChild(execInfo.hiddenRoot, NEOPIXEL_CALLBACK_NAME, callback);
+    return;
+  }
+  if (callback) jsiQueueEvents(0, callback, 0, 0);
+
   if (!jshGetPinStateIsManual(pin))
     jshPinSetState(pin, JSHPINSTATE_GPIO_OUT);
 
@@ -424,14 +581,159 @@ void jswrap_ESP8266_neopixelWrite(Pin pin, JsVar *jsArrayOfData) {
 #endif
 }
 
+/*JSON{
+  "type" : "idle",
+  "generate" : "jswrap_ESP8266_idle"
+}*/
+bool jswrap_ESP8266_idle() {
+  if (!jshI2SNeopixelIdle()) return false;
+  neopixelCallback(); // a neopixelWrite has finished
+  return true;
+}
+
+//===== ESP8266.pwmSetup / pwmWrite
+
+/*JSON{
+ "type"     : "staticmethod",
+ "class"    : "ESP8266",
+ "name"     : "pwmSetup",
+ "generate" : "jswrap_ESP8266_pwmSetup",
+ "params"   : [
+   ["pins", "JsVar", "An array of up to 8 pins to use hardware PWM on"],
+   ["freq", "float", "(optional) The PWM frequency in Hz, 100..1000 (default 1000)"]
+ ]
+}
+Use the SDK's hardware PWM driver for the given pins, instead of software PWM from the utility timer.
+This gives steady duty cycles with no CPU load, however many pins are used.
+
+After this, `analogWrite` on these pins uses hardware PWM. All the pins share one frequency (changing it
+with `analogWrite`'s `freq` option changes it for all of them). The SDK only allows this to be called once
+after the ESP8266 boots, and hardware PWM pins can't go back to being normal GPIOs until a reboot.
+*/
+void jswrap_ESP8266_pwmSetup(JsVar *pinsVar, JsVarFloat freq) {
+  Pin pins[JSH_PWM_HARDWARE_MAX];
+  int count = 0;
+  if (!jsvIsArray(pinsVar) || jsvGetArrayLength(pinsVar) > JSH_PWM_HARDWARE_MAX) {
+    jsExceptionHere(JSET_ERROR, "Expecting an array of up to %d pins", JSH_PWM_HARDWARE_MAX);
+    return;
+  }
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, pinsVar);
+  while (jsvObjectIteratorHasValue(&it)) {
+    pins[count++] = jshGetPinFromVarAndUnLock(jsvObjectIteratorGetValue(&it));
+    jsvObjectIteratorNext(&it);
+  }
+  jsvObjectIteratorFree(&it);
+  jshPWMHardwareSetup(pins, count, freq);
+}
+
+/*JSON{
+ "type"     : "staticmethod",
+ "class"    : "ESP8266",
+ "name"     : "pwmWrite",
+ "generate" : "jswrap_ESP8266_pwmWrite",
+ "params"   : [
+   ["pins", "JsVar", "An array of pins set up with `ESP8266.pwmSetup`"],
+   ["values", "JsVar", "An array of duty cycles (0..1), one for each pin"]
+ ]
+}
+Set the duty cycles of several hardware PWM pins at once. Unlike separate `analogWrite` calls, all the
+pins change at the start of the same PWM period - so fading between colours on an RGB LED stays smooth.
+*/
+void jswrap_ESP8266_pwmWrite(JsVar *pinsVar, JsVar *valuesVar) {
+  Pin pins[JSH_PWM_HARDWARE_MAX];
+  JsVarFloat values[JSH_PWM_HARDWARE_MAX];
+  if (!jsvIsArray(pinsVar) || !jsvIsIterable(valuesVar)) {
+    jsExceptionHere(JSET_ERROR, "Expecting arrays of pins and values");
+    return;
+  }
+  int count = 0;
+  JsvIterator vit;
+  jsvIteratorNew(&vit, valuesVar);
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, pinsVar);
+  while (jsvObjectIteratorHasValue(&it) && jsvIteratorHasElement(&vit) && count<JSH_PWM_HARDWARE_MAX) {
+    pins[count] = jshGetPinFromVarAndUnLock(jsvObjectIteratorGetValue(&it));
+    values[count] = jsvIteratorGetFloatValue(&vit);
+    count++;
+    jsvObjectIteratorNext(&it);
+    jsvIteratorNext(&vit);
+  }
+  jsvObjectIteratorFree(&it);
+  jsvIteratorFree(&vit);
+  jshPWMHardwareWrite(pins, values, count);
+}
+
+//===== ESP8266.analogReadBurst
+
+/*JSON{
+ "type"     : "staticmethod",
+ "class"    : "ESP8266",
+ "name"     : "analogReadBurst",
+ "generate" : "jswrap_ESP8266_analogReadBurst",
+ "params"   : [
+   ["count", "int", "The number of samples to take (1..65535)"],
+   ["clkDiv", "int", "(optional) ADC clock divider, 8..32 (default 8). Higher values sample more slowly"]
+ ],
+ "return"   : ["JsVar", "A Uint16Array of 10 bit ADC readings"]
+}
+Read the ADC `count` times, as fast as the hardware allows (around 100k samples/sec with `clkDiv` 8),
+using the SDK's `system_adc_read_fast`.
+
+Interrupts are disabled while this runs, so WiFi must be turned off first (eg. with `wifi.disconnect()`
+and `wifi.stopAP()`) - an error is thrown if it isn't.
+
+For continuous sampling with WiFi on, use `Waveform.startInput` with `{repeat:true}` - on the ESP8266
+any pin reads the ADC input.
+*/
+JsVar *jswrap_ESP8266_analogReadBurst(JsVarInt count, JsVarInt clkDiv) {
+  if (count<1 || count>65535) {
+    jsExceptionHere(JSET_ERROR, "Count must be between 1 and 65535");
+    return 0;
+  }
+  if (!clkDiv) clkDiv = 8;
+  if (clkDiv<8 || clkDiv>32) {
+    jsExceptionHere(JSET_ERROR, "clkDiv must be between 8 and 32");
+    return 0;
+  }
+  if (wifi_get_opmode() != NULL_MODE) {
+    jsExceptionHere(JSET_ERROR, "WiFi must be off for burst ADC reads");
+    return 0;
+  }
+  char *ptr = 0;
+  JsVar *buf = jsvNewArrayBufferWithPtr((unsigned int)count*2, &ptr);
+  if (!buf) {
+    jsExceptionHere(JSET_ERROR, "Not enough memory for %d samples", (int)count);
+    return 0;
+  }
+  system_adc_read_fast((uint16 *)ptr, (uint16)count, (uint8)clkDiv);
+  JsVar *arr = jswrap_typedarray_constructor(ARRAYBUFFERVIEW_UINT16, buf, 0, 0);
+  jsvUnLock(buf);
+  return arr;
+}
+
 //===== ESP8266.deepSleep
+
+// Variables are kept over deep sleep in RTC RAM between RTC_WAKE_ADDR and RTC_WIFI_ADDR (see ESP8266_board.h)
+#define RTC_WAKE_MAGIC 0x57414B45
+#define RTC_WAKE_DATA_LEN ((RTC_WIFI_ADDR - RTC_WAKE_ADDR)*4 - 12)
+
+// Variables kept in RTC RAM over deep sleep, as JSON
+typedef struct {
+  uint32_t magic;
+  uint32_t len;
+  uint32_t crc;
+  char data[RTC_WAKE_DATA_LEN];
+} RtcWakeData;
+
 /*JSON{
   "type"     : "staticmethod",
   "class"    : "ESP8266",
   "name"     : "deepSleep",
   "generate" : "jswrap_ESP8266_deepSleep",
   "params"   : [
-    ["micros", "JsVar", "Number of microseconds to sleep."]
+    ["micros", "JsVar", "Number of microseconds to sleep."],
+    ["keep", "JsVar", "An optional array of the names of global variables to keep while asleep"]
   ]
 }
 Put the ESP8266 into 'deep sleep' for the given number of microseconds,
@@ -441,13 +743,373 @@ reducing power consumption drastically.
 deep sleep actually turns off the processor. After the given number of
 microseconds have elapsed, the ESP8266 will restart as if power had been
 turned off and then back on. *All contents of RAM will be lost*.
+
+If an array of global variable names is given, those variables are kept in
+RTC memory (as JSON, so they can only contain simple values, and around 430
+bytes in total). When the ESP8266 wakes, it then doesn't load the state
+saved with `save()`, which is slow. Instead only boot code (see `E.setBootCode`)
+is executed, the variables are restored, and an `E.on('wake', ...)` event is
+emitted:
+
+```
+E.setBootCode("E.on('wake', function(vars) { count++; ESP8266.deepSleep(60000000, ['count']); });");
+var count = 0;
+ESP8266.deepSleep(60000000, ['count']);
+```
+
+Timers and other variables aren't kept, so the boot code must set up
+anything else that is needed.
 */
-void   jswrap_ESP8266_deepSleep(JsVar *jsMicros) {
+void   jswrap_ESP8266_deepSleep(JsVar *jsMicros, JsVar *jsKeep) {
   if (!jsvIsInt(jsMicros)) {
     jsExceptionHere(JSET_ERROR, "Invalid microseconds.");
     return;
   }
   int sleepTime = jsvGetInteger(jsMicros);
+  if (jsvIsArray(jsKeep)) {
+    JsVar *vars = jsvNewObject();
+    if (!vars) return;
+    JsvObjectIterator it;
+    jsvObjectIteratorNew(&it, jsKeep);
+    while (jsvObjectIteratorHasValue(&it)) {
+      JsVar *name = jsvAsString(jsvObjectIteratorGetValue(&it), true);
+      JsVar *value = jsvSkipNameAndUnLock(jsvFindChildFromVar(execInfo.root, name, false));
+      JsVar *keptName = jsvFindChildFromVar(vars, name, true);
+      if (keptName) jsvSetValueOfName(keptName, value);
+      jsvUnLock3(keptName, value, name);
+      jsvObjectIteratorNext(&it);
+    }
+    jsvObjectIteratorFree(&it);
+    JsVar *json = jswrap_json_stringify(vars);
+    jsvUnLock(vars);
+    RtcWakeData wake;
+    wake.len = json ? (uint32_t)jsvGetStringLength(json) : 0;
+    if (!json || wake.len >= RTC_WAKE_DATA_LEN) { // jsvGetStringChars needs room for a trailing 0
+      jsvUnLock(json);
+      jsExceptionHere(JSET_ERROR, "Variables too big to keep in RTC memory (%d bytes max)", RTC_WAKE_DATA_LEN-1);
+      return;
+    }
+    jsvGetStringChars(json, 0, wake.data, wake.len);
+    jsvUnLock(json);
+    wake.magic = RTC_WAKE_MAGIC;
+    wake.crc = crc32((uint8_t*)wake.data, wake.len);
+    system_rtc_mem_write(RTC_WAKE_ADDR, &wake, (12 + wake.len + 3) & ~3);
+  } else if (!jsvIsUndefined(jsKeep)) {
+    jsExceptionHere(JSET_ERROR, "Expecting an array of variable names, got %t", jsKeep);
+    return;
+  }
   system_deep_sleep(sleepTime);
 }
 
+/*JSON{
+  "type"  : "event",
+  "class" : "E",
+  "name"  : "wake",
+  "params" : [
+    ["vars", "JsVar", "An object containing the variables that were kept"]
+  ]
+}
+Called on the ESP8266 after waking from `ESP8266.deepSleep` when variables were
+kept in RTC memory. Only boot code is executed in this case, so the handler
+should be added with `E.setBootCode`.
+*/
+
+/**
+ * Returns true if we have just woken from deep sleep with variables kept in RTC
+ * memory by ESP8266.deepSleep, in which case the saved state needn't be loaded.
+ */
+bool jswrap_ESP8266_hasWakeData() {
+  if (system_get_rst_info()->reason != 5 /* deep sleep */) return false;
+  RtcWakeData wake;
+  system_rtc_mem_read(RTC_WAKE_ADDR, &wake, 12);
+  if (wake.magic != RTC_WAKE_MAGIC || wake.len > RTC_WAKE_DATA_LEN) return false;
+  system_rtc_mem_read(RTC_WAKE_ADDR, &wake, (12 + wake.len + 3) & ~3);
+  return wake.crc == crc32((uint8_t*)wake.data, wake.len);
+}
+
+/**
+ * Restore the variables kept by ESP8266.deepSleep and emit E.on('wake'). This
+ * should be called after initialisation, when boot code has been executed.
+ */
+void jswrap_ESP8266_wake() {
+  RtcWakeData wake;
+  system_rtc_mem_read(RTC_WAKE_ADDR, &wake, sizeof(wake));
+  // only use the data once - if we're reset, boot normally
+  uint32_t magic = 0;
+  system_rtc_mem_write(RTC_WAKE_ADDR, &magic, 4);
+  if (wake.magic != RTC_WAKE_MAGIC || wake.len > RTC_WAKE_DATA_LEN) return;
+
+  JsVar *json = jsvNewFromEmptyString();
+  if (!json) return;
+  jsvAppendStringBuf(json, wake.data, wake.len);
+  JsVar *vars = jswrap_json_parse(json);
+  jsvUnLock(json);
+  if (jsvIsObject(vars)) {
+    JsvObjectIterator it;
+    jsvObjectIteratorNew(&it, vars);
+    while (jsvObjectIteratorHasValue(&it)) {
+      JsVar *name = jsvObjectIteratorGetKey(&it);
+      JsVar *value = jsvObjectIteratorGetValue(&it);
+      JsVar *rootName = jsvFindChildFromVar(execInfo.root, name, true);
+      if (rootName) jsvSetValueOfName(rootName, value);
+      jsvUnLock3(rootName, value, name);
+      jsvObjectIteratorNext(&it);
+    }
+    jsvObjectIteratorFree(&it);
+    JsVar *E = jsvObjectGetChild(execInfo.root, "E", 0);
+    if (E) jsiQueueObjectCallbacks(E, JS_EVENT_PREFIX"wake", &vars, 1);
+    jsvUnLock(E);
+  }
+  jsvUnLock(vars);
+}
+
+
+
+//===== ESP8266.updateFrom
+
+// State of an update that is being downloaded, in hiddenRoot
+#define OTA_PULL_NAME JS_HIDDEN_CHAR_STR"ota"
+// How many times we'll reconnect without getting any more data before giving up
+#define OTA_PULL_RETRIES 5
+
+static sha256_ctx otaPullSha;
+static char *otaPullError; ///< set if writing the data we received failed
+
+static void otaPullRequest();
+
+/// Give up on (or finish) an update, calling back with the error (or null)
+static void otaPullDone(JsVar *state, const char *err) {
+  otaWriteAbort();
+  JsVar *callback = jsvObjectGetChild(state, "cb", 0);
+  jsvRemoveNamedChild(execInfo.hiddenRoot, OTA_PULL_NAME);
+  if (err) os_printf("OTA: %s\n", err);
+  if (callback) {
+    JsVar *arg = err ? jsvNewFromString(err) : jsvNewNull();
+    jsiQueueEvents(0, callback, &arg, 1);
+    jsvUnLock(arg);
+  }
+  jsvUnLock(callback);
+}
+
+/// Get the integer value of a response header, which may have been sent in lower case
+static JsVarInt otaPullGetHeader(JsVar *res, const char *name, const char *lowerName, int skip) {
+  JsVar *headers = jsvObjectGetChild(res, "headers", 0);
+  JsVar *v = jsvObjectGetChild(headers, name, 0);
+  if (!v) v = jsvObjectGetChild(headers, lowerName, 0);
+  jsvUnLock(headers);
+  char buf[40];
+  jsvGetString(v, buf, sizeof(buf));
+  jsvUnLock(v);
+  if ((int)strlen(buf) < skip) return -1;
+  return stringToInt(&buf[skip]);
+}
+
+static void otaPullDataCb(const unsigned char *data, size_t len, void *userData) {
+  NOT_USED(userData);
+  if (otaPullError) return;
+  sha256_update(&otaPullSha, data, (unsigned int)len);
+  otaPullError = otaWriteData((uint8_t*)data, (uint32_t)len);
+}
+
+static void otaPullData(JsVar *data) {
+  JsVar *state = jsvObjectGetChild(execInfo.hiddenRoot, OTA_PULL_NAME, 0);
+  if (!state) return;
+  otaPullError = NULL;
+  jsvIterateBufferCallback(data, otaPullDataCb, 0);
+  if (otaPullError) {
+    otaPullDone(state, otaPullError);
+  } else {
+    JsVarInt pos = jsvGetIntegerAndUnLock(jsvObjectGetChild(state, "pos", 0)) + (JsVarInt)jsvGetLength(data);
+    jsvObjectSetChildAndUnLock(state, "pos", jsvNewFromInteger(pos));
+    jsvObjectSetChildAndUnLock(state, "tries", jsvNewFromInteger(0)); // we're getting somewhere
+  }
+  jsvUnLock(state);
+}
+
+/// Check the downloaded image and switch to it. Returns an error string or NULL
+static const char *otaPullFinish(JsVar *state) {
+  const char *err = otaWriteEnd();
+  if (err) return err;
+  JsVar *expected = jsvObjectGetChild(state, "sha256", 0);
+  if (expected) {
+    char want[SHA256_DIGEST_SIZE+1]; // +1 for jsvGetStringChars' trailing 0
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    jsvGetStringChars(expected, 0, want, SHA256_DIGEST_SIZE);
+    jsvUnLock(expected);
+    sha256_final(&otaPullSha, digest);
+    if (memcmp(want, digest, SHA256_DIGEST_SIZE)) return "SHA256 doesn't match";
+  }
+  return otaSwitchPartition(jsvGetBoolAndUnLock(jsvObjectGetChild(state, "reboot", 0)));
+}
+
+/// The connection closed (or failed) - finish if we have everything, else try again from where we got to
+static void otaPullClose() {
+  JsVar *state = jsvObjectGetChild(execInfo.hiddenRoot, OTA_PULL_NAME, 0);
+  if (!state) return;
+  // a failed request may give us both 'error' and 'close'
+  if (jsvGetBoolAndUnLock(jsvObjectGetChild(state, "req", 0))) {
+    jsvObjectSetChildAndUnLock(state, "req", jsvNewFromBool(false));
+    JsVarInt pos = jsvGetIntegerAndUnLock(jsvObjectGetChild(state, "pos", 0));
+    JsVarInt len = jsvGetIntegerAndUnLock(jsvObjectGetChild(state, "len", 0));
+    JsVarInt tries = jsvGetIntegerAndUnLock(jsvObjectGetChild(state, "tries", 0)) + 1;
+    if (len && pos >= len) {
+      otaPullDone(state, otaPullFinish(state));
+    } else if (tries > OTA_PULL_RETRIES) {
+      otaPullDone(state, "Download failed");
+    } else {
+      os_printf("OTA: reconnecting at %d of %d\n", (int)pos, (int)len);
+      jsvObjectSetChildAndUnLock(state, "tries", jsvNewFromInteger(tries));
+      JsVar *fn = jsvNewNativeFunction((void (*)(void))otaPullRequest, JSWAT_VOID);
+      jsvUnLock2(jswrap_interface_setTimeout(fn, 1000.0*(JsVarFloat)tries, 0), fn);
+    }
+  }
+  jsvUnLock(state);
+}
+
+static void otaPullResponse(JsVar *res) {
+  JsVar *state = jsvObjectGetChild(execInfo.hiddenRoot, OTA_PULL_NAME, 0);
+  if (!state) return;
+  JsVarInt pos = jsvGetIntegerAndUnLock(jsvObjectGetChild(state, "pos", 0));
+  JsVarInt status = jsvGetIntegerAndUnLock(jsvObjectGetChild(res, "statusCode", 0));
+  const char *err = NULL;
+  if (status == 200 && pos) {
+    // the server ignored our Range header, so start again
+    otaWriteAbort();
+    pos = 0;
+    jsvObjectSetChildAndUnLock(state, "pos", jsvNewFromInteger(0));
+  }
+  if (status == 206) {
+    // Content-Range: bytes start-end/total
+    if (otaPullGetHeader(res, "Content-Range", "content-range", 6) != pos)
+      err = "Server sent the wrong range";
+  } else if (status != 200) {
+    err = "HTTP error";
+  }
+  if (!err && !pos) {
+    JsVarInt len = otaPullGetHeader(res, "Content-Length", "content-length", 0);
+    if (len <= 0) err = "No Content-Length";
+    else err = otaWriteBegin((uint32_t)len);
+    jsvObjectSetChildAndUnLock(state, "len", jsvNewFromInteger(len));
+    sha256_init(&otaPullSha);
+  }
+  if (err) {
+    otaPullDone(state, err);
+  } else {
+    jswrap_object_addEventListener(res, "data", (void (*)(void))otaPullData, JSWAT_VOID|(JSWAT_JSVAR<<JSWAT_BITS));
+    jswrap_object_addEventListener(res, "close", (void (*)(void))otaPullClose, JSWAT_VOID);
+  }
+  jsvUnLock(state);
+}
+
+/// Request the image, from where we got to
+static void otaPullRequest() {
+  JsVar *state = jsvObjectGetChild(execInfo.hiddenRoot, OTA_PULL_NAME, 0);
+  if (!state) return;
+  JsVar *options = jsvObjectGetChild(state, "opt", 0);
+  JsVarInt pos = jsvGetIntegerAndUnLock(jsvObjectGetChild(state, "pos", 0));
+  JsVar *headers = jsvNewObject();
+  if (headers && pos)
+    jsvObjectSetChildAndUnLock(headers, "Range", jsvVarPrintf("bytes=%d-", (int)pos));
+  jsvObjectSetChildAndUnLock(options, "headers", headers);
+  JsVar *callback = jsvNewNativeFunction((void (*)(void))otaPullResponse, JSWAT_VOID|(JSWAT_JSVAR<<JSWAT_BITS));
+  JsVar *req = jswrap_http_get(options, callback);
+  if (req) {
+    jsvObjectSetChildAndUnLock(state, "req", jsvNewFromBool(true));
+    jswrap_object_addEventListener(req, "error", (void (*)(void))otaPullClose, JSWAT_VOID);
+  } else {
+    otaPullDone(state, "Not connected");
+  }
+  jsvUnLock3(req, callback, options);
+  jsvUnLock(state);
+}
+
+/*JSON{
+ "type"     : "staticmethod",
+ "class"    : "ESP8266",
+ "name"     : "updateFrom",
+ "generate" : "jswrap_ESP8266_updateFrom",
+ "params"   : [
+   ["url", "JsVar", "The URL to get the firmware image from"],
+   ["options", "JsVar", "(optional) An object containing options, see below"],
+   ["callback", "JsVar", "(optional) A function called with `null` when the update has worked, or an error message"]
+ ]
+}
+Download new firmware and boot into it, so devices can update themselves from a server (eg. from
+behind NAT) rather than needing something to connect to them.
+
+The image is the same `user1.bin`/`user2.bin` that `/flash/upload` accepts (or a compressed or
+delta image made by `scripts/ota_pack.py`), and must be the one for the partition we're not running
+from - see `ESP8266.getState()`. It's written to flash as it arrives. If the connection drops we
+reconnect and carry on from where we got to with an HTTP `Range` request (up to 5 times without
+any progress), so the server should support ranges. `https:` URLs need a build with TLS support.
+
+`options` can contain:
+
+* `sha256` - the SHA256 of the file as a hex string. This is worked out as the data arrives, and
+  if it doesn't match the new firmware isn't used.
+* `reboot` - (default `true`) reboot into the new firmware 2 seconds after the callback. If
+  `false`, the new firmware runs after the next reset.
+
+Only if everything has worked is the new firmware marked as the one to boot from.
+
+```
+ESP8266.updateFrom("http://example.com/user2.bin", {sha256:"a4b2..."}, function(err) {
+  if (err) console.log("Update failed: "+err);
+});
+```
+*/
+void jswrap_ESP8266_updateFrom(JsVar *url, JsVar *options, JsVar *callback) {
+  JsVar *state = jsvObjectGetChild(execInfo.hiddenRoot, OTA_PULL_NAME, 0);
+  if (state) {
+    jsvUnLock(state);
+    jsExceptionHere(JSET_ERROR, "Update already in progress");
+    return;
+  }
+  if (!jsvIsString(url)) {
+    jsExceptionHere(JSET_TYPEERROR, "Expecting a URL string, got %t", url);
+    return;
+  }
+  if (!jsvIsUndefined(options) && !jsvIsObject(options)) {
+    jsExceptionHere(JSET_TYPEERROR, "Expecting an options object, got %t", options);
+    return;
+  }
+  if (callback && !jsvIsFunction(callback)) {
+    jsExceptionHere(JSET_TYPEERROR, "Callback must be a function");
+    return;
+  }
+  // the SHA256 we want, as bytes
+  JsVar *shaVar = jsvObjectGetChild(options, "sha256", 0);
+  JsVar *sha = 0;
+  if (shaVar) {
+    char hex[SHA256_DIGEST_SIZE*2+2];
+    char digest[SHA256_DIGEST_SIZE];
+    bool ok = jsvGetString(shaVar, hex, sizeof(hex)) == SHA256_DIGEST_SIZE*2;
+    int i;
+    for (i=0;ok && i<SHA256_DIGEST_SIZE;i++) {
+      int hi = chtod(hex[i*2]), lo = chtod(hex[i*2+1]);
+      ok = hi>=0 && hi<16 && lo>=0 && lo<16;
+      digest[i] = (char)((hi<<4) | lo);
+    }
+    jsvUnLock(shaVar);
+    if (!ok) {
+      jsExceptionHere(JSET_ERROR, "sha256 should be 64 hex characters");
+      return;
+    }
+    sha = jsvNewStringOfLength(SHA256_DIGEST_SIZE);
+    if (!sha) return;
+    jsvSetString(sha, digest, SHA256_DIGEST_SIZE);
+  }
+
+  state = jsvObjectGetChild(execInfo.hiddenRoot, OTA_PULL_NAME, JSV_OBJECT);
+  if (!state) {
+    jsvUnLock(sha);
+    return;
+  }
+  jsvObjectSetChildAndUnLock(state, "opt", jswrap_url_parse(url, false));
+  if (sha) jsvObjectSetChildAndUnLock(state, "sha256", sha);
+  if (callback) jsvObjectSetChild(state, "cb", callback);
+  JsVar *reboot = jsvObjectGetChild(options, "reboot", 0);
+  jsvObjectSetChildAndUnLock(state, "reboot", jsvNewFromBool(!reboot || jsvGetBool(reboot)));
+  jsvUnLock2(reboot, state);
+  otaPullRequest();
+}
@@ -23,9 +23,12 @@
 JsVar *jswrap_ESP8266_getResetInfo();
 JsVar *jswrap_ESP8266_getState();
 void   jswrap_ESP8266_dumpSocketInfo(void);
+JsVar *jswrap_ESP8266_getNetStats(void);
 void   jswrap_ESP8266_ping(JsVar *jsIpAddr, JsVar *jsPingCallback);
 void   jswrap_ESP8266_reboot();
 void   jswrap_ESP8266_setCPUFreq(JsVar *jsFreq);
+void   jswrap_ESP8266_setCPUGovernor(JsVarInt idleMs);
+void   jswrap_ESP8266_setLoopPolicy(JsVar *options);
 JsVar *jswrap_ESP8266_crc32(JsVar *jsData);
 JsVar *jswrap_ESP8266_getFreeFlash();
 
@@ -37,10 +40,18 @@ void   jswrap_ESP8266_wifi_pre_init();
 void   jswrap_ESP8266_wifi_init();
 void   jswrap_ESP8266_wifi_reset();
 
-void   jswrap_ESP8266_neopixelWrite(Pin pin, JsVar *jsArrayOfData);
+void   jswrap_ESP8266_neopixelWrite(Pin pin, JsVar *jsArrayOfData, JsVar *callback);
+bool   jswrap_ESP8266_idle();
+JsVar *jswrap_ESP8266_analogReadBurst(JsVarInt count, JsVarInt clkDiv);
+void   jswrap_ESP8266_pwmSetup(JsVar *pinsVar, JsVarFloat freq);
+void   jswrap_ESP8266_pwmWrite(JsVar *pinsVar, JsVar *valuesVar);
 
 uint32_t crc32(uint8_t *buf, uint32_t len);
 
-void   jswrap_ESP8266_deepSleep(JsVar *jsMicros);
+void   jswrap_ESP8266_updateFrom(JsVar *url, JsVar *options, JsVar *callback);
+
+void   jswrap_ESP8266_deepSleep(JsVar *jsMicros, JsVar *jsKeep);
+bool   jswrap_ESP8266_hasWakeData();
+void   jswrap_ESP8266_wake();
 
 #endif /* TARGETS_ESP8266_JSWRAP_ESP8266_H_ */
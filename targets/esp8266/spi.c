@@ -226,3 +226,142 @@ spi_transaction(uint8 spi_no, uint32 bits, uint32 dout_data)
                                // Note existing contents of SPI_W0 remain unless overwritten!
   }
 }
+
+// spi_block_start -- load up to SPI_TRANSFER_MAX bytes into W0..W15 and start sending them
+// The byte order bits are cleared, so bytes go out of (and come into) W0..W15 lowest
+// address first. Returns the byte order bits that were set before.
+static uint32 CALLED_FROM_INTERRUPT
+spi_block_start(uint8 spi_no, const uint8 *dout, uint32 len)
+{
+  uint32 byte_order = READ_PERI_REG(SPI_USER(spi_no)) & (SPI_WR_BYTE_ORDER|SPI_RD_BYTE_ORDER);
+  CLEAR_PERI_REG_MASK(SPI_USER(spi_no),
+      SPI_FLASH_MODE|SPI_USR_MOSI|SPI_USR_MISO|SPI_USR_COMMAND|SPI_USR_ADDR|SPI_USR_DUMMY|
+      SPI_WR_BYTE_ORDER|SPI_RD_BYTE_ORDER);
+  SET_PERI_REG_MASK(SPI_USER(spi_no),
+      SPI_USR_MOSI|SPI_DOUTDIN|SPI_CK_I_EDGE); // make sure we get out & in full-duplex
+
+  uint32 bits = len*8;
+  WRITE_PERI_REG(SPI_USER1(spi_no),
+      ((bits-1)&SPI_USR_MOSI_BITLEN)<<SPI_USR_MOSI_BITLEN_S |
+      ((bits-1)&SPI_USR_MISO_BITLEN)<<SPI_USR_MISO_BITLEN_S);
+
+  // copy data into W0..W15 a word at a time (dout may not be word aligned)
+  uint32 i, j;
+  for (i=0; i<len; i+=4) {
+    uint32 word = 0;
+    for (j=0; j<4 && i+j<len; j++)
+      word |= (uint32)dout[i+j] << (j*8);
+    WRITE_PERI_REG(SPI_W0(spi_no)+i, word);
+  }
+
+  SET_PERI_REG_MASK(SPI_CMD(spi_no), SPI_USR);
+  return byte_order;
+}
+
+// spi_block_read -- copy the bytes received by the last block out of W0..W15
+static void CALLED_FROM_INTERRUPT
+spi_block_read(uint8 spi_no, uint8 *din, uint32 len)
+{
+  uint32 i, j;
+  for (i=0; i<len; i+=4) {
+    uint32 word = READ_PERI_REG(SPI_W0(spi_no)+i);
+    for (j=0; j<4 && i+j<len; j++)
+      din[i+j] = (uint8)(word >> (j*8));
+  }
+}
+
+// spi_transfer -- send (and receive) a block of bytes in one SPI transaction
+//
+// Parameters:
+//   spi_no - SPI (0) or HSPI (1)
+//   dout - bytes to send, in order
+//   din - buffer for the bytes received, or NULL
+//   len - number of bytes, up to SPI_TRANSFER_MAX
+void
+spi_transfer(uint8 spi_no, const uint8 *dout, uint8 *din, uint32 len)
+{
+  if(spi_no > 1 || len == 0 || len > SPI_TRANSFER_MAX) return;
+
+  while(spi_busy(spi_no)); //wait for SPI to be ready
+  uint32 byte_order = spi_block_start(spi_no, dout, len);
+  while(spi_busy(spi_no)); //wait for SPI transaction to complete
+  if (din) spi_block_read(spi_no, din, len);
+
+  SET_PERI_REG_MASK(SPI_USER(spi_no), byte_order); // back to what spi_transaction expects
+}
+
+// Asynchronous HSPI transfers - each block is started from the 'transaction done'
+// interrupt of the one before, so the CPU is free while the data goes out.
+static struct {
+  const uint8 *dout;
+  uint8 *din;
+  uint32 len;           // bytes left, including the block being sent
+  uint32 byte_order;    // byte order bits to restore when finished
+  void (*callback)(void);
+  volatile bool busy;
+} spi_async;
+
+static void CALLED_FROM_INTERRUPT
+spi_async_intr_handler(void *arg)
+{
+  if (!(READ_PERI_REG(SPI_INTR_STATUS) & SPI_INTR_HSPI)) return;
+  CLEAR_PERI_REG_MASK(SPI_SLAVE(HSPI), SPI_TRANS_DONE);
+  if (!spi_async.busy) return;
+
+  uint32 n = spi_async.len > SPI_TRANSFER_MAX ? SPI_TRANSFER_MAX : spi_async.len;
+  if (spi_async.din) {
+    spi_block_read(HSPI, spi_async.din, n);
+    spi_async.din += n;
+  }
+  spi_async.dout += n;
+  spi_async.len -= n;
+  if (spi_async.len) {
+    spi_block_start(HSPI, spi_async.dout,
+        spi_async.len > SPI_TRANSFER_MAX ? SPI_TRANSFER_MAX : spi_async.len);
+  } else {
+    CLEAR_PERI_REG_MASK(SPI_SLAVE(HSPI), SPI_TRANS_DONE_EN);
+    SET_PERI_REG_MASK(SPI_USER(HSPI), spi_async.byte_order);
+    spi_async.busy = false;
+    if (spi_async.callback) spi_async.callback();
+  }
+}
+
+// spi_transfer_async -- send (and receive) any number of bytes on HSPI in the background
+//
+// Parameters:
+//   dout - bytes to send - must stay valid until the callback
+//   din - buffer for the bytes received, or NULL
+//   len - number of bytes
+//   callback - called from the interrupt when everything has been sent
+// Returns:
+//   false if a transfer is already in progress
+bool
+spi_transfer_async(const uint8 *dout, uint8 *din, uint32 len, void (*callback)(void))
+{
+  if (spi_async.busy || len == 0) return false;
+  static bool intr_attached = false;
+  if (!intr_attached) {
+    ETS_SPI_INTR_ATTACH(spi_async_intr_handler, NULL);
+    intr_attached = true;
+  }
+
+  while(spi_busy(HSPI)); //wait for SPI to be ready
+  spi_async.dout = dout;
+  spi_async.din = din;
+  spi_async.len = len;
+  spi_async.callback = callback;
+  spi_async.busy = true;
+  CLEAR_PERI_REG_MASK(SPI_SLAVE(HSPI), SPI_TRANS_DONE);
+  SET_PERI_REG_MASK(SPI_SLAVE(HSPI), SPI_TRANS_DONE_EN);
+  ETS_SPI_INTR_ENABLE();
+  spi_async.byte_order = spi_block_start(HSPI, dout,
+      len > SPI_TRANSFER_MAX ? SPI_TRANSFER_MAX : len);
+  return true;
+}
+
+// spi_transfer_async_busy -- is an asynchronous transfer still in progress?
+bool
+spi_transfer_async_busy(void)
+{
+  return spi_async.busy;
+}
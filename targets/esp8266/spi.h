@@ -24,6 +24,26 @@
 
 void spi_init(uint8 spi_no, uint32 baud_rate);
 uint32 spi_transaction(uint8 spi_no, uint32 bits, uint32 dout_data);
+void spi_transfer(uint8 spi_no, const uint8 *dout, uint8 *din, uint32 len);
+
+bool spi_transfer_async(const uint8 *dout, uint8 *din, uint32 len, void (*callback)(void));
+bool spi_transfer_async_busy(void);
+
+#define SPI_TRANSFER_MAX 64 // bytes that fit in the SPI_W0..W15 registers
+
+// Put code run from the SPI interrupt in RAM, as in jsutils.h
+#ifndef CALLED_FROM_INTERRUPT
+#define CALLED_FROM_INTERRUPT __attribute__((section(".iram1.text")))
+#endif
+
+// The SPI interrupt is shared between SPI, HSPI and I2S - this says which it was for
+#define SPI_INTR_STATUS 0x3ff00020
+#define SPI_INTR_HSPI   BIT7
+
+#ifndef ETS_SPI_INTR_ATTACH
+#define ETS_SPI_INTR_ATTACH(func, arg) ets_isr_attach(ETS_SPI_INUM, (func), (void *)(arg))
+#define ETS_SPI_INTR_ENABLE() ETS_INTR_ENABLE(ETS_SPI_INUM)
+#endif
 
 #define spi_busy(spi_no) READ_PERI_REG(SPI_CMD(spi_no))&SPI_USR
 
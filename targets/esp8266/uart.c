@@ -32,21 +32,66 @@ extern UartDevice    UartDev;
 LOCAL struct UartBuffer* pTxBuffer = NULL;
 LOCAL struct UartBuffer* pRxBuffer = NULL;
 
-#define MAX_RX_BUFFER 500
-static char rxBuffer[MAX_RX_BUFFER];
+/* Received data waits in this ring buffer until Espruino's event queue has
+ * room for it. The size, and the RX FIFO threshold and timeout that decide
+ * when we get an interrupt, can be set with uart_rx_setup. */
+static char *rxBuffer = NULL;
+static int rxBufferSize = 0;
+static int rxBufferStart = 0;
 static int rxBufferLen = 0;
+static bool rxBufferOverflowed = false;
+static uint8 rxFifoThreshold = RX_FIFO_THRESHOLD_DEFAULT;
+static uint8 rxFifoTimeout = RX_FIFO_TIMEOUT_DEFAULT;
 
+/**
+ * Set up receive buffering for UART0. Any value that is 0 is set to the default.
+ * Takes effect when uart_config is next called.
+ */
+void ICACHE_FLASH_ATTR uart_rx_setup(
+    int bufferSize, //!< Bytes of received data to buffer while Espruino's event queue is full
+    int threshold,  //!< Interrupt when the RX FIFO has this many bytes in (1..127)
+    int timeout     //!< Interrupt when no data has been received for this many character times (1..127)
+) {
+  if (bufferSize <= 0) bufferSize = RX_BUFFER_DEFAULT;
+  if (threshold <= 0 || threshold > UART_RXFIFO_FULL_THRHD) threshold = RX_FIFO_THRESHOLD_DEFAULT;
+  if (timeout <= 0 || timeout > UART_RX_TOUT_THRHD) timeout = RX_FIFO_TIMEOUT_DEFAULT;
+  rxFifoThreshold = (uint8)threshold;
+  rxFifoTimeout = (uint8)timeout;
+  if (bufferSize != rxBufferSize) {
+    ETS_UART_INTR_DISABLE();
+    char *oldBuffer = rxBuffer;
+    rxBuffer = (char *)os_malloc(bufferSize);
+    if (!rxBuffer) rxBuffer = (char *)os_malloc(bufferSize = RX_BUFFER_DEFAULT);
+    rxBufferSize = rxBuffer ? bufferSize : 0;
+    rxBufferStart = 0;
+    rxBufferLen = 0;
+    ETS_UART_INTR_ENABLE();
+    if (oldBuffer) os_free(oldBuffer);
+  }
+}
+
+/**
+ * Take up to bufferLen bytes of received data.
+ * Returns the number of bytes copied to pBuffer.
+ */
 int getRXBuffer(char *pBuffer, int bufferLen) {
-  if (rxBufferLen > bufferLen) {
-    memcpy(pBuffer,rxBuffer, bufferLen);
-    memcpy(rxBuffer, rxBuffer+bufferLen, rxBufferLen-bufferLen);
-    rxBufferLen = rxBufferLen - bufferLen;
-    return bufferLen;
+  if (bufferLen > rxBufferLen) bufferLen = rxBufferLen;
+  int i;
+  for (i=0; i<bufferLen; i++) {
+    pBuffer[i] = rxBuffer[rxBufferStart];
+    if (++rxBufferStart >= rxBufferSize) rxBufferStart = 0;
   }
-  int sizeReturned = rxBufferLen;
-  memcpy(pBuffer, rxBuffer, rxBufferLen);
-  rxBufferLen = 0;
-  return sizeReturned;
+  rxBufferLen -= bufferLen;
+  return bufferLen;
+}
+
+/**
+ * Has received data been lost because the buffer was full, since we last asked?
+ */
+bool uart_rx_overflowed() {
+  bool overflowed = rxBufferOverflowed;
+  rxBufferOverflowed = false;
+  return overflowed;
 }
 
 /*uart demo with a system task, to output what uart receives*/
@@ -102,12 +147,12 @@ uart_config(uint8 uart_no)
     if (uart_no == UART0){
         //set rx fifo trigger
         WRITE_PERI_REG(UART_CONF1(uart_no),
-        ((100 & UART_RXFIFO_FULL_THRHD) << UART_RXFIFO_FULL_THRHD_S) |
+        ((rxFifoThreshold & UART_RXFIFO_FULL_THRHD) << UART_RXFIFO_FULL_THRHD_S) |
         #if UART_HW_RTS
         ((110 & UART_RX_FLOW_THRHD) << UART_RX_FLOW_THRHD_S) |
         UART_RX_FLOW_EN |   //enbale rx flow control
         #endif
-        (0x02 & UART_RX_TOUT_THRHD) << UART_RX_TOUT_THRHD_S |
+        (rxFifoTimeout & UART_RX_TOUT_THRHD) << UART_RX_TOUT_THRHD_S |
         UART_RX_TOUT_EN|
         ((0x10 & UART_TXFIFO_EMPTY_THRHD)<<UART_TXFIFO_EMPTY_THRHD_S));//wjl
         #if UART_HW_CTS
@@ -115,7 +160,8 @@ uart_config(uint8 uart_no)
         #endif
         SET_PERI_REG_MASK(UART_INT_ENA(uart_no), UART_RXFIFO_TOUT_INT_ENA |UART_FRM_ERR_INT_ENA);
     }else{
-        WRITE_PERI_REG(UART_CONF1(uart_no),((UartDev.rcv_buff.TrigLvl & UART_RXFIFO_FULL_THRHD) << UART_RXFIFO_FULL_THRHD_S));//TrigLvl default val == 1
+        WRITE_PERI_REG(UART_CONF1(uart_no),((UartDev.rcv_buff.TrigLvl & UART_RXFIFO_FULL_THRHD) << UART_RXFIFO_FULL_THRHD_S) |//TrigLvl default val == 1
+        ((UART_TX_EMPTY_THRESH_VAL & UART_TXFIFO_EMPTY_THRHD)<<UART_TXFIFO_EMPTY_THRHD_S));
     }
     //clear all interrupt
     WRITE_PERI_REG(UART_INT_CLR(uart_no), 0xffff);
@@ -248,6 +294,12 @@ uart0_rx_intr_handler(void *para)
     uint8 temp,cnt;
     //RcvMsgBuff *pRxBuff = (RcvMsgBuff *)para;
 
+    // UART1 only transmits, so the TX FIFO empty interrupt is the only one we use for it
+    if(UART_TXFIFO_EMPTY_INT_ST == (READ_PERI_REG(UART_INT_ST(UART1)) & UART_TXFIFO_EMPTY_INT_ST)){
+        esp8266_uartTransmit(UART1);
+        WRITE_PERI_REG(UART_INT_CLR(UART1), UART_TXFIFO_EMPTY_INT_CLR);
+    }
+
       /*ATTENTION:*/
   /*IN NON-OS VERSION SDK, DO NOT USE "ICACHE_FLASH_ATTR" FUNCTIONS IN THE WHOLE HANDLER PROCESS*/
   /*ALL THE FUNCTIONS CALLED IN INTERRUPT HANDLER MUST BE DECLARED IN RAM */
@@ -279,6 +331,9 @@ uart0_rx_intr_handler(void *para)
   CLEAR_PERI_REG_MASK(UART_INT_ENA(UART0), UART_TXFIFO_EMPTY_INT_ENA);
   #if UART_BUFF_EN
     tx_start_uart_buffer(UART0);
+  #else
+    // refill the FIFO from txBuffer - this re-enables the interrupt if there's more
+    esp8266_uartTransmit(UART0);
   #endif
         //system_os_post(uart_recvTaskPrio, 1, 0);
         WRITE_PERI_REG(UART_INT_CLR(uart_no), UART_TXFIFO_EMPTY_INT_CLR);
@@ -319,13 +374,18 @@ uart_recvTask(os_event_t *events)
         uint8 fifo_len = (READ_PERI_REG(UART_STATUS(UART0))>>UART_RXFIFO_CNT_S)&UART_RXFIFO_CNT;
         uint8 d_tmp = 0;
         uint8 idx=0;
+        int end = rxBufferStart + rxBufferLen;
+        if (end >= rxBufferSize) end -= rxBufferSize;
         for(idx=0;idx<fifo_len;idx++) {
             d_tmp = READ_PERI_REG(UART_FIFO(UART0)) & 0xFF;
             // Uncomment the following line to local echo
             //uart_tx_one_char(UART0, d_tmp);
-            if (rxBufferLen < MAX_RX_BUFFER) {
-              rxBuffer[rxBufferLen] = d_tmp;
+            if (rxBufferLen < rxBufferSize) {
+              rxBuffer[end] = d_tmp;
+              if (++end >= rxBufferSize) end = 0;
               rxBufferLen++;
+            } else {
+              rxBufferOverflowed = true;
             }
         }
         if (fifo_len > 0) {
@@ -350,6 +410,7 @@ uart_init(UartBautRate uart0_br, UartBautRate uart1_br)
     /*this is a example to process uart data from task,please change the priority to fit your application task if exists*/
     system_os_task(uart_recvTask, uart_recvTaskPrio, uart_recvTaskQueue, uart_recvTaskQueueLen);  //demo with a task to process the uart data
 
+    uart_rx_setup(0, 0, 0);
     UartDev.baut_rate = uart0_br;
     uart_config(UART0);
     UartDev.baut_rate = uart1_br;
@@ -25,7 +25,13 @@
 #include "c_types.h"
 
 
+#define RX_BUFFER_DEFAULT         512 // bytes of received data we can hold while Espruino is busy
+#define RX_FIFO_THRESHOLD_DEFAULT 100 // interrupt when the RX FIFO has this many bytes in
+#define RX_FIFO_TIMEOUT_DEFAULT   2   // or when nothing has been received for this many character times
+
+void uart_rx_setup(int bufferSize, int threshold, int timeout);
 int getRXBuffer(char *pBuffer, int bufferLen);
+bool uart_rx_overflowed();
 //int uart_rx_discard();
 
 
@@ -188,6 +194,7 @@ typedef enum {
 
 //void ICACHE_FLASH_ATTR uart_test_rx();
 STATUS uart_tx_one_char(uint8 uart, uint8 TxChar);
+void esp8266_uartTransmit(uint8 uart_no); // in jshardware.c - fill the TX FIFO from txBuffer
 static STATUS uart_tx_one_char_no_wait(uint8 uart, uint8 TxChar);
 static void  uart1_sendStr_no_wait(const char *str);
 struct UartBuffer*  Uart_Buf_Init();
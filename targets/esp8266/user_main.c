@@ -26,8 +26,10 @@ typedef long long int64_t;
 #include <jsdevices.h>
 #include <jsinteractive.h>
 #include <jswrap_esp8266_network.h>
+#include <network_esp8266.h>
 #include <jswrap_esp8266.h>
 #include <ota.h>
+#include <esp8266_board_utils.h>
 #include <log.h>
 #include "ESP8266_board.h"
 
@@ -52,6 +54,36 @@ static bool suspendMainLoopFlag = false;
 // Time structure for main loop time suspension.
 static os_timer_t mainLoopSuspendTimer;
 
+// How long jshSleep asked for the main loop to be suspended after this iteration (ms).
+static uint32 mainLoopSleepInterval = 0;
+
+// Flag indicating the main loop is suspended because of jshSleep, and may be woken early.
+static volatile bool mainLoopSleeping = false;
+
+// How long the main loop may keep running jsiLoop while there are events (us, 0 = once per task).
+static uint32 mainLoopMaxRunUs = 0;
+
+// How long to give the SDK after a busy main loop before running again (us).
+static uint32 mainLoopMinYieldUs = 0;
+
+// How long we must be idle before the CPU governor drops to 80MHz (ms, 0 = governor off).
+static uint32 governorIdleMs = 0;
+
+// When the CPU governor last saw Espruino busy (system_get_time).
+static uint32 governorLastBusy = 0;
+
+// How long until the next JS timer, as passed to jshSleep before it was capped (ms, 0 = busy).
+static uint32 mainLoopTimeUntilNext = 0;
+
+// Whether the power manager picks the WiFi sleep type (Wifi.setConfig's powersave:'auto').
+static bool powerManagerOn = false;
+
+// When the power manager last saw Espruino or the network busy (system_get_time).
+static uint32 powerLastBusy = 0;
+
+// Whether the power manager has put the radio in forced sleep because WiFi is off.
+static bool powerRadioOff = false;
+
 // --- Globals
 
 uint16_t espFlashKB; // KB of flash (512, 1024, 2048, 4096)
@@ -153,9 +185,151 @@ void suspendMainLoop(
  */
 static void enableMainLoop() {
   suspendMainLoopFlag = false;
+  mainLoopSleeping = false;
   queueTaskMainLoop();
 }
 
+
+/**
+ * Called from jshSleep to ask for the main loop not to be run again
+ * until the given time has passed (or esp8266_wakeMainLoop is called).
+ */
+void esp8266_sleepMainLoop(
+    uint32 interval //!< sleep interval in milliseconds
+  ) {
+  mainLoopTimeUntilNext = interval;
+  if (interval > MAINLOOP_MAX_SLEEP_MS) interval = MAINLOOP_MAX_SLEEP_MS;
+  mainLoopSleepInterval = interval;
+}
+
+
+/**
+ * Set how the main loop trades latency for throughput.
+ * With a maxRunUs, jsiLoop is called repeatedly while there are events to
+ * handle, until the time would exceed maxRunUs. minYieldUs is how long
+ * to leave the SDK to itself afterwards if jsiLoop still has work to do.
+ */
+void esp8266_setLoopPolicy(
+    uint32 maxRunUs,  //!< the longest to run back-to-back iterations for, in microseconds
+    uint32 minYieldUs //!< the least time to yield to the SDK between bursts, in microseconds
+  ) {
+  if (maxRunUs > MAINLOOP_MAX_RUN_US) maxRunUs = MAINLOOP_MAX_RUN_US;
+  if (minYieldUs > MAINLOOP_MAX_SLEEP_MS*1000) minYieldUs = MAINLOOP_MAX_SLEEP_MS*1000;
+  mainLoopMaxRunUs = maxRunUs;
+  mainLoopMinYieldUs = minYieldUs;
+}
+
+
+/**
+ * Turn the CPU frequency governor on or off.
+ * When on, the CPU runs at 160MHz while JS is executing, data is being sent
+ * or events are waiting, and drops to 80MHz once it has been idle for idleMs.
+ */
+void esp8266_setCPUGovernor(
+    uint32 idleMs //!< how long to be idle before dropping to 80MHz, or 0 to turn off
+  ) {
+  governorIdleMs = idleMs;
+  governorLastBusy = system_get_time();
+}
+
+
+/**
+ * Pick the CPU frequency based on how busy the last main loop was.
+ */
+static void cpuGovernor() {
+  if (!governorIdleMs) return;
+  uint32 now = system_get_time();
+  if (jsiGetBusy() || jshHasEvents()) {
+    governorLastBusy = now;
+    if (system_get_cpu_freq() != SYS_CPU_160MHZ)
+      system_update_cpu_freq(SYS_CPU_160MHZ);
+  } else if (system_get_cpu_freq() != SYS_CPU_80MHZ &&
+             now - governorLastBusy > governorIdleMs*1000) {
+    system_update_cpu_freq(SYS_CPU_80MHZ);
+  }
+}
+
+
+/**
+ * Turn the WiFi power manager on or off.
+ * When on, the WiFi sleep type is picked after each main loop iteration from
+ * how busy Espruino and the network are and how long it is until the next timer.
+ * When turning it off, the caller sets the sleep type it wants.
+ */
+void esp8266_setPowerManager(
+    bool on //!< true to let the power manager pick the sleep type
+  ) {
+  esp8266_powerWakeRadio();
+  powerManagerOn = on;
+  powerLastBusy = system_get_time();
+}
+
+
+bool esp8266_getPowerManager() {
+  return powerManagerOn;
+}
+
+
+/**
+ * Take the radio out of the forced sleep the power manager puts it in when
+ * WiFi is off. This must be called before turning station or AP mode on.
+ */
+void esp8266_powerWakeRadio() {
+  if (!powerRadioOff) return;
+  powerRadioOff = false;
+  wifi_fpm_do_wakeup();
+  wifi_fpm_close();
+}
+
+
+/**
+ * Pick the WiFi sleep type based on what the last main loop did:
+ * - busy (JS running, events waiting, sockets sending/receiving, or a timer
+ *   due soon): no sleep, for the lowest latency
+ * - idle, but pins are watched: modem sleep, as light sleep would suspend the
+ *   CPU and miss pin changes
+ * - idle for POWER_IDLE_MS with nothing due for POWER_LIGHT_MIN_MS: light sleep
+ * - station and AP both off: force the radio to sleep until they're turned on
+ */
+static void powerManager() {
+  if (!powerManagerOn) return;
+  uint32 now = system_get_time();
+  if (wifi_get_opmode() == NULL_MODE) {
+    if (!powerRadioOff) {
+      wifi_fpm_set_sleep_type(MODEM_SLEEP_T);
+      wifi_fpm_open();
+      if (wifi_fpm_do_sleep(0xFFFFFFF) == 0) powerRadioOff = true; // until woken
+      else wifi_fpm_close();
+    }
+    return;
+  }
+  if (!mainLoopTimeUntilNext || jsiGetBusy() || jshHasEvents() ||
+      net_ESP8266_BOARD_isBusy(POWER_IDLE_MS)) {
+    powerLastBusy = now;
+  }
+  enum sleep_type type;
+  if (now - powerLastBusy < POWER_IDLE_MS*1000 || mainLoopTimeUntilNext < POWER_MODEM_MIN_MS)
+    type = NONE_SLEEP_T;
+  else if (esp8266_getWatchedPins() || mainLoopTimeUntilNext < POWER_LIGHT_MIN_MS)
+    type = MODEM_SLEEP_T;
+  else
+    type = LIGHT_SLEEP_T;
+  if (wifi_get_sleep_type() != type)
+    wifi_set_sleep_type(type);
+}
+
+
+/**
+ * Run the main loop as soon as possible if it is sleeping because of jshSleep.
+ * Safe to call from interrupts.
+ */
+void esp8266_wakeMainLoop() {
+  if (mainLoopSleeping) {
+    mainLoopSleeping = false;
+    system_os_post(TASK_APP_QUEUE, TASK_APP_WAKE, 0);
+  }
+}
+
 /**
  * Idle callback from the SDK, triggers an idle loop iteration
  */
@@ -182,16 +356,30 @@ static void eventHandler(
   case TASK_APP_MAINLOOP:
     mainLoop();
     break;
+  // Something happened while the main loop was sleeping - run it now.
+  case TASK_APP_WAKE:
+    if (suspendMainLoopFlag) {
+      os_timer_disarm(&mainLoopSuspendTimer);
+      enableMainLoop();
+    }
+    break;
   // Handle the event to process received data.
   case TASK_APP_RX_DATA:
     {
-    // Get the data from the UART RX buffer.  If the size of the returned data is
-    // not zero, then push it onto the Espruino processing queue for characters.
-      char pBuffer[100];
-      int size = getRXBuffer(pBuffer, sizeof(pBuffer));
-      if (size > 0) {
-        jshPushIOCharEvents(EV_SERIAL1, pBuffer, size);
+    // Move as much data from the UART RX buffer to the Espruino processing queue
+    // for characters as there is room for. Each chunk becomes one event.
+      char pBuffer[UART_FIFO_LEN];
+      int size = 1;
+      while (size > 0 && jshHasEventSpaceForChars(sizeof(pBuffer))) {
+        size = getRXBuffer(pBuffer, sizeof(pBuffer));
+        if (size > 0) jshPushIOCharEvents(EV_SERIAL1, pBuffer, (unsigned int)size);
       }
+      esp8266_wakeMainLoop();
+      if (uart_rx_overflowed())
+        jsErrorFlags |= JSERR_RX_FIFO_FULL;
+      // If there's more data, try again after the main loop has handled some events
+      if (size > 0)
+        system_os_post(TASK_APP_QUEUE, TASK_APP_RX_DATA, 0);
     }
     break;
   // Handle the unknown event type.
@@ -213,7 +401,22 @@ static void mainLoop() {
   if (suspendMainLoopFlag == true) {
     return;
   }
-  jsiLoop();
+  // Keep running while there are events and we have time, stopping early
+  // enough that the next iteration shouldn't overrun the budget
+  uint32 start = system_get_time();
+  uint32 longest = 0;
+  uint32 elapsed;
+  do {
+    uint32 iterStart = system_get_time();
+    jsiLoop();
+    uint32 now = system_get_time();
+    if (now - iterStart > longest) longest = now - iterStart;
+    elapsed = now - start;
+  } while (mainLoopMaxRunUs && !mainLoopSleepInterval && jshHasEvents() &&
+           elapsed + longest < mainLoopMaxRunUs);
+  esp8266_heapCheckFree(); // catch SDK allocations we can't track
+  cpuGovernor();
+  powerManager();
 
 #ifdef EPS8266_BOARD_HEARTBEAT
   if (system_get_time() - lastTime > 1000 * 1000 * 60) {
@@ -226,9 +429,17 @@ static void mainLoop() {
   }
 #endif
 
-  // Setup for another callback
+  // Setup for another callback - if jshSleep said there was nothing to do
+  // for a while, leave the CPU idle until then (or until we're woken)
   //queueTaskMainLoop();
-  suspendMainLoop(0); // HACK to get around SDK 1.4 bug
+  uint32 interval = mainLoopSleepInterval;
+  mainLoopSleepInterval = 0;
+  mainLoopTimeUntilNext = 0;
+  mainLoopSleeping = interval > 0;
+  // still busy - give the SDK at least minYieldUs (the timer is in ms)
+  if (!interval && mainLoopMinYieldUs)
+    interval = (mainLoopMinYieldUs + 999) / 1000;
+  suspendMainLoop(interval); // interval of 0 is a HACK to get around SDK 1.4 bug
 }
 
 
@@ -248,7 +459,16 @@ static void initDone() {
   //uart_rx_discard();
 
   jshInit(); // Initialize the hardware
+#ifdef JSVAR_MALLOC
+  // Use the heap the SDK has left us for variables, keeping JSVAR_HEAP_RESERVE for networking
+  uint32 heap = system_get_free_heap_size();
+  uint32 vars = heap > JSVAR_HEAP_RESERVE ? (heap - JSVAR_HEAP_RESERVE) / sizeof(JsVar) : 0;
+  if (vars < 500) vars = 500; // we can't do much with fewer
+  jsvSetMemoryTotal(vars);
+#endif
   jsvInit(); // Initialize the variables
+  os_printf("Variables: %d @%dea = %dbytes\n", jsvGetMemoryTotal(), sizeof(JsVar),
+      jsvGetMemoryTotal() * sizeof(JsVar));
   jsiInit(true); // Initialize the interactive subsystem
   // note: the wifi gets hooked-up via wifi_soft_init called from jsiInit
 
@@ -306,8 +526,6 @@ void user_init() {
   // Dump the restart exception information.
   dumpRestart();
   os_printf("Heap: %d\n", system_get_free_heap_size());
-  os_printf("Variables: %d @%dea = %dbytes\n", JSVAR_CACHE_SIZE, sizeof(JsVar),
-      JSVAR_CACHE_SIZE * sizeof(JsVar));
   os_printf("Time sys=%u rtc=%u\n", system_get_time(), system_get_rtc_time());
 
   espFlashKB = flash_kb[system_get_flash_size_map()];
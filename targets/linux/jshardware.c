@@ -22,6 +22,10 @@
  #include <sys/select.h>
  #include <termios.h>
  #include <fcntl.h>
+ #include <poll.h>
+ #include <sys/syscall.h>
+ #include <sys/mman.h>
+ #include <sys/stat.h>
 #endif//__MINGW32__
  #include <signal.h>
  #include <inttypes.h>
@@ -30,6 +34,9 @@
 #include "jsutils.h"
 #include "jsparse.h"
 #include "jsinteractive.h"
+#ifdef USE_NET
+#include "network_linux.h"
+#endif
 
 #include <pthread.h>
 
@@ -45,8 +52,8 @@
 #endif
 
 // ----------------------------------------------------------------------------
-int ioDevices[EV_DEVICE_MAX+1]; // list of open IO devices (or 0)
-JshPinState gpioState[JSH_PIN_COUNT]; // will be set to UNDEFINED if it isn't exported
+INSTANCE_LOCAL int ioDevices[EV_DEVICE_MAX+1]; // list of open IO devices (or 0)
+INSTANCE_LOCAL JshPinState gpioState[JSH_PIN_COUNT]; // will be set to UNDEFINED if it isn't exported
 
 #ifdef SYSFS_GPIO_DIR
 
@@ -133,7 +140,7 @@ void (*irqEXTIs[16])(void) = {
 };
 #endif
 // ----------------------------------------------------------------------------
-IOEventFlags gpioEventFlags[JSH_PIN_COUNT];
+INSTANCE_LOCAL IOEventFlags gpioEventFlags[JSH_PIN_COUNT];
 
 IOEventFlags pinToEVEXTI(Pin pin) {
   return gpioEventFlags[pin];
@@ -221,78 +228,116 @@ int getch()
 {
     int r;
     unsigned char c;
-    if ((r = (int)read(STDIN_FILENO, &c, sizeof(c))) < 0) {
-        return r;
+    if ((r = (int)read(STDIN_FILENO, &c, sizeof(c))) <= 0) {
+        return -1; // error or end of file
     } else {
         return c;
     }
 }
 #endif//__MINGW32__
 
-pthread_t inputThread;
-bool isInitialised;
+/* Interpreter state is INSTANCE_LOCAL, so the input thread can't push events itself. It
+ * just reads into this queue, and jshIdle moves what it got into the event queue. The
+ * only state it touches directly is execInfo.execute, so Ctrl-C can interrupt code that
+ * never gets back to the idle loop. */
+#define LINUX_INPUT_MASK 4095
+typedef struct {
+  volatile bool running;
+  bool readConsole; ///< Only the interpreter on the main thread reads stdin
+  volatile bool ctrlCInterrupts; ///< Does Ctrl-C on stdin interrupt? (not if console is elsewhere, or binary)
+  volatile JsExecFlags *execute;
+  int *devices; ///< the interpreter's ioDevices
+#ifndef __MINGW32__
+  int wakeFd[2]; ///< write to wakeFd[1] to wake the thread up
+#endif
+  struct { unsigned char device; char ch; } buf[LINUX_INPUT_MASK+1];
+  volatile unsigned int head, tail; ///< head is only written by the thread, tail by jshIdle
+} LinuxInput;
+static INSTANCE_LOCAL LinuxInput linuxInput;
+static INSTANCE_LOCAL pthread_t inputThread;
+
+static unsigned int jshInputSpace(LinuxInput *in) {
+  return (in->tail - in->head - 1) & LINUX_INPUT_MASK;
+}
+
+static void jshInputAdd(LinuxInput *in, IOEventFlags device, const char *data, int len) {
+  unsigned int head = in->head;
+  int i;
+  for (i=0;i<len;i++) {
+    in->buf[head].device = (unsigned char)device;
+    in->buf[head].ch = data[i];
+    head = (head+1) & LINUX_INPUT_MASK;
+  }
+  jshMemoryBarrier(); // data must be there before jshIdle sees the new head
+  in->head = head;
+}
 
-void jshInputThread() {
-  while (isInitialised) {
+static void *jshInputThread(void *arg) {
+  LinuxInput *in = (LinuxInput*)arg;
+  while (in->running) {
     bool shortSleep = false;
     /* Handle the delayed Ctrl-C -> interrupt behaviour (see description by EXEC_CTRL_C's definition)  */
-    if (execInfo.execute & EXEC_CTRL_C_WAIT)
-      execInfo.execute = (execInfo.execute & ~EXEC_CTRL_C_WAIT) | EXEC_INTERRUPTED;
-    if (execInfo.execute & EXEC_CTRL_C)
-      execInfo.execute = (execInfo.execute & ~EXEC_CTRL_C) | EXEC_CTRL_C_WAIT;
-    // Read from the console
-    while (kbhit()) {
-      int ch = getch();
-      if (ch<0) break;
-      jshPushIOCharEvent(EV_USBSERIAL, (char)ch);
-    }
-    // Read from any open devices - if we have space
-    if (jshGetEventsUsed() < IOBUFFERMASK/2) {
-      int i;
-      for (i=0;i<=EV_DEVICE_MAX;i++) {
-        if (ioDevices[i]) {
-          char buf[32];
-          // read can return -1 (EAGAIN) because O_NONBLOCK is set
-          int bytes = (int)read(ioDevices[i], buf, sizeof(buf));
-          if (bytes>0) {
-            //int j; for (j=0;j<bytes;j++) printf("]] '%c'\r\n", buf[j]);
-            jshPushIOCharEvents(i, buf, (unsigned int)bytes);
-            shortSleep = true;
-          }
+    if (*in->execute & EXEC_CTRL_C_WAIT)
+      *in->execute = (*in->execute & ~EXEC_CTRL_C_WAIT) | EXEC_INTERRUPTED;
+    if (*in->execute & EXEC_CTRL_C)
+      *in->execute = (*in->execute & ~EXEC_CTRL_C) | EXEC_CTRL_C_WAIT;
+    // Read from the console - if we have space (otherwise big pastes/uploads overflow the queue)
+    if (in->readConsole && jshInputSpace(in) > 256) {
+      char buf[256];
+      int bytes = 0;
+      while (bytes<(int)sizeof(buf) && kbhit()) {
+        int ch = getch();
+        if (ch<0) { // stdin has closed
+          in->readConsole = false;
+          break;
+        }
+        if (ch==3 && in->ctrlCInterrupts) {
+          *in->execute |= EXEC_CTRL_C; // the interpreter may be busy, so don't queue it
+          continue;
         }
+        buf[bytes++] = (char)ch;
       }
-    }
-    // Write any data we have
-    IOEventFlags device = jshGetDeviceToTransmit();
-    while (device != EV_NONE) {
-      char ch = (char)jshGetCharToTransmit(device);
-      //printf("[[ '%c'\r\n", ch);
-      if (ioDevices[device]) {
-        write(ioDevices[device], &ch, 1);
+      if (bytes) {
+        jshInputAdd(in, EV_USBSERIAL, buf, bytes);
         shortSleep = true;
       }
-      device = jshGetDeviceToTransmit();
     }
-
-
-#ifdef SYSFS_GPIO_DIR
-    Pin pin;
-    for (pin=0;pin<JSH_PIN_COUNT;pin++)
-      if (gpioShouldWatch[pin]) {
-        shortSleep = true;
-        bool state = jshPinGetValue(pin);
-        if (state != gpioLastState[pin]) {
-          jshPushIOEvent(pinToEVEXTI(pin) | (state?EV_EXTI_IS_HIGH:0), jshGetSystemTime());
-          gpioLastState[pin] = state;
+    // Read from any open devices - if we have space
+    int i;
+    for (i=0;i<=EV_DEVICE_MAX;i++) {
+      if (in->devices[i] && jshInputSpace(in) > 256) {
+        char buf[256];
+        // read can return -1 (EAGAIN) because O_NONBLOCK is set
+        int bytes = (int)read(in->devices[i], buf, sizeof(buf));
+        if (bytes>0) {
+          jshInputAdd(in, (IOEventFlags)i, buf, bytes);
+          shortSleep = true;
         }
       }
-#endif
-
+    }
+#ifndef __MINGW32__
+    struct pollfd p = { .fd = in->wakeFd[0], .events = POLLIN };
+    if (poll(&p, 1, shortSleep ? 1 : 50) > 0) {
+      char c;
+      while (read(in->wakeFd[0], &c, 1) > 0);
+    }
+#else
     usleep(shortSleep ? 1000 : 50000);
+#endif
   }
+  return 0;
 }
 
-
+/// Send anything waiting in the transmit queue (this used to be done by the input thread)
+static void jshTransmitPending() {
+  IOEventFlags device = jshGetDeviceToTransmit();
+  while (device != EV_NONE) {
+    char ch = (char)jshGetCharToTransmit(device);
+    if (ioDevices[device])
+      write(ioDevices[device], &ch, 1);
+    device = jshGetDeviceToTransmit();
+  }
+}
 
 void jshInit() {
 
@@ -311,8 +356,14 @@ void jshInit() {
     ioDevices[i] = 0;
 
   jshInitDevices();
+  LinuxInput *in = &linuxInput;
+#if defined(__linux__)
+  in->readConsole = getpid() == (pid_t)syscall(SYS_gettid);
+#else
+  in->readConsole = true;
+#endif
 #ifndef __MINGW32__
-  if (!terminal_set) {
+  if (in->readConsole && !terminal_set) {
     struct termios new_termios;
 
     /* take two copies - one for now, one for later */
@@ -336,26 +387,65 @@ void jshInit() {
   }
 #endif
 
-  isInitialised = true;
-  int err = pthread_create(&inputThread, NULL, &jshInputThread, NULL);
-  if (err != 0)
-      printf("Unable to create input thread, %s", strerror(err));
+  in->head = in->tail = 0;
+  in->ctrlCInterrupts = true;
+  in->execute = &execInfo.execute;
+  in->devices = ioDevices;
+#ifndef __MINGW32__
+  if (pipe(in->wakeFd) == 0) {
+    fcntl(in->wakeFd[0], F_SETFL, O_NONBLOCK);
+    fcntl(in->wakeFd[1], F_SETFL, O_NONBLOCK);
+  } else
+    in->wakeFd[0] = in->wakeFd[1] = -1;
+#endif
+  in->running = true;
+#ifndef __MINGW32__
+  // signals (eg. SIGINT) must go to the interpreter's thread, so block them in the input thread
+  sigset_t allSignals, oldSignals;
+  sigfillset(&allSignals);
+  pthread_sigmask(SIG_BLOCK, &allSignals, &oldSignals);
+#endif
+  int err = pthread_create(&inputThread, NULL, jshInputThread, in);
+#ifndef __MINGW32__
+  pthread_sigmask(SIG_SETMASK, &oldSignals, NULL);
+#endif
+  if (err != 0) {
+    in->running = false;
+    printf("Unable to create input thread, %s", strerror(err));
+  }
 }
 
 void jshReset() {
   jshResetDevices();
 }
 
+static void jshFlashUnmap();
+
 void jshKill() {
   int i;
 
-  isInitialised = false;
+  // stop the input thread before we close anything it's reading from
+  LinuxInput *in = &linuxInput;
+  if (in->running) {
+    in->running = false;
+#ifndef __MINGW32__
+    char c = 0;
+    if (write(in->wakeFd[1], &c, 1)) {};
+#endif
+    pthread_join(inputThread, NULL);
+  }
+#ifndef __MINGW32__
+  if (in->wakeFd[0]>=0) close(in->wakeFd[0]);
+  if (in->wakeFd[1]>=0) close(in->wakeFd[1]);
+  in->wakeFd[0] = in->wakeFd[1] = -1;
+#endif
 
   for (i=0;i<=EV_DEVICE_MAX;i++)
     if (ioDevices[i]) {
       close(ioDevices[i]);
       ioDevices[i]=0;
     }
+  jshFlashUnmap();
 
 #ifdef SYSFS_GPIO_DIR
 
@@ -367,7 +457,42 @@ void jshKill() {
 }
 
 void jshIdle() {
-  // all done in the thread now...
+  LinuxInput *in = &linuxInput;
+  in->ctrlCInterrupts = jsiGetConsoleDevice()==EV_USBSERIAL && !jshIsConsoleBinary();
+  // Move what the input thread read into the event queue - if we have space
+  unsigned int tail = in->tail;
+  while (tail != in->head && jshGetEventsUsed() < IOBUFFERMASK/2) {
+    jshMemoryBarrier();
+    char buf[256];
+    /* If it won't fit in the bulk buffer each character needs an
+     * event, so only push a little */
+    unsigned int maxLen = 32;
+#ifdef IOBULKBUFFERMASK
+    if (IOBULKBUFFERMASK-jshGetBulkCharsUsed() >= (int)sizeof(buf))
+      maxLen = sizeof(buf);
+#endif
+    IOEventFlags device = (IOEventFlags)in->buf[tail].device;
+    unsigned int len = 0;
+    while (tail != in->head && len<maxLen && in->buf[tail].device==device) {
+      buf[len++] = in->buf[tail].ch;
+      tail = (tail+1) & LINUX_INPUT_MASK;
+    }
+    jshPushIOCharEvents(device, buf, len);
+  }
+  in->tail = tail;
+  jshTransmitPending();
+
+#ifdef SYSFS_GPIO_DIR
+  Pin pin;
+  for (pin=0;pin<JSH_PIN_COUNT;pin++)
+    if (gpioShouldWatch[pin]) {
+      bool state = jshPinGetValue(pin);
+      if (state != gpioLastState[pin]) {
+        jshPushIOWatchEvent(pinToEVEXTI(pin)); // so buffers, irq actions and debounce all work
+        gpioLastState[pin] = state;
+      }
+    }
+#endif
 }
 
 // ----------------------------------------------------------------------------
@@ -551,7 +676,7 @@ void jshPinPulse(Pin pin, bool value, JsVarFloat time) {
   if (jshIsPinValid(pin)) {
     jshPinSetState(pin, JSHPINSTATE_GPIO_OUT);
     jshPinSetValue(pin, value);
-    usleep(time*1000000);
+    usleep((useconds_t)(time*1000000));
     jshPinSetValue(pin, !value);
   } else jsError("Invalid pin!");
 }
@@ -697,7 +822,7 @@ void jshUSARTSetup(IOEventFlags device, JshUSARTInfo *inf) {
  * to set up interrupts */
 void jshUSARTKick(IOEventFlags device) {
   assert(DEVICE_IS_USART(device) || DEVICE_IS_SPI(device));
-  // all done by the idle loop
+  jshTransmitPending();
 }
 
 void jshSPISetup(IOEventFlags device, JshSPIInfo *inf) {
@@ -726,6 +851,22 @@ int jshSPISend(IOEventFlags device, int data) {
   return -1;
 }
 
+bool jshSPISendMany(IOEventFlags device, unsigned char *tx, unsigned char *rx, size_t count) {
+  NOT_USED(device);
+  NOT_USED(tx);
+  NOT_USED(rx);
+  NOT_USED(count);
+  return false; // no faster than jshSPISend
+}
+
+bool jshSPISendAsync(IOEventFlags device, unsigned char *tx, unsigned char *rx, size_t count) {
+  NOT_USED(device);
+  NOT_USED(tx);
+  NOT_USED(rx);
+  NOT_USED(count);
+  return false;
+}
+
 /** Send 16 bit data through the given SPI device. */
 void jshSPISend16(IOEventFlags device, int data) {
   jshSPISend(device, data>>8);
@@ -768,8 +909,12 @@ bool jshSleep(JsSysTime timeUntilWake) {
     usecs=1000; // don't sleep much if we have watches - we need to keep polling them
   if (usecs > 50000)
     usecs = 50000; // don't want to sleep too much (user input/HTTP/etc)
-  if (usecs >= 1000)  
-    usleep(usecs); 
+  if (usecs >= 1000) {
+#ifdef USE_NET
+    if (!net_linux_sleep(usecs)) // wake early if a socket gets data
+#endif
+    usleep(usecs);
+  }
   return true;
 }
 
@@ -799,14 +944,109 @@ JsVarFloat jshReadTemperature() { return NAN; };
 JsVarFloat jshReadVRef()  { return NAN; };
 unsigned int jshGetRandomNumber() { return rand(); }
 
-bool jshFlashGetPage(uint32_t addr, uint32_t *startAddr, uint32_t *pageSize) { return false; }
+/* Emulate a small area of NOR flash, so code that uses free flash can be tested. It's
+ * mmapped from the file given with `--flash` (so it can be kept and copied between runs),
+ * or is just anonymous memory if there isn't one. */
+#define LINUX_FLASH_START 0x10000000
+#define LINUX_FLASH_PAGE_SIZE 4096
+#define LINUX_FLASH_PAGES 16
+#define LINUX_FLASH_SIZE (LINUX_FLASH_PAGE_SIZE*LINUX_FLASH_PAGES)
+const char *jshFlashFilename = 0;
+static INSTANCE_LOCAL unsigned char *linuxFlash = 0;
+
+static void jshFlashMap() {
+#ifndef __MINGW32__
+  if (jshFlashFilename) {
+    int fd = open(jshFlashFilename, O_RDWR|O_CREAT, 0644);
+    struct stat st;
+    if (fd>=0 && fstat(fd, &st)==0) {
+      // anything past the end of the file is erased
+      unsigned char erased[LINUX_FLASH_PAGE_SIZE];
+      memset(erased, 0xFF, sizeof(erased));
+      off_t size = st.st_size;
+      while (size < LINUX_FLASH_SIZE) {
+        size_t n = LINUX_FLASH_PAGE_SIZE - (size_t)(size % LINUX_FLASH_PAGE_SIZE);
+        if (pwrite(fd, erased, n, size) != (ssize_t)n) break;
+        size += (off_t)n;
+      }
+      if (size >= LINUX_FLASH_SIZE) {
+        void *p = mmap(0, LINUX_FLASH_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) linuxFlash = (unsigned char*)p;
+      }
+    }
+    if (fd>=0) close(fd);
+    if (!linuxFlash)
+      jsiConsolePrintf("Unable to map flash file %s\n", jshFlashFilename);
+  }
+  if (!linuxFlash) {
+    void *p = mmap(0, LINUX_FLASH_SIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return;
+    linuxFlash = (unsigned char*)p;
+    memset(linuxFlash, 0xFF, LINUX_FLASH_SIZE);
+  }
+#else
+  linuxFlash = (unsigned char*)malloc(LINUX_FLASH_SIZE);
+  if (linuxFlash) memset(linuxFlash, 0xFF, LINUX_FLASH_SIZE);
+#endif
+}
+
+static void jshFlashUnmap() {
+  if (!linuxFlash) return;
+#ifndef __MINGW32__
+  munmap(linuxFlash, LINUX_FLASH_SIZE); // writes back to the file, if there is one
+#else
+  free(linuxFlash);
+#endif
+  linuxFlash = 0;
+}
+
+static unsigned char *jshFlashGetPtr(uint32_t addr, uint32_t len) {
+  if (addr < LINUX_FLASH_START || addr+len > LINUX_FLASH_START+LINUX_FLASH_SIZE)
+    return 0;
+  if (!linuxFlash) jshFlashMap();
+  if (!linuxFlash) return 0;
+  return &linuxFlash[addr-LINUX_FLASH_START];
+}
+
+char *jshFlashGetMemMapAddress(uint32_t addr, uint32_t len) {
+  return (char*)jshFlashGetPtr(addr, len);
+}
+
+bool jshFlashGetPage(uint32_t addr, uint32_t *startAddr, uint32_t *pageSize) {
+  if (!jshFlashGetPtr(addr, 1)) return false;
+  *startAddr = addr & ~(uint32_t)(LINUX_FLASH_PAGE_SIZE-1);
+  *pageSize = LINUX_FLASH_PAGE_SIZE;
+  return true;
+}
 JsVar *jshFlashGetFree() {
-  // not implemented, or no free pages.
-  return 0;
+  JsVar *jsFreeFlash = jsvNewEmptyArray();
+  if (!jsFreeFlash) return 0;
+  JsVar *jsArea = jsvNewObject();
+  if (jsArea) {
+    jsvObjectSetChildAndUnLock(jsArea, "addr", jsvNewFromInteger(LINUX_FLASH_START));
+    jsvObjectSetChildAndUnLock(jsArea, "length", jsvNewFromInteger(LINUX_FLASH_SIZE));
+    jsvArrayPushAndUnLock(jsFreeFlash, jsArea);
+  }
+  return jsFreeFlash;
+}
+void jshFlashErasePage(uint32_t addr) {
+  uint32_t startAddr, pageSize;
+  if (!jshFlashGetPage(addr, &startAddr, &pageSize)) return;
+  memset(jshFlashGetPtr(startAddr, pageSize), 0xFF, pageSize);
+}
+void jshFlashRead(void *buf, uint32_t addr, uint32_t len) {
+  unsigned char *ptr = jshFlashGetPtr(addr, len);
+  if (ptr) memcpy(buf, ptr, len);
+  else memset(buf, 0, len);
+}
+void jshFlashWrite(void *buf, uint32_t addr, uint32_t len) {
+  // like real flash, writing can only clear bits
+  unsigned char *ptr = jshFlashGetPtr(addr, len);
+  if (!ptr) return;
+  uint32_t i;
+  for (i=0;i<len;i++)
+    ptr[i] &= ((unsigned char*)buf)[i];
 }
-void jshFlashErasePage(uint32_t addr) { }
-void jshFlashRead(void *buf, uint32_t addr, uint32_t len) { memset(buf, 0, len); }
-void jshFlashWrite(void *buf, uint32_t addr, uint32_t len) { }
 
 unsigned int jshSetSystemClock(JsVar *options) {
   return 0;
@@ -4,6 +4,7 @@
 #include <sys/stat.h>
 #include <signal.h>
 #include <dirent.h> // for readdir
+#include <pthread.h>
 
 #include "jslex.h"
 #include "jsvar.h"
@@ -13,11 +14,28 @@
 #include "jsinteractive.h"
 #include "jshardware.h"
 #include "jswrapper.h"
+#ifdef USE_NET
+#include "network_linux.h"
+#endif
 
 
 #define TEST_DIR "tests/"
-
-bool isRunning = true;
+#define BENCHMARK_DIR "benchmark/"
+#define BENCHMARK_MIN_TIME 1000 // milliseconds - run each benchmark until it has taken at least this long...
+#define BENCHMARK_MIN_RUNS 3 // ... and at least this many times
+#define BENCHMARK_MAX_RUNS 10000
+
+INSTANCE_LOCAL bool isRunning = true;
+int threadCount = 1; ///< How many interpreters to run at once, each on its own thread (--threads)
+
+/// Should we keep going around the idle loop (rather than exiting)?
+static bool hasWorkToDo(bool isBusy) {
+#ifdef USE_NET
+  // idle sockets don't make us busy, but they could still get data
+  if (net_linux_hasSockets()) return true;
+#endif
+  return jsiHasTimers() || isBusy;
+}
 
 void addNativeFunction(const char *name, void (*callbackPtr)(void)) {
   jsvObjectSetChildAndUnLock(execInfo.root, name, jsvNewNativeFunction(callbackPtr, JSWAT_VOID));
@@ -70,7 +88,7 @@ bool run_test(const char *filename) {
 
   isRunning = true;
   bool isBusy = true;
-  while (isRunning && (jsiHasTimers() || isBusy))
+  while (isRunning && hasWorkToDo(isBusy))
     isBusy = jsiLoop();
 
   JsVar *result = jsvObjectGetChild(execInfo.root, "result", 0/*no create*/);
@@ -156,6 +174,172 @@ bool run_all_tests() {
   return passed == count;
 }
 
+int handleErrors();
+void die(const char *txt);
+
+FILE *benchmarkJSON = 0; ///< If set, benchmark results are written here as JSON
+int benchmarkCount = 0;
+
+typedef struct {
+  const char *code;
+  int runs;
+  JsSysTime totalTime;
+  unsigned int vars, gcs;
+  size_t stack;
+  bool ok;
+} BenchmarkRun;
+
+/** Run a benchmark repeatedly, each time in a fresh interpreter. Only the time spent
+ * executing the code (including timers it sets) is counted. */
+static void *benchmark_thread(void *arg) {
+  BenchmarkRun *r = (BenchmarkRun*)arg;
+  char *stackBase = (char*)__builtin_frame_address(0);
+  while (r->ok && r->runs<BENCHMARK_MAX_RUNS &&
+         (r->runs<BENCHMARK_MIN_RUNS || jshGetMillisecondsFromTime(r->totalTime)<BENCHMARK_MIN_TIME)) {
+    jshInit();
+    jsvInit();
+    jsiInit(false /* do not autoload!!! */);
+    addNativeFunction("quit", nativeQuit);
+
+    unsigned int gcCount = jsvGCCount;
+    jsuStackLowest = 0;
+    JsSysTime startTime = jshGetSystemTime();
+    jsvUnLock(jspEvaluate(r->code, false));
+    isRunning = true;
+    bool isBusy = true;
+    while (isRunning && hasWorkToDo(isBusy))
+      isBusy = jsiLoop();
+    r->totalTime += jshGetSystemTime() - startTime;
+    r->runs++;
+
+    if (handleErrors()) r->ok = false;
+    r->vars = jsvGetMemoryUsage();
+    r->gcs = jsvGCCount - gcCount;
+    if (jsuStackLowest && jsuStackLowest<stackBase && (size_t)(stackBase-jsuStackLowest)>r->stack)
+      r->stack = (size_t)(stackBase-jsuStackLowest);
+    jsiKill();
+    jsvKill();
+    jshKill();
+  }
+  return 0;
+}
+
+/** Run a benchmark and report how many times a second it runs. With --threads, it's run
+ * in that many interpreters at once and the total is reported. */
+bool run_benchmark(const char *filename) {
+  char *buffer = read_file(filename);
+  if (!buffer) return false;
+
+  BenchmarkRun *results = (BenchmarkRun*)calloc((size_t)threadCount, sizeof(BenchmarkRun));
+  pthread_t *threads = (pthread_t*)calloc((size_t)threadCount, sizeof(pthread_t));
+  int t;
+  for (t=0;t<threadCount;t++) {
+    results[t].code = buffer;
+    results[t].ok = true;
+  }
+  if (threadCount==1) {
+    benchmark_thread(&results[0]);
+  } else {
+    for (t=0;t<threadCount;t++)
+      if (pthread_create(&threads[t], NULL, benchmark_thread, &results[t]))
+        die("Unable to create thread\n");
+    for (t=0;t<threadCount;t++)
+      pthread_join(threads[t], NULL);
+  }
+  free(threads);
+  free(buffer);
+
+  int runs = 0;
+  JsVarFloat ms = 0, opsPerSec = 0;
+  unsigned int vars = 0, gcs = 0;
+  size_t stack = 0;
+  bool ok = true;
+  for (t=0;t<threadCount;t++) {
+    JsVarFloat tms = jshGetMillisecondsFromTime(results[t].totalTime);
+    if (tms>0) opsPerSec += (JsVarFloat)(results[t].runs*1000)/tms;
+    ms += tms;
+    runs += results[t].runs;
+    if (!results[t].ok) ok = false;
+    if (results[t].vars>vars) vars = results[t].vars;
+    if (results[t].gcs>gcs) gcs = results[t].gcs;
+    if (results[t].stack>stack) stack = results[t].stack;
+  }
+  free(results);
+
+  char threadInfo[32] = "";
+  if (threadCount>1) snprintf(threadInfo, sizeof(threadInfo), " on %d threads", threadCount);
+  printf("BENCHMARK %s: %s%.2f ops/sec, %.3f ms/run (%d runs%s), %u vars, %u GCs, %u bytes stack\r\n",
+         filename, ok?"":"FAILED ", opsPerSec, ms/(JsVarFloat)runs, runs, threadInfo, vars, gcs, (unsigned int)stack);
+  if (benchmarkJSON) {
+    fprintf(benchmarkJSON, "%s\n  {\"name\":\"%s\", \"ok\":%s, \"threads\":%d, \"runs\":%d, \"opsPerSec\":%.3f, \"msPerRun\":%.4f, \"vars\":%u, \"gcs\":%u, \"stack\":%u}",
+            benchmarkCount ? "," : "", filename, ok?"true":"false", threadCount, runs, opsPerSec, ms/(JsVarFloat)runs, vars, gcs, (unsigned int)stack);
+  }
+  benchmarkCount++;
+  return ok;
+}
+
+typedef struct {
+  const char *code;
+  int errCode;
+} ScriptRun;
+
+/// Run code in a fresh interpreter until it has nothing left to do
+static void *script_thread(void *arg) {
+  ScriptRun *r = (ScriptRun*)arg;
+  jshInit();
+  jsvInit();
+  jsiInit(false /* do not autoload!!! */);
+  addNativeFunction("quit", nativeQuit);
+  jsvUnLock(jspEvaluate(r->code, false));
+  r->errCode = handleErrors();
+  isRunning = !r->errCode;
+  bool isBusy = true;
+  while (isRunning && hasWorkToDo(isBusy))
+    isBusy = jsiLoop();
+  jsiKill();
+  jsvKill();
+  jshKill();
+  return 0;
+}
+
+/// Run every benchmark in BENCHMARK_DIR
+bool run_all_benchmarks() {
+  bool ok = true;
+  struct dirent **names;
+  // sorted, so results are always in the same order
+  int i, n = scandir(BENCHMARK_DIR, &names, NULL, alphasort);
+  if (n<0) {
+    printf(BENCHMARK_DIR" directory not found\r\n");
+    return false;
+  }
+  for (i=0;i<n;i++) {
+    char *fn = names[i]->d_name;
+    size_t l = strlen(fn);
+    if (l>3 && !strcmp(&fn[l-3], ".js")) {
+      char *full_fn = (char *)malloc(1+l+strlen(BENCHMARK_DIR));
+      strcpy(full_fn, BENCHMARK_DIR);
+      strcat(full_fn, fn);
+      ok &= run_benchmark(full_fn);
+      free(full_fn);
+    }
+    free(names[i]);
+  }
+  free(names);
+  return ok;
+}
+
+/// Start/finish the JSON array of benchmark results
+void benchmark_json(bool start) {
+  if (!benchmarkJSON) return;
+  if (start) {
+    fprintf(benchmarkJSON, "[");
+  } else {
+    fprintf(benchmarkJSON, "\n]\n");
+    fclose(benchmarkJSON);
+    benchmarkJSON = 0;
+  }
+}
+
 bool run_memory_test(const char *fn, int vars) {
   unsigned int i;
   unsigned int min = 20;
@@ -216,11 +400,18 @@ void show_help() {
 #ifdef USE_TELNET
     printf("   --telnet                Enable internal telnet server on port 2323\n");
 #endif
+    printf("   --flash file.bin        Keep emulated flash memory in file.bin (it's mapped into\n");
+    printf("                           memory, so copying it snapshots what's in flash)\n");
     printf("   --test-all              Run all tests (in 'tests' directory)\n");
     printf("   --test test.js          Run the supplied test\n");
     printf("   --test-mem-all          Run all Exhaustive Memory crash tests\n");
     printf("   --test-mem test.js      Run the supplied Exhaustive Memory crash test\n");
     printf("   --test-mem-n test.js #  Run the supplied Exhaustive Memory crash test with # vars\n");
+    printf("   --benchmark-all         Run all benchmarks (in 'benchmark' directory)\n");
+    printf("   --benchmark bench.js    Run the supplied benchmark\n");
+    printf("   --benchmark-json f.json Write the results of the benchmarks that follow to f.json\n");
+    printf("   --threads n             Run the script or benchmarks that follow in n separate\n");
+    printf("                           interpreters at once, each on its own thread\n");
 }
 
 void die(const char *txt) {
@@ -266,7 +457,7 @@ int main(int argc, char **argv) {
         int errCode = handleErrors();
         isRunning = !errCode;
         bool isBusy = true;
-        while (isRunning && (jsiHasTimers() || isBusy))
+        while (isRunning && hasWorkToDo(isBusy))
           isBusy = jsiLoop();
         jsiKill();
         jsvKill();
@@ -274,9 +465,12 @@ int main(int argc, char **argv) {
         exit(errCode);
 #ifdef USE_TELNET
       } else if (!strcmp(a,"--telnet")) {
-        extern bool telnetEnabled;
+        extern INSTANCE_LOCAL bool telnetEnabled;
         telnetEnabled = true;
 #endif
+      } else if (!strcmp(a,"--flash")) {
+        if (i+1>=argc) die("Expecting an extra argument\n");
+        jshFlashFilename = argv[++i];
       } else if (!strcmp(a,"--test")) {
         if (i+1>=argc) die("Expecting an extra argument\n");
         bool ok = run_test(argv[i+1]);
@@ -291,6 +485,25 @@ int main(int argc, char **argv) {
         if (i+1>=argc) die("Expecting an extra argument\n");
         bool ok = run_memory_test(argv[i+1], 0);
         exit(ok ? 0 : 1);
+      } else if (!strcmp(a,"--threads")) {
+        if (i+1>=argc) die("Expecting an extra argument\n");
+        threadCount = atoi(argv[++i]);
+        if (threadCount<1) die("Expecting 1 or more threads\n");
+      } else if (!strcmp(a,"--benchmark-json")) {
+        if (i+1>=argc) die("Expecting an extra argument\n");
+        benchmarkJSON = fopen(argv[++i], "w");
+        if (!benchmarkJSON) die("Unable to open benchmark JSON file\n");
+      } else if (!strcmp(a,"--benchmark")) {
+        if (i+1>=argc) die("Expecting an extra argument\n");
+        benchmark_json(true);
+        bool ok = run_benchmark(argv[i+1]);
+        benchmark_json(false);
+        exit(ok ? 0 : 1);
+      } else if (!strcmp(a,"--benchmark-all")) {
+        benchmark_json(true);
+        bool ok = run_all_benchmarks();
+        benchmark_json(false);
+        exit(ok ? 0 : 1);
       } else if (!strcmp(a,"--test-mem-n")) {
         if (i+2>=argc) die("Expecting an extra 2 arguments\n");
         bool ok = run_memory_test(argv[i+1], atoi(argv[i+2]));
@@ -318,20 +531,25 @@ int main(int argc, char **argv) {
       while (cmd[0] && cmd[0]!='\n') cmd++;
       if (cmd[0]=='\n') cmd++;
     }
-    jshInit();
-    jsvInit();
-    jsiInit(false /* do not autoload!!! */);
-    addNativeFunction("quit", nativeQuit);
-    jsvUnLock(jspEvaluate(cmd, false));
-    int errCode = handleErrors();
+    int errCode = 0;
+    ScriptRun *runs = (ScriptRun*)calloc((size_t)threadCount, sizeof(ScriptRun));
+    pthread_t *threads = (pthread_t*)calloc((size_t)threadCount, sizeof(pthread_t));
+    for (i=0;i<threadCount;i++)
+      runs[i].code = cmd;
+    if (threadCount==1) {
+      script_thread(&runs[0]);
+    } else {
+      for (i=0;i<threadCount;i++)
+        if (pthread_create(&threads[i], NULL, script_thread, &runs[i]))
+          die("Unable to create thread\n");
+      for (i=0;i<threadCount;i++)
+        pthread_join(threads[i], NULL);
+    }
+    for (i=0;i<threadCount;i++)
+      if (runs[i].errCode) errCode = runs[i].errCode;
+    free(runs);
+    free(threads);
     free(buffer);
-    isRunning = !errCode;
-    bool isBusy = true;
-    while (isRunning && (jsiHasTimers() || isBusy))
-      isBusy = jsiLoop();
-    jsiKill();
-    jsvKill();
-    jshKill();
     exit(errCode);
   } else {
     printf("Unknown arguments!\n");
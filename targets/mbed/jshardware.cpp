@@ -211,6 +211,14 @@ void jshSPISetup(IOEventFlags device, JshSPIInfo *inf) {
 int jshSPISend(IOEventFlags device, int data) {
 }
 
+bool jshSPISendMany(IOEventFlags device, unsigned char *tx, unsigned char *rx, size_t count) {
+  return false;
+}
+
+bool jshSPISendAsync(IOEventFlags device, unsigned char *tx, unsigned char *rx, size_t count) {
+  return false;
+}
+
 /** Send 16 bit data through the given SPI device. */
 void jshSPISend16(IOEventFlags device, int data) {
   jshSPISend(device, data>>8);
@@ -2164,6 +2164,24 @@ int jshSPISend(IOEventFlags device, int data)
   }
 }
 
+/** Send 'count' bytes from 'tx' through the given SPI device, and put the response
+ * in 'rx' (if it isn't 0) */
+bool jshSPISendMany(IOEventFlags device, unsigned char *tx, unsigned char *rx, size_t count) {
+  size_t txPtr = 0, rxPtr = 0;
+  while (txPtr<count) {
+    int data = jshSPISend(device, tx[txPtr++]);
+    if (data>=0 && rx) rx[rxPtr++] = (unsigned char)data;
+  }
+  // wait for the rest of the response
+  while (rx && rxPtr<count)
+    rx[rxPtr++] = (unsigned char)jshSPISend(device, -1);
+  return true;
+}
+
+bool jshSPISendAsync(IOEventFlags device, unsigned char *tx, unsigned char *rx, size_t count) {
+  return false; // TODO: use DMA
+}
+
 /** Send 16 bit data through the given SPI device. */
 void jshSPISend16(IOEventFlags device, int data)
 {
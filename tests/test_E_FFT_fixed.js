@@ -0,0 +1,23 @@
+// E.FFT on Int16Array/Int32Array uses fixed point maths, which should match the floating point version closely
+var n=64, r=[];
+function maxErr(a,b) { var e=0; for (var i=0;i<a.length;i++) e=Math.max(e,Math.abs(a[i]-b[i])); return e; }
+var a=new Int16Array(n), f=new Float64Array(n);
+for (var i=0;i<n;i++) a[i]=f[i]=Math.round(10000*Math.sin(i*2*Math.PI*5/n)+3000*Math.cos(i*2*Math.PI*12/n));
+var a2=new Int16Array(a), f2=new Float64Array(f), ai=new Int16Array(n), fi=new Float64Array(n);
+E.FFT(a); E.FFT(f);
+r.push(maxErr(a,f)<5 && a[12]==1499);
+E.FFT(a2,ai); E.FFT(f2,fi);
+r.push(maxErr(a2,f2)<5 && maxErr(ai,fi)<5 && a2[5]==5000);
+
+var b=new Int32Array(n), bi=new Int32Array(n), g=new Float64Array(n), gi=new Float64Array(n);
+b[3]=g[3]=1000; bi[3]=gi[3]=-500;
+E.FFT(b,bi,true); E.FFT(g,gi,true);
+r.push(maxErr(b,g)<5 && maxErr(bi,gi)<5);
+
+// not a power of 2 - uses the floating point version
+var c=new Int16Array([100,0,0,0,0,0]);
+E.FFT(c);
+r.push(c.join()=="12,12,12,12,12,12");
+
+result = r.every(function(x){return x;});
+if (!result) print(r);
@@ -0,0 +1,42 @@
+// E.sum/variance/convolve/FFT on flat typed arrays match the generic path, plus E.dot/scale/add/minmax/histogram
+function arr(n) { var a=[]; for (var i=0;i<n;i++) a.push((i*7)%13 - 6); return a; }
+var a = arr(100), b = arr(100).reverse();
+var i16 = new Int16Array(a), f32 = new Float32Array(b), f64 = new Float64Array(a);
+
+var r = [];
+r.push(E.sum(i16)==E.sum(a), E.sum(f64)==E.sum(a));
+r.push(E.variance(i16,1)==E.variance(a,1));
+r.push(E.convolve(i16,f32,3)==E.convolve(a,b,3));
+r.push(E.dot(i16,f32)==E.convolve(a,b,0), E.dot(i16,f64)==E.dot(a,a), E.dot([1,2,3],[4,5])==14);
+// unaligned views are handled too
+var u = new Int16Array(new Uint8Array(201).buffer, 1, 100);
+u.set(a);
+r.push(E.sum(u)==E.sum(a));
+
+var s = new Int8Array([1,2,3,100]);
+E.scale(s, 2, 1);
+r.push(s.join()=="3,5,7,-55");
+var c = new Uint8ClampedArray([10,200]);
+E.add(c, [-20,100]);
+r.push(c.join()=="0,255");
+var l = [1,2,3];
+E.add(l, new Uint8Array([1,1,1,1]));
+r.push(l.join()=="2,3,4");
+
+var m = E.minmax(f32);
+r.push(m.min==-6 && m.max==6, E.minmax([])===undefined);
+
+var h = E.histogram([0,1,2,3,4,5,6,7,8,9,10,-1,11], 5, 0, 10);
+r.push(h instanceof Uint32Array, h.join()=="2,2,2,2,3");
+var h2 = new Uint16Array(2);
+E.histogram(new Float32Array([0.1,0.9]), h2, 0, 1);
+E.histogram([0.2], h2, 0, 1);
+r.push(h2.join()=="2,1");
+
+var fr = new Float32Array(64), fa = [];
+for (i=0;i<64;i++) fa.push(fr[i] = Math.sin(i));
+E.FFT(fr); E.FFT(fa);
+r.push(Math.abs(fr[3]-fa[3])<0.0001);
+
+result = r.every(function(x){return x;});
+if (!result) print(r);
@@ -0,0 +1,36 @@
+// File.readInto, and piping with a reused buffer
+var fd = E.openFile('./tests/FS_API_Test.txt','r');
+var expected = fd.read(1000);
+fd.close();
+
+fd = E.openFile('./tests/FS_API_Test.txt','r');
+var buf = new Uint8Array(10), n, str = "";
+while ((n = fd.readInto(buf, 2, 7)) > 0)
+  str += E.toString(new Uint8Array(buf.buffer, 2, n));
+fd.close();
+var r1 = str == expected;
+
+// small (non-flat) buffers
+fd = E.openFile('./tests/FS_API_Test.txt','r');
+var big = new Uint8Array(expected.length+10);
+big.set(E.toUint8Array("0123456789"), 0);
+n = fd.readInto(big, 10);
+fd.close();
+var r2 = n==expected.length && E.toString(big)==("0123456789"+expected);
+
+// big (flat) buffers are read into directly
+fd = E.openFile('./tests/FS_API_Test.txt','r');
+big = new Uint8Array(200);
+n = fd.readInto(big, 100);
+fd.close();
+r2 = r2 && n==expected.length && E.toString(new Uint8Array(big.buffer, 100, n))==expected;
+
+var r3 = false;
+var fdr = E.openFile('./tests/FS_API_Test.txt','r');
+var fdw = E.openFile('./tests/FS_API_Pipe_Test.txt','w');
+fdr.pipe(fdw, { chunkSize:8, reuseBuffer:true, complete:function() {
+  fd = E.openFile('./tests/FS_API_Pipe_Test.txt','r');
+  r3 = fd.read(1000) == expected;
+  fd.close();
+  result = r1 && r2 && r3;
+}});
@@ -0,0 +1,37 @@
+// E.createLog / DataLog
+var fs = require("fs");
+var path = "./tests/FS_API_Log_Test.bin";
+if (fs.statSync(path)) fs.unlinkSync(path);
+
+var log = E.createLog(path, {recordSize:4});
+var i;
+for (i=0;i<100;i++)
+  log.append(new Int16Array([i, -i]).buffer, 1000+i);
+var r1 = log.getLength()==100;
+
+// record times can't go backwards
+var r2 = false;
+try { log.append([1], 5); } catch (e) { r2 = true; }
+r2 = r2 && log.getLength()==100;
+
+// reopening picks up the existing records
+log = E.createLog(path);
+log.append([1,2], 2000); // shorter than recordSize, padded with 0
+var r3 = log.getLength()==101;
+
+var q = log.query(1010, 1012.5);
+var d = new Int16Array(q.data.buffer);
+var r4 = q.time.length==3 && q.time[0]==1010 && q.time[2]==1012 &&
+         d.length==6 && d[0]==10 && d[1]==-10 && d[4]==12 && d[5]==-12;
+
+q = log.query(1099);
+var r5 = q.time.length==2 && q.time[1]==2000 &&
+         q.data[4]==1 && q.data[5]==2 && q.data[6]==0 && q.data[7]==0;
+q = log.query(undefined, 999);
+var r6 = q.time.length==0 && q.data.length==0;
+
+var r7 = false;
+try { E.createLog(path, {recordSize:8}); } catch (e) { r7 = true; }
+
+fs.unlinkSync(path);
+result = r1 && r2 && r3 && r4 && r5 && r6 && r7;
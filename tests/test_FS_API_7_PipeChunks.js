@@ -0,0 +1,20 @@
+// Piping without a chunkSize grows the chunk size while the source has more data
+var src = './tests/FS_API_PipeChunks_Src.txt';
+var dst = './tests/FS_API_PipeChunks_Dst.txt';
+var data = "";
+for (var i=0;i<200;i++) data += "Line "+i+"\n";
+var fd = E.openFile(src,'w');
+fd.write(data);
+fd.close();
+
+var fdr = E.openFile(src,'r');
+var fdw = E.openFile(dst,'w');
+fdr.pipe(fdw, { complete:function(pipe) {
+  fd = E.openFile(dst,'r');
+  var copy = fd.read(data.length+100);
+  fd.close();
+  var fs = require("fs");
+  fs.unlinkSync(src);
+  fs.unlinkSync(dst);
+  result = copy==data && pipe.chunkSize==512 && pipe.position==data.length;
+}});
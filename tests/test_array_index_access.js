@@ -0,0 +1,30 @@
+// Array element lookups, in order, backwards, and after the array changes under them
+var r = [];
+var a=[]; for (var i=0;i<200;i++) a.push(i);
+var s=0; for (i=0;i<200;i++) s+=a[i];
+for (i=199;i>=0;i--) s+=a[i];
+r.push(s==2*199*100);
+r.push(a[500]===undefined, a[-1]===undefined, a[150]==150);
+
+var b=[1,2]; b.foo=5; b[5]=6; b.push(7); b[-1]=3;
+r.push(b[0]==1 && b[1]==2 && b[5]==6 && b[6]==7 && b[-1]==3 && b.foo==5 && b[3]===undefined);
+
+var q=[1,2,3,4];
+r.push(q[2]==3);
+q.shift(); r.push(q[2]==4 && q[0]==2);
+q.pop(); r.push(q[2]===undefined && q.length==2);
+q.unshift(9); r.push(q[0]==9 && q[1]==2 && q[2]==3);
+q.splice(1,1); r.push(q.join()=="9,3" && q[1]==3 && q[2]===undefined);
+delete q[1]; r.push(q[1]===undefined && q[0]==9);
+q[1] = 4; r.push(q[1]==4);
+
+// several arrays accessed in the same loop
+var x=[], y=[], z=[];
+for (i=0;i<50;i++) { x.push(i); y.push(i*2); }
+for (i=0;i<50;i++) z[i] = x[i]*2 + y[49-i];
+r.push(z.every(function(v){return v==98;}));
+y.shift();
+r.push(y[0]==2 && x[0]==0 && y[48]==98 && y[49]===undefined);
+
+result = r.every(function(x){return x;});
+if (!result) print(r);
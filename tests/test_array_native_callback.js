@@ -0,0 +1,25 @@
+// Array iteration methods called with built-in functions as callbacks
+var r = [];
+r.push([1,-2,3].map(Math.abs).join()=="1,2,3");
+r.push([1,2,3].map(E.reverseByte).join()=="128,64,192");
+r.push([1,NaN,3].filter(isNaN).length==1 && [NaN,NaN].every(isNaN) && ![1,2].some(isNaN));
+// typed arrays - values are passed without being boxed
+var f = new Float32Array([1,-2.5,9]).map(Math.abs);
+r.push(f instanceof Float32Array && f.join()=="1,2.5,9");
+r.push(new Uint8Array([1,2,128]).map(E.reverseByte).join()=="128,64,1");
+r.push(new Int16Array([4,-9]).map(Math.sqrt).join()=="2,0");
+// callbacks that keep hold of their arguments
+var k = [10,20,30].map(Array);
+r.push(k[0][1]==0 && k[1][1]==1 && k[2][1]==2 && k[2][2].length==3);
+r.push(new Uint8Array([5,6]).map(Number).join()=="5,6");
+// bound functions still get their bound arguments
+var o = [];
+[5,6].forEach(o.push.bind(o));
+r.push(o.length==6 && o[3]==6 && o[4]==1);
+r.push([2,3].map(Math.pow.bind(Math, 2)).join()=="4,8");
+// errors stop the iteration
+var n = 0;
+try { ["{", "1"].map(JSON.parse); } catch (e) { n++; }
+r.push(n==1);
+
+result = r.every(function(x){return x;});
@@ -0,0 +1,35 @@
+// Array.sort on dense arrays (merge sort - stable), and typed arrays (sorted as numbers)
+var r = [];
+var a=[]; for (var i=0;i<300;i++) a.push((i*7919)%307);
+var b=a.slice(), c=a.slice();
+a.sort(function(x,y){return x-y;});
+var ok=true; for (i=1;i<a.length;i++) ok = ok && a[i-1]<=a[i];
+r.push(ok && a.length==300);
+b.sort(); // as strings
+r.push(b[0]==0 && b[1]==1 && b[2]==10 && b[3]==100);
+r.push([10,9,1.5,"a",-1].sort().join()=="-1,1.5,10,9,a");
+
+var s=[]; for (i=0;i<20;i++) s.push({k:i%3,i:i});
+s.sort(function(x,y){return x.k-y.k;});
+r.push(s.map(function(e){return e.i;}).join()=="0,3,6,9,12,15,18,1,4,7,10,13,16,19,2,5,8,11,14,17");
+// indices are still right after relinking
+r.push(s[0].i==0 && s[19].i==17 && s.length==20);
+s.push(5); r.push(s[20]==5);
+
+var u=new Int16Array(200); for (i=0;i<200;i++) u[i]=(i*7919)%211-100;
+u.sort();
+ok=true; for (i=1;i<u.length;i++) ok = ok && u[i-1]<=u[i];
+r.push(ok);
+r.push(new Float32Array([3.5,-1,10,2]).sort().join()=="-1,2,3.5,10");
+// NaN goes last, as in other engines
+r.push(new Float32Array([3.5,NaN,-1,2]).sort().join()=="-1,2,3.5,NaN");
+r.push(new Float64Array([NaN,1,NaN,-Infinity,0]).sort().join()=="-Infinity,0,1,NaN,NaN");
+var f=new Float32Array(300); for (i=0;i<300;i++) f[i]=(i%7)?(i*31)%101:NaN; // big enough to be flat
+f.sort();
+ok=true; for (i=1;i<f.length;i++) ok = ok && (f[i-1]<=f[i] || isNaN(f[i]));
+r.push(ok && isNaN(f[299]) && !isNaN(f[256]));
+r.push(new Uint8Array([10,9,1]).sort().join()=="1,9,10");
+r.push(new Uint8Array([10,9,1]).sort(function(x,y){return y-x;}).join()=="10,9,1");
+
+result = r.every(function(x){return x;});
+if (!result) print(r);
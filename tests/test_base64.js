@@ -0,0 +1,50 @@
+// btoa/atob, and decoding base64 straight into an ArrayBuffer
+var results = [];
+function test(a,b) { results.push(a===b); if (a!==b) print("FAIL",a,"!==",b); }
+
+test(btoa(""), "");
+test(btoa("a"), "YQ==");
+test(btoa("ab"), "YWI=");
+test(btoa("abc"), "YWJj");
+test(btoa("Hello World!"), "SGVsbG8gV29ybGQh");
+test(btoa([1,2,255]), "AQL/");
+var bytes = new Uint8Array(256);
+for (var i=0;i<256;i++) bytes[i]=i;
+var enc = btoa(bytes);
+// encoding a flat buffer and a normal string must match
+test(btoa(E.toString(bytes)), enc);
+test(btoa(new Uint8Array(bytes.buffer,0,255)), enc.substr(0,340));
+// a non-byte typed array uses each element's value
+test(btoa(new Uint16Array([65,66])), "QUI=");
+
+test(atob(""), "");
+test(atob("YQ=="), "a");
+test(atob("YWI="), "ab");
+test(atob("  SGVsbG8g\nV29y bGQh"), "Hello World!");
+test(atob("YQ==YWI="), "aab");
+test(E.toString(E.toUint8Array(atob(enc))), E.toString(bytes));
+// longer than a single block of string data
+var long = "";
+for (i=0;i<40;i++) long += "The quick brown fox ";
+test(atob(btoa(long)), long);
+
+var buf = new Uint8Array(8);
+test(E.base64Decode("AQID", buf), 3);
+test(E.base64Decode("BAU=", buf, 3), 2);
+test(buf.join(","), "1,2,3,4,5,0,0,0");
+// stops when the buffer is full
+test(E.base64Decode("BgcICQoL", buf, 5), 3);
+test(buf.join(","), "1,2,3,4,5,6,7,8");
+test(E.base64Decode("AQID", buf, 8), 0);
+// views write at their own offset
+var dst = new Uint8Array(6);
+test(E.base64Decode(btoa("xyz"), new Uint8Array(dst.buffer, 2)), 3);
+test(E.toString(dst), "\0\0xyz\0");
+var bigBuf = new Uint8Array(256);
+test(E.base64Decode(enc, bigBuf), 256);
+test(E.toString(bigBuf), E.toString(bytes));
+var threw = false;
+try { E.base64Decode("AQID", "str"); } catch (e) { threw = true; }
+test(threw, true);
+
+result = results.every(function(r){return r;});
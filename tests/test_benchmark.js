@@ -0,0 +1,12 @@
+// E.benchmark timings and allocation counts
+var r = E.benchmark(function() { var a = [1,2,3]; }, 50);
+var e = E.benchmark(function() {}, 50);
+var x = 0;
+E.benchmark(function() { x++; }, 20);
+var threw = false;
+try { E.benchmark(5); } catch (err) { threw = true; }
+
+result = r.iterations==50 &&
+  r.min<=r.median && r.median<=r.max &&
+  r.allocs>=3 && e.allocs==0 &&
+  x==20 && threw;
@@ -0,0 +1,25 @@
+// Built-in functions are found with a perfect hash, and the same function
+// var is shared between lookups
+
+var r = [
+  Math.sin===Math.sin,
+  Math.abs(-3)==3,
+  Math.max(1,5,2)==5,
+  [1,2,3].indexOf(2)==1,
+  "Hello".indexOf("l")==2,
+  JSON.stringify({a:1})=='{"a":1}',
+  Math.notAFunction===undefined,
+  typeof Math.sqrt=="function",
+  Object.getOwnPropertyNames(Math).indexOf("sin")>=0,
+  Math.hasOwnProperty("cos"),
+  !Math.hasOwnProperty("xyz")
+];
+
+// adding properties to a shared function mustn't affect later lookups
+var f = Math.floor;
+f.foo = 42;
+r.push(Math.floor(2.5)==2);
+r.push(f.foo==42);
+r.push(Math.floor.foo===undefined);
+
+result = r.every(function(x) { return x; });
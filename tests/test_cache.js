@@ -0,0 +1,39 @@
+// E.Cache - LRU eviction by number of vars used
+var c = E.Cache(1000);
+c.set("a", "Hello");
+c.set("b", [1,2,3]);
+c.set(3, {x:1});
+var r1 = c.has("a") && c.has("b") && c.has("3") && !c.has("d");
+var r2 = c.get("a")=="Hello" && c.get(3).x==1 && c.get("d")===undefined;
+var r3 = c.used>0 && c.delete("b") && !c.delete("b") && !c.has("b");
+c.clear();
+var r4 = c.used==0 && !c.has("a");
+
+// replacing a value doesn't count it twice
+c.set("a", "x");
+var u = c.used;
+c.set("a", "y");
+var r5 = c.used==u;
+
+// least recently used gets thrown away first
+c = E.Cache(1000);
+c.set("a", "12345678");
+c = E.Cache(c.used*3); // room for three entries
+c.set("a", "12345678");
+c.set("b", "12345678");
+c.set("c", "12345678");
+c.get("a"); // now 'b' is the oldest
+c.set("d", "12345678");
+var r6 = c.has("a") && !c.has("b") && c.has("c") && c.has("d");
+// too big to fit
+c.set("e", new Array(100).fill(1));
+var r7 = !c.has("e") && c.has("a");
+
+// entries get freed when memory runs out
+var big = E.Cache(100000);
+var n = 0;
+while (n<20 || big.has(0)) big.set(n++, "Some data to use up memory "+n);
+var r8 = !big.has(0);
+big = undefined;
+
+result = r1 && r2 && r3 && r4 && r5 && r6 && r7 && r8;
@@ -0,0 +1,23 @@
+// E.toCBOR / E.fromCBOR
+
+var r = [];
+function hex(a) { return E.toString(a).split("").map(function(x){return (256+x.charCodeAt(0)).toString(16).substr(1)}).join(""); }
+// encodings from RFC 7049 appendix A
+r.push(hex(E.toCBOR(0))=="00" && hex(E.toCBOR(23))=="17" && hex(E.toCBOR(24))=="1818" && hex(E.toCBOR(1000))=="1903e8");
+r.push(hex(E.toCBOR(-1))=="20" && hex(E.toCBOR(-1000))=="3903e7" && hex(E.toCBOR(1.5))=="fa3fc00000" && hex(E.toCBOR(1.1))=="fb3ff199999999999a");
+r.push(hex(E.toCBOR([1,[2,3]]))=="8201820203" && hex(E.toCBOR({a:"b"}))=="a161616162");
+r.push(hex(E.toCBOR([true,false,null,undefined]))=="84f5f4f6f7");
+r.push(hex(E.toCBOR(new Uint8Array([1,2])))=="d840420102" && hex(E.toCBOR(new Uint8Array([1,2]).buffer))=="420102");
+r.push(E.fromCBOR(new Uint8Array([0xf9,0x3c,0x00]))===1 && E.fromCBOR("\x3b\x00\x00\x00\x01\x00\x00\x00\x00")==-4294967297);
+// round trip
+var o = { a:1, b:-100, c:3.5, d:0.1, e:"hello", f:[1,,3], g:null, fn:function(){}, j:new Int16Array([-1,300]), k:new Uint8Array([1,2,3]).buffer };
+var d = E.fromCBOR(E.toCBOR(o));
+r.push(JSON.stringify(d)==JSON.stringify(o) && d.f.length==3 && d.fn===undefined);
+r.push(d.j instanceof Int16Array && d.j[1]==300 && d.k instanceof ArrayBuffer && d.k.length==3);
+// errors
+var failed = 0;
+try { E.fromCBOR("\x82\x01"); } catch (e) { failed++; }
+var rec = {}; rec.rec = rec;
+try { E.toCBOR(rec); } catch (e) { failed++; }
+r.push(failed==2);
+result = r.every(function(x){return x;});
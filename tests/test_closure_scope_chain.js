@@ -0,0 +1,77 @@
+// Closures created inside nested function calls share their scopes
+
+function outer(a) {
+  var fns = [];
+  function middle(b) {
+    var c = b*10;
+    for (var i=0;i<3;i++) {
+      fns.push(function(d) { c++; return a+b+c+d; });
+    }
+    return function() { return c; };
+  }
+  var getC = middle(2);
+  return { fns:fns, getC:getC };
+}
+
+var o = outer(1);
+var r1 = o.fns[0](100); // 1+2+21+100
+var r2 = o.fns[1](100); // 1+2+22+100
+var r3 = o.getC();
+
+// 4 levels deep, each level modifying a variable from further out
+function l1() {
+  var x = 1;
+  return function l2() {
+    var y = 2;
+    return function l3() {
+      var z = 3;
+      return function l4() {
+        x++; y++; z++;
+        return x*100+y*10+z;
+      };
+    };
+  };
+}
+var f4 = l1()()();
+var r4 = f4();
+var r5 = f4();
+var g4 = l1()()();
+var r6 = g4();
+
+// shadowing still finds the innermost variable
+function s1() {
+  var v = "outer";
+  return function s2() {
+    var v = "middle";
+    return function() { return v; };
+  };
+}
+var r7 = s1()()();
+
+// closures from different calls don't share their variables
+function counter() {
+  var n = 0;
+  return function() {
+    return function() { return ++n; };
+  };
+}
+var ca = counter()(), cb = counter()();
+ca(); ca();
+var r8 = ca()*10 + cb();
+
+// memory is freed once closures go away
+o = f4 = g4 = ca = cb = undefined;
+function useClosures() {
+  for (var j=0;j<10;j++) { var t = outer(j); t.fns[2](j); }
+}
+var mem = 1000, memAfter = 1000, k;
+for (k=0;k<10;k++) useClosures(); // let it be pre-tokenised
+process.memory();
+mem = process.memory().usage;
+useClosures();
+memAfter = process.memory().usage;
+
+result = r1==124 && r2==125 && r3==22 &&
+         r4==234 && r5==345 && r6==234 &&
+         r7=="middle" && r8==31 &&
+         memAfter<=mem;
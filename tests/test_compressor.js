@@ -0,0 +1,20 @@
+// Streaming Compressor/Decompressor give the same results as E.compress/E.decompress
+var data = "";
+for (var i=0;i<1000;i++) data += String.fromCharCode(65 + ((i*i)>>6)%26);
+
+var c = new Compressor();
+var out = "";
+for (var i=0;i<data.length;i+=37) out += c.write(data.substr(i,37));
+out += c.end();
+
+var d = new Decompressor();
+var back = "";
+for (var i=0;i<out.length;i+=11) back += d.write(E.toUint8Array(out.substr(i,11)));
+back += d.end();
+
+// reuse after end()
+var again = c.write("Hello Hello Hello") + c.end();
+
+result = out == E.compress(data) && out.length < data.length &&
+         back == data && E.decompress(out) == data &&
+         E.decompress(again) == "Hello Hello Hello";
@@ -0,0 +1,14 @@
+// console.log formats values straight to the console device - check the output is unchanged
+var out = "";
+LoopbackB.on('data', function(d) { out += d; });
+LoopbackA.setConsole(true);
+console.log("Hello", 42, -1.5, true, null, undefined, {a:1, "q\"":[1,2]}, new Uint8Array([1,2]), new Uint32Array([4000000000, 5]), new Float32Array([0.5]), D1);
+E.setConsoleBlocking(false);
+console.log("nonblocking");
+E.setConsoleBlocking(true);
+
+setTimeout(function() {
+  USB.setConsole();
+  var expected = 'Hello 42 -1.5 true null undefined { "a": 1, \r\n  "q\\"": [ 1, 2 ]\r\n } new Uint8Array([1, 2]) new Uint32Array([4000000000, 5]) new Float32Array([0.5]) D1\r\nnonblocking\r\n';
+  result = out.indexOf(expected)>=0 && E.getErrorFlags().length==0;
+}, 10);
@@ -0,0 +1,24 @@
+// Small integers, booleans and null are shared between all uses - make sure they can't be modified
+
+var a = 5, b = 5;
+a++;
+var c = [1,2,3].map(function(x) { return x; });
+c[1]++;
+var m = [1,2,3].map(function(v,i) { return i==1; });
+var o = {};
+o[1] = true;
+o[2] = null;
+o[3] = 1;
+o[1] = false;
+var k = JSON.parse('{"0":1,"1":true,"2":null}');
+var arr = [];
+for (var i=0;i<5;i++) arr[i] = i;
+arr[2] += 10;
+while (arr.length) arr.pop();
+
+result = a==6 && b==5 &&
+         c.join()=="1,3,3" &&
+         m.join()=="false,true,false" &&
+         o[1]===false && o[2]===null && o[3]===1 &&
+         k[0]===1 && k[1]===true && k[2]===null && Object.keys(k).join()=="0,1,2" &&
+         arr.length==0 && 1===1 && true && null===null;
@@ -0,0 +1,59 @@
+// Streaming AES-CTR/GCM cipher objects
+var AES = require("crypto").AES;
+function fromHex(hex) {
+  var arr = new Uint8Array(hex.length/2);
+  var d = "0123456789abcdef"; // not parseInt, as that treats "0b.." as binary
+  for (var i=0;i<hex.length;i+=2) arr[i>>1] = d.indexOf(hex[i])*16 + d.indexOf(hex[i+1]);
+  return arr;
+}
+function toHex(a) {
+  var s = "";
+  for (var i=0;i<a.length;i++) s += (256+a[i]).toString(16).substr(-2);
+  return s;
+}
+var ok = true;
+function check(a, b) { if (a!=b) { console.log("Expected "+b+", got "+a); ok = false; } }
+
+// NIST GCM test case 2 (AES-128, all zero)
+var c = AES.createCipher(new Uint8Array(16), {mode:"GCM", iv:new Uint8Array(12)});
+check(toHex(c.update(new Uint8Array(16))), "0388dace60b6a392f328c2b971b2fe78");
+check(toHex(c.final()), "ab6e47d42cec13bdf53a67b21257bddf");
+
+// NIST GCM test case 4 (with AAD, not a multiple of 16 bytes), written in odd sized chunks
+var key = fromHex("feffe9928665731c6d6a8f9467308308");
+var iv = fromHex("cafebabefacedbaddecaf888");
+var aad = fromHex("feedfacedeadbeeffeedfacedeadbeefabaddad2");
+var plain = "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a721c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39";
+var cipher = "42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091";
+var tag = "5bc94fbc3221a5db94fae95ae7121a47";
+var data = fromHex(plain);
+c = AES.createCipher(key, {mode:"GCM", iv:iv, aad:aad});
+var out = "";
+[0,5,21,40,55].forEach(function(s,i,a) {
+  var chunk = new Uint8Array(data.buffer, s, (a[i+1]||data.length)-s);
+  var r = c.update(chunk);
+  if (r!==chunk) ok = false; // in place
+  out += toHex(r);
+});
+check(out, cipher);
+check(toHex(c.final()), tag);
+// in place means the original buffer was changed too
+check(toHex(data), cipher);
+
+// decrypt, checking the tag
+c = AES.createCipher(key, {mode:"GCM", iv:iv, aad:aad, decrypt:true});
+check(toHex(c.update(fromHex(cipher))), plain);
+c.final(fromHex(tag));
+c = AES.createCipher(key, {mode:"GCM", iv:iv, decrypt:true}); // no AAD - tag won't match
+c.update(fromHex(cipher));
+var threw = false;
+try { c.final(fromHex(tag)); } catch (e) { threw = true; }
+check(threw, true);
+
+// CTR matches AES.encrypt (which uses a zero counter), even from a String in chunks
+var msg = "Hello World, this is a CTR test message!";
+c = AES.createCipher(key, {mode:"CTR"});
+check(toHex(c.update(msg.substr(0,7))) + toHex(c.update(msg.substr(7))), toHex(new Uint8Array(AES.encrypt(msg, key, {mode:"CTR"}))));
+check(c.final(), undefined);
+
+result = ok;
@@ -0,0 +1,25 @@
+// SHA of messages too big to copy onto the stack - hashed a block at a time
+ArrayBuffer.prototype.toHex = function () {
+  var s = "";
+  for (var i=0;i<this.length;i++)
+    s += (256+this[i]).toString(16).substr(-2);
+  return s;
+};
+
+var crypto = require("crypto");
+var msg = "";
+for (var i=0;i<20000;i++) msg += String.fromCharCode(65 + ((i*7)%26));
+
+var arr = new Uint8Array(msg.length+3);
+for (var i=0;i<msg.length;i++) arr[i+3] = msg.charCodeAt(i);
+var view = new Uint8Array(arr.buffer, 3, msg.length); // ArrayBuffer with an offset
+
+var small = [];
+for (var i=0;i<100;i++) small.push(65 + ((i*7)%26));
+
+result = crypto.SHA1(msg).toHex() == "0c74e15ca40a2419f157b25f15c561fa7255cabf" &&
+         crypto.SHA256(msg).toHex() == "8e6bcb5daa9edcb1eb95fcdbc211161e1df6a5567a7f84c090b4c1079b3755e5" &&
+         crypto.SHA512(msg).toHex().substr(0,32) == "6b0fe4f63497199877a5a2be75bf7270" &&
+         crypto.SHA1(view).toHex() == "0c74e15ca40a2419f157b25f15c561fa7255cabf" &&
+         crypto.SHA1(small).toHex() == crypto.SHA1(msg.substr(0,100)).toHex() &&
+         crypto.SHA1("abc").toHex() == "a9993e364706816aba3e25717850c26c9cd0d89d";
@@ -0,0 +1,47 @@
+// DataView
+var r = [];
+var b = new ArrayBuffer(16);
+var d = new DataView(b);
+r.push(d.byteLength==16 && d.byteOffset==0 && d.buffer===b);
+d.setUint16(0, 0x1234);
+d.setUint16(2, 0x1234, true);
+var u = new Uint8Array(b);
+r.push(u[0]==0x12 && u[1]==0x34 && u[2]==0x34 && u[3]==0x12);
+r.push(d.getUint16(0)==0x1234 && d.getUint16(2,true)==0x1234 && d.getUint16(1)==0x3434);
+d.setInt32(4, -2);
+r.push(d.getInt32(4)==-2 && d.getUint32(4)==0xFFFFFFFE && d.getInt8(7)==-2 && d.getUint8(7)==254);
+d.setUint32(4, 0xDEADBEEF, true);
+r.push(d.getUint32(4,true)==0xDEADBEEF && d.getInt16(4,true)==-16657);
+d.setFloat32(8, 1.5);
+r.push(d.getFloat32(8)==1.5 && u[8]==0x3F && u[9]==0xC0);
+d.setFloat64(8, Math.PI, true);
+r.push(d.getFloat64(8, true)==Math.PI);
+// unaligned
+d.setFloat32(3, -0.25, true);
+r.push(d.getFloat32(3, true)==-0.25);
+
+// offset and length, and views of views
+var d2 = new DataView(b, 4, 4);
+r.push(d2.byteOffset==4 && d2.byteLength==4);
+d2.setUint8(0, 42);
+r.push(u[4]==42);
+var d3 = new DataView(new Uint8Array(b, 8));
+d3.setInt16(0, -300);
+r.push(d3.byteOffset==8 && d.getInt16(8)==-300);
+
+// out of bounds
+var err = 0;
+try { d2.getUint32(1); } catch (e) { err++; }
+try { d2.setUint8(4, 1); } catch (e) { err++; }
+try { new DataView(b, 10, 10); } catch (e) { err++; }
+try { new DataView([1,2,3]); } catch (e) { err++; }
+r.push(err==4);
+
+// small buffers aren't stored flat, so these use the string iterator
+var s = new Uint8Array([1,2,3,4,5]);
+var ds = new DataView(s.buffer);
+r.push(ds.getUint32(1)==0x02030405);
+ds.setUint16(3, 0xAABB, true);
+r.push(s[3]==0xBB && s[4]==0xAA);
+
+result = r.every(function(x){return x;});
@@ -0,0 +1,22 @@
+// E.defrag should make free memory contiguous, without breaking anything
+var obj = {};
+for (var i=0;i<20;i++) obj["key"+i] = "value "+i; // big enough to be indexed
+var str = "A string that is long enough to need quite a few blocks of memory";
+
+// fill memory with small objects, then free every other one
+var arr = [];
+while (process.memory().free > 400) arr.push({n:arr.length});
+for (var i=0;i<arr.length;i+=2) arr[i] = undefined;
+// How much memory is free and where depends on the build, so just check
+// that defragmenting never leaves us with a smaller contiguous free block
+var before = E.getMemoryMap().largestFree;
+var moved = E.defrag();
+var after = E.getMemoryMap().largestFree;
+
+var ok = moved>=0 && after>=before;
+for (var i=0;i<20;i++) ok = ok && obj["key"+i]=="value "+i;
+obj.extra = 42;
+delete obj.key3;
+ok = ok && obj.extra==42 && obj.key3===undefined && Object.keys(obj).length==20;
+for (var i=1;i<arr.length;i+=2) ok = ok && arr[i].n==i;
+result = ok && str=="A string that is long enough to need quite a few blocks of memory";
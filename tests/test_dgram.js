@@ -0,0 +1,22 @@
+// UDP sockets - several datagrams sent at once should all arrive, with where they came from
+
+var result = 0;
+var dgram = require("dgram");
+
+var got = [], listening = false;
+var server = dgram.createSocket("udp4", function(msg, rinfo) {
+  got.push(msg+"@"+rinfo.address+"/"+rinfo.size);
+  if (got.length==3) server.send("ack", rinfo.port, rinfo.address);
+});
+server.bind(8091, function() { listening = true; });
+
+var client = dgram.createSocket({ type : "udp4" });
+client.on("message", function(msg) {
+  client.close();
+  server.close();
+  result = listening && msg=="ack" &&
+           got.join(",")=="one@127.0.0.1/3,two@127.0.0.1/3,three@127.0.0.1/5";
+});
+client.send("one", 8091, "127.0.0.1");
+client.send("two", 8091, "127.0.0.1");
+client.send("three", 8091, "127.0.0.1");
@@ -0,0 +1,31 @@
+// EventEmitter.once - listeners are removed after being called, and removeListener works with them
+var o = {}, log = [];
+function a(x) { log.push("a"+x); }
+function b(x) { log.push("b"+x); }
+o.once("ev", a);
+o.on("ev", b);
+o.emit("ev", 1);
+o.emit("ev", 2);
+
+// a `once` listener can be removed with the original function
+var p = {};
+p.once("ev", a);
+p.removeListener("ev", a);
+p.emit("ev", 3);
+
+// removing every listener removes the event entirely
+var q = {};
+q.on("ev", a);
+q.on("ev", b);
+q.removeListener("ev", a);
+q.removeListener("ev", b);
+q.removeListener("nothere", b);
+
+var thisOk;
+var t = {};
+t.once("x", function(v) { thisOk = this===t && v==5; });
+t.emit("x", 5);
+
+setTimeout(function() {
+  result = log.join(",")=="a1,b1,b2" && Object.keys(q).length==0 && thisOk;
+}, 10);
@@ -0,0 +1,13 @@
+// Events queued with emit are executed later, with the right 'this' and arguments
+
+var o = {name:"o"};
+var got = [];
+o.on('ev', function(a,b,c) { got.push(this.name+a+b.x+c); });
+for (var i=0;i<100;i++) o.emit('ev', i, {x:"-"+i}, i&1 ? undefined : "!");
+// events are still queued - make sure GC and defrag don't lose their arguments
+process.memory();
+if (E.defrag) E.defrag();
+
+setTimeout(function() {
+  result = got.length==100 && got[0]=="o0-0!" && got[1]=="o1-1undefined" && got[99]=="o99-99undefined";
+}, 1);
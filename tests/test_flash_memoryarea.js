@@ -0,0 +1,16 @@
+// E.memoryArea can read emulated flash directly, and nothing outside it
+var flash = require("Flash");
+var addr = flash.getFree()[0].addr;
+flash.erasePage(addr);
+flash.write("Hello World!", addr);
+
+var r1 = E.memoryArea(addr, 12) == "Hello World!";
+// it references flash rather than copying it
+flash.erasePage(addr);
+var area = E.memoryArea(addr, 4);
+flash.write("Test", addr);
+var r2 = area == "Test";
+var r3 = false;
+try { E.memoryArea(0x1234, 4); } catch (e) { r3 = true; }
+
+result = r1 && r2 && r3;
@@ -0,0 +1,25 @@
+// Converting floats to and from strings
+
+var r = [];
+r.push((""+12345.678)=="12345.678");
+r.push((""+23.45)=="23.45");
+r.push((""+(1/3))=="0.33333333333");
+r.push((""+1000000000.1)=="1000000000.1");
+r.push((""+(-0.0001))=="-0.0001");
+r.push((""+1e-12)=="0");
+r.push((""+0.000012345)=="0.000012345");
+r.push(JSON.stringify([1.1,0.25,100])=="[1.1,0.25,100]");
+r.push(parseFloat("0.3")==3/10);
+r.push(parseFloat("123.456e-2")==1.23456);
+r.push(parseFloat("  -.5")==-0.5);
+r.push(parseFloat("1e400")==Infinity);
+r.push(isNaN(parseFloat("abc")));
+// numbers should survive being converted to a string and back
+var ok = true;
+for (var i=0;i<200;i++) {
+  var n = i*1.37+0.123;
+  if (parseFloat(""+n)!=Math.round(n*1000)/1000) ok = false;
+}
+r.push(ok);
+
+result = r.every(function(x){return x;});
@@ -0,0 +1,21 @@
+// Deleting keys from an object while iterating over it with for..in
+
+var o = {a:1,b:2,c:3,d:4};
+var r1 = [];
+for (var k in o) { r1.push(k); if (k=="a") delete o.b; } // delete the next key
+
+o = {a:1,b:2,c:3};
+var r2 = [];
+for (var k in o) { r2.push(k); delete o[k]; } // delete the current key
+var emptied = Object.keys(o).length==0;
+
+o = {a:1,b:2,c:3};
+var r3 = [];
+for (var k in o) { r3.push(k); if (k=="b") delete o.c; } // delete the last key
+
+var a = [1,2,3,4];
+var r4 = [];
+for (var k in a) { r4.push(k); if (k==0) a.splice(1,1); }
+
+result = r1.join()=="a,c,d" && r2.join()=="a,b,c" && emptied &&
+         r3.join()=="a,b" && r4.join()=="0,1,2";
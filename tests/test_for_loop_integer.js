@@ -0,0 +1,21 @@
+// Simple integer for loops are run without re-parsing the condition and iterator - check they behave the same
+
+var r = [];
+for (var i=0;i<5;i++) r.push(i);
+for (var i=5;i>0;--i) r.push(i);
+for (var i=0;i<=10;i+=5) r.push(i);
+for (var i=10;i>=0;i-=4) r.push(i);
+var n = 3;
+for (var i=0;i!=n;i++) r.push(i);
+var a = [1,2,3];
+for (var i=0;i<a.length;i++) if (a.length<6) a.push(i); // limit changes
+r.push(a.length);
+for (var i=0;i<10;i++) { if (i==2) i+=0.5; r.push(i); if (i>5) break; } // becomes float
+for (var i=0;i<10;i++) { if (i%2) continue; if (i==6) n = 0; r.push(i); }
+var s = "hello";
+for (var i=0;i<s.length;i++) r.push(s[i]);
+function f(x) { var t=0; for (var j=0;j<x;j++) t+=j; return t; }
+r.push(f(10));
+for (var i=2147483640;i<2147483650;i+=5) r.push(i); // overflow into floats
+
+result = r.join(",") == "0,1,2,3,4,5,4,3,2,1,0,5,10,10,6,2,0,1,2,6,0,1,2.5,3.5,4.5,5.5,0,2,4,6,8,h,e,l,l,o,45,2147483640,2147483645";
@@ -0,0 +1,26 @@
+// Freeing big and deeply nested structures when they are no longer referenced
+var base = process.memory().usage;
+var list = undefined;
+for (var i=0;i<2000;i++) list = {v:i, next:list, arr:[i]};
+var full = process.memory().usage;
+list = undefined; // freed right away, without recursing 2000 deep
+var r1 = full > base+4000 && process.memory().usage <= base+10;
+
+// with incremental GC, freeing a big structure is spread over the idle loop
+E.setGCMode({incremental:true});
+E.getErrorFlags(); // clear flags
+var big = [];
+for (i=0;i<500;i++) big.push({n:i, s:"str"+i, a:[i,i]});
+var keep = {k:[1,2,3]};
+big = undefined;
+// we can still allocate and use memory while it is being freed
+var more = [];
+for (i=0;i<100;i++) more.push({n:i});
+var sum = 0;
+more.forEach(function(m) { sum += m.n; });
+setTimeout(function() {
+  E.setGCMode({incremental:false});
+  more = undefined;
+  result = r1 && sum==4950 && keep.k[2]==3 &&
+           process.memory().usage <= base+20 && E.getErrorFlags().length==0;
+}, 10);
@@ -0,0 +1,23 @@
+// Local variables of frequently called functions are looked up by index - check scoping still works
+
+var g = 10, r = [];
+function fact(n) { var x = n; if (x<=1) return 1; return x*fact(x-1); }
+function counter(start) {
+  var count = start;
+  return function(inc) { count += inc; return count; };
+}
+function shadow(a) { var g = a*2; return g; }
+function useGlobal(a) { return g+a; }
+function inner(a) { var b = 1; function add() { b += a; } add(); return b; }
+function obj(a, b) { var o = {a:b, b:a}; return o.a+","+o.b; }
+function loop(n) { var t = 0; for (var i=0;i<n;i++) t += i; return t+":"+i; }
+function args(a, b) { return a+(b===undefined?"u":b); }
+
+for (var k=0;k<8;k++) {
+  var c = counter(k);
+  c(1);
+  r.push([fact(5), c(2), shadow(k), useGlobal(k), inner(k), obj(k,"x"), loop(k), args(k)].join(" "));
+}
+result = g==10 &&
+  r[0]=="120 3 0 10 1 x,0 0:0 0u" &&
+  r[7]=="120 10 14 17 8 x,7 21:7 7u";
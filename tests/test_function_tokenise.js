@@ -0,0 +1,31 @@
+// Functions that are called often get their code pre-tokenised - make sure they still behave the same
+
+function f(a, b) {
+  var o = {"default":1, "if":2}; // a comment
+  var c = a + +b
+  var d = a - -b;
+  /* block comment */ var s = "str\"ing\n" + 'x';
+  var g = function(x) {
+    // nested functions stay as source code
+    return x*2;
+  };
+  if (a>b) return 1 .toString() + o["default"] + o["if"] + s.length;
+  c++
+  return JSON.stringify([c, d, s, g(a), g.toString()]);
+}
+
+var first = f(1,3);
+var results = [];
+for (var i=0;i<10;i++) results.push(f(1,3));
+
+// line breaks are kept in the tokenised code, so errors report the right line
+var tokens = f["\xFFtkn"];
+var lines = typeof tokens=="string" && tokens.split("\n").length == f["\xFFcod"].split("\n").length;
+// functions that aren't called often don't get any extra variables
+function h(x) { return x+1; }
+h(1); h(2);
+var noTokens = h["\xFFtkn"]===undefined;
+
+result = lines && noTokens && first == '[5,4,"str\\"ing\\nx",2,"function (x) {return x*2;}"]' &&
+         results.every(function(r) { return r==first; }) &&
+         f(5,3) == "1129";
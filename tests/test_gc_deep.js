@@ -0,0 +1,24 @@
+// Garbage collection shouldn't need more stack for deeply nested data
+var list = undefined;
+for (var i=0;i<1000;i++) list = {v:i, next:list};
+// lots of children, which each have children
+var wide = [];
+for (var i=0;i<100;i++) wide.push({a:{b:[i]}});
+// and a long chain of garbage with a cycle, so GC has to free it
+var junk = {};
+var j = junk;
+for (var i=0;i<500;i++) j = j.next = [i];
+j.push(junk);
+junk = j = undefined;
+
+var before = process.memory().usage; // runs a GC
+
+var n = 0;
+for (var l=list; l; l=l.next) n++;
+list = undefined;
+var after = process.memory().usage;
+
+var sum = 0;
+wide.forEach(function(w) { sum += w.a.b[0]; });
+
+result = n==1000 && after < before-2000 && sum==4950;
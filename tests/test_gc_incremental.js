@@ -0,0 +1,23 @@
+// Incremental garbage collection - see E.setGCMode
+E.setGCMode({incremental:true, sliceUs:500});
+E.getErrorFlags(); // clear flags
+
+var keep = {a:[1,2,3], s:"Hello World, this is a long string", f:function(x) { return x+1; }};
+var n = 0;
+var iv = setInterval(function() {
+  // make garbage with circular references, so only the GC can free it
+  for (var i=0;i<5;i++) {
+    var junk = {n:i, str:"Garbage "+i, arr:[i,i+1]};
+    junk.self = junk;
+  }
+  keep["k"+(n&7)] = {n:n}; // keep changing what's live while we're collecting
+  if (++n > 400) {
+    clearInterval(iv);
+    var flags = E.getErrorFlags();
+    E.setGCMode({incremental:false});
+    result = flags.indexOf("LOW_MEMORY")<0 &&
+             keep.a.length==3 && keep.a[2]==3 &&
+             keep.s=="Hello World, this is a long string" &&
+             keep.f(1)==2 && keep.k0.n<=n;
+  }
+}, 1);
@@ -0,0 +1,13 @@
+// E.getAddressOf
+var a = new Uint8Array(100); // big enough to be a flat string
+var s = "Hi";
+
+var r = [
+  E.getAddressOf(a) != 0,
+  E.getAddressOf(a, true) != 0,
+  E.getAddressOf(a, true) != E.getAddressOf(a),
+  E.getAddressOf(a, true) == E.getAddressOf(a, true),
+  E.getAddressOf(s, true) == 0, // not flat
+];
+
+result = r.every(function(x) { return x; });
@@ -0,0 +1,12 @@
+// E.getTicks() returns integer microseconds that agree with getTime()
+var t1 = E.getTicks();
+var s1 = getTime();
+var x = 0;
+for (var i=0;i<2000;i++) x+=i;
+var t2 = E.getTicks();
+var s2 = getTime();
+var us = (t2-t1)|0;
+var expected = (s2-s1)*1000000;
+
+result = typeof t1 == "number" && (t1|0)==t1 &&
+         us > 0 && Math.abs(us - expected) < 5000;
@@ -0,0 +1,36 @@
+// ArrayBuffer big enough to be a flat string (drawn via a direct pointer)
+result = true;
+function check(ok, msg) { if (!ok) { print("FAIL: "+msg); result = false; } }
+
+// 8 bit
+var g = Graphics.createArrayBuffer(32,32,8);
+g.setColor(7);
+g.fillRect(2,3,5,6);
+var a = new Uint8Array(g.buffer), sum = 0;
+for (var i in a) sum += a[i];
+check(sum == 16*7, "8bpp sum "+sum);
+check(a[3*32+2]==7 && a[6*32+5]==7 && a[6*32+6]==0, "8bpp corners");
+check(g.getPixel(4,4)==7 && g.getPixel(1,4)==0, "8bpp getPixel");
+
+// 16 bit
+g = Graphics.createArrayBuffer(16,16,16);
+g.setColor(0x1234);
+g.drawLine(0,1,15,1);
+a = new Uint8Array(g.buffer);
+check(a[32]==0x34 && a[33]==0x12 && a[62]==0x34 && a[63]==0x12 && a[64]==0, "16bpp line");
+check(g.getPixel(8,1)==0x1234 && g.getPixel(8,2)==0, "16bpp getPixel");
+g.setColor(0xFFFF);
+g.fillRect(0,0,15,15);
+a = new Uint8Array(g.buffer);
+check(a[0]==255 && a[511]==255, "16bpp fill");
+
+// 1 bit, MSB first
+g = Graphics.createArrayBuffer(64,16,1,{msb:true});
+g.fillRect(3,0,20,0);
+a = new Uint8Array(g.buffer);
+check(a[0]==0x1F && a[1]==0xFF && a[2]==0xF8 && a[3]==0, "1bpp msb fill "+a[0]+","+a[1]+","+a[2]);
+check(g.getPixel(3,0)==1 && g.getPixel(2,0)==0 && g.getPixel(21,0)==0, "1bpp getPixel");
+g.clear();
+g.setPixel(9,1);
+a = new Uint8Array(g.buffer);
+check(a[9]==0x40, "1bpp setPixel "+a[9]);
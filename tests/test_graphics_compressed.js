@@ -0,0 +1,41 @@
+// Compressed images and fonts are decoded as they're drawn - check they match the uncompressed versions
+var raw = new Uint8Array(24*20);
+for (var i in raw) raw[i] = (i>>3)*5 + ((i&7)<4 ? 0 : 200);
+var c = E.compress(raw);
+var d = E.decompress(c);
+var roundTrip = d.length==raw.length;
+for (var i in raw) if (d.charCodeAt(i)!=raw[i]) roundTrip = false;
+var smaller = c.length < raw.length;
+
+function same(a, b) {
+  var ba = new Uint8Array(a.buffer), bb = new Uint8Array(b.buffer);
+  for (var i in ba) if (ba[i]!=bb[i]) return false;
+  return true;
+}
+
+var imagesOk = true;
+for (var rot=0;rot<4;rot++) {
+  var a = Graphics.createArrayBuffer(32,32,8), b = Graphics.createArrayBuffer(32,32,8);
+  a.setRotation(rot); b.setRotation(rot);
+  a.drawImage({ width : 24, height : 20, bpp : 8, buffer : raw.buffer }, -3, 5);
+  b.drawImage({ width : 24, height : 20, bpp : 8, buffer : c, compressed : true }, -3, 5);
+  if (!same(a,b)) imagesOk = false;
+}
+// 2bpp with a palette, from a compressed ArrayBuffer
+var a = Graphics.createArrayBuffer(32,32,8), b = Graphics.createArrayBuffer(32,32,8);
+var pal = new Uint8Array([9,8,7,6]);
+a.drawImage({ width : 48, height : 40, bpp : 2, buffer : raw.buffer, palette : pal }, 2, 2);
+b.drawImage({ width : 48, height : 40, bpp : 2, buffer : E.toArrayBuffer(c), compressed : true, palette : pal }, 2, 2);
+if (!same(a,b)) imagesOk = false;
+
+// Custom font - 8px wide, 8 high, chars 'A'..'Z'
+var font = "";
+for (var i=0;i<26*8;i++) font += String.fromCharCode((i*37)&255);
+var a = Graphics.createArrayBuffer(64,16,1), b = Graphics.createArrayBuffer(64,16,1);
+a.setFontCustom(font, 65, 8, 8);
+b.setFontCustom({ buffer : E.compress(font), compressed : true }, 65, 8, 8);
+a.drawString("HELLOZ", 1, 2);
+b.drawString("HELLOZ", 1, 2);
+var fontOk = same(a,b);
+
+result = roundTrip && smaller && imagesOk && fontOk;
@@ -0,0 +1,26 @@
+// Double buffered Graphics, flushed to an SPI device on flip()
+// (an unconfigured software SPI, as we can't really send on Linux)
+var spi = Object.create(SPI.prototype);
+var windows = [], frames = 0;
+var g = Graphics.createArrayBuffer(8,8,8,{doubleBuffer:true, flush:spi, flip:function(x1,y1,x2,y2) {
+  windows.push([x1,y1,x2,y2].join(","));
+}});
+var first = new Uint8Array(g.buffer);
+function drawingInto(arr) { // is g drawing into the given buffer?
+  arr[63] = 42;
+  var r = g.getPixel(7,7)==42;
+  arr[63] = 0;
+  return r;
+}
+g.setPixel(1,1,5);
+g.flip(function() { frames++; });
+// new buffer has a copy of the frame
+var swapped = !drawingInto(first) && g.getPixel(1,1)==5;
+g.setPixel(2,2,6);
+g.flip(function() { frames++; }); // previous frame still 'sending', so this waits
+var waited = frames==0 && !drawingInto(first);
+
+setTimeout(function() {
+  result = swapped && waited && frames==2 && windows.length==2 && windows[0]=="0,0,7,7" &&
+           g.getPixel(1,1)==5 && g.getPixel(2,2)==6 && drawingInto(first);
+}, 10);
@@ -0,0 +1,39 @@
+// drawImage with palettes, clipping, rotation and transparency - checked against setPixel
+var img2 = { width : 5, height : 3, bpp : 2, transparent : 3,
+  palette : new Uint16Array([0x1111,0x2222,0x3333,0x4444]),
+  buffer : new Uint8Array([0b00011011,0b11100100,0b01101100,0b11000110]).buffer };
+var data = new Uint8Array(40*30); // big enough to be a flat string
+for (var i in data) data[i] = (i*7)&255;
+var img8 = { width : 40, height : 30, bpp : 8, palette : new Uint16Array(256).map(function(v,i){return i*3;}), buffer : data.buffer };
+
+function getPixel(img, x, y) {
+  var bit = (y*img.width + x)*img.bpp, col = 0;
+  for (var b=0;b<img.bpp;b++,bit++)
+    col = (col<<1) | ((new Uint8Array(img.buffer)[bit>>3] >> (7-(bit&7)))&1);
+  return col;
+}
+
+function reference(g, img, x, y) {
+  for (var iy=0;iy<img.height;iy++)
+    for (var ix=0;ix<img.width;ix++) {
+      var c = getPixel(img, ix, iy);
+      if (img.transparent===undefined || c!=img.transparent)
+        g.setPixel(x+ix, y+iy, img.palette[c]);
+    }
+}
+
+result = true;
+[img2, img8].forEach(function(img) {
+  for (var rot=0;rot<4;rot++) {
+    [[0,0],[-2,-1],[12,10],[30,25]].forEach(function(p) {
+      var a = Graphics.createArrayBuffer(32,32,16), b = Graphics.createArrayBuffer(32,32,16);
+      a.setRotation(rot); b.setRotation(rot);
+      a.drawImage(img, p[0], p[1]);
+      reference(b, img, p[0], p[1]);
+      if (a.buffer != b.buffer) {
+        print("FAIL: bpp "+img.bpp+" rotation "+rot+" at "+p);
+        result = false;
+      }
+    });
+  }
+});
@@ -0,0 +1,35 @@
+// Graphics.flip() reports modified areas, merging overlapping ones
+var rects = [];
+var g = Graphics.createArrayBuffer(64,64,8,{flip:function(x1,y1,x2,y2) {
+  rects.push([x1,y1,x2,y2].join(","));
+}});
+result = true;
+function check(ok, msg) { if (!ok) { print("FAIL: "+msg+" "+JSON.stringify(rects)); result = false; } rects = []; }
+
+check(g.flip()==0 && rects.length==0, "nothing modified");
+
+g.fillRect(2,2,5,5);
+g.fillRect(4,4,8,8); // overlaps the first
+g.setPixel(40,40);
+g.flip();
+rects.sort();
+check(rects.length==2 && rects[0]=="2,2,8,8" && rects[1]=="40,40,40,40", "merged");
+
+check(g.flip()==0, "reset after flip");
+
+// more separate areas than we track get merged
+for (var i=0;i<6;i++) g.setPixel(i*10,i*10);
+g.flip();
+check(rects.length==4, "limited to 4");
+
+// getModified(true) resets too
+g.setPixel(1,1);
+g.getModified(true);
+check(g.flip()==0, "getModified reset");
+
+// drawing from the flip callback is tracked for the next flip
+g = Graphics.createArrayBuffer(16,16,1,{flip:function(){ rects.push(1); this.setPixel(0,0); }});
+g.setPixel(3,3);
+g.flip();
+check(rects.length==1, "flip with draw");
+check(g.flip()==1, "draw in callback");
@@ -0,0 +1,56 @@
+// Text drawn with the whole-glyph fast path (1bpp flat buffers) should match
+// text drawn a pixel at a time (8bpp, or rotated)
+result = true;
+function check(ok, msg) { if (!ok) { print("FAIL: "+msg); result = false; } }
+
+var W = 40, H = 20;
+function draw(g) {
+  g.setFontBitmap();
+  g.drawString("Hi! {g}", 1, 1);
+  g.drawString("@#%", 29, 13); // over the edge
+  g.setFontCustom(E.toString([0xFF,0x81,0x99,0xFF]), 48, 4, 8); // '0' is a 4x8 box
+  g.drawString("00", 3, 10);
+}
+var ref = Graphics.createArrayBuffer(W,H,8);
+draw(ref);
+function compare(g, name) {
+  var bad = 0;
+  for (var y=0;y<H;y++)
+    for (var x=0;x<W;x++)
+      if ((g.getPixel(x,y)?1:0) != (ref.getPixel(x,y)?1:0)) bad++;
+  check(bad==0, name+" differs in "+bad+" pixels");
+  var m = g.getModified(), r = ref.getModified();
+  check(m.x1==r.x1 && m.y1==r.y1 && m.x2==r.x2 && m.y2==r.y2, name+" modified area "+JSON.stringify(m));
+}
+[{}, {msb:true}, {vertical_byte:true}, {vertical_byte:true, msb:true}].forEach(function(opts) {
+  var g = Graphics.createArrayBuffer(W,H,1,opts);
+  ref.getModified(true);
+  draw(ref);
+  g.getModified(true);
+  draw(g);
+  compare(g, JSON.stringify(opts));
+});
+
+// drawing with colour 0 clears pixels
+var g = Graphics.createArrayBuffer(W,H,1);
+g.fillRect(0,0,W-1,H-1);
+g.setColor(0);
+g.drawString("Hi! {g}", 1, 1);
+ref = Graphics.createArrayBuffer(W,H,8);
+ref.fillRect(0,0,W-1,H-1);
+ref.setColor(0);
+ref.drawString("Hi! {g}", 1, 1);
+compare(g, "colour 0");
+
+// rotated - falls back to drawing each pixel
+g = Graphics.createArrayBuffer(H,W,1,{vertical_byte:true});
+g.setRotation(1);
+g.drawString("Hi!", 2, 3);
+ref = Graphics.createArrayBuffer(H,W,8);
+ref.setRotation(1);
+ref.drawString("Hi!", 2, 3);
+var bad = 0;
+for (var y=0;y<W;y++)
+  for (var x=0;x<H;x++)
+    if ((g.getPixel(x,y)?1:0) != (ref.getPixel(x,y)?1:0)) bad++;
+check(bad==0, "rotated differs in "+bad+" pixels");
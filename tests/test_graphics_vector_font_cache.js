@@ -0,0 +1,25 @@
+// Vector font characters drawn from the cache match freshly rasterised ones
+result = true;
+for (var rot=0;rot<4;rot++) {
+  var a = Graphics.createArrayBuffer(64,64,1), b = Graphics.createArrayBuffer(64,64,1);
+  a.setRotation(rot); b.setRotation(rot);
+  a.setFontVector(20); b.setFontVector(20);
+  a.drawString("Ag2", 3, 5);
+  // draw into b repeatedly so later draws come from the cache
+  for (var i=0;i<3;i++) {
+    b.clear();
+    b.drawString("Ag2", 3, 5);
+  }
+  if (a.buffer != b.buffer) {
+    print("FAIL: rotation "+rot);
+    result = false;
+  }
+  // and a different size isn't confused with the cached one
+  b.clear();
+  b.setFontVector(21);
+  b.drawString("Ag2", 3, 5);
+  if (a.buffer == b.buffer) {
+    print("FAIL: size 21 matches 20, rotation "+rot);
+    result = false;
+  }
+}
@@ -0,0 +1,55 @@
+// HMAC test vectors from RFC 4231
+var hashlib = require("hashlib");
+
+function hex(s) {
+  var r = "";
+  for (var i=0;i<s.length;i++) r += (256+s.charCodeAt(i)).toString(16).substr(1);
+  return r;
+}
+function rep(s,n) { var r=""; while (n--) r+=s; return r; }
+
+var tests = [
+  [ rep("\x0b",20), "Hi There",
+    "896fb1128abbdf196832107cd49df33f47b4b1169912ba4f53684b22",
+    "b0344c61d8db38535ca8afceaf0bf12b881dc200c9833da726e9376c2e32cff7" ],
+  [ "Jefe", "what do ya want for nothing?",
+    "a30e01098bc6dbbf45690f3a7e9e6d0f8bbea2a39e6148008fd05e44",
+    "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843" ],
+  [ rep("\xaa",20), rep("\xdd",50),
+    "7fb3cb3588c6c1f6ffa9694d7d6ad2649365b0c1f65d69d1ec8333ea",
+    "773ea91e36800e46854db8ebd09181a72959098b3ef8c122d9635514ced565fe" ],
+  // key longer than the block size
+  [ rep("\xaa",131), "Test Using Larger Than Block-Size Key - Hash Key First",
+    "95e9a0db962095adaebe9b2d6f0dbce2d499f112f2d2b7273fa6870e",
+    "60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54" ]
+];
+
+result = 1;
+tests.forEach(function(t) {
+  var h = hashlib.hmac(t[0], "sha224"); h.update(t[1]);
+  result &= h.hexdigest() == t[2];
+  h = hashlib.hmac(t[0]); h.update(t[1]);
+  result &= h.hexdigest() == t[3];
+  result &= hex(h.digest()) == t[3];
+});
+
+// update in parts, and reuse with reset
+var mac = hashlib.hmac("Jefe", "sha256");
+mac.update("what do ya ");
+mac.update(E.toUint8Array("want for nothing?"));
+result &= mac.hexdigest() == tests[1][3];
+mac.reset();
+mac.update(tests[1][1]);
+result &= mac.hexdigest() == tests[1][3];
+mac.reset();
+mac.update("Hi There");
+result &= mac.hexdigest() != tests[1][3];
+
+// plain hashes can be reset too
+var h = hashlib.sha256("xyz");
+h.reset();
+h.update("abc");
+result &= h.hexdigest() == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad";
+
+try { hashlib.hmac("k", "md5"); result = 0; } catch (e) {}
+result = !!result;
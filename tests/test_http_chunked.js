@@ -0,0 +1,31 @@
+// HTTP server chunking responses with no Content-Length for HTTP/1.1 clients
+
+var result = 0;
+var http = require("http");
+var net = require("net");
+
+var server = http.createServer(function (req, res) {
+  if (req.url=="/a") {
+    res.writeHead(200, {'Content-Type': 'text/plain'});
+    res.write("Hello ");
+    res.write("");
+    res.end("World");
+  } else {
+    res.end("Done");
+  }
+});
+server.listen(8086);
+
+var data = "";
+var client = net.connect({host: "localhost", port: 8086}, function() {
+  client.write("GET /a HTTP/1.1\r\nHost: localhost\r\n\r\nGET /b HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n");
+});
+client.on('data', function(d) { data += d; });
+client.on('close', function() {
+  var responses = data.split("HTTP/1.1 200 OK\r\n");
+  result = responses.length==3 &&
+           responses[1].indexOf("Transfer-Encoding: chunked\r\nConnection: keep-alive\r\n")>=0 &&
+           responses[1].indexOf("\r\n\r\n6\r\nHello \r\n5\r\nWorld\r\n0\r\n\r\n")>=0 &&
+           responses[2].indexOf("\r\n\r\n4\r\nDone\r\n0\r\n\r\n")>=0;
+  server.close();
+});
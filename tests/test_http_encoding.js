@@ -0,0 +1,39 @@
+// HTTP server sending pre-compressed data from flash only to clients that accept it
+
+var result = 0;
+var http = require("http");
+var flash = require("Flash");
+
+var body = "Pretend this is gzipped";
+while (body.length%4) body += " ";
+var addr = flash.getFree()[0].addr;
+flash.erasePage(addr);
+flash.write(body, addr);
+
+var accepted = [];
+var server = http.createServer(function (req, res) {
+  accepted.push(req.acceptsEncoding("gzip"));
+  res.sendFlash(addr, body.length, "text/html", "gzip");
+});
+server.listen(8087);
+
+function get(acceptEncoding, callback) {
+  var opts = url.parse("http://localhost:8087/");
+  if (acceptEncoding) opts.headers = { "Accept-Encoding" : acceptEncoding };
+  http.get(opts, function(res) {
+    var data = "";
+    res.on('data', function(d) { data += d; });
+    res.on('close', function() { callback(res, data); });
+  });
+}
+
+get("deflate, GZIP;q=0.8", function(res, data) {
+  var ok = res.statusCode==200 && data==body && res.headers["Content-Encoding"]=="gzip";
+  get("gzip;q=0, deflate", function(res, data) {
+    ok = ok && res.statusCode==406 && data=="";
+    get(undefined, function(res, data) {
+      result = ok && res.statusCode==406 && accepted.join(",")=="true,false,false";
+      server.close();
+    });
+  });
+});
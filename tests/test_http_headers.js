@@ -0,0 +1,37 @@
+// HTTP server parsing request headers, and refusing ones that are too long
+
+var result = 0;
+var http = require("http");
+
+var gotHeader, bigRequestHandled = false;
+var server = http.createServer(function (req, res) {
+  if (req.url=="/big") bigRequestHandled = true;
+  gotHeader = req.headers["X-Test"];
+  res.writeHead(200, {'Content-Type': 'text/plain'});
+  res.end(req.method+" "+req.url);
+});
+server.listen(8083);
+
+var opts = url.parse("http://localhost:8083/small");
+opts.headers = { "X-Test" : "Hello" };
+http.get(opts, function(res) {
+  var data = "";
+  res.on('data', function(d) { data += d; });
+  res.on('close', function() {
+    var ok = data=="GET /small" && gotHeader=="Hello";
+    var big = "";
+    for (var i=0;i<300;i++) big += "0123456789";
+    opts = url.parse("http://localhost:8083/big");
+    opts.headers = { "X-Test" : big };
+    var req = http.get(opts, function(res) {
+      res.on('close', function() {
+        result = ok && !bigRequestHandled;
+        server.close();
+      });
+    });
+    req.on('error', function() {
+      result = ok && !bigRequestHandled;
+      server.close();
+    });
+  });
+});
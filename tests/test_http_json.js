@@ -0,0 +1,23 @@
+// HTTP server streaming a big object as JSON a chunk at a time
+
+var result = 0;
+var http = require("http");
+
+var status = { name : "test", fn : function() {}, list : [] };
+for (var i=0;i<100;i++) status.list.push({ id : i, text : "Item number "+i });
+
+var server = http.createServer(function (req, res) {
+  res.json(status);
+});
+server.listen(8089);
+
+http.get("http://localhost:8089/", function(res) {
+  var data = "";
+  res.on('data', function(d) { data += d; });
+  res.on('close', function() {
+    result = res.statusCode==200 && res.headers["Content-Type"]=="application/json" &&
+             res.headers["Content-Length"]==data.length &&
+             data==JSON.stringify(status) && JSON.parse(data).list[99].id==99;
+    server.close();
+  });
+});
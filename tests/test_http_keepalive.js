@@ -0,0 +1,32 @@
+// HTTP server keeping a connection open for several (pipelined) requests
+
+var result = 0;
+var http = require("http");
+var net = require("net");
+
+var urls = [];
+var server = http.createServer(function (req, res) {
+  urls.push(req.url);
+  var body = "Page "+req.url;
+  res.writeHead(200, {'Content-Type': 'text/plain', 'Content-Length': body.length});
+  res.end(body);
+});
+server.listen(8084);
+
+var data = "", sentLast = false;
+var client = net.connect({host: "localhost", port: 8084}, function() {
+  client.write("GET /a HTTP/1.1\r\nHost: localhost\r\n\r\nGET /b HTTP/1.1\r\nHost: localhost\r\n\r\n");
+});
+client.on('data', function(d) {
+  data += d;
+  if (!sentLast && data.indexOf("Page /b")>=0) {
+    sentLast = true;
+    client.write("GET /c HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n");
+  }
+});
+client.on('close', function() {
+  result = urls.join(",")=="/a,/b,/c" &&
+           data.indexOf("Connection: keep-alive")>=0 &&
+           data.indexOf("Page /a")>=0 && data.indexOf("Page /c")>=0;
+  server.close();
+});
@@ -0,0 +1,23 @@
+// HTTP server sending a response much bigger than one network chunk
+
+var result = 0;
+var http = require("http");
+
+var body = "";
+for (var i=0;i<400;i++) body += "Line "+i+"\n";
+
+var server = http.createServer(function (req, res) {
+  res.writeHead(200, {'Content-Type': 'text/plain'});
+  res.write(body.substr(0,1000));
+  res.end(body.substr(1000));
+});
+server.listen(8081);
+
+http.get("http://localhost:8081/", function(res) {
+  var data = "";
+  res.on('data', function(d) { data += d; });
+  res.on('close', function() {
+    result = data==body;
+    server.close();
+  });
+});
@@ -0,0 +1,42 @@
+// httpCRs.pause/resume - no 'data' events (or receiving) while paused
+
+var result = 0;
+var http = require("http");
+
+var chunk = "";
+for (var i=0;i<64;i++) chunk += "0123456789abcdef";
+var CHUNKS = 40;
+var server = http.createServer(function (req, res) {
+  var n = 0;
+  res.writeHead(200, {"Content-Length" : CHUNKS*chunk.length});
+  function send() {
+    if (n++ < CHUNKS) res.write(chunk);
+    else { res.removeAllListeners("drain"); res.end(); }
+  }
+  res.on("drain", send);
+  send();
+});
+server.listen(8092);
+
+var received = 0, receivedWhilePaused = 0, paused = false, memPaused;
+http.get("http://localhost:8092/", function(res) {
+  res.on('data', function(d) {
+    received += d.length;
+    if (paused) receivedWhilePaused += d.length;
+    if (received > 4000 && !memPaused) {
+      res.pause();
+      paused = true;
+      memPaused = process.memory().usage;
+      setTimeout(function() {
+        // nothing should have built up in memory while we were paused
+        memPaused = process.memory().usage - memPaused;
+        paused = false;
+        res.resume();
+      }, 300);
+    }
+  });
+  res.on('close', function() {
+    server.close();
+    result = received==CHUNKS*chunk.length && receivedWhilePaused==0 && memPaused < 100;
+  });
+});
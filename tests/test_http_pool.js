@@ -0,0 +1,46 @@
+// HTTP client reusing a kept-alive connection for several requests to the same server
+
+var result = 0;
+var http = require("http");
+var net = require("net");
+
+var connections = 0, requests = [];
+var server = net.createServer(function (c) {
+  connections++;
+  var data = "";
+  c.on('data', function(d) {
+    data += d;
+    var end;
+    while ((end = data.indexOf("\r\n\r\n")) >= 0) {
+      requests.push(data.substr(0, end));
+      data = data.substr(end+4);
+      var close = requests[requests.length-1].indexOf("Connection: close")>=0;
+      c.write("HTTP/1.0 200 OK\r\nConnection: "+(close?"close":"keep-alive")+"\r\nContent-Length: 4\r\n\r\nOK"+requests.length+"!");
+      if (close) c.end();
+    }
+  });
+});
+server.listen(8085);
+
+var bodies = [];
+function get(n, keepAlive) {
+  http.request({host:"localhost", port:8085, path:"/"+n, method:"GET", keepAlive:keepAlive}, function(res) {
+    var body = "";
+    res.on('data', function(d) { body += d; });
+    res.on('close', function() {
+      bodies.push(body);
+      if (n<3) get(n+1, n<2);
+      else done();
+    });
+  }).end();
+}
+get(0, true);
+
+function done() {
+  result = connections==2 &&
+           bodies.join(",")=="OK1!,OK2!,OK3!,OK4!" &&
+           requests[0].indexOf("Connection: keep-alive")>=0 &&
+           requests[3].indexOf("Connection: close")>=0;
+  if (!result) console.log(connections, bodies, requests);
+  server.close();
+}
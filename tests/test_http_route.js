@@ -0,0 +1,55 @@
+// httpSrv.route - requests handled natively by path, with lazy req.path/req.query
+
+var result = 0;
+var http = require("http");
+var flash = require("Flash");
+
+var page = "<html>Hello</html>";
+while (page.length%4) page += " ";
+var addr = flash.getFree()[0].addr;
+flash.erasePage(addr);
+flash.write(page, addr);
+
+var fallback = [];
+var server = http.createServer(function (req, res) {
+  fallback.push(req.url);
+  res.end("fallback");
+});
+server.route("GET", "/", { addr : addr, len : page.length, type : "text/html" })
+  .route("GET", "/api", function (req, res) {
+    var q = req.query;
+    res.end(req.path+":"+q.a+":"+q.b);
+  })
+  .route("*", "/any/", function (req, res) {
+    res.end("any "+req.method);
+  });
+server.listen(8090);
+
+var tests = [
+  ["/", page],
+  ["/api/x?a=1&b=hello%20there", "/api/x:1:hello there"],
+  ["/api", "/api:undefined:undefined"],
+  ["/apix", "fallback"], // not under /api
+  ["/any/thing", "any GET"],
+  ["/other", "fallback"],
+  ["/any/", "any GET"],
+];
+var results = [];
+function next() {
+  if (!tests.length) {
+    server.close();
+    result = results.every(function(r) { return r; }) &&
+             fallback.length==2 && fallback[0]=="/apix";
+    return;
+  }
+  var t = tests.shift();
+  http.get("http://localhost:8090"+t[0], function(res) {
+    var data = "";
+    res.on('data', function(d) { data += d; });
+    res.on('close', function() {
+      results.push(data==t[1]);
+      next();
+    });
+  });
+}
+next();
@@ -0,0 +1,26 @@
+// HTTP server streaming a response straight out of flash memory
+
+var result = 0;
+var http = require("http");
+var flash = require("Flash");
+
+var body = "";
+for (var i=0;i<300;i++) body += "Line "+i+"\n";
+while (body.length%4) body += " ";
+var addr = flash.getFree()[0].addr;
+flash.erasePage(addr);
+flash.write(body, addr);
+
+var server = http.createServer(function (req, res) {
+  res.sendFlash(addr, body.length, "text/plain");
+});
+server.listen(8082);
+
+http.get("http://localhost:8082/", function(res) {
+  var data = "";
+  res.on('data', function(d) { data += d; });
+  res.on('close', function() {
+    result = data==body && res.headers["Content-Length"]==body.length;
+    server.close();
+  });
+});
@@ -0,0 +1,21 @@
+// Long property names share the rest of their characters between all
+// objects that use them
+
+var a = [];
+for (var i=0;i<20;i++) a.push({description:i, anotherLongName:i*2});
+var o = a[5];
+delete o.description;
+a[6]["description"] = "x";
+var c = JSON.parse(JSON.stringify(a[7]));
+var keys = [];
+for (var k in a[8]) keys.push(k);
+var copy = Object.assign ? Object.assign({}, a[9]) : a[9];
+
+result = a[10].description==10 && a[10].anotherLongName==20 &&
+  JSON.stringify(o)=='{"anotherLongName":10}' &&
+  a[6].description=="x" &&
+  c.description==7 && c.anotherLongName==14 &&
+  keys.join()=="description,anotherLongName" &&
+  copy.anotherLongName==18 &&
+  "description" in a[11] && !("descriptioN" in a[11]) &&
+  a[12].hasOwnProperty("anotherLongName");
@@ -0,0 +1,18 @@
+// Cloning an object with a long property name shares the rest of the name
+// between the copies. With 8 bit refcounts (VARIABLES<=1023) that string
+// can't take a reference for every clone, so copies after that get their own.
+
+var o = {aVeryLongKeyName:1};
+var a = [];
+for (var i=0;i<260;i++) a.push(o.clone());
+var ok = a.length==260;
+for (i=0;i<a.length;i++)
+  ok = ok && a[i].aVeryLongKeyName==1 && Object.keys(a[i]).join()=="aVeryLongKeyName";
+a = undefined;
+
+// names freed by the garbage collector (they're in a loop) must release the shared string too
+function make() { var x = {aVeryLongKeyName:2}; x.self = x; return x.self.aVeryLongKeyName; }
+for (i=0;i<300;i++) ok = ok && make()==2;
+process.memory();
+
+result = ok && o.clone().aVeryLongKeyName==1;
@@ -0,0 +1,18 @@
+// JSON.parse without the JS parser
+
+var r = [];
+var o = JSON.parse(' { "a" : [1, -2, 3.5, 1e3, true, false, null], "b" : { "c" : "x\\"y\\n\\u0041" }, "5":[] } ');
+r.push(JSON.stringify(o)=='{"a":[1,-2,3.5,1000,true,false,null],"b":{"c":"x\\"y\\nA"},"5":[]}');
+r.push(o[5].length===0 && o.b.c.length==5);
+r.push(JSON.parse("42")===42 && JSON.parse('"hi"')=="hi" && JSON.parse("[]").length===0);
+// from an ArrayBuffer, and a view part way into one
+var u = E.toUint8Array('xx{"a":1}yy');
+r.push(JSON.parse(new Uint8Array(u.buffer, 2, 7)).a===1);
+r.push(JSON.parse(E.toUint8Array('[1,2]'))[1]===2);
+// errors
+["", "{", "[1", '{"a" 1}', "tru", "1 2", "{a:1}"].forEach(function(s) {
+  var failed = false;
+  try { JSON.parse(s); } catch (e) { failed = e instanceof SyntaxError; }
+  r.push(failed);
+});
+result = r.every(function(x){return x;});
@@ -0,0 +1,15 @@
+// Lexing code from a flat string (like code run from flash), and checking
+// identifier/number/whitespace handling in the lexer's fast path
+
+var code = "var $a_1 = 0x1F + 0b101 + 1.5e1 + .5;\t\r\n" +
+           "// comment\n/* block\n comment */ var _b = $a_1 * 2;\x0B\x0C _b + 1e-1";
+var flat = E.toString(code);
+var r = [
+  eval(code) == 103.1,
+  eval(flat) == 103.1,
+  E.getSizeOf(flat)>0,
+  eval("1234567890123") == 1234567890123,
+  eval("\xA0 42 \xA0") == 42
+];
+
+result = r.every(function(x) { return x; });
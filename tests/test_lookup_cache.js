@@ -0,0 +1,19 @@
+// Property lookups are cached - make sure the cache is invalidated when properties change
+
+var o = {state:1, topic:"a"};
+var r = [];
+for (var i=0;i<3;i++) r.push(o.state);
+delete o.state;
+r.push(o.state);
+o.state = 2;
+r.push(o.state);
+o = {state:3};
+r.push(o.state);
+var p = Object.create({state:4});
+r.push(p.state);
+p.state = 5;
+r.push(p.state);
+
+var m = process.memory();
+result = JSON.stringify(r)=="[1,1,1,null,2,3,4,5]" &&
+         m.lookupHits>0 && m.lookupMisses>0;
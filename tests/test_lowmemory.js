@@ -0,0 +1,12 @@
+// E.on('lowMemory') fired (once) when free vars drop below the threshold
+var calls = 0, freeVars;
+E.setLowMemoryThreshold(process.memory().free-50);
+E.on('lowMemory', function(f) { calls++; freeVars = f; });
+var a = [];
+for (var i=0;i<300;i++) a.push(i);
+setTimeout(function() {
+  for (var i=0;i<300;i++) a.push(i);
+  setTimeout(function() {
+    result = calls==1 && freeVars>0;
+  }, 10);
+}, 10);
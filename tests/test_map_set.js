@@ -0,0 +1,67 @@
+// Map and Set
+var r = [];
+
+var m = new Map();
+r.push(m.size===0);
+r.push(m.set("a",1)===m);
+m.set(1,"int").set("1","str");
+r.push(m.get("a")===1 && m.get(1)==="int" && m.get("1")==="str");
+r.push(m.size===3);
+var o = {}, o2 = {};
+m.set(o,"obj");
+r.push(m.get(o)==="obj" && m.get(o2)===undefined && m.has(o) && !m.has(o2));
+m.set(NaN,"nan");
+r.push(m.get(NaN)==="nan");
+m.set(-0,"zero");
+r.push(m.get(0)==="zero" && 1/m.keys()[5]===Infinity);
+m.set(1.0,"int2"); // same key as 1
+r.push(m.get(1)==="int2" && m.size===6);
+r.push(m.delete("1") && !m.delete("1") && !m.has("1") && m.size===5);
+r.push(JSON.stringify(m.keys().slice(0,2))=='["a",1]');
+r.push(JSON.stringify(m.entries()[0])=='["a",1]');
+m.set(undefined, "u");
+r.push(m.has(undefined) && m.get(undefined)==="u" && !m.has(null));
+
+// lots of entries, and deleting some of them
+var big = new Map();
+for (var i=0;i<300;i++) big.set("k"+i, i);
+for (var i=0;i<300;i+=2) big.delete("k"+i);
+var ok = big.size===150;
+for (var i=0;i<300;i++) if (big.get("k"+i) !== (i&1 ? i : undefined)) ok = false;
+r.push(ok);
+r.push(big.keys()[0]==="k1" && big.values()[149]===299);
+
+// forEach, including deleting entries as we go
+var seen = [];
+var fm = new Map([["a",1],["b",2],["c",3],["d",4]]);
+fm.forEach(function(v,k,map) {
+  seen.push(k+v);
+  if (k=="a") map.delete("b");
+  if (k=="c") map.set("e",5);
+});
+r.push(seen.join(",")=="a1,c3,d4,e5");
+fm.clear();
+r.push(fm.size===0 && fm.get("a")===undefined);
+fm.set("x",1);
+r.push(fm.get("x")===1 && fm.size===1);
+
+// Set
+var s = new Set([1,"1",2,2,1]);
+r.push(s.size===3 && s.has(1) && s.has("1") && !s.has(3));
+r.push(s.add(3)===s && s.size===4);
+r.push(s.delete(2) && !s.has(2) && s.size===3);
+r.push(JSON.stringify(s.values())=='[1,"1",3]');
+var sum = 0;
+s.forEach(function(v,v2,set) { if (v===v2 && set===s) sum += +v; });
+r.push(sum===5);
+
+// the table is rebuilt after vars are moved by defragmenting
+var d = new Set();
+for (var i=0;i<50;i++) { d.add("d"+i); var junk = [1,2,3]; }
+junk = undefined;
+E.defrag();
+ok = true;
+for (var i=0;i<50;i++) if (!d.has("d"+i)) ok = false;
+r.push(ok && !d.has("d50"));
+
+result = r.every(function(x){return x;});
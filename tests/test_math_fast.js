@@ -0,0 +1,38 @@
+// Math functions should be accurate whether or not FAST_MATH is used
+var ok = true;
+function near(a, b, msg) {
+  if (!(Math.abs(a-b) <= 1E-9*Math.max(1,Math.abs(b)))) {
+    console.log(msg, a, "!=", b);
+    ok = false;
+  }
+}
+for (var x=-20;x<=20;x+=0.37) {
+  near(Math.sin(x), Math.sin(x+2*Math.PI), "sin period "+x);
+  near(Math.sin(x)*Math.sin(x) + Math.cos(x)*Math.cos(x), 1, "sin^2+cos^2 "+x);
+  near(Math.atan(Math.tan(x/20)), x/20, "atan "+x);
+  near(Math.log(Math.exp(x)), x, "log(exp) "+x);
+  near(Math.sqrt(x*x), Math.abs(x), "sqrt "+x);
+  near(Math.atan2(Math.sin(x), Math.cos(x)), x - 2*Math.PI*Math.round(x/(2*Math.PI)), "atan2 "+x);
+}
+near(Math.sin(Math.PI/6), 0.5, "sin(PI/6)");
+near(Math.exp(1), Math.E, "exp(1)");
+near(Math.log(10), Math.LN10, "log(10)");
+near(Math.sqrt(2), Math.SQRT2, "sqrt(2)");
+near(Math.atan2(1,-1), 3*Math.PI/4, "atan2(1,-1)");
+near(Math.atan2(-1,-1), -3*Math.PI/4, "atan2(-1,-1)");
+ok = ok && Math.atan2(0,-1)==Math.PI && Math.atan2(1,0)==Math.PI/2;
+ok = ok && isNaN(Math.sqrt(-1)) && isNaN(Math.log(-1)) && Math.log(0)==-Infinity;
+ok = ok && Math.exp(-Infinity)==0 && Math.exp(1000)==Infinity && isNaN(Math.sin(Infinity));
+
+// integer square root
+ok = ok && Math.isqrt(0)==0 && Math.isqrt(-5)==0 && Math.isqrt(15)==3 && Math.isqrt(16)==4;
+ok = ok && Math.isqrt(2147483647)==46340;
+for (var i=0;i<2000;i+=7) { var r = Math.isqrt(i); if (r*r>i || (r+1)*(r+1)<=i) ok = false; }
+
+// fixed point sine
+ok = ok && E.fixedSin(0)==0 && E.fixedSin(16384)==32767 && E.fixedSin(32768)==0 && E.fixedSin(49152)==-32767;
+ok = ok && E.fixedSin(65536+16384)==32767 && E.fixedSin(-16384)==-32767;
+for (var a=0;a<65536;a+=97)
+  if (Math.abs(E.fixedSin(a) - 32767*Math.sin(a*Math.PI/32768)) > 1.5) { console.log("fixedSin", a); ok = false; }
+
+result = ok;
@@ -0,0 +1,21 @@
+// Check the fast path for maths on plain numbers gives the same results as the general one
+
+var a = 7, b = 2, f = 2.5, o = {x:3, y:1.5}, arr = [4, 0.5];
+var r = [
+  a+b, a-b, a*b, a/b, a%b, a%0, a&b, a|b, a^b, a<<b, a>>b, -a>>>28,
+  a+f, a-f, a*f, a/f, a%f, f+o.y, o.x*arr[0], arr[1]+arr[0], o.x-a,
+  a<b, a<=7, a>b, a>=8, a==7, a!=7, a===7.0, a!==7, f==2.5, f<a,
+  2147483647+1, -2147483648-1, 65536*65536
+];
+var expected = [
+  9, 5, 14, 3.5, 1, NaN, 2, 7, 5, 28, 1, 15,
+  9.5, 4.5, 17.5, 2.8, 2, 4, 12, 4.5, -4,
+  false, true, true, false, true, false, true, false, true, true,
+  2147483648, -2147483649, 4294967296
+];
+result = r.length == expected.length;
+for (var i=0;i<r.length;i++)
+  if (!(r[i]===expected[i] || (isNaN(r[i]) && isNaN(expected[i])))) {
+    console.log(i, r[i], expected[i]);
+    result = false;
+  }
@@ -0,0 +1,11 @@
+// E.getMemoryMap fragmentation and type counts
+var before = E.getMemoryMap();
+var f = E.toString(new Uint8Array(400));
+var after = E.getMemoryMap();
+var runs = after.freeRuns.reduce(function(a,b) { return a+b; }, 0);
+
+result = before.freeRuns.length==8 &&
+  after.largestFree<=after.free && runs>0 &&
+  after.types.flatString > before.types.flatString &&
+  after.free < before.free &&
+  after.locked > 0;
@@ -0,0 +1,20 @@
+// Modules stored in flash with Modules.addFlash are loaded by require
+var s = require("Storage");
+s.eraseAll();
+
+var ok = Modules.addFlash("flashmod", "// a counter\nvar count = 0;\nexports.inc = function(a) {\n  count += a; // add\n  return count;\n};\nexports.name = 'flashmod';\n");
+var m = require("flashmod");
+var r1 = ok && m.inc(2)==2 && m.inc(3)==5 && m.name=="flashmod";
+// stored without comments
+var r2 = s.read("flashmod").indexOf("a counter")<0;
+// require caches the module...
+var r3 = require("flashmod")===m;
+// ...until it is replaced
+Modules.addFlash("flashmod", "exports.name = 'v2';");
+var r4 = require("flashmod").name=="v2";
+// code written with Storage.write works too
+s.write("plainmod", "exports.x = 42;");
+var r5 = require("plainmod").x==42;
+
+result = r1 && r2 && r3 && r4 && r5;
+s.eraseAll();
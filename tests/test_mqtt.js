@@ -0,0 +1,53 @@
+// Native MQTT client talking to a tiny fake broker
+
+var result = 0;
+var net = require("net");
+
+var brokerGot = [];
+var server = net.createServer(function(c) {
+  var buf = "";
+  c.on("data", function(d) {
+    buf += d;
+    // packets here are all short, so the length is always one byte
+    while (buf.length>=2 && buf.length>=2+buf.charCodeAt(1)) {
+      var type = buf.charCodeAt(0)>>4, qos = (buf.charCodeAt(0)>>1)&3;
+      var body = buf.substr(2, buf.charCodeAt(1));
+      buf = buf.substr(2+body.length);
+      brokerGot.push(type);
+      if (type==1) { // CONNECT
+        brokerGot.push(body.substr(2,4), body.substr(12));
+        c.write("\x20\x02\x00\x00");
+      }
+      if (type==8) c.write("\x90\x03"+body.substr(0,2)+"\x00"); // SUBSCRIBE -> SUBACK
+      if (type==3) { // PUBLISH -> echo it back, and PUBACK if QoS 1
+        var topicLen = 2+body.charCodeAt(1);
+        if (qos) c.write("\x40\x02"+body.substr(topicLen,2));
+        c.write(String.fromCharCode(0x30)+String.fromCharCode(topicLen+body.length-topicLen-(qos?2:0))+
+                body.substr(0,topicLen)+body.substr(topicLen+(qos?2:0)));
+      }
+      if (type==14) c.end(); // DISCONNECT
+    }
+  });
+});
+server.listen(8090);
+
+var connected = false, got = [], inFlight;
+var mqtt = require("mqtt").connect("mqtt://localhost:8090", { clientId : "test" });
+mqtt.on("connect", function() {
+  connected = true;
+  mqtt.subscribe("a/#");
+  mqtt.publish("a/b", "Hello");
+  mqtt.publish("a/c", "World", { qos : 1 });
+});
+mqtt.on("message", function(topic, msg) {
+  got.push(topic+"="+msg);
+  if (got.length==2) {
+    inFlight = Object.keys(mqtt.mqIf).length; // the QoS 1 message should have been acknowledged
+    mqtt.end();
+  }
+});
+mqtt.on("close", function() {
+  result = connected && got.join(",")=="a/b=Hello,a/c=World" && inFlight===0 &&
+           brokerGot.join(",")=="1,MQTT,test,8,3,3,14";
+  server.close();
+});
@@ -0,0 +1,18 @@
+// Socket.setNoDelay - data written is sent straight away
+var net = require("net");
+var received = "";
+var server = net.createServer(function(c) {
+  c.setNoDelay();
+  c.write("a");
+  c.write("b");
+  c.end();
+});
+server.listen(40123);
+var client = net.connect({host: "localhost", port: 40123}, function() {
+  client.setNoDelay(true);
+  client.on('data', function(d) { received += d; });
+  client.on('close', function() {
+    server.close();
+    result = received=="ab";
+  });
+});
@@ -0,0 +1,68 @@
+// NetworkJS driver using sendAll/NetworkJS.receive, looping sockets back to each other
+var NetworkJS = require("NetworkJS");
+var servers = {}; // port -> server socket
+var pending = {}; // server socket -> array of sockets waiting for accept
+var peer = {}; // socket -> socket at the other end
+var nextSckt = 1;
+var sendAllCalls = 0, perSocketCalls = 0;
+
+NetworkJS.create({
+  create : function(host, port) {
+    var s = nextSckt++;
+    if (host===undefined) {
+      servers[port] = s;
+      pending[s] = [];
+    } else {
+      var srv = servers[port];
+      if (srv===undefined) return -1;
+      var other = nextSckt++;
+      peer[s] = other;
+      peer[other] = s;
+      pending[srv].push(other);
+    }
+    return s;
+  },
+  close : function(sckt) {
+    var other = peer[sckt];
+    delete peer[sckt];
+    if (other!==undefined && peer[other]!==undefined)
+      setTimeout(function() { NetworkJS.receive(other); }, 1);
+  },
+  accept : function(sckt) {
+    var p = pending[sckt];
+    return (p && p.length) ? p.shift() : -1;
+  },
+  recv : function() { perSocketCalls++; return ""; },
+  send : function(s, d) { perSocketCalls++; return d.length; },
+  sendAll : function(data) {
+    sendAllCalls++;
+    setTimeout(function() {
+      for (var s in data)
+        if (peer[s]!==undefined) NetworkJS.receive(peer[s], E.toUint8Array(data[s]));
+    }, 1);
+  }
+});
+
+var big = "";
+for (var i=0;i<100;i++) big += "0123456789";
+
+var server = require("net").createServer(function(c) {
+  c.on('data', function(d) { c.write(d); }); // echo
+  c.on('end', function() { server.close(); });
+});
+server.listen(1234);
+
+var received = "";
+var client = require("net").connect({host:"127.0.0.1", port:1234}, function() {
+  client.write(big);
+  client.write("ab");
+  client.on('data', function(d) {
+    received += d;
+    if (received.length==big.length+2) client.end();
+  });
+});
+
+setTimeout(function() {
+  result = received==big+"ab" && perSocketCalls==0 && sendAllCalls>0 && sendAllCalls<20;
+  if (!result) print(received.length, perSocketCalls, sendAllCalls);
+}, 1000);
@@ -0,0 +1,16 @@
+// Object.values and Object.entries
+
+var o = {x:1, y:"hello", z:[2]};
+var v = Object.values(o);
+var e = Object.entries(o);
+
+function F() { this.a = 1; }
+F.prototype.b = 2;
+
+result = JSON.stringify(v)=='[1,"hello",[2]]' &&
+         JSON.stringify(e)=='[["x",1],["y","hello"],["z",[2]]]' &&
+         e[2][1]===o.z &&
+         JSON.stringify(Object.values([4,5]))=="[4,5]" &&
+         JSON.stringify(Object.entries(new F()))=='[["a",1]]' &&
+         Object.values({}).length==0 &&
+         Object.keys({p:1,q:2,r:3}).join()=="p,q,r";
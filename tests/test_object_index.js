@@ -0,0 +1,29 @@
+// Large objects get a hashed index of their children - check it stays correct
+
+var o = {};
+var i, ok = true;
+for (i=0;i<100;i++) o["k"+i] = i;
+for (i=0;i<100;i++) if (o["k"+i]!==i) ok = false;
+// delete half of them, and re-add some
+for (i=0;i<100;i+=2) delete o["k"+i];
+for (i=0;i<100;i++) if (o["k"+i]!==((i&1)?i:undefined)) ok = false;
+for (i=0;i<50;i+=4) o["k"+i] = -i;
+for (i=0;i<100;i++) {
+  var expected = (i&1) ? i : ((i<50 && !(i&3)) ? -i : undefined);
+  if (o["k"+i]!==expected) ok = false;
+}
+// the index should be invisible
+var keys = Object.keys(o);
+var hidden = keys.filter(function(k) { return k[0]!="k"; }).length;
+var str = JSON.stringify(o);
+// make sure objects made from this one don't share the index
+var p = JSON.parse(str);
+p.k1 = "p";
+delete p.k3;
+var c = o.clone();
+c.k5 = "c";
+delete c.k7;
+
+result = ok && hidden==0 && keys.length==63 && str.indexOf("idx")<0 &&
+         p.k1=="p" && o.k1==1 && p.k3===undefined && o.k3==3 && "k5" in o && !("k2" in o) &&
+         c.k5=="c" && o.k5==5 && c.k7===undefined && o.k7==7 && c.k9==9;
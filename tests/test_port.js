@@ -0,0 +1,13 @@
+// E.createPort - pin values can't be read back on Linux, so just check the API
+var p = E.createPort([D1,D2,D3]);
+p.write(5);
+digitalWrite(p, 2);
+shiftOut(p, { clk : D4 }, [1,7]);
+
+var err = 0;
+try { E.createPort(5); } catch (e) { err++; }
+var many = [];
+for (var i=0;i<33;i++) many.push(D1);
+try { E.createPort(many); } catch (e) { err++; }
+
+result = (p instanceof Port) && err==2;
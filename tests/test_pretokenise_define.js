@@ -0,0 +1,39 @@
+// Functions defined with E.setFlags({pretokenise:true}) are stored tokenised,
+// but still run and print correctly
+
+E.setFlags({pretokenise:true});
+function a(x, y) {
+  // a comment that shouldn't be stored
+  var s = "if (x) { return 'y' }"; /* neither should this */
+  if (x >= y && !(x === y)) return typeof x + " " + s;
+  for (var i=0;i<3;i++) x += i;
+  return x - --y;
+}
+var b = function(n) { return n instanceof Array ? n.length : -n; };
+// regexes can contain anything (like the UTF-8 for '°', which is 0xC2 0xB0)
+function c(x) { var t = x/2, u = 10 / t; return /°[^/]\/x/g.test("°a/x") && u==5; }
+function d() { return function(x) { return /°/.test(x); }; }
+var f = function(x) { return x && `°`; }; // not run - we don't handle templates yet
+E.setFlags({pretokenise:false});
+var e = d(); // defined from pre-tokenised code, but after pretokenise was turned off
+
+var r = [
+  a(5,2)=="number if (x) { return 'y' }",
+  a(1,2)==(1+3-1),
+  b([1,2,3])==3,
+  b(4)==-4,
+  // printed text should parse back to something that works the same
+  eval("("+a.toString()+")")(5,2)==a(5,2),
+  eval("("+a.toString()+")")(1,2)==a(1,2),
+  eval("("+b.toString()+")")(4)==-4,
+  a.toString().indexOf("comment")<0,
+  a.toString().indexOf("x- --y")>0 || a.toString().indexOf("x - --y")>0,
+  E.dumpStr().indexOf("instanceof Array")>0,
+  c(4) && eval("("+c.toString()+")")(4),
+  c.toString().indexOf('/°[^/]\\/x/g.test("°a/x")')>0,
+  e("°") && e.toString()=="function (x) {return /°/.test(x);}",
+  f.toString()=="function (x) {return x&&`°`;}",
+  (function(x){return /°/.test(x);}).toString()=="function (x) {return /°/.test(x);}"
+];
+
+result = r.every(function(x) { return x; });
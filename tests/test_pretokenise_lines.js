@@ -0,0 +1,9 @@
+// Pretokenised code keeps its line breaks, so errors still report the right line
+var src = "function (a) {\n  var g = function(x) {\n    return x*2;\n  };\n\n  return g(a);\n}";
+var plain = eval("("+src+")");
+E.setFlags({pretokenise:true});
+var tokenised = eval("("+src+")");
+E.setFlags({pretokenise:false});
+
+result = plain(3)==6 && tokenised(3)==6 &&
+         tokenised.toString().split("\n").length == plain.toString().split("\n").length;
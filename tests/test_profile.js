@@ -0,0 +1,13 @@
+// E.startProfile/stopProfile should attribute samples to the busy function
+function busy() {
+  var s = 0;
+  for (var i=0;i<20000;i++) s += i;
+  return s;
+}
+
+E.startProfile(2000);
+busy();
+var p = E.stopProfile();
+
+result = p.samples>0 && p.lines.length>0 &&
+         p.lines[0].name=="busy" && p.lines[0].count>0;
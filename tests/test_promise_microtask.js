@@ -0,0 +1,28 @@
+// Promise callbacks run as microtasks - before any other queued events or timers
+var order = [];
+
+setTimeout(function() { order.push("timeout"); }, 0);
+Promise.resolve(1).then(function(v) { order.push("then"+v); });
+order.push("sync");
+
+// resolving twice only calls .then once, with the first value
+var twice = 0, twiceValue;
+new Promise(function(res) { res("a"); res("b"); }).then(function(v) { twice++; twiceValue=v; });
+
+// .then added after a promise has already been handled still gets called
+var late;
+var p = Promise.resolve("late");
+p.then(function() {
+  p.then(function(v) { late = v; order.push("late"); });
+});
+
+// promises resolved from a timer are handled before the next timer
+setTimeout(function() {
+  Promise.resolve().then(function() { order.push("timer1 then"); });
+}, 5);
+setTimeout(function() { order.push("timer2"); }, 5);
+
+setTimeout(function() {
+  result = order.join(",")=="sync,then1,late,timeout,timer1 then,timer2" &&
+           twice==1 && twiceValue=="a" && late=="late";
+}, 50);
@@ -0,0 +1,48 @@
+// RegExp literals, exec/test, String.match/replace
+var r = [];
+r.push(/ab+c/.test("xxabbbcx"), !/ab+c/.test("xxacx"));
+r.push(JSON.stringify(/(\d+)-(\d+)/.exec("Ranges 10-20 now"))=='["10-20","10","20"]');
+r.push(/(\d+)-(\d+)/.exec("Ranges 10-20 now").index==7);
+r.push(/x/.exec("abc")===null);
+r.push("a1b22c333".match(/\d+/g).join()=="1,22,333", "abc".match(/\d/g)===null);
+r.push("Hello World".replace(/o/g, "0")=="Hell0 W0rld", "Hello".replace(/l/, "L")=="HeLlo");
+r.push("John Smith".replace(/(\w+)\s(\w+)/, "$2, $1")=="Smith, John");
+r.push("abc".replace(/b/, function(m){return m.toUpperCase()+"!";})=="aB!c");
+r.push("aBc".replace(/b/i, "[$&]")=="a[B]c", "a$b".replace(/\$/, "$$")=="a$b");
+r.push(/^abc$/i.test("ABC"), !/^abc$/.test("ABC"), !/a.c/.test("a\nc"));
+r.push(/colou?r/.test("color") && /colou?r/.test("colour"));
+r.push(/a{2,3}/.exec("caaaab")[0]=="aaa", /a{2}/.exec("caaaab")[0]=="aa", /ba{2,}/.exec("baaaa")[0]=="baaaa");
+r.push(/a+?/.exec("aaa")[0]=="a", /a*?b/.exec("aaab")[0]=="aaab", /<.*?>/.exec("<a><b>")[0]=="<a>");
+r.push(/[^a-c]+/.exec("abcdefabc")[0]=="def", /[\d.]+/.exec("v1.25x")[0]=="1.25", /[\/]/.test("a/b"));
+r.push(/\bfoo\b/.test("a foo b"), !/\bfoo\b/.test("afoob"), /\Boo/.test("foo"));
+r.push(JSON.stringify(/(a|ab)(c|bcd)(d*)/.exec("abcd"))=='["abcd","a","bcd",""]');
+r.push(/(a)|(b)/.exec("b")[1]===undefined, /(?:ab)+/.exec("ababx")[0]=="abab", /(?:ab)+/.exec("ababx").length==1);
+r.push("line1\nline2".match(/^line\d$/gm).join()=="line1,line2", "line1\nline2".match(/^line\d$/g)===null);
+var re = /o/g, s = "foo boo", m, idx = [];
+while ((m = re.exec(s)) !== null) idx.push(m.index);
+r.push(idx.join()=="1,2,5,6" && re.lastIndex==0);
+r.push("aaa".match(/x*/g).length==4);
+// regexes and division
+var a = 4, b = 2;
+r.push(a/b==2, 10/2/5==1, (a)/b==2, [8][0]/b==4);
+function f(x) { return /^\d+$/.test(x) ? x/2 : -1; }
+r.push(f("10")==5, f("1a")==-1);
+// constructor
+r.push(new RegExp("[a-z]+", "gi").flags=="gi", new RegExp("a.c").source=="a.c", new RegExp(/x/g).flags=="g");
+r.push("x+y".match("\\+").index==1);
+var err = 0;
+try { new RegExp("(ab"); } catch (e) { err++; }
+try { new RegExp("a**"); } catch (e) { err++; }
+try { new RegExp("a", "q"); } catch (e) { err++; }
+r.push(err==3);
+// long strings don't backtrack
+var big = ""; for (var i=0;i<500;i++) big += "ab";
+r.push(/(a|b)*c/.test(big+"c"), !/(a|b)*c/.test(big), /(a*)*b/.test(big));
+// split
+r.push("a,b;;c".split(/[,;]+/).join("|")=="a|b|c", "abc".split(/(?:)/).join("|")=="a|b|c");
+r.push("".split(/x/).length==1, "".split(/(?:)/).length==0, ",a,".split(/,/).join("|")=="|a|");
+var s = "a1b".split(/(x)?(\d)/);
+r.push(s.length==4 && s[0]=="a" && s[1]===undefined && s[2]=="1" && s[3]=="b");
+
+result = r.every(function(x){return x;});
+if (!result) print(r);
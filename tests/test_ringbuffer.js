@@ -0,0 +1,35 @@
+// E.RingBuffer
+var r = [];
+var b = E.RingBuffer(Float32Array, 4);
+r.push(b.length==0 && b.shift()===undefined && b.get(0)===undefined);
+r.push(b.push(1)==1 && b.push(2.5)==2 && b.length==2);
+r.push(b.get(0)==1 && b.get(1)==2.5 && b.get(-1)==2.5 && b.get(2)===undefined);
+b.push(3); b.push(4); b.push(5); // overwrites 1
+r.push(b.length==4 && b.get(0)==2.5 && b.get(3)==5);
+var a = b.toArray();
+r.push(a instanceof Float32Array && a.length==4 && a.join()=="2.5,3,4,5");
+r.push(E.sum(b)==14.5 && E.variance(b, 3.625)==E.variance(a, 3.625));
+r.push(b.shift()==2.5 && b.length==3 && b.toArray().join()=="3,4,5");
+b.clear();
+r.push(b.length==0 && b.toArray().length==0 && E.sum(b)==0);
+
+// values are stored with the typed array's type
+var c = E.RingBuffer(Int16Array, 3);
+c.push(1.7); c.push(-40000);
+r.push(c.get(0)==1 && c.get(1)==25536 && c.toArray() instanceof Int16Array);
+
+// big enough to be stored in a flat string, and wrapped around
+var d = E.RingBuffer(Int16Array, 100);
+var s = 0;
+for (var i=0;i<250;i++) d.push(i);
+for (var i=150;i<250;i++) s+=i;
+r.push(d.length==100 && d.get(0)==150 && d.get(99)==249 && E.sum(d)==s);
+a = d.toArray();
+r.push(a.length==100 && a[0]==150 && a[50]==200 && a[99]==249 && E.sum(a)==s);
+
+var err = 0;
+try { E.RingBuffer(Object, 3); } catch (e) { err++; }
+try { E.RingBuffer(Float32Array, 0); } catch (e) { err++; }
+r.push(err==2);
+
+result = r.every(function(x){return x;});
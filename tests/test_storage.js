@@ -0,0 +1,34 @@
+// Key/value storage in free flash
+var s = require("Storage");
+s.eraseAll();
+
+s.write("a", "Hello");
+s.write("b", [1,2,3]);
+s.write("a", "World");
+var r1 = s.read("a")=="World" && s.read("b")=="\1\2\3" && s.read("c")===undefined;
+var r2 = s.list().sort().join(",")=="a,b";
+var r3 = s.erase("b") && !s.erase("b") && s.read("b")===undefined;
+
+// overwrite enough times that the log must be compacted
+var big = "";
+for (var i=0;i<100;i++) big += "0123456789";
+for (var i=0;i<100;i++) s.write("big", big+i);
+var stats = s.getStats();
+var r4 = s.read("big")==big+"99" && s.read("a")=="World" &&
+         stats.keys==2 && stats.trashBytes < stats.totalBytes;
+
+// writing the same data again shouldn't use any space
+var free = s.getStats().freeBytes;
+s.write("a", "World");
+var r5 = s.getStats().freeBytes==free;
+
+s.compact();
+var r6 = s.getStats().trashBytes==0 && s.read("big")==big+"99";
+
+// the longest allowed key
+var longKey = ""; while (longKey.length<64) longKey += "k";
+s.write(longKey, "hello");
+var r7 = s.read(longKey)=="hello" && s.list().indexOf(longKey)>=0 && s.erase(longKey);
+s.eraseAll();
+
+result = r1 && r2 && r3 && r4 && r5 && r6 && r7;
@@ -0,0 +1,55 @@
+// Socket.setFraming - one 'data' event per complete frame
+var net = require("net");
+var results = {};
+
+// each connection gets sent the data for one framing mode, in pieces
+var sends = [
+  ["ab", "c\r\nde", "f\r\n\r\n", "gh"],          // delimiter
+  ["\x00\x03x", "yz\x00", "\x01", "w\x00\x00"],  // lengthPrefix u16be
+  ["123", "45"],                                 // idleTimeout only
+];
+var framings = [
+  {delimiter:"\r\n"},
+  {lengthPrefix:"u16be"},
+  {idleTimeout:100},
+];
+var server = net.createServer(function(c) {
+  c.on('data', function(d) {
+    var pieces = sends[d];
+    var i = 0;
+    function next() {
+      if (i<pieces.length) {
+        c.write(pieces[i++]);
+        setTimeout(next, 20);
+      } else setTimeout(function() { c.end(); }, 300);
+    }
+    next();
+  });
+});
+server.listen(40124);
+
+function test(n) {
+  var frames = [];
+  var client = net.connect({host: "localhost", port: 40124}, function() {
+    if (n==0) try {
+      client.setFraming({delimiter:"\r\n", length:4});
+      results.badOptions = "no error";
+    } catch (e) {}
+    client.setFraming(framings[n]);
+    client.on('data', function(d) { frames.push(d); });
+    client.write(n);
+  });
+  client.on('close', function() {
+    results[n] = JSON.stringify(frames);
+    if (n+1<sends.length) test(n+1);
+    else {
+      server.close();
+      result = !results.badOptions &&
+               results[0]=='["abc","def",""]' && // "gh" has no delimiter
+               results[1]=='["xyz","w",""]' &&
+               results[2]=='["12345"]';
+      if (!result) print(results);
+    }
+  });
+}
+test(0);
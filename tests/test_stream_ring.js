@@ -0,0 +1,29 @@
+// Data received with no 'data' listener is buffered, and can be read a bit at a time
+var net = require("net");
+function chunk(from, n) {
+  var s = "";
+  for (var i=from;i<from+n;i++) s += String.fromCharCode(65+i%26);
+  return s;
+}
+var expected = chunk(0,600);
+var got = "";
+var conn;
+var server = net.createServer(function(c) {
+  conn = c;
+  c.write(chunk(0,300));
+});
+server.listen(40126);
+var client = net.connect({host: "localhost", port: 40126}, function() {
+  setTimeout(function() {
+    got += client.read(100);
+    // the ring buffer now has to wrap around to fit this
+    conn.write(chunk(300,300));
+    setTimeout(function() {
+      var avail = client.available();
+      while (client.available()) got += client.read(7);
+      conn.end();
+      server.close();
+      result = avail==500 && got==expected && client.read()=="";
+    }, 200);
+  }, 200);
+});
@@ -0,0 +1,30 @@
+// Appending to strings repeatedly, switching between strings, and after they're freed
+var r = [];
+var s = "";
+for (var i=0;i<500;i++) s += "X";
+r.push(s.length==500 && s[0]=="X" && s[499]=="X");
+
+var a = "", b = "";
+for (i=0;i<200;i++) { a += "a"+i; b += i; a += ","; }
+r.push(a.split(",").length==201 && a.substr(0,6)=="a0,a1," && a.substr(-5)=="a199,");
+r.push(b.length==490 && b.substr(-3)=="199");
+
+var c = s; // a second reference means += makes a new string
+c += "Y";
+r.push(s.length==500 && c.length==501 && c[500]=="Y");
+s += "Z";
+r.push(s.length==501 && s[500]=="Z");
+
+s = undefined;
+var d = "";
+for (i=0;i<300;i++) d += String.fromCharCode(65+(i%26));
+r.push(d.length==300 && d[26]=="A" && d[299]==String.fromCharCode(65+(299%26)));
+r.push(E.toString(d)==d && d.indexOf("XYZ")==23);
+
+// appending a string to itself
+var e = "ab";
+for (i=0;i<5;i++) e += e;
+r.push(e.length==64 && e.substr(-4)=="abab");
+
+result = r.every(function(x){return x;});
+if (!result) print(r);
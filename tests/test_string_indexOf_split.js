@@ -0,0 +1,22 @@
+// String search with indexOf/split/replace, on normal and flat strings
+var r = [];
+var s = "";
+for (var i=0;i<100;i++) s += "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n";
+s += "\r\nbody\r\n";
+var f = E.toString(s);
+[s,f].forEach(function(s) {
+  r.push(s.indexOf("\r\n\r\n")==4298, s.indexOf("body")==4302, s.indexOf("H")==0);
+  r.push(s.indexOf("Content-Type: text/html")==-1, s.indexOf("plain\r\nHTTP", 100)==43*2+36);
+  r.push(s.indexOf("OK", 16)==43+13, s.indexOf("", 5)==5, s.indexOf("body\r\n!")==-1);
+  r.push(s.split("\r\n").length==203, s.split("\r\n")[201]=="body", s.split("\r\n")[202]=="");
+  r.push(s.replace("200 OK","404").substr(0,14)=="HTTP/1.1 404\r\n");
+});
+r.push("aaab".indexOf("aab")==1, "abcabd".indexOf("abd")==3, "abc".indexOf("abcd")==-1);
+r.push("a,b,,c".split(",").join("|")=="a|b||c", ",".split(",").length==2, "abc".split("").join("|")=="a|b|c");
+r.push("".split("").length==0, "".split(",").length==1, "abc".split("abc").join("|")=="|");
+r.push("x-y-z".split("-",undefined).length==3, "1234".indexOf(3)==2);
+var long = ""; for (i=0;i<80;i++) long += String.fromCharCode(48+(i%40));
+r.push((s+long+"end").indexOf(long)==s.length, s.indexOf(long)==-1);
+
+result = r.every(function(x){return x;});
+if (!result) print(r);
@@ -0,0 +1,50 @@
+// Seeking into and getting the length of long strings, which remember where they have seeked to
+var results = [];
+function test(a,b) { results.push(a===b); if (a!==b) print("FAIL",a,"!==",b); }
+
+var s = "", ref = [];
+for (var i=0;i<300;i++) { s += String.fromCharCode(33+(i%90)); ref.push(33+(i%90)); }
+test(s.length, 300);
+var ok = true;
+for (i=0;i<300;i++) if (s.charCodeAt(i)!=ref[i]) ok = false;
+// backwards too
+for (i=299;i>=0;i-=3) if (s.charCodeAt(i)!=ref[i]) ok = false;
+test(ok, true);
+test(s.substr(250,5), String.fromCharCode(33+70,33+71,33+72,33+73,33+74));
+// appending after seeking
+s.charCodeAt(290);
+s += "END";
+test(s.length, 303);
+test(s.substr(298), String.fromCharCode(33+28,33+29)+"END");
+test(s.indexOf("END", 10), 300);
+// strings that are freed and replaced shouldn't use stale positions
+for (var j=0;j<5;j++) {
+  var t = "";
+  for (i=0;i<100+j*37;i++) t += "x";
+  t += "y";
+  test(t.charCodeAt(t.length-1), 121);
+  test(t.length, 101+j*37);
+  t = undefined;
+}
+var a = "", b = "";
+for (i=0;i<200;i++) { a += "a"; b += "b"; }
+a.charCodeAt(150); b.charCodeAt(190);
+test(a[199]+b[199], "ab");
+E.defrag();
+test(a.length+b.length, 400);
+test(a[150]+b[190], "ab");
+
+// lengths are remembered for more strings than there are hints for
+var strs = [];
+for (j=0;j<6;j++) {
+  var t = "";
+  for (i=0;i<60+j*10;i++) t += "ab";
+  strs.push(t.substr(j));
+}
+for (var k=0;k<3;k++)
+  for (j=0;j<6;j++) test(strs[j].length, 120+j*20-j);
+strs[2] += "xyz";
+test(strs[2].length, 160-2+3);
+test(strs[2].substr(-4), "bxyz");
+
+result = results.every(function(r){return r;});
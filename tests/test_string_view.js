@@ -0,0 +1,47 @@
+// Substrings of flat strings are views onto the original string's data
+
+var big = E.toString((function(){var a=[];for(var i=0;i<512;i++)a.push(97+i%26);return a;})());
+var r = [];
+
+var s = big.substr(10,100);
+r.push(s.length==100 && s.substr(0,3)=="klm" && s==big.substring(10,110) && s==big.slice(10,110));
+// views of views
+var t = s.substr(20,50);
+r.push(t.length==50 && t.substr(0,3)=="efg");
+// appending doesn't modify the original
+var u = s;
+u += "!";
+r.push(u.length==101 && s.length==100 && big.charAt(110)=="g");
+// writing via an ArrayBuffer doesn't modify the original
+var a = new Uint8Array(E.toArrayBuffer(s));
+a[0] = 65;
+r.push(a[0]==65 && s.charAt(0)=="k" && big.charAt(10)=="k");
+// using a view as a property name
+var o = {};
+o[s] = 1;
+o[big.substr(36,100)]++;
+r.push(Object.keys(o).length==1 && o[s]==2);
+// views still work after the original has been freed
+big = undefined;
+process.memory();
+r.push(s.substr(0,5)=="klmno" && t.substr(-3)=="zab");
+// writing to the original via an ArrayBuffer doesn't modify views of it
+var flat = E.toString((function(){var a=[];for(var i=0;i<200;i++)a.push(65+i%26);return a;})());
+var v = flat.substr(0,60), w = v.substr(1,40);
+var fa = new Uint8Array(E.toArrayBuffer(flat));
+fa[0] = 72; fa[1] = 72;
+r.push(flat.substr(0,3)=="HHC" && v.substr(0,3)=="ABC" && v.length==60 && w.substr(0,2)=="BC" && w.length==40);
+flat = fa = undefined;
+process.memory();
+r.push(v.substr(58)=="GH" && (v+"!").length==61);
+// or substrings taken after it has been shared with an ArrayBuffer
+flat = E.toString((function(){var a=[];for(var i=0;i<200;i++)a.push(65+i%26);return a;})());
+fa = new Uint8Array(E.toArrayBuffer(flat));
+v = flat.substr(0,60);
+fa[0] = 72;
+r.push(flat.charAt(0)=="H" && v.charAt(0)=="A");
+// splitting
+var parts = E.toString((function(){var a=[];for(var i=0;i<300;i++)a.push(i==150?44:65);return a;})()).split(",");
+r.push(parts.length==2 && parts[0].length==150 && parts[1].length==149);
+
+result = r.every(function(x){return x;});
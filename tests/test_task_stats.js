@@ -0,0 +1,15 @@
+// E.getTaskStats should record how long each callback took
+
+E.getTaskStats(true);
+var n = 0;
+var iv = setInterval(function busy() {
+  for (var i=0;i<500;i++);
+  if (++n==3) clearInterval(iv);
+}, 10);
+setTimeout(function() {
+  var stats = E.getTaskStats(true);
+  var busy = stats.filter(function(s) { return s.name=="busy"; })[0];
+  result = busy && busy.type=="timer" && busy.calls==3 &&
+           busy.max>0 && busy.total>=busy.max &&
+           E.getTaskStats().length==0;
+}, 200);
@@ -0,0 +1,11 @@
+// Timers with slack should be run together in the same wakeup
+
+E.setTimerSlack(50);
+var a,b;
+setTimeout(function() { a=getTime(); }, 100);
+setTimeout(function() { b=getTime(); }, 130);
+E.setTimerSlack(0);
+setTimeout(function() {
+  result = a && b && Math.abs(a-b)<0.01 && // run together
+           b-a >= 0; // in order
+}, 300);
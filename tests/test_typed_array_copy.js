@@ -0,0 +1,33 @@
+// Copying data into and out of typed arrays - small arrays are stored in normal
+// strings, bigger ones in flat strings (which use memcpy/memset)
+var r = [];
+[4, 200].forEach(function(n) {
+  var a = new Uint8Array(n);
+  a.set("Hi", 1);
+  r.push(a[0]==0 && a[1]==72 && a[2]==105 && a[3]==0);
+  // overlapping copy within the same buffer
+  for (var i=0;i<n;i++) a[i]=i;
+  a.set(new Uint8Array(a.buffer, 0, 2), 1);
+  r.push(a[0]==0 && a[1]==0 && a[2]==1 && a[3]==3);
+
+  // slice returns the same type of array
+  var f = new Float32Array(n);
+  f.fill(1.5, 1, 3);
+  var s = f.slice(0, 4);
+  r.push(s instanceof Float32Array && s.join()=="0,1.5,1.5,0");
+  r.push(f.slice(-2).length==2 && f.slice(3,1).length==0 && f.slice(0).length==n);
+
+  var i16 = new Int16Array(n);
+  i16.fill(-2);
+  r.push(i16[0]==-2 && i16[n-1]==-2);
+  // same-size integer types keep the same bits, clamped arrays clamp
+  r.push(new Uint16Array(i16)[n-1]==65534);
+  var i8 = new Int8Array(n);
+  i8.fill(-5);
+  r.push(new Uint8Array(i8)[0]==251 && new Uint8ClampedArray(i8)[0]==0);
+  r.push(new Float32Array(i16)[0]==-2);
+});
+
+r.push(E.toString(E.toUint8Array("ab", [99, 100], {data:"e", count:2}, new Uint8Array([102]))) == "abcdeef");
+
+result = r.every(function(x){return x;});
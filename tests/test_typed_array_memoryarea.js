@@ -0,0 +1,29 @@
+// Typed arrays can view E.memoryArea (flash) directly without copying it into RAM
+var flash = require("Flash");
+var addr = flash.getFree()[0].addr;
+flash.erasePage(addr);
+flash.write(new Uint8Array([1,0,2,0,3,0,0xFF,0xFF,0,0,128,63]), addr);
+
+var mem = E.memoryArea(addr, 12);
+var u16 = new Uint16Array(mem);
+var r1 = u16.length==6 && u16[0]==1 && u16[1]==2 && u16[2]==3 && u16[3]==65535;
+var i16 = new Int16Array(mem, 6, 1);
+var r2 = i16.length==1 && i16[0]==-1;
+// unaligned offset into flash
+var u8 = new Uint8Array(mem, 1);
+var r3 = u8.length==11 && u8[1]==2;
+var f32 = new Float32Array(mem, 8);
+var r4 = f32.length==1 && f32[0]==1;
+// iteration, join and copying out all work
+var r5 = u16.join(",")=="1,2,3,65535,0,16256" && new Uint16Array(u16)[2]==3 &&
+         E.sum(new Uint8Array(mem, 0, 6))==6;
+// it references flash rather than copying it
+var view = new Uint8Array(E.memoryArea(addr+12, 4));
+flash.write(new Uint8Array([9,8,7,6]), addr+12);
+var r6 = view[0]==9 && view[3]==6;
+// writes are ignored - the view is read-only
+u16[0] = 1234;
+u16.fill(7);
+var r7 = u16[0]==1 && u16[1]==2 && new Uint8Array(flash.read(2, addr))[0]==1;
+
+result = r1 && r2 && r3 && r4 && r5 && r6 && r7;
@@ -0,0 +1,37 @@
+// Native WebSocket server and client talking to each other
+
+var result = 0;
+var http = require("http");
+
+var big = "";
+for (var i=0;i<30;i++) big += "0123456789";
+
+var server = http.createServer(function (req, res) {
+  res.end("Not a WebSocket");
+});
+var serverGot = [], serverUrl;
+server.on("websocket", function(ws, req) {
+  serverUrl = req.url;
+  ws.on("message", function(msg) {
+    serverGot.push(msg.length);
+    ws.send("Echo:"+msg);
+  });
+});
+server.listen(8088);
+
+var got = [], opened = false;
+var ws = http.connectWebSocket("ws://localhost:8088/chat", function() {
+  opened = true;
+  ws.send("Hello");
+  ws.send(big);
+});
+ws.on("message", function(msg) {
+  got.push(msg);
+  if (got.length==2) ws.close();
+});
+ws.on("close", function() {
+  result = opened && serverUrl=="/chat" &&
+           got[0]=="Echo:Hello" && got[1]=="Echo:"+big &&
+           serverGot.join(",")=="5,300";
+  server.close();
+});